@@ -13,6 +13,17 @@ then
     exit 0
 fi
 
+# Under the unified (v2) hierarchy, Faasm creates its own per-function groups
+# under this one, so it just needs to own it
+if [ -f /sys/fs/cgroup/cgroup.controllers ];
+then
+    echo "Setting up cgroup v2 group faasm for ${CGROUP_USER}"
+    echo "+cpu +memory" > /sys/fs/cgroup/cgroup.subtree_control
+    mkdir -p /sys/fs/cgroup/faasm
+    chown -R ${CGROUP_USER}:${CGROUP_USER} /sys/fs/cgroup/faasm
+    exit 0
+fi
+
 echo "Setting up cgroup ${CGROUP} for ${CGROUP_USER}"
 
 cgcreate -t ${CGROUP_USER}:${CGROUP_USER} -a ${CGROUP_USER}:${CGROUP_USER} -g ${CGROUP}
\ No newline at end of file
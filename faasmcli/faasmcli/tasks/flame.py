@@ -12,9 +12,18 @@ FLAME_GRAPH_DIR = join(WORK_DIR, "FlameGraph")
 
 
 @task(default=True)
-def general(ctx, user, func, cmd=None, data=None, reverse=False):
+def general(
+    ctx,
+    user,
+    func,
+    cmd=None,
+    data=None,
+    batch=None,
+    input_file=None,
+    reverse=False,
+):
     """
-    Generates a flame graph for the given function
+    Generates a flame graph for the given function, optionally run as a batch
     """
     print("Generating flame graph for {}/{}".format(user, func))
 
@@ -30,7 +39,14 @@ def general(ctx, user, func, cmd=None, data=None, reverse=False):
     # Set up the command to be perf'd
     if not cmd:
         func_runner_bin = find_command("func_runner")
-        cmd = " ".join([func_runner_bin, user, func, data if data else ""])
+        cmd = [func_runner_bin, user, func]
+        if data:
+            cmd.append("--input-data '{}'".format(data))
+        if batch:
+            cmd.append("--batch-size {}".format(batch))
+        if input_file:
+            cmd.append("--input-file {}".format(input_file))
+        cmd = " ".join(cmd)
 
     # Set up main perf command
     perf_cmd = ["perf", "record", "-k 1", "-F 99", "-g", cmd]
@@ -1,12 +1,26 @@
 #pragma once
 
 #include <conf/FaasmConfig.h>
+#include <storage/CodegenManifest.h>
 #include <storage/FileLoader.h>
 
 #include <cstdint>
+#include <string>
+#include <vector>
 
 namespace codegen {
 
+// Outcome of generating machine code for a single function or shared object
+// as part of a batch
+struct CodegenResult
+{
+    std::string name;
+    bool success = false;
+    bool skipped = false;
+    long timeMs = 0;
+    std::string error;
+};
+
 class MachineCodeGenerator
 {
   public:
@@ -14,16 +28,46 @@ class MachineCodeGenerator
 
     MachineCodeGenerator(storage::FileLoader& loaderIn);
 
-    void codegenForFunction(faabric::Message& msg, bool clean = false);
+    // Returns false if codegen was skipped because the input was unchanged.
+    // These check against, and update, the relevant codegen manifest.
+    bool codegenForFunction(faabric::Message& msg, bool clean = false);
 
-    void codegenForSharedObject(const std::string& inputPath,
+    bool codegenForSharedObject(const std::string& inputPath,
                                 bool clean = false);
 
+    // Links the given shared libraries into the function's wasm, replacing
+    // its stored wasm, then generates machine code for the result. The
+    // libraries' paths must be under the runtime root on this host. Only
+    // supported with WAVM.
+    void prelinkFunction(faabric::Message& msg,
+                         const std::vector<std::string>& libPaths);
+
+    // Whether the function's stored wasm is the given wasm, and its machine
+    // code was generated from it with the current settings, i.e. uploading
+    // the wasm again would change nothing
+    bool isFunctionUpToDate(const faabric::Message& msg,
+                            const std::vector<uint8_t>& wasmBytes);
+
+    // Variants that check against a manifest entry the caller has already
+    // looked up, and set the entry to record if codegen runs. The caller is
+    // responsible for updating the manifest, which lets a batch fetch and
+    // upload each manifest only once.
+    bool codegenForFunction(faabric::Message& msg,
+                            bool clean,
+                            const storage::CodegenManifestEntry& oldEntry,
+                            storage::CodegenManifestEntry& newEntry);
+
+    bool codegenForSharedObject(const std::string& inputPath,
+                                bool clean,
+                                const storage::CodegenManifestEntry& oldEntry,
+                                storage::CodegenManifestEntry& newEntry);
+
   private:
     conf::FaasmConfig& conf;
     storage::FileLoader& loader;
 
-    std::vector<uint8_t> hashBytes(const std::vector<uint8_t>& bytes);
+    storage::CodegenManifestEntry getManifestEntry(
+      const std::vector<uint8_t>& bytes);
 
     std::vector<uint8_t> doCodegen(std::vector<uint8_t>& bytes);
 };
@@ -31,4 +75,21 @@ class MachineCodeGenerator
 MachineCodeGenerator& getMachineCodeGenerator();
 
 MachineCodeGenerator& getMachineCodeGenerator(storage::FileLoader& loaderIn);
+
+// Batch codegen runs on a pool of threads, each of which pulls the next item
+// off a shared queue, so long-running items don't hold up the rest of the
+// batch. If the number of threads is zero, we use all usable cores. Results
+// are returned in the same order as the inputs. Each codegen manifest is
+// fetched once before the batch starts and uploaded once at the end.
+std::vector<CodegenResult> codegenForFunctions(
+  std::vector<faabric::Message>& msgs,
+  bool clean = false,
+  int nThreads = 0);
+
+std::vector<CodegenResult> codegenForSharedObjects(
+  const std::vector<std::string>& paths,
+  bool clean = false,
+  int nThreads = 0);
+
+void printCodegenResults(const std::vector<CodegenResult>& results);
 }
@@ -9,29 +9,275 @@ class FaasmConfig
     std::string hostType;
 
     std::string cgroupMode;
+
+    // Whether Faaslet threads share one cgroup ("host"), or get one per user
+    // ("user") or per function ("function")
+    std::string cgroupGranularity;
+
+    // CPU weight of each per-user or per-function cgroup, 100 being the
+    // kernel's default, and the share of a core each can use, zero meaning no
+    // limit
+    int cgroupCpuWeight;
+    int cgroupCpuMaxPercent;
+
+    // Memory limit for the whole base cgroup under cgroup v2, zero meaning no
+    // limit
+    int cgroupMemoryMaxMb;
+
     std::string netNsMode;
     int maxNetNs;
 
+    // How long claims wait for a network namespace when there are none left,
+    // zero failing straight away
+    int netNsClaimTimeoutMs;
+
+    // Egress rates for namespaces as tc rates, e.g. 100mbit. The default
+    // applies to all users without their own entry in the comma-separated
+    // user=rate list. Empty leaves the rates the namespaces were created with.
+    std::string netNsEgressRate;
+    std::string netNsTenantEgressRates;
+
+    // Idle keep-alive connections the host HTTP client keeps per tenant and
+    // backend, and how long they're kept for
+    int httpMaxIdleConnections;
+    int httpIdleTimeoutMs;
+
+    // Longest a name looked up for a function is cached for, whatever its DNS
+    // TTL. Zero turns off caching.
+    int dnsCacheMaxTtlSecs;
+
+    // Bytes of buffer in each IPC channel between co-located Faaslets
+    int ipcChannelSize;
+
+    // How executor threads are pinned to CPUs, either "off", "compact" (fill
+    // one NUMA node first) or "scatter" (spread across nodes)
+    std::string affinityPolicy;
+
+    // Port the worker serves Prometheus metrics on, zero meaning not at all
+    int metricsPort;
+
     std::string pythonPreload;
+
+    // Faaslets created for the Python runtime when preloading it
+    int pythonPreloadFaaslets;
+
+    // Python functions get their own zygote, snapshotted after the runtime
+    // has imported the function's module
+    std::string pythonImportZygote;
+
+    // Python keeps the bytecode it compiles in a directory of the runtime
+    // root, so it survives between instances on this host
+    std::string pythonBytecodeCache;
+
     std::string captureStdout;
 
+    // Captured stdout beyond this drops its oldest bytes
+    int captureStdoutMaxBytes;
+
+    // Comma-separated list of user/function pairs, hottest first
+    std::string prewarmFunctions;
+    int prewarmThreads;
+
+    // Function uploads and their codegen run on this many workers, with at
+    // most this many waiting, beyond which uploads are turned away
+    int uploadWorkers;
+    int uploadQueueSize;
+
     int chainedCallTimeout;
 
+    // Outputs of chained calls of at least this many bytes, whose caller is
+    // on the same host, are handed over in shared memory that the caller maps
+    // into its own. Zero turns this off.
+    int chainedShmOutputThreshold;
+
+    // Longest a single call may run for before it's stopped, zero means calls
+    // are only stopped once the caller has stopped waiting for them
+    int execTimeoutMs;
+
+    // Functions exporting a batch handler are only reset after this many
+    // successful calls. One or less resets after every call, as usual.
+    int batchResetInterval;
+
+    // Comma-separated list of idempotent user/function pairs, whose results
+    // are cached keyed on their input, up to the budget on each host. If
+    // shared, results are also kept in state for other hosts.
+    std::string resultCacheFunctions;
+    int resultCacheBudgetMb;
+    std::string resultCacheShared;
+
+    // If on, memory is pushed to the destination host in the background as
+    // soon as a migration is pending, and only the pages dirtied since are
+    // sent at the migration point
+    std::string migrationPrecopy;
+
+    // If on, zero pages are left out when pushing snapshots for migration
+    std::string migrationElideZeroPages;
+
+    // If "cost", MPI apps only act on pending migrations that are expected to
+    // pay for moving their memory at the given bandwidth, rather than always
+    std::string migrationPolicy;
+    int migrationBandwidthMbps;
+
+    // Minimum time between checkpoints to S3 taken at migration points, off if
+    // zero. If restore is on, calls resume from their function's latest one.
+    int checkpointPeriodSecs;
+    std::string checkpointRestore;
+
+    // Values written and read through the sharded state calls are split into
+    // shards of this size, each read from one of this many replicas
+    int stateShardKb;
+    int stateShardReplicas;
+
+    // If set, state values that have a shared file at state/<user>/<key> are
+    // read from that file, cached a chunk at a time in this local directory,
+    // rather than held in memory
+    std::string stateDiskDir;
+
+    // Memory budget for local replicas of state mastered on other hosts, over
+    // which the least recently used are dropped. Zero means no budget.
+    int stateReplicaBudgetMb;
+
     std::string wasmVm;
 
+    // Comma-separated list of LLVM CPU targets, best first, that WAVM machine
+    // code is also generated for. Hosts use the best one they support.
+    std::string codegenTargets;
+
+    // Size in bytes of the wasm stack of WAMR execution environments. The
+    // comma-separated user/function=size list overrides it per function.
+    int wamrStackSize;
+    std::string wamrFunctionStackSizes;
+
+    // Memory budget for cached modules, zero means unlimited
+    int moduleCacheBudgetMb;
+
+    // How WAVM modules are reset between calls, either "remap" (map the whole
+    // reset snapshot) or "dirty" (only restore pages dirtied since last reset)
+    std::string resetMode;
+
+    // If on, modules bound from the cache map their initial memory
+    // copy-on-write from the function's reset snapshot, so all instances of a
+    // function on a host share the pages they don't write to
+    std::string sharedZygoteMemory;
+
+    // If on, pages of read-only data segments are kept once per function on
+    // a host, and mapped copy-on-write into each module
+    std::string sharedReadOnlyData;
+
+    // If on, reset snapshots are kept in a host-wide store of pages keyed on
+    // their contents, so pages that are the same across functions (e.g. the
+    // Python runtime's) are only kept once
+    std::string snapshotPageDedup;
+
+    // Number of spare, already-reset modules each Faaslet keeps, so that
+    // resets happen off the critical path. Zero resets synchronously.
+    int resetPoolSize;
+
+    // Number of compartments each cached WAVM zygote keeps cloned ahead of
+    // time, so that resets don't have to clone their own. Zero turns it off.
+    int compartmentPoolSize;
+
+    // New Faaslets are only created while the host has at least this much
+    // memory available. Zero doesn't check.
+    int faasletMinFreeMemMb;
+
+    // Creations waiting for room before more are rejected, and how long each
+    // waits before it is
+    int faasletAdmissionQueue;
+    int faasletAdmissionTimeoutMs;
+
+    // If on, linear memory is advised to use transparent huge pages
+    std::string hugePages;
+
+    // Pthreads are dispatched in batches of this size as soon as they're
+    // created, rather than all together on the first join. Zero keeps them
+    // until the first join.
+    int pthreadDispatchBatch;
+
+    // If on, OpenMP teams that fit on this host run on a pool of persistent
+    // threads, rather than going through the scheduler
+    std::string ompLocalTeams;
+
+    // If set, per-thread OpenMP time breakdowns are appended to this file as
+    // JSON lines whenever a function or OpenMP thread finishes
+    std::string ompProfileFile;
+
+    // MPI messages of at least this many bytes between ranks on the same
+    // host are copied straight from the sender's memory. Zero turns this off.
+    int mpiRendezvousThreshold;
+
+    // If on, ranks on the same host combine their data for broadcasts and
+    // reductions in shared memory, and only one rank per host sends it on
+    std::string mpiShmCollectives;
+
+    // If set, per-rank MPI communication breakdowns are appended to this file
+    // as JSON lines whenever an MPI function finishes
+    std::string mpiProfileFile;
+
+    // If set, WAVM functions' call stacks are sampled this many times a
+    // second of CPU time, and appended to a file of folded stacks per
+    // function in this directory
+    std::string wasmProfileDir;
+    int wasmProfileHz;
+
+    // Percentage of calls sampled when profiling, so profiles can be
+    // collected from a fraction of live traffic
+    int wasmProfilePercent;
+
+    // If on, each call's hardware performance counters (instructions, cycles,
+    // cache and TLB misses, context switches) are attached to its result
+    std::string perfCounters;
+
     std::string functionDir;
     std::string objectFileDir;
     std::string runtimeFilesDir;
     std::string sharedFilesDir;
 
+    // Comma-separated directories under the runtime root that never change,
+    // e.g. the Python stdlib, which are indexed in memory and served read-only
+    std::string runtimeOverlayDirs;
+
+    // Downloaded artefacts are kept here by content hash, and the least
+    // recently used evicted past the budget. Zero means unlimited.
+    std::string artefactCacheDir;
+    int artefactCacheBudgetMb;
+
+    // If on, artefacts are fetched from other hosts that have them before
+    // falling back to S3
+    std::string artefactPeerFetch;
+
     std::string s3Bucket;
     std::string s3Host;
     std::string s3Port;
     std::string s3User;
     std::string s3Password;
 
+    // Objects bigger than one part are downloaded with parallel ranged gets
+    // and uploaded in parallel parts, this many at a time
+    int s3PartSizeMb;
+    int s3Concurrency;
+
+    // Writes to a shared file are uploaded this long after the first one not
+    // yet uploaded, so that writes in between go in the same upload. Zero
+    // uploads on every write. Syncing the file uploads it straight away.
+    int sharedFileWriteBackMs;
+
+    // Most enclaves SGX Faaslets are spread over on this host
+    int sgxEnclaves;
+
+    // Untrusted threads per enclave serving switchless OCALLs, zero making
+    // all OCALLs regular enclave exits
+    int sgxSwitchlessWorkers;
+
     std::string attestationProviderUrl;
 
+    // Service releasing keys for encrypted functions to attested enclaves
+    std::string sgxKeyReleaseUrl;
+
+    // Enclaves' cached attestation tokens are refreshed this long before they
+    // expire
+    int sgxAttestationRefreshSecs;
+
     FaasmConfig();
 
     void reset();
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Layout of encrypted functions (function.wasm.enc), shared by the host and
+ * the enclave. The AoT image is encrypted with AES-GCM-128 in fixed-size
+ * chunks, each followed by its MAC, so the host can stream the file into the
+ * enclave one chunk at a time:
+ *
+ *   header | chunk 0 | MAC 0 | chunk 1 | MAC 1 | ... | chunk n-1 | MAC n-1
+ *
+ * Every chunk is the header's chunk size except the last, which holds the
+ * rest of the image. Chunk i's IV is the header's base IV with i added to its
+ * last four bytes (big endian), and the whole header is the additional
+ * authenticated data for every chunk, so chunks can't be reordered, dropped
+ * or mixed between files without failing decryption.
+ *
+ * The image key is never on the host in the clear. The key release service
+ * wraps it with the secret it shares with the enclave's attestation key, an
+ * ECDH key pair whose public key is the held data of the enclave's quote.
+ */
+
+// "FSGXENC1" read as a little-endian integer
+#define FAASM_SGX_ENCRYPTED_MODULE_MAGIC 0x31434e4558475346ULL
+
+#define FAASM_SGX_ENCRYPTED_MODULE_IV_SIZE 12
+#define FAASM_SGX_ENCRYPTED_MODULE_MAC_SIZE 16
+#define FAASM_SGX_ENCRYPTED_MODULE_KEY_SIZE 16
+
+// Chunks are copied into the enclave whole, so are capped
+#define FAASM_SGX_ENCRYPTED_MODULE_MAX_CHUNK_SIZE (4 * 1024 * 1024)
+
+struct FaasmSgxEncryptedModuleHeader
+{
+    uint64_t magic;
+    uint64_t plainSize;
+    uint32_t chunkSize;
+    uint32_t nChunks;
+    uint8_t baseIv[FAASM_SGX_ENCRYPTED_MODULE_IV_SIZE];
+    uint32_t reserved;
+};
+
+static_assert(sizeof(FaasmSgxEncryptedModuleHeader) == 40,
+              "Encrypted module header must have no padding");
+
+// The image key, AES-GCM encrypted with a key derived from the ECDH secret
+struct FaasmSgxWrappedModuleKey
+{
+    uint8_t iv[FAASM_SGX_ENCRYPTED_MODULE_IV_SIZE];
+    uint8_t key[FAASM_SGX_ENCRYPTED_MODULE_KEY_SIZE];
+    uint8_t mac[FAASM_SGX_ENCRYPTED_MODULE_MAC_SIZE];
+};
@@ -41,7 +41,11 @@ typedef enum _faasm_error
     FAASM_SGX_DECRYPTION_FAILED = FAASM_SGX_ERROR(0x20),
     FAASM_SGX_HASH_FAILED = FAASM_SGX_ERROR(0x21),
     // Attestation errors
-    FAASM_SGX_GENERATE_REPORT_FAILED = FAASM_SGX_ERROR(0x22)
+    FAASM_SGX_GENERATE_REPORT_FAILED = FAASM_SGX_ERROR(0x22),
+    // Encrypted module loading errors
+    FAASM_SGX_KEY_EXCHANGE_FAILED = FAASM_SGX_ERROR(0x23),
+    FAASM_SGX_MODULE_KEY_NOT_RELEASED = FAASM_SGX_ERROR(0x24),
+    FAASM_SGX_MODULE_LOAD_NOT_STARTED = FAASM_SGX_ERROR(0x25)
 } faasm_sgx_status_t;
 
 #define FAASM_SGX_OCALL_ERROR(X)                                               \
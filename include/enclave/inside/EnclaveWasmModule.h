@@ -1,5 +1,6 @@
 #pragma once
 
+#include <enclave/inside/logging.h>
 #include <wamr/WAMRModuleMixin.h>
 
 #include <iwasm/aot/aot_runtime.h>
@@ -7,13 +8,13 @@
 
 #include <memory>
 #include <mutex>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
 #define ONE_KB_BYTES 1024
 #define ONE_MB_BYTES (1024 * 1024)
 
-#define FAASM_SGX_WAMR_HEAP_SIZE (32 * ONE_MB_BYTES)
 #define FAASM_SGX_WAMR_MODULE_ERROR_BUFFER_SIZE 128
 #define FAASM_SGX_WAMR_INSTANCE_DEFAULT_HEAP_SIZE (8 * ONE_KB_BYTES)
 #define FAASM_SGX_WAMR_INSTANCE_DEFAULT_STACK_SIZE (8 * ONE_KB_BYTES)
@@ -23,6 +24,38 @@
 
 namespace wasm {
 
+/*
+ * A function's AoT image, loaded into the enclave once and kept across calls.
+ * All the function's modules in this enclave are instantiated from it, so
+ * only the first to bind pays for copying the image in and parsing it.
+ */
+class LoadedWasmModule
+{
+  public:
+    ~LoadedWasmModule();
+
+    bool load(void* wasmOpCodePtr,
+              uint32_t wasmOpCodeSize,
+              const std::string& funcStrIn);
+
+    // Takes over an image already in the enclave, e.g. one decrypted here
+    bool load(std::vector<uint8_t>&& wasmBytesIn, const std::string& funcStrIn);
+
+    WASMModuleCommon* getModule();
+
+    const std::string& getFuncStr() const;
+
+  private:
+    char errorBuffer[FAASM_SGX_WAMR_MODULE_ERROR_BUFFER_SIZE];
+
+    std::string funcStr;
+
+    // WAMR may refer to the image after loading, so it's kept alongside
+    std::vector<uint8_t> wasmBytes;
+
+    WASMModuleCommon* wasmModule = nullptr;
+};
+
 /*
  * Abstraction around a WebAssembly module running inside an SGX enclave with
  * the WAMR runtime.  */
@@ -31,46 +64,77 @@ class EnclaveWasmModule : public WAMRModuleMixin<EnclaveWasmModule>
   public:
     static bool initialiseWAMRGlobally();
 
-    EnclaveWasmModule();
+    explicit EnclaveWasmModule(std::shared_ptr<LoadedWasmModule> loadedIn);
 
     ~EnclaveWasmModule();
 
-    bool loadWasm(void* wasmOpCodePtr, uint32_t wasmOpCodeSize);
+    bool instantiate();
+
+    // Swaps in a fresh instance, without reloading the module
+    bool reset();
 
     bool callFunction(uint32_t argcIn, char** argvIn);
 
     WASMModuleInstanceCommon* getModuleInstance();
 
+    // ---- Memory ----
+
+    size_t getMemorySizeBytes();
+
+    size_t getMaxMemoryPages();
+
+    // Grows memory by whole wasm pages, returning the old size, or -1 if it
+    // can't grow. Pages are committed as they're touched (see edmm.h).
+    int32_t growMemory(size_t nBytes);
+
+    // Snapshots hold linear memory and globals, each sealed to this enclave's
+    // identity, so they can only be read by enclaves built from the same
+    // image on this CPU, and only imported into the same function
+    size_t getSealedSnapshotSize();
+
+    bool exportSealedSnapshot(uint8_t* buffer, size_t bufferSize);
+
+    bool importSealedSnapshot(const uint8_t* buffer, size_t bufferSize);
+
     // ---- argc/arv ----
 
     uint32_t getArgc();
 
     std::vector<std::string> getArgv();
 
+    const wasm::StringArray& getArgvArray() const;
+
     size_t getArgvBufferSize();
 
   private:
     char errorBuffer[FAASM_SGX_WAMR_MODULE_ERROR_BUFFER_SIZE];
 
-    WASMModuleCommon* wasmModule;
-    WASMModuleInstanceCommon* moduleInstance;
+    std::shared_ptr<LoadedWasmModule> loaded;
+    WASMModuleInstanceCommon* moduleInstance = nullptr;
 
     // Argc/argv
     uint32_t argc;
     std::vector<std::string> argv;
+    wasm::StringArray argvArray;
     size_t argvBufferSize;
 
     void prepareArgcArgv(uint32_t argcIn, char** argvIn);
 };
 
-// Data structure to keep track of the modules currently loaded in the enclave.
-// And mutex to control concurrent accesses. Both objects have external
-// definition as they have to be accessed both when running an ECall, and
-// resolving a WAMR native symbol.
+// Data structure to keep track of the modules currently instantiated in the
+// enclave, by Faaslet. And mutex to control concurrent accesses. Both objects
+// have external definition as they have to be accessed both when running an
+// ECall, and resolving a WAMR native symbol.
 extern std::unordered_map<uint32_t, std::shared_ptr<wasm::EnclaveWasmModule>>
   moduleMap;
 extern std::mutex moduleMapMutex;
 
+// Modules loaded into the enclave, by function. Also guarded by the module
+// map mutex. Modules evicted from here stay loaded until their last instance
+// goes.
+extern std::unordered_map<std::string, std::shared_ptr<wasm::LoadedWasmModule>>
+  loadedModuleMap;
+
 // Return the EnclaveWasmModule that is executing in a given WASM execution
 // environment. This method relies on `wasm_exec_env_t` having a `module_inst`
 // property, pointint to the instantiated module.
@@ -86,7 +150,7 @@ std::shared_ptr<wasm::EnclaveWasmModule> getExecutingEnclaveWasmModule(
     std::shared_ptr<wasm::EnclaveWasmModule> module =                          \
       wasm::getExecutingEnclaveWasmModule(execEnv);                            \
     if (module == nullptr) {                                                   \
-        ocallLogError(                                                         \
+        sgx::logError(                                                         \
           "Error linking execution environment to registered modules");        \
         return 1;                                                              \
     }
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <enclave/encrypted_module.h>
+#include <enclave/error.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sgx_tcrypto.h>
+
+namespace wasm {
+
+/*
+ * An encrypted function being streamed into the enclave. The host starts it
+ * with the file's header, hands in the image key the key release service
+ * wrapped for the enclave's attestation key, then sends the file one chunk at
+ * a time. Chunks are decrypted straight into the image, so the enclave never
+ * holds more than one chunk of ciphertext.
+ */
+class EncryptedModuleLoad
+{
+  public:
+    explicit EncryptedModuleLoad(const std::string& funcStrIn);
+
+    ~EncryptedModuleLoad();
+
+    faasm_sgx_status_t begin(const uint8_t* headerBytes, size_t headerSize);
+
+    // Unwraps the image key with the secret shared with the release service
+    faasm_sgx_status_t releaseKey(const sgx_ec256_public_t* releaseKey,
+                                  const uint8_t* wrappedKeyBytes,
+                                  size_t wrappedKeySize);
+
+    faasm_sgx_status_t addChunk(const uint8_t* chunk, size_t chunkSize);
+
+    // Hands over the decrypted image once every chunk is in
+    faasm_sgx_status_t finish(std::vector<uint8_t>& imageOut);
+
+  private:
+    std::string funcStr;
+
+    FaasmSgxEncryptedModuleHeader header;
+
+    uint8_t imageKey[FAASM_SGX_ENCRYPTED_MODULE_KEY_SIZE];
+    bool hasImageKey = false;
+
+    uint32_t nextChunk = 0;
+
+    std::vector<uint8_t> image;
+
+    void wipeKeys();
+};
+
+// Loads in progress, by function. Guarded by the module map mutex
+extern std::unordered_map<std::string, std::shared_ptr<EncryptedModuleLoad>>
+  encryptedModuleLoads;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <enclave/error.h>
+
+#include <sgx_tcrypto.h>
+
+namespace sgx {
+
+/*
+ * Each enclave has one ECDH key pair for its lifetime, generated the first
+ * time it's asked for. The public key is the held data of every attestation
+ * of the enclave, so a single attestation token vouches for it, and can be
+ * cached and reused for every key released to the enclave. The private key
+ * never leaves the enclave.
+ */
+faasm_sgx_status_t getAttestationPublicKey(sgx_ec256_public_t* publicKey);
+
+// Derives the secret shared with the holder of the given public key
+faasm_sgx_status_t computeAttestationSharedSecret(
+  const sgx_ec256_public_t* peerKey,
+  sgx_ec256_dh_shared_t* shared);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Allocations at least this big, i.e. linear memories of one wasm page and
+// up, get their own region rather than coming out of the enclave heap
+#define EDMM_REGION_MIN_BYTES (64 * 1024)
+
+/*
+ * Enclave memory allocation for WAMR, using SGX2's dynamic memory management
+ * (EDMM) where the CPU supports it. Enclaves used to hand WAMR a pool sized
+ * up front, all of it committed to EPC when the enclave was created whether
+ * functions used it or not.
+ *
+ * With EDMM, each big allocation (in practice, each module's linear memory)
+ * is a region of the enclave's user range (UserRegionSize in enclave.config)
+ * whose pages are committed the first time they're touched, and given back
+ * when it's freed, e.g. when a module is reset. Smaller allocations come from
+ * the enclave heap, which the SDK also grows on demand with EDMM. On SGX1,
+ * and in simulation, everything comes from the heap, committed up front.
+ */
+namespace sgx {
+
+bool isEdmmAvailable();
+
+void* edmmMalloc(unsigned int size);
+
+void* edmmRealloc(void* ptr, unsigned int size);
+
+void edmmFree(void* ptr);
+
+// Bytes in EDMM regions, of which only touched pages are committed
+size_t getEdmmRegionBytes();
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+// Debug logs are buffered, and sent out of the enclave in batches
+#define FAASM_SGX_LOG_BATCH_BYTES 4096
+
+namespace sgx {
+
+// Buffers a debug message, sending the batch out if it's full
+void logDebug(const char* msg);
+
+// Sends out any buffered debug messages, then the error straight away
+void logError(const char* msg);
+
+void flushDebugLogs();
+
+/**
+ * Flushes buffered debug logs on leaving an ECALL.
+ */
+class DebugLogFlush
+{
+  public:
+    ~DebugLogFlush() { flushDebugLogs(); }
+};
+}
@@ -42,6 +42,8 @@ uint32_t getFaasmFunctionsApi(NativeSymbol** nativeSymbols);
 
 uint32_t getFaasmMemoryApi(NativeSymbol** nativeSymbols);
 
+uint32_t getFaasmOpenMPApi(NativeSymbol** nativeSymbols);
+
 uint32_t getFaasmPthreadApi(NativeSymbol** nativeSymbols);
 
 uint32_t getFaasmStateApi(NativeSymbol** nativeSymbols);
@@ -10,13 +10,9 @@ extern "C"
 {
     extern sgx_status_t SGX_CDECL ocallLogError(const char* msg);
 
-// In enclave release mode (i.e NDEBUG set) we disable debug logging, and
-// prevent it from doing an ocall (hence the different signature).
-#ifdef FAASM_SGX_DEBUG
-    void ocallLogDebug(const char* msg) { ; };
-#else
-    extern sgx_status_t SGX_CDECL ocallLogDebug(const char* msg);
-#endif
+    // Newline-separated debug messages, see logging.h
+    extern sgx_status_t SGX_CDECL ocallLogDebugBatch(const char* msgs,
+                                                     size_t msgsLen);
 
     extern sgx_status_t SGX_CDECL ocallFaasmReadInput(int* returnValue,
                                                       uint8_t* buffer,
@@ -44,6 +40,44 @@ extern "C"
                               uint8_t* buffer,
                               unsigned int bufferSize);
 
-    extern sgx_status_t SGX_CDECL ocallSbrk(int32_t* returnValue,
-                                            int32_t increment);
+    extern sgx_status_t SGX_CDECL ocallFaasmReadState(unsigned int* returnValue,
+                                                      const char* key,
+                                                      uint8_t* buffer,
+                                                      unsigned int bufferLen);
+
+    extern sgx_status_t SGX_CDECL ocallFaasmWriteState(const char* key,
+                                                       uint8_t* buffer,
+                                                       unsigned int bufferLen);
+
+    extern sgx_status_t SGX_CDECL
+    ocallFaasmReadStateOffset(const char* key,
+                              unsigned int totalLen,
+                              unsigned int offset,
+                              uint8_t* buffer,
+                              unsigned int bufferLen);
+
+    extern sgx_status_t SGX_CDECL
+    ocallFaasmWriteStateOffset(const char* key,
+                               unsigned int totalLen,
+                               unsigned int offset,
+                               uint8_t* buffer,
+                               unsigned int bufferLen);
+
+    extern sgx_status_t SGX_CDECL
+    ocallFaasmFlagStateOffsetDirty(const char* key,
+                                   unsigned int totalLen,
+                                   unsigned int offset,
+                                   unsigned int len);
+
+    extern sgx_status_t SGX_CDECL ocallFaasmPullState(const char* key,
+                                                      unsigned int stateLen);
+
+    extern sgx_status_t SGX_CDECL ocallFaasmPushState(const char* key);
+
+    extern sgx_status_t SGX_CDECL ocallFaasmPushStatePartial(const char* key);
+
+    extern sgx_status_t SGX_CDECL ocallFaasmTimerNanos(uint64_t* returnValue);
+
+    extern sgx_status_t SGX_CDECL
+    ocallFaasmTimerResolutionNanos(uint64_t* returnValue);
 }
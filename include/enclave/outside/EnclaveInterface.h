@@ -30,15 +30,43 @@ class EnclaveInterface final : public WasmModule
 
     bool unbindFunction();
 
+    // Re-instantiates the module from the copy loaded in the enclave
+    void reset(faabric::Message& msg, const std::string& snapshotKey) override;
+
     int32_t executeFunction(faabric::Message& msg) override;
 
     size_t getMemorySizeBytes() override;
 
     size_t getMaxMemoryPages() override;
 
+    // Enclave memory can't be read from outside, so this is always null
     uint8_t* getMemoryBase() override;
 
+    // Only the size of enclave memory is known outside, not what's resident
+    ModuleMemoryUsage getMemoryUsage() override;
+
+    // Snapshots of enclave modules are sealed inside the enclave, and hold
+    // the module's memory and globals. They can be restored into any enclave
+    // in the pool, but only into modules bound to the same function.
+    std::shared_ptr<faabric::util::SnapshotData> getSnapshotData() override;
+
+    void restore(const std::string& snapshotKey) override;
+
+    sgx_enclave_id_t getEnclaveId() const { return enclaveId; }
+
   private:
     uint32_t interfaceId = 0;
+
+    struct MemoryInfo
+    {
+        size_t sizeBytes = 0;
+        size_t maxPages = 0;
+        size_t sealedSnapshotBytes = 0;
+    };
+
+    MemoryInfo getMemoryInfo();
+
+    // Set by the enclave pool when bound
+    sgx_enclave_id_t enclaveId = 0;
 };
 }
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <faabric/proto/faabric.pb.h>
+
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <sgx_eid.h>
+
+// ECALLs the pool lets each enclave run at once. TCSNum in enclave.config is
+// one more, the spare being for background attestation, which isn't pooled
+#define FAASM_SGX_ENCLAVE_TCS_NUM 10
+
+// Functions with no instances left that each enclave keeps loaded
+#define FAASM_SGX_MAX_IDLE_MODULES 4
+
+namespace sgx {
+
+/*
+ * Hands out the host's enclaves to Faaslets. Enclaves are created as they're
+ * needed, up to the configured number, the first being the global enclave.
+ * Functions stay loaded in an enclave across calls and Faaslets, so Faaslets
+ * binding to a function are sent to an enclave that already has it wherever
+ * possible, and only instantiate it there. Functions with an encrypted file
+ * are streamed into the enclave from it instead. Each enclave's TCS slots are
+ * counted, so ECALLs wait for a free slot rather than failing with
+ * SGX_ERROR_OUT_OF_TCS.
+ */
+class EnclavePool
+{
+  public:
+    // Loads the function into an enclave if need be, and instantiates it there
+    // for the given Faaslet
+    sgx_enclave_id_t bindFunction(const faabric::Message& msg,
+                                  uint32_t faasletId);
+
+    void unbindFunction(sgx_enclave_id_t enclaveId,
+                        const std::string& funcStr,
+                        uint32_t faasletId);
+
+    void acquireTcs(sgx_enclave_id_t enclaveId);
+
+    void releaseTcs(sgx_enclave_id_t enclaveId);
+
+    int getEnclaveCount();
+
+    int getFreeTcs(sgx_enclave_id_t enclaveId);
+
+    std::set<std::string> getLoadedFunctions(sgx_enclave_id_t enclaveId);
+
+    // Destroys all but the global enclave and forgets what's loaded
+    void clear();
+
+  private:
+    struct Enclave
+    {
+        sgx_enclave_id_t id = 0;
+
+        int nBound = 0;
+        int tcsInUse = 0;
+
+        std::set<std::string> loaded;
+
+        // Functions a Faaslet is loading, others binding to them wait
+        std::set<std::string> loading;
+        std::map<std::string, int> instances;
+
+        // Loaded functions without instances, least recently used first
+        std::list<std::string> idle;
+    };
+
+    std::mutex mx;
+    std::condition_variable tcsCv;
+    std::condition_variable loadCv;
+
+    std::vector<std::unique_ptr<Enclave>> enclaves;
+
+    Enclave& getEnclave(sgx_enclave_id_t enclaveId);
+
+    Enclave& pickEnclave(const std::string& funcStr);
+
+    void waitForTcs(std::unique_lock<std::mutex>& lock, Enclave& enclave);
+
+    void loadModule(Enclave& enclave,
+                    const faabric::Message& msg,
+                    const std::string& funcStr);
+
+    // Streams an encrypted function in a chunk at a time, getting its key
+    // released to the enclave on the way
+    void loadEncryptedModule(Enclave& enclave,
+                             const std::string& funcStr,
+                             const std::string& filePath);
+};
+
+EnclavePool& getEnclavePool();
+
+/**
+ * Holds one of an enclave's TCS slots for the duration of an ECALL.
+ */
+class TcsSlot
+{
+  public:
+    explicit TcsSlot(sgx_enclave_id_t enclaveIdIn);
+
+    ~TcsSlot();
+
+  private:
+    sgx_enclave_id_t enclaveId;
+};
+}
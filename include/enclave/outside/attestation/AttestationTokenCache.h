@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <sgx_eid.h>
+
+namespace sgx {
+
+typedef std::function<std::string(sgx_enclave_id_t)> AttestFunction;
+
+/*
+ * Caches the attestation service's JWT for each of the host's enclaves, so
+ * releasing keys to an enclave doesn't wait on the attestation service. An
+ * enclave is attested the first time its token is asked for, and from then
+ * on a background thread attests it again before its token expires, within
+ * the configured refresh margin. Tokens that couldn't be refreshed are used
+ * until they expire, after which asking for one attests the enclave again.
+ */
+class AttestationTokenCache
+{
+  public:
+    // Attests with the enclave's attestation key unless told otherwise
+    AttestationTokenCache();
+
+    explicit AttestationTokenCache(AttestFunction attestIn);
+
+    ~AttestationTokenCache();
+
+    // Has the enclave attested in the background, e.g. as it's created
+    void addEnclave(sgx_enclave_id_t enclaveId);
+
+    // The enclave's JWT response, attesting it only if there's no valid one
+    std::string getToken(sgx_enclave_id_t enclaveId);
+
+    void removeEnclave(sgx_enclave_id_t enclaveId);
+
+    // Forgets all tokens and stops the refresh thread
+    void clear();
+
+    size_t getTokenCount();
+
+  private:
+    struct CachedToken
+    {
+        std::string jwtResponse;
+        std::chrono::system_clock::time_point expiry;
+        std::chrono::system_clock::time_point refreshAt;
+    };
+
+    AttestFunction attest;
+
+    std::mutex mx;
+    std::condition_variable refreshCv;
+    std::thread refreshThread;
+    bool stopping = false;
+
+    std::map<sgx_enclave_id_t, CachedToken> tokens;
+
+    CachedToken attestEnclave(sgx_enclave_id_t enclaveId);
+
+    void refreshLoop();
+
+    // Must hold the mutex
+    void startRefreshThread();
+
+    void stopRefreshThread();
+};
+
+AttestationTokenCache& getAttestationTokenCache();
+
+// When the token in the attestation service's response expires
+std::chrono::system_clock::time_point getJwtExpiry(
+  const std::string& jwtResponse);
+}
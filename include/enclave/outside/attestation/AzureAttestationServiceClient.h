@@ -45,6 +45,9 @@ class AzureAttestationServiceClient
     static std::string requestBodyFromEnclaveInfo(
       const EnclaveInfo& enclaveInfo);
 
+    // Extract the token itself from the attestation service's response
+    static std::string getTokenFromJwtResponse(const std::string& jwtResponse);
+
     AzureAttestationServiceClient(const std::string& attestationServiceUrlIn);
 
     // This method sends the enclave quote to the remote attestation service.
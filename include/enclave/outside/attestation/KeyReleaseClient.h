@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <sgx_tcrypto.h>
+
+namespace sgx {
+
+struct ReleasedModuleKey
+{
+    // The service's half of the key exchange
+    sgx_ec256_public_t releaseKey;
+
+    // A FaasmSgxWrappedModuleKey, only the enclave can unwrap
+    std::vector<uint8_t> wrappedKey;
+};
+
+/*
+ * This class interfaces with the service holding the keys of encrypted
+ * functions. It presents the attestation service's JWT for an enclave, whose
+ * held data is the enclave's public key for the load, and gets back the
+ * function's key wrapped with the secret the service shares with that key.
+ * The service is trusted to check the JWT before releasing anything.
+ */
+class KeyReleaseClient
+{
+  private:
+    std::string keyReleaseUrl;
+
+  public:
+    static std::string requestBody(const std::string& funcStr,
+                                   const std::string& jwtToken);
+
+    static ReleasedModuleKey releasedKeyFromResponse(
+      const std::string& responseBody);
+
+    KeyReleaseClient(const std::string& keyReleaseUrlIn);
+
+    ReleasedModuleKey releaseModuleKey(const std::string& funcStr,
+                                       const std::string& jwtResponse);
+};
+}
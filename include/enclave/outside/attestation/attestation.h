@@ -1,10 +1,13 @@
 #pragma once
 
 #include <enclave/outside/attestation/EnclaveInfo.h>
+#include <enclave/outside/attestation/KeyReleaseClient.h>
 
 #include <string>
 #include <vector>
 
+#include <sgx_eid.h>
+
 namespace sgx {
 
 // An enclave report is a signed measure of the enclave's memory contents. To
@@ -18,12 +21,24 @@ EnclaveInfo generateQuote(int enclaveId,
 // Validation happens in two steps. First, we send the enclave's quote to an
 // external attestation service that checks the quote against an attestation
 // policy, and returns a JWT upon succesful validation. Second, we validate
-// the integrity and signature of the JWT.
-void validateQuote(const EnclaveInfo& enclaveInfo,
-                   const std::string& attestationProviderUrl);
+// the integrity and signature of the JWT, which is returned.
+std::string validateQuote(const EnclaveInfo& enclaveInfo,
+                          const std::string& attestationProviderUrl);
 
 // Attests that the enclave identified by the unique enclave id. Remote
 // attestation happens in two steps. First, we generate a quote for the
 // enclave. Second, we validate the quote with an external attestation service.
-void attestEnclave(int enclaveId, std::vector<uint8_t> enclaveHeldData);
+// Returns the JWT vouching for the enclave and its held data.
+std::string attestEnclave(int enclaveId, std::vector<uint8_t> enclaveHeldData);
+
+// Attests the enclave with its attestation public key as the held data, so
+// the JWT vouches for the key, and keys can be released to the enclave with it
+std::string attestEnclaveWithKey(sgx_enclave_id_t enclaveId);
+
+// Gets the key of an encrypted function for an enclave that's loading it, by
+// presenting the enclave's cached attestation JWT to the key release service.
+// Keys are only released to attested enclaves, and only when they load the
+// function.
+ReleasedModuleKey releaseModuleKey(sgx_enclave_id_t enclaveId,
+                                   const std::string& funcStr);
 }
@@ -2,6 +2,7 @@
 
 #include <sgx.h>
 #include <sgx_report.h>
+#include <sgx_tcrypto.h>
 #include <sgx_urts.h>
 
 // What follows are the definitions of the enclave-entry calls. This is, the
@@ -22,11 +23,72 @@ extern "C"
                                         faasm_sgx_status_t* retVal,
                                         const void* wasmOpCodePtr,
                                         const uint32_t wasmOpCodeSize,
-                                        uint32_t faasletId);
+                                        const char* funcStr);
+
+    extern sgx_status_t ecallGetAttestationKey(sgx_enclave_id_t enclaveId,
+                                               faasm_sgx_status_t* retVal,
+                                               sgx_ec256_public_t* publicKey);
+
+    extern sgx_status_t ecallBeginModuleLoad(sgx_enclave_id_t enclaveId,
+                                             faasm_sgx_status_t* retVal,
+                                             const char* funcStr,
+                                             const uint8_t* header,
+                                             size_t headerSize);
+
+    extern sgx_status_t ecallReleaseModuleKey(
+      sgx_enclave_id_t enclaveId,
+      faasm_sgx_status_t* retVal,
+      const char* funcStr,
+      const sgx_ec256_public_t* releaseKey,
+      const uint8_t* wrappedKey,
+      size_t wrappedKeySize);
+
+    extern sgx_status_t ecallLoadModuleChunk(sgx_enclave_id_t enclaveId,
+                                             faasm_sgx_status_t* retVal,
+                                             const char* funcStr,
+                                             const uint8_t* chunk,
+                                             size_t chunkSize);
+
+    extern sgx_status_t ecallEndModuleLoad(sgx_enclave_id_t enclaveId,
+                                           faasm_sgx_status_t* retVal,
+                                           const char* funcStr,
+                                           bool abort);
 
     extern sgx_status_t ecallUnloadModule(sgx_enclave_id_t enclaveId,
                                           faasm_sgx_status_t* retVal,
-                                          uint32_t faasletId);
+                                          const char* funcStr);
+
+    extern sgx_status_t ecallInstantiateModule(sgx_enclave_id_t enclaveId,
+                                               faasm_sgx_status_t* retVal,
+                                               const char* funcStr,
+                                               uint32_t faasletId);
+
+    extern sgx_status_t ecallDeinstantiateModule(sgx_enclave_id_t enclaveId,
+                                                 faasm_sgx_status_t* retVal,
+                                                 uint32_t faasletId);
+
+    extern sgx_status_t ecallResetModule(sgx_enclave_id_t enclaveId,
+                                         faasm_sgx_status_t* retVal,
+                                         uint32_t faasletId);
+
+    extern sgx_status_t ecallGetMemoryInfo(sgx_enclave_id_t enclaveId,
+                                           faasm_sgx_status_t* retVal,
+                                           uint32_t faasletId,
+                                           size_t* sizeBytes,
+                                           size_t* maxPages,
+                                           size_t* sealedSnapshotBytes);
+
+    extern sgx_status_t ecallExportSnapshot(sgx_enclave_id_t enclaveId,
+                                            faasm_sgx_status_t* retVal,
+                                            uint32_t faasletId,
+                                            uint8_t* buffer,
+                                            size_t bufferSize);
+
+    extern sgx_status_t ecallImportSnapshot(sgx_enclave_id_t enclaveId,
+                                            faasm_sgx_status_t* retVal,
+                                            uint32_t faasletId,
+                                            const uint8_t* buffer,
+                                            size_t bufferSize);
 
     extern sgx_status_t ecallCallFunction(sgx_enclave_id_t enclaveId,
                                           faasm_sgx_status_t* retVal,
@@ -9,6 +9,11 @@
 namespace sgx {
 sgx_enclave_id_t getGlobalEnclaveId();
 
+// Creates, initialises and (in hardware mode) attests a new enclave
+sgx_enclave_id_t createEnclave();
+
+void destroyEnclave(sgx_enclave_id_t enclaveId);
+
 void processECallErrors(
   std::string errorMessage,
   sgx_status_t sgxReturnValue,
@@ -6,16 +6,64 @@
 
 #include <system/NetworkNamespace.h>
 #include <wasm/WasmModule.h>
+#include <wasm/function_profile.h>
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Timings of each phase of a call, attached to its exec graph details in
+// microseconds. Phases that didn't happen for a call are left out.
+#define PHASE_FAASLET_INIT "faaslet-init-us"
+#define PHASE_ISOLATION_SETUP "isolation-setup-us"
+#define PHASE_EXECUTE "execute-us"
+#define PHASE_RESET "reset-us"
+
+// When the Faaslet started and finished the call, in microseconds since the
+// epoch, so that callers on the same host can work out the time either side
+#define PHASE_TASK_START "task-start-epoch-us"
+#define PHASE_TASK_END "task-end-epoch-us"
 
 namespace faaslet {
 
+struct FaasletMemoryUsage
+{
+    int faasletId = 0;
+    std::string user;
+    std::string function;
+    std::string resetSnapshotKey;
+
+    // The module running calls, and any spares in the reset pool
+    int nModules = 0;
+    wasm::ModuleMemoryUsage modules;
+};
+
+struct FunctionMemoryUsage
+{
+    std::string user;
+    std::string function;
+
+    // Summed over the function's Faaslets
+    int nFaaslets = 0;
+    wasm::ModuleMemoryUsage modules;
+
+    // Shared by all the function's Faaslets. Snapshots deduplicated in the
+    // page store are still counted in full.
+    size_t snapshotBytes = 0;
+    size_t cachedModuleBytes = 0;
+};
+
 class Faaslet final : public faabric::scheduler::Executor
 {
   public:
     explicit Faaslet(faabric::Message& msg);
 
+    ~Faaslet() override;
+
     std::unique_ptr<wasm::WasmModule> module;
 
     void reset(faabric::Message& msg) override;
@@ -27,6 +75,11 @@ class Faaslet final : public faabric::scheduler::Executor
 
     std::string getLocalResetSnapshotKey();
 
+    // Number of spare modules that have been reset and are ready to swap in
+    size_t getCleanModuleCount();
+
+    FaasletMemoryUsage getMemoryUsage();
+
     void shutdown() override;
 
   protected:
@@ -39,7 +92,47 @@ class Faaslet final : public faabric::scheduler::Executor
   private:
     std::string localResetSnapshotKey;
 
-    std::shared_ptr<isolation::NetworkNamespace> ns;
+    // Identifies the Faaslet in memory reports
+    const int faasletId;
+    std::string user;
+    std::string function;
+
+    // The bound function's overrides of the host's settings
+    wasm::FunctionProfile profile;
+    std::string wasmVm;
+
+    // Creating and binding the module is only paid for by the first call
+    long initMicros = 0;
+    bool initRecorded = false;
+
+    std::unique_ptr<wasm::WasmModule> createModule();
+
+    // Binds a new module and registers its reset snapshot
+    void bindModule(faabric::Message& msg);
+
+    // Whether the last call threw, in which case its instance isn't reused
+    bool lastCallFailed = false;
+
+    // Whether the last call was answered from the result cache, so never ran
+    bool lastCallCached = false;
+
+    // Whether to keep the instance for the next call of a batch handler,
+    // rather than resetting it
+    bool keepBatchInstance(const faabric::Message& msg);
+
+    // If enabled, reset swaps in a clean module from this pool and hands the
+    // used one to a background thread to reset
+    std::mutex resetPoolMx;
+    std::condition_variable resetPoolCv;
+    std::deque<std::unique_ptr<wasm::WasmModule>> cleanModules;
+    std::deque<std::pair<std::unique_ptr<wasm::WasmModule>, faabric::Message>>
+      dirtyModules;
+    std::thread resetThread;
+    bool resetPoolRunning = false;
+
+    void startResetPool(faabric::Message& msg);
+
+    void stopResetPool();
 };
 
 class FaasletFactory final : public faabric::scheduler::ExecutorFactory
@@ -47,12 +140,104 @@ class FaasletFactory final : public faabric::scheduler::ExecutorFactory
   public:
     ~FaasletFactory();
 
+    // Creates Faaslets for the function up front, which are handed out
+    // before any new ones are created
+    void prewarmFaaslets(faabric::Message& msg, int n);
+
+    std::shared_ptr<Faaslet> claimWarmFaaslet(const faabric::Message& msg);
+
+    size_t getWarmFaasletCount(const faabric::Message& msg);
+
   protected:
     std::shared_ptr<faabric::scheduler::Executor> createExecutor(
       faabric::Message& msg) override;
 
     void flushHost() override;
+
+  private:
+    std::mutex warmFaasletsMx;
+    std::unordered_map<std::string, std::vector<std::shared_ptr<Faaslet>>>
+      warmFaaslets;
+
+    void clearWarmFaaslets();
+};
+
+struct FaasletAdmissionStats
+{
+    // Creations waiting for the host to have room
+    size_t waiting = 0;
+
+    // Creations admitted, but whose Faaslet isn't created yet
+    size_t inFlight = 0;
+
+    // Creations turned away, either with the queue full or after timing out
+    uint64_t rejected = 0;
 };
 
+/**
+ * Admission control for new Faaslets. A Faaslet is only created when the host
+ * has at least FAASLET_MIN_FREE_MEM_MB available and, with network namespaces
+ * on, a free namespace. Otherwise creation waits up to
+ * FAASLET_ADMISSION_TIMEOUT_MS for the host to have room, with at most
+ * FAASLET_ADMISSION_QUEUE creations waiting at once. Throws if the creation
+ * is rejected, which fails the call rather than overloading the host. Warm
+ * Faaslets are already paid for, so are handed out without admission.
+ * Admitted creations count against the room until finishFaasletAdmission.
+ */
+void admitFaaslet(const faabric::Message& msg);
+
+// Called once an admitted Faaslet has been created, or failed to be, so it no
+// longer counts against the host's room
+void finishFaasletAdmission();
+
+// Wakes up a creation waiting for room, e.g. when a Faaslet is destroyed
+void notifyFaasletReleased();
+
+FaasletAdmissionStats getFaasletAdmissionStats();
+
+void resetFaasletAdmissionStats();
+
+// Builds the Python runtime's module caches and reset snapshot, and
+// optionally creates PYTHON_PRELOAD_FAASLETS Faaslets for it. Does nothing
+// unless PYTHON_PRELOAD is on.
 void preloadPythonRuntime();
+
+uint64_t getEpochMicros();
+
+// Reads one of the phase timings from a call's result, zero if it's not there
+long getPhaseMicros(const faabric::Message& msg, const std::string& phase);
+
+// Parses the functions listed for prewarming in the config
+std::vector<faabric::Message> getPrewarmMessages();
+
+// Populates the module caches and reset snapshot for the given function,
+// without executing it
+void prewarmFunction(faabric::Message& msg);
+
+// Prewarms the functions listed in the config on background threads, so that
+// new workers don't pay the cold-start cost on the first request for each
+// function. Returns immediately, use waitForPrewarm to wait for completion.
+void startPrewarm();
+
+void waitForPrewarm();
+
+/**
+ * Memory accounting for every Faaslet on this host, for bin-packing and for
+ * spotting leaks before the OOM killer does. Linear memory is counted by its
+ * resident pages rather than its size, and pages still shared with the reset
+ * snapshot are told apart from the Faaslet's own. Reads the page tables of
+ * every module, so isn't for hot paths.
+ */
+std::vector<FaasletMemoryUsage> getFaasletMemoryUsage();
+
+// Includes functions with cached modules but no Faaslets left
+std::vector<FunctionMemoryUsage> getFunctionMemoryUsage();
+
+// Both of the above, as JSON
+std::string dumpMemoryUsage();
+
+// Registers gauges for the worker's module caches, namespace pool,
+// isolation and memory, to be served alongside the metrics recorded
+// elsewhere, and the memory report
+void registerWorkerMetrics();
 }
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Always-on tracing of Faaslet lifecycle events. Each thread records into its
+ * own fixed-size ring, overwriting its oldest events, so recording is a clock
+ * read and a few plain stores, with no locks or allocation. The rings can be
+ * dumped at any time in the Chrome trace format, which Perfetto and
+ * chrome://tracing both open, e.g. from the metrics server's /trace path.
+ */
+namespace metrics {
+
+// Events kept per thread, must be a power of two
+#define LIFECYCLE_TRACE_RING_SIZE 4096
+
+enum class TraceEvent : uint8_t
+{
+    Bind = 0,
+    Reset,
+    SnapshotRestore,
+    ThreadFork,
+    ThreadJoin,
+    MigrationPoint,
+    ChainedCall,
+    ChainedAwait,
+
+    // State transfers are recorded as instants, with their size in bytes
+    StatePush,
+    StatePull,
+
+    NumEvents
+};
+
+std::string traceEventName(TraceEvent event);
+
+struct TraceRecord
+{
+    TraceEvent event;
+    int32_t tid = 0;
+    int32_t msgId = 0;
+
+    uint64_t startNanos = 0;
+    uint64_t durationNanos = 0;
+
+    // Event-specific, e.g. the bytes of a state transfer
+    uint64_t arg = 0;
+};
+
+uint64_t getTraceNanos();
+
+/**
+ * Events the calling thread records from here on are put down to this
+ * message, until it's changed again. Zero means none.
+ */
+void setTraceMessage(int32_t msgId);
+
+void traceEvent(TraceEvent event,
+                uint64_t startNanos,
+                uint64_t durationNanos,
+                uint64_t arg = 0);
+
+void traceInstant(TraceEvent event, uint64_t arg = 0);
+
+// Events still held in all threads' rings, oldest first within each thread
+std::vector<TraceRecord> getLifecycleTrace();
+
+// All held events as a Chrome trace JSON object
+std::string dumpLifecycleTrace();
+
+void clearLifecycleTrace();
+
+/**
+ * Records the time from construction to destruction as an event.
+ */
+class TraceScope
+{
+  public:
+    explicit TraceScope(TraceEvent eventIn, uint64_t argIn = 0);
+
+    ~TraceScope();
+
+  private:
+    TraceEvent event;
+    uint64_t arg;
+    uint64_t startNanos;
+};
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <faabric/util/timing.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Host-wide operational metrics, rendered in the Prometheus text format by
+ * the worker's metrics server. Counters and histograms are registered once,
+ * usually into a function-local static, and are then updated with relaxed
+ * atomics so they can sit on hot paths. Gauges, and counters kept elsewhere,
+ * are read from callbacks when the metrics are rendered, so cost nothing in
+ * between.
+ */
+namespace metrics {
+
+class Counter
+{
+  public:
+    void inc(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+    void reset() { value.store(0, std::memory_order_relaxed); }
+
+  private:
+    std::atomic<uint64_t> value = 0;
+};
+
+/**
+ * Histogram of durations in microseconds, with an upper bound for each
+ * bucket and an extra bucket for everything above the last one. Durations
+ * are rendered in seconds.
+ */
+class Histogram
+{
+  public:
+    explicit Histogram(std::vector<uint64_t> boundsMicrosIn);
+
+    void observe(uint64_t micros);
+
+    const std::vector<uint64_t>& getBoundsMicros() const
+    {
+        return boundsMicros;
+    }
+
+    // Counts in each bucket, not cumulative, ending with the overflow bucket
+    std::vector<uint64_t> getBucketCounts() const;
+
+    uint64_t getCount() const { return count.load(std::memory_order_relaxed); }
+
+    uint64_t getSumMicros() const
+    {
+        return sumMicros.load(std::memory_order_relaxed);
+    }
+
+    void reset();
+
+  private:
+    const std::vector<uint64_t> boundsMicros;
+
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+    std::atomic<uint64_t> count = 0;
+    std::atomic<uint64_t> sumMicros = 0;
+};
+
+// Bounds from 1ms to 10s, for remote calls such as S3 requests
+std::vector<uint64_t> getDefaultLatencyBoundsMicros();
+
+// Counters and histograms live as long as the process, and asking for the
+// same name again returns the same one
+Counter& getCounter(const std::string& name, const std::string& help);
+
+Histogram& getHistogram(
+  const std::string& name,
+  const std::string& help,
+  const std::vector<uint64_t>& boundsMicros = getDefaultLatencyBoundsMicros());
+
+// Registering a callback under an existing name replaces it
+void registerGauge(const std::string& name,
+                   const std::string& help,
+                   std::function<double()> read);
+
+// For totals a subsystem already keeps itself, read when rendered like gauges
+void registerCounterCallback(const std::string& name,
+                             const std::string& help,
+                             std::function<double()> read);
+
+void removeCallback(const std::string& name);
+
+// Extra JSON pages for the metrics server, for reports too detailed for
+// Prometheus, rendered when requested. Registering a path again replaces it.
+void registerPage(const std::string& path, std::function<std::string()> render);
+
+// Returns false if nothing is registered at the path
+bool renderPage(const std::string& path, std::string& body);
+
+// All metrics in the Prometheus text exposition format, sorted by name
+std::string renderMetrics();
+
+// Zeroes all counters and histograms, leaving gauges registered
+void resetMetrics();
+
+/**
+ * Records the time between construction and destruction in a histogram.
+ */
+class HistogramTimer
+{
+  public:
+    explicit HistogramTimer(Histogram& histogramIn);
+
+    ~HistogramTimer();
+
+  private:
+    Histogram& histogram;
+    faabric::util::TimePoint start;
+};
+}
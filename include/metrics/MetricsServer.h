@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cpprest/http_listener.h>
+
+#include <memory>
+#include <string>
+
+#define METRICS_URL_PATH "/metrics"
+#define TRACE_URL_PATH "/trace"
+#define MEMORY_URL_PATH "/memory"
+
+namespace metrics {
+
+/**
+ * Serves the host's metrics to Prometheus scrapes, its lifecycle trace for
+ * debugging, and any pages registered with registerPage. Requests are handled
+ * on cpprest's own threads, so starting the server doesn't block.
+ */
+class MetricsServer
+{
+  public:
+    void start(int port);
+
+    void stop();
+
+    static void handleGet(const web::http::http_request& request);
+
+  private:
+    std::unique_ptr<web::http::experimental::listener::http_listener>
+      listener;
+};
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <faabric/proto/faabric.pb.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace runner {
+
+/*
+ * Measures the latency of calls that can't reuse everything from a previous
+ * call, i.e. cold starts, under increasingly warm conditions:
+ *
+ * - cold: nothing on the host, so artefacts are fetched from S3
+ * - artefact: artefacts in the local cache, but no cached modules
+ * - module: cached modules, but a new Faaslet for each call
+ * - pooled: an existing Faaslet that's already run the function
+ *
+ * Calls go straight to a Faaslet rather than through the scheduler, so the
+ * latency is that of creating the Faaslet (unless pooled) and running the
+ * call.
+ */
+enum class ColdStartCondition
+{
+    Cold,
+    Artefact,
+    Module,
+    Pooled,
+};
+
+std::string coldStartConditionToString(ColdStartCondition condition);
+
+struct ColdStartResult
+{
+    std::string user;
+    std::string function;
+    std::string wasmVm;
+    ColdStartCondition condition = ColdStartCondition::Cold;
+    int run = 0;
+    int returnValue = 0;
+    long latencyMicros = 0;
+
+    // Phases of the call as recorded by the Faaslet
+    long initMicros = 0;
+    long isolationMicros = 0;
+    long executeMicros = 0;
+
+    // One JSON object, written one per line
+    std::string toJson() const;
+};
+
+class ColdStartRunner
+{
+  public:
+    /**
+     * The spec is the same as for the microbench runner, i.e. lines of
+     * <user>,<function>,<n_runs>[,<input>]. Results are written as JSON
+     * lines. If flushing, the host is flushed between every run, and the
+     * parts a condition keeps warm are warmed again, so no run benefits from
+     * the one before.
+     */
+    static int execute(const std::string& inFile,
+                       const std::string& outFile,
+                       bool flushBetweenRuns);
+
+    static std::vector<ColdStartResult> doRun(const std::string& user,
+                                              const std::string& function,
+                                              const std::string& inputData,
+                                              const std::string& wasmVm,
+                                              ColdStartCondition condition,
+                                              int nRuns,
+                                              bool flushBetweenRuns);
+
+    // The wasm VMs supported by this build
+    static std::vector<std::string> getWasmVms();
+};
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <faabric/proto/faabric.pb.h>
+
+#include <fstream>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace runner {
+
+/*
+ * Benchmarks how OpenMP and MPI kernels scale across hosts. Each kernel is
+ * run on every number of hosts up to the number given, with every number of
+ * threads per host, by limiting the slots each host offers the scheduler.
+ * Kernels take "<size> <parallelism>" as input, where parallelism is the
+ * total number of threads or ranks. Kernels under the mpi user are run as MPI
+ * worlds of that size, and the rest are expected to fork that many OpenMP
+ * threads.
+ */
+enum class DistBenchScaling
+{
+    // The same problem size at every scale
+    Strong,
+
+    // The problem size grows with the parallelism
+    Weak,
+};
+
+struct DistBenchKernel
+{
+    std::string user;
+    std::string function;
+    DistBenchScaling scaling = DistBenchScaling::Strong;
+    long size = 0;
+};
+
+struct DistBenchSpec
+{
+    // Hosts other than this one, which is always used
+    std::vector<std::string> hosts;
+    std::vector<int> threads = { 1 };
+    int repeats = 3;
+
+    std::vector<DistBenchKernel> kernels;
+};
+
+/*
+ * Communication totals across every call in the run's exec graph. These come
+ * from the MPI and OpenMP profiles, so are only there if profiling is on on
+ * every host.
+ */
+struct DistBenchComms
+{
+    long mpiNanos = 0;
+    long mpiWaitNanos = 0;
+    long mpiBytes = 0;
+    long ompForkNanos = 0;
+    long ompBarrierNanos = 0;
+
+    void add(const faabric::Message& msg);
+};
+
+class DistBenchRunner
+{
+  public:
+    static int execute(const std::string& inFile, const std::string& outFile);
+
+    static int doRun(std::ofstream& outFs,
+                     const DistBenchSpec& spec,
+                     const DistBenchKernel& kernel);
+
+    /**
+     * The spec's first line holds its settings as comma-separated key=value
+     * pairs, where hosts and threads are space-separated lists, and the rest
+     * are <user>,<function>,<strong|weak>,<size>. Throws if the spec is
+     * invalid.
+     */
+    static DistBenchSpec parseSpec(std::istream& in);
+
+    /**
+     * Strong scaling efficiency is the speedup over the baseline divided by
+     * the increase in parallelism, and weak scaling efficiency is the
+     * baseline time over the time taken.
+     */
+    static double getEfficiency(DistBenchScaling scaling,
+                                long baselineMicros,
+                                int baselineParallelism,
+                                long micros,
+                                int parallelism);
+
+    static std::string getKernelInput(const DistBenchKernel& kernel,
+                                      int parallelism);
+};
+}
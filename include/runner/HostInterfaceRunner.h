@@ -0,0 +1,59 @@
+#pragma once
+
+#include <faabric/proto/faabric.pb.h>
+
+#include <fstream>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace runner {
+
+/*
+ * Benchmarks the cost of individual host calls, e.g. reading state, locking
+ * mutexes or sending MPI messages. Each benchmark is a small function that
+ * makes the same host call in a loop, taking "<iterations> <size> <threads>"
+ * as its input. The time per call comes from the difference between running
+ * it with the given iterations and with none, so the rest of the function's
+ * cost drops out.
+ */
+struct HostInterfaceBench
+{
+    std::string user;
+    std::string function;
+    int iterations = 0;
+    std::vector<int> sizes;
+    std::vector<int> threads;
+};
+
+struct HostInterfaceResult
+{
+    double nanosPerCall = 0;
+    double callsPerSec = 0;
+};
+
+class HostInterfaceRunner
+{
+  public:
+    static int execute(const std::string& inFile, const std::string& outFile);
+
+    static int doRun(std::ofstream& outFs,
+                     const HostInterfaceBench& bench,
+                     const std::string& wasmVm);
+
+    /**
+     * Lines are <user>,<function>,<iterations>,<sizes>,<threads>, where sizes
+     * and threads are space-separated lists, and every combination of the two
+     * is run. Throws if the spec is invalid.
+     */
+    static std::vector<HostInterfaceBench> parseSpec(std::istream& in);
+
+    // Each of the given threads makes the given number of calls
+    static HostInterfaceResult getResult(long baselineMicros,
+                                         long runMicros,
+                                         int iterations,
+                                         int threads);
+
+    static std::string getBenchInput(int iterations, int size, int threads);
+};
+}
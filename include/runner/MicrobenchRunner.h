@@ -1,9 +1,56 @@
+#pragma once
+
 #include <faabric/proto/faabric.pb.h>
 
+#include <istream>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace runner {
+
+enum class LoadArrivalProcess
+{
+    Constant,
+    Poisson,
+};
+
+struct LoadFunction
+{
+    std::string user;
+    std::string function;
+    std::string inputData;
+
+    // Share of requests going to this function, relative to the others
+    double weight = 1;
+};
+
+/*
+ * Open-loop load runs send requests at a target rate regardless of how quickly
+ * earlier ones finish, with up to the given number outstanding at once.
+ * Latencies are measured from when each request was due to be sent, so time
+ * spent waiting for a free slot counts against them. Requests due during the
+ * warmup aren't included in the results.
+ */
+struct LoadSpec
+{
+    double rate = 10;
+    int durationSecs = 10;
+    int warmupSecs = 0;
+    int concurrency = 1;
+    LoadArrivalProcess arrival = LoadArrivalProcess::Poisson;
+    unsigned int seed = 0;
+    bool forceLocal = false;
+
+    std::vector<LoadFunction> functions;
+};
+
+struct LoadArrival
+{
+    long offsetNanos = 0;
+    int functionIdx = 0;
+};
+
 class MicrobenchRunner
 {
   public:
@@ -15,9 +62,39 @@ class MicrobenchRunner
                      int nRuns,
                      const std::string& inputData);
 
+    // The time spent in each phase of the call, as CSV columns
+    static std::string getPhaseColumns(const faabric::Message& res,
+                                       long sentMicros,
+                                       long receivedMicros);
+
+    // The call's hardware performance counters, as CSV columns
+    static std::string getPerfColumns(const faabric::Message& res);
+
     static std::shared_ptr<faabric::BatchExecuteRequest> createBatchRequest(
       const std::string& user,
       const std::string& function,
-      const std::string& inputData);
+      const std::string& inputData,
+      bool forceLocal = true);
+
+    // ----- Open-loop load -----
+
+    static int executeLoad(const std::string& inFile,
+                           const std::string& outFile);
+
+    static int doLoadRun(std::ofstream& outFs, const LoadSpec& spec);
+
+    /**
+     * The spec's first line holds its settings as comma-separated key=value
+     * pairs, and the rest are <user>,<function>,<weight>[,<input>]. Throws
+     * if the spec is invalid.
+     */
+    static LoadSpec parseLoadSpec(std::istream& in);
+
+    // Every request in the run, warmup included, in the order they're due
+    static std::vector<LoadArrival> getLoadSchedule(const LoadSpec& spec);
+
+    // Nearest-rank percentile of already sorted values
+    static float getPercentile(const std::vector<float>& sorted,
+                               double percentile);
 };
 }
@@ -1,9 +1,39 @@
 #pragma once
 
+#include <faabric/proto/faabric.pb.h>
+#include <faabric/util/timing.h>
+
 #include <boost/program_options.hpp>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace po = boost::program_options;
 
 namespace runner {
 po::variables_map parseRunnerCmdLine(int argc, char* argv[]);
+
+/**
+ * Reads one input per line, skipping empty lines. Messages in a batch take
+ * these in turn, starting again from the first if there are more messages
+ * than inputs.
+ */
+std::vector<std::string> readBatchInputs(std::istream& in);
+
+/**
+ * Builds the batch described by the runner command line, i.e. batch-size
+ * messages with inputs from input-file if given, or otherwise all with the
+ * same input-data.
+ */
+std::shared_ptr<faabric::BatchExecuteRequest> createRunnerBatch(
+  const po::variables_map& vm);
+
+/**
+ * Waits for every message in the batch, logging how long the whole batch
+ * took since it was submitted. Throws if any of them failed.
+ */
+void awaitRunnerBatch(std::shared_ptr<faabric::BatchExecuteRequest> req,
+                      int timeoutMs,
+                      const faabric::util::TimePoint& start);
 }
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+namespace storage {
+
+struct ArtefactCacheStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t bytes = 0;
+    size_t nBlobs = 0;
+};
+
+/**
+ * Host-wide store of the artefacts the file loader has downloaded, kept as
+ * blobs under ARTEFACT_CACHE_DIR and keyed by their content hash (the S3
+ * ETag). The files callers see in the function, object and shared files
+ * directories are hard links to the blobs, so identical artefacts are only
+ * stored once however many users have them, and clearing those directories
+ * doesn't lose the blobs. Shared files are copied out rather than linked, as
+ * functions can write to them.
+ *
+ * Once the blobs take up more than ARTEFACT_CACHE_BUDGET_MB, the least
+ * recently used ones are removed along with the files made from them. Zero
+ * means there's no limit.
+ */
+class ArtefactCache
+{
+  public:
+    ArtefactCache();
+
+    /**
+     * Puts the blob with the given hash at the path, returning false (and
+     * counting a miss) if there's no such blob.
+     */
+    bool fetch(const std::string& hash, const std::string& path, bool copy);
+
+    // Where to download a missing blob before inserting it
+    std::string getDownloadPath(const std::string& hash);
+
+    /**
+     * Moves the downloaded file into the store as the blob for the hash, puts
+     * it at the path, and evicts whatever is needed to stay within budget.
+     */
+    void insert(const std::string& hash,
+                const std::string& downloadPath,
+                const std::string& path,
+                bool copy);
+
+    // Counts a hit on a file that was already where the caller wanted it
+    void touch(const std::string& path);
+
+    // Called once the files made from blobs have been removed
+    void forgetPaths();
+
+    void clear();
+
+    ArtefactCacheStats getStats();
+
+  private:
+    struct Blob
+    {
+        size_t size = 0;
+        uint64_t lastUsed = 0;
+
+        // Files linked to, or copied from, this blob
+        std::set<std::string> paths;
+    };
+
+    std::mutex mx;
+    std::string dir;
+    bool scanned = false;
+    uint64_t useCount = 0;
+
+    std::unordered_map<std::string, Blob> blobs;
+    std::unordered_map<std::string, std::string> pathHashes;
+    ArtefactCacheStats stats;
+
+    void scanDir();
+
+    std::string getBlobPath(const std::string& hash);
+
+    void placeBlob(const std::string& hash,
+                   Blob& blob,
+                   const std::string& path,
+                   bool copy);
+
+    void evictToBudget(const std::string& keepHash);
+};
+
+ArtefactCache& getArtefactCache();
+}
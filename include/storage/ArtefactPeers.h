@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+
+#define ARTEFACT_PEERS_STATE_USER "_artefacts"
+
+namespace storage {
+
+/*
+ * Optional peer tier for artefact downloads, switched on with
+ * ARTEFACT_PEER_FETCH=on when state is in-memory. The first host to download
+ * an artefact from S3 publishes it as a state value keyed by its hash, and
+ * becomes its master. Other hosts then pull it from that host, rather than
+ * from S3, and drop their state replica once it's on disk. The publishing
+ * host keeps the value in memory for as long as it runs.
+ *
+ * Each artefact is served by one host, as faabric state has a single master
+ * per key. There's no fan-out from hosts that have pulled it since.
+ */
+
+bool isArtefactPeerFetchEnabled();
+
+/**
+ * Writes the artefact with the given hash to the file if another host holds
+ * it, returning false if none does or the fetch failed.
+ */
+bool fetchArtefactFromPeer(const std::string& hash,
+                           const std::string& filePath);
+
+// Offers the downloaded artefact to other hosts, unless one already does
+void shareArtefactWithPeers(const std::string& hash,
+                            const std::string& filePath);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#define CODEGEN_MANIFEST_FILENAME "codegen.manifest"
+
+// Shared objects aren't owned by a user, so share a single manifest
+#define SHARED_OBJ_MANIFEST_SCOPE "_shared_obj"
+
+namespace storage {
+
+// Everything that determines the machine code generated for a given artefact.
+// If any of these change, the artefact must be regenerated.
+struct CodegenManifestEntry
+{
+    std::string hash;
+    std::string compilerVersion;
+    std::string options;
+
+    bool empty() const { return hash.empty(); }
+
+    bool operator==(const CodegenManifestEntry& other) const
+    {
+        return hash == other.hash && compilerVersion == other.compilerVersion &&
+               options == other.options;
+    }
+
+    bool operator!=(const CodegenManifestEntry& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+/**
+ * The codegen manifest maps the keys of generated artefacts (object files and
+ * AOT files) to the entry they were generated from. There is one manifest per
+ * user (and one for all shared objects), so that checking whether a set of
+ * functions needs codegen costs a single request to object storage.
+ *
+ * The manifest is not thread-safe, callers must synchronise access.
+ */
+class CodegenManifest
+{
+  public:
+    CodegenManifest() = default;
+
+    explicit CodegenManifest(const std::vector<uint8_t>& bytes);
+
+    std::vector<uint8_t> toBytes() const;
+
+    // Returns an empty entry if the key is not present
+    CodegenManifestEntry getEntry(const std::string& key) const;
+
+    void setEntry(const std::string& key, const CodegenManifestEntry& entry);
+
+    size_t size() const { return entries.size(); }
+
+  private:
+    std::map<std::string, CodegenManifestEntry> entries;
+};
+
+// Hashes codegen inputs, returning the digest as a hex string
+std::string hashCodegenInput(const std::vector<uint8_t>& bytes);
+}
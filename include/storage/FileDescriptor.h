@@ -2,6 +2,7 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -57,6 +58,19 @@ class DirEnt
     std::string path;
 };
 
+/**
+ * Lists a directory on disk, reading entries in large getdents64 batches
+ * rather than one readdir call at a time. Cookies count from one, in the
+ * order the entries were read.
+ */
+std::vector<DirEnt> readDirEntries(const std::string& realPath);
+
+// Forgets the cached listing of the shared directory holding the path
+void clearSharedDirListingFor(const std::string& sharedPath);
+
+// Forgets the cached listings of all shared directories
+void clearSharedDirListings();
+
 class Stat
 {
   public:
@@ -96,7 +110,10 @@ class FileDescriptor
 
     void iterReset();
 
-    size_t copyDirentsToWasiBuffer(uint8_t* buffer, size_t bufferLen);
+    // Copies entries from the one with the given cookie on, as fd_readdir
+    size_t copyDirentsToWasiBuffer(uint8_t* buffer,
+                                   size_t bufferLen,
+                                   uint64_t cookie);
 
     Stat stat(const std::string& relativePath = "");
 
@@ -117,6 +134,26 @@ class FileDescriptor
 
     ssize_t write(std::vector<::iovec>& nativeIovecs, int iovecCount);
 
+    // Positional reads and writes go straight to and from the iovecs, and
+    // don't move the offset. These return -1 on failure.
+    ssize_t pread(std::vector<::iovec>& nativeIovecs,
+                  int iovecCount,
+                  uint64_t offset);
+
+    ssize_t pwrite(std::vector<::iovec>& nativeIovecs,
+                   int iovecCount,
+                   uint64_t offset);
+
+    /**
+     * Copies up to count bytes to the other descriptor without them passing
+     * through the module, like sendfile. Reads from the offset if given, and
+     * updates it, otherwise from the current position.
+     */
+    ssize_t sendTo(FileDescriptor& outDesc, off_t* offset, size_t count);
+
+    // Flushes the file to disk, and any writes to a shared file to S3
+    bool sync();
+
     void close() const;
 
     bool mkdir(const std::string& dirPath);
@@ -167,8 +204,11 @@ class FileDescriptor
 
     uint16_t wasiErrno = 0;
 
+    // Listings never change once loaded, so copies of the descriptor share
+    // them rather than copying every entry. Entry i has cookie i + 1, so
+    // reads from a cookie go straight to the entry.
     bool dirContentsLoaded = false;
-    std::vector<DirEnt> dirContents;
+    std::shared_ptr<const std::vector<DirEnt>> dirContents = nullptr;
     int dirContentsIdx = 0;
 };
 }
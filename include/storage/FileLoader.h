@@ -1,6 +1,8 @@
 #pragma once
 
 #include <conf/FaasmConfig.h>
+#include <storage/CodegenManifest.h>
+#include <storage/FunctionMetadata.h>
 #include <storage/S3Wrapper.h>
 
 #include <faabric/util/config.h>
@@ -15,7 +17,8 @@
 
 #define SHARED_OBJ_EXT ".o"
 
-#define HASH_EXT ".md5"
+// Name of a function's wasm, as recorded in its metadata
+#define FUNC_FILENAME "function.wasm"
 
 #define PYTHON_USER "python"
 #define PYTHON_FUNC "py_func"
@@ -23,6 +26,12 @@
 
 namespace storage {
 
+/*
+ * The load* methods return a file's contents, while the cache* methods make
+ * sure it's in the local cache and return its path there. The latter stream
+ * straight from S3 to disk, so are preferable for big files that the caller
+ * doesn't need in memory.
+ */
 class FileLoader
 {
   public:
@@ -32,8 +41,6 @@ class FileLoader
 
     void clearLocalCache();
 
-    std::string getHashFilePath(const std::string& path);
-
     // ----- Function wasm -----
     std::string getFunctionFile(const faabric::Message& msg);
 
@@ -42,37 +49,61 @@ class FileLoader
     void uploadFunction(faabric::Message& msg);
 
     // ----- Function object files -----
-    std::string getFunctionObjectFile(const faabric::Message& msg);
+    // Functions can also have object files generated for specific CPU
+    // targets. Loading an object file that isn't there gives nothing, rather
+    // than an error.
+    std::string getFunctionObjectFile(const faabric::Message& msg,
+                                      const std::string& target = "");
 
-    std::vector<uint8_t> loadFunctionObjectFile(const faabric::Message& msg);
+    std::vector<uint8_t> loadFunctionObjectFile(const faabric::Message& msg,
+                                                const std::string& target = "");
 
-    std::vector<uint8_t> loadFunctionObjectHash(const faabric::Message& msg);
+    std::string cacheFunctionObjectFile(const faabric::Message& msg);
 
     void uploadFunctionObjectFile(const faabric::Message& msg,
-                                  const std::vector<uint8_t>& objBytes);
-
-    void uploadFunctionObjectHash(const faabric::Message& msg,
-                                  const std::vector<uint8_t>& hash);
+                                  const std::vector<uint8_t>& objBytes,
+                                  const std::string& target = "");
 
     // ----- Function WAMR AoT files -----
     std::string getFunctionAotFile(const faabric::Message& msg);
 
     std::vector<uint8_t> loadFunctionWamrAotFile(const faabric::Message& msg);
 
-    std::vector<uint8_t> loadFunctionWamrAotHash(const faabric::Message& msg);
+    std::string cacheFunctionWamrAotFile(const faabric::Message& msg);
 
     void uploadFunctionWamrAotFile(const faabric::Message& msg,
                                    const std::vector<uint8_t>& objBytes);
 
-    void uploadFunctionWamrAotHash(const faabric::Message& msg,
-                                   const std::vector<uint8_t>& hash);
-
     // ----- Encrypted function wasm -----
     std::string getEncryptedFunctionFile(const faabric::Message& msg);
 
     // ----- Function symbols -----
     std::string getFunctionSymbolsFile(const faabric::Message& msg);
 
+    // ----- Function preloads -----
+    // Shared modules to load and link when binding the function's zygote, one
+    // wasm path per line. Blank lines and lines starting with # are ignored
+    std::string getFunctionPreloadFile(const faabric::Message& msg);
+
+    static std::vector<std::string> parseFunctionPreloads(
+      const std::string& contents);
+
+    std::vector<std::string> loadFunctionPreloads(const faabric::Message& msg);
+
+    void uploadFunctionPreloads(const faabric::Message& msg,
+                                const std::vector<std::string>& paths);
+
+    // ----- Function metadata -----
+    // Uploading any of the function's artefacts records it in the metadata.
+    // Functions without metadata get an empty one.
+    std::string getFunctionMetadataFile(const faabric::Message& msg);
+
+    FunctionMetadata loadFunctionMetadata(const faabric::Message& msg);
+
+    // Sets the given hints in the function's metadata, leaving the rest
+    void recordFunctionHints(const faabric::Message& msg,
+                             const std::map<std::string, std::string>& hints);
+
     // ----- Shared object wasm -----
     std::vector<uint8_t> loadSharedObjectWasm(const std::string& path);
 
@@ -81,24 +112,68 @@ class FileLoader
 
     std::vector<uint8_t> loadSharedObjectObjectFile(const std::string& path);
 
-    std::vector<uint8_t> loadSharedObjectObjectHash(const std::string& path);
+    std::string cacheSharedObjectObjectFile(const std::string& path);
 
     void uploadSharedObjectObjectFile(const std::string& path,
                                       const std::vector<uint8_t>& objBytes);
 
-    void uploadSharedObjectObjectHash(const std::string& path,
-                                      const std::vector<uint8_t>& hash);
+    // ----- Codegen manifests -----
+    std::string getCodegenManifestFile(const std::string& scope);
+
+    std::vector<uint8_t> loadCodegenManifest(const std::string& scope);
+
+    void uploadCodegenManifest(const std::string& scope,
+                               const std::vector<uint8_t>& bytes);
+
+    // Sets the given entries in the manifest, leaving the rest. Starts from
+    // the latest manifest in S3, not a locally cached copy.
+    void recordCodegenManifestEntries(
+      const std::string& scope,
+      const std::vector<std::pair<std::string, CodegenManifestEntry>>& entries);
+
+    // Key of a function's machine code in its user's manifest, which depends
+    // on the WASM VM
+    std::string getFunctionCodegenKey(const faabric::Message& msg);
+
+    std::string getSharedObjectCodegenKey(const std::string& path);
 
     // ----- Shared files -----
     std::string getSharedFileFile(const std::string& path);
 
     std::vector<uint8_t> loadSharedFile(const std::string& path);
 
+    std::string cacheSharedFile(const std::string& path);
+
+    // Size and byte ranges of a shared file, for reading it a chunk at a time
+    size_t getSharedFileSize(const std::string& path);
+
+    void loadSharedFileRange(const std::string& path,
+                             size_t offset,
+                             uint8_t* buffer,
+                             size_t len);
+
     void deleteSharedFile(const std::string& path);
 
+    // Names of the shared files and directories (ending in a slash) directly
+    // inside the given shared directory
+    std::vector<std::string> listSharedDirectory(const std::string& dir);
+
     void uploadSharedFile(const std::string& path,
                           const std::vector<uint8_t>& fileBytes);
 
+    // Whether the stored shared file has exactly these contents, going by
+    // its ETag. Files uploaded in parts don't have an MD5 for an ETag, so
+    // never match.
+    bool isSharedFileUnchanged(const std::string& path,
+                               const std::vector<uint8_t>& fileBytes);
+
+    // Uploads the shared file from its local copy, which has only been
+    // written in the given [start, end) ranges since it was last uploaded.
+    // Only the parts written are sent where S3 can copy the rest.
+    void uploadSharedFileRanges(
+      const std::string& path,
+      const std::vector<std::pair<size_t, size_t>>& dirtyRanges);
+
     // ----- Python files -----
     std::string getPythonFunctionSharedFilePath(const faabric::Message& msg);
 
@@ -114,25 +189,30 @@ class FileLoader
 
     bool useLocalFsCache = true;
 
+    void recordFunctionArtefact(const faabric::Message& msg,
+                                const std::string& name,
+                                const std::vector<uint8_t>& bytes);
+
     std::vector<uint8_t> doCodegen(std::vector<uint8_t>& bytes,
                                    const std::string& fileName,
                                    bool isSgx = false);
 
+    std::string loadFileToCache(const std::string& path,
+                                const std::string& localCachePath,
+                                bool tolerateMissing = false);
+
+    std::string downloadFileToCache(const std::string& pathCopy,
+                                    const std::string& localCachePath,
+                                    bool tolerateMissing);
+
     std::vector<uint8_t> loadFileBytes(const std::string& path,
                                        const std::string& localCachePath,
                                        bool tolerateMissing = false);
 
-    std::vector<uint8_t> loadHashFileBytes(const std::string& path,
-                                           const std::string& localCachePath);
-
     void uploadFileBytes(const std::string& path,
                          const std::string& localCachePath,
                          const std::vector<uint8_t>& bytes);
 
-    void uploadHashFileBytes(const std::string& path,
-                             const std::string& localCachePath,
-                             const std::vector<uint8_t>& bytes);
-
     void uploadFileString(const std::string& path,
                           const std::string& localCachePath,
                           const std::string& bytes);
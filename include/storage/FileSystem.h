@@ -4,12 +4,35 @@
 
 #include <faabric/proto/faabric.pb.h>
 
-#include <unordered_map>
+#include <vector>
 
 namespace storage {
+
+struct FileDescriptorSlot
+{
+    bool inUse = false;
+
+    // Copies of a filesystem share the Linux fds that were open when it was
+    // copied, so only the one that opened an fd closes it
+    bool owned = false;
+
+    storage::FileDescriptor desc;
+};
+
+/**
+ * The fds of a module. Fds are allocated sequentially, so they index straight
+ * into a table, with closed ones reused. The table is copied whenever a
+ * module is cloned or reset, so descriptors are kept cheap to copy.
+ */
 class FileSystem
 {
   public:
+    FileSystem() = default;
+
+    FileSystem(const FileSystem& other);
+
+    FileSystem& operator=(const FileSystem& other);
+
     void prepareFilesystem();
 
     bool fileDescriptorExists(int fd);
@@ -28,6 +51,9 @@ class FileSystem
 
     int dup(int fd);
 
+    // Returns false if there's no such fd. Stdio and preopened fds are kept.
+    bool closeFileDescriptor(int fd);
+
     void tearDown();
 
     std::string getPathForFd(int fd);
@@ -35,10 +61,12 @@ class FileSystem
     void printDebugInfo();
 
   private:
-    int nextFd;
+    std::vector<FileDescriptorSlot> fileDescriptors;
 
-    std::unordered_map<int, storage::FileDescriptor> fileDescriptors;
+    std::vector<int> freeFds;
 
     int getNewFd();
+
+    void addFileDescriptor(int fd, const storage::FileDescriptor& fileDesc);
 };
 }
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#define FUNC_METADATA_FILENAME "function.meta"
+
+namespace storage {
+
+struct FunctionArtefact
+{
+    std::string hash;
+    size_t size = 0;
+
+    bool empty() const { return hash.empty(); }
+};
+
+/**
+ * A function's metadata lists the artefacts uploaded for it (wasm, machine
+ * code, preload list etc.), keyed by file name, along with free-form hints
+ * for the runtime. It's stored next to the artefacts, so a host can find out
+ * everything it has for a function with a single request to object storage,
+ * rather than probing for each artefact.
+ *
+ * Metadata is not thread-safe, callers must synchronise access.
+ */
+class FunctionMetadata
+{
+  public:
+    FunctionMetadata() = default;
+
+    explicit FunctionMetadata(const std::vector<uint8_t>& bytes);
+
+    std::vector<uint8_t> toBytes() const;
+
+    // Functions uploaded before metadata existed have none
+    bool empty() const { return artefacts.empty() && hints.empty(); }
+
+    // Returns an empty artefact if it is not present
+    FunctionArtefact getArtefact(const std::string& name) const;
+
+    bool hasArtefact(const std::string& name) const;
+
+    void setArtefact(const std::string& name,
+                     const std::vector<uint8_t>& bytes);
+
+    const std::map<std::string, FunctionArtefact>& getArtefacts() const
+    {
+        return artefacts;
+    }
+
+    // Returns an empty string if the hint is not set
+    std::string getHint(const std::string& key) const;
+
+    void setHint(const std::string& key, const std::string& value);
+
+  private:
+    std::map<std::string, FunctionArtefact> artefacts;
+    std::map<std::string, std::string> hints;
+};
+}
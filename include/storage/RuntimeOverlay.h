@@ -0,0 +1,63 @@
+#pragma once
+
+#include <storage/FileDescriptor.h>
+
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace storage {
+
+struct RuntimeOverlayEntry
+{
+    struct stat nativeStat
+    {};
+
+    // Only set for directories, including . and .., and shared with the
+    // descriptors listing them
+    std::shared_ptr<const std::vector<DirEnt>> children = nullptr;
+};
+
+/**
+ * In-memory index of the runtime root directories listed in
+ * RUNTIME_OVERLAY_DIRS, built once per host. As these directories never
+ * change, stats and directory listings of paths in them are answered from the
+ * index, as are opens of paths that don't exist, which is most of what CPython
+ * does when importing. Opens of files that do exist still go to the
+ * filesystem, as reads need a real fd.
+ *
+ * Paths are relative to the runtime root.
+ */
+class RuntimeOverlay
+{
+  public:
+    RuntimeOverlay();
+
+    RuntimeOverlay(const std::string& rootDirIn, const std::string& dirsIn);
+
+    // Whether the path is in one of the overlay's directories
+    bool covers(const std::string& path) const;
+
+    // Returns the index entry for the path, or null if it doesn't exist
+    const RuntimeOverlayEntry* lookUp(const std::string& path) const;
+
+    size_t getNPaths() const { return entries.size(); }
+
+  private:
+    std::string rootDir;
+
+    std::vector<std::string> dirs;
+
+    std::unordered_map<std::string, RuntimeOverlayEntry> entries;
+
+    // Ancestors are the devices and inodes of the directories above, so that
+    // links back up the tree aren't followed forever
+    void indexDir(const std::string& dir,
+                  std::vector<std::pair<dev_t, ino_t>>& ancestors);
+};
+
+RuntimeOverlay& getRuntimeOverlay();
+}
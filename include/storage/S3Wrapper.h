@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
@@ -15,6 +16,13 @@
 #define S3_REQUEST_TIMEOUT_MS 10000
 #define S3_CONNECT_TIMEOUT_MS 500
 
+// No single request moves more than one part, so the request timeout is
+// stretched to cover a part at this (pessimistic) rate
+#define S3_MIN_BYTES_PER_MS 1024
+
+// S3 rejects multipart uploads with smaller parts than this, bar the last
+#define S3_MIN_PART_BYTES (5 * 1024 * 1024)
+
 namespace storage {
 
 void initFaasmS3();
@@ -34,6 +42,11 @@ class S3Wrapper
 
     std::vector<std::string> listKeys(const std::string& bucketName);
 
+    // Lists what's directly under the prefix, as with a directory, with
+    // sub-directories ending in a slash
+    std::vector<std::string> listDirectory(const std::string& bucketName,
+                                           const std::string& prefix);
+
     void deleteKey(const std::string& bucketName, const std::string& keyName);
 
     void addKeyBytes(const std::string& bucketName,
@@ -51,9 +64,68 @@ class S3Wrapper
     std::string getKeyStr(const std::string& bucketName,
                           const std::string& keyName);
 
+    // Streams the object straight to the given file, rather than buffering
+    // it in memory. Returns false if the key is missing and tolerated
+    bool getKeyToFile(const std::string& bucketName,
+                      const std::string& keyName,
+                      const std::string& filePath,
+                      bool tolerateMissing = false);
+
+    // Returns the object's ETag, which identifies its contents, or an empty
+    // string if the key is missing
+    std::string getKeyETag(const std::string& bucketName,
+                           const std::string& keyName);
+
+    // Returns the object's size in bytes, or -1 if the key is missing
+    int64_t getKeySize(const std::string& bucketName,
+                       const std::string& keyName);
+
+    /**
+     * Uploads the file to the key, which only differs from it in the given
+     * [start, end) byte ranges. Parts of the object without any of those
+     * bytes are copied within S3 rather than uploaded. Returns false without
+     * uploading anything if nothing can be copied, e.g. if the key is
+     * missing or the file fits in one part.
+     */
+    bool updateKeyFromFile(
+      const std::string& bucketName,
+      const std::string& keyName,
+      const std::string& filePath,
+      const std::vector<std::pair<size_t, size_t>>& dirtyRanges);
+
+    // Reads len bytes of the object from the given offset into the buffer
+    void getKeyRange(const std::string& bucketName,
+                     const std::string& keyName,
+                     size_t offset,
+                     uint8_t* buffer,
+                     size_t len);
+
   private:
     const conf::FaasmConfig& faasmConf;
     Aws::Client::ClientConfiguration clientConf;
     Aws::S3::S3Client client;
+
+    size_t getPartSize() const;
+
+    void runParts(size_t nParts, const std::function<void(size_t)>& op);
+
+    // Uploads nParts parts, sent by the given function, which returns the
+    // ETag of the part with the given number (from one)
+    void runMultipart(
+      const std::string& bucketName,
+      const std::string& keyName,
+      size_t nParts,
+      const std::function<Aws::String(const Aws::String&, int)>& sendPart);
+
+    Aws::String uploadPart(const std::string& bucketName,
+                           const std::string& keyName,
+                           const Aws::String& uploadId,
+                           int partNumber,
+                           const uint8_t* data,
+                           size_t len);
+
+    void addKeyMultipart(const std::string& bucketName,
+                         const std::string& keyName,
+                         const std::vector<uint8_t>& data);
 };
 }
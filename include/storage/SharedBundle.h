@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// A bundle is uploaded as this file in the shared directory it holds
+#define SHARED_BUNDLE_NAME ".faasm_bundle"
+
+#define SHARED_BUNDLE_MAGIC "FAASMBDL"
+#define SHARED_BUNDLE_VERSION 1
+
+namespace storage {
+
+struct SharedBundleEntry
+{
+    size_t offset = 0;
+    size_t size = 0;
+};
+
+/**
+ * Builds a bundle of the given files, keyed by their paths relative to the
+ * directory the bundle will be uploaded to. Directories are implied by the
+ * paths.
+ *
+ * The layout is the magic string, then the version and number of files as
+ * uint32s, then for each file its offset and size as uint64s, its path length
+ * as a uint32 and its path, followed by the contents of the files. Offsets
+ * are from the start of the bundle, and everything is little-endian.
+ */
+std::vector<uint8_t> buildSharedBundle(
+  const std::map<std::string, std::vector<uint8_t>>& files);
+
+// Throws if the bytes aren't a bundle
+void validateSharedBundle(const std::vector<uint8_t>& bytes);
+
+// The files in a bundle by path, throwing if the bytes aren't a bundle
+std::unordered_map<std::string, SharedBundleEntry> getSharedBundleEntries(
+  const std::vector<uint8_t>& bytes);
+
+/**
+ * A bundle that's been downloaded and mapped into memory. Files in it are
+ * opened as sealed memfds, so they're never extracted to disk.
+ */
+class SharedBundle
+{
+  public:
+    explicit SharedBundle(const std::string& filePathIn);
+
+    ~SharedBundle();
+
+    SharedBundle(const SharedBundle&) = delete;
+    SharedBundle& operator=(const SharedBundle&) = delete;
+
+    bool isFile(const std::string& path) const;
+
+    bool isDir(const std::string& path) const;
+
+    // Names of the files and directories immediately inside the directory
+    std::vector<std::string> listDir(const std::string& path) const;
+
+    // Returns a read-only fd for the file, or -1 with errno set
+    int openFile(const std::string& path) const;
+
+    // Fills in the stat for a file or directory as if it were on disk
+    void statPath(const std::string& path, struct stat& nativeStat) const;
+
+    std::vector<uint8_t> readFile(const std::string& path) const;
+
+    size_t getNFiles() const { return files.size(); }
+
+  private:
+    std::string filePath;
+
+    uint8_t* data = nullptr;
+    size_t dataSize = 0;
+
+    struct stat bundleStat
+    {};
+
+    std::unordered_map<std::string, SharedBundleEntry> files;
+    std::unordered_set<std::string> dirs;
+
+    const SharedBundleEntry& getEntry(const std::string& path) const;
+};
+}
@@ -2,8 +2,18 @@
 
 #include <faabric/proto/faabric.pb.h>
 
+#include <storage/SharedBundle.h>
+
+#include <cstddef>
+#include <memory>
 #include <string>
 
+// How long a shared file found to be missing, or a listing of a shared
+// directory, is trusted before checking again
+#define SHARED_FILE_LOOKUP_TTL_MS 10000
+
+#define SHARED_FILE_SHARDS 32
+
 namespace storage {
 class SharedFiles
 {
@@ -13,6 +23,15 @@ class SharedFiles
 
     static void clearCacheForSharedFile(const std::string& sharedPath);
 
+    /**
+     * Returns the bundle serving a synced shared file or directory, or null if
+     * it's not from a bundle. Files from bundles aren't on disk, so must be
+     * opened and stat-ed through the bundle.
+     */
+    static std::shared_ptr<SharedBundle> getBundleForSharedFile(
+      const std::string& sharedPath,
+      std::string& pathInBundle);
+
     static std::string realPathForSharedFile(const std::string& sharedPath);
 
     static std::string stripSharedPrefix(const std::string& sharedPath);
@@ -21,8 +40,28 @@ class SharedFiles
 
     static void deleteSharedFile(const std::string& p);
 
+    // Uploads the whole of the shared file straight away
     static void updateSharedFile(const std::string& p);
 
+    /**
+     * Records a write of len bytes at the offset of the shared file. Writes
+     * are uploaded together SHARED_FILE_WRITE_BACK_MS after the first, only
+     * sending the parts of the file written, or straight away if that's zero.
+     * Other hosts only see writes once they're uploaded.
+     */
+    static void writeSharedFile(const std::string& p,
+                                size_t offset,
+                                size_t len);
+
+    // Uploads any writes to the shared file not yet uploaded, throwing if
+    // they can't be. This is the point at which they're durable.
+    static void flushSharedFile(const std::string& p);
+
+    static void flushSharedFiles();
+
+    // Shared files with writes not yet uploaded
+    static size_t getDirtySharedFileCount();
+
     static void syncPythonFunctionFile(const faabric::Message& msg);
 
     static void clear();
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace isolation {
+
+// Parses a kernel CPU list, e.g. "0-3,8,10-11"
+std::vector<int> parseCpuList(const std::string& cpuList);
+
+// CPUs on each of this host's NUMA nodes. Without NUMA information the host
+// is one node with all its CPUs.
+const std::vector<std::vector<int>>& getNumaNodeCpus();
+
+/**
+ * The order CPUs are handed to executor threads in. "compact" fills one node
+ * before moving on to the next, "scatter" goes round the nodes in turn.
+ */
+std::vector<int> getCpuPlacementOrder(
+  const std::string& policy,
+  const std::vector<std::vector<int>>& nodeCpus);
+
+/**
+ * Pins the calling thread to the least used CPU under AFFINITY_POLICY, and
+ * has its memory allocated on that CPU's node where possible. Linear memory
+ * is faulted in by the thread executing the function, so it ends up on the
+ * same node. The CPU is given back when the thread exits. Does nothing if
+ * the policy is off.
+ */
+void pinCurrentThread();
+
+int getCurrentNumaNode();
+
+// Keeps the calling thread on the node's CPUs and memory, e.g. for OpenMP
+// threads that should stay on their team's socket. Does nothing if
+// AFFINITY_POLICY is off.
+void bindCurrentThreadToNumaNode(int node);
+}
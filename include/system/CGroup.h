@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #define BASE_CGROUP_NAME "faasm"
 
@@ -10,6 +11,31 @@ enum CgroupMode
     cg_on
 };
 
+enum CgroupVersion
+{
+    cg_v1,
+    cg_v2
+};
+
+struct CGroupUsage
+{
+    // Total CPU time used by the group's threads
+    uint64_t cpuMicros = 0;
+
+    // Memory charged to the group. Under cgroup v2 this is only there for the
+    // base group, as memory can't be split between threads of one process.
+    uint64_t memoryBytes = 0;
+};
+
+/**
+ * A cgroup Faaslet threads join. This is either the base group, or one under
+ * it per user or function (see CGROUP_GRANULARITY), which is created with the
+ * configured CPU limits the first time a thread joins it. Each group gets the
+ * same weight, so CPU is shared between tenants rather than between threads.
+ *
+ * Works with both the v1 cpu hierarchy and the v2 unified hierarchy, in which
+ * the groups under the base group are threaded.
+ */
 class CGroup
 {
   public:
@@ -17,12 +43,34 @@ class CGroup
 
     void addCurrentThread();
 
+    // Fields that can't be read for the group are left as zero
+    CGroupUsage getUsage();
+
     const std::string getName();
 
     const CgroupMode getMode();
 
+    const CgroupVersion getVersion();
+
   private:
     std::string name;
     CgroupMode mode;
+    CgroupVersion version;
+
+    void createGroup();
 };
+
+CgroupVersion getCgroupVersion();
+
+// Name of the group the function's threads join, e.g. faasm/demo.echo
+std::string getCgroupNameForFunction(const std::string& user,
+                                     const std::string& function);
+
+// As above, but with the given granularity rather than CGROUP_GRANULARITY
+std::string getCgroupNameForFunction(const std::string& user,
+                                     const std::string& function,
+                                     const std::string& granularity);
+
+// Returns the usage_usec field of a v2 cpu.stat file
+uint64_t parseCpuStatUsage(const std::string& cpuStat);
 }
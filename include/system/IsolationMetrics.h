@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+namespace isolation {
+
+/**
+ * Host-wide counts of the work done isolating executor threads. Threads are
+ * only isolated again when they move to a different tenant, so most tasks
+ * should be counted as reused.
+ */
+struct IsolationMetrics
+{
+    uint64_t cgroupAdds = 0;
+    uint64_t cgroupAddMicros = 0;
+
+    uint64_t netNsAdds = 0;
+    uint64_t netNsAddMicros = 0;
+
+    // Tasks run on a thread already isolated for their tenant
+    uint64_t reused = 0;
+};
+
+void recordCgroupAdd(uint64_t micros);
+
+void recordNetNsAdd(uint64_t micros);
+
+void recordIsolationReused();
+
+IsolationMetrics getIsolationMetrics();
+
+void resetIsolationMetrics();
+}
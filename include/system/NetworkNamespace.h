@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <shared_mutex>
 #include <string>
@@ -7,25 +9,93 @@
 #define BASE_NETNS_NAME "faasmns"
 
 namespace isolation {
+
+struct NetworkNamespaceCounters
+{
+    // Bytes sent out of and in to the namespace
+    uint64_t egressBytes = 0;
+    uint64_t ingressBytes = 0;
+};
+
 class NetworkNamespace
 {
   public:
     explicit NetworkNamespace(const std::string& name);
 
+    ~NetworkNamespace();
+
+    NetworkNamespace(const NetworkNamespace&) = delete;
+    NetworkNamespace& operator=(const NetworkNamespace&) = delete;
+
     void addCurrentThread();
 
     void removeCurrentThread();
 
     const std::string getName();
 
+    // Opens the namespace if it isn't already, returning false if it doesn't
+    // exist
+    bool open();
+
+    /**
+     * Caps traffic leaving the namespace at the user's egress rate, if there
+     * is one. This changes the rate of the htb class the namespace is created
+     * with, so tc is only run when the rate differs from the last one set.
+     */
+    void shapeEgress(const std::string& user);
+
+    // Read from the host side of the namespace's veth pair
+    NetworkNamespaceCounters getCounters();
+
   private:
     std::string name;
 
+    // Egress rate last applied, empty if it's as created
+    std::string egressRate;
+
+    // Kept open for as long as the namespace is in the pool, so joining it is
+    // just a setns
+    int nsFd = -1;
+
     std::shared_mutex mx;
+
+    bool openLocked();
+};
+
+struct NetworkNamespacePoolStats
+{
+    uint64_t claims = 0;
+
+    // Claims that found the pool empty, and those of them that gave up
+    uint64_t exhausted = 0;
+    uint64_t failed = 0;
+
+    uint64_t totalClaimMicros = 0;
+    uint64_t maxClaimMicros = 0;
+
+    size_t size = 0;
+    size_t free = 0;
 };
 
+/**
+ * Namespaces are created outside of Faasm (see bin/netns.sh), and the pool
+ * starts with MAX_NET_NAMESPACES of them. When it runs low, a background
+ * thread picks up any further namespaces that have been created since, so the
+ * pool can be grown without a restart. Claims on an empty pool wait up to
+ * NETNS_CLAIM_TIMEOUT_MS for a namespace to be returned or added.
+ */
 std::shared_ptr<NetworkNamespace> claimNetworkNamespace();
 
 void returnNetworkNamespace(std::shared_ptr<NetworkNamespace> ns);
 
+NetworkNamespacePoolStats getNetworkNamespacePoolStats();
+
+void resetNetworkNamespacePoolStats();
+
+// Name of the namespace the calling thread has joined, empty if none
+std::string getCurrentThreadNetworkNamespace();
+
+// Egress rate for the user's namespaces as a tc rate, e.g. 100mbit, taken from
+// NETNS_TENANT_EGRESS_RATES or NETNS_EGRESS_RATE. Empty if unshaped.
+std::string getEgressRateForUser(const std::string& user);
 }
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of times a waiting thread checks for progress before blocking
+#define LOCAL_TEAM_SPIN_ITERS 4000
+
+// Number of teams a pool runs before retiring workers none of them needed
+#define LOCAL_POOL_SHRINK_RUNS 64
+
+namespace threads {
+
+/**
+ * Synchronisation for a team of threads that all run on this host, so needs
+ * none of the point-to-point messaging used by distributed teams.
+ */
+class LocalTeam
+{
+  public:
+    explicit LocalTeam(int sizeIn);
+
+    const int size;
+
+    void barrier();
+
+    // Host-local critical section, as for a group's local lock
+    std::mutex localMx;
+
+  private:
+    std::atomic<int> nArrived = 0;
+    std::atomic<uint32_t> generation = 0;
+};
+
+std::shared_ptr<LocalTeam> getCurrentLocalTeam();
+
+void setCurrentLocalTeam(const std::shared_ptr<LocalTeam>& team);
+
+using LocalTask = std::function<int32_t(int)>;
+
+/**
+ * A pool of persistent threads for running short-lived teams on this host.
+ * The calling thread runs the first task of each team itself, and idle
+ * workers spin for a while before blocking, so back-to-back teams avoid most
+ * wake-ups. Workers are only started once a team needs them, and those that
+ * no team has needed for a while are stopped again, so the pool follows the
+ * parallelism actually in use. With an AFFINITY_POLICY set, the workers run on
+ * the same NUMA node as the thread that creates the pool.
+ */
+class LocalThreadPool
+{
+  public:
+    explicit LocalThreadPool(int nWorkersIn);
+
+    ~LocalThreadPool();
+
+    LocalThreadPool(const LocalThreadPool&) = delete;
+    LocalThreadPool& operator=(const LocalThreadPool&) = delete;
+
+    int getMaxTeamSize() const { return nWorkers + 1; }
+
+    // Workers currently running, at most one fewer than the max team size
+    int getNumWorkers();
+
+    /**
+     * Runs task(i) for every i in the team and puts the return values in
+     * results. Returns false without running anything if the team is too big
+     * or the pool is already running another team. If any task throws, the
+     * first exception is rethrown once the whole team has finished.
+     */
+    bool tryRun(int teamSize,
+                const LocalTask& task,
+                std::vector<int32_t>& results);
+
+  private:
+    struct Worker
+    {
+        std::thread thread;
+        std::atomic<uint32_t> epoch = 0;
+        std::atomic<bool> stop = false;
+        int32_t result = 0;
+        std::exception_ptr error = nullptr;
+    };
+
+    const int nWorkers;
+
+    // Only grown and shrunk by the thread running a team, under runMx
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    // The most workers any team has needed since the pool last shrank
+    int nRecentRuns = 0;
+    int nRecentWorkersNeeded = 0;
+
+    // Workers stay on the node of the thread that made the pool, so a team
+    // keeps to one socket
+    const int numaNode;
+
+    std::mutex runMx;
+    const LocalTask* currentTask = nullptr;
+    std::atomic<int> nRunning = 0;
+
+    void startWorkers(int nWorkersNeeded);
+
+    void stopWorkers(int nWorkersKept);
+
+    void workerLoop(Worker* w, int workerIdx);
+};
+}
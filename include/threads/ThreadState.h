@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <mutex>
+#include <string>
 #include <vector>
 
 #include <faabric/proto/faabric.pb.h>
@@ -55,8 +56,19 @@ class Level
     // Instance functions
     int getMaxThreadsAtNextLevel() const;
 
+    // Whether the next level's size was set by num_threads or
+    // omp_set_num_threads, rather than left to the runtime
+    bool isNextLevelSizeRequested() const;
+
     std::vector<uint8_t> serialise();
 
+    // Serialises straight into the string, e.g. a request's context data,
+    // reusing its buffer
+    void serialise(std::string& out);
+
+    // Resets everything but the shared offsets from the serialised level
+    void setFromSerialised(const std::string& bytes);
+
     int getLocalThreadNum(const faabric::Message* msg);
 
     int getGlobalThreadNum(int localThreadNum);
@@ -64,6 +76,11 @@ class Level
     int getGlobalThreadNum(const faabric::Message* msg);
 
     std::string toString();
+
+  private:
+    size_t getSerialisedSize() const;
+
+    void serialiseTo(uint8_t* bytes);
 };
 
 class PthreadCall
@@ -74,6 +91,15 @@ class PthreadCall
     int32_t argsPtr;
 };
 
+/**
+ * A pthread's entrypoint takes a single pointer argument, which its message
+ * carries as the raw four bytes of its input data, so it's read back without
+ * any parsing.
+ */
+void setPthreadArgsPtr(faabric::Message& msg, int32_t argsPtr);
+
+int32_t getPthreadArgsPtr(const faabric::Message& msg);
+
 std::shared_ptr<Level> levelFromBatchRequest(
   const std::shared_ptr<faabric::BatchExecuteRequest>& req);
 
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How many finished jobs are kept around for clients to poll
+#define UPLOAD_JOB_HISTORY 1000
+
+/*
+ * Uploads that involve a lot of work, i.e. writing functions to S3 and
+ * generating their machine code, are run as jobs on a fixed pool of workers,
+ * so that they neither hold up the listener nor all run at once. Callers can
+ * either wait for a job, or hand its ID back to the client to poll.
+ */
+namespace edge {
+
+enum class UploadJobStatus
+{
+    Queued,
+    Running,
+    Succeeded,
+    Failed,
+};
+
+std::string uploadJobStatusToString(UploadJobStatus status);
+
+struct UploadJob
+{
+    int id = 0;
+    std::string name;
+    UploadJobStatus status = UploadJobStatus::Queued;
+    std::string error;
+
+    bool isFinished() const
+    {
+        return status == UploadJobStatus::Succeeded ||
+               status == UploadJobStatus::Failed;
+    }
+};
+
+class UploadJobQueue
+{
+  public:
+    UploadJobQueue(int nWorkersIn, int maxQueuedIn);
+
+    ~UploadJobQueue();
+
+    /**
+     * Queues the task to run on a worker and returns the job's ID, or -1 if
+     * the queue is full. Any exception thrown by the task fails the job.
+     */
+    int submit(const std::string& name, std::function<void()> task);
+
+    // Returns false if there's no such job, or it's been forgotten
+    bool getJob(int id, UploadJob& job);
+
+    // Waits for the job to finish and returns it
+    UploadJob awaitJob(int id);
+
+    size_t getQueuedCount();
+
+    // Finishes queued jobs and stops the workers
+    void shutdown();
+
+  private:
+    const int nWorkers;
+    const int maxQueued;
+
+    std::mutex mx;
+    std::condition_variable workerCv;
+    std::condition_variable finishedCv;
+
+    bool stopped = false;
+    int nextId = 1;
+
+    std::vector<std::thread> workers;
+    std::deque<std::pair<int, std::function<void()>>> queue;
+    std::map<int, UploadJob> jobs;
+    std::deque<int> finishedIds;
+
+    void runWorker();
+
+    void finishJob(int id, UploadJobStatus status, const std::string& error);
+};
+
+// Sized from the Faasm config the first time it's used
+UploadJobQueue& getUploadJobQueue();
+}
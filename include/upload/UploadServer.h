@@ -4,6 +4,8 @@
 
 #include <cpprest/http_listener.h>
 
+#include <functional>
+
 using namespace web::http::experimental::listener;
 using namespace web::http;
 
@@ -13,6 +15,26 @@ using namespace web::http;
 #define PYTHON_URL_PART "p"
 #define STATE_URL_PART "s"
 #define SHARED_FILE_URL_PART "file"
+#define SHARED_BUNDLE_URL_PART "bundle"
+#define JOB_URL_PART "job"
+#define PRELOAD_URL_PART "preload"
+#define PROFILE_URL_PART "profile"
+#define ARCHIVE_URL_PART "archive"
+
+// Files in an archive are uploaded by this many threads at once
+#define ARCHIVE_UPLOAD_THREADS 8
+
+// State and shared files are downloaded a chunk at a time, reading no more
+// than a few chunks ahead of the client
+#define DOWNLOAD_CHUNK_BYTES (1024 * 1024)
+#define DOWNLOAD_MAX_BUFFERED_BYTES (4 * DOWNLOAD_CHUNK_BYTES)
+
+// Downloads are abandoned if the client stops reading for this long
+#define DOWNLOAD_STALL_TIMEOUT_MS 60000
+
+// Uploads with this query parameter reply with a job ID straight away, rather
+// than waiting for the upload to finish
+#define ASYNC_QUERY_PARAM "async"
 
 namespace edge {
 class UploadServer
@@ -31,8 +53,20 @@ class UploadServer
   private:
     bool stopped = false;
 
-    static std::vector<uint8_t> getState(const std::string& user,
-                                         const std::string& key);
+    static void handleStateDownload(const http_request& request,
+                                    const std::string& user,
+                                    const std::string& key);
+
+    static void handleSharedFileDownload(const http_request& request,
+                                         const std::string& path);
+
+    static void handleJobStatus(const http_request& request,
+                                const std::string& jobId);
+
+    static void runUploadJob(const http_request& request,
+                             const std::string& name,
+                             std::function<void()> task,
+                             const std::string& completeMessage);
 
     static void handlePythonFunctionUpload(const http_request& request,
                                            const std::string& user,
@@ -42,6 +76,14 @@ class UploadServer
                                      const std::string& user,
                                      const std::string& function);
 
+    static void handlePreloadUpload(const http_request& request,
+                                    const std::string& user,
+                                    const std::string& function);
+
+    static void handleProfileUpload(const http_request& request,
+                                    const std::string& user,
+                                    const std::string& function);
+
     static void handleStateUpload(const http_request& request,
                                   const std::string& user,
                                   const std::string& key);
@@ -49,6 +91,11 @@ class UploadServer
     static void handleSharedFileUpload(const http_request& request,
                                        const std::string& path);
 
+    static void handleSharedBundleUpload(const http_request& request,
+                                         const std::string& dir);
+
+    static void handleArchiveUpload(const http_request& request);
+
     static void extractRequestBody(const http_request& req,
                                    faabric::Message& msg);
 };
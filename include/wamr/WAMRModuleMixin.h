@@ -1,7 +1,9 @@
 #pragma once
 
+#include <wasm/StringArray.h>
 #include <wasm_export.h>
 
+#include <algorithm>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -75,27 +77,25 @@ struct WAMRModuleMixin
     // Helper function to write a string array to a buffer in the WASM linear
     // memory, and record the offsets where each new string begins (note that
     // in WASM this strings are now interpreted as char pointers).
-    void writeStringArrayToMemory(const std::vector<std::string>& strings,
+    void writeStringArrayToMemory(const wasm::StringArray& strings,
                                   uint32_t* strOffsets,
                                   char* strBuffer)
     {
         // Validate that the offset array has enough capacity to hold all
-        // offsets (one per string)
-        validateNativePointer(strOffsets, strings.size() * sizeof(uint32_t));
-
-        char* nextBuffer = strBuffer;
-        for (size_t i = 0; i < strings.size(); i++) {
-            const std::string& thisStr = strings.at(i);
-
-            // Validate that the WASM offset we are going to write to is within
-            // the bounds of the linear memory
-            validateNativePointer(nextBuffer, thisStr.size() + 1);
-
-            std::copy(thisStr.begin(), thisStr.end(), nextBuffer);
-            nextBuffer[thisStr.size()] = '\0';
-            strOffsets[i] = nativePointerToWasmOffset(nextBuffer);
-
-            nextBuffer += thisStr.size() + 1;
+        // offsets (one per string), and that the buffer can hold all the
+        // strings, before copying them all over at once
+        validateNativePointer(strOffsets,
+                              strings.getCount() * sizeof(uint32_t));
+        validateNativePointer(strBuffer, strings.getBufferSize());
+
+        std::copy(strings.getBuffer(),
+                  strings.getBuffer() + strings.getBufferSize(),
+                  strBuffer);
+
+        uint32_t bufferOffset = nativePointerToWasmOffset(strBuffer);
+        const std::vector<uint32_t>& offsets = strings.getOffsets();
+        for (size_t i = 0; i < offsets.size(); i++) {
+            strOffsets[i] = bufferOffset + offsets.at(i);
         }
     }
 
@@ -104,6 +104,6 @@ struct WAMRModuleMixin
     void writeArgvToWamrMemory(uint32_t* argvOffsetsWasm, char* argvBuffWasm)
     {
         writeStringArrayToMemory(
-          this->underlying().getArgv(), argvOffsetsWasm, argvBuffWasm);
+          this->underlying().getArgvArray(), argvOffsetsWasm, argvBuffWasm);
     }
 };
@@ -4,12 +4,22 @@
 #include <wasm/WasmModule.h>
 #include <wasm_runtime_common.h>
 
+#include <faabric/util/locks.h>
+
+#include <mutex>
 #include <setjmp.h>
+#include <shared_mutex>
+#include <unordered_map>
 
 #define ERROR_BUFFER_SIZE 256
+// Default size of the wasm stack of each execution environment. Despite the
+// name, WAMR takes this in bytes.
 #define STACK_SIZE_KB 8192
 #define HEAP_SIZE_KB 8192
 
+// Maximum number of threads WAMR will let us spawn for each module
+#define WAMR_MAX_THREAD_NUM 128
+
 #define WAMR_INTERNAL_EXCEPTION_PREFIX "Exception: "
 #define WAMR_EXIT_PREFIX "wamr_exit_code_"
 
@@ -23,8 +33,19 @@ enum WAMRExceptionTypes
     QueueTimeoutException = 3,
 };
 
+// Counters for the lock protecting WAMR's global state. A lock acquisition is
+// contended if it could not be acquired without blocking
+struct WAMRLockStats
+{
+    uint64_t acquired = 0;
+    uint64_t contended = 0;
+};
+
 std::vector<uint8_t> wamrCodegen(std::vector<uint8_t>& wasmBytesIn, bool isSgx);
 
+// Size of the wasm stack of the function's execution environments, in bytes
+uint32_t getWamrStackSize(const faabric::Message& msg);
+
 class WAMRWasmModule final
   : public WasmModule
   , public WAMRModuleMixin<WAMRWasmModule>
@@ -32,12 +53,24 @@ class WAMRWasmModule final
   public:
     static void initialiseWAMRGlobally();
 
+    static WAMRLockStats getGlobalsLockStats();
+
+    static void resetGlobalsLockStats();
+
     WAMRWasmModule();
 
     explicit WAMRWasmModule(int threadPoolSizeIn);
 
     ~WAMRWasmModule();
 
+    static void clearCaches();
+
+    // Loads the given AOT bytes into a WAMR module. The bytes must outlive the
+    // returned module
+    static WASMModuleCommon* loadWasmModule(std::vector<uint8_t>& bytes);
+
+    static void unloadWasmModule(WASMModuleCommon* module);
+
     // ----- Module lifecycle -----
     void reset(faabric::Message& msg, const std::string& snapshotKey) override;
 
@@ -45,6 +78,16 @@ class WAMRWasmModule final
 
     int32_t executeFunction(faabric::Message& msg) override;
 
+    bool hasBatchHandler() override;
+
+    int32_t executeOMPThread(int threadPoolIdx,
+                             uint32_t stackTop,
+                             faabric::Message& msg) override;
+
+    int32_t executePthread(int threadPoolIdx,
+                           uint32_t stackTop,
+                           faabric::Message& msg) override;
+
     // ----- Exception handling -----
     void doThrowException(std::exception& e) override;
 
@@ -62,26 +105,64 @@ class WAMRWasmModule final
     uint8_t* wasmPointerToNative(uint32_t wasmPtr) override;
 
     // ----- Memory management -----
-    uint32_t mmapFile(uint32_t fp, size_t length) override;
-
     size_t getMemorySizeBytes() override;
 
     uint8_t* getMemoryBase() override;
 
     size_t getMaxMemoryPages() override;
 
+    // Adds the execution environments' stacks, which WAMR keeps on the host
+    ModuleMemoryUsage getMemoryUsage() override;
+
     WASMModuleInstanceCommon* getModuleInstance();
 
+    // The loaded module instances are made from, shared if it's from the cache
+    WASMModuleCommon* getWasmModule();
+
+    // The environment calls on the main thread run in, created on first use
+    // and kept between calls
+    WASMExecEnv* getMainExecEnv();
+
+    uint32_t getExecEnvStackSize();
+
     std::vector<std::string> getArgv();
 
   private:
     char errorBuffer[ERROR_BUFFER_SIZE];
 
     std::vector<uint8_t> wasmBytes;
-    WASMModuleCommon* wasmModule;
-    WASMModuleInstanceCommon* moduleInstance;
+    WASMModuleCommon* wasmModule = nullptr;
+    WASMModuleInstanceCommon* moduleInstance = nullptr;
+
+    // Modules loaded from the cache are shared, so must not be unloaded
+    bool ownsWasmModule = false;
+
+    // Copy of the module's globals after binding, to be restored on reset
+    std::vector<uint8_t> resetGlobalData;
+
+    // Threads of the same module can be executing at once, so each needs its
+    // own jump buffer
+    static thread_local jmp_buf wamrExceptionJmpBuf;
+
+    uint32_t execEnvStackSize = STACK_SIZE_KB;
+
+    WASMExecEnv* mainExecEnv = nullptr;
+
+    void destroyMainExecEnv();
 
-    jmp_buf wamrExceptionJmpBuf;
+    // Threads each get their own module instance, sharing this one's memory
+    // but with their own globals (e.g. the stack pointer). They're spawned
+    // from a parent environment, which we keep, as it must outlive them.
+    std::mutex threadExecEnvsMx;
+    WASMExecEnv* threadsParentExecEnv = nullptr;
+    std::vector<WASMExecEnv*> threadExecEnvs;
+
+    // The stack each thread's environment was last pointed at
+    std::vector<uint32_t> threadExecEnvStacks;
+
+    WASMExecEnv* getThreadExecEnv(int threadPoolIdx, uint32_t stackTop);
+
+    void destroyThreadExecEnvs();
 
     int executeWasmFunction(const std::string& funcName);
 
@@ -92,10 +173,69 @@ class WAMRWasmModule final
                                int argc,
                                std::vector<uint32_t>& argv);
 
+    bool executeCatchException(WASMExecEnv* execEnv,
+                               WASMFunctionInstanceCommon* func,
+                               int wasmFuncPtr,
+                               int argc,
+                               std::vector<uint32_t>& argv);
+
     void bindInternal(faabric::Message& msg);
 
     bool doGrowMemory(uint32_t pageChange) override;
+
+    void restoreFromResetSnapshot(const std::string& snapshotKey);
+
+    // WAMR checks for termination at loop back-edges and calls, in both the
+    // interpreter and the AOT code we generate
+    void doInterruptExecution() override;
+
+    void doRecoverFromInterrupt() override;
 };
 
+struct WAMRCacheEntryStats
+{
+    std::string user;
+    std::string function;
+
+    // The AOT code, which the loaded module keeps references into
+    size_t moduleBytes = 0;
+};
+
+/*
+ * Holds one loaded WAMR module per function, from which each WAMRWasmModule
+ * instantiates. Loading (and relocating) AOT code is expensive, so we only
+ * want to do it once per function per host.
+ */
+class WAMRModuleCache
+{
+  public:
+    WASMModuleCommon* getCachedModule(faabric::Message& msg);
+
+    std::string registerResetSnapshot(wasm::WasmModule& module,
+                                      faabric::Message& msg);
+
+    // Note that this unloads all cached modules, so must only be called when
+    // no modules instantiated from the cache are still alive
+    void clear();
+
+    size_t getTotalCachedModuleCount();
+
+    std::vector<WAMRCacheEntryStats> getEntryStats();
+
+  private:
+    struct CachedWAMRModule
+    {
+        std::string user;
+        std::string function;
+        std::vector<uint8_t> bytes;
+        WASMModuleCommon* module = nullptr;
+    };
+
+    std::shared_mutex mx;
+    std::unordered_map<std::string, CachedWAMRModule> cachedModuleMap;
+};
+
+WAMRModuleCache& getWAMRModuleCache();
+
 WAMRWasmModule* getExecutingWAMRModule();
 }
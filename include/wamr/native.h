@@ -57,6 +57,8 @@ uint32_t getFaasmMemoryApi(NativeSymbol** nativeSymbols);
 
 uint32_t getFaasmMpiApi(NativeSymbol** nativeSymbols);
 
+uint32_t getFaasmOpenMPApi(NativeSymbol** nativeSymbols);
+
 uint32_t getFaasmProcessApi(NativeSymbol** nativeSymbols);
 
 uint32_t getFaasmPthreadApi(NativeSymbol** nativeSymbols);
@@ -67,6 +69,8 @@ uint32_t getFaasmStateApi(NativeSymbol** nativeSymbols);
 
 uint32_t getFaasmStubs(NativeSymbol** nativeSymbols);
 
+uint32_t getFaasmTimingApi(NativeSymbol** nativeSymbols);
+
 // ---------- WASI symbols ----------
 
 uint32_t getFaasmWasiEnvApi(NativeSymbol** nativeSymbols);
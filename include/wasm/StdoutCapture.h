@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <sys/uio.h>
+
+namespace wasm {
+
+/*
+ * Holds a function's captured stdout in memory, so writes don't each cost a
+ * syscall. Once the buffer reaches its cap it wraps around, dropping the
+ * oldest bytes first, so chatty functions keep the end of their output, which
+ * is usually the interesting part.
+ */
+class StdoutCapture
+{
+  public:
+    // Capped at CAPTURE_STDOUT_MAX_BYTES
+    StdoutCapture();
+
+    explicit StdoutCapture(size_t maxBytesIn);
+
+    size_t write(const struct ::iovec* iovecs, int iovecCount);
+
+    size_t write(const char* data, size_t len);
+
+    // Returns what's been captured, noting how much was dropped, if any
+    std::string read();
+
+    size_t size();
+
+    // Bytes allocated for the buffer, which can be more than it holds
+    size_t capacity();
+
+    size_t getDroppedBytes();
+
+    void clear();
+
+  private:
+    std::mutex mx;
+
+    size_t maxBytes = 0;
+
+    // Grows up to the cap, after which the oldest byte is at the head
+    std::string buffer;
+    size_t head = 0;
+
+    size_t droppedBytes = 0;
+
+    void doWrite(const char* data, size_t len);
+};
+}
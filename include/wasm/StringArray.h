@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace wasm {
+
+/*
+ * An array of strings laid out the way argv and environ are in wasm memory,
+ * i.e. one buffer of null-terminated strings, alongside the offset in that
+ * buffer of each string. Building this once means the whole thing can be
+ * written with a single copy, leaving only the pointers to fill in.
+ *
+ * This is header-only so that it can also be used inside SGX enclaves.
+ */
+class StringArray
+{
+  public:
+    StringArray() = default;
+
+    explicit StringArray(const std::vector<std::string>& strings)
+    {
+        size_t bufferSize = 0;
+        for (const auto& str : strings) {
+            bufferSize += str.size() + 1;
+        }
+
+        buffer.resize(bufferSize, '\0');
+        offsets.reserve(strings.size());
+
+        size_t offset = 0;
+        for (const auto& str : strings) {
+            offsets.emplace_back(offset);
+            std::memcpy(buffer.data() + offset, str.data(), str.size());
+            offset += str.size() + 1;
+        }
+    }
+
+    uint32_t getCount() const { return offsets.size(); }
+
+    uint32_t getBufferSize() const { return buffer.size(); }
+
+    const char* getBuffer() const { return buffer.data(); }
+
+    const std::vector<uint32_t>& getOffsets() const { return offsets; }
+
+  private:
+    std::vector<char> buffer;
+    std::vector<uint32_t> offsets;
+};
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <wasm/StringArray.h>
+
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -20,6 +22,9 @@
 
 #define MAIN_MODULE_DYNLINK_HANDLE 999
 
+// Where Python keeps compiled bytecode, relative to the runtime root
+#define PYTHON_BYTECODE_CACHE_DIR "/pycache"
+
 namespace wasm {
 class WasmEnvironment
 {
@@ -34,11 +39,17 @@ class WasmEnvironment
 
     std::vector<std::string> getVars();
 
+    // The variables as they're written to wasm memory, kept up to date as
+    // they change rather than rebuilt for every call
+    const StringArray& getVarsArray() const;
+
     std::string getEnv(const std::string& key);
 
     void printDebugInfo();
 
   private:
     std::unordered_map<std::string, std::string> vars;
+
+    StringArray varsArray;
 };
 }
@@ -8,17 +8,41 @@
 #include <faabric/util/snapshot.h>
 #include <storage/FileSystem.h>
 #include <threads/ThreadState.h>
+#include <wasm/StdoutCapture.h>
+#include <wasm/StringArray.h>
 #include <wasm/WasmCommon.h>
 #include <wasm/WasmEnvironment.h>
+#include <wasm/futex.h>
+#include <wasm/ipc.h>
+#include <wasm/memory_accounting.h>
+#include <wasm/page_store.h>
+#include <wasm/state_disk.h>
 
 #include <atomic>
+#include <condition_variable>
 #include <exception>
+#include <functional>
+#include <future>
+#include <map>
 #include <mutex>
+#include <set>
 #include <string>
 #include <sys/uio.h>
 #include <thread>
 #include <tuple>
 
+// As with musl's PTHREAD_KEYS_MAX and PTHREAD_DESTRUCTOR_ITERATIONS
+#define MAX_PTHREAD_KEYS 128
+#define PTHREAD_KEY_DESTRUCTOR_ITERATIONS 4
+
+// Once a module runs threads, memory is committed at least this many wasm
+// pages at a time, so most of their brk increments can skip the lock
+#define MEMORY_GROWTH_CHUNK_PAGES 16
+
+// Returned by remapMemory when a mapping can't grow where it is and isn't
+// allowed to move. Never a valid offset, as mappings are page-aligned.
+#define REMAP_MEMORY_FAILED UINT32_MAX
+
 namespace wasm {
 
 // Note - avoid a zero default on the thread request type otherwise it can
@@ -32,6 +56,10 @@ enum ThreadRequestType
 
 bool isWasmPageAligned(int32_t offset);
 
+// Key of the zygote a message's module is cloned from. Usually this is the
+// function, but with PYTHON_IMPORT_ZYGOTE Python functions get their own.
+std::string getZygoteKey(const faabric::Message& msg);
+
 class WasmModule
 {
   public:
@@ -52,12 +80,27 @@ class WasmModule
 
     virtual int32_t executeFunction(faabric::Message& msg);
 
+    // Whether the function exports BATCH_HANDLER_FUNC_NAME
+    virtual bool hasBatchHandler();
+
+    // How many calls the instance has handled since it was last reset
+    uint32_t getBatchIndex();
+
+    void setBatchIndex(uint32_t batchIndexIn);
+
     bool isBound();
 
     std::string getBoundUser();
 
     std::string getBoundFunction();
 
+    std::string getBoundZygoteKey();
+
+    // Only set if the module is a Python function's own zygote (or a clone)
+    std::string getBoundPythonUser();
+
+    std::string getBoundPythonFunction();
+
     virtual void flush();
 
     // ----- argc/ argv -----
@@ -65,6 +108,8 @@ class WasmModule
 
     uint32_t getArgvBufferSize();
 
+    const StringArray& getArgvArray() const;
+
     virtual void writeArgvToMemory(uint32_t wasmArgvPointers,
                                    uint32_t wasmArgvBuffer);
 
@@ -83,6 +128,22 @@ class WasmModule
     // code we work around the lack of exceptions with setjmp/longjmp
     virtual void doThrowException(std::exception& e);
 
+    // ----- Execution deadlines -----
+    // Stops the executing function as soon as possible. Called from the
+    // execution watchdog's thread, not the one executing the function.
+    void interruptExecution();
+
+    bool isExecutionInterrupted();
+
+    // Undoes whatever the interrupt did, so that the module can be reset
+    void recoverFromInterrupt();
+
+    // Mark host code running on the guest's behalf (see HOST_CALL), for
+    // runtimes that can't interrupt the guest while it's running
+    virtual void enterHostCall() {}
+
+    virtual void exitHostCall() {}
+
     // ----- Stdout capture -----
     ssize_t captureStdout(const struct ::iovec* iovecs, int iovecCount);
 
@@ -103,10 +164,45 @@ class WasmModule
 
     uint32_t mmapMemory(size_t nBytes);
 
-    virtual uint32_t mmapFile(uint32_t fp, size_t length);
+    // Maps the file directly into linear memory, so that instances mapping
+    // the same file share the host's page cache. Writable mappings are always
+    // private copy-on-write, so guests can never modify files on the host.
+    virtual uint32_t mmapFile(uint32_t fd,
+                              size_t length,
+                              int prot,
+                              int flags,
+                              uint64_t offset);
+
+    uint32_t mmapFile(uint32_t fd, size_t length);
+
+    // Puts the data in new read-only memory, which the guest can free with
+    // munmap. Returns zero if the data is empty.
+    virtual uint32_t mapReadOnlyBytes(const std::string& data);
+
+    // As with mapReadOnlyBytes, for a range of a state value, which is mapped
+    // rather than copied. The pages around the range are visible too.
+    virtual uint32_t mapReadOnlyState(
+      const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+      size_t offset,
+      uint32_t length);
 
     void unmapMemory(uint32_t offset, size_t nBytes);
 
+    // Resizes a mapping, as with mremap. It grows in place into a hole or the
+    // top of memory where it can. Otherwise, if allowed to, it's moved by
+    // remapping its pages, so the bytes aren't copied. Returns the new
+    // offset, or REMAP_MEMORY_FAILED if it couldn't grow in place.
+    uint32_t remapMemory(uint32_t offset,
+                         size_t oldBytes,
+                         size_t newBytes,
+                         bool mayMove);
+
+    // Whether a remapping is of a page-aligned mapping below the brk, to a
+    // size that fits in memory. Remapping anything else throws.
+    bool canRemapMemory(uint32_t offset, size_t oldBytes, size_t newBytes);
+
+    size_t getFreeMemoryBytes();
+
     uint32_t createMemoryGuardRegion(uint32_t wasmOffset);
 
     virtual uint32_t mapSharedStateMemory(
@@ -114,42 +210,136 @@ class WasmModule
       long offset,
       uint32_t length);
 
+    // Maps the start of the state value over existing, page-aligned memory,
+    // replacing what was there
+    virtual void mapSharedStateMemoryAt(
+      const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+      uint32_t wasmOffset,
+      size_t nBytes);
+
+    // Undoes mapSharedStateMemoryAt, giving the memory its own pages back
+    // with what the state value last held
+    void unmapSharedStateMemoryAt(uint32_t wasmOffset, size_t nBytes);
+
+    // As with mapSharedStateMemory, for a disk-backed value (see
+    // state_disk.h), fetching just the chunks that are mapped
+    uint32_t mapDiskStateMemory(const std::shared_ptr<DiskStateValue>& value,
+                                size_t offset,
+                                uint32_t length);
+
+    // Returns a handle for the state value for the given key, so that calls
+    // using it skip the key lookup. Handles last as long as the module.
+    int32_t getStateHandle(const std::string& key, size_t size);
+
+    std::shared_ptr<faabric::state::StateKeyValue> getStateKVForHandle(
+      int32_t handle);
+
+    // ----- IPC channels -----
+    int32_t openChannel(const std::string& name, bool write);
+
+    IpcChannelEnd getChannelForHandle(int32_t handle);
+
+    void closeChannel(int32_t handle);
+
+    // Ends left open are closed once the call finishes, so that readers don't
+    // wait forever on writers that forgot to close
+    void closeAllChannels();
+
     virtual uint8_t* wasmPointerToNative(uint32_t wasmPtr);
 
     virtual size_t getMemorySizeBytes();
 
     virtual size_t getMaxMemoryPages();
 
+    // Caps how far memory can grow below the module's own maximum, e.g. from
+    // the function's profile. Zero means no cap.
+    void setMemoryPagesLimit(uint32_t pages);
+
+    size_t getMemoryPagesLimit();
+
     virtual uint8_t* getMemoryBase();
 
+    // What the module takes up on the host, for accounting. Reads the page
+    // tables, so isn't for hot paths.
+    virtual ModuleMemoryUsage getMemoryUsage();
+
     // ----- Snapshot/ restore -----
-    std::shared_ptr<faabric::util::SnapshotData> getSnapshotData();
+    virtual std::shared_ptr<faabric::util::SnapshotData> getSnapshotData();
 
     std::span<uint8_t> getMemoryView();
 
     std::string snapshot(bool locallyRestorable = true);
 
-    void restore(const std::string& snapshotKey);
+    virtual void restore(const std::string& snapshotKey);
+
+    // Byte ranges of memory shared read-only with other modules, which
+    // snapshot diffs skip
+    virtual std::vector<std::pair<uint32_t, uint32_t>> getReadOnlyDataRegions();
 
     // ----- Threading -----
     // Queues a pthread call that will be executed along with all other queued
-    // calls on the first call to await
+    // calls on the first call to await. With PTHREAD_DISPATCH_BATCH set, calls
+    // are instead dispatched in batches as soon as they're queued.
     void queuePthreadCall(threads::PthreadCall call);
 
     // Executes all queued pthread calls and awaits the call relating to the
     // given pointer
     int awaitPthreadCall(faabric::Message* msg, int pthreadPtr);
 
+    // Waits for any dispatched pthreads that were never joined
+    void awaitDispatchedPthreads();
+
+    // Thread stacks are only provisioned the first time a thread needs one,
+    // so single-threaded functions never pay for them
+    uint32_t getThreadStack(int threadPoolIdx);
+
     std::vector<uint32_t> getThreadStacks();
 
-    // Returns the given pthread mutex and errors if it doesn't exist
-    std::shared_ptr<std::mutex> getPthreadMutex(uint32_t id);
+    // Local teams can use stacks beyond the thread pool, up to this many.
+    // These are only provisioned once a team needs them, after the pool's.
+    int getMaxThreadPoolSize() const;
+
+    std::vector<uint32_t> getThreadStacks(int nStacks);
+
+    // Drops the stacks, for when the memory they were in has been replaced
+    void clearThreadStacks();
+
+    // Host-side mutexes for the module's pthread mutexes
+    FutexMutexSlab& getPthreadMutexSlab();
 
-    // Returns the given pthread mutex, creating it if it doesn't exist
-    std::shared_ptr<std::mutex> getOrCreatePthreadMutex(uint32_t id);
+    // Returns the given pthread condition variable, creating it if it doesn't
+    // exist. These wait on the pthread mutexes above.
+    std::shared_ptr<std::condition_variable_any> getOrCreatePthreadCond(
+      uint32_t id);
+
+    // Pthread keys are shared by all the module's threads, but each thread has
+    // its own values, which are zero until it sets them. Returns the new key,
+    // or -1 if all keys are in use.
+    int32_t createPthreadKey(int32_t destructorFunc);
+
+    void deletePthreadKey(int32_t key);
+
+    int32_t getPthreadSpecific(int32_t key);
+
+    // Returns false if the key is out of range
+    bool setPthreadSpecific(int32_t key, int32_t value);
+
+    // Clears the calling thread's values, as it starts executing a new thread
+    void clearPthreadSpecifics();
+
+    // Calls the destructors of keys with values on the calling thread, as it
+    // exits. Destructors may set values again, so this repeats a few times.
+    void runPthreadKeyDestructors(
+      const std::function<void(int32_t, int32_t)>& callDestructor);
+
+    // Returns the host-local lock for the given OpenMP critical section,
+    // creating it if it doesn't exist
+    std::shared_ptr<std::recursive_mutex> getOrCreateCriticalMutex(
+      uint32_t crit);
 
     // Adds a merge region to be used in the next threaded operation spawned by
-    // this module
+    // this module. Registering the same region again replaces it, so regions
+    // don't pile up when threads are spawned repeatedly.
     void addMergeRegionForNextThreads(
       uint32_t wasmPtr,
       size_t regionSize,
@@ -174,20 +364,78 @@ class WasmModule
   protected:
     std::shared_mutex moduleMutex;
 
+    // Bumped lock-free within committed memory, where everything above it is
+    // zeroed and writable. Anything else that moves it holds the module mutex
+    // and uses a CAS, so it can't lose a concurrent bump.
     std::atomic<uint32_t> currentBrk = 0;
 
+    // Set once threads are in use, from when memory is grown in chunks
+    std::atomic<bool> growMemoryInChunks = false;
+
+    // Highest brk reached by the executing call
+    std::atomic<uint32_t> peakBrk = 0;
+
+    uint32_t memoryPagesLimit = 0;
+
+    void updatePeakBrk(uint32_t brk);
+
+    std::atomic<bool> executionInterrupted = false;
+
+    // Runtime-specific ways of stopping wasm code mid-flight
+    virtual void doInterruptExecution();
+
+    virtual void doRecoverFromInterrupt();
+
+    // Drops anything the runtime keeps on the executing thread for the
+    // duration of a call, once the call's done
+    virtual void clearCallThreadState() {}
+
+    // Unmapped holes below the brk that mmapMemory can reuse, as offset to
+    // length. Guarded by the module mutex.
+    std::map<uint32_t, uint32_t> freeMemoryRegions;
+
+    // Releases the host pages backing part of linear memory, leaving it zeroed
+    virtual void reclaimMemory(uint32_t offset, size_t nBytes);
+
+    // Lowers the brk from oldBrk to newBrk, or lower if there's a hole just
+    // below it. Fails if the brk has moved since. Must be called with the
+    // module mutex held.
+    bool tryLowerBrk(uint32_t oldBrk, uint32_t newBrk);
+
+    // Adds already reclaimed pages to the free list, merging them with any
+    // adjacent holes. Must be called with the module mutex held.
+    void addFreeMemoryRegion(uint32_t start, uint32_t end);
+
+    // Extends the mapping ending at top by nBytes, from a hole starting there
+    // or by growing memory if it's at the brk
+    bool tryGrowMappingInPlace(uint32_t top, uint32_t nBytes);
+
+    // Moves whole pages from one mapped region to another
+    void movePages(uint32_t from, uint32_t to, size_t nBytes);
+
+    // Advises the kernel to back the region with huge pages if enabled. This
+    // must be redone whenever the region is remapped.
+    void adviseHugePages(uint32_t offset, size_t nBytes);
+
     std::string boundUser;
     std::string boundFunction;
+    std::string boundZygoteKey;
+    std::string boundPythonUser;
+    std::string boundPythonFunction;
     bool _isBound = false;
 
     storage::FileSystem filesystem;
 
     WasmEnvironment wasmEnvironment;
 
-    int stdoutMemFd = 0;
-    ssize_t stdoutSize = 0;
+    StdoutCapture capturedStdout;
+
+    uint32_t batchIndex = 0;
 
     int threadPoolSize = 0;
+
+    // The tops of the provisioned thread stacks, empty until a thread runs
+    std::mutex threadStacksMx;
     std::vector<uint32_t> threadStacks;
 
     // Argc/argv
@@ -195,20 +443,67 @@ class WasmModule
     std::vector<std::string> argv;
     size_t argvBufferSize;
 
+    // Modules mostly see the same command line over and over, so argv is
+    // only rebuilt when it changes
+    StringArray argvArray;
+    std::string argvCmdline;
+    bool argvPrepared = false;
+
     // Threads
+    using PthreadResults = std::vector<std::pair<uint32_t, int32_t>>;
     std::vector<threads::PthreadCall> queuedPthreadCalls;
     std::unordered_map<int32_t, uint32_t> pthreadPtrsToChainedCalls;
-    std::vector<std::pair<uint32_t, int32_t>> lastPthreadResults;
+    std::unordered_map<uint32_t, std::shared_future<PthreadResults>>
+      pthreadCallBatches;
+    std::atomic<int> nDispatchedPthreads = 0;
+    int nextPthreadIdx = 1;
     std::vector<faabric::util::SnapshotMergeRegion> mergeRegions;
+    std::unordered_map<uint32_t, size_t> mergeRegionIdxs;
+
+    FutexMutexSlab pthreadMutexSlab;
+
+    std::shared_mutex pthreadCondsMx;
+    std::unordered_map<uint32_t, std::shared_ptr<std::condition_variable_any>>
+      pthreadConds;
+
+    // Keys created during a call are dropped at the end of it, as the call's
+    // memory is reset. Those created before the first call are kept.
+    std::mutex pthreadKeysMx;
+    std::vector<int32_t> pthreadKeyDestructors;
+    size_t nPersistentPthreadKeys = 0;
+    bool pthreadKeysPersisted = false;
 
-    std::shared_mutex pthreadLocksMx;
-    std::unordered_map<uint32_t, std::shared_ptr<std::mutex>> pthreadLocks;
+    void dropCallPthreadKeys();
+
+    std::shared_mutex criticalLocksMx;
+    std::unordered_map<uint32_t, std::shared_ptr<std::recursive_mutex>>
+      criticalLocks;
 
     // Shared memory regions
     std::shared_mutex sharedMemWasmPtrsMutex;
     std::unordered_map<std::string, uint32_t> sharedMemWasmPtrs;
 
-    int getStdoutFd();
+    // State replicas mapped into memory or held as handles, which can't be
+    // evicted while the module has them (see state_replicas.h)
+    mutable std::mutex pinnedStateReplicasMx;
+    std::set<std::pair<std::string, std::string>> pinnedStateReplicas;
+
+    void pinStateReplica(const std::string& user, const std::string& key);
+
+    // Takes on the other module's pins along with its mappings
+    void copyPinnedStateReplicas(const WasmModule& other);
+
+    void unpinAllStateReplicas();
+
+    // State handles, which index into the vector
+    std::shared_mutex stateHandlesMx;
+    std::unordered_map<std::string, int32_t> stateHandleKeys;
+    std::vector<std::shared_ptr<faabric::state::StateKeyValue>> stateHandles;
+
+    // IPC channel ends opened by the current call
+    std::mutex channelEndsMx;
+    std::unordered_map<int32_t, IpcChannelEnd> channelEnds;
+    int32_t nextChannelHandle = 0;
 
     void prepareArgcArgv(const faabric::Message& msg);
 
@@ -225,8 +520,36 @@ class WasmModule
 
     void ignoreThreadStacksInSnapshot(const std::string& snapKey);
 
+    void ignoreReadOnlyDataInSnapshot(const std::string& snapKey);
+
+    /**
+     * Holes are only known from the calls that unmapped them, so a snapshot
+     * mapped over memory doesn't have any. They must go before memory is
+     * sized to the snapshot, or shrinking could absorb one and drop the brk
+     * below the snapshot.
+     */
+    void clearFreeMemoryRegions();
+
+    // Sizes memory to the reset snapshot and maps it in, from the page store
+    // if it's held there, otherwise from the snapshot registry
+    void mapResetSnapshot(const std::string& snapKey);
+
+    // Held while mapped, so that its pages aren't released from the store
+    std::shared_ptr<PagedSnapshot> mappedPagedSnapshot = nullptr;
+
     // Threads
-    void createThreadStacks();
+    void provisionThreadStacks();
+
+    // Must hold the stacks lock
+    void addThreadStacks(int nStacks);
+
+    void protectThreadStacks();
+
+    bool canDispatchPthreadsEagerly();
+
+    int getNextPthreadIdx();
+
+    void dispatchPthreadCalls(faabric::Message& msg, bool eager);
 };
 
 // Convenience functions
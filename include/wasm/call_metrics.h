@@ -0,0 +1,103 @@
+#pragma once
+
+#include <faabric/proto/faabric.pb.h>
+
+#include <wasm/perf_counters.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Per-call execution metrics, shared by WAVM and WAMR and attached to each
+ * message's exec graph details when it finishes, alongside the Faaslet's
+ * phase timings (e.g. execute-us, the call's wall time) and the state
+ * metrics. Host calls are counted against the calling thread, so calls made
+ * from threads the function starts itself are only counted when those
+ * threads are their own scheduled messages.
+ *
+ * With PERF_COUNTERS on, the calling thread's hardware counters are attached
+ * too, e.g. perf-instructions.
+ */
+namespace wasm {
+
+enum class HostCallCategory : int
+{
+    State = 0,
+    Chaining,
+    Mpi,
+    OpenMP,
+    Threads,
+    Filesystem,
+    Network,
+    Memory,
+    Process,
+    Other,
+
+    NumCategories
+};
+
+#define N_HOST_CALL_CATEGORIES (int)wasm::HostCallCategory::NumCategories
+
+// Counts a host call in the given category, e.g. HOST_CALL(State), and marks
+// it as running until the end of the enclosing scope
+#define HOST_CALL(category)                                                    \
+    wasm::HostCallScope hostCallScope(wasm::HostCallCategory::category)
+
+std::string hostCallCategoryName(HostCallCategory category);
+
+void recordHostCall(HostCallCategory category);
+
+class WasmModule;
+
+/**
+ * Tells the executing module that host code is running on the guest's behalf,
+ * so that interrupts don't pull memory out from under it. Throws straight
+ * back into the guest if it's already been interrupted.
+ */
+class HostCallScope
+{
+  public:
+    explicit HostCallScope(HostCallCategory category);
+
+    ~HostCallScope();
+
+    HostCallScope(const HostCallScope&) = delete;
+
+    HostCallScope& operator=(const HostCallScope&) = delete;
+
+  private:
+    WasmModule* module = nullptr;
+};
+
+struct CallMetrics
+{
+    uint64_t cpuNanos = 0;
+    uint64_t peakMemoryBytes = 0;
+    uint64_t snapshotBytes = 0;
+
+    std::array<uint64_t, N_HOST_CALL_CATEGORIES> hostCalls = {};
+
+    // Only collected with PERF_COUNTERS on
+    PerfCounts perfCounts;
+};
+
+/**
+ * Starts measuring a call on the calling thread, dropping anything recorded
+ * since the last call finished.
+ */
+void startCallMetrics();
+
+// Removes and returns what the calling thread has recorded since starting
+CallMetrics takeCallMetrics();
+
+/**
+ * Attaches the calling thread's metrics to the message, along with the
+ * memory figures the module knows about. Called whenever a function
+ * finishes.
+ */
+void flushCallMetrics(faabric::Message& msg,
+                      uint64_t peakMemoryBytes,
+                      uint64_t snapshotBytes);
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <faabric/proto/faabric.pb.h>
+
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -12,8 +14,110 @@ int awaitChainedCallOutput(unsigned int messageId,
                            uint8_t* buffer,
                            int bufferLen);
 
+/**
+ * Awaits the call and puts its output in new memory in the executing module,
+ * returning where it is and how long it is. Outputs handed over in shared
+ * memory are mapped in without being copied.
+ */
+int awaitChainedCallOutputMapped(unsigned int messageId,
+                                 uint32_t* outputPtr,
+                                 uint32_t* outputLen);
+
+// Copies the executing call's input into the buffer, or returns its size if
+// the buffer is empty
+int readCallInput(uint8_t* buffer, int bufferLen);
+
+/**
+ * Puts the executing call's input in new read-only memory in the executing
+ * module, returning where it is and how long it is. The guest skips
+ * allocating its own buffer and copying the input again.
+ */
+void readCallInputMapped(uint32_t* inputPtr, uint32_t* inputLen);
+
+/**
+ * Sets the executing call's output straight from linear memory. Large outputs
+ * for callers on this host go through shared memory instead.
+ */
+void writeCallOutput(const uint8_t* output, size_t outputLen);
+
+/**
+ * Appends a chunk to the executing call's output. Callers on this host can
+ * read it as soon as it's appended, otherwise it builds up the call's result.
+ */
+void appendCallOutput(const uint8_t* output, size_t outputLen);
+
+/**
+ * Reads the next chunk of the chained call's output, waiting for the callee to
+ * append it if it's streaming to this host. Returns the number of bytes read,
+ * zero at the end of the output, or -1 if the call can't be awaited.
+ */
+int readChainedCallOutput(unsigned int messageId,
+                          uint8_t* buffer,
+                          int bufferLen);
+
+/**
+ * Chains a call to the given function. If state keys are given, the call is
+ * sent to the host that is master for most of them, so that the callee's state
+ * is local.
+ */
 int makeChainedCall(const std::string& functionName,
                     int wasmFuncPtr,
                     const char* pyFunc,
-                    const std::vector<uint8_t>& inputData);
+                    const std::vector<uint8_t>& inputData,
+                    const std::vector<std::string>& stateKeys = {});
+
+/**
+ * Chains a call whose input is the given range of one of the caller's state
+ * values. Rather than the bytes going with the call, the callee reads them
+ * from state when it reads its input, and the call is sent to the value's
+ * master where there is one.
+ */
+int makeChainedCallWithStateInput(const std::string& functionName,
+                                  int wasmFuncPtr,
+                                  const std::string& stateKey,
+                                  size_t offset,
+                                  size_t length);
+
+/**
+ * Chains one call to the given function per input, all sent to the scheduler
+ * in a single request. Returns the IDs of the calls, in the order of the
+ * inputs.
+ */
+std::vector<int> makeChainedCalls(
+  const std::string& functionName,
+  int wasmFuncPtr,
+  const char* pyFunc,
+  const std::vector<std::vector<uint8_t>>& inputs,
+  const std::vector<std::string>& stateKeys = {});
+
+/**
+ * Awaits all the given calls, filling in their return values in the same
+ * order, and returns how many didn't return zero. Calls that fail or time out
+ * have a return value of one.
+ */
+int awaitChainedCalls(const std::vector<unsigned int>& messageIds,
+                      std::vector<int>& returnValues);
+
+// Fills in a chained call's message, passing on the caller's details
+void setUpChainedMessage(faabric::Message& msg,
+                         const faabric::Message& originalCall,
+                         int wasmFuncPtr,
+                         const char* pyFuncName,
+                         const std::vector<uint8_t>& inputData);
+
+/**
+ * Waits for the chained call's result, either from the callee directly if
+ * it's on this host, or through the scheduler. Throws if it times out.
+ */
+faabric::Message getChainedCallResult(const faabric::Message& msg,
+                                      int timeoutMs);
+
+// Waits for anything the caller chained that's still running in the
+// background, then drops the records of its chained calls
+void finishChainedCalls(unsigned int callerId);
+
+// The host that is master for most of the given keys, or empty if none are
+// known
+std::string getStateAffinityHost(const std::string& user,
+                                 const std::vector<std::string>& stateKeys);
 }
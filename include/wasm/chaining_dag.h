@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Chains a small graph of calls at once, where each edge passes the output of
+ * one call on as input to another. The graph is run from the caller's host in
+ * the background, so outputs are forwarded without going back through the
+ * caller's code. Each call is sent to the host its first input came from, so
+ * producers and consumers run together where possible.
+ */
+namespace wasm {
+
+struct ChainedDagNode
+{
+    std::string functionName;
+    std::vector<uint8_t> inputData;
+};
+
+// Edges go from the producing node to the consuming node
+using ChainedDagEdge = std::pair<int, int>;
+
+/**
+ * Orders the nodes so that every node comes after all of its inputs. Throws
+ * if an edge refers to a node that doesn't exist, or the edges form a cycle.
+ */
+std::vector<int> getChainedDagOrder(size_t nNodes,
+                                    const std::vector<ChainedDagEdge>& edges);
+
+/**
+ * Starts running the graph and returns the IDs of the nodes' calls, which can
+ * be awaited like any other chained call. Each node's input is its own input
+ * data followed by the outputs of its inputs, in the order of the edges.
+ * Nodes whose inputs fail are not run, and return one.
+ */
+std::vector<int> makeChainedDag(const std::vector<ChainedDagNode>& nodes,
+                                const std::vector<ChainedDagEdge>& edges);
+
+// Waits for all graphs started by the given caller to finish
+void awaitChainedDags(unsigned int callerId);
+}
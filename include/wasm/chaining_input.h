@@ -0,0 +1,39 @@
+#pragma once
+
+#include <faabric/proto/faabric.pb.h>
+#include <faabric/state/StateKeyValue.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/*
+ * Chained calls can be given a range of one of their user's state values as
+ * their input, rather than bytes copied from the caller through the
+ * scheduler. The callee reads the range itself, only once it asks for its
+ * input, from whichever replica is closest.
+ */
+namespace wasm {
+
+struct ChainedInputRef
+{
+    std::string key;
+    size_t offset = 0;
+    size_t length = 0;
+};
+
+// The reference travels in the message's details, which are passed on
+// wherever the call is scheduled
+void setChainedInputRef(faabric::Message& msg, const ChainedInputRef& ref);
+
+// Returns false if the call's input is in the message as usual
+bool getChainedInputRef(const faabric::Message& msg, ChainedInputRef& ref);
+
+bool hasChainedInputRef(const faabric::Message& msg);
+
+// The state value the reference points into. Throws if the range is outside
+// the value.
+std::shared_ptr<faabric::state::StateKeyValue> resolveChainedInputRef(
+  const std::string& user,
+  const ChainedInputRef& ref);
+}
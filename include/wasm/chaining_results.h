@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Callers waiting on a call that should be notified check the scheduler this
+// often, in case the call has been moved to another host
+#define CHAINED_RESULT_POLL_INTERVAL_MS 1000
+
+/*
+ * Lets callees notify callers on the same host as soon as they finish, rather
+ * than callers waiting on the result backend. As with outputs in shared
+ * memory, callers record the calls they chain here, and drop the records of
+ * calls that were scheduled elsewhere, which are awaited as usual.
+ */
+namespace wasm {
+
+struct ChainedResult
+{
+    int32_t returnValue = 0;
+    std::string outputData;
+};
+
+// Records that the given call was chained by a caller on this host
+void expectChainedResult(unsigned int callerId, unsigned int messageId);
+
+// Whether the given call will notify a caller on this host
+bool isChainedResultExpected(unsigned int messageId);
+
+// Drops the record for a call that won't run on this host
+void forgetChainedResult(unsigned int messageId);
+
+/**
+ * Passes the call's result on to its caller, if it's on this host. Returns
+ * false if nobody here is waiting for it.
+ */
+bool notifyChainedResult(unsigned int messageId, const ChainedResult& result);
+
+/**
+ * Waits up to the timeout for the call to notify its result. Returns false if
+ * it doesn't, or if the call isn't expected to notify at all. A call's result
+ * can be awaited any number of times until its caller finishes.
+ */
+bool awaitChainedResultNotification(unsigned int messageId,
+                                    int timeoutMs,
+                                    ChainedResult& result);
+
+// Drops the records of all calls chained by the given caller, once it has
+// finished
+void dropChainedResults(unsigned int callerId);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Hands large outputs of chained calls to callers on the same host through
+ * shared memory, rather than copying them through the call's result. All
+ * Faaslets on a host are in the same process, so a caller records the calls
+ * it chains here, and callees that find themselves recorded write their
+ * output to a memfd instead. The caller then maps the memfd straight into its
+ * linear memory. Callees that run on another host never see the record, and
+ * pass their output on as usual.
+ */
+namespace wasm {
+
+struct ChainedShmOutput
+{
+    int fd = -1;
+    size_t size = 0;
+};
+
+// Records that the given call was chained by a caller on this host
+void expectChainedShmOutput(unsigned int callerId, unsigned int messageId);
+
+/**
+ * Writes the call's output to shared memory if its caller is on this host and
+ * the output is at least CHAINED_SHM_OUTPUT_THRESHOLD bytes. Returns false if
+ * the output should be passed on as usual.
+ */
+bool writeChainedShmOutput(unsigned int messageId,
+                           const uint8_t* data,
+                           size_t len);
+
+// Drops any output written for the call, e.g. when it fails afterwards
+void discardChainedShmOutput(unsigned int messageId);
+
+/**
+ * Takes the output written for the call, if there is one, in which case the
+ * caller must close the fd. Otherwise the fd is -1.
+ */
+ChainedShmOutput takeChainedShmOutput(unsigned int messageId);
+
+// Drops the records and outputs of all calls chained by the given caller,
+// once it has finished
+void dropChainedShmOutputs(unsigned int callerId);
+
+size_t getChainedShmOutputCount();
+}
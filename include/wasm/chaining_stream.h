@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Returned by reads of streams that have nothing to give, in which case the
+// call's output has to be read from its result
+#define CHAINED_OUTPUT_STREAM_UNAVAILABLE -1
+
+/*
+ * Streams the output of chained calls to callers on the same host as it's
+ * appended, so callers can consume early chunks while the call runs, and the
+ * whole output never has to be in the callee's memory at once. As with
+ * results, callers record the calls they chain here, and drop the records of
+ * calls that were scheduled elsewhere. Callees that aren't streaming to a
+ * caller here append to their result instead.
+ */
+namespace wasm {
+
+// Records that the given call was chained by a caller on this host
+void expectChainedOutputStream(unsigned int callerId, unsigned int messageId);
+
+// Stops streaming to the caller, e.g. for a call that won't run on this host
+void forgetChainedOutputStream(unsigned int messageId);
+
+/**
+ * Appends a chunk of the call's output to its stream and wakes the caller.
+ * Returns false if no caller on this host is reading it.
+ */
+bool appendChainedOutputStream(unsigned int messageId,
+                               const uint8_t* data,
+                               size_t len);
+
+// Marks the end of the call's output, once it has finished
+void finishChainedOutputStream(unsigned int messageId);
+
+/**
+ * Reads the next chunk of the call's output into the buffer, waiting up to
+ * the timeout for the callee to append one. Returns the number of bytes read,
+ * or zero at the end of the output. Returns
+ * CHAINED_OUTPUT_STREAM_UNAVAILABLE if the call isn't streaming its output
+ * here, or hasn't appended anything before the timeout.
+ */
+int readChainedOutputStream(unsigned int messageId,
+                            uint8_t* buffer,
+                            int bufferLen,
+                            int timeoutMs);
+
+// Replaces the call's stream with its whole output, for calls whose output
+// has to be read from their result
+void fillChainedOutputStream(unsigned int callerId,
+                             unsigned int messageId,
+                             std::string outputData);
+
+// Drops the streams of all calls chained by the given caller, once it has
+// finished
+void dropChainedOutputStreams(unsigned int callerId);
+}
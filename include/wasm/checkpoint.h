@@ -0,0 +1,139 @@
+#pragma once
+
+#include <faabric/proto/faabric.pb.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+/*
+ * Checkpoint/restart of calls to S3, for fault tolerance. A checkpoint is the
+ * call's memory, plus the function pointer and argument to resume from, just
+ * like the snapshot sent when migrating. For MPI calls every rank in the world
+ * checkpoints together.
+ *
+ * Memory is stored in fixed-size chunks, and only chunks that have changed
+ * since the rank's last checkpoint are uploaded. Chunks that are all zeroes
+ * aren't uploaded at all. Each rank writes a manifest saying which checkpoint
+ * holds each of its chunks, and the checkpoint only counts once a marker with
+ * its number has been written for the function, after every rank is done.
+ * Chunks and manifests it supersedes are deleted after that.
+ *
+ * Keys are under checkpoints/<user>/<function>/, so a function has at most one
+ * checkpointed call (or MPI world) at a time.
+ */
+namespace wasm {
+class WasmModule;
+
+struct CheckpointManifest
+{
+    int seq = 0;
+
+    size_t memSize = 0;
+
+    int32_t funcPtr = 0;
+
+    std::string funcArg;
+
+    // Zero unless the call is MPI
+    int worldSize = 0;
+
+    // The checkpoint that holds each chunk, zero for chunks of zeroes
+    std::vector<int> chunkSeqs;
+
+    std::vector<uint8_t> toBytes() const;
+
+    static CheckpointManifest fromBytes(const std::vector<uint8_t>& bytes);
+};
+
+/**
+ * Reads and writes one rank's checkpoints, remembering what it last uploaded
+ * so the next checkpoint only sends what's changed.
+ */
+class Checkpointer
+{
+  public:
+    Checkpointer(const std::string& userIn,
+                 const std::string& functionIn,
+                 int rankIn,
+                 size_t chunkBytesIn = 4 * 1024 * 1024);
+
+    // Uploads the changed chunks and the manifest, returning the bytes sent
+    size_t write(int seq,
+                 std::span<const uint8_t> memory,
+                 int32_t funcPtr,
+                 const std::string& funcArg,
+                 int worldSize);
+
+    // Deletes what the last checkpoint written has superseded
+    void prune();
+
+    CheckpointManifest readManifest(int seq);
+
+    // Memory must be at least the manifest's size, anything past it is kept
+    void restore(const CheckpointManifest& manifest, std::span<uint8_t> memory);
+
+    // Carries on from a checkpoint written elsewhere, so the next supersedes it
+    void resumeFrom(const CheckpointManifest& manifest);
+
+    // Deletes everything this rank has checkpointed
+    void remove();
+
+  private:
+    const std::string user;
+    const std::string function;
+    const int rank;
+    const size_t chunkBytes;
+
+    CheckpointManifest last;
+    std::vector<size_t> chunkHashes;
+
+    std::vector<std::string> superseded;
+
+    std::string getRankPrefix() const;
+
+    std::string getChunkKey(size_t idx, int seq) const;
+
+    std::string getManifestKey(int seq) const;
+};
+
+// The latest checkpoint of the function, zero if there isn't one
+int getLatestCheckpoint(const std::string& user, const std::string& function);
+
+void setLatestCheckpoint(const std::string& user,
+                         const std::string& function,
+                         int seq);
+
+void removeLatestCheckpoint(const std::string& user,
+                            const std::string& function);
+
+/**
+ * Checkpoints the executing call, resuming from the given function and
+ * argument on restart. For MPI calls, all ranks in the world must call it.
+ */
+void doCheckpoint(int32_t entrypointFuncWasmOffset,
+                  const std::string& entrypointFuncArg);
+
+/**
+ * Called at migration points, checkpoints if the period in the config has
+ * passed since the last one (as decided by rank zero for MPI calls).
+ */
+void doPeriodicCheckpoint(int32_t entrypointFuncWasmOffset,
+                          const std::string& entrypointFuncArg);
+
+/**
+ * Called at the start of each call. If restore is on and the function has a
+ * checkpoint, restores the module's memory and points the call at where to
+ * resume. Rank zero of an MPI world recreates the world, whose other ranks
+ * then restore their own part of the same checkpoint.
+ */
+bool restoreCheckpoint(WasmModule& module, faabric::Message& msg);
+
+/**
+ * Called at the end of each call. Calls that succeed delete their
+ * checkpoints, so that nothing later resumes from them.
+ */
+void finishCheckpoints(const faabric::Message& msg, bool succeeded);
+}
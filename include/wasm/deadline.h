@@ -0,0 +1,95 @@
+#pragma once
+
+#include <faabric/proto/faabric.pb.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+
+// Return value of calls stopped at their deadline, as with timeout(1)
+#define EXECUTION_DEADLINE_RETURN_VALUE 124
+
+namespace wasm {
+
+class WasmModule;
+
+// Time, in epoch milliseconds, after which the caller stops waiting for the
+// message's result, so there's no point the function carrying on
+int64_t getExecutionDeadlineMs(const faabric::Message& msg);
+
+/**
+ * Deadline of a call that starts executing at the given time. This is the
+ * caller's deadline, brought forward if the call would otherwise run for
+ * longer than EXEC_TIMEOUT_MS.
+ */
+int64_t getCallDeadlineMs(const faabric::Message& msg, int64_t startMs);
+
+// Deadline of the call executing on this thread, or -1 if there isn't one
+int64_t getCurrentDeadlineMs();
+
+// Milliseconds left before the current call's deadline, or -1 if it has none
+int64_t getRemainingTimeMs();
+
+/**
+ * Watches over calls executing with a deadline, and interrupts the module
+ * executing them once they run past it. Interrupts are sent with the lock
+ * held, so once a call is disarmed its module won't be interrupted any more.
+ */
+class ExecutionWatchdog
+{
+  public:
+    ~ExecutionWatchdog();
+
+    uint64_t arm(WasmModule* module, int64_t deadlineMs);
+
+    void disarm(uint64_t id);
+
+    size_t getArmedCount();
+
+  private:
+    struct ArmedCall
+    {
+        WasmModule* module;
+        int64_t deadlineMs;
+    };
+
+    std::mutex mx;
+    std::condition_variable cv;
+    std::map<uint64_t, ArmedCall> armed;
+    uint64_t nextId = 1;
+
+    bool running = false;
+    std::thread watchThread;
+
+    void watch();
+};
+
+ExecutionWatchdog& getExecutionWatchdog();
+
+/**
+ * Arms the watchdog for the call executing on this thread for as long as it's
+ * in scope. Once the guard is gone the module won't be interrupted, so it's
+ * safe to check whether it was and recover.
+ */
+class ExecutionDeadlineGuard
+{
+  public:
+    ExecutionDeadlineGuard(WasmModule& moduleIn, const faabric::Message& msg);
+
+    ~ExecutionDeadlineGuard();
+
+    ExecutionDeadlineGuard(const ExecutionDeadlineGuard&) = delete;
+
+    ExecutionDeadlineGuard& operator=(const ExecutionDeadlineGuard&) = delete;
+
+    int64_t getDeadlineMs() const { return deadlineMs; }
+
+  private:
+    WasmModule& module;
+    int64_t deadlineMs;
+    int64_t previousDeadlineMs;
+    uint64_t watchId;
+};
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace wasm {
+
+/**
+ * Tracks which pages of one module's memory are written to.
+ *
+ * faabric's dirty tracker is process-wide: soft-dirty bits are cleared for
+ * the whole process, and segfault tracking depends on which thread started
+ * it, so modules using it at the same time wipe each other's tracking. Where
+ * the kernel supports it, this write-protects just the module's own range
+ * with an asynchronous userfaultfd, and reads back the written pages with
+ * PAGEMAP_SCAN, so trackers never affect each other.
+ *
+ * Otherwise it falls back to faabric's tracker, but only while no other
+ * module is using it. If it's taken, tracking doesn't start and the caller
+ * must assume every page is dirty.
+ *
+ * Remapping any part of the range drops it from the userfaultfd, so anything
+ * that remaps memory must stop tracking.
+ */
+class MemoryDirtyTracker
+{
+  public:
+    MemoryDirtyTracker() = default;
+
+    MemoryDirtyTracker(const MemoryDirtyTracker&) = delete;
+
+    MemoryDirtyTracker& operator=(const MemoryDirtyTracker&) = delete;
+
+    ~MemoryDirtyTracker();
+
+    // Returns false if the range can't be tracked
+    bool startTracking(std::span<uint8_t> memIn);
+
+    // One entry per host page, non-zero if written since tracking started or
+    // was last restarted
+    std::vector<char> getDirtyPages();
+
+    // Starts again from a clean slate, e.g. once dirty pages are restored
+    void restartTracking();
+
+    void stopTracking();
+
+    bool isTracking() const { return uffd >= 0 || usingShared; }
+
+    // Whether the kernel can track ranges on their own
+    static bool isPerRangeTrackingSupported();
+
+  private:
+    std::span<uint8_t> mem;
+
+    int uffd = -1;
+
+    bool usingShared = false;
+
+    bool startRangeTracking();
+
+    void writeProtectRange();
+};
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <faabric/proto/faabric.pb.h>
+
+#include <storage/FunctionMetadata.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+// Hints in the function's metadata that make up its profile
+#define PROFILE_MAX_MEMORY_PAGES "max-memory-pages"
+#define PROFILE_WASM_VM "wasm-vm"
+#define PROFILE_WAMR_STACK_SIZE "wamr-stack-size"
+#define PROFILE_CGROUP_GRANULARITY "cgroup-granularity"
+#define PROFILE_PREWARM_FAASLETS "prewarm-faaslets"
+
+/*
+ * Per-function overrides of host-wide settings, so that hosts don't have to be
+ * configured for the most demanding function they run. Profiles are stored as
+ * hints in the function's metadata, and applied when a Faaslet creates and
+ * binds the function's module. Each host reads a function's profile once, and
+ * again after a flush.
+ */
+namespace wasm {
+
+struct FunctionProfile
+{
+    // Zero or empty leaves the host's setting
+
+    // Caps the function's memory below MAX_WASM_MEM
+    uint32_t maxMemoryPages = 0;
+
+    // "wavm" or "wamr". Machine code for it must have been generated.
+    std::string wasmVm;
+
+    // In bytes, as with WAMR_STACK_SIZE
+    uint32_t wamrStackSize = 0;
+
+    // "host", "user" or "function", as with CGROUP_GRANULARITY
+    std::string cgroupGranularity;
+
+    // Faaslets created up front when the function is prewarmed
+    int prewarmFaaslets = 0;
+};
+
+// Returns an error message if the hint isn't a valid part of a profile
+std::string validateProfileHint(const std::string& key,
+                                const std::string& value);
+
+// Parses "key=value" lines, skipping blank lines and # comments. Throws if any
+// line is malformed or invalid.
+std::map<std::string, std::string> parseProfileHints(
+  const std::string& contents);
+
+// Invalid hints are ignored with a warning
+FunctionProfile parseFunctionProfile(
+  const storage::FunctionMetadata& metadata);
+
+FunctionProfile getFunctionProfile(const faabric::Message& msg);
+
+// The function's wasm VM, falling back to the host's
+std::string getFunctionWasmVm(const faabric::Message& msg);
+
+void clearFunctionProfiles();
+}
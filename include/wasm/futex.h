@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Most pthread mutexes a module can have at once
+#define MAX_PTHREAD_MUTEXES 16384
+
+namespace wasm {
+
+/**
+ * Futexes on words in a module's linear memory. Threads of a module share its
+ * memory on the same host, so these go straight to the OS futex on the native
+ * address.
+ *
+ * Timeouts are relative, in milliseconds, with -1 meaning no timeout. Waits
+ * never outlast the deadline of the call being executed, as a thread blocked
+ * in the kernel can't be interrupted.
+ */
+
+// Blocks while the word holds the expected value, until woken or the timeout
+// passes. Returns 0 once woken, otherwise -errno, e.g. -EAGAIN if the word no
+// longer holds the expected value, or -ETIMEDOUT.
+int futexWait(int32_t* addr, int32_t expected, int64_t timeoutMs);
+
+// Wakes up to the given number of waiters, returning how many were woken
+int futexWake(int32_t* addr, int32_t maxWaiters);
+
+/**
+ * Mutex that only goes to the kernel when contended, as with glibc and musl.
+ * Unlike futex waits above, waiting for the lock isn't bounded by the call's
+ * deadline, as with a std::mutex.
+ */
+class FutexMutex
+{
+  public:
+    void lock();
+
+    bool try_lock();
+
+    void unlock();
+
+  private:
+    // Zero when unlocked, one when locked, two when there may be waiters
+    std::atomic<int32_t> state = 0;
+};
+
+/**
+ * Pre-allocated mutexes for the pthread mutexes of a module. Each pthread
+ * mutex's slot is cached in a word of its struct in linear memory, which we
+ * own as we intercept all the pthread mutex functions. Once a mutex has its
+ * slot, finding it is a read of that word and a check that the slot still
+ * belongs to it, without any locks.
+ *
+ * Slots are checked as the word may come from memory restored from another
+ * host, or have survived the mutex being destroyed.
+ */
+class FutexMutexSlab
+{
+  public:
+    explicit FutexMutexSlab(size_t capacityIn = MAX_PTHREAD_MUTEXES);
+
+    // Returns the mutex at the given wasm pointer, giving it a slot if it
+    // doesn't have one. Throws if the slab is full.
+    FutexMutex& get(uint32_t mxPtr, int32_t* slotWord);
+
+    void release(uint32_t mxPtr, int32_t* slotWord);
+
+    size_t getUsedCount();
+
+  private:
+    struct Slot
+    {
+        FutexMutex mx;
+        std::atomic<uint32_t> owner = 0;
+    };
+
+    size_t capacity;
+
+    // Slots are only allocated once a module uses mutexes
+    std::atomic<Slot*> slots = nullptr;
+    std::unique_ptr<Slot[]> slotsMemory;
+
+    std::mutex allocMx;
+    std::vector<int32_t> freeSlots;
+    size_t nextSlot = 0;
+
+    Slot* findSlot(uint32_t mxPtr, int32_t* slotWord);
+};
+
+/**
+ * Condition variables on a sequence word in linear memory, bumped on every
+ * signal. Waiters release the given mutex while waiting on the word and hold
+ * it again on return, whether or not they were woken in time. As with
+ * pthreads, waits may return spuriously.
+ */
+int futexCondWait(int32_t* seq, FutexMutex& mx, int64_t timeoutMs);
+
+void futexCondWake(int32_t* seq, int32_t maxWaiters);
+}
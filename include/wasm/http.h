@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace wasm {
+
+struct HttpUrl
+{
+    std::string host;
+    int port = 80;
+    std::string path = "/";
+};
+
+// Only plain http URLs are supported, e.g. http://backend:8080/api
+HttpUrl parseHttpUrl(const std::string& url);
+
+struct HttpResponse
+{
+    int status = 0;
+    std::vector<uint8_t> body;
+};
+
+/**
+ * Idle keep-alive connections to each backend, so that functions calling the
+ * same backend over and over don't open a new TCP connection every time.
+ * Connections belong to the host rather than the module, so outlive module
+ * resets. As well as by tenant and backend they're keyed by network
+ * namespace, as a socket stays in the namespace it was opened in.
+ */
+class HttpConnectionPool
+{
+  public:
+    ~HttpConnectionPool();
+
+    // Returns an idle connection that's still open, or -1 if there isn't one
+    int claim(const std::string& key);
+
+    // Connections that can't be reused should be closed rather than released
+    void release(const std::string& key, int fd);
+
+    size_t getIdleCount(const std::string& key);
+
+    void clear();
+
+  private:
+    struct IdleConnection
+    {
+        int fd;
+        std::chrono::steady_clock::time_point idleSince;
+    };
+
+    std::mutex mx;
+    std::unordered_map<std::string, std::vector<IdleConnection>> idle;
+};
+
+HttpConnectionPool& getHttpConnectionPool();
+
+std::string getHttpPoolKey(const std::string& user, const HttpUrl& url);
+
+/**
+ * Makes a request for the executing function, reusing a pooled connection
+ * where there is one. Extra headers are given as "Name: value" lines separated
+ * by \r\n. Waits are bounded by the function's execution deadline. Throws on
+ * failure.
+ */
+HttpResponse doHttpRequest(const std::string& method,
+                           const std::string& url,
+                           const std::string& headers,
+                           const std::vector<uint8_t>& body);
+
+/**
+ * Shared by the runtimes' host interfaces. Copies as much of the response body
+ * as fits into the buffer, and returns the length of the whole body, or -1 if
+ * the request failed.
+ */
+int32_t doHostHttpRequest(const std::string& method,
+                          const std::string& url,
+                          const std::string& headers,
+                          const uint8_t* body,
+                          size_t bodyLen,
+                          uint8_t* responseBuffer,
+                          size_t responseBufferLen,
+                          int32_t* status);
+}
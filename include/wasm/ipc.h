@@ -0,0 +1,109 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Direct hand-offs into a reader's memory stop this long before the reader's
+// deadline, as its memory may be revoked once the deadline passes
+#define IPC_HANDOFF_DEADLINE_MARGIN_MS 50
+
+namespace wasm {
+
+/**
+ * Ring buffer through which Faaslets on the same host stream bytes to one
+ * another, without going through the scheduler or serialising anything. When
+ * a reader is already waiting, writes are copied straight into its buffer,
+ * otherwise they're buffered in the ring. Chunks from different writers may
+ * be interleaved.
+ *
+ * Deadlines are in epoch milliseconds, with -1 meaning no deadline.
+ */
+class IpcChannel
+{
+  public:
+    explicit IpcChannel(size_t capacityIn);
+
+    // Blocks until everything is written or the deadline passes, and returns
+    // how much was written
+    size_t write(const uint8_t* data, size_t len, int64_t deadlineMs);
+
+    // Blocks until there's something to read, and returns how much was read.
+    // Returns zero once all writers have closed and everything has been read,
+    // or -1 if the deadline passes first.
+    int64_t read(uint8_t* buffer, size_t len, int64_t deadlineMs);
+
+    void addWriter();
+
+    void removeWriter();
+
+    size_t getCapacity();
+
+    size_t getBufferedBytes();
+
+  private:
+    struct PendingRead
+    {
+        uint8_t* buffer;
+        size_t len;
+        int64_t deadlineMs;
+        size_t filled = 0;
+    };
+
+    std::mutex mx;
+    std::condition_variable cv;
+
+    std::vector<uint8_t> ring;
+    size_t head = 0;
+    size_t used = 0;
+
+    int writers = 0;
+    bool hadWriters = false;
+
+    PendingRead* pendingRead = nullptr;
+
+    bool isFinished();
+
+    bool canHandOff();
+
+    bool waitUntil(std::unique_lock<std::mutex>& lock, int64_t deadlineMs);
+
+    void copyIn(const uint8_t* data, size_t len);
+
+    void copyOut(uint8_t* buffer, size_t len);
+};
+
+// One module's end of a channel
+struct IpcChannelEnd
+{
+    std::string user;
+    std::string name;
+    bool write = false;
+    std::shared_ptr<IpcChannel> channel = nullptr;
+};
+
+/**
+ * Channels are named per tenant, and created by whichever end opens them
+ * first, with IPC_CHANNEL_SIZE bytes of buffer. They're removed once the last
+ * end is closed.
+ */
+IpcChannelEnd openIpcChannel(const std::string& user,
+                             const std::string& name,
+                             bool write);
+
+void closeIpcChannel(IpcChannelEnd& end);
+
+size_t getOpenIpcChannelCount();
+
+// Shared by the runtimes' host interfaces. These return -1 on failure.
+int32_t doHostChannelOpen(const std::string& name, int32_t write);
+
+int32_t doHostChannelWrite(int32_t handle, const uint8_t* data, int32_t len);
+
+int32_t doHostChannelRead(int32_t handle, uint8_t* buffer, int32_t len);
+
+int32_t doHostChannelClose(int32_t handle);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+// Granularity of memory diffs. Changed ranges are rounded out to blocks of this
+// size, which is the width of an AVX2 register
+#define MEMORY_DIFF_BLOCK_SIZE 32
+
+// Changed ranges closer together than this are merged into one, as the
+// overhead of an extra diff outweighs sending a few unchanged bytes
+#define MEMORY_DIFF_MERGE_GAP 128
+
+/*
+ * Memory comparisons done on the Faasm side: migration pre-copies, state
+ * pushes and checkpoint zero-page elision. The diffs sent back when threads
+ * finish, and merged into the main thread's memory, are made by faabric's
+ * snapshots, so don't go through these.
+ */
+namespace wasm {
+
+/**
+ * Compares two equally sized regions of memory, returning the (start, end)
+ * byte ranges that differ. Uses AVX2 when the host supports it.
+ */
+std::vector<std::pair<size_t, size_t>> diffMemoryRanges(
+  std::span<const uint8_t> original,
+  std::span<const uint8_t> updated);
+
+bool isZeroMemory(std::span<const uint8_t> data);
+}
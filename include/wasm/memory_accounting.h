@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace wasm {
+
+struct ResidentMemory
+{
+    // Pages backed by physical memory
+    size_t residentBytes = 0;
+
+    // Of those, pages that aren't shared with anything else, e.g. ones
+    // written since a snapshot was mapped over the memory
+    size_t privateBytes = 0;
+};
+
+/**
+ * Finds which pages of the range are resident from /proc/self/pagemap, which
+ * also tells private pages from those still shared with a snapshot or the
+ * page cache. If pagemap can't be read, falls back to mincore, which can't
+ * tell them apart, so every resident page is counted as private.
+ */
+ResidentMemory getResidentMemory(const uint8_t* ptr, size_t len);
+
+// Memory a module takes up on the host
+struct ModuleMemoryUsage
+{
+    // The size of linear memory, whether or not it's been touched
+    size_t linearMemoryBytes = 0;
+
+    size_t residentBytes = 0;
+
+    size_t privateBytes = 0;
+
+    // Held by the host on the module's behalf, e.g. captured stdout and
+    // execution environment stacks
+    size_t hostBufferBytes = 0;
+
+    ModuleMemoryUsage& operator+=(const ModuleMemoryUsage& other);
+};
+}
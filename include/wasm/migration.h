@@ -1,6 +1,63 @@
 #pragma once
 
+#include <faabric/proto/faabric.pb.h>
+#include <faabric/util/snapshot.h>
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
 namespace wasm {
+class WasmModule;
+
 void doMigrationPoint(int32_t entrypointFuncWasmOffset,
                       const std::string& entrypointFuncArg);
+
+/**
+ * Cost model for migrating MPI apps. The app's run time is taken to grow with
+ * the fraction of pairs of ranks on different hosts, and the app is assumed
+ * to have as long left to run as it has run so far. Migrating is worthwhile
+ * if the time that saves is more than moving the ranks' memory would take.
+ */
+bool isMigrationWorthwhile(size_t bytesToMove,
+                           double elapsedSecs,
+                           const std::vector<std::string>& rankHostsBefore,
+                           const std::vector<std::string>& rankHostsAfter,
+                           int bandwidthMbps);
+
+// The fraction of pairs of ranks on different hosts
+double getCrossHostFraction(const std::vector<std::string>& rankHosts);
+
+/**
+ * Pre-copy migration. While the guard is alive, a background thread watches
+ * for a pending migration of the call. As soon as one appears, it pushes a
+ * snapshot of the module's memory to the destination host. At the migration
+ * point only what has changed since has to be sent, which keeps the time the
+ * function is frozen short.
+ *
+ * Does nothing unless pre-copy is enabled in the config and the call has a
+ * migration check period.
+ */
+class MigrationPrecopyGuard
+{
+  public:
+    MigrationPrecopyGuard(const faabric::Message& msg, WasmModule& module);
+
+    ~MigrationPrecopyGuard();
+
+  private:
+    int msgId = 0;
+    bool active = false;
+};
+
+/**
+ * Diffs that bring a pre-copy of memory up to date. Memory is compared with
+ * what was pre-copied rather than relying on dirty tracking, which other
+ * users of the process-wide tracker could reset. Memory grown since is sent
+ * in full.
+ */
+std::vector<faabric::util::SnapshotDiff> getPrecopyDiffs(
+  std::span<const uint8_t> precopied,
+  std::span<const uint8_t> memory);
 }
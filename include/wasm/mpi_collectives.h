@@ -0,0 +1,57 @@
+#pragma once
+
+#include <faabric/mpi/MpiWorld.h>
+#include <faabric/mpi/mpi.h>
+
+#include <cstdint>
+
+/*
+ * Collectives with a different amount of data per rank, built on faabric's
+ * point-to-point and collective calls, and shared by the WAVM and WAMR MPI
+ * host interfaces. Counts and displacements are in elements of the relevant
+ * datatype, as in MPI.
+ */
+namespace wasm {
+
+/**
+ * Ring all-gather: each rank passes on the block it received in the previous
+ * step, so only one block crosses each link per step. A null send buffer means
+ * the rank's block is already in place in the receive buffer.
+ */
+void mpiAllGatherV(faabric::mpi::MpiWorld& world,
+                   int rank,
+                   const uint8_t* sendBuf,
+                   int sendCount,
+                   faabric_datatype_t* sendType,
+                   uint8_t* recvBuf,
+                   const int32_t* recvCounts,
+                   const int32_t* displs,
+                   faabric_datatype_t* recvType);
+
+/**
+ * Pairwise exchange with every rank at once. Empty blocks are skipped, which
+ * keeps sparse exchanges cheap.
+ */
+void mpiAllToAllV(faabric::mpi::MpiWorld& world,
+                  int rank,
+                  const uint8_t* sendBuf,
+                  const int32_t* sendCounts,
+                  const int32_t* sendDispls,
+                  faabric_datatype_t* sendType,
+                  uint8_t* recvBuf,
+                  const int32_t* recvCounts,
+                  const int32_t* recvDispls,
+                  faabric_datatype_t* recvType);
+
+/**
+ * Reduces the whole buffer across all ranks, then keeps this rank's block. A
+ * send buffer equal to the receive buffer means in-place.
+ */
+void mpiReduceScatter(faabric::mpi::MpiWorld& world,
+                      int rank,
+                      const uint8_t* sendBuf,
+                      uint8_t* recvBuf,
+                      const int32_t* recvCounts,
+                      faabric_datatype_t* datatype,
+                      faabric_op_t* op);
+}
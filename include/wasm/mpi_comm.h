@@ -0,0 +1,241 @@
+#pragma once
+
+#include <faabric/mpi/MpiWorld.h>
+#include <faabric/mpi/mpi.h>
+
+#include <wasm/mpi_ops.h>
+#include <wasm/mpi_shm.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Sub-communicators, shared by the WAVM and WAMR MPI host interfaces. Faabric
+ * only knows about the world, so a communicator is a group of world ranks,
+ * and its collectives are built from point-to-point messages between them.
+ * As faabric matches messages on sender and receiver only, members must not
+ * have point-to-point messages outstanding between each other when they enter
+ * a collective. With MPI_SHM_COLLECTIVES on, members on the same host meet in
+ * a shared segment for broadcasts and reductions with built-in operators,
+ * rather than messaging each other.
+ *
+ * Every member gives a communicator the same ID, so state shared between
+ * members can be keyed on it.
+ */
+
+// Faabric's MPI header doesn't have it, so we use Open MPI's
+#ifndef MPI_PROC_NULL
+#define MPI_PROC_NULL -2
+#endif
+
+namespace wasm {
+
+class MpiCommunicator
+{
+  public:
+    // World ranks are given in order of their rank in the communicator
+    MpiCommunicator(int idIn, std::vector<int> worldRanksIn, int worldRank);
+
+    int getId() const { return id; }
+
+    int getRank() const { return rank; }
+
+    int getSize() const { return (int)worldRanks.size(); }
+
+    int getWorldRank(int commRank) const;
+
+    int getCommRank(int worldRank) const;
+
+    /**
+     * Lays the ranks out on a Cartesian grid, in row-major order, as in
+     * MPI_Cart_create. The grid must have as many cells as there are ranks.
+     */
+    void setCartTopology(std::vector<int> dimsIn, std::vector<bool> periodsIn);
+
+    bool hasCartTopology() const { return !cartDims.empty(); }
+
+    const std::vector<int>& getCartDims() const { return cartDims; }
+
+    const std::vector<bool>& getCartPeriods() const { return cartPeriods; }
+
+    std::vector<int> getCartCoords(int commRank) const;
+
+    // Coordinates wrap in periodic dimensions, and are MPI_PROC_NULL off the
+    // edge of others
+    int getCartRank(const std::vector<int>& coords) const;
+
+    // The ranks this rank receives from and sends to in a shift, as in
+    // MPI_Cart_shift
+    std::pair<int, int> shiftCart(int direction, int disp) const;
+
+    // Comm ranks of the members on this rank's host, with the lowest first
+    const std::vector<int>& getHostMembers(faabric::mpi::MpiWorld& world);
+
+    // The lowest comm rank on each host, in order
+    std::vector<int> getHostLeaders(faabric::mpi::MpiWorld& world);
+
+    // Forgets which hosts the members are on, e.g. after a migration
+    void resetHosts();
+
+    // Drops this host's shared segment, once the communicator is done with
+    void releaseHostSegment();
+
+    void barrier(faabric::mpi::MpiWorld& world);
+
+    void broadcast(faabric::mpi::MpiWorld& world,
+                   int root,
+                   uint8_t* buffer,
+                   faabric_datatype_t* datatype,
+                   int count);
+
+    void reduce(faabric::mpi::MpiWorld& world,
+                int root,
+                const uint8_t* sendBuf,
+                uint8_t* recvBuf,
+                faabric_datatype_t* datatype,
+                int count,
+                faabric_op_t* op);
+
+    /**
+     * Reduces with the given function. Non-commutative functions are applied
+     * in rank order on the root, as MPI requires.
+     */
+    void reduce(faabric::mpi::MpiWorld& world,
+                int root,
+                const uint8_t* sendBuf,
+                uint8_t* recvBuf,
+                faabric_datatype_t* datatype,
+                int count,
+                const MpiCombineFunction& combine,
+                bool commute);
+
+    void allReduce(faabric::mpi::MpiWorld& world,
+                   const uint8_t* sendBuf,
+                   uint8_t* recvBuf,
+                   faabric_datatype_t* datatype,
+                   int count,
+                   faabric_op_t* op);
+
+    void allReduce(faabric::mpi::MpiWorld& world,
+                   const uint8_t* sendBuf,
+                   uint8_t* recvBuf,
+                   faabric_datatype_t* datatype,
+                   int count,
+                   const MpiCombineFunction& combine,
+                   bool commute);
+
+    void allGather(faabric::mpi::MpiWorld& world,
+                   const uint8_t* sendBuf,
+                   uint8_t* recvBuf,
+                   faabric_datatype_t* datatype,
+                   int count);
+
+  private:
+    const int id;
+    const std::vector<int> worldRanks;
+    std::map<int, int> commRanks;
+    int rank = -1;
+
+    std::vector<int> cartDims;
+    std::vector<bool> cartPeriods;
+
+    // Comm ranks of each host's members, with the lowest first
+    std::map<std::string, std::vector<int>> hostMembers;
+
+    // Shared by the members on this host, when shared-memory collectives
+    // are on
+    std::string hostSegmentKey;
+    std::shared_ptr<MpiHostSegment> hostSegment;
+
+    void initHosts(faabric::mpi::MpiWorld& world);
+
+    MpiHostSegment& getHostSegment(faabric::mpi::MpiWorld& world);
+
+    void broadcastOnHost(faabric::mpi::MpiWorld& world,
+                         int root,
+                         uint8_t* buffer,
+                         faabric_datatype_t* datatype,
+                         int count);
+
+    void reduceOnHost(faabric::mpi::MpiWorld& world,
+                      int root,
+                      const uint8_t* sendBuf,
+                      uint8_t* recvBuf,
+                      faabric_datatype_t* datatype,
+                      int count,
+                      const MpiCombineFunction& combine);
+
+    void reduceInOrder(faabric::mpi::MpiWorld& world,
+                       int root,
+                       const uint8_t* sendBuf,
+                       uint8_t* recvBuf,
+                       faabric_datatype_t* datatype,
+                       int count,
+                       const MpiCombineFunction& combine);
+
+    // The rank that talks to other hosts for the host of the given rank. On
+    // the root's host this is the root.
+    int getHostLeader(faabric::mpi::MpiWorld& world, int commRank, int root);
+};
+
+/**
+ * Splits the given communicator, as in MPI_Comm_split. Collective over the
+ * parent, and returns the ID of the calling rank's new communicator, or -1 if
+ * its colour is MPI_UNDEFINED.
+ */
+int splitMpiCommunicator(faabric::mpi::MpiWorld& world,
+                         int worldRank,
+                         int parentId,
+                         int color,
+                         int key);
+
+// Registers a copy of the given communicator under a new ID
+int dupMpiCommunicator(faabric::mpi::MpiWorld& world,
+                       int worldRank,
+                       int parentId);
+
+/**
+ * Creates a communicator laid out on a Cartesian grid over the parent's first
+ * ranks, as in MPI_Cart_create. With reorder, ranks are placed so that grid
+ * neighbours are on the same host where possible. Every member works out the
+ * same placement from where ranks are, so this sends no messages. Returns -1
+ * for ranks left off the grid.
+ *
+ * A grid over the whole world that keeps its ranks in place is the world
+ * communicator itself, so calls that only take the world still work with it.
+ */
+int createMpiCartCommunicator(faabric::mpi::MpiWorld& world,
+                              int worldRank,
+                              int parentId,
+                              const std::vector<int>& dims,
+                              const std::vector<bool>& periods,
+                              bool reorder);
+
+/**
+ * Places ranks on a Cartesian grid given the host of each, returning the rank
+ * to put at each cell, in row-major order. Each host's ranks fill a compact
+ * block of the grid, which keeps most grid neighbours on the same host. Ranks
+ * stay in order if this wouldn't put more neighbours together.
+ */
+std::vector<int> getMpiCartPlacement(const std::vector<int>& dims,
+                                     const std::vector<bool>& periods,
+                                     const std::vector<std::string>& hosts);
+
+/**
+ * Gets the calling rank's communicator for the given ID, with
+ * FAABRIC_COMM_WORLD giving one over the whole world.
+ */
+MpiCommunicator& getMpiCommunicator(faabric::mpi::MpiWorld& world,
+                                    int worldRank,
+                                    int id);
+
+void freeMpiCommunicator(int id);
+
+void resetMpiCommunicatorHosts();
+
+void clearMpiCommunicators();
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <faabric/mpi/MpiWorld.h>
+#include <faabric/mpi/mpi.h>
+
+#include <wasm/mpi_comm.h>
+
+#include <cstdint>
+#include <memory>
+
+/*
+ * The runtime-agnostic part of the MPI host interface, shared by WAVM and
+ * WAMR. The runtimes decode and check the guest's arguments, turning wasm
+ * offsets into native pointers and handles into host structs and IDs, and
+ * leave the rest to this, so both support the same calls in the same way.
+ *
+ * Ranks and counts are as the guest gave them, i.e. ranks are in the given
+ * communicator and counts are in elements of the given datatype. Buffers must
+ * already have been checked to hold them.
+ */
+namespace wasm {
+
+class MpiCore
+{
+  public:
+    MpiCore(faabric::mpi::MpiWorld& worldIn, int rankIn);
+
+    MpiCore(const MpiCore&) = delete;
+    MpiCore& operator=(const MpiCore&) = delete;
+
+    // The world communicator is kept to hand, as nearly every call uses it
+    MpiCommunicator& getCommunicator(int commId);
+
+    void send(uint8_t* buffer,
+              int count,
+              faabric_datatype_t* datatype,
+              int destRank,
+              int commId);
+
+    void recv(uint8_t* buffer,
+              int count,
+              faabric_datatype_t* datatype,
+              int sourceRank,
+              int commId,
+              MPI_Status* status);
+
+    // Returns the ID of the request
+    int isend(uint8_t* buffer,
+              int count,
+              faabric_datatype_t* datatype,
+              int destRank,
+              int commId);
+
+    // Returns the ID of the request. The buffer is written when it's awaited.
+    int irecv(uint8_t* buffer,
+              int count,
+              faabric_datatype_t* datatype,
+              int sourceRank,
+              int commId);
+
+    /**
+     * Persistent requests, bound to their buffer, peer and datatype once and
+     * started any number of times (see addMpiPersistentRequest). Returns the
+     * ID of the request.
+     */
+    int sendInit(uint8_t* buffer,
+                 int count,
+                 faabric_datatype_t* datatype,
+                 int destRank,
+                 int commId);
+
+    int recvInit(uint8_t* buffer,
+                 int count,
+                 faabric_datatype_t* datatype,
+                 int sourceRank,
+                 int commId);
+
+    void sendRecv(uint8_t* sendBuf,
+                  int sendCount,
+                  faabric_datatype_t* sendType,
+                  int destRank,
+                  uint8_t* recvBuf,
+                  int recvCount,
+                  faabric_datatype_t* recvType,
+                  int sourceRank,
+                  int commId,
+                  MPI_Status* status);
+
+    void broadcast(uint8_t* buffer,
+                   int count,
+                   faabric_datatype_t* datatype,
+                   int root,
+                   int commId);
+
+    void barrier(int commId);
+
+    /**
+     * Reductions with built-in ops. User ops call into the guest, so the
+     * runtimes reduce with those themselves (see MpiCommunicator). A null send
+     * buffer means in-place, here and in the other collectives.
+     */
+    void reduce(uint8_t* sendBuf,
+                uint8_t* recvBuf,
+                int count,
+                faabric_datatype_t* datatype,
+                faabric_op_t* op,
+                int root,
+                int commId);
+
+    void allReduce(uint8_t* sendBuf,
+                   uint8_t* recvBuf,
+                   int count,
+                   faabric_datatype_t* datatype,
+                   faabric_op_t* op,
+                   int commId);
+
+    // The receive buffer holds a block for every rank in the communicator
+    void allGather(uint8_t* sendBuf,
+                   int sendCount,
+                   faabric_datatype_t* sendType,
+                   uint8_t* recvBuf,
+                   int recvCount,
+                   faabric_datatype_t* recvType,
+                   int commId);
+
+    // Only on the world communicator, like faabric's
+    void allToAll(uint8_t* sendBuf,
+                  int sendCount,
+                  faabric_datatype_t* sendType,
+                  uint8_t* recvBuf,
+                  int recvCount,
+                  faabric_datatype_t* recvType);
+
+    /**
+     * Non-blocking collectives, which return the ID of a request to wait on.
+     * They run on the rank's progress thread (see mpi_progress.h), and the
+     * buffers belong to them until the request is waited on.
+     */
+    int ibroadcast(uint8_t* buffer,
+                   int count,
+                   faabric_datatype_t* datatype,
+                   int root,
+                   int commId);
+
+    int iallReduce(uint8_t* sendBuf,
+                   uint8_t* recvBuf,
+                   int count,
+                   faabric_datatype_t* datatype,
+                   faabric_op_t* op,
+                   int commId);
+
+    int iallToAll(uint8_t* sendBuf,
+                  int sendCount,
+                  faabric_datatype_t* sendType,
+                  uint8_t* recvBuf,
+                  int recvCount,
+                  faabric_datatype_t* recvType);
+
+    // MPI-IO on shared files (see mpi_file.h)
+    void fileWriteAtAll(int fileId,
+                        int64_t offset,
+                        uint8_t* buffer,
+                        int count,
+                        faabric_datatype_t* datatype,
+                        MPI_Status* status);
+
+    void fileReadAtAll(int fileId,
+                       int64_t offset,
+                       uint8_t* buffer,
+                       int count,
+                       faabric_datatype_t* datatype,
+                       MPI_Status* status);
+
+    // Cleans up everything the rank's calls left behind and destroys the world
+    void finalize();
+
+    faabric::mpi::MpiWorld& world;
+    const int rank;
+
+  private:
+    MpiCommunicator* worldComm = nullptr;
+};
+
+/**
+ * Migration points may move ranks between hosts, so they invalidate the
+ * calling thread's cached MPI contexts, and what its communicators know about
+ * where their members are.
+ */
+void invalidateMpiContext();
+
+uint64_t getMpiContextEpoch();
+
+/**
+ * The calling thread's MPI context for a runtime. It's built at MPI_Init and
+ * reused by every call after, so calls don't have to look up the world or the
+ * module. After a migration point it's rebuilt on next use, which is also how
+ * a rank that's just migrated to this host gets one.
+ */
+template<typename T>
+class MpiContextCache
+{
+  public:
+    T* operator->()
+    {
+        if (context == nullptr || epoch != getMpiContextEpoch()) {
+            build();
+        }
+
+        return context.get();
+    }
+
+    void build()
+    {
+        context = std::make_unique<T>();
+        epoch = getMpiContextEpoch();
+    }
+
+    void reset() { context = nullptr; }
+
+  private:
+    std::unique_ptr<T> context = nullptr;
+    uint64_t epoch = 0;
+};
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <faabric/mpi/MpiWorld.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <sys/uio.h>
+#include <vector>
+
+// Faabric's MPI header doesn't have MPI-IO, so we use Open MPI's values
+#ifndef MPI_MODE_CREATE
+#define MPI_MODE_CREATE 1
+#define MPI_MODE_RDONLY 2
+#define MPI_MODE_WRONLY 4
+#define MPI_MODE_RDWR 8
+#define MPI_MODE_DELETE_ON_CLOSE 16
+#define MPI_MODE_UNIQUE_OPEN 32
+#define MPI_MODE_EXCL 64
+#define MPI_MODE_APPEND 128
+#define MPI_MODE_SEQUENTIAL 256
+#endif
+
+/*
+ * MPI-IO on shared files (faasm://), with collective buffering. Every host
+ * has its own copy of the file, and the lowest rank of the communicator on
+ * each host is the host's aggregator. In collective reads and writes the
+ * other ranks on the host hand their pieces to the aggregator, which sorts
+ * them and issues one large read or write for each contiguous run.
+ *
+ * Writes are only seen by ranks on the same host until the file is closed.
+ * Closing sends what each host wrote to the aggregator of the communicator's
+ * first rank, which uploads the whole file once (in parts, when it's big),
+ * rather than on every write as with WASI file calls.
+ *
+ * Offsets are in bytes, i.e. the default file view.
+ */
+namespace wasm {
+
+class MpiFile
+{
+  public:
+    // Opening is collective over the communicator, which must outlive the file
+    MpiFile(faabric::mpi::MpiWorld& worldIn,
+            int worldRankIn,
+            int commIdIn,
+            const std::string& pathIn,
+            int amodeIn);
+
+    MpiFile(const MpiFile&) = delete;
+    MpiFile& operator=(const MpiFile&) = delete;
+
+    ~MpiFile();
+
+    // Returns the bytes written
+    size_t writeAtAll(int64_t offset, const uint8_t* data, size_t nBytes);
+
+    // Returns the bytes read, fewer than asked for past the end of the file
+    size_t readAtAll(int64_t offset, uint8_t* buffer, size_t nBytes);
+
+    // The size of this host's copy of the file
+    int64_t getSize();
+
+    void close();
+
+  private:
+    faabric::mpi::MpiWorld& world;
+    const int worldRank;
+    const int commId;
+    const std::string path;
+    const int amode;
+
+    std::string realPath;
+    int fd = -1;
+
+    // Comm ranks on this host, with the aggregator first
+    std::vector<int> hostMembers;
+    bool isAggregator = false;
+
+    // Byte ranges the aggregator has written, as start to end
+    std::map<int64_t, int64_t> dirtyRanges;
+
+    void openFile(int flags);
+
+    void checkWritable() const;
+
+    // Writes the buffers one after the other from the offset
+    void writeRun(int64_t offset, const std::vector<iovec>& run);
+
+    void addDirtyRange(int64_t start, int64_t end);
+
+    void sendDirtyRanges(int rootWorldRank);
+
+    void recvDirtyRanges(int leaderWorldRank);
+};
+
+/**
+ * Files are identified by the ID the guest holds in its MPI_File, and belong
+ * to the calling rank's thread.
+ */
+int openMpiFile(faabric::mpi::MpiWorld& world,
+                int worldRank,
+                int commId,
+                const std::string& path,
+                int amode);
+
+MpiFile& getMpiFile(int fileId);
+
+void closeMpiFile(int fileId);
+
+// Drops the calling rank's files without closing them collectively
+void clearMpiFiles();
+}
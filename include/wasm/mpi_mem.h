@@ -0,0 +1,33 @@
+#pragma once
+
+#include <wasm/WasmModule.h>
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Memory handed out by MPI_Alloc_mem, which applications use to declare their
+ * communication buffers. Each region is its own stretch of linear memory,
+ * advised onto huge pages (and aligned to them when big enough) and locked in
+ * RAM, so transfers never fault on it. With rendezvous on (see
+ * mpi_rendezvous.h), sends from these regions to ranks on the same host always
+ * go by rendezvous, whatever their size.
+ *
+ * Regions are kept per rank as wasm offsets, so still hold if the runtime
+ * moves linear memory when it grows, although the pages are then no longer
+ * locked.
+ */
+namespace wasm {
+
+// Returns the wasm offset of a new region of at least the given size
+uint32_t allocMpiMemory(WasmModule& module, size_t nBytes);
+
+// Unlocks the region. Its memory is left in place, as with munmap.
+void freeMpiMemory(WasmModule& module, uint32_t offset);
+
+// Whether the buffer lies within one of the executing rank's regions
+bool isMpiMemory(const uint8_t* buffer, size_t nBytes);
+
+// Forgets the calling rank's regions
+void clearMpiMemory();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+/*
+ * User-defined MPI reduction operators, shared by the WAVM and WAMR MPI host
+ * interfaces. Faabric's reductions only know the built-in operators, so user
+ * operators are reduced by our communicators (see MpiCommunicator), calling
+ * back into the guest's function to combine buffers.
+ */
+namespace wasm {
+
+// IDs of user operators start here, well clear of faabric's built-in ones
+#define FAASM_MPI_USER_OP_BASE 0x10000
+
+// Combines count elements of in into inout, as in MPI_User_function
+using MpiCombineFunction =
+  std::function<void(const uint8_t* in, uint8_t* inout, int count)>;
+
+struct MpiUserOp
+{
+    // Table index of the guest's MPI_User_function
+    int32_t funcPtr = 0;
+    bool commute = false;
+};
+
+int createMpiUserOp(int32_t funcPtr, bool commute);
+
+bool isMpiUserOp(int opId);
+
+const MpiUserOp& getMpiUserOp(int opId);
+
+void freeMpiUserOp(int opId);
+
+void clearMpiUserOps();
+}
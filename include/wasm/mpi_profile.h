@@ -0,0 +1,119 @@
+#pragma once
+
+#include <faabric/proto/faabric.pb.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+/*
+ * Per-rank breakdown of MPI communication, switched on by setting
+ * MPI_PROFILE_FILE. For each call type a rank records how often it was made,
+ * the bytes it moved, the time spent in it and how much of that was spent
+ * waiting on other ranks, along with a histogram of call latencies. It also
+ * records what it sent to each other rank, so together the ranks' profiles
+ * give the world's point-to-point communication matrix.
+ */
+namespace wasm {
+
+// Bucket i holds calls that took [2^i, 2^(i+1)) ns, with the last one holding
+// everything longer
+#define MPI_PROFILE_BUCKETS 40
+
+int getMpiLatencyBucket(uint64_t nanos);
+
+struct MpiCallProfile
+{
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    uint64_t nanos = 0;
+    uint64_t waitNanos = 0;
+
+    std::array<uint64_t, MPI_PROFILE_BUCKETS> histogram = {};
+
+    void record(uint64_t callNanos, uint64_t callWaitNanos, size_t callBytes);
+};
+
+struct MpiRankProfile
+{
+    // Keyed by call name, e.g. MPI_Send
+    std::map<std::string, MpiCallProfile> calls;
+
+    // Keyed by the destination's world rank
+    std::map<int, uint64_t> sentBytes;
+    std::map<int, uint64_t> sentMessages;
+
+    bool empty() const { return calls.empty(); }
+
+    std::string toJson(const std::string& host,
+                       int32_t worldId,
+                       int32_t rank) const;
+};
+
+bool isMpiProfiling();
+
+/**
+ * Counts bytes towards the call in progress on the calling thread. Sends
+ * also count towards the communication matrix.
+ */
+void recordMpiBytes(size_t nBytes);
+
+void recordMpiSend(int destWorldRank, size_t nBytes);
+
+/**
+ * Removes and returns what the calling thread has recorded. Each rank runs on
+ * its own thread, so this is the rank's profile.
+ */
+MpiRankProfile takeMpiProfile();
+
+/**
+ * Appends the calling thread's profile for the message to the profile file,
+ * if profiling is on and the message is an MPI rank. Called whenever a
+ * function finishes, so every host writes its own ranks. The rank's totals
+ * are also attached to the message's exec graph details, so they can be
+ * collected without going to each host's file.
+ */
+void flushMpiProfile(faabric::Message& msg);
+
+/**
+ * Records the time from construction to destruction against the MPI call,
+ * along with any waiting and bytes recorded in between. The name is taken
+ * from the call's trace string, e.g. "S - MPI_Send {} {}". Does nothing when
+ * profiling is off.
+ */
+class MpiProfileTimer
+{
+  public:
+    explicit MpiProfileTimer(const char* traceStr);
+
+    ~MpiProfileTimer();
+
+    MpiProfileTimer(const MpiProfileTimer&) = delete;
+    MpiProfileTimer& operator=(const MpiProfileTimer&) = delete;
+
+  private:
+    const char* traceStr;
+    const bool enabled;
+    uint64_t startNanos = 0;
+    uint64_t startWaitNanos = 0;
+    uint64_t startBytes = 0;
+};
+
+// Counts the time from construction to destruction as waiting on other ranks
+class MpiWaitTimer
+{
+  public:
+    MpiWaitTimer();
+
+    ~MpiWaitTimer();
+
+    MpiWaitTimer(const MpiWaitTimer&) = delete;
+    MpiWaitTimer& operator=(const MpiWaitTimer&) = delete;
+
+  private:
+    const bool enabled;
+    uint64_t startNanos = 0;
+};
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <functional>
+
+/*
+ * Non-blocking collectives, run on a progress thread per rank, so they advance
+ * while the guest computes. Each rank's collectives run one at a time in the
+ * order the rank started them, so they match up across ranks just as blocking
+ * ones do.
+ *
+ * Faabric has a single queue of messages between each pair of ranks, so a
+ * rank mustn't talk to other ranks itself while its progress thread does.
+ * Every other call that communicates first waits for the rank's collectives
+ * in flight (see awaitMpiCollectives), but the rank can start any number of
+ * non-blocking collectives back to back, and compute until it waits on them.
+ */
+namespace wasm {
+
+/**
+ * Queues the collective on the calling rank's progress thread, and returns the
+ * ID of its request. Anything the collective uses must outlive the request.
+ */
+int startMpiCollective(std::function<void()> collective);
+
+bool isMpiCollectiveRequest(int requestId);
+
+// Whether waiting on the request would return straight away
+bool isMpiCollectiveDone(int requestId);
+
+// Waits for the collective and forgets its request, rethrowing any error
+void awaitMpiCollective(int requestId);
+
+/**
+ * Waits for all the calling rank's collectives in flight. Their requests are
+ * still waited on as usual after.
+ */
+void awaitMpiCollectives();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <faabric/mpi/MpiWorld.h>
+#include <faabric/mpi/mpi.h>
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Zero-copy MPI_Send/MPI_Recv between ranks on the same host, shared by the
+ * WAVM and WAMR MPI host interfaces. Ranks on a host are threads in the same
+ * process, so rather than sending a large message through faabric's queues,
+ * the sender sends a small marker and waits while the receiver copies the
+ * data straight out of the sender's memory.
+ *
+ * Messages above the threshold, or sent from MPI_Alloc_mem memory (see
+ * mpi_mem.h), can be received with MPI_Recv, MPI_Irecv, MPI_Recv_init or
+ * MPI_Sendrecv, which all recognise the markers. MPI_Probe sees the marker,
+ * so reports its size rather than the message's.
+ */
+namespace wasm {
+
+// Whether MPI_Send may send markers, i.e. receives need to look for them
+bool isMpiRendezvousEnabled();
+
+/**
+ * Sends the message by rendezvous if it's big enough and the receiver is on
+ * this host, blocking until it's been received. Returns false if the message
+ * should be sent normally.
+ */
+bool sendMpiRendezvous(faabric::mpi::MpiWorld& world,
+                       int sendRank,
+                       int recvRank,
+                       const uint8_t* buffer,
+                       faabric_datatype_t* datatype,
+                       int count);
+
+/**
+ * Checks whether the message just received into the buffer is a rendezvous
+ * marker. If so, copies the real message into the buffer, updates the status
+ * and returns true. Receives that don't have a status, e.g. MPI_Irecv, pass
+ * null.
+ */
+bool recvMpiRendezvous(uint8_t* buffer,
+                       faabric_datatype_t* datatype,
+                       int count,
+                       MPI_Status* status);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <faabric/mpi/MpiWorld.h>
+
+#include <functional>
+#include <vector>
+
+/*
+ * Completion of groups of asynchronous MPI requests, shared by the WAVM and
+ * WAMR MPI host interfaces. Requests are point-to-point or non-blocking
+ * collectives (see mpi_progress.h). Request IDs of zero are null requests.
+ */
+namespace wasm {
+
+// Sends are complete as soon as faabric has sent them, so we track them to
+// finish them before waiting on any receive
+void addMpiSendRequest(int requestId);
+
+// Runs once the receive has been awaited, e.g. to unpack its data
+void addMpiRecvCompletion(int requestId, std::function<void()> onComplete);
+
+/**
+ * Persistent requests are bound to a call once, and started any number of
+ * times after. Each start runs the given function, which begins the call and
+ * returns the ID of its request. Until started, and again once awaited, a
+ * persistent request waits like a null one. Returns its ID.
+ */
+int addMpiPersistentRequest(std::function<int()> start);
+
+// Persistent requests stay with the guest after being awaited
+bool isMpiPersistentRequest(int requestId);
+
+void startMpiPersistentRequest(int requestId);
+
+/**
+ * Waits for all the given requests in one go. Puts any sends first, and cleans
+ * up requests that were freed since the last wait.
+ */
+void awaitAllMpiRequests(faabric::mpi::MpiWorld& world,
+                         const std::vector<int>& requestIds);
+
+/**
+ * Waits for one of the given requests, preferring sends as they have already
+ * completed. Returns its index, or -1 if all the requests are null.
+ */
+int awaitAnyMpiRequest(faabric::mpi::MpiWorld& world,
+                       const std::vector<int>& requestIds);
+
+/**
+ * MPI lets a request be freed before it completes, but faabric still needs it
+ * to be awaited, so we do so at the next wait or finalize.
+ */
+void freeMpiRequest(int requestId);
+
+// Called on finalize to await freed requests and forget the rest
+void finishMpiRequests(faabric::mpi::MpiWorld& world);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * Shared-memory collectives for the ranks of a communicator on the same host,
+ * switched on with MPI_SHM_COLLECTIVES. Ranks on a host are threads in the
+ * same process, so rather than each sending its data to the host's leader,
+ * they combine it straight into a segment they share. Only the leader talks
+ * to the other hosts, and the result is copied back out of the segment.
+ *
+ * Every collective is a round: each member contributes (possibly nothing),
+ * the leader waits for them all and fills in the result, then each member
+ * reads it. The next round can only start once every member has read the
+ * last, which holds as MPI makes all ranks call collectives in the same order.
+ */
+namespace wasm {
+
+using MpiSegmentCombineFunction =
+  std::function<void(const uint8_t* in, uint8_t* inout)>;
+
+class MpiHostSegment
+{
+  public:
+    explicit MpiHostSegment(int nMembersIn);
+
+    int getMemberCount() const { return nMembers; }
+
+    /**
+     * Adds this member's data to the round, combining it with what's there
+     * already. A null buffer contributes nothing, only marking the member as
+     * having arrived.
+     */
+    void contribute(const uint8_t* data,
+                    size_t nBytes,
+                    const MpiSegmentCombineFunction& combine);
+
+    /**
+     * Called by the leader only. Waits for every member to contribute, then
+     * returns the combined data. Nothing else touches the data until the
+     * leader publishes, so it may change it.
+     */
+    std::vector<uint8_t>& awaitContributions();
+
+    // Called by the leader once the data holds the round's result
+    void publish();
+
+    /**
+     * Waits for the result and copies it out, unless the buffer is null. Every
+     * member, including the leader, must read once per round.
+     */
+    void read(uint8_t* buffer, size_t nBytes);
+
+  private:
+    enum class RoundState
+    {
+        Gathering,
+        Full,
+        Published,
+    };
+
+    const int nMembers;
+
+    std::mutex mx;
+    std::condition_variable cv;
+
+    RoundState state = RoundState::Gathering;
+    int nArrived = 0;
+    int nDeparted = 0;
+    bool hasData = false;
+    std::vector<uint8_t> data;
+};
+
+/**
+ * Gets the segment with the given key, creating it if need be. The members of
+ * a communicator on a host must all use the same key.
+ */
+std::shared_ptr<MpiHostSegment> getMpiHostSegment(const std::string& key,
+                                                  int nMembers);
+
+void removeMpiHostSegment(const std::string& key);
+
+bool isMpiShmCollectivesEnabled();
+}
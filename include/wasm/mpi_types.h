@@ -0,0 +1,154 @@
+#pragma once
+
+#include <faabric/mpi/mpi.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*
+ * Derived MPI datatypes, shared by the WAVM and WAMR MPI host interfaces.
+ * Faabric only knows contiguous types, so messages in derived types are packed
+ * on the host straight out of the guest's memory before sending, and unpacked
+ * straight into it when received.
+ *
+ * Derived types with no gaps are given faabric's byte type, so they work
+ * everywhere. The rest can only be used in point-to-point calls and
+ * broadcasts.
+ */
+namespace wasm {
+
+// IDs of derived types with gaps start here, well clear of faabric's ones
+#define FAASM_MPI_DERIVED_TYPE_BASE 0x20000
+
+#ifndef MPI_ORDER_C
+#define MPI_ORDER_C 56
+#define MPI_ORDER_FORTRAN 57
+#endif
+
+/**
+ * The data in one element of an MPI datatype, as runs of bytes at offsets
+ * within its extent. Elements in an array are one extent apart.
+ */
+class MpiTypeLayout
+{
+  public:
+    struct Block
+    {
+        size_t offset;
+        size_t length;
+    };
+
+    MpiTypeLayout() = default;
+
+    // Predefined and other contiguous types
+    explicit MpiTypeLayout(size_t sizeIn);
+
+    // Appends count consecutive elements of the given type at the offset
+    void append(const MpiTypeLayout& type, size_t offset, int count);
+
+    void setExtent(size_t extentIn) { extent = extentIn; }
+
+    // Bytes of data in one element
+    size_t getSize() const { return size; }
+
+    size_t getExtent() const { return extent; }
+
+    // Bytes the data of count elements spans in memory
+    size_t getSpan(int count) const;
+
+    bool isContiguous() const;
+
+    const std::vector<Block>& getBlocks() const { return blocks; }
+
+    void pack(const uint8_t* src, int count, uint8_t* dst) const;
+
+    void unpack(const uint8_t* src, int count, uint8_t* dst) const;
+
+  private:
+    std::vector<Block> blocks;
+    size_t size = 0;
+    size_t extent = 0;
+};
+
+MpiTypeLayout mpiTypeContiguous(int count, const MpiTypeLayout& oldType);
+
+// The stride is in elements of the old type
+MpiTypeLayout mpiTypeVector(int count,
+                            int blockLength,
+                            int stride,
+                            const MpiTypeLayout& oldType);
+
+// Displacements are in elements of the old type
+MpiTypeLayout mpiTypeIndexed(int count,
+                             const int32_t* blockLengths,
+                             const int32_t* displacements,
+                             const MpiTypeLayout& oldType);
+
+// Displacements are in bytes, as a wasm MPI_Aint is 32 bits
+MpiTypeLayout mpiTypeStruct(int count,
+                            const int32_t* blockLengths,
+                            const int32_t* displacements,
+                            const std::vector<MpiTypeLayout>& types);
+
+MpiTypeLayout mpiTypeSubarray(int nDims,
+                              const int32_t* sizes,
+                              const int32_t* subSizes,
+                              const int32_t* starts,
+                              int order,
+                              const MpiTypeLayout& oldType);
+
+/**
+ * Fills in the guest's datatype struct for a new derived type, at the given
+ * wasm offset, registering its layout if it has gaps. Types belong to the
+ * calling rank's thread.
+ */
+void createMpiDerivedType(int32_t typePtr,
+                          const MpiTypeLayout& layout,
+                          faabric_datatype_t* newType);
+
+bool isMpiDerivedType(const faabric_datatype_t* type);
+
+// Layouts are shared so that in-flight messages outlive freeing the type
+std::shared_ptr<const MpiTypeLayout> getMpiTypeLayout(
+  const faabric_datatype_t* type);
+
+// Bytes of guest memory that count elements of the type span
+size_t getMpiTypeSpan(const faabric_datatype_t* type, int count);
+
+/**
+ * Forgets the derived type at the given wasm offset. Returns false if it's not
+ * one we created, e.g. a predefined type, so there's nothing to free.
+ */
+bool freeMpiDerivedType(int32_t typePtr, const faabric_datatype_t* type);
+
+void clearMpiDerivedTypes();
+
+/**
+ * A message's data as faabric sees it. For derived types with gaps this is a
+ * packed copy on the host, otherwise it's just the guest's buffer.
+ */
+class MpiTypeBuffer
+{
+  public:
+    MpiTypeBuffer(uint8_t* guestBufferIn,
+                  faabric_datatype_t* typeIn,
+                  int countIn);
+
+    uint8_t* data() { return packed ? packedData.data() : guestBuffer; }
+
+    // Copies the guest's data in, before sending
+    void pack();
+
+    // Copies received data out to the guest
+    void unpack();
+
+  private:
+    uint8_t* guestBuffer;
+    const int count;
+    const bool packed;
+    std::shared_ptr<const MpiTypeLayout> layout;
+    std::vector<uint8_t> packedData;
+};
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <faabric/mpi/MpiWorld.h>
+#include <faabric/state/StateKeyValue.h>
+
+#include <wasm/WasmModule.h>
+
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace wasm {
+
+// What the guest's MPI_Win points to, laid out as in wasm memory
+struct wasm_faabric_win_t
+{
+    uint32_t worldId;
+    uint32_t rank;
+    uint32_t size;
+    uint32_t wasmPtr;
+    uint32_t dispUnit;
+};
+
+/**
+ * An MPI one-sided communication window, used with fence synchronisation.
+ *
+ * Each rank's part of the window is backed by a state key. When the rank's
+ * window is page-aligned (e.g. from MPI_Alloc_mem) the key is mapped over it,
+ * so co-located ranks read and write the window memory directly, until it's
+ * freed and the memory gets its own pages back. Otherwise the rank's own
+ * changes are copied to and from the key at each fence.
+ *
+ * Puts and gets to ranks on other hosts are batched: puts are pushed and gets
+ * are pulled at the next fence, as MPI only defines their results once it
+ * completes.
+ */
+class MpiWindow
+{
+  public:
+    MpiWindow(faabric::mpi::MpiWorld& worldIn,
+              int rankIn,
+              int windowIdxIn,
+              const std::string& userIn,
+              WasmModule* moduleIn,
+              uint32_t baseOffsetIn,
+              size_t sizeIn,
+              int dispUnitIn);
+
+    MpiWindow(const MpiWindow&) = delete;
+    MpiWindow& operator=(const MpiWindow&) = delete;
+
+    void put(int targetRank,
+             size_t targetDisp,
+             const uint8_t* buffer,
+             size_t nBytes);
+
+    void get(int targetRank, size_t targetDisp, uint8_t* buffer, size_t nBytes);
+
+    void fence();
+
+    void free();
+
+    // Gives a mapped window its own pages back, so the memory stops being
+    // shared through the state key
+    void unmap();
+
+    bool isMapped() const { return mapped; }
+
+  private:
+    faabric::mpi::MpiWorld& world;
+    const int rank;
+    const int windowIdx;
+    const std::string user;
+    const std::string thisHost;
+
+    WasmModule* module;
+    const uint32_t baseOffset;
+    uint8_t* base;
+    const size_t size;
+    const int dispUnit;
+    bool mapped = false;
+
+    // What the rank's window held at the last fence, when it's not mapped
+    std::vector<uint8_t> shadow;
+
+    std::vector<int> targetSizes;
+    std::vector<int> targetDispUnits;
+    std::vector<std::shared_ptr<faabric::state::StateKeyValue>> targetKvs;
+
+    struct PendingGet
+    {
+        int targetRank;
+        size_t offset;
+        uint8_t* buffer;
+        size_t nBytes;
+    };
+    std::vector<PendingGet> pendingGets;
+    std::set<int> dirtyRemoteTargets;
+
+    std::string getKey(int targetRank) const;
+
+    bool isLocal(int targetRank);
+
+    std::shared_ptr<faabric::state::StateKeyValue> getTargetKV(int targetRank);
+
+    size_t getTargetOffset(int targetRank, size_t targetDisp, size_t nBytes);
+
+    void publishLocalChanges();
+
+    void collectRemoteChanges();
+};
+
+/**
+ * Windows are identified by the wasm offset of the MPI_Win the guest holds,
+ * and belong to the calling rank's thread.
+ */
+MpiWindow& createMpiWindow(int32_t winPtr,
+                           faabric::mpi::MpiWorld& world,
+                           int rank,
+                           const std::string& user,
+                           WasmModule* module,
+                           uint32_t baseOffset,
+                           size_t size,
+                           int dispUnit);
+
+MpiWindow& getMpiWindow(int32_t winPtr);
+
+void freeMpiWindow(int32_t winPtr);
+
+/**
+ * Drops the calling thread's windows without synchronising with the other
+ * ranks, e.g. once a call ends whether or not the guest freed them.
+ */
+void clearMpiWindows();
+}
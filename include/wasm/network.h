@@ -0,0 +1,32 @@
+#pragma once
+
+#include <wasm/deadline.h>
+
+#include <cstdint>
+#include <poll.h>
+#include <sys/epoll.h>
+
+namespace wasm {
+
+/**
+ * Caps a poll/ epoll timeout so that a function waiting on sockets returns
+ * before its deadline. As with poll(2), a negative timeout waits forever. Once
+ * the deadline has passed the timeout is zero, turning the wait into a check.
+ */
+int clampTimeoutToDeadline(int timeoutMs, int64_t nowMs, int64_t deadlineMs);
+
+// Clamps against the deadline of the call currently being executed
+int getNetworkWaitTimeoutMs(int timeoutMs);
+
+/**
+ * Waits on the given native fds within the execution deadline. Guest sockets
+ * are host fds, so can be passed straight through. Like the raw syscalls these
+ * return -errno on failure.
+ */
+int pollWithinDeadline(pollfd* fds, int nFds, int timeoutMs);
+
+int epollWaitWithinDeadline(int epollFd,
+                            epoll_event* events,
+                            int maxEvents,
+                            int timeoutMs);
+}
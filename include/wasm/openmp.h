@@ -0,0 +1,168 @@
+#pragma once
+
+#include <faabric/proto/faabric.pb.h>
+#include <faabric/scheduler/ExecutorContext.h>
+#include <faabric/transport/PointToPointBroker.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/macros.h>
+
+#include <threads/ThreadState.h>
+#include <wasm/WasmModule.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+// Sets up the current level and thread numbers for an OpenMP host function
+#define OMP_FUNC(str)                                                          \
+    std::shared_ptr<threads::Level> level = threads::getCurrentOpenMPLevel();  \
+    faabric::Message* msg =                                                    \
+      &faabric::scheduler::ExecutorContext::get()->getMsg();                   \
+    int localThreadNum = level->getLocalThreadNum(msg);                        \
+    int globalThreadNum = level->getGlobalThreadNum(msg);                      \
+    UNUSED(level);                                                             \
+    UNUSED(msg);                                                               \
+    UNUSED(localThreadNum);                                                    \
+    UNUSED(globalThreadNum);                                                   \
+    SPDLOG_TRACE("OMP {} ({}): " str, localThreadNum, globalThreadNum);
+
+#define OMP_FUNC_ARGS(formatStr, ...)                                          \
+    std::shared_ptr<threads::Level> level = threads::getCurrentOpenMPLevel();  \
+    faabric::Message* msg =                                                    \
+      &faabric::scheduler::ExecutorContext::get()->getMsg();                   \
+    int localThreadNum = level->getLocalThreadNum(msg);                        \
+    int globalThreadNum = level->getGlobalThreadNum(msg);                      \
+    UNUSED(level);                                                             \
+    UNUSED(msg);                                                               \
+    UNUSED(localThreadNum);                                                    \
+    UNUSED(globalThreadNum);                                                   \
+    SPDLOG_TRACE("OMP {} ({}): " formatStr,                                    \
+                 localThreadNum,                                               \
+                 globalThreadNum,                                              \
+                 __VA_ARGS__);
+
+/*
+ * Runtime-independent parts of the OpenMP host interface. Each runtime
+ * (WAVM, WAMR) defines its own __kmpc_* and omp_* functions, translating wasm
+ * pointers and calling back into wasm, then hands over to these for the
+ * scheduling, synchronisation and reductions.
+ */
+namespace wasm {
+
+std::shared_ptr<faabric::transport::PointToPointGroup>
+getExecutingPointToPointGroup();
+
+// Barrier across the executing team, whether on the local thread pool or
+// spread over the scheduler
+void teamBarrier(int groupIdx);
+
+// Barriers kept for scheduled teams that landed on this host, including any
+// stale ones not yet dropped
+size_t getHostTeamCount();
+
+// ----- Critical sections -----
+
+void enterOpenMPCritical(faabric::Message* msg,
+                         const std::shared_ptr<threads::Level>& level,
+                         int32_t crit);
+
+void exitOpenMPCritical(faabric::Message* msg,
+                        const std::shared_ptr<threads::Level>& level,
+                        int32_t crit);
+
+// ----- Single -----
+
+/**
+ * Whether this thread runs the current single construct, as for
+ * __kmpc_single. Neither end of the construct waits for the rest of the team,
+ * the compiler adds a barrier unless the construct is nowait.
+ */
+int32_t startOpenMPSingle(faabric::Message* msg,
+                          const std::shared_ptr<threads::Level>& level);
+
+// ----- Forking -----
+
+/**
+ * Creates the level for a new team forked from the given one, with the given
+ * shared variable offsets. Nested teams only get a single thread, as the outer
+ * team's threads are already occupying the executor's thread pool.
+ */
+std::shared_ptr<threads::Level> createNextOpenMPLevel(
+  const std::shared_ptr<threads::Level>& parentLevel,
+  int32_t nSharedVars,
+  uint32_t* sharedVarOffsets);
+
+/**
+ * Runs the team for the given level through the scheduler, blocking until
+ * every thread has finished. Throws if any thread fails.
+ */
+void executeOpenMPTeam(WasmModule* module,
+                       faabric::Message* parentCall,
+                       const std::shared_ptr<threads::Level>& nextLevel,
+                       int32_t microtaskPtr);
+
+// ----- Loops -----
+
+template<typename T>
+void for_static_init(int32_t schedule,
+                     int32_t* lastIter,
+                     T* lower,
+                     T* upper,
+                     T* stride,
+                     T incr,
+                     T chunk);
+
+template<typename T>
+void dispatch_init(int32_t schedule,
+                   T lower,
+                   T upper,
+                   int64_t incr,
+                   int64_t chunk);
+
+template<typename T>
+int32_t dispatch_next(int32_t* lastIter, T* lower, T* upper, T* stride);
+
+// Nested teams run inline on the calling thread, so the outer team's loop
+// state must be put aside while they run
+void pushThreadDispatch();
+
+void popThreadDispatch();
+
+// ----- Reductions -----
+
+// Combines the reduce data at the second offset into that at the first, by
+// calling the compiler's reduce function
+using OpenMPReduceFunc = std::function<void(int32_t, int32_t)>;
+
+/**
+ * Starts a reduction for this thread, as for __kmpc_reduce.
+ *
+ * @return 1 if the caller must apply its reduce data to the shared variables
+ * and then call endOpenMPReduce, 0 if there's nothing left to do.
+ */
+int32_t startOpenMPReduce(faabric::Message* msg,
+                          const std::shared_ptr<threads::Level>& level,
+                          int32_t reduceData,
+                          const OpenMPReduceFunc& reduceFunc,
+                          bool nowait);
+
+void endOpenMPReduce(faabric::Message* msg,
+                     const std::shared_ptr<threads::Level>& level,
+                     bool nowait);
+
+/**
+ * Declares a reduction variable in shared memory, as for __faasm_sm_reduce,
+ * holding length values of the given snapshot data type. Each host's copy is
+ * merged into the main thread's with the given snapshot merge operation once
+ * the team is done. Variables in the current batch of threads are added to
+ * the main thread's snapshot, others are kept for the next batch.
+ *
+ * Faabric's typed merge regions hold a single value, so arrays are added as
+ * a region per element.
+ */
+void addOpenMPMergeRegion(int32_t varPtr,
+                          int32_t varType,
+                          int32_t mergeOp,
+                          int32_t length,
+                          bool currentBatch);
+}
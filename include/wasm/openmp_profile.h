@@ -0,0 +1,104 @@
+#pragma once
+
+#include <faabric/proto/faabric.pb.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Per-thread breakdown of where OpenMP time goes, switched on by setting
+ * OMP_PROFILE_FILE. Comparing the region time across threads shows load
+ * imbalance, while the other events show Faasm's own overhead.
+ */
+namespace wasm {
+
+enum class OpenMPProfileEvent : int
+{
+    // Running this thread's part of a parallel section, including the waits
+    // below but leaving out nested sections, which are recorded separately
+    Region = 0,
+
+    // Time the forking thread spends in the fork outside its own part of the
+    // section: setting up, dispatching and joining the team. For teams that
+    // go through the scheduler this includes merging the threads' snapshot
+    // diffs, which happens as they finish.
+    Fork,
+
+    // Waiting at team barriers
+    Barrier,
+
+    // Waiting to enter critical sections
+    Critical,
+
+    // Combining reduction data. Any barrier at the end counts as barrier time.
+    Reduce,
+
+    NumEvents
+};
+
+std::string openMPProfileEventName(OpenMPProfileEvent event);
+
+struct OpenMPThreadProfile
+{
+    int32_t appId = 0;
+    int32_t threadNum = 0;
+
+    std::array<uint64_t, (int)OpenMPProfileEvent::NumEvents> nanos = {};
+    std::array<uint64_t, (int)OpenMPProfileEvent::NumEvents> counts = {};
+
+    std::string toJson(const std::string& host) const;
+};
+
+bool isOpenMPProfiling();
+
+// Adds the given time to the calling thread's totals for the executing message
+void recordOpenMPEvent(OpenMPProfileEvent event, uint64_t nanos);
+
+/**
+ * Total time recorded for the given event on the calling OS thread, across
+ * all messages. Used to leave a nested event out of an enclosing one.
+ */
+uint64_t getThreadOpenMPNanos(OpenMPProfileEvent event);
+
+/**
+ * Removes and returns this host's profiles for the given app, one per OpenMP
+ * thread, ordered by thread number.
+ */
+std::vector<OpenMPThreadProfile> takeOpenMPProfiles(int32_t appId);
+
+/**
+ * Appends this host's profiles for the message's app to the profile file, if
+ * profiling is on. Called whenever a function or scheduled OpenMP thread
+ * finishes, so every host writes its own threads. The totals for each event
+ * across those threads are also attached to the message's exec graph
+ * details, e.g. as omp-barrier-ns.
+ */
+void flushOpenMPProfile(faabric::Message& msg);
+
+/**
+ * Records the time from construction to destruction against the given event,
+ * leaving out any time recorded for the excluded event in between. Does
+ * nothing when profiling is off.
+ */
+class OpenMPProfileTimer
+{
+  public:
+    explicit OpenMPProfileTimer(
+      OpenMPProfileEvent eventIn,
+      OpenMPProfileEvent excludeIn = OpenMPProfileEvent::NumEvents);
+
+    ~OpenMPProfileTimer();
+
+    OpenMPProfileTimer(const OpenMPProfileTimer&) = delete;
+    OpenMPProfileTimer& operator=(const OpenMPProfileTimer&) = delete;
+
+  private:
+    const OpenMPProfileEvent event;
+    const OpenMPProfileEvent exclude;
+    const bool enabled;
+    uint64_t startNanos = 0;
+    uint64_t startExcludedNanos = 0;
+};
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <faabric/proto/faabric.pb.h>
+
+#include <threads/ThreadState.h>
+#include <wasm/WasmModule.h>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Runtime-independent parts of the OpenMP task runtime. Tasks and their
+ * shared variables live in the module's memory, and each runtime defines the
+ * __kmpc_omp_task* functions, calling back into wasm to run the tasks' entry
+ * functions.
+ */
+namespace wasm {
+
+struct OpenMPTaskGroup
+{
+    std::atomic<int> nPending = 0;
+    std::shared_ptr<OpenMPTaskGroup> parent = nullptr;
+};
+
+struct OpenMPTaskTeam;
+
+/**
+ * A task, or a thread's implicit task in a parallel section (which has no
+ * task pointer). Children hold a reference to their parent so they can
+ * report completion even if the parent has finished.
+ */
+struct OpenMPTask
+{
+    int32_t taskPtr = 0;
+    uint32_t size = 0;
+    int32_t routine = 0;
+
+    // Null for tasks run immediately on a single thread
+    std::shared_ptr<OpenMPTaskTeam> team = nullptr;
+
+    std::shared_ptr<OpenMPTask> parent = nullptr;
+    std::atomic<int> nChildren = 0;
+
+    // The task group this task was created in, and the innermost one it has
+    // opened itself while running
+    std::shared_ptr<OpenMPTaskGroup> group = nullptr;
+    std::shared_ptr<OpenMPTaskGroup> openGroup = nullptr;
+};
+
+struct OpenMPTaskDeque
+{
+    std::mutex mx;
+    std::deque<std::shared_ptr<OpenMPTask>> tasks;
+};
+
+/**
+ * Work-stealing state for the threads of a team on this host. Each thread
+ * pushes and pops its own tasks at the back of its deque, and idle threads
+ * steal from the front of the others'. Tasks are never sent to other hosts,
+ * as their memory isn't shared.
+ *
+ * Task memory comes from an arena of chunks mapped in the module's memory,
+ * which goes when the team's last thread on this host finishes.
+ */
+struct OpenMPTaskTeam
+{
+    WasmModule* module = nullptr;
+    int numThreads = 0;
+    std::vector<std::unique_ptr<OpenMPTaskDeque>> deques;
+
+    // Tasks queued or running
+    std::atomic<int> nPending = 0;
+
+    // Guarded by the teams mutex
+    int nJoined = 0;
+    int nFinished = 0;
+
+    std::mutex arenaMx;
+    std::vector<std::pair<uint32_t, uint32_t>> arenaChunks;
+    uint32_t arenaNext = 0;
+    uint32_t arenaEnd = 0;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> freeLists;
+
+    uint32_t allocate(uint32_t nBytes);
+
+    void free(uint32_t offset, uint32_t nBytes);
+
+    void releaseArena();
+
+    // Takes a task from the back of the given thread's deque, or steals one
+    // from the front of another's
+    std::shared_ptr<OpenMPTask> takeTask(int localThreadNum);
+};
+
+// Runs a task's entry function on the calling thread
+using OpenMPTaskFunc = std::function<void(const OpenMPTask&)>;
+
+/**
+ * The calling thread's task team in the current parallel section, joining it
+ * on first use. Single threads (including nested teams) have no task team,
+ * so run their tasks immediately.
+ */
+std::shared_ptr<OpenMPTaskTeam> getOpenMPTaskTeam(
+  faabric::Message* msg,
+  const std::shared_ptr<threads::Level>& level);
+
+// Allocates a zeroed task of the given size, from the team's arena if any
+std::shared_ptr<OpenMPTask> allocateOpenMPTask(
+  const std::shared_ptr<OpenMPTaskTeam>& team,
+  uint32_t nBytes,
+  int32_t routine);
+
+// The compiler only has a task's pointer between allocating it and starting
+// or queueing it, so the allocating thread holds on to it in between
+void holdOpenMPTask(const std::shared_ptr<OpenMPTask>& task);
+
+// Takes back a task this thread holds, throwing if there's no such task
+std::shared_ptr<OpenMPTask> takeHeldOpenMPTask(int32_t taskPtr);
+
+void freeOpenMPTask(const OpenMPTask& task);
+
+// Runs the task, then frees it. Queued tasks are counted, so tell everything
+// waiting on them that they're done.
+void runOpenMPTask(const OpenMPTaskFunc& func,
+                   const std::shared_ptr<OpenMPTask>& task,
+                   bool counted);
+
+// Queues a task for any thread in the team, as a child of the calling
+// thread's current task
+void queueOpenMPTask(const std::shared_ptr<OpenMPTask>& task);
+
+// Runs the team's tasks until the current task's children are done, as for
+// taskwait
+void waitForOpenMPChildTasks(const OpenMPTaskFunc& func);
+
+// Runs one of the team's tasks, if there are any
+void yieldOpenMPTask(const OpenMPTaskFunc& func);
+
+void startOpenMPTaskGroup();
+
+// Runs the team's tasks until every task created in the group, including
+// their descendants, is done
+void endOpenMPTaskGroup(const OpenMPTaskFunc& func);
+
+// An undeferred task (i.e. with an if clause that's false) is run by the
+// compiler between these two
+void startUndeferredOpenMPTask(int32_t taskPtr);
+
+void finishUndeferredOpenMPTask(int32_t taskPtr);
+
+// Runs the team's tasks until there are none queued or running, e.g. before
+// a barrier
+void runPendingOpenMPTasks(const OpenMPTaskFunc& func,
+                           faabric::Message* msg,
+                           const std::shared_ptr<threads::Level>& level);
+
+/**
+ * Runs the team's remaining tasks at the end of the calling thread's part of
+ * a parallel section. The last of the team's threads on this host releases
+ * the team's task memory.
+ */
+void finishOpenMPTeamTasks(const OpenMPTaskFunc& func,
+                           faabric::Message* msg,
+                           const std::shared_ptr<threads::Level>& level);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Address space reserved for the store's read-only view of its pages. Only
+// pages that are actually stored take up memory.
+#define PAGE_STORE_MAX_BYTES (64UL * 1024 * 1024 * 1024)
+
+/*
+ * Host-wide store of snapshot pages, keyed on their contents. Functions that
+ * share a runtime have reset snapshots that are mostly the same, e.g. the
+ * interpreter heap of every Python function, so each distinct page is kept
+ * once in a memfd and mapped copy-on-write into every module restored from a
+ * snapshot that has it. Pages of zeros aren't stored at all.
+ *
+ * With SNAPSHOT_PAGE_DEDUP on, reset snapshots are kept here rather than in
+ * the snapshot registry. Snapshots that are sent to other hosts (threads,
+ * migration) still go through the registry.
+ */
+namespace wasm {
+
+class PageStore;
+
+class PagedSnapshot
+{
+  public:
+    ~PagedSnapshot();
+
+    size_t getSize() const { return size; }
+
+    // Maps the snapshot copy-on-write over the start of the given memory,
+    // which must be page-aligned and at least the snapshot's size rounded up
+    // to a page
+    void mapToMemory(std::span<uint8_t> target) const;
+
+    // Copies part of the snapshot, which may span pages
+    void copyTo(size_t offset, uint8_t* dest, size_t len) const;
+
+  private:
+    friend class PageStore;
+
+    PageStore* pageStore = nullptr;
+
+    size_t size = 0;
+
+    // Slot in the store of each page, -1 for pages of zeros
+    std::vector<int64_t> slots;
+};
+
+struct PageStoreStats
+{
+    // Pages held by snapshots, and the distinct ones actually stored
+    uint64_t refs = 0;
+    uint64_t stored = 0;
+};
+
+class PageStore
+{
+  public:
+    PageStore();
+
+    ~PageStore();
+
+    // Reset snapshots are held under the same keys they'd have in the
+    // snapshot registry
+    void registerSnapshot(const std::string& key,
+                          std::span<const uint8_t> data);
+
+    // Null if there's no such snapshot
+    std::shared_ptr<PagedSnapshot> getSnapshot(const std::string& key);
+
+    bool snapshotExists(const std::string& key);
+
+    void deleteSnapshot(const std::string& key);
+
+    void clear();
+
+    PageStoreStats getStats();
+
+  private:
+    friend class PagedSnapshot;
+
+    int fd = -1;
+    const uint8_t* view = nullptr;
+    size_t fdSize = 0;
+
+    std::mutex pagesMx;
+    std::unordered_multimap<size_t, int64_t> slotsByHash;
+    std::vector<size_t> slotHashes;
+    std::vector<uint32_t> slotRefs;
+    std::vector<int64_t> freeSlots;
+    uint64_t nRefs = 0;
+
+    std::shared_mutex snapshotsMx;
+    std::unordered_map<std::string, std::shared_ptr<PagedSnapshot>> snapshots;
+
+    std::shared_ptr<PagedSnapshot> store(std::span<const uint8_t> data);
+
+    int64_t storePage(const uint8_t* page);
+
+    void release(const std::vector<int64_t>& slots);
+};
+
+PageStore& getPageStore();
+}
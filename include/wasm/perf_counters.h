@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+/*
+ * Hardware performance counters around each call, for working out why a
+ * function is slow rather than just that it is, e.g. to compare huge pages,
+ * NUMA pinning or codegen variants on real traffic. With PERF_COUNTERS on,
+ * each executor thread opens its own counters with perf_event_open the first
+ * time it runs a call, and keeps them for as long as it lives. Counters only
+ * cover the thread they're opened on.
+ *
+ * Counters the host doesn't support, e.g. hardware ones in most VMs, or any
+ * at all when perf_event_paranoid doesn't allow them, are left out.
+ */
+namespace wasm {
+
+enum class PerfCounter : int
+{
+    Instructions = 0,
+    Cycles,
+    LlcMisses,
+    DtlbMisses,
+    ContextSwitches,
+
+    NumCounters
+};
+
+#define N_PERF_COUNTERS (int)wasm::PerfCounter::NumCounters
+
+std::string perfCounterName(PerfCounter counter);
+
+struct PerfCounts
+{
+    std::array<uint64_t, N_PERF_COUNTERS> values = {};
+
+    // Whether each counter could be opened on the thread
+    std::array<bool, N_PERF_COUNTERS> available = {};
+};
+
+/**
+ * Starts counting on the calling thread, opening its counters if it hasn't
+ * already.
+ */
+void startPerfCounters();
+
+// Counts on the calling thread since it last started
+PerfCounts readPerfCounters();
+}
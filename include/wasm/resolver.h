@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// How long failed lookups are cached for, as there's no TTL to go on
+#define RESOLVER_NEGATIVE_TTL_S 5
+
+/*
+ * Name resolution for functions, behind the guest's getaddrinfo. Modules are
+ * reset between calls, so nothing a function resolves survives to the next
+ * one, and functions calling the same hosts over and over would otherwise pay
+ * for a DNS lookup every time. Instead, lookups are made on the host and
+ * cached per host until their DNS TTL runs out, capped by DNS_CACHE_MAX_TTL_S.
+ *
+ * Lookups are made from the calling thread, i.e. from the function's network
+ * namespace if it has one. Namespaces in the pool are all set up alike, so
+ * share one cache, kept apart from that of threads outside any namespace.
+ */
+namespace wasm {
+
+// Laid out as the guest expects, with families as in Linux and musl
+struct ResolvedAddress
+{
+    int32_t family = 0;
+
+    // Four bytes for IPv4, sixteen for IPv6, in network order
+    uint8_t addr[16] = {};
+};
+
+/**
+ * Resolves the host's addresses of the given family (AF_INET, AF_INET6 or
+ * AF_UNSPEC for both), as getaddrinfo would. Returns zero, or the EAI_ error
+ * getaddrinfo gave.
+ */
+int resolveHost(const std::string& host,
+                int family,
+                std::vector<ResolvedAddress>& result);
+
+/**
+ * Host side of __faasm_resolve_host. Writes up to bufferLen bytes of
+ * ResolvedAddress to the buffer, and returns how many it wrote, or the EAI_
+ * error (negative, and the same in glibc and musl).
+ */
+int32_t doHostResolveHost(const std::string& host,
+                          int32_t family,
+                          uint8_t* buffer,
+                          int32_t bufferLen);
+
+void clearResolverCache();
+
+size_t getResolverCacheSize();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <faabric/proto/faabric.pb.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Results of functions listed in RESULT_CACHE_FUNCTIONS, which their owners
+ * declare idempotent, are kept keyed on a hash of the function, its cmdline
+ * and its input. Calls with a cached result are answered without running, and
+ * chained calls with one are never sent to the scheduler at all, so don't
+ * claim an executor.
+ *
+ * Each host keeps its own cache, least recently used first out once over
+ * RESULT_CACHE_BUDGET_MB. With RESULT_CACHE_SHARED on, results also go in
+ * state, so hosts can pick up each other's. Only successful calls of the
+ * function's main entrypoint are cached.
+ */
+namespace wasm {
+
+// Whether calls like this one may be answered from the cache
+bool isResultCacheable(const faabric::Message& msg);
+
+// The cache key for the message's function, cmdline and input
+std::string getResultCacheKey(const faabric::Message& msg);
+
+/**
+ * Looks up a cached result for the message, filling in the output if there
+ * is one. Returns false if the call has to run.
+ */
+bool lookupCachedResult(const faabric::Message& msg, std::string& output);
+
+// Caches the output of a finished call, if it succeeded and can be cached
+void storeCachedResult(const faabric::Message& msg, int32_t returnValue);
+
+// Bytes held in this host's cache
+size_t getResultCacheBytes();
+
+// Empties this host's cache, leaving shared results in state
+void clearResultCache();
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <functional>
+
+/*
+ * Non-blocking state pulls and pushes, shared by WAVM and WAMR. Each one runs
+ * in the background and is identified by a handle, which the function waits
+ * on or polls, much like an MPI request. Handles belong to the calling
+ * thread.
+ *
+ * As with MPI requests, the function mustn't touch the value while its
+ * transfer is in progress.
+ */
+namespace wasm {
+
+// Starts the operation in the background and returns its handle
+int startStateOperation(std::function<void()> op);
+
+/**
+ * Waits for the operation to finish and forgets its handle. Rethrows anything
+ * the operation threw.
+ */
+void awaitStateOperation(int handle);
+
+// Whether the operation has finished, successfully or not
+bool pollStateOperation(int handle);
+
+/**
+ * Waits for all of the calling thread's operations, so that none carry on
+ * into its next function. Errors are logged rather than thrown.
+ */
+void finishStateOperations();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <faabric/state/StateKeyValue.h>
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Host side of the vectored state calls, shared by WAVM and WAMR. Pulling or
+ * pushing a key is a round trip to its master, so a batch keeps several in
+ * flight at once rather than making them one after the other.
+ */
+namespace wasm {
+
+// Most of a batch's operations that run at once
+#define STATE_BATCH_MAX_CONCURRENCY 16
+
+/**
+ * Gets the calling function's user's key-values for the given keys, in
+ * order. Sizes of zero leave the size to be found out from the master.
+ */
+std::vector<std::shared_ptr<faabric::state::StateKeyValue>> getStateKVs(
+  const std::vector<std::string>& keys,
+  const std::vector<size_t>& sizes);
+
+/**
+ * Runs the operation for every index up to nOps, with up to
+ * STATE_BATCH_MAX_CONCURRENCY at once, and returns when they're all done. If
+ * any throw, the first exception is rethrown once the rest have finished.
+ */
+void runStateBatch(size_t nOps, const std::function<void(size_t)>& op);
+}
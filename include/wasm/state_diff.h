@@ -0,0 +1,29 @@
+#pragma once
+
+#include <faabric/state/StateKeyValue.h>
+
+#include <memory>
+#include <string>
+
+/*
+ * Automatic partial state pushes, shared by WAVM and WAMR. Rather than the
+ * function flagging what it has changed, the host keeps a copy of each value
+ * as it was last pushed, diffs the value against it and pushes only the runs
+ * that differ. This suits functions that rewrite the whole of a large value
+ * but only change a little of it each time, e.g. model weights.
+ *
+ * The copy costs as much memory as the value, so it's only kept for keys
+ * pushed this way.
+ */
+namespace wasm {
+
+/**
+ * Pushes whatever has changed in the value since it was last pushed through
+ * here, returning the number of bytes flagged as dirty. The first push of a
+ * key sends the whole value.
+ */
+size_t pushStateChanges(std::shared_ptr<faabric::state::StateKeyValue> kv);
+
+// Forgets the last pushed copy of every key
+void clearStateChanges();
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Values are fetched to local disk in chunks of this size
+#define STATE_DISK_CHUNK_SIZE (4 * 1024 * 1024)
+
+// Shared files holding disk-backed values live under this directory
+#define STATE_DISK_PREFIX "state"
+
+/*
+ * Disk-backed state, for read-mostly values too big to hold in memory on
+ * every host that reads them, e.g. embedding tables. With STATE_DISK_DIR set,
+ * a value with a shared file at state/<user>/<key> is read from that file
+ * rather than from faabric state. Each host keeps a sparse copy of the file
+ * in STATE_DISK_DIR, e.g. on local NVMe, and only fetches the chunks that are
+ * read. Mapped ranges are backed by the copy, so the kernel pages them in and
+ * out as needed rather than them taking up memory.
+ *
+ * Values are uploaded as shared files, and are read-only through state.
+ * Mappings are copy-on-write, so functions writing to them only change their
+ * own memory. Cached copies are dropped when the host is flushed.
+ */
+namespace wasm {
+
+std::string getDiskStatePath(const std::string& user, const std::string& key);
+
+class DiskStateValue
+{
+  public:
+    DiskStateValue(const std::string& userIn,
+                   const std::string& keyIn,
+                   size_t sizeIn,
+                   const std::string& localPathIn);
+
+    ~DiskStateValue();
+
+    const std::string user;
+    const std::string key;
+
+    size_t size() const { return valueSize; }
+
+    // Fetches any chunks of the range not yet on local disk
+    void fetchRange(size_t offset, size_t len);
+
+    /**
+     * Fetches and maps the range copy-on-write over the target, which must be
+     * page-aligned, as must the offset. The mapping is rounded up to a page.
+     */
+    void mapRange(uint8_t* target, size_t offset, size_t len);
+
+    size_t getFetchedChunkCount();
+
+  private:
+    const size_t valueSize;
+    const std::string localPath;
+    int fd = -1;
+
+    std::mutex chunksMx;
+    std::condition_variable chunksCv;
+
+    enum class ChunkStatus : uint8_t
+    {
+        Missing,
+        Fetching,
+        Fetched,
+    };
+    std::vector<ChunkStatus> chunks;
+
+    void fetchChunk(size_t chunkIdx);
+};
+
+class DiskStateStore
+{
+  public:
+    // Null if disk-backed state is off, or the key has no shared file
+    std::shared_ptr<DiskStateValue> getValue(const std::string& user,
+                                             const std::string& key);
+
+    // Drops cached values, and which keys have no shared file
+    void clear();
+
+  private:
+    std::shared_mutex valuesMx;
+    std::unordered_map<std::string, std::shared_ptr<DiskStateValue>> values;
+    std::unordered_set<std::string> missing;
+};
+
+DiskStateStore& getDiskStateStore();
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/*
+ * Loading files into state, shared by WAVM and WAMR. The file is mapped and
+ * copied into the state value a chunk at a time, so it's never held in memory
+ * twice. Each chunk is pushed in the background while the next one is copied.
+ */
+namespace wasm {
+
+#define STATE_FILE_CHUNK_SIZE (64 * 1024 * 1024)
+
+/**
+ * Sets the state value for the given key to the contents of the file at the
+ * given host path, and returns the file's size. The chunk size must be a
+ * multiple of the host page size.
+ */
+size_t writeStateFromFile(const std::string& user,
+                          const std::string& key,
+                          const std::string& filePath,
+                          size_t chunkSize = STATE_FILE_CHUNK_SIZE);
+}
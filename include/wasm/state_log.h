@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+/*
+ * Append logs in state, shared by WAVM and WAMR. Unlike appended state, each
+ * entry has its own index, so readers keep a cursor and only fetch the entries
+ * they haven't seen, and entries nobody needs any more can be trimmed. This
+ * makes a log usable as a work queue between chained functions.
+ *
+ * A log's bounds live in the value for its key, and each entry in its own
+ * value. Appends to a log are serialised on the host, so all writers to a log
+ * must be on the same host, while readers can be anywhere.
+ */
+namespace wasm {
+
+// Longest a blocking read backs off for between checks
+#define STATE_LOG_MAX_POLL_MS 50
+
+/**
+ * Appends an entry, returning its index. Indexes start at zero and carry on
+ * increasing after trims.
+ */
+uint64_t appendStateLog(const std::string& user,
+                        const std::string& key,
+                        const uint8_t* data,
+                        size_t dataLen);
+
+/**
+ * Copies the entry at the given index into the buffer, as much as fits, and
+ * returns its size. If the entry isn't there yet, waits up to the timeout for
+ * it, and returns -1 if it doesn't appear. Reading a trimmed entry is an
+ * error.
+ */
+int64_t readStateLog(const std::string& user,
+                     const std::string& key,
+                     uint64_t index,
+                     uint8_t* buffer,
+                     size_t bufferLen,
+                     int timeoutMs);
+
+// Removes every entry before the given index
+void trimStateLog(const std::string& user,
+                  const std::string& key,
+                  uint64_t index);
+
+// The index of the first entry still in the log, and of the next to be added
+std::pair<uint64_t, uint64_t> getStateLogBounds(const std::string& user,
+                                                const std::string& key);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <faabric/proto/faabric.pb.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Accounting of each function's state traffic, shared by WAVM and WAMR. The
+ * host interface records its explicit transfers, lock waits and mappings
+ * against the calling thread, which is running one message at a time. When
+ * the message finishes its counts are attached to it, under the exec graph
+ * details, and added to this host's totals for the function.
+ *
+ * Transfers made lazily by faabric, e.g. the first read of a value, aren't
+ * seen here. Partial pushes only know what was dirty, so they count round
+ * trips but not bytes.
+ */
+namespace wasm {
+
+struct StateMetrics
+{
+    uint64_t bytesPulled = 0;
+    uint64_t bytesPushed = 0;
+    uint64_t roundTrips = 0;
+    uint64_t lockWaitNanos = 0;
+    uint64_t bytesMapped = 0;
+
+    void add(const StateMetrics& other);
+
+    bool empty() const;
+};
+
+void recordStatePull(size_t nBytes);
+
+void recordStatePush(size_t nBytes);
+
+void recordStateMapping(size_t nBytes);
+
+// Removes and returns what the calling thread has recorded
+StateMetrics takeStateMetrics();
+
+/**
+ * Attaches the calling thread's metrics to the message and adds them to the
+ * host totals for its function. Called whenever a function finishes.
+ */
+void flushStateMetrics(faabric::Message& msg);
+
+// This host's totals for the given function, e.g. demo/echo
+StateMetrics getHostStateMetrics(const std::string& funcStr);
+
+void clearHostStateMetrics();
+
+// Records the time from construction to destruction as waiting on a lock
+class StateLockTimer
+{
+  public:
+    StateLockTimer();
+
+    ~StateLockTimer();
+
+    StateLockTimer(const StateLockTimer&) = delete;
+    StateLockTimer& operator=(const StateLockTimer&) = delete;
+
+  private:
+    uint64_t startNanos;
+};
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <faabric/state/State.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/*
+ * Host-wide budget for local replicas of state mastered elsewhere. Without
+ * one, a host keeps a copy of every value its functions have ever read, so
+ * long-running workers touching lots of keys grow without bound. With
+ * STATE_REPLICA_BUDGET_MB set, state looked up through host calls is tracked
+ * here, and once replicas go over the budget the least recently used are
+ * dropped from local state, to be pulled again if read.
+ *
+ * Replicas are never dropped while in use. Values mapped into a module, or
+ * held as a state handle, are pinned for as long as the module has them, and
+ * values looked up by a call are pinned until it finishes, so that writes it
+ * hasn't pushed yet aren't lost. Values mastered on this host don't count
+ * towards the budget, as dropping them would drop the only copy.
+ */
+namespace wasm {
+
+struct StateReplicaStats
+{
+    uint64_t replicas = 0;
+    uint64_t bytes = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+};
+
+class StateReplicaCache
+{
+  public:
+    std::shared_ptr<faabric::state::StateKeyValue> getKV(
+      const std::string& user,
+      const std::string& key,
+      size_t size);
+
+    // For values that already exist, as with faabric's getKV
+    std::shared_ptr<faabric::state::StateKeyValue> getKV(
+      const std::string& user,
+      const std::string& key);
+
+    // Pins nest, and each must be matched with an unpin
+    void pin(const std::string& user, const std::string& key);
+
+    void unpin(const std::string& user, const std::string& key);
+
+    // Pins held by the call running on this thread are released once it's
+    // done. Called at the end of each task.
+    void releaseCallPins();
+
+    StateReplicaStats getStats();
+
+    // Forgets tracked replicas and resets the counters. Pins are kept, as
+    // modules still hold them.
+    void clear();
+
+  private:
+    struct Replica
+    {
+        std::string user;
+        std::string key;
+        size_t size = 0;
+        bool master = false;
+        std::list<std::string>::iterator lruIt;
+    };
+
+    std::mutex mx;
+    std::unordered_map<std::string, Replica> replicas;
+    std::unordered_map<std::string, int> pins;
+
+    // Most recently used at the front
+    std::list<std::string> lru;
+
+    size_t bytes = 0;
+    StateReplicaStats counts;
+
+    std::shared_ptr<faabric::state::StateKeyValue> track(
+      const std::string& user,
+      const std::string& key,
+      const std::function<std::shared_ptr<faabric::state::StateKeyValue>()>&
+        lookup);
+
+    void evict(const std::string& keep);
+};
+
+StateReplicaCache& getStateReplicaCache();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Sharded state for large, hot values such as model parameters, shared by
+ * WAVM and WAMR. The value is split by byte range into fixed-size shards, each
+ * held under its own key (<key>_shard_<i>) and so with its own master, which
+ * spreads the traffic for the value over several hosts.
+ *
+ * Faabric makes the first host to touch a key its master, so masters only
+ * spread out if different hosts touch different shards first, e.g. by each
+ * worker writing its own part of the value before anything reads it.
+ *
+ * Writes push just the chunks written and bump the shard's version (see
+ * state_version.h). Reads pull whole shards, but only when their version has
+ * changed. With a replication factor above one, shards also have copies
+ * (<key>_shard_<i>_copy_<r>), and each host reads from the one picked by its
+ * name. Copies are brought up to date by the readers that find them stale,
+ * so their masters are readers, and the value's readers are spread over them
+ * rather than all going to the shard's master.
+ *
+ * The shard size and replication factor come from the config, so must match
+ * across hosts.
+ */
+namespace wasm {
+
+struct StateShardLayout
+{
+    size_t totalSize = 0;
+
+    size_t shardSize = 0;
+
+    // Number of replicas of each shard, including the shard itself
+    int replicas = 1;
+
+    size_t nShards() const;
+
+    size_t getShardSize(size_t shardIdx) const;
+};
+
+// The layout of a value of the given size, as set in the config
+StateShardLayout getStateShardLayout(size_t totalSize);
+
+// Replica zero is the shard itself
+std::string getStateShardKey(const std::string& key,
+                             size_t shardIdx,
+                             int replica = 0);
+
+// The replica this host reads from
+int getStateShardReplica(int replicas);
+
+void writeStateSharded(const std::string& user,
+                       const std::string& key,
+                       const StateShardLayout& layout,
+                       size_t offset,
+                       const uint8_t* data,
+                       size_t dataLen);
+
+void readStateSharded(const std::string& user,
+                      const std::string& key,
+                      const StateShardLayout& layout,
+                      int replica,
+                      size_t offset,
+                      uint8_t* buffer,
+                      size_t bufferLen);
+}
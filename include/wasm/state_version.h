@@ -0,0 +1,45 @@
+#pragma once
+
+#include <faabric/state/StateKeyValue.h>
+
+#include <cstdint>
+#include <memory>
+
+/*
+ * Versioned state for read-mostly keys, shared by WAVM and WAMR. Each push
+ * through here bumps a version number held in a small companion key. Hosts
+ * remember the version of the replica they last pulled, so a pull only costs
+ * fetching the version when nothing has changed.
+ *
+ * Writers of a key must all use versioned pushes, otherwise readers won't
+ * notice their changes, and only one may push at a time, as bumping the
+ * version isn't atomic across hosts.
+ */
+namespace wasm {
+
+/**
+ * Pulls the value unless this host's replica is already at the latest
+ * version. Returns whether it pulled.
+ */
+bool pullStateIfChanged(std::shared_ptr<faabric::state::StateKeyValue> kv);
+
+// Pushes the value and bumps its version, returning the new version
+uint64_t pushStateVersioned(std::shared_ptr<faabric::state::StateKeyValue> kv);
+
+// As above, but only pushes the chunks that have been written
+uint64_t pushStatePartialVersioned(
+  std::shared_ptr<faabric::state::StateKeyValue> kv);
+
+// The latest version of the value, fetched from the master of its version
+uint64_t getStateVersion(std::shared_ptr<faabric::state::StateKeyValue> kv);
+
+/**
+ * Pushes the value with the given version rather than bumping it, for copies
+ * of another key that keep track of the version they were copied from.
+ */
+void pushStateAtVersion(std::shared_ptr<faabric::state::StateKeyValue> kv,
+                        uint64_t version);
+
+// Forgets which versions this host has pulled
+void clearStateVersions();
+}
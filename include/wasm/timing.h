@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+namespace wasm {
+
+/**
+ * High-resolution monotonic timer shared by omp_get_wtime and the Faasm host
+ * interface, so that timings agree across runtimes.
+ */
+uint64_t getTimerNanos();
+
+uint64_t getTimerResolutionNanos();
+
+double getTimerSeconds();
+
+double getTimerResolutionSeconds();
+
+/**
+ * Fast paths for the WASI clock calls, which some code (e.g. Python's
+ * perf_counter loops) makes millions of times. WASI clock IDs are the same in
+ * every runtime's headers, so are mapped with a table, and the realtime and
+ * monotonic clocks are read through the vDSO without a syscall. Both return
+ * zero, or -EINVAL for unknown clocks.
+ */
+int getWasiClockNanos(uint32_t wasiClockId, uint64_t* result);
+
+int getWasiClockResolutionNanos(uint32_t wasiClockId, uint64_t* result);
+
+class WasmModule;
+
+/**
+ * Sleeps parked on a futex, so that the sleep can be cut short by waking the
+ * module executing the call, e.g. when its Faaslet shuts down or it has a
+ * migration pending. As with futex waits, sleeps never outlast the deadline
+ * of the call being executed. Returns whether the sleep was cut short.
+ */
+bool sleepNanos(uint64_t nanos);
+
+// Cuts short the sleeps of calls executing in the module
+void wakeSleepingCalls(WasmModule* module);
+}
@@ -3,8 +3,13 @@
 #include <WAVM/IR/Module.h>
 #include <WAVM/Runtime/Intrinsics.h>
 
+#include <faabric/proto/faabric.pb.h>
 #include <faabric/util/config.h>
+
+#include <future>
+#include <mutex>
 #include <shared_mutex>
+#include <vector>
 
 using namespace WAVM;
 
@@ -30,6 +35,14 @@ class IRModuleCache
                                    const std::string& func,
                                    const std::string& path);
 
+    // Byte ranges of memory initialised from read-only data segments, i.e.
+    // those the linker named .rodata. Only segments at constant offsets are
+    // found, and none if the module has no names section.
+    std::vector<std::pair<uint32_t, uint32_t>> getReadOnlyDataRanges(
+      const std::string& user,
+      const std::string& func,
+      const std::string& path);
+
     bool isModuleCached(const std::string& user,
                         const std::string& func,
                         const std::string& path);
@@ -38,18 +51,52 @@ class IRModuleCache
                                 const std::string& func,
                                 const std::string& path);
 
+    // Returns the number of unique compiled shared modules held in the cache
+    size_t getSharedCompiledModuleCount();
+
+    // Size of the object code the module was loaded from, zero if unknown
+    size_t getCompiledModuleSize(const std::string& user,
+                                 const std::string& func,
+                                 const std::string& path);
+
+    // Drops the IR and compiled code for a main module. Shared modules are
+    // left in place as other functions may still be using them. Callers must
+    // make sure nothing is still holding a reference to the IR module.
+    void evictMainModule(const std::string& user, const std::string& func);
+
+    // Main modules with no machine code are compiled on first use, and the
+    // result uploaded in the background. This waits for those uploads.
+    void awaitObjectUploads();
+
     void clear();
 
   private:
     std::shared_mutex mx;
     std::unordered_map<std::string, IR::Module> moduleMap;
     std::unordered_map<std::string, Runtime::ModuleRef> compiledModuleMap;
+    std::unordered_map<std::string, size_t> compiledModuleSizes;
     std::unordered_map<std::string, int> originalTableSizes;
 
+    // Main modules being compiled, which other callers wait on
+    std::unordered_map<std::string, std::shared_future<Runtime::ModuleRef>>
+      pendingCompiles;
+
+    std::mutex uploadsMx;
+    std::vector<std::future<void>> objectUploads;
+
+    // Maps shared module paths to their content-addressed cache key
+    std::unordered_map<std::string, std::string> sharedModuleKeys;
+
     faabric::util::SystemConfig& conf;
 
     int getModuleCount(const std::string& key);
 
+    std::string getSharedModuleKey(const std::string& path);
+
+    std::string getKeyForModule(const std::string& user,
+                                const std::string& func,
+                                const std::string& path);
+
     int getCompiledModuleCount(const std::string& key);
 
     IR::Module& getMainModule(const std::string& user, const std::string& func);
@@ -66,6 +113,11 @@ class IRModuleCache
                                                const std::string& path);
 
     IR::Module& getModuleFromMap(const std::string& key);
+
+    std::vector<uint8_t> loadMainObjectFile(const faabric::Message& msg);
+
+    void uploadObjectCode(const faabric::Message& msg,
+                          std::vector<uint8_t> objectCode);
 };
 
 IRModuleCache& getIRModuleCache();
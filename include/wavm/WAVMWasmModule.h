@@ -3,22 +3,50 @@
 #include <faabric/util/bytes.h>
 #include <faabric/util/locks.h>
 
+#include <threads/LocalTeam.h>
 #include <threads/ThreadState.h>
 #include <wasm/WasmExecutionContext.h>
 #include <wasm/WasmModule.h>
+#include <wasm/dirty_tracking.h>
 #include <wavm/LoadedDynamicModule.h>
 
+#include <WAVM/IR/FeatureSpec.h>
 #include <WAVM/Runtime/Intrinsics.h>
 #include <WAVM/Runtime/Linker.h>
 #include <WAVM/Runtime/Runtime.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// How many old compartments can be waiting to be collected before resets
+// block on the reclaimer
+#define COMPARTMENT_RECLAIM_QUEUE_SIZE 4
+
 namespace wasm {
 
 WAVM_DECLARE_INTRINSIC_MODULE(env)
 
 WAVM_DECLARE_INTRINSIC_MODULE(wasi)
 
-std::vector<uint8_t> wavmCodegen(std::vector<uint8_t>& wasmBytes);
+// The wasm features modules may use. Machine code and the IR loaded alongside
+// it must be parsed with the same features.
+void setWavmFeatureSpec(WAVM::IR::FeatureSpec& featureSpec);
+
+// Generates machine code for this host's CPU, or for the given LLVM CPU target
+// on this host's architecture
+std::vector<uint8_t> wavmCodegen(std::vector<uint8_t>& wasmBytes,
+                                 const std::string& targetCpu = "");
+
+// The CPU targets machine code is also generated for, best first
+std::vector<std::string> getCodegenTargets();
+
+// Whether this host can run machine code generated for the given CPU target.
+// Only the x86-64 microarchitecture levels and Neoverse cores are recognised.
+bool isCodegenTargetSupported(const std::string& targetCpu);
 
 template<class T>
 T unalignedWavmRead(WAVM::Runtime::Memory* memory, WAVM::Uptr offset)
@@ -38,6 +66,27 @@ void unalignedWavmWrite(const T& value,
     faabric::util::unalignedWrite<T>(value, bytes);
 }
 
+/**
+ * Pages of a zygote's read-only data segments, kept once per host in a memfd
+ * and mapped copy-on-write into every module cloned from the zygote, rather
+ * than each module carrying its own copy.
+ */
+struct SharedReadOnlyData
+{
+    // All page-aligned
+    struct Region
+    {
+        uint32_t memOffset = 0;
+        uint32_t fdOffset = 0;
+        uint32_t length = 0;
+    };
+
+    int fd = -1;
+    std::vector<Region> regions;
+
+    ~SharedReadOnlyData();
+};
+
 class WAVMWasmModule final
   : public WasmModule
   , WAVM::Runtime::Resolver
@@ -65,8 +114,31 @@ class WAVMWasmModule final
     // ----- Exception handling -----
     void doThrowException(std::exception& e) override;
 
+    // ----- Execution deadlines -----
+    void enterHostCall() override;
+
+    void exitHostCall() override;
+
     // ----- Memory management -----
-    uint32_t mmapFile(uint32_t fd, size_t length) override;
+    using WasmModule::mmapFile;
+
+    uint32_t mmapFile(uint32_t fd,
+                      size_t length,
+                      int prot,
+                      int flags,
+                      uint64_t offset) override;
+
+    uint32_t mapReadOnlyBytes(const std::string& data) override;
+
+    uint32_t mapReadOnlyState(
+      const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+      size_t offset,
+      uint32_t length) override;
+
+    void mapSharedStateMemoryAt(
+      const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+      uint32_t wasmOffset,
+      size_t nBytes) override;
 
     uint8_t* wasmPointerToNative(uint32_t wasmPtr) override;
 
@@ -158,6 +230,8 @@ class WAVMWasmModule final
 
     int32_t executeFunction(faabric::Message& msg) override;
 
+    bool hasBatchHandler() override;
+
     int32_t executeOMPThread(int threadPoolIdx,
                              uint32_t stackTop,
                              faabric::Message& msg) override;
@@ -166,8 +240,106 @@ class WAVMWasmModule final
                            uint32_t stackTop,
                            faabric::Message& msg) override;
 
+    // ----- Read-only data -----
+    // Moves the pages of this zygote's read-only data into a shared memfd,
+    // which modules cloned from it then map rather than copy
+    void shareReadOnlyData();
+
+    std::vector<std::pair<uint32_t, uint32_t>> getReadOnlyDataRegions()
+      override;
+
+    // ----- Compartment pool -----
+    // Tops up this zygote's pool of compartments cloned ahead of time, which
+    // modules cloned from it take rather than cloning their own
+    void fillCompartmentPool();
+
+    size_t getCompartmentPoolCount();
+
+    // Pool for OpenMP teams that run on this host without the scheduler.
+    // Team member i uses thread stack i, so teams are at most as big as the
+    // executor's thread pool.
+    threads::LocalThreadPool& getOpenMPThreadPool();
+
   private:
     std::shared_mutex resetMx;
+
+    // The cached zygote we were cloned from, which keeps its cache entry (and
+    // reset snapshot) from being evicted while we're alive
+    std::shared_ptr<WAVMWasmModule> zygoteModule = nullptr;
+
+    std::shared_ptr<const SharedReadOnlyData> readOnlyData = nullptr;
+
+    void mapReadOnlyData();
+
+    // A compartment cloned from this module, along with everything clone
+    // would otherwise have to remap into it
+    struct PreclonedCompartment
+    {
+        bool withMemory = false;
+        WAVM::Runtime::GCPointer<WAVM::Runtime::Compartment> compartment;
+        WAVM::Runtime::GCPointer<WAVM::Runtime::Context> executionContext;
+        WAVM::Runtime::GCPointer<WAVM::Runtime::Instance> envModule;
+        WAVM::Runtime::GCPointer<WAVM::Runtime::Instance> wasiModule;
+        WAVM::Runtime::GCPointer<WAVM::Runtime::Instance> moduleInstance;
+        std::unordered_map<int,
+                           WAVM::Runtime::GCPointer<WAVM::Runtime::Instance>>
+          dynamicModules;
+    };
+
+    // Only zygotes have a pool. Modules take from it through the const
+    // reference they clone from, hence mutable.
+    mutable std::mutex compartmentPoolMx;
+    mutable std::deque<PreclonedCompartment> compartmentPool;
+    mutable bool compartmentPoolWithMemory = false;
+
+    PreclonedCompartment precloneCompartment(bool withMemory) const;
+
+    // Falls back to cloning on the spot if the pool is empty
+    PreclonedCompartment takePreclonedCompartment(bool withMemory) const;
+
+    static void releasePreclonedCompartment(PreclonedCompartment& p,
+                                            bool inBackground);
+
+    // Dirty-page reset. Once armed, the next reset only restores the pages
+    // dirtied since the last one. Anything that changes state outside the
+    // tracked memory (threads, dynamic linking, file mappings, reclaiming
+    // memory) disarms it. Each module tracks only its own memory, so
+    // concurrent modules can't wipe each other's tracking.
+    std::atomic<bool> dirtyResetArmed = false;
+    MemoryDirtyTracker dirtyTracker;
+    std::string dirtyResetSnapshotKey;
+    size_t dirtyResetMemorySize = 0;
+    uint32_t dirtyResetBrk = 0;
+
+    void armDirtyReset(const std::string& snapshotKey);
+
+    void disarmDirtyReset();
+
+    // Records the number of pages restored against the message
+    bool resetDirtyPages(const WAVMWasmModule& zygote,
+                         const std::string& snapshotKey,
+                         faabric::Message& msg);
+
+    // WAVM has no way to stop a running call, so interrupts revoke access to
+    // linear memory and wasm code traps on its next load or store. Host calls
+    // need memory too, so while any are running on the module's threads, the
+    // last one to return revokes it instead, and any made after that trap
+    // straight away. Wasm code that touches neither can't be stopped.
+    void doInterruptExecution() override;
+
+    void doRecoverFromInterrupt() override;
+
+    // The forking thread's OpenMP hot team only lives for a single call
+    void clearCallThreadState() override;
+
+    // Host calls in progress, along with HOST_CALLS_STOPPED once memory's
+    // been revoked
+    std::atomic<uint32_t> hostCallState = 0;
+
+    void revokeMemoryAccess();
+
+    void reclaimMemory(uint32_t offset, size_t nBytes) override;
+
     WAVM::Runtime::GCPointer<WAVM::Runtime::Instance> envModule;
     WAVM::Runtime::GCPointer<WAVM::Runtime::Instance> wasiModule;
     WAVM::Runtime::GCPointer<WAVM::Runtime::Instance> moduleInstance;
@@ -178,17 +350,32 @@ class WAVMWasmModule final
     int lastLoadedDynamicModuleHandle = 0;
     LoadedDynamicModule& getLastLoadedDynamicModule();
 
+    // Handles of libraries prelinked into the main module, mapped to their
+    // index in it. These are part of the main module's instance.
+    std::unordered_map<int, size_t> prelinkedLibraryMap;
+    int getPrelinkedLibraryIndex(const std::string& path);
+
     // Dynamic linking tables and memories
     std::unordered_map<std::string, WAVM::Uptr> globalOffsetTableMap;
     std::unordered_map<std::string, std::pair<int, bool>> globalOffsetMemoryMap;
     std::unordered_map<std::string, int> missingGlobalOffsetEntries;
 
+    // Table indices of functions looked up by dlsym, by handle then name
+    std::unordered_map<int, std::unordered_map<std::string, uint32_t>>
+      dynamicSymbolCache;
+
     // Memory management
     bool doGrowMemory(uint32_t pageChange) override;
 
     // OpenMP
     std::vector<WAVM::Runtime::Context*> openMPContexts;
 
+    // Pthreads
+    std::vector<WAVM::Runtime::Context*> pthreadContexts;
+
+    std::mutex openMPThreadPoolMx;
+    std::unique_ptr<threads::LocalThreadPool> openMPThreadPool = nullptr;
+
     static WAVM::Runtime::Instance* getEnvModule();
 
     static WAVM::Runtime::Instance* getWasiModule();
@@ -197,19 +384,23 @@ class WAVMWasmModule final
                                   bool executeZygote,
                                   bool useCache);
 
-    void writeStringArrayToMemory(const std::vector<std::string>& strings,
-                                  uint32_t strPoitners,
+    void writeStringArrayToMemory(const StringArray& strings,
+                                  uint32_t strPointers,
                                   uint32_t strBuffer) const;
 
     void clone(const WAVMWasmModule& other, const std::string& snapshotKey);
 
     void addModuleToGOT(WAVM::IR::Module& mod, bool isMainModule);
 
+    void preloadDynamicModules(const faabric::Message& msg);
+
     void executeZygoteFunction();
 
     void executeWasmConstructorsFunction(WAVM::Runtime::Instance* module);
 
-    void doWAVMGarbageCollection();
+    // Collects the module's compartment, either here or by handing it to the
+    // reclaimer thread
+    void doWAVMGarbageCollection(bool inBackground = false);
 
     WAVM::Runtime::Instance* createModuleInstance(
       const std::string& name,
@@ -221,14 +412,50 @@ class WAVMWasmModule final
     static WAVM::Runtime::Function* getDefaultZygoteFunction(
       WAVM::Runtime::Instance* module);
 
+    static WAVM::Runtime::Function* getBatchHandlerFunction(
+      WAVM::Runtime::Instance* module);
+
     static WAVM::Runtime::Function* getWasmConstructorsFunction(
       WAVM::Runtime::Instance* module);
 };
 
+// Resident size and usage of a single entry in the module cache
+struct WAVMCacheEntryStats
+{
+    std::string key;
+    size_t residentBytes = 0;
+    bool inUse = false;
+
+    std::string user;
+    std::string function;
+
+    // The zygote's memory and compiled code, and the reset snapshot, which
+    // make up the resident bytes
+    size_t moduleBytes = 0;
+    size_t snapshotBytes = 0;
+};
+
+/**
+ * Caches a bound zygote module per function, which new modules are cloned
+ * from. Modules bound from the cache hold a reference to their zygote, so
+ * entries that are in use are never evicted. If a memory budget is set,
+ * unused entries are evicted least-recently-used first, along with their
+ * reset snapshot and the function's IR and compiled code.
+ *
+ * Lookups are on the hot path of every reset, so cache hits take no lock.
+ * The map is copy-on-write: writers publish a new immutable copy under the
+ * lock and bump a generation counter, and each thread keeps a view of the
+ * latest copy it has seen, refreshing it when the generation changes. Views
+ * only hold weak references, so evicted entries are freed straight away, even
+ * if some threads never look anything up again.
+ *
+ * Reset snapshots are only registered for functions with a cached entry, so
+ * that evicting the entry always deletes its snapshot.
+ */
 class WAVMModuleCache
 {
   public:
-    std::pair<wasm::WAVMWasmModule&, faabric::util::SharedLock> getCachedModule(
+    std::shared_ptr<wasm::WAVMWasmModule> getCachedModule(
       faabric::Message& msg);
 
     std::string registerResetSnapshot(wasm::WasmModule& module,
@@ -238,14 +465,141 @@ class WAVMModuleCache
 
     size_t getTotalCachedModuleCount();
 
+    size_t getTotalResidentBytes();
+
+    std::vector<WAVMCacheEntryStats> getEntryStats();
+
   private:
+    struct CachedWAVMModule
+    {
+        // Immutable once published
+        std::shared_ptr<wasm::WAVMWasmModule> module;
+        std::string user;
+        std::string function;
+        size_t moduleBytes = 0;
+
+        // Guarded by the cache's lock
+        size_t snapshotBytes = 0;
+
+        // Coarse timestamp, updated without the lock on cache hits
+        std::atomic<uint64_t> lastUsed = 0;
+
+        size_t residentBytes() const { return moduleBytes + snapshotBytes; }
+
+        bool inUse() const { return module.use_count() > 1; }
+    };
+
+    using CachedWAVMModuleMap =
+      std::unordered_map<std::string, std::shared_ptr<CachedWAVMModule>>;
+
+    using CachedWAVMModuleView =
+      std::unordered_map<std::string, std::weak_ptr<CachedWAVMModule>>;
+
+    struct ThreadCacheView
+    {
+        const WAVMModuleCache* cache = nullptr;
+        uint64_t generation = 0;
+        CachedWAVMModuleView entries;
+    };
+
+    static thread_local ThreadCacheView threadView;
+
+    // Writers hold the full lock, and readers only take it to refresh their
+    // view when the generation has changed
     std::shared_mutex mx;
-    std::unordered_map<std::string, wasm::WAVMWasmModule> cachedModuleMap;
+    std::shared_ptr<const CachedWAVMModuleMap> cachedModuleMap =
+      std::make_shared<const CachedWAVMModuleMap>();
+    std::atomic<uint64_t> generation = 1;
+
+    const CachedWAVMModuleView& getThreadView();
+
+    // Must be called with the full lock held
+    void publish(std::shared_ptr<const CachedWAVMModuleMap> newMap);
 
     int getCachedModuleCount(const std::string& key);
+
+    // Must be called with the full lock held
+    void evictToBudget(const std::string& keepKey);
 };
 
 WAVMModuleCache& getWAVMModuleCache();
 
+/**
+ * Collects the compartments that modules leave behind when they're reset, off
+ * the executing thread. Collecting a compartment unmaps its memory and walks
+ * its objects, which would otherwise hold up every reset. The queue is
+ * bounded, so resets only block when the reclaimer falls behind, and old
+ * compartments can't pile up and take the host's memory with them.
+ */
+class CompartmentReclaimer
+{
+  public:
+    ~CompartmentReclaimer();
+
+    // The module must have dropped all its other references to the
+    // compartment's objects
+    void reclaim(
+      WAVM::Runtime::GCPointer<WAVM::Runtime::Compartment>&& compartment);
+
+    // Waits for all the compartments queued so far to be collected
+    void drain();
+
+    size_t getPendingCount();
+
+    size_t getFailedCount();
+
+  private:
+    std::mutex mx;
+    std::condition_variable queuedCv;
+    std::condition_variable collectedCv;
+    std::deque<WAVM::Runtime::GCPointer<WAVM::Runtime::Compartment>> queue;
+    bool collecting = false;
+    size_t failedCount = 0;
+
+    bool running = false;
+    std::thread reclaimThread;
+
+    void reclaimLoop();
+};
+
+CompartmentReclaimer& getCompartmentReclaimer();
+
+/**
+ * Refills the compartment pools of zygotes in the background, after modules
+ * have taken from them. Pools hold COMPARTMENT_POOL_SIZE compartments each.
+ */
+class CompartmentPoolFiller
+{
+  public:
+    ~CompartmentPoolFiller();
+
+    // Does nothing if pools are turned off
+    void requestFill(std::shared_ptr<WAVMWasmModule> zygote);
+
+    // Waits for all the requested fills to finish
+    void drain();
+
+  private:
+    std::mutex mx;
+    std::condition_variable requestedCv;
+    std::condition_variable filledCv;
+    std::deque<std::weak_ptr<WAVMWasmModule>> requested;
+    bool filling = false;
+
+    bool running = false;
+    std::thread fillThread;
+
+    void fillLoop();
+};
+
+CompartmentPoolFiller& getCompartmentPoolFiller();
+
 WAVMWasmModule* getExecutingWAVMModule();
+
+// Runs any OpenMP tasks left over when a thread finishes a parallel section
+void finishOpenMPTasks(WAVM::Runtime::Context* ctx);
+
+// Drops the calling thread's OpenMP hot team, so the next parallel section
+// builds a new one
+void clearOpenMPHotTeam();
 }
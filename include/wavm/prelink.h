@@ -0,0 +1,39 @@
+#pragma once
+
+#include <WAVM/IR/Module.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Custom section listing the shared libraries linked into a main module, one
+// path per line, in the order their exports are numbered
+#define PRELINKED_SECTION_NAME "faasm.prelinked"
+
+namespace wasm {
+
+struct PrelinkedLibrary
+{
+    // As dlopen would be given it, relative to the runtime root
+    std::string path;
+
+    std::vector<uint8_t> bytes;
+};
+
+/**
+ * Links shared libraries into a main module ahead of time, rather than each
+ * Faaslet loading them with dlopen. The libraries' data and table entries are
+ * given fixed places after the main module's, their imports become direct
+ * calls and constant globals, and their constructors run with the main
+ * module's. Each library's exports are kept under the name given by
+ * getPrelinkedExportName, so that dlsym can still find them.
+ */
+std::vector<uint8_t> wavmPrelink(const std::vector<uint8_t>& mainBytes,
+                                 const std::vector<PrelinkedLibrary>& libs);
+
+// Empty if the module wasn't prelinked
+std::vector<std::string> getPrelinkedLibraryPaths(
+  const WAVM::IR::Module& module);
+
+std::string getPrelinkedExportName(size_t libIdx, const std::string& name);
+}
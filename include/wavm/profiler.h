@@ -0,0 +1,69 @@
+#pragma once
+
+#include <faabric/proto/faabric.pb.h>
+
+#include <WAVM/Platform/Diagnostics.h>
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * Sampling profiler for wasm code run by WAVM, switched on by setting
+ * WASM_PROFILE_DIR. While a function runs, a CPU-time timer on its thread
+ * captures the call stack WASM_PROFILE_HZ times a second. When it finishes
+ * the wasm frames are resolved to their names in the module and appended to
+ * <user>_<function>.folded in that directory, ready for flamegraph.pl. Only
+ * WASM_PROFILE_PERCENT of calls are sampled.
+ */
+namespace wasm {
+
+// Most stacks kept per call, anything after this is dropped
+#define WASM_PROFILE_MAX_SAMPLES 4096
+
+class WAVMWasmModule;
+
+bool isWasmProfiling();
+
+// Whether this call is one of the sampled ones, if profiling is on
+bool isCallProfiled(const faabric::Message& msg);
+
+/**
+ * Turns a call stack, as described by WAVM with the innermost frame first,
+ * into a line of a folded stack, i.e. the outermost frame first separated by
+ * semicolons. Only wasm frames are kept, and are named using the given
+ * disassembly map where possible.
+ */
+std::string foldWasmCallStack(const std::vector<std::string>& frames,
+                              const std::map<std::string, std::string>& names);
+
+std::string getWasmProfileFile(const faabric::Message& msg);
+
+/**
+ * Samples the calling thread's call stack for as long as it's in scope, and
+ * writes out the folded stacks when it goes out of scope. Does nothing unless
+ * profiling is switched on.
+ */
+class WasmSamplingProfiler
+{
+  public:
+    WasmSamplingProfiler(WAVMWasmModule& moduleIn, const faabric::Message& msg);
+
+    ~WasmSamplingProfiler();
+
+    void recordSample();
+
+  private:
+    WAVMWasmModule& module;
+    const std::string filePath;
+    const bool enabled;
+
+    timer_t timerId;
+
+    std::vector<WAVM::Platform::CallStack> samples;
+    size_t nSamples = 0;
+
+    void writeSamples();
+};
+}
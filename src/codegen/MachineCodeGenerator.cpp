@@ -2,13 +2,25 @@
 #include <faabric/util/bytes.h>
 #include <faabric/util/config.h>
 #include <faabric/util/files.h>
+#include <faabric/util/environment.h>
 #include <faabric/util/func.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
 #include <storage/FileLoader.h>
 #include <wamr/WAMRWasmModule.h>
 #include <wavm/WAVMWasmModule.h>
+#include <wavm/prelink.h>
 
-#include <openssl/evp.h>
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <map>
 #include <stdexcept>
+#include <thread>
+
+// Recorded in codegen manifests, so that changing the toolchain invalidates
+// existing machine code
+#define CODEGEN_COMPILER_VERSION "llvm-" FAASM_CODEGEN_LLVM_VERSION
 
 using namespace faabric::util;
 
@@ -36,22 +48,20 @@ MachineCodeGenerator::MachineCodeGenerator(storage::FileLoader& loaderIn)
   , loader(loaderIn)
 {}
 
-std::vector<uint8_t> MachineCodeGenerator::hashBytes(
+storage::CodegenManifestEntry MachineCodeGenerator::getManifestEntry(
   const std::vector<uint8_t>& bytes)
 {
-    // Use the new high-level hashing APIs as suggested for OpenSSL 3.0
-    // https://github.com/openssl/openssl/issues/12260
-    EVP_MD_CTX* mdctx;
-    mdctx = EVP_MD_CTX_new();
-    EVP_DigestInit_ex(mdctx, EVP_md5(), NULL);
-    EVP_DigestUpdate(mdctx, bytes.data(), bytes.size());
+    storage::CodegenManifestEntry entry;
+    entry.hash = storage::hashCodegenInput(bytes);
+    entry.compilerVersion = CODEGEN_COMPILER_VERSION;
+    entry.options = conf.wasmVm;
 
-    unsigned int md5DigestLen = EVP_MD_size(EVP_md5());
-    std::vector<uint8_t> result(md5DigestLen);
-    EVP_DigestFinal_ex(mdctx, result.data(), &md5DigestLen);
-    EVP_MD_CTX_free(mdctx);
+    // Changing the targets means generating machine code for the new ones
+    if (conf.wasmVm == "wavm" && !conf.codegenTargets.empty()) {
+        entry.options += ":" + conf.codegenTargets;
+    }
 
-    return result;
+    return entry;
 }
 
 std::vector<uint8_t> MachineCodeGenerator::doCodegen(
@@ -68,7 +78,70 @@ std::vector<uint8_t> MachineCodeGenerator::doCodegen(
     return wasm::wavmCodegen(bytes);
 }
 
-void MachineCodeGenerator::codegenForFunction(faabric::Message& msg, bool clean)
+// -------------------------------------
+// MANIFESTS
+// -------------------------------------
+
+typedef std::vector<std::pair<std::string, storage::CodegenManifestEntry>>
+  ManifestUpdates;
+
+static void updateManifest(storage::FileLoader& loader,
+                           const std::string& scope,
+                           const ManifestUpdates& updates)
+{
+    if (updates.empty()) {
+        return;
+    }
+
+    SPDLOG_DEBUG("Updating {} entries in codegen manifest for {}",
+                 updates.size(),
+                 scope);
+    loader.recordCodegenManifestEntries(scope, updates);
+}
+
+// -------------------------------------
+// FUNCTIONS AND SHARED OBJECTS
+// -------------------------------------
+
+bool MachineCodeGenerator::isFunctionUpToDate(
+  const faabric::Message& msg,
+  const std::vector<uint8_t>& wasmBytes)
+{
+    // Functions uploaded before metadata existed are never up to date
+    storage::FunctionArtefact stored =
+      loader.loadFunctionMetadata(msg).getArtefact(FUNC_FILENAME);
+    if (stored.empty() || stored.size != wasmBytes.size() ||
+        stored.hash != storage::hashCodegenInput(wasmBytes)) {
+        return false;
+    }
+
+    // The manifest is only updated once the machine code has been uploaded
+    storage::CodegenManifest manifest(loader.loadCodegenManifest(msg.user()));
+    storage::CodegenManifestEntry entry =
+      manifest.getEntry(loader.getFunctionCodegenKey(msg));
+
+    return !entry.empty() && entry == getManifestEntry(wasmBytes);
+}
+
+bool MachineCodeGenerator::codegenForFunction(faabric::Message& msg, bool clean)
+{
+    const std::string key = loader.getFunctionCodegenKey(msg);
+    storage::CodegenManifest manifest(loader.loadCodegenManifest(msg.user()));
+
+    storage::CodegenManifestEntry newEntry;
+    if (!codegenForFunction(msg, clean, manifest.getEntry(key), newEntry)) {
+        return false;
+    }
+
+    updateManifest(loader, msg.user(), { { key, newEntry } });
+    return true;
+}
+
+bool MachineCodeGenerator::codegenForFunction(
+  faabric::Message& msg,
+  bool clean,
+  const storage::CodegenManifestEntry& oldEntry,
+  storage::CodegenManifestEntry& newEntry)
 {
     std::vector<uint8_t> bytes = loader.loadFunctionWasm(msg);
 
@@ -78,42 +151,39 @@ void MachineCodeGenerator::codegenForFunction(faabric::Message& msg, bool clean)
         throw std::runtime_error("Loaded empty bytes for " + funcStr);
     }
 
-    // Compare hashes
-    std::vector<uint8_t> newHash = hashBytes(bytes);
-    std::vector<uint8_t> oldHash;
-    if (conf.wasmVm == "wamr" || conf.wasmVm == "sgx") {
-        oldHash = loader.loadFunctionWamrAotHash(msg);
-    } else if (conf.wasmVm == "wavm") {
-        oldHash = loader.loadFunctionObjectHash(msg);
-    } else {
+    if (conf.wasmVm != "wamr" && conf.wasmVm != "sgx" &&
+        conf.wasmVm != "wavm") {
         SPDLOG_ERROR("Unrecognised WASM VM during codegen: {}", conf.wasmVm);
         throw std::runtime_error("Unrecognised WASM VM");
     }
 
+    // Compare against the manifest
+    newEntry = getManifestEntry(bytes);
+
     // If we run the machine code generator with the 'clean' flag, we ignore
-    // previously recorded hashes
-    if (!clean && (!oldHash.empty()) && newHash == oldHash) {
+    // previously recorded entries
+    if (!clean && !oldEntry.empty() && newEntry == oldEntry) {
         // Even if we skip the code generation step, we want to sync the latest
         // object file
         if (conf.wasmVm == "wamr" || conf.wasmVm == "sgx") {
-            UNUSED(loader.loadFunctionWamrAotHash(msg));
+            UNUSED(loader.cacheFunctionWamrAotFile(msg));
         } else {
-            UNUSED(loader.loadFunctionObjectFile(msg));
+            UNUSED(loader.cacheFunctionObjectFile(msg));
         }
         SPDLOG_DEBUG(
           "Skipping codegen for {} (WASM VM: {})", funcStr, conf.wasmVm);
-        return;
+        return false;
     }
 
-    if (oldHash.empty()) {
+    if (oldEntry.empty()) {
         SPDLOG_DEBUG(
-          "No old hash found for {} (WASM VM: {})", funcStr, conf.wasmVm);
+          "No manifest entry for {} (WASM VM: {})", funcStr, conf.wasmVm);
     } else if (clean) {
         SPDLOG_DEBUG(
           "Generating machine code for {} (WASM VM: {})", funcStr, conf.wasmVm);
     } else {
         SPDLOG_DEBUG(
-          "Hashes differ for {} (WASM VM: {})", funcStr, conf.wasmVm);
+          "Manifest entry differs for {} (WASM VM: {})", funcStr, conf.wasmVm);
     }
 
     // Run the actual codegen
@@ -123,35 +193,110 @@ void MachineCodeGenerator::codegenForFunction(faabric::Message& msg, bool clean)
     } catch (std::runtime_error& ex) {
         SPDLOG_ERROR(
           "Codegen failed for {} (WASM VM: {})", funcStr, conf.wasmVm);
-        throw ex;
+        throw;
     }
 
-    // Upload the file contents and the hash
+    // Upload the file contents
     if (conf.wasmVm == "wamr" || conf.wasmVm == "sgx") {
         loader.uploadFunctionWamrAotFile(msg, objBytes);
-        loader.uploadFunctionWamrAotHash(msg, newHash);
-    } else {
-        loader.uploadFunctionObjectFile(msg, objBytes);
-        loader.uploadFunctionObjectHash(msg, newHash);
+        return true;
+    }
+
+    loader.uploadFunctionObjectFile(msg, objBytes);
+
+    // Hosts fall back to the machine code above if they support none of the
+    // targets
+    for (const auto& target : wasm::getCodegenTargets()) {
+        SPDLOG_DEBUG("Generating {} machine code for {}", target, funcStr);
+        loader.uploadFunctionObjectFile(
+          msg, wasm::wavmCodegen(bytes, target), target);
     }
+
+    return true;
 }
 
-void MachineCodeGenerator::codegenForSharedObject(const std::string& inputPath,
+void MachineCodeGenerator::prelinkFunction(
+  faabric::Message& msg,
+  const std::vector<std::string>& libPaths)
+{
+    const std::string funcStr = funcToString(msg, false);
+    if (conf.wasmVm != "wavm") {
+        SPDLOG_ERROR("Prelinking {} is only supported with WAVM, not {}",
+                     funcStr,
+                     conf.wasmVm);
+        throw std::runtime_error("Prelinking not supported");
+    }
+
+    std::vector<uint8_t> bytes = loader.loadFunctionWasm(msg);
+    if (bytes.empty()) {
+        throw std::runtime_error("Loaded empty bytes for " + funcStr);
+    }
+
+    // Libraries are recorded as dlopen will see them in the function, i.e.
+    // relative to the runtime root, which may be elsewhere on other hosts
+    std::vector<wasm::PrelinkedLibrary> libs;
+    for (const auto& path : libPaths) {
+        std::filesystem::path relativePath =
+          std::filesystem::path(path).lexically_relative(conf.runtimeFilesDir);
+        if (relativePath.empty() || relativePath.string().starts_with("..")) {
+            SPDLOG_ERROR("Prelinked library {} is not under the runtime root "
+                         "{}",
+                         path,
+                         conf.runtimeFilesDir);
+            throw std::runtime_error("Prelinked library outside runtime root");
+        }
+
+        wasm::PrelinkedLibrary& lib = libs.emplace_back();
+        lib.path = relativePath.string();
+        lib.bytes = loader.loadSharedObjectWasm(path);
+    }
+
+    SPDLOG_INFO("Prelinking {} libraries into {}", libs.size(), funcStr);
+    std::vector<uint8_t> linkedBytes = wasm::wavmPrelink(bytes, libs);
+
+    // Uploads take the function's wasm as the message's input
+    msg.set_inputdata(linkedBytes.data(), linkedBytes.size());
+    loader.uploadFunction(msg);
+    msg.clear_inputdata();
+
+    codegenForFunction(msg, true);
+}
+
+bool MachineCodeGenerator::codegenForSharedObject(const std::string& inputPath,
                                                   bool clean)
+{
+    const std::string key = loader.getSharedObjectCodegenKey(inputPath);
+    storage::CodegenManifest manifest(
+      loader.loadCodegenManifest(SHARED_OBJ_MANIFEST_SCOPE));
+
+    storage::CodegenManifestEntry newEntry;
+    if (!codegenForSharedObject(
+          inputPath, clean, manifest.getEntry(key), newEntry)) {
+        return false;
+    }
+
+    updateManifest(loader, SHARED_OBJ_MANIFEST_SCOPE, { { key, newEntry } });
+    return true;
+}
+
+bool MachineCodeGenerator::codegenForSharedObject(
+  const std::string& inputPath,
+  bool clean,
+  const storage::CodegenManifestEntry& oldEntry,
+  storage::CodegenManifestEntry& newEntry)
 {
     // Load the wasm
     std::vector<uint8_t> bytes = loader.loadSharedObjectWasm(inputPath);
 
-    // Check the hash
-    std::vector<uint8_t> newHash = hashBytes(bytes);
-    std::vector<uint8_t> oldHash = loader.loadSharedObjectObjectHash(inputPath);
+    // Compare against the manifest
+    newEntry = getManifestEntry(bytes);
 
-    if ((!oldHash.empty()) && newHash == oldHash && !clean) {
+    if (!clean && !oldEntry.empty() && newEntry == oldEntry) {
         // Even if we skip the code generation step, we want to sync the latest
         // shared object object file
-        UNUSED(loader.loadSharedObjectObjectFile(inputPath));
+        UNUSED(loader.cacheSharedObjectObjectFile(inputPath));
         SPDLOG_DEBUG("Skipping codegen for {}", inputPath);
-        return;
+        return false;
     }
 
     // Run the actual codegen
@@ -164,6 +309,185 @@ void MachineCodeGenerator::codegenForSharedObject(const std::string& inputPath,
     }
 
     loader.uploadSharedObjectObjectFile(inputPath, objBytes);
-    loader.uploadSharedObjectObjectHash(inputPath, newHash);
+
+    return true;
+}
+
+// -------------------------------------
+// BATCH CODEGEN
+// -------------------------------------
+
+static std::vector<CodegenResult> runBatchCodegen(
+  size_t nItems,
+  int nThreads,
+  const std::function<std::string(size_t)>& getName,
+  const std::function<bool(MachineCodeGenerator&, size_t)>& doItem)
+{
+    std::vector<CodegenResult> results(nItems);
+    if (nItems == 0) {
+        return results;
+    }
+
+    if (nThreads <= 0) {
+        nThreads = faabric::util::getUsableCores();
+    }
+    nThreads = std::min<int>(nThreads, nItems);
+
+    SPDLOG_INFO("Running batch codegen on {} items with {} threads",
+                nItems,
+                nThreads);
+
+    std::atomic<size_t> nextItem = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; t++) {
+        threads.emplace_back([&] {
+            // Each thread has its own generator and file loader
+            MachineCodeGenerator& gen = getMachineCodeGenerator();
+
+            while (true) {
+                size_t idx = nextItem.fetch_add(1, std::memory_order_relaxed);
+                if (idx >= nItems) {
+                    break;
+                }
+
+                CodegenResult& result = results.at(idx);
+                result.name = getName(idx);
+
+                faabric::util::TimePoint start = faabric::util::startTimer();
+                try {
+                    result.skipped = !doItem(gen, idx);
+                    result.success = true;
+                } catch (std::exception& ex) {
+                    SPDLOG_ERROR("Batch codegen failed for {}: {}",
+                                 result.name,
+                                 ex.what());
+                    result.success = false;
+                    result.error = ex.what();
+                }
+
+                result.timeMs = faabric::util::getTimeDiffMillis(start);
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+
+    return results;
+}
+
+std::vector<CodegenResult> codegenForFunctions(
+  std::vector<faabric::Message>& msgs,
+  bool clean,
+  int nThreads)
+{
+    storage::FileLoader& loader = storage::getFileLoader();
+
+    // Fetch each user's manifest once, up front
+    std::map<std::string, storage::CodegenManifest> manifests;
+    std::vector<std::string> keys;
+    std::vector<storage::CodegenManifestEntry> oldEntries;
+    for (const auto& msg : msgs) {
+        if (manifests.find(msg.user()) == manifests.end()) {
+            manifests.emplace(
+              msg.user(),
+              storage::CodegenManifest(loader.loadCodegenManifest(msg.user())));
+        }
+
+        keys.emplace_back(loader.getFunctionCodegenKey(msg));
+        oldEntries.emplace_back(manifests.at(msg.user()).getEntry(keys.back()));
+    }
+
+    std::vector<storage::CodegenManifestEntry> newEntries(msgs.size());
+    std::vector<CodegenResult> results = runBatchCodegen(
+      msgs.size(),
+      nThreads,
+      [&msgs](size_t idx) { return funcToString(msgs.at(idx), false); },
+      [&](MachineCodeGenerator& gen, size_t idx) {
+          return gen.codegenForFunction(
+            msgs.at(idx), clean, oldEntries.at(idx), newEntries.at(idx));
+      });
+
+    // Upload each modified manifest once
+    std::map<std::string, ManifestUpdates> updates;
+    for (size_t i = 0; i < results.size(); i++) {
+        if (results.at(i).success && !results.at(i).skipped) {
+            updates[msgs.at(i).user()].emplace_back(keys.at(i),
+                                                    newEntries.at(i));
+        }
+    }
+
+    for (const auto& [user, userUpdates] : updates) {
+        updateManifest(loader, user, userUpdates);
+    }
+
+    return results;
+}
+
+std::vector<CodegenResult> codegenForSharedObjects(
+  const std::vector<std::string>& paths,
+  bool clean,
+  int nThreads)
+{
+    storage::FileLoader& loader = storage::getFileLoader();
+
+    storage::CodegenManifest manifest(
+      loader.loadCodegenManifest(SHARED_OBJ_MANIFEST_SCOPE));
+    std::vector<std::string> keys;
+    std::vector<storage::CodegenManifestEntry> oldEntries;
+    for (const auto& path : paths) {
+        keys.emplace_back(loader.getSharedObjectCodegenKey(path));
+        oldEntries.emplace_back(manifest.getEntry(keys.back()));
+    }
+
+    std::vector<storage::CodegenManifestEntry> newEntries(paths.size());
+    std::vector<CodegenResult> results = runBatchCodegen(
+      paths.size(),
+      nThreads,
+      [&paths](size_t idx) { return paths.at(idx); },
+      [&](MachineCodeGenerator& gen, size_t idx) {
+          return gen.codegenForSharedObject(
+            paths.at(idx), clean, oldEntries.at(idx), newEntries.at(idx));
+      });
+
+    ManifestUpdates updates;
+    for (size_t i = 0; i < results.size(); i++) {
+        if (results.at(i).success && !results.at(i).skipped) {
+            updates.emplace_back(keys.at(i), newEntries.at(i));
+        }
+    }
+    updateManifest(loader, SHARED_OBJ_MANIFEST_SCOPE, updates);
+
+    return results;
+}
+
+void printCodegenResults(const std::vector<CodegenResult>& results)
+{
+    int nFailed = 0;
+    int nSkipped = 0;
+    long totalMs = 0;
+
+    for (const auto& r : results) {
+        std::string status = "compiled";
+        if (!r.success) {
+            status = "FAILED";
+            nFailed++;
+        } else if (r.skipped) {
+            status = "unchanged";
+            nSkipped++;
+        }
+
+        totalMs += r.timeMs;
+        SPDLOG_INFO("{:>8}ms  {:<9}  {}", r.timeMs, status, r.name);
+    }
+
+    SPDLOG_INFO("Codegen: {} items, {} unchanged, {} failed ({}ms CPU total)",
+                results.size(),
+                nSkipped,
+                nFailed,
+                totalMs);
 }
 }
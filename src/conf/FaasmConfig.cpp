@@ -21,14 +21,81 @@ void FaasmConfig::initialise()
     hostType = getEnvVar("HOST_TYPE", "default");
 
     cgroupMode = getEnvVar("CGROUP_MODE", "on");
+    cgroupGranularity = getEnvVar("CGROUP_GRANULARITY", "host");
+    cgroupCpuWeight = this->getIntParam("CGROUP_CPU_WEIGHT", "100");
+    cgroupCpuMaxPercent = this->getIntParam("CGROUP_CPU_MAX_PERCENT", "0");
+    cgroupMemoryMaxMb = this->getIntParam("CGROUP_MEMORY_MAX_MB", "0");
     netNsMode = getEnvVar("NETNS_MODE", "off");
     maxNetNs = this->getIntParam("MAX_NET_NAMESPACES", "100");
+    netNsClaimTimeoutMs = this->getIntParam("NETNS_CLAIM_TIMEOUT_MS", "0");
+    netNsEgressRate = getEnvVar("NETNS_EGRESS_RATE", "");
+    netNsTenantEgressRates = getEnvVar("NETNS_TENANT_EGRESS_RATES", "");
+    httpMaxIdleConnections = this->getIntParam("HTTP_MAX_IDLE_CONNS", "16");
+    httpIdleTimeoutMs = this->getIntParam("HTTP_IDLE_TIMEOUT_MS", "30000");
+    dnsCacheMaxTtlSecs = this->getIntParam("DNS_CACHE_MAX_TTL_S", "300");
+    ipcChannelSize = this->getIntParam("IPC_CHANNEL_SIZE", "4194304");
+    affinityPolicy = getEnvVar("AFFINITY_POLICY", "off");
+    metricsPort = this->getIntParam("METRICS_PORT", "0");
 
     pythonPreload = getEnvVar("PYTHON_PRELOAD", "off");
+    pythonPreloadFaaslets = this->getIntParam("PYTHON_PRELOAD_FAASLETS", "0");
+    pythonImportZygote = getEnvVar("PYTHON_IMPORT_ZYGOTE", "off");
+    pythonBytecodeCache = getEnvVar("PYTHON_BYTECODE_CACHE", "on");
     captureStdout = getEnvVar("CAPTURE_STDOUT", "off");
+    captureStdoutMaxBytes =
+      this->getIntParam("CAPTURE_STDOUT_MAX_BYTES", "1048576");
+
+    prewarmFunctions = getEnvVar("PREWARM_FUNCTIONS", "");
+    prewarmThreads = this->getIntParam("PREWARM_THREADS", "2");
+    uploadWorkers = this->getIntParam("UPLOAD_WORKERS", "2");
+    uploadQueueSize = this->getIntParam("UPLOAD_QUEUE_SIZE", "32");
 
     wasmVm = getEnvVar("WASM_VM", "wavm");
+    codegenTargets = getEnvVar("CODEGEN_TARGETS", "");
+    wamrStackSize = this->getIntParam("WAMR_STACK_SIZE", "8192");
+    wamrFunctionStackSizes = getEnvVar("WAMR_FUNCTION_STACK_SIZES", "");
+    moduleCacheBudgetMb = this->getIntParam("MODULE_CACHE_BUDGET_MB", "0");
+    resetMode = getEnvVar("RESET_MODE", "remap");
+    resetPoolSize = this->getIntParam("RESET_POOL_SIZE", "0");
+    compartmentPoolSize = this->getIntParam("COMPARTMENT_POOL_SIZE", "0");
+    faasletMinFreeMemMb = this->getIntParam("FAASLET_MIN_FREE_MEM_MB", "0");
+    faasletAdmissionQueue = this->getIntParam("FAASLET_ADMISSION_QUEUE", "64");
+    faasletAdmissionTimeoutMs =
+      this->getIntParam("FAASLET_ADMISSION_TIMEOUT_MS", "10000");
+    sharedZygoteMemory = getEnvVar("SHARED_ZYGOTE_MEMORY", "off");
+    sharedReadOnlyData = getEnvVar("SHARED_READ_ONLY_DATA", "on");
+    snapshotPageDedup = getEnvVar("SNAPSHOT_PAGE_DEDUP", "off");
+    hugePages = getEnvVar("HUGE_PAGES", "off");
+    pthreadDispatchBatch = this->getIntParam("PTHREAD_DISPATCH_BATCH", "0");
+    ompLocalTeams = getEnvVar("OMP_LOCAL_TEAMS", "on");
+    ompProfileFile = getEnvVar("OMP_PROFILE_FILE", "");
+    mpiRendezvousThreshold =
+      this->getIntParam("MPI_RENDEZVOUS_THRESHOLD", "0");
+    mpiShmCollectives = getEnvVar("MPI_SHM_COLLECTIVES", "off");
+    mpiProfileFile = getEnvVar("MPI_PROFILE_FILE", "");
+    wasmProfileDir = getEnvVar("WASM_PROFILE_DIR", "");
+    wasmProfileHz = this->getIntParam("WASM_PROFILE_HZ", "99");
+    wasmProfilePercent = this->getIntParam("WASM_PROFILE_PERCENT", "100");
+    perfCounters = getEnvVar("PERF_COUNTERS", "off");
     chainedCallTimeout = this->getIntParam("CHAINED_CALL_TIMEOUT", "300000");
+    chainedShmOutputThreshold =
+      this->getIntParam("CHAINED_SHM_OUTPUT_THRESHOLD", "0");
+    execTimeoutMs = this->getIntParam("EXEC_TIMEOUT_MS", "0");
+    batchResetInterval = this->getIntParam("BATCH_RESET_INTERVAL", "64");
+    resultCacheFunctions = getEnvVar("RESULT_CACHE_FUNCTIONS", "");
+    resultCacheBudgetMb = this->getIntParam("RESULT_CACHE_BUDGET_MB", "64");
+    resultCacheShared = getEnvVar("RESULT_CACHE_SHARED", "off");
+    migrationPrecopy = getEnvVar("MIGRATION_PRECOPY", "off");
+    migrationElideZeroPages = getEnvVar("MIGRATION_ELIDE_ZERO_PAGES", "off");
+    migrationPolicy = getEnvVar("MIGRATION_POLICY", "always");
+    migrationBandwidthMbps =
+      this->getIntParam("MIGRATION_BANDWIDTH_MBPS", "1000");
+    checkpointPeriodSecs = this->getIntParam("CHECKPOINT_PERIOD_S", "0");
+    checkpointRestore = getEnvVar("CHECKPOINT_RESTORE", "off");
+    stateShardKb = this->getIntParam("STATE_SHARD_KB", "1024");
+    stateShardReplicas = this->getIntParam("STATE_SHARD_REPLICAS", "1");
+    stateDiskDir = getEnvVar("STATE_DISK_DIR", "");
+    stateReplicaBudgetMb = this->getIntParam("STATE_REPLICA_BUDGET_MB", "0");
 
     std::string faasmLocalDir =
       getEnvVar("FAASM_LOCAL_DIR", "/usr/local/faasm");
@@ -36,14 +103,28 @@ void FaasmConfig::initialise()
     objectFileDir = fmt::format("{}/{}", faasmLocalDir, "object");
     runtimeFilesDir = fmt::format("{}/{}", faasmLocalDir, "runtime_root");
     sharedFilesDir = fmt::format("{}/{}", faasmLocalDir, "shared");
+    runtimeOverlayDirs = getEnvVar("RUNTIME_OVERLAY_DIRS", "");
+    artefactCacheDir = fmt::format("{}/{}", faasmLocalDir, "artefacts");
+    artefactCacheBudgetMb =
+      this->getIntParam("ARTEFACT_CACHE_BUDGET_MB", "0");
+    artefactPeerFetch = getEnvVar("ARTEFACT_PEER_FETCH", "off");
 
     s3Bucket = getEnvVar("S3_BUCKET", "faasm");
     s3Host = getEnvVar("S3_HOST", "minio");
     s3Port = getEnvVar("S3_PORT", "9000");
     s3User = getEnvVar("S3_USER", "minio");
     s3Password = getEnvVar("S3_PASSWORD", "minio123");
+    s3PartSizeMb = this->getIntParam("S3_PART_SIZE_MB", "16");
+    s3Concurrency = this->getIntParam("S3_CONCURRENCY", "8");
+    sharedFileWriteBackMs =
+      this->getIntParam("SHARED_FILE_WRITE_BACK_MS", "0");
 
+    sgxEnclaves = this->getIntParam("SGX_ENCLAVES", "1");
+    sgxSwitchlessWorkers = this->getIntParam("SGX_SWITCHLESS_WORKERS", "2");
     attestationProviderUrl = getEnvVar("AZ_ATTESTATION_PROVIDER_URL", "");
+    sgxKeyReleaseUrl = getEnvVar("SGX_KEY_RELEASE_URL", "");
+    sgxAttestationRefreshSecs =
+      this->getIntParam("SGX_ATTESTATION_REFRESH_SECS", "300");
 }
 
 int FaasmConfig::getIntParam(const char* name, const char* defaultValue)
@@ -62,20 +143,92 @@ void FaasmConfig::print()
 {
     SPDLOG_INFO("--- HOST ---");
     SPDLOG_INFO("Cgroup mode:          {}", cgroupMode);
+    SPDLOG_INFO("Cgroup granularity:   {}", cgroupGranularity);
+    SPDLOG_INFO("Cgroup CPU weight:    {}", cgroupCpuWeight);
+    SPDLOG_INFO("Cgroup CPU max:       {}%", cgroupCpuMaxPercent);
+    SPDLOG_INFO("Cgroup memory max:    {}MB", cgroupMemoryMaxMb);
     SPDLOG_INFO("Host type:            {}", hostType);
     SPDLOG_INFO("Network ns mode:      {}", netNsMode);
     SPDLOG_INFO("Max. network ns:      {}", maxNetNs);
+    SPDLOG_INFO("Net ns claim timeout: {}ms", netNsClaimTimeoutMs);
+    SPDLOG_INFO("Net ns egress rate:   {}", netNsEgressRate);
+    SPDLOG_INFO("Tenant egress rates:  {}", netNsTenantEgressRates);
+    SPDLOG_INFO("HTTP max idle conns:  {}", httpMaxIdleConnections);
+    SPDLOG_INFO("HTTP idle timeout:    {}ms", httpIdleTimeoutMs);
+    SPDLOG_INFO("DNS cache max TTL:    {}s", dnsCacheMaxTtlSecs);
+    SPDLOG_INFO("IPC channel size:     {}", ipcChannelSize);
+    SPDLOG_INFO("Affinity policy:      {}", affinityPolicy);
+    SPDLOG_INFO("Metrics port:         {}", metricsPort);
 
     SPDLOG_INFO("--- MISC ---");
     SPDLOG_INFO("Capture stdout:       {}", captureStdout);
+    SPDLOG_INFO("Capture stdout max:   {}", captureStdoutMaxBytes);
     SPDLOG_INFO("Chained call timeout: {}", chainedCallTimeout);
+    SPDLOG_INFO("Chained shm output:   {}", chainedShmOutputThreshold);
+    SPDLOG_INFO("Exec timeout:         {}ms", execTimeoutMs);
+    SPDLOG_INFO("Batch reset interval: {}", batchResetInterval);
+    SPDLOG_INFO("Result cache funcs:   {}", resultCacheFunctions);
+    SPDLOG_INFO("Result cache budget:  {}MB", resultCacheBudgetMb);
+    SPDLOG_INFO("Result cache shared:  {}", resultCacheShared);
+    SPDLOG_INFO("Migration pre-copy:   {}", migrationPrecopy);
+    SPDLOG_INFO("Elide zero pages:     {}", migrationElideZeroPages);
+    SPDLOG_INFO("Migration policy:     {}", migrationPolicy);
+    SPDLOG_INFO("Migration bandwidth:  {}Mbps", migrationBandwidthMbps);
+    SPDLOG_INFO("Checkpoint period:    {}s", checkpointPeriodSecs);
+    SPDLOG_INFO("Checkpoint restore:   {}", checkpointRestore);
+    SPDLOG_INFO("State shard size:     {}KB", stateShardKb);
+    SPDLOG_INFO("State shard replicas: {}", stateShardReplicas);
+    SPDLOG_INFO("State disk dir:       {}", stateDiskDir);
+    SPDLOG_INFO("State replica budget: {}MB", stateReplicaBudgetMb);
     SPDLOG_INFO("Python preload:       {}", pythonPreload);
+    SPDLOG_INFO("Python Faaslets:      {}", pythonPreloadFaaslets);
+    SPDLOG_INFO("Python import zygote: {}", pythonImportZygote);
+    SPDLOG_INFO("Python bytecode:      {}", pythonBytecodeCache);
+    SPDLOG_INFO("Prewarm functions:    {}", prewarmFunctions);
+    SPDLOG_INFO("Prewarm threads:      {}", prewarmThreads);
+    SPDLOG_INFO("Upload workers:       {}", uploadWorkers);
+    SPDLOG_INFO("Upload queue size:    {}", uploadQueueSize);
     SPDLOG_INFO("Wasm VM:              {}", wasmVm);
+    SPDLOG_INFO("Codegen targets:      {}", codegenTargets);
+    SPDLOG_INFO("WAMR stack size:      {}", wamrStackSize);
+    SPDLOG_INFO("WAMR function stacks: {}", wamrFunctionStackSizes);
+    SPDLOG_INFO("Module cache budget:  {}MB", moduleCacheBudgetMb);
+    SPDLOG_INFO("Reset mode:           {}", resetMode);
+    SPDLOG_INFO("Reset pool size:      {}", resetPoolSize);
+    SPDLOG_INFO("Compartment pool:     {}", compartmentPoolSize);
+    SPDLOG_INFO("Faaslet min free mem: {}MB", faasletMinFreeMemMb);
+    SPDLOG_INFO("Admission queue:      {}", faasletAdmissionQueue);
+    SPDLOG_INFO("Admission timeout:    {}ms", faasletAdmissionTimeoutMs);
+    SPDLOG_INFO("Shared zygote memory: {}", sharedZygoteMemory);
+    SPDLOG_INFO("Shared rodata:        {}", sharedReadOnlyData);
+    SPDLOG_INFO("Snapshot page dedup:  {}", snapshotPageDedup);
+    SPDLOG_INFO("Huge pages:           {}", hugePages);
+    SPDLOG_INFO("Pthread dispatch:     {}", pthreadDispatchBatch);
+    SPDLOG_INFO("OpenMP local teams:   {}", ompLocalTeams);
+    SPDLOG_INFO("OpenMP profile file:  {}", ompProfileFile);
+    SPDLOG_INFO("MPI rendezvous bytes: {}", mpiRendezvousThreshold);
+    SPDLOG_INFO("MPI shm collectives:  {}", mpiShmCollectives);
+    SPDLOG_INFO("MPI profile file:     {}", mpiProfileFile);
+    SPDLOG_INFO("Wasm profile dir:     {}", wasmProfileDir);
+    SPDLOG_INFO("Wasm profile Hz:      {}", wasmProfileHz);
+    SPDLOG_INFO("Wasm profile percent: {}", wasmProfilePercent);
+    SPDLOG_INFO("Perf counters:        {}", perfCounters);
+    SPDLOG_INFO("SGX enclaves:         {}", sgxEnclaves);
+    SPDLOG_INFO("SGX switchless:       {}", sgxSwitchlessWorkers);
+    SPDLOG_INFO("SGX key release URL:  {}", sgxKeyReleaseUrl);
+    SPDLOG_INFO("SGX attest refresh:   {}s", sgxAttestationRefreshSecs);
 
     SPDLOG_INFO("--- STORAGE ---");
     SPDLOG_INFO("Function dir:         {}", functionDir);
     SPDLOG_INFO("Object file dir:      {}", objectFileDir);
     SPDLOG_INFO("Runtime files dir:    {}", runtimeFilesDir);
     SPDLOG_INFO("Shared files dir:     {}", sharedFilesDir);
+    SPDLOG_INFO("Runtime overlay dirs: {}", runtimeOverlayDirs);
+    SPDLOG_INFO("Artefact cache dir:   {}", artefactCacheDir);
+    SPDLOG_INFO("Artefact budget:      {}MB", artefactCacheBudgetMb);
+    SPDLOG_INFO("Artefact peer fetch:  {}", artefactPeerFetch);
+    SPDLOG_INFO("S3 part size:         {}MB", s3PartSizeMb);
+    SPDLOG_INFO("S3 concurrency:       {}", s3Concurrency);
+    SPDLOG_INFO("File write-back:      {}ms", sharedFileWriteBackMs);
 }
 }
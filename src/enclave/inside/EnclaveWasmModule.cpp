@@ -1,55 +1,91 @@
 #include <enclave/inside/EnclaveWasmModule.h>
+#include <enclave/inside/edmm.h>
 #include <enclave/inside/ocalls.h>
 
 #include <string>
 #include <vector>
 
+#include <sgx_tseal.h>
+
 namespace wasm {
 
-// Define the module map and its mutex
+// Define the module maps and their mutex
 std::unordered_map<uint32_t, std::shared_ptr<EnclaveWasmModule>> moduleMap;
+std::unordered_map<std::string, std::shared_ptr<LoadedWasmModule>>
+  loadedModuleMap;
 std::mutex moduleMapMutex;
 
-// Define the WAMR's heap buffer
-static uint8_t wamrHeapBuffer[FAASM_SGX_WAMR_HEAP_SIZE];
-
 bool EnclaveWasmModule::initialiseWAMRGlobally()
 {
-    // Initialise the WAMR runtime
+    // Initialise the WAMR runtime. Rather than a pool committed when the
+    // enclave is created, memory is committed as it's used (see edmm.h).
     RuntimeInitArgs wamrRteArgs;
     memset(&wamrRteArgs, 0x0, sizeof(wamrRteArgs));
-    wamrRteArgs.mem_alloc_type = Alloc_With_Pool;
-    wamrRteArgs.mem_alloc_option.pool.heap_buf = (void*)wamrHeapBuffer;
-    wamrRteArgs.mem_alloc_option.pool.heap_size = sizeof(wamrHeapBuffer);
+    wamrRteArgs.mem_alloc_type = Alloc_With_Allocator;
+    wamrRteArgs.mem_alloc_option.allocator.malloc_func = (void*)sgx::edmmMalloc;
+    wamrRteArgs.mem_alloc_option.allocator.realloc_func =
+      (void*)sgx::edmmRealloc;
+    wamrRteArgs.mem_alloc_option.allocator.free_func = (void*)sgx::edmmFree;
 
     // Returns true if success, false otherwise
     return wasm_runtime_full_init(&wamrRteArgs);
 }
 
-EnclaveWasmModule::EnclaveWasmModule() {}
+LoadedWasmModule::~LoadedWasmModule()
+{
+    if (wasmModule != nullptr) {
+        wasm_runtime_unload(wasmModule);
+    }
+}
 
-EnclaveWasmModule::~EnclaveWasmModule()
+bool LoadedWasmModule::load(void* wasmOpCodePtr,
+                            uint32_t wasmOpCodeSize,
+                            const std::string& funcStrIn)
 {
-    wasm_runtime_deinstantiate(moduleInstance);
-    wasm_runtime_unload(wasmModule);
+    return load(std::vector<uint8_t>((uint8_t*)wasmOpCodePtr,
+                                     (uint8_t*)wasmOpCodePtr + wasmOpCodeSize),
+                funcStrIn);
 }
 
-bool EnclaveWasmModule::loadWasm(void* wasmOpCodePtr, uint32_t wasmOpCodeSize)
+bool LoadedWasmModule::load(std::vector<uint8_t>&& wasmBytesIn,
+                            const std::string& funcStrIn)
 {
-    std::vector<uint8_t> wasmBytes((uint8_t*)wasmOpCodePtr,
-                                   (uint8_t*)wasmOpCodePtr + wasmOpCodeSize);
+    funcStr = funcStrIn;
+    wasmBytes = std::move(wasmBytesIn);
 
     wasmModule = wasm_runtime_load(wasmBytes.data(),
                                    wasmBytes.size(),
                                    errorBuffer,
                                    FAASM_SGX_WAMR_MODULE_ERROR_BUFFER_SIZE);
 
-    if (wasmModule == nullptr) {
-        return false;
+    return wasmModule != nullptr;
+}
+
+WASMModuleCommon* LoadedWasmModule::getModule()
+{
+    return wasmModule;
+}
+
+const std::string& LoadedWasmModule::getFuncStr() const
+{
+    return funcStr;
+}
+
+EnclaveWasmModule::EnclaveWasmModule(std::shared_ptr<LoadedWasmModule> loadedIn)
+  : loaded(std::move(loadedIn))
+{}
+
+EnclaveWasmModule::~EnclaveWasmModule()
+{
+    if (moduleInstance != nullptr) {
+        wasm_runtime_deinstantiate(moduleInstance);
     }
+}
 
+bool EnclaveWasmModule::instantiate()
+{
     moduleInstance =
-      wasm_runtime_instantiate(wasmModule,
+      wasm_runtime_instantiate(loaded->getModule(),
                                FAASM_SGX_WAMR_INSTANCE_DEFAULT_STACK_SIZE,
                                FAASM_SGX_WAMR_INSTANCE_DEFAULT_HEAP_SIZE,
                                errorBuffer,
@@ -58,20 +94,30 @@ bool EnclaveWasmModule::loadWasm(void* wasmOpCodePtr, uint32_t wasmOpCodeSize)
     return moduleInstance != nullptr;
 }
 
+bool EnclaveWasmModule::reset()
+{
+    if (moduleInstance != nullptr) {
+        wasm_runtime_deinstantiate(moduleInstance);
+        moduleInstance = nullptr;
+    }
+
+    return instantiate();
+}
+
 bool EnclaveWasmModule::callFunction(uint32_t argcIn, char** argvIn)
 {
     prepareArgcArgv(argcIn, argvIn);
 
     WASMExecEnv* execEnv = wasm_runtime_get_exec_env_singleton(moduleInstance);
     if (execEnv == nullptr) {
-        ocallLogError("Failed to create WAMR exec env");
+        sgx::logError("Failed to create WAMR exec env");
         throw std::runtime_error("Failed to create WAMR exec env");
     }
 
     WASMFunctionInstanceCommon* func =
       wasm_runtime_lookup_function(moduleInstance, WASM_ENTRY_FUNC, nullptr);
     if (func == nullptr) {
-        ocallLogError("Did not find named WASM function");
+        sgx::logError("Did not find named WASM function");
         throw std::runtime_error("Did not find named wasm function");
     }
 
@@ -81,12 +127,12 @@ bool EnclaveWasmModule::callFunction(uint32_t argcIn, char** argvIn)
     uint32_t returnValue = argv[0];
 
     if (success) {
-        ocallLogDebug("Success calling WASM function");
+        sgx::logDebug("Success calling WASM function");
     } else {
         std::string errorMessage(wasm_runtime_get_exception(moduleInstance));
         std::string errorText =
           "Caught WASM runtime exception: " + errorMessage;
-        ocallLogError(errorText.c_str());
+        sgx::logError(errorText.c_str());
     }
 
     return success;
@@ -108,6 +154,8 @@ void EnclaveWasmModule::prepareArgcArgv(uint32_t argcIn, char** argvIn)
         argvBufferSize += strlen(argvIn[i]) + 1;
         argv.at(i) = std::string(argvIn[i]);
     }
+
+    argvArray = wasm::StringArray(argv);
 }
 
 uint32_t EnclaveWasmModule::getArgc()
@@ -120,6 +168,178 @@ std::vector<std::string> EnclaveWasmModule::getArgv()
     return argv;
 }
 
+const wasm::StringArray& EnclaveWasmModule::getArgvArray() const
+{
+    return argvArray;
+}
+
+static AOTMemoryInstance* getAotMemory(WASMModuleInstanceCommon* instance)
+{
+    auto* aotModule = reinterpret_cast<AOTModuleInstance*>(instance);
+    return ((AOTMemoryInstance**)aotModule->memories)[0];
+}
+
+size_t EnclaveWasmModule::getMemorySizeBytes()
+{
+    AOTMemoryInstance* aotMem = getAotMemory(moduleInstance);
+    return (size_t)aotMem->cur_page_count * aotMem->num_bytes_per_page;
+}
+
+size_t EnclaveWasmModule::getMaxMemoryPages()
+{
+    return getAotMemory(moduleInstance)->max_page_count;
+}
+
+int32_t EnclaveWasmModule::growMemory(size_t nBytes)
+{
+    AOTMemoryInstance* aotMem = getAotMemory(moduleInstance);
+    size_t oldBytes = getMemorySizeBytes();
+
+    size_t pageBytes = aotMem->num_bytes_per_page;
+    uint32_t nPages = (nBytes + pageBytes - 1) / pageBytes;
+    auto* aotModule = reinterpret_cast<AOTModuleInstance*>(moduleInstance);
+    if (nPages > 0 && !aot_enlarge_memory(aotModule, nPages)) {
+        sgx::logError("Failed to grow enclave module memory");
+        return -1;
+    }
+
+    return (int32_t)oldBytes;
+}
+
+static uint32_t getGlobalDataSize(WASMModuleInstanceCommon* instance)
+{
+    return reinterpret_cast<AOTModuleInstance*>(instance)->global_data_size;
+}
+
+size_t EnclaveWasmModule::getSealedSnapshotSize()
+{
+    const std::string& funcStr = loaded->getFuncStr();
+    uint32_t memSize =
+      sgx_calc_sealed_data_size(funcStr.size(), getMemorySizeBytes());
+    uint32_t globalsSize =
+      sgx_calc_sealed_data_size(0, getGlobalDataSize(moduleInstance));
+
+    if (memSize == UINT32_MAX || globalsSize == UINT32_MAX) {
+        return 0;
+    }
+
+    return (size_t)memSize + globalsSize;
+}
+
+bool EnclaveWasmModule::exportSealedSnapshot(uint8_t* buffer,
+                                             size_t bufferSize)
+{
+    size_t snapshotSize = getSealedSnapshotSize();
+    if (snapshotSize == 0 || bufferSize != snapshotSize) {
+        sgx::logError("Wrong buffer size for sealed snapshot");
+        return false;
+    }
+
+    // Memory is sealed straight from the instance, with the function as
+    // authenticated but unencrypted text
+    const std::string& funcStr = loaded->getFuncStr();
+    size_t memBytes = getMemorySizeBytes();
+    uint32_t memSealedSize =
+      sgx_calc_sealed_data_size(funcStr.size(), memBytes);
+    sgx_status_t status =
+      sgx_seal_data(funcStr.size(),
+                    (const uint8_t*)funcStr.data(),
+                    memBytes,
+                    (uint8_t*)getAotMemory(moduleInstance)->memory_data,
+                    memSealedSize,
+                    (sgx_sealed_data_t*)buffer);
+    if (status != SGX_SUCCESS) {
+        sgx::logError("Failed to seal memory");
+        return false;
+    }
+
+    auto* aotModule = reinterpret_cast<AOTModuleInstance*>(moduleInstance);
+    status = sgx_seal_data(0,
+                           nullptr,
+                           aotModule->global_data_size,
+                           (uint8_t*)aotModule->global_data,
+                           bufferSize - memSealedSize,
+                           (sgx_sealed_data_t*)(buffer + memSealedSize));
+    if (status != SGX_SUCCESS) {
+        sgx::logError("Failed to seal globals");
+        return false;
+    }
+
+    return true;
+}
+
+bool EnclaveWasmModule::importSealedSnapshot(const uint8_t* buffer,
+                                             size_t bufferSize)
+{
+    auto* sealedMem = (const sgx_sealed_data_t*)buffer;
+    if (bufferSize < sizeof(sgx_sealed_data_t)) {
+        sgx::logError("Sealed snapshot too small");
+        return false;
+    }
+
+    const std::string& funcStr = loaded->getFuncStr();
+    uint32_t pageBytes = getAotMemory(moduleInstance)->num_bytes_per_page;
+    uint32_t macTextLen = sgx_get_add_mac_txt_len(sealedMem);
+    uint32_t memBytes = sgx_get_encrypt_txt_len(sealedMem);
+    if (macTextLen != funcStr.size() || memBytes % pageBytes != 0) {
+        sgx::logError("Sealed snapshot is not for this function");
+        return false;
+    }
+
+    uint32_t memSealedSize = sgx_calc_sealed_data_size(macTextLen, memBytes);
+    if (memSealedSize == UINT32_MAX || memSealedSize >= bufferSize) {
+        sgx::logError("Sealed snapshot truncated");
+        return false;
+    }
+
+    // Memory can only grow, so snapshots must be at least as big
+    size_t currentBytes = getMemorySizeBytes();
+    if (memBytes < currentBytes) {
+        sgx::logError("Sealed snapshot smaller than current memory");
+        return false;
+    }
+
+    auto* aotModule = reinterpret_cast<AOTModuleInstance*>(moduleInstance);
+    uint32_t pageChange = (memBytes - currentBytes) / pageBytes;
+    if (pageChange > 0 && !aot_enlarge_memory(aotModule, pageChange)) {
+        sgx::logError("Failed to grow memory for sealed snapshot");
+        return false;
+    }
+
+    // Unsealing checks the MAC before anything is written
+    std::string macText(macTextLen, '\0');
+    uint32_t unsealedMemBytes = memBytes;
+    sgx_status_t status =
+      sgx_unseal_data(sealedMem,
+                      (uint8_t*)macText.data(),
+                      &macTextLen,
+                      (uint8_t*)getAotMemory(moduleInstance)->memory_data,
+                      &unsealedMemBytes);
+    if (status != SGX_SUCCESS || macText != funcStr) {
+        sgx::logError("Failed to unseal memory");
+        return false;
+    }
+
+    auto* sealedGlobals = (const sgx_sealed_data_t*)(buffer + memSealedSize);
+    uint32_t globalsBytes = aotModule->global_data_size;
+    if (sgx_get_encrypt_txt_len(sealedGlobals) != globalsBytes) {
+        sgx::logError("Sealed globals don't match module");
+        return false;
+    }
+
+    status = sgx_unseal_data(sealedGlobals,
+                             nullptr,
+                             nullptr,
+                             (uint8_t*)aotModule->global_data,
+                             &globalsBytes);
+    if (status != SGX_SUCCESS) {
+        sgx::logError("Failed to unseal globals");
+        return false;
+    }
+
+    return true;
+}
+
 size_t EnclaveWasmModule::getArgvBufferSize()
 {
     return argvBufferSize;
@@ -140,7 +360,7 @@ std::shared_ptr<EnclaveWasmModule> getExecutingEnclaveWasmModule(
     // execution environment to any of the registered modules. This is a fatal
     // error, but we expect the caller to handle it, as throwing exceptions
     // is not supported.
-    ocallLogError("Can not find any registered module corresponding to the "
+    sgx::logError("Can not find any registered module corresponding to the "
                   "supplied execution environment, this is a fatal error");
 
     return nullptr;
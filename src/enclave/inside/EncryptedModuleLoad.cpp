@@ -0,0 +1,203 @@
+#include <enclave/inside/EncryptedModuleLoad.h>
+#include <enclave/inside/attestation.h>
+#include <enclave/inside/logging.h>
+
+#include <new>
+#include <string.h>
+
+namespace wasm {
+
+std::unordered_map<std::string, std::shared_ptr<EncryptedModuleLoad>>
+  encryptedModuleLoads;
+
+EncryptedModuleLoad::EncryptedModuleLoad(const std::string& funcStrIn)
+  : funcStr(funcStrIn)
+{
+    memset(&header, 0, sizeof(header));
+}
+
+EncryptedModuleLoad::~EncryptedModuleLoad()
+{
+    wipeKeys();
+}
+
+static void wipe(void* ptr, size_t size)
+{
+    // Unlike memset this can't be optimised away
+    memset_s(ptr, size, 0, size);
+}
+
+void EncryptedModuleLoad::wipeKeys()
+{
+    wipe(imageKey, sizeof(imageKey));
+    hasImageKey = false;
+}
+
+faasm_sgx_status_t EncryptedModuleLoad::begin(const uint8_t* headerBytes,
+                                              size_t headerSize)
+{
+    if (headerSize != sizeof(header)) {
+        sgx::logError("Encrypted module header has the wrong size");
+        return FAASM_SGX_INVALID_PAYLOAD_LEN;
+    }
+    memcpy(&header, headerBytes, sizeof(header));
+
+    bool validSizes = header.plainSize > 0 && header.plainSize <= UINT32_MAX &&
+                      header.chunkSize > 0 &&
+                      header.chunkSize <=
+                        FAASM_SGX_ENCRYPTED_MODULE_MAX_CHUNK_SIZE;
+    if (header.magic != FAASM_SGX_ENCRYPTED_MODULE_MAGIC || !validSizes ||
+        header.nChunks != (header.plainSize + header.chunkSize - 1) /
+                            header.chunkSize) {
+        sgx::logError("Invalid encrypted module header");
+        return FAASM_SGX_INVALID_PAYLOAD_LEN;
+    }
+
+    try {
+        image.reserve(header.plainSize);
+    } catch (std::bad_alloc&) {
+        sgx::logError("No room in the enclave for the module image");
+        return FAASM_SGX_OUT_OF_MEMORY;
+    }
+
+    return FAASM_SGX_SUCCESS;
+}
+
+faasm_sgx_status_t EncryptedModuleLoad::releaseKey(
+  const sgx_ec256_public_t* releaseKey,
+  const uint8_t* wrappedKeyBytes,
+  size_t wrappedKeySize)
+{
+    if (wrappedKeySize != sizeof(FaasmSgxWrappedModuleKey)) {
+        sgx::logError("Wrapped module key has the wrong size");
+        return FAASM_SGX_INVALID_PAYLOAD_LEN;
+    }
+
+    FaasmSgxWrappedModuleKey wrappedKey;
+    memcpy(&wrappedKey, wrappedKeyBytes, sizeof(wrappedKey));
+
+    sgx_ec256_dh_shared_t shared;
+    faasm_sgx_status_t returnValue =
+      sgx::computeAttestationSharedSecret(releaseKey, &shared);
+    if (returnValue != FAASM_SGX_SUCCESS) {
+        return returnValue;
+    }
+
+    // The key wrapping key is the hash of the shared secret and the function,
+    // so a key released for one function can't be used to load another
+    sgx_sha256_hash_t kekHash;
+    sgx_sha_state_handle_t shaHandle;
+    sgx_status_t status = sgx_sha256_init(&shaHandle);
+    if (status == SGX_SUCCESS) {
+        status = sgx_sha256_update(shared.s, sizeof(shared.s), shaHandle);
+    }
+    if (status == SGX_SUCCESS) {
+        status = sgx_sha256_update(
+          (const uint8_t*)funcStr.data(), funcStr.size(), shaHandle);
+    }
+    if (status == SGX_SUCCESS) {
+        status = sgx_sha256_get_hash(shaHandle, &kekHash);
+    }
+    sgx_sha256_close(shaHandle);
+    wipe(&shared, sizeof(shared));
+
+    if (status != SGX_SUCCESS) {
+        wipe(kekHash, sizeof(kekHash));
+        return FAASM_SGX_HASH_FAILED;
+    }
+
+    status = sgx_rijndael128GCM_decrypt(
+      (const sgx_aes_gcm_128bit_key_t*)kekHash,
+      wrappedKey.key,
+      sizeof(wrappedKey.key),
+      imageKey,
+      wrappedKey.iv,
+      sizeof(wrappedKey.iv),
+      (const uint8_t*)funcStr.data(),
+      funcStr.size(),
+      (const sgx_aes_gcm_128bit_tag_t*)wrappedKey.mac);
+    wipe(kekHash, sizeof(kekHash));
+
+    if (status != SGX_SUCCESS) {
+        sgx::logError("Error unwrapping module key");
+        wipeKeys();
+        return FAASM_SGX_DECRYPTION_FAILED;
+    }
+
+    hasImageKey = true;
+
+    return FAASM_SGX_SUCCESS;
+}
+
+faasm_sgx_status_t EncryptedModuleLoad::addChunk(const uint8_t* chunk,
+                                                 size_t chunkSize)
+{
+    if (!hasImageKey) {
+        sgx::logError("Module key not released before loading chunks");
+        return FAASM_SGX_MODULE_KEY_NOT_RELEASED;
+    }
+
+    if (nextChunk >= header.nChunks) {
+        sgx::logError("Too many encrypted module chunks");
+        return FAASM_SGX_INVALID_PAYLOAD_LEN;
+    }
+
+    size_t plainChunkSize = header.chunkSize;
+    if (nextChunk == header.nChunks - 1) {
+        plainChunkSize = header.plainSize - image.size();
+    }
+
+    if (chunkSize != plainChunkSize + FAASM_SGX_ENCRYPTED_MODULE_MAC_SIZE) {
+        sgx::logError("Encrypted module chunk has the wrong size");
+        return FAASM_SGX_INVALID_PAYLOAD_LEN;
+    }
+
+    // Add the chunk's index to the last four bytes of the base IV
+    uint8_t iv[FAASM_SGX_ENCRYPTED_MODULE_IV_SIZE];
+    memcpy(iv, header.baseIv, sizeof(iv));
+    uint32_t counter = ((uint32_t)iv[8] << 24) | ((uint32_t)iv[9] << 16) |
+                       ((uint32_t)iv[10] << 8) | (uint32_t)iv[11];
+    counter += nextChunk;
+    iv[8] = (uint8_t)(counter >> 24);
+    iv[9] = (uint8_t)(counter >> 16);
+    iv[10] = (uint8_t)(counter >> 8);
+    iv[11] = (uint8_t)counter;
+
+    // Decrypt in place at the end of the image, which was reserved up front
+    size_t offset = image.size();
+    image.resize(offset + plainChunkSize);
+    sgx_status_t status = sgx_rijndael128GCM_decrypt(
+      (const sgx_aes_gcm_128bit_key_t*)imageKey,
+      chunk,
+      plainChunkSize,
+      image.data() + offset,
+      iv,
+      sizeof(iv),
+      (const uint8_t*)&header,
+      sizeof(header),
+      (const sgx_aes_gcm_128bit_tag_t*)(chunk + plainChunkSize));
+
+    if (status != SGX_SUCCESS) {
+        sgx::logError("Error decrypting module chunk");
+        image.resize(offset);
+        return FAASM_SGX_DECRYPTION_FAILED;
+    }
+
+    nextChunk++;
+
+    return FAASM_SGX_SUCCESS;
+}
+
+faasm_sgx_status_t EncryptedModuleLoad::finish(std::vector<uint8_t>& imageOut)
+{
+    if (!hasImageKey || nextChunk != header.nChunks) {
+        sgx::logError("Encrypted module load finished early");
+        return FAASM_SGX_INVALID_PAYLOAD_LEN;
+    }
+
+    wipeKeys();
+    imageOut = std::move(image);
+
+    return FAASM_SGX_SUCCESS;
+}
+}
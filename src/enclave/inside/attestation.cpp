@@ -0,0 +1,84 @@
+#include <enclave/inside/attestation.h>
+#include <enclave/inside/logging.h>
+
+#include <mutex>
+
+namespace sgx {
+
+static std::mutex attestationKeyMx;
+
+static bool hasAttestationKey = false;
+static sgx_ec256_private_t attestationPrivateKey;
+static sgx_ec256_public_t attestationPublicKey;
+
+// Must hold the key mutex
+static faasm_sgx_status_t doGenerateAttestationKey()
+{
+    if (hasAttestationKey) {
+        return FAASM_SGX_SUCCESS;
+    }
+
+    sgx_ecc_state_handle_t eccHandle;
+    if (sgx_ecc256_open_context(&eccHandle) != SGX_SUCCESS) {
+        return FAASM_SGX_KEY_EXCHANGE_FAILED;
+    }
+
+    sgx_status_t status = sgx_ecc256_create_key_pair(
+      &attestationPrivateKey, &attestationPublicKey, eccHandle);
+    sgx_ecc256_close_context(eccHandle);
+    if (status != SGX_SUCCESS) {
+        logError("Error generating enclave attestation key pair");
+        return FAASM_SGX_KEY_EXCHANGE_FAILED;
+    }
+
+    hasAttestationKey = true;
+
+    return FAASM_SGX_SUCCESS;
+}
+
+faasm_sgx_status_t getAttestationPublicKey(sgx_ec256_public_t* publicKey)
+{
+    std::unique_lock<std::mutex> lock(attestationKeyMx);
+    faasm_sgx_status_t returnValue = doGenerateAttestationKey();
+    if (returnValue == FAASM_SGX_SUCCESS) {
+        *publicKey = attestationPublicKey;
+    }
+
+    return returnValue;
+}
+
+faasm_sgx_status_t computeAttestationSharedSecret(
+  const sgx_ec256_public_t* peerKey,
+  sgx_ec256_dh_shared_t* shared)
+{
+    std::unique_lock<std::mutex> lock(attestationKeyMx);
+    if (!hasAttestationKey) {
+        logError("Enclave has no attestation key yet");
+        return FAASM_SGX_KEY_EXCHANGE_FAILED;
+    }
+
+    sgx_ecc_state_handle_t eccHandle;
+    if (sgx_ecc256_open_context(&eccHandle) != SGX_SUCCESS) {
+        return FAASM_SGX_KEY_EXCHANGE_FAILED;
+    }
+
+    int validPoint = 0;
+    sgx_status_t status =
+      sgx_ecc256_check_point(peerKey, eccHandle, &validPoint);
+    if (status == SGX_SUCCESS && validPoint != 0) {
+        status = sgx_ecc256_compute_shared_dhkey(
+          &attestationPrivateKey,
+          const_cast<sgx_ec256_public_t*>(peerKey),
+          shared,
+          eccHandle);
+    }
+    sgx_ecc256_close_context(eccHandle);
+
+    if (status != SGX_SUCCESS || validPoint == 0) {
+        logError("Error computing secret shared with peer key");
+        return FAASM_SGX_KEY_EXCHANGE_FAILED;
+    }
+
+    return FAASM_SGX_SUCCESS;
+}
+}
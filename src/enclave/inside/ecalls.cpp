@@ -1,4 +1,7 @@
 #include <enclave/inside/EnclaveWasmModule.h>
+#include <enclave/inside/EncryptedModuleLoad.h>
+#include <enclave/inside/attestation.h>
+#include <enclave/inside/logging.h>
 #include <enclave/inside/native.h>
 #include <enclave/inside/ocalls.h>
 
@@ -8,6 +11,20 @@
 #include <sgx_trts.h>
 #include <sgx_utils.h>
 
+// Looks up a Faaslet's module, holding the lock only while doing so
+static std::shared_ptr<wasm::EnclaveWasmModule> getFaasletModule(
+  uint32_t faasletId)
+{
+    std::unique_lock<std::mutex> lock(wasm::moduleMapMutex);
+    auto it = wasm::moduleMap.find(faasletId);
+    if (it == wasm::moduleMap.end()) {
+        sgx::logError("Faaslet not bound to any module.");
+        return nullptr;
+    }
+
+    return it->second;
+}
+
 // Implementation of the ECalls API
 extern "C"
 {
@@ -30,10 +47,13 @@ extern "C"
 
     faasm_sgx_status_t ecallInitWamr(void)
     {
+        // Debug logs from this call go out in one batch at the end
+        sgx::DebugLogFlush flushLogs;
+
         // Initialise WAMR once for all modules
-        ocallLogDebug("Initialising WAMR runtime");
+        sgx::logDebug("Initialising WAMR runtime");
         if (!wasm::EnclaveWasmModule::initialiseWAMRGlobally()) {
-            ocallLogError("Error initialising WAMR globally");
+            sgx::logError("Error initialising WAMR globally");
             return FAASM_SGX_WAMR_RTE_INIT_FAILED;
         }
 
@@ -45,8 +65,10 @@ extern "C"
 
     faasm_sgx_status_t ecallLoadModule(void* wasmOpCodePtr,
                                        uint32_t wasmOpCodeSize,
-                                       uint32_t faasletId)
+                                       const char* funcStr)
     {
+        sgx::DebugLogFlush flushLogs;
+
         // Check if passed wasm opcode size or wasm opcode ptr is zero
         if (!wasmOpCodeSize) {
             return FAASM_SGX_INVALID_OPCODE_SIZE;
@@ -55,31 +77,201 @@ extern "C"
             return FAASM_SGX_INVALID_PTR;
         }
 
-        // Add module for faaslet to the module map
+        // Faaslets binding to the same function at once may both load it
+        std::unique_lock<std::mutex> lock(wasm::moduleMapMutex);
+        if (wasm::loadedModuleMap.find(funcStr) !=
+            wasm::loadedModuleMap.end()) {
+            return FAASM_SGX_SUCCESS;
+        }
+
+        auto loaded = std::make_shared<wasm::LoadedWasmModule>();
+        if (!loaded->load(wasmOpCodePtr, wasmOpCodeSize, funcStr)) {
+            sgx::logError("Error loading WASM to module");
+            return FAASM_SGX_WAMR_MODULE_LOAD_FAILED;
+        }
+
+        wasm::loadedModuleMap[funcStr] = loaded;
+
+        return FAASM_SGX_SUCCESS;
+    }
+
+    faasm_sgx_status_t ecallGetAttestationKey(sgx_ec256_public_t* publicKey)
+    {
+        sgx::DebugLogFlush flushLogs;
+
+        if (publicKey == nullptr) {
+            return FAASM_SGX_INVALID_PTR;
+        }
+
+        return sgx::getAttestationPublicKey(publicKey);
+    }
+
+    faasm_sgx_status_t ecallBeginModuleLoad(const char* funcStr,
+                                            const uint8_t* header,
+                                            size_t headerSize)
+    {
+        sgx::DebugLogFlush flushLogs;
+
+        if (header == nullptr) {
+            return FAASM_SGX_INVALID_PTR;
+        }
+
+        // Starting again drops any load of the function left unfinished
+        auto load = std::make_shared<wasm::EncryptedModuleLoad>(funcStr);
+        faasm_sgx_status_t returnValue = load->begin(header, headerSize);
+        if (returnValue != FAASM_SGX_SUCCESS) {
+            return returnValue;
+        }
+
+        std::unique_lock<std::mutex> lock(wasm::moduleMapMutex);
+        wasm::encryptedModuleLoads[funcStr] = load;
+
+        return FAASM_SGX_SUCCESS;
+    }
+
+    faasm_sgx_status_t ecallReleaseModuleKey(
+      const char* funcStr,
+      const sgx_ec256_public_t* releaseKey,
+      const uint8_t* wrappedKey,
+      size_t wrappedKeySize)
+    {
+        sgx::DebugLogFlush flushLogs;
+
+        if (releaseKey == nullptr || wrappedKey == nullptr) {
+            return FAASM_SGX_INVALID_PTR;
+        }
+
+        std::shared_ptr<wasm::EncryptedModuleLoad> load;
         {
             std::unique_lock<std::mutex> lock(wasm::moduleMapMutex);
-            if (wasm::moduleMap.find(faasletId) != wasm::moduleMap.end()) {
-                ocallLogError("Faaslet is already bound to a module.");
-                return FAASM_SGX_WAMR_MODULE_LOAD_FAILED;
+            auto it = wasm::encryptedModuleLoads.find(funcStr);
+            if (it == wasm::encryptedModuleLoads.end()) {
+                sgx::logError("No encrypted load started for function.");
+                return FAASM_SGX_MODULE_LOAD_NOT_STARTED;
             }
+            load = it->second;
+        }
 
-            wasm::moduleMap[faasletId] =
-              std::make_shared<wasm::EnclaveWasmModule>();
-            if (!wasm::moduleMap[faasletId]->loadWasm(wasmOpCodePtr,
-                                                      wasmOpCodeSize)) {
-                ocallLogError("Error loading WASM to module");
-                return FAASM_SGX_WAMR_MODULE_LOAD_FAILED;
+        return load->releaseKey(releaseKey, wrappedKey, wrappedKeySize);
+    }
+
+    faasm_sgx_status_t ecallLoadModuleChunk(const char* funcStr,
+                                            const uint8_t* chunk,
+                                            size_t chunkSize)
+    {
+        sgx::DebugLogFlush flushLogs;
+
+        if (chunk == nullptr) {
+            return FAASM_SGX_INVALID_PTR;
+        }
+
+        std::shared_ptr<wasm::EncryptedModuleLoad> load;
+        {
+            std::unique_lock<std::mutex> lock(wasm::moduleMapMutex);
+            auto it = wasm::encryptedModuleLoads.find(funcStr);
+            if (it == wasm::encryptedModuleLoads.end()) {
+                sgx::logError("No encrypted load started for function.");
+                return FAASM_SGX_MODULE_LOAD_NOT_STARTED;
             }
+            load = it->second;
+        }
+
+        return load->addChunk(chunk, chunkSize);
+    }
+
+    faasm_sgx_status_t ecallEndModuleLoad(const char* funcStr, bool abort)
+    {
+        sgx::DebugLogFlush flushLogs;
+
+        std::unique_lock<std::mutex> lock(wasm::moduleMapMutex);
+        auto it = wasm::encryptedModuleLoads.find(funcStr);
+        if (it == wasm::encryptedModuleLoads.end()) {
+            sgx::logError("No encrypted load started for function.");
+            return FAASM_SGX_MODULE_LOAD_NOT_STARTED;
+        }
+
+        std::shared_ptr<wasm::EncryptedModuleLoad> load = it->second;
+        wasm::encryptedModuleLoads.erase(it);
+        if (abort) {
+            return FAASM_SGX_SUCCESS;
+        }
+
+        std::vector<uint8_t> image;
+        faasm_sgx_status_t returnValue = load->finish(image);
+        if (returnValue != FAASM_SGX_SUCCESS) {
+            return returnValue;
+        }
+
+        // Another Faaslet may have loaded the function in the meantime
+        if (wasm::loadedModuleMap.find(funcStr) !=
+            wasm::loadedModuleMap.end()) {
+            return FAASM_SGX_SUCCESS;
+        }
+
+        auto loaded = std::make_shared<wasm::LoadedWasmModule>();
+        if (!loaded->load(std::move(image), funcStr)) {
+            sgx::logError("Error loading decrypted WASM to module");
+            return FAASM_SGX_WAMR_MODULE_LOAD_FAILED;
         }
 
+        wasm::loadedModuleMap[funcStr] = loaded;
+
         return FAASM_SGX_SUCCESS;
     }
 
-    faasm_sgx_status_t ecallUnloadModule(uint32_t faasletId)
+    faasm_sgx_status_t ecallUnloadModule(const char* funcStr)
     {
+        sgx::DebugLogFlush flushLogs;
+
+        std::unique_lock<std::mutex> lock(wasm::moduleMapMutex);
+        if (wasm::loadedModuleMap.find(funcStr) ==
+            wasm::loadedModuleMap.end()) {
+            sgx::logError("Function not loaded into enclave.");
+            return FAASM_SGX_MODULE_NOT_LOADED;
+        }
+
+        // Any remaining instances keep the module until they're gone
+        wasm::loadedModuleMap.erase(funcStr);
+
+        return FAASM_SGX_SUCCESS;
+    }
+
+    faasm_sgx_status_t ecallInstantiateModule(const char* funcStr,
+                                              uint32_t faasletId)
+    {
+        sgx::DebugLogFlush flushLogs;
+
+        std::unique_lock<std::mutex> lock(wasm::moduleMapMutex);
+        if (wasm::moduleMap.find(faasletId) != wasm::moduleMap.end()) {
+            sgx::logError("Faaslet is already bound to a module.");
+            return FAASM_SGX_WAMR_MODULE_INSTANTIATION_FAILED;
+        }
+
+        auto loadedIt = wasm::loadedModuleMap.find(funcStr);
+        if (loadedIt == wasm::loadedModuleMap.end()) {
+            sgx::logError("Function not loaded into enclave.");
+            return FAASM_SGX_MODULE_NOT_LOADED;
+        }
+
+        auto module =
+          std::make_shared<wasm::EnclaveWasmModule>(loadedIt->second);
+        if (!module->instantiate()) {
+            sgx::logError("Error instantiating WASM module");
+            return FAASM_SGX_WAMR_MODULE_INSTANTIATION_FAILED;
+        }
+
+        wasm::moduleMap[faasletId] = module;
+
+        return FAASM_SGX_SUCCESS;
+    }
+
+    faasm_sgx_status_t ecallDeinstantiateModule(uint32_t faasletId)
+    {
+        sgx::DebugLogFlush flushLogs;
+
         std::unique_lock<std::mutex> lock(wasm::moduleMapMutex);
         if (wasm::moduleMap.find(faasletId) == wasm::moduleMap.end()) {
-            ocallLogError("Faaslet not bound to any module.");
+            sgx::logError("Faaslet not bound to any module.");
             return FAASM_SGX_WAMR_MODULE_NOT_BOUND;
         }
 
@@ -89,17 +281,93 @@ extern "C"
         return FAASM_SGX_SUCCESS;
     }
 
+    faasm_sgx_status_t ecallResetModule(uint32_t faasletId)
+    {
+        sgx::DebugLogFlush flushLogs;
+
+        std::unique_lock<std::mutex> lock(wasm::moduleMapMutex);
+        auto it = wasm::moduleMap.find(faasletId);
+        if (it == wasm::moduleMap.end()) {
+            sgx::logError("Faaslet not bound to any module.");
+            return FAASM_SGX_WAMR_MODULE_NOT_BOUND;
+        }
+
+        if (!it->second->reset()) {
+            sgx::logError("Error re-instantiating WASM module");
+            return FAASM_SGX_WAMR_MODULE_INSTANTIATION_FAILED;
+        }
+
+        return FAASM_SGX_SUCCESS;
+    }
+
+    faasm_sgx_status_t ecallGetMemoryInfo(uint32_t faasletId,
+                                          size_t* sizeBytes,
+                                          size_t* maxPages,
+                                          size_t* sealedSnapshotBytes)
+    {
+        sgx::DebugLogFlush flushLogs;
+
+        auto module = getFaasletModule(faasletId);
+        if (module == nullptr) {
+            return FAASM_SGX_WAMR_MODULE_NOT_BOUND;
+        }
+
+        *sizeBytes = module->getMemorySizeBytes();
+        *maxPages = module->getMaxMemoryPages();
+        *sealedSnapshotBytes = module->getSealedSnapshotSize();
+
+        return FAASM_SGX_SUCCESS;
+    }
+
+    faasm_sgx_status_t ecallExportSnapshot(uint32_t faasletId,
+                                           uint8_t* buffer,
+                                           size_t bufferSize)
+    {
+        sgx::DebugLogFlush flushLogs;
+
+        auto module = getFaasletModule(faasletId);
+        if (module == nullptr) {
+            return FAASM_SGX_WAMR_MODULE_NOT_BOUND;
+        }
+
+        if (!module->exportSealedSnapshot(buffer, bufferSize)) {
+            return FAASM_SGX_ENCRYPTION_FAILED;
+        }
+
+        return FAASM_SGX_SUCCESS;
+    }
+
+    faasm_sgx_status_t ecallImportSnapshot(uint32_t faasletId,
+                                           const uint8_t* buffer,
+                                           size_t bufferSize)
+    {
+        sgx::DebugLogFlush flushLogs;
+
+        auto module = getFaasletModule(faasletId);
+        if (module == nullptr) {
+            return FAASM_SGX_WAMR_MODULE_NOT_BOUND;
+        }
+
+        if (!module->importSealedSnapshot(buffer, bufferSize)) {
+            return FAASM_SGX_DECRYPTION_FAILED;
+        }
+
+        return FAASM_SGX_SUCCESS;
+    }
+
     faasm_sgx_status_t ecallCallFunction(uint32_t faasletId,
                                          uint32_t argc,
                                          char** argv)
     {
+        sgx::DebugLogFlush flushLogs;
+
         std::shared_ptr<wasm::EnclaveWasmModule> module = nullptr;
 
         // Acquire a lock just to get the module
         {
             std::unique_lock<std::mutex> lock(wasm::moduleMapMutex);
             if (wasm::moduleMap.find(faasletId) == wasm::moduleMap.end()) {
-                ocallLogError("Faaslet not bound to any module.");
+                sgx::logError("Faaslet not bound to any module.");
                 return FAASM_SGX_WAMR_MODULE_NOT_BOUND;
             }
 
@@ -109,7 +377,7 @@ extern "C"
         // Call the function without a lock on the module map, to allow for
         // chaining on the same enclave
         if (!module->callFunction(argc, argv)) {
-            ocallLogError("Error trying to call function");
+            sgx::logError("Error trying to call function");
             return FAASM_SGX_WAMR_FUNCTION_UNABLE_TO_CALL;
         }
 
@@ -0,0 +1,173 @@
+#include <enclave/inside/edmm.h>
+#include <enclave/inside/logging.h>
+
+#include <sgx_mm.h>
+#include <tlibc/stdlib.h>
+#include <tlibc/string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#define EDMM_PAGE_BYTES 4096
+
+namespace sgx {
+
+enum EdmmSupport
+{
+    EDMM_UNKNOWN,
+    EDMM_SUPPORTED,
+    EDMM_UNSUPPORTED,
+};
+
+static std::atomic<int> edmmSupport(EDMM_UNKNOWN);
+
+// Each region's reserved length, and how much of it was asked for
+struct EdmmRegion
+{
+    size_t length;
+    size_t size;
+};
+
+static std::mutex regionsMx;
+static std::unordered_map<void*, EdmmRegion> regions;
+static size_t regionBytes = 0;
+
+bool isEdmmAvailable()
+{
+    return edmmSupport.load() != EDMM_UNSUPPORTED;
+}
+
+// Null if EDMM isn't available, in which case the caller uses the heap
+static void* allocRegion(size_t size)
+{
+    if (edmmSupport.load() == EDMM_UNSUPPORTED) {
+        return nullptr;
+    }
+
+    // Twice the size is reserved, so that growing memory a bit at a time
+    // rarely has to move it. Pages that aren't touched aren't committed.
+    size_t length =
+      (2 * size + EDMM_PAGE_BYTES - 1) / EDMM_PAGE_BYTES * EDMM_PAGE_BYTES;
+
+    void* addr = nullptr;
+    int res = sgx_mm_alloc(
+      nullptr, length, SGX_EMA_COMMIT_ON_DEMAND, nullptr, nullptr, &addr);
+    if (res != 0) {
+        // The first failure is taken to mean the CPU or SDK doesn't have it,
+        // later ones that the user range is full
+        int expected = EDMM_UNKNOWN;
+        if (edmmSupport.compare_exchange_strong(expected, EDMM_UNSUPPORTED)) {
+            logDebug("EDMM not available, enclave memory comes from the heap");
+        } else {
+            std::string msg =
+              "Failed to allocate EDMM region: " + std::to_string(res);
+            logError(msg.c_str());
+        }
+
+        return nullptr;
+    }
+
+    edmmSupport.store(EDMM_SUPPORTED);
+
+    EdmmRegion region = { length, size };
+
+    std::unique_lock<std::mutex> lock(regionsMx);
+    regions[addr] = region;
+    regionBytes += length;
+
+    return addr;
+}
+
+// Returns false if it isn't a region
+static bool getRegion(void* ptr, EdmmRegion& region)
+{
+    std::unique_lock<std::mutex> lock(regionsMx);
+    std::unordered_map<void*, EdmmRegion>::iterator it = regions.find(ptr);
+    if (it == regions.end()) {
+        return false;
+    }
+
+    region = it->second;
+    return true;
+}
+
+static void freeRegion(void* ptr, size_t length)
+{
+    {
+        std::unique_lock<std::mutex> lock(regionsMx);
+        regions.erase(ptr);
+        regionBytes -= length;
+    }
+
+    // Gives the committed pages back to the EPC
+    if (sgx_mm_dealloc(ptr, length) != 0) {
+        logError("Failed to free EDMM region");
+    }
+}
+
+void* edmmMalloc(unsigned int size)
+{
+    if (size >= EDMM_REGION_MIN_BYTES) {
+        void* addr = allocRegion(size);
+        if (addr != nullptr) {
+            return addr;
+        }
+    }
+
+    return malloc(size);
+}
+
+void* edmmRealloc(void* ptr, unsigned int size)
+{
+    if (ptr == nullptr) {
+        return edmmMalloc(size);
+    }
+
+    // Heap allocations stay on the heap, as we don't know how big they are
+    EdmmRegion region;
+    if (!getRegion(ptr, region)) {
+        return realloc(ptr, size);
+    }
+
+    if (size <= region.length) {
+        std::unique_lock<std::mutex> lock(regionsMx);
+        regions[ptr].size = std::max<size_t>(region.size, size);
+        return ptr;
+    }
+
+    void* addr = allocRegion(size);
+    if (addr == nullptr) {
+        return nullptr;
+    }
+
+    // Only what was asked for is copied, as reading the rest would commit it
+    memcpy(addr, ptr, region.size);
+    freeRegion(ptr, region.length);
+
+    return addr;
+}
+
+void edmmFree(void* ptr)
+{
+    if (ptr == nullptr) {
+        return;
+    }
+
+    EdmmRegion region;
+    if (!getRegion(ptr, region)) {
+        free(ptr);
+        return;
+    }
+
+    freeRegion(ptr, region.length);
+}
+
+size_t getEdmmRegionBytes()
+{
+    std::unique_lock<std::mutex> lock(regionsMx);
+    return regionBytes;
+}
+}
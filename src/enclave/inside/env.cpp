@@ -9,7 +9,7 @@ static int wasi_args_get(wasm_exec_env_t execEnv,
                          uint32_t* argvOffsetsWasm,
                          char* argvBuffWasm)
 {
-    ocallLogDebug("S - wasi_args_get");
+    logDebug("S - wasi_args_get");
 
     GET_EXECUTING_MODULE_AND_CHECK(execEnv);
 
@@ -22,7 +22,7 @@ static int wasi_args_sizes_get(wasm_exec_env_t execEnv,
                                uint32_t* argcWasm,
                                uint32_t* argvBuffSizeWasm)
 {
-    ocallLogDebug("S - wasi_args_sizes_get");
+    logDebug("S - wasi_args_sizes_get");
 
     GET_EXECUTING_MODULE_AND_CHECK(execEnv);
 
@@ -78,6 +78,32 @@ static unsigned int faasm_await_call_output_wrapper(wasm_exec_env_t execEnv,
     return returnValue;
 }
 
+static uint64_t faasm_timer_nanos_wrapper(wasm_exec_env_t execEnv)
+{
+    sgx_status_t sgxReturnValue;
+    uint64_t returnValue = 0;
+    if ((sgxReturnValue = ocallFaasmTimerNanos(&returnValue)) != SGX_SUCCESS) {
+        SET_ERROR(FAASM_SGX_OCALL_ERROR(sgxReturnValue));
+    }
+    return returnValue;
+}
+
+static double omp_get_wtime_wrapper(wasm_exec_env_t execEnv)
+{
+    return ((double)faasm_timer_nanos_wrapper(execEnv)) / 1e9;
+}
+
+static double omp_get_wtick_wrapper(wasm_exec_env_t execEnv)
+{
+    sgx_status_t sgxReturnValue;
+    uint64_t returnValue = 0;
+    if ((sgxReturnValue = ocallFaasmTimerResolutionNanos(&returnValue)) !=
+        SGX_SUCCESS) {
+        SET_ERROR(FAASM_SGX_OCALL_ERROR(sgxReturnValue));
+    }
+    return ((double)returnValue) / 1e9;
+}
+
 static NativeSymbol ns[] = {
     REG_FAASM_NATIVE_FUNC(faasm_read_input, "($i)i"),
     REG_FAASM_NATIVE_FUNC(faasm_write_output, "($i)"),
@@ -85,6 +111,9 @@ static NativeSymbol ns[] = {
     REG_FAASM_NATIVE_FUNC(faasm_chain_ptr, "(*$i)i"),
     REG_FAASM_NATIVE_FUNC(faasm_await_call, "(i)i"),
     REG_FAASM_NATIVE_FUNC(faasm_await_call_output, "(i)i"),
+    REG_FAASM_NATIVE_FUNC(faasm_timer_nanos, "()I"),
+    REG_NATIVE_FUNC(omp_get_wtick, "()F"),
+    REG_NATIVE_FUNC(omp_get_wtime, "()F"),
 };
 
 uint32_t getFaasmFunctionsApi(NativeSymbol** nativeSymbols)
@@ -0,0 +1,51 @@
+#include <enclave/inside/logging.h>
+#include <enclave/inside/ocalls.h>
+
+#include <cstring>
+#include <mutex>
+#include <string>
+
+namespace sgx {
+
+static std::mutex logMx;
+
+// Messages separated by newlines
+static std::string debugLogs;
+
+static void doFlushDebugLogs()
+{
+    if (debugLogs.empty()) {
+        return;
+    }
+
+    ocallLogDebugBatch(debugLogs.c_str(), debugLogs.size());
+    debugLogs.clear();
+}
+
+void logDebug(const char* msg)
+{
+// Debug logging is disabled along with the debug OCALL it replaced
+#ifndef FAASM_SGX_DEBUG
+    std::unique_lock<std::mutex> lock(logMx);
+    if (debugLogs.size() + strlen(msg) + 1 > FAASM_SGX_LOG_BATCH_BYTES) {
+        doFlushDebugLogs();
+    }
+
+    debugLogs.append(msg);
+    debugLogs.push_back('\n');
+#endif
+}
+
+void logError(const char* msg)
+{
+    std::unique_lock<std::mutex> lock(logMx);
+    doFlushDebugLogs();
+    ocallLogError(msg);
+}
+
+void flushDebugLogs()
+{
+    std::unique_lock<std::mutex> lock(logMx);
+    doFlushDebugLogs();
+}
+}
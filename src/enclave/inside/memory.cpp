@@ -1,16 +1,24 @@
+#include <enclave/inside/EnclaveWasmModule.h>
 #include <enclave/inside/native.h>
 
 namespace sgx {
+// Memory is grown inside the enclave, rather than asking the host, and only
+// committed as it's touched (see edmm.h). As with the host's sbrk, memory is
+// never given back by shrinking, but is when the module is reset.
 static int32_t __sbrk_wrapper(wasm_exec_env_t execEnv, int32_t increment)
 {
-    int32_t returnValue;
-    sgx_status_t sgxReturnValue;
+    std::shared_ptr<wasm::EnclaveWasmModule> module =
+      wasm::getExecutingEnclaveWasmModule(execEnv);
+    if (module == nullptr) {
+        logError("Error linking execution environment to registered modules");
+        return -1;
+    }
 
-    if ((sgxReturnValue = ocallSbrk(&returnValue, increment)) != SGX_SUCCESS) {
-        SET_ERROR(FAASM_SGX_OCALL_ERROR(sgxReturnValue));
+    if (increment <= 0) {
+        return (int32_t)module->getMemorySizeBytes();
     }
 
-    return returnValue;
+    return module->growMemory(increment);
 }
 
 static NativeSymbol ns[] = {
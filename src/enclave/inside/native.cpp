@@ -19,7 +19,9 @@ void initialiseSGXWAMRNatives()
 {
     doNativeSymbolRegistration(getFaasmFunctionsApi);
     doNativeSymbolRegistration(getFaasmMemoryApi);
+    doNativeSymbolRegistration(getFaasmOpenMPApi);
     doNativeSymbolRegistration(getFaasmPthreadApi);
+    doNativeSymbolRegistration(getFaasmStateApi);
 
     doWasiSymbolRegistration(getFaasmWasiEnvApi);
     doWasiSymbolRegistration(getFaasmWasiFilesystemApi);
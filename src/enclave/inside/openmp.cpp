@@ -0,0 +1,245 @@
+#include <enclave/inside/native.h>
+
+#include <vector>
+
+/*
+ * There's no scheduler inside the enclave, so OpenMP code runs on a single
+ * thread: every team has one thread, which runs the microtask inline, and
+ * synchronisation is a no-op.
+ */
+namespace sgx {
+
+// Depth of the parallel section being executed
+static int ompDepth = 0;
+
+static int32_t omp_get_thread_num_wrapper(wasm_exec_env_t execEnv)
+{
+    return 0;
+}
+
+static int32_t omp_get_num_threads_wrapper(wasm_exec_env_t execEnv)
+{
+    return 1;
+}
+
+static int32_t omp_get_max_threads_wrapper(wasm_exec_env_t execEnv)
+{
+    return 1;
+}
+
+static int32_t omp_get_level_wrapper(wasm_exec_env_t execEnv)
+{
+    return ompDepth;
+}
+
+static void omp_set_num_threads_wrapper(wasm_exec_env_t execEnv,
+                                        int32_t numThreads)
+{}
+
+static void __kmpc_push_num_threads_wrapper(wasm_exec_env_t execEnv,
+                                            int32_t loc,
+                                            int32_t globalTid,
+                                            int32_t numThreads)
+{}
+
+static int32_t __kmpc_global_thread_num_wrapper(wasm_exec_env_t execEnv,
+                                                int32_t loc)
+{
+    return 0;
+}
+
+static void __kmpc_barrier_wrapper(wasm_exec_env_t execEnv,
+                                   int32_t loc,
+                                   int32_t globalTid)
+{}
+
+static void __kmpc_critical_wrapper(wasm_exec_env_t execEnv,
+                                    int32_t loc,
+                                    int32_t globalTid,
+                                    int32_t crit)
+{}
+
+static void __kmpc_end_critical_wrapper(wasm_exec_env_t execEnv,
+                                        int32_t loc,
+                                        int32_t globalTid,
+                                        int32_t crit)
+{}
+
+static void __kmpc_flush_wrapper(wasm_exec_env_t execEnv, int32_t loc)
+{
+    __sync_synchronize();
+}
+
+static int32_t __kmpc_master_wrapper(wasm_exec_env_t execEnv,
+                                     int32_t loc,
+                                     int32_t globalTid)
+{
+    return 1;
+}
+
+static void __kmpc_end_master_wrapper(wasm_exec_env_t execEnv,
+                                      int32_t loc,
+                                      int32_t globalTid)
+{}
+
+static int32_t __kmpc_single_wrapper(wasm_exec_env_t execEnv,
+                                     int32_t loc,
+                                     int32_t globalTid)
+{
+    return 1;
+}
+
+static void __kmpc_end_single_wrapper(wasm_exec_env_t execEnv,
+                                      int32_t loc,
+                                      int32_t globalTid)
+{}
+
+static void __kmpc_fork_call_wrapper(wasm_exec_env_t execEnv,
+                                     int32_t locPtr,
+                                     int32_t nSharedVars,
+                                     int32_t microtaskPtr,
+                                     int32_t sharedVarPtrs)
+{
+    wasm_module_inst_t moduleInst = wasm_runtime_get_module_inst(execEnv);
+
+    std::vector<uint32_t> argv = { 0, (uint32_t)nSharedVars };
+    if (nSharedVars > 0) {
+        if (!wasm_runtime_validate_app_addr(
+              moduleInst, sharedVarPtrs, nSharedVars * sizeof(uint32_t))) {
+            SET_ERROR(FAASM_SGX_INVALID_PTR);
+            return;
+        }
+
+        auto* sharedVars = reinterpret_cast<uint32_t*>(
+          wasm_runtime_addr_app_to_native(moduleInst, sharedVarPtrs));
+        argv.insert(argv.end(), sharedVars, sharedVars + nSharedVars);
+    }
+
+    ompDepth++;
+    bool success = wasm_runtime_call_indirect(
+      execEnv, microtaskPtr, argv.size(), argv.data());
+    ompDepth--;
+
+    if (!success) {
+        SET_ERROR(FAASM_SGX_WAMR_FUNCTION_UNABLE_TO_CALL);
+    }
+}
+
+// With a single thread, each loop is run in one go
+template<typename T>
+static void for_static_init(int32_t* lastIter,
+                            T* lower,
+                            T* upper,
+                            T* stride,
+                            T incr)
+{
+    *lastIter = 1;
+
+    if (incr > 0) {
+        *stride = *upper - *lower + 1;
+    } else {
+        *stride = -(*lower - *upper + 1);
+    }
+}
+
+static void __kmpc_for_static_init_4_wrapper(wasm_exec_env_t execEnv,
+                                             int32_t loc,
+                                             int32_t gtid,
+                                             int32_t schedule,
+                                             int32_t* lastIter,
+                                             int32_t* lower,
+                                             int32_t* upper,
+                                             int32_t* stride,
+                                             int32_t incr,
+                                             int32_t chunk)
+{
+    for_static_init<int32_t>(lastIter, lower, upper, stride, incr);
+}
+
+static void __kmpc_for_static_init_8_wrapper(wasm_exec_env_t execEnv,
+                                             int32_t loc,
+                                             int32_t gtid,
+                                             int32_t schedule,
+                                             int32_t* lastIter,
+                                             int64_t* lower,
+                                             int64_t* upper,
+                                             int64_t* stride,
+                                             int64_t incr,
+                                             int64_t chunk)
+{
+    for_static_init<int64_t>(lastIter, lower, upper, stride, incr);
+}
+
+static void __kmpc_for_static_fini_wrapper(wasm_exec_env_t execEnv,
+                                           int32_t loc,
+                                           int32_t gtid)
+{}
+
+static int32_t __kmpc_reduce_wrapper(wasm_exec_env_t execEnv,
+                                     int32_t loc,
+                                     int32_t gtid,
+                                     int32_t numReduceVars,
+                                     int32_t reduceVarsSize,
+                                     int32_t reduceVarPtrs,
+                                     int32_t reduceFunc,
+                                     int32_t lockPtr)
+{
+    return 1;
+}
+
+static int32_t __kmpc_reduce_nowait_wrapper(wasm_exec_env_t execEnv,
+                                            int32_t loc,
+                                            int32_t gtid,
+                                            int32_t numReduceVars,
+                                            int32_t reduceVarsSize,
+                                            int32_t reduceVarPtrs,
+                                            int32_t reduceFunc,
+                                            int32_t lockPtr)
+{
+    return 1;
+}
+
+static void __kmpc_end_reduce_wrapper(wasm_exec_env_t execEnv,
+                                      int32_t loc,
+                                      int32_t gtid,
+                                      int32_t lck)
+{}
+
+static void __kmpc_end_reduce_nowait_wrapper(wasm_exec_env_t execEnv,
+                                             int32_t loc,
+                                             int32_t gtid,
+                                             int32_t lck)
+{}
+
+static NativeSymbol ns[] = {
+    REG_NATIVE_FUNC(omp_get_thread_num, "()i"),
+    REG_NATIVE_FUNC(omp_get_num_threads, "()i"),
+    REG_NATIVE_FUNC(omp_get_max_threads, "()i"),
+    REG_NATIVE_FUNC(omp_get_level, "()i"),
+    REG_NATIVE_FUNC(omp_set_num_threads, "(i)"),
+    REG_NATIVE_FUNC(__kmpc_push_num_threads, "(iii)"),
+    REG_NATIVE_FUNC(__kmpc_global_thread_num, "(i)i"),
+    REG_NATIVE_FUNC(__kmpc_barrier, "(ii)"),
+    REG_NATIVE_FUNC(__kmpc_critical, "(iii)"),
+    REG_NATIVE_FUNC(__kmpc_end_critical, "(iii)"),
+    REG_NATIVE_FUNC(__kmpc_flush, "(i)"),
+    REG_NATIVE_FUNC(__kmpc_master, "(ii)i"),
+    REG_NATIVE_FUNC(__kmpc_end_master, "(ii)"),
+    REG_NATIVE_FUNC(__kmpc_single, "(ii)i"),
+    REG_NATIVE_FUNC(__kmpc_end_single, "(ii)"),
+    REG_NATIVE_FUNC(__kmpc_fork_call, "(iiii)"),
+    REG_NATIVE_FUNC(__kmpc_for_static_init_4, "(iii****ii)"),
+    REG_NATIVE_FUNC(__kmpc_for_static_init_8, "(iii****II)"),
+    REG_NATIVE_FUNC(__kmpc_for_static_fini, "(ii)"),
+    REG_NATIVE_FUNC(__kmpc_reduce, "(iiiiiii)i"),
+    REG_NATIVE_FUNC(__kmpc_reduce_nowait, "(iiiiiii)i"),
+    REG_NATIVE_FUNC(__kmpc_end_reduce, "(iii)"),
+    REG_NATIVE_FUNC(__kmpc_end_reduce_nowait, "(iii)"),
+};
+
+uint32_t getFaasmOpenMPApi(NativeSymbol** nativeSymbols)
+{
+    *nativeSymbols = ns;
+    return sizeof(ns) / sizeof(NativeSymbol);
+}
+}
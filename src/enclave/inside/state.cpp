@@ -0,0 +1,151 @@
+#include <enclave/inside/native.h>
+
+namespace sgx {
+static int32_t faasm_read_state_wrapper(wasm_exec_env_t execEnv,
+                                        const char* key,
+                                        uint8_t* buffer,
+                                        unsigned int bufferLen)
+{
+    sgx_status_t sgxReturnValue;
+    unsigned int returnValue = 0;
+    if ((sgxReturnValue = ocallFaasmReadState(
+           &returnValue, key, buffer, bufferLen)) != SGX_SUCCESS) {
+        SET_ERROR(FAASM_SGX_OCALL_ERROR(sgxReturnValue));
+    }
+    return (int32_t)returnValue;
+}
+
+static void faasm_write_state_wrapper(wasm_exec_env_t execEnv,
+                                      const char* key,
+                                      uint8_t* buffer,
+                                      unsigned int bufferLen)
+{
+    sgx_status_t sgxReturnValue;
+    if ((sgxReturnValue = ocallFaasmWriteState(key, buffer, bufferLen)) !=
+        SGX_SUCCESS) {
+        SET_ERROR(FAASM_SGX_OCALL_ERROR(sgxReturnValue));
+    }
+}
+
+static void faasm_read_state_offset_wrapper(wasm_exec_env_t execEnv,
+                                            const char* key,
+                                            unsigned int totalLen,
+                                            unsigned int offset,
+                                            uint8_t* buffer,
+                                            unsigned int bufferLen)
+{
+    sgx_status_t sgxReturnValue;
+    if ((sgxReturnValue = ocallFaasmReadStateOffset(
+           key, totalLen, offset, buffer, bufferLen)) != SGX_SUCCESS) {
+        SET_ERROR(FAASM_SGX_OCALL_ERROR(sgxReturnValue));
+    }
+}
+
+static void faasm_write_state_offset_wrapper(wasm_exec_env_t execEnv,
+                                             const char* key,
+                                             unsigned int totalLen,
+                                             unsigned int offset,
+                                             uint8_t* buffer,
+                                             unsigned int bufferLen)
+{
+    sgx_status_t sgxReturnValue;
+    if ((sgxReturnValue = ocallFaasmWriteStateOffset(
+           key, totalLen, offset, buffer, bufferLen)) != SGX_SUCCESS) {
+        SET_ERROR(FAASM_SGX_OCALL_ERROR(sgxReturnValue));
+    }
+}
+
+static int32_t faasm_read_state_ptr_wrapper(wasm_exec_env_t execEnv,
+                                            const char* key,
+                                            unsigned int totalLen)
+{
+    // Enclave memory can't be mapped onto state held outside the enclave, so
+    // functions must read and write state through a buffer instead
+    SET_ERROR(FAASM_SGX_WAMR_FUNCTION_NOT_IMPLEMENTED);
+
+    return 0;
+}
+
+static int32_t faasm_read_state_offset_ptr_wrapper(wasm_exec_env_t execEnv,
+                                                   const char* key,
+                                                   unsigned int totalLen,
+                                                   unsigned int offset,
+                                                   unsigned int len)
+{
+    // See faasm_read_state_ptr
+    SET_ERROR(FAASM_SGX_WAMR_FUNCTION_NOT_IMPLEMENTED);
+
+    return 0;
+}
+
+static void faasm_flag_state_dirty_wrapper(wasm_exec_env_t execEnv,
+                                           const char* key,
+                                           unsigned int totalLen)
+{
+    sgx_status_t sgxReturnValue;
+    if ((sgxReturnValue = ocallFaasmFlagStateOffsetDirty(
+           key, totalLen, 0, totalLen)) != SGX_SUCCESS) {
+        SET_ERROR(FAASM_SGX_OCALL_ERROR(sgxReturnValue));
+    }
+}
+
+static void faasm_flag_state_offset_dirty_wrapper(wasm_exec_env_t execEnv,
+                                                  const char* key,
+                                                  unsigned int totalLen,
+                                                  unsigned int offset,
+                                                  unsigned int len)
+{
+    sgx_status_t sgxReturnValue;
+    if ((sgxReturnValue = ocallFaasmFlagStateOffsetDirty(
+           key, totalLen, offset, len)) != SGX_SUCCESS) {
+        SET_ERROR(FAASM_SGX_OCALL_ERROR(sgxReturnValue));
+    }
+}
+
+static void faasm_pull_state_wrapper(wasm_exec_env_t execEnv,
+                                     const char* key,
+                                     unsigned int stateLen)
+{
+    sgx_status_t sgxReturnValue;
+    if ((sgxReturnValue = ocallFaasmPullState(key, stateLen)) != SGX_SUCCESS) {
+        SET_ERROR(FAASM_SGX_OCALL_ERROR(sgxReturnValue));
+    }
+}
+
+static void faasm_push_state_wrapper(wasm_exec_env_t execEnv, const char* key)
+{
+    sgx_status_t sgxReturnValue;
+    if ((sgxReturnValue = ocallFaasmPushState(key)) != SGX_SUCCESS) {
+        SET_ERROR(FAASM_SGX_OCALL_ERROR(sgxReturnValue));
+    }
+}
+
+static void faasm_push_state_partial_wrapper(wasm_exec_env_t execEnv,
+                                             const char* key)
+{
+    sgx_status_t sgxReturnValue;
+    if ((sgxReturnValue = ocallFaasmPushStatePartial(key)) != SGX_SUCCESS) {
+        SET_ERROR(FAASM_SGX_OCALL_ERROR(sgxReturnValue));
+    }
+}
+
+static NativeSymbol ns[] = {
+    REG_FAASM_NATIVE_FUNC(faasm_flag_state_dirty, "($i)"),
+    REG_FAASM_NATIVE_FUNC(faasm_flag_state_offset_dirty, "($iii)"),
+    REG_FAASM_NATIVE_FUNC(faasm_pull_state, "($i)"),
+    REG_FAASM_NATIVE_FUNC(faasm_push_state, "($)"),
+    REG_FAASM_NATIVE_FUNC(faasm_push_state_partial, "($)"),
+    REG_FAASM_NATIVE_FUNC(faasm_read_state, "($*~)i"),
+    REG_FAASM_NATIVE_FUNC(faasm_read_state_offset, "($ii*~)"),
+    REG_FAASM_NATIVE_FUNC(faasm_read_state_offset_ptr, "($iii)i"),
+    REG_FAASM_NATIVE_FUNC(faasm_read_state_ptr, "($i)i"),
+    REG_FAASM_NATIVE_FUNC(faasm_write_state, "($*~)"),
+    REG_FAASM_NATIVE_FUNC(faasm_write_state_offset, "($ii*~)"),
+};
+
+uint32_t getFaasmStateApi(NativeSymbol** nativeSymbols)
+{
+    *nativeSymbols = ns;
+    return sizeof(ns) / sizeof(NativeSymbol);
+}
+}
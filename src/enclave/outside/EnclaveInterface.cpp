@@ -1,10 +1,13 @@
 #include <enclave/outside/EnclaveInterface.h>
+#include <enclave/outside/EnclavePool.h>
 #include <enclave/outside/ecalls.h>
 #include <enclave/outside/system.h>
 #include <faabric/util/gids.h>
 #include <wasm/WasmExecutionContext.h>
 
+#include <faabric/snapshot/SnapshotRegistry.h>
 #include <faabric/util/func.h>
+#include <faabric/util/snapshot.h>
 
 using namespace sgx;
 
@@ -15,8 +18,7 @@ EnclaveInterface::EnclaveInterface()
 {
     checkSgxSetup();
 
-    SPDLOG_DEBUG("Created enclave interface for enclave {}",
-                 sgx::getGlobalEnclaveId());
+    SPDLOG_DEBUG("Created enclave interface {}", interfaceId);
 }
 
 EnclaveInterface::~EnclaveInterface()
@@ -31,54 +33,49 @@ void EnclaveInterface::doBindToFunction(faabric::Message& msg, bool cache)
     storage::FileSystem fs;
     fs.prepareFilesystem();
 
-    // Load AoT
-    storage::FileLoader& functionLoader = storage::getFileLoader();
-
-    std::vector<uint8_t> wasmBytes =
-      functionLoader.loadFunctionWamrAotFile(msg);
-
-    // Load the wasm module
-    // Note - loading and instantiating happen in the same ecall
-    faasm_sgx_status_t returnValue;
-    sgx_status_t status = ecallLoadModule(sgx::getGlobalEnclaveId(),
-                                          &returnValue,
-                                          (void*)wasmBytes.data(),
-                                          (uint32_t)wasmBytes.size(),
-                                          interfaceId);
-    processECallErrors("Unable to enter enclave", status, returnValue);
-
-    // Set up the thread stacks
-    // 28/06/2021 - Threading is not supported in SGX-WAMR. However, the Faasm
-    // runtime expects (asserts) this vector to be non-empty. Change when
-    // in-SGX threading is supported.
-    threadStacks.push_back(-1);
+    // The pool only loads the AoT file if no enclave has it already
+    enclaveId = getEnclavePool().bindFunction(msg, interfaceId);
 }
 
 bool EnclaveInterface::unbindFunction()
 {
-    if (!isBound()) {
+    if (!isBound() || enclaveId == 0) {
         return true;
     }
 
-    SPDLOG_DEBUG("Unloading SGX wasm module");
+    SPDLOG_DEBUG("Removing SGX wasm module from enclave {}", enclaveId);
 
-    faasm_sgx_status_t returnValue;
-    sgx_status_t sgxReturnValue =
-      ecallUnloadModule(sgx::getGlobalEnclaveId(), &returnValue, interfaceId);
-    processECallErrors("Error trying to unload module from enclave",
-                       sgxReturnValue,
-                       returnValue);
+    std::string funcStr = fmt::format("{}/{}", boundUser, boundFunction);
+    sgx_enclave_id_t oldEnclaveId = enclaveId;
+    enclaveId = 0;
+    getEnclavePool().unbindFunction(oldEnclaveId, funcStr, interfaceId);
 
     return true;
 }
 
+void EnclaveInterface::reset(faabric::Message& msg,
+                             const std::string& snapshotKey)
+{
+    if (!isBound()) {
+        return;
+    }
+
+    faasm_sgx_status_t returnValue;
+    sgx_status_t sgxReturnValue;
+    {
+        TcsSlot slot(enclaveId);
+        sgxReturnValue = ecallResetModule(enclaveId, &returnValue, interfaceId);
+    }
+    processECallErrors(
+      "Error resetting module in enclave", sgxReturnValue, returnValue);
+}
+
 int32_t EnclaveInterface::executeFunction(faabric::Message& msg)
 {
 
     std::string funcStr = faabric::util::funcToString(msg, true);
 
-    SPDLOG_DEBUG(
-      "Entering enclave {} to execute {}", sgx::getGlobalEnclaveId(), funcStr);
+    SPDLOG_DEBUG("Entering enclave {} to execute {}", enclaveId, funcStr);
 
     // Prepare argc/argv to be passed to the enclave.
     std::vector<std::string> argv = faabric::util::getArgvForMessage(msg);
@@ -95,29 +92,109 @@ int32_t EnclaveInterface::executeFunction(faabric::Message& msg)
 
     // Enter enclave and call function
     faasm_sgx_status_t returnValue;
-    sgx_status_t sgxReturnValue = ecallCallFunction(
-      sgx::getGlobalEnclaveId(), &returnValue, interfaceId, argc, &cArgv[0]);
+    sgx_status_t sgxReturnValue;
+    {
+        TcsSlot slot(enclaveId);
+        sgxReturnValue = ecallCallFunction(
+          enclaveId, &returnValue, interfaceId, argc, &cArgv[0]);
+    }
     processECallErrors(
       "Error running function inside enclave", sgxReturnValue, returnValue);
 
     return 0;
 }
 
+EnclaveInterface::MemoryInfo EnclaveInterface::getMemoryInfo()
+{
+    if (!isBound()) {
+        throw std::runtime_error("Enclave interface not bound");
+    }
+
+    MemoryInfo info;
+    faasm_sgx_status_t returnValue;
+    sgx_status_t sgxReturnValue;
+    {
+        TcsSlot slot(enclaveId);
+        sgxReturnValue = ecallGetMemoryInfo(enclaveId,
+                                            &returnValue,
+                                            interfaceId,
+                                            &info.sizeBytes,
+                                            &info.maxPages,
+                                            &info.sealedSnapshotBytes);
+    }
+    processECallErrors(
+      "Error getting memory info from enclave", sgxReturnValue, returnValue);
+
+    return info;
+}
+
 size_t EnclaveInterface::getMemorySizeBytes()
 {
-    SPDLOG_WARN("SGX-WAMR getMemorySizeBytes not implemented");
-    return 0;
+    return getMemoryInfo().sizeBytes;
 }
 
 size_t EnclaveInterface::getMaxMemoryPages()
 {
-    SPDLOG_WARN("SGX-WAMR getMaxMemoryPages not implemented");
-    return 0;
+    return getMemoryInfo().maxPages;
 }
 
 uint8_t* EnclaveInterface::getMemoryBase()
 {
-    SPDLOG_WARN("SGX-WAMR getMemoryBase not implemented");
+    SPDLOG_WARN("SGX-WAMR memory is not accessible outside the enclave");
     return nullptr;
 }
+
+ModuleMemoryUsage EnclaveInterface::getMemoryUsage()
+{
+    ModuleMemoryUsage usage;
+    usage.linearMemoryBytes = getMemorySizeBytes();
+    usage.hostBufferBytes = capturedStdout.capacity();
+
+    return usage;
+}
+
+std::shared_ptr<faabric::util::SnapshotData>
+EnclaveInterface::getSnapshotData()
+{
+    // Memory may grow between the two calls, which the enclave rejects
+    std::vector<uint8_t> sealed(getMemoryInfo().sealedSnapshotBytes);
+
+    faasm_sgx_status_t returnValue;
+    sgx_status_t sgxReturnValue;
+    {
+        TcsSlot slot(enclaveId);
+        sgxReturnValue = ecallExportSnapshot(
+          enclaveId, &returnValue, interfaceId, sealed.data(), sealed.size());
+    }
+    processECallErrors(
+      "Error exporting snapshot from enclave", sgxReturnValue, returnValue);
+
+    return std::make_shared<faabric::util::SnapshotData>(
+      std::span<const uint8_t>(sealed.data(), sealed.size()), sealed.size());
+}
+
+void EnclaveInterface::restore(const std::string& snapshotKey)
+{
+    if (!isBound()) {
+        SPDLOG_ERROR("Must bind enclave interface before restoring snapshot {}",
+                     snapshotKey);
+        throw std::runtime_error("Cannot restore unbound enclave interface");
+    }
+
+    auto data =
+      faabric::snapshot::getSnapshotRegistry().getSnapshot(snapshotKey);
+
+    faasm_sgx_status_t returnValue;
+    sgx_status_t sgxReturnValue;
+    {
+        TcsSlot slot(enclaveId);
+        sgxReturnValue = ecallImportSnapshot(enclaveId,
+                                             &returnValue,
+                                             interfaceId,
+                                             data->getDataPtr(),
+                                             data->getSize());
+    }
+    processECallErrors(
+      "Error importing snapshot into enclave", sgxReturnValue, returnValue);
+}
 }
@@ -0,0 +1,389 @@
+#include <conf/FaasmConfig.h>
+#include <enclave/encrypted_module.h>
+#include <enclave/outside/EnclavePool.h>
+#include <enclave/outside/attestation/attestation.h>
+#include <enclave/outside/ecalls.h>
+#include <enclave/outside/system.h>
+#include <storage/FileLoader.h>
+
+#include <faabric/util/func.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace sgx {
+
+EnclavePool& getEnclavePool()
+{
+    static EnclavePool pool;
+    return pool;
+}
+
+EnclavePool::Enclave& EnclavePool::getEnclave(sgx_enclave_id_t enclaveId)
+{
+    for (auto& e : enclaves) {
+        if (e->id == enclaveId) {
+            return *e;
+        }
+    }
+
+    SPDLOG_ERROR("Enclave {} not in pool", enclaveId);
+    throw std::runtime_error("Enclave not in pool");
+}
+
+EnclavePool::Enclave& EnclavePool::pickEnclave(const std::string& funcStr)
+{
+    // The global enclave is always the first
+    if (enclaves.empty()) {
+        checkSgxSetup();
+        enclaves.emplace_back(std::make_unique<Enclave>());
+        enclaves.back()->id = getGlobalEnclaveId();
+    }
+
+    // Prefer the least busy enclave that already has the function loaded, as
+    // long as it has a TCS slot for each Faaslet
+    Enclave* withFunc = nullptr;
+    Enclave* leastBound = nullptr;
+    for (auto& e : enclaves) {
+        if (leastBound == nullptr || e->nBound < leastBound->nBound) {
+            leastBound = e.get();
+        }
+
+        if (e->loaded.count(funcStr) == 0 ||
+            e->nBound >= FAASM_SGX_ENCLAVE_TCS_NUM) {
+            continue;
+        }
+
+        if (withFunc == nullptr || e->nBound < withFunc->nBound) {
+            withFunc = e.get();
+        }
+    }
+
+    if (withFunc != nullptr) {
+        return *withFunc;
+    }
+
+    // Otherwise spread Faaslets over new enclaves until there are enough
+    size_t maxEnclaves = std::max(conf::getFaasmConfig().sgxEnclaves, 1);
+    if (leastBound->nBound > 0 && enclaves.size() < maxEnclaves) {
+        enclaves.emplace_back(std::make_unique<Enclave>());
+        enclaves.back()->id = createEnclave();
+        SPDLOG_DEBUG("Added enclave {} to pool ({}/{})",
+                     enclaves.back()->id,
+                     enclaves.size(),
+                     maxEnclaves);
+
+        return *enclaves.back();
+    }
+
+    return *leastBound;
+}
+
+void EnclavePool::waitForTcs(std::unique_lock<std::mutex>& lock,
+                             Enclave& enclave)
+{
+    tcsCv.wait(lock, [&enclave] {
+        return enclave.tcsInUse < FAASM_SGX_ENCLAVE_TCS_NUM;
+    });
+
+    enclave.tcsInUse++;
+}
+
+void EnclavePool::loadModule(Enclave& enclave,
+                             const faabric::Message& msg,
+                             const std::string& funcStr)
+{
+    std::string encryptedPath =
+      storage::getFileLoader().getEncryptedFunctionFile(msg);
+    if (std::filesystem::exists(encryptedPath)) {
+        loadEncryptedModule(enclave, funcStr, encryptedPath);
+        return;
+    }
+
+    SPDLOG_DEBUG("Loading {} into enclave {}", funcStr, enclave.id);
+
+    std::vector<uint8_t> wasmBytes =
+      storage::getFileLoader().loadFunctionWamrAotFile(msg);
+
+    faasm_sgx_status_t returnValue;
+    sgx_status_t status;
+    {
+        TcsSlot slot(enclave.id);
+        status = ecallLoadModule(enclave.id,
+                                 &returnValue,
+                                 (void*)wasmBytes.data(),
+                                 (uint32_t)wasmBytes.size(),
+                                 funcStr.c_str());
+    }
+    processECallErrors(
+      "Unable to load module into enclave", status, returnValue);
+}
+
+void EnclavePool::loadEncryptedModule(Enclave& enclave,
+                                      const std::string& funcStr,
+                                      const std::string& filePath)
+{
+    SPDLOG_DEBUG("Streaming encrypted {} into enclave {} from {}",
+                 funcStr,
+                 enclave.id,
+                 filePath);
+
+    std::ifstream in(filePath, std::ios::binary);
+    FaasmSgxEncryptedModuleHeader header;
+    if (!in.read((char*)&header, sizeof(header))) {
+        SPDLOG_ERROR("Encrypted function file {} too short", filePath);
+        throw std::runtime_error("Encrypted function file too short");
+    }
+
+    faasm_sgx_status_t returnValue;
+    sgx_status_t status;
+    {
+        TcsSlot slot(enclave.id);
+        status = ecallBeginModuleLoad(enclave.id,
+                                      &returnValue,
+                                      funcStr.c_str(),
+                                      (const uint8_t*)&header,
+                                      sizeof(header));
+    }
+    processECallErrors(
+      "Unable to start encrypted module load", status, returnValue);
+
+    try {
+        // Key release happens while no TCS slot is held
+        ReleasedModuleKey released = releaseModuleKey(enclave.id, funcStr);
+        {
+            TcsSlot slot(enclave.id);
+            status = ecallReleaseModuleKey(enclave.id,
+                                           &returnValue,
+                                           funcStr.c_str(),
+                                           &released.releaseKey,
+                                           released.wrappedKey.data(),
+                                           released.wrappedKey.size());
+        }
+        processECallErrors(
+          "Unable to release module key in enclave", status, returnValue);
+
+        // The enclave has checked the header, so its sizes can be trusted
+        std::vector<uint8_t> chunk;
+        uint64_t remaining = header.plainSize;
+        for (uint32_t i = 0; i < header.nChunks; i++) {
+            uint64_t plainChunkSize =
+              std::min<uint64_t>(remaining, header.chunkSize);
+            chunk.resize(plainChunkSize + FAASM_SGX_ENCRYPTED_MODULE_MAC_SIZE);
+            if (!in.read((char*)chunk.data(), chunk.size())) {
+                SPDLOG_ERROR("Encrypted function file {} truncated at chunk {}",
+                             filePath,
+                             i);
+                throw std::runtime_error("Encrypted function file truncated");
+            }
+            remaining -= plainChunkSize;
+
+            {
+                TcsSlot slot(enclave.id);
+                status = ecallLoadModuleChunk(enclave.id,
+                                              &returnValue,
+                                              funcStr.c_str(),
+                                              chunk.data(),
+                                              chunk.size());
+            }
+            processECallErrors(
+              "Unable to load encrypted module chunk", status, returnValue);
+        }
+
+        {
+            TcsSlot slot(enclave.id);
+            status = ecallEndModuleLoad(
+              enclave.id, &returnValue, funcStr.c_str(), false);
+        }
+        processECallErrors(
+          "Unable to finish encrypted module load", status, returnValue);
+    } catch (std::exception& e) {
+        // Drop the partial image and any key inside the enclave
+        TcsSlot slot(enclave.id);
+        ecallEndModuleLoad(enclave.id, &returnValue, funcStr.c_str(), true);
+        throw;
+    }
+}
+
+sgx_enclave_id_t EnclavePool::bindFunction(const faabric::Message& msg,
+                                           uint32_t faasletId)
+{
+    std::string funcStr = faabric::util::funcToString(msg, false);
+
+    // Counting the instance first stops the function being evicted while
+    // we're loading or instantiating it
+    Enclave* enclave = nullptr;
+    bool isLoading = false;
+    {
+        std::unique_lock<std::mutex> lock(mx);
+        enclave = &pickEnclave(funcStr);
+        enclave->nBound++;
+        enclave->instances[funcStr]++;
+        enclave->idle.remove(funcStr);
+
+        // Only one Faaslet loads a function into each enclave at a time
+        loadCv.wait(lock, [enclave, &funcStr] {
+            return enclave->loading.count(funcStr) == 0;
+        });
+        if (enclave->loaded.count(funcStr) == 0) {
+            enclave->loading.insert(funcStr);
+            isLoading = true;
+        }
+    }
+
+    try {
+        faasm_sgx_status_t returnValue;
+        sgx_status_t status;
+
+        if (isLoading) {
+            loadModule(*enclave, msg, funcStr);
+
+            {
+                std::unique_lock<std::mutex> lock(mx);
+                enclave->loaded.insert(funcStr);
+                enclave->loading.erase(funcStr);
+            }
+            isLoading = false;
+            loadCv.notify_all();
+        }
+
+        {
+            TcsSlot slot(enclave->id);
+            status = ecallInstantiateModule(
+              enclave->id, &returnValue, funcStr.c_str(), faasletId);
+        }
+        processECallErrors(
+          "Unable to instantiate module in enclave", status, returnValue);
+    } catch (std::exception& e) {
+        std::unique_lock<std::mutex> lock(mx);
+        if (isLoading) {
+            enclave->loading.erase(funcStr);
+            loadCv.notify_all();
+        }
+
+        enclave->nBound--;
+        if (--enclave->instances[funcStr] == 0) {
+            enclave->instances.erase(funcStr);
+            if (enclave->loaded.count(funcStr) > 0) {
+                enclave->idle.push_back(funcStr);
+            }
+        }
+
+        throw;
+    }
+
+    return enclave->id;
+}
+
+void EnclavePool::unbindFunction(sgx_enclave_id_t enclaveId,
+                                 const std::string& funcStr,
+                                 uint32_t faasletId)
+{
+    faasm_sgx_status_t returnValue;
+    sgx_status_t status;
+    {
+        TcsSlot slot(enclaveId);
+        status = ecallDeinstantiateModule(enclaveId, &returnValue, faasletId);
+    }
+
+    // The function stays loaded for the next Faaslet to bind to it
+    {
+        std::unique_lock<std::mutex> lock(mx);
+        Enclave& enclave = getEnclave(enclaveId);
+        enclave.nBound--;
+        if (--enclave.instances[funcStr] == 0) {
+            enclave.instances.erase(funcStr);
+            enclave.idle.push_back(funcStr);
+        }
+
+        // Evictions keep the lock throughout so nothing binds to the
+        // function while it's being unloaded
+        while (enclave.idle.size() > FAASM_SGX_MAX_IDLE_MODULES) {
+            waitForTcs(lock, enclave);
+            if (enclave.idle.size() <= FAASM_SGX_MAX_IDLE_MODULES) {
+                enclave.tcsInUse--;
+                break;
+            }
+
+            std::string evicted = enclave.idle.front();
+            enclave.idle.pop_front();
+            enclave.loaded.erase(evicted);
+
+            SPDLOG_DEBUG("Unloading {} from enclave {}", evicted, enclaveId);
+            faasm_sgx_status_t unloadReturnValue;
+            sgx_status_t unloadStatus =
+              ecallUnloadModule(enclaveId, &unloadReturnValue, evicted.c_str());
+            enclave.tcsInUse--;
+            tcsCv.notify_all();
+
+            processECallErrors("Error trying to unload module from enclave",
+                               unloadStatus,
+                               unloadReturnValue);
+        }
+    }
+
+    processECallErrors(
+      "Error trying to remove module from enclave", status, returnValue);
+}
+
+void EnclavePool::acquireTcs(sgx_enclave_id_t enclaveId)
+{
+    std::unique_lock<std::mutex> lock(mx);
+    waitForTcs(lock, getEnclave(enclaveId));
+}
+
+void EnclavePool::releaseTcs(sgx_enclave_id_t enclaveId)
+{
+    {
+        std::unique_lock<std::mutex> lock(mx);
+        getEnclave(enclaveId).tcsInUse--;
+    }
+
+    tcsCv.notify_all();
+}
+
+int EnclavePool::getEnclaveCount()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    return enclaves.size();
+}
+
+int EnclavePool::getFreeTcs(sgx_enclave_id_t enclaveId)
+{
+    std::unique_lock<std::mutex> lock(mx);
+    return FAASM_SGX_ENCLAVE_TCS_NUM - getEnclave(enclaveId).tcsInUse;
+}
+
+std::set<std::string> EnclavePool::getLoadedFunctions(
+  sgx_enclave_id_t enclaveId)
+{
+    std::unique_lock<std::mutex> lock(mx);
+    return getEnclave(enclaveId).loaded;
+}
+
+void EnclavePool::clear()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    for (auto& e : enclaves) {
+        if (e->id != getGlobalEnclaveId()) {
+            destroyEnclave(e->id);
+        }
+    }
+
+    enclaves.clear();
+}
+
+TcsSlot::TcsSlot(sgx_enclave_id_t enclaveIdIn)
+  : enclaveId(enclaveIdIn)
+{
+    getEnclavePool().acquireTcs(enclaveId);
+}
+
+TcsSlot::~TcsSlot()
+{
+    getEnclavePool().releaseTcs(enclaveId);
+}
+}
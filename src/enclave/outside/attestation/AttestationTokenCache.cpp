@@ -0,0 +1,230 @@
+#include <conf/FaasmConfig.h>
+#include <enclave/outside/attestation/AttestationTokenCache.h>
+#include <enclave/outside/attestation/AzureAttestationServiceClient.h>
+#include <enclave/outside/attestation/attestation.h>
+#include <faabric/util/logging.h>
+
+#include <jwt-cpp/jwt.h>
+
+#include <algorithm>
+#include <vector>
+
+// Tokens with no expiry are still attested again this often
+#define ATTESTATION_TOKEN_DEFAULT_TTL_SECS 300
+
+// Wait between failed refreshes of the same token
+#define ATTESTATION_RETRY_SECS 10
+
+using namespace std::chrono;
+
+namespace sgx {
+
+AttestationTokenCache& getAttestationTokenCache()
+{
+    static AttestationTokenCache cache;
+    return cache;
+}
+
+system_clock::time_point getJwtExpiry(const std::string& jwtResponse)
+{
+    auto decodedJwt = jwt::decode(
+      AzureAttestationServiceClient::getTokenFromJwtResponse(jwtResponse));
+
+    if (!decodedJwt.has_expires_at()) {
+        SPDLOG_WARN("Attestation token has no expiry, keeping it for {}s",
+                    ATTESTATION_TOKEN_DEFAULT_TTL_SECS);
+        return system_clock::now() +
+               seconds(ATTESTATION_TOKEN_DEFAULT_TTL_SECS);
+    }
+
+    return decodedJwt.get_expires_at();
+}
+
+// Refreshes are due the margin before expiry, but at least halfway through
+// the token's remaining life, so short-lived tokens aren't refreshed in a loop
+static system_clock::time_point getRefreshTime(
+  system_clock::time_point expiry)
+{
+    auto now = system_clock::now();
+    auto margin = seconds(conf::getFaasmConfig().sgxAttestationRefreshSecs);
+
+    return std::max(expiry - margin, now + (expiry - now) / 2);
+}
+
+AttestationTokenCache::AttestationTokenCache()
+  : attest(attestEnclaveWithKey)
+{}
+
+AttestationTokenCache::AttestationTokenCache(AttestFunction attestIn)
+  : attest(std::move(attestIn))
+{}
+
+AttestationTokenCache::~AttestationTokenCache()
+{
+    stopRefreshThread();
+}
+
+AttestationTokenCache::CachedToken AttestationTokenCache::attestEnclave(
+  sgx_enclave_id_t enclaveId)
+{
+    CachedToken token;
+    token.jwtResponse = attest(enclaveId);
+    token.expiry = getJwtExpiry(token.jwtResponse);
+    token.refreshAt = getRefreshTime(token.expiry);
+
+    return token;
+}
+
+void AttestationTokenCache::startRefreshThread()
+{
+    if (!refreshThread.joinable()) {
+        refreshThread = std::thread(&AttestationTokenCache::refreshLoop, this);
+    }
+}
+
+void AttestationTokenCache::addEnclave(sgx_enclave_id_t enclaveId)
+{
+    {
+        std::unique_lock<std::mutex> lock(mx);
+        if (tokens.count(enclaveId) > 0) {
+            return;
+        }
+
+        // An expired placeholder, due for refresh straight away
+        CachedToken& token = tokens[enclaveId];
+        token.refreshAt = system_clock::now();
+        startRefreshThread();
+    }
+    refreshCv.notify_all();
+}
+
+std::string AttestationTokenCache::getToken(sgx_enclave_id_t enclaveId)
+{
+    {
+        std::unique_lock<std::mutex> lock(mx);
+        auto it = tokens.find(enclaveId);
+        if (it != tokens.end() && it->second.expiry > system_clock::now()) {
+            return it->second.jwtResponse;
+        }
+    }
+
+    // Only enclaves with no valid token wait on the attestation service
+    SPDLOG_DEBUG("No valid attestation token for enclave {}", enclaveId);
+    CachedToken token = attestEnclave(enclaveId);
+    if (token.expiry <= system_clock::now()) {
+        SPDLOG_WARN("Enclave {} attested with an expired token", enclaveId);
+        return token.jwtResponse;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mx);
+        tokens[enclaveId] = token;
+        startRefreshThread();
+    }
+    refreshCv.notify_all();
+
+    return token.jwtResponse;
+}
+
+void AttestationTokenCache::refreshLoop()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    while (!stopping) {
+        // Sleep until the first refresh is due, or the tokens change
+        auto nextRefresh = system_clock::now() + hours(1);
+        for (const auto& [enclaveId, token] : tokens) {
+            nextRefresh = std::min(nextRefresh, token.refreshAt);
+        }
+        refreshCv.wait_until(lock, nextRefresh);
+
+        auto now = system_clock::now();
+        std::vector<sgx_enclave_id_t> due;
+        for (const auto& [enclaveId, token] : tokens) {
+            if (token.refreshAt <= now) {
+                due.push_back(enclaveId);
+            }
+        }
+
+        for (auto enclaveId : due) {
+            if (stopping) {
+                break;
+            }
+
+            // Attestation goes over the network, so is done unlocked
+            lock.unlock();
+            bool success = true;
+            CachedToken token;
+            try {
+                token = attestEnclave(enclaveId);
+            } catch (std::exception& e) {
+                SPDLOG_WARN("Failed refreshing attestation token for "
+                            "enclave {}: {}",
+                            enclaveId,
+                            e.what());
+                success = false;
+            }
+            lock.lock();
+
+            // The enclave may have gone in the meantime
+            auto it = tokens.find(enclaveId);
+            if (it == tokens.end()) {
+                continue;
+            }
+
+            if (success) {
+                SPDLOG_DEBUG("Refreshed attestation token for enclave {}",
+                             enclaveId);
+                it->second = token;
+            }
+
+            // Expired tokens are dropped, so the next use attests again
+            now = system_clock::now();
+            if (it->second.expiry <= now) {
+                SPDLOG_WARN("No valid attestation token for enclave {}",
+                            enclaveId);
+                tokens.erase(it);
+            } else if (!success) {
+                it->second.refreshAt =
+                  std::min(now + seconds(ATTESTATION_RETRY_SECS),
+                           it->second.expiry);
+            }
+        }
+    }
+}
+
+void AttestationTokenCache::removeEnclave(sgx_enclave_id_t enclaveId)
+{
+    std::unique_lock<std::mutex> lock(mx);
+    tokens.erase(enclaveId);
+}
+
+void AttestationTokenCache::stopRefreshThread()
+{
+    {
+        std::unique_lock<std::mutex> lock(mx);
+        stopping = true;
+    }
+    refreshCv.notify_all();
+
+    if (refreshThread.joinable()) {
+        refreshThread.join();
+    }
+
+    std::unique_lock<std::mutex> lock(mx);
+    stopping = false;
+}
+
+void AttestationTokenCache::clear()
+{
+    stopRefreshThread();
+
+    std::unique_lock<std::mutex> lock(mx);
+    tokens.clear();
+}
+
+size_t AttestationTokenCache::getTokenCount()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    return tokens.size();
+}
+}
@@ -58,10 +58,9 @@ std::string AzureAttestationServiceClient::requestBodyFromEnclaveInfo(
 
     // runtimeData: data provided by the enclave at quote generation time. This
     // field corresponds to the enclave held data variable that we can configure
-    // before attestation.
-    // 06/04/2022 - For the moment we don't include the enclave held data in
-    // the request, as there is still not a clear use for it.
-    std::vector<uint8_t> heldData = {};
+    // before attestation. Its hash is in the quote, and the service includes
+    // it in the JWT, e.g. to carry an enclave's public key for key release.
+    std::vector<uint8_t> heldData = enclaveInfo.getEnclaveHeldData();
     std::string enclaveHeldDataBase64 =
       cppcodec::base64_url::encode(&heldData[0], heldData.size());
     std::string dataType = "Binary";
@@ -127,7 +126,8 @@ std::string AzureAttestationServiceClient::attestEnclave(
     return jwt;
 }
 
-static std::string getTokenFromJwtResponse(const std::string& jwtResponse)
+std::string AzureAttestationServiceClient::getTokenFromJwtResponse(
+  const std::string& jwtResponse)
 {
     rapidjson::Document d;
     d.Parse(jwtResponse.c_str());
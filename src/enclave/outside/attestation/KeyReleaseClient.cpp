@@ -0,0 +1,116 @@
+#include <enclave/encrypted_module.h>
+#include <enclave/outside/attestation/AzureAttestationServiceClient.h>
+#include <enclave/outside/attestation/KeyReleaseClient.h>
+#include <faabric/util/logging.h>
+
+#include <cppcodec/base64_url.hpp>
+#include <cpprest/http_client.h>
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include <cstring>
+
+#define KEY_RELEASE_URI_SUFFIX "/release"
+
+using namespace rapidjson;
+using namespace web;
+using namespace web::http;
+using namespace web::http::client;
+
+namespace sgx {
+
+std::string KeyReleaseClient::requestBody(const std::string& funcStr,
+                                          const std::string& jwtToken)
+{
+    Document d;
+    d.SetObject();
+    Document::AllocatorType& allocator = d.GetAllocator();
+
+    d.AddMember(
+      "function", Value(funcStr.c_str(), funcStr.size(), allocator), allocator);
+    d.AddMember(
+      "token", Value(jwtToken.c_str(), jwtToken.size(), allocator), allocator);
+
+    StringBuffer buffer;
+    Writer<rapidjson::StringBuffer> writer(buffer);
+    d.Accept(writer);
+    return std::string(buffer.GetString());
+}
+
+ReleasedModuleKey KeyReleaseClient::releasedKeyFromResponse(
+  const std::string& responseBody)
+{
+    Document d;
+    d.Parse(responseBody.c_str());
+    if (d.HasParseError() || !d.IsObject() || !d.HasMember("releaseKey") ||
+        !d.HasMember("wrappedKey") || !d["releaseKey"].IsString() ||
+        !d["wrappedKey"].IsString()) {
+        SPDLOG_ERROR("Malformed response from key release service: {}",
+                     responseBody);
+        throw std::runtime_error("Malformed key release response");
+    }
+
+    std::vector<uint8_t> releaseKey =
+      cppcodec::base64_url::decode(std::string(d["releaseKey"].GetString()));
+    std::vector<uint8_t> wrappedKey =
+      cppcodec::base64_url::decode(std::string(d["wrappedKey"].GetString()));
+
+    if (releaseKey.size() != sizeof(sgx_ec256_public_t) ||
+        wrappedKey.size() != sizeof(FaasmSgxWrappedModuleKey)) {
+        SPDLOG_ERROR("Released keys have the wrong size ({} and {} bytes)",
+                     releaseKey.size(),
+                     wrappedKey.size());
+        throw std::runtime_error("Malformed key release response");
+    }
+
+    ReleasedModuleKey released;
+    std::memcpy(&released.releaseKey, releaseKey.data(), releaseKey.size());
+    released.wrappedKey = std::move(wrappedKey);
+
+    return released;
+}
+
+KeyReleaseClient::KeyReleaseClient(const std::string& keyReleaseUrlIn)
+  : keyReleaseUrl(keyReleaseUrlIn)
+{}
+
+ReleasedModuleKey KeyReleaseClient::releaseModuleKey(
+  const std::string& funcStr,
+  const std::string& jwtResponse)
+{
+    std::string jwtToken =
+      AzureAttestationServiceClient::getTokenFromJwtResponse(jwtResponse);
+
+    // Prepare HTTP request
+    http_client client(keyReleaseUrl + KEY_RELEASE_URI_SUFFIX);
+    http_request request(methods::POST);
+    request.headers().add("Content-Type", "application/json");
+    request.set_body(requestBody(funcStr, jwtToken));
+
+    // Send HTTP request and wait for task to complete
+    pplx::task<http_response> responseTask = client.request(request);
+    try {
+        responseTask.wait();
+    } catch (const std::exception& e) {
+        SPDLOG_ERROR("Caught exception while querying key release service "
+                     "for {}: {}",
+                     funcStr,
+                     e.what());
+        throw std::runtime_error("Exception querying key release service");
+    }
+
+    // Process output
+    std::string body = responseTask.get().extract_string().get();
+    if (responseTask.get().status_code() != status_codes::OK) {
+        SPDLOG_ERROR("Key release service refused {}'s key (code {}): {}",
+                     funcStr,
+                     responseTask.get().status_code(),
+                     body);
+        throw std::runtime_error("Error releasing function key");
+    }
+    SPDLOG_DEBUG("Received wrapped key for {}", funcStr);
+
+    return releasedKeyFromResponse(body);
+}
+}
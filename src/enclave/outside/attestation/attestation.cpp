@@ -1,4 +1,5 @@
 #include <conf/FaasmConfig.h>
+#include <enclave/outside/attestation/AttestationTokenCache.h>
 #include <enclave/outside/attestation/AzureAttestationServiceClient.h>
 #include <enclave/outside/attestation/attestation.h>
 #include <enclave/outside/ecalls.h>
@@ -93,8 +94,8 @@ EnclaveInfo generateQuote(int enclaveId,
 }
 #endif
 
-void validateQuote(const EnclaveInfo& enclaveInfo,
-                   const std::string& attestationProviderUrl)
+std::string validateQuote(const EnclaveInfo& enclaveInfo,
+                          const std::string& attestationProviderUrl)
 {
     AzureAttestationServiceClient client(attestationProviderUrl);
 
@@ -103,13 +104,55 @@ void validateQuote(const EnclaveInfo& enclaveInfo,
 
     // Validate JWT response token
     client.validateJwtToken(jwtResponse);
+
+    return jwtResponse;
 }
 
 #ifdef FAASM_SGX_HARDWARE_MODE
-void attestEnclave(int enclaveId, std::vector<uint8_t> enclaveHeldData)
+std::string attestEnclave(int enclaveId, std::vector<uint8_t> enclaveHeldData)
 {
     EnclaveInfo enclaveInfo = generateQuote(enclaveId, enclaveHeldData);
-    validateQuote(enclaveInfo, conf::getFaasmConfig().attestationProviderUrl);
+    return validateQuote(enclaveInfo,
+                         conf::getFaasmConfig().attestationProviderUrl);
+}
+
+std::string attestEnclaveWithKey(sgx_enclave_id_t enclaveId)
+{
+    sgx_ec256_public_t publicKey;
+    faasm_sgx_status_t returnValue;
+    sgx_status_t sgxReturnValue =
+      ecallGetAttestationKey(enclaveId, &returnValue, &publicKey);
+    if (sgxReturnValue != SGX_SUCCESS || returnValue != FAASM_SGX_SUCCESS) {
+        SPDLOG_ERROR("Error getting enclave {}'s attestation key", enclaveId);
+        throw std::runtime_error("Error getting enclave's attestation key");
+    }
+
+    const uint8_t* keyBytes = (const uint8_t*)&publicKey;
+    std::vector<uint8_t> heldData(keyBytes, keyBytes + sizeof(publicKey));
+    return attestEnclave(enclaveId, heldData);
+}
+#else
+std::string attestEnclaveWithKey(sgx_enclave_id_t enclaveId)
+{
+    // Without a quote there's nothing to convince the service with
+    SPDLOG_ERROR("Can't attest enclave {} without SGX hardware mode",
+                 enclaveId);
+    throw std::runtime_error("Attestation needs SGX hardware mode");
 }
 #endif
+
+ReleasedModuleKey releaseModuleKey(sgx_enclave_id_t enclaveId,
+                                   const std::string& funcStr)
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    if (conf.sgxKeyReleaseUrl.empty()) {
+        SPDLOG_ERROR("No key release service to get {}'s key from", funcStr);
+        throw std::runtime_error("Key release service not configured");
+    }
+
+    std::string jwtResponse = getAttestationTokenCache().getToken(enclaveId);
+
+    KeyReleaseClient client(conf.sgxKeyReleaseUrl);
+    return client.releaseModuleKey(funcStr, jwtResponse);
+}
 }
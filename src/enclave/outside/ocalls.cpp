@@ -1,13 +1,24 @@
 #include <faabric/scheduler/ExecutorContext.h>
+#include <faabric/state/State.h>
 
 #include <enclave/outside/EnclaveInterface.h>
 #include <wasm/chaining.h>
+#include <wasm/timing.h>
 
 #include <cstdio>
 #include <cstring>
+#include <string>
 
 using namespace faabric::scheduler;
 
+static std::shared_ptr<faabric::state::StateKeyValue> getStateKV(
+  const char* key,
+  size_t size)
+{
+    std::string user = ExecutorContext::get()->getMsg().user();
+    return faabric::state::getGlobalState().getKV(user, key, size);
+}
+
 extern "C"
 {
     int ocallFaasmReadInput(uint8_t* buffer, unsigned int bufferSize)
@@ -72,18 +83,101 @@ extern "C"
         return wasm::awaitChainedCallOutput(callId, buffer, bufferSize);
     }
 
-    int32_t ocallSbrk(int32_t increment)
+    // ---------------------------------------
+    // State
+    //
+    // Enclave memory can't be mapped onto the host's state, so everything is
+    // copied in and out of the enclave
+    // ---------------------------------------
+
+    unsigned int ocallFaasmReadState(const char* key,
+                                     uint8_t* buffer,
+                                     unsigned int bufferLen)
     {
-        SPDLOG_TRACE("S - __sbrk - {}", increment);
-        SPDLOG_WARN("SGX-WAMR sbrk does not allocate more memory");
-        return 0;
+        std::string user = ExecutorContext::get()->getMsg().user();
+        if (bufferLen == 0) {
+            return faabric::state::getGlobalState().getStateSize(user, key);
+        }
+
+        auto kv = getStateKV(key, bufferLen);
+        kv->get(buffer);
+        return kv->size();
+    }
+
+    void ocallFaasmWriteState(const char* key,
+                              uint8_t* buffer,
+                              unsigned int bufferLen)
+    {
+        getStateKV(key, bufferLen)->set(buffer);
+    }
+
+    void ocallFaasmReadStateOffset(const char* key,
+                                   unsigned int totalLen,
+                                   unsigned int offset,
+                                   uint8_t* buffer,
+                                   unsigned int bufferLen)
+    {
+        getStateKV(key, totalLen)->getChunk(offset, buffer, bufferLen);
+    }
+
+    void ocallFaasmWriteStateOffset(const char* key,
+                                    unsigned int totalLen,
+                                    unsigned int offset,
+                                    uint8_t* buffer,
+                                    unsigned int bufferLen)
+    {
+        getStateKV(key, totalLen)->setChunk(offset, buffer, bufferLen);
+    }
+
+    void ocallFaasmFlagStateOffsetDirty(const char* key,
+                                        unsigned int totalLen,
+                                        unsigned int offset,
+                                        unsigned int len)
+    {
+        getStateKV(key, totalLen)->flagChunkDirty(offset, len);
+    }
+
+    void ocallFaasmPullState(const char* key, unsigned int stateLen)
+    {
+        getStateKV(key, stateLen)->pull();
+    }
+
+    void ocallFaasmPushState(const char* key)
+    {
+        getStateKV(key, 0)->pushFull();
+    }
+
+    void ocallFaasmPushStatePartial(const char* key)
+    {
+        getStateKV(key, 0)->pushPartial();
+    }
+
+    // The enclave has no high-resolution clock of its own
+    uint64_t ocallFaasmTimerNanos() { return wasm::getTimerNanos(); }
+
+    uint64_t ocallFaasmTimerResolutionNanos()
+    {
+        return wasm::getTimerResolutionNanos();
     }
 
     // ---------------------------------------
     // Logging
     // ---------------------------------------
 
-    void ocallLogDebug(const char* msg) { SPDLOG_DEBUG("[enclave] {}", msg); }
+    void ocallLogDebugBatch(const char* msgs, size_t msgsLen)
+    {
+        std::string batch(msgs, msgsLen);
+        size_t start = 0;
+        while (start < batch.size()) {
+            size_t end = batch.find('\n', start);
+            if (end == std::string::npos) {
+                end = batch.size();
+            }
+
+            SPDLOG_DEBUG("[enclave] {}", batch.substr(start, end - start));
+            start = end + 1;
+        }
+    }
 
     void ocallLogError(const char* msg) { SPDLOG_ERROR("[enclave] {}", msg); }
 }
@@ -1,4 +1,7 @@
+#include <conf/FaasmConfig.h>
 #include <enclave/error.h>
+#include <enclave/outside/EnclavePool.h>
+#include <enclave/outside/attestation/AttestationTokenCache.h>
 #include <enclave/outside/attestation/attestation.h>
 #include <enclave/outside/ecalls.h>
 #include <enclave/outside/getSgxSupport.h>
@@ -7,6 +10,7 @@
 
 #include <boost/filesystem/operations.hpp>
 #include <sgx_urts.h>
+#include <sgx_uswitchless.h>
 #include <string>
 
 // Global enclave ID
@@ -24,15 +28,8 @@ sgx_enclave_id_t getGlobalEnclaveId()
     return globalEnclaveId;
 }
 
-void checkSgxSetup()
+sgx_enclave_id_t createEnclave()
 {
-
-    // Skip set-up if enclave already exists
-    if (globalEnclaveId != 0) {
-        SPDLOG_DEBUG("SGX enclave already exists ({})", globalEnclaveId);
-        return;
-    }
-
     faasm_sgx_status_t returnValue;
 
 #ifdef FAASM_SGX_HARDWARE_MODE
@@ -50,41 +47,81 @@ void checkSgxSetup()
         throw std::runtime_error("Could not find enclave file");
     }
 
+    // Switchless OCALLs are served by this many untrusted worker threads per
+    // enclave, none turning them into regular OCALLs
+    int nWorkers = conf::getFaasmConfig().sgxSwitchlessWorkers;
+    sgx_uswitchless_config_t switchlessConfig =
+      SGX_USWITCHLESS_CONFIG_INITIALIZER;
+    switchlessConfig.num_uworkers = nWorkers;
+    switchlessConfig.num_tworkers = 0;
+
+    const void* enclaveExFeatures[32] = { nullptr };
+    uint32_t enclaveExFeatureFlags = 0;
+    if (nWorkers > 0) {
+        enclaveExFeatures[SGX_CREATE_ENCLAVE_EX_SWITCHLESS_BIT_IDX] =
+          &switchlessConfig;
+        enclaveExFeatureFlags |= SGX_CREATE_ENCLAVE_EX_SWITCHLESS;
+    }
+
     // Create the enclave
+    sgx_enclave_id_t enclaveId = 0;
     sgx_launch_token_t sgxEnclaveToken = { 0 };
     int sgxEnclaveTokenUpdated = 0;
-    sgx_status_t sgxReturnValue = sgx_create_enclave(FAASM_ENCLAVE_PATH,
-                                                     SGX_DEBUG_FLAG,
-                                                     &sgxEnclaveToken,
-                                                     &sgxEnclaveTokenUpdated,
-                                                     &globalEnclaveId,
-                                                     nullptr);
+    sgx_status_t sgxReturnValue =
+      sgx_create_enclave_ex(FAASM_ENCLAVE_PATH,
+                            SGX_DEBUG_FLAG,
+                            &sgxEnclaveToken,
+                            &sgxEnclaveTokenUpdated,
+                            &enclaveId,
+                            nullptr,
+                            enclaveExFeatureFlags,
+                            enclaveExFeatures);
     processECallErrors("Unable to create enclave", sgxReturnValue);
-    SPDLOG_DEBUG("Created SGX enclave: {}", globalEnclaveId);
+    SPDLOG_DEBUG(
+      "Created SGX enclave: {} ({} switchless workers)", enclaveId, nWorkers);
 
     // Initialise WebAssembly runtime inside the enclave (WAMR)
-    sgxReturnValue = ecallInitWamr(globalEnclaveId, &returnValue);
+    sgxReturnValue = ecallInitWamr(enclaveId, &returnValue);
     processECallErrors(
       "Unable to initialise WAMR inside enclave", sgxReturnValue, returnValue);
-    SPDLOG_DEBUG("Initialised WAMR in SGX enclave {}", globalEnclaveId);
+    SPDLOG_DEBUG("Initialised WAMR in SGX enclave {}", enclaveId);
 
 #ifdef FAASM_SGX_HARDWARE_MODE
-    // Attest enclave only in hardware mode
-    // 06/04/2022 - For the moment, the enclave held data is a dummy placeholder
-    // until we decide if we are going to use it or not.
-    std::vector<uint8_t> enclaveHeldData{ 0x01, 0x02, 0x03, 0x04, 0x05, 0x06 };
-    attestEnclave(globalEnclaveId, enclaveHeldData);
-    SPDLOG_DEBUG("Attested SGX enclave: {}", globalEnclaveId);
+    // Attest enclave only in hardware mode. This happens in the background,
+    // and the token is cached for releasing keys to the enclave later
+    getAttestationTokenCache().addEnclave(enclaveId);
 #endif
+
+    return enclaveId;
 }
 
-void tearDownEnclave()
+void destroyEnclave(sgx_enclave_id_t enclaveId)
 {
+    SPDLOG_DEBUG("Destroying enclave {}", enclaveId);
 
-    SPDLOG_DEBUG("Destroying enclave {}", globalEnclaveId);
+    getAttestationTokenCache().removeEnclave(enclaveId);
 
-    sgx_status_t sgxReturnValue = sgx_destroy_enclave(globalEnclaveId);
+    sgx_status_t sgxReturnValue = sgx_destroy_enclave(enclaveId);
     processECallErrors("Unable to destroy enclave", sgxReturnValue);
+}
+
+void checkSgxSetup()
+{
+    // Skip set-up if enclave already exists
+    if (globalEnclaveId != 0) {
+        SPDLOG_DEBUG("SGX enclave already exists ({})", globalEnclaveId);
+        return;
+    }
+
+    globalEnclaveId = createEnclave();
+}
+
+void tearDownEnclave()
+{
+    // The pool's other enclaves go too, and it forgets what was loaded
+    getEnclavePool().clear();
+
+    destroyEnclave(globalEnclaveId);
 
     globalEnclaveId = 0;
 }
@@ -200,6 +237,10 @@ std::string faasmSgxErrorString(faasm_sgx_status_t status)
         ERROR_PRINT_CASE(FAASM_SGX_ENCRYPTION_FAILED)
         ERROR_PRINT_CASE(FAASM_SGX_DECRYPTION_FAILED)
         ERROR_PRINT_CASE(FAASM_SGX_HASH_FAILED)
+        ERROR_PRINT_CASE(FAASM_SGX_GENERATE_REPORT_FAILED)
+        ERROR_PRINT_CASE(FAASM_SGX_KEY_EXCHANGE_FAILED)
+        ERROR_PRINT_CASE(FAASM_SGX_MODULE_KEY_NOT_RELEASED)
+        ERROR_PRINT_CASE(FAASM_SGX_MODULE_LOAD_NOT_STARTED)
         default: {
             char res[20];
             sprintf(res, "%#010x", status);
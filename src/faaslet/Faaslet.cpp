@@ -1,10 +1,21 @@
 #include <faaslet/Faaslet.h>
 
 #include <conf/FaasmConfig.h>
+#include <metrics/LifecycleTrace.h>
+#include <metrics/Metrics.h>
+#include <metrics/MetricsServer.h>
+#include <system/Affinity.h>
 #include <system/CGroup.h>
+#include <system/IsolationMetrics.h>
 #include <system/NetworkNamespace.h>
 #include <threads/ThreadState.h>
 #include <wamr/WAMRWasmModule.h>
+#include <wasm/chaining_results.h>
+#include <wasm/page_store.h>
+#include <wasm/result_cache.h>
+#include <wasm/state_disk.h>
+#include <wasm/state_replicas.h>
+#include <wasm/timing.h>
 #include <wavm/WAVMWasmModule.h>
 
 #include <faabric/scheduler/Scheduler.h>
@@ -17,7 +28,16 @@
 #include <faabric/util/logging.h>
 #include <faabric/util/timing.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
 #include <stdexcept>
+#include <thread>
 
 #ifndef FAASM_SGX_DISABLED_MODE
 #include <enclave/outside/EnclaveInterface.h>
@@ -26,12 +46,56 @@
 #include <storage/FileLoader.h>
 #include <storage/FileSystem.h>
 
-static thread_local bool threadIsIsolated = false;
-
 using namespace isolation;
 
 namespace faaslet {
 
+/**
+ * What the calling executor thread is isolated for. Threads can go on to run
+ * functions for other tenants, so this is checked on every task, and isolation
+ * only re-applied when the tenant changes. The namespace is given back to the
+ * pool when the thread exits.
+ */
+struct ThreadIsolation
+{
+    std::string cgroupName;
+    std::string user;
+    std::shared_ptr<NetworkNamespace> ns;
+
+    ~ThreadIsolation()
+    {
+        if (ns != nullptr) {
+            returnNetworkNamespace(ns);
+        }
+    }
+};
+
+static thread_local ThreadIsolation threadIsolation;
+
+static void recordPhase(faabric::Message& msg,
+                        const std::string& phase,
+                        uint64_t micros)
+{
+    (*msg.mutable_execgraphdetails())[phase] = std::to_string(micros);
+}
+
+uint64_t getEpochMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+long getPhaseMicros(const faabric::Message& msg, const std::string& phase)
+{
+    auto it = msg.execgraphdetails().find(phase);
+    if (it == msg.execgraphdetails().end()) {
+        return 0;
+    }
+
+    return std::stol(it->second);
+}
+
 void preloadPythonRuntime()
 {
     conf::FaasmConfig& conf = conf::getFaasmConfig();
@@ -47,46 +111,772 @@ void preloadPythonRuntime()
     msg.set_ispython(true);
     msg.set_pythonuser("python");
     msg.set_pythonfunction("noop");
-    faabric::util::setMessageId(msg);
 
-    faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
-    sch.callFunction(msg, true);
+    // Builds the caches and reset snapshot without going via the scheduler
+    prewarmFunction(msg);
+
+    if (conf.pythonPreloadFaaslets <= 0) {
+        return;
+    }
+
+    auto fac = std::dynamic_pointer_cast<FaasletFactory>(
+      faabric::scheduler::getExecutorFactory());
+    if (fac == nullptr) {
+        SPDLOG_WARN("Not pre-creating Python Faaslets, no Faaslet factory");
+        return;
+    }
+
+    fac->prewarmFaaslets(msg, conf.pythonPreloadFaaslets);
+}
+
+// -------------------------------------
+// PREWARMING
+// -------------------------------------
+
+static std::mutex prewarmMx;
+static std::vector<std::thread> prewarmThreads;
+
+std::vector<faabric::Message> getPrewarmMessages()
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+
+    std::vector<faabric::Message> msgs;
+    std::istringstream in(conf.prewarmFunctions);
+    std::string funcStr;
+    while (std::getline(in, funcStr, ',')) {
+        if (funcStr.empty()) {
+            continue;
+        }
+
+        size_t sepIdx = funcStr.find('/');
+        if (sepIdx == std::string::npos || sepIdx == 0 ||
+            sepIdx == funcStr.size() - 1) {
+            SPDLOG_WARN("Ignoring invalid prewarm function: {}", funcStr);
+            continue;
+        }
+
+        msgs.emplace_back(faabric::util::messageFactory(
+          funcStr.substr(0, sepIdx), funcStr.substr(sepIdx + 1)));
+    }
+
+    return msgs;
+}
+
+void prewarmFunction(faabric::Message& msg)
+{
+    const std::string funcStr = faabric::util::funcToString(msg, false);
+    const std::string wasmVm = wasm::getFunctionWasmVm(msg);
+
+    // Binding a throwaway module populates the module caches, and gives us the
+    // memory to register the reset snapshot from. We don't execute anything
+    // other than the module's initialisation.
+    if (wasmVm == "wavm") {
+        wasm::WAVMWasmModule module;
+        module.bindToFunction(msg);
+        wasm::getWAVMModuleCache().registerResetSnapshot(module, msg);
+    } else if (wasmVm == "wamr") {
+        wasm::WAMRWasmModule module;
+        module.bindToFunction(msg);
+        wasm::getWAMRModuleCache().registerResetSnapshot(module, msg);
+    } else {
+        SPDLOG_WARN("Prewarming not supported for wasm VM {}, skipping {}",
+                    wasmVm,
+                    funcStr);
+        return;
+    }
+
+    SPDLOG_DEBUG("Prewarmed {}", funcStr);
+
+    int nFaaslets = wasm::getFunctionProfile(msg).prewarmFaaslets;
+    if (nFaaslets <= 0) {
+        return;
+    }
+
+    auto fac = std::dynamic_pointer_cast<FaasletFactory>(
+      faabric::scheduler::getExecutorFactory());
+    if (fac == nullptr) {
+        SPDLOG_WARN("Not pre-creating Faaslets for {}, no Faaslet factory",
+                    funcStr);
+        return;
+    }
+
+    fac->prewarmFaaslets(msg, nFaaslets);
+}
+
+void startPrewarm()
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+
+    // The Python runtime is warmed on its own thread, as it takes a while
+    if (conf.pythonPreload == "on") {
+        faabric::util::UniqueLock lock(prewarmMx);
+        prewarmThreads.emplace_back([] {
+            try {
+                preloadPythonRuntime();
+            } catch (std::exception& ex) {
+                SPDLOG_ERROR("Failed to preload python runtime: {}",
+                             ex.what());
+            }
+        });
+    }
+
+    // The messages are shared between the prewarm threads
+    auto msgs =
+      std::make_shared<std::vector<faabric::Message>>(getPrewarmMessages());
+    if (msgs->empty()) {
+        SPDLOG_INFO("No functions to prewarm");
+        return;
+    }
+
+    int nThreads = std::clamp<int>(conf.prewarmThreads, 1, msgs->size());
+    SPDLOG_INFO(
+      "Prewarming {} functions with {} threads", msgs->size(), nThreads);
+
+    // Threads pull functions off the list in order, so the hottest functions
+    // are warmed first
+    auto nextIdx = std::make_shared<std::atomic<size_t>>(0);
+
+    faabric::util::UniqueLock lock(prewarmMx);
+    for (int i = 0; i < nThreads; i++) {
+        prewarmThreads.emplace_back([msgs, nextIdx] {
+            faabric::util::TimePoint start = faabric::util::startTimer();
+
+            while (true) {
+                size_t idx = nextIdx->fetch_add(1);
+                if (idx >= msgs->size()) {
+                    break;
+                }
+
+                faabric::Message& msg = msgs->at(idx);
+                try {
+                    prewarmFunction(msg);
+                } catch (std::exception& ex) {
+                    SPDLOG_ERROR("Failed to prewarm {}: {}",
+                                 faabric::util::funcToString(msg, false),
+                                 ex.what());
+                }
+            }
+
+            SPDLOG_DEBUG("Prewarm thread finished after {}ms",
+                         faabric::util::getTimeDiffMillis(start));
+        });
+    }
+}
+
+void waitForPrewarm()
+{
+    faabric::util::UniqueLock lock(prewarmMx);
+    for (auto& t : prewarmThreads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+
+    prewarmThreads.clear();
+}
+
+void registerWorkerMetrics()
+{
+    metrics::registerGauge(
+      "faasm_wavm_cached_modules", "Modules in the WAVM module cache", [] {
+          return wasm::getWAVMModuleCache().getTotalCachedModuleCount();
+      });
+    metrics::registerGauge(
+      "faasm_wamr_cached_modules", "Modules in the WAMR module cache", [] {
+          return wasm::getWAMRModuleCache().getTotalCachedModuleCount();
+      });
+
+    metrics::registerGauge("faasm_netns_pool_size",
+                           "Network namespaces in the pool",
+                           [] { return getNetworkNamespacePoolStats().size; });
+    metrics::registerGauge("faasm_netns_pool_free",
+                           "Network namespaces in the pool not yet claimed",
+                           [] { return getNetworkNamespacePoolStats().free; });
+    metrics::registerCounterCallback(
+      "faasm_netns_claims_exhausted_total",
+      "Network namespace claims that found the pool empty",
+      [] { return getNetworkNamespacePoolStats().exhausted; });
+
+    metrics::registerCounterCallback(
+      "faasm_cgroup_adds_total",
+      "Threads moved into a cgroup",
+      [] { return getIsolationMetrics().cgroupAdds; });
+    metrics::registerCounterCallback(
+      "faasm_netns_adds_total",
+      "Threads moved into a network namespace",
+      [] { return getIsolationMetrics().netNsAdds; });
+    metrics::registerCounterCallback(
+      "faasm_isolation_reused_total",
+      "Tasks run on a thread already isolated for their tenant",
+      [] { return getIsolationMetrics().reused; });
+
+    metrics::registerCounterCallback(
+      "faasm_cgroup_cpu_seconds_total",
+      "CPU time used by all Faaslet threads",
+      [] { return CGroup(BASE_CGROUP_NAME).getUsage().cpuMicros / 1e6; });
+    metrics::registerGauge(
+      "faasm_cgroup_memory_bytes",
+      "Memory charged to Faaslets, only known under cgroup v2",
+      [] { return CGroup(BASE_CGROUP_NAME).getUsage().memoryBytes; });
+
+    metrics::registerGauge("faasm_page_store_refs",
+                           "Snapshot pages held in the page store",
+                           [] { return wasm::getPageStore().getStats().refs; });
+    metrics::registerGauge(
+      "faasm_page_store_pages",
+      "Distinct snapshot pages stored in the page store",
+      [] { return wasm::getPageStore().getStats().stored; });
+
+    metrics::registerGauge(
+      "faasm_state_replicas",
+      "Local replicas of state mastered on other hosts",
+      [] { return wasm::getStateReplicaCache().getStats().replicas; });
+    metrics::registerGauge(
+      "faasm_state_replica_bytes",
+      "Bytes held in local replicas of state mastered on other hosts",
+      [] { return wasm::getStateReplicaCache().getStats().bytes; });
+    metrics::registerCounterCallback(
+      "faasm_state_replica_hits_total",
+      "State lookups that found the value already tracked on this host",
+      [] { return wasm::getStateReplicaCache().getStats().hits; });
+    metrics::registerCounterCallback(
+      "faasm_state_replica_misses_total",
+      "State lookups for values not yet tracked on this host",
+      [] { return wasm::getStateReplicaCache().getStats().misses; });
+    metrics::registerCounterCallback(
+      "faasm_state_replica_evictions_total",
+      "State replicas dropped to stay within the replica budget",
+      [] { return wasm::getStateReplicaCache().getStats().evictions; });
+
+    metrics::registerGauge(
+      "faasm_faaslet_resident_bytes",
+      "Resident linear memory of all Faaslets' modules",
+      [] {
+          size_t total = 0;
+          for (const auto& f : getFaasletMemoryUsage()) {
+              total += f.modules.residentBytes;
+          }
+          return total;
+      });
+    metrics::registerGauge(
+      "faasm_faaslet_private_bytes",
+      "Resident linear memory of all Faaslets not shared with a snapshot",
+      [] {
+          size_t total = 0;
+          for (const auto& f : getFaasletMemoryUsage()) {
+              total += f.modules.privateBytes;
+          }
+          return total;
+      });
+    metrics::registerGauge(
+      "faasm_faaslet_host_buffer_bytes",
+      "Memory the host holds on behalf of Faaslets' modules",
+      [] {
+          size_t total = 0;
+          for (const auto& f : getFaasletMemoryUsage()) {
+              total += f.modules.hostBufferBytes;
+          }
+          return total;
+      });
+    metrics::registerPage(MEMORY_URL_PATH, dumpMemoryUsage);
+
+    metrics::registerGauge(
+      "faasm_faaslet_admission_waiting",
+      "Faaslet creations waiting for the host to have room",
+      [] { return getFaasletAdmissionStats().waiting; });
+    metrics::registerCounterCallback(
+      "faasm_faaslet_admission_rejected_total",
+      "Faaslet creations rejected as the host had no room",
+      [] { return getFaasletAdmissionStats().rejected; });
+}
+
+// -------------------------------------
+// ADMISSION
+// -------------------------------------
+
+// How often waiting creations check for room, as memory can be freed without
+// any Faaslet being destroyed
+#define ADMISSION_POLL_MS 50
+
+static std::mutex admissionMx;
+static std::condition_variable admissionCv;
+static size_t admissionWaiting = 0;
+static size_t admissionsInFlight = 0;
+static std::atomic<uint64_t> admissionRejected = 0;
+
+// MemAvailable from /proc/meminfo, or -1 if it can't be read
+static long getAvailableMemMb()
+{
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key;
+    long valueKb;
+    std::string unit;
+    while (meminfo >> key >> valueKb >> unit) {
+        if (key == "MemAvailable:") {
+            return valueKb / 1024;
+        }
+    }
+
+    return -1;
+}
+
+// Must hold the admission lock. Faaslets admitted but not yet created are
+// counted against the room, as what they'll use doesn't show yet.
+static bool hostHasRoom(std::string& reason)
+{
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+    if (conf.faasletMinFreeMemMb > 0) {
+        long availableMb = getAvailableMemMb();
+        if (availableMb >= 0 && availableMb < conf.faasletMinFreeMemMb) {
+            reason = fmt::format("{}MB available", availableMb);
+            return false;
+        }
+
+        // We can't tell how much memory a Faaslet being created will take
+        if (admissionsInFlight > 0) {
+            reason = fmt::format("{} creations in flight", admissionsInFlight);
+            return false;
+        }
+    }
+
+    if (conf.netNsMode == "on") {
+        NetworkNamespacePoolStats stats = getNetworkNamespacePoolStats();
+        if (stats.size > 0 && stats.free <= admissionsInFlight) {
+            reason = fmt::format("{} free network namespaces, {} in flight",
+                                 stats.free,
+                                 admissionsInFlight);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void admitFaaslet(const faabric::Message& msg)
+{
+    std::unique_lock<std::mutex> lock(admissionMx);
+
+    std::string reason;
+    if (hostHasRoom(reason)) {
+        admissionsInFlight++;
+        return;
+    }
+
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+    std::string funcStr = faabric::util::funcToString(msg, false);
+
+    if (admissionWaiting >= (size_t)conf.faasletAdmissionQueue) {
+        admissionRejected++;
+        SPDLOG_WARN(
+          "Rejecting Faaslet for {}, queue full ({})", funcStr, reason);
+        throw std::runtime_error("Host has no room for a new Faaslet");
+    }
+
+    SPDLOG_DEBUG("Faaslet for {} waiting for room ({})", funcStr, reason);
+    admissionWaiting++;
+
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(conf.faasletAdmissionTimeoutMs);
+    bool admitted = false;
+    while (std::chrono::steady_clock::now() < deadline) {
+        auto wakeUp = std::min(deadline,
+                               std::chrono::steady_clock::now() +
+                                 std::chrono::milliseconds(ADMISSION_POLL_MS));
+        admissionCv.wait_until(lock, wakeUp);
+
+        if (hostHasRoom(reason)) {
+            admitted = true;
+            break;
+        }
+    }
+
+    admissionWaiting--;
+
+    if (admitted) {
+        admissionsInFlight++;
+    } else {
+        admissionRejected++;
+        SPDLOG_WARN(
+          "Rejecting Faaslet for {}, timed out ({})", funcStr, reason);
+        throw std::runtime_error(
+          "Timed out waiting for room for a new Faaslet");
+    }
+}
+
+void finishFaasletAdmission()
+{
+    {
+        std::unique_lock<std::mutex> lock(admissionMx);
+        if (admissionsInFlight > 0) {
+            admissionsInFlight--;
+        }
+    }
+
+    admissionCv.notify_one();
+}
+
+void notifyFaasletReleased()
+{
+    // Each release makes room for one creation, and any others still find
+    // room when they next poll
+    admissionCv.notify_one();
+}
+
+FaasletAdmissionStats getFaasletAdmissionStats()
+{
+    FaasletAdmissionStats stats;
+    {
+        std::unique_lock<std::mutex> lock(admissionMx);
+        stats.waiting = admissionWaiting;
+        stats.inFlight = admissionsInFlight;
+    }
+    stats.rejected = admissionRejected.load();
+
+    return stats;
+}
+
+void resetFaasletAdmissionStats()
+{
+    admissionRejected = 0;
+}
+
+// -------------------------------------
+// MEMORY ACCOUNTING
+// -------------------------------------
+
+// Faaslets take themselves out before any of their modules go, so holding the
+// lock keeps the ones listed alive while they're read
+static std::mutex liveFaasletsMx;
+static std::set<Faaslet*> liveFaaslets;
+
+static void addLiveFaaslet(Faaslet* faaslet)
+{
+    faabric::util::UniqueLock lock(liveFaasletsMx);
+    liveFaaslets.insert(faaslet);
+}
+
+static void removeLiveFaaslet(Faaslet* faaslet)
+{
+    faabric::util::UniqueLock lock(liveFaasletsMx);
+    liveFaaslets.erase(faaslet);
+}
+
+std::vector<FaasletMemoryUsage> getFaasletMemoryUsage()
+{
+    faabric::util::UniqueLock lock(liveFaasletsMx);
+
+    std::vector<FaasletMemoryUsage> usage;
+    for (Faaslet* faaslet : liveFaaslets) {
+        usage.emplace_back(faaslet->getMemoryUsage());
+    }
+
+    return usage;
+}
+
+static size_t getSnapshotBytes(const std::string& snapKey)
+{
+    if (conf::getFaasmConfig().snapshotPageDedup == "on") {
+        std::shared_ptr<wasm::PagedSnapshot> paged =
+          wasm::getPageStore().getSnapshot(snapKey);
+        return paged == nullptr ? 0 : paged->getSize();
+    }
+
+    faabric::snapshot::SnapshotRegistry& reg =
+      faabric::snapshot::getSnapshotRegistry();
+    if (!reg.snapshotExists(snapKey)) {
+        return 0;
+    }
+
+    return reg.getSnapshot(snapKey)->getSize();
+}
+
+std::vector<FunctionMemoryUsage> getFunctionMemoryUsage()
+{
+    std::map<std::string, FunctionMemoryUsage> functions;
+    auto getFunction = [&functions](const std::string& user,
+                                    const std::string& function) {
+        FunctionMemoryUsage& f = functions[user + "/" + function];
+        f.user = user;
+        f.function = function;
+        return &f;
+    };
+
+    std::map<std::string, std::set<std::string>> snapKeys;
+    for (const FaasletMemoryUsage& faaslet : getFaasletMemoryUsage()) {
+        FunctionMemoryUsage* f = getFunction(faaslet.user, faaslet.function);
+        f->nFaaslets++;
+        f->modules += faaslet.modules;
+
+        if (!faaslet.resetSnapshotKey.empty()) {
+            snapKeys[f->user + "/" + f->function].insert(
+              faaslet.resetSnapshotKey);
+        }
+    }
+
+    for (const auto& [funcStr, keys] : snapKeys) {
+        for (const std::string& key : keys) {
+            functions[funcStr].snapshotBytes += getSnapshotBytes(key);
+        }
+    }
+
+    // Functions with no Faaslets left still hold their reset snapshot in the
+    // WAVM cache
+    for (const auto& e : wasm::getWAVMModuleCache().getEntryStats()) {
+        FunctionMemoryUsage* f = getFunction(e.user, e.function);
+        f->cachedModuleBytes += e.moduleBytes;
+        if (f->nFaaslets == 0) {
+            f->snapshotBytes += e.snapshotBytes;
+        }
+    }
+
+    for (const auto& e : wasm::getWAMRModuleCache().getEntryStats()) {
+        getFunction(e.user, e.function)->cachedModuleBytes += e.moduleBytes;
+    }
+
+    std::vector<FunctionMemoryUsage> usage;
+    for (auto& [funcStr, f] : functions) {
+        usage.emplace_back(std::move(f));
+    }
+
+    return usage;
+}
+
+static void writeModuleMemoryUsage(std::stringstream& out,
+                                   const wasm::ModuleMemoryUsage& usage)
+{
+    out << "\"linear_memory_bytes\":" << usage.linearMemoryBytes
+        << ",\"resident_bytes\":" << usage.residentBytes
+        << ",\"private_bytes\":" << usage.privateBytes
+        << ",\"host_buffer_bytes\":" << usage.hostBufferBytes;
+}
+
+std::string dumpMemoryUsage()
+{
+    std::vector<FaasletMemoryUsage> faaslets = getFaasletMemoryUsage();
+    std::vector<FunctionMemoryUsage> functions = getFunctionMemoryUsage();
+
+    std::stringstream out;
+    out << "{\"faaslets\":[";
+    for (size_t i = 0; i < faaslets.size(); i++) {
+        const FaasletMemoryUsage& f = faaslets.at(i);
+        if (i > 0) {
+            out << ",";
+        }
+
+        out << "{\"id\":" << f.faasletId << ",\"user\":\"" << f.user
+            << "\",\"function\":\"" << f.function
+            << "\",\"modules\":" << f.nModules << ",";
+        writeModuleMemoryUsage(out, f.modules);
+        out << "}";
+    }
+
+    out << "],\"functions\":[";
+    for (size_t i = 0; i < functions.size(); i++) {
+        const FunctionMemoryUsage& f = functions.at(i);
+        if (i > 0) {
+            out << ",";
+        }
+
+        out << "{\"user\":\"" << f.user << "\",\"function\":\""
+            << f.function << "\",\"faaslets\":" << f.nFaaslets << ",";
+        writeModuleMemoryUsage(out, f.modules);
+        out << ",\"snapshot_bytes\":" << f.snapshotBytes
+            << ",\"cached_module_bytes\":" << f.cachedModuleBytes << "}";
+    }
+    out << "]}";
+
+    return out.str();
 }
 
+// -------------------------------------
+// FAASLET
+// -------------------------------------
+
 Faaslet::Faaslet(faabric::Message& msg)
   : Executor(msg)
+  , faasletId(faabric::util::generateGid())
+  , user(msg.user())
+  , function(msg.function())
+{
+    faabric::util::TimePoint initStart = faabric::util::startTimer();
+
+    bindModule(msg);
+
+    initMicros = faabric::util::getTimeDiffMicros(initStart);
+
+    addLiveFaaslet(this);
+}
+
+void Faaslet::bindModule(faabric::Message& msg)
 {
     conf::FaasmConfig& conf = conf::getFaasmConfig();
 
+    profile = wasm::getFunctionProfile(msg);
+    wasmVm = wasm::getFunctionWasmVm(msg);
+
     // Instantiate the right wasm module for the chosen runtime
-    if (conf.wasmVm == "sgx") {
+    module = createModule();
+
+    // Bind to the function
+    module->bindToFunction(msg);
+
+    // Create the reset snapshot for this function if it doesn't already exist
+    // (SGX modules reset by re-instantiating inside the enclave instead)
+    if (wasmVm == "wavm") {
+        localResetSnapshotKey =
+          wasm::getWAVMModuleCache().registerResetSnapshot(*module, msg);
+    } else if (wasmVm == "wamr") {
+        localResetSnapshotKey =
+          wasm::getWAMRModuleCache().registerResetSnapshot(*module, msg);
+    }
+
+    // The pool restores reset snapshots, so isn't used for SGX
+    if (conf.resetPoolSize > 0 && !localResetSnapshotKey.empty()) {
+        startResetPool(msg);
+    }
+}
+
+Faaslet::~Faaslet()
+{
+    removeLiveFaaslet(this);
+
+    stopResetPool();
+
+    notifyFaasletReleased();
+}
+
+std::unique_ptr<wasm::WasmModule> Faaslet::createModule()
+{
+    std::unique_ptr<wasm::WasmModule> newModule;
+    if (wasmVm == "sgx") {
 #ifndef FAASM_SGX_DISABLED_MODE
-        module = std::make_unique<wasm::EnclaveInterface>();
+        newModule = std::make_unique<wasm::EnclaveInterface>();
 #else
         SPDLOG_ERROR(
           "SGX WASM VM selected, but SGX support disabled in config");
         throw std::runtime_error("SGX support disabled in config");
 #endif
-    } else if (conf.wasmVm == "wamr") {
+    } else if (wasmVm == "wamr") {
         // Vanilla WAMR
-        module = std::make_unique<wasm::WAMRWasmModule>(threadPoolSize);
-    } else if (conf.wasmVm == "wavm") {
-        module = std::make_unique<wasm::WAVMWasmModule>(threadPoolSize);
+        newModule = std::make_unique<wasm::WAMRWasmModule>(threadPoolSize);
+    } else if (wasmVm == "wavm") {
+        newModule = std::make_unique<wasm::WAVMWasmModule>(threadPoolSize);
     } else {
-
-        SPDLOG_ERROR("Unrecognised wasm VM: {}", conf.wasmVm);
+        SPDLOG_ERROR("Unrecognised wasm VM: {}", wasmVm);
         throw std::runtime_error("Unrecognised wasm VM");
     }
 
-    // Bind to the function
-    module->bindToFunction(msg);
+    newModule->setMemoryPagesLimit(profile.maxMemoryPages);
 
-    // Create the reset snapshot for this function if it doesn't already exist
-    // (currently only supported in WAVM)
-    if (conf.wasmVm == "wavm") {
-        localResetSnapshotKey =
-          wasm::getWAVMModuleCache().registerResetSnapshot(*module, msg);
+    return newModule;
+}
+
+void Faaslet::startResetPool(faabric::Message& msg)
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+
+    // Freshly bound modules are as good as reset ones
+    for (int i = 0; i < conf.resetPoolSize; i++) {
+        std::unique_ptr<wasm::WasmModule> spare = createModule();
+        spare->bindToFunction(msg);
+        cleanModules.emplace_back(std::move(spare));
     }
+
+    resetPoolRunning = true;
+    resetThread = std::thread([this] {
+        faabric::util::UniqueLock lock(resetPoolMx);
+        while (true) {
+            resetPoolCv.wait(lock, [this] {
+                return !resetPoolRunning || !dirtyModules.empty();
+            });
+
+            if (dirtyModules.empty()) {
+                break;
+            }
+
+            auto [dirty, dirtyMsg] = std::move(dirtyModules.front());
+            dirtyModules.pop_front();
+
+            // Reset without holding the lock, so the executor can still swap
+            // in clean modules
+            lock.unlock();
+            bool success = true;
+            try {
+                dirty->reset(dirtyMsg, localResetSnapshotKey);
+            } catch (std::exception& ex) {
+                SPDLOG_ERROR("Failed to reset pooled module for {}: {}",
+                             faabric::util::funcToString(dirtyMsg, false),
+                             ex.what());
+                success = false;
+            }
+            lock.lock();
+
+            // Modules that failed to reset are dropped, and the pool shrinks
+            if (success) {
+                cleanModules.emplace_back(std::move(dirty));
+            }
+        }
+    });
+
+    SPDLOG_DEBUG("Started reset pool of {} modules for {}",
+                 conf.resetPoolSize,
+                 faabric::util::funcToString(msg, false));
+}
+
+void Faaslet::stopResetPool()
+{
+    {
+        faabric::util::UniqueLock lock(resetPoolMx);
+        if (!resetPoolRunning) {
+            return;
+        }
+
+        resetPoolRunning = false;
+    }
+
+    // Any outstanding resets are finished before the thread exits
+    resetPoolCv.notify_one();
+    if (resetThread.joinable()) {
+        resetThread.join();
+    }
+
+    cleanModules.clear();
+}
+
+size_t Faaslet::getCleanModuleCount()
+{
+    faabric::util::UniqueLock lock(resetPoolMx);
+    return cleanModules.size();
+}
+
+FaasletMemoryUsage Faaslet::getMemoryUsage()
+{
+    FaasletMemoryUsage usage;
+    usage.faasletId = faasletId;
+    usage.user = user;
+    usage.function = function;
+    usage.resetSnapshotKey = localResetSnapshotKey;
+
+    // Modules are only swapped in and out of the pool under its lock. The one
+    // being reset in the background isn't held by either queue, so is left
+    // out until it's back.
+    faabric::util::UniqueLock lock(resetPoolMx);
+    if (module != nullptr) {
+        usage.modules += module->getMemoryUsage();
+        usage.nModules++;
+    }
+
+    for (const auto& m : cleanModules) {
+        usage.modules += m->getMemoryUsage();
+        usage.nModules++;
+    }
+
+    for (const auto& [m, msg] : dirtyModules) {
+        usage.modules += m->getMemoryUsage();
+        usage.nModules++;
+    }
+
+    return usage;
 }
 
 int32_t Faaslet::executeTask(int threadPoolIdx,
@@ -99,20 +889,100 @@ int32_t Faaslet::executeTask(int threadPoolIdx,
     // Because this is a thread-specific operation we don't need any
     // synchronisation here, and rely on the cgroup and network namespace
     // operations being thread-safe.
+    faabric::Message& msg = req->mutable_messages()->at(msgIdx);
+    recordPhase(msg, PHASE_TASK_START, getEpochMicros());
 
-    if (!threadIsIsolated) {
-        // Add this thread to the cgroup
-        CGroup cgroup(BASE_CGROUP_NAME);
-        cgroup.addCurrentThread();
+    if (!initRecorded) {
+        recordPhase(msg, PHASE_FAASLET_INIT, initMicros);
+        initRecorded = true;
+    }
+
+    // Cached results are handed back without touching the module, so there's
+    // nothing to reset afterwards either
+    std::string cachedOutput;
+    lastCallCached = wasm::lookupCachedResult(msg, cachedOutput);
+    if (lastCallCached) {
+        SPDLOG_DEBUG("Answering {} from the result cache",
+                     faabric::util::funcToString(msg, true));
+        msg.set_outputdata(std::move(cachedOutput));
+        recordPhase(msg, PHASE_TASK_END, getEpochMicros());
+        wasm::notifyChainedResult(msg.id(), { 0, msg.outputdata() });
+        return 0;
+    }
+
+    std::string cgroupGranularity = profile.cgroupGranularity.empty()
+                                      ? conf::getFaasmConfig().cgroupGranularity
+                                      : profile.cgroupGranularity;
+    std::string cgroupName =
+      getCgroupNameForFunction(msg.user(), msg.function(), cgroupGranularity);
+
+    bool cgroupChanged = cgroupName != threadIsolation.cgroupName;
+    bool userChanged = threadIsolation.ns == nullptr ||
+                       msg.user() != threadIsolation.user;
 
-        // Set up network namespace
-        ns = claimNetworkNamespace();
-        ns->addCurrentThread();
+    if (cgroupChanged || userChanged) {
+        faabric::util::TimePoint start = faabric::util::startTimer();
 
-        threadIsIsolated = true;
+        if (cgroupChanged) {
+            CGroup cgroup(cgroupName);
+            cgroup.addCurrentThread();
+            threadIsolation.cgroupName = cgroupName;
+        }
+
+        isolation::pinCurrentThread();
+
+        // A different tenant gets a different namespace, so nothing left in
+        // the old one is shared with it
+        if (userChanged) {
+            if (threadIsolation.ns != nullptr) {
+                returnNetworkNamespace(threadIsolation.ns);
+                threadIsolation.ns = nullptr;
+            }
+
+            threadIsolation.ns = claimNetworkNamespace();
+            threadIsolation.ns->shapeEgress(msg.user());
+            threadIsolation.ns->addCurrentThread();
+            threadIsolation.user = msg.user();
+        }
+
+        recordPhase(msg,
+                    PHASE_ISOLATION_SETUP,
+                    faabric::util::getTimeDiffMicros(start));
+    } else {
+        recordIsolationReused();
     }
 
-    int32_t returnValue = module->executeTask(threadPoolIdx, msgIdx, req);
+    // All Python functions share a Faaslet, but with PYTHON_IMPORT_ZYGOTE each
+    // has its own zygote, so a different one means rebinding
+    if (module->getBoundZygoteKey() != wasm::getZygoteKey(msg)) {
+        SPDLOG_DEBUG("Rebinding Faaslet from {} to {}",
+                     module->getBoundZygoteKey(),
+                     wasm::getZygoteKey(msg));
+        stopResetPool();
+        bindModule(msg);
+    }
+
+    // Callers on this host are told the result straight away, rather than
+    // waiting for it to reach the scheduler. Migrated calls finish elsewhere.
+    int32_t returnValue;
+    faabric::util::TimePoint execStart = faabric::util::startTimer();
+    lastCallFailed = true;
+    try {
+        returnValue = module->executeTask(threadPoolIdx, msgIdx, req);
+    } catch (faabric::util::FunctionMigratedException& e) {
+        throw;
+    } catch (std::exception& e) {
+        wasm::notifyChainedResult(msg.id(), { 1, e.what() });
+        throw;
+    }
+    lastCallFailed = false;
+
+    recordPhase(
+      msg, PHASE_EXECUTE, faabric::util::getTimeDiffMicros(execStart));
+    recordPhase(msg, PHASE_TASK_END, getEpochMicros());
+
+    wasm::storeCachedResult(msg, returnValue);
+    wasm::notifyChainedResult(msg.id(), { returnValue, msg.outputdata() });
 
     return returnValue;
 }
@@ -120,16 +990,64 @@ int32_t Faaslet::executeTask(int threadPoolIdx,
 void Faaslet::reset(faabric::Message& msg)
 {
     faabric::scheduler::Executor::reset(msg);
-    module->reset(msg, localResetSnapshotKey);
+
+    if (lastCallCached) {
+        return;
+    }
+
+    if (keepBatchInstance(msg)) {
+        module->setBatchIndex(module->getBatchIndex() + 1);
+        return;
+    }
+
+    metrics::TraceScope trace(metrics::TraceEvent::Reset);
+
+    // The last call in a batch is reset before its result is sent, so the
+    // time taken goes along with it
+    faabric::util::TimePoint start = faabric::util::startTimer();
+
+    // Swap in a clean module if there is one, otherwise reset in place
+    bool swapped = false;
+    {
+        faabric::util::UniqueLock lock(resetPoolMx);
+        if (resetPoolRunning && !cleanModules.empty()) {
+            dirtyModules.emplace_back(std::move(module), msg);
+            module = std::move(cleanModules.front());
+            cleanModules.pop_front();
+            swapped = true;
+        }
+    }
+
+    if (swapped) {
+        resetPoolCv.notify_one();
+    } else {
+        module->reset(msg, localResetSnapshotKey);
+    }
+    module->setBatchIndex(0);
+
+    recordPhase(msg, PHASE_RESET, faabric::util::getTimeDiffMicros(start));
 }
 
-void Faaslet::shutdown()
+bool Faaslet::keepBatchInstance(const faabric::Message& msg)
 {
-    if (ns != nullptr) {
-        ns->removeCurrentThread();
-        returnNetworkNamespace(ns);
+    // Failed calls may have left the instance in any state, and threads run
+    // from snapshots, so both are always reset
+    int interval = conf::getFaasmConfig().batchResetInterval;
+    if (interval <= 1 || lastCallFailed || msg.returnvalue() != 0 ||
+        msg.funcptr() > 0) {
+        return false;
     }
 
+    return module->getBatchIndex() + 1 < interval && module->hasBatchHandler();
+}
+
+void Faaslet::shutdown()
+{
+    stopResetPool();
+
+    // Don't wait for calls that are sleeping to finish their sleeps
+    wasm::wakeSleepingCalls(module.get());
+
     Executor::shutdown();
 }
 
@@ -140,6 +1058,9 @@ std::span<uint8_t> Faaslet::getMemoryView()
 
 void Faaslet::setMemorySize(size_t newSize)
 {
+    // The executor only sets the size to map a snapshot over the memory,
+    // which replaces any thread stacks in it
+    module->clearThreadStacks();
     module->setMemorySize(newSize);
 }
 
@@ -153,24 +1074,104 @@ std::string Faaslet::getLocalResetSnapshotKey()
     return localResetSnapshotKey;
 }
 
-FaasletFactory::~FaasletFactory() {}
+FaasletFactory::~FaasletFactory()
+{
+    clearWarmFaaslets();
+}
 
 std::shared_ptr<faabric::scheduler::Executor> FaasletFactory::createExecutor(
   faabric::Message& msg)
 {
-    return std::make_shared<Faaslet>(msg);
+    std::shared_ptr<Faaslet> warm = claimWarmFaaslet(msg);
+    if (warm != nullptr) {
+        return warm;
+    }
+
+    admitFaaslet(msg);
+
+    std::shared_ptr<Faaslet> faaslet;
+    try {
+        faaslet = std::make_shared<Faaslet>(msg);
+    } catch (...) {
+        finishFaasletAdmission();
+        throw;
+    }
+    finishFaasletAdmission();
+
+    return faaslet;
+}
+
+void FaasletFactory::prewarmFaaslets(faabric::Message& msg, int n)
+{
+    // Faaslets are created outside the lock, as binding takes a while
+    std::vector<std::shared_ptr<Faaslet>> faaslets;
+    for (int i = 0; i < n; i++) {
+        faaslets.emplace_back(std::make_shared<Faaslet>(msg));
+    }
+
+    std::string funcStr = faabric::util::funcToString(msg, false);
+    faabric::util::UniqueLock lock(warmFaasletsMx);
+    auto& pool = warmFaaslets[funcStr];
+    pool.insert(pool.end(), faaslets.begin(), faaslets.end());
+
+    SPDLOG_DEBUG("{} warm Faaslets for {}", pool.size(), funcStr);
+}
+
+std::shared_ptr<Faaslet> FaasletFactory::claimWarmFaaslet(
+  const faabric::Message& msg)
+{
+    faabric::util::UniqueLock lock(warmFaasletsMx);
+    auto it = warmFaaslets.find(faabric::util::funcToString(msg, false));
+    if (it == warmFaaslets.end() || it->second.empty()) {
+        return nullptr;
+    }
+
+    std::shared_ptr<Faaslet> faaslet = std::move(it->second.back());
+    it->second.pop_back();
+
+    return faaslet;
+}
+
+size_t FaasletFactory::getWarmFaasletCount(const faabric::Message& msg)
+{
+    faabric::util::UniqueLock lock(warmFaasletsMx);
+    auto it = warmFaaslets.find(faabric::util::funcToString(msg, false));
+    return it == warmFaaslets.end() ? 0 : it->second.size();
+}
+
+void FaasletFactory::clearWarmFaaslets()
+{
+    std::unordered_map<std::string, std::vector<std::shared_ptr<Faaslet>>>
+      faaslets;
+    {
+        faabric::util::UniqueLock lock(warmFaasletsMx);
+        faaslets.swap(warmFaaslets);
+    }
+
+    for (auto& [funcStr, pool] : faaslets) {
+        for (auto& faaslet : pool) {
+            faaslet->shutdown();
+        }
+    }
 }
 
 void FaasletFactory::flushHost()
 {
+    // Warm Faaslets hold modules bound from the caches being flushed
+    clearWarmFaaslets();
+
     // Clear cached wasm and object files
     storage::FileLoader& fileLoader = storage::getFileLoader();
     fileLoader.clearLocalCache();
 
-    // WAVM-specific flushing
-    const conf::FaasmConfig& conf = conf::getFaasmConfig();
-    if (conf.wasmVm == "wavm") {
-        wasm::WAVMWasmModule::clearCaches();
-    }
+    // Functions can pick their own runtime, so any of the caches may be used
+    wasm::WAVMWasmModule::clearCaches();
+    wasm::WAMRWasmModule::clearCaches();
+    wasm::getPageStore().clear();
+    wasm::getDiskStateStore().clear();
+    wasm::getStateReplicaCache().clear();
+
+    // Profiles may have changed along with the functions
+    wasm::clearFunctionProfiles();
 }
 }
@@ -0,0 +1,280 @@
+#include <metrics/LifecycleTrace.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define RING_MASK (LIFECYCLE_TRACE_RING_SIZE - 1)
+
+static_assert((LIFECYCLE_TRACE_RING_SIZE & RING_MASK) == 0,
+              "Lifecycle trace ring size must be a power of two");
+
+namespace metrics {
+
+/**
+ * Each slot is a tiny seqlock. The owning thread zeroes the sequence number
+ * before writing the fields and sets it after, so readers on other threads
+ * can tell when they've read a slot mid-write and skip it.
+ */
+struct TraceSlot
+{
+    std::atomic<uint64_t> seq = 0;
+    std::atomic<uint64_t> startNanos = 0;
+    std::atomic<uint64_t> durationNanos = 0;
+    std::atomic<uint64_t> arg = 0;
+
+    // Event in the low byte, message ID above it
+    std::atomic<uint64_t> meta = 0;
+};
+
+struct TraceRing
+{
+    std::array<TraceSlot, LIFECYCLE_TRACE_RING_SIZE> slots;
+
+    // Only written by the owning thread
+    std::atomic<uint64_t> head = 0;
+
+    // Events up to this sequence number have been cleared
+    std::atomic<uint64_t> clearedSeq = 0;
+
+    std::atomic<int32_t> tid = 0;
+
+    // Guarded by the registry mutex
+    bool inUse = false;
+};
+
+static std::mutex ringsMx;
+
+// Rings are never freed, those of threads that have exited are reused
+static std::vector<std::unique_ptr<TraceRing>> rings;
+
+static TraceRing* claimRing()
+{
+    faabric::util::UniqueLock lock(ringsMx);
+    TraceRing* ring = nullptr;
+    for (auto& r : rings) {
+        if (!r->inUse) {
+            ring = r.get();
+            break;
+        }
+    }
+
+    if (ring == nullptr) {
+        rings.emplace_back(std::make_unique<TraceRing>());
+        ring = rings.back().get();
+    }
+
+    ring->inUse = true;
+    ring->tid.store(syscall(SYS_gettid), std::memory_order_relaxed);
+
+    return ring;
+}
+
+struct ThreadTrace
+{
+    TraceRing* ring = nullptr;
+    int32_t msgId = 0;
+
+    ~ThreadTrace()
+    {
+        if (ring != nullptr) {
+            faabric::util::UniqueLock lock(ringsMx);
+            ring->inUse = false;
+        }
+    }
+};
+
+static thread_local ThreadTrace threadTrace;
+
+static TraceRing& getThreadRing()
+{
+    if (threadTrace.ring == nullptr) {
+        threadTrace.ring = claimRing();
+    }
+
+    return *threadTrace.ring;
+}
+
+std::string traceEventName(TraceEvent event)
+{
+    switch (event) {
+        case TraceEvent::Bind:
+            return "bind";
+        case TraceEvent::Reset:
+            return "reset";
+        case TraceEvent::SnapshotRestore:
+            return "snapshot-restore";
+        case TraceEvent::ThreadFork:
+            return "thread-fork";
+        case TraceEvent::ThreadJoin:
+            return "thread-join";
+        case TraceEvent::MigrationPoint:
+            return "migration-point";
+        case TraceEvent::ChainedCall:
+            return "chained-call";
+        case TraceEvent::ChainedAwait:
+            return "chained-await";
+        case TraceEvent::StatePush:
+            return "state-push";
+        case TraceEvent::StatePull:
+            return "state-pull";
+        default: {
+            SPDLOG_ERROR("Unrecognised trace event {}", (int)event);
+            throw std::runtime_error("Unrecognised trace event");
+        }
+    }
+}
+
+uint64_t getTraceNanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void setTraceMessage(int32_t msgId)
+{
+    threadTrace.msgId = msgId;
+}
+
+void traceEvent(TraceEvent event,
+                uint64_t startNanos,
+                uint64_t durationNanos,
+                uint64_t arg)
+{
+    TraceRing& ring = getThreadRing();
+    uint64_t seq = ring.head.load(std::memory_order_relaxed) + 1;
+    TraceSlot& slot = ring.slots[seq & RING_MASK];
+
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    uint64_t meta = (uint64_t(uint32_t(threadTrace.msgId)) << 8) |
+                    uint64_t(static_cast<uint8_t>(event));
+    slot.startNanos.store(startNanos, std::memory_order_relaxed);
+    slot.durationNanos.store(durationNanos, std::memory_order_relaxed);
+    slot.arg.store(arg, std::memory_order_relaxed);
+    slot.meta.store(meta, std::memory_order_relaxed);
+
+    slot.seq.store(seq, std::memory_order_release);
+    ring.head.store(seq, std::memory_order_relaxed);
+}
+
+void traceInstant(TraceEvent event, uint64_t arg)
+{
+    traceEvent(event, getTraceNanos(), 0, arg);
+}
+
+std::vector<TraceRecord> getLifecycleTrace()
+{
+    std::vector<TraceRecord> records;
+
+    faabric::util::UniqueLock lock(ringsMx);
+    for (auto& ring : rings) {
+        int32_t tid = ring->tid.load(std::memory_order_relaxed);
+        uint64_t clearedSeq = ring->clearedSeq.load(std::memory_order_relaxed);
+
+        std::vector<std::pair<uint64_t, TraceRecord>> ringRecords;
+        for (auto& slot : ring->slots) {
+            uint64_t seqBefore = slot.seq.load(std::memory_order_acquire);
+            if (seqBefore <= clearedSeq) {
+                continue;
+            }
+
+            TraceRecord r;
+            r.tid = tid;
+            r.startNanos = slot.startNanos.load(std::memory_order_relaxed);
+            r.durationNanos =
+              slot.durationNanos.load(std::memory_order_relaxed);
+            r.arg = slot.arg.load(std::memory_order_relaxed);
+            uint64_t meta = slot.meta.load(std::memory_order_relaxed);
+
+            // Skip slots overwritten while we were reading them
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) != seqBefore) {
+                continue;
+            }
+
+            r.event = static_cast<TraceEvent>(meta & 0xFF);
+            r.msgId = int32_t(uint32_t(meta >> 8));
+            ringRecords.emplace_back(seqBefore, r);
+        }
+
+        std::sort(
+          ringRecords.begin(),
+          ringRecords.end(),
+          [](const auto& a, const auto& b) { return a.first < b.first; });
+        for (auto& [seq, r] : ringRecords) {
+            records.push_back(r);
+        }
+    }
+
+    return records;
+}
+
+std::string dumpLifecycleTrace()
+{
+    std::vector<TraceRecord> records = getLifecycleTrace();
+    int pid = getpid();
+
+    // Timestamps and durations are in microseconds
+    std::stringstream out;
+    out << "{\"traceEvents\":[";
+    for (size_t i = 0; i < records.size(); i++) {
+        const TraceRecord& r = records.at(i);
+        if (i > 0) {
+            out << ",";
+        }
+
+        out << "{\"name\":\"" << traceEventName(r.event)
+            << "\",\"cat\":\"faasm\",\"pid\":" << pid << ",\"tid\":" << r.tid
+            << ",\"ts\":" << fmt::format("{:.3f}", r.startNanos / 1000.0);
+
+        if (r.durationNanos > 0) {
+            out << ",\"ph\":\"X\",\"dur\":"
+                << fmt::format("{:.3f}", r.durationNanos / 1000.0);
+        } else {
+            out << ",\"ph\":\"i\",\"s\":\"t\"";
+        }
+
+        out << ",\"args\":{\"msg\":" << r.msgId << ",\"arg\":" << r.arg
+            << "}}";
+    }
+    out << "]}";
+
+    return out.str();
+}
+
+void clearLifecycleTrace()
+{
+    faabric::util::UniqueLock lock(ringsMx);
+    for (auto& ring : rings) {
+        ring->clearedSeq.store(ring->head.load(std::memory_order_relaxed),
+                               std::memory_order_relaxed);
+    }
+}
+
+TraceScope::TraceScope(TraceEvent eventIn, uint64_t argIn)
+  : event(eventIn)
+  , arg(argIn)
+  , startNanos(getTraceNanos())
+{}
+
+TraceScope::~TraceScope()
+{
+    // Zero durations are instants, so events always last at least 1ns
+    uint64_t duration = std::max<uint64_t>(getTraceNanos() - startNanos, 1);
+    traceEvent(event, startNanos, duration, arg);
+}
+}
@@ -0,0 +1,321 @@
+#include <metrics/Metrics.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+namespace metrics {
+
+enum class MetricType
+{
+    Counter,
+    Gauge,
+    Histogram
+};
+
+struct Metric
+{
+    MetricType type;
+    std::string help;
+
+    std::unique_ptr<Counter> counter;
+    std::unique_ptr<Histogram> histogram;
+
+    // Set for gauges and counters kept outside the registry
+    std::function<double()> read;
+};
+
+static std::mutex registryMx;
+
+static std::map<std::string, Metric> registry;
+
+static std::string getTypeName(MetricType type)
+{
+    switch (type) {
+        case MetricType::Counter:
+            return "counter";
+        case MetricType::Gauge:
+            return "gauge";
+        case MetricType::Histogram:
+            return "histogram";
+        default: {
+            SPDLOG_ERROR("Unrecognised metric type {}", (int)type);
+            throw std::runtime_error("Unrecognised metric type");
+        }
+    }
+}
+
+static std::string microsToSeconds(uint64_t micros)
+{
+    return fmt::format("{}", (double)micros / 1000000);
+}
+
+// Looks up a metric that must have the given type if it already exists
+static Metric* findMetric(const std::string& name, MetricType type)
+{
+    auto it = registry.find(name);
+    if (it == registry.end()) {
+        return nullptr;
+    }
+
+    if (it->second.type != type) {
+        SPDLOG_ERROR("Metric {} is a {}, not a {}",
+                     name,
+                     getTypeName(it->second.type),
+                     getTypeName(type));
+        throw std::runtime_error("Metric registered with another type");
+    }
+
+    return &it->second;
+}
+
+Histogram::Histogram(std::vector<uint64_t> boundsMicrosIn)
+  : boundsMicros(std::move(boundsMicrosIn))
+  , buckets(new std::atomic<uint64_t>[boundsMicros.size() + 1])
+{
+    if (!std::is_sorted(boundsMicros.begin(), boundsMicros.end())) {
+        throw std::runtime_error("Histogram bounds must be sorted");
+    }
+
+    reset();
+}
+
+void Histogram::observe(uint64_t micros)
+{
+    size_t bucket =
+      std::lower_bound(boundsMicros.begin(), boundsMicros.end(), micros) -
+      boundsMicros.begin();
+
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sumMicros.fetch_add(micros, std::memory_order_relaxed);
+}
+
+std::vector<uint64_t> Histogram::getBucketCounts() const
+{
+    std::vector<uint64_t> counts(boundsMicros.size() + 1);
+    for (size_t i = 0; i < counts.size(); i++) {
+        counts[i] = buckets[i].load(std::memory_order_relaxed);
+    }
+
+    return counts;
+}
+
+void Histogram::reset()
+{
+    for (size_t i = 0; i < boundsMicros.size() + 1; i++) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+
+    count.store(0, std::memory_order_relaxed);
+    sumMicros.store(0, std::memory_order_relaxed);
+}
+
+std::vector<uint64_t> getDefaultLatencyBoundsMicros()
+{
+    return { 1000,   2500,   5000,    10000,   25000,   50000,
+             100000, 250000, 500000, 1000000, 2500000, 10000000 };
+}
+
+Counter& getCounter(const std::string& name, const std::string& help)
+{
+    faabric::util::UniqueLock lock(registryMx);
+    Metric* metric = findMetric(name, MetricType::Counter);
+    if (metric == nullptr) {
+        metric = &registry[name];
+        metric->type = MetricType::Counter;
+        metric->help = help;
+        metric->counter = std::make_unique<Counter>();
+    } else if (metric->counter == nullptr) {
+        SPDLOG_ERROR("Counter {} is already registered with a callback", name);
+        throw std::runtime_error("Metric already registered");
+    }
+
+    return *metric->counter;
+}
+
+Histogram& getHistogram(const std::string& name,
+                        const std::string& help,
+                        const std::vector<uint64_t>& boundsMicros)
+{
+    faabric::util::UniqueLock lock(registryMx);
+    Metric* metric = findMetric(name, MetricType::Histogram);
+    if (metric == nullptr) {
+        metric = &registry[name];
+        metric->type = MetricType::Histogram;
+        metric->help = help;
+        metric->histogram = std::make_unique<Histogram>(boundsMicros);
+    }
+
+    return *metric->histogram;
+}
+
+static void registerCallback(const std::string& name,
+                             const std::string& help,
+                             MetricType type,
+                             std::function<double()> read)
+{
+    faabric::util::UniqueLock lock(registryMx);
+    Metric* metric = findMetric(name, type);
+    if (metric == nullptr) {
+        metric = &registry[name];
+        metric->type = type;
+    } else if (metric->read == nullptr) {
+        SPDLOG_ERROR("Metric {} is already registered without a callback",
+                     name);
+        throw std::runtime_error("Metric already registered");
+    }
+
+    metric->help = help;
+    metric->read = std::move(read);
+}
+
+void registerGauge(const std::string& name,
+                   const std::string& help,
+                   std::function<double()> read)
+{
+    registerCallback(name, help, MetricType::Gauge, std::move(read));
+}
+
+void registerCounterCallback(const std::string& name,
+                             const std::string& help,
+                             std::function<double()> read)
+{
+    registerCallback(name, help, MetricType::Counter, std::move(read));
+}
+
+void removeCallback(const std::string& name)
+{
+    faabric::util::UniqueLock lock(registryMx);
+    auto it = registry.find(name);
+    if (it != registry.end() && it->second.read != nullptr) {
+        registry.erase(it);
+    }
+}
+
+static std::mutex pagesMx;
+
+static std::map<std::string, std::function<std::string()>> pages;
+
+void registerPage(const std::string& path, std::function<std::string()> render)
+{
+    faabric::util::UniqueLock lock(pagesMx);
+    pages[path] = std::move(render);
+}
+
+bool renderPage(const std::string& path, std::string& body)
+{
+    std::function<std::string()> render;
+    {
+        faabric::util::UniqueLock lock(pagesMx);
+        auto it = pages.find(path);
+        if (it == pages.end()) {
+            return false;
+        }
+
+        render = it->second;
+    }
+
+    body = render();
+    return true;
+}
+
+std::string renderMetrics()
+{
+    // Callbacks may take their subsystems' locks, so are run outside ours
+    std::vector<std::pair<std::string, std::function<double()>>> callbacks;
+    {
+        faabric::util::UniqueLock lock(registryMx);
+        for (const auto& [name, metric] : registry) {
+            if (metric.read != nullptr) {
+                callbacks.emplace_back(name, metric.read);
+            }
+        }
+    }
+
+    std::map<std::string, double> callbackValues;
+    for (const auto& [name, read] : callbacks) {
+        callbackValues[name] = read();
+    }
+
+    std::stringstream out;
+    faabric::util::UniqueLock lock(registryMx);
+    for (const auto& [name, metric] : registry) {
+        // Callbacks registered since we ran the others are left out
+        auto valueIt = callbackValues.find(name);
+        if (metric.read != nullptr && valueIt == callbackValues.end()) {
+            continue;
+        }
+
+        out << "# HELP " << name << " " << metric.help << "\n";
+        out << "# TYPE " << name << " " << getTypeName(metric.type) << "\n";
+
+        if (metric.read != nullptr) {
+            out << name << " " << fmt::format("{}", valueIt->second) << "\n";
+            continue;
+        }
+
+        switch (metric.type) {
+            case MetricType::Counter: {
+                out << name << " " << metric.counter->get() << "\n";
+                break;
+            }
+            case MetricType::Gauge: {
+                // Gauges always have callbacks
+                break;
+            }
+            case MetricType::Histogram: {
+                const Histogram& histogram = *metric.histogram;
+                const auto& bounds = histogram.getBoundsMicros();
+                std::vector<uint64_t> counts = histogram.getBucketCounts();
+
+                uint64_t cumulative = 0;
+                for (size_t i = 0; i < bounds.size(); i++) {
+                    cumulative += counts.at(i);
+                    out << name << "_bucket{le=\""
+                        << microsToSeconds(bounds.at(i)) << "\"} "
+                        << cumulative << "\n";
+                }
+                cumulative += counts.back();
+                out << name << "_bucket{le=\"+Inf\"} " << cumulative << "\n";
+
+                out << name << "_sum "
+                    << microsToSeconds(histogram.getSumMicros()) << "\n";
+                out << name << "_count " << histogram.getCount() << "\n";
+                break;
+            }
+        }
+    }
+
+    return out.str();
+}
+
+void resetMetrics()
+{
+    faabric::util::UniqueLock lock(registryMx);
+    for (auto& [name, metric] : registry) {
+        if (metric.counter != nullptr) {
+            metric.counter->reset();
+        }
+
+        if (metric.histogram != nullptr) {
+            metric.histogram->reset();
+        }
+    }
+}
+
+HistogramTimer::HistogramTimer(Histogram& histogramIn)
+  : histogram(histogramIn)
+  , start(faabric::util::startTimer())
+{}
+
+HistogramTimer::~HistogramTimer()
+{
+    histogram.observe(faabric::util::getTimeDiffMicros(start));
+}
+}
@@ -0,0 +1,65 @@
+#include <metrics/LifecycleTrace.h>
+#include <metrics/Metrics.h>
+#include <metrics/MetricsServer.h>
+
+#include <faabric/util/logging.h>
+
+using namespace web::http::experimental::listener;
+using namespace web::http;
+
+namespace metrics {
+
+void MetricsServer::start(int port)
+{
+    if (listener != nullptr) {
+        SPDLOG_WARN("Metrics server already started");
+        return;
+    }
+
+    std::string addr = fmt::format("http://0.0.0.0:{}", port);
+    listener = std::make_unique<http_listener>(addr);
+    listener->support(methods::GET, MetricsServer::handleGet);
+    listener->open().wait();
+
+    SPDLOG_INFO("Serving metrics on localhost:{}{}", port, METRICS_URL_PATH);
+}
+
+void MetricsServer::stop()
+{
+    if (listener == nullptr) {
+        return;
+    }
+
+    listener->close().wait();
+    listener = nullptr;
+}
+
+void MetricsServer::handleGet(const http_request& request)
+{
+    std::string relativeUri = uri::decode(request.relative_uri().path());
+    if (relativeUri == TRACE_URL_PATH) {
+        http_response response(status_codes::OK);
+        response.set_body(dumpLifecycleTrace(), "application/json");
+        request.reply(response);
+        return;
+    }
+
+    std::string pageBody;
+    if (renderPage(relativeUri, pageBody)) {
+        http_response response(status_codes::OK);
+        response.set_body(pageBody, "application/json");
+        request.reply(response);
+        return;
+    }
+
+    if (relativeUri != METRICS_URL_PATH) {
+        request.reply(status_codes::NotFound,
+                      fmt::format("Unrecognised metrics path {}", relativeUri));
+        return;
+    }
+
+    http_response response(status_codes::OK);
+    response.set_body(renderMetrics(), "text/plain; version=0.0.4");
+    request.reply(response);
+}
+}
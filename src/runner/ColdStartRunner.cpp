@@ -0,0 +1,288 @@
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include <conf/FaasmConfig.h>
+#include <faaslet/Faaslet.h>
+#include <runner/ColdStartRunner.h>
+#include <runner/MicrobenchRunner.h>
+#include <storage/ArtefactCache.h>
+
+#include <faabric/scheduler/ExecutorContext.h>
+#include <faabric/scheduler/ExecutorFactory.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
+
+namespace runner {
+
+std::string coldStartConditionToString(ColdStartCondition condition)
+{
+    switch (condition) {
+        case ColdStartCondition::Cold:
+            return "cold";
+        case ColdStartCondition::Artefact:
+            return "artefact";
+        case ColdStartCondition::Module:
+            return "module";
+        case ColdStartCondition::Pooled:
+            return "pooled";
+    }
+
+    return "unknown";
+}
+
+std::string ColdStartResult::toJson() const
+{
+    return fmt::format(
+      "{{\"user\":\"{}\",\"function\":\"{}\",\"wasm_vm\":\"{}\","
+      "\"condition\":\"{}\",\"run\":{},\"return_value\":{},"
+      "\"latency_us\":{},\"init_us\":{},\"isolation_us\":{},"
+      "\"execute_us\":{}}}",
+      user,
+      function,
+      wasmVm,
+      coldStartConditionToString(condition),
+      run,
+      returnValue,
+      latencyMicros,
+      initMicros,
+      isolationMicros,
+      executeMicros);
+}
+
+std::vector<std::string> ColdStartRunner::getWasmVms()
+{
+#ifndef FAASM_SGX_DISABLED_MODE
+    return { "wavm", "wamr", "sgx" };
+#else
+    return { "wavm", "wamr" };
+#endif
+}
+
+static void flushHost()
+{
+    faabric::scheduler::getExecutorFactory()->flushHost();
+}
+
+// Gets the host to the state the condition starts from
+static void prepareHost(const faabric::Message& msg,
+                        ColdStartCondition condition)
+{
+    switch (condition) {
+        case ColdStartCondition::Cold:
+            // Downloaded blobs survive a flush, so have to go separately
+            storage::getArtefactCache().clear();
+            flushHost();
+            break;
+        case ColdStartCondition::Artefact: {
+            // Prewarming fetches the artefacts, then the flush drops
+            // everything but the blobs in the artefact cache
+            faabric::Message warmMsg = msg;
+            faaslet::prewarmFunction(warmMsg);
+            flushHost();
+            break;
+        }
+        case ColdStartCondition::Module:
+        case ColdStartCondition::Pooled: {
+            faabric::Message warmMsg = msg;
+            faaslet::prewarmFunction(warmMsg);
+            break;
+        }
+    }
+}
+
+static int runOnFaaslet(faaslet::Faaslet& faaslet,
+                        std::shared_ptr<faabric::BatchExecuteRequest> req)
+{
+    faabric::Message& msg = req->mutable_messages()->at(0);
+    faabric::scheduler::ExecutorContext::set(&faaslet, req, 0);
+    int returnValue = faaslet.executeTask(0, 0, req);
+    faaslet.reset(msg);
+
+    return returnValue;
+}
+
+std::vector<ColdStartResult> ColdStartRunner::doRun(
+  const std::string& user,
+  const std::string& function,
+  const std::string& inputData,
+  const std::string& wasmVm,
+  ColdStartCondition condition,
+  int nRuns,
+  bool flushBetweenRuns)
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    std::string originalVm = conf.wasmVm;
+    conf.wasmVm = wasmVm;
+
+    std::vector<ColdStartResult> results;
+    auto createRequest = [&] {
+        return MicrobenchRunner::createBatchRequest(user, function, inputData);
+    };
+
+    // A pooled Faaslet has already run the function once, and stays on this
+    // thread as it would on its pool thread
+    std::unique_ptr<faaslet::Faaslet> pooled;
+    if (condition == ColdStartCondition::Pooled) {
+        auto req = createRequest();
+        pooled =
+          std::make_unique<faaslet::Faaslet>(req->mutable_messages()->at(0));
+        runOnFaaslet(*pooled, req);
+    }
+
+    for (int r = 0; r < nRuns; r++) {
+        auto req = createRequest();
+        faabric::Message& msg = req->mutable_messages()->at(0);
+
+        if (r == 0 || flushBetweenRuns) {
+            if (flushBetweenRuns) {
+                flushHost();
+            }
+
+            prepareHost(msg, condition);
+        } else if (condition == ColdStartCondition::Cold ||
+                   condition == ColdStartCondition::Artefact) {
+            // These conditions have to be set up again on every run
+            prepareHost(msg, condition);
+        }
+
+        ColdStartResult result;
+        result.user = user;
+        result.function = function;
+        result.wasmVm = wasmVm;
+        result.condition = condition;
+        result.run = r;
+
+        // New Faaslets each get a fresh thread, as they would in a pool
+        auto doCall = [&] {
+            faabric::util::TimePoint start = faabric::util::startTimer();
+            try {
+                if (pooled != nullptr) {
+                    result.returnValue = runOnFaaslet(*pooled, req);
+                } else {
+                    faaslet::Faaslet faaslet(msg);
+                    result.returnValue = runOnFaaslet(faaslet, req);
+                }
+            } catch (std::exception& e) {
+                SPDLOG_ERROR("Cold start of {}/{} on {} failed: {}",
+                             user,
+                             function,
+                             wasmVm,
+                             e.what());
+                result.returnValue = 1;
+            }
+            result.latencyMicros = faabric::util::getTimeDiffMicros(start);
+        };
+
+        if (pooled != nullptr) {
+            doCall();
+        } else {
+            std::thread t(doCall);
+            t.join();
+        }
+
+        result.initMicros = faaslet::getPhaseMicros(msg, PHASE_FAASLET_INIT);
+        result.isolationMicros =
+          faaslet::getPhaseMicros(msg, PHASE_ISOLATION_SETUP);
+        result.executeMicros = faaslet::getPhaseMicros(msg, PHASE_EXECUTE);
+
+        SPDLOG_DEBUG("{}/{} {} {} run {}: {}us",
+                     user,
+                     function,
+                     wasmVm,
+                     coldStartConditionToString(condition),
+                     r,
+                     result.latencyMicros);
+
+        results.emplace_back(result);
+    }
+
+    if (pooled != nullptr) {
+        pooled->shutdown();
+    }
+
+    conf.wasmVm = originalVm;
+
+    return results;
+}
+
+int ColdStartRunner::execute(const std::string& inFile,
+                             const std::string& outFile,
+                             bool flushBetweenRuns)
+{
+    if (!boost::filesystem::exists(inFile)) {
+        SPDLOG_ERROR("Input file does not exist: {}", inFile);
+        return 1;
+    }
+
+    std::fstream inFs;
+    inFs.open(inFile, std::ios::in);
+    if (!inFs.is_open()) {
+        SPDLOG_ERROR("Cannot open input file at {}", inFile);
+        return 1;
+    }
+
+    std::ofstream outFs;
+    outFs.open(outFile);
+
+    // Flushing goes through the executor factory, as it would on a worker
+    auto fac = std::make_shared<faaslet::FaasletFactory>();
+    faabric::scheduler::setExecutorFactory(fac);
+
+    int returnValue = 0;
+    std::string nextLine;
+    while (getline(inFs, nextLine)) {
+        boost::algorithm::trim(nextLine);
+        if (nextLine.empty()) {
+            continue;
+        }
+
+        std::vector<std::string> lineParts;
+        boost::split(lineParts, nextLine, [](char c) { return c == ','; });
+
+        if (lineParts.size() < 3 || lineParts.size() > 4) {
+            SPDLOG_ERROR("Invalid line: {}", nextLine);
+            return 1;
+        }
+
+        std::string user = lineParts[0];
+        std::string function = lineParts[1];
+        int nRuns = std::stoi(lineParts[2]);
+        std::string inputData = lineParts.size() == 4 ? lineParts[3] : "";
+
+        for (const auto& wasmVm : getWasmVms()) {
+            for (auto condition : { ColdStartCondition::Cold,
+                                    ColdStartCondition::Artefact,
+                                    ColdStartCondition::Module,
+                                    ColdStartCondition::Pooled }) {
+                SPDLOG_INFO("Cold starts of {}/{} on {} ({}) x{}",
+                            user,
+                            function,
+                            wasmVm,
+                            coldStartConditionToString(condition),
+                            nRuns);
+
+                std::vector<ColdStartResult> results = doRun(user,
+                                                             function,
+                                                             inputData,
+                                                             wasmVm,
+                                                             condition,
+                                                             nRuns,
+                                                             flushBetweenRuns);
+
+                for (const auto& result : results) {
+                    outFs << result.toJson() << std::endl;
+                    returnValue |= result.returnValue != 0;
+                }
+            }
+        }
+    }
+
+    outFs.close();
+    inFs.close();
+
+    return returnValue;
+}
+}
@@ -0,0 +1,332 @@
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+#include <conf/FaasmConfig.h>
+#include <faaslet/Faaslet.h>
+#include <runner/DistBenchRunner.h>
+#include <runner/MicrobenchRunner.h>
+
+#include <faabric/runner/FaabricMain.h>
+#include <faabric/scheduler/ExecutorFactory.h>
+#include <faabric/scheduler/Scheduler.h>
+#include <faabric/util/config.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
+
+#define DIST_BENCH_RESULT_TIMEOUT_MS 300000
+
+namespace runner {
+
+static long getDetail(const faabric::Message& msg, const std::string& key)
+{
+    auto it = msg.execgraphdetails().find(key);
+    if (it == msg.execgraphdetails().end()) {
+        return 0;
+    }
+
+    return std::stol(it->second);
+}
+
+void DistBenchComms::add(const faabric::Message& msg)
+{
+    mpiNanos += getDetail(msg, "mpi-ns");
+    mpiWaitNanos += getDetail(msg, "mpi-wait-ns");
+    mpiBytes += getDetail(msg, "mpi-bytes");
+    ompForkNanos += getDetail(msg, "omp-fork-ns");
+    ompBarrierNanos += getDetail(msg, "omp-barrier-ns");
+}
+
+static void addExecGraphComms(const faabric::scheduler::ExecGraphNode& node,
+                              DistBenchComms& comms)
+{
+    comms.add(node.msg);
+    for (const auto& child : node.children) {
+        addExecGraphComms(child, comms);
+    }
+}
+
+static std::vector<std::string> splitList(const std::string& str)
+{
+    std::vector<std::string> parts;
+    boost::split(parts, str, [](char c) { return c == ' '; });
+    parts.erase(std::remove(parts.begin(), parts.end(), ""), parts.end());
+
+    return parts;
+}
+
+DistBenchSpec DistBenchRunner::parseSpec(std::istream& in)
+{
+    DistBenchSpec spec;
+
+    std::string nextLine;
+    bool settingsRead = false;
+    while (getline(in, nextLine)) {
+        boost::algorithm::trim(nextLine);
+        if (nextLine.empty() || nextLine.at(0) == '#') {
+            continue;
+        }
+
+        std::vector<std::string> lineParts;
+        boost::split(lineParts, nextLine, [](char c) { return c == ','; });
+
+        if (!settingsRead) {
+            settingsRead = true;
+
+            for (const auto& setting : lineParts) {
+                std::vector<std::string> keyValue;
+                boost::split(
+                  keyValue, setting, [](char c) { return c == '='; });
+                if (keyValue.size() != 2) {
+                    SPDLOG_ERROR("Invalid dist bench setting: {}", setting);
+                    throw std::runtime_error("Invalid dist bench setting");
+                }
+
+                const std::string& key = keyValue.at(0);
+                const std::string& value = keyValue.at(1);
+                if (key == "hosts") {
+                    spec.hosts = splitList(value);
+                } else if (key == "threads") {
+                    spec.threads.clear();
+                    for (const auto& t : splitList(value)) {
+                        spec.threads.push_back(std::stoi(t));
+                    }
+                } else if (key == "repeats") {
+                    spec.repeats = std::stoi(value);
+                } else {
+                    SPDLOG_ERROR("Unrecognised dist bench setting: {}", key);
+                    throw std::runtime_error("Unrecognised dist bench setting");
+                }
+            }
+
+            continue;
+        }
+
+        if (lineParts.size() != 4) {
+            SPDLOG_ERROR("Invalid dist bench kernel: {}", nextLine);
+            throw std::runtime_error("Invalid dist bench kernel");
+        }
+
+        DistBenchKernel kernel;
+        kernel.user = lineParts[0];
+        kernel.function = lineParts[1];
+        kernel.size = std::stol(lineParts[3]);
+
+        const std::string& scaling = lineParts[2];
+        if (scaling == "strong") {
+            kernel.scaling = DistBenchScaling::Strong;
+        } else if (scaling == "weak") {
+            kernel.scaling = DistBenchScaling::Weak;
+        } else {
+            SPDLOG_ERROR("Unrecognised dist bench scaling: {}", scaling);
+            throw std::runtime_error("Unrecognised dist bench scaling");
+        }
+
+        spec.kernels.emplace_back(kernel);
+    }
+
+    bool threadsValid =
+      !spec.threads.empty() &&
+      std::all_of(spec.threads.begin(), spec.threads.end(), [](int t) {
+          return t > 0;
+      });
+    if (!threadsValid || spec.repeats <= 0 || spec.kernels.empty()) {
+        SPDLOG_ERROR("Invalid dist bench spec ({} threads, {} repeats, {} "
+                     "kernels)",
+                     spec.threads.size(),
+                     spec.repeats,
+                     spec.kernels.size());
+        throw std::runtime_error("Invalid dist bench spec");
+    }
+
+    return spec;
+}
+
+double DistBenchRunner::getEfficiency(DistBenchScaling scaling,
+                                      long baselineMicros,
+                                      int baselineParallelism,
+                                      long micros,
+                                      int parallelism)
+{
+    if (micros <= 0 || parallelism <= 0) {
+        return 0;
+    }
+
+    if (scaling == DistBenchScaling::Weak) {
+        return double(baselineMicros) / micros;
+    }
+
+    return double(baselineMicros) * baselineParallelism /
+           (double(micros) * parallelism);
+}
+
+std::string DistBenchRunner::getKernelInput(const DistBenchKernel& kernel,
+                                            int parallelism)
+{
+    long size = kernel.size;
+    if (kernel.scaling == DistBenchScaling::Weak) {
+        size *= parallelism;
+    }
+
+    return fmt::format("{} {}", size, parallelism);
+}
+
+// Only the first nHosts hosts offer any slots, each offering the given number
+static void setHostSlots(const DistBenchSpec& spec, int nHosts, int slots)
+{
+    faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
+
+    std::vector<std::string> hosts = {
+        faabric::util::getSystemConfig().endpointHost
+    };
+    hosts.insert(hosts.end(), spec.hosts.begin(), spec.hosts.end());
+
+    for (int h = 0; h < hosts.size(); h++) {
+        auto res = std::make_shared<faabric::HostResources>();
+        res->set_slots(h < nHosts ? slots : 0);
+        res->set_usedslots(0);
+        sch.addHostToGlobalSet(hosts.at(h), res);
+    }
+}
+
+int DistBenchRunner::doRun(std::ofstream& outFs,
+                           const DistBenchSpec& spec,
+                           const DistBenchKernel& kernel)
+{
+    faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
+    bool isMpi = kernel.user == "mpi";
+
+    long baselineMicros = 0;
+    int baselineParallelism = 0;
+    int nHosts = spec.hosts.size() + 1;
+    for (int h = 1; h <= nHosts; h++) {
+        for (int threads : spec.threads) {
+            int parallelism = h * threads;
+            std::string inputData = getKernelInput(kernel, parallelism);
+            setHostSlots(spec, h, threads);
+
+            SPDLOG_INFO("Running {}/{} on {} hosts x {} threads ({})",
+                        kernel.user,
+                        kernel.function,
+                        h,
+                        threads,
+                        inputData);
+
+            std::vector<long> times;
+            faabric::Message lastResult;
+            for (int r = 0; r < spec.repeats; r++) {
+                auto req = MicrobenchRunner::createBatchRequest(
+                  kernel.user, kernel.function, inputData, false);
+                faabric::Message& msg = req->mutable_messages()->at(0);
+                msg.set_recordexecgraph(true);
+                if (isMpi) {
+                    msg.set_ismpi(true);
+                    msg.set_mpiworldsize(parallelism);
+                }
+
+                faabric::util::TimePoint start = faabric::util::startTimer();
+                sch.callFunctions(req);
+                lastResult =
+                  sch.getFunctionResult(msg, DIST_BENCH_RESULT_TIMEOUT_MS);
+                times.push_back(faabric::util::getTimeDiffMicros(start));
+
+                if (lastResult.returnvalue() != 0) {
+                    SPDLOG_ERROR("{}/{} failed on {} hosts x {} threads: {}",
+                                 kernel.user,
+                                 kernel.function,
+                                 h,
+                                 threads,
+                                 lastResult.returnvalue());
+                    return 1;
+                }
+            }
+
+            std::sort(times.begin(), times.end());
+            long micros = times.at(times.size() / 2);
+            if (baselineParallelism == 0) {
+                baselineMicros = micros;
+                baselineParallelism = parallelism;
+            }
+
+            double efficiency = getEfficiency(kernel.scaling,
+                                              baselineMicros,
+                                              baselineParallelism,
+                                              micros,
+                                              parallelism);
+
+            // All the calls report back to this host, so the exec graph
+            // holds every host's totals
+            auto execGraph = sch.getFunctionExecGraph(lastResult.id());
+            std::set<std::string> hostsUsed =
+              faabric::scheduler::getExecGraphHosts(execGraph);
+            DistBenchComms comms;
+            addExecGraphComms(execGraph.rootNode, comms);
+
+            outFs << kernel.user << "," << kernel.function << ","
+                  << (kernel.scaling == DistBenchScaling::Strong ? "strong"
+                                                                 : "weak")
+                  << "," << h << "," << threads << "," << parallelism << ","
+                  << inputData.substr(0, inputData.find(' ')) << "," << micros
+                  << "," << efficiency << "," << hostsUsed.size() << ","
+                  << comms.mpiNanos / 1000 << "," << comms.mpiWaitNanos / 1000
+                  << "," << comms.mpiBytes << "," << comms.ompForkNanos / 1000
+                  << "," << comms.ompBarrierNanos / 1000 << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+int DistBenchRunner::execute(const std::string& inFile,
+                             const std::string& outFile)
+{
+    if (!boost::filesystem::exists(inFile)) {
+        SPDLOG_ERROR("Input file does not exist: {}", inFile);
+        return 1;
+    }
+
+    std::fstream inFs;
+    inFs.open(inFile, std::ios::in);
+    if (!inFs.is_open()) {
+        SPDLOG_ERROR("Cannot open input file at {}", inFile);
+        return 1;
+    }
+
+    DistBenchSpec spec;
+    try {
+        spec = parseSpec(inFs);
+    } catch (std::exception& e) {
+        return 1;
+    }
+    inFs.close();
+
+    std::ofstream outFs;
+    outFs.open(outFile);
+    outFs << "User,Function,Scaling,Hosts,Threads,Parallelism,Size,Time (us),"
+             "Efficiency,Hosts used,MPI (us),MPI wait (us),MPI bytes,"
+             "OpenMP fork (us),OpenMP barrier (us)"
+          << std::endl;
+
+    auto fac = std::make_shared<faaslet::FaasletFactory>();
+    faabric::scheduler::setExecutorFactory(fac);
+    faabric::runner::FaabricMain m(fac);
+    m.startRunner();
+
+    int returnValue = 0;
+    for (const auto& kernel : spec.kernels) {
+        returnValue = doRun(outFs, spec, kernel);
+        if (returnValue != 0) {
+            break;
+        }
+    }
+
+    m.shutdown();
+    outFs.close();
+
+    return returnValue;
+}
+}
@@ -0,0 +1,253 @@
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include <conf/FaasmConfig.h>
+#include <faaslet/Faaslet.h>
+#include <runner/HostInterfaceRunner.h>
+#include <runner/MicrobenchRunner.h>
+
+#include <faabric/runner/FaabricMain.h>
+#include <faabric/scheduler/ExecutorFactory.h>
+#include <faabric/scheduler/Scheduler.h>
+#include <faabric/util/logging.h>
+
+// Each point is run this many times, taking the median
+#define HOST_INTERFACE_REPEATS 5
+
+#define HOST_INTERFACE_RESULT_TIMEOUT_MS 60000
+
+namespace runner {
+
+static std::vector<int> parseIntList(const std::string& str)
+{
+    std::vector<std::string> parts;
+    boost::split(parts, str, [](char c) { return c == ' '; });
+
+    std::vector<int> values;
+    for (const auto& part : parts) {
+        if (part.empty()) {
+            continue;
+        }
+
+        int value = std::stoi(part);
+        if (value <= 0) {
+            SPDLOG_ERROR("Invalid host interface bench value: {}", part);
+            throw std::runtime_error("Invalid host interface bench value");
+        }
+
+        values.push_back(value);
+    }
+
+    return values;
+}
+
+std::vector<HostInterfaceBench> HostInterfaceRunner::parseSpec(
+  std::istream& in)
+{
+    std::vector<HostInterfaceBench> benches;
+
+    std::string nextLine;
+    while (getline(in, nextLine)) {
+        boost::algorithm::trim(nextLine);
+        if (nextLine.empty() || nextLine.at(0) == '#') {
+            continue;
+        }
+
+        std::vector<std::string> lineParts;
+        boost::split(lineParts, nextLine, [](char c) { return c == ','; });
+        if (lineParts.size() != 5) {
+            SPDLOG_ERROR("Invalid host interface bench line: {}", nextLine);
+            throw std::runtime_error("Invalid host interface bench line");
+        }
+
+        HostInterfaceBench bench;
+        bench.user = lineParts[0];
+        bench.function = lineParts[1];
+        bench.iterations = std::stoi(lineParts[2]);
+        bench.sizes = parseIntList(lineParts[3]);
+        bench.threads = parseIntList(lineParts[4]);
+
+        if (bench.iterations <= 0 || bench.sizes.empty() ||
+            bench.threads.empty()) {
+            SPDLOG_ERROR("Invalid host interface bench line: {}", nextLine);
+            throw std::runtime_error("Invalid host interface bench line");
+        }
+
+        benches.emplace_back(bench);
+    }
+
+    return benches;
+}
+
+HostInterfaceResult HostInterfaceRunner::getResult(long baselineMicros,
+                                                   long runMicros,
+                                                   int iterations,
+                                                   int threads)
+{
+    HostInterfaceResult result;
+
+    // Noise can put the baseline above the run, in which case the calls are
+    // too cheap to measure
+    long callMicros = std::max(0L, runMicros - baselineMicros);
+    if (callMicros == 0 || iterations <= 0) {
+        return result;
+    }
+
+    result.nanosPerCall = double(callMicros) * 1000 / iterations;
+    result.callsPerSec = double(iterations) * threads * 1e6 / callMicros;
+
+    return result;
+}
+
+std::string HostInterfaceRunner::getBenchInput(int iterations,
+                                               int size,
+                                               int threads)
+{
+    return fmt::format("{} {} {}", iterations, size, threads);
+}
+
+// Median time spent executing the function, excluding dispatch and reset
+static long getExecuteMicros(const HostInterfaceBench& bench,
+                             const std::string& inputData,
+                             int threads)
+{
+    faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
+
+    std::vector<long> times;
+    for (int r = 0; r < HOST_INTERFACE_REPEATS; r++) {
+        auto req = MicrobenchRunner::createBatchRequest(
+          bench.user, bench.function, inputData);
+        faabric::Message& msg = req->mutable_messages()->at(0);
+
+        // MPI benchmarks use a rank per thread
+        if (bench.user == "mpi") {
+            msg.set_ismpi(true);
+            msg.set_mpiworldsize(threads);
+        }
+
+        sch.callFunctions(req);
+        faabric::Message res =
+          sch.getFunctionResult(msg, HOST_INTERFACE_RESULT_TIMEOUT_MS);
+        if (res.returnvalue() != 0) {
+            SPDLOG_ERROR("{}/{} failed with input [{}]: {}",
+                         bench.user,
+                         bench.function,
+                         inputData,
+                         res.returnvalue());
+            throw std::runtime_error("Host interface bench failed");
+        }
+
+        times.push_back(faaslet::getPhaseMicros(res, PHASE_EXECUTE));
+    }
+
+    std::sort(times.begin(), times.end());
+    return times.at(times.size() / 2);
+}
+
+int HostInterfaceRunner::doRun(std::ofstream& outFs,
+                               const HostInterfaceBench& bench,
+                               const std::string& wasmVm)
+{
+    for (int threads : bench.threads) {
+        for (int size : bench.sizes) {
+            std::string baselineInput = getBenchInput(0, size, threads);
+            std::string runInput =
+              getBenchInput(bench.iterations, size, threads);
+
+            SPDLOG_INFO("Benchmarking {}/{} on {} (size {}, {} threads)",
+                        bench.user,
+                        bench.function,
+                        wasmVm,
+                        size,
+                        threads);
+
+            long baselineMicros;
+            long runMicros;
+            try {
+                // The baseline also warms up the Faaslets
+                baselineMicros =
+                  getExecuteMicros(bench, baselineInput, threads);
+                runMicros = getExecuteMicros(bench, runInput, threads);
+            } catch (std::exception& e) {
+                return 1;
+            }
+
+            HostInterfaceResult result =
+              getResult(baselineMicros, runMicros, bench.iterations, threads);
+
+            outFs << bench.user << "," << bench.function << "," << wasmVm
+                  << "," << size << "," << threads << "," << bench.iterations
+                  << "," << result.nanosPerCall << "," << result.callsPerSec
+                  << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+int HostInterfaceRunner::execute(const std::string& inFile,
+                                 const std::string& outFile)
+{
+    if (!boost::filesystem::exists(inFile)) {
+        SPDLOG_ERROR("Input file does not exist: {}", inFile);
+        return 1;
+    }
+
+    std::fstream inFs;
+    inFs.open(inFile, std::ios::in);
+    if (!inFs.is_open()) {
+        SPDLOG_ERROR("Cannot open input file at {}", inFile);
+        return 1;
+    }
+
+    std::vector<HostInterfaceBench> benches;
+    try {
+        benches = parseSpec(inFs);
+    } catch (std::exception& e) {
+        return 1;
+    }
+    inFs.close();
+
+    std::ofstream outFs;
+    outFs.open(outFile);
+    outFs << "User,Function,Wasm VM,Size,Threads,Iterations,Call (ns),"
+             "Calls/s"
+          << std::endl;
+
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    std::string originalVm = conf.wasmVm;
+
+    // Faaslets are tied to a VM, so each gets its own runner
+    int returnValue = 0;
+    for (const char* wasmVm : { "wavm", "wamr" }) {
+        conf.wasmVm = wasmVm;
+
+        auto fac = std::make_shared<faaslet::FaasletFactory>();
+        faabric::scheduler::setExecutorFactory(fac);
+        faabric::runner::FaabricMain m(fac);
+        m.startRunner();
+
+        for (const auto& bench : benches) {
+            returnValue = doRun(outFs, bench, wasmVm);
+            if (returnValue != 0) {
+                break;
+            }
+        }
+
+        m.shutdown();
+
+        if (returnValue != 0) {
+            break;
+        }
+    }
+
+    conf.wasmVm = originalVm;
+    outFs.close();
+
+    return returnValue;
+}
+}
@@ -1,14 +1,22 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <fstream>
 #include <iostream>
+#include <random>
+#include <stdexcept>
 #include <string>
+#include <thread>
 
 #include <conf/FaasmConfig.h>
 #include <faaslet/Faaslet.h>
 #include <runner/MicrobenchRunner.h>
 #include <storage/FileLoader.h>
 #include <wasm/WasmModule.h>
+#include <wasm/perf_counters.h>
 #include <wavm/WAVMWasmModule.h>
 
 #include <faabric/proto/faabric.pb.h>
@@ -24,12 +32,20 @@ using namespace faabric::util;
 
 #define PREFLIGHT_CALLS true
 
+#define PHASE_COLUMNS                                                          \
+    "Dispatch (us),Faaslet init (us),Isolation (us),Execute (us),Reset (us),"  \
+    "Result (us)"
+
+#define PERF_COLUMNS                                                           \
+    "Instructions,Cycles,LLC misses,dTLB misses,Context switches"
+
 namespace runner {
 
 std::shared_ptr<faabric::BatchExecuteRequest>
 MicrobenchRunner::createBatchRequest(const std::string& user,
                                      const std::string& function,
-                                     const std::string& inputData)
+                                     const std::string& inputData,
+                                     bool forceLocal)
 {
     // Set up invocation message
     std::shared_ptr<faabric::BatchExecuteRequest> req =
@@ -48,11 +64,66 @@ MicrobenchRunner::createBatchRequest(const std::string& user,
     msg.set_inputdata(inputData);
 
     // Force local to avoid any scheduling logic
-    msg.set_topologyhint("FORCE_LOCAL");
+    if (forceLocal) {
+        msg.set_topologyhint("FORCE_LOCAL");
+    }
 
     return req;
 }
 
+/**
+ * Splits a call's time up into phases, using the timings the Faaslet attaches
+ * to the result. Dispatch covers everything from sending the call to the
+ * Faaslet picking it up, i.e. scheduling and claiming an executor, and the
+ * result phase from the end of the call to the result arriving, less the
+ * reset.
+ */
+std::string MicrobenchRunner::getPhaseColumns(const faabric::Message& res,
+                                              long sentMicros,
+                                              long receivedMicros)
+{
+    long initMicros = faaslet::getPhaseMicros(res, PHASE_FAASLET_INIT);
+    long isolationMicros = faaslet::getPhaseMicros(res, PHASE_ISOLATION_SETUP);
+    long executeMicros = faaslet::getPhaseMicros(res, PHASE_EXECUTE);
+    long resetMicros = faaslet::getPhaseMicros(res, PHASE_RESET);
+    long taskStart = faaslet::getPhaseMicros(res, PHASE_TASK_START);
+    long taskEnd = faaslet::getPhaseMicros(res, PHASE_TASK_END);
+
+    // Without the Faaslet's timestamps, e.g. if the call failed, there's
+    // nothing to split up
+    long dispatchMicros = 0;
+    long resultMicros = 0;
+    if (taskStart > 0 && taskEnd > 0) {
+        dispatchMicros = std::max(0L, taskStart - sentMicros - initMicros);
+        resultMicros = std::max(0L, receivedMicros - taskEnd - resetMicros);
+    }
+
+    return fmt::format("{},{},{},{},{},{}",
+                       dispatchMicros,
+                       initMicros,
+                       isolationMicros,
+                       executeMicros,
+                       resetMicros,
+                       resultMicros);
+}
+
+/**
+ * The call's hardware counters, left empty where the host didn't collect
+ * them, e.g. without PERF_COUNTERS on.
+ */
+std::string MicrobenchRunner::getPerfColumns(const faabric::Message& res)
+{
+    std::vector<std::string> columns;
+    for (int i = 0; i < N_PERF_COUNTERS; i++) {
+        std::string name = wasm::perfCounterName((wasm::PerfCounter)i);
+        auto it = res.execgraphdetails().find("perf-" + name);
+        columns.push_back(it == res.execgraphdetails().end() ? ""
+                                                             : it->second);
+    }
+
+    return boost::algorithm::join(columns, ",");
+}
+
 int MicrobenchRunner::doRun(std::ofstream& outFs,
                             const std::string& user,
                             const std::string& function,
@@ -95,15 +166,19 @@ int MicrobenchRunner::doRun(std::ofstream& outFs,
     for (int r = 0; r < nRuns; r++) {
         // Execute
         TimePoint execStart = startTimer();
+        long sentMicros = faaslet::getEpochMicros();
         sch.callFunctions(req);
         faabric::Message res = sch.getFunctionResult(msg, 10000);
+        long receivedMicros = faaslet::getEpochMicros();
         long execNanos = getTimeDiffNanos(execStart);
         float execMicros = float(execNanos) / 1000;
 
         // Write result line
         int returnValue = res.returnvalue();
         outFs << user << "," << function << "," << returnValue << ","
-              << execMicros << std::endl;
+              << execMicros << ","
+              << getPhaseColumns(res, sentMicros, receivedMicros) << ","
+              << getPerfColumns(res) << std::endl;
 
         if (returnValue != 0) {
             SPDLOG_ERROR("{}/{} failed on run {} with value {}",
@@ -129,7 +204,8 @@ int MicrobenchRunner::execute(const std::string& inFile,
     // Set up output file
     std::ofstream outFs;
     outFs.open(outFile);
-    outFs << "User,Function,Return value,Execution (us)" << std::endl;
+    outFs << "User,Function,Return value,Execution (us)," << PHASE_COLUMNS
+          << "," << PERF_COLUMNS << std::endl;
 
     std::fstream inFs;
     inFs.open(inFile, std::ios::in);
@@ -188,4 +264,340 @@ int MicrobenchRunner::execute(const std::string& inFile,
 
     return 0;
 }
+
+// --------------------------------------
+// OPEN-LOOP LOAD
+// --------------------------------------
+
+LoadSpec MicrobenchRunner::parseLoadSpec(std::istream& in)
+{
+    LoadSpec spec;
+
+    std::string nextLine;
+    bool settingsRead = false;
+    while (getline(in, nextLine)) {
+        boost::algorithm::trim(nextLine);
+        if (nextLine.empty() || nextLine.at(0) == '#') {
+            continue;
+        }
+
+        std::vector<std::string> lineParts;
+        boost::split(lineParts, nextLine, [](char c) { return c == ','; });
+
+        if (!settingsRead) {
+            settingsRead = true;
+
+            for (const auto& setting : lineParts) {
+                std::vector<std::string> kv;
+                boost::split(kv, setting, [](char c) { return c == '='; });
+                if (kv.size() != 2) {
+                    SPDLOG_ERROR("Invalid load setting: {}", setting);
+                    throw std::runtime_error("Invalid load setting");
+                }
+
+                const std::string& key = kv.at(0);
+                const std::string& value = kv.at(1);
+                if (key == "rate") {
+                    spec.rate = std::stod(value);
+                } else if (key == "duration") {
+                    spec.durationSecs = std::stoi(value);
+                } else if (key == "warmup") {
+                    spec.warmupSecs = std::stoi(value);
+                } else if (key == "concurrency") {
+                    spec.concurrency = std::stoi(value);
+                } else if (key == "seed") {
+                    spec.seed = std::stoul(value);
+                } else if (key == "local") {
+                    spec.forceLocal = value == "on";
+                } else if (key == "arrival" && value == "constant") {
+                    spec.arrival = LoadArrivalProcess::Constant;
+                } else if (key == "arrival" && value == "poisson") {
+                    spec.arrival = LoadArrivalProcess::Poisson;
+                } else {
+                    SPDLOG_ERROR("Unrecognised load setting: {}", setting);
+                    throw std::runtime_error("Unrecognised load setting");
+                }
+            }
+
+            continue;
+        }
+
+        if (lineParts.size() < 3 || lineParts.size() > 4) {
+            SPDLOG_ERROR("Invalid line: {}", nextLine);
+            throw std::runtime_error("Invalid load function");
+        }
+
+        LoadFunction func;
+        func.user = lineParts[0];
+        func.function = lineParts[1];
+        func.weight = std::stod(lineParts[2]);
+        if (lineParts.size() == 4) {
+            func.inputData = lineParts[3];
+        }
+
+        if (func.weight <= 0) {
+            SPDLOG_ERROR("Invalid weight for {}/{}: {}",
+                         func.user,
+                         func.function,
+                         func.weight);
+            throw std::runtime_error("Invalid load function weight");
+        }
+
+        spec.functions.emplace_back(func);
+    }
+
+    if (spec.rate <= 0 || spec.durationSecs <= 0 || spec.warmupSecs < 0 ||
+        spec.concurrency <= 0) {
+        SPDLOG_ERROR("Invalid load (rate {}, duration {}s, warmup {}s, "
+                     "concurrency {})",
+                     spec.rate,
+                     spec.durationSecs,
+                     spec.warmupSecs,
+                     spec.concurrency);
+        throw std::runtime_error("Invalid load settings");
+    }
+
+    if (spec.functions.empty()) {
+        SPDLOG_ERROR("Load spec has no functions");
+        throw std::runtime_error("Load spec has no functions");
+    }
+
+    return spec;
+}
+
+std::vector<LoadArrival> MicrobenchRunner::getLoadSchedule(
+  const LoadSpec& spec)
+{
+    std::mt19937 gen(spec.seed);
+    std::exponential_distribution<double> gaps(spec.rate);
+
+    std::vector<double> weights;
+    for (const auto& func : spec.functions) {
+        weights.push_back(func.weight);
+    }
+    std::discrete_distribution<int> pickFunction(weights.begin(),
+                                                 weights.end());
+
+    double totalSecs = spec.warmupSecs + spec.durationSecs;
+    std::vector<LoadArrival> schedule;
+
+    double offsetSecs = 0;
+    for (long i = 0;; i++) {
+        if (spec.arrival == LoadArrivalProcess::Constant) {
+            offsetSecs = i / spec.rate;
+        } else {
+            offsetSecs += gaps(gen);
+        }
+
+        if (offsetSecs >= totalSecs) {
+            break;
+        }
+
+        LoadArrival arrival;
+        arrival.offsetNanos = std::lround(offsetSecs * 1e9);
+        arrival.functionIdx = pickFunction(gen);
+        schedule.emplace_back(arrival);
+    }
+
+    return schedule;
+}
+
+float MicrobenchRunner::getPercentile(const std::vector<float>& sorted,
+                                      double percentile)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+
+    // Allow for rounding, e.g. 99.9% of 1000 coming out just over 999
+    size_t rank = std::ceil(percentile / 100 * sorted.size() - 1e-9);
+    rank = std::clamp<size_t>(rank, 1, sorted.size());
+
+    return sorted.at(rank - 1);
+}
+
+static void writeLoadResultLine(std::ofstream& outFs,
+                                const std::string& user,
+                                const std::string& function,
+                                std::vector<float>& latencies,
+                                int nFailed,
+                                double measuredSecs)
+{
+    std::sort(latencies.begin(), latencies.end());
+
+    double throughput = latencies.size() / measuredSecs;
+    outFs << user << "," << function << "," << latencies.size() << ","
+          << nFailed << "," << throughput << ","
+          << MicrobenchRunner::getPercentile(latencies, 50) << ","
+          << MicrobenchRunner::getPercentile(latencies, 90) << ","
+          << MicrobenchRunner::getPercentile(latencies, 99) << ","
+          << MicrobenchRunner::getPercentile(latencies, 99.9) << std::endl;
+}
+
+int MicrobenchRunner::doLoadRun(std::ofstream& outFs, const LoadSpec& spec)
+{
+    faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
+
+    std::vector<LoadArrival> schedule = getLoadSchedule(spec);
+    size_t nArrivals = schedule.size();
+
+    SPDLOG_INFO("Sending {} requests over {}s ({}s warmup) at {}/s with up "
+                "to {} outstanding",
+                nArrivals,
+                spec.warmupSecs + spec.durationSecs,
+                spec.warmupSecs,
+                spec.rate,
+                spec.concurrency);
+
+    // Each worker takes the next request that's due, so when all of them are
+    // busy, requests go out late and their latencies include the wait
+    std::vector<float> latencies(nArrivals, 0);
+    std::vector<char> succeeded(nArrivals, 0);
+    std::vector<long> finishNanos(nArrivals, 0);
+    std::atomic<size_t> nextArrival = 0;
+
+    auto runStart = std::chrono::steady_clock::now();
+    auto runWorker = [&] {
+        while (true) {
+            size_t idx = nextArrival.fetch_add(1);
+            if (idx >= nArrivals) {
+                return;
+            }
+
+            const LoadArrival& arrival = schedule.at(idx);
+            const LoadFunction& func = spec.functions.at(arrival.functionIdx);
+
+            auto due =
+              runStart + std::chrono::nanoseconds(arrival.offsetNanos);
+            std::this_thread::sleep_until(due);
+
+            auto req = createBatchRequest(
+              func.user, func.function, func.inputData, spec.forceLocal);
+            try {
+                sch.callFunctions(req);
+                faabric::Message res =
+                  sch.getFunctionResult(req->messages().at(0), 10000);
+                succeeded.at(idx) = res.returnvalue() == 0;
+            } catch (std::exception& e) {
+                SPDLOG_ERROR("Request {} to {}/{} failed: {}",
+                             idx,
+                             func.user,
+                             func.function,
+                             e.what());
+            }
+
+            auto finish = std::chrono::steady_clock::now();
+            latencies.at(idx) =
+              std::chrono::duration<float, std::micro>(finish - due).count();
+            finishNanos.at(idx) =
+              std::chrono::duration_cast<std::chrono::nanoseconds>(finish -
+                                                                   runStart)
+                .count();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < spec.concurrency; i++) {
+        workers.emplace_back(runWorker);
+    }
+
+    for (auto& t : workers) {
+        t.join();
+    }
+
+    // Throughput is over the time from the end of the warmup to the last
+    // measured request finishing
+    long warmupNanos = long(spec.warmupSecs) * 1000000000L;
+    long lastFinishNanos = warmupNanos;
+
+    std::vector<std::vector<float>> funcLatencies(spec.functions.size());
+    std::vector<int> funcFailures(spec.functions.size(), 0);
+    std::vector<float> allLatencies;
+    int allFailures = 0;
+    for (size_t i = 0; i < nArrivals; i++) {
+        if (schedule.at(i).offsetNanos < warmupNanos) {
+            continue;
+        }
+
+        lastFinishNanos = std::max(lastFinishNanos, finishNanos.at(i));
+
+        int funcIdx = schedule.at(i).functionIdx;
+        if (succeeded.at(i)) {
+            funcLatencies.at(funcIdx).push_back(latencies.at(i));
+            allLatencies.push_back(latencies.at(i));
+        } else {
+            funcFailures.at(funcIdx)++;
+            allFailures++;
+        }
+    }
+
+    double measuredSecs = (lastFinishNanos - warmupNanos) / 1e9;
+    if (measuredSecs <= 0) {
+        measuredSecs = spec.durationSecs;
+    }
+
+    for (size_t i = 0; i < spec.functions.size(); i++) {
+        const LoadFunction& func = spec.functions.at(i);
+        writeLoadResultLine(outFs,
+                            func.user,
+                            func.function,
+                            funcLatencies.at(i),
+                            funcFailures.at(i),
+                            measuredSecs);
+    }
+
+    writeLoadResultLine(
+      outFs, "all", "all", allLatencies, allFailures, measuredSecs);
+
+    SPDLOG_INFO("Completed {} measured requests ({} failed) in {}s",
+                allLatencies.size(),
+                allFailures,
+                measuredSecs);
+
+    return allFailures > 0 ? 1 : 0;
+}
+
+int MicrobenchRunner::executeLoad(const std::string& inFile,
+                                  const std::string& outFile)
+{
+    std::fstream inFs;
+    inFs.open(inFile, std::ios::in);
+    if (!inFs.is_open()) {
+        SPDLOG_ERROR("Cannot open input file at {}", inFile);
+        return 1;
+    }
+
+    LoadSpec spec;
+    try {
+        spec = parseLoadSpec(inFs);
+    } catch (std::exception& e) {
+        SPDLOG_ERROR("Invalid load spec in {}: {}", inFile, e.what());
+        return 1;
+    }
+    inFs.close();
+
+    std::ofstream outFs;
+    outFs.open(outFile);
+    outFs << "User,Function,Requests,Failures,Throughput (req/s),p50 (us),"
+             "p90 (us),p99 (us),p99.9 (us)"
+          << std::endl;
+
+    // Clear out redis
+    faabric::redis::Redis& redis = faabric::redis::Redis::getQueue();
+    redis.flushAll();
+
+    // Set up the runner
+    std::shared_ptr<faaslet::FaasletFactory> fac =
+      std::make_shared<faaslet::FaasletFactory>();
+    faabric::scheduler::setExecutorFactory(fac);
+    faabric::runner::FaabricMain m(fac);
+    m.startRunner();
+
+    int returnValue = doLoadRun(outFs, spec);
+
+    outFs.close();
+    m.shutdown();
+
+    return returnValue;
+}
 }
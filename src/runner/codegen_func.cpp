@@ -3,7 +3,6 @@
 #include <faabric/util/config.h>
 #include <faabric/util/environment.h>
 #include <faabric/util/func.h>
-#include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
 #include <storage/FileLoader.h>
 #include <storage/S3Wrapper.h>
@@ -89,49 +88,35 @@ int main(int argc, char* argv[])
             return 1;
         }
 
-        boost::filesystem::directory_iterator iter(path);
-        boost::filesystem::directory_iterator end;
-        std::mutex mx;
-
-        unsigned int nThreads = faabric::util::getUsableCores();
-        std::vector<std::thread> threads;
-
-        for (unsigned int i = 0; i < nThreads; i++) {
-            threads.emplace_back([&iter, &mx, &end, &user, clean] {
-                SPDLOG_INFO("Spawning codegen thread");
-
-                while (true) {
-                    std::string thisPath;
-
-                    {
-                        // Get lock
-                        faabric::util::UniqueLock lock(mx);
-
-                        // Check if we've got more to do
-                        if (iter == end) {
-                            SPDLOG_INFO("Codegen thread finished");
-                            break;
-                        }
-
-                        // Get path and increment
-                        thisPath = iter->path().string();
-                        iter++;
-                    }
-
-                    directory_entry subPath(thisPath);
-                    std::string functionName =
-                      subPath.path().filename().string();
-                    codegenForFunc(user, functionName, clean);
-                }
-            });
+        // Build the batch of all valid functions for this user
+        storage::FileLoader& loader = storage::getFileLoader();
+        std::vector<faabric::Message> msgs;
+        for (const auto& entry : boost::filesystem::directory_iterator(path)) {
+            std::string functionName = entry.path().filename().string();
+            faabric::Message msg =
+              faabric::util::messageFactory(user, functionName);
+
+            if (!boost::filesystem::exists(loader.getFunctionFile(msg))) {
+                SPDLOG_WARN("Invalid function: {}/{}", user, functionName);
+                continue;
+            }
+
+            msgs.emplace_back(msg);
         }
 
-        for (auto& t : threads) {
-            if (t.joinable()) {
-                t.join();
+        std::vector<codegen::CodegenResult> results =
+          codegen::codegenForFunctions(msgs, clean);
+        codegen::printCodegenResults(results);
+
+        for (const auto& r : results) {
+            if (!r.success) {
+                storage::shutdownFaasmS3();
+                return 1;
             }
         }
     }
 
     storage::shutdownFaasmS3();
+
+    return 0;
 }
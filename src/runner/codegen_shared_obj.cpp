@@ -1,6 +1,5 @@
 #include <codegen/MachineCodeGenerator.h>
-#include <faabric/util/environment.h>
-#include <faabric/util/locks.h>
+#include <faabric/util/func.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/string_tools.h>
 #include <storage/S3Wrapper.h>
@@ -16,13 +15,17 @@ po::variables_map parseCmdLine(int argc, char* argv[])
     // Define command line arguments
     po::options_description desc("Allowed options");
     desc.add_options()("input-path",
-                       po::value<std::string>(),
+                       po::value<std::vector<std::string>>(),
                        "directory of shared objects (required)")(
-      "clean", "overwrite existing generated code");
+      "clean", "overwrite existing generated code")(
+      "prelink",
+      po::value<std::string>(),
+      "link the shared objects into this user/function instead");
 
-    // Mark user and function as positional arguments
+    // Mark input paths as positional arguments. Only prelinking takes more
+    // than one.
     po::positional_options_description p;
-    p.add("input-path", 1);
+    p.add("input-path", -1);
 
     // Parse command line arguments
     po::variables_map vm;
@@ -34,60 +37,32 @@ po::variables_map parseCmdLine(int argc, char* argv[])
     return vm;
 }
 
-void codegenForDirectory(std::string& inputPath, bool clean)
+bool codegenForDirectory(std::string& inputPath, bool clean)
 {
     SPDLOG_INFO("Running codegen on directory {}", inputPath);
 
-    // Iterate through the directory
+    // Gather all the shared objects in the directory
+    std::vector<std::string> paths;
     path inputFilePath(inputPath);
-    recursive_directory_iterator iter(inputFilePath);
-    recursive_directory_iterator end;
-    std::mutex mx;
-
-    // Run multiple threads to do codegen
-    unsigned int nThreads = faabric::util::getUsableCores();
-    std::vector<std::thread> threads;
-
-    for (unsigned int i = 0; i < nThreads; i++) {
-        threads.emplace_back([&iter, &mx, &end, clean] {
-            SPDLOG_INFO("Spawning codegen thread");
-            codegen::MachineCodeGenerator& gen =
-              codegen::getMachineCodeGenerator();
-
-            while (true) {
-                std::string thisPath;
-
-                {
-                    // Get lock
-                    faabric::util::UniqueLock lock(mx);
-
-                    // Check if we've got more to do
-                    if (iter == end) {
-                        SPDLOG_INFO("Codegen thread finished");
-                        break;
-                    }
-
-                    // Get path and increment
-                    thisPath = iter->path().string();
-                    iter++;
-                }
-
-                directory_entry f(thisPath);
-                const std::string fileName = f.path().filename().string();
-                if (faabric::util::endsWith(fileName, ".so") ||
-                    faabric::util::endsWith(fileName, ".wasm")) {
-                    SPDLOG_INFO("Generating machine code for {}", thisPath);
-                    gen.codegenForSharedObject(thisPath, clean);
-                }
-            }
-        });
+    for (const auto& entry : recursive_directory_iterator(inputFilePath)) {
+        const std::string fileName = entry.path().filename().string();
+        if (faabric::util::endsWith(fileName, ".so") ||
+            faabric::util::endsWith(fileName, ".wasm")) {
+            paths.emplace_back(entry.path().string());
+        }
     }
 
-    for (auto& t : threads) {
-        if (t.joinable()) {
-            t.join();
+    std::vector<codegen::CodegenResult> results =
+      codegen::codegenForSharedObjects(paths, clean);
+    codegen::printCodegenResults(results);
+
+    for (const auto& r : results) {
+        if (!r.success) {
+            return false;
         }
     }
+
+    return true;
 }
 
 int main(int argc, char* argv[])
@@ -96,15 +71,42 @@ int main(int argc, char* argv[])
     storage::initFaasmS3();
 
     auto vm = parseCmdLine(argc, argv);
-    std::string inputPath = vm["input-path"].as<std::string>();
+    std::vector<std::string> inputPaths =
+      vm["input-path"].as<std::vector<std::string>>();
     bool clean = vm.find("clean") != vm.end();
 
+    if (vm.find("prelink") != vm.end()) {
+        std::string prelink = vm["prelink"].as<std::string>();
+        size_t sep = prelink.find('/');
+        if (sep == std::string::npos) {
+            SPDLOG_ERROR("Expected user/function to prelink into, got {}",
+                         prelink);
+            return 1;
+        }
+
+        faabric::Message msg = faabric::util::messageFactory(
+          prelink.substr(0, sep), prelink.substr(sep + 1));
+        codegen::getMachineCodeGenerator().prelinkFunction(msg, inputPaths);
+
+        storage::shutdownFaasmS3();
+        return 0;
+    }
+
+    if (inputPaths.size() != 1) {
+        SPDLOG_ERROR("Expected one input path, got {}", inputPaths.size());
+        return 1;
+    }
+    std::string inputPath = inputPaths.front();
+
+    bool success = true;
     if (is_directory(inputPath)) {
-        codegenForDirectory(inputPath, clean);
+        success = codegenForDirectory(inputPath, clean);
     } else {
         codegen::MachineCodeGenerator& gen = codegen::getMachineCodeGenerator();
         gen.codegenForSharedObject(inputPath, clean);
     }
 
     storage::shutdownFaasmS3();
+
+    return success ? 0 : 1;
 }
@@ -0,0 +1,41 @@
+#include <string>
+
+#include <conf/FaasmConfig.h>
+#include <runner/ColdStartRunner.h>
+#include <storage/S3Wrapper.h>
+
+#include <faabric/util/config.h>
+#include <faabric/util/logging.h>
+
+using namespace faabric::util;
+using namespace runner;
+
+int main(int argc, char* argv[])
+{
+    storage::initFaasmS3();
+
+    initLogging();
+
+    if (argc < 3 || argc > 4) {
+        SPDLOG_ERROR("Usage: cold_start_runner <infile> <outfile> [--flush]");
+        return 1;
+    }
+
+    std::string inFile = argv[1];
+    std::string outFile = argv[2];
+    bool flushBetweenRuns = argc == 4;
+    if (flushBetweenRuns && std::string(argv[3]) != "--flush") {
+        SPDLOG_ERROR("Unrecognised option {}", argv[3]);
+        return 1;
+    }
+
+    SystemConfig& conf = getSystemConfig();
+    conf.boundTimeout = 60000;
+    conf.globalMessageTimeout = 60000;
+    conf::getFaasmConfig().chainedCallTimeout = 60000;
+
+    int returnValue =
+      ColdStartRunner::execute(inFile, outFile, flushBetweenRuns);
+    storage::shutdownFaasmS3();
+    return returnValue;
+}
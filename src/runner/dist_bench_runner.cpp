@@ -0,0 +1,35 @@
+#include <string>
+
+#include <conf/FaasmConfig.h>
+#include <runner/DistBenchRunner.h>
+#include <storage/S3Wrapper.h>
+
+#include <faabric/util/config.h>
+#include <faabric/util/logging.h>
+
+using namespace faabric::util;
+using namespace runner;
+
+int main(int argc, char* argv[])
+{
+    storage::initFaasmS3();
+
+    initLogging();
+
+    if (argc != 3) {
+        SPDLOG_ERROR("Usage: dist_bench_runner <infile> <outfile>");
+        return 1;
+    }
+
+    std::string inFile = argv[1];
+    std::string outFile = argv[2];
+
+    SystemConfig& conf = getSystemConfig();
+    conf.boundTimeout = 60000;
+    conf.globalMessageTimeout = 300000;
+    conf::getFaasmConfig().chainedCallTimeout = 300000;
+
+    int returnValue = DistBenchRunner::execute(inFile, outFile);
+    storage::shutdownFaasmS3();
+    return returnValue;
+}
@@ -22,7 +22,7 @@ int doRunner(int argc, char* argv[])
     std::string function = vm["function"].as<std::string>();
 
     std::shared_ptr<faabric::BatchExecuteRequest> req =
-      faabric::util::batchExecFactory(user, function, 1);
+      runner::createRunnerBatch(vm);
     faabric::Message& msg = req->mutable_messages()->at(0);
 
     faabric::util::SystemConfig& conf = faabric::util::getSystemConfig();
@@ -33,8 +33,10 @@ int doRunner(int argc, char* argv[])
     conf.globalMessageTimeout = 120000;
     faasmConf.chainedCallTimeout = 120000;
 
-    // Make sure we have enough space for chained calls
+    // Make sure we have enough space for chained calls, and for the whole
+    // batch to run at once
     int nThreads = std::min<int>(faabric::util::getUsableCores(), 10);
+    nThreads = std::max<int>(nThreads, req->messages_size());
     faabric::HostResources res;
     res.set_slots(nThreads);
     faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
@@ -46,14 +48,7 @@ int doRunner(int argc, char* argv[])
     faabric::redis::Redis& redis = faabric::redis::Redis::getQueue();
     redis.flushAll();
 
-    if (user == "python") {
-        msg.set_pythonuser(msg.user());
-        msg.set_pythonfunction(msg.function());
-        msg.set_ispython(true);
-
-        msg.set_user(PYTHON_USER);
-        msg.set_function(PYTHON_FUNC);
-
+    if (msg.ispython()) {
         SPDLOG_INFO("Running Python function {}/{}",
                     msg.pythonuser(),
                     msg.pythonfunction());
@@ -62,13 +57,11 @@ int doRunner(int argc, char* argv[])
     }
 
     if (vm.count("input-data")) {
-        msg.set_inputdata(vm["input-data"].as<std::string>());
         SPDLOG_INFO("Adding input data: {}",
                     vm["input-data"].as<std::string>());
     }
 
     if (vm.count("cmdline")) {
-        msg.set_cmdline(vm["cmdline"].as<std::string>());
         SPDLOG_INFO("Adding command line arguments: {}",
                     vm["cmdline"].as<std::string>());
     }
@@ -80,15 +73,11 @@ int doRunner(int argc, char* argv[])
 
     // Submit the invocation
     PROF_START(FunctionExec)
+    faabric::util::TimePoint start = faabric::util::startTimer();
     sch.callFunctions(req);
 
-    // Await the result
-    const faabric::Message& result =
-      sch.getFunctionResult(msg, conf.globalMessageTimeout);
-    if (result.returnvalue() != 0) {
-        SPDLOG_ERROR("Execution failed: {}", result.outputdata());
-        throw std::runtime_error("Executing function failed");
-    }
+    // Await the results
+    runner::awaitRunnerBatch(req, conf.globalMessageTimeout, start);
 
     PROF_END(FunctionExec)
 
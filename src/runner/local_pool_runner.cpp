@@ -1,6 +1,7 @@
 #include <faabric/endpoint/FaabricEndpoint.h>
 #include <faabric/runner/FaabricMain.h>
 #include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
 #include <faaslet/Faaslet.h>
 #include <runner/runner_utils.h>
 #include <storage/S3Wrapper.h>
@@ -8,34 +9,24 @@
 int doRunner(int argc, char* argv[])
 {
     auto vm = runner::parseRunnerCmdLine(argc, argv);
-    std::string user = vm["user"].as<std::string>();
-    std::string function = vm["function"].as<std::string>();
     std::shared_ptr<faabric::BatchExecuteRequest> req =
-      faabric::util::batchExecFactory(user, function, 1);
-    faabric::Message& msg = req->mutable_messages()->at(0);
-    msg.set_topologyhint("FORCE_LOCAL");
-
-    if (vm.count("input-data")) {
-        msg.set_inputdata(vm["input-data"].as<std::string>());
-    }
-    if (vm.count("cmdline")) {
-        msg.set_cmdline(vm["cmdline"].as<std::string>());
+      runner::createRunnerBatch(vm);
+    for (auto& msg : *req->mutable_messages()) {
+        msg.set_topologyhint("FORCE_LOCAL");
     }
 
+    // Make sure the whole batch can run at once
     faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
-    sch.callFunctions(req);
+    faabric::HostResources res = sch.getThisHostResources();
+    if (res.slots() < req->messages_size()) {
+        res.set_slots(req->messages_size());
+        sch.setThisHostResources(res);
+    }
 
-    usleep(1000 * 500);
+    faabric::util::TimePoint start = faabric::util::startTimer();
+    sch.callFunctions(req);
 
-    for (const auto& m : req->messages()) {
-        faabric::Message result = sch.getFunctionResult(m, 20000 * 100);
-        if (result.returnvalue() != 0) {
-            SPDLOG_ERROR("Message ({}) returned error code: {}",
-                         m.id(),
-                         result.returnvalue());
-            throw std::runtime_error("Message execution failed");
-        }
-    }
+    runner::awaitRunnerBatch(req, 20000 * 100, start);
 
     return 0;
 }
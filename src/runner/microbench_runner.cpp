@@ -23,14 +23,19 @@ int main(int argc, char* argv[])
 
     initLogging();
 
-    if (argc < 3) {
-        SPDLOG_ERROR("Usage: microbench_runner <infile> <outfile>");
+    if (argc < 3 || argc > 4) {
+        SPDLOG_ERROR("Usage: microbench_runner <infile> <outfile> [--load]");
         return 1;
     }
 
     // Process input args
     std::string inFile = argv[1];
     std::string outFile = argv[2];
+    bool openLoop = argc == 4;
+    if (openLoop && std::string(argv[3]) != "--load") {
+        SPDLOG_ERROR("Unrecognised option {}", argv[3]);
+        return 1;
+    }
 
     // Set up config
     SystemConfig& conf = getSystemConfig();
@@ -40,7 +45,8 @@ int main(int argc, char* argv[])
     conf.globalMessageTimeout = 60000;
     faasmConf.chainedCallTimeout = 60000;
 
-    int returnValue = MicrobenchRunner::execute(inFile, outFile);
+    int returnValue = openLoop ? MicrobenchRunner::executeLoad(inFile, outFile)
+                               : MicrobenchRunner::execute(inFile, outFile);
     storage::shutdownFaasmS3();
     return returnValue;
 }
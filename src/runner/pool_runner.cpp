@@ -1,5 +1,8 @@
+#include <conf/FaasmConfig.h>
 #include <faaslet/Faaslet.h>
+#include <metrics/MetricsServer.h>
 #include <storage/S3Wrapper.h>
+#include <storage/SharedFiles.h>
 
 #include <faabric/endpoint/FaabricEndpoint.h>
 #include <faabric/runner/FaabricMain.h>
@@ -18,13 +21,29 @@ int main()
         faabric::runner::FaabricMain m(fac);
         m.startBackground();
 
+        // Warm up hot functions in the background
+        faaslet::startPrewarm();
+
+        // Serve operational metrics if asked to
+        metrics::MetricsServer metricsServer;
+        int metricsPort = conf::getFaasmConfig().metricsPort;
+        if (metricsPort > 0) {
+            faaslet::registerWorkerMetrics();
+            metricsServer.start(metricsPort);
+        }
+
         // Start endpoint (will also have multiple threads)
         SPDLOG_INFO("Starting endpoint");
         faabric::endpoint::FaabricEndpoint endpoint;
         endpoint.start(faabric::endpoint::EndpointMode::SIGNAL);
 
         SPDLOG_INFO("Shutting down");
+        metricsServer.stop();
+        faaslet::waitForPrewarm();
         m.shutdown();
+
+        // Writes to shared files may still be waiting to be uploaded
+        storage::SharedFiles::flushSharedFiles();
     }
 
     storage::shutdownFaasmS3();
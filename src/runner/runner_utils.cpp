@@ -1,5 +1,15 @@
 #include <runner/runner_utils.h>
 
+#include <storage/FileLoader.h>
+
+#include <faabric/scheduler/Scheduler.h>
+#include <faabric/util/func.h>
+#include <faabric/util/logging.h>
+
+#include <boost/algorithm/string.hpp>
+#include <fstream>
+#include <stdexcept>
+
 namespace po = boost::program_options;
 
 namespace runner {
@@ -13,7 +23,13 @@ po::variables_map parseRunnerCmdLine(int argc, char* argv[])
       "input-data", po::value<std::string>(), "input data for the function")(
       "cmdline",
       po::value<std::string>(),
-      "command line arguments to pass the function");
+      "command line arguments to pass the function")(
+      "batch-size",
+      po::value<int>()->default_value(1),
+      "number of messages to submit in one batch")(
+      "input-file",
+      po::value<std::string>(),
+      "file with one input per line, shared out across the batch");
 
     // Mark user and function as positional arguments
     po::positional_options_description p;
@@ -29,4 +45,110 @@ po::variables_map parseRunnerCmdLine(int argc, char* argv[])
 
     return vm;
 }
+
+std::vector<std::string> readBatchInputs(std::istream& in)
+{
+    std::vector<std::string> inputs;
+
+    std::string nextLine;
+    while (getline(in, nextLine)) {
+        boost::algorithm::trim_right(nextLine);
+        if (!nextLine.empty()) {
+            inputs.push_back(nextLine);
+        }
+    }
+
+    return inputs;
+}
+
+std::shared_ptr<faabric::BatchExecuteRequest> createRunnerBatch(
+  const po::variables_map& vm)
+{
+    std::string user = vm["user"].as<std::string>();
+    std::string function = vm["function"].as<std::string>();
+
+    int batchSize = vm["batch-size"].as<int>();
+    if (batchSize <= 0) {
+        SPDLOG_ERROR("Invalid batch size: {}", batchSize);
+        throw std::runtime_error("Invalid batch size");
+    }
+
+    std::vector<std::string> inputs;
+    if (vm.count("input-file")) {
+        std::string inputFile = vm["input-file"].as<std::string>();
+        std::ifstream inFs(inputFile);
+        if (!inFs.is_open()) {
+            SPDLOG_ERROR("Cannot open input file at {}", inputFile);
+            throw std::runtime_error("Cannot open input file");
+        }
+
+        inputs = readBatchInputs(inFs);
+        if (inputs.empty()) {
+            SPDLOG_ERROR("No inputs in {}", inputFile);
+            throw std::runtime_error("No inputs in input file");
+        }
+    } else if (vm.count("input-data")) {
+        inputs.push_back(vm["input-data"].as<std::string>());
+    }
+
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory(user, function, batchSize);
+
+    for (int i = 0; i < batchSize; i++) {
+        faabric::Message& msg = req->mutable_messages()->at(i);
+
+        if (user == "python") {
+            msg.set_pythonuser(msg.user());
+            msg.set_pythonfunction(msg.function());
+            msg.set_ispython(true);
+
+            msg.set_user(PYTHON_USER);
+            msg.set_function(PYTHON_FUNC);
+        }
+
+        if (!inputs.empty()) {
+            msg.set_inputdata(inputs.at(i % inputs.size()));
+        }
+
+        if (vm.count("cmdline")) {
+            msg.set_cmdline(vm["cmdline"].as<std::string>());
+        }
+    }
+
+    SPDLOG_INFO("Created batch of {} {}/{} ({} distinct inputs)",
+                batchSize,
+                user,
+                function,
+                inputs.size());
+
+    return req;
+}
+
+void awaitRunnerBatch(std::shared_ptr<faabric::BatchExecuteRequest> req,
+                      int timeoutMs,
+                      const faabric::util::TimePoint& start)
+{
+    faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
+
+    int nFailed = 0;
+    for (const auto& m : req->messages()) {
+        faabric::Message result = sch.getFunctionResult(m, timeoutMs);
+        if (result.returnvalue() != 0) {
+            SPDLOG_ERROR("Message ({}) returned error code {}: {}",
+                         m.id(),
+                         result.returnvalue(),
+                         result.outputdata());
+            nFailed++;
+        }
+    }
+
+    SPDLOG_INFO("Batch of {} finished in {}ms ({} failed)",
+                req->messages_size(),
+                faabric::util::getTimeDiffMillis(start),
+                nFailed);
+
+    if (nFailed > 0) {
+        throw std::runtime_error("Message execution failed");
+    }
+}
 }
@@ -0,0 +1,238 @@
+#include <conf/FaasmConfig.h>
+#include <storage/ArtefactCache.h>
+
+#include <faabric/util/gids.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <filesystem>
+#include <system_error>
+
+namespace storage {
+
+ArtefactCache& getArtefactCache()
+{
+    static ArtefactCache cache;
+    return cache;
+}
+
+ArtefactCache::ArtefactCache()
+  : dir(conf::getFaasmConfig().artefactCacheDir)
+{}
+
+// Blobs left by an earlier run are picked up, oldest first to go, though we
+// no longer know which files were made from them
+void ArtefactCache::scanDir()
+{
+    if (scanned) {
+        return;
+    }
+    scanned = true;
+
+    std::filesystem::create_directories(dir);
+    for (const auto& f : std::filesystem::directory_iterator(dir)) {
+        std::string name = f.path().filename().string();
+        if (!f.is_regular_file() || name.find('.') != std::string::npos) {
+            continue;
+        }
+
+        Blob& blob = blobs[name];
+        blob.size = f.file_size();
+        stats.bytes += blob.size;
+    }
+
+    SPDLOG_DEBUG("Found {} artefact blobs ({} bytes) in {}",
+                 blobs.size(),
+                 stats.bytes,
+                 dir);
+}
+
+std::string ArtefactCache::getBlobPath(const std::string& hash)
+{
+    return dir + "/" + hash;
+}
+
+std::string ArtefactCache::getDownloadPath(const std::string& hash)
+{
+    faabric::util::UniqueLock lock(mx);
+    scanDir();
+
+    return fmt::format(
+      "{}.{}.tmp", getBlobPath(hash), faabric::util::generateGid());
+}
+
+void ArtefactCache::placeBlob(const std::string& hash,
+                              Blob& blob,
+                              const std::string& path,
+                              bool copy)
+{
+    std::string blobPath = getBlobPath(hash);
+    std::string tmpPath =
+      fmt::format("{}.{}.tmp", path, faabric::util::generateGid());
+
+    // Link next to the destination and rename over it, so that nobody sees
+    // the path missing or half written. Links can't cross filesystems, in
+    // which case we fall back to copying.
+    std::error_code ec;
+    if (!copy) {
+        std::filesystem::create_hard_link(blobPath, tmpPath, ec);
+    }
+
+    if (copy || ec) {
+        std::filesystem::copy_file(blobPath, tmpPath);
+    }
+
+    std::filesystem::rename(tmpPath, path);
+
+    // The path may have been made from another blob before
+    auto it = pathHashes.find(path);
+    if (it != pathHashes.end() && it->second != hash) {
+        auto oldBlob = blobs.find(it->second);
+        if (oldBlob != blobs.end()) {
+            oldBlob->second.paths.erase(path);
+        }
+    }
+
+    pathHashes[path] = hash;
+    blob.paths.insert(path);
+    blob.lastUsed = ++useCount;
+}
+
+bool ArtefactCache::fetch(const std::string& hash,
+                          const std::string& path,
+                          bool copy)
+{
+    faabric::util::UniqueLock lock(mx);
+    scanDir();
+
+    auto it = blobs.find(hash);
+    if (it == blobs.end()) {
+        stats.misses++;
+        return false;
+    }
+
+    SPDLOG_TRACE("Artefact cache hit on {} for {}", hash, path);
+    placeBlob(hash, it->second, path, copy);
+    stats.hits++;
+
+    return true;
+}
+
+void ArtefactCache::insert(const std::string& hash,
+                           const std::string& downloadPath,
+                           const std::string& path,
+                           bool copy)
+{
+    faabric::util::UniqueLock lock(mx);
+    scanDir();
+
+    // Another thread may have downloaded the same blob for another path, in
+    // which case the contents are the same
+    std::filesystem::rename(downloadPath, getBlobPath(hash));
+
+    auto [it, isNew] = blobs.try_emplace(hash);
+    if (isNew) {
+        it->second.size = std::filesystem::file_size(getBlobPath(hash));
+        stats.bytes += it->second.size;
+    }
+
+    placeBlob(hash, it->second, path, copy);
+    evictToBudget(hash);
+}
+
+void ArtefactCache::touch(const std::string& path)
+{
+    faabric::util::UniqueLock lock(mx);
+    stats.hits++;
+
+    auto it = pathHashes.find(path);
+    if (it == pathHashes.end()) {
+        return;
+    }
+
+    auto blob = blobs.find(it->second);
+    if (blob != blobs.end()) {
+        blob->second.lastUsed = ++useCount;
+    }
+}
+
+void ArtefactCache::evictToBudget(const std::string& keepHash)
+{
+    size_t budgetBytes =
+      ((size_t)conf::getFaasmConfig().artefactCacheBudgetMb) * 1024 * 1024;
+    if (budgetBytes == 0) {
+        return;
+    }
+
+    while (stats.bytes > budgetBytes) {
+        auto victim = blobs.end();
+        for (auto it = blobs.begin(); it != blobs.end(); ++it) {
+            if (it->first == keepHash) {
+                continue;
+            }
+
+            if (victim == blobs.end() ||
+                it->second.lastUsed < victim->second.lastUsed) {
+                victim = it;
+            }
+        }
+
+        if (victim == blobs.end()) {
+            SPDLOG_WARN("Artefact cache over budget ({} > {} bytes) with "
+                        "nothing left to evict",
+                        stats.bytes,
+                        budgetBytes);
+            break;
+        }
+
+        SPDLOG_DEBUG("Artefact cache evicting {} ({} bytes, {} files)",
+                     victim->first,
+                     victim->second.size,
+                     victim->second.paths.size());
+
+        // Anything holding the files open keeps its copy until it's done
+        for (const auto& path : victim->second.paths) {
+            std::filesystem::remove(path);
+            pathHashes.erase(path);
+        }
+        std::filesystem::remove(getBlobPath(victim->first));
+
+        stats.bytes -= victim->second.size;
+        stats.evictions++;
+        blobs.erase(victim);
+    }
+}
+
+void ArtefactCache::forgetPaths()
+{
+    faabric::util::UniqueLock lock(mx);
+    for (auto& [hash, blob] : blobs) {
+        blob.paths.clear();
+    }
+    pathHashes.clear();
+}
+
+void ArtefactCache::clear()
+{
+    faabric::util::UniqueLock lock(mx);
+    std::filesystem::remove_all(dir);
+
+    blobs.clear();
+    pathHashes.clear();
+    stats = ArtefactCacheStats();
+    useCount = 0;
+
+    // Pick up any change of directory
+    dir = conf::getFaasmConfig().artefactCacheDir;
+    scanned = false;
+}
+
+ArtefactCacheStats ArtefactCache::getStats()
+{
+    faabric::util::UniqueLock lock(mx);
+    ArtefactCacheStats result = stats;
+    result.nBlobs = blobs.size();
+
+    return result;
+}
+}
@@ -0,0 +1,127 @@
+#include <conf/FaasmConfig.h>
+#include <storage/ArtefactPeers.h>
+
+#include <faabric/state/InMemoryStateRegistry.h>
+#include <faabric/state/State.h>
+#include <faabric/util/config.h>
+#include <faabric/util/logging.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace storage {
+
+bool isArtefactPeerFetchEnabled()
+{
+    // Only in-memory state lives on the hosts themselves
+    return conf::getFaasmConfig().artefactPeerFetch == "on" &&
+           faabric::util::getSystemConfig().stateMode == "inmemory";
+}
+
+// Returns the host holding the artefact, or an empty string if none does
+static std::string getArtefactHost(const std::string& hash)
+{
+    const std::string& thisHost =
+      faabric::util::getSystemConfig().endpointHost;
+    try {
+        return faabric::state::getInMemoryStateRegistry().getMasterIP(
+          ARTEFACT_PEERS_STATE_USER, hash, thisHost, false);
+    } catch (std::exception& ex) {
+        SPDLOG_TRACE("No peer holds artefact {}: {}", hash, ex.what());
+        return "";
+    }
+}
+
+bool fetchArtefactFromPeer(const std::string& hash,
+                           const std::string& filePath)
+{
+    std::string peerHost = getArtefactHost(hash);
+    if (peerHost.empty() ||
+        peerHost == faabric::util::getSystemConfig().endpointHost) {
+        return false;
+    }
+
+    SPDLOG_DEBUG("Fetching artefact {} from peer {}", hash, peerHost);
+    faabric::state::State& state = faabric::state::getGlobalState();
+    try {
+        size_t size = state.getStateSize(ARTEFACT_PEERS_STATE_USER, hash);
+        auto kv = state.getKV(ARTEFACT_PEERS_STATE_USER, hash, size);
+        kv->pull();
+
+        std::ofstream outFs(filePath, std::ios::binary | std::ios::trunc);
+        outFs.write(reinterpret_cast<const char*>(kv->get()), size);
+        outFs.close();
+        if (!outFs) {
+            throw std::runtime_error("Failed writing artefact from peer");
+        }
+    } catch (std::exception& ex) {
+        SPDLOG_WARN(
+          "Failed to fetch artefact {} from {}: {}", hash, peerHost, ex.what());
+        state.deleteKVLocally(ARTEFACT_PEERS_STATE_USER, hash);
+        std::remove(filePath.c_str());
+        return false;
+    }
+
+    // The file is what we keep, so don't hold a second copy in memory
+    state.deleteKVLocally(ARTEFACT_PEERS_STATE_USER, hash);
+
+    return true;
+}
+
+void shareArtefactWithPeers(const std::string& hash,
+                            const std::string& filePath)
+{
+    if (!getArtefactHost(hash).empty()) {
+        return;
+    }
+
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        SPDLOG_WARN("Failed to open artefact {} at {}: {}",
+                    hash,
+                    filePath,
+                    std::strerror(errno));
+        return;
+    }
+
+    struct stat s;
+    fstat(fd, &s);
+    size_t size = s.st_size;
+    if (size == 0) {
+        close(fd);
+        return;
+    }
+
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        SPDLOG_WARN("Failed to map artefact {} at {}: {}",
+                    hash,
+                    filePath,
+                    std::strerror(errno));
+        return;
+    }
+
+    // Creating the value claims it for this host, unless another host got
+    // there first, in which case it can serve it
+    faabric::state::State& state = faabric::state::getGlobalState();
+    auto kv = state.getKV(ARTEFACT_PEERS_STATE_USER, hash, size);
+    const std::string& thisHost =
+      faabric::util::getSystemConfig().endpointHost;
+    if (getArtefactHost(hash) == thisHost) {
+        SPDLOG_DEBUG("Sharing artefact {} ({} bytes) with peers", hash, size);
+        kv->set(static_cast<uint8_t*>(mapped));
+    } else {
+        state.deleteKVLocally(ARTEFACT_PEERS_STATE_USER, hash);
+    }
+
+    munmap(mapped, size);
+}
+}
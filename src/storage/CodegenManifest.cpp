@@ -0,0 +1,109 @@
+#include <storage/CodegenManifest.h>
+
+#include <faabric/util/bytes.h>
+#include <faabric/util/logging.h>
+
+#include <openssl/evp.h>
+#include <sstream>
+#include <stdexcept>
+
+// Bump this if the manifest format changes. Manifests with a different header
+// are discarded, which forces a full codegen
+#define CODEGEN_MANIFEST_HEADER "faasm-codegen-manifest-v1"
+
+namespace storage {
+
+CodegenManifest::CodegenManifest(const std::vector<uint8_t>& bytes)
+{
+    if (bytes.empty()) {
+        return;
+    }
+
+    std::istringstream in(faabric::util::bytesToString(bytes));
+    std::string line;
+
+    std::getline(in, line);
+    if (line != CODEGEN_MANIFEST_HEADER) {
+        SPDLOG_WARN("Ignoring codegen manifest with unrecognised header: {}",
+                    line);
+        return;
+    }
+
+    // Each line is a tab-separated key, hash, compiler version and options
+    while (std::getline(in, line)) {
+        if (line.empty()) {
+            continue;
+        }
+
+        std::istringstream lineStream(line);
+        std::string key;
+        CodegenManifestEntry entry;
+        std::getline(lineStream, key, '\t');
+        std::getline(lineStream, entry.hash, '\t');
+        std::getline(lineStream, entry.compilerVersion, '\t');
+        std::getline(lineStream, entry.options, '\t');
+
+        if (key.empty() || entry.hash.empty()) {
+            SPDLOG_WARN("Skipping malformed codegen manifest line: {}", line);
+            continue;
+        }
+
+        entries[key] = entry;
+    }
+}
+
+std::vector<uint8_t> CodegenManifest::toBytes() const
+{
+    std::ostringstream out;
+    out << CODEGEN_MANIFEST_HEADER << "\n";
+    for (const auto& [key, entry] : entries) {
+        out << key << "\t" << entry.hash << "\t" << entry.compilerVersion
+            << "\t" << entry.options << "\n";
+    }
+
+    return faabric::util::stringToBytes(out.str());
+}
+
+CodegenManifestEntry CodegenManifest::getEntry(const std::string& key) const
+{
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        return {};
+    }
+
+    return it->second;
+}
+
+void CodegenManifest::setEntry(const std::string& key,
+                               const CodegenManifestEntry& entry)
+{
+    entries[key] = entry;
+}
+
+std::string hashCodegenInput(const std::vector<uint8_t>& bytes)
+{
+    // BLAKE2b is considerably faster than MD5 on 64-bit hosts and ships with
+    // the OpenSSL we already link against
+    const EVP_MD* md = EVP_blake2b512();
+    EVP_MD_CTX* mdctx = EVP_MD_CTX_new();
+    if (mdctx == nullptr || EVP_DigestInit_ex(mdctx, md, nullptr) != 1) {
+        EVP_MD_CTX_free(mdctx);
+        throw std::runtime_error("Failed to initialise codegen hash");
+    }
+
+    EVP_DigestUpdate(mdctx, bytes.data(), bytes.size());
+
+    unsigned int digestLen = EVP_MD_size(md);
+    std::vector<uint8_t> digest(digestLen);
+    EVP_DigestFinal_ex(mdctx, digest.data(), &digestLen);
+    EVP_MD_CTX_free(mdctx);
+
+    std::string result;
+    result.reserve(2 * digestLen);
+    for (unsigned int i = 0; i < digestLen; i++) {
+        result += fmt::format("{:02x}", digest[i]);
+    }
+
+    return result;
+}
+}
@@ -2,26 +2,39 @@
 
 #include <faabric/util/bytes.h>
 #include <faabric/util/config.h>
+#include <faabric/util/files.h>
+#include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/macros.h>
 #include <faabric/util/timing.h>
 
 #include <conf/FaasmConfig.h>
+#include <storage/RuntimeOverlay.h>
 #include <storage/SharedFiles.h>
 
 #include <WAVM/WASI/WASIABI.h>
 #include <boost/filesystem.hpp>
+#include <chrono>
 #include <dirent.h>
 #include <fcntl.h>
+#include <shared_mutex>
 #include <stdexcept>
 #include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/uio.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
 
 #define WASI_FD_FLAGS                                                          \
     (__WASI_FDFLAG_RSYNC | __WASI_FDFLAG_APPEND | __WASI_FDFLAG_DSYNC |        \
      __WASI_FDFLAG_SYNC | __WASI_FDFLAG_NONBLOCK)
 
+// Bytes of directory entries read from the kernel at once
+#define DIRENTS_BATCH_BYTES (256 * 1024)
+
 namespace storage {
 std::string prependRuntimeRoot(const std::string& originalPath)
 {
@@ -135,6 +148,8 @@ uint16_t errnoToWasi(int errnoIn)
             return __WASI_EMFILE;
         case ESPIPE:
             return __WASI_ESPIPE;
+        case EROFS:
+            return __WASI_EROFS;
         default:
             throw std::runtime_error("Unsupported WASI errno: " +
                                      std::to_string(errnoIn));
@@ -193,12 +208,127 @@ FileDescriptor FileDescriptor::stderrFactory()
     return FileDescriptor::stdFdFactory(STDERR_FILENO, "/dev/stderr");
 }
 
+// As filled in by getdents64, which glibc doesn't declare a struct for
+struct LinuxDirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+std::vector<DirEnt> readDirEntries(const std::string& realPath)
+{
+    int dirFd = ::open(realPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0) {
+        SPDLOG_ERROR("Failed to open dir {} ({})", realPath, strerror(errno));
+        throw std::runtime_error("Failed to open dir");
+    }
+
+    std::vector<DirEnt> entries;
+    std::vector<char> batch(DIRENTS_BATCH_BYTES);
+    while (true) {
+        long nBytes =
+          ::syscall(SYS_getdents64, dirFd, batch.data(), batch.size());
+        if (nBytes < 0) {
+            int err = errno;
+            ::close(dirFd);
+            SPDLOG_ERROR("Failed to read dir {} ({})", realPath, strerror(err));
+            throw std::runtime_error("Failed to read dir");
+        }
+
+        if (nBytes == 0) {
+            break;
+        }
+
+        long pos = 0;
+        while (pos < nBytes) {
+            auto* d = reinterpret_cast<LinuxDirent64*>(batch.data() + pos);
+
+            // The cookie passed back to fd_readdir is one past the entry
+            DirEnt& ent = entries.emplace_back();
+            ent.next = entries.size();
+            ent.type = d->d_type;
+            ent.ino = d->d_ino;
+            ent.path = std::string(d->d_name);
+
+            pos += d->d_reclen;
+        }
+    }
+
+    ::close(dirFd);
+
+    return entries;
+}
+
+// Listings of shared directories only change when files are uploaded to them,
+// so are trusted for as long as lookups of shared files are, or until this
+// host writes to or deletes from the directory
+struct SharedDirListing
+{
+    std::shared_ptr<const std::vector<DirEnt>> contents;
+    std::chrono::steady_clock::time_point expiry;
+};
+
+static std::shared_mutex sharedListingsMx;
+static std::unordered_map<std::string, SharedDirListing> sharedListings;
+
+static std::string trimTrailingSlashes(const std::string& path)
+{
+    size_t end = path.find_last_not_of('/');
+    return end == std::string::npos ? path : path.substr(0, end + 1);
+}
+
+static std::shared_ptr<const std::vector<DirEnt>> getSharedDirListing(
+  const std::string& dirPath)
+{
+    std::shared_lock<std::shared_mutex> lock(sharedListingsMx);
+    auto it = sharedListings.find(trimTrailingSlashes(dirPath));
+    if (it == sharedListings.end() ||
+        it->second.expiry < std::chrono::steady_clock::now()) {
+        return nullptr;
+    }
+
+    return it->second.contents;
+}
+
+static void setSharedDirListing(
+  const std::string& dirPath,
+  std::shared_ptr<const std::vector<DirEnt>> contents)
+{
+    faabric::util::FullLock lock(sharedListingsMx);
+    sharedListings[trimTrailingSlashes(dirPath)] = {
+        std::move(contents),
+        std::chrono::steady_clock::now() +
+          std::chrono::milliseconds(SHARED_FILE_LOOKUP_TTL_MS)
+    };
+}
+
+void clearSharedDirListingFor(const std::string& sharedPath)
+{
+    std::string p = trimTrailingSlashes(sharedPath);
+    size_t slash = p.find_last_of('/');
+    if (slash == std::string::npos) {
+        return;
+    }
+
+    faabric::util::FullLock lock(sharedListingsMx);
+    sharedListings.erase(trimTrailingSlashes(p.substr(0, slash)));
+}
+
+void clearSharedDirListings()
+{
+    faabric::util::FullLock lock(sharedListingsMx);
+    sharedListings.clear();
+}
+
 void FileDescriptor::iterReset()
 {
     // Reset iterator state
     dirContentsLoaded = false;
     dirContentsIdx = 0;
-    dirContents.clear();
+    dirContents = nullptr;
 }
 
 void FileDescriptor::loadDirContents()
@@ -206,6 +336,8 @@ void FileDescriptor::loadDirContents()
 
     // Work out the local filesystem path
     std::string realPath;
+    std::shared_ptr<SharedBundle> bundle = nullptr;
+    std::string pathInBundle;
     if (SharedFiles::isPathShared(path)) {
         int pullErr = SharedFiles::syncSharedFile(path);
 
@@ -213,44 +345,72 @@ void FileDescriptor::loadDirContents()
             throw std::runtime_error("Failed to open shared dir");
         }
 
+        dirContents = getSharedDirListing(path);
+        if (dirContents != nullptr) {
+            SPDLOG_TRACE("Loading dir contents from cache: {}", path);
+            dirContentsLoaded = true;
+            return;
+        }
+
         realPath = SharedFiles::realPathForSharedFile(path);
+        bundle = SharedFiles::getBundleForSharedFile(path, pathInBundle);
     } else {
-        realPath = prependRuntimeRoot(path);
-    }
+        RuntimeOverlay& overlay = getRuntimeOverlay();
+        const RuntimeOverlayEntry* entry = nullptr;
+        if (overlay.covers(path)) {
+            entry = overlay.lookUp(path);
+        }
 
-    // Open the directory
-    SPDLOG_DEBUG("Loading dir contents: {}", realPath);
-    DIR* dirPtr = ::opendir(realPath.c_str());
-    if (dirPtr == nullptr) {
-        throw std::runtime_error("Failed to open dir");
+        if (entry != nullptr && entry->children != nullptr) {
+            SPDLOG_DEBUG("Loading dir contents from runtime overlay: {}", path);
+            dirContents = entry->children;
+            dirContentsLoaded = true;
+            return;
+        }
+
+        realPath = prependRuntimeRoot(path);
     }
 
     // Load all directory entries
-    uint64_t nextIdx = 0;
-    struct dirent* direntPtr;
-    while ((direntPtr = ::readdir(dirPtr)) != nullptr) {
-        nextIdx++;
+    SPDLOG_DEBUG("Loading dir contents: {}", realPath);
+    auto contents =
+      std::make_shared<std::vector<DirEnt>>(readDirEntries(realPath));
+    uint64_t nextIdx = contents->size();
+
+    // Add whatever's in the bundle and not already on disk
+    if (bundle != nullptr) {
+        std::unordered_set<std::string> onDisk;
+        for (const auto& ent : *contents) {
+            onDisk.insert(ent.path);
+        }
 
-        DirEnt nextEnt;
+        for (const auto& name : bundle->listDir(pathInBundle)) {
+            if (onDisk.count(name) > 0) {
+                continue;
+            }
 
-        // We have to set "next" here to specify the offset of this
-        // directory entry. It seems this is only used to be passed
-        // back as the "cookie" value to fd_readdir
-        nextEnt.next = nextIdx;
+            std::string bundledPath =
+              pathInBundle.empty() ? name : pathInBundle + "/" + name;
 
-        nextEnt.type = direntPtr->d_type;
-        nextEnt.ino = direntPtr->d_ino;
-        nextEnt.path = std::string(direntPtr->d_name);
+            DirEnt nextEnt;
+            nextEnt.next = ++nextIdx;
+            nextEnt.type = bundle->isDir(bundledPath) ? DT_DIR : DT_REG;
+            nextEnt.ino = 0;
+            nextEnt.path = name;
 
-        dirContents.push_back(nextEnt);
+            contents->push_back(nextEnt);
+        }
     }
 
-    // Close iterator
-    closedir(dirPtr);
-    SPDLOG_DEBUG("Loaded {} entries for {}", dirContents.size(), realPath);
+    SPDLOG_DEBUG("Loaded {} entries for {}", contents->size(), realPath);
 
     // Set flag
+    dirContents = std::move(contents);
     dirContentsLoaded = true;
+
+    if (SharedFiles::isPathShared(path)) {
+        setSharedDirListing(path, dirContents);
+    }
 }
 
 void FileDescriptor::iterBack()
@@ -273,7 +433,7 @@ bool FileDescriptor::iterStarted() const
 
 bool FileDescriptor::iterFinished()
 {
-    return dirContentsLoaded && (dirContentsIdx >= dirContents.size());
+    return dirContentsLoaded && (dirContentsIdx >= dirContents->size());
 }
 
 DirEnt FileDescriptor::iterNext()
@@ -288,10 +448,10 @@ DirEnt FileDescriptor::iterNext()
         throw std::runtime_error(
           fmt::format("Accessing index {} in directory length {}",
                       dirContentsIdx,
-                      dirContents.size()));
+                      dirContents->size()));
     }
 
-    DirEnt nextEntry = dirContents.at(dirContentsIdx);
+    DirEnt nextEntry = dirContents->at(dirContentsIdx);
 
     // Increment the iterator
     dirContentsIdx++;
@@ -300,32 +460,33 @@ DirEnt FileDescriptor::iterNext()
 }
 
 /**
- * Note that this function conforms to the standard readdir interface:
- * - Copy each dirent struct followed by its path string
- * - If the last path string doesn't fit, return the buffer length
- * - If the last dirent doesn't fit, don't copy it and return the buffer length
- *
- * The external libc wrapper should prevent this third point.
- *
- * If the final dirent or path doesn't fit, the caller will expect the next
- * result to contain that same dirent/ path, so we have to step back one in the
- * iterator if that's the case.
+ * Copies each entry as a WASI dirent followed by its name, starting from the
+ * entry with the given cookie. As with fd_readdir, if the last entry doesn't
+ * fit it's cut short and the buffer is filled, so the caller knows to read
+ * again from that entry's cookie. The caller knows they've reached the end
+ * when the buffer is _not_ filled.
  *
- * The caller knows they've reached the end when the buffer is _not_ filled by
- * this call.
+ * Reading from the start cookie lists the directory afresh, so as to pick up
+ * any changes, as with rewinddir.
  */
 size_t FileDescriptor::copyDirentsToWasiBuffer(uint8_t* buffer,
-                                               size_t bufferLen)
+                                               size_t bufferLen,
+                                               uint64_t cookie)
 {
+    if (cookie == __WASI_DIRCOOKIE_START) {
+        iterReset();
+    }
 
-    // Prepare loop variables
-    size_t bytesLeft = bufferLen;
-    bool isBufferFull = false;
+    if (!dirContentsLoaded) {
+        loadDirContents();
+    }
 
+    size_t idx = std::min<uint64_t>(cookie, dirContents->size());
+    size_t bytesLeft = bufferLen;
     size_t wasiDirentSize = sizeof(__wasi_dirent_t);
 
-    while (!iterFinished()) {
-        DirEnt d = iterNext();
+    for (; idx < dirContents->size() && bytesLeft > 0; idx++) {
+        const DirEnt& d = dirContents->at(idx);
 
         // Create WASI dirent
         size_t pathSize = d.path.size();
@@ -334,34 +495,27 @@ size_t FileDescriptor::copyDirentsToWasiBuffer(uint8_t* buffer,
                                     .d_namlen = (uint32_t)pathSize,
                                     .d_type = d.type };
 
-        // Drop out if we have no room for the dirent
-        if (bytesLeft < wasiDirentSize) {
-            isBufferFull = true;
-            break;
-        }
-
         auto* direntPtr = BYTES(&wasmDirEnt);
-        std::copy(direntPtr, direntPtr + wasiDirentSize, buffer);
-        bytesLeft -= wasiDirentSize;
-        buffer += wasiDirentSize;
+        size_t direntBytes = std::min(wasiDirentSize, bytesLeft);
+        std::copy(direntPtr, direntPtr + direntBytes, buffer);
+        bytesLeft -= direntBytes;
+        buffer += direntBytes;
 
-        // Drop out if we have no room for the path
-        if (bytesLeft < pathSize) {
-            isBufferFull = true;
+        const auto* pathPtr = BYTES_CONST(d.path.c_str());
+        size_t pathBytes = std::min(pathSize, bytesLeft);
+        std::copy(pathPtr, pathPtr + pathBytes, buffer);
+        bytesLeft -= pathBytes;
+        buffer += pathBytes;
+
+        // Entries cut short will be read again
+        if (direntBytes < wasiDirentSize || pathBytes < pathSize) {
             break;
         }
-
-        const auto* pathPtr = BYTES_CONST(d.path.c_str());
-        std::copy(pathPtr, pathPtr + pathSize, buffer);
-        bytesLeft -= pathSize;
-        buffer += pathSize;
     }
 
-    if (isBufferFull) {
-        // Go back one, we've not been able to finish this entry
-        iterBack();
-        return bufferLen;
-    } // Return the number of bytes copied
+    // Leave the iterator at the first entry not fully copied
+    dirContentsIdx = idx;
+
     return bufferLen - bytesLeft;
 }
 
@@ -446,7 +600,49 @@ bool FileDescriptor::pathOpen(uint32_t lookupFlags,
         }
 
         realPath = SharedFiles::realPathForSharedFile(path);
+
+        // Files from bundles are read straight from the bundle. Writes go to
+        // a local copy, which takes over from then on.
+        std::string pathInBundle;
+        std::shared_ptr<SharedBundle> bundle =
+          SharedFiles::getBundleForSharedFile(path, pathInBundle);
+        if (bundle != nullptr && bundle->isFile(pathInBundle)) {
+            if (!isWrite) {
+                linuxFd = bundle->openFile(pathInBundle);
+                if (linuxFd < 0) {
+                    linuxErrno = errno;
+                    wasiErrno = errnoToWasi(linuxErrno);
+                    return false;
+                }
+
+                return true;
+            }
+
+            boost::filesystem::create_directories(
+              boost::filesystem::path(realPath).parent_path());
+            faabric::util::writeBytesToFile(realPath,
+                                            bundle->readFile(pathInBundle));
+            SharedFiles::clearCacheForSharedFile(path);
+        }
     } else {
+        // Paths in the overlay can only be read, and only exist if they're in
+        // its index
+        RuntimeOverlay& overlay = getRuntimeOverlay();
+        if (overlay.covers(path)) {
+            if (isWrite || openMode == OpenMode::CREATE ||
+                openMode == OpenMode::TRUNC) {
+                linuxErrno = EROFS;
+            } else if (overlay.lookUp(path) == nullptr) {
+                linuxErrno = ENOENT;
+            }
+
+            if (linuxErrno != 0) {
+                linuxFd = -1;
+                wasiErrno = errnoToWasi(linuxErrno);
+                return false;
+            }
+        }
+
         realPath = prependRuntimeRoot(path);
     }
 
@@ -499,6 +695,21 @@ bool FileDescriptor::updateFlags(int32_t fdFlags)
     return true;
 }
 
+// Writes at the current offset have just moved it past what they wrote
+static void recordSharedWrite(const std::string& path,
+                              int linuxFd,
+                              ssize_t bytesWritten)
+{
+    off_t end = ::lseek(linuxFd, 0, SEEK_CUR);
+    if (end < bytesWritten) {
+        // Can't tell where the write went, so the whole file is uploaded
+        SharedFiles::writeSharedFile(path, 0, SIZE_MAX);
+        return;
+    }
+
+    SharedFiles::writeSharedFile(path, end - bytesWritten, bytesWritten);
+}
+
 ssize_t FileDescriptor::write(std::vector<::iovec>& nativeIovecs,
                               int iovecCount)
 {
@@ -509,18 +720,104 @@ ssize_t FileDescriptor::write(std::vector<::iovec>& nativeIovecs,
         SPDLOG_ERROR(
           "writev failed on fd {}: {}", getLinuxFd(), strerror(errno));
         wasiErrno = errnoToWasi(errno);
-        return false;
+        return -1;
     }
 
-    bool isShared = SharedFiles::isPathShared(path);
-    std::string realPath;
-    if (isShared) {
-        SharedFiles::updateSharedFile(path);
+    if (SharedFiles::isPathShared(path)) {
+        recordSharedWrite(path, getLinuxFd(), bytesWritten);
+    }
+
+    return bytesWritten;
+}
+
+ssize_t FileDescriptor::pread(std::vector<::iovec>& nativeIovecs,
+                              int iovecCount,
+                              uint64_t offset)
+{
+    ssize_t bytesRead =
+      ::preadv(getLinuxFd(), nativeIovecs.data(), iovecCount, offset);
+
+    if (bytesRead < 0) {
+        wasiErrno = errnoToWasi(errno);
+        return -1;
+    }
+
+    return bytesRead;
+}
+
+ssize_t FileDescriptor::pwrite(std::vector<::iovec>& nativeIovecs,
+                               int iovecCount,
+                               uint64_t offset)
+{
+    ssize_t bytesWritten =
+      ::pwritev(getLinuxFd(), nativeIovecs.data(), iovecCount, offset);
+
+    if (bytesWritten < 0) {
+        SPDLOG_ERROR(
+          "pwritev failed on fd {}: {}", getLinuxFd(), strerror(errno));
+        wasiErrno = errnoToWasi(errno);
+        return -1;
+    }
+
+    if (SharedFiles::isPathShared(path)) {
+        SharedFiles::writeSharedFile(path, offset, bytesWritten);
     }
 
     return bytesWritten;
 }
 
+ssize_t FileDescriptor::sendTo(FileDescriptor& outDesc,
+                               off_t* offset,
+                               size_t count)
+{
+    // Copies between files stay in the kernel, and may not copy at all on
+    // filesystems that share blocks. Anything else, e.g. pipes and sockets,
+    // goes through sendfile.
+    ssize_t bytesSent = ::copy_file_range(
+      getLinuxFd(), offset, outDesc.getLinuxFd(), nullptr, count, 0);
+
+    if (bytesSent < 0 && (errno == EXDEV || errno == EINVAL ||
+                          errno == ENOSYS || errno == EOPNOTSUPP)) {
+        bytesSent =
+          ::sendfile(outDesc.getLinuxFd(), getLinuxFd(), offset, count);
+    }
+
+    if (bytesSent < 0) {
+        SPDLOG_ERROR("Failed sending from fd {} to {}: {}",
+                     getLinuxFd(),
+                     outDesc.getLinuxFd(),
+                     strerror(errno));
+        wasiErrno = errnoToWasi(errno);
+        return -1;
+    }
+
+    if (SharedFiles::isPathShared(outDesc.path)) {
+        recordSharedWrite(outDesc.path, outDesc.getLinuxFd(), bytesSent);
+    }
+
+    return bytesSent;
+}
+
+bool FileDescriptor::sync()
+{
+    if (::fsync(getLinuxFd()) != 0) {
+        wasiErrno = errnoToWasi(errno);
+        return false;
+    }
+
+    if (SharedFiles::isPathShared(path)) {
+        try {
+            SharedFiles::flushSharedFile(path);
+        } catch (std::exception& e) {
+            SPDLOG_ERROR("Failed to sync shared file {}: {}", path, e.what());
+            wasiErrno = __WASI_EIO;
+            return false;
+        }
+    }
+
+    return true;
+}
+
 void FileDescriptor::close() const
 {
     if (linuxFd > 0) {
@@ -595,9 +892,24 @@ Stat FileDescriptor::stat(const std::string& relativePath)
         std::string realPath;
         if (SharedFiles::isPathShared(statPath)) {
             statErrno = SharedFiles::syncSharedFile(statPath);
-            if (statErrno == 0) {
+
+            std::string pathInBundle;
+            std::shared_ptr<SharedBundle> bundle =
+              SharedFiles::getBundleForSharedFile(statPath, pathInBundle);
+            if (statErrno == 0 && bundle != nullptr &&
+                bundle->isFile(pathInBundle)) {
+                bundle->statPath(pathInBundle, nativeStat);
+            } else if (statErrno == 0) {
                 realPath = SharedFiles::realPathForSharedFile(statPath);
             }
+        } else if (getRuntimeOverlay().covers(statPath)) {
+            const RuntimeOverlayEntry* entry =
+              getRuntimeOverlay().lookUp(statPath);
+            if (entry == nullptr) {
+                statErrno = ENOENT;
+            } else {
+                nativeStat = entry->nativeStat;
+            }
         } else {
             realPath = prependRuntimeRoot(statPath);
         }
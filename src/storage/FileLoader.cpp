@@ -1,4 +1,8 @@
 #include <conf/FaasmConfig.h>
+#include <metrics/Metrics.h>
+#include <storage/ArtefactCache.h>
+#include <storage/ArtefactPeers.h>
+#include <storage/CodegenManifest.h>
 #include <storage/FileLoader.h>
 #include <storage/SharedFiles.h>
 
@@ -6,10 +10,18 @@
 #include <faabric/util/config.h>
 #include <faabric/util/files.h>
 #include <faabric/util/func.h>
+#include <faabric/util/locks.h>
 #include <faabric/util/testing.h>
 
+#include <openssl/evp.h>
+
 #include <filesystem>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <sstream>
 #include <stdexcept>
+#include <unordered_map>
 
 using namespace faabric::util;
 
@@ -19,11 +31,27 @@ namespace storage {
 // UTILITIES
 // -------------------------------------
 
-#define FUNC_FILENAME "function.wasm"
+static metrics::Counter& getCacheHitCounter()
+{
+    static metrics::Counter& counter = metrics::getCounter(
+      "faasm_file_loader_cache_hits_total",
+      "Files found in the file loader's local cache");
+    return counter;
+}
+
+static metrics::Counter& getCacheMissCounter()
+{
+    static metrics::Counter& counter = metrics::getCounter(
+      "faasm_file_loader_cache_misses_total",
+      "Files the file loader had to fetch into its local cache");
+    return counter;
+}
+
 #define FUNC_OBJECT_FILENAME "function.wasm.o"
 #define PYTHON_FUNCTION_FILENAME "function.py"
 #define FUNC_ENCRYPTED_FILENAME "function.wasm.enc"
 #define FUNCTION_SYMBOLS_FILENAME "function.symbols"
+#define FUNC_PRELOAD_FILENAME "function.preload"
 #define WAMR_AOT_FILENAME "function.aot"
 #define SGX_WAMR_AOT_FILENAME "function.aot.sgx"
 
@@ -108,6 +136,14 @@ static std::filesystem::path getDir(std::string baseDir,
     return path;
 }
 
+// Downloads into the local cache in progress on this host, keyed by S3 path.
+// Concurrent loads of the same file wait on the one download rather than all
+// fetching it.
+static std::mutex downloadsMx;
+
+static std::unordered_map<std::string, std::shared_future<std::string>>
+  downloads;
+
 // -------------------------------------
 // MISC CLASS METHODS
 // -------------------------------------
@@ -152,19 +188,25 @@ void FileLoader::clearLocalCache()
 
     SPDLOG_DEBUG("Clearing the local shared files cache");
     SharedFiles::clear();
+
+    // The downloaded blobs are kept, so files that haven't changed in S3 can
+    // be restored without fetching them again
+    getArtefactCache().forgetPaths();
 }
 
 // -------------------------------------
 // SHARED LOAD/ UPLOAD
 // -------------------------------------
 
-std::vector<uint8_t> FileLoader::loadFileBytes(
-  const std::string& path,
-  const std::string& localCachePath,
-  bool tolerateMissing)
+/**
+ * Makes sure the file is at the local cache path, returning the path, or an
+ * empty string if the file is missing and that's tolerated. Loaders without
+ * a local cache always fetch a fresh copy.
+ */
+std::string FileLoader::loadFileToCache(const std::string& path,
+                                        const std::string& localCachePath,
+                                        bool tolerateMissing)
 {
-    SPDLOG_TRACE("Loading file {} ({})", path, localCachePath);
-
     // Check locally first
     if (useLocalFsCache && std::filesystem::exists(localCachePath)) {
         if (std::filesystem::is_directory(localCachePath)) {
@@ -173,24 +215,137 @@ std::vector<uint8_t> FileLoader::loadFileBytes(
             throw SharedFileIsDirectoryException(localCachePath);
         }
 
-        SPDLOG_TRACE("Loading {} from filesystem at {}", path, localCachePath);
-        return readFileToBytes(localCachePath);
+        SPDLOG_TRACE("Found {} in filesystem at {}", path, localCachePath);
+        getCacheHitCounter().inc();
+        getArtefactCache().touch(localCachePath);
+        return localCachePath;
     }
 
-    // Load from S3 if not found
     std::string pathCopy = trimLeadingSlashes(path);
-    std::vector<uint8_t> bytes =
-      s3.getKeyBytes(conf.s3Bucket, pathCopy, tolerateMissing);
 
-    if (!bytes.empty() && useLocalFsCache) {
-        SPDLOG_TRACE("Caching S3 key {}/{} at {}",
-                     conf.s3Bucket,
-                     pathCopy,
-                     localCachePath);
-        writeBytesToFile(localCachePath, bytes);
+    std::promise<std::string> downloadPromise;
+    std::shared_future<std::string> download;
+    bool isLeader = false;
+    {
+        faabric::util::UniqueLock lock(downloadsMx);
+        auto it = downloads.find(pathCopy);
+        if (it != downloads.end()) {
+            download = it->second;
+        } else {
+            download = downloadPromise.get_future().share();
+            downloads[pathCopy] = download;
+            isLeader = true;
+        }
     }
 
-    return bytes;
+    getCacheMissCounter().inc();
+
+    if (!isLeader) {
+        SPDLOG_TRACE("Waiting on download of {} by another thread", pathCopy);
+        std::string cachedPath = download.get();
+
+        // The other thread may have tolerated the file being missing
+        if (cachedPath.empty() && !tolerateMissing) {
+            SPDLOG_ERROR(
+              "S3 key {}/{} does not exist", conf.s3Bucket, pathCopy);
+            throw std::runtime_error("S3 error");
+        }
+
+        return cachedPath;
+    }
+
+    try {
+        std::string cachedPath =
+          downloadFileToCache(pathCopy, localCachePath, tolerateMissing);
+        downloadPromise.set_value(cachedPath);
+    } catch (...) {
+        downloadPromise.set_exception(std::current_exception());
+    }
+
+    {
+        faabric::util::UniqueLock lock(downloadsMx);
+        downloads.erase(pathCopy);
+    }
+
+    // Rethrows any error for us too
+    return download.get();
+}
+
+std::string FileLoader::downloadFileToCache(const std::string& pathCopy,
+                                            const std::string& localCachePath,
+                                            bool tolerateMissing)
+{
+    // The ETag tells us whether we already have these contents, e.g. from
+    // another user, or from before the cache directories were cleared
+    std::string etag = s3.getKeyETag(conf.s3Bucket, pathCopy);
+    if (etag.empty()) {
+        if (tolerateMissing) {
+            SPDLOG_TRACE(
+              "Tolerating missing S3 key {}/{}", conf.s3Bucket, pathCopy);
+            return "";
+        }
+
+        SPDLOG_ERROR("S3 key {}/{} does not exist", conf.s3Bucket, pathCopy);
+        throw std::runtime_error("S3 error");
+    }
+
+    std::filesystem::path cachePath(localCachePath);
+    createDirectories(cachePath.parent_path());
+
+    // Functions may write to shared files, so they get their own copy
+    bool copy = localCachePath.rfind(conf.sharedFilesDir, 0) == 0;
+
+    ArtefactCache& cache = getArtefactCache();
+    if (cache.fetch(etag, localCachePath, copy)) {
+        return localCachePath;
+    }
+
+    // The file gets streamed straight to disk, rather than being held in
+    // memory while we write it out. This matters for large object files
+    // (e.g. CPython's). The blob is only put in place once it's complete, so
+    // that other threads never see a partially written file.
+    SPDLOG_TRACE(
+      "Caching S3 key {}/{} at {}", conf.s3Bucket, pathCopy, localCachePath);
+    std::string downloadPath = cache.getDownloadPath(etag);
+    bool peerFetch = isArtefactPeerFetchEnabled();
+    if (peerFetch && fetchArtefactFromPeer(etag, downloadPath)) {
+        SPDLOG_TRACE(
+          "Fetched S3 key {}/{} from a peer", conf.s3Bucket, pathCopy);
+    } else {
+        if (!s3.getKeyToFile(
+              conf.s3Bucket, pathCopy, downloadPath, tolerateMissing)) {
+            return "";
+        }
+
+        if (peerFetch) {
+            shareArtefactWithPeers(etag, downloadPath);
+        }
+    }
+
+    cache.insert(etag, downloadPath, localCachePath, copy);
+
+    return localCachePath;
+}
+
+std::vector<uint8_t> FileLoader::loadFileBytes(
+  const std::string& path,
+  const std::string& localCachePath,
+  bool tolerateMissing)
+{
+    SPDLOG_TRACE("Loading file {} ({})", path, localCachePath);
+
+    if (!useLocalFsCache || localCachePath.empty()) {
+        std::string pathCopy = trimLeadingSlashes(path);
+        return s3.getKeyBytes(conf.s3Bucket, pathCopy, tolerateMissing);
+    }
+
+    std::string cachedPath =
+      loadFileToCache(path, localCachePath, tolerateMissing);
+    if (cachedPath.empty()) {
+        return {};
+    }
+
+    return readFileToBytes(cachedPath);
 }
 
 void FileLoader::uploadFileBytes(const std::string& path,
@@ -205,6 +360,9 @@ void FileLoader::uploadFileBytes(const std::string& path,
                      conf.s3Bucket,
                      pathCopy,
                      localCachePath);
+
+        // The old file may be linked to a cached blob, which mustn't change
+        std::filesystem::remove(localCachePath);
         writeBytesToFile(localCachePath, bytes);
     }
 }
@@ -223,35 +381,12 @@ void FileLoader::uploadFileString(const std::string& path,
                      conf.s3Bucket,
                      pathCopy,
                      localCachePath);
+
+        std::filesystem::remove(localCachePath);
         writeBytesToFile(localCachePath, stringToBytes(bytes));
     }
 }
 
-// -------------------------------------
-// HASHING
-// -------------------------------------
-
-std::string FileLoader::getHashFilePath(const std::string& path)
-{
-    return path + HASH_EXT;
-}
-
-std::vector<uint8_t> FileLoader::loadHashFileBytes(
-  const std::string& path,
-  const std::string& localCachePath)
-{
-    return loadFileBytes(
-      getHashFilePath(path), getHashFilePath(localCachePath), true);
-}
-
-void FileLoader::uploadHashFileBytes(const std::string& path,
-                                     const std::string& localCachePath,
-                                     const std::vector<uint8_t>& bytes)
-{
-    uploadFileBytes(
-      getHashFilePath(path), getHashFilePath(localCachePath), bytes);
-}
-
 // -------------------------------------
 // FUNCTION WASM
 // -------------------------------------
@@ -278,73 +413,80 @@ void FileLoader::uploadFunction(faabric::Message& msg)
     // Note, when uploading, the input data is the function body
     const std::string& inputBytes = msg.inputdata();
     uploadFileString(key, localCachePath, inputBytes);
+
+    recordFunctionArtefact(msg, FUNC_FILENAME, stringToBytes(inputBytes));
 }
 
 // -------------------------------------
 // FUNCTION OBJECT FILES
 // -------------------------------------
 
-std::string FileLoader::getFunctionObjectFile(const faabric::Message& msg)
+static std::string getObjectFilename(const std::string& target)
+{
+    if (target.empty()) {
+        return FUNC_OBJECT_FILENAME;
+    }
+
+    return fmt::format("function.wasm.{}.o", target);
+}
+
+std::string FileLoader::getFunctionObjectFile(const faabric::Message& msg,
+                                              const std::string& target)
 {
     auto path = getDir(conf.objectFileDir, msg, true);
-    path.append(FUNC_OBJECT_FILENAME);
+    path.append(getObjectFilename(target));
     return path.string();
 }
 
 std::vector<uint8_t> FileLoader::loadFunctionObjectFile(
-  const faabric::Message& msg)
+  const faabric::Message& msg,
+  const std::string& target)
 {
-    const std::string key = getKey(msg, FUNC_OBJECT_FILENAME);
-    const std::string localCachePath = getFunctionObjectFile(msg);
-    return loadFileBytes(key, localCachePath);
+    const std::string key = getKey(msg, getObjectFilename(target));
+    const std::string localCachePath = getFunctionObjectFile(msg, target);
+    return loadFileBytes(key, localCachePath, true);
 }
 
-std::vector<uint8_t> FileLoader::loadFunctionObjectHash(
-  const faabric::Message& msg)
+std::string FileLoader::cacheFunctionObjectFile(const faabric::Message& msg)
 {
     const std::string key = getKey(msg, FUNC_OBJECT_FILENAME);
-    const std::string localCachePath = getFunctionObjectFile(msg);
-    return loadHashFileBytes(key, localCachePath);
+    return loadFileToCache(key, getFunctionObjectFile(msg));
 }
 
 void FileLoader::uploadFunctionObjectFile(const faabric::Message& msg,
-                                          const std::vector<uint8_t>& objBytes)
+                                          const std::vector<uint8_t>& objBytes,
+                                          const std::string& target)
 {
-    const std::string key = getKey(msg, FUNC_OBJECT_FILENAME);
-    const std::string localCachePath = getFunctionObjectFile(msg);
+    const std::string filename = getObjectFilename(target);
+    const std::string key = getKey(msg, filename);
+    const std::string localCachePath = getFunctionObjectFile(msg, target);
     uploadFileBytes(key, localCachePath, objBytes);
-}
 
-void FileLoader::uploadFunctionObjectHash(const faabric::Message& msg,
-                                          const std::vector<uint8_t>& hash)
-{
-    const std::string key = getKey(msg, FUNC_OBJECT_FILENAME);
-    const std::string localCachePath = getFunctionObjectFile(msg);
-    uploadHashFileBytes(key, localCachePath, hash);
+    recordFunctionArtefact(msg, filename, objBytes);
 }
 
 // -------------------------------------
 // FUNCTION WAMR AOT FILES
 // -------------------------------------
 
-static const std::string getWamrAotKey(const faabric::Message& msg)
+static const std::string getWamrAotFilename()
 {
     if (conf::getFaasmConfig().wasmVm == "sgx") {
-        return getKey(msg, SGX_WAMR_AOT_FILENAME);
+        return SGX_WAMR_AOT_FILENAME;
     } else {
-        return getKey(msg, WAMR_AOT_FILENAME);
+        return WAMR_AOT_FILENAME;
     }
 }
 
+static const std::string getWamrAotKey(const faabric::Message& msg)
+{
+    return getKey(msg, getWamrAotFilename());
+}
+
 std::string FileLoader::getFunctionAotFile(const faabric::Message& msg)
 {
     auto path = getDir(conf.objectFileDir, msg, true);
-    if (conf::getFaasmConfig().wasmVm == "sgx") {
-        path.append(SGX_WAMR_AOT_FILENAME);
-    } else {
-        path.append(WAMR_AOT_FILENAME);
-    }
-
+    path.append(getWamrAotFilename());
     return path.string();
 }
 
@@ -356,12 +498,9 @@ std::vector<uint8_t> FileLoader::loadFunctionWamrAotFile(
     return loadFileBytes(key, localCachePath);
 }
 
-std::vector<uint8_t> FileLoader::loadFunctionWamrAotHash(
-  const faabric::Message& msg)
+std::string FileLoader::cacheFunctionWamrAotFile(const faabric::Message& msg)
 {
-    const std::string key = getWamrAotKey(msg);
-    const std::string localCachePath = getFunctionAotFile(msg);
-    return loadHashFileBytes(key, localCachePath);
+    return loadFileToCache(getWamrAotKey(msg), getFunctionAotFile(msg));
 }
 
 void FileLoader::uploadFunctionWamrAotFile(const faabric::Message& msg,
@@ -370,14 +509,17 @@ void FileLoader::uploadFunctionWamrAotFile(const faabric::Message& msg,
     const std::string key = getWamrAotKey(msg);
     const std::string localCachePath = getFunctionAotFile(msg);
     uploadFileBytes(key, localCachePath, objBytes);
+
+    recordFunctionArtefact(msg, getWamrAotFilename(), objBytes);
 }
 
-void FileLoader::uploadFunctionWamrAotHash(const faabric::Message& msg,
-                                           const std::vector<uint8_t>& hash)
+std::string FileLoader::getFunctionCodegenKey(const faabric::Message& msg)
 {
-    const std::string key = getWamrAotKey(msg);
-    const std::string localCachePath = getFunctionAotFile(msg);
-    uploadHashFileBytes(key, localCachePath, hash);
+    if (conf.wasmVm == "wamr" || conf.wasmVm == "sgx") {
+        return getWamrAotKey(msg);
+    }
+
+    return getKey(msg, FUNC_OBJECT_FILENAME);
 }
 
 // -------------------------------------
@@ -402,6 +544,117 @@ std::string FileLoader::getFunctionSymbolsFile(const faabric::Message& msg)
     return path.string();
 }
 
+// -------------------------------------
+// FUNCTION PRELOADS
+// -------------------------------------
+
+std::string FileLoader::getFunctionPreloadFile(const faabric::Message& msg)
+{
+    auto path = getDir(conf.functionDir, msg, true);
+    path.append(FUNC_PRELOAD_FILENAME);
+    return path.string();
+}
+
+std::vector<std::string> FileLoader::parseFunctionPreloads(
+  const std::string& contents)
+{
+    std::vector<std::string> preloads;
+    std::istringstream in(contents);
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+
+        size_t end = line.find_last_not_of(" \t\r");
+        preloads.emplace_back(line.substr(start, end - start + 1));
+    }
+
+    return preloads;
+}
+
+std::vector<std::string> FileLoader::loadFunctionPreloads(
+  const faabric::Message& msg)
+{
+    // Most functions don't have a preload list, which their metadata saves us
+    // looking for
+    FunctionMetadata metadata = loadFunctionMetadata(msg);
+    if (!metadata.empty() && !metadata.hasArtefact(FUNC_PRELOAD_FILENAME)) {
+        return {};
+    }
+
+    const std::string key = getKey(msg, FUNC_PRELOAD_FILENAME);
+    std::vector<uint8_t> bytes =
+      loadFileBytes(key, getFunctionPreloadFile(msg), true);
+
+    return parseFunctionPreloads(std::string(bytes.begin(), bytes.end()));
+}
+
+void FileLoader::uploadFunctionPreloads(const faabric::Message& msg,
+                                        const std::vector<std::string>& paths)
+{
+    std::string contents;
+    for (const auto& path : paths) {
+        contents += path + "\n";
+    }
+
+    const std::string key = getKey(msg, FUNC_PRELOAD_FILENAME);
+    uploadFileString(key, getFunctionPreloadFile(msg), contents);
+
+    recordFunctionArtefact(msg, FUNC_PRELOAD_FILENAME, stringToBytes(contents));
+}
+
+// -------------------------------------
+// FUNCTION METADATA
+// -------------------------------------
+
+// Artefacts of the same function may be uploaded concurrently
+static std::mutex metadataMx;
+
+std::string FileLoader::getFunctionMetadataFile(const faabric::Message& msg)
+{
+    auto path = getDir(conf.functionDir, msg, true);
+    path.append(FUNC_METADATA_FILENAME);
+    return path.string();
+}
+
+FunctionMetadata FileLoader::loadFunctionMetadata(const faabric::Message& msg)
+{
+    const std::string key = getKey(msg, FUNC_METADATA_FILENAME);
+    return FunctionMetadata(
+      loadFileBytes(key, getFunctionMetadataFile(msg), true));
+}
+
+void FileLoader::recordFunctionArtefact(const faabric::Message& msg,
+                                        const std::string& name,
+                                        const std::vector<uint8_t>& bytes)
+{
+    const std::string key = getKey(msg, FUNC_METADATA_FILENAME);
+    std::string pathCopy = trimLeadingSlashes(key);
+
+    // Always start from the latest metadata, not a locally cached copy
+    faabric::util::UniqueLock lock(metadataMx);
+    FunctionMetadata metadata(s3.getKeyBytes(conf.s3Bucket, pathCopy, true));
+    metadata.setArtefact(name, bytes);
+    uploadFileBytes(key, getFunctionMetadataFile(msg), metadata.toBytes());
+}
+
+void FileLoader::recordFunctionHints(
+  const faabric::Message& msg,
+  const std::map<std::string, std::string>& hints)
+{
+    const std::string key = getKey(msg, FUNC_METADATA_FILENAME);
+    std::string pathCopy = trimLeadingSlashes(key);
+
+    faabric::util::UniqueLock lock(metadataMx);
+    FunctionMetadata metadata(s3.getKeyBytes(conf.s3Bucket, pathCopy, true));
+    for (const auto& [hintKey, value] : hints) {
+        metadata.setHint(hintKey, value);
+    }
+    uploadFileBytes(key, getFunctionMetadataFile(msg), metadata.toBytes());
+}
+
 // -------------------------------------
 // SHARED OBJECT WASM
 // -------------------------------------
@@ -446,11 +699,9 @@ std::vector<uint8_t> FileLoader::loadSharedObjectObjectFile(
     return loadFileBytes(path, localCachePath);
 }
 
-std::vector<uint8_t> FileLoader::loadSharedObjectObjectHash(
-  const std::string& path)
+std::string FileLoader::cacheSharedObjectObjectFile(const std::string& path)
 {
-    const std::string localCachePath = getSharedObjectObjectFile(path);
-    return loadHashFileBytes(path, localCachePath);
+    return loadFileToCache(path, getSharedObjectObjectFile(path));
 }
 
 void FileLoader::uploadSharedObjectObjectFile(
@@ -461,11 +712,62 @@ void FileLoader::uploadSharedObjectObjectFile(
     uploadFileBytes(path, localCachePath, objBytes);
 }
 
-void FileLoader::uploadSharedObjectObjectHash(const std::string& path,
-                                              const std::vector<uint8_t>& hash)
+std::string FileLoader::getSharedObjectCodegenKey(const std::string& path)
 {
-    const std::string localCachePath = getSharedObjectObjectFile(path);
-    uploadHashFileBytes(path, localCachePath, hash);
+    return trimLeadingSlashes(path) + SHARED_OBJ_EXT;
+}
+
+// -------------------------------------
+// CODEGEN MANIFESTS
+// -------------------------------------
+
+static std::string getCodegenManifestKey(const std::string& scope)
+{
+    return fmt::format("{}/{}", scope, CODEGEN_MANIFEST_FILENAME);
+}
+
+std::string FileLoader::getCodegenManifestFile(const std::string& scope)
+{
+    std::filesystem::path path(conf.objectFileDir);
+    path.append(scope);
+    createDirectories(path);
+    path.append(CODEGEN_MANIFEST_FILENAME);
+    return path.string();
+}
+
+std::vector<uint8_t> FileLoader::loadCodegenManifest(const std::string& scope)
+{
+    return loadFileBytes(
+      getCodegenManifestKey(scope), getCodegenManifestFile(scope), true);
+}
+
+void FileLoader::uploadCodegenManifest(const std::string& scope,
+                                       const std::vector<uint8_t>& bytes)
+{
+    uploadFileBytes(
+      getCodegenManifestKey(scope), getCodegenManifestFile(scope), bytes);
+}
+
+// Serialises updates to manifests from this host. Updates from different
+// hosts may still race, in which case the last writer wins, and the lost
+// entries will just be regenerated next time
+static std::mutex codegenManifestMx;
+
+void FileLoader::recordCodegenManifestEntries(
+  const std::string& scope,
+  const std::vector<std::pair<std::string, CodegenManifestEntry>>& entries)
+{
+    const std::string key = getCodegenManifestKey(scope);
+    std::string pathCopy = trimLeadingSlashes(key);
+
+    // The locally cached copy may be from before another host's update
+    faabric::util::UniqueLock lock(codegenManifestMx);
+    CodegenManifest manifest(s3.getKeyBytes(conf.s3Bucket, pathCopy, true));
+    for (const auto& [entryKey, entry] : entries) {
+        manifest.setEntry(entryKey, entry);
+    }
+
+    uploadFileBytes(key, getCodegenManifestFile(scope), manifest.toBytes());
 }
 
 // -------------------------------------
@@ -496,6 +798,59 @@ std::vector<uint8_t> FileLoader::loadSharedFile(const std::string& path)
     return bytes;
 }
 
+std::string FileLoader::cacheSharedFile(const std::string& path)
+{
+    std::string cachedPath =
+      loadFileToCache(path, getSharedFileFile(path), true);
+    if (cachedPath.empty()) {
+        throw SharedFileNotExistsException(path);
+    }
+
+    return cachedPath;
+}
+
+size_t FileLoader::getSharedFileSize(const std::string& path)
+{
+    const std::string localCachePath = getSharedFileFile(path);
+    if (useLocalFsCache && !localCachePath.empty()) {
+        return std::filesystem::file_size(cacheSharedFile(path));
+    }
+
+    // As when loading, empty files are as good as missing
+    int64_t size = s3.getKeySize(conf.s3Bucket, trimLeadingSlashes(path));
+    if (size <= 0) {
+        throw SharedFileNotExistsException(path);
+    }
+
+    return size;
+}
+
+void FileLoader::loadSharedFileRange(const std::string& path,
+                                     size_t offset,
+                                     uint8_t* buffer,
+                                     size_t len)
+{
+    if (len == 0) {
+        return;
+    }
+
+    const std::string localCachePath = getSharedFileFile(path);
+    if (!useLocalFsCache || localCachePath.empty()) {
+        s3.getKeyRange(
+          conf.s3Bucket, trimLeadingSlashes(path), offset, buffer, len);
+        return;
+    }
+
+    std::ifstream in(cacheSharedFile(path), std::ios::binary);
+    in.seekg(offset);
+    in.read(reinterpret_cast<char*>(buffer), len);
+    if ((size_t)in.gcount() != len) {
+        SPDLOG_ERROR(
+          "Short read of shared file {} ({} + {})", path, offset, len);
+        throw std::runtime_error("Short read of shared file");
+    }
+}
+
 void FileLoader::deleteSharedFile(const std::string& path)
 {
     std::string pathCopy = trimLeadingSlashes(path);
@@ -509,6 +864,22 @@ void FileLoader::deleteSharedFile(const std::string& path)
     }
 }
 
+std::vector<std::string> FileLoader::listSharedDirectory(
+  const std::string& dir)
+{
+    std::string prefix = trimLeadingSlashes(dir);
+    if (!prefix.empty() && prefix.back() != '/') {
+        prefix += "/";
+    }
+
+    std::vector<std::string> names;
+    for (const auto& key : s3.listDirectory(conf.s3Bucket, prefix)) {
+        names.push_back(key.substr(prefix.size()));
+    }
+
+    return names;
+}
+
 void FileLoader::uploadSharedFile(const std::string& path,
                                   const std::vector<uint8_t>& fileBytes)
 {
@@ -516,6 +887,53 @@ void FileLoader::uploadSharedFile(const std::string& path,
     uploadFileBytes(path, localCachePath, fileBytes);
 }
 
+bool FileLoader::isSharedFileUnchanged(const std::string& path,
+                                       const std::vector<uint8_t>& fileBytes)
+{
+    std::string etag = s3.getKeyETag(conf.s3Bucket, trimLeadingSlashes(path));
+    if (etag.empty()) {
+        return false;
+    }
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digestLen = 0;
+    if (EVP_Digest(fileBytes.data(),
+                   fileBytes.size(),
+                   digest,
+                   &digestLen,
+                   EVP_md5(),
+                   nullptr) != 1) {
+        throw std::runtime_error("Failed to hash shared file");
+    }
+
+    std::string md5;
+    for (unsigned int i = 0; i < digestLen; i++) {
+        md5 += fmt::format("{:02x}", digest[i]);
+    }
+
+    return etag == md5;
+}
+
+void FileLoader::uploadSharedFileRanges(
+  const std::string& path,
+  const std::vector<std::pair<size_t, size_t>>& dirtyRanges)
+{
+    const std::string localPath = getSharedFileFile(path);
+    std::string key = trimLeadingSlashes(path);
+    try {
+        if (s3.updateKeyFromFile(conf.s3Bucket, key, localPath, dirtyRanges)) {
+            return;
+        }
+    } catch (std::runtime_error& e) {
+        // Not all S3 implementations can copy parts, so fall back
+        SPDLOG_WARN("Failed to update {} in place, uploading it whole: {}",
+                    path,
+                    e.what());
+    }
+
+    uploadSharedFile(path, loadSharedFile(path));
+}
+
 // -------------------------------------
 // PYTHON FUNCTIONS
 // -------------------------------------
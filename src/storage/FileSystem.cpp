@@ -4,29 +4,61 @@
 #include <conf/FaasmConfig.h>
 
 #include <WASI/WASIPrivate.h>
+#include <algorithm>
 #include <boost/filesystem.hpp>
 
 #include <faabric/util/config.h>
 #include <faabric/util/logging.h>
 
+// The fds below this are stdio and the preopened roots
+#define FIRST_USER_FD 5
+
 namespace storage {
+FileSystem::FileSystem(const FileSystem& other)
+{
+    *this = other;
+}
+
+FileSystem& FileSystem::operator=(const FileSystem& other)
+{
+    fileDescriptors = other.fileDescriptors;
+    freeFds = other.freeFds;
+
+    for (auto& slot : fileDescriptors) {
+        slot.owned = false;
+    }
+
+    return *this;
+}
+
 void FileSystem::prepareFilesystem()
 {
     // Clear existing file descriptors if any
     fileDescriptors.clear();
+    freeFds.clear();
 
     // Predefined stdin, stdout and stderr
-    fileDescriptors.emplace(0, storage::FileDescriptor::stdinFactory());
-    fileDescriptors.emplace(1, storage::FileDescriptor::stdoutFactory());
-    fileDescriptors.emplace(2, storage::FileDescriptor::stderrFactory());
+    addFileDescriptor(0, storage::FileDescriptor::stdinFactory());
+    addFileDescriptor(1, storage::FileDescriptor::stdoutFactory());
+    addFileDescriptor(2, storage::FileDescriptor::stderrFactory());
 
     // Add roots, note that they are predefined as the file descriptors
     // just above the stdxxx's (i.e. > 3)
     createPreopenedFileDescriptor(3, "/");
     createPreopenedFileDescriptor(4, ".");
+}
 
-    // Set the starting point for subsequent file descriptors
-    nextFd = 5;
+void FileSystem::addFileDescriptor(int fd,
+                                   const storage::FileDescriptor& fileDesc)
+{
+    if (fd >= (int)fileDescriptors.size()) {
+        fileDescriptors.resize(fd + 1);
+    }
+
+    FileDescriptorSlot& slot = fileDescriptors.at(fd);
+    slot.inUse = true;
+    slot.owned = true;
+    slot.desc = fileDesc;
 }
 
 void FileSystem::createPreopenedFileDescriptor(int fd, const std::string& path)
@@ -53,24 +85,31 @@ void FileSystem::createPreopenedFileDescriptor(int fd, const std::string& path)
 
     // Add to this module's fds
     fileDesc.wasiPreopenType = __WASI_PREOPENTYPE_DIR;
-    fileDescriptors.emplace(fd, fileDesc);
+    addFileDescriptor(fd, fileDesc);
 }
 
 int FileSystem::getNewFd()
 {
-    // Assign a new file descriptor
-    int thisFd = nextFd;
-    nextFd++;
+    // Reuse a closed fd if there is one, otherwise take the next one
+    int thisFd;
+    if (!freeFds.empty()) {
+        thisFd = freeFds.back();
+        freeFds.pop_back();
+    } else {
+        thisFd = std::max<int>(fileDescriptors.size(), FIRST_USER_FD);
+    }
+
+    addFileDescriptor(thisFd, storage::FileDescriptor());
     return thisFd;
 }
 
 std::string FileSystem::getPathForFd(int fd)
 {
-    if (fileDescriptors.count(fd) == 0) {
+    if (!fileDescriptorExists(fd)) {
         return "";
     }
 
-    return fileDescriptors[fd].getPath();
+    return fileDescriptors[fd].desc.getPath();
 }
 
 int FileSystem::openFileDescriptor(int rootFd,
@@ -95,11 +134,6 @@ int FileSystem::openFileDescriptor(int rootFd,
         fullPath = std::string(joinedPath.string());
     }
 
-    // Initialise the new fd
-    int thisFd = getNewFd();
-    FileDescriptor& fileDesc = fileDescriptors[thisFd];
-    fileDesc.setPath(fullPath);
-
     // AND requested rights with those of the root file descriptor. Rights for
     // this file descriptor are only permitted if they can be inherited, and
     // children of this file descriptor can only inherit rights permitted by
@@ -109,12 +143,20 @@ int FileSystem::openFileDescriptor(int rootFd,
     uint64_t effectiveRights =
       rightsBase & rootFileDesc.getActualRightsInheriting();
 
+    // Initialise the new fd. This can grow the table, so the root fd can't
+    // be used after.
+    int thisFd = getNewFd();
+    FileDescriptor& fileDesc = fileDescriptors[thisFd].desc;
+    fileDesc.setPath(fullPath);
+
     fileDesc.setActualRights(effectiveRights, effectiveRightsInheriting);
 
     // Open the path
     bool success = fileDesc.pathOpen(lookupFlags, openFlags, fdFlags);
     if (!success) {
-        return -1 * fileDesc.getWasiErrno();
+        int wasiErrno = fileDesc.getWasiErrno();
+        closeFileDescriptor(thisFd);
+        return -1 * wasiErrno;
     }
 
     return thisFd;
@@ -122,35 +164,64 @@ int FileSystem::openFileDescriptor(int rootFd,
 
 bool FileSystem::fileDescriptorExists(int fd)
 {
-    return fileDescriptors.count(fd) > 0;
+    return fd >= 0 && fd < (int)fileDescriptors.size() &&
+           fileDescriptors[fd].inUse;
 }
 
 storage::FileDescriptor& FileSystem::getFileDescriptor(int fd)
 {
-    if (fileDescriptors.count(fd) == 0) {
+    if (!fileDescriptorExists(fd)) {
         throw std::runtime_error("File descriptor does not exist");
     }
 
-    return fileDescriptors.at(fd);
+    return fileDescriptors[fd].desc;
 }
 
 int FileSystem::dup(int fd)
 {
-    int newFd = getNewFd();
-
     FileDescriptor& originalDesc = getFileDescriptor(fd);
-    FileDescriptor& newDesc = fileDescriptors[newFd];
+
+    // Make the copy first, as taking a new fd can grow the table
+    FileDescriptor newDesc;
     newDesc.duplicate(originalDesc);
 
+    int newFd = getNewFd();
+    fileDescriptors[newFd].desc = newDesc;
+
     return newFd;
 }
 
+bool FileSystem::closeFileDescriptor(int fd)
+{
+    if (!fileDescriptorExists(fd)) {
+        return false;
+    }
+
+    // Closing stdio or the roots would break everything after
+    if (fd < FIRST_USER_FD) {
+        return true;
+    }
+
+    FileDescriptorSlot& slot = fileDescriptors[fd];
+    if (slot.owned) {
+        slot.desc.close();
+    }
+
+    slot.inUse = false;
+    slot.owned = false;
+    slot.desc = storage::FileDescriptor();
+    freeFds.push_back(fd);
+
+    return true;
+}
+
 void FileSystem::tearDown()
 {
-    for (auto& f : fileDescriptors) {
+    for (auto& slot : fileDescriptors) {
         // Only close non-preopened fds
-        if (f.second.wasiPreopenType != __WASI_PREOPENTYPE_DIR) {
-            f.second.close();
+        if (slot.inUse && slot.owned &&
+            slot.desc.wasiPreopenType != __WASI_PREOPENTYPE_DIR) {
+            slot.desc.close();
         }
     }
 }
@@ -158,8 +229,10 @@ void FileSystem::tearDown()
 void FileSystem::printDebugInfo()
 {
     printf("--- Open file descriptors ---\n");
-    for (auto& p : fileDescriptors) {
-        printf("    %s\n", p.second.getPath().c_str());
+    for (auto& slot : fileDescriptors) {
+        if (slot.inUse) {
+            printf("    %s\n", slot.desc.getPath().c_str());
+        }
     }
 }
 
@@ -0,0 +1,123 @@
+#include <storage/CodegenManifest.h>
+#include <storage/FunctionMetadata.h>
+
+#include <faabric/util/bytes.h>
+#include <faabric/util/logging.h>
+
+#include <sstream>
+
+// Bump this if the metadata format changes. Metadata with a different header
+// is ignored, as if the function had none
+#define FUNC_METADATA_HEADER "faasm-function-metadata-v1"
+
+#define ARTEFACT_LINE "artefact"
+#define HINT_LINE "hint"
+
+namespace storage {
+
+FunctionMetadata::FunctionMetadata(const std::vector<uint8_t>& bytes)
+{
+    if (bytes.empty()) {
+        return;
+    }
+
+    std::istringstream in(faabric::util::bytesToString(bytes));
+    std::string line;
+
+    std::getline(in, line);
+    if (line != FUNC_METADATA_HEADER) {
+        SPDLOG_WARN("Ignoring function metadata with unrecognised header: {}",
+                    line);
+        return;
+    }
+
+    // Each line is tab-separated, either an artefact's name, hash and size,
+    // or a hint's key and value
+    while (std::getline(in, line)) {
+        if (line.empty()) {
+            continue;
+        }
+
+        std::istringstream lineStream(line);
+        std::string type;
+        std::string name;
+        std::getline(lineStream, type, '\t');
+        std::getline(lineStream, name, '\t');
+
+        if (type == ARTEFACT_LINE && !name.empty()) {
+            FunctionArtefact artefact;
+            std::string sizeStr;
+            std::getline(lineStream, artefact.hash, '\t');
+            std::getline(lineStream, sizeStr, '\t');
+
+            try {
+                artefact.size = std::stoul(sizeStr);
+            } catch (std::exception&) {
+                artefact.hash.clear();
+            }
+
+            if (!artefact.empty()) {
+                artefacts[name] = artefact;
+                continue;
+            }
+        } else if (type == HINT_LINE && !name.empty()) {
+            std::getline(lineStream, hints[name], '\t');
+            continue;
+        }
+
+        SPDLOG_WARN("Skipping malformed function metadata line: {}", line);
+    }
+}
+
+std::vector<uint8_t> FunctionMetadata::toBytes() const
+{
+    std::ostringstream out;
+    out << FUNC_METADATA_HEADER << "\n";
+    for (const auto& [name, artefact] : artefacts) {
+        out << ARTEFACT_LINE << "\t" << name << "\t" << artefact.hash << "\t"
+            << artefact.size << "\n";
+    }
+
+    for (const auto& [key, value] : hints) {
+        out << HINT_LINE << "\t" << key << "\t" << value << "\n";
+    }
+
+    return faabric::util::stringToBytes(out.str());
+}
+
+FunctionArtefact FunctionMetadata::getArtefact(const std::string& name) const
+{
+    auto it = artefacts.find(name);
+    if (it == artefacts.end()) {
+        return {};
+    }
+
+    return it->second;
+}
+
+bool FunctionMetadata::hasArtefact(const std::string& name) const
+{
+    return artefacts.find(name) != artefacts.end();
+}
+
+void FunctionMetadata::setArtefact(const std::string& name,
+                                   const std::vector<uint8_t>& bytes)
+{
+    artefacts[name] = { hashCodegenInput(bytes), bytes.size() };
+}
+
+std::string FunctionMetadata::getHint(const std::string& key) const
+{
+    auto it = hints.find(key);
+    if (it == hints.end()) {
+        return "";
+    }
+
+    return it->second;
+}
+
+void FunctionMetadata::setHint(const std::string& key, const std::string& value)
+{
+    hints[key] = value;
+}
+}
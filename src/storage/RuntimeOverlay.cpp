@@ -0,0 +1,191 @@
+#include <conf/FaasmConfig.h>
+#include <storage/RuntimeOverlay.h>
+
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <dirent.h>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+
+namespace storage {
+
+RuntimeOverlay& getRuntimeOverlay()
+{
+    static RuntimeOverlay overlay;
+    return overlay;
+}
+
+// Paths come in with and without leading slashes and dots
+static std::string normalisePath(const std::string& path)
+{
+    std::string p = std::filesystem::path(path).lexically_normal().string();
+
+    size_t start = p.find_first_not_of('/');
+    if (start == std::string::npos) {
+        return "";
+    }
+    p = p.substr(start);
+
+    while (p.size() > 1 && p.back() == '/') {
+        p.pop_back();
+    }
+
+    if (p == ".") {
+        return "";
+    }
+
+    return p;
+}
+
+static uint8_t modeToDirentType(mode_t mode)
+{
+    if (S_ISDIR(mode)) {
+        return DT_DIR;
+    }
+
+    if (S_ISREG(mode)) {
+        return DT_REG;
+    }
+
+    if (S_ISLNK(mode)) {
+        return DT_LNK;
+    }
+
+    return DT_UNKNOWN;
+}
+
+RuntimeOverlay::RuntimeOverlay()
+  : RuntimeOverlay(conf::getFaasmConfig().runtimeFilesDir,
+                   conf::getFaasmConfig().runtimeOverlayDirs)
+{}
+
+RuntimeOverlay::RuntimeOverlay(const std::string& rootDirIn,
+                               const std::string& dirsIn)
+  : rootDir(rootDirIn)
+{
+    std::istringstream in(dirsIn);
+    std::string dir;
+    while (std::getline(in, dir, ',')) {
+        dir = normalisePath(dir);
+        if (dir.empty()) {
+            SPDLOG_WARN("Not overlaying the whole runtime root");
+            continue;
+        }
+
+        if (!std::filesystem::is_directory(rootDir + "/" + dir)) {
+            SPDLOG_WARN("Runtime overlay dir {}/{} doesn't exist, skipping",
+                        rootDir,
+                        dir);
+            continue;
+        }
+
+        dirs.push_back(dir);
+
+        std::vector<std::pair<dev_t, ino_t>> ancestors;
+        indexDir(dir, ancestors);
+    }
+
+    if (!dirs.empty()) {
+        SPDLOG_INFO("Runtime overlay indexed {} paths in {} dirs",
+                    entries.size(),
+                    dirs.size());
+    }
+}
+
+void RuntimeOverlay::indexDir(const std::string& dir,
+                              std::vector<std::pair<dev_t, ino_t>>& ancestors)
+{
+    std::string realDir = rootDir + "/" + dir;
+
+    RuntimeOverlayEntry& dirEntry = entries[dir];
+    if (::stat(realDir.c_str(), &dirEntry.nativeStat) != 0) {
+        SPDLOG_ERROR("Failed to stat runtime overlay dir {}", realDir);
+        throw std::runtime_error("Failed to stat runtime overlay dir");
+    }
+
+    std::pair<dev_t, ino_t> id = { dirEntry.nativeStat.st_dev,
+                                   dirEntry.nativeStat.st_ino };
+    if (std::find(ancestors.begin(), ancestors.end(), id) != ancestors.end()) {
+        SPDLOG_WARN("Not indexing {} again, links back up the tree", realDir);
+        return;
+    }
+    ancestors.push_back(id);
+
+    // Listings look like they would from readdir, cookies included
+    auto children = std::make_shared<std::vector<DirEnt>>();
+    uint64_t nextIdx = 0;
+    for (const char* name : { ".", ".." }) {
+        DirEnt ent;
+        ent.next = ++nextIdx;
+        ent.type = DT_DIR;
+        ent.ino = 0;
+        ent.path = name;
+        children->push_back(ent);
+    }
+
+    std::vector<std::string> subDirs;
+    for (const auto& f : std::filesystem::directory_iterator(realDir)) {
+        std::string name = f.path().filename().string();
+        std::string path = dir + "/" + name;
+
+        struct stat nativeStat;
+        if (::stat(f.path().c_str(), &nativeStat) != 0) {
+            // Dangling links look like they don't exist
+            continue;
+        }
+
+        DirEnt ent;
+        ent.next = ++nextIdx;
+        ent.type = modeToDirentType(nativeStat.st_mode);
+        ent.ino = nativeStat.st_ino;
+        ent.path = name;
+
+        children->push_back(ent);
+
+        if (S_ISDIR(nativeStat.st_mode)) {
+            subDirs.push_back(path);
+        } else {
+            entries[path].nativeStat = nativeStat;
+        }
+    }
+
+    dirEntry.children = std::move(children);
+
+    for (const auto& subDir : subDirs) {
+        indexDir(subDir, ancestors);
+    }
+
+    ancestors.pop_back();
+}
+
+bool RuntimeOverlay::covers(const std::string& path) const
+{
+    if (dirs.empty()) {
+        return false;
+    }
+
+    std::string p = normalisePath(path);
+    for (const auto& dir : dirs) {
+        if (p == dir ||
+            (p.size() > dir.size() && p.rfind(dir, 0) == 0 &&
+             p[dir.size()] == '/')) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const RuntimeOverlayEntry* RuntimeOverlay::lookUp(
+  const std::string& path) const
+{
+    auto it = entries.find(normalisePath(path));
+    if (it == entries.end()) {
+        return nullptr;
+    }
+
+    return &it->second;
+}
+}
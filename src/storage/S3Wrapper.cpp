@@ -1,16 +1,40 @@
 #include <conf/FaasmConfig.h>
+#include <metrics/Metrics.h>
 #include <storage/S3Wrapper.h>
 
 #include <faabric/util/bytes.h>
+#include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
 
+#include <aws/core/utils/memory/stl/AWSStreamFwd.h>
+#include <aws/core/utils/stream/PreallocatedStreamBuf.h>
 #include <aws/s3/S3Errors.h>
+#include <aws/s3/model/AbortMultipartUploadRequest.h>
+#include <aws/s3/model/CompleteMultipartUploadRequest.h>
 #include <aws/s3/model/CreateBucketRequest.h>
+#include <aws/s3/model/CreateMultipartUploadRequest.h>
 #include <aws/s3/model/DeleteBucketRequest.h>
 #include <aws/s3/model/DeleteObjectRequest.h>
 #include <aws/s3/model/GetObjectRequest.h>
+#include <aws/s3/model/HeadObjectRequest.h>
 #include <aws/s3/model/ListObjectsRequest.h>
 #include <aws/s3/model/PutObjectRequest.h>
+#include <aws/s3/model/UploadPartCopyRequest.h>
+#include <aws/s3/model/UploadPartRequest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
 
 using namespace Aws::S3::Model;
 using namespace Aws::Client;
@@ -82,6 +106,56 @@ ClientConfiguration getClientConf(long timeout)
     return config;
 }
 
+static std::string getRangeHeader(size_t offset, size_t len)
+{
+    return fmt::format("bytes={}-{}", offset, offset + len - 1);
+}
+
+// Ranged responses give the full size after the slash, e.g. "bytes 0-9/1234",
+// and servers that ignore the range just send the whole object
+static size_t getObjectSize(const GetObjectResult& result)
+{
+    const Aws::String& contentRange = result.GetContentRange();
+    size_t slash = contentRange.find('/');
+    if (slash == Aws::String::npos) {
+        return result.GetContentLength();
+    }
+
+    return std::stoull(std::string(contentRange.substr(slash + 1)));
+}
+
+// Asking for the first part of an empty object is an invalid range
+static bool isEmptyObjectError(const Aws::S3::S3Error& err)
+{
+    return err.GetExceptionName() == "InvalidRange";
+}
+
+static metrics::Histogram& getS3GetHistogram()
+{
+    static metrics::Histogram& histogram = metrics::getHistogram(
+      "faasm_s3_get_seconds", "Time taken to download S3 objects");
+    return histogram;
+}
+
+static metrics::Histogram& getS3PutHistogram()
+{
+    static metrics::Histogram& histogram = metrics::getHistogram(
+      "faasm_s3_put_seconds", "Time taken to upload S3 objects");
+    return histogram;
+}
+
+static metrics::Histogram& getS3HeadHistogram()
+{
+    static metrics::Histogram& histogram = metrics::getHistogram(
+      "faasm_s3_head_seconds", "Time taken to look up S3 object ETags");
+    return histogram;
+}
+
+static long getRequestTimeoutMs(size_t partSize)
+{
+    return S3_REQUEST_TIMEOUT_MS + (long)(partSize / S3_MIN_BYTES_PER_MS);
+}
+
 void initFaasmS3()
 {
     const auto& conf = conf::getFaasmConfig();
@@ -112,13 +186,253 @@ void shutdownFaasmS3()
 
 S3Wrapper::S3Wrapper()
   : faasmConf(conf::getFaasmConfig())
-  , clientConf(getClientConf(S3_REQUEST_TIMEOUT_MS))
+  , clientConf(getClientConf(getRequestTimeoutMs(getPartSize())))
   , client(AWSCredentials(faasmConf.s3User, faasmConf.s3Password),
            clientConf,
            AWSAuthV4Signer::PayloadSigningPolicy::Never,
            false)
 {}
 
+size_t S3Wrapper::getPartSize() const
+{
+    return std::max<size_t>(faasmConf.s3PartSizeMb, 1) * 1024 * 1024;
+}
+
+void S3Wrapper::runParts(size_t nParts, const std::function<void(size_t)>& op)
+{
+    size_t nThreads =
+      std::min<size_t>(nParts, std::max(faasmConf.s3Concurrency, 1));
+
+    std::atomic<size_t> nextPart = 0;
+    std::mutex errorMx;
+    std::exception_ptr error = nullptr;
+
+    auto worker = [&] {
+        for (size_t i = nextPart++; i < nParts; i = nextPart++) {
+            try {
+                op(i);
+            } catch (...) {
+                faabric::util::UniqueLock lock(errorMx);
+                if (error == nullptr) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    };
+
+    // The calling thread does its share too
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < nThreads; t++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    if (error != nullptr) {
+        std::rethrow_exception(error);
+    }
+}
+
+void S3Wrapper::getKeyRange(const std::string& bucketName,
+                            const std::string& keyName,
+                            size_t offset,
+                            uint8_t* buffer,
+                            size_t len)
+{
+    SPDLOG_TRACE(
+      "Getting S3 key {}/{} range {}+{}", bucketName, keyName, offset, len);
+    auto request = reqFactory<GetObjectRequest>(bucketName, keyName);
+    request.SetRange(getRangeHeader(offset, len));
+
+    // The body goes straight into the destination
+    Aws::Utils::Stream::PreallocatedStreamBuf streamBuf(buffer, len);
+    request.SetResponseStreamFactory([&streamBuf] {
+        return Aws::New<Aws::IOStream>("S3Wrapper", &streamBuf);
+    });
+
+    GetObjectOutcome response = client.GetObject(request);
+    CHECK_ERRORS(response, bucketName, keyName);
+}
+
+void S3Wrapper::runMultipart(
+  const std::string& bucketName,
+  const std::string& keyName,
+  size_t nParts,
+  const std::function<Aws::String(const Aws::String&, int)>& sendPart)
+{
+    auto createReq =
+      reqFactory<CreateMultipartUploadRequest>(bucketName, keyName);
+    auto createResponse = client.CreateMultipartUpload(createReq);
+    CHECK_ERRORS(createResponse, bucketName, keyName);
+    const Aws::String uploadId = createResponse.GetResult().GetUploadId();
+
+    Aws::Vector<CompletedPart> parts(nParts);
+    try {
+        runParts(nParts, [&](size_t i) {
+            parts.at(i).SetPartNumber((int)i + 1);
+            parts.at(i).SetETag(sendPart(uploadId, (int)i + 1));
+        });
+
+        CompletedMultipartUpload completed;
+        completed.SetParts(parts);
+
+        auto completeReq =
+          reqFactory<CompleteMultipartUploadRequest>(bucketName, keyName);
+        completeReq.SetUploadId(uploadId);
+        completeReq.SetMultipartUpload(completed);
+
+        auto completeResponse = client.CompleteMultipartUpload(completeReq);
+        CHECK_ERRORS(completeResponse, bucketName, keyName);
+    } catch (...) {
+        // Don't leave the uploaded parts taking up space in the bucket
+        auto abortReq =
+          reqFactory<AbortMultipartUploadRequest>(bucketName, keyName);
+        abortReq.SetUploadId(uploadId);
+        client.AbortMultipartUpload(abortReq);
+        throw;
+    }
+}
+
+Aws::String S3Wrapper::uploadPart(const std::string& bucketName,
+                                  const std::string& keyName,
+                                  const Aws::String& uploadId,
+                                  int partNumber,
+                                  const uint8_t* data,
+                                  size_t len)
+{
+    // Parts are sent straight from the caller's buffer
+    Aws::Utils::Stream::PreallocatedStreamBuf streamBuf(
+      const_cast<uint8_t*>(data), len);
+
+    auto partReq = reqFactory<UploadPartRequest>(bucketName, keyName);
+    partReq.SetUploadId(uploadId);
+    partReq.SetPartNumber(partNumber);
+    partReq.SetContentLength((long long)len);
+    partReq.SetBody(Aws::MakeShared<Aws::IOStream>("S3Wrapper", &streamBuf));
+
+    auto partResponse = client.UploadPart(partReq);
+    CHECK_ERRORS(partResponse, bucketName, keyName);
+
+    return partResponse.GetResult().GetETag();
+}
+
+void S3Wrapper::addKeyMultipart(const std::string& bucketName,
+                                const std::string& keyName,
+                                const std::vector<uint8_t>& data)
+{
+    size_t partSize = std::max<size_t>(getPartSize(), S3_MIN_PART_BYTES);
+    size_t nParts = (data.size() + partSize - 1) / partSize;
+    SPDLOG_TRACE("Writing S3 key {}/{} in {} parts of {} bytes",
+                 bucketName,
+                 keyName,
+                 nParts,
+                 partSize);
+
+    runMultipart(
+      bucketName, keyName, nParts, [&](const Aws::String& uploadId, int n) {
+          size_t offset = (n - 1) * partSize;
+          size_t len = std::min(partSize, data.size() - offset);
+          return uploadPart(
+            bucketName, keyName, uploadId, n, data.data() + offset, len);
+      });
+}
+
+bool S3Wrapper::updateKeyFromFile(
+  const std::string& bucketName,
+  const std::string& keyName,
+  const std::string& filePath,
+  const std::vector<std::pair<size_t, size_t>>& dirtyRanges)
+{
+    size_t fileSize = std::filesystem::file_size(filePath);
+    size_t partSize = std::max<size_t>(getPartSize(), S3_MIN_PART_BYTES);
+    size_t nParts = (fileSize + partSize - 1) / partSize;
+    if (nParts < 2) {
+        return false;
+    }
+
+    int64_t oldSize = getKeySize(bucketName, keyName);
+    if (oldSize <= 0) {
+        return false;
+    }
+
+    // Parts can only be copied if none of their bytes have been written, and
+    // the object already has all of them
+    std::vector<bool> copyPart(nParts, true);
+    for (const auto& [start, end] : dirtyRanges) {
+        for (size_t i = start / partSize; i < nParts && i * partSize < end;
+             i++) {
+            copyPart.at(i) = false;
+        }
+    }
+
+    size_t nCopied = 0;
+    for (size_t i = 0; i < nParts; i++) {
+        size_t partEnd = std::min((i + 1) * partSize, fileSize);
+        if (partEnd > (size_t)oldSize) {
+            copyPart.at(i) = false;
+        }
+        nCopied += copyPart.at(i) ? 1 : 0;
+    }
+
+    if (nCopied == 0) {
+        return false;
+    }
+
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        SPDLOG_ERROR("Failed to open {}: {}", filePath, std::strerror(errno));
+        throw std::runtime_error("Failed to open file for upload");
+    }
+
+    SPDLOG_TRACE("Updating S3 key {}/{}, copying {}/{} parts",
+                 bucketName,
+                 keyName,
+                 nCopied,
+                 nParts);
+
+    try {
+        runMultipart(
+          bucketName, keyName, nParts, [&](const Aws::String& uploadId, int n) {
+              size_t offset = (n - 1) * partSize;
+              size_t len = std::min(partSize, fileSize - offset);
+
+              if (!copyPart.at(n - 1)) {
+                  std::vector<uint8_t> buffer(len);
+                  if (::pread(fd, buffer.data(), len, offset) != (ssize_t)len) {
+                      SPDLOG_ERROR("Short read of {} at {}", filePath, offset);
+                      throw std::runtime_error("Short read of file to upload");
+                  }
+
+                  return uploadPart(
+                    bucketName, keyName, uploadId, n, buffer.data(), len);
+              }
+
+              // Unchanged parts are copied within S3 from the old object
+              auto copyReq =
+                reqFactory<UploadPartCopyRequest>(bucketName, keyName);
+              copyReq.SetCopySource(bucketName + "/" + keyName);
+              copyReq.SetCopySourceRange(getRangeHeader(offset, len));
+              copyReq.SetUploadId(uploadId);
+              copyReq.SetPartNumber(n);
+
+              auto copyResponse = client.UploadPartCopy(copyReq);
+              CHECK_ERRORS(copyResponse, bucketName, keyName);
+
+              return copyResponse.GetResult().GetCopyPartResult().GetETag();
+          });
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+
+    ::close(fd);
+
+    return true;
+}
+
 void S3Wrapper::createBucket(const std::string& bucketName)
 {
     SPDLOG_DEBUG("Creating bucket {}", bucketName);
@@ -213,6 +527,46 @@ std::vector<std::string> S3Wrapper::listKeys(const std::string& bucketName)
     return keys;
 }
 
+std::vector<std::string> S3Wrapper::listDirectory(const std::string& bucketName,
+                                                 const std::string& prefix)
+{
+    SPDLOG_TRACE("Listing S3 directory {}/{}", bucketName, prefix);
+    auto request = reqFactory<ListObjectsRequest>(bucketName);
+    request.SetPrefix(prefix);
+    request.SetDelimiter("/");
+
+    std::vector<std::string> names;
+    while (true) {
+        auto response = client.ListObjects(request);
+        CHECK_ERRORS(response, bucketName, prefix);
+
+        const auto& result = response.GetResult();
+        for (const auto& keyObject : result.GetContents()) {
+            names.emplace_back(keyObject.GetKey().c_str());
+        }
+        for (const auto& commonPrefix : result.GetCommonPrefixes()) {
+            names.emplace_back(commonPrefix.GetPrefix().c_str());
+        }
+
+        // Big directories come back a page at a time. Listings with a
+        // delimiter say where the next page starts.
+        if (!result.GetIsTruncated()) {
+            break;
+        }
+
+        Aws::String marker = result.GetNextMarker();
+        if (marker.empty() && !result.GetContents().empty()) {
+            marker = result.GetContents().back().GetKey();
+        }
+        if (marker.empty()) {
+            break;
+        }
+        request.SetMarker(marker);
+    }
+
+    return names;
+}
+
 void S3Wrapper::deleteKey(const std::string& bucketName,
                           const std::string& keyName)
 {
@@ -238,8 +592,15 @@ void S3Wrapper::addKeyBytes(const std::string& bucketName,
                             const std::string& keyName,
                             const std::vector<uint8_t>& data)
 {
+    metrics::HistogramTimer timer(getS3PutHistogram());
+
     // See example:
     // https://github.com/awsdocs/aws-doc-sdk-examples/blob/main/cpp/example_code/s3/put_object_buffer.cpp
+    if (data.size() > getPartSize()) {
+        addKeyMultipart(bucketName, keyName, data);
+        return;
+    }
+
     SPDLOG_TRACE("Writing S3 key {}/{} as bytes", bucketName, keyName);
     auto request = reqFactory<PutObjectRequest>(bucketName, keyName);
 
@@ -261,6 +622,7 @@ void S3Wrapper::addKeyStr(const std::string& bucketName,
     // See example:
     // https://github.com/awsdocs/aws-doc-sdk-examples/blob/main/cpp/example_code/s3/put_object_buffer.cpp
     SPDLOG_TRACE("Writing S3 key {}/{} as string", bucketName, keyName);
+    metrics::HistogramTimer timer(getS3PutHistogram());
 
     auto request = reqFactory<PutObjectRequest>(bucketName, keyName);
 
@@ -279,7 +641,12 @@ std::vector<uint8_t> S3Wrapper::getKeyBytes(const std::string& bucketName,
                                             bool tolerateMissing)
 {
     SPDLOG_TRACE("Getting S3 key {}/{} as bytes", bucketName, keyName);
+    metrics::HistogramTimer timer(getS3GetHistogram());
+
+    // The first part tells us the size of the rest
+    size_t partSize = getPartSize();
     auto request = reqFactory<GetObjectRequest>(bucketName, keyName);
+    request.SetRange(getRangeHeader(0, partSize));
     GetObjectOutcome response = client.GetObject(request);
 
     if (!response.IsSuccess()) {
@@ -293,18 +660,178 @@ std::vector<uint8_t> S3Wrapper::getKeyBytes(const std::string& bucketName,
             return empty;
         }
 
+        if (isEmptyObjectError(err)) {
+            return std::vector<uint8_t>();
+        }
+
         CHECK_ERRORS(response, bucketName, keyName);
     }
 
-    std::vector<uint8_t> rawData(response.GetResult().GetContentLength());
-    response.GetResult().GetBody().read((char*)rawData.data(), rawData.size());
+    size_t firstLen = response.GetResult().GetContentLength();
+    std::vector<uint8_t> rawData(getObjectSize(response.GetResult()));
+    response.GetResult().GetBody().read((char*)rawData.data(), firstLen);
+
+    // Fetch the rest in parallel, each part straight into its place
+    size_t nParts = (rawData.size() - firstLen + partSize - 1) / partSize;
+    runParts(nParts, [&](size_t i) {
+        size_t offset = firstLen + i * partSize;
+        size_t len = std::min(partSize, rawData.size() - offset);
+        getKeyRange(bucketName, keyName, offset, rawData.data() + offset, len);
+    });
+
     return rawData;
 }
 
+bool S3Wrapper::getKeyToFile(const std::string& bucketName,
+                             const std::string& keyName,
+                             const std::string& filePath,
+                             bool tolerateMissing)
+{
+    SPDLOG_TRACE(
+      "Getting S3 key {}/{} into file {}", bucketName, keyName, filePath);
+    metrics::HistogramTimer timer(getS3GetHistogram());
+
+    // As with getKeyBytes, the first part gives the size
+    size_t partSize = getPartSize();
+    auto request = reqFactory<GetObjectRequest>(bucketName, keyName);
+    request.SetRange(getRangeHeader(0, partSize));
+    request.SetResponseStreamFactory([&filePath] {
+        return Aws::New<Aws::FStream>("S3Wrapper",
+                                      filePath,
+                                      std::ios_base::out | std::ios_base::in |
+                                        std::ios_base::binary |
+                                        std::ios_base::trunc);
+    });
+
+    GetObjectOutcome response = client.GetObject(request);
+
+    if (!response.IsSuccess()) {
+        // Don't leave any error response body lying around
+        std::filesystem::remove(filePath);
+
+        const auto& err = response.GetError();
+        auto errType = err.GetErrorType();
+
+        if (tolerateMissing && (errType == Aws::S3::S3Errors::NO_SUCH_KEY)) {
+            SPDLOG_TRACE(
+              "Tolerating missing S3 key {}/{}", bucketName, keyName);
+            return false;
+        }
+
+        if (isEmptyObjectError(err)) {
+            std::ofstream emptyFile(filePath, std::ios::trunc);
+            return true;
+        }
+
+        CHECK_ERRORS(response, bucketName, keyName);
+    }
+
+    size_t firstLen = response.GetResult().GetContentLength();
+    size_t objectSize = getObjectSize(response.GetResult());
+    if (objectSize == firstLen) {
+        return true;
+    }
+
+    // Write the rest of the parts straight into the file through a mapping
+    response.GetResult().GetBody().flush();
+    std::filesystem::resize_file(filePath, objectSize);
+    int fd = open(filePath.c_str(), O_RDWR);
+    if (fd < 0) {
+        SPDLOG_ERROR("Failed to open {} for S3 key {}/{}: {}",
+                     filePath,
+                     bucketName,
+                     keyName,
+                     std::strerror(errno));
+        throw std::runtime_error("Failed to open file for S3 key");
+    }
+
+    void* mapped =
+      mmap(nullptr, objectSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        SPDLOG_ERROR("Failed to map {} for S3 key {}/{}: {}",
+                     filePath,
+                     bucketName,
+                     keyName,
+                     std::strerror(errno));
+        throw std::runtime_error("Failed to map file for S3 key");
+    }
+    uint8_t* data = static_cast<uint8_t*>(mapped);
+
+    size_t nParts = (objectSize - firstLen + partSize - 1) / partSize;
+    try {
+        runParts(nParts, [&](size_t i) {
+            size_t offset = firstLen + i * partSize;
+            size_t len = std::min(partSize, objectSize - offset);
+            getKeyRange(bucketName, keyName, offset, data + offset, len);
+        });
+    } catch (...) {
+        munmap(mapped, objectSize);
+        std::filesystem::remove(filePath);
+        throw;
+    }
+
+    munmap(mapped, objectSize);
+
+    return true;
+}
+
+std::string S3Wrapper::getKeyETag(const std::string& bucketName,
+                                  const std::string& keyName)
+{
+    SPDLOG_TRACE("Getting S3 key {}/{} ETag", bucketName, keyName);
+    metrics::HistogramTimer timer(getS3HeadHistogram());
+    auto request = reqFactory<HeadObjectRequest>(bucketName, keyName);
+    auto response = client.HeadObject(request);
+
+    if (!response.IsSuccess()) {
+        // Head responses have no body, so missing keys are just not found
+        auto errType = response.GetError().GetErrorType();
+        if (errType == Aws::S3::S3Errors::NO_SUCH_KEY ||
+            errType == Aws::S3::S3Errors::RESOURCE_NOT_FOUND) {
+            return "";
+        }
+
+        CHECK_ERRORS(response, bucketName, keyName);
+    }
+
+    // ETags come quoted, and multipart ones end in -<parts>
+    std::string etag;
+    for (char c : response.GetResult().GetETag()) {
+        if (std::isalnum(c) || c == '-') {
+            etag += c;
+        }
+    }
+
+    return etag;
+}
+
+int64_t S3Wrapper::getKeySize(const std::string& bucketName,
+                              const std::string& keyName)
+{
+    SPDLOG_TRACE("Getting S3 key {}/{} size", bucketName, keyName);
+    metrics::HistogramTimer timer(getS3HeadHistogram());
+    auto request = reqFactory<HeadObjectRequest>(bucketName, keyName);
+    auto response = client.HeadObject(request);
+
+    if (!response.IsSuccess()) {
+        auto errType = response.GetError().GetErrorType();
+        if (errType == Aws::S3::S3Errors::NO_SUCH_KEY ||
+            errType == Aws::S3::S3Errors::RESOURCE_NOT_FOUND) {
+            return -1;
+        }
+
+        CHECK_ERRORS(response, bucketName, keyName);
+    }
+
+    return response.GetResult().GetContentLength();
+}
+
 std::string S3Wrapper::getKeyStr(const std::string& bucketName,
                                  const std::string& keyName)
 {
     SPDLOG_TRACE("Getting S3 key {}/{} as string", bucketName, keyName);
+    metrics::HistogramTimer timer(getS3GetHistogram());
     auto request = reqFactory<GetObjectRequest>(bucketName, keyName);
     GetObjectOutcome response = client.GetObject(request);
     CHECK_ERRORS(response, bucketName, keyName);
@@ -0,0 +1,280 @@
+#include <storage/SharedBundle.h>
+
+#include <faabric/util/logging.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define MAGIC_LEN (sizeof(SHARED_BUNDLE_MAGIC) - 1)
+
+namespace storage {
+
+template<typename T>
+static void appendValue(std::vector<uint8_t>& bytes, T value)
+{
+    auto* valuePtr = reinterpret_cast<uint8_t*>(&value);
+    bytes.insert(bytes.end(), valuePtr, valuePtr + sizeof(T));
+}
+
+std::vector<uint8_t> buildSharedBundle(
+  const std::map<std::string, std::vector<uint8_t>>& files)
+{
+    size_t headerSize = MAGIC_LEN + 2 * sizeof(uint32_t);
+    for (const auto& [path, contents] : files) {
+        headerSize += 2 * sizeof(uint64_t) + sizeof(uint32_t) + path.size();
+    }
+
+    std::vector<uint8_t> bytes(SHARED_BUNDLE_MAGIC,
+                               SHARED_BUNDLE_MAGIC + MAGIC_LEN);
+    appendValue<uint32_t>(bytes, SHARED_BUNDLE_VERSION);
+    appendValue<uint32_t>(bytes, files.size());
+
+    uint64_t offset = headerSize;
+    for (const auto& [path, contents] : files) {
+        appendValue<uint64_t>(bytes, offset);
+        appendValue<uint64_t>(bytes, contents.size());
+        appendValue<uint32_t>(bytes, path.size());
+        bytes.insert(bytes.end(), path.begin(), path.end());
+
+        offset += contents.size();
+    }
+
+    for (const auto& [path, contents] : files) {
+        bytes.insert(bytes.end(), contents.begin(), contents.end());
+    }
+
+    return bytes;
+}
+
+static void throwInvalidBundle(const std::string& reason)
+{
+    SPDLOG_ERROR("Invalid shared bundle: {}", reason);
+    throw std::runtime_error("Invalid shared bundle");
+}
+
+template<typename T>
+static T readValue(const uint8_t* data, size_t dataSize, size_t& pos)
+{
+    if (pos + sizeof(T) > dataSize) {
+        throwInvalidBundle("header truncated");
+    }
+
+    T value;
+    std::memcpy(&value, data + pos, sizeof(T));
+    pos += sizeof(T);
+
+    return value;
+}
+
+static void parseSharedBundle(
+  const uint8_t* data,
+  size_t dataSize,
+  std::unordered_map<std::string, SharedBundleEntry>& files)
+{
+    if (dataSize < MAGIC_LEN ||
+        std::memcmp(data, SHARED_BUNDLE_MAGIC, MAGIC_LEN) != 0) {
+        throwInvalidBundle("bad magic");
+    }
+
+    size_t pos = MAGIC_LEN;
+    auto version = readValue<uint32_t>(data, dataSize, pos);
+    if (version != SHARED_BUNDLE_VERSION) {
+        throwInvalidBundle(fmt::format("unsupported version {}", version));
+    }
+
+    auto nFiles = readValue<uint32_t>(data, dataSize, pos);
+    for (uint32_t i = 0; i < nFiles; i++) {
+        SharedBundleEntry entry;
+        entry.offset = readValue<uint64_t>(data, dataSize, pos);
+        entry.size = readValue<uint64_t>(data, dataSize, pos);
+        auto pathLen = readValue<uint32_t>(data, dataSize, pos);
+
+        if (pos + pathLen > dataSize) {
+            throwInvalidBundle("header truncated");
+        }
+        std::string path((const char*)data + pos, pathLen);
+        pos += pathLen;
+
+        if (path.empty() || path.front() == '/' || path.back() == '/') {
+            throwInvalidBundle(fmt::format("bad path \"{}\"", path));
+        }
+
+        if (entry.offset > dataSize || entry.size > dataSize - entry.offset) {
+            throwInvalidBundle(fmt::format("{} out of bounds", path));
+        }
+
+        files[path] = entry;
+    }
+}
+
+void validateSharedBundle(const std::vector<uint8_t>& bytes)
+{
+    getSharedBundleEntries(bytes);
+}
+
+std::unordered_map<std::string, SharedBundleEntry> getSharedBundleEntries(
+  const std::vector<uint8_t>& bytes)
+{
+    std::unordered_map<std::string, SharedBundleEntry> files;
+    parseSharedBundle(bytes.data(), bytes.size(), files);
+    return files;
+}
+
+SharedBundle::SharedBundle(const std::string& filePathIn)
+  : filePath(filePathIn)
+{
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        SPDLOG_ERROR(
+          "Failed to open shared bundle {}: {}", filePath, strerror(errno));
+        throw std::runtime_error("Failed to open shared bundle");
+    }
+
+    ::fstat(fd, &bundleStat);
+    dataSize = bundleStat.st_size;
+
+    if (dataSize > 0) {
+        void* mapped = ::mmap(nullptr, dataSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            SPDLOG_ERROR(
+              "Failed to map shared bundle {}: {}", filePath, strerror(errno));
+            ::close(fd);
+            throw std::runtime_error("Failed to map shared bundle");
+        }
+        data = static_cast<uint8_t*>(mapped);
+    }
+
+    // The mapping keeps the file around, even if it's removed from the cache
+    ::close(fd);
+
+    try {
+        parseSharedBundle(data, dataSize, files);
+    } catch (std::runtime_error& e) {
+        SPDLOG_ERROR("Failed to load shared bundle {}", filePath);
+        if (data != nullptr) {
+            ::munmap(data, dataSize);
+        }
+        throw;
+    }
+
+    dirs.insert("");
+    for (const auto& [path, entry] : files) {
+        size_t slash = path.find('/');
+        while (slash != std::string::npos) {
+            dirs.insert(path.substr(0, slash));
+            slash = path.find('/', slash + 1);
+        }
+    }
+
+    SPDLOG_DEBUG("Loaded shared bundle {} with {} files in {} dirs",
+                 filePath,
+                 files.size(),
+                 dirs.size());
+}
+
+SharedBundle::~SharedBundle()
+{
+    if (data != nullptr) {
+        ::munmap(data, dataSize);
+    }
+}
+
+bool SharedBundle::isFile(const std::string& path) const
+{
+    return files.count(path) > 0;
+}
+
+bool SharedBundle::isDir(const std::string& path) const
+{
+    return dirs.count(path) > 0;
+}
+
+const SharedBundleEntry& SharedBundle::getEntry(const std::string& path) const
+{
+    auto it = files.find(path);
+    if (it == files.end()) {
+        SPDLOG_ERROR("No file {} in shared bundle {}", path, filePath);
+        throw std::runtime_error("File not in shared bundle");
+    }
+
+    return it->second;
+}
+
+std::vector<std::string> SharedBundle::listDir(const std::string& path) const
+{
+    std::string prefix = path.empty() ? "" : path + "/";
+    std::unordered_set<std::string> names;
+
+    auto addName = [&prefix, &names](const std::string& p) {
+        if (p.size() <= prefix.size() || p.rfind(prefix, 0) != 0) {
+            return;
+        }
+
+        std::string rest = p.substr(prefix.size());
+        names.insert(rest.substr(0, rest.find('/')));
+    };
+
+    for (const auto& [p, entry] : files) {
+        addName(p);
+    }
+
+    return { names.begin(), names.end() };
+}
+
+int SharedBundle::openFile(const std::string& path) const
+{
+    const SharedBundleEntry& entry = getEntry(path);
+
+    int fd = ::memfd_create(path.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        return -1;
+    }
+
+    size_t written = 0;
+    while (written < entry.size) {
+        ssize_t res = ::write(
+          fd, data + entry.offset + written, entry.size - written);
+        if (res < 0) {
+            int writeErrno = errno;
+            ::close(fd);
+            errno = writeErrno;
+            return -1;
+        }
+        written += res;
+    }
+
+    // Everyone opening the file gets the same contents
+    ::lseek(fd, 0, SEEK_SET);
+    ::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE);
+
+    return fd;
+}
+
+void SharedBundle::statPath(const std::string& path,
+                            struct stat& nativeStat) const
+{
+    nativeStat = bundleStat;
+
+    mode_t perms = bundleStat.st_mode & 0777;
+    if (isDir(path)) {
+        nativeStat.st_mode = S_IFDIR | perms | 0111;
+        nativeStat.st_size = 0;
+    } else {
+        nativeStat.st_mode = S_IFREG | perms;
+        nativeStat.st_size = getEntry(path).size;
+    }
+    nativeStat.st_nlink = 1;
+}
+
+std::vector<uint8_t> SharedBundle::readFile(const std::string& path) const
+{
+    const SharedBundleEntry& entry = getEntry(path);
+    const uint8_t* start = data + entry.offset;
+
+    return { start, start + entry.size };
+}
+}
@@ -1,15 +1,29 @@
 #include "SharedFiles.h"
 
 #include <boost/filesystem.hpp>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
 #include <faabric/util/config.h>
 #include <faabric/util/files.h>
 #include <faabric/util/func.h>
 #include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
 #include <faabric/util/string_tools.h>
 
 #include <conf/FaasmConfig.h>
+#include <storage/FileDescriptor.h>
 #include <storage/FileLoader.h>
+#include <storage/SharedBundle.h>
 
 namespace storage {
 enum FileState
@@ -17,11 +31,358 @@ enum FileState
     NOT_CHECKED,
     NOT_EXISTS,
     EXISTS_DIR,
-    EXISTS
+    EXISTS,
+    EXISTS_BUNDLED
 };
 
-static std::shared_mutex sharedFileMapMutex;
-static std::unordered_map<std::string, FileState> sharedFileMap;
+// Missing files, and directory listings, are only trusted for a while, as
+// other hosts may upload them
+struct SharedFileEntry
+{
+    FileState state = NOT_CHECKED;
+    std::chrono::steady_clock::time_point expiry;
+
+    // Set for files and directories served from a bundle
+    std::shared_ptr<SharedBundle> bundle = nullptr;
+    std::string pathInBundle;
+};
+
+struct DirectoryListing
+{
+    std::unordered_set<std::string> names;
+    std::chrono::steady_clock::time_point expiry;
+};
+
+// Lookups come from every thread doing file I/O, so the map is split into
+// shards with their own locks
+struct SharedFileShard
+{
+    std::shared_mutex mx;
+    std::unordered_map<std::string, SharedFileEntry> entries;
+};
+
+static std::array<SharedFileShard, SHARED_FILE_SHARDS> sharedFileShards;
+
+static std::shared_mutex listingsMx;
+static std::unordered_map<std::string, DirectoryListing> listings;
+
+// Bundles stay mapped once they're found, keyed by the directory they hold
+static std::mutex bundlesMx;
+static std::unordered_map<std::string, std::shared_ptr<SharedBundle>> bundles;
+
+/**
+ * Writes to shared files not yet uploaded, as [start, end) ranges merged as
+ * they come in. A background thread uploads each file once its writes are
+ * due, and uploads are made one at a time, so that a flush only returns once
+ * any upload of the same writes already under way has finished.
+ */
+struct DirtySharedFile
+{
+    std::map<size_t, size_t> ranges;
+    std::chrono::steady_clock::time_point due;
+};
+
+class SharedFileWriteBack
+{
+  public:
+    ~SharedFileWriteBack()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mx);
+            running = false;
+            if (!dirty.empty()) {
+                SPDLOG_WARN("{} shared files with writes not uploaded",
+                            dirty.size());
+            }
+        }
+
+        cv.notify_one();
+        if (flushThread.joinable()) {
+            flushThread.join();
+        }
+    }
+
+    // Returns true if the file's writes are due straight away
+    bool addWrite(const std::string& p, size_t start, size_t end)
+    {
+        int writeBackMs = conf::getFaasmConfig().sharedFileWriteBackMs;
+
+        std::unique_lock<std::mutex> lock(mx);
+        auto [it, isNew] = dirty.try_emplace(p);
+        if (isNew) {
+            it->second.due = std::chrono::steady_clock::now() +
+                             std::chrono::milliseconds(writeBackMs);
+        }
+        mergeRange(it->second.ranges, start, end);
+
+        if (writeBackMs <= 0) {
+            return true;
+        }
+
+        // Only started once there's something to upload
+        if (!running) {
+            running = true;
+            flushThread = std::thread(&SharedFileWriteBack::run, this);
+        }
+
+        if (isNew) {
+            cv.notify_one();
+        }
+
+        return false;
+    }
+
+    void flush(const std::string& p)
+    {
+        std::unique_lock<std::mutex> uploadLock(uploadMx);
+
+        DirtySharedFile file;
+        {
+            std::unique_lock<std::mutex> lock(mx);
+            auto it = dirty.find(p);
+            if (it == dirty.end()) {
+                return;
+            }
+
+            file = std::move(it->second);
+            dirty.erase(it);
+        }
+
+        std::vector<std::pair<size_t, size_t>> ranges(file.ranges.begin(),
+                                                      file.ranges.end());
+        try {
+            getFileLoader().uploadSharedFileRanges(
+              SharedFiles::stripSharedPrefix(p), ranges);
+        } catch (std::exception& e) {
+            // Kept for the next flush, which waits a while before retrying
+            int writeBackMs = conf::getFaasmConfig().sharedFileWriteBackMs;
+            std::unique_lock<std::mutex> lock(mx);
+            auto [it, isNew] = dirty.try_emplace(p);
+            it->second.due = std::chrono::steady_clock::now() +
+                             std::chrono::milliseconds(writeBackMs);
+            for (const auto& [start, end] : ranges) {
+                mergeRange(it->second.ranges, start, end);
+            }
+
+            throw;
+        }
+
+        SPDLOG_TRACE("Uploaded {} ranges written to {}", ranges.size(), p);
+        SharedFiles::clearCacheForSharedFile(p);
+    }
+
+    std::vector<std::string> getDirtyPaths()
+    {
+        std::unique_lock<std::mutex> lock(mx);
+        std::vector<std::string> paths;
+        for (const auto& [p, file] : dirty) {
+            paths.push_back(p);
+        }
+
+        return paths;
+    }
+
+    // Drops writes not yet uploaded, e.g. when the file is uploaded whole
+    void forget(const std::string& p)
+    {
+        std::unique_lock<std::mutex> lock(mx);
+        dirty.erase(p);
+    }
+
+  private:
+    std::mutex mx;
+    std::condition_variable cv;
+    std::map<std::string, DirtySharedFile> dirty;
+
+    std::mutex uploadMx;
+
+    bool running = false;
+    std::thread flushThread;
+
+    static void mergeRange(std::map<size_t, size_t>& ranges,
+                           size_t start,
+                           size_t end)
+    {
+        // Swallow any ranges overlapping or touching this one
+        auto it = ranges.upper_bound(start);
+        if (it != ranges.begin() && std::prev(it)->second >= start) {
+            --it;
+        }
+
+        while (it != ranges.end() && it->first <= end) {
+            start = std::min(start, it->first);
+            end = std::max(end, it->second);
+            it = ranges.erase(it);
+        }
+
+        ranges.emplace(start, end);
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mx);
+        while (running) {
+            if (dirty.empty()) {
+                cv.wait(lock);
+                continue;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            auto nextDue = std::chrono::steady_clock::time_point::max();
+            std::vector<std::string> due;
+            for (const auto& [p, file] : dirty) {
+                if (file.due <= now) {
+                    due.push_back(p);
+                } else {
+                    nextDue = std::min(nextDue, file.due);
+                }
+            }
+
+            if (due.empty()) {
+                cv.wait_until(lock, nextDue);
+                continue;
+            }
+
+            lock.unlock();
+            for (const auto& p : due) {
+                try {
+                    flush(p);
+                } catch (std::exception& e) {
+                    SPDLOG_ERROR("Failed to upload writes to {}: {}",
+                                 p,
+                                 e.what());
+                }
+            }
+            lock.lock();
+        }
+    }
+};
+
+static SharedFileWriteBack writeBack;
+
+static SharedFileShard& getShard(const std::string& sharedPath)
+{
+    size_t idx = std::hash<std::string>{}(sharedPath) % SHARED_FILE_SHARDS;
+    return sharedFileShards[idx];
+}
+
+static std::chrono::steady_clock::time_point getLookupExpiry()
+{
+    return std::chrono::steady_clock::now() +
+           std::chrono::milliseconds(SHARED_FILE_LOOKUP_TTL_MS);
+}
+
+static std::string getParentDir(const std::string& strippedPath)
+{
+    size_t slash = strippedPath.find_last_of('/');
+    if (slash == std::string::npos) {
+        return "";
+    }
+
+    return strippedPath.substr(0, slash);
+}
+
+/**
+ * Returns the state of the name in the directory according to one listing of
+ * the directory, which is shared by every probe of that directory, e.g. Python
+ * looking for a module. NOT_CHECKED means it's a file that needs fetching.
+ */
+static FileState lookUpInDirectoryListing(const std::string& dir,
+                                          const std::string& name)
+{
+    auto now = std::chrono::steady_clock::now();
+    auto getState = [&name](const DirectoryListing& listing) {
+        if (listing.names.count(name) > 0) {
+            return NOT_CHECKED;
+        }
+        if (listing.names.count(name + "/") > 0) {
+            return EXISTS_DIR;
+        }
+        return NOT_EXISTS;
+    };
+
+    {
+        std::shared_lock<std::shared_mutex> lock(listingsMx);
+        auto it = listings.find(dir);
+        if (it != listings.end() && it->second.expiry > now) {
+            return getState(it->second);
+        }
+    }
+
+    DirectoryListing listing;
+    for (const auto& n : getFileLoader().listSharedDirectory(dir)) {
+        listing.names.insert(n);
+    }
+    listing.expiry = getLookupExpiry();
+    SPDLOG_TRACE(
+      "Listed {} entries in shared dir {}", listing.names.size(), dir);
+
+    FileState state = getState(listing);
+
+    faabric::util::FullLock lock(listingsMx);
+    listings[dir] = std::move(listing);
+
+    return state;
+}
+
+static FileState checkDirectoryListing(const std::string& strippedPath)
+{
+    std::string dir = getParentDir(strippedPath);
+    std::string name = strippedPath.substr(dir.empty() ? 0 : dir.size() + 1);
+    if (name.empty()) {
+        return NOT_CHECKED;
+    }
+
+    return lookUpInDirectoryListing(dir, name);
+}
+
+/**
+ * Finds the nearest bundle above the shared path that holds it, mapping any
+ * bundles found on the way. Returns null if there isn't one.
+ */
+static std::shared_ptr<SharedBundle> findSharedBundle(
+  const std::string& strippedPath,
+  std::string& pathInBundle)
+{
+    std::string dir = strippedPath;
+    while (!dir.empty()) {
+        dir = getParentDir(dir);
+
+        std::shared_ptr<SharedBundle> bundle = nullptr;
+        {
+            faabric::util::UniqueLock lock(bundlesMx);
+            auto it = bundles.find(dir);
+            if (it != bundles.end()) {
+                bundle = it->second;
+            }
+        }
+
+        if (bundle == nullptr &&
+            lookUpInDirectoryListing(dir, SHARED_BUNDLE_NAME) == NOT_CHECKED) {
+            std::string bundlePath = dir.empty()
+                                       ? SHARED_BUNDLE_NAME
+                                       : dir + "/" + SHARED_BUNDLE_NAME;
+            bundle = std::make_shared<SharedBundle>(
+              getFileLoader().cacheSharedFile(bundlePath));
+
+            faabric::util::UniqueLock lock(bundlesMx);
+            bundle = bundles.try_emplace(dir, bundle).first->second;
+        }
+
+        if (bundle == nullptr) {
+            continue;
+        }
+
+        std::string relativePath =
+          strippedPath.substr(dir.empty() ? 0 : dir.size() + 1);
+        if (bundle->isFile(relativePath) || bundle->isDir(relativePath)) {
+            pathInBundle = relativePath;
+            return bundle;
+        }
+    }
+
+    return nullptr;
+}
 
 std::string SharedFiles::prependSharedRoot(const std::string& originalPath)
 {
@@ -51,31 +412,68 @@ bool SharedFiles::isPathShared(const std::string& p)
 
 void SharedFiles::deleteSharedFile(const std::string& p)
 {
+    writeBack.forget(p);
+
     FileLoader& loader = getFileLoader();
     std::string relativePath = stripSharedPrefix(p);
     loader.deleteSharedFile(relativePath);
 
-    clearCacheForSharedFile(relativePath);
+    clearCacheForSharedFile(p);
 }
 
 void SharedFiles::updateSharedFile(const std::string& p)
 {
+    writeBack.forget(p);
+
     FileLoader& loader = getFileLoader();
     std::string relativePath = stripSharedPrefix(p);
 
     std::vector<uint8_t> bytes = loader.loadSharedFile(relativePath);
     loader.uploadSharedFile(relativePath, bytes);
+
+    clearCacheForSharedFile(p);
+}
+
+void SharedFiles::writeSharedFile(const std::string& p,
+                                  size_t offset,
+                                  size_t len)
+{
+    if (len == 0) {
+        return;
+    }
+
+    size_t end = offset + len < offset ? SIZE_MAX : offset + len;
+    if (writeBack.addWrite(p, offset, end)) {
+        flushSharedFile(p);
+    }
+}
+
+void SharedFiles::flushSharedFile(const std::string& p)
+{
+    writeBack.flush(p);
+}
+
+void SharedFiles::flushSharedFiles()
+{
+    for (const auto& p : writeBack.getDirtyPaths()) {
+        flushSharedFile(p);
+    }
 }
 
-int getReturnValueForSharedFileState(const std::string& sharedPath)
+size_t SharedFiles::getDirtySharedFileCount()
+{
+    return writeBack.getDirtyPaths().size();
+}
+
+static int getReturnValueForSharedFileState(FileState state)
 {
-    FileState& state = sharedFileMap[sharedPath];
     switch (state) {
         case (NOT_EXISTS): {
             return ENOENT;
         }
         case (EXISTS_DIR):
-        case (EXISTS): {
+        case (EXISTS):
+        case (EXISTS_BUNDLED): {
             return 0;
         }
         default: {
@@ -87,18 +485,56 @@ int getReturnValueForSharedFileState(const std::string& sharedPath)
 void SharedFiles::clearCacheForSharedFile(const std::string& sharedPath)
 {
     SPDLOG_TRACE("Clearing shared file cache for {}", sharedPath);
-    faabric::util::FullLock lock(sharedFileMapMutex);
+    {
+        SharedFileShard& shard = getShard(sharedPath);
+        faabric::util::FullLock lock(shard.mx);
+        shard.entries.erase(sharedPath);
+    }
+
+    std::string strippedPath = stripSharedPrefix(sharedPath);
+    std::string dir = getParentDir(strippedPath);
+    {
+        faabric::util::FullLock lock(listingsMx);
+        listings.erase(dir);
+    }
+
+    clearSharedDirListingFor(sharedPath);
+
+    if (boost::filesystem::path(strippedPath).filename() ==
+        SHARED_BUNDLE_NAME) {
+        faabric::util::UniqueLock lock(bundlesMx);
+        bundles.erase(dir);
+    }
+}
+
+std::shared_ptr<SharedBundle> SharedFiles::getBundleForSharedFile(
+  const std::string& sharedPath,
+  std::string& pathInBundle)
+{
+    SharedFileShard& shard = getShard(sharedPath);
+    faabric::util::SharedLock lock(shard.mx);
+
+    auto it = shard.entries.find(sharedPath);
+    if (it == shard.entries.end() || it->second.bundle == nullptr) {
+        return nullptr;
+    }
 
-    sharedFileMap.erase(sharedPath);
+    pathInBundle = it->second.pathInBundle;
+    return it->second.bundle;
 }
 
 int SharedFiles::syncSharedFile(const std::string& sharedPath,
                                 const std::string& localPath)
 {
+    SharedFileShard& shard = getShard(sharedPath);
+
     // See if file already synced
     {
-        faabric::util::SharedLock lock(sharedFileMapMutex);
-        if (sharedFileMap.find(sharedPath) != sharedFileMap.end()) {
+        faabric::util::SharedLock lock(shard.mx);
+        auto it = shard.entries.find(sharedPath);
+        if (it != shard.entries.end() &&
+            (it->second.state != NOT_EXISTS ||
+             it->second.expiry > std::chrono::steady_clock::now())) {
             if (localPath.empty()) {
                 SPDLOG_TRACE("Not syncing shared file {}, already checked",
                              sharedPath);
@@ -108,19 +544,13 @@ int SharedFiles::syncSharedFile(const std::string& sharedPath,
                              localPath);
             }
 
-            return getReturnValueForSharedFileState(sharedPath);
+            return getReturnValueForSharedFileState(it->second.state);
         }
     }
 
-    // At this point, file has not been synced, therefore need a lock
-    faabric::util::FullLock fullLock(sharedFileMapMutex);
-
-    // Check again
-    if (sharedFileMap.count(sharedPath) > 0) {
-        SPDLOG_TRACE("Not syncing {}, cached at {}", sharedPath, localPath);
-        return getReturnValueForSharedFileState(sharedPath);
-    }
-
+    // The sync itself happens without holding the lock, so lookups of other
+    // files aren't held up by downloads. Concurrent syncs of the same file
+    // share one download in the file loader.
     if (localPath.empty()) {
         SPDLOG_TRACE("Syncing shared file {}", sharedPath);
     } else {
@@ -137,24 +567,55 @@ int SharedFiles::syncSharedFile(const std::string& sharedPath,
         realPath = localPath;
     }
 
-    // Check the filesystem
-    sharedFileMap[sharedPath] = NOT_CHECKED;
+    // Check the filesystem, then what's in S3, then any bundles. Directories
+    // may be partly in a bundle, so their listings include its contents.
+    FileState state = NOT_CHECKED;
+    std::shared_ptr<SharedBundle> bundle = nullptr;
+    std::string pathInBundle;
     if (boost::filesystem::exists(realPath)) {
         // If already exists on filesystem, just mark it as such
         if (boost::filesystem::is_directory(realPath)) {
-            sharedFileMap[sharedPath] = EXISTS_DIR;
+            state = EXISTS_DIR;
+            bundle = findSharedBundle(strippedPath, pathInBundle);
         } else {
-            sharedFileMap[sharedPath] = EXISTS;
+            state = EXISTS;
         }
     } else {
-        boost::filesystem::path p(realPath);
+        state = checkDirectoryListing(strippedPath);
+
+        if (state == NOT_EXISTS) {
+            bundle = findSharedBundle(strippedPath, pathInBundle);
+        }
+
+        if (bundle != nullptr) {
+            if (bundle->isDir(pathInBundle)) {
+                state = EXISTS_DIR;
+            } else if (localPath.empty()) {
+                state = EXISTS_BUNDLED;
+            } else {
+                // Callers asking for a specific path need the file there
+                boost::filesystem::create_directories(
+                  boost::filesystem::path(realPath).parent_path());
+                faabric::util::writeBytesToFile(
+                  realPath, bundle->readFile(pathInBundle));
+                state = EXISTS;
+                bundle = nullptr;
+            }
+        }
+    }
 
+    boost::filesystem::path p(realPath);
+    if (state == EXISTS_DIR && !boost::filesystem::exists(realPath)) {
+        boost::filesystem::create_directories(p);
+    } else if (state == NOT_CHECKED) {
         FileLoader& loader = getFileLoader();
-        std::vector<uint8_t> bytes;
+        std::string cachedPath;
         bool isDir = false;
 
+        // The file is streamed into the loader's cache, which is usually
+        // where it's wanted anyway, so it's never held in memory
         try {
-            bytes = loader.loadSharedFile(strippedPath);
+            cachedPath = loader.cacheSharedFile(strippedPath);
         } catch (storage::SharedFileIsDirectoryException& e) {
             isDir = true;
         } catch (storage::SharedFileNotExistsException& e) {
@@ -165,22 +626,35 @@ int SharedFiles::syncSharedFile(const std::string& sharedPath,
         if (isDir) {
             // Create directory if path is a directory
             boost::filesystem::create_directories(p);
-            sharedFileMap[sharedPath] = EXISTS_DIR;
-        } else if (bytes.empty()) {
-            sharedFileMap[sharedPath] = NOT_EXISTS;
+            state = EXISTS_DIR;
+        } else if (cachedPath.empty()) {
+            state = NOT_EXISTS;
         } else {
-            // Create parent directory
-            if (p.has_parent_path()) {
-                boost::filesystem::create_directories(p.parent_path());
+            if (cachedPath != realPath) {
+                if (p.has_parent_path()) {
+                    boost::filesystem::create_directories(p.parent_path());
+                }
+
+                std::filesystem::copy_file(
+                  cachedPath,
+                  realPath,
+                  std::filesystem::copy_options::overwrite_existing);
             }
 
-            // Write to file
-            faabric::util::writeBytesToFile(realPath, bytes);
-            sharedFileMap[sharedPath] = EXISTS;
+            state = EXISTS;
         }
     }
 
-    return getReturnValueForSharedFileState(sharedPath);
+    {
+        faabric::util::FullLock lock(shard.mx);
+        SharedFileEntry& entry = shard.entries[sharedPath];
+        entry.state = state;
+        entry.expiry = getLookupExpiry();
+        entry.bundle = bundle;
+        entry.pathInBundle = pathInBundle;
+    }
+
+    return getReturnValueForSharedFileState(state);
 }
 
 void SharedFiles::syncPythonFunctionFile(const faabric::Message& msg)
@@ -213,6 +687,26 @@ void SharedFiles::syncPythonFunctionFile(const faabric::Message& msg)
 
 void SharedFiles::clear()
 {
-    sharedFileMap.clear();
+    // Flushes shouldn't lose writes
+    try {
+        flushSharedFiles();
+    } catch (std::exception& e) {
+        SPDLOG_ERROR("Failed to upload shared file writes: {}", e.what());
+    }
+
+    for (auto& shard : sharedFileShards) {
+        faabric::util::FullLock lock(shard.mx);
+        shard.entries.clear();
+    }
+
+    {
+        faabric::util::FullLock lock(listingsMx);
+        listings.clear();
+    }
+
+    clearSharedDirListings();
+
+    faabric::util::UniqueLock lock(bundlesMx);
+    bundles.clear();
 }
 }
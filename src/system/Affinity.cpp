@@ -0,0 +1,262 @@
+#include "Affinity.h"
+
+#include <conf/FaasmConfig.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <linux/mempolicy.h>
+#include <mutex>
+#include <sched.h>
+#include <sstream>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+namespace isolation {
+
+static const std::string NODES_DIR = "/sys/devices/system/node";
+
+std::vector<int> parseCpuList(const std::string& cpuList)
+{
+    std::vector<int> cpus;
+
+    std::istringstream in(cpuList);
+    std::string range;
+    while (std::getline(in, range, ',')) {
+        range.erase(std::remove_if(range.begin(), range.end(), ::isspace),
+                    range.end());
+        if (range.empty()) {
+            continue;
+        }
+
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = first;
+        if (dash != std::string::npos) {
+            last = std::stoi(range.substr(dash + 1));
+        }
+
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+
+    return cpus;
+}
+
+static std::vector<std::vector<int>> readNumaNodeCpus()
+{
+    std::vector<std::vector<int>> nodeCpus;
+
+    // Containers may only be allowed some of the host's CPUs
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool haveAllowed = ::sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+    auto isAllowed = [&allowed, haveAllowed](int cpu) {
+        return !haveAllowed || CPU_ISSET(cpu, &allowed);
+    };
+
+    // Node directories are numbered from zero without gaps on the hosts we
+    // run on, so stop at the first missing one
+    for (int node = 0;; node++) {
+        std::string cpuListPath =
+          NODES_DIR + "/node" + std::to_string(node) + "/cpulist";
+        if (!boost::filesystem::exists(cpuListPath)) {
+            break;
+        }
+
+        std::ifstream in(cpuListPath);
+        std::string cpuList;
+        std::getline(in, cpuList);
+
+        std::vector<int> cpus = parseCpuList(cpuList);
+        auto notAllowed = [&isAllowed](int c) { return !isAllowed(c); };
+        cpus.erase(std::remove_if(cpus.begin(), cpus.end(), notAllowed),
+                   cpus.end());
+        nodeCpus.emplace_back(cpus);
+    }
+
+    if (nodeCpus.empty()) {
+        int nCpus = haveAllowed ? CPU_SETSIZE
+                                : (int)std::thread::hardware_concurrency();
+        std::vector<int> allCpus;
+        for (int i = 0; i < nCpus; i++) {
+            if (isAllowed(i)) {
+                allCpus.push_back(i);
+            }
+        }
+        nodeCpus.emplace_back(allCpus);
+    }
+
+    return nodeCpus;
+}
+
+const std::vector<std::vector<int>>& getNumaNodeCpus()
+{
+    static std::vector<std::vector<int>> nodeCpus = readNumaNodeCpus();
+    return nodeCpus;
+}
+
+std::vector<int> getCpuPlacementOrder(
+  const std::string& policy,
+  const std::vector<std::vector<int>>& nodeCpus)
+{
+    std::vector<int> order;
+
+    if (policy == "compact") {
+        for (const auto& cpus : nodeCpus) {
+            order.insert(order.end(), cpus.begin(), cpus.end());
+        }
+    } else if (policy == "scatter") {
+        size_t maxCpus = 0;
+        for (const auto& cpus : nodeCpus) {
+            maxCpus = std::max(maxCpus, cpus.size());
+        }
+
+        for (size_t i = 0; i < maxCpus; i++) {
+            for (const auto& cpus : nodeCpus) {
+                if (i < cpus.size()) {
+                    order.push_back(cpus.at(i));
+                }
+            }
+        }
+    } else {
+        SPDLOG_ERROR("Unrecognised affinity policy: {}", policy);
+        throw std::runtime_error("Unrecognised affinity policy");
+    }
+
+    return order;
+}
+
+static int getNodeForCpu(int cpu)
+{
+    const auto& nodeCpus = getNumaNodeCpus();
+    for (size_t node = 0; node < nodeCpus.size(); node++) {
+        const auto& cpus = nodeCpus.at(node);
+        if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end()) {
+            return node;
+        }
+    }
+
+    return 0;
+}
+
+// Failing to set affinity or memory policy only costs performance, so these
+// are logged rather than thrown
+static void setCurrentThreadCpus(const std::vector<int>& cpus)
+{
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &cpuSet);
+    }
+
+    if (::sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0) {
+        SPDLOG_WARN("Failed to set thread affinity: {}", strerror(errno));
+    }
+}
+
+static void preferCurrentThreadMemoryOnNode(int node)
+{
+    unsigned long maxNode = sizeof(unsigned long) * 8;
+    if (node < 0 || (unsigned long)node >= maxNode) {
+        return;
+    }
+    unsigned long nodeMask = 1UL << node;
+
+    // Preferred rather than bound, so allocations can still spill over
+    // rather than fail when the node is full
+    if (::syscall(SYS_set_mempolicy, MPOL_PREFERRED, &nodeMask, maxNode) != 0) {
+        SPDLOG_WARN(
+          "Failed to prefer memory on node {}: {}", node, strerror(errno));
+    }
+}
+
+static std::mutex cpusMx;
+static std::vector<int> threadsPerCpu;
+
+struct PinnedCpu
+{
+    int cpu = -1;
+
+    ~PinnedCpu()
+    {
+        if (cpu >= 0) {
+            faabric::util::UniqueLock lock(cpusMx);
+            threadsPerCpu.at(cpu)--;
+        }
+    }
+};
+
+static thread_local PinnedCpu pinnedCpu;
+
+void pinCurrentThread()
+{
+    const std::string& policy = conf::getFaasmConfig().affinityPolicy;
+    if (policy == "off" || pinnedCpu.cpu >= 0) {
+        return;
+    }
+
+    std::vector<int> order = getCpuPlacementOrder(policy, getNumaNodeCpus());
+    if (order.empty()) {
+        return;
+    }
+
+    // Ties go to the CPU earliest in the order
+    int cpu;
+    {
+        faabric::util::UniqueLock lock(cpusMx);
+        int maxCpu = *std::max_element(order.begin(), order.end());
+        if (threadsPerCpu.size() <= (size_t)maxCpu) {
+            threadsPerCpu.resize(maxCpu + 1, 0);
+        }
+
+        cpu = order.front();
+        for (int c : order) {
+            if (threadsPerCpu.at(c) < threadsPerCpu.at(cpu)) {
+                cpu = c;
+            }
+        }
+
+        threadsPerCpu.at(cpu)++;
+    }
+    pinnedCpu.cpu = cpu;
+
+    int node = getNodeForCpu(cpu);
+    SPDLOG_DEBUG("Pinning thread to CPU {} on node {}", cpu, node);
+
+    setCurrentThreadCpus({ cpu });
+    preferCurrentThreadMemoryOnNode(node);
+}
+
+int getCurrentNumaNode()
+{
+    int cpu = ::sched_getcpu();
+    if (cpu < 0) {
+        return 0;
+    }
+
+    return getNodeForCpu(cpu);
+}
+
+void bindCurrentThreadToNumaNode(int node)
+{
+    if (conf::getFaasmConfig().affinityPolicy == "off") {
+        return;
+    }
+
+    const auto& nodeCpus = getNumaNodeCpus();
+    if (node < 0 || (size_t)node >= nodeCpus.size()) {
+        return;
+    }
+
+    setCurrentThreadCpus(nodeCpus.at(node));
+    preferCurrentThreadMemoryOnNode(node);
+}
+}
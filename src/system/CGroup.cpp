@@ -1,14 +1,24 @@
 #include "CGroup.h"
+#include "IsolationMetrics.h"
 
 #include <conf/FaasmConfig.h>
 
 #include <faabric/util/config.h>
+#include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/timing.h>
 
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
 #include <fstream>
 #include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <sys/stat.h>
 #include <syscall.h>
+#include <unistd.h>
+#include <unordered_set>
 
 #include <boost/filesystem.hpp>
 
@@ -18,12 +28,62 @@ namespace isolation {
 static const std::string BASE_DIR = "/sys/fs/cgroup/";
 static const std::string CG_CPU = "cpu";
 
-static const std::vector<std::string> controllers = { CG_CPU };
+// Period CPU limits are given over, in microseconds
+static const int CPU_PERIOD_US = 100000;
 
-static std::mutex groupMutex;
+static std::shared_mutex groupsMx;
+static std::unordered_set<std::string> createdGroups;
+
+static std::once_flag baseGroupFlag;
+
+CgroupVersion getCgroupVersion()
+{
+    // Only the unified hierarchy has this at its root
+    static CgroupVersion version = exists(BASE_DIR + "cgroup.controllers")
+                                     ? CgroupVersion::cg_v2
+                                     : CgroupVersion::cg_v1;
+    return version;
+}
+
+std::string getCgroupNameForFunction(const std::string& user,
+                                     const std::string& function)
+{
+    return getCgroupNameForFunction(
+      user, function, conf::getFaasmConfig().cgroupGranularity);
+}
+
+std::string getCgroupNameForFunction(const std::string& user,
+                                     const std::string& function,
+                                     const std::string& granularity)
+{
+    if (granularity == "user") {
+        return fmt::format("{}/{}", BASE_CGROUP_NAME, user);
+    }
+
+    if (granularity == "function") {
+        return fmt::format("{}/{}.{}", BASE_CGROUP_NAME, user, function);
+    }
+
+    return BASE_CGROUP_NAME;
+}
+
+uint64_t parseCpuStatUsage(const std::string& cpuStat)
+{
+    std::istringstream in(cpuStat);
+    std::string key;
+    uint64_t value;
+    while (in >> key >> value) {
+        if (key == "usage_usec") {
+            return value;
+        }
+    }
+
+    return 0;
+}
 
 CGroup::CGroup(const std::string& name)
   : name(name)
+  , version(getCgroupVersion())
 {
     conf::FaasmConfig& conf = conf::getFaasmConfig();
 
@@ -44,23 +104,129 @@ const CgroupMode CGroup::getMode()
     return this->mode;
 }
 
+const CgroupVersion CGroup::getVersion()
+{
+    return this->version;
+}
+
 pid_t getCurrentTid()
 {
     auto tid = (pid_t)syscall(SYS_gettid);
     return tid;
 }
 
-void addCurrentThreadToTasks(const path& tasksPath)
+// Each of these files takes a single write, which the kernel serialises, so
+// there's no need for a lock. Failures leave the thread where it is rather than
+// failing the call.
+static bool writeToCgroupFile(const path& filePath, const std::string& value)
 {
+    int fd = ::open(filePath.c_str(), O_WRONLY);
+    if (fd < 0) {
+        SPDLOG_ERROR(
+          "Failed to open {}: {}", filePath.string(), strerror(errno));
+        return false;
+    }
 
-    pid_t threadId = getCurrentTid();
+    ssize_t res = ::write(fd, value.c_str(), value.size());
+    int writeErrno = errno;
+    ::close(fd);
+
+    if (res < 0) {
+        SPDLOG_ERROR("Failed to write {} to {}: {}",
+                     value,
+                     filePath.string(),
+                     strerror(writeErrno));
+        return false;
+    }
 
-    std::ofstream outfile;
-    outfile.open(tasksPath.string(), std::ios_base::app);
-    outfile << threadId << std::endl;
-    outfile.flush();
+    return true;
+}
 
-    SPDLOG_DEBUG("Added thread id {} to {}", threadId, tasksPath.string());
+static std::string readCgroupFile(const path& filePath)
+{
+    std::ifstream in(filePath.string());
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+static path getGroupDir(CgroupVersion version, const std::string& name)
+{
+    path dir(BASE_DIR);
+    if (version == CgroupVersion::cg_v1) {
+        dir.append(CG_CPU);
+    }
+    dir.append(name);
+
+    return dir;
+}
+
+// In v2 threads can only move between groups in their process' domain, so the
+// whole process joins the base group first
+static void setUpBaseGroup()
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    path baseDir = getGroupDir(CgroupVersion::cg_v2, BASE_CGROUP_NAME);
+
+    writeToCgroupFile(baseDir / "cgroup.procs", std::to_string(::getpid()));
+
+    if (conf.cgroupMemoryMaxMb > 0) {
+        uint64_t maxBytes = (uint64_t)conf.cgroupMemoryMaxMb * 1024 * 1024;
+        writeToCgroupFile(baseDir / "memory.max", std::to_string(maxBytes));
+    }
+
+    if (conf.cgroupGranularity != "host") {
+        writeToCgroupFile(baseDir / "cgroup.subtree_control", "+cpu");
+    }
+}
+
+void CGroup::createGroup()
+{
+    {
+        faabric::util::SharedLock lock(groupsMx);
+        if (createdGroups.count(name) > 0) {
+            return;
+        }
+    }
+
+    faabric::util::FullLock lock(groupsMx);
+    if (createdGroups.count(name) > 0) {
+        return;
+    }
+
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    path groupDir = getGroupDir(version, name);
+
+    if (::mkdir(groupDir.c_str(), 0755) != 0 && errno != EEXIST) {
+        SPDLOG_ERROR(
+          "Failed to create cgroup {}: {}", groupDir.string(), strerror(errno));
+        return;
+    }
+
+    int quota = -1;
+    if (conf.cgroupCpuMaxPercent > 0) {
+        quota = conf.cgroupCpuMaxPercent * CPU_PERIOD_US / 100;
+    }
+
+    if (version == CgroupVersion::cg_v2) {
+        writeToCgroupFile(groupDir / "cgroup.type", "threaded");
+        writeToCgroupFile(groupDir / "cpu.weight",
+                          std::to_string(conf.cgroupCpuWeight));
+        writeToCgroupFile(groupDir / "cpu.max",
+                          fmt::format("{} {}",
+                                      quota < 0 ? "max" : std::to_string(quota),
+                                      CPU_PERIOD_US));
+    } else {
+        // Shares of 1024 are the same as the v2 default weight of 100
+        writeToCgroupFile(groupDir / "cpu.shares",
+                          std::to_string(conf.cgroupCpuWeight * 1024 / 100));
+        writeToCgroupFile(groupDir / "cpu.cfs_period_us",
+                          std::to_string(CPU_PERIOD_US));
+        writeToCgroupFile(groupDir / "cpu.cfs_quota_us", std::to_string(quota));
+    }
+
+    SPDLOG_DEBUG("Created cgroup {}", groupDir.string());
+    createdGroups.insert(name);
 }
 
 void CGroup::addCurrentThread()
@@ -71,18 +237,54 @@ void CGroup::addCurrentThread()
         return;
     }
 
-    PROF_START(cGroupAdd)
-    // Get lock and add to controllers
-    std::scoped_lock<std::mutex> guard(groupMutex);
+    faabric::util::TimePoint start = faabric::util::startTimer();
+    if (version == CgroupVersion::cg_v2) {
+        std::call_once(baseGroupFlag, setUpBaseGroup);
+    }
+
+    if (name != BASE_CGROUP_NAME) {
+        createGroup();
+    }
 
-    for (const std::string& controller : controllers) {
-        path tasksPath(BASE_DIR);
-        tasksPath.append(controller);
-        tasksPath.append(this->name);
-        tasksPath.append("tasks");
+    path groupDir = getGroupDir(version, name);
+    path tasksPath = groupDir / "tasks";
+    if (version == CgroupVersion::cg_v2) {
+        tasksPath = groupDir / "cgroup.threads";
+    }
 
-        addCurrentThreadToTasks(tasksPath);
+    pid_t threadId = getCurrentTid();
+    if (writeToCgroupFile(tasksPath, std::to_string(threadId))) {
+        SPDLOG_DEBUG("Added thread id {} to {}", threadId, tasksPath.string());
     }
-    PROF_END(cGroupAdd)
+
+    recordCgroupAdd(faabric::util::getTimeDiffMicros(start));
+}
+
+CGroupUsage CGroup::getUsage()
+{
+    CGroupUsage usage;
+    if (mode == CgroupMode::cg_off) {
+        return usage;
+    }
+
+    path groupDir = getGroupDir(version, name);
+
+    if (version == CgroupVersion::cg_v2) {
+        usage.cpuMicros =
+          parseCpuStatUsage(readCgroupFile(groupDir / "cpu.stat"));
+
+        path memoryPath = groupDir / "memory.current";
+        if (exists(memoryPath)) {
+            usage.memoryBytes = std::stoull(readCgroupFile(memoryPath));
+        }
+    } else {
+        // Only there if cpuacct is mounted with cpu
+        path cpuPath = groupDir / "cpuacct.usage";
+        if (exists(cpuPath)) {
+            usage.cpuMicros = std::stoull(readCgroupFile(cpuPath)) / 1000;
+        }
+    }
+
+    return usage;
 }
 }
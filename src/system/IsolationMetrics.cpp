@@ -0,0 +1,51 @@
+#include "IsolationMetrics.h"
+
+#include <atomic>
+
+namespace isolation {
+
+// Recorded on every task, so kept lock-free
+static std::atomic<uint64_t> cgroupAdds = 0;
+static std::atomic<uint64_t> cgroupAddMicros = 0;
+static std::atomic<uint64_t> netNsAdds = 0;
+static std::atomic<uint64_t> netNsAddMicros = 0;
+static std::atomic<uint64_t> reused = 0;
+
+void recordCgroupAdd(uint64_t micros)
+{
+    cgroupAdds.fetch_add(1, std::memory_order_relaxed);
+    cgroupAddMicros.fetch_add(micros, std::memory_order_relaxed);
+}
+
+void recordNetNsAdd(uint64_t micros)
+{
+    netNsAdds.fetch_add(1, std::memory_order_relaxed);
+    netNsAddMicros.fetch_add(micros, std::memory_order_relaxed);
+}
+
+void recordIsolationReused()
+{
+    reused.fetch_add(1, std::memory_order_relaxed);
+}
+
+IsolationMetrics getIsolationMetrics()
+{
+    IsolationMetrics metrics;
+    metrics.cgroupAdds = cgroupAdds.load(std::memory_order_relaxed);
+    metrics.cgroupAddMicros = cgroupAddMicros.load(std::memory_order_relaxed);
+    metrics.netNsAdds = netNsAdds.load(std::memory_order_relaxed);
+    metrics.netNsAddMicros = netNsAddMicros.load(std::memory_order_relaxed);
+    metrics.reused = reused.load(std::memory_order_relaxed);
+
+    return metrics;
+}
+
+void resetIsolationMetrics()
+{
+    cgroupAdds = 0;
+    cgroupAddMicros = 0;
+    netNsAdds = 0;
+    netNsAddMicros = 0;
+    reused = 0;
+}
+}
@@ -1,4 +1,5 @@
 #include "NetworkNamespace.h"
+#include "IsolationMetrics.h"
 
 #include <boost/filesystem.hpp>
 
@@ -10,14 +11,107 @@
 
 #include <conf/FaasmConfig.h>
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <errno.h>
 #include <fcntl.h>
+#include <fstream>
+#include <sched.h>
+#include <spawn.h>
+#include <sstream>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 namespace isolation {
 
+// Once the pool has this fraction of its namespaces left, it looks for more
+#define NETNS_LOW_WATER_FRACTION 4
+
+#define VETH_PREFIX "faasm"
+
 std::vector<std::shared_ptr<NetworkNamespace>> namespaces;
 bool namespacesInitialised = false;
 std::mutex namespacesLock;
+std::condition_variable namespacesCv;
+
+static NetworkNamespacePoolStats poolStats;
+
+static thread_local std::string currentThreadNs;
+static size_t poolSize = 0;
+
+// Index of the next namespace the pool will look for when growing
+static int nextNsIdx = 0;
+
+// Destroying a thread that's still joinable aborts, so it's joined at exit
+struct PoolGrowthThread
+{
+    std::thread thread;
+    bool running = false;
+
+    ~PoolGrowthThread()
+    {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+};
+
+static PoolGrowthThread growthThread;
+
+static void growPool()
+{
+    int idx;
+    {
+        faabric::util::UniqueLock lock(namespacesLock);
+        idx = nextNsIdx;
+    }
+
+    // Namespaces are numbered in order, so the first missing one is the end
+    std::vector<std::shared_ptr<NetworkNamespace>> added;
+    while (true) {
+        std::string netnsName = BASE_NETNS_NAME + std::to_string(idx);
+        auto ns = std::make_shared<NetworkNamespace>(netnsName);
+        if (!ns->open()) {
+            break;
+        }
+
+        added.emplace_back(ns);
+        idx++;
+    }
+
+    faabric::util::UniqueLock lock(namespacesLock);
+    nextNsIdx = idx;
+    namespaces.insert(namespaces.end(), added.begin(), added.end());
+    poolSize += added.size();
+    growthThread.running = false;
+
+    if (!added.empty()) {
+        SPDLOG_INFO("Added {} network namespaces to the pool, now {}",
+                    added.size(),
+                    poolSize);
+        namespacesCv.notify_all();
+    }
+}
+
+// Must be called with the namespaces lock held
+static void startPoolGrowth()
+{
+    if (growthThread.running) {
+        return;
+    }
+
+    // Any previous thread has finished with the lock by now
+    if (growthThread.thread.joinable()) {
+        growthThread.thread.join();
+    }
+
+    growthThread.running = true;
+    growthThread.thread = std::thread(growPool);
+}
 
 void returnNetworkNamespace(std::shared_ptr<NetworkNamespace> ns)
 {
@@ -28,10 +122,13 @@ void returnNetworkNamespace(std::shared_ptr<NetworkNamespace> ns)
 
     faabric::util::UniqueLock lock(namespacesLock);
     namespaces.emplace_back(ns);
+    namespacesCv.notify_one();
 }
 
 std::shared_ptr<NetworkNamespace> claimNetworkNamespace()
 {
+    faabric::util::TimePoint start = faabric::util::startTimer();
+
     faabric::util::UniqueLock lock(namespacesLock);
     const auto& conf = conf::getFaasmConfig();
 
@@ -47,57 +144,114 @@ std::shared_ptr<NetworkNamespace> claimNetworkNamespace()
               std::make_shared<NetworkNamespace>(netnsName));
         }
 
+        poolSize = conf.maxNetNs;
+        nextNsIdx = conf.maxNetNs;
         namespacesInitialised = true;
     }
 
+    // If network namespaces are turned off, we return a valid pointer but
+    // don't remove the resource, as no isolation is actually taking place
+    if (conf.netNsMode == "off") {
+        if (namespaces.empty()) {
+            throw std::runtime_error("Namespaces have run out");
+        }
+
+        return namespaces.back();
+    }
+
+    poolStats.claims++;
+
     if (namespaces.empty()) {
-        throw std::runtime_error("Namespaces have run out");
+        poolStats.exhausted++;
+        startPoolGrowth();
+
+        namespacesCv.wait_for(
+          lock, std::chrono::milliseconds(conf.netNsClaimTimeoutMs), [] {
+              return !namespaces.empty();
+          });
+
+        if (namespaces.empty()) {
+            poolStats.failed++;
+            SPDLOG_ERROR("No network namespaces left, pool has {}", poolSize);
+            throw std::runtime_error("Namespaces have run out");
+        }
     }
 
     std::shared_ptr<NetworkNamespace> res = namespaces.back();
+    namespaces.pop_back();
 
-    // If network namespaces are turned off, we return a valid pointer but
-    // don't remove the resource, as no isolation is actually taking place
-    if (conf.netNsMode == "off") {
-        return res;
+    // Claims take one at a time, so this only starts growing once per drain
+    if (namespaces.size() == poolSize / NETNS_LOW_WATER_FRACTION) {
+        startPoolGrowth();
     }
 
-    namespaces.pop_back();
+    uint64_t claimMicros = faabric::util::getTimeDiffMicros(start);
+    poolStats.totalClaimMicros += claimMicros;
+    poolStats.maxClaimMicros = std::max(poolStats.maxClaimMicros, claimMicros);
+
     return res;
 }
 
+NetworkNamespacePoolStats getNetworkNamespacePoolStats()
+{
+    faabric::util::UniqueLock lock(namespacesLock);
+
+    NetworkNamespacePoolStats stats = poolStats;
+    stats.size = poolSize;
+    stats.free = namespaces.size();
+
+    return stats;
+}
+
+void resetNetworkNamespacePoolStats()
+{
+    faabric::util::UniqueLock lock(namespacesLock);
+    poolStats = NetworkNamespacePoolStats();
+}
+
 NetworkNamespace::NetworkNamespace(const std::string& name)
   : name(name){};
 
+NetworkNamespace::~NetworkNamespace()
+{
+    if (nsFd >= 0) {
+        ::close(nsFd);
+    }
+}
+
 const std::string NetworkNamespace::getName()
 {
     faabric::util::SharedLock lock(mx);
     return this->name;
 }
 
-void joinNamespace(const boost::filesystem::path& nsPath)
+bool NetworkNamespace::open()
 {
-    const auto& conf = conf::getFaasmConfig();
-    if (conf.netNsMode == "off") {
-        return;
+    faabric::util::FullLock lock(mx);
+    return openLocked();
+}
+
+bool NetworkNamespace::openLocked()
+{
+    if (nsFd >= 0) {
+        return true;
     }
 
-    SPDLOG_DEBUG("Setting network ns to {}", nsPath.string());
+    boost::filesystem::path nsPath("/var/run/netns");
+    nsPath.append(name);
 
-    int fd;
-    fd = open(nsPath.c_str(), O_RDONLY, 0);
-    if (fd == -1) {
-        std::string errorMsg = "Failed to open fd at " + nsPath.string();
-        throw std::runtime_error(errorMsg);
-    }
+    nsFd = ::open(nsPath.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    return nsFd >= 0;
+}
 
-    int result = setns(fd, 0);
-    close(fd);
+static void joinNamespace(int fd, const std::string& name)
+{
+    SPDLOG_DEBUG("Setting network ns to {}", name);
 
+    int result = setns(fd, CLONE_NEWNET);
     if (result != 0) {
-        SPDLOG_ERROR("Failed to join namespace at {} - {}",
-                     nsPath.string(),
-                     std::strerror(errno));
+        SPDLOG_ERROR(
+          "Failed to join namespace {} - {}", name, std::strerror(errno));
         std::string errorMsg = "setns failed " + std::to_string(errno);
         throw std::runtime_error(errorMsg);
     }
@@ -112,15 +266,18 @@ void NetworkNamespace::addCurrentThread()
         return;
     }
 
-    PROF_START(netNsAdd)
+    faabric::util::TimePoint start = faabric::util::startTimer();
     SPDLOG_DEBUG("Adding thread to network ns: {}", name);
 
-    // Open path to the namespace
-    boost::filesystem::path nsPath("/var/run/netns");
-    nsPath.append(name);
+    if (!openLocked()) {
+        std::string errorMsg = "Failed to open fd for network ns " + name;
+        throw std::runtime_error(errorMsg);
+    }
+
+    joinNamespace(nsFd, name);
+    currentThreadNs = name;
 
-    joinNamespace(nsPath);
-    PROF_END(netNsAdd)
+    recordNetNsAdd(faabric::util::getTimeDiffMicros(start));
 };
 
 void NetworkNamespace::removeCurrentThread()
@@ -132,13 +289,154 @@ void NetworkNamespace::removeCurrentThread()
         return;
     }
 
-    // Return process to its parent namespace
-    pid_t parentPid = getppid();
+    // Return process to its parent namespace, which we only open once
+    static int parentNsFd = [] {
+        boost::filesystem::path nsPath("/proc");
+        nsPath.append(std::to_string(getppid()));
+        nsPath.append("ns/net");
+
+        int fd = ::open(nsPath.c_str(), O_RDONLY | O_CLOEXEC, 0);
+        if (fd == -1) {
+            std::string errorMsg = "Failed to open fd at " + nsPath.string();
+            throw std::runtime_error(errorMsg);
+        }
+
+        return fd;
+    }();
+
+    joinNamespace(parentNsFd, "parent");
+    currentThreadNs.clear();
+}
+
+std::string getCurrentThreadNetworkNamespace()
+{
+    return currentThreadNs;
+}
+
+std::string getEgressRateForUser(const std::string& user)
+{
+    const auto& conf = conf::getFaasmConfig();
+
+    std::istringstream in(conf.netNsTenantEgressRates);
+    std::string entry;
+    while (std::getline(in, entry, ',')) {
+        size_t equals = entry.find('=');
+        if (equals != std::string::npos && entry.substr(0, equals) == user) {
+            return entry.substr(equals + 1);
+        }
+    }
+
+    return conf.netNsEgressRate;
+}
+
+// Namespaces are created by network.create-ns as faasmnsN, with the veth pair
+// faasmN outside and faasmpN inside
+static std::string getVethName(const std::string& nsName, bool inside)
+{
+    std::string idx = nsName.substr(std::strlen(BASE_NETNS_NAME));
+    return std::string(VETH_PREFIX) + (inside ? "p" : "") + idx;
+}
+
+static bool runCommand(const std::vector<std::string>& args)
+{
+    std::vector<char*> argv;
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    std::string cmd = args.at(0);
+    for (size_t i = 1; i < args.size(); i++) {
+        cmd += " " + args.at(i);
+    }
+
+    pid_t pid;
+    int res =
+      ::posix_spawnp(&pid, argv.at(0), nullptr, nullptr, argv.data(), environ);
+    if (res != 0) {
+        SPDLOG_ERROR("Failed to run {}: {}", cmd, std::strerror(res));
+        return false;
+    }
+
+    int status;
+    if (::waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        SPDLOG_ERROR("Command failed: {}", cmd);
+        return false;
+    }
+
+    return true;
+}
+
+void NetworkNamespace::shapeEgress(const std::string& user)
+{
+    faabric::util::FullLock lock(mx);
+    const auto& conf = conf::getFaasmConfig();
+    if (conf.netNsMode == "off") {
+        return;
+    }
+
+    std::string rate = getEgressRateForUser(user);
+    if (rate.empty() || rate == egressRate) {
+        return;
+    }
+
+    // Failing to shape is logged rather than failing the call, as with
+    // cgroup limits
+    SPDLOG_DEBUG("Shaping egress from {} to {} for {}", name, rate, user);
+    bool success = runCommand({ "ip",
+                                "netns",
+                                "exec",
+                                name,
+                                "tc",
+                                "class",
+                                "replace",
+                                "dev",
+                                getVethName(name, true),
+                                "parent",
+                                "1:",
+                                "classid",
+                                "1:1",
+                                "htb",
+                                "rate",
+                                rate,
+                                "ceil",
+                                rate });
+
+    if (success) {
+        egressRate = rate;
+    }
+}
+
+static uint64_t readInterfaceStat(const std::string& iface,
+                                  const std::string& stat)
+{
+    boost::filesystem::path statPath("/sys/class/net");
+    statPath.append(iface);
+    statPath.append("statistics");
+    statPath.append(stat);
+
+    std::ifstream in(statPath.string());
+    uint64_t value = 0;
+    in >> value;
+
+    return value;
+}
+
+NetworkNamespaceCounters NetworkNamespace::getCounters()
+{
+    NetworkNamespaceCounters counters;
+
+    const auto& conf = conf::getFaasmConfig();
+    if (conf.netNsMode == "off") {
+        return counters;
+    }
 
-    boost::filesystem::path nsPath("/proc");
-    nsPath.append(std::to_string(parentPid));
-    nsPath.append("ns/net");
+    // What the namespace sends is received by the outside end of the pair
+    std::string outsideVeth = getVethName(getName(), false);
+    counters.egressBytes = readInterfaceStat(outsideVeth, "rx_bytes");
+    counters.ingressBytes = readInterfaceStat(outsideVeth, "tx_bytes");
 
-    joinNamespace(nsPath);
+    return counters;
 }
 }
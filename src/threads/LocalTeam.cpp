@@ -0,0 +1,236 @@
+#include <system/Affinity.h>
+#include <threads/LocalTeam.h>
+
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace threads {
+
+static thread_local std::shared_ptr<LocalTeam> currentTeam = nullptr;
+
+std::shared_ptr<LocalTeam> getCurrentLocalTeam()
+{
+    return currentTeam;
+}
+
+void setCurrentLocalTeam(const std::shared_ptr<LocalTeam>& team)
+{
+    currentTeam = team;
+}
+
+static inline void cpuRelax()
+{
+#if defined(__x86_64__)
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// Waits until the value is no longer the given one. Spins first, as teams
+// are often only apart for a few microseconds.
+template<typename T>
+static T waitForChange(std::atomic<T>& value, T old)
+{
+    for (int i = 0; i < LOCAL_TEAM_SPIN_ITERS; i++) {
+        T current = value.load(std::memory_order_acquire);
+        if (current != old) {
+            return current;
+        }
+
+        cpuRelax();
+    }
+
+    T current;
+    while ((current = value.load(std::memory_order_acquire)) == old) {
+        value.wait(old, std::memory_order_acquire);
+    }
+
+    return current;
+}
+
+// -------------------------------------
+// TEAM
+// -------------------------------------
+
+LocalTeam::LocalTeam(int sizeIn)
+  : size(sizeIn)
+{}
+
+void LocalTeam::barrier()
+{
+    if (size <= 1) {
+        return;
+    }
+
+    uint32_t gen = generation.load(std::memory_order_acquire);
+
+    // The last to arrive resets the count before releasing everyone else, so
+    // it's ready for the next barrier
+    if (nArrived.fetch_add(1, std::memory_order_acq_rel) == size - 1) {
+        nArrived.store(0, std::memory_order_relaxed);
+        generation.fetch_add(1, std::memory_order_release);
+        generation.notify_all();
+        return;
+    }
+
+    waitForChange(generation, gen);
+}
+
+// -------------------------------------
+// POOL
+// -------------------------------------
+
+LocalThreadPool::LocalThreadPool(int nWorkersIn)
+  : nWorkers(nWorkersIn)
+  , numaNode(isolation::getCurrentNumaNode())
+{
+    SPDLOG_DEBUG("Creating local thread pool of up to {} workers", nWorkers);
+
+    workers.reserve(nWorkers);
+}
+
+LocalThreadPool::~LocalThreadPool()
+{
+    stopWorkers(0);
+}
+
+int LocalThreadPool::getNumWorkers()
+{
+    std::unique_lock<std::mutex> lock(runMx);
+    return workers.size();
+}
+
+void LocalThreadPool::startWorkers(int nWorkersNeeded)
+{
+    while ((int)workers.size() < nWorkersNeeded) {
+        int workerIdx = workers.size();
+        SPDLOG_TRACE("Starting local thread pool worker {}", workerIdx);
+
+        auto w = std::make_unique<Worker>();
+        w->thread =
+          std::thread(&LocalThreadPool::workerLoop, this, w.get(), workerIdx);
+        workers.emplace_back(std::move(w));
+    }
+}
+
+void LocalThreadPool::stopWorkers(int nWorkersKept)
+{
+    if ((int)workers.size() <= nWorkersKept) {
+        return;
+    }
+
+    SPDLOG_DEBUG("Stopping {} idle local thread pool workers",
+                 workers.size() - nWorkersKept);
+
+    for (size_t i = nWorkersKept; i < workers.size(); i++) {
+        Worker& w = *workers.at(i);
+        w.stop.store(true, std::memory_order_release);
+        w.epoch.fetch_add(1, std::memory_order_release);
+        w.epoch.notify_one();
+    }
+
+    for (size_t i = nWorkersKept; i < workers.size(); i++) {
+        if (workers.at(i)->thread.joinable()) {
+            workers.at(i)->thread.join();
+        }
+    }
+
+    workers.resize(nWorkersKept);
+}
+
+bool LocalThreadPool::tryRun(int teamSize,
+                             const LocalTask& task,
+                             std::vector<int32_t>& results)
+{
+    if (teamSize < 1 || teamSize > getMaxTeamSize()) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(runMx, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return false;
+    }
+
+    // Worker i runs the task for team member i + 1
+    int nWorkersNeeded = teamSize - 1;
+    startWorkers(nWorkersNeeded);
+
+    currentTask = &task;
+    nRunning.store(nWorkersNeeded, std::memory_order_relaxed);
+    for (int i = 0; i < nWorkersNeeded; i++) {
+        Worker& w = *workers.at(i);
+        w.error = nullptr;
+        w.epoch.fetch_add(1, std::memory_order_release);
+        w.epoch.notify_one();
+    }
+
+    results.assign(teamSize, 0);
+    std::exception_ptr error = nullptr;
+    try {
+        results.at(0) = task(0);
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    // Wait for the rest of the team
+    int n = nRunning.load(std::memory_order_acquire);
+    while (n != 0) {
+        n = waitForChange(nRunning, n);
+    }
+
+    currentTask = nullptr;
+
+    for (int i = 0; i < nWorkersNeeded; i++) {
+        Worker& w = *workers.at(i);
+        results.at(i + 1) = w.result;
+        if (error == nullptr && w.error != nullptr) {
+            error = w.error;
+        }
+    }
+
+    // Workers none of the recent teams needed are only taking up threads
+    nRecentWorkersNeeded = std::max(nRecentWorkersNeeded, nWorkersNeeded);
+    if (++nRecentRuns == LOCAL_POOL_SHRINK_RUNS) {
+        stopWorkers(nRecentWorkersNeeded);
+        nRecentRuns = 0;
+        nRecentWorkersNeeded = 0;
+    }
+
+    if (error != nullptr) {
+        std::rethrow_exception(error);
+    }
+
+    return true;
+}
+
+void LocalThreadPool::workerLoop(Worker* worker, int workerIdx)
+{
+    Worker& w = *worker;
+    uint32_t seen = 0;
+
+    isolation::bindCurrentThreadToNumaNode(numaNode);
+
+    while (true) {
+        seen = waitForChange(w.epoch, seen);
+        if (w.stop.load(std::memory_order_acquire)) {
+            break;
+        }
+
+        try {
+            w.result = (*currentTask)(workerIdx + 1);
+        } catch (...) {
+            w.error = std::current_exception();
+        }
+
+        if (nRunning.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            nRunning.notify_one();
+        }
+    }
+}
+}
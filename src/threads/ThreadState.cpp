@@ -14,6 +14,9 @@
 #include <conf/FaasmConfig.h>
 #include <threads/ThreadState.h>
 
+#include <cstring>
+#include <stdexcept>
+
 using namespace faabric::util;
 
 #define LEVEL_WAIT_TIMEOUT_MS 20000
@@ -27,21 +30,43 @@ void setCurrentOpenMPLevel(const std::shared_ptr<Level>& level)
     currentLevel = level;
 }
 
+// The last level this thread deserialised, and the context it came from.
+// Tight loops of parallel sections send the same context over and over, so
+// the level can be reused rather than rebuilt.
+struct CachedLevel
+{
+    std::string context;
+    std::shared_ptr<Level> level = nullptr;
+};
+
+static thread_local CachedLevel cachedLevel;
+
 void setCurrentOpenMPLevel(
   const std::shared_ptr<faabric::BatchExecuteRequest> req)
 {
-    if (req->contextdata().empty()) {
+    const std::string& context = req->contextdata();
+    if (context.empty()) {
         SPDLOG_ERROR("Empty OpenMP context for {}", req->id());
         throw std::runtime_error("Empty context for OpenMP request");
     }
 
-    std::string funcStr = faabric::util::funcToString(req);
+    if (cachedLevel.level != nullptr && cachedLevel.context == context) {
+        // The thread may have changed its level while running the last
+        // section, so put back the settings it was sent with. The shared
+        // offsets are the same, as the contexts are.
+        cachedLevel.level->setFromSerialised(context);
+        currentLevel = cachedLevel.level;
+        return;
+    }
 
     currentLevel = levelFromBatchRequest(req);
+    cachedLevel.context = context;
+    cachedLevel.level = currentLevel;
+
     SPDLOG_TRACE(
       "Deserialised thread-local OpenMP level from {} bytes for {}, {}",
-      req->contextdata().size(),
-      funcStr,
+      context.size(),
+      faabric::util::funcToString(req),
       currentLevel->toString());
 }
 
@@ -57,6 +82,27 @@ std::shared_ptr<Level> getCurrentOpenMPLevel()
     return currentLevel;
 }
 
+void setPthreadArgsPtr(faabric::Message& msg, int32_t argsPtr)
+{
+    msg.set_inputdata(&argsPtr, sizeof(argsPtr));
+}
+
+int32_t getPthreadArgsPtr(const faabric::Message& msg)
+{
+    const std::string& inputData = msg.inputdata();
+    if (inputData.size() != sizeof(int32_t)) {
+        SPDLOG_ERROR("Pthread message {} has {} bytes of args, expected {}",
+                     msg.id(),
+                     inputData.size(),
+                     sizeof(int32_t));
+        throw std::runtime_error("Invalid pthread args");
+    }
+
+    int32_t argsPtr;
+    std::memcpy(&argsPtr, inputData.data(), sizeof(argsPtr));
+    return argsPtr;
+}
+
 std::shared_ptr<Level> levelFromBatchRequest(
   const std::shared_ptr<faabric::BatchExecuteRequest>& req)
 {
@@ -75,9 +121,12 @@ std::vector<uint32_t> Level::getSharedVarOffsets()
 
 void Level::setSharedVarOffsets(uint32_t* ptr, int nVars)
 {
-    // Record the offsets themselves
-    sharedVarOffsets = std::make_unique<uint32_t[]>(nVars);
-    nSharedVarOffsets = nVars;
+    // Record the offsets themselves, reusing the buffer when a level is
+    // reused for another parallel section with the same number of variables
+    if (sharedVarOffsets == nullptr || nSharedVarOffsets != (uint32_t)nVars) {
+        sharedVarOffsets = std::make_unique<uint32_t[]>(nVars);
+        nSharedVarOffsets = nVars;
+    }
     std::memcpy(sharedVarOffsets.get(), ptr, nVars * sizeof(uint32_t));
 }
 
@@ -121,31 +170,68 @@ int Level::getMaxThreadsAtNextLevel() const
     return defaultNumThreads;
 }
 
-std::vector<uint8_t> Level::serialise()
+bool Level::isNextLevelSizeRequested() const
 {
-    // Work out the size of this object
-    size_t thisSize = sizeof(Level);
-    thisSize += nSharedVarOffsets * sizeof(uint32_t);
+    return activeLevels >= maxActiveLevels || pushedThreads > 0 ||
+           wantedThreads > 0;
+}
 
-    std::vector<uint8_t> bytes(thisSize, 0);
+size_t Level::getSerialisedSize() const
+{
+    return sizeof(Level) + nSharedVarOffsets * sizeof(uint32_t);
+}
 
+void Level::serialiseTo(uint8_t* bytes)
+{
     // Copy the level without the shared offsets (relying on the C++ class
     // memory layout placing members at the top)
-    uint8_t* bytesPtr = BYTES(this);
-    std::memcpy(bytes.data(), bytesPtr, sizeof(Level));
+    std::memcpy(bytes, BYTES(this), sizeof(Level));
+
+    // Leave out the address of the offsets, so equal levels serialise the same
+    size_t ptrOffset = BYTES(&sharedVarOffsets) - BYTES(this);
+    std::memset(bytes + ptrOffset, 0, sizeof(sharedVarOffsets));
 
     // Copy the shared offsets
     if (nSharedVarOffsets > 0) {
-        std::memcpy(bytes.data() + sizeof(Level),
+        std::memcpy(bytes + sizeof(Level),
                     sharedVarOffsets.get(),
                     nSharedVarOffsets * sizeof(uint32_t));
     }
 
-    SPDLOG_TRACE("Serialising to {} bytes, {}", bytes.size(), toString());
+    SPDLOG_TRACE(
+      "Serialising to {} bytes, {}", getSerialisedSize(), toString());
+}
+
+std::vector<uint8_t> Level::serialise()
+{
+    std::vector<uint8_t> bytes(getSerialisedSize(), 0);
+    serialiseTo(bytes.data());
 
     return bytes;
 }
 
+void Level::serialise(std::string& out)
+{
+    out.resize(getSerialisedSize());
+    serialiseTo(BYTES(out.data()));
+}
+
+void Level::setFromSerialised(const std::string& bytes)
+{
+    // As in deserialise, but keeping this level's shared offsets
+    Level serialised(0);
+    std::memcpy(BYTES(&serialised), bytes.data(), sizeof(Level));
+    new (&serialised.sharedVarOffsets) std::unique_ptr<uint32_t[]>(nullptr);
+
+    depth = serialised.depth;
+    activeLevels = serialised.activeLevels;
+    maxActiveLevels = serialised.maxActiveLevels;
+    numThreads = serialised.numThreads;
+    wantedThreads = serialised.wantedThreads;
+    pushedThreads = serialised.pushedThreads;
+    globalTidOffset = serialised.globalTidOffset;
+}
+
 std::shared_ptr<Level> Level::deserialise(const std::vector<uint8_t>& bytes)
 {
     // Copy the top section of bytes into a new instance (relying on the
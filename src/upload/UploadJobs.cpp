@@ -0,0 +1,186 @@
+#include <upload/UploadJobs.h>
+
+#include <conf/FaasmConfig.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace edge {
+
+std::string uploadJobStatusToString(UploadJobStatus status)
+{
+    switch (status) {
+        case UploadJobStatus::Queued:
+            return "QUEUED";
+        case UploadJobStatus::Running:
+            return "RUNNING";
+        case UploadJobStatus::Succeeded:
+            return "SUCCEEDED";
+        case UploadJobStatus::Failed:
+            return "FAILED";
+    }
+
+    return "UNKNOWN";
+}
+
+UploadJobQueue::UploadJobQueue(int nWorkersIn, int maxQueuedIn)
+  : nWorkers(std::max(nWorkersIn, 1))
+  , maxQueued(std::max(maxQueuedIn, 1))
+{}
+
+UploadJobQueue::~UploadJobQueue()
+{
+    shutdown();
+}
+
+int UploadJobQueue::submit(const std::string& name, std::function<void()> task)
+{
+    faabric::util::UniqueLock lock(mx);
+    if (stopped) {
+        SPDLOG_ERROR("Submitting upload job {} after shutdown", name);
+        throw std::runtime_error("Upload job queue shut down");
+    }
+
+    if (queue.size() >= maxQueued) {
+        SPDLOG_WARN(
+          "Upload queue full ({} jobs), rejecting {}", maxQueued, name);
+        return -1;
+    }
+
+    // Workers are only started once there's something for them to do
+    if (workers.empty()) {
+        for (int i = 0; i < nWorkers; i++) {
+            workers.emplace_back(&UploadJobQueue::runWorker, this);
+        }
+    }
+
+    int id = nextId++;
+    UploadJob& job = jobs[id];
+    job.id = id;
+    job.name = name;
+
+    queue.emplace_back(id, std::move(task));
+    workerCv.notify_one();
+
+    SPDLOG_DEBUG("Queued upload job {} ({})", id, name);
+
+    return id;
+}
+
+bool UploadJobQueue::getJob(int id, UploadJob& job)
+{
+    faabric::util::UniqueLock lock(mx);
+    auto it = jobs.find(id);
+    if (it == jobs.end()) {
+        return false;
+    }
+
+    job = it->second;
+    return true;
+}
+
+UploadJob UploadJobQueue::awaitJob(int id)
+{
+    faabric::util::UniqueLock lock(mx);
+    if (jobs.count(id) == 0) {
+        SPDLOG_ERROR("Awaiting unknown upload job {}", id);
+        throw std::runtime_error("Unknown upload job");
+    }
+
+    // Jobs can be forgotten as soon as they finish, so hold on to a copy
+    UploadJob job;
+    finishedCv.wait(lock, [this, id, &job] {
+        auto it = jobs.find(id);
+        if (it == jobs.end()) {
+            return true;
+        }
+
+        job = it->second;
+        return job.isFinished();
+    });
+
+    return job;
+}
+
+size_t UploadJobQueue::getQueuedCount()
+{
+    faabric::util::UniqueLock lock(mx);
+    return queue.size();
+}
+
+void UploadJobQueue::shutdown()
+{
+    std::vector<std::thread> toJoin;
+    {
+        faabric::util::UniqueLock lock(mx);
+        stopped = true;
+        toJoin = std::move(workers);
+        workers.clear();
+        workerCv.notify_all();
+    }
+
+    for (auto& t : toJoin) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+}
+
+void UploadJobQueue::runWorker()
+{
+    while (true) {
+        std::pair<int, std::function<void()>> next;
+        {
+            faabric::util::UniqueLock lock(mx);
+            workerCv.wait(lock, [this] { return stopped || !queue.empty(); });
+
+            // Anything already queued still gets run
+            if (queue.empty()) {
+                return;
+            }
+
+            next = std::move(queue.front());
+            queue.pop_front();
+            jobs.at(next.first).status = UploadJobStatus::Running;
+        }
+
+        SPDLOG_DEBUG("Running upload job {}", next.first);
+
+        try {
+            next.second();
+            finishJob(next.first, UploadJobStatus::Succeeded, "");
+        } catch (std::exception& e) {
+            SPDLOG_ERROR("Upload job {} failed: {}", next.first, e.what());
+            finishJob(next.first, UploadJobStatus::Failed, e.what());
+        }
+    }
+}
+
+void UploadJobQueue::finishJob(int id,
+                               UploadJobStatus status,
+                               const std::string& error)
+{
+    faabric::util::UniqueLock lock(mx);
+    UploadJob& job = jobs.at(id);
+    job.status = status;
+    job.error = error;
+
+    finishedIds.push_back(id);
+    while (finishedIds.size() > UPLOAD_JOB_HISTORY) {
+        jobs.erase(finishedIds.front());
+        finishedIds.pop_front();
+    }
+
+    finishedCv.notify_all();
+}
+
+UploadJobQueue& getUploadJobQueue()
+{
+    static UploadJobQueue jobQueue(conf::getFaasmConfig().uploadWorkers,
+                                   conf::getFaasmConfig().uploadQueueSize);
+    return jobQueue;
+}
+}
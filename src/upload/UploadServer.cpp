@@ -11,9 +11,25 @@
 #include <codegen/MachineCodeGenerator.h>
 #include <conf/FaasmConfig.h>
 #include <storage/FileLoader.h>
+#include <storage/SharedBundle.h>
+#include <upload/UploadJobs.h>
+#include <wasm/function_profile.h>
+
+#include <cpprest/producerconsumerstream.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <memory>
+#include <stdexcept>
+#include <thread>
 
 namespace edge {
 
+// Reads len bytes of a value from the given offset into the buffer
+using ChunkReader =
+  std::function<void(size_t offset, uint8_t* buffer, size_t len)>;
+
 // --------------------------------------
 // REQUEST UTILS
 // --------------------------------------
@@ -71,6 +87,18 @@ class PathParts
         }                                                                      \
     }
 
+bool isAsyncRequest(const http_request& request)
+{
+    std::map<std::string, std::string> query =
+      uri::split_query(request.relative_uri().query());
+    auto it = query.find(ASYNC_QUERY_PARAM);
+    if (it == query.end()) {
+        return false;
+    }
+
+    return it->second != "0" && it->second != "false";
+}
+
 void setPermissiveHeaders(http_response& response)
 {
     response.headers().add(U("Access-Control-Allow-Origin"), U("*"));
@@ -80,6 +108,179 @@ void setPermissiveHeaders(http_response& response)
                            U("Accept,Content-Type"));
 }
 
+void replyEmpty(const http_request& request)
+{
+    http_response response(status_codes::InternalError);
+    response.set_body(EMPTY_FILE_RESPONSE);
+    setPermissiveHeaders(response);
+    request.reply(response);
+}
+
+// --------------------------------------
+// DOWNLOADS
+// --------------------------------------
+
+enum class RangeResult
+{
+    Full,
+    Partial,
+    Unsatisfiable
+};
+
+static bool parseSize(const std::string& str, size_t& result)
+{
+    if (str.empty() ||
+        !std::all_of(str.begin(), str.end(), [](unsigned char c) {
+            return std::isdigit(c);
+        })) {
+        return false;
+    }
+
+    try {
+        result = std::stoull(str);
+    } catch (std::out_of_range& e) {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Works out the part of a value of the given size that the request's Range
+ * header asks for. Only single ranges are supported; as the RFC allows,
+ * anything else gets the whole value, as do malformed headers.
+ */
+static RangeResult getRequestRange(const http_request& request,
+                                   size_t totalSize,
+                                   size_t& offset,
+                                   size_t& len)
+{
+    offset = 0;
+    len = totalSize;
+
+    const http_headers& headers = request.headers();
+    if (!headers.has(header_names::range)) {
+        return RangeResult::Full;
+    }
+
+    std::string header = headers.find(header_names::range)->second;
+    std::string prefix = "bytes=";
+    if (header.rfind(prefix, 0) != 0 ||
+        header.find(',') != std::string::npos) {
+        return RangeResult::Full;
+    }
+
+    std::string spec = header.substr(prefix.size());
+    size_t dash = spec.find('-');
+    if (dash == std::string::npos) {
+        return RangeResult::Full;
+    }
+
+    std::string startStr = spec.substr(0, dash);
+    std::string endStr = spec.substr(dash + 1);
+
+    // Suffix ranges ask for the last N bytes
+    if (startStr.empty()) {
+        size_t suffixLen = 0;
+        if (!parseSize(endStr, suffixLen)) {
+            return RangeResult::Full;
+        }
+
+        if (suffixLen == 0) {
+            return RangeResult::Unsatisfiable;
+        }
+
+        offset = totalSize - std::min(suffixLen, totalSize);
+        len = totalSize - offset;
+        return RangeResult::Partial;
+    }
+
+    size_t start = 0;
+    size_t end = totalSize - 1;
+    if (!parseSize(startStr, start) ||
+        (!endStr.empty() && !parseSize(endStr, end)) || end < start) {
+        return RangeResult::Full;
+    }
+
+    if (start >= totalSize) {
+        return RangeResult::Unsatisfiable;
+    }
+
+    offset = start;
+    len = std::min(end, totalSize - 1) - start + 1;
+    return RangeResult::Partial;
+}
+
+/**
+ * Replies with the part of a value asked for by the request, read a chunk at
+ * a time by the given reader. The response is streamed, with chunks read in
+ * the background only as the client keeps up, so large values never have to
+ * fit in memory.
+ */
+static void replyStreamed(const http_request& request,
+                          size_t totalSize,
+                          const ChunkReader& reader)
+{
+    size_t offset = 0;
+    size_t len = 0;
+    RangeResult range = getRequestRange(request, totalSize, offset, len);
+
+    if (range == RangeResult::Unsatisfiable) {
+        http_response response(status_codes::RangeNotSatisfiable);
+        response.headers().add(header_names::content_range,
+                               fmt::format("bytes */{}", totalSize));
+        setPermissiveHeaders(response);
+        request.reply(response);
+        return;
+    }
+
+    http_response response(range == RangeResult::Partial
+                             ? status_codes::PartialContent
+                             : status_codes::OK);
+    response.headers().add(header_names::accept_ranges, U("bytes"));
+    if (range == RangeResult::Partial) {
+        response.headers().add(
+          header_names::content_range,
+          fmt::format("bytes {}-{}/{}", offset, offset + len - 1, totalSize));
+    }
+
+    concurrency::streams::producer_consumer_buffer<uint8_t> buffer;
+    response.set_body(
+      buffer.create_istream(), len, U("application/octet-stream"));
+    setPermissiveHeaders(response);
+    request.reply(response);
+
+    pplx::create_task([buffer, reader, offset, len]() mutable {
+        std::vector<uint8_t> chunk(std::min<size_t>(len, DOWNLOAD_CHUNK_BYTES));
+        try {
+            for (size_t pos = 0; pos < len; pos += chunk.size()) {
+                size_t chunkLen = std::min(chunk.size(), len - pos);
+
+                int waitedMs = 0;
+                while (buffer.in_avail() > DOWNLOAD_MAX_BUFFERED_BYTES) {
+                    if (waitedMs >= DOWNLOAD_STALL_TIMEOUT_MS) {
+                        throw std::runtime_error("Download client stalled");
+                    }
+
+                    SLEEP_MS(10);
+                    waitedMs += 10;
+                }
+
+                reader(offset + pos, chunk.data(), chunkLen);
+
+                // The buffer copies the chunk, so it can be reused
+                buffer.putn_nocopy(chunk.data(), chunkLen).wait();
+            }
+        } catch (std::exception& e) {
+            SPDLOG_ERROR("Download failed after starting: {}", e.what());
+            buffer.close(std::ios_base::out, std::current_exception()).wait();
+            return;
+        }
+
+        buffer.close(std::ios_base::out).wait();
+    });
+}
+
 // --------------------------------------
 // SERVER LIFECYCLE
 // --------------------------------------
@@ -128,58 +329,109 @@ void UploadServer::handleGet(const http_request& request)
 
     PathParts pathParts(request);
 
-    storage::FileLoader& l = storage::getFileLoaderWithoutLocalCache();
     PATH_PART(pathType, pathParts, 0);
-    std::vector<uint8_t> returnBytes;
 
     if (pathType == STATE_URL_PART) {
         SPDLOG_DEBUG("GET request for state at {}", pathParts.relativeUri);
 
         PATH_PART(user, pathParts, 1);
         PATH_PART(key, pathParts, 2);
-        returnBytes = getState(user, key);
+        handleStateDownload(request, user, key);
 
     } else if (pathType == SHARED_FILE_URL_PART) {
         SPDLOG_DEBUG("GET request for shared file at {}",
                      pathParts.relativeUri);
 
         PATH_HEADER(filePath, request);
-        returnBytes = l.loadSharedFile(filePath);
+        handleSharedFileDownload(request, filePath);
+
+    } else if (pathType == JOB_URL_PART) {
+        SPDLOG_DEBUG("GET request for upload job at {}",
+                     pathParts.relativeUri);
+
+        PATH_PART(jobId, pathParts, 1);
+        handleJobStatus(request, jobId);
 
     } else {
         std::string errMessage =
           fmt::format("Unrecognised GET request to {}", pathParts.relativeUri);
         request.reply(status_codes::BadRequest, errMessage);
+    }
+}
+
+void UploadServer::handleStateDownload(const http_request& request,
+                                       const std::string& user,
+                                       const std::string& key)
+{
+    SPDLOG_INFO("Downloading state from ({}/{})", user, key);
 
+    faabric::state::State& state = faabric::state::getGlobalState();
+    size_t stateSize = state.getStateSize(user, key);
+    if (stateSize == 0) {
+        replyEmpty(request);
         return;
     }
 
-    http_response response;
-    if (returnBytes.empty()) {
-        response = http_response(status_codes::InternalError);
-        response.set_body(EMPTY_FILE_RESPONSE);
-    } else {
-        response = http_response(status_codes::OK);
-        response.set_body(returnBytes);
+    // Chunks are pulled as they're read, so the value is never held in full
+    // unless this host is its master
+    auto kv = state.getKV(user, key, stateSize);
+    replyStreamed(
+      request, stateSize, [kv](size_t offset, uint8_t* buffer, size_t len) {
+          kv->getChunk(offset, buffer, len);
+      });
+}
+
+void UploadServer::handleSharedFileDownload(const http_request& request,
+                                            const std::string& path)
+{
+    SPDLOG_INFO("Downloading shared file {}", path);
+
+    storage::FileLoader& l = storage::getFileLoaderWithoutLocalCache();
+    size_t fileSize = 0;
+    try {
+        fileSize = l.getSharedFileSize(path);
+    } catch (storage::SharedFileNotExistsException& e) {
+        replyEmpty(request);
+        return;
     }
 
-    setPermissiveHeaders(response);
-    request.reply(response);
+    // Chunks are read on another thread, which has its own loader
+    replyStreamed(
+      request, fileSize, [path](size_t offset, uint8_t* buffer, size_t len) {
+          storage::getFileLoaderWithoutLocalCache().loadSharedFileRange(
+            path, offset, buffer, len);
+      });
 }
 
-std::vector<uint8_t> UploadServer::getState(const std::string& user,
-                                            const std::string& key)
+void UploadServer::handleJobStatus(const http_request& request,
+                                   const std::string& jobId)
 {
-    SPDLOG_INFO("Downloading state from ({}/{})", user, key);
+    int id = 0;
+    try {
+        id = std::stoi(jobId);
+    } catch (std::exception& e) {
+        request.reply(status_codes::BadRequest,
+                      fmt::format("Invalid upload job ID {}\n", jobId));
+        return;
+    }
 
-    faabric::state::State& state = faabric::state::getGlobalState();
-    size_t stateSize = state.getStateSize(user, key);
-    const std::shared_ptr<faabric::state::StateKeyValue>& kv =
-      state.getKV(user, key, stateSize);
-    uint8_t* stateValue = kv->get();
+    UploadJob job;
+    if (!getUploadJobQueue().getJob(id, job)) {
+        request.reply(status_codes::NotFound,
+                      fmt::format("No upload job {}\n", id));
+        return;
+    }
+
+    // Failed jobs give the reason after the status
+    std::string body = uploadJobStatusToString(job.status);
+    if (job.status == UploadJobStatus::Failed) {
+        body += ": " + job.error;
+    }
 
-    const std::vector<uint8_t> value(stateValue, stateValue + stateSize);
-    return value;
+    http_response response(status_codes::OK);
+    response.set_body(body);
+    setPermissiveHeaders(response);
+    request.reply(response);
 }
 
 // --------------------------------------
@@ -226,6 +478,18 @@ void UploadServer::handlePut(const http_request& request)
         PATH_HEADER(filePath, request);
         handleSharedFileUpload(request, filePath);
 
+    } else if (pathType == SHARED_BUNDLE_URL_PART) {
+        SPDLOG_DEBUG("PUT request for shared bundle at {}",
+                     pathParts.relativeUri);
+
+        PATH_HEADER(dirPath, request);
+        handleSharedBundleUpload(request, dirPath);
+
+    } else if (pathType == ARCHIVE_URL_PART) {
+        SPDLOG_DEBUG("PUT request for archive at {}", pathParts.relativeUri);
+
+        handleArchiveUpload(request);
+
     } else if (pathType == FUNCTION_URL_PART) {
         SPDLOG_DEBUG("PUT request for function at {}", pathParts.relativeUri);
 
@@ -233,6 +497,20 @@ void UploadServer::handlePut(const http_request& request)
         PATH_PART(function, pathParts, 2);
         handleFunctionUpload(request, user, function);
 
+    } else if (pathType == PRELOAD_URL_PART) {
+        SPDLOG_DEBUG("PUT request for preloads at {}", pathParts.relativeUri);
+
+        PATH_PART(user, pathParts, 1);
+        PATH_PART(function, pathParts, 2);
+        handlePreloadUpload(request, user, function);
+
+    } else if (pathType == PROFILE_URL_PART) {
+        SPDLOG_DEBUG("PUT request for profile at {}", pathParts.relativeUri);
+
+        PATH_PART(user, pathParts, 1);
+        PATH_PART(function, pathParts, 2);
+        handleProfileUpload(request, user, function);
+
     } else {
         std::string errMessage =
           fmt::format("Unrecognised PUT request to {}", pathParts.relativeUri);
@@ -285,11 +563,17 @@ void UploadServer::handlePythonFunctionUpload(const http_request& request,
                 msg.pythonuser(),
                 msg.pythonfunction());
 
-    // Do the upload
-    storage::FileLoader& l = storage::getFileLoaderWithoutLocalCache();
-    l.uploadPythonFunction(msg);
-
-    request.reply(status_codes::OK, "Python function upload complete\n");
+    // Python functions can be large, so the upload itself happens on a worker
+    std::string name =
+      fmt::format("{}/{}", msg.pythonuser(), msg.pythonfunction());
+    runUploadJob(
+      request,
+      name,
+      [msg = std::move(msg)]() mutable {
+          storage::FileLoader& l = storage::getFileLoaderWithoutLocalCache();
+          l.uploadPythonFunction(msg);
+      },
+      "Python function upload complete\n");
 }
 
 void UploadServer::handleSharedFileUpload(const http_request& request,
@@ -315,6 +599,257 @@ void UploadServer::handleSharedFileUpload(const http_request& request,
     request.reply(status_codes::OK, "Shared file uploaded\n");
 }
 
+void UploadServer::handleSharedBundleUpload(const http_request& request,
+                                            const std::string& dir)
+{
+    SPDLOG_INFO("Uploading shared bundle for {}", dir);
+
+    std::string bundlePath =
+      dir.empty() ? SHARED_BUNDLE_NAME : dir + "/" + SHARED_BUNDLE_NAME;
+
+    bool valid = true;
+    const concurrency::streams::istream bodyStream = request.body();
+    concurrency::streams::stringstreambuf inputStream;
+    bodyStream.read_to_end(inputStream)
+      .then([&inputStream, &bundlePath, &valid](size_t size) {
+          UNUSED(size);
+
+          std::string s = inputStream.collection();
+          const std::vector<uint8_t> bytesData =
+            faabric::util::stringToBytes(s);
+
+          try {
+              storage::validateSharedBundle(bytesData);
+          } catch (std::runtime_error& e) {
+              valid = false;
+              return;
+          }
+
+          storage::FileLoader& l = storage::getFileLoaderWithoutLocalCache();
+          l.uploadSharedFile(bundlePath, bytesData);
+      })
+      .wait();
+
+    if (!valid) {
+        request.reply(status_codes::BadRequest, "Invalid shared bundle\n");
+        return;
+    }
+
+    request.reply(status_codes::OK, "Shared bundle uploaded\n");
+}
+
+// A file in an archive, whose path says what it is in the same way as the
+// upload URLs, i.e. f/<user>/<function>, p/<user>/<function>, s/<user>/<key>
+// or file/<shared file path>
+struct ArchiveEntry
+{
+    std::string type;
+    std::string user;
+    std::string name;
+    storage::SharedBundleEntry data;
+};
+
+static bool parseArchivePath(const std::string& path, ArchiveEntry& entry)
+{
+    size_t typeEnd = path.find('/');
+    if (typeEnd == std::string::npos) {
+        return false;
+    }
+
+    entry.type = path.substr(0, typeEnd);
+    std::string rest = path.substr(typeEnd + 1);
+    if (entry.type == SHARED_FILE_URL_PART) {
+        entry.name = rest;
+        return true;
+    }
+
+    if (entry.type != FUNCTION_URL_PART && entry.type != PYTHON_URL_PART &&
+        entry.type != STATE_URL_PART) {
+        return false;
+    }
+
+    size_t userEnd = rest.find('/');
+    if (userEnd == std::string::npos || userEnd == 0 ||
+        rest.find('/', userEnd + 1) != std::string::npos) {
+        return false;
+    }
+
+    entry.user = rest.substr(0, userEnd);
+    entry.name = rest.substr(userEnd + 1);
+    return !entry.name.empty();
+}
+
+// Returns false if what's stored already has these contents
+static bool uploadArchiveEntry(const std::vector<uint8_t>& archive,
+                               const ArchiveEntry& entry)
+{
+    auto begin = archive.begin() + entry.data.offset;
+    std::vector<uint8_t> bytes(begin, begin + entry.data.size);
+
+    storage::FileLoader& l = storage::getFileLoaderWithoutLocalCache();
+    if (entry.type == FUNCTION_URL_PART) {
+        faabric::Message msg =
+          faabric::util::messageFactory(entry.user, entry.name);
+        codegen::MachineCodeGenerator& gen =
+          codegen::getMachineCodeGenerator(l);
+        if (gen.isFunctionUpToDate(msg, bytes)) {
+            return false;
+        }
+
+        // Machine code is generated afterwards with the cached loader, so
+        // uploading with it too means it picks up the new wasm
+        msg.set_inputdata(std::string(bytes.begin(), bytes.end()));
+        storage::getFileLoader().uploadFunction(msg);
+
+    } else if (entry.type == PYTHON_URL_PART) {
+        faabric::Message msg;
+        msg.set_ispython(true);
+        msg.set_pythonuser(entry.user);
+        msg.set_pythonfunction(entry.name);
+        if (l.isSharedFileUnchanged(l.getPythonFunctionRelativePath(msg),
+                                    bytes)) {
+            return false;
+        }
+
+        msg.set_inputdata(std::string(bytes.begin(), bytes.end()));
+        l.uploadPythonFunction(msg);
+
+    } else if (entry.type == STATE_URL_PART) {
+        // State isn't content addressed, so is always pushed
+        faabric::state::State& state = faabric::state::getGlobalState();
+        const std::shared_ptr<faabric::state::StateKeyValue>& kv =
+          state.getKV(entry.user, entry.name, bytes.size());
+        kv->set(bytes.data());
+        kv->pushFull();
+
+    } else {
+        if (l.isSharedFileUnchanged(entry.name, bytes)) {
+            return false;
+        }
+
+        l.uploadSharedFile(entry.name, bytes);
+    }
+
+    return true;
+}
+
+/**
+ * Uploads the files in an archive in parallel, skipping any that are already
+ * stored, then generates machine code for the functions that changed as a
+ * single batch.
+ */
+static void uploadArchive(const std::vector<uint8_t>& archive,
+                          const std::vector<ArchiveEntry>& entries)
+{
+    // Written by each thread for its own entries, so not a vector<bool>
+    std::vector<uint8_t> changed(entries.size(), 0);
+    std::vector<std::string> errors(entries.size());
+
+    std::atomic<size_t> nextEntry = 0;
+    int nThreads = std::min<int>(ARCHIVE_UPLOAD_THREADS, entries.size());
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; t++) {
+        threads.emplace_back([&] {
+            while (true) {
+                size_t idx = nextEntry.fetch_add(1, std::memory_order_relaxed);
+                if (idx >= entries.size()) {
+                    break;
+                }
+
+                try {
+                    changed.at(idx) = uploadArchiveEntry(archive, entries[idx]);
+                } catch (std::exception& e) {
+                    errors.at(idx) = e.what();
+                }
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+
+    std::vector<faabric::Message> changedFuncs;
+    size_t nChanged = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        const ArchiveEntry& entry = entries.at(i);
+        if (!errors.at(i).empty()) {
+            throw std::runtime_error(fmt::format("Failed to upload {}/{}: {}",
+                                                 entry.type,
+                                                 entry.name,
+                                                 errors.at(i)));
+        }
+
+        if (!changed.at(i)) {
+            continue;
+        }
+
+        nChanged++;
+        if (entry.type == FUNCTION_URL_PART) {
+            changedFuncs.emplace_back(
+              faabric::util::messageFactory(entry.user, entry.name));
+        }
+    }
+
+    SPDLOG_INFO("Uploaded {} archive files, {} unchanged",
+                nChanged,
+                entries.size() - nChanged);
+
+    // When uploading a function, we always want to re-run the code
+    // generation so we set the clean flag to true
+    std::vector<codegen::CodegenResult> results =
+      codegen::codegenForFunctions(changedFuncs, true);
+    for (const auto& result : results) {
+        if (!result.success) {
+            throw std::runtime_error(fmt::format(
+              "Codegen failed for {}: {}", result.name, result.error));
+        }
+    }
+}
+
+void UploadServer::handleArchiveUpload(const http_request& request)
+{
+    faabric::Message body;
+    UploadServer::extractRequestBody(request, body);
+    auto archive = std::make_shared<std::vector<uint8_t>>(
+      faabric::util::stringToBytes(body.inputdata()));
+
+    // The archive's index is its manifest, so everything in it is checked
+    // before anything's uploaded
+    std::unordered_map<std::string, storage::SharedBundleEntry> files;
+    try {
+        files = storage::getSharedBundleEntries(*archive);
+    } catch (std::runtime_error& e) {
+        request.reply(status_codes::BadRequest, "Invalid archive\n");
+        return;
+    }
+
+    std::vector<ArchiveEntry> entries;
+    for (const auto& [path, data] : files) {
+        ArchiveEntry entry;
+        if (!parseArchivePath(path, entry)) {
+            request.reply(status_codes::BadRequest,
+                          fmt::format("Invalid archive path {}\n", path));
+            return;
+        }
+
+        entry.data = data;
+        entries.emplace_back(std::move(entry));
+    }
+
+    SPDLOG_INFO("Uploading archive of {} files", entries.size());
+
+    runUploadJob(
+      request,
+      fmt::format("archive of {} files", entries.size()),
+      [archive, entries = std::move(entries)]() {
+          uploadArchive(*archive, entries);
+      },
+      "Archive upload complete\n");
+}
+
 void UploadServer::handleFunctionUpload(const http_request& request,
                                         const std::string& user,
                                         const std::string& function)
@@ -324,18 +859,116 @@ void UploadServer::handleFunctionUpload(const http_request& request,
 
     SPDLOG_INFO("Uploading {}", faabric::util::funcToString(msg, false));
 
-    // Upload the WASM bytes using a file loader without cache to make sure we
-    // always use the latest-uploaded WASM. We also want to make sure we use
-    // the same file loader to generate the machine code
+    // Redeploys re-upload many unchanged functions, which would otherwise
+    // each be written and have their machine code generated again. Checking
+    // is cheap, so happens here rather than taking up a job
     storage::FileLoader& l = storage::getFileLoaderWithoutLocalCache();
-    l.uploadFunction(msg);
-
     codegen::MachineCodeGenerator& gen = codegen::getMachineCodeGenerator(l);
-    // When uploading a function, we always want to re-run the code generation
-    // so we set the clean flag to true
-    gen.codegenForFunction(msg, true);
+    if (gen.isFunctionUpToDate(
+          msg, faabric::util::stringToBytes(msg.inputdata()))) {
+        SPDLOG_INFO("Skipping upload of unchanged {}",
+                    faabric::util::funcToString(msg, false));
+        request.reply(status_codes::OK, "Function unchanged\n");
+        return;
+    }
+
+    std::string name = faabric::util::funcToString(msg, false);
+    runUploadJob(
+      request,
+      name,
+      [msg = std::move(msg)]() mutable {
+          // Upload the WASM bytes using a file loader without cache to make
+          // sure we always use the latest-uploaded WASM. We also want to make
+          // sure we use the same file loader to generate the machine code
+          storage::FileLoader& l = storage::getFileLoaderWithoutLocalCache();
+          l.uploadFunction(msg);
+
+          codegen::MachineCodeGenerator& gen =
+            codegen::getMachineCodeGenerator(l);
+          // When uploading a function, we always want to re-run the code
+          // generation so we set the clean flag to true
+          gen.codegenForFunction(msg, true);
+      },
+      "Function upload complete\n");
+}
+
+void UploadServer::handlePreloadUpload(const http_request& request,
+                                       const std::string& user,
+                                       const std::string& function)
+{
+    faabric::Message msg = faabric::util::messageFactory(user, function);
+    UploadServer::extractRequestBody(request, msg);
+
+    std::vector<std::string> preloads =
+      storage::FileLoader::parseFunctionPreloads(msg.inputdata());
+    SPDLOG_INFO("Uploading {} preloads for {}",
+                preloads.size(),
+                faabric::util::funcToString(msg, false));
+
+    storage::FileLoader& l = storage::getFileLoaderWithoutLocalCache();
+    l.uploadFunctionPreloads(msg, preloads);
+
+    request.reply(status_codes::OK, "Preloads uploaded\n");
+}
+
+void UploadServer::handleProfileUpload(const http_request& request,
+                                       const std::string& user,
+                                       const std::string& function)
+{
+    faabric::Message msg = faabric::util::messageFactory(user, function);
+    UploadServer::extractRequestBody(request, msg);
+
+    std::map<std::string, std::string> hints;
+    try {
+        hints = wasm::parseProfileHints(msg.inputdata());
+    } catch (std::runtime_error& e) {
+        request.reply(status_codes::BadRequest,
+                      fmt::format("Invalid profile: {}\n", e.what()));
+        return;
+    }
+
+    SPDLOG_INFO("Uploading {} profile settings for {}",
+                hints.size(),
+                faabric::util::funcToString(msg, false));
+
+    storage::FileLoader& l = storage::getFileLoaderWithoutLocalCache();
+    l.recordFunctionHints(msg, hints);
+
+    request.reply(status_codes::OK, "Profile uploaded\n");
+}
+
+void UploadServer::runUploadJob(const http_request& request,
+                                const std::string& name,
+                                std::function<void()> task,
+                                const std::string& completeMessage)
+{
+    UploadJobQueue& jobQueue = getUploadJobQueue();
+    int jobId = jobQueue.submit(name, std::move(task));
+    if (jobId < 0) {
+        request.reply(status_codes::ServiceUnavailable,
+                      "Too many uploads in progress, try again later\n");
+        return;
+    }
+
+    if (isAsyncRequest(request)) {
+        SPDLOG_INFO("Upload of {} running as job {}", name, jobId);
+
+        http_response response(status_codes::Accepted);
+        response.set_body(std::to_string(jobId));
+        setPermissiveHeaders(response);
+        request.reply(response);
+        return;
+    }
+
+    UploadJob job = jobQueue.awaitJob(jobId);
+    if (job.status == UploadJobStatus::Failed) {
+        std::string errorMsg =
+          fmt::format("Upload of {} failed: {}\n", name, job.error);
+        request.reply(status_codes::InternalError, errorMsg);
+        return;
+    }
 
-    request.reply(status_codes::OK, "Function upload complete\n");
+    request.reply(status_codes::OK, completeMessage);
 }
 
 void UploadServer::extractRequestBody(const http_request& req,
@@ -0,0 +1,116 @@
+#include <conf/FaasmConfig.h>
+#include <storage/FileLoader.h>
+#include <wamr/WAMRWasmModule.h>
+#include <wasm/page_store.h>
+
+#include <faabric/snapshot/SnapshotRegistry.h>
+#include <faabric/util/func.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+namespace wasm {
+WAMRModuleCache& getWAMRModuleCache()
+{
+    static WAMRModuleCache r;
+    return r;
+}
+
+size_t WAMRModuleCache::getTotalCachedModuleCount()
+{
+    faabric::util::SharedLock lock(mx);
+    return cachedModuleMap.size();
+}
+
+std::vector<WAMRCacheEntryStats> WAMRModuleCache::getEntryStats()
+{
+    faabric::util::SharedLock lock(mx);
+
+    std::vector<WAMRCacheEntryStats> stats;
+    for (const auto& [key, cached] : cachedModuleMap) {
+        stats.push_back({ cached.user, cached.function, cached.bytes.size() });
+    }
+
+    return stats;
+}
+
+WASMModuleCommon* WAMRModuleCache::getCachedModule(faabric::Message& msg)
+{
+    std::string key = faabric::util::funcToString(msg, false);
+
+    {
+        faabric::util::SharedLock lock(mx);
+        auto it = cachedModuleMap.find(key);
+        if (it != cachedModuleMap.end()) {
+            return it->second.module;
+        }
+    }
+
+    faabric::util::FullLock lock(mx);
+
+    // Re-check condition
+    auto it = cachedModuleMap.find(key);
+    if (it != cachedModuleMap.end()) {
+        return it->second.module;
+    }
+
+    SPDLOG_DEBUG("WAMR module cache initialising {}", key);
+
+    // Note that WAMR may keep references into the AOT bytes, so we keep them
+    // alongside the loaded module
+    CachedWAMRModule& cached = cachedModuleMap[key];
+    cached.user = msg.user();
+    cached.function = msg.function();
+    storage::FileLoader& functionLoader = storage::getFileLoader();
+    cached.bytes = functionLoader.loadFunctionWamrAotFile(msg);
+
+    try {
+        cached.module = WAMRWasmModule::loadWasmModule(cached.bytes);
+    } catch (std::runtime_error& ex) {
+        cachedModuleMap.erase(key);
+        throw;
+    }
+
+    return cached.module;
+}
+
+std::string WAMRModuleCache::registerResetSnapshot(wasm::WasmModule& module,
+                                                   faabric::Message& msg)
+{
+    std::string snapKey =
+      faabric::util::funcToString(msg, false) + "_wamr_reset";
+
+    faabric::snapshot::SnapshotRegistry& reg =
+      faabric::snapshot::getSnapshotRegistry();
+
+    bool paged = conf::getFaasmConfig().snapshotPageDedup == "on";
+    PageStore& pageStore = getPageStore();
+    auto exists = [&] {
+        return paged ? pageStore.snapshotExists(snapKey)
+                     : reg.snapshotExists(snapKey);
+    };
+
+    if (!exists()) {
+        faabric::util::FullLock lock(mx);
+        if (!exists()) {
+            if (paged) {
+                pageStore.registerSnapshot(snapKey, module.getMemoryView());
+            } else {
+                reg.registerSnapshot(snapKey, module.getSnapshotData());
+            }
+        }
+    }
+
+    return snapKey;
+}
+
+void WAMRModuleCache::clear()
+{
+    faabric::util::FullLock lock(mx);
+
+    for (auto& p : cachedModuleMap) {
+        WAMRWasmModule::unloadWasmModule(p.second.module);
+    }
+
+    cachedModuleMap.clear();
+}
+}
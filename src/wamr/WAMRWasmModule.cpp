@@ -1,15 +1,23 @@
+#include <conf/FaasmConfig.h>
+#include <faabric/snapshot/SnapshotRegistry.h>
 #include <faabric/util/files.h>
 #include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/string_tools.h>
 #include <storage/FileLoader.h>
+#include <threads/ThreadState.h>
 #include <wamr/WAMRWasmModule.h>
 #include <wamr/native.h>
 #include <wasm/WasmExecutionContext.h>
 #include <wasm/WasmModule.h>
+#include <wasm/function_profile.h>
+#include <wasm/openmp_profile.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <setjmp.h>
+#include <sstream>
 #include <stdexcept>
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,18 +33,69 @@
 namespace wasm {
 // The high level API for WAMR can be found here:
 // https://github.com/bytecodealliance/wasm-micro-runtime/blob/main/core/iwasm/include/wasm_export.h
-static bool wamrInitialised = false;
+static std::atomic<bool> wamrInitialised = false;
 
-// WAMR maintains some global state, which we must be careful not to modify
-// concurrently from our side. We are deliberately cautious with this locking,
-// so it may cause performance issues under high churn of short-lived functions.
-static std::mutex wamrGlobalsMutex;
+thread_local jmp_buf WAMRWasmModule::wamrExceptionJmpBuf;
+
+// WAMR maintains some global state (the runtime itself, native symbol
+// registrations and the list of loaded modules), which we must be careful not
+// to modify concurrently from our side. Operations that modify this state
+// (initialisation, loading and unloading modules) take this lock exclusively,
+// whereas operations that only touch a single module instance (instantiation
+// and deinstantiation) take it in shared mode, so they can run in parallel.
+static std::shared_mutex wamrGlobalsMutex;
+
+static std::atomic<uint64_t> wamrGlobalsLockCount = 0;
+static std::atomic<uint64_t> wamrGlobalsContendedCount = 0;
+
+template<class L>
+static L lockWAMRGlobals()
+{
+    wamrGlobalsLockCount.fetch_add(1, std::memory_order_relaxed);
+
+    L lock(wamrGlobalsMutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        wamrGlobalsContendedCount.fetch_add(1, std::memory_order_relaxed);
+        lock.lock();
+    }
+
+    return lock;
+}
+
+static faabric::util::FullLock lockWAMRGlobalsExclusive()
+{
+    return lockWAMRGlobals<faabric::util::FullLock>();
+}
+
+static faabric::util::SharedLock lockWAMRGlobalsShared()
+{
+    return lockWAMRGlobals<faabric::util::SharedLock>();
+}
+
+WAMRLockStats WAMRWasmModule::getGlobalsLockStats()
+{
+    return WAMRLockStats{
+        .acquired = wamrGlobalsLockCount.load(std::memory_order_relaxed),
+        .contended = wamrGlobalsContendedCount.load(std::memory_order_relaxed),
+    };
+}
+
+void WAMRWasmModule::resetGlobalsLockStats()
+{
+    wamrGlobalsLockCount.store(0, std::memory_order_relaxed);
+    wamrGlobalsContendedCount.store(0, std::memory_order_relaxed);
+}
 
 void WAMRWasmModule::initialiseWAMRGlobally()
 {
-    faabric::util::UniqueLock lock(wamrGlobalsMutex);
+    // Avoid taking the lock at all on the common path
+    if (wamrInitialised.load(std::memory_order_acquire)) {
+        return;
+    }
 
-    if (wamrInitialised) {
+    faabric::util::FullLock lock = lockWAMRGlobalsExclusive();
+
+    if (wamrInitialised.load(std::memory_order_acquire)) {
         return;
     }
 
@@ -50,6 +109,9 @@ void WAMRWasmModule::initialiseWAMRGlobally()
     initArgs.mem_alloc_option.allocator.realloc_func = (void*)::realloc;
     initArgs.mem_alloc_option.allocator.free_func = (void*)::free;
 
+    // Thread configuration
+    initArgs.max_thread_num = WAMR_MAX_THREAD_NUM;
+
     bool success = wasm_runtime_full_init(&initArgs);
     if (!success) {
         throw std::runtime_error("Failed to initialise WAMR");
@@ -63,7 +125,7 @@ void WAMRWasmModule::initialiseWAMRGlobally()
     // Set log level: BH_LOG_LEVEL_{FATAL,ERROR,WARNING,DEBUG,VERBOSE}
     bh_log_set_verbose_level(BH_LOG_LEVEL_WARNING);
 
-    wamrInitialised = true;
+    wamrInitialised.store(true, std::memory_order_release);
 }
 
 WAMRWasmModule::WAMRWasmModule()
@@ -82,10 +144,72 @@ WAMRWasmModule::~WAMRWasmModule()
     SPDLOG_TRACE(
       "Destructing WAMR wasm module {}/{}", boundUser, boundFunction);
 
-    faabric::util::UniqueLock lock(wamrGlobalsMutex);
+    destroyMainExecEnv();
+    destroyThreadExecEnvs();
+
+    if (moduleInstance != nullptr) {
+        faabric::util::SharedLock lock = lockWAMRGlobalsShared();
+        wasm_runtime_deinstantiate(moduleInstance);
+    }
+
+    if (ownsWasmModule) {
+        unloadWasmModule(wasmModule);
+    }
+}
+
+void WAMRWasmModule::clearCaches()
+{
+    getWAMRModuleCache().clear();
+}
+
+WASMModuleCommon* WAMRWasmModule::loadWasmModule(std::vector<uint8_t>& bytes)
+{
+    char loadErrorBuffer[ERROR_BUFFER_SIZE];
+
+    faabric::util::FullLock lock = lockWAMRGlobalsExclusive();
+    SPDLOG_TRACE("WAMR loading {} wasm bytes\n", bytes.size());
+    WASMModuleCommon* module = wasm_runtime_load(
+      bytes.data(), bytes.size(), loadErrorBuffer, ERROR_BUFFER_SIZE);
+
+    if (module == nullptr) {
+        std::string errorMsg = std::string(loadErrorBuffer);
+        SPDLOG_ERROR("Failed to load WAMR module: \n{}", errorMsg);
+        throw std::runtime_error("Failed to load WAMR module");
+    }
+
+    return module;
+}
+
+void WAMRWasmModule::unloadWasmModule(WASMModuleCommon* module)
+{
+    if (module == nullptr) {
+        return;
+    }
+
+    faabric::util::FullLock lock = lockWAMRGlobalsExclusive();
+    wasm_runtime_unload(module);
+}
+
+uint32_t getWamrStackSize(const faabric::Message& msg)
+{
+    uint32_t profileStackSize = getFunctionProfile(msg).wamrStackSize;
+    if (profileStackSize > 0) {
+        return profileStackSize;
+    }
+
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+    const std::string funcStr = faabric::util::funcToString(msg, false);
+
+    std::istringstream in(conf.wamrFunctionStackSizes);
+    std::string entry;
+    while (std::getline(in, entry, ',')) {
+        size_t equals = entry.find('=');
+        if (equals != std::string::npos && entry.substr(0, equals) == funcStr) {
+            return (uint32_t)std::stoul(entry.substr(equals + 1));
+        }
+    }
 
-    wasm_runtime_deinstantiate(moduleInstance);
-    wasm_runtime_unload(wasmModule);
+    return (uint32_t)conf.wamrStackSize;
 }
 
 WAMRWasmModule* getExecutingWAMRModule()
@@ -105,10 +229,43 @@ void WAMRWasmModule::reset(faabric::Message& msg,
     std::string funcStr = faabric::util::funcToString(msg, true);
     SPDLOG_DEBUG("WAMR resetting after {} (snap key {})", funcStr, snapshotKey);
 
-    wasm_runtime_deinstantiate(moduleInstance);
+    // If we have a reset snapshot we can restore the memory in place, rather
+    // than having to deinstantiate and instantiate the module again
+    if (!snapshotKey.empty() && !resetGlobalData.empty()) {
+        restoreFromResetSnapshot(snapshotKey);
+        return;
+    }
+
+    destroyMainExecEnv();
+    destroyThreadExecEnvs();
+
+    {
+        faabric::util::SharedLock lock = lockWAMRGlobalsShared();
+        wasm_runtime_deinstantiate(moduleInstance);
+        moduleInstance = nullptr;
+    }
+
     bindInternal(msg);
 }
 
+void WAMRWasmModule::restoreFromResetSnapshot(const std::string& snapshotKey)
+{
+    // Restore the filesystem
+    filesystem.prepareFilesystem();
+
+    // Restore the memory. The snapshot is from before any threads ran, so
+    // thread stacks are provisioned again if needed.
+    clearThreadStacks();
+    mapResetSnapshot(snapshotKey);
+    adviseHugePages(0, getCurrentBrk());
+
+    // Restore the globals (e.g. the stack pointer)
+    auto* aotModule = reinterpret_cast<AOTModuleInstance*>(moduleInstance);
+    std::copy(resetGlobalData.begin(),
+              resetGlobalData.end(),
+              (uint8_t*)aotModule->global_data);
+}
+
 void WAMRWasmModule::doBindToFunction(faabric::Message& msg, bool cache)
 {
     SPDLOG_TRACE("WAMR binding to {}/{} via message {}",
@@ -116,24 +273,25 @@ void WAMRWasmModule::doBindToFunction(faabric::Message& msg, bool cache)
                  msg.function(),
                  msg.id());
 
-    // Load the wasm file
-    storage::FileLoader& functionLoader = storage::getFileLoader();
-    wasmBytes = functionLoader.loadFunctionWamrAotFile(msg);
-
-    {
-        faabric::util::UniqueLock lock(wamrGlobalsMutex);
-        SPDLOG_TRACE("WAMR loading {} wasm bytes\n", wasmBytes.size());
-        wasmModule = wasm_runtime_load(
-          wasmBytes.data(), wasmBytes.size(), errorBuffer, ERROR_BUFFER_SIZE);
-
-        if (wasmModule == nullptr) {
-            std::string errorMsg = std::string(errorBuffer);
-            SPDLOG_ERROR("Failed to load WAMR module: \n{}", errorMsg);
-            throw std::runtime_error("Failed to load WAMR module");
-        }
+    if (cache) {
+        // Instantiate from the module shared by all instances of this function
+        wasmModule = getWAMRModuleCache().getCachedModule(msg);
+        ownsWasmModule = false;
+    } else {
+        // Load the wasm file
+        storage::FileLoader& functionLoader = storage::getFileLoader();
+        wasmBytes = functionLoader.loadFunctionWamrAotFile(msg);
+        wasmModule = loadWasmModule(wasmBytes);
+        ownsWasmModule = true;
     }
 
     bindInternal(msg);
+
+    // Keep a copy of the globals to restore on reset
+    auto* aotModule = reinterpret_cast<AOTModuleInstance*>(moduleInstance);
+    const auto* globalData = (const uint8_t*)aotModule->global_data;
+    resetGlobalData.assign(globalData,
+                           globalData + aotModule->global_data_size);
 }
 
 void WAMRWasmModule::bindInternal(faabric::Message& msg)
@@ -144,8 +302,18 @@ void WAMRWasmModule::bindInternal(faabric::Message& msg)
     // Instantiate module. Set the app-managed heap size to 0 to use
     // wasi-libc's managed heap. See:
     // https://bytecodealliance.github.io/wamr.dev/blog/understand-the-wamr-heap/
-    moduleInstance = wasm_runtime_instantiate(
-      wasmModule, STACK_SIZE_KB, 0, errorBuffer, ERROR_BUFFER_SIZE);
+    execEnvStackSize = getWamrStackSize(msg);
+    {
+        faabric::util::SharedLock lock = lockWAMRGlobalsShared();
+        moduleInstance = wasm_runtime_instantiate(
+          wasmModule, execEnvStackSize, 0, errorBuffer, ERROR_BUFFER_SIZE);
+    }
+
+    if (moduleInstance == nullptr) {
+        std::string errorMsg = std::string(errorBuffer);
+        SPDLOG_ERROR("Failed to instantiate WAMR module: \n{}", errorMsg);
+        throw std::runtime_error("Failed to instantiate WAMR module");
+    }
 
     // Sense-check the module
     auto* aotModule = reinterpret_cast<AOTModuleInstance*>(moduleInstance);
@@ -157,16 +325,12 @@ void WAMRWasmModule::bindInternal(faabric::Message& msg)
                      WASM_BYTES_PER_PAGE);
         throw std::runtime_error("WAMR module bytes per page wrong");
     }
-
-    if (moduleInstance == nullptr) {
-        std::string errorMsg = std::string(errorBuffer);
-        SPDLOG_ERROR("Failed to instantiate WAMR module: \n{}", errorMsg);
-        throw std::runtime_error("Failed to instantiate WAMR module");
-    }
     currentBrk.store(getMemorySizeBytes(), std::memory_order_release);
+    freeMemoryRegions.clear();
+    adviseHugePages(0, getMemorySizeBytes());
 
-    // Set up thread stacks
-    createThreadStacks();
+    // Thread stacks are only provisioned once threads run
+    clearThreadStacks();
 }
 
 int32_t WAMRWasmModule::executeFunction(faabric::Message& msg)
@@ -183,8 +347,9 @@ int32_t WAMRWasmModule::executeFunction(faabric::Message& msg)
     } else {
         prepareArgcArgv(msg);
 
-        // Run the main function
-        returnValue = executeWasmFunction(ENTRY_FUNC_NAME);
+        // Run the batch handler if there is one, otherwise the main function
+        returnValue = executeWasmFunction(
+          hasBatchHandler() ? BATCH_HANDLER_FUNC_NAME : ENTRY_FUNC_NAME);
     }
 
     // Record the return value
@@ -193,6 +358,17 @@ int32_t WAMRWasmModule::executeFunction(faabric::Message& msg)
     return returnValue;
 }
 
+bool WAMRWasmModule::hasBatchHandler()
+{
+    if (!_isBound) {
+        return false;
+    }
+
+    WASMFunctionInstanceCommon* func = wasm_runtime_lookup_function(
+      moduleInstance, BATCH_HANDLER_FUNC_NAME, nullptr);
+    return func != nullptr;
+}
+
 int WAMRWasmModule::executeWasmFunctionFromPointer(faabric::Message& msg)
 {
     // WASM function pointers are indices into the module's function table
@@ -313,6 +489,63 @@ bool WAMRWasmModule::executeCatchException(WASMFunctionInstanceCommon* func,
                                            int wasmFuncPtr,
                                            int argc,
                                            std::vector<uint32_t>& argv)
+{
+    WASMExecEnv* execEnv = getMainExecEnv();
+
+    // Set thread handle and stack boundary (required by WAMR). The executing
+    // thread can change between calls.
+    wasm_exec_env_set_thread_info(execEnv);
+
+    // Calls that fail or throw may leave the environment mid-call, so it's
+    // only kept after calls that return normally
+    bool success = false;
+    try {
+        success =
+          executeCatchException(execEnv, func, wasmFuncPtr, argc, argv);
+    } catch (...) {
+        destroyMainExecEnv();
+        wasm_runtime_set_exec_env_tls(nullptr);
+        throw;
+    }
+
+    if (!success) {
+        destroyMainExecEnv();
+    }
+    wasm_runtime_set_exec_env_tls(nullptr);
+
+    return success;
+}
+
+WASMExecEnv* WAMRWasmModule::getMainExecEnv()
+{
+    if (mainExecEnv == nullptr) {
+        mainExecEnv = wasm_exec_env_create(moduleInstance, execEnvStackSize);
+        if (mainExecEnv == nullptr) {
+            throw std::runtime_error("Error creating execution environment");
+        }
+    }
+
+    return mainExecEnv;
+}
+
+void WAMRWasmModule::destroyMainExecEnv()
+{
+    if (mainExecEnv != nullptr) {
+        wasm_runtime_destroy_exec_env(mainExecEnv);
+        mainExecEnv = nullptr;
+    }
+}
+
+uint32_t WAMRWasmModule::getExecEnvStackSize()
+{
+    return execEnvStackSize;
+}
+
+bool WAMRWasmModule::executeCatchException(WASMExecEnv* execEnv,
+                                           WASMFunctionInstanceCommon* func,
+                                           int wasmFuncPtr,
+                                           int argc,
+                                           std::vector<uint32_t>& argv)
 {
     bool isIndirect;
     if (wasmFuncPtr == NO_WASM_FUNC_PTR && func != nullptr) {
@@ -324,23 +557,6 @@ bool WAMRWasmModule::executeCatchException(WASMFunctionInstanceCommon* func,
           "Incorrect combination of arguments to execute WAMR function");
     }
 
-    auto execEnvDtor = [&](WASMExecEnv* execEnv) {
-        if (execEnv != nullptr) {
-            wasm_runtime_destroy_exec_env(execEnv);
-        }
-        wasm_runtime_set_exec_env_tls(nullptr);
-    };
-
-    // Create an execution environment
-    std::unique_ptr<WASMExecEnv, decltype(execEnvDtor)> execEnv(
-      wasm_exec_env_create(moduleInstance, STACK_SIZE_KB), execEnvDtor);
-    if (execEnv == nullptr) {
-        throw std::runtime_error("Error creating execution environment");
-    }
-
-    // Set thread handle and stack boundary (required by WAMR)
-    wasm_exec_env_set_thread_info(execEnv.get());
-
     bool success;
     {
         // This switch statement is used to catch exceptions thrown by native
@@ -351,10 +567,10 @@ bool WAMRWasmModule::executeCatchException(WASMFunctionInstanceCommon* func,
             case 0: {
                 if (isIndirect) {
                     success = wasm_runtime_call_indirect(
-                      execEnv.get(), wasmFuncPtr, argc, argv.data());
+                      execEnv, wasmFuncPtr, argc, argv.data());
                 } else {
-                    success = wasm_runtime_call_wasm(
-                      execEnv.get(), func, argc, argv.data());
+                    success =
+                      wasm_runtime_call_wasm(execEnv, func, argc, argv.data());
                 }
                 break;
             }
@@ -381,6 +597,170 @@ bool WAMRWasmModule::executeCatchException(WASMFunctionInstanceCommon* func,
     return success;
 }
 
+// -----
+// Threading
+// -----
+
+int32_t WAMRWasmModule::executeOMPThread(int threadPoolIdx,
+                                         uint32_t stackTop,
+                                         faabric::Message& msg)
+{
+    std::shared_ptr<threads::Level> ompLevel = threads::getCurrentOpenMPLevel();
+
+    // Set up the microtask arguments: the thread number, the number of shared
+    // variables and then the shared variables themselves
+    int argc = ompLevel->nSharedVarOffsets;
+    std::vector<uint32_t> argv = { (uint32_t)msg.appidx(), (uint32_t)argc };
+    for (int argIdx = 0; argIdx < argc; argIdx++) {
+        argv.emplace_back(ompLevel->sharedVarOffsets[argIdx]);
+    }
+
+    SPDLOG_TRACE("WAMR executing OpenMP thread {} ({} shared vars)",
+                 msg.appidx(),
+                 argc);
+
+    WASMExecEnv* execEnv = getThreadExecEnv(threadPoolIdx, stackTop);
+    bool success;
+    {
+        OpenMPProfileTimer regionTimer(OpenMPProfileEvent::Region,
+                                       OpenMPProfileEvent::Region);
+        success = executeCatchException(
+          execEnv, nullptr, msg.funcptr(), (int)argv.size(), argv);
+    }
+
+    if (!success) {
+        SPDLOG_ERROR(
+          "Error executing OpenMP thread {}: {}",
+          msg.appidx(),
+          wasm_runtime_get_exception(wasm_runtime_get_module_inst(execEnv)));
+        throw std::runtime_error("Error executing OpenMP thread with WAMR");
+    }
+
+    // Microtasks don't return anything
+    msg.set_returnvalue(0);
+    return 0;
+}
+
+int32_t WAMRWasmModule::executePthread(int threadPoolIdx,
+                                       uint32_t stackTop,
+                                       faabric::Message& msg)
+{
+    std::string funcStr = faabric::util::funcToString(msg, false);
+    SPDLOG_DEBUG("WAMR executing pthread {} for {}", threadPoolIdx, funcStr);
+
+    // The entrypoint takes the args pointer as its only argument, and WAMR
+    // writes the return value over it
+    uint32_t argsPtr = threads::getPthreadArgsPtr(msg);
+    std::vector<uint32_t> argv = { argsPtr };
+
+    WASMExecEnv* execEnv = getThreadExecEnv(threadPoolIdx, stackTop);
+    bool success = executeCatchException(
+      execEnv, nullptr, msg.funcptr(), (int)argv.size(), argv);
+
+    if (!success) {
+        SPDLOG_ERROR(
+          "Error executing pthread {}: {}",
+          threadPoolIdx,
+          wasm_runtime_get_exception(wasm_runtime_get_module_inst(execEnv)));
+        throw std::runtime_error("Error executing pthread with WAMR");
+    }
+
+    int32_t returnValue = (int32_t)argv[0];
+    msg.set_returnvalue(returnValue);
+
+    // Destructors of the thread's pthread keys run in its environment
+    runPthreadKeyDestructors([this, execEnv](int32_t func, int32_t value) {
+        std::vector<uint32_t> destructorArgv = { (uint32_t)value };
+        if (!executeCatchException(execEnv, nullptr, func, 1, destructorArgv)) {
+            SPDLOG_ERROR("Error executing pthread key destructor {}", func);
+            throw std::runtime_error("Error executing pthread key destructor");
+        }
+    });
+
+    return returnValue;
+}
+
+WASMExecEnv* WAMRWasmModule::getThreadExecEnv(int threadPoolIdx,
+                                              uint32_t stackTop)
+{
+    faabric::util::UniqueLock lock(threadExecEnvsMx);
+
+    if (threadsParentExecEnv == nullptr) {
+        threadsParentExecEnv =
+          wasm_exec_env_create(moduleInstance, execEnvStackSize);
+        if (threadsParentExecEnv == nullptr) {
+            SPDLOG_ERROR("Failed to create WAMR parent environment");
+            throw std::runtime_error("Error creating execution environment");
+        }
+
+        threadExecEnvs.assign(threadPoolSize, nullptr);
+        threadExecEnvStacks.assign(threadPoolSize, 0);
+    }
+
+    WASMExecEnv*& execEnv = threadExecEnvs.at(threadPoolIdx);
+    if (execEnv == nullptr) {
+        faabric::util::SharedLock globalsLock = lockWAMRGlobalsShared();
+        execEnv = wasm_runtime_spawn_exec_env(threadsParentExecEnv);
+        if (execEnv == nullptr) {
+            SPDLOG_ERROR("Failed to spawn WAMR environment for thread {}",
+                         threadPoolIdx);
+            throw std::runtime_error("Error spawning execution environment");
+        }
+    }
+
+    // Use the stack we've set aside for this thread in linear memory. Stacks
+    // are provisioned again after restores, so may have moved since.
+    uint32_t& envStackTop = threadExecEnvStacks.at(threadPoolIdx);
+    if (envStackTop != stackTop) {
+        if (!wasm_exec_env_set_aux_stack(
+              execEnv, stackTop, THREAD_STACK_SIZE - 16)) {
+            SPDLOG_ERROR("Failed to set WAMR stack for thread {}",
+                         threadPoolIdx);
+            throw std::runtime_error("Error setting thread stack");
+        }
+        envStackTop = stackTop;
+    }
+
+    // The executing thread can change between calls
+    wasm_exec_env_set_thread_info(execEnv);
+
+    return execEnv;
+}
+
+void WAMRWasmModule::destroyThreadExecEnvs()
+{
+    faabric::util::UniqueLock lock(threadExecEnvsMx);
+
+    for (WASMExecEnv* execEnv : threadExecEnvs) {
+        if (execEnv != nullptr) {
+            wasm_runtime_destroy_spawned_exec_env(execEnv);
+        }
+    }
+    threadExecEnvs.clear();
+    threadExecEnvStacks.clear();
+
+    if (threadsParentExecEnv != nullptr) {
+        wasm_runtime_destroy_exec_env(threadsParentExecEnv);
+        threadsParentExecEnv = nullptr;
+    }
+}
+
+// -----
+// Execution deadlines
+// -----
+
+void WAMRWasmModule::doInterruptExecution()
+{
+    wasm_runtime_terminate(moduleInstance);
+}
+
+void WAMRWasmModule::doRecoverFromInterrupt()
+{
+    // Resetting from a snapshot keeps the instance, which would otherwise
+    // still be marked as terminated
+    wasm_runtime_clear_exception(moduleInstance);
+}
+
 // -----
 // Exception handling
 // -----
@@ -423,7 +803,7 @@ void WAMRWasmModule::writeWasmEnvToWamrMemory(uint32_t* envOffsetsWasm,
                                               char* envBuffWasm)
 {
     writeStringArrayToMemory(
-      wasmEnvironment.getVars(), envOffsetsWasm, envBuffWasm);
+      wasmEnvironment.getVarsArray(), envOffsetsWasm, envBuffWasm);
 }
 
 void WAMRWasmModule::validateWasmOffset(uint32_t wasmOffset, size_t size)
@@ -468,6 +848,26 @@ uint8_t* WAMRWasmModule::getMemoryBase()
     return reinterpret_cast<uint8_t*>(aotMem->memory_data);
 }
 
+ModuleMemoryUsage WAMRWasmModule::getMemoryUsage()
+{
+    ModuleMemoryUsage usage = WasmModule::getMemoryUsage();
+
+    size_t nExecEnvs = mainExecEnv != nullptr ? 1 : 0;
+    {
+        faabric::util::UniqueLock lock(threadExecEnvsMx);
+        if (threadsParentExecEnv != nullptr) {
+            nExecEnvs++;
+        }
+
+        nExecEnvs += std::count_if(threadExecEnvs.begin(),
+                                   threadExecEnvs.end(),
+                                   [](WASMExecEnv* e) { return e != nullptr; });
+    }
+    usage.hostBufferBytes += nExecEnvs * execEnvStackSize;
+
+    return usage;
+}
+
 size_t WAMRWasmModule::getMaxMemoryPages()
 {
     auto* aotModule = reinterpret_cast<AOTModuleInstance*>(moduleInstance);
@@ -484,14 +884,14 @@ WASMModuleInstanceCommon* WAMRWasmModule::getModuleInstance()
     return moduleInstance;
 }
 
-std::vector<std::string> WAMRWasmModule::getArgv()
+WASMModuleCommon* WAMRWasmModule::getWasmModule()
 {
-    return argv;
+    return wasmModule;
 }
 
-uint32_t WAMRWasmModule::mmapFile(uint32_t fp, size_t length)
+std::vector<std::string> WAMRWasmModule::getArgv()
 {
-    // TODO - implement
-    return 0;
+    return argv;
 }
+
 }
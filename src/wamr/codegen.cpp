@@ -2,14 +2,22 @@
 #include <faabric/util/logging.h>
 #include <wamr/WAMRWasmModule.h>
 
-#include <boost/filesystem.hpp>
-#include <boost/filesystem/operations.hpp>
+#include <memory>
 #include <stdexcept>
 #include <type_traits>
 
 #include <aot_export.h>
 #include <wasm_export.h>
 
+// WAMR can emit the AOT image to a buffer, but does not expose this in
+// aot_export.h. The returned buffer must be freed with wasm_runtime_free
+extern "C"
+{
+    uint8_t* aot_emit_aot_file_buf(aot_comp_context_t compContext,
+                                   aot_comp_data_t compData,
+                                   uint32_t* aotFileSize);
+}
+
 namespace wasm {
 std::vector<uint8_t> wamrCodegen(std::vector<uint8_t>& wasmBytesIn, bool isSgx)
 {
@@ -68,10 +76,15 @@ std::vector<uint8_t> wamrCodegen(std::vector<uint8_t>& wasmBytesIn, bool isSgx)
     // Switching this flag between 0 and 1 can make some WAMR generated code
     // seg-fault unexpectedly, so modify with care
     option.bounds_checks = 0;
+    // Bulk memory needs WAMR_BUILD_BULK_MEMORY in the runtime, which breaks
+    // our brk memory management (see src/wamr/CMakeLists.txt)
     option.enable_bulk_memory = false;
     option.enable_ref_types = true;
     option.is_jit_mode = false;
     option.enable_simd = true;
+    // Checks for termination in loops and calls, so calls can be stopped at
+    // their execution deadline
+    option.enable_thread_mgr = true;
 
     if (isSgx) {
         option.size_level = 1;
@@ -99,23 +112,21 @@ std::vector<uint8_t> wamrCodegen(std::vector<uint8_t>& wasmBytesIn, bool isSgx)
 
     SPDLOG_TRACE("WAMR codegen successfully compiled wasm");
 
-    // TODO - avoid using a temp file here
-    // WAMR doesn't let us generate an array of bytes, so we have to write to a
-    // temp file, then load the bytes again
-    boost::filesystem::path temp = boost::filesystem::unique_path();
-    bool aotSuccess =
-      aot_emit_aot_file(compileContext.get(), compileData.get(), temp.c_str());
-    if (!aotSuccess) {
-        SPDLOG_ERROR("Failed to write AOT file to {}", temp.string());
+    // Emit the AOT image straight into memory
+    uint32_t aotFileSize = 0;
+    std::unique_ptr<uint8_t, decltype(&wasm_runtime_free)> aotBuffer(
+      aot_emit_aot_file_buf(
+        compileContext.get(), compileData.get(), &aotFileSize),
+      &wasm_runtime_free);
+    if (aotBuffer == nullptr) {
+        SPDLOG_ERROR("Failed to emit AOT file: {}", aot_get_last_error());
         throw std::runtime_error("Failed to emit AOT file");
     }
 
-    // Read object bytes back in
-    std::vector<uint8_t> objBytes =
-      faabric::util::readFileToBytes(temp.c_str());
+    SPDLOG_TRACE("WAMR codegen emitted {} bytes of AOT code", aotFileSize);
 
-    // Delete the file
-    boost::filesystem::remove(temp.c_str());
+    std::vector<uint8_t> objBytes(aotBuffer.get(),
+                                  aotBuffer.get() + aotFileSize);
 
     return objBytes;
 }
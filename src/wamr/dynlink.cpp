@@ -1,5 +1,6 @@
 #include <stdexcept>
 #include <wamr/native.h>
+#include <wasm/call_metrics.h>
 #include <wasm_export.h>
 
 namespace wasm {
@@ -9,6 +10,7 @@ static int32_t dlopen_wrapper(wasm_exec_env_t exec_env,
                               char* filename,
                               int32_t flags)
 {
+    HOST_CALL(Other);
     throw std::runtime_error("Native dlopen not implemented");
 }
 
@@ -16,11 +18,13 @@ static int32_t dlsym_wrapper(wasm_exec_env_t exec_env,
                              void* handle,
                              char* symbol)
 {
+    HOST_CALL(Other);
     throw std::runtime_error("Native dlsym not implemented");
 }
 
 static int32_t dlclose_wrapper(wasm_exec_env_t exec_env, void* handle)
 {
+    HOST_CALL(Other);
     throw std::runtime_error("Native dlclose not implemented");
 }
 
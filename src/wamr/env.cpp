@@ -2,6 +2,7 @@
 #include <storage/FileDescriptor.h>
 #include <wamr/WAMRWasmModule.h>
 #include <wamr/native.h>
+#include <wasm/call_metrics.h>
 
 #include <stdexcept>
 #include <sys/random.h>
@@ -12,6 +13,7 @@
 namespace wasm {
 static int32_t getrlimit_wrapper(wasm_exec_env_t exec_env, int32_t a, int32_t b)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - getrlimit");
     // We ignore calls to getrlimit, this may break some functionalities
     return 0;
@@ -32,6 +34,7 @@ uint32_t wasi_args_get(wasm_exec_env_t exec_env,
                        uint32_t* argvOffsetsWasm,
                        char* argvBuffWasm)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - args_get");
 
     WAMRWasmModule* module = getExecutingWAMRModule();
@@ -44,6 +47,7 @@ uint32_t wasi_args_sizes_get(wasm_exec_env_t exec_env,
                              uint32_t* argcWasm,
                              uint32_t* argvBuffSizeWasm)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - args_sizes_get");
 
     WAMRWasmModule* module = getExecutingWAMRModule();
@@ -61,6 +65,7 @@ uint32_t wasi_environ_get(wasm_exec_env_t exec_env,
                           uint32_t* envOffsetsWasm,
                           char* envBuffWasm)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - environ_get");
 
     WAMRWasmModule* module = getExecutingWAMRModule();
@@ -73,6 +78,7 @@ uint32_t wasi_environ_sizes_get(wasm_exec_env_t exec_env,
                                 int32_t* envCountWasm,
                                 int32_t* envBufferSizeWasm)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - environ_sizes_get");
 
     WAMRWasmModule* module = getExecutingWAMRModule();
@@ -89,6 +95,7 @@ uint32_t wasi_environ_sizes_get(wasm_exec_env_t exec_env,
 
 void wasi_proc_exit(wasm_exec_env_t execEnv, int32_t retCode)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - proc_exit {}", retCode);
     auto* moduleInstance = getExecutingWAMRModule()->getModuleInstance();
     WASIContext* wasiCtx = wasm_runtime_get_wasi_ctx(moduleInstance);
@@ -100,6 +107,7 @@ static uint32_t wasi_random_get(wasm_exec_env_t exec_env,
                                 void* buf,
                                 uint32_t bufLen)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - random_get");
 
     getrandom(buf, bufLen, 0);
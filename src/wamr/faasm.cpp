@@ -7,10 +7,22 @@
 #include <wamr/native.h>
 #include <wasm/WasmExecutionContext.h>
 #include <wasm/WasmModule.h>
+#include <wasm/call_metrics.h>
 #include <wasm/chaining.h>
+#include <wasm/chaining_dag.h>
+#include <wasm/checkpoint.h>
+#include <wasm/deadline.h>
 #include <wasm/host_interface_test.h>
+#include <wasm/http.h>
+#include <wasm/ipc.h>
 #include <wasm/migration.h>
+#include <wasm/resolver.h>
+#include <wasm/state_async.h>
+#include <wasm/state_batch.h>
+#include <wasm/state_metrics.h>
+#include <wasm/timing.h>
 
+#include <algorithm>
 #include <wasm_export.h>
 
 using namespace faabric::scheduler;
@@ -39,12 +51,99 @@ static std::shared_ptr<faabric::state::StateKeyValue> getStateKV(
 static int32_t __faasm_await_call_wrapper(wasm_exec_env_t exec_env,
                                           int32_t callId)
 {
+    HOST_CALL(Chaining);
     SPDLOG_DEBUG("S - faasm_await_call {}", callId);
 
     int32_t result = wasm::awaitChainedCall((uint32_t)callId);
     return result;
 }
 
+/**
+ * Await a number of chained functions, writing each one's return value to the
+ * results array and returning how many didn't return zero
+ */
+static int32_t __faasm_await_all_wrapper(wasm_exec_env_t execEnv,
+                                         int32_t* callIdsPtr,
+                                         int32_t nCalls,
+                                         int32_t* resultsPtr)
+{
+    HOST_CALL(Chaining);
+    SPDLOG_DEBUG("S - faasm_await_all {}", nCalls);
+
+    if (nCalls < 0) {
+        SPDLOG_ERROR("Invalid number of calls to await {}", nCalls);
+        throw std::runtime_error("Invalid number of calls to await");
+    }
+
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    module->validateNativePointer(callIdsPtr, nCalls * sizeof(int32_t));
+    module->validateNativePointer(resultsPtr, nCalls * sizeof(int32_t));
+
+    std::vector<unsigned int> callIds(callIdsPtr, callIdsPtr + nCalls);
+    std::vector<int> results;
+    int32_t nFailed = wasm::awaitChainedCalls(callIds, results);
+    std::copy(results.begin(), results.end(), resultsPtr);
+
+    return nFailed;
+}
+
+/**
+ * Await a chained function's completion, putting its output in new memory and
+ * writing where it is and how long it is
+ */
+static int32_t __faasm_await_call_output_mapped_wrapper(
+  wasm_exec_env_t execEnv,
+  int32_t callId,
+  int32_t* outputPtrPtr,
+  int32_t* outputLenPtr)
+{
+    HOST_CALL(Chaining);
+    SPDLOG_DEBUG("S - faasm_await_call_output_mapped {}", callId);
+
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    module->validateNativePointer(outputPtrPtr, sizeof(int32_t));
+    module->validateNativePointer(outputLenPtr, sizeof(int32_t));
+
+    uint32_t outputPtr = 0;
+    uint32_t outputLen = 0;
+    int32_t returnValue =
+      wasm::awaitChainedCallOutputMapped(callId, &outputPtr, &outputLen);
+    *outputPtrPtr = outputPtr;
+    *outputLenPtr = outputLen;
+
+    return returnValue;
+}
+
+static void __faasm_await_state_wrapper(wasm_exec_env_t execEnv,
+                                       int32_t handle)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - await_state - {}", handle);
+
+    awaitStateOperation(handle);
+}
+
+// The vectored state calls take an array of pointers to the keys
+static std::vector<std::string> getStateKeys(int32_t* keysPtr, int32_t nKeys)
+{
+    if (nKeys < 0) {
+        SPDLOG_ERROR("Invalid number of state keys {}", nKeys);
+        throw std::runtime_error("Invalid number of state keys");
+    }
+
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    module->validateNativePointer(keysPtr, nKeys * sizeof(int32_t));
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < nKeys; i++) {
+        module->validateWasmOffset(keysPtr[i], sizeof(char));
+        keys.emplace_back(reinterpret_cast<char*>(
+          module->wasmOffsetToNativePointer(keysPtr[i])));
+    }
+
+    return keys;
+}
+
 /**
  * Chain a function by name
  */
@@ -53,6 +152,7 @@ static int32_t __faasm_chain_name_wrapper(wasm_exec_env_t execEnv,
                                           const uint8_t* input,
                                           uint32_t inputSize)
 {
+    HOST_CALL(Chaining);
     std::vector<uint8_t> _input(input, input + inputSize);
     SPDLOG_DEBUG("S - chain_name - {}", std::string(name));
     return wasm::makeChainedCall(std::string(name), 0, nullptr, _input);
@@ -66,6 +166,7 @@ static int32_t __faasm_chain_ptr_wrapper(wasm_exec_env_t exec_env,
                                          char* inBuff,
                                          int32_t inLen)
 {
+    HOST_CALL(Chaining);
     SPDLOG_DEBUG("S - faasm_chain_ptr {} {} {}", wasmFuncPtr, inBuff, inLen);
 
     faabric::Message& call = ExecutorContext::get()->getMsg();
@@ -73,12 +174,247 @@ static int32_t __faasm_chain_ptr_wrapper(wasm_exec_env_t exec_env,
     return makeChainedCall(call.function(), wasmFuncPtr, nullptr, inputData);
 }
 
+/**
+ * Chain a function by name, sending it to where the given state keys are
+ */
+static int32_t __faasm_chain_name_affinity_wrapper(wasm_exec_env_t execEnv,
+                                                   const char* name,
+                                                   const uint8_t* input,
+                                                   uint32_t inputSize,
+                                                   int32_t* keysPtr,
+                                                   int32_t nKeys)
+{
+    HOST_CALL(Chaining);
+    SPDLOG_DEBUG("S - chain_name_affinity - {} {}", std::string(name), nKeys);
+
+    std::vector<uint8_t> _input(input, input + inputSize);
+    std::vector<std::string> keys = getStateKeys(keysPtr, nKeys);
+    return makeChainedCall(std::string(name), 0, nullptr, _input, keys);
+}
+
+/**
+ * Chain a function by function pointer, sending it to where the given state
+ * keys are
+ */
+static int32_t __faasm_chain_ptr_affinity_wrapper(wasm_exec_env_t exec_env,
+                                                  int32_t wasmFuncPtr,
+                                                  char* inBuff,
+                                                  int32_t inLen,
+                                                  int32_t* keysPtr,
+                                                  int32_t nKeys)
+{
+    HOST_CALL(Chaining);
+    SPDLOG_DEBUG(
+      "S - faasm_chain_ptr_affinity {} {} {}", wasmFuncPtr, inLen, nKeys);
+
+    faabric::Message& call = ExecutorContext::get()->getMsg();
+    std::vector<uint8_t> inputData(BYTES(inBuff), BYTES(inBuff) + inLen);
+    std::vector<std::string> keys = getStateKeys(keysPtr, nKeys);
+    return makeChainedCall(
+      call.function(), wasmFuncPtr, nullptr, inputData, keys);
+}
+
+/**
+ * Chain a function by name, with a range of a state value as its input
+ */
+static int32_t __faasm_chain_name_state_wrapper(wasm_exec_env_t execEnv,
+                                                const char* name,
+                                                const char* key,
+                                                int32_t offset,
+                                                int32_t length)
+{
+    HOST_CALL(Chaining);
+    SPDLOG_DEBUG("S - chain_name_state - {} {} {} {}",
+                 std::string(name),
+                 std::string(key),
+                 offset,
+                 length);
+
+    if (offset < 0 || length < 0) {
+        throw std::runtime_error("Invalid chained call state input");
+    }
+
+    return makeChainedCallWithStateInput(
+      std::string(name), 0, std::string(key), offset, length);
+}
+
+/**
+ * Chain a function by function pointer, with a range of a state value as its
+ * input
+ */
+static int32_t __faasm_chain_ptr_state_wrapper(wasm_exec_env_t execEnv,
+                                               int32_t wasmFuncPtr,
+                                               const char* key,
+                                               int32_t offset,
+                                               int32_t length)
+{
+    HOST_CALL(Chaining);
+    SPDLOG_DEBUG("S - chain_ptr_state - {} {} {} {}",
+                 wasmFuncPtr,
+                 std::string(key),
+                 offset,
+                 length);
+
+    if (offset < 0 || length < 0) {
+        throw std::runtime_error("Invalid chained call state input");
+    }
+
+    faabric::Message& call = ExecutorContext::get()->getMsg();
+    return makeChainedCallWithStateInput(
+      call.function(), wasmFuncPtr, std::string(key), offset, length);
+}
+
+// The batch variants chain one call per input, taking arrays of pointers to
+// the inputs and their lengths, and write the call IDs to another array
+static std::vector<std::vector<uint8_t>> getChainInputs(int32_t* inputsPtr,
+                                                        int32_t* lensPtr,
+                                                        int32_t nInputs)
+{
+    if (nInputs < 0) {
+        SPDLOG_ERROR("Invalid number of chained call inputs {}", nInputs);
+        throw std::runtime_error("Invalid number of chained call inputs");
+    }
+
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    module->validateNativePointer(inputsPtr, nInputs * sizeof(int32_t));
+    module->validateNativePointer(lensPtr, nInputs * sizeof(int32_t));
+
+    std::vector<std::vector<uint8_t>> inputs;
+    for (int i = 0; i < nInputs; i++) {
+        module->validateWasmOffset(inputsPtr[i], lensPtr[i]);
+        auto* input = BYTES(module->wasmOffsetToNativePointer(inputsPtr[i]));
+        inputs.emplace_back(input, input + lensPtr[i]);
+    }
+
+    return inputs;
+}
+
+static int32_t writeCallIds(const std::vector<int>& callIds,
+                            int32_t* callIdsPtr)
+{
+    getExecutingWAMRModule()->validateNativePointer(
+      callIdsPtr, callIds.size() * sizeof(int32_t));
+    std::copy(callIds.begin(), callIds.end(), callIdsPtr);
+
+    return callIds.size();
+}
+
+/**
+ * Chain one call to a function by name per input, returning the number of
+ * calls chained
+ */
+static int32_t __faasm_chain_name_batch_wrapper(wasm_exec_env_t execEnv,
+                                                const char* name,
+                                                int32_t* inputsPtr,
+                                                int32_t* lensPtr,
+                                                int32_t nInputs,
+                                                int32_t* callIdsPtr)
+{
+    HOST_CALL(Chaining);
+    SPDLOG_DEBUG("S - chain_name_batch - {} {}", std::string(name), nInputs);
+
+    std::vector<std::vector<uint8_t>> inputs =
+      getChainInputs(inputsPtr, lensPtr, nInputs);
+    std::vector<int> callIds =
+      makeChainedCalls(std::string(name), 0, nullptr, inputs);
+
+    return writeCallIds(callIds, callIdsPtr);
+}
+
+/**
+ * Chain one call to a function pointer per input, returning the number of
+ * calls chained
+ */
+static int32_t __faasm_chain_ptr_batch_wrapper(wasm_exec_env_t execEnv,
+                                               int32_t wasmFuncPtr,
+                                               int32_t* inputsPtr,
+                                               int32_t* lensPtr,
+                                               int32_t nInputs,
+                                               int32_t* callIdsPtr)
+{
+    HOST_CALL(Chaining);
+    SPDLOG_DEBUG("S - chain_ptr_batch - {} {}", wasmFuncPtr, nInputs);
+
+    faabric::Message& call = ExecutorContext::get()->getMsg();
+    std::vector<std::vector<uint8_t>> inputs =
+      getChainInputs(inputsPtr, lensPtr, nInputs);
+    std::vector<int> callIds =
+      makeChainedCalls(call.function(), wasmFuncPtr, nullptr, inputs);
+
+    return writeCallIds(callIds, callIdsPtr);
+}
+
+/**
+ * Chain a graph of calls, taking arrays of pointers to the nodes' function
+ * names, their inputs and lengths, and an array of pairs of node indices for
+ * the edges. Returns the number of calls chained, or -1 if the graph isn't
+ * valid.
+ */
+static int32_t __faasm_chain_dag_wrapper(wasm_exec_env_t execEnv,
+                                         int32_t* namesPtr,
+                                         int32_t* inputsPtr,
+                                         int32_t* lensPtr,
+                                         int32_t nNodes,
+                                         int32_t* edgesPtr,
+                                         int32_t nEdges,
+                                         int32_t* callIdsPtr)
+{
+    HOST_CALL(Chaining);
+    SPDLOG_DEBUG("S - chain_dag - {} {}", nNodes, nEdges);
+
+    if (nEdges < 0) {
+        SPDLOG_ERROR("Invalid number of chained call graph edges {}", nEdges);
+        return -1;
+    }
+
+    std::vector<std::vector<uint8_t>> inputs =
+      getChainInputs(inputsPtr, lensPtr, nNodes);
+
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    module->validateNativePointer(namesPtr, nNodes * sizeof(int32_t));
+    module->validateNativePointer(edgesPtr, 2 * nEdges * sizeof(int32_t));
+
+    std::vector<ChainedDagNode> nodes;
+    for (int i = 0; i < nNodes; i++) {
+        module->validateWasmOffset(namesPtr[i], sizeof(char));
+        std::string name = reinterpret_cast<char*>(
+          module->wasmOffsetToNativePointer(namesPtr[i]));
+        nodes.push_back({ name, inputs.at(i) });
+    }
+
+    std::vector<ChainedDagEdge> edges;
+    for (int i = 0; i < nEdges; i++) {
+        edges.emplace_back(edgesPtr[2 * i], edgesPtr[2 * i + 1]);
+    }
+
+    std::vector<int> callIds;
+    try {
+        callIds = makeChainedDag(nodes, edges);
+    } catch (std::runtime_error& e) {
+        SPDLOG_ERROR("Failed to chain call graph: {}", e.what());
+        return -1;
+    }
+
+    return writeCallIds(callIds, callIdsPtr);
+}
+
+static void __faasm_checkpoint_wrapper(wasm_exec_env_t execEnv,
+                                       int32_t wasmFuncPtr,
+                                       std::string funcArg)
+{
+    HOST_CALL(Process);
+    SPDLOG_DEBUG("S - faasm_checkpoint {} {}", wasmFuncPtr, funcArg);
+
+    wasm::doCheckpoint(wasmFuncPtr, funcArg);
+}
+
 /*
  * Single entry-point for testing the host interface behaviour
  */
 static void __faasm_host_interface_test_wrapper(wasm_exec_env_t execEnv,
                                                 int32_t testNum)
 {
+    HOST_CALL(Other);
     wasm::doHostInterfaceTest(testNum);
 }
 
@@ -86,6 +422,7 @@ static void __faasm_migrate_point_wrapper(wasm_exec_env_t execEnv,
                                           int32_t wasmFuncPtr,
                                           std::string funcArg)
 {
+    HOST_CALL(Process);
     SPDLOG_DEBUG("S - faasm_migrate_point {} {}", wasmFuncPtr, funcArg);
 
     wasm::doMigrationPoint(wasmFuncPtr, funcArg);
@@ -95,17 +432,166 @@ static void __faasm_pull_state_wrapper(wasm_exec_env_t execEnv,
                                        int32_t* keyPtr,
                                        int32_t stateLen)
 {
+    HOST_CALL(State);
     auto kv = getStateKV(keyPtr, stateLen);
     SPDLOG_DEBUG("S - pull_state - {} {}", kv->key, stateLen);
 
     kv->pull();
+    recordStatePull(kv->size());
+}
+
+// Returns 1 if the operation has finished, and 0 if not
+static int32_t __faasm_poll_state_wrapper(wasm_exec_env_t execEnv,
+                                          int32_t handle)
+{
+    HOST_CALL(State);
+    SPDLOG_TRACE("S - poll_state - {}", handle);
+
+    return pollStateOperation(handle) ? 1 : 0;
+}
+
+/**
+ * Starts pulling the value in the background, returning a handle to wait on
+ * or poll (see state_async.h)
+ */
+static int32_t __faasm_pull_state_async_wrapper(wasm_exec_env_t execEnv,
+                                                int32_t* keyPtr,
+                                                int32_t stateLen)
+{
+    HOST_CALL(State);
+    auto kv = getStateKV(keyPtr, stateLen);
+    recordStatePull(kv->size());
+    int handle = startStateOperation([kv] { kv->pull(); });
+    SPDLOG_DEBUG("S - pull_state_async - {} {} {}", kv->key, stateLen, handle);
+
+    return handle;
+}
+
+static void __faasm_pull_state_multi_wrapper(wasm_exec_env_t execEnv,
+                                             int32_t* keysPtr,
+                                             int32_t nKeys,
+                                             int32_t* stateLensPtr)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - pull_state_multi - {}", nKeys);
+
+    std::vector<std::string> keys = getStateKeys(keysPtr, nKeys);
+    getExecutingWAMRModule()->validateNativePointer(stateLensPtr,
+                                                    nKeys * sizeof(int32_t));
+    std::vector<size_t> lens(stateLensPtr, stateLensPtr + nKeys);
+    auto kvs = getStateKVs(keys, lens);
+
+    runStateBatch(kvs.size(), [&kvs](size_t i) { kvs.at(i)->pull(); });
+    for (const auto& kv : kvs) {
+        recordStatePull(kv->size());
+    }
 }
 
 static void __faasm_push_state_wrapper(wasm_exec_env_t execEnv, int32_t* keyPtr)
 {
+    HOST_CALL(State);
     auto kv = getStateKV(keyPtr, 0);
     SPDLOG_DEBUG("S - push_state - {}", kv->key);
     kv->pushFull();
+    recordStatePush(kv->size());
+}
+
+static int32_t __faasm_push_state_async_wrapper(wasm_exec_env_t execEnv,
+                                                int32_t* keyPtr)
+{
+    HOST_CALL(State);
+    auto kv = getStateKV(keyPtr, 0);
+    recordStatePush(kv->size());
+    int handle = startStateOperation([kv] { kv->pushFull(); });
+    SPDLOG_DEBUG("S - push_state_async - {} {}", kv->key, handle);
+
+    return handle;
+}
+
+static void __faasm_push_state_multi_wrapper(wasm_exec_env_t execEnv,
+                                             int32_t* keysPtr,
+                                             int32_t nKeys)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - push_state_multi - {}", nKeys);
+
+    std::vector<std::string> keys = getStateKeys(keysPtr, nKeys);
+    auto kvs = getStateKVs(keys, std::vector<size_t>(keys.size(), 0));
+
+    runStateBatch(kvs.size(), [&kvs](size_t i) { kvs.at(i)->pushFull(); });
+    for (const auto& kv : kvs) {
+        recordStatePush(kv->size());
+    }
+}
+
+static int64_t __faasm_timer_nanos_wrapper(wasm_exec_env_t execEnv)
+{
+    HOST_CALL(Other);
+    return (int64_t)wasm::getTimerNanos();
+}
+
+static int64_t __faasm_remaining_time_ms_wrapper(wasm_exec_env_t execEnv)
+{
+    HOST_CALL(Other);
+    return wasm::getRemainingTimeMs();
+}
+
+static int32_t __faasm_http_request_wrapper(wasm_exec_env_t execEnv,
+                                            char* method,
+                                            char* url,
+                                            char* headers,
+                                            uint8_t* body,
+                                            int32_t bodyLen,
+                                            uint8_t* response,
+                                            int32_t responseLen,
+                                            int32_t* status)
+{
+    HOST_CALL(Network);
+    return wasm::doHostHttpRequest(
+      method, url, headers, body, bodyLen, response, responseLen, status);
+}
+
+static int32_t __faasm_resolve_host_wrapper(wasm_exec_env_t execEnv,
+                                            char* host,
+                                            int32_t family,
+                                            uint8_t* buffer,
+                                            int32_t bufferLen)
+{
+    HOST_CALL(Network);
+    return wasm::doHostResolveHost(host, family, buffer, bufferLen);
+}
+
+static int32_t __faasm_channel_open_wrapper(wasm_exec_env_t execEnv,
+                                            char* name,
+                                            int32_t write)
+{
+    HOST_CALL(Chaining);
+    return wasm::doHostChannelOpen(name, write);
+}
+
+static int32_t __faasm_channel_write_wrapper(wasm_exec_env_t execEnv,
+                                             int32_t handle,
+                                             uint8_t* data,
+                                             int32_t dataLen)
+{
+    HOST_CALL(Chaining);
+    return wasm::doHostChannelWrite(handle, data, dataLen);
+}
+
+static int32_t __faasm_channel_read_wrapper(wasm_exec_env_t execEnv,
+                                            int32_t handle,
+                                            uint8_t* buffer,
+                                            int32_t bufferLen)
+{
+    HOST_CALL(Chaining);
+    return wasm::doHostChannelRead(handle, buffer, bufferLen);
+}
+
+static int32_t __faasm_channel_close_wrapper(wasm_exec_env_t execEnv,
+                                             int32_t handle)
+{
+    HOST_CALL(Chaining);
+    return wasm::doHostChannelClose(handle);
 }
 
 /**
@@ -115,21 +601,43 @@ static int32_t __faasm_read_input_wrapper(wasm_exec_env_t exec_env,
                                           char* inBuff,
                                           int32_t inLen)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - faasm_read_input {} {}", inBuff, inLen);
 
-    faabric::Message& call = ExecutorContext::get()->getMsg();
-    std::vector<uint8_t> inputBytes =
-      faabric::util::stringToBytes(call.inputdata());
+    return wasm::readCallInput(reinterpret_cast<uint8_t*>(inBuff), inLen);
+}
 
-    // If nothing, return nothing
-    if (inputBytes.empty()) {
-        return 0;
-    }
+/**
+ * How many calls the instance has handled since it was last reset
+ */
+static int32_t __faasm_batch_index_wrapper(wasm_exec_env_t exec_env)
+{
+    HOST_CALL(Other);
+    SPDLOG_DEBUG("S - faasm_batch_index");
+
+    return getExecutingWAMRModule()->getBatchIndex();
+}
+
+/**
+ * Put the function input in new read-only memory, writing where it is and how
+ * long it is
+ */
+static void __faasm_read_input_mapped_wrapper(wasm_exec_env_t exec_env,
+                                              int32_t* inputPtrPtr,
+                                              int32_t* inputLenPtr)
+{
+    HOST_CALL(Other);
+    SPDLOG_DEBUG("S - faasm_read_input_mapped");
 
-    // Write to the wasm buffer
-    int inputSize = faabric::util::safeCopyToBuffer(
-      inputBytes, reinterpret_cast<uint8_t*>(inBuff), inLen);
-    return inputSize;
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    module->validateNativePointer(inputPtrPtr, sizeof(int32_t));
+    module->validateNativePointer(inputLenPtr, sizeof(int32_t));
+
+    uint32_t inputPtr = 0;
+    uint32_t inputLen = 0;
+    wasm::readCallInputMapped(&inputPtr, &inputLen);
+    *inputPtrPtr = inputPtr;
+    *inputLenPtr = inputLen;
 }
 
 /**
@@ -139,21 +647,76 @@ static void __faasm_write_output_wrapper(wasm_exec_env_t exec_env,
                                          char* outBuff,
                                          int32_t outLen)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - faasm_write_output {} {}", outBuff, outLen);
 
-    faabric::Message& call = ExecutorContext::get()->getMsg();
-    call.set_outputdata(outBuff, outLen);
+    wasm::writeCallOutput(BYTES(outBuff), outLen);
+}
+
+/**
+ * Append a chunk to the function output
+ */
+static void __faasm_append_output_wrapper(wasm_exec_env_t exec_env,
+                                          char* outBuff,
+                                          int32_t outLen)
+{
+    HOST_CALL(Other);
+    SPDLOG_DEBUG("S - faasm_append_output {} {}", outBuff, outLen);
+
+    wasm::appendCallOutput(BYTES(outBuff), outLen);
+}
+
+/**
+ * Read the next chunk of a chained function's output
+ */
+static int32_t __faasm_read_call_output_wrapper(wasm_exec_env_t exec_env,
+                                                int32_t callId,
+                                                char* buffer,
+                                                int32_t bufferLen)
+{
+    HOST_CALL(Chaining);
+    SPDLOG_DEBUG("S - faasm_read_call_output {} {}", callId, bufferLen);
+
+    return wasm::readChainedCallOutput(callId, BYTES(buffer), bufferLen);
 }
 
 static NativeSymbol ns[] = {
+    REG_NATIVE_FUNC(__faasm_append_output, "($i)"),
+    REG_NATIVE_FUNC(__faasm_await_all, "(*i*)i"),
     REG_NATIVE_FUNC(__faasm_await_call, "(i)i"),
+    REG_NATIVE_FUNC(__faasm_await_call_output_mapped, "(i**)i"),
+    REG_NATIVE_FUNC(__faasm_await_state, "(i)"),
+    REG_NATIVE_FUNC(__faasm_batch_index, "()i"),
+    REG_NATIVE_FUNC(__faasm_chain_dag, "(***i*i*)i"),
     REG_NATIVE_FUNC(__faasm_chain_name, "($$i)i"),
+    REG_NATIVE_FUNC(__faasm_chain_name_affinity, "($$i*i)i"),
+    REG_NATIVE_FUNC(__faasm_chain_name_batch, "($**i*)i"),
+    REG_NATIVE_FUNC(__faasm_chain_name_state, "($$ii)i"),
     REG_NATIVE_FUNC(__faasm_chain_ptr, "(i$i)i"),
+    REG_NATIVE_FUNC(__faasm_chain_ptr_affinity, "(i$i*i)i"),
+    REG_NATIVE_FUNC(__faasm_chain_ptr_batch, "(i**i*)i"),
+    REG_NATIVE_FUNC(__faasm_chain_ptr_state, "(i$ii)i"),
+    REG_NATIVE_FUNC(__faasm_channel_close, "(i)i"),
+    REG_NATIVE_FUNC(__faasm_channel_open, "($i)i"),
+    REG_NATIVE_FUNC(__faasm_channel_read, "(i*~)i"),
+    REG_NATIVE_FUNC(__faasm_channel_write, "(i*~)i"),
+    REG_NATIVE_FUNC(__faasm_checkpoint, "(i$)"),
     REG_NATIVE_FUNC(__faasm_host_interface_test, "(i)"),
+    REG_NATIVE_FUNC(__faasm_http_request, "($$$*~*~*)i"),
     REG_NATIVE_FUNC(__faasm_migrate_point, "(i$)"),
+    REG_NATIVE_FUNC(__faasm_poll_state, "(i)i"),
     REG_NATIVE_FUNC(__faasm_pull_state, "(*i)"),
+    REG_NATIVE_FUNC(__faasm_pull_state_async, "(*i)i"),
+    REG_NATIVE_FUNC(__faasm_pull_state_multi, "(*i*)"),
     REG_NATIVE_FUNC(__faasm_push_state, "(*)"),
+    REG_NATIVE_FUNC(__faasm_push_state_async, "(*)i"),
+    REG_NATIVE_FUNC(__faasm_push_state_multi, "(*i)"),
+    REG_NATIVE_FUNC(__faasm_read_call_output, "(i*~)i"),
     REG_NATIVE_FUNC(__faasm_read_input, "($i)i"),
+    REG_NATIVE_FUNC(__faasm_read_input_mapped, "(**)"),
+    REG_NATIVE_FUNC(__faasm_remaining_time_ms, "()I"),
+    REG_NATIVE_FUNC(__faasm_resolve_host, "($i*~)i"),
+    REG_NATIVE_FUNC(__faasm_timer_nanos, "()I"),
     REG_NATIVE_FUNC(__faasm_write_output, "($i)"),
 };
 
@@ -4,11 +4,13 @@
 #include <wamr/WAMRWasmModule.h>
 #include <wamr/native.h>
 #include <wamr/types.h>
+#include <wasm/call_metrics.h>
 
 #include <cstring>
 #include <stdexcept>
 #include <string>
 #include <sys/uio.h>
+#include <unistd.h>
 
 #include <wasm_export.h>
 #include <wasmtime_ssp.h>
@@ -24,6 +26,7 @@ static uint32_t __wasi_fd_dup_wrapper(wasm_exec_env_t exec_env,
                                       uint32_t fd,
                                       uint32_t* resFd)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - __wasi_fd_dup {}");
 
     *resFd = doWasiDup(fd);
@@ -33,28 +36,83 @@ static uint32_t __wasi_fd_dup_wrapper(wasm_exec_env_t exec_env,
 
 static uint32_t dup_wrapper(wasm_exec_env_t exec_env, uint32_t fd)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - dup {}", fd);
     return doWasiDup(fd);
 }
 
 static uint32_t getpwnam_wrapper(wasm_exec_env_t exec_env, uint32_t a)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - getpwnam");
     throw std::runtime_error("getpwnam not implemented");
 }
 
+/**
+ * Copies between the descriptors on the host, so the data never passes
+ * through linear memory. The offset is a pointer to an off_t, or null to use
+ * and move the input's own offset.
+ */
 static int32_t sendfile_wrapper(wasm_exec_env_t exec_env,
                                 int32_t out_fd,
                                 int32_t in_fd,
                                 int32_t offset,
                                 int32_t count)
 {
-    SPDLOG_DEBUG("S - sendfile {}");
-    throw std::runtime_error("sendfile not implemented");
+    HOST_CALL(Filesystem);
+    SPDLOG_TRACE("S - sendfile {} {} {} {}", out_fd, in_fd, offset, count);
+
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    storage::FileSystem& fileSystem = module->getFileSystem();
+    if (!fileSystem.fileDescriptorExists(out_fd) ||
+        !fileSystem.fileDescriptorExists(in_fd)) {
+        return -1;
+    }
+
+    storage::FileDescriptor& outDesc = fileSystem.getFileDescriptor(out_fd);
+    storage::FileDescriptor& inDesc = fileSystem.getFileDescriptor(in_fd);
+
+    off_t* nativeOffset = nullptr;
+    if (offset != 0) {
+        module->validateWasmOffset(offset, sizeof(off_t));
+        nativeOffset =
+          reinterpret_cast<off_t*>(module->wasmPointerToNative(offset));
+    }
+
+    // Captured stdout has to come through the host, so stage it
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    bool isStd = out_fd <= 2;
+    if (isStd && conf.captureStdout == "on") {
+        std::vector<uint8_t> buffer(count);
+        ssize_t bytesRead =
+          nativeOffset == nullptr
+            ? ::read(inDesc.getLinuxFd(), buffer.data(), count)
+            : ::pread(inDesc.getLinuxFd(), buffer.data(), count, *nativeOffset);
+        if (bytesRead < 0) {
+            return -1;
+        }
+
+        std::vector<::iovec> ioVecBuffNative = { { buffer.data(),
+                                                   (size_t)bytesRead } };
+        ssize_t bytesWritten = outDesc.write(ioVecBuffNative, 1);
+        if (bytesWritten < 0) {
+            return -1;
+        }
+        module->captureStdout(ioVecBuffNative.data(), 1);
+
+        if (nativeOffset != nullptr) {
+            *nativeOffset += bytesWritten;
+        }
+
+        return bytesWritten;
+    }
+
+    return inDesc.sendTo(outDesc, nativeOffset, count);
 }
 
 static int32_t tempnam_wrapper(wasm_exec_env_t exec_env, int32_t a, int32_t b)
 {
+    HOST_CALL(Filesystem);
     throw std::runtime_error("tempnam not implemented");
 }
 
@@ -74,28 +132,58 @@ uint32_t getFaasmFilesystemApi(NativeSymbol** nativeSymbols)
 
 // ---------- WASI symbols ----------
 
+// The native iovecs point straight into linear memory, so nothing is copied
+static std::vector<::iovec> wasmIovecsToNative(WAMRWasmModule* module,
+                                               const iovec_app_t* ioVecBuffWasm,
+                                               int32_t ioVecCountWasm)
+{
+    module->validateNativePointer((void*)ioVecBuffWasm,
+                                  sizeof(iovec_app_t) * ioVecCountWasm);
+
+    std::vector<::iovec> ioVecBuffNative(ioVecCountWasm, (::iovec){});
+    for (int i = 0; i < ioVecCountWasm; i++) {
+        module->validateWasmOffset(ioVecBuffWasm[i].buffOffset,
+                                   sizeof(char) * ioVecBuffWasm[i].buffLen);
+
+        ioVecBuffNative[i] = {
+            .iov_base =
+              module->wasmPointerToNative(ioVecBuffWasm[i].buffOffset),
+            .iov_len = ioVecBuffWasm[i].buffLen,
+        };
+    }
+
+    return ioVecBuffNative;
+}
+
 static uint32_t wasi_fd_allocate(wasm_exec_env_t exec_env,
                                  __wasi_fd_t fd,
                                  __wasi_filesize_t offset,
                                  __wasi_filesize_t len)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("wasi_fd_allocate {}", fd);
     throw std::runtime_error("wasi_fd_allocate not implemented");
 }
 
 static int32_t wasi_fd_close(wasm_exec_env_t exec_env, int32_t fd)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - fd_close {}", fd);
 
-    // Ignore for now
+    // The preopened fds are left open, as closing them messes things up
+    storage::FileSystem& fs = getExecutingWAMRModule()->getFileSystem();
+    if (!fs.closeFileDescriptor(fd)) {
+        return __WASI_EBADF;
+    }
 
-    return 0;
+    return __WASI_ESUCCESS;
 }
 
 static int32_t wasi_fd_fdstat_get(wasm_exec_env_t exec_env,
                                   int32_t fd,
                                   __wasi_fdstat_t* statWasm)
 {
+    HOST_CALL(Filesystem);
     WAMRWasmModule* module = getExecutingWAMRModule();
     storage::FileSystem& fs = module->getFileSystem();
     std::string path = fs.getPathForFd(fd);
@@ -129,6 +217,7 @@ static int32_t wasi_fd_fdstat_set_flags(wasm_exec_env_t exec_env,
                                         int32_t a,
                                         int32_t b)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - fd_fdstat_set_flags");
     throw std::runtime_error("fd_fdstat_set_flags not implemented");
 }
@@ -138,6 +227,7 @@ static int32_t wasi_fd_fdstat_set_rights(wasm_exec_env_t exec_env,
                                          int64_t b,
                                          int64_t c)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - fd_fdstat_set_rights");
     throw std::runtime_error("fd_fdstat_set_rights not implemented");
 }
@@ -173,6 +263,7 @@ static int32_t wasi_fd_filestat_get(wasm_exec_env_t exec_env,
                                     int32_t fd,
                                     __wasi_filestat_t* statWasm)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - fd_filestat_get {}", fd);
 
     return doFileStat(fd, "", statWasm);
@@ -182,6 +273,7 @@ static int32_t wasi_fd_filestat_set_size(wasm_exec_env_t execEnv,
                                          int32_t a,
                                          int64_t b)
 {
+    HOST_CALL(Filesystem);
     throw std::runtime_error("wasi_fd_filestat_set_size not implemented!");
 }
 
@@ -192,8 +284,28 @@ static uint32_t wasi_fd_pread(wasm_exec_env_t exec_env,
                               __wasi_filesize_t offset,
                               uint32_t* nReadWasm)
 {
-    SPDLOG_DEBUG("S - fd_pread {}");
-    throw std::runtime_error("fd_pread not implemented");
+    HOST_CALL(Filesystem);
+    SPDLOG_TRACE("S - fd_pread {} {} {}", fd, iovecLen, offset);
+
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    storage::FileSystem& fileSystem = module->getFileSystem();
+    if (!fileSystem.fileDescriptorExists(fd)) {
+        return __WASI_EBADF;
+    }
+
+    module->validateNativePointer(nReadWasm, sizeof(uint32_t));
+    std::vector<::iovec> ioVecBuffNative =
+      wasmIovecsToNative(module, iovecWasm, iovecLen);
+
+    storage::FileDescriptor& fileDesc = fileSystem.getFileDescriptor(fd);
+    ssize_t n = fileDesc.pread(ioVecBuffNative, iovecLen, offset);
+    if (n < 0) {
+        return fileDesc.getWasiErrno();
+    }
+
+    *nReadWasm = n;
+
+    return __WASI_ESUCCESS;
 }
 
 static int32_t wasi_fd_prestat_dir_name(wasm_exec_env_t exec_env,
@@ -201,6 +313,7 @@ static int32_t wasi_fd_prestat_dir_name(wasm_exec_env_t exec_env,
                                         char* path,
                                         int32_t* pathLen)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - fd_prestat_dir_name {}", fd);
 
     WAMRWasmModule* module = getExecutingWAMRModule();
@@ -219,6 +332,7 @@ static int32_t wasi_fd_prestat_get(wasm_exec_env_t exec_env,
                                    int32_t fd,
                                    wasi_prestat_app_t* prestatWasm)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - fd_prestat_get {}", fd);
 
     WAMRWasmModule* module = getExecutingWAMRModule();
@@ -244,8 +358,28 @@ static uint32_t wasi_fd_pwrite(wasm_exec_env_t exec_env,
                                __wasi_filesize_t offset,
                                uint32_t* nWrittenWasm)
 {
-    SPDLOG_DEBUG("S - fd_pwrite {}");
-    throw std::runtime_error("fd_pwrite not implemented");
+    HOST_CALL(Filesystem);
+    SPDLOG_TRACE("S - fd_pwrite {} {} {}", fd, iovecLen, offset);
+
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    storage::FileSystem& fileSystem = module->getFileSystem();
+    if (!fileSystem.fileDescriptorExists(fd)) {
+        return __WASI_EBADF;
+    }
+
+    module->validateNativePointer(nWrittenWasm, sizeof(uint32_t));
+    std::vector<::iovec> ioVecBuffNative =
+      wasmIovecsToNative(module, iovecWasm, iovecLen);
+
+    storage::FileDescriptor& fileDesc = fileSystem.getFileDescriptor(fd);
+    ssize_t n = fileDesc.pwrite(ioVecBuffNative, iovecLen, offset);
+    if (n < 0) {
+        return fileDesc.getWasiErrno();
+    }
+
+    *nWrittenWasm = n;
+
+    return __WASI_ESUCCESS;
 }
 
 static int32_t wasi_fd_read(wasm_exec_env_t exec_env,
@@ -254,26 +388,17 @@ static int32_t wasi_fd_read(wasm_exec_env_t exec_env,
                             int32_t ioVecCountWasm,
                             int32_t* bytesRead)
 {
+    HOST_CALL(Filesystem);
     WAMRWasmModule* module = getExecutingWAMRModule();
     storage::FileSystem& fileSystem = module->getFileSystem();
     std::string path = fileSystem.getPathForFd(fd);
 
     SPDLOG_TRACE("S - fd_read {} ({})", fd, path);
 
-    storage::FileDescriptor fileDesc = fileSystem.getFileDescriptor(fd);
-
-    // Translate app iovecs to native ones
-    std::vector<::iovec> ioVecBuffNative(ioVecCountWasm, (::iovec){});
-    for (int i = 0; i < ioVecCountWasm; i++) {
-        module->validateWasmOffset(ioVecBuffWasm[i].buffOffset,
-                                   sizeof(char) * ioVecBuffWasm[i].buffLen);
+    storage::FileDescriptor& fileDesc = fileSystem.getFileDescriptor(fd);
 
-        ioVecBuffNative[i] = {
-            .iov_base =
-              module->wasmPointerToNative(ioVecBuffWasm[i].buffOffset),
-            .iov_len = ioVecBuffWasm[i].buffLen,
-        };
-    }
+    std::vector<::iovec> ioVecBuffNative =
+      wasmIovecsToNative(module, ioVecBuffWasm, ioVecCountWasm);
 
     // Read from fd
     module->validateNativePointer(bytesRead, sizeof(int32_t));
@@ -284,14 +409,23 @@ static int32_t wasi_fd_read(wasm_exec_env_t exec_env,
 }
 
 static int32_t wasi_fd_readdir(wasm_exec_env_t exec_env,
-                               int32_t a,
-                               int32_t* b,
-                               char* c,
-                               int64_t d,
-                               int32_t e)
+                               int32_t fd,
+                               uint8_t* buf,
+                               uint32_t bufLen,
+                               int64_t startCookie,
+                               uint32_t* resSizePtr)
 {
-    SPDLOG_DEBUG("S - fd_readdir");
-    throw std::runtime_error("fd_readdir not implemented");
+    HOST_CALL(Filesystem);
+    SPDLOG_TRACE("S - fd_readdir {} {} {}", fd, bufLen, startCookie);
+
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    module->validateNativePointer(resSizePtr, sizeof(uint32_t));
+
+    storage::FileDescriptor& fileDesc =
+      module->getFileSystem().getFileDescriptor(fd);
+    *resSizePtr = fileDesc.copyDirentsToWasiBuffer(buf, bufLen, startCookie);
+
+    return __WASI_ESUCCESS;
 }
 
 static int32_t wasi_fd_seek(wasm_exec_env_t exec_env,
@@ -300,6 +434,7 @@ static int32_t wasi_fd_seek(wasm_exec_env_t exec_env,
                             int32_t whence,
                             __wasi_filesize_t* newOffset)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - fd_seek {} {} {}", fd, offset, whence);
 
     WAMRWasmModule* module = getExecutingWAMRModule();
@@ -314,14 +449,27 @@ static int32_t wasi_fd_seek(wasm_exec_env_t exec_env,
 
 static uint32_t wasi_fd_sync(wasm_exec_env_t exec_env, __wasi_fd_t fd)
 {
-    SPDLOG_DEBUG("S - fd_sync {}", fd);
-    throw std::runtime_error("fd_sync not implemented");
+    HOST_CALL(Filesystem);
+    SPDLOG_TRACE("S - fd_sync {}", fd);
+
+    storage::FileSystem& fileSystem = getExecutingWAMRModule()->getFileSystem();
+    if (!fileSystem.fileDescriptorExists(fd)) {
+        return __WASI_EBADF;
+    }
+
+    storage::FileDescriptor& fileDesc = fileSystem.getFileDescriptor(fd);
+    if (!fileDesc.sync()) {
+        return fileDesc.getWasiErrno();
+    }
+
+    return __WASI_ESUCCESS;
 }
 
 static uint32_t wasi_fd_tell(wasm_exec_env_t exec_env,
                              uint32_t fd,
                              uint32_t* resOffset)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_TRACE("S - fd_tell {}", fd);
 
     storage::FileDescriptor& fileDesc =
@@ -337,29 +485,16 @@ static int32_t wasi_fd_write(wasm_exec_env_t exec_env,
                              int32_t ioVecCountWasm,
                              int32_t* bytesWritten)
 {
+    HOST_CALL(Filesystem);
     WAMRWasmModule* module = getExecutingWAMRModule();
     storage::FileSystem& fileSystem = module->getFileSystem();
     std::string path = fileSystem.getPathForFd(fd);
 
     SPDLOG_TRACE("S - fd_write {} ({})", fd, path);
 
-    // Check pointers
-    module->validateNativePointer(reinterpret_cast<void*>(ioVecBuffWasm),
-                                  sizeof(iovec_app_t) * ioVecCountWasm);
     module->validateNativePointer(bytesWritten, sizeof(int32_t));
-
-    // Translate the app iovecs into native iovecs
-    std::vector<::iovec> ioVecBuffNative(ioVecCountWasm, (::iovec){});
-    for (int i = 0; i < ioVecCountWasm; i++) {
-        module->validateWasmOffset(ioVecBuffWasm[i].buffOffset,
-                                   sizeof(char) * ioVecBuffWasm[i].buffLen);
-
-        ioVecBuffNative[i] = {
-            .iov_base =
-              module->wasmPointerToNative(ioVecBuffWasm[i].buffOffset),
-            .iov_len = ioVecBuffWasm[i].buffLen,
-        };
-    }
+    std::vector<::iovec> ioVecBuffNative =
+      wasmIovecsToNative(module, ioVecBuffWasm, ioVecCountWasm);
 
     // Do the write
     storage::FileDescriptor& fileDesc = fileSystem.getFileDescriptor(fd);
@@ -387,6 +522,7 @@ static int32_t wasi_path_create_directory(wasm_exec_env_t exec_env,
                                           int32_t* b,
                                           char* c)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - path_create_directory");
     throw std::runtime_error("path_create_directory not implemented");
 }
@@ -398,6 +534,7 @@ static int32_t wasi_path_filestat_get(wasm_exec_env_t exec_env,
                                       int32_t pathLen,
                                       __wasi_filestat_t* statWasm)
 {
+    HOST_CALL(Filesystem);
     WAMRWasmModule* module = getExecutingWAMRModule();
     module->validateNativePointer(path, pathLen);
     std::string pathStr(path, pathLen);
@@ -416,6 +553,7 @@ static uint32_t wasi_path_filestat_set_times(wasm_exec_env_t exec_env,
                                              __wasi_timestamp_t stMtim,
                                              __wasi_fstflags_t fstflags)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("wasi_path_filestat_set_times {}", fd);
     throw std::runtime_error("wasi_path_filestat_set_times not implemented");
 }
@@ -429,6 +567,7 @@ static int32_t wasi_path_link(wasm_exec_env_t exec_env,
                               int32_t* f,
                               char* g)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - path_link");
     throw std::runtime_error("path_link not implemented");
 }
@@ -444,6 +583,7 @@ static int32_t wasi_path_open(wasm_exec_env_t exec_env,
                               int32_t fdFlags,
                               int32_t* fdWasm)
 {
+    HOST_CALL(Filesystem);
     WAMRWasmModule* module = getExecutingWAMRModule();
 
     module->validateNativePointer(path, pathLen);
@@ -475,6 +615,7 @@ static int32_t wasi_path_readlink(wasm_exec_env_t exec_env,
                                   uint32_t bufLen,
                                   uint32_t* resBytesUsed)
 {
+    HOST_CALL(Filesystem);
     WAMRWasmModule* module = getExecutingWAMRModule();
 
     module->validateNativePointer(path, pathLen);
@@ -495,6 +636,7 @@ static int32_t wasi_path_remove_directory(wasm_exec_env_t exec_env,
                                           int32_t* b,
                                           char* c)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - path_remove_directory");
     throw std::runtime_error("path_remove_directory not implemented");
 }
@@ -507,6 +649,7 @@ static int32_t wasi_path_rename(wasm_exec_env_t exec_env,
                                 char* newPath,
                                 uint32_t newPathLen)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - path_rename {} (fd: {}) -> {} (fd: {})",
                  oldPath,
                  oldFd,
@@ -536,6 +679,7 @@ static int32_t wasi_path_symlink(wasm_exec_env_t exec_env,
                                  const char* newPath,
                                  uint32_t newPathLen)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - path_symlink");
     throw std::runtime_error("path_symlink not implemented");
 }
@@ -545,6 +689,7 @@ static int32_t wasi_path_unlink_file(wasm_exec_env_t exec_env,
                                      char* path,
                                      uint32_t pathLen)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - path_unlink_file");
 
     std::string pathStr(path, pathLen);
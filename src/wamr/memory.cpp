@@ -5,11 +5,16 @@
 #include <wamr/native.h>
 #include <wasm/WasmExecutionContext.h>
 #include <wasm/WasmModule.h>
+#include <wasm/call_metrics.h>
 #include <wasm_export.h>
 
+#include <cerrno>
+#include <sys/mman.h>
+
 namespace wasm {
 static int32_t __sbrk_wrapper(wasm_exec_env_t exec_env, int32_t increment)
 {
+    HOST_CALL(Memory);
     // Note trace logging here as this is called a lot
     SPDLOG_TRACE("S - __sbrk - {}", increment);
     WasmModule* module = getExecutingModule();
@@ -35,14 +40,11 @@ static int32_t mmap_wrapper(wasm_exec_env_t exec_env,
                             int32_t fd,
                             int64_t offset)
 {
+    HOST_CALL(Memory);
     SPDLOG_TRACE(
       "S - mmap - {} {} {} {} {} {}", addr, length, prot, flags, fd, offset);
 
-    if (offset != 0) {
-        SPDLOG_WARN("WARNING: ignoring non-zero mmap offset ({})", offset);
-    }
-
-    // Likewise with the address hint
+    // We don't support fixed addresses, so ignore the hint
     if (addr != 0) {
         SPDLOG_WARN("WARNING: ignoring mmap hint at {}", addr);
     }
@@ -53,7 +55,13 @@ static int32_t mmap_wrapper(wasm_exec_env_t exec_env,
         // If fd is provided, we're mapping a file into memory
         storage::FileDescriptor& fileDesc =
           module->getFileSystem().getFileDescriptor(fd);
-        return module->mmapFile(fileDesc.getLinuxFd(), length);
+        return module->mmapFile(
+          fileDesc.getLinuxFd(), length, prot, flags, offset);
+    }
+
+    // The offset is meaningless without a file
+    if (offset != 0) {
+        SPDLOG_WARN("WARNING: ignoring non-zero mmap offset ({})", offset);
     }
 
     // If fd not provided, map memory directly
@@ -64,6 +72,7 @@ static int32_t munmap_wrapper(wasm_exec_env_t exec_env,
                               int32_t addr,
                               int32_t length)
 {
+    HOST_CALL(Memory);
     SPDLOG_TRACE("S - munmap - {} {}", addr, length);
 
     WAMRWasmModule* executingModule = getExecutingWAMRModule();
@@ -72,9 +81,49 @@ static int32_t munmap_wrapper(wasm_exec_env_t exec_env,
     return 0;
 }
 
+static int32_t mremap_wrapper(wasm_exec_env_t exec_env,
+                              int32_t oldAddr,
+                              int32_t oldSize,
+                              int32_t newSize,
+                              int32_t flags,
+                              int32_t newAddr)
+{
+    HOST_CALL(Memory);
+    SPDLOG_TRACE("S - mremap - {} {} {} {} {}",
+                 oldAddr,
+                 oldSize,
+                 newSize,
+                 flags,
+                 newAddr);
+
+    // As with mmap, we place mappings ourselves
+    if ((flags & ~MREMAP_MAYMOVE) != 0) {
+        SPDLOG_WARN("Unsupported mremap flags {}", flags);
+        return -EINVAL;
+    }
+
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    if (!module->canRemapMemory(
+          oldAddr, (uint32_t)oldSize, (uint32_t)newSize)) {
+        return -EINVAL;
+    }
+
+    uint32_t res = module->remapMemory(
+      oldAddr,
+      (uint32_t)oldSize,
+      (uint32_t)newSize,
+      (flags & MREMAP_MAYMOVE) != 0);
+    if (res == REMAP_MEMORY_FAILED) {
+        return -ENOMEM;
+    }
+
+    return res;
+}
+
 static NativeSymbol ns[] = {
     REG_NATIVE_FUNC(__sbrk, "(i)i"),
     REG_NATIVE_FUNC(mmap, "(iiiiiI)i"),
+    REG_NATIVE_FUNC(mremap, "(iiiii)i"),
     REG_NATIVE_FUNC(munmap, "(ii)i"),
 };
 
@@ -5,15 +5,38 @@
 #include <wamr/WAMRModuleMixin.h>
 #include <wamr/WAMRWasmModule.h>
 #include <wamr/native.h>
+#include <wasm/call_metrics.h>
+#include <wasm/mpi_collectives.h>
+#include <wasm/mpi_comm.h>
+#include <wasm/mpi_core.h>
+#include <wasm/mpi_file.h>
+#include <wasm/mpi_mem.h>
+#include <wasm/mpi_ops.h>
+#include <wasm/mpi_profile.h>
+#include <wasm/mpi_progress.h>
+#include <wasm/mpi_rendezvous.h>
+#include <wasm/mpi_requests.h>
+#include <wasm/mpi_types.h>
+#include <wasm/mpi_window.h>
 
 #include <wasm_export.h>
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <tuple>
+#include <vector>
+
 using namespace faabric::mpi;
 
 #define MPI_FUNC(str)                                                          \
+    HOST_CALL(Mpi);                                                            \
+    MpiProfileTimer mpiProfileTimer(str);                                      \
     SPDLOG_TRACE("MPI-{} {}", executingContext.getRank(), str);
 
 #define MPI_FUNC_ARGS(formatStr, ...)                                          \
+    HOST_CALL(Mpi);                                                            \
+    MpiProfileTimer mpiProfileTimer(formatStr);                                \
     SPDLOG_TRACE("MPI-{} " formatStr, executingContext.getRank(), __VA_ARGS__);
 
 namespace wasm {
@@ -21,21 +44,27 @@ static thread_local MpiContext executingContext;
 
 static MpiWorld& getExecutingWorld()
 {
+    // A rank that's been migrated here didn't call MPI_Init on this host
+    faabric::Message& msg =
+      faabric::scheduler::ExecutorContext::get()->getMsg();
+    if (msg.ismpi() && executingContext.getWorldId() != msg.mpiworldid()) {
+        executingContext.joinWorld(msg);
+    }
+
     MpiWorldRegistry& reg = getMpiWorldRegistry();
     return reg.getWorld(executingContext.getWorldId());
 }
 
 /**
- * Convenience wrapper around the MPI context for use in the syscalls in this
- * file.
+ * Decodes the guest's arguments for the shared MPI core, for use in the
+ * syscalls in this file.
  */
-class WamrMpiContextWrapper
+class WamrMpiContextWrapper : public MpiCore
 {
   public:
     explicit WamrMpiContextWrapper()
-      : module(wasm::getExecutingWAMRModule())
-      , world(getExecutingWorld())
-      , rank(executingContext.getRank())
+      : MpiCore(getExecutingWorld(), executingContext.getRank())
+      , module(wasm::getExecutingWAMRModule())
     {}
 
     void checkMpiComm(int32_t* wasmPtr) const
@@ -50,15 +79,103 @@ class WamrMpiContextWrapper
         }
     }
 
-    faabric_datatype_t* getFaasmDataType(int32_t* wasmPtr) const
+    int getCommId(int32_t* wasmPtr) const
+    {
+        module->validateNativePointer(wasmPtr, sizeof(faabric_communicator_t));
+        faabric_communicator_t* hostComm =
+          reinterpret_cast<faabric_communicator_t*>(wasmPtr);
+
+        return hostComm->id;
+    }
+
+    MpiCommunicator& getComm(int32_t* wasmPtr)
+    {
+        return getCommunicator(getCommId(wasmPtr));
+    }
+
+    // Allocates a communicator in the wasm heap and writes its offset to the
+    // given MPI_Comm. The MPI_Comm is itself a pointer, so WAMR converts the
+    // outer wasm offset to a native pointer for us, but we write a wasm
+    // offset through it. Be _very_ careful with these unaligned writes, as it
+    // has happened before that they smash other values in the stack.
+    void writeNewComm(int32_t* newCommPtr, int commId) const
+    {
+        module->validateNativePointer(newCommPtr, sizeof(MPI_Comm));
+
+        faabric_communicator_t* hostNewComm = nullptr;
+        uint32_t wasmPtr = module->wasmModuleMalloc(
+          sizeof(faabric_communicator_t), (void**)&hostNewComm);
+        if (wasmPtr == 0) {
+            SPDLOG_ERROR("Error allocating memory in the WASM's heap");
+            throw std::runtime_error(
+              "Error allocating memory in the WASM heap");
+        }
+        hostNewComm->id = commId;
+
+        faabric::util::unalignedWrite<faabric_communicator_t*>(
+          reinterpret_cast<faabric_communicator_t*>(wasmPtr),
+          reinterpret_cast<uint8_t*>(newCommPtr));
+    }
+
+    // Derived types with gaps need packing, so calls that can do so have to
+    // ask for them explicitly (see MpiTypeBuffer)
+    faabric_datatype_t* getFaasmDataType(int32_t* wasmPtr,
+                                         bool allowGaps = false) const
     {
         module->validateNativePointer(wasmPtr, sizeof(faabric_datatype_t));
         faabric_datatype_t* hostDataType =
           reinterpret_cast<faabric_datatype_t*>(wasmPtr);
 
+        if (!allowGaps && isMpiDerivedType(hostDataType)) {
+            SPDLOG_ERROR("MPI datatype {} with gaps not supported here",
+                         hostDataType->id);
+            throw std::runtime_error("MPI datatype with gaps not supported");
+        }
+
         return hostDataType;
     }
 
+    uint8_t* getMpiBuffer(int32_t* buffer,
+                          faabric_datatype_t* type,
+                          int count) const
+    {
+        module->validateNativePointer(buffer, getMpiTypeSpan(type, count));
+        return reinterpret_cast<uint8_t*>(buffer);
+    }
+
+    // Null for MPI_IN_PLACE, as the core expects
+    uint8_t* getMpiSendBuffer(int32_t* buffer,
+                              faabric_datatype_t* type,
+                              int count) const
+    {
+        if (isInPlace(buffer)) {
+            return nullptr;
+        }
+
+        return getMpiBuffer(buffer, type, count);
+    }
+
+    void writeNewDataType(int32_t* newTypePtr,
+                          const MpiTypeLayout& layout) const
+    {
+        module->validateNativePointer(newTypePtr, sizeof(MPI_Datatype));
+
+        faabric_datatype_t* hostNewType = nullptr;
+        uint32_t wasmPtr = module->wasmModuleMalloc(
+          sizeof(faabric_datatype_t), (void**)&hostNewType);
+        if (wasmPtr == 0) {
+            SPDLOG_ERROR("Error allocating memory in the WASM's heap");
+            throw std::runtime_error(
+              "Error allocating memory in the WASM heap");
+        }
+        createMpiDerivedType(wasmPtr, layout, hostNewType);
+
+        // See writeNewComm for why the write is unaligned
+        faabric::util::unalignedWrite<faabric_datatype_t*>(
+          reinterpret_cast<faabric_datatype_t*>(wasmPtr),
+          reinterpret_cast<uint8_t*>(newTypePtr));
+    }
+
     // MPI passes an MPI_Request* as part of the asynchronous API calls.
     // MPI_Request is in itself a faabric_request_t* so requestPtrPtr is a
     // faabric_request_t**, which is a double wasm offset. Allocating memory
@@ -104,6 +221,22 @@ class WamrMpiContextWrapper
         return hostOpType;
     }
 
+    faabric_info_t* getFaasmInfoType(int32_t* wasmPtr) const
+    {
+        module->validateNativePointer(wasmPtr, sizeof(faabric_info_t));
+        faabric_info_t* hostInfoType =
+          reinterpret_cast<faabric_info_t*>(wasmPtr);
+
+        return hostInfoType;
+    }
+
+    // Windows are identified by the wasm offset of their struct, as in WAVM
+    int32_t getWindowPtr(int32_t* winPtr) const
+    {
+        module->validateNativePointer(winPtr, sizeof(wasm_faabric_win_t));
+        return module->nativePointerToWasmOffset(winPtr);
+    }
+
     template<typename T>
     void writeMpiResult(int32_t* resPtr, T result)
     {
@@ -112,19 +245,15 @@ class WamrMpiContextWrapper
     }
 
     wasm::WAMRWasmModule* module;
-    MpiWorld& world;
-    int rank;
 };
 
-static thread_local std::unique_ptr<WamrMpiContextWrapper> ctx = nullptr;
+static thread_local MpiContextCache<WamrMpiContextWrapper> ctx;
 
 static int terminateMpi()
 {
-    // Destroy the MPI world
-    ctx->world.destroy();
+    ctx->finalize();
 
-    // Null-out the context
-    ctx = nullptr;
+    ctx.reset();
 
     return MPI_SUCCESS;
 }
@@ -154,27 +283,19 @@ static int32_t MPI_Allgather_wrapper(wasm_exec_env_t execEnv,
                   (uintptr_t)recvType,
                   (uintptr_t)comm);
 
-    ctx->checkMpiComm(comm);
     faabric_datatype_t* hostSendDtype = ctx->getFaasmDataType(sendType);
     faabric_datatype_t* hostRecvDtype = ctx->getFaasmDataType(recvType);
-
-    ctx->module->validateNativePointer(recvBuf,
-                                       recvCount * hostRecvDtype->size);
-
-    if (ctx->isInPlace(sendBuf)) {
-        sendBuf = recvBuf;
-    } else {
-        ctx->module->validateNativePointer(sendBuf,
-                                           sendCount * hostSendDtype->size);
-    }
-
-    ctx->world.allGather(ctx->rank,
-                         (uint8_t*)sendBuf,
-                         hostSendDtype,
-                         sendCount,
-                         (uint8_t*)recvBuf,
-                         hostRecvDtype,
-                         recvCount);
+    int commSize = ctx->getComm(comm).getSize();
+    uint8_t* hostRecvBuffer =
+      ctx->getMpiBuffer(recvBuf, hostRecvDtype, commSize * recvCount);
+
+    ctx->allGather(ctx->getMpiSendBuffer(sendBuf, hostSendDtype, sendCount),
+                   sendCount,
+                   hostSendDtype,
+                   hostRecvBuffer,
+                   recvCount,
+                   hostRecvDtype,
+                   ctx->getCommId(comm));
 
     return MPI_SUCCESS;
 }
@@ -184,12 +305,148 @@ static int32_t MPI_Allgatherv_wrapper(wasm_exec_env_t execEnv,
                                       int32_t sendCount,
                                       int32_t* sendType,
                                       int32_t* recvBuf,
-                                      int32_t recvCount,
-                                      int32_t dspls,
+                                      int32_t* recvCounts,
+                                      int32_t* dspls,
                                       int32_t* recvType,
                                       int32_t* comm)
 {
-    throw std::runtime_error("MPI_Allgatherv not implemented!");
+    MPI_FUNC_ARGS("S - MPI_Allgatherv {} {} {} {} {} {} {} {}",
+                  (uintptr_t)sendBuf,
+                  sendCount,
+                  (uintptr_t)sendType,
+                  (uintptr_t)recvBuf,
+                  (uintptr_t)recvCounts,
+                  (uintptr_t)dspls,
+                  (uintptr_t)recvType,
+                  (uintptr_t)comm);
+
+    ctx->checkMpiComm(comm);
+    faabric_datatype_t* hostSendDtype = ctx->getFaasmDataType(sendType);
+    faabric_datatype_t* hostRecvDtype = ctx->getFaasmDataType(recvType);
+
+    int worldSize = ctx->world.getSize();
+    ctx->module->validateNativePointer(recvCounts, worldSize * sizeof(int32_t));
+    ctx->module->validateNativePointer(dspls, worldSize * sizeof(int32_t));
+
+    size_t recvSize = 0;
+    for (int r = 0; r < worldSize; r++) {
+        recvSize = std::max<size_t>(
+          recvSize, (dspls[r] + recvCounts[r]) * hostRecvDtype->size);
+    }
+    ctx->module->validateNativePointer(recvBuf, recvSize);
+
+    uint8_t* hostSendBuffer = nullptr;
+    if (!ctx->isInPlace(sendBuf)) {
+        ctx->module->validateNativePointer(sendBuf,
+                                           sendCount * hostSendDtype->size);
+        hostSendBuffer = (uint8_t*)sendBuf;
+    }
+
+    mpiAllGatherV(ctx->world,
+                  ctx->rank,
+                  hostSendBuffer,
+                  sendCount,
+                  hostSendDtype,
+                  (uint8_t*)recvBuf,
+                  recvCounts,
+                  dspls,
+                  hostRecvDtype);
+
+    return MPI_SUCCESS;
+}
+
+// Reduces with a user-defined operator, to the given root or, if it's
+// negative, to all ranks. The guest's MPI_User_function takes wasm pointers,
+// so each combine goes through scratch memory in the wasm heap. As the user
+// function may grow memory, which invalidates native pointers, we work on
+// host copies and only go back to the receive buffer's offset at the end.
+static void reduceWithUserOp(wasm_exec_env_t execEnv,
+                             MpiCommunicator& comm,
+                             int root,
+                             int32_t* sendBuf,
+                             int32_t* recvBuf,
+                             int32_t* datatype,
+                             int count,
+                             int opId)
+{
+    awaitMpiCollectives();
+
+    const MpiUserOp& userOp = getMpiUserOp(opId);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
+    size_t nBytes = count * hostDtype->size;
+
+    uint32_t recvOffset = ctx->module->nativePointerToWasmOffset(recvBuf);
+    uint32_t datatypeOffset = ctx->module->nativePointerToWasmOffset(datatype);
+    auto* hostSendBuffer = reinterpret_cast<uint8_t*>(sendBuf);
+    std::vector<uint8_t> sendData(hostSendBuffer, hostSendBuffer + nBytes);
+    std::vector<uint8_t> recvData(nBytes);
+
+    size_t scratchSize = 2 * nBytes + 2 * sizeof(int32_t);
+    void* nativeScratch = nullptr;
+    uint32_t scratch =
+      ctx->module->wasmModuleMalloc(scratchSize, &nativeScratch);
+    uint32_t inoutOffset = scratch + nBytes;
+    uint32_t lenOffset = scratch + 2 * nBytes;
+    uint32_t datatypePtrOffset = lenOffset + sizeof(int32_t);
+
+    MpiCombineFunction combine =
+      [&](const uint8_t* in, uint8_t* inout, int n) {
+          size_t combineBytes = n * hostDtype->size;
+          auto* hostScratch =
+            (uint8_t*)ctx->module->wasmOffsetToNativePointer(scratch);
+          std::memcpy(hostScratch, in, combineBytes);
+          std::memcpy(hostScratch + nBytes, inout, combineBytes);
+          int32_t lenAndType[2] = { n, (int32_t)datatypeOffset };
+          std::memcpy(hostScratch + 2 * nBytes, lenAndType, sizeof(lenAndType));
+
+          std::vector<uint32_t> argv = {
+              scratch, inoutOffset, lenOffset, datatypePtrOffset
+          };
+          if (!wasm_runtime_call_indirect(
+                execEnv, userOp.funcPtr, argv.size(), argv.data())) {
+              SPDLOG_ERROR("Error calling MPI user op {}: {}",
+                           userOp.funcPtr,
+                           wasm_runtime_get_exception(
+                             ctx->module->getModuleInstance()));
+              throw std::runtime_error("Error calling MPI user op");
+          }
+
+          hostScratch =
+            (uint8_t*)ctx->module->wasmOffsetToNativePointer(inoutOffset);
+          std::memcpy(inout, hostScratch, combineBytes);
+      };
+
+    try {
+        if (root < 0) {
+            comm.allReduce(ctx->world,
+                           sendData.data(),
+                           recvData.data(),
+                           hostDtype,
+                           count,
+                           combine,
+                           userOp.commute);
+        } else {
+            comm.reduce(ctx->world,
+                        root,
+                        sendData.data(),
+                        recvData.data(),
+                        hostDtype,
+                        count,
+                        combine,
+                        userOp.commute);
+        }
+    } catch (...) {
+        wasm_runtime_module_free(ctx->module->getModuleInstance(), scratch);
+        throw;
+    }
+
+    wasm_runtime_module_free(ctx->module->getModuleInstance(), scratch);
+
+    if (root < 0 || comm.getRank() == root) {
+        std::memcpy(ctx->module->wasmOffsetToNativePointer(recvOffset),
+                    recvData.data(),
+                    nBytes);
+    }
 }
 
 static int32_t MPI_Allreduce_wrapper(wasm_exec_env_t execEnv,
@@ -208,24 +465,60 @@ static int32_t MPI_Allreduce_wrapper(wasm_exec_env_t execEnv,
                   (uintptr_t)op,
                   (uintptr_t)comm);
 
-    ctx->checkMpiComm(comm);
     faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
     faabric_op_t* hostOp = ctx->getFaasmOp(op);
+    uint8_t* hostRecvBuffer = ctx->getMpiBuffer(recvBuf, hostDtype, count);
+    uint8_t* hostSendBuffer = ctx->getMpiSendBuffer(sendBuf, hostDtype, count);
+
+    if (isMpiUserOp(hostOp->id)) {
+        reduceWithUserOp(execEnv,
+                         ctx->getComm(comm),
+                         -1,
+                         hostSendBuffer ? sendBuf : recvBuf,
+                         recvBuf,
+                         datatype,
+                         count,
+                         hostOp->id);
+        return MPI_SUCCESS;
+    }
 
-    ctx->module->validateNativePointer(recvBuf, count * hostDtype->size);
+    ctx->allReduce(hostSendBuffer,
+                   hostRecvBuffer,
+                   count,
+                   hostDtype,
+                   hostOp,
+                   ctx->getCommId(comm));
 
-    if (ctx->isInPlace(sendBuf)) {
-        sendBuf = recvBuf;
-    } else {
-        ctx->module->validateNativePointer(sendBuf, count * hostDtype->size);
+    return MPI_SUCCESS;
+}
+
+/**
+ * Allocates memory for communication buffers (see allocMpiMemory)
+ */
+static int32_t MPI_Alloc_mem_wrapper(wasm_exec_env_t execEnv,
+                                     int32_t memSize,
+                                     int32_t* info,
+                                     int32_t* resPtrPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Alloc_mem {} {} {}",
+                  memSize,
+                  (uintptr_t)info,
+                  (uintptr_t)resPtrPtr);
+
+    faabric_info_t* hostInfo = ctx->getFaasmInfoType(info);
+    if (hostInfo->id != FAABRIC_INFO_NULL) {
+        throw std::runtime_error("Non-null info not supported");
     }
 
-    ctx->world.allReduce(ctx->rank,
-                         (uint8_t*)sendBuf,
-                         (uint8_t*)recvBuf,
-                         hostDtype,
-                         count,
-                         hostOp);
+    // Growing the memory may move it, so hold on to the result's offset
+    ctx->module->validateNativePointer(resPtrPtr, sizeof(int32_t));
+    uint32_t resOffset = ctx->module->nativePointerToWasmOffset(resPtrPtr);
+
+    uint32_t mappedWasmPtr = allocMpiMemory(*ctx->module, memSize);
+
+    int32_t* hostResPtr =
+      (int32_t*)ctx->module->wasmOffsetToNativePointer(resOffset);
+    ctx->writeMpiResult<int32_t>(hostResPtr, mappedWasmPtr);
 
     return MPI_SUCCESS;
 }
@@ -257,37 +550,79 @@ static int32_t MPI_Alltoall_wrapper(wasm_exec_env_t execEnv,
     ctx->module->validateNativePointer(recvBuf,
                                        recvCount * hostRecvDtype->size);
 
-    ctx->world.allToAll(ctx->rank,
-                        (uint8_t*)sendBuf,
-                        hostSendDtype,
-                        sendCount,
-                        (uint8_t*)recvBuf,
-                        hostRecvDtype,
-                        recvCount);
+    ctx->allToAll((uint8_t*)sendBuf,
+                  sendCount,
+                  hostSendDtype,
+                  (uint8_t*)recvBuf,
+                  recvCount,
+                  hostRecvDtype);
 
     return MPI_SUCCESS;
 }
 
 static int32_t MPI_Alltoallv_wrapper(wasm_exec_env_t execEnv,
                                      int32_t* sendBuf,
-                                     int32_t sendCount,
-                                     int32_t sdispls,
+                                     int32_t* sendCounts,
+                                     int32_t* sdispls,
                                      int32_t* sendType,
                                      int32_t* recvBuf,
-                                     int32_t recvCount,
-                                     int32_t rdispls,
+                                     int32_t* recvCounts,
+                                     int32_t* rdispls,
                                      int32_t* recvType,
                                      int32_t* comm)
 {
-    throw std::runtime_error("MPI_Alltoallv not implemented!");
+    MPI_FUNC_ARGS("S - MPI_Alltoallv {} {} {} {} {} {} {} {} {}",
+                  (uintptr_t)sendBuf,
+                  (uintptr_t)sendCounts,
+                  (uintptr_t)sdispls,
+                  (uintptr_t)sendType,
+                  (uintptr_t)recvBuf,
+                  (uintptr_t)recvCounts,
+                  (uintptr_t)rdispls,
+                  (uintptr_t)recvType,
+                  (uintptr_t)comm);
+
+    ctx->checkMpiComm(comm);
+    faabric_datatype_t* hostSendDtype = ctx->getFaasmDataType(sendType);
+    faabric_datatype_t* hostRecvDtype = ctx->getFaasmDataType(recvType);
+
+    int worldSize = ctx->world.getSize();
+    size_t arraySize = worldSize * sizeof(int32_t);
+    ctx->module->validateNativePointer(sendCounts, arraySize);
+    ctx->module->validateNativePointer(sdispls, arraySize);
+    ctx->module->validateNativePointer(recvCounts, arraySize);
+    ctx->module->validateNativePointer(rdispls, arraySize);
+
+    size_t sendSize = 0;
+    size_t recvSize = 0;
+    for (int r = 0; r < worldSize; r++) {
+        sendSize = std::max<size_t>(
+          sendSize, (sdispls[r] + sendCounts[r]) * hostSendDtype->size);
+        recvSize = std::max<size_t>(
+          recvSize, (rdispls[r] + recvCounts[r]) * hostRecvDtype->size);
+    }
+    ctx->module->validateNativePointer(sendBuf, sendSize);
+    ctx->module->validateNativePointer(recvBuf, recvSize);
+
+    mpiAllToAllV(ctx->world,
+                 ctx->rank,
+                 (uint8_t*)sendBuf,
+                 sendCounts,
+                 sdispls,
+                 hostSendDtype,
+                 (uint8_t*)recvBuf,
+                 recvCounts,
+                 rdispls,
+                 hostRecvDtype);
+
+    return MPI_SUCCESS;
 }
 
 static int32_t MPI_Barrier_wrapper(wasm_exec_env_t execEnv, int32_t* comm)
 {
     MPI_FUNC_ARGS("S - MPI_Barrier {}", (uintptr_t)comm);
 
-    ctx->checkMpiComm(comm);
-    ctx->world.barrier(ctx->rank);
+    ctx->barrier(ctx->getCommId(comm));
 
     return MPI_SUCCESS;
 }
@@ -306,74 +641,50 @@ static int32_t MPI_Bcast_wrapper(wasm_exec_env_t execEnv,
                   root,
                   (uintptr_t)comm);
 
-    ctx->checkMpiComm(comm);
-    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
-
-    ctx->module->validateNativePointer(buffer, count * hostDtype->size);
-
-    ctx->world.broadcast(root,
-                         ctx->rank,
-                         reinterpret_cast<uint8_t*>(buffer),
-                         hostDtype,
-                         count,
-                         MPIMessage::BROADCAST);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    ctx->broadcast(ctx->getMpiBuffer(buffer, hostDtype, count),
+                   count,
+                   hostDtype,
+                   root,
+                   ctx->getCommId(comm));
 
     return MPI_SUCCESS;
 }
 
+// With reorder set, ranks may be renumbered so grid neighbours are on the
+// same host (see createMpiCartCommunicator). Ranks left off the grid get a
+// null communicator.
 static int32_t MPI_Cart_create_wrapper(wasm_exec_env_t execEnv,
                                        int32_t* oldCommPtrPtr,
                                        int32_t ndims,
-                                       int32_t dims,
-                                       int32_t periods,
+                                       int32_t* dims,
+                                       int32_t* periods,
                                        int32_t reorder,
                                        int32_t* newCommPtrPtr)
 {
     MPI_FUNC_ARGS("S - MPI_Cart_create {} {} {} {} {} {}",
                   (uintptr_t)oldCommPtrPtr,
                   ndims,
-                  dims,
-                  periods,
+                  (uintptr_t)dims,
+                  (uintptr_t)periods,
                   reorder,
                   (uintptr_t)newCommPtrPtr);
 
-    // Note that the communicator pointers are, in fact, double pointers.
-    // Double pointers are particularly confusing because the first pointer
-    // is converted from a wasm offset into a native pointer by WAMR, but the
-    // second one is not. Therefore, when operating on a double pointer, we
-    // need to convert the pointed to offset into a native pointer
-    ctx->module->validateNativePointer(newCommPtrPtr, sizeof(MPI_Comm));
-    MPI_Comm* newCommPtr = reinterpret_cast<MPI_Comm*>(newCommPtrPtr);
-
-    // Allocate memory for the pointed-to faabric_communicator_t
-    faabric_communicator_t* hostNewCommPtr = nullptr;
-    uint32_t wasmPtr = ctx->module->wasmModuleMalloc(
-      sizeof(faabric_communicator_t), (void**)&hostNewCommPtr);
-    if (wasmPtr == 0) {
-        SPDLOG_ERROR("Error allocating memory in the WASM's heap");
-        throw std::runtime_error("Error allocating memory in the WASM heap");
+    ctx->module->validateNativePointer(dims, sizeof(int) * ndims);
+    ctx->module->validateNativePointer(periods, sizeof(int) * ndims);
+
+    std::vector<int> dimsVec(dims, dims + ndims);
+    std::vector<bool> periodsVec(periods, periods + ndims);
+
+    int parentId = ctx->getComm(oldCommPtrPtr).getId();
+    int commId = createMpiCartCommunicator(
+      ctx->world, ctx->rank, parentId, dimsVec, periodsVec, reorder != 0);
+    if (commId < 0) {
+        ctx->module->validateNativePointer(newCommPtrPtr, sizeof(MPI_Comm));
+        *newCommPtrPtr = 0;
+    } else {
+        ctx->writeNewComm(newCommPtrPtr, commId);
     }
-    assert(hostNewCommPtr != nullptr);
-
-    // Assign the new offset (i.e. wasm pointer) to the MPI_Comm value. Note
-    // that we are assigning a WASM offset to a native pointer, hence why we
-    // need to force the casting to let the compiler know we know what we are
-    // doing. Be _very_ careful with this unaligned writes, as it has happened
-    // before that they smash other values in the stack if not used properly
-    faabric::util::unalignedWrite<faabric_communicator_t*>(
-      reinterpret_cast<faabric_communicator_t*>(wasmPtr),
-      reinterpret_cast<uint8_t*>(newCommPtr));
-
-    // Populate the new communicator with values from the old communicator
-    ctx->module->validateNativePointer(oldCommPtrPtr, sizeof(MPI_Comm));
-    MPI_Comm* oldCommPtr = reinterpret_cast<MPI_Comm*>(oldCommPtrPtr);
-
-    // Be careful, as *newCommPtr is a WASM offset, not a native pointer. We
-    // need the native pointer to copy the values from the old communicator
-    faabric_communicator_t* hostOldCommPtr =
-      reinterpret_cast<faabric_communicator_t*>(
-        ctx->module->wasmOffsetToNativePointer((uintptr_t)*oldCommPtr));
-    *hostNewCommPtr = *hostOldCommPtr;
 
     return MPI_SUCCESS;
 }
@@ -392,7 +703,12 @@ static int32_t MPI_Cart_get_wrapper(wasm_exec_env_t execEnv,
                   (uintptr_t)periods,
                   (uintptr_t)coords);
 
-    if (maxdims < MPI_CART_MAX_DIMENSIONS) {
+    MpiCommunicator& hostComm = ctx->getComm(comm);
+
+    int ndims = hostComm.hasCartTopology()
+                  ? (int)hostComm.getCartDims().size()
+                  : MPI_CART_MAX_DIMENSIONS;
+    if (maxdims < ndims) {
         SPDLOG_ERROR("Unexpected number of max. dimensions: {}", maxdims);
         throw std::runtime_error("Bad dimensions in MPI_Cart_get");
     }
@@ -401,7 +717,18 @@ static int32_t MPI_Cart_get_wrapper(wasm_exec_env_t execEnv,
     ctx->module->validateNativePointer(periods, sizeof(int) * maxdims);
     ctx->module->validateNativePointer(coords, sizeof(int) * maxdims);
 
-    ctx->world.getCartesianRank(ctx->rank, maxdims, dims, periods, coords);
+    if (!hostComm.hasCartTopology()) {
+        ctx->world.getCartesianRank(
+          ctx->rank, maxdims, dims, periods, coords);
+        return MPI_SUCCESS;
+    }
+
+    std::vector<int> hostCoords = hostComm.getCartCoords(hostComm.getRank());
+    for (int d = 0; d < ndims; d++) {
+        dims[d] = hostComm.getCartDims().at(d);
+        periods[d] = hostComm.getCartPeriods().at(d) ? 1 : 0;
+        coords[d] = hostCoords.at(d);
+    }
 
     return MPI_SUCCESS;
 }
@@ -416,9 +743,18 @@ static int32_t MPI_Cart_rank_wrapper(wasm_exec_env_t execEnv,
                   (uintptr_t)coords,
                   (uintptr_t)rank);
 
-    ctx->module->validateNativePointer(coords,
-                                       sizeof(int) * MPI_CART_MAX_DIMENSIONS);
-    ctx->world.getRankFromCoords(rank, coords);
+    MpiCommunicator& hostComm = ctx->getComm(comm);
+    if (!hostComm.hasCartTopology()) {
+        ctx->module->validateNativePointer(
+          coords, sizeof(int) * MPI_CART_MAX_DIMENSIONS);
+        ctx->world.getRankFromCoords(rank, coords);
+        return MPI_SUCCESS;
+    }
+
+    int ndims = (int)hostComm.getCartDims().size();
+    ctx->module->validateNativePointer(coords, sizeof(int) * ndims);
+    ctx->module->validateNativePointer(rank, sizeof(int));
+    *rank = hostComm.getCartRank(std::vector<int>(coords, coords + ndims));
 
     return MPI_SUCCESS;
 }
@@ -437,8 +773,16 @@ static int32_t MPI_Cart_shift_wrapper(wasm_exec_env_t execEnv,
                   (uintptr_t)sourceRank,
                   (uintptr_t)destRank);
 
-    ctx->world.shiftCartesianCoords(
-      ctx->rank, direction, disp, sourceRank, destRank);
+    MpiCommunicator& hostComm = ctx->getComm(comm);
+    if (!hostComm.hasCartTopology()) {
+        ctx->world.shiftCartesianCoords(
+          ctx->rank, direction, disp, sourceRank, destRank);
+        return MPI_SUCCESS;
+    }
+
+    ctx->module->validateNativePointer(sourceRank, sizeof(int));
+    ctx->module->validateNativePointer(destRank, sizeof(int));
+    std::tie(*sourceRank, *destRank) = hostComm.shiftCart(direction, disp);
 
     return MPI_SUCCESS;
 }
@@ -447,13 +791,30 @@ static int32_t MPI_Comm_dup_wrapper(wasm_exec_env_t execEnv,
                                     int32_t* comm,
                                     int32_t* newComm)
 {
-    throw std::runtime_error("MPI_Comm_dup not implemented!");
+    MPI_FUNC_ARGS(
+      "S - MPI_Comm_dup {} {}", (uintptr_t)comm, (uintptr_t)newComm);
+
+    int parentId = ctx->getComm(comm).getId();
+    int commId = dupMpiCommunicator(ctx->world, ctx->rank, parentId);
+    ctx->writeNewComm(newComm, commId);
+
+    return MPI_SUCCESS;
 }
 
 static int32_t MPI_Comm_free_wrapper(wasm_exec_env_t execEnv, int32_t* comm)
 {
     MPI_FUNC_ARGS("MPI_Comm_free {}", (uintptr_t)comm);
-    // Deallocation is handled outside of MPI
+
+    // The guest passes an MPI_Comm*, which we set to null. The communicator
+    // in the wasm heap is left, as it's tiny
+    ctx->module->validateNativePointer(comm, sizeof(MPI_Comm));
+    int32_t commOffset = *comm;
+    if (commOffset != 0) {
+        int32_t* hostComm = reinterpret_cast<int32_t*>(
+          ctx->module->wasmOffsetToNativePointer(commOffset));
+        freeMpiCommunicator(ctx->getComm(hostComm).getId());
+        *comm = 0;
+    }
 
     return MPI_SUCCESS;
 }
@@ -465,8 +826,7 @@ static int32_t MPI_Comm_rank_wrapper(wasm_exec_env_t execEnv,
     MPI_FUNC_ARGS(
       "S - MPI_Comm_rank {} {}", (uintptr_t)comm, (uintptr_t)resPtr);
 
-    ctx->checkMpiComm(comm);
-    ctx->writeMpiResult<int>(resPtr, ctx->rank);
+    ctx->writeMpiResult<int>(resPtr, ctx->getComm(comm).getRank());
 
     return MPI_SUCCESS;
 }
@@ -478,8 +838,7 @@ static int32_t MPI_Comm_size_wrapper(wasm_exec_env_t execEnv,
     MPI_FUNC_ARGS(
       "S - MPI_Comm_size {} {}", (uintptr_t)comm, (uintptr_t)resPtr);
 
-    ctx->checkMpiComm(comm);
-    ctx->writeMpiResult<int>(resPtr, ctx->world.getSize());
+    ctx->writeMpiResult<int>(resPtr, ctx->getComm(comm).getSize());
 
     return MPI_SUCCESS;
 }
@@ -490,7 +849,128 @@ static int32_t MPI_Comm_split_wrapper(wasm_exec_env_t execEnv,
                                       int32_t key,
                                       int32_t* newComm)
 {
-    throw std::runtime_error("MPI_Comm_split not implemented!");
+    MPI_FUNC_ARGS("S - MPI_Comm_split {} {} {} {}",
+                  (uintptr_t)comm,
+                  color,
+                  key,
+                  (uintptr_t)newComm);
+
+    int parentId = ctx->getComm(comm).getId();
+    int commId =
+      splitMpiCommunicator(ctx->world, ctx->rank, parentId, color, key);
+    if (commId < 0) {
+        ctx->module->validateNativePointer(newComm, sizeof(MPI_Comm));
+        *newComm = 0;
+    } else {
+        ctx->writeNewComm(newComm, commId);
+    }
+
+    return MPI_SUCCESS;
+}
+
+static int32_t MPI_File_close_wrapper(wasm_exec_env_t execEnv, int32_t* fh)
+{
+    MPI_FUNC_ARGS("S - MPI_File_close {}", (uintptr_t)fh);
+
+    ctx->module->validateNativePointer(fh, sizeof(int32_t));
+    closeMpiFile(*fh);
+    *fh = 0;
+
+    return MPI_SUCCESS;
+}
+
+static int32_t MPI_File_get_size_wrapper(wasm_exec_env_t execEnv,
+                                         int32_t fh,
+                                         int64_t* size)
+{
+    MPI_FUNC_ARGS("S - MPI_File_get_size {} {}", fh, (uintptr_t)size);
+
+    ctx->module->validateNativePointer(size, sizeof(int64_t));
+    *size = getMpiFile(fh).getSize();
+
+    return MPI_SUCCESS;
+}
+
+// Opens a shared file collectively over the communicator (see MpiFile). The
+// guest's MPI_File holds the file's ID. Hints in the info are ignored.
+static int32_t MPI_File_open_wrapper(wasm_exec_env_t execEnv,
+                                     int32_t* comm,
+                                     const char* filename,
+                                     int32_t amode,
+                                     int32_t* info,
+                                     int32_t* fh)
+{
+    MPI_FUNC_ARGS("S - MPI_File_open {} {} {} {} {}",
+                  (uintptr_t)comm,
+                  filename,
+                  amode,
+                  (uintptr_t)info,
+                  (uintptr_t)fh);
+
+    int fileId = openMpiFile(
+      ctx->world, ctx->rank, ctx->getComm(comm).getId(), filename, amode);
+    ctx->module->validateNativePointer(fh, sizeof(int32_t));
+    *fh = fileId;
+
+    return MPI_SUCCESS;
+}
+
+static int32_t MPI_File_read_at_all_wrapper(wasm_exec_env_t execEnv,
+                                            int32_t fh,
+                                            int64_t offset,
+                                            int32_t* buffer,
+                                            int32_t count,
+                                            int32_t* datatype,
+                                            int32_t* statusPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_File_read_at_all {} {} {} {} {} {}",
+                  fh,
+                  offset,
+                  (uintptr_t)buffer,
+                  count,
+                  (uintptr_t)datatype,
+                  (uintptr_t)statusPtr);
+
+    ctx->module->validateNativePointer(statusPtr, sizeof(MPI_Status));
+    MPI_Status* status = reinterpret_cast<MPI_Status*>(statusPtr);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    ctx->fileReadAtAll(fh,
+                       offset,
+                       ctx->getMpiBuffer(buffer, hostDtype, count),
+                       count,
+                       hostDtype,
+                       status);
+
+    return MPI_SUCCESS;
+}
+
+static int32_t MPI_File_write_at_all_wrapper(wasm_exec_env_t execEnv,
+                                             int32_t fh,
+                                             int64_t offset,
+                                             int32_t* buffer,
+                                             int32_t count,
+                                             int32_t* datatype,
+                                             int32_t* statusPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_File_write_at_all {} {} {} {} {} {}",
+                  fh,
+                  offset,
+                  (uintptr_t)buffer,
+                  count,
+                  (uintptr_t)datatype,
+                  (uintptr_t)statusPtr);
+
+    ctx->module->validateNativePointer(statusPtr, sizeof(MPI_Status));
+    MPI_Status* status = reinterpret_cast<MPI_Status*>(statusPtr);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    ctx->fileWriteAtAll(fh,
+                        offset,
+                        ctx->getMpiBuffer(buffer, hostDtype, count),
+                        count,
+                        hostDtype,
+                        status);
+
+    return MPI_SUCCESS;
 }
 
 static int32_t MPI_Finalize_wrapper(wasm_exec_env_t execEnv)
@@ -500,6 +980,18 @@ static int32_t MPI_Finalize_wrapper(wasm_exec_env_t execEnv)
     return terminateMpi();
 }
 
+static int32_t MPI_Free_mem_wrapper(wasm_exec_env_t execEnv, int32_t* basePtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Free_mem {}", (uintptr_t)basePtr);
+
+    // Only unlocks the memory, leaving it in place as we do with munmap
+    ctx->module->validateNativePointer(basePtr, 1);
+    uint32_t baseOffset = ctx->module->nativePointerToWasmOffset(basePtr);
+    freeMpiMemory(*ctx->module, baseOffset);
+
+    return MPI_SUCCESS;
+}
+
 static int32_t MPI_Gather_wrapper(wasm_exec_env_t execEnv,
                                   int32_t* sendBuf,
                                   int32_t sendCount,
@@ -534,6 +1026,7 @@ static int32_t MPI_Gather_wrapper(wasm_exec_env_t execEnv,
                                            sendCount * hostSendDtype->size);
     }
 
+    awaitMpiCollectives();
     ctx->world.gather(ctx->rank,
                       root,
                       (uint8_t*)sendBuf,
@@ -546,6 +1039,46 @@ static int32_t MPI_Gather_wrapper(wasm_exec_env_t execEnv,
     return MPI_SUCCESS;
 }
 
+/**
+ * One-sided read from another rank's window.
+ */
+static int32_t MPI_Get_wrapper(wasm_exec_env_t execEnv,
+                               int32_t* recvBuf,
+                               int32_t recvCount,
+                               int32_t* recvType,
+                               int32_t sendRank,
+                               int32_t sendOffset,
+                               int32_t sendCount,
+                               int32_t* sendType,
+                               int32_t* win)
+{
+    MPI_FUNC_ARGS("S - MPI_Get {} {} {} {} {} {} {} {}",
+                  (uintptr_t)recvBuf,
+                  recvCount,
+                  (uintptr_t)recvType,
+                  sendRank,
+                  sendOffset,
+                  sendCount,
+                  (uintptr_t)sendType,
+                  (uintptr_t)win);
+
+    faabric_datatype_t* hostRecvDtype = ctx->getFaasmDataType(recvType);
+    faabric_datatype_t* hostSendDtype = ctx->getFaasmDataType(sendType);
+    size_t nBytes = recvCount * hostRecvDtype->size;
+    if (nBytes != (size_t)(sendCount * hostSendDtype->size)) {
+        SPDLOG_ERROR("MPI_Get size mismatch ({} != {})",
+                     nBytes,
+                     sendCount * hostSendDtype->size);
+        throw std::runtime_error("MPI_Get size mismatch");
+    }
+
+    ctx->module->validateNativePointer(recvBuf, nBytes);
+    getMpiWindow(ctx->getWindowPtr(win))
+      .get(sendRank, sendOffset, (uint8_t*)recvBuf, nBytes);
+
+    return MPI_SUCCESS;
+}
+
 static int32_t MPI_Get_count_wrapper(wasm_exec_env_t execEnv,
                                      int32_t* statusPtr,
                                      int32_t* datatype,
@@ -593,36 +1126,162 @@ static int32_t MPI_Get_version_wrapper(wasm_exec_env_t execEnv,
     throw std::runtime_error("MPI_Get_version not implemented!");
 }
 
-static int32_t MPI_Init_wrapper(wasm_exec_env_t execEnv, int32_t a, int32_t b)
+// Non-blocking collectives keep native pointers to the buffers until they're
+// waited on, so have the same caveat as MPI_Wait below
+static int32_t MPI_Iallreduce_wrapper(wasm_exec_env_t execEnv,
+                                      int32_t* sendBuf,
+                                      int32_t* recvBuf,
+                                      int32_t count,
+                                      int32_t* datatype,
+                                      int32_t* op,
+                                      int32_t* comm,
+                                      int32_t* requestPtrPtr)
 {
-    faabric::Message* call =
-      &faabric::scheduler::ExecutorContext::get()->getMsg();
-
-    // Note - only want to initialise the world on rank zero (or when rank isn't
-    // set yet)
-    if (call->mpirank() <= 0) {
-        SPDLOG_DEBUG("MPI_Init (create)");
+    MPI_FUNC_ARGS("S - MPI_Iallreduce {} {} {} {} {} {} {}",
+                  (uintptr_t)sendBuf,
+                  (uintptr_t)recvBuf,
+                  count,
+                  (uintptr_t)datatype,
+                  (uintptr_t)op,
+                  (uintptr_t)comm,
+                  (uintptr_t)requestPtrPtr);
 
-        // Initialise the world
-        int worldId = executingContext.createWorld(*call);
-        call->set_mpiworldid(worldId);
-    } else {
-        SPDLOG_DEBUG("MPI_Init (join)");
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
+    faabric_op_t* hostOp = ctx->getFaasmOp(op);
+    uint8_t* hostRecvBuffer = ctx->getMpiBuffer(recvBuf, hostDtype, count);
+    uint8_t* hostSendBuffer = ctx->getMpiSendBuffer(sendBuf, hostDtype, count);
+
+    // User ops call into the guest, so can't run on the progress thread
+    if (isMpiUserOp(hostOp->id)) {
+        ctx->module->validateNativePointer(requestPtrPtr, sizeof(int32_t));
+        uint32_t requestOffset =
+          ctx->module->nativePointerToWasmOffset(requestPtrPtr);
+
+        reduceWithUserOp(execEnv,
+                         ctx->getComm(comm),
+                         -1,
+                         hostSendBuffer ? sendBuf : recvBuf,
+                         recvBuf,
+                         datatype,
+                         count,
+                         hostOp->id);
 
-        // Join the world
-        executingContext.joinWorld(*call);
+        ctx->writeFaasmRequestId(
+          (int32_t*)ctx->module->wasmOffsetToNativePointer(requestOffset), 0);
+        return MPI_SUCCESS;
     }
 
-    ctx = std::make_unique<WamrMpiContextWrapper>();
+    int requestId = ctx->iallReduce(hostSendBuffer,
+                                    hostRecvBuffer,
+                                    count,
+                                    hostDtype,
+                                    hostOp,
+                                    ctx->getCommId(comm));
 
-    return 0;
+    ctx->writeFaasmRequestId(requestPtrPtr, requestId);
+
+    return MPI_SUCCESS;
 }
 
-static int32_t MPI_Irecv_wrapper(wasm_exec_env_t execEnv,
-                                 int32_t* buffer,
-                                 int32_t count,
-                                 int32_t* datatype,
-                                 int32_t sourceRank,
+static int32_t MPI_Ialltoall_wrapper(wasm_exec_env_t execEnv,
+                                     int32_t* sendBuf,
+                                     int32_t sendCount,
+                                     int32_t* sendType,
+                                     int32_t* recvBuf,
+                                     int32_t recvCount,
+                                     int32_t* recvType,
+                                     int32_t* comm,
+                                     int32_t* requestPtrPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Ialltoall {} {} {} {} {} {} {} {}",
+                  (uintptr_t)sendBuf,
+                  sendCount,
+                  (uintptr_t)sendType,
+                  (uintptr_t)recvBuf,
+                  recvCount,
+                  (uintptr_t)recvType,
+                  (uintptr_t)comm,
+                  (uintptr_t)requestPtrPtr);
+
+    ctx->checkMpiComm(comm);
+    faabric_datatype_t* hostSendDtype = ctx->getFaasmDataType(sendType);
+    faabric_datatype_t* hostRecvDtype = ctx->getFaasmDataType(recvType);
+
+    ctx->module->validateNativePointer(sendBuf,
+                                       sendCount * hostSendDtype->size);
+    ctx->module->validateNativePointer(recvBuf,
+                                       recvCount * hostRecvDtype->size);
+
+    int requestId = ctx->iallToAll((uint8_t*)sendBuf,
+                                   sendCount,
+                                   hostSendDtype,
+                                   (uint8_t*)recvBuf,
+                                   recvCount,
+                                   hostRecvDtype);
+
+    ctx->writeFaasmRequestId(requestPtrPtr, requestId);
+
+    return MPI_SUCCESS;
+}
+
+static int32_t MPI_Ibcast_wrapper(wasm_exec_env_t execEnv,
+                                  int32_t* buffer,
+                                  int32_t count,
+                                  int32_t* datatype,
+                                  int32_t root,
+                                  int32_t* comm,
+                                  int32_t* requestPtrPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Ibcast {} {} {} {} {} {}",
+                  (uintptr_t)buffer,
+                  count,
+                  (uintptr_t)datatype,
+                  root,
+                  (uintptr_t)comm,
+                  (uintptr_t)requestPtrPtr);
+
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    int requestId = ctx->ibroadcast(ctx->getMpiBuffer(buffer, hostDtype, count),
+                                    count,
+                                    hostDtype,
+                                    root,
+                                    ctx->getCommId(comm));
+
+    ctx->writeFaasmRequestId(requestPtrPtr, requestId);
+
+    return MPI_SUCCESS;
+}
+
+static int32_t MPI_Init_wrapper(wasm_exec_env_t execEnv, int32_t a, int32_t b)
+{
+    faabric::Message* call =
+      &faabric::scheduler::ExecutorContext::get()->getMsg();
+
+    // Note - only want to initialise the world on rank zero (or when rank isn't
+    // set yet)
+    if (call->mpirank() <= 0) {
+        SPDLOG_DEBUG("MPI_Init (create)");
+
+        // Initialise the world
+        int worldId = executingContext.createWorld(*call);
+        call->set_mpiworldid(worldId);
+    } else {
+        SPDLOG_DEBUG("MPI_Init (join)");
+
+        // Join the world
+        executingContext.joinWorld(*call);
+    }
+
+    ctx.build();
+
+    return 0;
+}
+
+static int32_t MPI_Irecv_wrapper(wasm_exec_env_t execEnv,
+                                 int32_t* buffer,
+                                 int32_t count,
+                                 int32_t* datatype,
+                                 int32_t sourceRank,
                                  int32_t tag,
                                  int32_t* comm,
                                  int32_t* requestPtrPtr)
@@ -636,13 +1295,12 @@ static int32_t MPI_Irecv_wrapper(wasm_exec_env_t execEnv,
                   (uintptr_t)comm,
                   (uintptr_t)requestPtrPtr);
 
-    ctx->checkMpiComm(comm);
-    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
-
-    ctx->module->validateNativePointer(buffer, count * hostDtype->size);
-
-    int requestId = ctx->world.irecv(
-      sourceRank, ctx->rank, (uint8_t*)buffer, hostDtype, count);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    int requestId = ctx->irecv(ctx->getMpiBuffer(buffer, hostDtype, count),
+                               count,
+                               hostDtype,
+                               sourceRank,
+                               ctx->getCommId(comm));
 
     ctx->writeFaasmRequestId(requestPtrPtr, requestId);
 
@@ -667,29 +1325,57 @@ static int32_t MPI_Isend_wrapper(wasm_exec_env_t execEnv,
                   (uintptr_t)comm,
                   (uintptr_t)requestPtrPtr);
 
-    ctx->checkMpiComm(comm);
-    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
-
-    ctx->module->validateNativePointer(buffer, count * hostDtype->size);
-    int requestId =
-      ctx->world.isend(ctx->rank, destRank, (uint8_t*)buffer, hostDtype, count);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    int requestId = ctx->isend(ctx->getMpiBuffer(buffer, hostDtype, count),
+                               count,
+                               hostDtype,
+                               destRank,
+                               ctx->getCommId(comm));
 
     ctx->writeFaasmRequestId(requestPtrPtr, requestId);
 
     return MPI_SUCCESS;
 }
 
+// The user function is a table index, so is passed as an integer
 static int32_t MPI_Op_create_wrapper(wasm_exec_env_t execEnv,
-                                     int32_t* userFn,
+                                     int32_t userFn,
                                      int32_t commute,
-                                     int32_t op)
+                                     int32_t* op)
 {
-    throw std::runtime_error("MPI_Op_create not implemented!");
+    MPI_FUNC_ARGS(
+      "S - MPI_Op_create {} {} {}", userFn, commute, (uintptr_t)op);
+
+    ctx->module->validateNativePointer(op, sizeof(MPI_Op));
+
+    faabric_op_t* hostOp = nullptr;
+    uint32_t wasmPtr =
+      ctx->module->wasmModuleMalloc(sizeof(faabric_op_t), (void**)&hostOp);
+    hostOp->id = createMpiUserOp(userFn, commute != 0);
+
+    // See writeNewComm for why the write is unaligned
+    faabric::util::unalignedWrite<faabric_op_t*>(
+      reinterpret_cast<faabric_op_t*>(wasmPtr),
+      reinterpret_cast<uint8_t*>(op));
+
+    return MPI_SUCCESS;
 }
 
 static int32_t MPI_Op_free_wrapper(wasm_exec_env_t execEnv, int32_t* op)
 {
-    throw std::runtime_error("MPI_Op_free not implemented!");
+    MPI_FUNC_ARGS("S - MPI_Op_free {}", (uintptr_t)op);
+
+    ctx->module->validateNativePointer(op, sizeof(MPI_Op));
+    int32_t opOffset = *op;
+    if (opOffset != 0) {
+        int32_t* hostOp = reinterpret_cast<int32_t*>(
+          ctx->module->wasmOffsetToNativePointer(opOffset));
+        freeMpiUserOp(ctx->getFaasmOp(hostOp)->id);
+        wasm_runtime_module_free(ctx->module->getModuleInstance(), opOffset);
+        *op = 0;
+    }
+
+    return MPI_SUCCESS;
 }
 
 static int32_t MPI_Probe_wrapper(wasm_exec_env_t execEnv,
@@ -707,6 +1393,46 @@ static int32_t MPI_Probe_wrapper(wasm_exec_env_t execEnv,
     throw std::runtime_error("MPI_Probe not implemented!");
 }
 
+/**
+ * One-sided write to another rank's window.
+ */
+static int32_t MPI_Put_wrapper(wasm_exec_env_t execEnv,
+                               int32_t* sendBuf,
+                               int32_t sendCount,
+                               int32_t* sendType,
+                               int32_t recvRank,
+                               int32_t recvOffset,
+                               int32_t recvCount,
+                               int32_t* recvType,
+                               int32_t* win)
+{
+    MPI_FUNC_ARGS("S - MPI_Put {} {} {} {} {} {} {} {}",
+                  (uintptr_t)sendBuf,
+                  sendCount,
+                  (uintptr_t)sendType,
+                  recvRank,
+                  recvOffset,
+                  recvCount,
+                  (uintptr_t)recvType,
+                  (uintptr_t)win);
+
+    faabric_datatype_t* hostSendDtype = ctx->getFaasmDataType(sendType);
+    faabric_datatype_t* hostRecvDtype = ctx->getFaasmDataType(recvType);
+    size_t nBytes = sendCount * hostSendDtype->size;
+    if (nBytes != (size_t)(recvCount * hostRecvDtype->size)) {
+        SPDLOG_ERROR("MPI_Put size mismatch ({} != {})",
+                     nBytes,
+                     recvCount * hostRecvDtype->size);
+        throw std::runtime_error("MPI_Put size mismatch");
+    }
+
+    ctx->module->validateNativePointer(sendBuf, nBytes);
+    getMpiWindow(ctx->getWindowPtr(win))
+      .put(recvRank, recvOffset, (uint8_t*)sendBuf, nBytes);
+
+    return MPI_SUCCESS;
+}
+
 static int32_t MPI_Recv_wrapper(wasm_exec_env_t execEnv,
                                 int32_t* buffer,
                                 int32_t count,
@@ -725,15 +1451,47 @@ static int32_t MPI_Recv_wrapper(wasm_exec_env_t execEnv,
                   (uintptr_t)comm,
                   (uintptr_t)statusPtr);
 
-    ctx->checkMpiComm(comm);
     ctx->module->validateNativePointer(statusPtr, sizeof(MPI_Status));
     MPI_Status* status = reinterpret_cast<MPI_Status*>(statusPtr);
-    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    ctx->recv(ctx->getMpiBuffer(buffer, hostDtype, count),
+              count,
+              hostDtype,
+              sourceRank,
+              ctx->getCommId(comm),
+              status);
+
+    return MPI_SUCCESS;
+}
 
-    ctx->module->validateNativePointer(buffer, count * hostDtype->size);
+// Persistent requests keep native pointers to their buffers, so have the same
+// caveat as MPI_Wait below
+static int32_t MPI_Recv_init_wrapper(wasm_exec_env_t execEnv,
+                                     int32_t* buffer,
+                                     int32_t count,
+                                     int32_t* datatype,
+                                     int32_t sourceRank,
+                                     int32_t tag,
+                                     int32_t* comm,
+                                     int32_t* requestPtrPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Recv_init {} {} {} {} {} {} {}",
+                  (uintptr_t)buffer,
+                  count,
+                  (uintptr_t)datatype,
+                  sourceRank,
+                  tag,
+                  (uintptr_t)comm,
+                  (uintptr_t)requestPtrPtr);
 
-    ctx->world.recv(
-      sourceRank, ctx->rank, (uint8_t*)buffer, hostDtype, count, status);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    int requestId = ctx->recvInit(ctx->getMpiBuffer(buffer, hostDtype, count),
+                                  count,
+                                  hostDtype,
+                                  sourceRank,
+                                  ctx->getCommId(comm));
+
+    ctx->writeFaasmRequestId(requestPtrPtr, requestId);
 
     return MPI_SUCCESS;
 }
@@ -756,25 +1514,30 @@ static int32_t MPI_Reduce_wrapper(wasm_exec_env_t execEnv,
                   root,
                   (uintptr_t)comm);
 
-    ctx->checkMpiComm(comm);
     faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
     faabric_op_t* hostOp = ctx->getFaasmOp(op);
-
-    ctx->module->validateNativePointer(recvBuf, count * hostDtype->size);
-
-    if (ctx->isInPlace(sendBuf)) {
-        sendBuf = recvBuf;
-    } else {
-        ctx->module->validateNativePointer(sendBuf, count * hostDtype->size);
+    uint8_t* hostRecvBuffer = ctx->getMpiBuffer(recvBuf, hostDtype, count);
+    uint8_t* hostSendBuffer = ctx->getMpiSendBuffer(sendBuf, hostDtype, count);
+
+    if (isMpiUserOp(hostOp->id)) {
+        reduceWithUserOp(execEnv,
+                         ctx->getComm(comm),
+                         root,
+                         hostSendBuffer ? sendBuf : recvBuf,
+                         recvBuf,
+                         datatype,
+                         count,
+                         hostOp->id);
+        return MPI_SUCCESS;
     }
 
-    ctx->world.reduce(ctx->rank,
-                      root,
-                      (uint8_t*)sendBuf,
-                      (uint8_t*)recvBuf,
-                      hostDtype,
-                      count,
-                      hostOp);
+    ctx->reduce(hostSendBuffer,
+                hostRecvBuffer,
+                count,
+                hostDtype,
+                hostOp,
+                root,
+                ctx->getCommId(comm));
 
     return MPI_SUCCESS;
 }
@@ -782,18 +1545,62 @@ static int32_t MPI_Reduce_wrapper(wasm_exec_env_t execEnv,
 static int32_t MPI_Reduce_scatter_wrapper(wasm_exec_env_t execEnv,
                                           int32_t* sendBuf,
                                           int32_t* recvBuf,
-                                          int32_t recvCount,
+                                          int32_t* recvCounts,
                                           int32_t* datatype,
                                           int32_t* op,
                                           int32_t* comm)
 {
-    throw std::runtime_error("MPI_Reduce_scatter not implemented!");
+    MPI_FUNC_ARGS("S - MPI_Reduce_scatter {} {} {} {} {} {}",
+                  (uintptr_t)sendBuf,
+                  (uintptr_t)recvBuf,
+                  (uintptr_t)recvCounts,
+                  (uintptr_t)datatype,
+                  (uintptr_t)op,
+                  (uintptr_t)comm);
+
+    ctx->checkMpiComm(comm);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
+    faabric_op_t* hostOp = ctx->getFaasmOp(op);
+
+    int worldSize = ctx->world.getSize();
+    ctx->module->validateNativePointer(recvCounts, worldSize * sizeof(int32_t));
+    int totalCount = 0;
+    for (int r = 0; r < worldSize; r++) {
+        totalCount += recvCounts[r];
+    }
+
+    // In-place, the receive buffer holds all the data to start with
+    if (ctx->isInPlace(sendBuf)) {
+        ctx->module->validateNativePointer(recvBuf,
+                                           totalCount * hostDtype->size);
+        sendBuf = recvBuf;
+    } else {
+        ctx->module->validateNativePointer(
+          recvBuf, recvCounts[ctx->rank] * hostDtype->size);
+        ctx->module->validateNativePointer(sendBuf,
+                                           totalCount * hostDtype->size);
+    }
+
+    mpiReduceScatter(ctx->world,
+                     ctx->rank,
+                     (uint8_t*)sendBuf,
+                     (uint8_t*)recvBuf,
+                     recvCounts,
+                     hostDtype,
+                     hostOp);
+
+    return MPI_SUCCESS;
 }
 
 static int32_t MPI_Request_free_wrapper(wasm_exec_env_t execEnv,
                                         int32_t* requestPtr)
 {
-    throw std::runtime_error("MPI_Request_free not implemented!");
+    MPI_FUNC_ARGS("S - MPI_Request_free {}", (uintptr_t)requestPtr);
+
+    freeMpiRequest(ctx->getFaasmRequestId(requestPtr));
+    ctx->writeFaasmRequestId(requestPtr, 0);
+
+    return MPI_SUCCESS;
 }
 
 static int32_t MPI_Rsend_wrapper(wasm_exec_env_t execEnv,
@@ -835,6 +1642,7 @@ static int32_t MPI_Scan_wrapper(wasm_exec_env_t execEnv,
         ctx->module->validateNativePointer(sendBuf, count * hostDtype->size);
     }
 
+    awaitMpiCollectives();
     ctx->world.scan(ctx->rank,
                     (uint8_t*)sendBuf,
                     (uint8_t*)recvBuf,
@@ -874,6 +1682,7 @@ static int32_t MPI_Scatter_wrapper(wasm_exec_env_t execEnv,
     ctx->module->validateNativePointer(recvBuf,
                                        recvCount * hostRecvDtype->size);
 
+    awaitMpiCollectives();
     ctx->world.scatter(root,
                        ctx->rank,
                        (uint8_t*)sendBuf,
@@ -896,12 +1705,42 @@ static int32_t MPI_Send_wrapper(wasm_exec_env_t execEnv,
 {
     MPI_FUNC_ARGS("S - MPI_Send {} -> {}", ctx->rank, destRank);
 
-    ctx->checkMpiComm(comm);
-    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    ctx->send(ctx->getMpiBuffer(buffer, hostDtype, count),
+              count,
+              hostDtype,
+              destRank,
+              ctx->getCommId(comm));
+
+    return MPI_SUCCESS;
+}
+
+static int32_t MPI_Send_init_wrapper(wasm_exec_env_t execEnv,
+                                     int32_t* buffer,
+                                     int32_t count,
+                                     int32_t* datatype,
+                                     int32_t destRank,
+                                     int32_t tag,
+                                     int32_t* comm,
+                                     int32_t* requestPtrPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Send_init {} {} {} {} {} {} {}",
+                  (uintptr_t)buffer,
+                  count,
+                  (uintptr_t)datatype,
+                  destRank,
+                  tag,
+                  (uintptr_t)comm,
+                  (uintptr_t)requestPtrPtr);
 
-    ctx->module->validateNativePointer(buffer, count * hostDtype->size);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    int requestId = ctx->sendInit(ctx->getMpiBuffer(buffer, hostDtype, count),
+                                  count,
+                                  hostDtype,
+                                  destRank,
+                                  ctx->getCommId(comm));
 
-    ctx->world.send(ctx->rank, destRank, (uint8_t*)buffer, hostDtype, count);
+    ctx->writeFaasmRequestId(requestPtrPtr, requestId);
 
     return MPI_SUCCESS;
 }
@@ -934,28 +1773,46 @@ static int32_t MPI_Sendrecv_wrapper(wasm_exec_env_t execEnv,
                   (uintptr_t)comm,
                   (uintptr_t)statusPtr);
 
-    ctx->checkMpiComm(comm);
-    faabric_datatype_t* hostSendDtype = ctx->getFaasmDataType(sendType);
-    faabric_datatype_t* hostRecvDtype = ctx->getFaasmDataType(recvType);
+    faabric_datatype_t* hostSendDtype = ctx->getFaasmDataType(sendType, true);
+    faabric_datatype_t* hostRecvDtype = ctx->getFaasmDataType(recvType, true);
 
     ctx->module->validateNativePointer(statusPtr, sizeof(MPI_Status));
     MPI_Status* status = reinterpret_cast<MPI_Status*>(statusPtr);
 
-    ctx->module->validateNativePointer(sendBuf,
-                                       sendCount * hostSendDtype->size);
-    ctx->module->validateNativePointer(recvBuf,
-                                       recvCount * hostRecvDtype->size);
+    ctx->sendRecv(ctx->getMpiBuffer(sendBuf, hostSendDtype, sendCount),
+                  sendCount,
+                  hostSendDtype,
+                  destination,
+                  ctx->getMpiBuffer(recvBuf, hostRecvDtype, recvCount),
+                  recvCount,
+                  hostRecvDtype,
+                  source,
+                  ctx->getCommId(comm),
+                  status);
 
-    ctx->world.sendRecv((uint8_t*)sendBuf,
-                        sendCount,
-                        hostSendDtype,
-                        destination,
-                        (uint8_t*)recvBuf,
-                        recvCount,
-                        hostRecvDtype,
-                        source,
-                        ctx->rank,
-                        status);
+    return MPI_SUCCESS;
+}
+
+static int32_t MPI_Start_wrapper(wasm_exec_env_t execEnv,
+                                 int32_t* requestPtrPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Start {}", (uintptr_t)requestPtrPtr);
+
+    startMpiPersistentRequest(ctx->getFaasmRequestId(requestPtrPtr));
+
+    return MPI_SUCCESS;
+}
+
+static int32_t MPI_Startall_wrapper(wasm_exec_env_t execEnv,
+                                    int32_t count,
+                                    int32_t* requestArray)
+{
+    MPI_FUNC_ARGS("S - MPI_Startall {} {}", count, (uintptr_t)requestArray);
+
+    ctx->module->validateNativePointer(requestArray, count * sizeof(int32_t));
+    for (int i = 0; i < count; i++) {
+        startMpiPersistentRequest(requestArray[i]);
+    }
 
     return MPI_SUCCESS;
 }
@@ -973,14 +1830,148 @@ static int32_t MPI_Type_contiguous_wrapper(wasm_exec_env_t execEnv,
                                            int32_t* oldDataTypePtr,
                                            int32_t* newDataTypePtr)
 {
-    MPI_FUNC("MPI_Type_contiguous");
+    MPI_FUNC_ARGS("S - MPI_Type_contiguous {} {} {}",
+                  count,
+                  (uintptr_t)oldDataTypePtr,
+                  (uintptr_t)newDataTypePtr);
+
+    auto oldLayout =
+      getMpiTypeLayout(ctx->getFaasmDataType(oldDataTypePtr, true));
+    ctx->writeNewDataType(newDataTypePtr, mpiTypeContiguous(count, *oldLayout));
+
+    return MPI_SUCCESS;
+}
+
+static int32_t MPI_Type_vector_wrapper(wasm_exec_env_t execEnv,
+                                       int32_t count,
+                                       int32_t blockLength,
+                                       int32_t stride,
+                                       int32_t* oldDataTypePtr,
+                                       int32_t* newDataTypePtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Type_vector {} {} {} {} {}",
+                  count,
+                  blockLength,
+                  stride,
+                  (uintptr_t)oldDataTypePtr,
+                  (uintptr_t)newDataTypePtr);
+
+    auto oldLayout =
+      getMpiTypeLayout(ctx->getFaasmDataType(oldDataTypePtr, true));
+    ctx->writeNewDataType(
+      newDataTypePtr, mpiTypeVector(count, blockLength, stride, *oldLayout));
+
+    return MPI_SUCCESS;
+}
+
+static int32_t MPI_Type_indexed_wrapper(wasm_exec_env_t execEnv,
+                                        int32_t count,
+                                        int32_t* blockLengths,
+                                        int32_t* displacements,
+                                        int32_t* oldDataTypePtr,
+                                        int32_t* newDataTypePtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Type_indexed {} {} {} {} {}",
+                  count,
+                  (uintptr_t)blockLengths,
+                  (uintptr_t)displacements,
+                  (uintptr_t)oldDataTypePtr,
+                  (uintptr_t)newDataTypePtr);
+
+    ctx->module->validateNativePointer(blockLengths, count * sizeof(int32_t));
+    ctx->module->validateNativePointer(displacements, count * sizeof(int32_t));
+    auto oldLayout =
+      getMpiTypeLayout(ctx->getFaasmDataType(oldDataTypePtr, true));
+    ctx->writeNewDataType(
+      newDataTypePtr,
+      mpiTypeIndexed(count, blockLengths, displacements, *oldLayout));
+
+    return MPI_SUCCESS;
+}
+
+static int32_t MPI_Type_create_struct_wrapper(wasm_exec_env_t execEnv,
+                                              int32_t count,
+                                              int32_t* blockLengths,
+                                              int32_t* displacements,
+                                              int32_t* types,
+                                              int32_t* newDataTypePtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Type_create_struct {} {} {} {} {}",
+                  count,
+                  (uintptr_t)blockLengths,
+                  (uintptr_t)displacements,
+                  (uintptr_t)types,
+                  (uintptr_t)newDataTypePtr);
+
+    ctx->module->validateNativePointer(blockLengths, count * sizeof(int32_t));
+    ctx->module->validateNativePointer(displacements, count * sizeof(int32_t));
+    ctx->module->validateNativePointer(types, count * sizeof(MPI_Datatype));
+
+    // The types are wasm offsets of the guest's datatype structs
+    std::vector<MpiTypeLayout> layouts;
+    for (int i = 0; i < count; i++) {
+        int32_t* typePtr = reinterpret_cast<int32_t*>(
+          ctx->module->wasmOffsetToNativePointer(types[i]));
+        layouts.push_back(
+          *getMpiTypeLayout(ctx->getFaasmDataType(typePtr, true)));
+    }
+
+    ctx->writeNewDataType(
+      newDataTypePtr,
+      mpiTypeStruct(count, blockLengths, displacements, layouts));
+
+    return MPI_SUCCESS;
+}
+
+static int32_t MPI_Type_create_subarray_wrapper(wasm_exec_env_t execEnv,
+                                                int32_t nDims,
+                                                int32_t* sizes,
+                                                int32_t* subSizes,
+                                                int32_t* starts,
+                                                int32_t order,
+                                                int32_t* oldDataTypePtr,
+                                                int32_t* newDataTypePtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Type_create_subarray {} {} {} {} {} {} {}",
+                  nDims,
+                  (uintptr_t)sizes,
+                  (uintptr_t)subSizes,
+                  (uintptr_t)starts,
+                  order,
+                  (uintptr_t)oldDataTypePtr,
+                  (uintptr_t)newDataTypePtr);
+
+    ctx->module->validateNativePointer(sizes, nDims * sizeof(int32_t));
+    ctx->module->validateNativePointer(subSizes, nDims * sizeof(int32_t));
+    ctx->module->validateNativePointer(starts, nDims * sizeof(int32_t));
+    auto oldLayout =
+      getMpiTypeLayout(ctx->getFaasmDataType(oldDataTypePtr, true));
+    ctx->writeNewDataType(
+      newDataTypePtr,
+      mpiTypeSubarray(nDims, sizes, subSizes, starts, order, *oldLayout));
 
     return MPI_SUCCESS;
 }
 
 static int32_t MPI_Type_free_wrapper(wasm_exec_env_t execEnv, int32_t* datatype)
 {
-    throw std::runtime_error("MPI_Type_free is not implemented!");
+    MPI_FUNC_ARGS("S - MPI_Type_free {}", (uintptr_t)datatype);
+
+    ctx->module->validateNativePointer(datatype, sizeof(MPI_Datatype));
+    int32_t typeOffset = *datatype;
+    if (typeOffset == 0) {
+        return MPI_SUCCESS;
+    }
+
+    int32_t* hostType = reinterpret_cast<int32_t*>(
+      ctx->module->wasmOffsetToNativePointer(typeOffset));
+    if (freeMpiDerivedType(typeOffset,
+                           ctx->getFaasmDataType(hostType, true))) {
+        wasm_runtime_module_free(ctx->module->getModuleInstance(), typeOffset);
+        *datatype = 0;
+    }
+
+    return MPI_SUCCESS;
 }
 
 static int32_t MPI_Type_size_wrapper(wasm_exec_env_t execEnv,
@@ -989,7 +1980,7 @@ static int32_t MPI_Type_size_wrapper(wasm_exec_env_t execEnv,
 {
     MPI_FUNC_ARGS("MPI_Type_size {} {}", (uintptr_t)typePtr, (uintptr_t)res);
 
-    faabric_datatype_t* hostType = ctx->getFaasmDataType(typePtr);
+    faabric_datatype_t* hostType = ctx->getFaasmDataType(typePtr, true);
     ctx->writeMpiResult<int>(res, hostType->size);
 
     return MPI_SUCCESS;
@@ -1013,7 +2004,7 @@ static int32_t MPI_Wait_wrapper(wasm_exec_env_t execEnv,
 
     MPI_FUNC_ARGS("S - MPI_Wait {} {}", (uintptr_t)requestPtrPtr, requestId);
 
-    ctx->world.awaitAsyncRequest(requestId);
+    awaitAllMpiRequests(ctx->world, { requestId });
 
     return MPI_SUCCESS;
 }
@@ -1023,16 +2014,193 @@ static int32_t MPI_Waitall_wrapper(wasm_exec_env_t execEnv,
                                    int32_t* requestArray,
                                    int32_t* statusArray)
 {
-    throw std::runtime_error("MPI_Waitall is not implemented!");
+    MPI_FUNC_ARGS("S - MPI_Waitall {} {} {}",
+                  count,
+                  (uintptr_t)requestArray,
+                  (uintptr_t)statusArray);
+
+    ctx->module->validateNativePointer(requestArray, count * sizeof(int32_t));
+    std::vector<int> requestIds(requestArray, requestArray + count);
+
+    awaitAllMpiRequests(ctx->world, requestIds);
+    for (int i = 0; i < count; i++) {
+        if (!isMpiPersistentRequest(requestIds.at(i))) {
+            requestArray[i] = 0;
+        }
+    }
+
+    return MPI_SUCCESS;
 }
 
 static int32_t MPI_Waitany_wrapper(wasm_exec_env_t execEnv,
                                    int32_t count,
                                    int32_t* requestArray,
-                                   int32_t idx,
+                                   int32_t* idx,
                                    int32_t* status)
 {
-    throw std::runtime_error("MPI_Waitany is not implemented!");
+    MPI_FUNC_ARGS("S - MPI_Waitany {} {} {} {}",
+                  count,
+                  (uintptr_t)requestArray,
+                  (uintptr_t)idx,
+                  (uintptr_t)status);
+
+    ctx->module->validateNativePointer(requestArray, count * sizeof(int32_t));
+    std::vector<int> requestIds(requestArray, requestArray + count);
+
+    int completedIdx = awaitAnyMpiRequest(ctx->world, requestIds);
+    if (completedIdx >= 0 &&
+        !isMpiPersistentRequest(requestIds.at(completedIdx))) {
+        requestArray[completedIdx] = 0;
+    }
+
+    ctx->writeMpiResult<int>(idx, completedIdx);
+
+    return MPI_SUCCESS;
+}
+
+/**
+ * Creates a window for one-sided communication. The guest's MPI_Win points to
+ * a wasm_faabric_win_t we allocate here, whose offset identifies the window.
+ * See MpiWindow for how the window memory is shared.
+ */
+static int32_t MPI_Win_create_wrapper(wasm_exec_env_t execEnv,
+                                      int32_t* basePtr,
+                                      int32_t size,
+                                      int32_t dispUnit,
+                                      int32_t* info,
+                                      int32_t* comm,
+                                      int32_t* winPtrPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Win_create {} {} {} {} {} {}",
+                  (uintptr_t)basePtr,
+                  size,
+                  dispUnit,
+                  (uintptr_t)info,
+                  (uintptr_t)comm,
+                  (uintptr_t)winPtrPtr);
+
+    ctx->checkMpiComm(comm);
+
+    faabric_info_t* hostInfo = ctx->getFaasmInfoType(info);
+    if (hostInfo->id != FAABRIC_INFO_NULL) {
+        throw std::runtime_error("Non-null info not supported");
+    }
+
+    // Check the window is within memory
+    ctx->module->validateNativePointer(basePtr, size);
+    ctx->module->validateNativePointer(winPtrPtr, sizeof(MPI_Win));
+    uint32_t baseOffset = ctx->module->nativePointerToWasmOffset(basePtr);
+
+    wasm_faabric_win_t* win = nullptr;
+    uint32_t winPtr = ctx->module->wasmModuleMalloc(sizeof(wasm_faabric_win_t),
+                                                    (void**)&win);
+    if (winPtr == 0) {
+        SPDLOG_ERROR("Error allocating memory in the WASM's heap");
+        throw std::runtime_error("Error allocating memory in the WASM heap");
+    }
+    win->worldId = ctx->world.getId();
+    win->rank = ctx->rank;
+    win->size = size;
+    win->wasmPtr = baseOffset;
+    win->dispUnit = dispUnit;
+
+    createMpiWindow(winPtr,
+                    ctx->world,
+                    ctx->rank,
+                    faabric::scheduler::ExecutorContext::get()->getMsg().user(),
+                    ctx->module,
+                    baseOffset,
+                    size,
+                    dispUnit);
+
+    // See writeNewComm for why the write is unaligned
+    faabric::util::unalignedWrite<int32_t>(
+      winPtr, reinterpret_cast<uint8_t*>(winPtrPtr));
+
+    return MPI_SUCCESS;
+}
+
+/**
+ * Collective synchronisation that completes all RMA operations on the window
+ * since the last fence.
+ */
+static int32_t MPI_Win_fence_wrapper(wasm_exec_env_t execEnv,
+                                     int32_t assert,
+                                     int32_t* win)
+{
+    MPI_FUNC_ARGS("S - MPI_Win_fence {} {}", assert, (uintptr_t)win);
+
+    getMpiWindow(ctx->getWindowPtr(win)).fence();
+
+    return MPI_SUCCESS;
+}
+
+/**
+ * Cleans up the given window. This is collective, and sets the guest's
+ * MPI_Win to null.
+ */
+static int32_t MPI_Win_free_wrapper(wasm_exec_env_t execEnv,
+                                    int32_t* winPtrPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Win_free {}", (uintptr_t)winPtrPtr);
+
+    ctx->module->validateNativePointer(winPtrPtr, sizeof(MPI_Win));
+    int32_t winPtr = faabric::util::unalignedRead<int32_t>(
+      reinterpret_cast<uint8_t*>(winPtrPtr));
+
+    freeMpiWindow(winPtr);
+    wasm_runtime_module_free(ctx->module->getModuleInstance(), winPtr);
+
+    faabric::util::unalignedWrite<int32_t>(
+      0, reinterpret_cast<uint8_t*>(winPtrPtr));
+
+    return MPI_SUCCESS;
+}
+
+/**
+ * Returns the value for a given attribute of a window. As in MPI, the result
+ * is a pointer to the value, so we point into the window struct.
+ */
+static int32_t MPI_Win_get_attr_wrapper(wasm_exec_env_t execEnv,
+                                        int32_t* win,
+                                        int32_t attrKey,
+                                        int32_t* attrResPtrPtr,
+                                        int32_t* flagResPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Win_get_attr {} {} {} {}",
+                  (uintptr_t)win,
+                  attrKey,
+                  (uintptr_t)attrResPtrPtr,
+                  (uintptr_t)flagResPtr);
+
+    int32_t winPtr = ctx->getWindowPtr(win);
+    wasm_faabric_win_t* hostWin = reinterpret_cast<wasm_faabric_win_t*>(win);
+
+    int flag = 1;
+    switch (attrKey) {
+        case MPI_WIN_BASE: {
+            ctx->writeMpiResult<int32_t>(attrResPtrPtr, hostWin->wasmPtr);
+            break;
+        }
+        case MPI_WIN_SIZE: {
+            ctx->writeMpiResult<int32_t>(
+              attrResPtrPtr, winPtr + offsetof(wasm_faabric_win_t, size));
+            break;
+        }
+        case MPI_WIN_DISP_UNIT: {
+            ctx->writeMpiResult<int32_t>(
+              attrResPtrPtr, winPtr + offsetof(wasm_faabric_win_t, dispUnit));
+            break;
+        }
+        default: {
+            SPDLOG_WARN("Unsupported MPI window attribute {}", attrKey);
+            flag = 0;
+        }
+    }
+
+    ctx->writeMpiResult<int32_t>(flagResPtr, flag);
+
+    return MPI_SUCCESS;
 }
 
 static double MPI_Wtime_wrapper()
@@ -1045,13 +2213,14 @@ static double MPI_Wtime_wrapper()
 static NativeSymbol ns[] = {
     REG_NATIVE_FUNC(MPI_Abort, "(ii)i"),
     REG_NATIVE_FUNC(MPI_Allgather, "(*i**i**)i"),
-    REG_NATIVE_FUNC(MPI_Allgatherv, "(*i**ii**)i"),
+    REG_NATIVE_FUNC(MPI_Allgatherv, "(*i******)i"),
+    REG_NATIVE_FUNC(MPI_Alloc_mem, "(i**)i"),
     REG_NATIVE_FUNC(MPI_Allreduce, "(**i***)i"),
     REG_NATIVE_FUNC(MPI_Alltoall, "(*i**i**)i"),
-    REG_NATIVE_FUNC(MPI_Alltoallv, "(*ii**ii**)i"),
+    REG_NATIVE_FUNC(MPI_Alltoallv, "(*********)i"),
     REG_NATIVE_FUNC(MPI_Barrier, "(*)i"),
     REG_NATIVE_FUNC(MPI_Bcast, "(*i*i*)i"),
-    REG_NATIVE_FUNC(MPI_Cart_create, "(*iiii*)i"),
+    REG_NATIVE_FUNC(MPI_Cart_create, "(*i**i*)i"),
     REG_NATIVE_FUNC(MPI_Cart_get, "(*i***)i"),
     REG_NATIVE_FUNC(MPI_Cart_rank, "(***)i"),
     REG_NATIVE_FUNC(MPI_Cart_shift, "(*ii**)i"),
@@ -1060,33 +2229,56 @@ static NativeSymbol ns[] = {
     REG_NATIVE_FUNC(MPI_Comm_rank, "(**)i"),
     REG_NATIVE_FUNC(MPI_Comm_size, "(**)i"),
     REG_NATIVE_FUNC(MPI_Comm_split, "(*ii*)i"),
+    REG_NATIVE_FUNC(MPI_File_close, "(*)i"),
+    REG_NATIVE_FUNC(MPI_File_get_size, "(i*)i"),
+    REG_NATIVE_FUNC(MPI_File_open, "(*$i**)i"),
+    REG_NATIVE_FUNC(MPI_File_read_at_all, "(iI*i**)i"),
+    REG_NATIVE_FUNC(MPI_File_write_at_all, "(iI*i**)i"),
     REG_NATIVE_FUNC(MPI_Finalize, "()i"),
+    REG_NATIVE_FUNC(MPI_Free_mem, "(*)i"),
     REG_NATIVE_FUNC(MPI_Gather, "(*i**i*i*)i"),
+    REG_NATIVE_FUNC(MPI_Get, "(*i*iii**)i"),
     REG_NATIVE_FUNC(MPI_Get_count, "(***)i"),
     REG_NATIVE_FUNC(MPI_Get_processor_name, "(*i)i"),
     REG_NATIVE_FUNC(MPI_Get_version, "(**)i"),
+    REG_NATIVE_FUNC(MPI_Iallreduce, "(**i****)i"),
+    REG_NATIVE_FUNC(MPI_Ialltoall, "(*i**i***)i"),
+    REG_NATIVE_FUNC(MPI_Ibcast, "(*i*i**)i"),
     REG_NATIVE_FUNC(MPI_Init, "(ii)i"),
     REG_NATIVE_FUNC(MPI_Irecv, "(*i*ii**)i"),
     REG_NATIVE_FUNC(MPI_Isend, "(*i*ii**)i"),
-    REG_NATIVE_FUNC(MPI_Op_create, "(*ii)i"),
+    REG_NATIVE_FUNC(MPI_Op_create, "(ii*)i"),
     REG_NATIVE_FUNC(MPI_Op_free, "(*)i"),
     REG_NATIVE_FUNC(MPI_Probe, "(ii**)i"),
+    REG_NATIVE_FUNC(MPI_Put, "(*i*iii**)i"),
     REG_NATIVE_FUNC(MPI_Recv, "(*i*ii**)i"),
+    REG_NATIVE_FUNC(MPI_Recv_init, "(*i*ii**)i"),
     REG_NATIVE_FUNC(MPI_Reduce, "(**i**i*)i"),
-    REG_NATIVE_FUNC(MPI_Reduce_scatter, "(**i***)i"),
+    REG_NATIVE_FUNC(MPI_Reduce_scatter, "(******)i"),
     REG_NATIVE_FUNC(MPI_Request_free, "(*)i"),
     REG_NATIVE_FUNC(MPI_Rsend, "(*i*ii*)i"),
     REG_NATIVE_FUNC(MPI_Scan, "(**i***)i"),
     REG_NATIVE_FUNC(MPI_Scatter, "(*i**i*i*)i"),
     REG_NATIVE_FUNC(MPI_Send, "(*i*ii*)i"),
+    REG_NATIVE_FUNC(MPI_Send_init, "(*i*ii**)i"),
     REG_NATIVE_FUNC(MPI_Sendrecv, "(*i*ii*i*ii**)i"),
+    REG_NATIVE_FUNC(MPI_Start, "(*)i"),
+    REG_NATIVE_FUNC(MPI_Startall, "(i*)i"),
     REG_NATIVE_FUNC(MPI_Type_commit, "(*)i"),
     REG_NATIVE_FUNC(MPI_Type_contiguous, "(i**)i"),
+    REG_NATIVE_FUNC(MPI_Type_create_struct, "(i****)i"),
+    REG_NATIVE_FUNC(MPI_Type_create_subarray, "(i***i**)i"),
     REG_NATIVE_FUNC(MPI_Type_free, "(*)i"),
+    REG_NATIVE_FUNC(MPI_Type_indexed, "(i****)i"),
     REG_NATIVE_FUNC(MPI_Type_size, "(**)i"),
+    REG_NATIVE_FUNC(MPI_Type_vector, "(iii**)i"),
     REG_NATIVE_FUNC(MPI_Wait, "(*i)i"),
     REG_NATIVE_FUNC(MPI_Waitall, "(i**)i"),
-    REG_NATIVE_FUNC(MPI_Waitany, "(i*i*)i"),
+    REG_NATIVE_FUNC(MPI_Waitany, "(i***)i"),
+    REG_NATIVE_FUNC(MPI_Win_create, "(*ii***)i"),
+    REG_NATIVE_FUNC(MPI_Win_fence, "(i*)i"),
+    REG_NATIVE_FUNC(MPI_Win_free, "(*)i"),
+    REG_NATIVE_FUNC(MPI_Win_get_attr, "(*i**)i"),
     REG_NATIVE_FUNC(MPI_Wtime, "()F"),
 };
 
@@ -26,11 +26,13 @@ void initialiseWAMRNatives()
     doSymbolRegistration(getFaasmFunctionsApi);
     doSymbolRegistration(getFaasmMemoryApi);
     doSymbolRegistration(getFaasmMpiApi);
+    doSymbolRegistration(getFaasmOpenMPApi);
     doSymbolRegistration(getFaasmProcessApi);
     doSymbolRegistration(getFaasmPthreadApi);
     doSymbolRegistration(getFaasmSignalApi);
     doSymbolRegistration(getFaasmStateApi);
     doSymbolRegistration(getFaasmStubs);
+    doSymbolRegistration(getFaasmTimingApi);
 
     // Register wasi symbols
     doWasiSymbolRegistration(getFaasmWasiEnvApi);
@@ -0,0 +1,554 @@
+#include <faabric/scheduler/ExecutorContext.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/macros.h>
+#include <metrics/LifecycleTrace.h>
+#include <threads/ThreadState.h>
+#include <wamr/WAMRWasmModule.h>
+#include <wamr/native.h>
+#include <wasm/call_metrics.h>
+#include <wasm/openmp.h>
+#include <wasm/openmp_profile.h>
+
+#include <stdexcept>
+#include <wasm_export.h>
+
+using namespace faabric::scheduler;
+
+namespace wasm {
+
+// Calls the function at the given table index on the calling thread's
+// execution environment. WAMR puts any return value in argv[0].
+static void callWasmFunction(wasm_exec_env_t execEnv,
+                             int32_t funcPtr,
+                             std::vector<uint32_t>& argv)
+{
+    uint32_t argc = argv.size();
+    if (argv.empty()) {
+        argv.push_back(0);
+    }
+
+    if (!wasm_runtime_call_indirect(execEnv, funcPtr, argc, argv.data())) {
+        SPDLOG_ERROR(
+          "Error calling OpenMP function {}: {}",
+          funcPtr,
+          wasm_runtime_get_exception(wasm_runtime_get_module_inst(execEnv)));
+        throw std::runtime_error("Error calling OpenMP function with WAMR");
+    }
+}
+
+// ------------------------------------------------
+// THREAD NUMS AND LEVELS
+// ------------------------------------------------
+
+static int32_t omp_get_thread_num_wrapper(wasm_exec_env_t execEnv)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC("omp_get_thread_num")
+    return localThreadNum;
+}
+
+static int32_t omp_get_num_threads_wrapper(wasm_exec_env_t execEnv)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC("omp_get_num_threads")
+    return level->numThreads;
+}
+
+static int32_t omp_get_max_threads_wrapper(wasm_exec_env_t execEnv)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC("omp_get_max_threads");
+    return level->getMaxThreadsAtNextLevel();
+}
+
+static int32_t omp_get_level_wrapper(wasm_exec_env_t execEnv)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC("omp_get_level");
+    return level->depth;
+}
+
+static int32_t omp_get_max_active_levels_wrapper(wasm_exec_env_t execEnv)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC("omp_get_max_active_levels");
+    return level->maxActiveLevels;
+}
+
+static void omp_set_max_active_levels_wrapper(wasm_exec_env_t execEnv,
+                                              int32_t maxLevels)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("omp_set_max_active_levels {}", maxLevels)
+
+    if (maxLevels < 0) {
+        SPDLOG_WARN("Trying to set active level with a negative number {}",
+                    maxLevels);
+    } else {
+        level->maxActiveLevels = maxLevels;
+    }
+}
+
+static void __kmpc_push_num_threads_wrapper(wasm_exec_env_t execEnv,
+                                            int32_t loc,
+                                            int32_t globalTid,
+                                            int32_t numThreads)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS(
+      "__kmpc_push_num_threads {} {} {}", loc, globalTid, numThreads);
+
+    if (numThreads > 0) {
+        level->pushedThreads = numThreads;
+    }
+}
+
+static void omp_set_num_threads_wrapper(wasm_exec_env_t execEnv,
+                                        int32_t numThreads)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("omp_set_num_threads {}", numThreads);
+
+    if (numThreads > 0) {
+        level->wantedThreads = numThreads;
+    }
+}
+
+static int32_t __kmpc_global_thread_num_wrapper(wasm_exec_env_t execEnv,
+                                                int32_t loc)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_global_thread_num {}", loc);
+    return globalThreadNum;
+}
+
+static int32_t omp_get_num_devices_wrapper(wasm_exec_env_t execEnv)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC("omp_get_num_devices");
+    return 1;
+}
+
+// ------------------------------------------------
+// SYNCHRONISATION
+// ------------------------------------------------
+
+static void __kmpc_barrier_wrapper(wasm_exec_env_t execEnv,
+                                   int32_t loc,
+                                   int32_t globalTid)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_barrier {} {}", loc, globalTid);
+
+    if (level->numThreads == 1) {
+        return;
+    }
+
+    teamBarrier(msg->groupidx());
+}
+
+static void __kmpc_critical_wrapper(wasm_exec_env_t execEnv,
+                                    int32_t loc,
+                                    int32_t globalTid,
+                                    int32_t crit)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_critical {} {} {}", loc, globalTid, crit);
+
+    enterOpenMPCritical(msg, level, crit);
+}
+
+static void __kmpc_end_critical_wrapper(wasm_exec_env_t execEnv,
+                                        int32_t loc,
+                                        int32_t globalTid,
+                                        int32_t crit)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_end_critical {} {} {}", loc, globalTid, crit);
+
+    exitOpenMPCritical(msg, level, crit);
+}
+
+static void __kmpc_flush_wrapper(wasm_exec_env_t execEnv, int32_t loc)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_flush {}", loc);
+
+    __sync_synchronize();
+}
+
+static int32_t __kmpc_master_wrapper(wasm_exec_env_t execEnv,
+                                     int32_t loc,
+                                     int32_t globalTid)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_master {} {}", loc, globalTid);
+
+    return localThreadNum == 0;
+}
+
+static void __kmpc_end_master_wrapper(wasm_exec_env_t execEnv,
+                                      int32_t loc,
+                                      int32_t globalTid)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_end_master {} {}", loc, globalTid);
+
+    if (localThreadNum != 0) {
+        throw std::runtime_error("Calling _kmpc_end_master from non-master");
+    }
+}
+
+static int32_t __kmpc_single_wrapper(wasm_exec_env_t execEnv,
+                                     int32_t loc,
+                                     int32_t globalTid)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_single {} {}", loc, globalTid);
+
+    return startOpenMPSingle(msg, level);
+}
+
+static void __kmpc_end_single_wrapper(wasm_exec_env_t execEnv,
+                                      int32_t loc,
+                                      int32_t globalTid)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_end_single {} {}", loc, globalTid);
+}
+
+// ------------------------------------------------
+// FORKING
+// ------------------------------------------------
+
+/**
+ * Runs the single thread of a nested team inline on the calling thread, as
+ * for WAVM.
+ */
+static void executeMasterInline(wasm_exec_env_t execEnv,
+                                faabric::Message* msg,
+                                std::shared_ptr<threads::Level> parentLevel,
+                                std::shared_ptr<threads::Level> nextLevel,
+                                int32_t microtaskPtr)
+{
+    OpenMPProfileTimer regionTimer(OpenMPProfileEvent::Region,
+                                   OpenMPProfileEvent::Region);
+
+    int parentThreadNum = msg->appidx();
+    int threadNum = nextLevel->getGlobalThreadNum(0);
+
+    std::vector<uint32_t> argv = { (uint32_t)threadNum,
+                                   nextLevel->nSharedVarOffsets };
+    for (uint32_t i = 0; i < nextLevel->nSharedVarOffsets; i++) {
+        argv.emplace_back(nextLevel->sharedVarOffsets[i]);
+    }
+
+    msg->set_appidx(threadNum);
+    threads::setCurrentOpenMPLevel(nextLevel);
+    pushThreadDispatch();
+
+    try {
+        callWasmFunction(execEnv, microtaskPtr, argv);
+    } catch (...) {
+        popThreadDispatch();
+        msg->set_appidx(parentThreadNum);
+        threads::setCurrentOpenMPLevel(parentLevel);
+        throw;
+    }
+
+    popThreadDispatch();
+    msg->set_appidx(parentThreadNum);
+    threads::setCurrentOpenMPLevel(parentLevel);
+}
+
+/**
+ * See the WAVM version of __kmpc_fork_call for details. The shared variable
+ * pointers are passed as a pointer to the varargs.
+ */
+static void __kmpc_fork_call_wrapper(wasm_exec_env_t execEnv,
+                                     int32_t locPtr,
+                                     int32_t nSharedVars,
+                                     int32_t microtaskPtr,
+                                     int32_t sharedVarPtrs)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_fork_call {} {} {} {}",
+                  locPtr,
+                  nSharedVars,
+                  microtaskPtr,
+                  sharedVarPtrs);
+    OpenMPProfileTimer forkTimer(OpenMPProfileEvent::Fork,
+                                 OpenMPProfileEvent::Region);
+    metrics::TraceScope trace(metrics::TraceEvent::ThreadFork);
+
+    WAMRWasmModule* module = getExecutingWAMRModule();
+
+    uint32_t* sharedVarsPtr = nullptr;
+    if (nSharedVars > 0) {
+        module->validateWasmOffset(sharedVarPtrs,
+                                   nSharedVars * sizeof(uint32_t));
+        sharedVarsPtr = reinterpret_cast<uint32_t*>(
+          module->wasmPointerToNative(sharedVarPtrs));
+    }
+
+    std::shared_ptr<threads::Level> parentLevel = level;
+    std::shared_ptr<threads::Level> nextLevel =
+      createNextOpenMPLevel(parentLevel, nSharedVars, sharedVarsPtr);
+
+    if (nextLevel->depth > 1) {
+        executeMasterInline(execEnv, msg, parentLevel, nextLevel, microtaskPtr);
+    } else {
+        executeOpenMPTeam(module, msg, nextLevel, microtaskPtr);
+    }
+
+    // Reset parent level for next setting of threads
+    parentLevel->pushedThreads = -1;
+}
+
+// ------------------------------------------------
+// LOOPS
+// ------------------------------------------------
+
+static void __kmpc_for_static_init_4_wrapper(wasm_exec_env_t execEnv,
+                                             int32_t loc,
+                                             int32_t gtid,
+                                             int32_t schedule,
+                                             int32_t* lastIter,
+                                             int32_t* lower,
+                                             int32_t* upper,
+                                             int32_t* stride,
+                                             int32_t incr,
+                                             int32_t chunk)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_for_static_init_4 {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  schedule,
+                  incr,
+                  chunk);
+
+    for_static_init<int32_t>(
+      schedule, lastIter, lower, upper, stride, incr, chunk);
+}
+
+static void __kmpc_for_static_init_8_wrapper(wasm_exec_env_t execEnv,
+                                             int32_t loc,
+                                             int32_t gtid,
+                                             int32_t schedule,
+                                             int32_t* lastIter,
+                                             int64_t* lower,
+                                             int64_t* upper,
+                                             int64_t* stride,
+                                             int64_t incr,
+                                             int64_t chunk)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_for_static_init_8 {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  schedule,
+                  incr,
+                  chunk);
+
+    for_static_init<int64_t>(
+      schedule, lastIter, lower, upper, stride, incr, chunk);
+}
+
+static void __kmpc_for_static_fini_wrapper(wasm_exec_env_t execEnv,
+                                           int32_t loc,
+                                           int32_t gtid)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_for_static_fini {} {}", loc, gtid);
+}
+
+#define DISPATCH_INIT_WRAPPER(suffix, T, ArgT)                                 \
+    static void __kmpc_dispatch_init_##suffix##_wrapper(                       \
+      wasm_exec_env_t execEnv,                                                 \
+      int32_t loc,                                                             \
+      int32_t gtid,                                                            \
+      int32_t schedule,                                                        \
+      ArgT lower,                                                              \
+      ArgT upper,                                                              \
+      ArgT incr,                                                               \
+      ArgT chunk)                                                              \
+    {                                                                          \
+        HOST_CALL(OpenMP);                                                     \
+        OMP_FUNC_ARGS("__kmpc_dispatch_init_" #suffix " {} {} {} {} {} {} {}", \
+                      loc,                                                     \
+                      gtid,                                                    \
+                      schedule,                                                \
+                      lower,                                                   \
+                      upper,                                                   \
+                      incr,                                                    \
+                      chunk);                                                  \
+        dispatch_init<T>(schedule, (T)lower, (T)upper, incr, chunk);           \
+    }
+
+#define DISPATCH_NEXT_WRAPPER(suffix, T)                                       \
+    static int32_t __kmpc_dispatch_next_##suffix##_wrapper(                    \
+      wasm_exec_env_t execEnv,                                                 \
+      int32_t loc,                                                             \
+      int32_t gtid,                                                            \
+      int32_t* lastIter,                                                       \
+      T* lower,                                                                \
+      T* upper,                                                                \
+      T* stride)                                                               \
+    {                                                                          \
+        HOST_CALL(OpenMP);                                                     \
+        OMP_FUNC_ARGS("__kmpc_dispatch_next_" #suffix " {} {}", loc, gtid);    \
+        return dispatch_next<T>(lastIter, lower, upper, stride);               \
+    }
+
+#define DISPATCH_FINI_WRAPPER(suffix)                                          \
+    static void __kmpc_dispatch_fini_##suffix##_wrapper(                       \
+      wasm_exec_env_t execEnv, int32_t loc, int32_t gtid)                      \
+    {                                                                          \
+        HOST_CALL(OpenMP);                                                     \
+        OMP_FUNC_ARGS("__kmpc_dispatch_fini_" #suffix " {} {}", loc, gtid);    \
+    }
+
+DISPATCH_INIT_WRAPPER(4, int32_t, int32_t)
+DISPATCH_INIT_WRAPPER(4u, uint32_t, int32_t)
+DISPATCH_INIT_WRAPPER(8, int64_t, int64_t)
+DISPATCH_INIT_WRAPPER(8u, uint64_t, int64_t)
+
+DISPATCH_NEXT_WRAPPER(4, int32_t)
+DISPATCH_NEXT_WRAPPER(4u, uint32_t)
+DISPATCH_NEXT_WRAPPER(8, int64_t)
+DISPATCH_NEXT_WRAPPER(8u, uint64_t)
+
+DISPATCH_FINI_WRAPPER(4)
+DISPATCH_FINI_WRAPPER(4u)
+DISPATCH_FINI_WRAPPER(8)
+DISPATCH_FINI_WRAPPER(8u)
+
+// ------------------------------------------------
+// REDUCTION
+// ------------------------------------------------
+
+static OpenMPReduceFunc getReduceFunc(wasm_exec_env_t execEnv,
+                                      int32_t reduceFunc)
+{
+    return [execEnv, reduceFunc](int32_t lhs, int32_t rhs) {
+        std::vector<uint32_t> argv = { (uint32_t)lhs, (uint32_t)rhs };
+        callWasmFunction(execEnv, reduceFunc, argv);
+    };
+}
+
+static int32_t __kmpc_reduce_wrapper(wasm_exec_env_t execEnv,
+                                     int32_t loc,
+                                     int32_t gtid,
+                                     int32_t numReduceVars,
+                                     int32_t reduceVarsSize,
+                                     int32_t reduceVarPtrs,
+                                     int32_t reduceFunc,
+                                     int32_t lockPtr)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_reduce {} {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  numReduceVars,
+                  reduceVarsSize,
+                  reduceVarPtrs,
+                  reduceFunc,
+                  lockPtr);
+
+    return startOpenMPReduce(
+      msg, level, reduceVarPtrs, getReduceFunc(execEnv, reduceFunc), false);
+}
+
+static int32_t __kmpc_reduce_nowait_wrapper(wasm_exec_env_t execEnv,
+                                            int32_t loc,
+                                            int32_t gtid,
+                                            int32_t numReduceVars,
+                                            int32_t reduceVarsSize,
+                                            int32_t reduceVarPtrs,
+                                            int32_t reduceFunc,
+                                            int32_t lockPtr)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_reduce_nowait {} {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  numReduceVars,
+                  reduceVarsSize,
+                  reduceVarPtrs,
+                  reduceFunc,
+                  lockPtr);
+
+    return startOpenMPReduce(
+      msg, level, reduceVarPtrs, getReduceFunc(execEnv, reduceFunc), true);
+}
+
+static void __kmpc_end_reduce_wrapper(wasm_exec_env_t execEnv,
+                                      int32_t loc,
+                                      int32_t gtid,
+                                      int32_t lck)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_end_reduce {} {} {}", loc, gtid, lck);
+
+    endOpenMPReduce(msg, level, false);
+}
+
+static void __kmpc_end_reduce_nowait_wrapper(wasm_exec_env_t execEnv,
+                                             int32_t loc,
+                                             int32_t gtid,
+                                             int32_t lck)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_end_reduce_nowait {} {} {}", loc, gtid, lck);
+
+    endOpenMPReduce(msg, level, true);
+}
+
+static NativeSymbol ns[] = {
+    REG_NATIVE_FUNC(omp_get_thread_num, "()i"),
+    REG_NATIVE_FUNC(omp_get_num_threads, "()i"),
+    REG_NATIVE_FUNC(omp_get_max_threads, "()i"),
+    REG_NATIVE_FUNC(omp_get_level, "()i"),
+    REG_NATIVE_FUNC(omp_get_max_active_levels, "()i"),
+    REG_NATIVE_FUNC(omp_set_max_active_levels, "(i)"),
+    REG_NATIVE_FUNC(omp_set_num_threads, "(i)"),
+    REG_NATIVE_FUNC(omp_get_num_devices, "()i"),
+    REG_NATIVE_FUNC(__kmpc_push_num_threads, "(iii)"),
+    REG_NATIVE_FUNC(__kmpc_global_thread_num, "(i)i"),
+    REG_NATIVE_FUNC(__kmpc_barrier, "(ii)"),
+    REG_NATIVE_FUNC(__kmpc_critical, "(iii)"),
+    REG_NATIVE_FUNC(__kmpc_end_critical, "(iii)"),
+    REG_NATIVE_FUNC(__kmpc_flush, "(i)"),
+    REG_NATIVE_FUNC(__kmpc_master, "(ii)i"),
+    REG_NATIVE_FUNC(__kmpc_end_master, "(ii)"),
+    REG_NATIVE_FUNC(__kmpc_single, "(ii)i"),
+    REG_NATIVE_FUNC(__kmpc_end_single, "(ii)"),
+    REG_NATIVE_FUNC(__kmpc_fork_call, "(iiii)"),
+    REG_NATIVE_FUNC(__kmpc_for_static_init_4, "(iii****ii)"),
+    REG_NATIVE_FUNC(__kmpc_for_static_init_8, "(iii****II)"),
+    REG_NATIVE_FUNC(__kmpc_for_static_fini, "(ii)"),
+    REG_NATIVE_FUNC(__kmpc_dispatch_init_4, "(iiiiiii)"),
+    REG_NATIVE_FUNC(__kmpc_dispatch_init_4u, "(iiiiiii)"),
+    REG_NATIVE_FUNC(__kmpc_dispatch_init_8, "(iiiIIII)"),
+    REG_NATIVE_FUNC(__kmpc_dispatch_init_8u, "(iiiIIII)"),
+    REG_NATIVE_FUNC(__kmpc_dispatch_next_4, "(ii****)i"),
+    REG_NATIVE_FUNC(__kmpc_dispatch_next_4u, "(ii****)i"),
+    REG_NATIVE_FUNC(__kmpc_dispatch_next_8, "(ii****)i"),
+    REG_NATIVE_FUNC(__kmpc_dispatch_next_8u, "(ii****)i"),
+    REG_NATIVE_FUNC(__kmpc_dispatch_fini_4, "(ii)"),
+    REG_NATIVE_FUNC(__kmpc_dispatch_fini_4u, "(ii)"),
+    REG_NATIVE_FUNC(__kmpc_dispatch_fini_8, "(ii)"),
+    REG_NATIVE_FUNC(__kmpc_dispatch_fini_8u, "(ii)"),
+    REG_NATIVE_FUNC(__kmpc_reduce, "(iiiiiii)i"),
+    REG_NATIVE_FUNC(__kmpc_reduce_nowait, "(iiiiiii)i"),
+    REG_NATIVE_FUNC(__kmpc_end_reduce, "(iii)"),
+    REG_NATIVE_FUNC(__kmpc_end_reduce_nowait, "(iii)"),
+};
+
+uint32_t getFaasmOpenMPApi(NativeSymbol** nativeSymbols)
+{
+    *nativeSymbols = ns;
+    return sizeof(ns) / sizeof(NativeSymbol);
+}
+}
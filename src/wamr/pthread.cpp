@@ -1,137 +1,352 @@
+#include <faabric/scheduler/ExecutorContext.h>
+#include <faabric/util/logging.h>
+#include <threads/ThreadState.h>
+#include <wamr/WAMRWasmModule.h>
 #include <wamr/native.h>
+#include <wasm/call_metrics.h>
+#include <wasm/futex.h>
+
+#include <atomic>
+#include <cerrno>
+#include <limits>
+#include <stdexcept>
 #include <wasm_export.h>
 
-#include <faabric/util/logging.h>
+using namespace faabric::scheduler;
 
 namespace wasm {
 
 // -------------------------------------------
-// 14/04/21 - WAMR threading not implemented
-// All of these functions are stubbed as threading with WAMR isn't yet
-// implemented. Once it is, we will need to implement the function here,
-// exepctially the locking which is used to manage thread-safe memory
-// provisioning.
+// As in WAVM, we intercept the pthread API at a high level and mostly ignore
+// the contents of the pthread structs, using the wasm pointer to each struct
+// as its ID. Threads are queued on create and dispatched by the module, each
+// running in its own WAMR execution environment sharing the module's memory.
+//
+// Mutexes and condition variables are host-local, as all threads of a module
+// execute on the same host. We use trace logging as these are called a lot.
 // -------------------------------------------
 
+static int32_t* getWasmInt(WAMRWasmModule* module, int32_t wasmPtr)
+{
+    module->validateWasmOffset(wasmPtr, sizeof(int32_t));
+    return reinterpret_cast<int32_t*>(module->wasmPointerToNative(wasmPtr));
+}
+
 static int32_t pthread_create_wrapper(wasm_exec_env_t exec_env,
-                                      int32_t a,
-                                      int32_t b,
-                                      int32_t c,
-                                      int32_t d)
+                                      int32_t pthreadPtr,
+                                      int32_t attrPtr,
+                                      int32_t entryFunc,
+                                      int32_t argsPtr)
 {
-    SPDLOG_DEBUG("S - pthread_create {} {} {} {}", a, b, c, d);
+    HOST_CALL(Threads);
+    SPDLOG_DEBUG("S - pthread_create {} {} {} {}",
+                 pthreadPtr,
+                 attrPtr,
+                 entryFunc,
+                 argsPtr);
+
+    // Setting the self pointer is crucial for inter-operation with existing
+    // C code
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    *getWasmInt(module, pthreadPtr) = pthreadPtr;
+
+    threads::PthreadCall pthreadCall;
+    pthreadCall.pthreadPtr = pthreadPtr;
+    pthreadCall.entryFunc = entryFunc;
+    pthreadCall.argsPtr = argsPtr;
+
+    module->queuePthreadCall(pthreadCall);
+
     return 0;
 }
 
 static int32_t pthread_join_wrapper(wasm_exec_env_t exec_env,
-                                    int32_t a,
-                                    int32_t b)
+                                    int32_t pthreadPtr,
+                                    int32_t resPtrPtr)
 {
-    SPDLOG_DEBUG("S - pthread_join {} {}", a, b);
+    HOST_CALL(Threads);
+    SPDLOG_DEBUG("S - pthread_join {} {}", pthreadPtr, resPtrPtr);
+
+    faabric::Message* call = &ExecutorContext::get()->getMsg();
+    WAMRWasmModule* module = getExecutingWAMRModule();
+
+    int returnValue = module->awaitPthreadCall(call, pthreadPtr);
+
+    // The result is written through a pointer to a pointer, which callers not
+    // interested in the result leave null
+    if (resPtrPtr != 0) {
+        *getWasmInt(module, resPtrPtr) = returnValue;
+    }
+
     return 0;
 }
 
+static void pthread_exit_wrapper(wasm_exec_env_t exec_env, int32_t code)
+{
+    HOST_CALL(Threads);
+    SPDLOG_DEBUG("S - pthread_exit {}", code);
+}
+
 static int32_t pthread_once_wrapper(wasm_exec_env_t exec_env,
-                                    int32_t a,
-                                    int32_t b)
+                                    int32_t onceControlPtr,
+                                    int32_t initFunc)
 {
-    // Trace logging as this may be called a lot
-    SPDLOG_TRACE("S - pthread_once {} {}", a, b);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_once {} {}", onceControlPtr, initFunc);
+
+    // The control word is zero to start with, then one while the init
+    // function runs and two once it's done
+    int32_t* onceControl =
+      getWasmInt(getExecutingWAMRModule(), onceControlPtr);
+    std::atomic_ref<int32_t> control(*onceControl);
+
+    int32_t state = 0;
+    while (!control.compare_exchange_strong(state, 1)) {
+        if (state == 2) {
+            return 0;
+        }
+
+        // Another thread is running the init function
+        futexWait(onceControl, 1, -1);
+        state = 0;
+    }
+
+    uint32_t argv[1] = { 0 };
+    bool success = wasm_runtime_call_indirect(exec_env, initFunc, 0, argv);
+
+    // Waiters try again if the init function failed
+    control.store(success ? 2 : 0);
+    futexWake(onceControl, std::numeric_limits<int32_t>::max());
+
+    if (!success) {
+        SPDLOG_ERROR(
+          "Error calling pthread_once function {}: {}",
+          initFunc,
+          wasm_runtime_get_exception(wasm_runtime_get_module_inst(exec_env)));
+        throw std::runtime_error("Error calling pthread_once function");
+    }
+
     return 0;
 }
 
+static int32_t pthread_equal_wrapper(wasm_exec_env_t exec_env,
+                                     int32_t a,
+                                     int32_t b)
+{
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_equal {} {}", a, b);
+    return a == b;
+}
+
+// --------------------------
+// Mutexes
+// --------------------------
+
+// The first word of the mutex struct holds its slot in the module's slab
+static FutexMutex& getPthreadMutex(int32_t mx)
+{
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    return module->getPthreadMutexSlab().get(mx, getWasmInt(module, mx));
+}
+
 static int32_t pthread_mutex_init_wrapper(wasm_exec_env_t exec_env,
-                                          int32_t a,
-                                          int32_t b)
+                                          int32_t mx,
+                                          int32_t attr)
 {
-    SPDLOG_DEBUG("S - pthread_mutex_init {} {}", a, b);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_mutex_init {} {}", mx, attr);
+    getPthreadMutex(mx);
+
     return 0;
 }
 
-static int32_t pthread_mutex_lock_wrapper(wasm_exec_env_t exec_env, int32_t a)
+static int32_t pthread_mutex_lock_wrapper(wasm_exec_env_t exec_env, int32_t mx)
 {
-    SPDLOG_TRACE("S - pthread_mutex_lock {}", a);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_mutex_lock {}", mx);
+    getPthreadMutex(mx).lock();
+
     return 0;
 }
 
-static int32_t pthread_mutex_unlock_wrapper(wasm_exec_env_t exec_env, int32_t a)
+static int32_t pthread_mutex_trylock_wrapper(wasm_exec_env_t exec_env,
+                                             int32_t mx)
 {
-    SPDLOG_TRACE("S - pthread_mutex_unlock {}", a);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_mutex_trylock {}", mx);
+
+    bool success = getPthreadMutex(mx).try_lock();
+    if (!success) {
+        return EBUSY;
+    }
+
+    return 0;
+}
+
+static int32_t pthread_mutex_unlock_wrapper(wasm_exec_env_t exec_env,
+                                            int32_t mx)
+{
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_mutex_unlock {}", mx);
+    getPthreadMutex(mx).unlock();
+
     return 0;
 }
 
 static int32_t pthread_mutex_destroy_wrapper(wasm_exec_env_t exec_env,
-                                             int32_t a)
+                                             int32_t mx)
 {
-    SPDLOG_DEBUG("S - pthread_mutex_destroy {}", a);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_mutex_destroy {}", mx);
+
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    module->getPthreadMutexSlab().release(mx, getWasmInt(module, mx));
+
     return 0;
 }
 
-static int32_t pthread_cond_init_wrapper(wasm_exec_env_t exec_env,
-                                         int32_t a,
-                                         int32_t b)
+static int32_t pthread_mutexattr_init_wrapper(wasm_exec_env_t exec_env,
+                                              int32_t a)
 {
-    SPDLOG_DEBUG("S - pthread_cond_init {}", a, b);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_mutexattr_init {}", a);
     return 0;
 }
 
-static int32_t pthread_cond_signal_wrapper(wasm_exec_env_t exec_env, int32_t a)
+static int32_t pthread_mutexattr_destroy_wrapper(wasm_exec_env_t exec_env,
+                                                 int32_t a)
 {
-    SPDLOG_DEBUG("S - pthread_cond_signal {}", a);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_mutexattr_destroy {}", a);
     return 0;
 }
 
-static int32_t pthread_cond_wait_wrapper(wasm_exec_env_t exec_env,
-                                         int32_t a,
-                                         int32_t b)
+// --------------------------
+// Keys
+// --------------------------
+
+static int32_t pthread_key_create_wrapper(wasm_exec_env_t exec_env,
+                                          int32_t keyPtr,
+                                          int32_t destructorFunc)
 {
-    SPDLOG_DEBUG("S - pthread_cond_wait {}", a, b);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_key_create {} {}", keyPtr, destructorFunc);
+
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    int32_t key = module->createPthreadKey(destructorFunc);
+    if (key < 0) {
+        return EAGAIN;
+    }
+
+    *getWasmInt(module, keyPtr) = key;
+
     return 0;
 }
 
-static int32_t pthread_cond_broadcast_wrapper(wasm_exec_env_t exec_env,
-                                              int32_t a)
+static int32_t pthread_key_delete_wrapper(wasm_exec_env_t exec_env,
+                                          int32_t key)
 {
-    SPDLOG_DEBUG("S - pthread_cond_broadcast {}", a);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_key_delete {}", key);
+    getExecutingWAMRModule()->deletePthreadKey(key);
+
     return 0;
 }
 
-static int32_t pthread_cond_destroy_wrapper(wasm_exec_env_t exec_env, int32_t a)
+static int32_t pthread_getspecific_wrapper(wasm_exec_env_t exec_env,
+                                           int32_t key)
+{
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_getspecific {}", key);
+    return getExecutingWAMRModule()->getPthreadSpecific(key);
+}
+
+static int32_t pthread_setspecific_wrapper(wasm_exec_env_t exec_env,
+                                           int32_t key,
+                                           int32_t value)
 {
-    SPDLOG_DEBUG("S - pthread_cond_destroy {}", a);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_setspecific {} {}", key, value);
+
+    if (!getExecutingWAMRModule()->setPthreadSpecific(key, value)) {
+        return EINVAL;
+    }
+
     return 0;
 }
 
-static int32_t pthread_mutexattr_init_wrapper(wasm_exec_env_t exec_env,
-                                              int32_t a)
+// --------------------------
+// Condition variables
+// --------------------------
+
+static int32_t pthread_cond_init_wrapper(wasm_exec_env_t exec_env,
+                                         int32_t cond,
+                                         int32_t attr)
 {
-    SPDLOG_DEBUG("S - pthread_mutexattr_init {}", a);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_cond_init {} {}", cond, attr);
+    getExecutingWAMRModule()->getOrCreatePthreadCond(cond);
+
     return 0;
 }
 
-static int32_t pthread_mutexattr_destroy_wrapper(wasm_exec_env_t exec_env,
-                                                 int32_t a)
+static int32_t pthread_cond_wait_wrapper(wasm_exec_env_t exec_env,
+                                         int32_t cond,
+                                         int32_t mx)
 {
-    SPDLOG_DEBUG("S - pthread_mutexattr_destroy {}", a);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_cond_wait {} {}", cond, mx);
+
+    // The caller holds the mutex, which is released while waiting and held
+    // again on return, as with the real thing
+    FutexMutex& mutex = getPthreadMutex(mx);
+    getExecutingWAMRModule()->getOrCreatePthreadCond(cond)->wait(mutex);
+
     return 0;
 }
 
-static int32_t pthread_equal_wrapper(wasm_exec_env_t exec_env,
-                                     int32_t a,
-                                     int32_t b)
+static int32_t pthread_cond_signal_wrapper(wasm_exec_env_t exec_env,
+                                           int32_t cond)
+{
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_cond_signal {}", cond);
+    getExecutingWAMRModule()->getOrCreatePthreadCond(cond)->notify_one();
+
+    return 0;
+}
+
+static int32_t pthread_cond_broadcast_wrapper(wasm_exec_env_t exec_env,
+                                              int32_t cond)
+{
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_cond_broadcast {}", cond);
+    getExecutingWAMRModule()->getOrCreatePthreadCond(cond)->notify_all();
+
+    return 0;
+}
+
+static int32_t pthread_cond_destroy_wrapper(wasm_exec_env_t exec_env,
+                                            int32_t cond)
 {
-    SPDLOG_DEBUG("S - pthread_equal {} {}", a, b);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_cond_destroy {}", cond);
     return 0;
 }
 
 static NativeSymbol ns[] = {
     REG_NATIVE_FUNC(pthread_create, "(iiii)i"),
     REG_NATIVE_FUNC(pthread_join, "(ii)i"),
+    REG_NATIVE_FUNC(pthread_exit, "(i)"),
     REG_NATIVE_FUNC(pthread_once, "(ii)i"),
     REG_NATIVE_FUNC(pthread_mutex_init, "(ii)i"),
     REG_NATIVE_FUNC(pthread_mutex_lock, "(i)i"),
+    REG_NATIVE_FUNC(pthread_mutex_trylock, "(i)i"),
     REG_NATIVE_FUNC(pthread_mutex_unlock, "(i)i"),
     REG_NATIVE_FUNC(pthread_mutex_destroy, "(i)i"),
+    REG_NATIVE_FUNC(pthread_key_create, "(ii)i"),
+    REG_NATIVE_FUNC(pthread_key_delete, "(i)i"),
+    REG_NATIVE_FUNC(pthread_getspecific, "(i)i"),
+    REG_NATIVE_FUNC(pthread_setspecific, "(ii)i"),
     REG_NATIVE_FUNC(pthread_cond_init, "(ii)i"),
     REG_NATIVE_FUNC(pthread_cond_signal, "(i)i"),
     REG_NATIVE_FUNC(pthread_cond_wait, "(ii)i"),
@@ -1,12 +1,14 @@
 #include <faabric/util/logging.h>
 #include <wamr/native.h>
 #include <wasm/WasmEnvironment.h>
+#include <wasm/call_metrics.h>
 
 #include <wasm_export.h>
 
 namespace wasm {
 static uint32_t signal_wrapper(wasm_exec_env_t exec_env, uint32_t a, uint32_t b)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - signal");
 
     return 0;
@@ -2,15 +2,40 @@
 #include <faabric/scheduler/ExecutorContext.h>
 #include <faabric/util/logging.h>
 
+#include <storage/FileDescriptor.h>
 #include <wamr/WAMRWasmModule.h>
 #include <wamr/native.h>
 #include <wasm/WasmExecutionContext.h>
 #include <wasm/WasmModule.h>
+#include <wasm/call_metrics.h>
+#include <wasm/state_diff.h>
+#include <wasm/state_disk.h>
+#include <wasm/state_file.h>
+#include <wasm/state_log.h>
+#include <wasm/state_metrics.h>
+#include <wasm/state_replicas.h>
+#include <wasm/state_shard.h>
+#include <wasm/state_version.h>
 #include <wasm_export.h>
 
 using namespace faabric::scheduler;
 
 namespace wasm {
+static std::shared_ptr<faabric::state::StateKeyValue> getStateKV(
+  const char* key,
+  size_t size)
+{
+    std::string user = ExecutorContext::get()->getMsg().user();
+    return getStateReplicaCache().getKV(user, key, size);
+}
+
+// Null unless the key is disk-backed (see state_disk.h)
+static std::shared_ptr<DiskStateValue> getDiskState(const char* key)
+{
+    std::string user = ExecutorContext::get()->getMsg().user();
+    return getDiskStateStore().getValue(user, key);
+}
+
 /**
  * Read state for the given key into the buffer provided.
  *
@@ -21,6 +46,7 @@ static int32_t __faasm_read_state_wrapper(wasm_exec_env_t exec_env,
                                           char* buffer,
                                           int32_t bufferLen)
 {
+    HOST_CALL(State);
     SPDLOG_DEBUG("S - faasm_read_state {} <buffer> {}", key, bufferLen);
 
     std::string user = ExecutorContext::get()->getMsg().user();
@@ -31,7 +57,7 @@ static int32_t __faasm_read_state_wrapper(wasm_exec_env_t exec_env,
         return (int32_t)state.getStateSize(user, key);
     } else {
         // Write state to buffer
-        auto kv = faabric::state::getGlobalState().getKV(user, key, bufferLen);
+        auto kv = getStateReplicaCache().getKV(user, key, bufferLen);
         kv->get(reinterpret_cast<uint8_t*>(buffer));
 
         return kv->size();
@@ -48,14 +74,26 @@ static int32_t __faasm_read_state_ptr_wrapper(wasm_exec_env_t exec_env,
                                               char* key,
                                               int32_t bufferLen)
 {
+    HOST_CALL(State);
+    WasmModule* module = getExecutingModule();
+
+    auto diskValue = getDiskState(key);
+    if (diskValue != nullptr) {
+        SPDLOG_DEBUG("S - faasm_read_state_ptr - {} {} (disk)", key, bufferLen);
+        uint32_t wasmPtr = module->mapDiskStateMemory(diskValue, 0, bufferLen);
+        recordStateMapping(bufferLen);
+
+        return wasmPtr;
+    }
+
     std::string user = ExecutorContext::get()->getMsg().user();
-    auto kv = faabric::state::getGlobalState().getKV(user, key, bufferLen);
+    auto kv = getStateReplicaCache().getKV(user, key, bufferLen);
 
     SPDLOG_DEBUG("S - faasm_read_state_ptr - {} {}", kv->key, bufferLen);
 
     // Map shared memory
-    WasmModule* module = getExecutingModule();
     uint32_t wasmPtr = module->mapSharedStateMemory(kv, 0, bufferLen);
+    recordStateMapping(bufferLen);
 
     // Call get to make sure the value is pulled
     kv->get();
@@ -71,8 +109,9 @@ static void __faasm_write_state_wrapper(wasm_exec_env_t exec_env,
                                         char* buffer,
                                         int32_t bufferLen)
 {
+    HOST_CALL(State);
     std::string user = ExecutorContext::get()->getMsg().user();
-    auto kv = faabric::state::getGlobalState().getKV(user, key, bufferLen);
+    auto kv = getStateReplicaCache().getKV(user, key, bufferLen);
 
     SPDLOG_DEBUG("S - faasm_write_state - {} <data> {}", kv->key, bufferLen);
 
@@ -84,18 +123,597 @@ static void __faasm_write_state_wrapper(wasm_exec_env_t exec_env,
  */
 static void __faasm_push_state_wrapper(wasm_exec_env_t exec_env, char* key)
 {
+    HOST_CALL(State);
     SPDLOG_DEBUG("S - faasm_push_state - {}", key);
 
     std::string user = ExecutorContext::get()->getMsg().user();
-    auto kv = faabric::state::getGlobalState().getKV(user, key, 0);
+    auto kv = getStateReplicaCache().getKV(user, key, 0);
+    kv->pushFull();
+    recordStatePush(kv->size());
+}
+
+/**
+ * Pushes only the chunks of the state for the given key that have been flagged
+ * as dirty
+ */
+static void __faasm_push_state_partial_wrapper(wasm_exec_env_t exec_env,
+                                               char* key)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_push_state_partial - {}", key);
+
+    getStateKV(key, 0)->pushPartial();
+    recordStatePush(0);
+}
+
+/**
+ * Pushes the chunks of the state for the given key that are set in the value
+ * of the mask key
+ */
+static void __faasm_push_state_partial_mask_wrapper(wasm_exec_env_t exec_env,
+                                                    char* key,
+                                                    char* maskKey)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_push_state_partial_mask - {} {}", key, maskKey);
+
+    auto kv = getStateKV(key, 0);
+    auto maskKv = getStateKV(maskKey, 0);
+    kv->pushPartialMask(maskKv);
+    recordStatePush(0);
+}
+
+/**
+ * Pushes whatever has changed in the state for the given key since it was last
+ * pushed this way (see state_diff.h)
+ */
+static int32_t __faasm_push_state_changes_wrapper(wasm_exec_env_t exec_env,
+                                                  char* key)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_push_state_changes - {}", key);
+
+    return (int32_t)pushStateChanges(getStateKV(key, 0));
+}
+
+static void __faasm_lock_state_read_wrapper(wasm_exec_env_t exec_env,
+                                            char* key)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_lock_state_read - {}", key);
+
+    auto kv = getStateKV(key, 0);
+    StateLockTimer lockTimer;
+    kv->lockRead();
+}
+
+static void __faasm_unlock_state_read_wrapper(wasm_exec_env_t exec_env,
+                                              char* key)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_unlock_state_read - {}", key);
+
+    getStateKV(key, 0)->unlockRead();
+}
+
+static void __faasm_lock_state_write_wrapper(wasm_exec_env_t exec_env,
+                                             char* key)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_lock_state_write - {}", key);
+
+    auto kv = getStateKV(key, 0);
+    StateLockTimer lockTimer;
+    kv->lockWrite();
+}
+
+static void __faasm_unlock_state_write_wrapper(wasm_exec_env_t exec_env,
+                                               char* key)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_unlock_state_write - {}", key);
+
+    getStateKV(key, 0)->unlockWrite();
+}
+
+static void __faasm_append_state_wrapper(wasm_exec_env_t exec_env,
+                                         char* key,
+                                         uint8_t* data,
+                                         int32_t dataLen)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_append_state - {} <data> {}", key, dataLen);
+
+    getStateKV(key, 0)->append(data, dataLen);
+}
+
+/**
+ * Reads the given number of appended elements for the given key into the
+ * buffer provided
+ */
+static void __faasm_read_appended_state_wrapper(wasm_exec_env_t exec_env,
+                                                char* key,
+                                                uint8_t* buffer,
+                                                int32_t bufferLen,
+                                                int32_t nElems)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_read_appended_state - {} <buffer> {} {}",
+                 key,
+                 bufferLen,
+                 nElems);
+
+    getStateKV(key, bufferLen)->getAppended(buffer, bufferLen, nElems);
+}
+
+static void __faasm_clear_appended_state_wrapper(wasm_exec_env_t exec_env,
+                                                 char* key)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_clear_appended_state - {}", key);
+
+    getStateKV(key, 0)->clearAppended();
+}
+
+/**
+ * Writes the given data buffer to the state for the given key, at an offset
+ */
+static void __faasm_write_state_offset_wrapper(wasm_exec_env_t exec_env,
+                                               char* key,
+                                               int32_t totalLen,
+                                               int32_t offset,
+                                               uint8_t* data,
+                                               int32_t dataLen)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_write_state_offset - {} {} {} <data> {}",
+                 key,
+                 totalLen,
+                 offset,
+                 dataLen);
+
+    getStateKV(key, totalLen)->setChunk(offset, data, dataLen);
+}
+
+/**
+ * Writes the contents of the given file to the state for the given key,
+ * returning the file's size
+ */
+static int32_t __faasm_write_state_from_file_wrapper(wasm_exec_env_t exec_env,
+                                                     char* key,
+                                                     char* path)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_write_state_from_file - {} {}", key, path);
+
+    std::string user = ExecutorContext::get()->getMsg().user();
+    const std::string maskedPath = storage::prependRuntimeRoot(path);
+
+    return (int32_t)writeStateFromFile(user, key, maskedPath);
+}
+
+/**
+ * Reads the state for the given key at an offset into the buffer provided
+ */
+static void __faasm_read_state_offset_wrapper(wasm_exec_env_t exec_env,
+                                              char* key,
+                                              int32_t totalLen,
+                                              int32_t offset,
+                                              uint8_t* buffer,
+                                              int32_t bufferLen)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_read_state_offset - {} {} {} <buffer> {}",
+                 key,
+                 totalLen,
+                 offset,
+                 bufferLen);
+
+    getStateKV(key, totalLen)->getChunk(offset, buffer, bufferLen);
+}
+
+/**
+ * Maps the given chunk of the state for the given key into memory, and
+ * returns a pointer to it
+ */
+static int32_t readStateOffsetPtr(const char* key,
+                                  int64_t totalLen,
+                                  int64_t offset,
+                                  int32_t len)
+{
+    WasmModule* module = getExecutingModule();
+
+    // Disk-backed values only have the chunks in the range fetched
+    auto diskValue = getDiskState(key);
+    if (diskValue != nullptr) {
+        SPDLOG_DEBUG("S - faasm_read_state_offset_ptr - {} {} {} {} (disk)",
+                     key,
+                     totalLen,
+                     offset,
+                     len);
+        uint32_t wasmPtr = module->mapDiskStateMemory(diskValue, offset, len);
+        recordStateMapping(len);
+
+        return wasmPtr;
+    }
+
+    auto kv = getStateKV(key, totalLen);
+    SPDLOG_DEBUG("S - faasm_read_state_offset_ptr - {} {} {} {}",
+                 kv->key,
+                 totalLen,
+                 offset,
+                 len);
+
+    uint32_t wasmPtr = module->mapSharedStateMemory(kv, offset, len);
+    recordStateMapping(len);
+
+    // Call get to make sure the chunk is pulled
+    kv->getChunk(offset, len);
+
+    return wasmPtr;
+}
+
+static int32_t __faasm_read_state_offset_ptr_wrapper(wasm_exec_env_t exec_env,
+                                                     char* key,
+                                                     int32_t totalLen,
+                                                     int32_t offset,
+                                                     int32_t len)
+{
+    HOST_CALL(State);
+    return readStateOffsetPtr(key, totalLen, offset, len);
+}
+
+// Variant taking a 64-bit size and offset, for values past 2GB
+static int32_t __faasm_read_state_offset_ptr64_wrapper(
+  wasm_exec_env_t exec_env,
+  char* key,
+  int64_t totalLen,
+  int64_t offset,
+  int32_t len)
+{
+    HOST_CALL(State);
+    if (totalLen < 0 || offset < 0 || len < 0) {
+        throw std::runtime_error("Negative state size, offset or length");
+    }
+
+    return readStateOffsetPtr(key, totalLen, offset, len);
+}
+
+static void __faasm_flag_state_dirty_wrapper(wasm_exec_env_t exec_env,
+                                             char* key,
+                                             int32_t totalLen)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_flag_state_dirty - {} {}", key, totalLen);
+
+    getStateKV(key, totalLen)->flagDirty();
+}
+
+static void __faasm_flag_state_offset_dirty_wrapper(wasm_exec_env_t exec_env,
+                                                    char* key,
+                                                    int32_t totalLen,
+                                                    int32_t offset,
+                                                    int32_t len)
+{
+    HOST_CALL(State);
+    // Avoid heavy logging, this is called for every chunk written
+    getStateKV(key, totalLen)->flagChunkDirty(offset, len);
+}
+
+// Versioned pulls skip fetching read-mostly values that haven't changed (see
+// state_version.h)
+static int32_t __faasm_pull_state_versioned_wrapper(wasm_exec_env_t exec_env,
+                                                    char* key,
+                                                    int32_t stateLen)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_pull_state_versioned - {} {}", key, stateLen);
+
+    return pullStateIfChanged(getStateKV(key, stateLen)) ? 1 : 0;
+}
+
+static int64_t __faasm_push_state_versioned_wrapper(wasm_exec_env_t exec_env,
+                                                    char* key)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_push_state_versioned - {}", key);
+
+    return (int64_t)pushStateVersioned(getStateKV(key, 0));
+}
+
+// Sharded state spreads large values over several masters (see state_shard.h)
+static void __faasm_write_state_sharded_wrapper(wasm_exec_env_t exec_env,
+                                                char* key,
+                                                int32_t totalLen,
+                                                int32_t offset,
+                                                uint8_t* data,
+                                                int32_t dataLen)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_write_state_sharded - {} {} {} <data> {}",
+                 key,
+                 totalLen,
+                 offset,
+                 dataLen);
+
+    std::string user = ExecutorContext::get()->getMsg().user();
+    writeStateSharded(
+      user, key, getStateShardLayout(totalLen), offset, data, dataLen);
+}
+
+static void __faasm_read_state_sharded_wrapper(wasm_exec_env_t exec_env,
+                                               char* key,
+                                               int32_t totalLen,
+                                               int32_t offset,
+                                               uint8_t* buffer,
+                                               int32_t bufferLen)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_read_state_sharded - {} {} {} <buffer> {}",
+                 key,
+                 totalLen,
+                 offset,
+                 bufferLen);
+
+    std::string user = ExecutorContext::get()->getMsg().user();
+    StateShardLayout layout = getStateShardLayout(totalLen);
+    readStateSharded(user,
+                     key,
+                     layout,
+                     getStateShardReplica(layout.replicas),
+                     offset,
+                     buffer,
+                     bufferLen);
+}
+
+// Variants taking 64-bit sizes and offsets, for values past 4GB
+static void __faasm_write_state_sharded64_wrapper(wasm_exec_env_t exec_env,
+                                                  char* key,
+                                                  int64_t totalLen,
+                                                  int64_t offset,
+                                                  uint8_t* data,
+                                                  int32_t dataLen)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_write_state_sharded64 - {} {} {} <data> {}",
+                 key,
+                 totalLen,
+                 offset,
+                 dataLen);
+
+    if (totalLen < 0 || offset < 0) {
+        throw std::runtime_error("Negative sharded state size or offset");
+    }
+
+    std::string user = ExecutorContext::get()->getMsg().user();
+    writeStateSharded(
+      user, key, getStateShardLayout(totalLen), offset, data, dataLen);
+}
+
+static void __faasm_read_state_sharded64_wrapper(wasm_exec_env_t exec_env,
+                                                 char* key,
+                                                 int64_t totalLen,
+                                                 int64_t offset,
+                                                 uint8_t* buffer,
+                                                 int32_t bufferLen)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_read_state_sharded64 - {} {} {} <buffer> {}",
+                 key,
+                 totalLen,
+                 offset,
+                 bufferLen);
+
+    if (totalLen < 0 || offset < 0) {
+        throw std::runtime_error("Negative sharded state size or offset");
+    }
+
+    std::string user = ExecutorContext::get()->getMsg().user();
+    StateShardLayout layout = getStateShardLayout(totalLen);
+    readStateSharded(user,
+                     key,
+                     layout,
+                     getStateShardReplica(layout.replicas),
+                     offset,
+                     buffer,
+                     bufferLen);
+}
+
+// Append logs (see state_log.h)
+static int64_t __faasm_append_log_wrapper(wasm_exec_env_t exec_env,
+                                          char* key,
+                                          uint8_t* data,
+                                          int32_t dataLen)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_append_log - {} <data> {}", key, dataLen);
+
+    std::string user = ExecutorContext::get()->getMsg().user();
+    return (int64_t)appendStateLog(user, key, data, dataLen);
+}
+
+static int64_t __faasm_read_log_wrapper(wasm_exec_env_t exec_env,
+                                        char* key,
+                                        int64_t index,
+                                        uint8_t* buffer,
+                                        int32_t bufferLen,
+                                        int32_t timeoutMs)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_read_log - {} {} <buffer> {} {}",
+                 key,
+                 index,
+                 bufferLen,
+                 timeoutMs);
+
+    std::string user = ExecutorContext::get()->getMsg().user();
+    return readStateLog(user, key, index, buffer, bufferLen, timeoutMs);
+}
+
+static void __faasm_trim_log_wrapper(wasm_exec_env_t exec_env,
+                                     char* key,
+                                     int64_t index)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_trim_log - {} {}", key, index);
+
+    std::string user = ExecutorContext::get()->getMsg().user();
+    trimStateLog(user, key, index);
+}
+
+static void __faasm_get_log_bounds_wrapper(wasm_exec_env_t exec_env,
+                                           char* key,
+                                           uint64_t* headPtr,
+                                           uint64_t* tailPtr)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_get_log_bounds - {}", key);
+
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    module->validateNativePointer(headPtr, sizeof(uint64_t));
+    module->validateNativePointer(tailPtr, sizeof(uint64_t));
+
+    std::string user = ExecutorContext::get()->getMsg().user();
+    auto [head, tail] = getStateLogBounds(user, key);
+    *headPtr = head;
+    *tailPtr = tail;
+}
+
+// Handle-based calls skip reading and looking up the key each time
+static int32_t __faasm_get_state_handle_wrapper(wasm_exec_env_t exec_env,
+                                                char* key,
+                                                int32_t stateLen)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - faasm_get_state_handle - {} {}", key, stateLen);
+
+    return getExecutingModule()->getStateHandle(key, stateLen);
+}
+
+static void __faasm_read_state_handle_wrapper(wasm_exec_env_t exec_env,
+                                              int32_t handle,
+                                              int32_t offset,
+                                              uint8_t* buffer,
+                                              int32_t bufferLen)
+{
+    HOST_CALL(State);
+    SPDLOG_TRACE("S - faasm_read_state_handle - {} {} <buffer> {}",
+                 handle,
+                 offset,
+                 bufferLen);
+
+    auto kv = getExecutingModule()->getStateKVForHandle(handle);
+    kv->getChunk(offset, buffer, bufferLen);
+}
+
+static void __faasm_write_state_handle_wrapper(wasm_exec_env_t exec_env,
+                                               int32_t handle,
+                                               int32_t offset,
+                                               uint8_t* data,
+                                               int32_t dataLen)
+{
+    HOST_CALL(State);
+    SPDLOG_TRACE("S - faasm_write_state_handle - {} {} <data> {}",
+                 handle,
+                 offset,
+                 dataLen);
+
+    auto kv = getExecutingModule()->getStateKVForHandle(handle);
+    kv->setChunk(offset, data, dataLen);
+}
+
+static void __faasm_pull_state_handle_wrapper(wasm_exec_env_t exec_env,
+                                              int32_t handle)
+{
+    HOST_CALL(State);
+    SPDLOG_TRACE("S - faasm_pull_state_handle - {}", handle);
+
+    auto kv = getExecutingModule()->getStateKVForHandle(handle);
+    kv->pull();
+    recordStatePull(kv->size());
+}
+
+static void __faasm_push_state_handle_wrapper(wasm_exec_env_t exec_env,
+                                              int32_t handle)
+{
+    HOST_CALL(State);
+    SPDLOG_TRACE("S - faasm_push_state_handle - {}", handle);
+
+    auto kv = getExecutingModule()->getStateKVForHandle(handle);
     kv->pushFull();
+    recordStatePush(kv->size());
+}
+
+static void __faasm_push_state_partial_handle_wrapper(wasm_exec_env_t exec_env,
+                                                      int32_t handle)
+{
+    HOST_CALL(State);
+    SPDLOG_TRACE("S - faasm_push_state_partial_handle - {}", handle);
+
+    getExecutingModule()->getStateKVForHandle(handle)->pushPartial();
+    recordStatePush(0);
+}
+
+static void __faasm_lock_state_handle_wrapper(wasm_exec_env_t exec_env,
+                                              int32_t handle)
+{
+    HOST_CALL(State);
+    SPDLOG_TRACE("S - faasm_lock_state_handle - {}", handle);
+
+    auto kv = getExecutingModule()->getStateKVForHandle(handle);
+    StateLockTimer lockTimer;
+    kv->lockWrite();
+}
+
+static void __faasm_unlock_state_handle_wrapper(wasm_exec_env_t exec_env,
+                                                int32_t handle)
+{
+    HOST_CALL(State);
+    SPDLOG_TRACE("S - faasm_unlock_state_handle - {}", handle);
+
+    getExecutingModule()->getStateKVForHandle(handle)->unlockWrite();
 }
 
 static NativeSymbol ns[] = {
+    REG_NATIVE_FUNC(__faasm_append_log, "($*~)I"),
+    REG_NATIVE_FUNC(__faasm_append_state, "($*~)"),
+    REG_NATIVE_FUNC(__faasm_clear_appended_state, "($)"),
+    REG_NATIVE_FUNC(__faasm_flag_state_dirty, "($i)"),
+    REG_NATIVE_FUNC(__faasm_flag_state_offset_dirty, "($iii)"),
+    REG_NATIVE_FUNC(__faasm_get_log_bounds, "($**)"),
+    REG_NATIVE_FUNC(__faasm_get_state_handle, "($i)i"),
+    REG_NATIVE_FUNC(__faasm_lock_state_handle, "(i)"),
+    REG_NATIVE_FUNC(__faasm_lock_state_read, "($)"),
+    REG_NATIVE_FUNC(__faasm_lock_state_write, "($)"),
+    REG_NATIVE_FUNC(__faasm_pull_state_handle, "(i)"),
+    REG_NATIVE_FUNC(__faasm_pull_state_versioned, "($i)i"),
+    REG_NATIVE_FUNC(__faasm_push_state, "($)"),
+    REG_NATIVE_FUNC(__faasm_push_state_changes, "($)i"),
+    REG_NATIVE_FUNC(__faasm_push_state_handle, "(i)"),
+    REG_NATIVE_FUNC(__faasm_push_state_partial, "($)"),
+    REG_NATIVE_FUNC(__faasm_push_state_partial_handle, "(i)"),
+    REG_NATIVE_FUNC(__faasm_push_state_partial_mask, "($$)"),
+    REG_NATIVE_FUNC(__faasm_push_state_versioned, "($)I"),
+    REG_NATIVE_FUNC(__faasm_read_appended_state, "($*~i)"),
+    REG_NATIVE_FUNC(__faasm_read_log, "($I*~i)I"),
     REG_NATIVE_FUNC(__faasm_read_state, "($$i)i"),
+    REG_NATIVE_FUNC(__faasm_read_state_handle, "(ii*~)"),
+    REG_NATIVE_FUNC(__faasm_read_state_offset, "($ii*~)"),
+    REG_NATIVE_FUNC(__faasm_read_state_offset_ptr, "($iii)i"),
+    REG_NATIVE_FUNC(__faasm_read_state_offset_ptr64, "($IIi)i"),
     REG_NATIVE_FUNC(__faasm_read_state_ptr, "($i)i"),
+    REG_NATIVE_FUNC(__faasm_read_state_sharded, "($ii*~)"),
+    REG_NATIVE_FUNC(__faasm_read_state_sharded64, "($II*~)"),
+    REG_NATIVE_FUNC(__faasm_trim_log, "($I)"),
+    REG_NATIVE_FUNC(__faasm_unlock_state_handle, "(i)"),
+    REG_NATIVE_FUNC(__faasm_unlock_state_read, "($)"),
+    REG_NATIVE_FUNC(__faasm_unlock_state_write, "($)"),
     REG_NATIVE_FUNC(__faasm_write_state, "($$i)"),
-    REG_NATIVE_FUNC(__faasm_push_state, "($)"),
+    REG_NATIVE_FUNC(__faasm_write_state_from_file, "($$)i"),
+    REG_NATIVE_FUNC(__faasm_write_state_handle, "(ii*~)"),
+    REG_NATIVE_FUNC(__faasm_write_state_offset, "($ii*~)"),
+    REG_NATIVE_FUNC(__faasm_write_state_sharded, "($ii*~)"),
+    REG_NATIVE_FUNC(__faasm_write_state_sharded64, "($II*~)"),
 };
 
 uint32_t getFaasmStateApi(NativeSymbol** nativeSymbols)
@@ -1,6 +1,7 @@
 #include <faabric/util/logging.h>
 #include <stdexcept>
 #include <wamr/native.h>
+#include <wasm/call_metrics.h>
 #include <wasm_export.h>
 
 namespace wasm {
@@ -13,6 +14,7 @@ static int32_t syscall_wrapper(wasm_exec_env_t exec_env,
                                int32_t syscallNo,
                                int32_t syscallArgs)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("syscall - {}", syscallNo);
     switch (syscallNo) {
         case 224:
@@ -28,6 +30,7 @@ static int32_t syscall_wrapper(wasm_exec_env_t exec_env,
 static int32_t __cxa_allocate_exception_wrapper(wasm_exec_env_t exec_env,
                                                 int32_t a)
 {
+    HOST_CALL(Other);
     throw std::runtime_error("Native __cxa_allocate_exception not implemented");
 }
 
@@ -36,6 +39,7 @@ static void __cxa_throw_wrapper(wasm_exec_env_t exec_env,
                                 int32_t b,
                                 int32_t c)
 {
+    HOST_CALL(Other);
     throw std::runtime_error("Native __cxa_throw not implemented");
 }
 
@@ -44,6 +48,7 @@ static int32_t shm_open_wrapper(wasm_exec_env_t exec_env,
                                 int32_t b,
                                 int32_t c)
 {
+    HOST_CALL(Other);
     throw std::runtime_error("Native shm_open not implemented");
 }
 
@@ -1,8 +1,9 @@
 #include <faabric/util/logging.h>
-#include <faabric/util/timing.h>
 #include <wamr/WAMRWasmModule.h>
 #include <wamr/native.h>
 #include <wamr/types.h>
+#include <wasm/call_metrics.h>
+#include <wasm/timing.h>
 
 #include <stdexcept>
 #include <sys/time.h>
@@ -14,44 +15,31 @@ uint32_t wasi_clock_time_get(wasm_exec_env_t exec_env,
                              int64_t precision,
                              int32_t* result)
 {
-    SPDLOG_TRACE("S - clock_time_get");
-
-    timespec ts{};
-
-    // This switch statement is duplicated in src/wavm/timing.cpp the reason
-    // being that, even though the constants should be the same, they are
-    // defined in runtime-specific headers. Instead of mixing them up, we
-    // keep the code duplicated
-    int linuxClockId;
-    switch (clockId) {
-        case __WASI_CLOCK_REALTIME:
-            linuxClockId = CLOCK_REALTIME;
-            break;
-        case __WASI_CLOCK_MONOTONIC:
-            linuxClockId = CLOCK_MONOTONIC;
-            break;
-        case __WASI_CLOCK_PROCESS_CPUTIME_ID:
-            linuxClockId = CLOCK_PROCESS_CPUTIME_ID;
-            break;
-        case __WASI_CLOCK_THREAD_CPUTIME_ID:
-            linuxClockId = CLOCK_THREAD_CPUTIME_ID;
-            break;
-        default:
-            SPDLOG_ERROR("Unknown clock ID: {}", clockId);
-            throw std::runtime_error("Unknown clock ID");
+    // Hot path, so no logging (see timing.h)
+    HOST_CALL(Other);
+
+    uint64_t nanos = 0;
+    if (getWasiClockNanos((uint32_t)clockId, &nanos) != 0) {
+        return __WASI_EINVAL;
     }
 
-    int retVal = clock_gettime(linuxClockId, &ts);
-    if (retVal < 0) {
-        if (EINVAL) {
-            return __WASI_EINVAL;
-        }
+    *result = nanos;
+
+    return __WASI_ESUCCESS;
+}
 
-        SPDLOG_ERROR("Unexpected clock error: {}", retVal);
-        throw std::runtime_error("Unexpected clock error");
+uint32_t wasi_clock_res_get(wasm_exec_env_t exec_env,
+                            int32_t clockId,
+                            int64_t* result)
+{
+    HOST_CALL(Other);
+
+    uint64_t nanos = 0;
+    if (getWasiClockResolutionNanos((uint32_t)clockId, &nanos) != 0) {
+        return __WASI_EINVAL;
     }
 
-    *result = faabric::util::timespecToNanos(&ts);
+    *result = nanos;
 
     return __WASI_ESUCCESS;
 }
@@ -62,6 +50,7 @@ uint32_t wasi_poll_oneoff(wasm_exec_env_t exec_env,
                           int32_t nSubs,
                           int32_t* resNEvents)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - poll_oneoff");
 
     WAMRWasmModule* module = getExecutingWAMRModule();
@@ -80,20 +69,13 @@ uint32_t wasi_poll_oneoff(wasm_exec_env_t exec_env,
 
         if (thisSub->u.type == __WASI_EVENTTYPE_CLOCK) {
             // This is a timing event like a sleep
-            uint64_t timeoutNanos = thisSub->u.u.clock.timeout;
-            int clockType = 0;
-            if (thisSub->u.u.clock.clock_id == __WASI_CLOCK_MONOTONIC) {
-                clockType = CLOCK_MONOTONIC;
-            } else if (thisSub->u.u.clock.clock_id == __WASI_CLOCK_REALTIME) {
-                clockType = CLOCK_REALTIME;
-            } else {
+            if (thisSub->u.u.clock.clock_id != __WASI_CLOCK_MONOTONIC &&
+                thisSub->u.u.clock.clock_id != __WASI_CLOCK_REALTIME) {
                 throw std::runtime_error("Unimplemented clock type");
             }
 
-            // Do the sleep
-            timespec t{};
-            faabric::util::nanosToTimespec(timeoutNanos, &t);
-            clock_nanosleep(clockType, 0, &t, nullptr);
+            // Parked so that the sleep can be cut short (see timing.h)
+            sleepNanos(thisSub->u.u.clock.timeout);
         } else {
             throw std::runtime_error("Unimplemented event type");
         }
@@ -109,7 +91,31 @@ uint32_t wasi_poll_oneoff(wasm_exec_env_t exec_env,
     return __WASI_ESUCCESS;
 }
 
+static double omp_get_wtime_wrapper(wasm_exec_env_t execEnv)
+{
+    HOST_CALL(Other);
+    return getTimerSeconds();
+}
+
+static double omp_get_wtick_wrapper(wasm_exec_env_t execEnv)
+{
+    HOST_CALL(Other);
+    return getTimerResolutionSeconds();
+}
+
+static NativeSymbol ns[] = {
+    REG_NATIVE_FUNC(omp_get_wtick, "()F"),
+    REG_NATIVE_FUNC(omp_get_wtime, "()F"),
+};
+
+uint32_t getFaasmTimingApi(NativeSymbol** nativeSymbols)
+{
+    *nativeSymbols = ns;
+    return sizeof(ns) / sizeof(NativeSymbol);
+}
+
 static NativeSymbol wasiNs[] = {
+    REG_WASI_NATIVE_FUNC(clock_res_get, "(i*)i"),
     REG_WASI_NATIVE_FUNC(clock_time_get, "(iI*)i"),
     REG_WASI_NATIVE_FUNC(poll_oneoff, "(**i*)i"),
 };
@@ -0,0 +1,111 @@
+#include <conf/FaasmConfig.h>
+#include <wasm/StdoutCapture.h>
+
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace wasm {
+
+StdoutCapture::StdoutCapture()
+  : StdoutCapture(
+      std::max<int>(conf::getFaasmConfig().captureStdoutMaxBytes, 0))
+{}
+
+StdoutCapture::StdoutCapture(size_t maxBytesIn)
+  : maxBytes(maxBytesIn)
+{}
+
+size_t StdoutCapture::write(const struct ::iovec* iovecs, int iovecCount)
+{
+    std::unique_lock<std::mutex> lock(mx);
+
+    size_t written = 0;
+    for (int i = 0; i < iovecCount; i++) {
+        doWrite(static_cast<const char*>(iovecs[i].iov_base),
+                iovecs[i].iov_len);
+        written += iovecs[i].iov_len;
+    }
+
+    return written;
+}
+
+size_t StdoutCapture::write(const char* data, size_t len)
+{
+    std::unique_lock<std::mutex> lock(mx);
+    doWrite(data, len);
+
+    return len;
+}
+
+void StdoutCapture::doWrite(const char* data, size_t len)
+{
+    if (len >= maxBytes) {
+        // Only the end of the write fits, and replaces everything
+        droppedBytes += buffer.size() + len - maxBytes;
+        buffer.assign(data + len - maxBytes, maxBytes);
+        head = 0;
+        return;
+    }
+
+    size_t nAppended = std::min(len, maxBytes - buffer.size());
+    buffer.append(data, nAppended);
+    data += nAppended;
+    len -= nAppended;
+
+    // Each byte past the cap overwrites the oldest one
+    while (len > 0) {
+        size_t nBytes = std::min(len, maxBytes - head);
+        std::memcpy(buffer.data() + head, data, nBytes);
+        head = (head + nBytes) % maxBytes;
+        droppedBytes += nBytes;
+        data += nBytes;
+        len -= nBytes;
+    }
+}
+
+std::string StdoutCapture::read()
+{
+    std::unique_lock<std::mutex> lock(mx);
+
+    std::string result;
+    if (droppedBytes > 0) {
+        SPDLOG_WARN("Dropped {} bytes of captured stdout", droppedBytes);
+        result = fmt::format("[{} bytes of stdout dropped]\n", droppedBytes);
+    }
+
+    result.append(buffer, head, std::string::npos);
+    result.append(buffer, 0, head);
+
+    return result;
+}
+
+size_t StdoutCapture::size()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    return buffer.size();
+}
+
+size_t StdoutCapture::capacity()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    return buffer.capacity();
+}
+
+size_t StdoutCapture::getDroppedBytes()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    return droppedBytes;
+}
+
+void StdoutCapture::clear()
+{
+    std::unique_lock<std::mutex> lock(mx);
+
+    // Let go of the memory, as the next call may not print anything
+    std::string().swap(buffer);
+    head = 0;
+    droppedBytes = 0;
+}
+}
@@ -1,5 +1,7 @@
 #include "WasmEnvironment.h"
 
+#include <conf/FaasmConfig.h>
+
 #include <cstdlib>
 #include <stdexcept>
 #include <string>
@@ -17,6 +19,14 @@ WasmEnvironment::WasmEnvironment()
     vars["PYTHONHASHSEED"] = "0";
     vars["PYTHONNOUSERSITE"] = "on";
     vars["PYTHONWASM"] = "1";
+
+    // Otherwise bytecode goes next to each source, where it's lost whenever
+    // the sources are synced afresh
+    if (conf::getFaasmConfig().pythonBytecodeCache == "on") {
+        vars["PYTHONPYCACHEPREFIX"] = PYTHON_BYTECODE_CACHE_DIR;
+    }
+
+    varsArray = StringArray(getVars());
 }
 
 std::vector<std::string> WasmEnvironment::getVars()
@@ -39,22 +49,23 @@ std::string WasmEnvironment::getEnv(const std::string& key)
 void WasmEnvironment::addEnv(const std::string& key, const std::string& value)
 {
     vars[key] = value;
+    varsArray = StringArray(getVars());
+}
+
+const StringArray& WasmEnvironment::getVarsArray() const
+{
+    return varsArray;
 }
 
 uint32_t WasmEnvironment::getEnvCount()
 {
-    return vars.size();
+    return varsArray.getCount();
 }
 
 uint32_t WasmEnvironment::getEnvBufferSize()
 {
-    uint32_t bufferSize = 0;
-    for (const auto& v : vars) {
-        // Format is {first}={second}{terminator}
-        bufferSize += v.first.size() + v.second.size() + 2;
-    }
-
-    return bufferSize;
+    // Format is {first}={second}{terminator}
+    return varsArray.getBufferSize();
 }
 
 void WasmEnvironment::printDebugInfo()
@@ -1,7 +1,22 @@
 #include <conf/FaasmConfig.h>
+#include <metrics/LifecycleTrace.h>
+#include <metrics/Metrics.h>
 #include <threads/ThreadState.h>
 #include <wasm/WasmExecutionContext.h>
 #include <wasm/WasmModule.h>
+#include <wasm/call_metrics.h>
+#include <wasm/chaining.h>
+#include <wasm/chaining_shm.h>
+#include <wasm/chaining_stream.h>
+#include <wasm/checkpoint.h>
+#include <wasm/deadline.h>
+#include <wasm/migration.h>
+#include <wasm/mpi_profile.h>
+#include <wasm/mpi_window.h>
+#include <wasm/openmp_profile.h>
+#include <wasm/state_async.h>
+#include <wasm/state_metrics.h>
+#include <wasm/state_replicas.h>
 
 #include <faabric/proto/faabric.pb.h>
 #include <faabric/scheduler/ExecutorContext.h>
@@ -18,7 +33,9 @@
 #include <faabric/util/snapshot.h>
 #include <faabric/util/timing.h>
 
+#include <algorithm>
 #include <boost/filesystem.hpp>
+#include <iterator>
 #include <sstream>
 #include <sys/mman.h>
 #include <sys/uio.h>
@@ -34,6 +51,19 @@ bool isWasmPageAligned(int32_t offset)
     }
 }
 
+std::string getZygoteKey(const faabric::Message& msg)
+{
+    std::string funcStr = faabric::util::funcToString(msg, false);
+    if (!msg.ispython() || msg.pythonuser().empty() ||
+        msg.pythonfunction().empty() ||
+        conf::getFaasmConfig().pythonImportZygote != "on") {
+        return funcStr;
+    }
+
+    return fmt::format(
+      "{}:{}/{}", funcStr, msg.pythonuser(), msg.pythonfunction());
+}
+
 size_t getNumberOfWasmPagesForBytes(size_t nBytes)
 {
     // Round up to nearest page
@@ -65,7 +95,12 @@ WasmModule::WasmModule(int threadPoolSizeIn)
   , reg(faabric::snapshot::getSnapshotRegistry())
 {}
 
-WasmModule::~WasmModule() {}
+WasmModule::~WasmModule()
+{
+    awaitDispatchedPthreads();
+    closeAllChannels();
+    unpinAllStateReplicas();
+}
 
 void WasmModule::flush() {}
 
@@ -146,9 +181,15 @@ void WasmModule::restore(const std::string& snapshotKey)
         throw std::runtime_error("Cannot restore unbound wasm module");
     }
 
+    metrics::TraceScope trace(metrics::TraceEvent::SnapshotRestore);
+
     faabric::snapshot::SnapshotRegistry& reg =
       faabric::snapshot::getSnapshotRegistry();
 
+    // Any stacks we had are overwritten, and are provisioned again if needed
+    clearThreadStacks();
+    clearFreeMemoryRegions();
+
     // Expand memory if necessary
     auto data = reg.getSnapshot(snapshotKey);
     setMemorySize(data->getSize());
@@ -156,17 +197,51 @@ void WasmModule::restore(const std::string& snapshotKey)
     // Map the snapshot into memory
     uint8_t* memoryBase = getMemoryBase();
     data->mapToMemory({ memoryBase, data->getSize() });
+    adviseHugePages(0, data->getSize());
+}
+
+void WasmModule::clearFreeMemoryRegions()
+{
+    faabric::util::FullLock lock(moduleMutex);
+    freeMemoryRegions.clear();
+}
+
+void WasmModule::mapResetSnapshot(const std::string& snapKey)
+{
+    clearFreeMemoryRegions();
+
+    std::shared_ptr<PagedSnapshot> paged = getPageStore().getSnapshot(snapKey);
+    if (paged != nullptr) {
+        setMemorySize(paged->getSize());
+        paged->mapToMemory({ getMemoryBase(), getMemorySizeBytes() });
+        mappedPagedSnapshot = std::move(paged);
+        return;
+    }
+
+    auto data = reg.getSnapshot(snapKey);
+    setMemorySize(data->getSize());
+    data->mapToMemory({ getMemoryBase(), data->getSize() });
+    mappedPagedSnapshot = nullptr;
 }
 
 void WasmModule::ignoreThreadStacksInSnapshot(const std::string& snapKey)
 {
+    uint32_t threadStackRegionStart;
+    {
+        faabric::util::UniqueLock lock(threadStacksMx);
+        if (threadStacks.empty()) {
+            return;
+        }
+
+        // Stacks grow downwards and snapshot diffs are inclusive, so we need
+        // to start the diff on the byte at the bottom of the stacks region
+        threadStackRegionStart =
+          threadStacks.at(0) - (THREAD_STACK_SIZE - 1) - GUARD_REGION_SIZE;
+    }
+
     std::shared_ptr<faabric::util::SnapshotData> snap =
       faabric::snapshot::getSnapshotRegistry().getSnapshot(snapKey);
 
-    // Stacks grow downwards and snapshot diffs are inclusive, so we need to
-    // start the diff on the byte at the bottom of the stacks region
-    uint32_t threadStackRegionStart =
-      threadStacks.at(0) - (THREAD_STACK_SIZE - 1) - GUARD_REGION_SIZE;
     uint32_t threadStackRegionSize =
       threadPoolSize * (THREAD_STACK_SIZE + (2 * GUARD_REGION_SIZE));
 
@@ -184,6 +259,30 @@ void WasmModule::ignoreThreadStacksInSnapshot(const std::string& snapKey)
                          faabric::util::SnapshotMergeOperation::Ignore);
 }
 
+std::vector<std::pair<uint32_t, uint32_t>> WasmModule::getReadOnlyDataRegions()
+{
+    return {};
+}
+
+void WasmModule::ignoreReadOnlyDataInSnapshot(const std::string& snapKey)
+{
+    std::vector<std::pair<uint32_t, uint32_t>> regions =
+      getReadOnlyDataRegions();
+    if (regions.empty()) {
+        return;
+    }
+
+    std::shared_ptr<faabric::util::SnapshotData> snap =
+      faabric::snapshot::getSnapshotRegistry().getSnapshot(snapKey);
+
+    for (const auto& [start, end] : regions) {
+        snap->addMergeRegion(start,
+                             end - start,
+                             faabric::util::SnapshotDataType::Raw,
+                             faabric::util::SnapshotMergeOperation::Ignore);
+    }
+}
+
 std::string WasmModule::getBoundUser()
 {
     return boundUser;
@@ -194,72 +293,80 @@ std::string WasmModule::getBoundFunction()
     return boundFunction;
 }
 
-int WasmModule::getStdoutFd()
+std::string WasmModule::getBoundZygoteKey()
 {
-    if (stdoutMemFd == 0) {
-        stdoutMemFd = memfd_create("stdoutfd", 0);
-        SPDLOG_DEBUG("Capturing stdout: fd={}", stdoutMemFd);
-    }
-
-    return stdoutMemFd;
+    return boundZygoteKey;
 }
 
-ssize_t WasmModule::captureStdout(const struct ::iovec* iovecs, int iovecCount)
+std::string WasmModule::getBoundPythonUser()
 {
-    int memFd = getStdoutFd();
-    ssize_t writtenSize = ::writev(memFd, iovecs, iovecCount);
+    return boundPythonUser;
+}
 
-    if (writtenSize < 0) {
-        SPDLOG_ERROR("Failed capturing stdout: {}", strerror(errno));
-        throw std::runtime_error(std::string("Failed capturing stdout: ") +
-                                 strerror(errno));
-    }
+std::string WasmModule::getBoundPythonFunction()
+{
+    return boundPythonFunction;
+}
 
-    SPDLOG_DEBUG("Captured {} bytes of formatted stdout", writtenSize);
-    stdoutSize += writtenSize;
-    return writtenSize;
+static metrics::Counter& getCapturedStdoutCounter()
+{
+    static metrics::Counter& counter = metrics::getCounter(
+      "faasm_captured_stdout_bytes_total",
+      "Bytes of function stdout captured into call outputs");
+    return counter;
 }
 
-ssize_t WasmModule::captureStdout(const void* buffer)
+static metrics::Counter& getDroppedStdoutCounter()
 {
-    int memFd = getStdoutFd();
+    static metrics::Counter& counter = metrics::getCounter(
+      "faasm_captured_stdout_dropped_bytes_total",
+      "Bytes of captured function stdout dropped over the cap");
+    return counter;
+}
 
-    ssize_t writtenSize =
-      dprintf(memFd, "%s\n", reinterpret_cast<const char*>(buffer));
+ssize_t WasmModule::captureStdout(const struct ::iovec* iovecs, int iovecCount)
+{
+    size_t writtenSize = capturedStdout.write(iovecs, iovecCount);
 
-    if (writtenSize < 0) {
-        SPDLOG_ERROR("Failed capturing stdout: {}", strerror(errno));
-        throw std::runtime_error("Failed capturing stdout");
-    }
+    SPDLOG_TRACE("Captured {} bytes of formatted stdout", writtenSize);
+    getCapturedStdoutCounter().inc(writtenSize);
+    return writtenSize;
+}
 
-    SPDLOG_DEBUG("Captured {} bytes of unformatted stdout", writtenSize);
-    stdoutSize += writtenSize;
+ssize_t WasmModule::captureStdout(const void* buffer)
+{
+    const char* str = reinterpret_cast<const char*>(buffer);
+    size_t len = strlen(str);
+    struct ::iovec iovecs[2] = { { const_cast<char*>(str), len },
+                                 { const_cast<char*>("\n"), 1 } };
+    size_t writtenSize = capturedStdout.write(iovecs, 2);
+
+    SPDLOG_TRACE("Captured {} bytes of unformatted stdout", writtenSize);
+    getCapturedStdoutCounter().inc(writtenSize);
     return writtenSize;
 }
 
 std::string WasmModule::getCapturedStdout()
 {
-    if (stdoutSize == 0) {
-        return "";
-    }
+    // Read once per call, before it's cleared
+    getDroppedStdoutCounter().inc(capturedStdout.getDroppedBytes());
 
-    // Go back to start
-    int memFd = getStdoutFd();
-    lseek(memFd, 0, SEEK_SET);
+    return capturedStdout.read();
+}
 
-    // Read in and return
-    std::string stdoutString(stdoutSize, '\0');
-    read(memFd, stdoutString.data(), stdoutSize);
-    SPDLOG_DEBUG("Read stdout length {}:\n{}", stdoutSize, stdoutString);
+void WasmModule::clearCapturedStdout()
+{
+    capturedStdout.clear();
+}
 
-    return stdoutString;
+uint32_t WasmModule::getBatchIndex()
+{
+    return batchIndex;
 }
 
-void WasmModule::clearCapturedStdout()
+void WasmModule::setBatchIndex(uint32_t batchIndexIn)
 {
-    close(stdoutMemFd);
-    stdoutMemFd = 0;
-    stdoutSize = 0;
+    batchIndex = batchIndexIn;
 }
 
 uint32_t WasmModule::getArgc()
@@ -272,15 +379,27 @@ uint32_t WasmModule::getArgvBufferSize()
     return argvBufferSize;
 }
 
+const StringArray& WasmModule::getArgvArray() const
+{
+    return argvArray;
+}
+
 void WasmModule::bindToFunction(faabric::Message& msg, bool cache)
 {
     if (_isBound) {
         throw std::runtime_error("Cannot bind a module twice");
     }
 
+    metrics::TraceScope trace(metrics::TraceEvent::Bind);
+
     _isBound = true;
     boundUser = msg.user();
     boundFunction = msg.function();
+    boundZygoteKey = getZygoteKey(msg);
+    if (boundZygoteKey != faabric::util::funcToString(msg, false)) {
+        boundPythonUser = msg.pythonuser();
+        boundPythonFunction = msg.pythonfunction();
+    }
 
     // Call into subclass hook, setting the context beforehand
     WasmExecutionContext ctx(this);
@@ -293,15 +412,19 @@ void WasmModule::prepareArgcArgv(const faabric::Message& msg)
     // We allow passing of arbitrary commandline arguments via the
     // invocation message. These are passed as a string with a space
     // separating each argument.
+    if (argvPrepared && msg.cmdline() == argvCmdline) {
+        return;
+    }
+
     argv = faabric::util::getArgvForMessage(msg);
-    argc = argv.size();
+    argvArray = StringArray(argv);
+    argc = argvArray.getCount();
 
-    // Work out the size of the buffer to hold the strings (allowing
-    // for null terminators)
-    argvBufferSize = 0;
-    for (const auto& thisArg : argv) {
-        argvBufferSize += thisArg.size() + 1;
-    }
+    // The buffer holds the strings with their null terminators
+    argvBufferSize = argvArray.getBufferSize();
+
+    argvCmdline = msg.cmdline();
+    argvPrepared = true;
 }
 
 /**
@@ -350,6 +473,7 @@ uint32_t WasmModule::mapSharedStateMemory(
 
             // Cache the wasm pointer
             sharedMemWasmPtrs[segmentKey] = wasmOffsetPtr;
+            pinStateReplica(kv->user, kv->key);
         }
     }
 
@@ -360,11 +484,238 @@ uint32_t WasmModule::mapSharedStateMemory(
     }
 }
 
+uint32_t WasmModule::mapDiskStateMemory(
+  const std::shared_ptr<DiskStateValue>& value,
+  size_t offset,
+  uint32_t length)
+{
+    std::string segmentKey = "disk_" + value->user + "_" + value->key + "__" +
+                             std::to_string(offset) + "__" +
+                             std::to_string(length);
+    {
+        faabric::util::SharedLock lock(sharedMemWasmPtrsMutex);
+        auto it = sharedMemWasmPtrs.find(segmentKey);
+        if (it != sharedMemWasmPtrs.end()) {
+            return it->second;
+        }
+    }
+
+    faabric::util::FullLock lock(sharedMemWasmPtrsMutex);
+    auto it = sharedMemWasmPtrs.find(segmentKey);
+    if (it != sharedMemWasmPtrs.end()) {
+        return it->second;
+    }
+
+    if (offset + length > value->size()) {
+        SPDLOG_ERROR("Mapping disk state {} out of bounds ({} + {} > {})",
+                     value->key,
+                     offset,
+                     length,
+                     value->size());
+        throw std::runtime_error("Mapping disk state out of bounds");
+    }
+
+    // Only the pages covering the range are mapped, as values can be far
+    // bigger than wasm memory
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    size_t alignedOffset = offset - (offset % pageSize);
+    size_t alignedLength = length + (offset - alignedOffset);
+
+    uint32_t wasmBasePtr =
+      this->growMemory(roundUpToWasmPageAligned(alignedLength));
+    value->mapRange(
+      wasmPointerToNative(wasmBasePtr), alignedOffset, alignedLength);
+
+    uint32_t wasmOffsetPtr = wasmBasePtr + (offset - alignedOffset);
+    sharedMemWasmPtrs[segmentKey] = wasmOffsetPtr;
+
+    return wasmOffsetPtr;
+}
+
+void WasmModule::mapSharedStateMemoryAt(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+  uint32_t wasmOffset,
+  size_t nBytes)
+{
+    uint8_t* nativePtr = wasmPointerToNative(wasmOffset);
+    if (((uintptr_t)nativePtr % faabric::util::HOST_PAGE_SIZE) != 0 ||
+        (nBytes % faabric::util::HOST_PAGE_SIZE) != 0) {
+        SPDLOG_ERROR("Mapping state {} at unaligned offset {} ({} bytes)",
+                     kv->key,
+                     wasmOffset,
+                     nBytes);
+        throw std::runtime_error("Mapping state at unaligned offset");
+    }
+
+    if (wasmOffset + nBytes > getMemorySizeBytes()) {
+        SPDLOG_ERROR("Mapping state {} beyond end of memory ({} + {} > {})",
+                     kv->key,
+                     wasmOffset,
+                     nBytes,
+                     getMemorySizeBytes());
+        throw std::runtime_error("Mapping state beyond end of memory");
+    }
+
+    kv->mapSharedMemory(static_cast<void*>(nativePtr),
+                        0,
+                        nBytes / faabric::util::HOST_PAGE_SIZE);
+    pinStateReplica(kv->user, kv->key);
+}
+
+void WasmModule::unmapSharedStateMemoryAt(uint32_t wasmOffset, size_t nBytes)
+{
+    uint8_t* nativePtr = wasmPointerToNative(wasmOffset);
+    std::vector<uint8_t> contents(nativePtr, nativePtr + nBytes);
+
+    // Mapping fresh pages over the region drops the shared ones
+    reclaimMemory(wasmOffset, nBytes);
+    std::memcpy(nativePtr, contents.data(), nBytes);
+}
+
+int32_t WasmModule::getStateHandle(const std::string& key, size_t size)
+{
+    {
+        faabric::util::SharedLock lock(stateHandlesMx);
+        auto it = stateHandleKeys.find(key);
+        if (it != stateHandleKeys.end()) {
+            return it->second;
+        }
+    }
+
+    auto kv = getStateReplicaCache().getKV(boundUser, key, size);
+    pinStateReplica(boundUser, key);
+
+    faabric::util::FullLock lock(stateHandlesMx);
+    auto [it, inserted] =
+      stateHandleKeys.try_emplace(key, (int32_t)stateHandles.size());
+    if (inserted) {
+        stateHandles.push_back(kv);
+    }
+
+    return it->second;
+}
+
+std::shared_ptr<faabric::state::StateKeyValue> WasmModule::getStateKVForHandle(
+  int32_t handle)
+{
+    faabric::util::SharedLock lock(stateHandlesMx);
+    if (handle < 0 || handle >= (int32_t)stateHandles.size()) {
+        SPDLOG_ERROR("Invalid state handle {}", handle);
+        throw std::runtime_error("Invalid state handle");
+    }
+
+    return stateHandles.at(handle);
+}
+
+void WasmModule::pinStateReplica(const std::string& user,
+                                 const std::string& key)
+{
+    faabric::util::UniqueLock lock(pinnedStateReplicasMx);
+    if (pinnedStateReplicas.emplace(user, key).second) {
+        getStateReplicaCache().pin(user, key);
+    }
+}
+
+void WasmModule::copyPinnedStateReplicas(const WasmModule& other)
+{
+    std::set<std::pair<std::string, std::string>> otherPins;
+    {
+        faabric::util::UniqueLock lock(other.pinnedStateReplicasMx);
+        otherPins = other.pinnedStateReplicas;
+    }
+
+    // Pinned before the old ones are dropped, so shared ones stay pinned
+    StateReplicaCache& replicas = getStateReplicaCache();
+    for (const auto& [user, key] : otherPins) {
+        replicas.pin(user, key);
+    }
+
+    unpinAllStateReplicas();
+
+    faabric::util::UniqueLock lock(pinnedStateReplicasMx);
+    pinnedStateReplicas = std::move(otherPins);
+}
+
+void WasmModule::unpinAllStateReplicas()
+{
+    std::set<std::pair<std::string, std::string>> pins;
+    {
+        faabric::util::UniqueLock lock(pinnedStateReplicasMx);
+        pins.swap(pinnedStateReplicas);
+    }
+
+    StateReplicaCache& replicas = getStateReplicaCache();
+    for (const auto& [user, key] : pins) {
+        replicas.unpin(user, key);
+    }
+}
+
+int32_t WasmModule::openChannel(const std::string& name, bool write)
+{
+    IpcChannelEnd end = openIpcChannel(boundUser, name, write);
+
+    faabric::util::UniqueLock lock(channelEndsMx);
+    int32_t handle = nextChannelHandle++;
+    channelEnds.emplace(handle, std::move(end));
+
+    return handle;
+}
+
+IpcChannelEnd WasmModule::getChannelForHandle(int32_t handle)
+{
+    faabric::util::UniqueLock lock(channelEndsMx);
+    auto it = channelEnds.find(handle);
+    if (it == channelEnds.end()) {
+        SPDLOG_ERROR("Invalid IPC channel handle {}", handle);
+        throw std::runtime_error("Invalid IPC channel handle");
+    }
+
+    return it->second;
+}
+
+void WasmModule::closeChannel(int32_t handle)
+{
+    IpcChannelEnd end;
+    {
+        faabric::util::UniqueLock lock(channelEndsMx);
+        auto it = channelEnds.find(handle);
+        if (it == channelEnds.end()) {
+            SPDLOG_ERROR("Invalid IPC channel handle {}", handle);
+            throw std::runtime_error("Invalid IPC channel handle");
+        }
+
+        end = std::move(it->second);
+        channelEnds.erase(it);
+    }
+
+    closeIpcChannel(end);
+}
+
+void WasmModule::closeAllChannels()
+{
+    std::unordered_map<int32_t, IpcChannelEnd> ends;
+    {
+        faabric::util::UniqueLock lock(channelEndsMx);
+        ends.swap(channelEnds);
+    }
+
+    for (auto& it : ends) {
+        closeIpcChannel(it.second);
+    }
+}
+
 uint32_t WasmModule::getCurrentBrk()
 {
     return currentBrk.load(std::memory_order_acquire);
 }
 
+void WasmModule::updatePeakBrk(uint32_t brk)
+{
+    uint32_t peak = peakBrk.load(std::memory_order_relaxed);
+    while (brk > peak && !peakBrk.compare_exchange_weak(peak, brk)) {
+    }
+}
+
 int32_t WasmModule::executeTask(
   int threadPoolIdx,
   int msgIdx,
@@ -383,19 +734,27 @@ int32_t WasmModule::executeTask(
 
     // Set up context for this task
     WasmExecutionContext ctx(this);
+    startCallMetrics();
+    metrics::setTraceMessage(msg.id());
+    peakBrk.store(getCurrentBrk(), std::memory_order_relaxed);
 
-    // Modules must have provisioned their own thread stacks
-    assert(!threadStacks.empty());
-    uint32_t stackTop = threadStacks.at(threadPoolIdx);
+    // Only threads need stacks, which are provisioned on first use
+    bool isThread = req->type() == faabric::BatchExecuteRequest::THREADS;
+    uint32_t stackTop = isThread ? getThreadStack(threadPoolIdx) : 0;
 
     // Ignore stacks and guard pages in snapshot if present
     if (!msg.snapshotkey().empty()) {
         ignoreThreadStacksInSnapshot(msg.snapshotkey());
+        ignoreReadOnlyDataInSnapshot(msg.snapshotkey());
     }
 
+    // This host thread may have executed other threads before
+    clearPthreadSpecifics();
+
     // Perform the appropriate type of execution
     int returnValue;
-    if (req->type() == faabric::BatchExecuteRequest::THREADS) {
+    bool deadlineExpired = false;
+    if (isThread) {
         switch (req->subtype()) {
             case ThreadRequestType::PTHREAD: {
                 SPDLOG_TRACE("Executing {} as pthread", funcStr);
@@ -420,17 +779,92 @@ int32_t WasmModule::executeTask(
                 throw std::runtime_error("Unrecognised thread subtype");
             }
         }
+
+        finishChainedCalls(msg.id());
     } else {
         // Vanilla function
         SPDLOG_TRACE("Executing {} as standard function", funcStr);
-        returnValue = executeFunction(msg);
+        restoreCheckpoint(*this, msg);
+        MigrationPrecopyGuard precopyGuard(msg, *this);
+
+        {
+            faabric::util::UniqueLock lock(pthreadKeysMx);
+            if (!pthreadKeysPersisted) {
+                nPersistentPthreadKeys = pthreadKeyDestructors.size();
+                pthreadKeysPersisted = true;
+            }
+        }
+
+        // Runtimes surface interrupts as whatever error they like, so errors
+        // are only passed on once we know the call wasn't interrupted
+        std::exception_ptr error;
+        {
+            ExecutionDeadlineGuard deadlineGuard(*this, msg);
+            try {
+                returnValue = executeFunction(msg);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+
+        deadlineExpired = isExecutionInterrupted();
+        if (deadlineExpired) {
+            SPDLOG_WARN("{} ran past its deadline and was stopped", funcStr);
+            recoverFromInterrupt();
+            returnValue = EXECUTION_DEADLINE_RETURN_VALUE;
+            msg.set_returnvalue(returnValue);
+        }
+
+        awaitDispatchedPthreads();
+        dropCallPthreadKeys();
+        closeAllChannels();
+
+        // Windows the guest didn't free, e.g. as it failed, would otherwise
+        // keep its memory mapped to their state
+        clearMpiWindows();
+
+        clearCallThreadState();
+
+        // Results of calls chained from this one can't be collected any more,
+        // and failed calls' outputs are replaced by the error
+        finishChainedCalls(msg.id());
+        finishChainedOutputStream(msg.id());
+        finishCheckpoints(msg, !error && !deadlineExpired && returnValue == 0);
+        if (error || deadlineExpired || returnValue != 0) {
+            discardChainedShmOutput(msg.id());
+        }
+
+        if (error && !deadlineExpired) {
+            std::rethrow_exception(error);
+        }
     }
 
-    if (returnValue != 0) {
+    if (deadlineExpired) {
+        msg.set_outputdata("Call stopped at its execution deadline");
+    } else if (returnValue != 0) {
         msg.set_outputdata(
           fmt::format("Call failed (return value={})", returnValue));
     }
 
+    // Write out any OpenMP and MPI profiling from this host
+    flushOpenMPProfile(msg);
+    flushMpiProfile(msg);
+
+    // Don't leave background state transfers running into the next function
+    finishStateOperations();
+    getStateReplicaCache().releaseCallPins();
+
+    // Attach the function's state traffic and other metrics to its result
+    flushStateMetrics(msg);
+
+    uint64_t snapshotBytes = 0;
+    if (!msg.snapshotkey().empty() && reg.snapshotExists(msg.snapshotkey())) {
+        snapshotBytes = reg.getSnapshot(msg.snapshotkey())->getSize();
+    }
+    updatePeakBrk(getCurrentBrk());
+    flushCallMetrics(
+      msg, peakBrk.load(std::memory_order_relaxed), snapshotBytes);
+
     // Add captured stdout if necessary
     conf::FaasmConfig& conf = conf::getFaasmConfig();
     if (conf.captureStdout == "on") {
@@ -473,6 +907,17 @@ void WasmModule::addMergeRegionForNextThreads(
   faabric::util::SnapshotDataType dataType,
   faabric::util::SnapshotMergeOperation mergeOp)
 {
+    // Arrays are declared a region per element, so this needs to be cheap
+    auto it = mergeRegionIdxs.find(wasmPtr);
+    if (it != mergeRegionIdxs.end()) {
+        auto& r = mergeRegions.at(it->second);
+        r.length = regionSize;
+        r.dataType = dataType;
+        r.operation = mergeOp;
+        return;
+    }
+
+    mergeRegionIdxs.emplace(wasmPtr, mergeRegions.size());
     mergeRegions.emplace_back(wasmPtr, regionSize, dataType, mergeOp);
 }
 
@@ -484,6 +929,7 @@ std::vector<faabric::util::SnapshotMergeRegion> WasmModule::getMergeRegions()
 void WasmModule::clearMergeRegions()
 {
     mergeRegions.clear();
+    mergeRegionIdxs.clear();
 }
 
 void WasmModule::queuePthreadCall(threads::PthreadCall call)
@@ -492,6 +938,14 @@ void WasmModule::queuePthreadCall(threads::PthreadCall call)
     // await is called from the same thread, so this doesn't need to be
     // thread-safe.
     queuedPthreadCalls.emplace_back(call);
+
+    size_t batchSize = conf::getFaasmConfig().pthreadDispatchBatch;
+    if (batchSize > 0 && queuedPthreadCalls.size() >= batchSize &&
+        canDispatchPthreadsEagerly()) {
+        faabric::Message& msg =
+          faabric::scheduler::ExecutorContext::get()->getMsg();
+        dispatchPthreadCalls(msg, true);
+    }
 }
 
 int WasmModule::awaitPthreadCall(faabric::Message* msg, int pthreadPtr)
@@ -501,59 +955,42 @@ int WasmModule::awaitPthreadCall(faabric::Message* msg, int pthreadPtr)
     // thread safe.
     assert(msg != nullptr);
 
-    // Execute the queued pthread calls
-    faabric::scheduler::Executor* executor =
-      faabric::scheduler::ExecutorContext::get()->getExecutor();
-    if (!queuedPthreadCalls.empty()) {
-        int nPthreadCalls = queuedPthreadCalls.size();
-
-        std::string funcStr = faabric::util::funcToString(*msg, true);
-        SPDLOG_DEBUG(
-          "Executing {} pthread calls for {}", nPthreadCalls, funcStr);
-
-        std::shared_ptr<faabric::BatchExecuteRequest> req =
-          faabric::util::batchExecFactory(
-            msg->user(), msg->function(), nPthreadCalls);
-
-        req->set_type(faabric::BatchExecuteRequest::THREADS);
-        req->set_subtype(wasm::ThreadRequestType::PTHREAD);
-
-        for (int i = 0; i < nPthreadCalls; i++) {
-            threads::PthreadCall p = queuedPthreadCalls.at(i);
-            faabric::Message& m = req->mutable_messages()->at(i);
-
-            // Propagate app ID
-            m.set_appid(msg->appid());
-
-            // Function pointer and args
-            // NOTE - with a pthread interface we only ever pass the
-            // function a single pointer argument, hence we use the
-            // input data here to hold this argument as a string
-            m.set_funcptr(p.entryFunc);
-            m.set_inputdata(std::to_string(p.argsPtr));
-
-            // Assign a thread ID and increment. Our pthread IDs start
-            // at 1. Set this as part of the group with the other threads.
-            m.set_appidx(i + 1);
-            m.set_groupidx(i + 1);
+    metrics::TraceScope trace(metrics::TraceEvent::ThreadJoin);
 
-            // Record this thread -> call ID
-            SPDLOG_TRACE("pthread {} mapped to call {}", p.pthreadPtr, m.id());
-            pthreadPtrsToChainedCalls.insert({ p.pthreadPtr, m.id() });
+    if (!queuedPthreadCalls.empty()) {
+        bool eager = conf::getFaasmConfig().pthreadDispatchBatch > 0 &&
+                     canDispatchPthreadsEagerly();
+
+        // Threads dispatched from here may go to other hosts, and their
+        // changes are merged by remapping memory once they finish, so nothing
+        // else can still be running
+        if (!eager) {
+            for (auto& it : pthreadCallBatches) {
+                it.second.wait();
+            }
         }
 
-        // Execute the threads and await results
-        lastPthreadResults = executor->executeThreads(req, mergeRegions);
-
-        // Empty the queue
-        queuedPthreadCalls.clear();
+        dispatchPthreadCalls(*msg, eager);
     }
 
     // Get the result of this call
     unsigned int pthreadMsgId = pthreadPtrsToChainedCalls[pthreadPtr];
+    auto batchIt = pthreadCallBatches.find(pthreadMsgId);
+    if (batchIt == pthreadCallBatches.end()) {
+        SPDLOG_ERROR("Did not find a result for pthread: ptr {}, mid {}",
+                     pthreadPtr,
+                     pthreadMsgId);
+        throw std::runtime_error("Result not found for pthread");
+    }
+
+    // Copy the future, as the batch outlives this thread's entry
+    std::shared_future<PthreadResults> results = batchIt->second;
+    pthreadCallBatches.erase(batchIt);
+    pthreadPtrsToChainedCalls.erase(pthreadPtr);
+
     bool found = false;
     int thisResult = 0;
-    for (auto [mid, res] : lastPthreadResults) {
+    for (auto [mid, res] : results.get()) {
         if (pthreadMsgId == mid) {
             thisResult = res;
             found = true;
@@ -568,30 +1005,152 @@ int WasmModule::awaitPthreadCall(faabric::Message* msg, int pthreadPtr)
         throw std::runtime_error("Result not found for pthread");
     }
 
-    // Remove the mapping for this pointer
-    pthreadPtrsToChainedCalls.erase(pthreadPtr);
+    return thisResult;
+}
 
-    // If we're done, clear the results
-    if (pthreadPtrsToChainedCalls.empty()) {
-        lastPthreadResults.clear();
+void WasmModule::awaitDispatchedPthreads()
+{
+    for (auto& it : pthreadCallBatches) {
+        it.second.wait();
     }
 
-    return thisResult;
+    pthreadCallBatches.clear();
+    pthreadPtrsToChainedCalls.clear();
 }
 
-void WasmModule::createThreadStacks()
+bool WasmModule::canDispatchPthreadsEagerly()
 {
-    SPDLOG_DEBUG("Creating {} thread stacks", threadPoolSize);
+    // Threads dispatched while the main thread carries on must stay on this
+    // host, as changes from remote threads are merged by remapping memory. We
+    // only dispatch as many as fit in the thread pool alongside the main
+    // thread, which the scheduler keeps on this host.
+    size_t lastIdx = getNextPthreadIdx() + queuedPthreadCalls.size() - 1;
+    return lastIdx < (size_t)threadPoolSize;
+}
+
+int WasmModule::getNextPthreadIdx()
+{
+    // Our pthread IDs start at 1, the main thread being 0
+    if (nDispatchedPthreads == 0) {
+        return 1;
+    }
+
+    return nextPthreadIdx;
+}
+
+void WasmModule::dispatchPthreadCalls(faabric::Message& msg, bool eager)
+{
+    int nPthreadCalls = queuedPthreadCalls.size();
+    metrics::TraceScope trace(metrics::TraceEvent::ThreadFork, nPthreadCalls);
+
+    std::string funcStr = faabric::util::funcToString(msg, true);
+    SPDLOG_DEBUG("Executing {} pthread calls for {}{}",
+                 nPthreadCalls,
+                 funcStr,
+                 eager ? " in the background" : "");
+
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory(
+        msg.user(), msg.function(), nPthreadCalls);
+
+    req->set_type(faabric::BatchExecuteRequest::THREADS);
+    req->set_subtype(wasm::ThreadRequestType::PTHREAD);
+
+    // Threads still running in the background keep their IDs
+    int firstIdx = getNextPthreadIdx();
+    for (int i = 0; i < nPthreadCalls; i++) {
+        threads::PthreadCall p = queuedPthreadCalls.at(i);
+        faabric::Message& m = req->mutable_messages()->at(i);
+
+        // Propagate app ID
+        m.set_appid(msg.appid());
+
+        // Function pointer and args
+        m.set_funcptr(p.entryFunc);
+        threads::setPthreadArgsPtr(m, p.argsPtr);
+
+        // Assign a thread ID and increment. Set this as part of the group
+        // with the other threads.
+        m.set_appidx(firstIdx + i);
+        m.set_groupidx(firstIdx + i);
+
+        // Record this thread -> call ID
+        SPDLOG_TRACE("pthread {} mapped to call {}", p.pthreadPtr, m.id());
+        pthreadPtrsToChainedCalls.insert({ p.pthreadPtr, m.id() });
+    }
+
+    queuedPthreadCalls.clear();
+
+    std::shared_ptr<faabric::scheduler::ExecutorContext> parentCtx =
+      faabric::scheduler::ExecutorContext::get();
+    faabric::scheduler::Executor* executor = parentCtx->getExecutor();
+    std::vector<faabric::util::SnapshotMergeRegion> regions = mergeRegions;
+    auto execute = [executor, req, regions] {
+        return executor->executeThreads(req, regions);
+    };
+
+    // Deferred batches are executed by the first join that needs them, eager
+    // ones straight away in the background with the main thread's context
+    std::shared_future<PthreadResults> results;
+    if (eager) {
+        nDispatchedPthreads += nPthreadCalls;
+        nextPthreadIdx = firstIdx + nPthreadCalls;
+
+        auto executeInBackground = [this, parentCtx, execute, nPthreadCalls] {
+            faabric::scheduler::ExecutorContext::set(
+              parentCtx->getExecutor(),
+              parentCtx->getBatchRequest(),
+              parentCtx->getMsgIdx());
+
+            PthreadResults res;
+            try {
+                res = execute();
+            } catch (...) {
+                nDispatchedPthreads -= nPthreadCalls;
+                throw;
+            }
+
+            nDispatchedPthreads -= nPthreadCalls;
+            return res;
+        };
+
+        results = std::async(std::launch::async, executeInBackground).share();
+    } else {
+        results = std::async(std::launch::deferred, execute).share();
+    }
+
+    for (const auto& m : req->messages()) {
+        pthreadCallBatches.insert({ m.id(), results });
+    }
+}
+
+void WasmModule::provisionThreadStacks()
+{
+    faabric::util::UniqueLock lock(threadStacksMx);
+    if (!threadStacks.empty()) {
+        return;
+    }
 
-    for (int i = 0; i < threadPoolSize; i++) {
-        // Allocate thread stack and guard pages
-        uint32_t memSize = THREAD_STACK_SIZE + (2 * GUARD_REGION_SIZE);
-        uint32_t memBase = growMemory(memSize);
+    // The pool's stacks are grown in one go, so they're at the same offsets
+    // in every module restored from the same snapshot, and their merge regions
+    // line up
+    addThreadStacks(threadPoolSize);
+}
+
+void WasmModule::addThreadStacks(int nStacks)
+{
+    SPDLOG_DEBUG("Creating {} thread stacks", nStacks);
+
+    uint32_t stackSize = THREAD_STACK_SIZE + (2 * GUARD_REGION_SIZE);
+    uint32_t regionBase = growMemory(nStacks * stackSize);
+    growMemoryInChunks = true;
 
+    for (int i = 0; i < nStacks; i++) {
         // Note that wasm stacks grow downwards, so we have to store the
         // stack top, which is the offset one below the guard region above
         // the stack Subtract 16 to make sure the stack is 16-aligned as
         // required by the C ABI
+        uint32_t memBase = regionBase + i * stackSize;
         uint32_t stackTop =
           memBase + GUARD_REGION_SIZE + THREAD_STACK_SIZE - 16;
         threadStacks.push_back(stackTop);
@@ -602,44 +1161,226 @@ void WasmModule::createThreadStacks()
     }
 }
 
-std::vector<uint32_t> WasmModule::getThreadStacks()
+void WasmModule::clearThreadStacks()
 {
-    return threadStacks;
+    faabric::util::UniqueLock lock(threadStacksMx);
+    threadStacks.clear();
 }
 
-std::shared_ptr<std::mutex> WasmModule::getPthreadMutex(uint32_t id)
+void WasmModule::protectThreadStacks()
 {
-    faabric::util::SharedLock lock(pthreadLocksMx);
-    auto it = pthreadLocks.find(id);
-    if (it != pthreadLocks.end()) {
-        return it->second;
-    }
+    faabric::util::UniqueLock lock(threadStacksMx);
+    for (uint32_t stackTop : threadStacks) {
+        uint32_t memBase =
+          stackTop + 16 - THREAD_STACK_SIZE - GUARD_REGION_SIZE;
 
-    SPDLOG_ERROR("Trying to get non-existent pthread lock {}", id);
-    throw std::runtime_error("Non-existent pthread lock");
+        // Add guard regions
+        createMemoryGuardRegion(memBase);
+        createMemoryGuardRegion(stackTop + 16);
+    }
+}
+
+uint32_t WasmModule::getThreadStack(int threadPoolIdx)
+{
+    provisionThreadStacks();
+
+    faabric::util::UniqueLock lock(threadStacksMx);
+    return threadStacks.at(threadPoolIdx);
+}
+
+std::vector<uint32_t> WasmModule::getThreadStacks()
+{
+    provisionThreadStacks();
+
+    faabric::util::UniqueLock lock(threadStacksMx);
+    return threadStacks;
+}
+
+int WasmModule::getMaxThreadPoolSize() const
+{
+    return std::max(threadPoolSize, faabric::util::getUsableCores());
+}
+
+std::vector<uint32_t> WasmModule::getThreadStacks(int nStacks)
+{
+    if (nStacks > getMaxThreadPoolSize()) {
+        SPDLOG_ERROR("Asked for {} thread stacks, max is {}",
+                     nStacks,
+                     getMaxThreadPoolSize());
+        throw std::runtime_error("Too many thread stacks");
+    }
+
+    provisionThreadStacks();
+
+    // Stacks past the pool's are only used by local teams, which never take
+    // snapshots, so they don't need to line up between modules
+    faabric::util::UniqueLock lock(threadStacksMx);
+    if ((int)threadStacks.size() < nStacks) {
+        addThreadStacks(nStacks - threadStacks.size());
+    }
+
+    return threadStacks;
+}
+
+FutexMutexSlab& WasmModule::getPthreadMutexSlab()
+{
+    return pthreadMutexSlab;
 }
 
-std::shared_ptr<std::mutex> WasmModule::getOrCreatePthreadMutex(uint32_t id)
+std::shared_ptr<std::condition_variable_any>
+WasmModule::getOrCreatePthreadCond(uint32_t id)
 {
-    std::shared_ptr<std::mutex> mx = nullptr;
     {
-        faabric::util::SharedLock lock(pthreadLocksMx);
-        auto it = pthreadLocks.find(id);
-        if (it != pthreadLocks.end()) {
+        faabric::util::SharedLock lock(pthreadCondsMx);
+        auto it = pthreadConds.find(id);
+        if (it != pthreadConds.end()) {
             return it->second;
         }
     }
 
-    faabric::util::FullLock lock(pthreadLocksMx);
-    auto it = pthreadLocks.find(id);
-    if (it != pthreadLocks.end()) {
-        return it->second;
+    faabric::util::FullLock lock(pthreadCondsMx);
+    auto [it, inserted] = pthreadConds.try_emplace(id, nullptr);
+    if (inserted) {
+        it->second = std::make_shared<std::condition_variable_any>();
+    }
+
+    return it->second;
+}
+
+// Host threads execute many wasm threads, and modules, one after the other,
+// so values only count for the module that set them
+struct PthreadKeyValues
+{
+    const WasmModule* module = nullptr;
+    std::vector<int32_t> values;
+};
+
+static thread_local PthreadKeyValues threadKeyValues;
+
+int32_t WasmModule::createPthreadKey(int32_t destructorFunc)
+{
+    int32_t key;
+    {
+        faabric::util::UniqueLock lock(pthreadKeysMx);
+        if (pthreadKeyDestructors.size() >= MAX_PTHREAD_KEYS) {
+            SPDLOG_ERROR("All {} pthread keys in use", MAX_PTHREAD_KEYS);
+            return -1;
+        }
+
+        key = (int32_t)pthreadKeyDestructors.size();
+        pthreadKeyDestructors.push_back(destructorFunc);
+    }
+
+    // The key may previously have been used in an earlier call
+    setPthreadSpecific(key, 0);
+
+    return key;
+}
+
+void WasmModule::deletePthreadKey(int32_t key)
+{
+    // Keys aren't reused until the end of the call, so just drop the
+    // destructor
+    faabric::util::UniqueLock lock(pthreadKeysMx);
+    if (key >= 0 && key < (int32_t)pthreadKeyDestructors.size()) {
+        pthreadKeyDestructors.at(key) = 0;
+    }
+}
+
+int32_t WasmModule::getPthreadSpecific(int32_t key)
+{
+    if (threadKeyValues.module != this || key < 0 ||
+        key >= (int32_t)threadKeyValues.values.size()) {
+        return 0;
+    }
+
+    return threadKeyValues.values[key];
+}
+
+bool WasmModule::setPthreadSpecific(int32_t key, int32_t value)
+{
+    if (key < 0 || key >= MAX_PTHREAD_KEYS) {
+        return false;
     }
 
-    mx = std::make_shared<std::mutex>();
-    pthreadLocks[id] = mx;
+    if (threadKeyValues.module != this) {
+        clearPthreadSpecifics();
+    }
+
+    if (key >= (int32_t)threadKeyValues.values.size()) {
+        threadKeyValues.values.resize(key + 1, 0);
+    }
+
+    threadKeyValues.values[key] = value;
+    return true;
+}
 
-    return mx;
+void WasmModule::clearPthreadSpecifics()
+{
+    threadKeyValues.module = this;
+    threadKeyValues.values.clear();
+}
+
+void WasmModule::runPthreadKeyDestructors(
+  const std::function<void(int32_t, int32_t)>& callDestructor)
+{
+    if (threadKeyValues.module != this) {
+        return;
+    }
+
+    for (int i = 0; i < PTHREAD_KEY_DESTRUCTOR_ITERATIONS; i++) {
+        std::vector<std::pair<int32_t, int32_t>> calls;
+        {
+            faabric::util::UniqueLock lock(pthreadKeysMx);
+            std::vector<int32_t>& values = threadKeyValues.values;
+            for (size_t key = 0; key < values.size(); key++) {
+                if (values[key] == 0 || key >= pthreadKeyDestructors.size() ||
+                    pthreadKeyDestructors[key] == 0) {
+                    continue;
+                }
+
+                // Values are cleared before their destructor is called
+                calls.emplace_back(pthreadKeyDestructors[key], values[key]);
+                values[key] = 0;
+            }
+        }
+
+        if (calls.empty()) {
+            break;
+        }
+
+        for (auto [func, value] : calls) {
+            callDestructor(func, value);
+        }
+    }
+}
+
+void WasmModule::dropCallPthreadKeys()
+{
+    faabric::util::UniqueLock lock(pthreadKeysMx);
+    if (!pthreadKeysPersisted) {
+        return;
+    }
+
+    pthreadKeyDestructors.resize(nPersistentPthreadKeys);
+}
+
+std::shared_ptr<std::recursive_mutex> WasmModule::getOrCreateCriticalMutex(
+  uint32_t crit)
+{
+    {
+        faabric::util::SharedLock lock(criticalLocksMx);
+        auto it = criticalLocks.find(crit);
+        if (it != criticalLocks.end()) {
+            return it->second;
+        }
+    }
+
+    faabric::util::FullLock lock(criticalLocksMx);
+    auto [it, inserted] =
+      criticalLocks.try_emplace(crit, std::make_shared<std::recursive_mutex>());
+
+    return it->second;
 }
 
 bool WasmModule::isBound()
@@ -656,6 +1397,11 @@ void WasmModule::reset(faabric::Message& msg, const std::string& snapshotKey)
     SPDLOG_WARN("Using default reset of wasm module");
 }
 
+bool WasmModule::hasBatchHandler()
+{
+    return false;
+}
+
 void WasmModule::doBindToFunction(faabric::Message& msg, bool cache)
 {
     throw std::runtime_error("doBindToFunction not implemented");
@@ -674,86 +1420,119 @@ void WasmModule::writeWasmEnvToMemory(uint32_t envPointers, uint32_t envBuffer)
 
 uint32_t WasmModule::growMemory(size_t nBytes)
 {
-    if (nBytes == 0) {
-        return currentBrk.load(std::memory_order_acquire);
-    }
-
-    faabric::util::FullLock lock(moduleMutex);
-
-    uint32_t oldBytes = getMemorySizeBytes();
     uint32_t oldBrk = currentBrk.load(std::memory_order_acquire);
-    uint32_t newBrk = oldBrk + nBytes;
-
-    if (!isWasmPageAligned(newBrk)) {
-        SPDLOG_ERROR("Growing memory by {} is not wasm page aligned"
-                     " (current brk: {}, new brk: {})",
-                     nBytes,
-                     oldBrk,
-                     newBrk);
-        throw std::runtime_error("Non-wasm-page-aligned memory growth");
+    if (nBytes == 0) {
+        return oldBrk;
     }
 
-    size_t newBytes = oldBytes + nBytes;
-    uint32_t oldPages = getNumberOfWasmPagesForBytes(oldBytes);
-    uint32_t newPages = getNumberOfWasmPagesForBytes(newBytes);
-    size_t maxPages = getMaxMemoryPages();
-
-    if (newBytes > UINT32_MAX || newPages > maxPages) {
-        SPDLOG_ERROR("Growing memory would exceed max of {} pages (current {}, "
-                     "requested {})",
-                     maxPages,
-                     oldPages,
-                     newPages);
-        throw std::runtime_error("Memory growth exceeding max");
+    // Bumps within committed memory don't need the lock, as everything above
+    // the brk is already zeroed and writable
+    if (isWasmPageAligned(nBytes)) {
+        size_t committedBytes = getMemorySizeBytes();
+        while (oldBrk + nBytes <= committedBytes) {
+            uint32_t newBrk = oldBrk + nBytes;
+            if (currentBrk.compare_exchange_weak(oldBrk,
+                                                 newBrk,
+                                                 std::memory_order_acq_rel,
+                                                 std::memory_order_acquire)) {
+                SPDLOG_TRACE(
+                  "MEM - Growing memory lock-free {} + {}", oldBrk, nBytes);
+                updatePeakBrk(newBrk);
+                return oldBrk;
+            }
+        }
     }
 
-    // If we can reclaim old memory, just bump the break
-    if (newBrk <= oldBytes) {
-        SPDLOG_TRACE(
-          "MEM - Growing memory using already provisioned {} + {} <= {}",
-          oldBrk,
-          nBytes,
-          oldBytes);
+    faabric::util::FullLock lock(moduleMutex);
 
-        currentBrk.store(newBrk, std::memory_order_release);
+    while (true) {
+        oldBrk = currentBrk.load(std::memory_order_acquire);
+        size_t newBrk = oldBrk + nBytes;
+
+        if (!isWasmPageAligned(nBytes)) {
+            SPDLOG_ERROR("Growing memory by {} is not wasm page aligned"
+                         " (current brk: {}, new brk: {})",
+                         nBytes,
+                         oldBrk,
+                         newBrk);
+            throw std::runtime_error("Non-wasm-page-aligned memory growth");
+        }
 
-        // Make sure permissions on memory are open
-        size_t newTop = faabric::util::getRequiredHostPages(currentBrk);
-        size_t newStart = faabric::util::getRequiredHostPagesRoundDown(oldBrk);
-        newTop *= faabric::util::HOST_PAGE_SIZE;
-        newStart *= faabric::util::HOST_PAGE_SIZE;
-        SPDLOG_TRACE("Reclaiming memory {}-{}", newStart, newTop);
+        size_t oldBytes = getMemorySizeBytes();
+        uint32_t oldPages = getNumberOfWasmPagesForBytes(oldBytes);
+        uint32_t newPages = getNumberOfWasmPagesForBytes(newBrk);
+        size_t maxPages = getMemoryPagesLimit();
+
+        if (newBrk > UINT32_MAX || newPages > maxPages) {
+            SPDLOG_ERROR("Growing memory would exceed max of {} pages "
+                         "(current {}, requested {})",
+                         maxPages,
+                         oldPages,
+                         newPages);
+            throw std::runtime_error("Memory growth exceeding max");
+        }
 
-        uint8_t* memBase = getMemoryBase();
-        faabric::util::claimVirtualMemory(
-          { memBase + newStart, memBase + newTop });
+        if (newBrk <= oldBytes) {
+            // If we can reclaim old memory, just bump the break
+            SPDLOG_TRACE(
+              "MEM - Growing memory using already provisioned {} + {} <= {}",
+              oldBrk,
+              nBytes,
+              oldBytes);
+
+            // Make sure permissions on memory are open
+            size_t newTop = faabric::util::getRequiredHostPages(newBrk);
+            size_t newStart =
+              faabric::util::getRequiredHostPagesRoundDown(oldBrk);
+            newTop *= faabric::util::HOST_PAGE_SIZE;
+            newStart *= faabric::util::HOST_PAGE_SIZE;
+            SPDLOG_TRACE("Reclaiming memory {}-{}", newStart, newTop);
+
+            uint8_t* memBase = getMemoryBase();
+            faabric::util::claimVirtualMemory(
+              { memBase + newStart, memBase + newTop });
+        } else {
+            // With threads, commit more than needed so that the next bumps
+            // don't come through here
+            uint32_t targetPages = newPages;
+            if (growMemoryInChunks.load(std::memory_order_relaxed)) {
+                targetPages = std::min<size_t>(
+                  std::max(newPages, oldPages + MEMORY_GROWTH_CHUNK_PAGES),
+                  maxPages);
+            }
 
-        return oldBrk;
-    }
+            bool success = doGrowMemory(targetPages - oldPages);
+            if (!success) {
+                throw std::runtime_error("Failed to grow memory");
+            }
 
-    uint32_t pageChange = newPages - oldPages;
-    bool success = doGrowMemory(pageChange);
-    if (!success) {
-        throw std::runtime_error("Failed to grow memory");
-    }
+            SPDLOG_TRACE("Growing memory from {} to {} pages (max {})",
+                         oldPages,
+                         targetPages,
+                         maxPages);
 
-    SPDLOG_TRACE("Growing memory from {} to {} pages (max {})",
-                 oldPages,
-                 newPages,
-                 maxPages);
+            size_t newMemorySize = getMemorySizeBytes();
+            adviseHugePages(oldBytes, newMemorySize - oldBytes);
 
-    size_t newMemorySize = getMemorySizeBytes();
-    currentBrk.store(newMemorySize, std::memory_order_release);
+            if (newMemorySize != (size_t)targetPages * WASM_BYTES_PER_PAGE) {
+                SPDLOG_ERROR("Expected memory to grow to {} pages, but it's "
+                             "{} bytes",
+                             targetPages,
+                             newMemorySize);
+                throw std::runtime_error("Memory growth discrepancy");
+            }
+        }
 
-    if (newMemorySize != newBytes) {
-        SPDLOG_ERROR(
-          "Expected new brk ({}) to be old memory plus new bytes ({})",
-          newMemorySize,
-          newBytes);
-        throw std::runtime_error("Memory growth discrepancy");
+        // A lock-free bump may have got in first, in which case we go again
+        // from the new brk, with the memory already grown
+        if (currentBrk.compare_exchange_strong(oldBrk,
+                                               (uint32_t)newBrk,
+                                               std::memory_order_acq_rel,
+                                               std::memory_order_acquire)) {
+            updatePeakBrk(newBrk);
+            return oldBrk;
+        }
     }
-
-    return oldBrk;
 }
 
 bool WasmModule::doGrowMemory(uint32_t pageChange)
@@ -771,32 +1550,186 @@ uint32_t WasmModule::shrinkMemory(size_t nBytes)
     faabric::util::FullLock lock(moduleMutex);
 
     uint32_t oldBrk = currentBrk.load(std::memory_order_acquire);
-
     if (nBytes > oldBrk) {
         SPDLOG_ERROR(
           "Shrinking by more than current brk ({} > {})", nBytes, oldBrk);
         throw std::runtime_error("Shrinking by more than current brk");
     }
 
-    // Note - we don't actually free the memory, we just change the brk
-    uint32_t newBrk = oldBrk - nBytes;
+    // Wasm memory can't shrink, so we lower the brk and release the pages. If
+    // a lock-free bump gets in first, the pages above the old brk belong to
+    // whoever bumped it, so ours are freed as a hole instead.
+    uint32_t newBrk = oldBrk - (uint32_t)nBytes;
+    if (!tryLowerBrk(oldBrk, newBrk)) {
+        SPDLOG_TRACE("MEM - brk moved past {}, freeing {} as a hole",
+                     oldBrk,
+                     nBytes);
+        addFreeMemoryRegion(newBrk, oldBrk);
+    }
+
+    return oldBrk;
+}
+
+bool WasmModule::tryLowerBrk(uint32_t oldBrk, uint32_t newBrk)
+{
+    // Absorb a hole that ends at the new brk, as that memory is already free
+    auto firstDropped = freeMemoryRegions.lower_bound(newBrk);
+    if (firstDropped != freeMemoryRegions.begin()) {
+        auto last = std::prev(firstDropped);
+        if (last->first + last->second >= newBrk) {
+            newBrk = last->first;
+            firstDropped = last;
+        }
+    }
+
+    // Pages are released before the brk comes down, so lock-free bumps never
+    // get pages that are still being reclaimed. If the brk has moved, the
+    // pages are still being freed by the caller, so releasing them is fine.
+    reclaimMemory(newBrk, oldBrk - newBrk);
+
+    if (!currentBrk.compare_exchange_strong(
+          oldBrk, newBrk, std::memory_order_acq_rel)) {
+        return false;
+    }
 
     SPDLOG_TRACE("MEM - shrinking memory {} -> {}", oldBrk, newBrk);
-    currentBrk.store(newBrk, std::memory_order_release);
 
-    return oldBrk;
+    // Drop any holes that are now above the brk
+    freeMemoryRegions.erase(firstDropped, freeMemoryRegions.end());
+
+    return true;
 }
 
 uint32_t WasmModule::mmapMemory(size_t nBytes)
 {
     // The mmap interface allows non page-aligned values, and rounds up
     uint32_t pageAligned = roundUpToWasmPageAligned(nBytes);
+
+    // Reuse the first hole that fits before growing at the top
+    {
+        faabric::util::FullLock lock(moduleMutex);
+        for (auto it = freeMemoryRegions.begin();
+             it != freeMemoryRegions.end();
+             ++it) {
+            if (it->second < pageAligned) {
+                continue;
+            }
+
+            uint32_t offset = it->first;
+            uint32_t remaining = it->second - pageAligned;
+            freeMemoryRegions.erase(it);
+            if (remaining > 0) {
+                freeMemoryRegions[offset + pageAligned] = remaining;
+            }
+
+            SPDLOG_TRACE(
+              "MEM - reusing unmapped memory {} at {}", pageAligned, offset);
+            return offset;
+        }
+    }
+
     return growMemory(pageAligned);
 }
 
-uint32_t WasmModule::mmapFile(uint32_t fp, size_t length)
+uint32_t WasmModule::mmapFile(uint32_t fd, size_t length)
+{
+    return mmapFile(fd, length, PROT_READ, MAP_SHARED, 0);
+}
+
+uint32_t WasmModule::mmapFile(uint32_t fd,
+                              size_t length,
+                              int prot,
+                              int flags,
+                              uint64_t offset)
 {
-    throw std::runtime_error("mmapFile not implemented");
+    if (offset % faabric::util::HOST_PAGE_SIZE != 0) {
+        SPDLOG_ERROR("Non-page aligned file mmap offset {}", offset);
+        throw std::runtime_error("Non-page aligned file mmap offset");
+    }
+
+    // Read-only mappings are shared, so every instance reads the same page
+    // cache. Writable ones are private so writes never reach the file.
+    bool writable = (prot & PROT_WRITE) != 0;
+    if (writable && (flags & MAP_SHARED) != 0) {
+        SPDLOG_WARN("Mapping fd {} private, shared writable file mappings are "
+                    "not supported",
+                    fd);
+    }
+    int mapProt = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    int mapFlags = MAP_FIXED | (writable ? MAP_PRIVATE : MAP_SHARED);
+
+    // Reserve the region in linear memory, then map the file over it
+    uint32_t wasmPtr = mmapMemory(length);
+    uint8_t* targetPtr = getMemoryBase() + wasmPtr;
+
+    void* mappedPtr = mmap(targetPtr, length, mapProt, mapFlags, fd, offset);
+    if (mappedPtr == MAP_FAILED) {
+        SPDLOG_ERROR("Failed mmapping file descriptor {} ({} - {})",
+                     fd,
+                     errno,
+                     strerror(errno));
+        throw std::runtime_error("Unable to map file");
+    }
+
+    return wasmPtr;
+}
+
+uint32_t WasmModule::mapReadOnlyBytes(const std::string& data)
+{
+    if (data.empty()) {
+        return 0;
+    }
+
+    uint32_t wasmPtr = mmapMemory(data.size());
+    uint8_t* nativePtr = wasmPointerToNative(wasmPtr);
+    std::memcpy(nativePtr, data.data(), data.size());
+
+    // Writes trap rather than changing the data under the guest. Unmapping
+    // reclaims the region with fresh writable pages.
+    int res = mprotect(
+      nativePtr, roundUpToWasmPageAligned(data.size()), PROT_READ);
+    if (res != 0) {
+        SPDLOG_ERROR("Failed to make {} bytes at {} read-only: {}",
+                     data.size(),
+                     wasmPtr,
+                     std::strerror(errno));
+        throw std::runtime_error("Failed to map read-only bytes");
+    }
+
+    return wasmPtr;
+}
+
+uint32_t WasmModule::mapReadOnlyState(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+  size_t offset,
+  uint32_t length)
+{
+    if (length == 0) {
+        return 0;
+    }
+
+    // Whole pages are mapped, with the range part way into the first
+    faabric::util::AlignedChunk chunk =
+      faabric::util::getPageAlignedChunk(offset, length);
+    uint32_t wasmBasePtr = mmapMemory(chunk.nBytesLength);
+    uint8_t* nativePtr = wasmPointerToNative(wasmBasePtr);
+    kv->mapSharedMemory(static_cast<void*>(nativePtr),
+                        chunk.nPagesOffset,
+                        chunk.nPagesLength);
+    pinStateReplica(kv->user, kv->key);
+
+    // Only this view is read-only, the value itself can still be written
+    int res = mprotect(
+      nativePtr, roundUpToWasmPageAligned(chunk.nBytesLength), PROT_READ);
+    if (res != 0) {
+        SPDLOG_ERROR("Failed to make state {} at {} read-only: {}",
+                     kv->key,
+                     wasmBasePtr,
+                     std::strerror(errno));
+        throw std::runtime_error("Failed to map read-only state");
+    }
+
+    return wasmBasePtr + chunk.offsetRemainder;
 }
 
 void WasmModule::unmapMemory(uint32_t offset, size_t nBytes)
@@ -823,13 +1756,242 @@ void WasmModule::unmapMemory(uint32_t offset, size_t nBytes)
         throw std::runtime_error("munmapping outside memory max");
     }
 
-    if (unmapTop == currentBrk.load(std::memory_order_acquire)) {
-        SPDLOG_TRACE("MEM - munmapping top of memory by {}", pageAligned);
-        shrinkMemory(pageAligned);
-    } else {
+    faabric::util::FullLock lock(moduleMutex);
+
+    // If the brk has moved up in the meantime, this is just another hole
+    if (unmapTop == currentBrk.load(std::memory_order_acquire) &&
+        tryLowerBrk(unmapTop, offset)) {
+        SPDLOG_TRACE("MEM - munmapped top of memory by {}", pageAligned);
+        return;
+    }
+
+    if (unmapTop > currentBrk.load(std::memory_order_acquire)) {
         SPDLOG_WARN("MEM - unable to reclaim unmapped memory {} at {}",
                     pageAligned,
                     offset);
+        return;
+    }
+
+    SPDLOG_TRACE("MEM - munmapping {} at {}", pageAligned, offset);
+    reclaimMemory(offset, pageAligned);
+
+    addFreeMemoryRegion(offset, unmapTop);
+}
+
+void WasmModule::addFreeMemoryRegion(uint32_t start, uint32_t end)
+{
+    // Merge the hole with its neighbours. Pages that are already free are
+    // tolerated, as munmap allows double unmaps.
+    auto it = freeMemoryRegions.upper_bound(start);
+    if (it != freeMemoryRegions.begin()) {
+        auto prev = std::prev(it);
+        if (prev->first + prev->second >= start) {
+            start = prev->first;
+            end = std::max(end, prev->first + prev->second);
+            freeMemoryRegions.erase(prev);
+        }
+    }
+
+    it = freeMemoryRegions.lower_bound(start);
+    while (it != freeMemoryRegions.end() && it->first <= end) {
+        end = std::max(end, it->first + it->second);
+        it = freeMemoryRegions.erase(it);
+    }
+
+    freeMemoryRegions[start] = end - start;
+}
+
+uint32_t WasmModule::remapMemory(uint32_t offset,
+                                 size_t oldBytes,
+                                 size_t newBytes,
+                                 bool mayMove)
+{
+    if (!canRemapMemory(offset, oldBytes, newBytes)) {
+        throw std::runtime_error("Invalid memory remapping");
+    }
+
+    // Both sizes fit in 32 bits once rounded, as checked above
+    uint32_t oldAligned = roundUpToWasmPageAligned(oldBytes);
+    uint32_t newAligned = roundUpToWasmPageAligned(newBytes);
+    uint32_t oldTop = offset + oldAligned;
+
+    if (newAligned <= oldAligned) {
+        unmapMemory(offset + newAligned, oldAligned - newAligned);
+        return offset;
+    }
+
+    if (tryGrowMappingInPlace(oldTop, newAligned - oldAligned)) {
+        SPDLOG_TRACE("MEM - remapped {} at {} to {} in place",
+                     oldAligned,
+                     offset,
+                     newAligned);
+        return offset;
+    }
+
+    if (!mayMove) {
+        return REMAP_MEMORY_FAILED;
+    }
+
+    // Unmapping the old region afterwards gives it back as a hole
+    uint32_t newOffset = mmapMemory(newAligned);
+    movePages(offset, newOffset, oldAligned);
+    unmapMemory(offset, oldAligned);
+
+    SPDLOG_TRACE("MEM - moved {} from {} to {}, now {}",
+                 oldAligned,
+                 offset,
+                 newOffset,
+                 newAligned);
+
+    return newOffset;
+}
+
+bool WasmModule::canRemapMemory(uint32_t offset,
+                                size_t oldBytes,
+                                size_t newBytes)
+{
+    if (!isWasmPageAligned(offset)) {
+        SPDLOG_ERROR("Non-page aligned mremap address {}", offset);
+        return false;
+    }
+
+    if (oldBytes == 0 || newBytes == 0) {
+        SPDLOG_ERROR("Remapping {} at {} to {}", oldBytes, offset, newBytes);
+        return false;
+    }
+
+    // Done in 64 bits, as sizes near 4GB wrap once rounded up to pages
+    uint64_t brk = currentBrk.load(std::memory_order_acquire);
+    uint64_t oldAligned =
+      getNumberOfWasmPagesForBytes(oldBytes) * WASM_BYTES_PER_PAGE;
+    uint64_t newAligned =
+      getNumberOfWasmPagesForBytes(newBytes) * WASM_BYTES_PER_PAGE;
+
+    if (offset >= brk || offset + oldAligned > brk) {
+        SPDLOG_ERROR("Remapping {} at {}, beyond the brk", oldBytes, offset);
+        return false;
+    }
+
+    if (newAligned > UINT32_MAX) {
+        SPDLOG_ERROR("Remapping {} at {} to {}, beyond 32-bit memory",
+                     oldBytes,
+                     offset,
+                     newBytes);
+        return false;
+    }
+
+    return true;
+}
+
+bool WasmModule::tryGrowMappingInPlace(uint32_t top, uint32_t nBytes)
+{
+    {
+        faabric::util::FullLock lock(moduleMutex);
+        auto it = freeMemoryRegions.find(top);
+        if (it != freeMemoryRegions.end() && it->second >= nBytes) {
+            uint32_t remaining = it->second - nBytes;
+            freeMemoryRegions.erase(it);
+            if (remaining > 0) {
+                freeMemoryRegions[top + nBytes] = remaining;
+            }
+
+            return true;
+        }
+    }
+
+    if (currentBrk.load(std::memory_order_acquire) != top) {
+        return false;
+    }
+
+    // Another thread may grow memory first, in which case what we get isn't
+    // next to the mapping, so we give it back
+    uint32_t grown = growMemory(nBytes);
+    if (grown == top) {
+        return true;
+    }
+
+    unmapMemory(grown, nBytes);
+    return false;
+}
+
+void WasmModule::movePages(uint32_t from, uint32_t to, size_t nBytes)
+{
+    uint8_t* memBase = getMemoryBase();
+    void* res = mremap(memBase + from,
+                       nBytes,
+                       nBytes,
+                       MREMAP_MAYMOVE | MREMAP_FIXED,
+                       memBase + to);
+    if (res != MAP_FAILED) {
+        return;
+    }
+
+    // mremap can only move pages from a single host mapping, whereas the
+    // region may span several, e.g. part mapped from a snapshot or a file
+    SPDLOG_DEBUG("MEM - copying {} from {} to {}, can't remap pages: {}",
+                 nBytes,
+                 from,
+                 to,
+                 std::strerror(errno));
+    std::memcpy(memBase + to, memBase + from, nBytes);
+}
+
+size_t WasmModule::getFreeMemoryBytes()
+{
+    faabric::util::SharedLock lock(moduleMutex);
+
+    size_t total = 0;
+    for (const auto& [offset, length] : freeMemoryRegions) {
+        total += length;
+    }
+
+    return total;
+}
+
+void WasmModule::reclaimMemory(uint32_t offset, size_t nBytes)
+{
+    if (nBytes == 0) {
+        return;
+    }
+
+    // MADV_DONTNEED would only zero anonymous memory. Memory restored from a
+    // snapshot is a private file mapping, where it would bring back the
+    // snapshot instead, so we map fresh zero pages over the region.
+    uint8_t* ptr = getMemoryBase() + offset;
+    void* res = mmap(ptr,
+                     nBytes,
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+                     -1,
+                     0);
+    if (res == MAP_FAILED) {
+        SPDLOG_ERROR("Failed to reclaim memory {} at {} ({} - {})",
+                     nBytes,
+                     offset,
+                     errno,
+                     strerror(errno));
+        throw std::runtime_error("Failed to reclaim memory");
+    }
+
+    adviseHugePages(offset, nBytes);
+}
+
+void WasmModule::adviseHugePages(uint32_t offset, size_t nBytes)
+{
+    if (nBytes == 0 || conf::getFaasmConfig().hugePages != "on") {
+        return;
+    }
+
+    // Failure isn't fatal, e.g. THP may be disabled on the host. Guard
+    // regions and dirty tracking still work on huge pages, as mprotect splits
+    // them back into normal pages where needed.
+    int res = madvise(getMemoryBase() + offset, nBytes, MADV_HUGEPAGE);
+    if (res != 0) {
+        SPDLOG_DEBUG("Failed to advise huge pages for {} at {} ({} - {})",
+                     nBytes,
+                     offset,
+                     errno,
+                     strerror(errno));
     }
 }
 
@@ -838,6 +2000,34 @@ void WasmModule::doThrowException(std::exception& e)
     throw std::runtime_error("doThrowException not implemented");
 }
 
+void WasmModule::interruptExecution()
+{
+    executionInterrupted = true;
+    doInterruptExecution();
+}
+
+bool WasmModule::isExecutionInterrupted()
+{
+    return executionInterrupted;
+}
+
+void WasmModule::recoverFromInterrupt()
+{
+    if (!executionInterrupted) {
+        return;
+    }
+
+    doRecoverFromInterrupt();
+    executionInterrupted = false;
+}
+
+void WasmModule::doInterruptExecution()
+{
+    SPDLOG_WARN("Module can't be interrupted, call will run to completion");
+}
+
+void WasmModule::doRecoverFromInterrupt() {}
+
 uint8_t* WasmModule::wasmPointerToNative(uint32_t wasmPtr)
 {
     throw std::runtime_error("wasmPointerToNative not implemented");
@@ -858,11 +2048,41 @@ size_t WasmModule::getMaxMemoryPages()
     throw std::runtime_error("getMaxMemoryPages not implemented");
 }
 
+void WasmModule::setMemoryPagesLimit(uint32_t pages)
+{
+    memoryPagesLimit = pages;
+}
+
+size_t WasmModule::getMemoryPagesLimit()
+{
+    size_t maxPages = getMaxMemoryPages();
+    if (memoryPagesLimit == 0) {
+        return maxPages;
+    }
+
+    return std::min<size_t>(memoryPagesLimit, maxPages);
+}
+
 uint8_t* WasmModule::getMemoryBase()
 {
     throw std::runtime_error("getMemoryBase not implemented");
 }
 
+ModuleMemoryUsage WasmModule::getMemoryUsage()
+{
+    ModuleMemoryUsage usage;
+    usage.linearMemoryBytes = getMemorySizeBytes();
+
+    ResidentMemory resident =
+      getResidentMemory(getMemoryBase(), usage.linearMemoryBytes);
+    usage.residentBytes = resident.residentBytes;
+    usage.privateBytes = resident.privateBytes;
+
+    usage.hostBufferBytes = capturedStdout.capacity();
+
+    return usage;
+}
+
 int32_t WasmModule::executeFunction(faabric::Message& msg)
 {
     throw std::runtime_error("executeFunction not implemented");
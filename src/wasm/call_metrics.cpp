@@ -0,0 +1,146 @@
+#include <conf/FaasmConfig.h>
+#include <wasm/WasmExecutionContext.h>
+#include <wasm/call_metrics.h>
+
+#include <faabric/util/logging.h>
+
+#include <ctime>
+#include <stdexcept>
+
+namespace wasm {
+
+static thread_local CallMetrics threadMetrics;
+
+static thread_local uint64_t threadStartCpuNanos = 0;
+
+static thread_local bool threadPerfCounting = false;
+
+static uint64_t getThreadCpuNanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+std::string hostCallCategoryName(HostCallCategory category)
+{
+    switch (category) {
+        case HostCallCategory::State:
+            return "state";
+        case HostCallCategory::Chaining:
+            return "chaining";
+        case HostCallCategory::Mpi:
+            return "mpi";
+        case HostCallCategory::OpenMP:
+            return "openmp";
+        case HostCallCategory::Threads:
+            return "threads";
+        case HostCallCategory::Filesystem:
+            return "filesystem";
+        case HostCallCategory::Network:
+            return "network";
+        case HostCallCategory::Memory:
+            return "memory";
+        case HostCallCategory::Process:
+            return "process";
+        case HostCallCategory::Other:
+            return "other";
+        default: {
+            SPDLOG_ERROR("Unrecognised host call category {}", (int)category);
+            throw std::runtime_error("Unrecognised host call category");
+        }
+    }
+}
+
+void recordHostCall(HostCallCategory category)
+{
+    threadMetrics.hostCalls[(int)category]++;
+}
+
+HostCallScope::HostCallScope(HostCallCategory category)
+{
+    recordHostCall(category);
+
+    module = getExecutingModule();
+    if (module != nullptr) {
+        module->enterHostCall();
+    }
+}
+
+HostCallScope::~HostCallScope()
+{
+    if (module != nullptr) {
+        module->exitHostCall();
+    }
+}
+
+void startCallMetrics()
+{
+    threadMetrics = CallMetrics();
+
+    threadPerfCounting = conf::getFaasmConfig().perfCounters == "on";
+    if (threadPerfCounting) {
+        startPerfCounters();
+    }
+
+    threadStartCpuNanos = getThreadCpuNanos();
+}
+
+CallMetrics takeCallMetrics()
+{
+    CallMetrics metrics = threadMetrics;
+    metrics.cpuNanos = getThreadCpuNanos() - threadStartCpuNanos;
+    if (threadPerfCounting) {
+        metrics.perfCounts = readPerfCounters();
+        startPerfCounters();
+    }
+
+    threadMetrics = CallMetrics();
+    threadStartCpuNanos = getThreadCpuNanos();
+
+    return metrics;
+}
+
+void flushCallMetrics(faabric::Message& msg,
+                      uint64_t peakMemoryBytes,
+                      uint64_t snapshotBytes)
+{
+    CallMetrics metrics = takeCallMetrics();
+    metrics.peakMemoryBytes = peakMemoryBytes;
+    metrics.snapshotBytes = snapshotBytes;
+
+    auto& details = *msg.mutable_execgraphdetails();
+    details["cpu-us"] = std::to_string(metrics.cpuNanos / 1000);
+    details["peak-memory-bytes"] = std::to_string(metrics.peakMemoryBytes);
+    if (metrics.snapshotBytes > 0) {
+        details["snapshot-bytes"] = std::to_string(metrics.snapshotBytes);
+    }
+
+    uint64_t totalCalls = 0;
+    for (int i = 0; i < N_HOST_CALL_CATEGORIES; i++) {
+        uint64_t nCalls = metrics.hostCalls[i];
+        if (nCalls == 0) {
+            continue;
+        }
+
+        std::string name = hostCallCategoryName((HostCallCategory)i);
+        details["host-calls-" + name] = std::to_string(nCalls);
+        totalCalls += nCalls;
+    }
+
+    for (int i = 0; i < N_PERF_COUNTERS; i++) {
+        if (metrics.perfCounts.available[i]) {
+            std::string name = perfCounterName((PerfCounter)i);
+            details["perf-" + name] =
+              std::to_string(metrics.perfCounts.values[i]);
+        }
+    }
+
+    SPDLOG_DEBUG("Call {} used {}us CPU, peak memory {}, {} host calls",
+                 msg.id(),
+                 metrics.cpuNanos / 1000,
+                 metrics.peakMemoryBytes,
+                 totalCalls);
+}
+}
@@ -0,0 +1,298 @@
+#include <conf/FaasmConfig.h>
+#include <wasm/chaining.h>
+#include <wasm/chaining_dag.h>
+#include <wasm/chaining_results.h>
+#include <wasm/chaining_shm.h>
+
+#include <faabric/scheduler/ExecutorContext.h>
+#include <faabric/scheduler/Scheduler.h>
+#include <faabric/util/config.h>
+#include <faabric/util/func.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/scheduling.h>
+
+#include <future>
+#include <queue>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace wasm {
+
+enum class DagNodeState
+{
+    Pending,
+    Scheduled,
+    Succeeded,
+    Failed,
+};
+
+struct ChainedDagRun
+{
+    faabric::Message originalCall;
+
+    // One request per node, as nodes may be different functions
+    std::vector<std::shared_ptr<faabric::BatchExecuteRequest>> reqs;
+
+    // The nodes whose outputs each node takes, in the order of the edges
+    std::vector<std::vector<int>> inputsOf;
+
+    std::vector<int> order;
+};
+
+static std::mutex dagsMx;
+static std::unordered_map<unsigned int, std::vector<std::future<void>>>
+  runningDags;
+
+std::vector<int> getChainedDagOrder(size_t nNodes,
+                                    const std::vector<ChainedDagEdge>& edges)
+{
+    std::vector<int> nInputs(nNodes, 0);
+    std::vector<std::vector<int>> outputsTo(nNodes);
+    for (const auto& [from, to] : edges) {
+        if (from < 0 || from >= nNodes || to < 0 || to >= nNodes) {
+            SPDLOG_ERROR("Chained call graph edge {} -> {} out of range ({})",
+                         from,
+                         to,
+                         nNodes);
+            throw std::runtime_error("Chained call graph edge out of range");
+        }
+
+        nInputs.at(to)++;
+        outputsTo.at(from).push_back(to);
+    }
+
+    std::queue<int> ready;
+    for (int i = 0; i < nNodes; i++) {
+        if (nInputs.at(i) == 0) {
+            ready.push(i);
+        }
+    }
+
+    std::vector<int> order;
+    while (!ready.empty()) {
+        int node = ready.front();
+        ready.pop();
+        order.push_back(node);
+
+        for (int to : outputsTo.at(node)) {
+            if (--nInputs.at(to) == 0) {
+                ready.push(to);
+            }
+        }
+    }
+
+    if (order.size() != nNodes) {
+        SPDLOG_ERROR("Chained call graph of {} nodes has a cycle", nNodes);
+        throw std::runtime_error("Chained call graph has a cycle");
+    }
+
+    return order;
+}
+
+static void runChainedDag(std::shared_ptr<ChainedDagRun> run)
+{
+    faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
+    const std::string& thisHost = faabric::util::getSystemConfig().endpointHost;
+    int callTimeoutMs = conf::getFaasmConfig().chainedCallTimeout;
+
+    size_t nNodes = run->reqs.size();
+    std::vector<DagNodeState> states(nNodes, DagNodeState::Pending);
+    std::vector<std::string> hosts(nNodes);
+    std::vector<std::string> outputs(nNodes);
+
+    auto getMsg = [&run](int node) -> faabric::Message& {
+        return run->reqs.at(node)->mutable_messages()->at(0);
+    };
+
+    // Nodes that won't run still have to give their callers a result
+    auto skipNode = [&](int node, const std::string& reason) {
+        states.at(node) = DagNodeState::Failed;
+        notifyChainedResult(getMsg(node).id(), { 1, reason });
+    };
+
+    auto scheduleReadyNodes = [&] {
+        for (int node : run->order) {
+            if (states.at(node) != DagNodeState::Pending) {
+                continue;
+            }
+
+            bool ready = true;
+            bool inputFailed = false;
+            for (int input : run->inputsOf.at(node)) {
+                DagNodeState inputState = states.at(input);
+                inputFailed |= inputState == DagNodeState::Failed;
+                ready &= inputState == DagNodeState::Succeeded;
+            }
+
+            if (inputFailed) {
+                skipNode(node, "Input to chained call failed");
+                continue;
+            }
+
+            if (!ready) {
+                continue;
+            }
+
+            faabric::Message& msg = getMsg(node);
+            std::string inputData = msg.inputdata();
+            for (int input : run->inputsOf.at(node)) {
+                inputData += outputs.at(input);
+            }
+            msg.set_inputdata(inputData);
+
+            // Consumers go where their first input was produced
+            std::vector<int>& inputs = run->inputsOf.at(node);
+            std::string host = inputs.empty() ? "" : hosts.at(inputs.front());
+
+            faabric::util::SchedulingDecision decision(msg.appid(),
+                                                       msg.groupid());
+            if (host.empty() || host == thisHost) {
+                decision = sch.callFunctions(run->reqs.at(node));
+            } else {
+                decision.addMessage(host, msg);
+                sch.callFunctions(run->reqs.at(node), decision);
+            }
+
+            hosts.at(node) = decision.hosts.at(0);
+            if (hosts.at(node) != thisHost) {
+                forgetChainedResult(msg.id());
+            }
+
+            SPDLOG_DEBUG("Chained graph node {} ({}) sent to {}",
+                         node,
+                         msg.id(),
+                         hosts.at(node));
+
+            states.at(node) = DagNodeState::Scheduled;
+        }
+    };
+
+    try {
+        scheduleReadyNodes();
+
+        // Every node's inputs come before it, so by the time we get to a
+        // node it's either been sent off or skipped
+        for (int node : run->order) {
+            if (states.at(node) != DagNodeState::Scheduled) {
+                continue;
+            }
+
+            faabric::Message& msg = getMsg(node);
+            try {
+                faabric::Message result =
+                  getChainedCallResult(msg, callTimeoutMs);
+                outputs.at(node) = result.outputdata();
+                states.at(node) = result.returnvalue() == 0
+                                    ? DagNodeState::Succeeded
+                                    : DagNodeState::Failed;
+            } catch (std::exception& e) {
+                SPDLOG_ERROR("Failed awaiting chained graph node {} ({}): {}",
+                             node,
+                             msg.id(),
+                             e.what());
+                states.at(node) = DagNodeState::Failed;
+            }
+
+            scheduleReadyNodes();
+        }
+    } catch (std::exception& e) {
+        SPDLOG_ERROR("Error running chained call graph from {}: {}",
+                     run->originalCall.id(),
+                     e.what());
+
+        for (int node : run->order) {
+            if (states.at(node) == DagNodeState::Pending) {
+                skipNode(node, "Chained call graph failed");
+            }
+        }
+    }
+}
+
+std::vector<int> makeChainedDag(const std::vector<ChainedDagNode>& nodes,
+                                const std::vector<ChainedDagEdge>& edges)
+{
+    faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
+    faabric::Message& originalCall =
+      faabric::scheduler::ExecutorContext::get()->getMsg();
+    auto* exec = faabric::scheduler::ExecutorContext::get()->getExecutor();
+
+    auto run = std::make_shared<ChainedDagRun>();
+    run->originalCall = originalCall;
+    run->order = getChainedDagOrder(nodes.size(), edges);
+    run->inputsOf.resize(nodes.size());
+
+    std::vector<bool> hasConsumers(nodes.size(), false);
+    for (const auto& [from, to] : edges) {
+        run->inputsOf.at(to).push_back(from);
+        hasConsumers.at(from) = true;
+    }
+
+    if (nodes.empty()) {
+        return {};
+    }
+
+    SPDLOG_INFO("Chaining graph of {} call(s) and {} edge(s) from {}/{} ({})",
+                nodes.size(),
+                edges.size(),
+                originalCall.user(),
+                originalCall.function(),
+                originalCall.id());
+
+    // As with other chained calls, everything is recorded before any of it
+    // can run. Outputs that are passed on aren't handed over in shared
+    // memory, as the graph needs them itself.
+    bool shmOutputs = conf::getFaasmConfig().chainedShmOutputThreshold > 0;
+    std::vector<int> callIds;
+    for (int i = 0; i < nodes.size(); i++) {
+        const ChainedDagNode& node = nodes.at(i);
+        if (node.functionName.empty()) {
+            SPDLOG_ERROR("Chained call graph node {} has no function", i);
+            throw std::runtime_error("Chained call graph node has no function");
+        }
+
+        auto req = faabric::util::batchExecFactory(
+          originalCall.user(), node.functionName, 1);
+        faabric::Message& msg = req->mutable_messages()->at(0);
+        setUpChainedMessage(msg, originalCall, 0, nullptr, node.inputData);
+
+        exec->addChainedMessage(msg);
+        expectChainedResult(originalCall.id(), msg.id());
+        if (shmOutputs && !hasConsumers.at(i)) {
+            expectChainedShmOutput(originalCall.id(), msg.id());
+        }
+
+        if (originalCall.recordexecgraph()) {
+            sch.logChainedFunction(originalCall, msg);
+        }
+
+        run->reqs.push_back(req);
+        callIds.push_back(msg.id());
+    }
+
+    faabric::util::UniqueLock lock(dagsMx);
+    runningDags[originalCall.id()].emplace_back(
+      std::async(std::launch::async, runChainedDag, run));
+
+    return callIds;
+}
+
+void awaitChainedDags(unsigned int callerId)
+{
+    std::vector<std::future<void>> dags;
+    {
+        faabric::util::UniqueLock lock(dagsMx);
+        auto it = runningDags.find(callerId);
+        if (it == runningDags.end()) {
+            return;
+        }
+
+        dags = std::move(it->second);
+        runningDags.erase(it);
+    }
+
+    for (auto& dag : dags) {
+        dag.wait();
+    }
+}
+}
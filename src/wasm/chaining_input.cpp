@@ -0,0 +1,72 @@
+#include <wasm/chaining_input.h>
+#include <wasm/state_replicas.h>
+
+#include <faabric/util/logging.h>
+
+#include <stdexcept>
+
+#define INPUT_REF_KEY "input-state-key"
+#define INPUT_REF_OFFSET "input-state-offset"
+#define INPUT_REF_LENGTH "input-state-length"
+
+namespace wasm {
+
+void setChainedInputRef(faabric::Message& msg, const ChainedInputRef& ref)
+{
+    auto& details = *msg.mutable_execgraphdetails();
+    details[INPUT_REF_KEY] = ref.key;
+    details[INPUT_REF_OFFSET] = std::to_string(ref.offset);
+    details[INPUT_REF_LENGTH] = std::to_string(ref.length);
+
+    msg.clear_inputdata();
+}
+
+bool getChainedInputRef(const faabric::Message& msg, ChainedInputRef& ref)
+{
+    const auto& details = msg.execgraphdetails();
+    auto keyIt = details.find(INPUT_REF_KEY);
+    if (keyIt == details.end()) {
+        return false;
+    }
+
+    auto offsetIt = details.find(INPUT_REF_OFFSET);
+    auto lengthIt = details.find(INPUT_REF_LENGTH);
+    if (offsetIt == details.end() || lengthIt == details.end()) {
+        SPDLOG_ERROR("Incomplete state input for call {}", msg.id());
+        throw std::runtime_error("Incomplete chained call state input");
+    }
+
+    ref.key = keyIt->second;
+    ref.offset = std::stoull(offsetIt->second);
+    ref.length = std::stoull(lengthIt->second);
+
+    return true;
+}
+
+bool hasChainedInputRef(const faabric::Message& msg)
+{
+    return msg.execgraphdetails().count(INPUT_REF_KEY) > 0;
+}
+
+std::shared_ptr<faabric::state::StateKeyValue> resolveChainedInputRef(
+  const std::string& user,
+  const ChainedInputRef& ref)
+{
+    // Looked up through the replica cache, so the value stays put for the
+    // rest of the call
+    auto kv = getStateReplicaCache().getKV(user, ref.key);
+
+    size_t valueSize = kv->size();
+    if (ref.length > valueSize || ref.offset > valueSize - ref.length) {
+        SPDLOG_ERROR("State input {}/{} out of bounds ({} + {} > {})",
+                     user,
+                     ref.key,
+                     ref.offset,
+                     ref.length,
+                     valueSize);
+        throw std::runtime_error("Chained call state input out of bounds");
+    }
+
+    return kv;
+}
+}
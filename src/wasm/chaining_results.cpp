@@ -0,0 +1,125 @@
+#include <wasm/chaining_results.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace wasm {
+
+struct ChainedResultRecord
+{
+    unsigned int callerId = 0;
+    bool finished = false;
+    ChainedResult result;
+
+    // Waiters wait on each record separately, all under the same lock
+    std::condition_variable cv;
+};
+
+static std::mutex resultsMx;
+static std::unordered_map<unsigned int, std::shared_ptr<ChainedResultRecord>>
+  chainedResults;
+static std::unordered_map<unsigned int, std::vector<unsigned int>>
+  callerMessageIds;
+
+void expectChainedResult(unsigned int callerId, unsigned int messageId)
+{
+    auto record = std::make_shared<ChainedResultRecord>();
+    record->callerId = callerId;
+
+    faabric::util::UniqueLock lock(resultsMx);
+    chainedResults[messageId] = record;
+    callerMessageIds[callerId].push_back(messageId);
+}
+
+bool isChainedResultExpected(unsigned int messageId)
+{
+    faabric::util::UniqueLock lock(resultsMx);
+    return chainedResults.count(messageId) > 0;
+}
+
+void forgetChainedResult(unsigned int messageId)
+{
+    faabric::util::UniqueLock lock(resultsMx);
+    auto it = chainedResults.find(messageId);
+    if (it == chainedResults.end()) {
+        return;
+    }
+
+    // Anyone already waiting goes back to the scheduler
+    it->second->cv.notify_all();
+    chainedResults.erase(it);
+}
+
+bool notifyChainedResult(unsigned int messageId, const ChainedResult& result)
+{
+    faabric::util::UniqueLock lock(resultsMx);
+    auto it = chainedResults.find(messageId);
+    if (it == chainedResults.end()) {
+        return false;
+    }
+
+    SPDLOG_TRACE("Notifying caller {} of result of {}",
+                 it->second->callerId,
+                 messageId);
+
+    it->second->result = result;
+    it->second->finished = true;
+    it->second->cv.notify_all();
+
+    return true;
+}
+
+bool awaitChainedResultNotification(unsigned int messageId,
+                                    int timeoutMs,
+                                    ChainedResult& result)
+{
+    faabric::util::UniqueLock lock(resultsMx);
+    auto it = chainedResults.find(messageId);
+    if (it == chainedResults.end()) {
+        return false;
+    }
+
+    // Hold on to the record in case it's forgotten while we wait
+    std::shared_ptr<ChainedResultRecord> record = it->second;
+    bool forgotten = false;
+    record->cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&] {
+        auto current = chainedResults.find(messageId);
+        forgotten =
+          current == chainedResults.end() || current->second != record;
+        return record->finished || forgotten;
+    });
+
+    if (!record->finished || forgotten) {
+        return false;
+    }
+
+    result = record->result;
+
+    return true;
+}
+
+void dropChainedResults(unsigned int callerId)
+{
+    faabric::util::UniqueLock lock(resultsMx);
+    auto callerIt = callerMessageIds.find(callerId);
+    if (callerIt == callerMessageIds.end()) {
+        return;
+    }
+
+    for (unsigned int messageId : callerIt->second) {
+        auto it = chainedResults.find(messageId);
+        if (it != chainedResults.end() && it->second->callerId == callerId) {
+            it->second->cv.notify_all();
+            chainedResults.erase(it);
+        }
+    }
+
+    callerMessageIds.erase(callerIt);
+}
+}
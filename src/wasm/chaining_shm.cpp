@@ -0,0 +1,171 @@
+#include <conf/FaasmConfig.h>
+#include <wasm/chaining_shm.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace wasm {
+
+struct ChainedShmRecord
+{
+    unsigned int callerId = 0;
+    ChainedShmOutput output;
+};
+
+static std::mutex shmOutputsMx;
+static std::unordered_map<unsigned int, ChainedShmRecord> shmOutputs;
+static std::unordered_map<unsigned int, std::vector<unsigned int>>
+  callerMessageIds;
+
+static void closeOutput(ChainedShmOutput& output)
+{
+    if (output.fd >= 0) {
+        ::close(output.fd);
+    }
+
+    output = ChainedShmOutput();
+}
+
+static int createOutputFd(const uint8_t* data, size_t len)
+{
+    int fd = memfd_create("faasm-chained-output", MFD_CLOEXEC);
+    if (fd < 0) {
+        SPDLOG_ERROR("Failed to create chained output memfd ({} - {})",
+                     errno,
+                     strerror(errno));
+        return -1;
+    }
+
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = ::pwrite(fd, data + written, len - written, written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            SPDLOG_ERROR("Failed to write {} bytes of chained output ({} - {})",
+                         len,
+                         errno,
+                         strerror(errno));
+            ::close(fd);
+            return -1;
+        }
+
+        written += n;
+    }
+
+    return fd;
+}
+
+void expectChainedShmOutput(unsigned int callerId, unsigned int messageId)
+{
+    faabric::util::UniqueLock lock(shmOutputsMx);
+    shmOutputs[messageId].callerId = callerId;
+    callerMessageIds[callerId].push_back(messageId);
+}
+
+bool writeChainedShmOutput(unsigned int messageId,
+                           const uint8_t* data,
+                           size_t len)
+{
+    int threshold = conf::getFaasmConfig().chainedShmOutputThreshold;
+    if (threshold <= 0 || len < (size_t)threshold) {
+        return false;
+    }
+
+    {
+        faabric::util::UniqueLock lock(shmOutputsMx);
+        if (shmOutputs.count(messageId) == 0) {
+            return false;
+        }
+    }
+
+    // Outputs can be large, so they're written without holding the lock
+    int fd = createOutputFd(data, len);
+    if (fd < 0) {
+        return false;
+    }
+
+    faabric::util::UniqueLock lock(shmOutputsMx);
+    auto it = shmOutputs.find(messageId);
+    if (it == shmOutputs.end()) {
+        // The caller finished in the meantime, so nobody will read it
+        ::close(fd);
+        return false;
+    }
+
+    // Writing the output again replaces it
+    closeOutput(it->second.output);
+    it->second.output.fd = fd;
+    it->second.output.size = len;
+
+    SPDLOG_TRACE("Wrote {} bytes of output for {} to shared memory",
+                 len,
+                 messageId);
+
+    return true;
+}
+
+void discardChainedShmOutput(unsigned int messageId)
+{
+    faabric::util::UniqueLock lock(shmOutputsMx);
+    auto it = shmOutputs.find(messageId);
+    if (it != shmOutputs.end()) {
+        closeOutput(it->second.output);
+    }
+}
+
+ChainedShmOutput takeChainedShmOutput(unsigned int messageId)
+{
+    faabric::util::UniqueLock lock(shmOutputsMx);
+    auto it = shmOutputs.find(messageId);
+    if (it == shmOutputs.end()) {
+        return ChainedShmOutput();
+    }
+
+    ChainedShmOutput output = it->second.output;
+    it->second.output = ChainedShmOutput();
+
+    return output;
+}
+
+void dropChainedShmOutputs(unsigned int callerId)
+{
+    faabric::util::UniqueLock lock(shmOutputsMx);
+    auto callerIt = callerMessageIds.find(callerId);
+    if (callerIt == callerMessageIds.end()) {
+        return;
+    }
+
+    for (unsigned int messageId : callerIt->second) {
+        auto it = shmOutputs.find(messageId);
+        if (it != shmOutputs.end()) {
+            closeOutput(it->second.output);
+            shmOutputs.erase(it);
+        }
+    }
+
+    callerMessageIds.erase(callerIt);
+}
+
+size_t getChainedShmOutputCount()
+{
+    faabric::util::UniqueLock lock(shmOutputsMx);
+    size_t count = 0;
+    for (const auto& [messageId, record] : shmOutputs) {
+        if (record.output.fd >= 0) {
+            count++;
+        }
+    }
+
+    return count;
+}
+}
@@ -0,0 +1,194 @@
+#include <wasm/chaining_results.h>
+#include <wasm/chaining_stream.h>
+
+#include <faabric/util/clock.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace wasm {
+
+struct ChainedOutputStream
+{
+    unsigned int callerId = 0;
+
+    // Whether the callee can append here, i.e. it's running on this host
+    bool local = true;
+
+    // Whether there's output to read, rather than it all being in the result
+    bool streamed = false;
+
+    bool finished = false;
+
+    // Appended chunks not read yet, starting at the read offset
+    std::string pending;
+    size_t readOffset = 0;
+
+    std::condition_variable cv;
+};
+
+static std::mutex streamsMx;
+static std::unordered_map<unsigned int, std::shared_ptr<ChainedOutputStream>>
+  streams;
+static std::unordered_map<unsigned int, std::vector<unsigned int>>
+  callerMessageIds;
+
+void expectChainedOutputStream(unsigned int callerId, unsigned int messageId)
+{
+    auto stream = std::make_shared<ChainedOutputStream>();
+    stream->callerId = callerId;
+
+    faabric::util::UniqueLock lock(streamsMx);
+    streams[messageId] = stream;
+    callerMessageIds[callerId].push_back(messageId);
+}
+
+void forgetChainedOutputStream(unsigned int messageId)
+{
+    faabric::util::UniqueLock lock(streamsMx);
+    auto it = streams.find(messageId);
+    if (it == streams.end()) {
+        return;
+    }
+
+    it->second->local = false;
+    it->second->cv.notify_all();
+}
+
+bool appendChainedOutputStream(unsigned int messageId,
+                               const uint8_t* data,
+                               size_t len)
+{
+    faabric::util::UniqueLock lock(streamsMx);
+    auto it = streams.find(messageId);
+    if (it == streams.end() || !it->second->local ||
+        it->second->finished) {
+        return false;
+    }
+
+    ChainedOutputStream& stream = *it->second;
+
+    // Drop what the caller has already read before growing the buffer
+    if (stream.readOffset > 0) {
+        stream.pending.erase(0, stream.readOffset);
+        stream.readOffset = 0;
+    }
+
+    stream.pending.append(reinterpret_cast<const char*>(data), len);
+    stream.streamed = true;
+    stream.cv.notify_all();
+
+    SPDLOG_TRACE("Streamed {} bytes of output of {} to caller {}",
+                 len,
+                 messageId,
+                 stream.callerId);
+
+    return true;
+}
+
+void finishChainedOutputStream(unsigned int messageId)
+{
+    faabric::util::UniqueLock lock(streamsMx);
+    auto it = streams.find(messageId);
+    if (it == streams.end() || !it->second->local) {
+        return;
+    }
+
+    it->second->finished = true;
+    it->second->cv.notify_all();
+}
+
+int readChainedOutputStream(unsigned int messageId,
+                            uint8_t* buffer,
+                            int bufferLen,
+                            int timeoutMs)
+{
+    faabric::util::UniqueLock lock(streamsMx);
+    auto it = streams.find(messageId);
+    if (it == streams.end()) {
+        return CHAINED_OUTPUT_STREAM_UNAVAILABLE;
+    }
+
+    // Hold on to the stream in case it's dropped while we wait
+    std::shared_ptr<ChainedOutputStream> stream = it->second;
+
+    faabric::util::Clock& clock = faabric::util::getGlobalClock();
+    int64_t timeoutEndMs = clock.epochMillis() + timeoutMs;
+    while (true) {
+        size_t available = stream->pending.size() - stream->readOffset;
+        if (available > 0) {
+            size_t nBytes = std::min<size_t>(available, bufferLen);
+            std::memcpy(
+              buffer, stream->pending.data() + stream->readOffset, nBytes);
+            stream->readOffset += nBytes;
+
+            return (int)nBytes;
+        }
+
+        if (stream->finished) {
+            return stream->streamed ? 0 : CHAINED_OUTPUT_STREAM_UNAVAILABLE;
+        }
+
+        int64_t remainingMs = timeoutEndMs - clock.epochMillis();
+        if (!stream->local || remainingMs <= 0) {
+            return CHAINED_OUTPUT_STREAM_UNAVAILABLE;
+        }
+
+        // Check now and then that the callee hasn't moved to another host
+        int waitMs = (int)std::min<int64_t>(remainingMs,
+                                            CHAINED_RESULT_POLL_INTERVAL_MS);
+        stream->cv.wait_for(lock, std::chrono::milliseconds(waitMs));
+        if (!isChainedResultExpected(messageId)) {
+            stream->local = false;
+        }
+    }
+}
+
+void fillChainedOutputStream(unsigned int callerId,
+                             unsigned int messageId,
+                             std::string outputData)
+{
+    auto stream = std::make_shared<ChainedOutputStream>();
+    stream->callerId = callerId;
+    stream->local = false;
+    stream->streamed = true;
+    stream->finished = true;
+    stream->pending = std::move(outputData);
+
+    faabric::util::UniqueLock lock(streamsMx);
+    auto it = streams.find(messageId);
+    if (it == streams.end()) {
+        callerMessageIds[callerId].push_back(messageId);
+    } else {
+        it->second->cv.notify_all();
+    }
+
+    streams[messageId] = stream;
+}
+
+void dropChainedOutputStreams(unsigned int callerId)
+{
+    faabric::util::UniqueLock lock(streamsMx);
+    auto callerIt = callerMessageIds.find(callerId);
+    if (callerIt == callerMessageIds.end()) {
+        return;
+    }
+
+    for (unsigned int messageId : callerIt->second) {
+        auto it = streams.find(messageId);
+        if (it != streams.end() && it->second->callerId == callerId) {
+            it->second->cv.notify_all();
+            streams.erase(it);
+        }
+    }
+
+    callerMessageIds.erase(callerIt);
+}
+}
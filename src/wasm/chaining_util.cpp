@@ -1,26 +1,89 @@
 #include <faabric/scheduler/ExecutorContext.h>
 #include <faabric/scheduler/Scheduler.h>
+#include <faabric/state/InMemoryStateRegistry.h>
 #include <faabric/util/bytes.h>
+#include <faabric/util/clock.h>
+#include <faabric/util/config.h>
 #include <faabric/util/func.h>
 #include <faabric/util/logging.h>
+#include <faabric/util/scheduling.h>
 
 #include <conf/FaasmConfig.h>
+#include <metrics/LifecycleTrace.h>
 #include <wasm/WasmExecutionContext.h>
 #include <wasm/WasmModule.h>
 #include <wasm/chaining.h>
+#include <wasm/chaining_dag.h>
+#include <wasm/chaining_input.h>
+#include <wasm/chaining_results.h>
+#include <wasm/chaining_shm.h>
+#include <wasm/chaining_stream.h>
+#include <wasm/result_cache.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <sys/mman.h>
+#include <unistd.h>
 
 namespace wasm {
+
+// Callees on this host notify us when they finish, while results of those
+// elsewhere come through the scheduler. Waits for notifications also check
+// the scheduler now and then, in case the callee has been migrated.
+faabric::Message getChainedCallResult(const faabric::Message& msg,
+                                      int timeoutMs)
+{
+    faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
+    if (!isChainedResultExpected(msg.id())) {
+        return sch.getFunctionResult(msg, timeoutMs);
+    }
+
+    faabric::util::Clock& clock = faabric::util::getGlobalClock();
+    int64_t timeoutEndMs = clock.epochMillis() + timeoutMs;
+    while (true) {
+        int64_t remainingMs = timeoutEndMs - clock.epochMillis();
+        int waitMs = (int)std::clamp<int64_t>(
+          remainingMs, 1, CHAINED_RESULT_POLL_INTERVAL_MS);
+
+        ChainedResult notified;
+        if (awaitChainedResultNotification(msg.id(), waitMs, notified)) {
+            faabric::Message result = msg;
+            result.set_returnvalue(notified.returnValue);
+            result.set_outputdata(notified.outputData);
+            return result;
+        }
+
+        if (!isChainedResultExpected(msg.id())) {
+            return sch.getFunctionResult(
+              msg, (int)std::max<int64_t>(remainingMs, 1));
+        }
+
+        // A timeout of zero doesn't block
+        faabric::Message polled = sch.getFunctionResult(msg, 0);
+        if (polled.type() != faabric::Message_MessageType_EMPTY) {
+            return polled;
+        }
+
+        if (clock.epochMillis() >= timeoutEndMs) {
+            throw faabric::redis::RedisNoResponseException(
+              "Timed out waiting for chained call result");
+        }
+    }
+}
+
 int awaitChainedCall(unsigned int messageId)
 {
+    metrics::TraceScope trace(metrics::TraceEvent::ChainedAwait, messageId);
     int callTimeoutMs = conf::getFaasmConfig().chainedCallTimeout;
     auto* exec = faabric::scheduler::ExecutorContext::get()->getExecutor();
 
     int returnCode = 1;
     try {
         auto msg = exec->getChainedMessage(messageId);
-        faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
         const faabric::Message result =
-          sch.getFunctionResult(msg, callTimeoutMs);
+          getChainedCallResult(msg, callTimeoutMs);
         returnCode = result.returnvalue();
     } catch (faabric::scheduler::ChainedCallException& ex) {
         SPDLOG_ERROR(
@@ -35,73 +98,303 @@ int awaitChainedCall(unsigned int messageId)
     return returnCode;
 }
 
-int makeChainedCall(const std::string& functionName,
-                    int wasmFuncPtr,
-                    const char* pyFuncName,
-                    const std::vector<uint8_t>& inputData)
+std::string getStateAffinityHost(const std::string& user,
+                                 const std::vector<std::string>& stateKeys)
 {
-    faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
-    faabric::Message* originalCall =
-      &faabric::scheduler::ExecutorContext::get()->getMsg();
+    // Only in-memory state has masters, Redis state is the same everywhere
+    const faabric::util::SystemConfig& sysConf =
+      faabric::util::getSystemConfig();
+    if (stateKeys.empty() || sysConf.stateMode != "inmemory") {
+        return "";
+    }
 
-    std::string user = originalCall->user();
+    faabric::state::InMemoryStateRegistry& registry =
+      faabric::state::getInMemoryStateRegistry();
 
-    assert(!user.empty());
-    assert(!functionName.empty());
+    std::map<std::string, int> hostCounts;
+    for (const auto& key : stateKeys) {
+        try {
+            std::string masterHost =
+              registry.getMasterIP(user, key, sysConf.endpointHost, false);
+            if (!masterHost.empty()) {
+                hostCounts[masterHost]++;
+            }
+        } catch (std::exception& ex) {
+            // Keys that don't exist yet have no master
+            SPDLOG_TRACE("No master for state {}/{}: {}", user, key, ex.what());
+        }
+    }
 
-    std::shared_ptr<faabric::BatchExecuteRequest> req =
-      faabric::util::batchExecFactory(originalCall->user(), functionName, 1);
+    std::string bestHost;
+    int bestCount = 0;
+    for (const auto& [host, count] : hostCounts) {
+        if (count > bestCount) {
+            bestHost = host;
+            bestCount = count;
+        }
+    }
 
-    faabric::Message& msg = req->mutable_messages()->at(0);
+    return bestHost;
+}
+
+void setUpChainedMessage(faabric::Message& msg,
+                         const faabric::Message& originalCall,
+                         int wasmFuncPtr,
+                         const char* pyFuncName,
+                         const std::vector<uint8_t>& inputData)
+{
     msg.set_inputdata(inputData.data(), inputData.size());
     msg.set_funcptr(wasmFuncPtr);
 
     // Propagate the command line if needed
-    msg.set_cmdline(originalCall->cmdline());
+    msg.set_cmdline(originalCall.cmdline());
 
     // Propagate the app ID
-    msg.set_appid(originalCall->appid());
+    msg.set_appid(originalCall.appid());
 
     // Python properties
-    msg.set_pythonuser(originalCall->pythonuser());
-    msg.set_pythonfunction(originalCall->pythonfunction());
+    msg.set_pythonuser(originalCall.pythonuser());
+    msg.set_pythonfunction(originalCall.pythonfunction());
     if (pyFuncName != nullptr) {
         msg.set_pythonentry(pyFuncName);
     }
-    msg.set_ispython(originalCall->ispython());
+    msg.set_ispython(originalCall.ispython());
 
-    if (originalCall->recordexecgraph()) {
+    if (originalCall.recordexecgraph()) {
         msg.set_recordexecgraph(true);
     }
+}
+
+// Sends the chained calls in the request, whose messages have been set up,
+// and returns their IDs
+static std::vector<int> callChainedMessages(
+  std::shared_ptr<faabric::BatchExecuteRequest> req,
+  int wasmFuncPtr,
+  const std::vector<std::string>& stateKeys)
+{
+    faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
+    faabric::Message* originalCall =
+      &faabric::scheduler::ExecutorContext::get()->getMsg();
+
+    std::string user = originalCall->user();
 
-    if (msg.funcptr() == 0) {
-        SPDLOG_INFO("Chaining call {}/{} -> {}/{} (ids: {} -> {})",
+    const faabric::Message& firstMsg = req->messages(0);
+    if (wasmFuncPtr == 0) {
+        SPDLOG_INFO("Chaining {} call(s) {}/{} -> {}/{} (ids: {} -> {}...)",
+                    req->messages_size(),
                     originalCall->user(),
                     originalCall->function(),
-                    msg.user(),
-                    msg.function(),
+                    firstMsg.user(),
+                    firstMsg.function(),
                     originalCall->id(),
-                    msg.id());
+                    firstMsg.id());
     } else {
-        SPDLOG_INFO("Chaining nested call {}/{} (ids: {} -> {})",
-                    msg.user(),
-                    msg.function(),
+        SPDLOG_INFO("Chaining {} nested call(s) {}/{} (ids: {} -> {}...)",
+                    req->messages_size(),
+                    firstMsg.user(),
+                    firstMsg.function(),
                     originalCall->id(),
-                    msg.id());
+                    firstMsg.id());
+    }
+
+    // Calls with a cached result are answered here and never scheduled, so
+    // don't claim an executor. The rest keep their order in the request.
+    std::vector<int> callIds;
+    std::vector<std::pair<faabric::Message, std::string>> cachedCalls;
+    auto* msgs = req->mutable_messages();
+    int nUncached = 0;
+    for (int i = 0; i < msgs->size(); i++) {
+        callIds.push_back(msgs->at(i).id());
+
+        std::string output;
+        if (lookupCachedResult(msgs->at(i), output)) {
+            cachedCalls.emplace_back(msgs->at(i), std::move(output));
+        } else {
+            msgs->SwapElements(i, nUncached++);
+        }
+    }
+    msgs->DeleteSubrange(nUncached, msgs->size() - nUncached);
+
+    // Record the chained calls in the executor before invoking the new
+    // functions to avoid data races. Callees that end up on this host can
+    // then also notify us directly, and hand their outputs over in shared
+    // memory.
+    bool shmOutputs = conf::getFaasmConfig().chainedShmOutputThreshold > 0;
+    auto* exec = faabric::scheduler::ExecutorContext::get()->getExecutor();
+    for (const auto& [msg, output] : cachedCalls) {
+        exec->addChainedMessage(msg);
+        expectChainedResult(originalCall->id(), msg.id());
+        notifyChainedResult(msg.id(), { 0, output });
+
+        if (originalCall->recordexecgraph()) {
+            sch.logChainedFunction(*originalCall, msg);
+        }
+    }
+
+    if (req->messages_size() == 0) {
+        SPDLOG_DEBUG("All {} chained call(s) answered from the result cache",
+                     cachedCalls.size());
+        return callIds;
     }
 
-    // Record the chained call in the executor before invoking the new
-    // functions to avoid data races
-    faabric::scheduler::ExecutorContext::get()
-      ->getExecutor()
-      ->addChainedMessage(req->messages(0));
+    for (const auto& msg : req->messages()) {
+        exec->addChainedMessage(msg);
+        expectChainedResult(originalCall->id(), msg.id());
+        expectChainedOutputStream(originalCall->id(), msg.id());
+
+        if (shmOutputs) {
+            expectChainedShmOutput(originalCall->id(), msg.id());
+        }
+    }
+
+    // Send the calls to where their state is, if we know. The scheduler
+    // already prefers this host, so only remote state needs a decision.
+    std::string affinityHost = getStateAffinityHost(user, stateKeys);
+    const std::string& thisHost = faabric::util::getSystemConfig().endpointHost;
+    faabric::util::SchedulingDecision decision(req->messages(0).appid(),
+                                               req->messages(0).groupid());
+    if (affinityHost.empty() || affinityHost == thisHost) {
+        decision = sch.callFunctions(req);
+    } else {
+        SPDLOG_DEBUG("Chaining {} call(s) to {} for state affinity",
+                     req->messages_size(),
+                     affinityHost);
+        for (const auto& msg : req->messages()) {
+            decision.addMessage(affinityHost, msg);
+        }
+        sch.callFunctions(req, decision);
+    }
+
+    // Calls sent elsewhere are awaited through the scheduler
+    for (int i = 0; i < decision.hosts.size(); i++) {
+        if (decision.hosts.at(i) != thisHost) {
+            forgetChainedResult(decision.messageIds.at(i));
+            forgetChainedOutputStream(decision.messageIds.at(i));
+        }
+    }
 
-    sch.callFunctions(req);
     if (originalCall->recordexecgraph()) {
-        sch.logChainedFunction(*originalCall, msg);
+        for (const auto& msg : req->messages()) {
+            sch.logChainedFunction(*originalCall, msg);
+        }
+    }
+
+    return callIds;
+}
+
+std::vector<int> makeChainedCalls(
+  const std::string& functionName,
+  int wasmFuncPtr,
+  const char* pyFuncName,
+  const std::vector<std::vector<uint8_t>>& inputs,
+  const std::vector<std::string>& stateKeys)
+{
+    faabric::Message* originalCall =
+      &faabric::scheduler::ExecutorContext::get()->getMsg();
+
+    assert(!originalCall->user().empty());
+    assert(!functionName.empty());
+
+    if (inputs.empty()) {
+        return {};
+    }
+
+    metrics::TraceScope trace(metrics::TraceEvent::ChainedCall, inputs.size());
+
+    // All the calls go in one request, so the scheduler only sees one
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory(
+        originalCall->user(), functionName, inputs.size());
+
+    for (int i = 0; i < inputs.size(); i++) {
+        setUpChainedMessage(req->mutable_messages()->at(i),
+                            *originalCall,
+                            wasmFuncPtr,
+                            pyFuncName,
+                            inputs.at(i));
+    }
+
+    return callChainedMessages(req, wasmFuncPtr, stateKeys);
+}
+
+int makeChainedCall(const std::string& functionName,
+                    int wasmFuncPtr,
+                    const char* pyFuncName,
+                    const std::vector<uint8_t>& inputData,
+                    const std::vector<std::string>& stateKeys)
+{
+    return makeChainedCalls(
+             functionName, wasmFuncPtr, pyFuncName, { inputData }, stateKeys)
+      .at(0);
+}
+
+int makeChainedCallWithStateInput(const std::string& functionName,
+                                  int wasmFuncPtr,
+                                  const std::string& stateKey,
+                                  size_t offset,
+                                  size_t length)
+{
+    faabric::Message* originalCall =
+      &faabric::scheduler::ExecutorContext::get()->getMsg();
+
+    assert(!originalCall->user().empty());
+    assert(!functionName.empty());
+
+    metrics::TraceScope trace(metrics::TraceEvent::ChainedCall, 1);
+
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory(originalCall->user(), functionName, 1);
+    faabric::Message& msg = req->mutable_messages()->at(0);
+    setUpChainedMessage(msg, *originalCall, wasmFuncPtr, nullptr, {});
+    setChainedInputRef(msg, { stateKey, offset, length });
+
+    // The call is sent to the input's master where there is one, so the
+    // callee doesn't have to fetch it from elsewhere
+    return callChainedMessages(req, wasmFuncPtr, { stateKey }).at(0);
+}
+
+int awaitChainedCalls(const std::vector<unsigned int>& messageIds,
+                      std::vector<int>& returnValues)
+{
+    metrics::TraceScope trace(metrics::TraceEvent::ChainedAwait,
+                              messageIds.size());
+    int callTimeoutMs = conf::getFaasmConfig().chainedCallTimeout;
+    auto* exec = faabric::scheduler::ExecutorContext::get()->getExecutor();
+
+    // The calls all run at once, so awaiting them one by one takes as long
+    // as the slowest. They share one timeout rather than having one each.
+    faabric::util::Clock& clock = faabric::util::getGlobalClock();
+    int64_t timeoutEndMs = clock.epochMillis() + callTimeoutMs;
+
+    returnValues.assign(messageIds.size(), 1);
+    int nFailed = 0;
+    for (int i = 0; i < messageIds.size(); i++) {
+        int remainingMs = (int)std::max<int64_t>(
+          timeoutEndMs - clock.epochMillis(), 1);
+
+        try {
+            auto msg = exec->getChainedMessage(messageIds.at(i));
+            const faabric::Message result =
+              getChainedCallResult(msg, remainingMs);
+            returnValues.at(i) = result.returnvalue();
+        } catch (faabric::scheduler::ChainedCallException& ex) {
+            SPDLOG_ERROR("Error getting chained call message: {}: {}",
+                         messageIds.at(i),
+                         ex.what());
+        } catch (faabric::redis::RedisNoResponseException& ex) {
+            SPDLOG_ERROR("Timed out waiting for chained call: {}",
+                         messageIds.at(i));
+        } catch (std::exception& ex) {
+            SPDLOG_ERROR("Non-timeout exception waiting for chained call: {}",
+                         ex.what());
+        }
+
+        if (returnValues.at(i) != 0) {
+            nFailed++;
+        }
     }
 
-    return msg.id();
+    return nFailed;
 }
 
 // TODO: is this used?
@@ -140,38 +433,286 @@ int spawnChainedThread(const std::string& snapshotKey,
     return call.id();
 }
 
-int awaitChainedCallOutput(unsigned int messageId,
-                           uint8_t* buffer,
-                           int bufferLen)
+// Awaits the call and gives back its result, along with its output if it was
+// handed over in shared memory
+static bool awaitChainedResult(unsigned int messageId,
+                               faabric::Message& result,
+                               ChainedShmOutput& shmOutput)
 {
     int callTimeoutMs = conf::getFaasmConfig().chainedCallTimeout;
     auto* exec = faabric::scheduler::ExecutorContext::get()->getExecutor();
-    faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
 
-    faabric::Message result;
     try {
         auto msg = exec->getChainedMessage(messageId);
-        result = sch.getFunctionResult(msg, callTimeoutMs);
+        result = getChainedCallResult(msg, callTimeoutMs);
     } catch (faabric::scheduler::ChainedCallException& e) {
         SPDLOG_ERROR(
           "Error awaiting for chained call {}: {}", messageId, e.what());
-        return 1;
+        return false;
     }
 
     if (result.type() == faabric::Message_MessageType_EMPTY) {
         SPDLOG_ERROR("Cannot find output for {}", messageId);
     }
 
-    std::vector<uint8_t> outputData =
-      faabric::util::stringToBytes(result.outputdata());
-    int outputLen =
-      faabric::util::safeCopyToBuffer(outputData, buffer, bufferLen);
+    shmOutput = takeChainedShmOutput(messageId);
+
+    return true;
+}
+
+int awaitChainedCallOutput(unsigned int messageId,
+                           uint8_t* buffer,
+                           int bufferLen)
+{
+    faabric::Message result;
+    ChainedShmOutput shmOutput;
+    if (!awaitChainedResult(messageId, result, shmOutput)) {
+        return 1;
+    }
+
+    size_t outputSize = result.outputdata().size();
+    int outputLen = 0;
+    if (shmOutput.fd >= 0) {
+        outputSize = shmOutput.size;
+        size_t toRead = std::min<size_t>(outputSize, std::max(bufferLen, 0));
+        while (outputLen < toRead) {
+            ssize_t n = ::pread(
+              shmOutput.fd, buffer + outputLen, toRead - outputLen, outputLen);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (n <= 0) {
+                SPDLOG_ERROR("Failed reading output for {} ({} - {})",
+                             messageId,
+                             errno,
+                             strerror(errno));
+                break;
+            }
+
+            outputLen += n;
+        }
+
+        ::close(shmOutput.fd);
+    } else {
+        std::vector<uint8_t> outputData =
+          faabric::util::stringToBytes(result.outputdata());
+        outputLen =
+          faabric::util::safeCopyToBuffer(outputData, buffer, bufferLen);
+    }
 
-    if (outputLen < outputData.size()) {
+    if (outputLen < outputSize) {
         SPDLOG_WARN(
-          "Undersized output buffer: {} for {} output", bufferLen, outputLen);
+          "Undersized output buffer: {} for {} output", bufferLen, outputSize);
+    }
+
+    return result.returnvalue();
+}
+
+int awaitChainedCallOutputMapped(unsigned int messageId,
+                                 uint32_t* outputPtr,
+                                 uint32_t* outputLen)
+{
+    *outputPtr = 0;
+    *outputLen = 0;
+
+    faabric::Message result;
+    ChainedShmOutput shmOutput;
+    if (!awaitChainedResult(messageId, result, shmOutput)) {
+        return 1;
+    }
+
+    WasmModule* module = getExecutingModule();
+    if (shmOutput.fd >= 0) {
+        // Mapped privately, so the caller can write to it without the pages
+        // being copied until it does
+        uint32_t wasmPtr = 0;
+        try {
+            wasmPtr = module->mmapFile(shmOutput.fd,
+                                       shmOutput.size,
+                                       PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE,
+                                       0);
+        } catch (std::runtime_error& e) {
+            ::close(shmOutput.fd);
+            throw;
+        }
+
+        // The mapping holds its own reference to the memory
+        ::close(shmOutput.fd);
+        *outputPtr = wasmPtr;
+        *outputLen = shmOutput.size;
+    } else if (!result.outputdata().empty()) {
+        // Outputs from other hosts, or under the threshold, are copied in
+        const std::string& outputData = result.outputdata();
+        *outputPtr = module->mmapMemory(outputData.size());
+        *outputLen = outputData.size();
+        std::memcpy(module->wasmPointerToNative(*outputPtr),
+                    outputData.data(),
+                    outputData.size());
     }
 
     return result.returnvalue();
 }
+
+int readCallInput(uint8_t* buffer, int bufferLen)
+{
+    const faabric::Message& msg =
+      faabric::scheduler::ExecutorContext::get()->getMsg();
+
+    // Only the part that fits in the buffer is pulled, and nothing when the
+    // guest is just asking for the size
+    ChainedInputRef ref;
+    if (getChainedInputRef(msg, ref)) {
+        if (ref.length == 0 || bufferLen <= 0) {
+            return ref.length;
+        }
+
+        auto kv = resolveChainedInputRef(msg.user(), ref);
+        int inputSize = std::min<size_t>(ref.length, bufferLen);
+        kv->getChunk(ref.offset, buffer, inputSize);
+
+        return inputSize;
+    }
+
+    const std::string& inputData = msg.inputdata();
+
+    if (inputData.empty() || bufferLen <= 0) {
+        return inputData.size();
+    }
+
+    // Copied straight from the message, without an intermediate vector
+    int inputSize = std::min<int>(inputData.size(), bufferLen);
+    std::memcpy(buffer, inputData.data(), inputSize);
+
+    return inputSize;
+}
+
+void readCallInputMapped(uint32_t* inputPtr, uint32_t* inputLen)
+{
+    const faabric::Message& msg =
+      faabric::scheduler::ExecutorContext::get()->getMsg();
+
+    // State inputs are mapped straight from the local replica
+    ChainedInputRef ref;
+    if (getChainedInputRef(msg, ref)) {
+        auto kv = resolveChainedInputRef(msg.user(), ref);
+        if (ref.length > 0) {
+            kv->getChunk(ref.offset, ref.length);
+        }
+
+        *inputPtr =
+          getExecutingModule()->mapReadOnlyState(kv, ref.offset, ref.length);
+        *inputLen = ref.length;
+        return;
+    }
+
+    const std::string& inputData = msg.inputdata();
+    *inputPtr = getExecutingModule()->mapReadOnlyBytes(inputData);
+    *inputLen = inputData.size();
+}
+
+void writeCallOutput(const uint8_t* output, size_t outputLen)
+{
+    faabric::Message& msg =
+      faabric::scheduler::ExecutorContext::get()->getMsg();
+
+    if (writeChainedShmOutput(msg.id(), output, outputLen)) {
+        msg.clear_outputdata();
+        return;
+    }
+
+    // The only copy of the output is into the message
+    msg.set_outputdata(reinterpret_cast<const char*>(output), outputLen);
+}
+
+void appendCallOutput(const uint8_t* output, size_t outputLen)
+{
+    faabric::Message& msg =
+      faabric::scheduler::ExecutorContext::get()->getMsg();
+
+    if (!appendChainedOutputStream(msg.id(), output, outputLen)) {
+        msg.mutable_outputdata()->append(reinterpret_cast<const char*>(output),
+                                         outputLen);
+    }
+}
+
+static bool readShmOutputData(unsigned int messageId,
+                              const ChainedShmOutput& shmOutput,
+                              std::string& outputData)
+{
+    outputData.resize(shmOutput.size);
+    size_t nRead = 0;
+    while (nRead < shmOutput.size) {
+        ssize_t n = ::pread(shmOutput.fd,
+                            outputData.data() + nRead,
+                            shmOutput.size - nRead,
+                            nRead);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            SPDLOG_ERROR("Failed reading output for {} ({} - {})",
+                         messageId,
+                         errno,
+                         strerror(errno));
+            return false;
+        }
+
+        nRead += n;
+    }
+
+    return true;
+}
+
+int readChainedCallOutput(unsigned int messageId,
+                          uint8_t* buffer,
+                          int bufferLen)
+{
+    if (bufferLen <= 0) {
+        SPDLOG_ERROR("Reading output of {} into empty buffer", messageId);
+        return -1;
+    }
+
+    int timeoutMs = conf::getFaasmConfig().chainedCallTimeout;
+    int nBytes =
+      readChainedOutputStream(messageId, buffer, bufferLen, timeoutMs);
+    if (nBytes != CHAINED_OUTPUT_STREAM_UNAVAILABLE) {
+        return nBytes;
+    }
+
+    // Calls that ran elsewhere, or wrote their output in one go, are read
+    // from their result, a chunk at a time like the rest
+    faabric::Message result;
+    ChainedShmOutput shmOutput;
+    if (!awaitChainedResult(messageId, result, shmOutput)) {
+        return -1;
+    }
+
+    std::string outputData;
+    if (shmOutput.fd >= 0) {
+        bool success = readShmOutputData(messageId, shmOutput, outputData);
+        ::close(shmOutput.fd);
+        if (!success) {
+            return -1;
+        }
+    } else {
+        outputData = std::move(*result.mutable_outputdata());
+    }
+
+    unsigned int callerId =
+      faabric::scheduler::ExecutorContext::get()->getMsg().id();
+    fillChainedOutputStream(callerId, messageId, std::move(outputData));
+
+    return readChainedOutputStream(messageId, buffer, bufferLen, 0);
+}
+
+void finishChainedCalls(unsigned int callerId)
+{
+    awaitChainedDags(callerId);
+    dropChainedResults(callerId);
+    dropChainedShmOutputs(callerId);
+    dropChainedOutputStreams(callerId);
+}
 }
@@ -0,0 +1,530 @@
+#include <conf/FaasmConfig.h>
+#include <storage/S3Wrapper.h>
+#include <wasm/WasmExecutionContext.h>
+#include <wasm/WasmModule.h>
+#include <wasm/checkpoint.h>
+#include <wasm/memdiff.h>
+#include <wasm/mpi_comm.h>
+#include <wasm/mpi_progress.h>
+
+#include <faabric/mpi/MpiWorldRegistry.h>
+#include <faabric/scheduler/ExecutorContext.h>
+#include <faabric/util/gids.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+using namespace faabric::mpi;
+
+namespace wasm {
+
+static std::string getFunctionPrefix(const std::string& user,
+                                     const std::string& function)
+{
+    return fmt::format("checkpoints/{}/{}", user, function);
+}
+
+static std::string getLatestKey(const std::string& user,
+                                const std::string& function)
+{
+    return getFunctionPrefix(user, function) + "/latest";
+}
+
+static size_t hashChunk(std::span<const uint8_t> chunk)
+{
+    return std::hash<std::string_view>()(
+      std::string_view((const char*)chunk.data(), chunk.size()));
+}
+
+// -------------------------------------
+// MANIFEST
+// -------------------------------------
+
+// A line of numbers ending with the chunks' checkpoints, then the argument
+std::vector<uint8_t> CheckpointManifest::toBytes() const
+{
+    std::stringstream ss;
+    ss << seq << " " << memSize << " " << funcPtr << " " << worldSize << " "
+       << funcArg.size() << " " << chunkSeqs.size();
+
+    for (int chunkSeq : chunkSeqs) {
+        ss << " " << chunkSeq;
+    }
+    ss << "\n" << funcArg;
+
+    std::string str = ss.str();
+    return std::vector<uint8_t>(str.begin(), str.end());
+}
+
+CheckpointManifest CheckpointManifest::fromBytes(
+  const std::vector<uint8_t>& bytes)
+{
+    std::stringstream ss(std::string(bytes.begin(), bytes.end()));
+
+    CheckpointManifest manifest;
+    size_t nChunks = 0;
+    size_t argSize = 0;
+    ss >> manifest.seq >> manifest.memSize >> manifest.funcPtr >>
+      manifest.worldSize >> argSize >> nChunks;
+
+    manifest.chunkSeqs.resize(nChunks);
+    for (size_t i = 0; i < nChunks; i++) {
+        ss >> manifest.chunkSeqs.at(i);
+    }
+
+    // Skip to the start of the argument
+    ss.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    manifest.funcArg.resize(argSize);
+    ss.read(manifest.funcArg.data(), argSize);
+
+    if (!ss || manifest.seq <= 0) {
+        SPDLOG_ERROR("Malformed checkpoint manifest ({} bytes)", bytes.size());
+        throw std::runtime_error("Malformed checkpoint manifest");
+    }
+
+    return manifest;
+}
+
+// -------------------------------------
+// CHECKPOINTER
+// -------------------------------------
+
+Checkpointer::Checkpointer(const std::string& userIn,
+                           const std::string& functionIn,
+                           int rankIn,
+                           size_t chunkBytesIn)
+  : user(userIn)
+  , function(functionIn)
+  , rank(rankIn)
+  , chunkBytes(chunkBytesIn)
+{}
+
+std::string Checkpointer::getRankPrefix() const
+{
+    return fmt::format("{}/rank_{}/", getFunctionPrefix(user, function), rank);
+}
+
+std::string Checkpointer::getChunkKey(size_t idx, int seq) const
+{
+    return fmt::format("{}chunk_{}_{}", getRankPrefix(), idx, seq);
+}
+
+std::string Checkpointer::getManifestKey(int seq) const
+{
+    return fmt::format("{}manifest_{}", getRankPrefix(), seq);
+}
+
+size_t Checkpointer::write(int seq,
+                           std::span<const uint8_t> memory,
+                           int32_t funcPtr,
+                           const std::string& funcArg,
+                           int worldSize)
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    storage::S3Wrapper s3;
+
+    CheckpointManifest manifest;
+    manifest.seq = seq;
+    manifest.memSize = memory.size();
+    manifest.funcPtr = funcPtr;
+    manifest.funcArg = funcArg;
+    manifest.worldSize = worldSize;
+
+    size_t nChunks = (memory.size() + chunkBytes - 1) / chunkBytes;
+    manifest.chunkSeqs.resize(nChunks, 0);
+
+    // Only kept once everything is uploaded, so a failed checkpoint doesn't
+    // stop the next one sending what it didn't
+    std::vector<size_t> hashes(nChunks, 0);
+    std::vector<std::string> oldKeys;
+
+    size_t sentBytes = 0;
+    for (size_t i = 0; i < nChunks; i++) {
+        size_t offset = i * chunkBytes;
+        std::span<const uint8_t> chunk =
+          memory.subspan(offset, std::min(chunkBytes, memory.size() - offset));
+
+        int prevSeq = i < last.chunkSeqs.size() ? last.chunkSeqs.at(i) : 0;
+        bool wasWhole = offset + chunk.size() <= last.memSize;
+
+        if (!isZeroMemory(chunk)) {
+            hashes.at(i) = hashChunk(chunk);
+
+            if (prevSeq != 0 && wasWhole && i < chunkHashes.size() &&
+                hashes.at(i) == chunkHashes.at(i)) {
+                manifest.chunkSeqs.at(i) = prevSeq;
+            } else {
+                s3.addKeyBytes(
+                  conf.s3Bucket,
+                  getChunkKey(i, seq),
+                  std::vector<uint8_t>(chunk.begin(), chunk.end()));
+                manifest.chunkSeqs.at(i) = seq;
+                sentBytes += chunk.size();
+            }
+        }
+
+        if (prevSeq != 0 && prevSeq != manifest.chunkSeqs.at(i)) {
+            oldKeys.push_back(getChunkKey(i, prevSeq));
+        }
+    }
+
+    // Memory can't shrink, but the manifest we carried on from may be bigger
+    for (size_t i = nChunks; i < last.chunkSeqs.size(); i++) {
+        if (last.chunkSeqs.at(i) != 0) {
+            oldKeys.push_back(getChunkKey(i, last.chunkSeqs.at(i)));
+        }
+    }
+
+    s3.addKeyBytes(conf.s3Bucket, getManifestKey(seq), manifest.toBytes());
+    if (last.seq != 0 && last.seq != seq) {
+        oldKeys.push_back(getManifestKey(last.seq));
+    }
+
+    last = manifest;
+    chunkHashes = std::move(hashes);
+    superseded.insert(superseded.end(), oldKeys.begin(), oldKeys.end());
+
+    return sentBytes;
+}
+
+void Checkpointer::prune()
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    storage::S3Wrapper s3;
+
+    // Leftovers only cost space, so failing to delete them isn't fatal
+    for (const auto& key : superseded) {
+        try {
+            s3.deleteKey(conf.s3Bucket, key);
+        } catch (std::exception& ex) {
+            SPDLOG_WARN(
+              "Failed to delete checkpoint key {}: {}", key, ex.what());
+        }
+    }
+
+    superseded.clear();
+}
+
+CheckpointManifest Checkpointer::readManifest(int seq)
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    storage::S3Wrapper s3;
+
+    return CheckpointManifest::fromBytes(
+      s3.getKeyBytes(conf.s3Bucket, getManifestKey(seq)));
+}
+
+void Checkpointer::restore(const CheckpointManifest& manifest,
+                           std::span<uint8_t> memory)
+{
+    size_t nChunks = (manifest.memSize + chunkBytes - 1) / chunkBytes;
+    if (memory.size() < manifest.memSize ||
+        manifest.chunkSeqs.size() != nChunks) {
+        SPDLOG_ERROR("Checkpoint {} of {}/{} rank {} doesn't fit memory "
+                     "({} bytes, {} chunks, have {} bytes)",
+                     manifest.seq,
+                     user,
+                     function,
+                     rank,
+                     manifest.memSize,
+                     manifest.chunkSeqs.size(),
+                     memory.size());
+        throw std::runtime_error("Checkpoint doesn't fit memory");
+    }
+
+    // Memory past what was checkpointed is left alone
+    memory = memory.first(manifest.memSize);
+
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    storage::S3Wrapper s3;
+
+    for (size_t i = 0; i < nChunks; i++) {
+        size_t offset = i * chunkBytes;
+        std::span<uint8_t> chunk =
+          memory.subspan(offset, std::min(chunkBytes, memory.size() - offset));
+
+        int chunkSeq = manifest.chunkSeqs.at(i);
+        if (chunkSeq == 0) {
+            std::memset(chunk.data(), 0, chunk.size());
+            continue;
+        }
+
+        std::vector<uint8_t> bytes =
+          s3.getKeyBytes(conf.s3Bucket, getChunkKey(i, chunkSeq));
+        if (bytes.size() != chunk.size()) {
+            SPDLOG_ERROR("Checkpoint chunk {} is {} bytes, expected {}",
+                         getChunkKey(i, chunkSeq),
+                         bytes.size(),
+                         chunk.size());
+            throw std::runtime_error("Checkpoint chunk has wrong size");
+        }
+
+        std::memcpy(chunk.data(), bytes.data(), bytes.size());
+    }
+
+    // What's restored needn't be sent again
+    resumeFrom(manifest);
+    chunkHashes.assign(nChunks, 0);
+    for (size_t i = 0; i < nChunks; i++) {
+        if (manifest.chunkSeqs.at(i) != 0) {
+            size_t offset = i * chunkBytes;
+            chunkHashes.at(i) = hashChunk(memory.subspan(
+              offset, std::min(chunkBytes, memory.size() - offset)));
+        }
+    }
+}
+
+void Checkpointer::resumeFrom(const CheckpointManifest& manifest)
+{
+    last = manifest;
+    chunkHashes.clear();
+    superseded.clear();
+}
+
+void Checkpointer::remove()
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    storage::S3Wrapper s3;
+
+    // Listing also catches chunks left by checkpoints that never completed
+    std::string prefix = getRankPrefix();
+    for (const auto& key : s3.listKeys(conf.s3Bucket)) {
+        if (key.starts_with(prefix)) {
+            s3.deleteKey(conf.s3Bucket, key);
+        }
+    }
+
+    last = CheckpointManifest();
+    chunkHashes.clear();
+    superseded.clear();
+}
+
+int getLatestCheckpoint(const std::string& user, const std::string& function)
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    storage::S3Wrapper s3;
+
+    std::vector<uint8_t> bytes =
+      s3.getKeyBytes(conf.s3Bucket, getLatestKey(user, function), true);
+    if (bytes.empty()) {
+        return 0;
+    }
+
+    return std::stoi(std::string(bytes.begin(), bytes.end()));
+}
+
+void setLatestCheckpoint(const std::string& user,
+                         const std::string& function,
+                         int seq)
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    storage::S3Wrapper s3;
+
+    std::string seqStr = std::to_string(seq);
+    s3.addKeyBytes(conf.s3Bucket,
+                   getLatestKey(user, function),
+                   std::vector<uint8_t>(seqStr.begin(), seqStr.end()));
+}
+
+void removeLatestCheckpoint(const std::string& user,
+                            const std::string& function)
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    storage::S3Wrapper s3;
+
+    s3.deleteKey(conf.s3Bucket, getLatestKey(user, function));
+}
+
+// -------------------------------------
+// CALLS
+// -------------------------------------
+
+struct CallCheckpoints
+{
+    std::unique_ptr<Checkpointer> checkpointer;
+
+    // The last checkpoint this call has written or restored
+    int seq = 0;
+
+    faabric::util::TimePoint lastTime = faabric::util::startTimer();
+};
+
+// Executor threads run one call at a time, so this is the executing call's
+static thread_local CallCheckpoints callCheckpoints;
+
+static int getCallRank(const faabric::Message& msg)
+{
+    return msg.ismpi() ? msg.mpirank() : 0;
+}
+
+void doCheckpoint(int32_t entrypointFuncWasmOffset,
+                  const std::string& entrypointFuncArg)
+{
+    faabric::Message& call =
+      faabric::scheduler::ExecutorContext::get()->getMsg();
+    faabric::util::TimePoint start = faabric::util::startTimer();
+
+    // Collectives in flight may still be writing to memory
+    MpiWorld* world = nullptr;
+    if (call.ismpi()) {
+        awaitMpiCollectives();
+        world = &getMpiWorldRegistry().getWorld(call.mpiworldid());
+    }
+
+    CallCheckpoints& state = callCheckpoints;
+    if (state.checkpointer == nullptr) {
+        state.checkpointer = std::make_unique<Checkpointer>(
+          call.user(), call.function(), getCallRank(call));
+
+        // A migrated call carries on from the checkpoints of the host it
+        // came from, so their keys are cleaned up as usual
+        state.seq = getLatestCheckpoint(call.user(), call.function());
+        if (state.seq > 0) {
+            state.checkpointer->resumeFrom(
+              state.checkpointer->readManifest(state.seq));
+        }
+    }
+
+    int seq = state.seq + 1;
+    std::span<uint8_t> memView = getExecutingModule()->getMemoryView();
+    size_t sentBytes =
+      state.checkpointer->write(seq,
+                                memView,
+                                entrypointFuncWasmOffset,
+                                entrypointFuncArg,
+                                world == nullptr ? 0 : world->getSize());
+
+    // The checkpoint only counts once every rank has written its part
+    if (world != nullptr) {
+        MpiCommunicator& comm =
+          getMpiCommunicator(*world, call.mpirank(), FAABRIC_COMM_WORLD);
+        comm.barrier(*world);
+        if (call.mpirank() == 0) {
+            setLatestCheckpoint(call.user(), call.function(), seq);
+        }
+        comm.barrier(*world);
+    } else {
+        setLatestCheckpoint(call.user(), call.function(), seq);
+    }
+
+    state.checkpointer->prune();
+    state.seq = seq;
+    state.lastTime = faabric::util::startTimer();
+
+    SPDLOG_INFO("Checkpoint {} of {}/{} rank {} took {}ms ({}/{} bytes sent)",
+                seq,
+                call.user(),
+                call.function(),
+                getCallRank(call),
+                faabric::util::getTimeDiffMillis(start),
+                sentBytes,
+                memView.size());
+}
+
+void doPeriodicCheckpoint(int32_t entrypointFuncWasmOffset,
+                          const std::string& entrypointFuncArg)
+{
+    int periodSecs = conf::getFaasmConfig().checkpointPeriodSecs;
+    if (periodSecs <= 0) {
+        return;
+    }
+
+    faabric::Message& call =
+      faabric::scheduler::ExecutorContext::get()->getMsg();
+    int due = faabric::util::getTimeDiffMillis(callCheckpoints.lastTime) >=
+                  periodSecs * 1000.0
+                ? 1
+                : 0;
+
+    // Ranks' clocks differ, so they go with rank zero
+    if (call.ismpi()) {
+        awaitMpiCollectives();
+        MpiWorld& world = getMpiWorldRegistry().getWorld(call.mpiworldid());
+        getMpiCommunicator(world, call.mpirank(), FAABRIC_COMM_WORLD)
+          .broadcast(world, 0, (uint8_t*)&due, MPI_INT, 1);
+    }
+
+    if (due != 0) {
+        doCheckpoint(entrypointFuncWasmOffset, entrypointFuncArg);
+    }
+}
+
+bool restoreCheckpoint(WasmModule& module, faabric::Message& msg)
+{
+    callCheckpoints = CallCheckpoints();
+
+    // Calls from function pointers are migrated or chained, so are already
+    // part way through
+    if (conf::getFaasmConfig().checkpointRestore != "on" ||
+        msg.funcptr() > 0) {
+        return false;
+    }
+
+    int seq = getLatestCheckpoint(msg.user(), msg.function());
+    if (seq == 0) {
+        return false;
+    }
+
+    int rank = getCallRank(msg);
+    auto checkpointer =
+      std::make_unique<Checkpointer>(msg.user(), msg.function(), rank);
+    CheckpointManifest manifest = checkpointer->readManifest(seq);
+
+    // The brk may be below the end of linear memory if the module was reset,
+    // so it's the brk that's moved to the checkpointed size
+    module.setMemorySize(manifest.memSize);
+    checkpointer->restore(manifest, module.getMemoryView());
+
+    // Other ranks join the world lazily, as when they've been migrated
+    if (manifest.worldSize > 0 && rank == 0) {
+        int worldId = (int)faabric::util::generateGid();
+        msg.set_ismpi(true);
+        msg.set_mpirank(0);
+        msg.set_mpiworldsize(manifest.worldSize);
+        msg.set_mpiworldid(worldId);
+        getMpiWorldRegistry().createWorld(msg, worldId);
+    }
+
+    msg.set_funcptr(manifest.funcPtr);
+    msg.set_inputdata(manifest.funcArg);
+
+    callCheckpoints.checkpointer = std::move(checkpointer);
+    callCheckpoints.seq = seq;
+
+    SPDLOG_INFO("Restored {}/{} rank {} from checkpoint {}",
+                msg.user(),
+                msg.function(),
+                rank,
+                seq);
+
+    return true;
+}
+
+void finishCheckpoints(const faabric::Message& msg, bool succeeded)
+{
+    CallCheckpoints& state = callCheckpoints;
+    if (state.checkpointer != nullptr && succeeded) {
+        try {
+            if (getCallRank(msg) == 0) {
+                removeLatestCheckpoint(msg.user(), msg.function());
+            }
+            state.checkpointer->remove();
+        } catch (std::exception& ex) {
+            SPDLOG_WARN("Failed to remove checkpoints of {}/{}: {}",
+                        msg.user(),
+                        msg.function(),
+                        ex.what());
+        }
+    }
+
+    callCheckpoints = CallCheckpoints();
+}
+}
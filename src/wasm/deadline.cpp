@@ -0,0 +1,174 @@
+#include <conf/FaasmConfig.h>
+#include <wasm/WasmModule.h>
+#include <wasm/deadline.h>
+
+#include <faabric/scheduler/ExecutorContext.h>
+#include <faabric/util/clock.h>
+#include <faabric/util/config.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+namespace wasm {
+
+static thread_local int64_t currentDeadlineMs = -1;
+
+int64_t getExecutionDeadlineMs(const faabric::Message& msg)
+{
+    int timeoutMs = faabric::util::getSystemConfig().globalMessageTimeout;
+    return (int64_t)msg.timestamp() + timeoutMs;
+}
+
+int64_t getCallDeadlineMs(const faabric::Message& msg, int64_t startMs)
+{
+    // Messages made up on this host, e.g. in tests, may not be timestamped
+    int64_t deadlineMs;
+    if (msg.timestamp() > 0) {
+        deadlineMs = getExecutionDeadlineMs(msg);
+    } else {
+        deadlineMs =
+          startMs + faabric::util::getSystemConfig().globalMessageTimeout;
+    }
+
+    int execTimeoutMs = conf::getFaasmConfig().execTimeoutMs;
+    if (execTimeoutMs > 0) {
+        deadlineMs = std::min<int64_t>(deadlineMs, startMs + execTimeoutMs);
+    }
+
+    return deadlineMs;
+}
+
+int64_t getCurrentDeadlineMs()
+{
+    if (currentDeadlineMs >= 0) {
+        return currentDeadlineMs;
+    }
+
+    if (!faabric::scheduler::ExecutorContext::isSet()) {
+        return -1;
+    }
+
+    return getExecutionDeadlineMs(
+      faabric::scheduler::ExecutorContext::get()->getMsg());
+}
+
+int64_t getRemainingTimeMs()
+{
+    int64_t deadlineMs = getCurrentDeadlineMs();
+    if (deadlineMs < 0) {
+        return -1;
+    }
+
+    int64_t nowMs = faabric::util::getGlobalClock().epochMillis();
+    return std::max<int64_t>(deadlineMs - nowMs, 0);
+}
+
+ExecutionWatchdog::~ExecutionWatchdog()
+{
+    {
+        std::unique_lock<std::mutex> lock(mx);
+        running = false;
+    }
+
+    cv.notify_one();
+    if (watchThread.joinable()) {
+        watchThread.join();
+    }
+}
+
+uint64_t ExecutionWatchdog::arm(WasmModule* module, int64_t deadlineMs)
+{
+    std::unique_lock<std::mutex> lock(mx);
+
+    // Only started when there's something to watch, so hosts and tests that
+    // never execute anything don't get the thread
+    if (!running) {
+        running = true;
+        watchThread = std::thread(&ExecutionWatchdog::watch, this);
+    }
+
+    // The watch thread only needs waking if it would otherwise sleep past
+    // this deadline
+    bool isEarliest = std::all_of(
+      armed.begin(), armed.end(), [deadlineMs](const auto& a) {
+          return deadlineMs < a.second.deadlineMs;
+      });
+
+    uint64_t id = nextId++;
+    armed.emplace(id, ArmedCall{ module, deadlineMs });
+    lock.unlock();
+
+    if (isEarliest) {
+        cv.notify_one();
+    }
+
+    return id;
+}
+
+void ExecutionWatchdog::disarm(uint64_t id)
+{
+    std::unique_lock<std::mutex> lock(mx);
+    armed.erase(id);
+}
+
+size_t ExecutionWatchdog::getArmedCount()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    return armed.size();
+}
+
+void ExecutionWatchdog::watch()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    while (running) {
+        int64_t nowMs = faabric::util::getGlobalClock().epochMillis();
+        int64_t nextDeadlineMs = std::numeric_limits<int64_t>::max();
+
+        for (auto it = armed.begin(); it != armed.end();) {
+            if (it->second.deadlineMs > nowMs) {
+                nextDeadlineMs =
+                  std::min(nextDeadlineMs, it->second.deadlineMs);
+                ++it;
+                continue;
+            }
+
+            SPDLOG_WARN("Interrupting call {}ms past its deadline",
+                        nowMs - it->second.deadlineMs);
+            it->second.module->interruptExecution();
+            it = armed.erase(it);
+        }
+
+        if (armed.empty()) {
+            cv.wait(lock);
+        } else {
+            cv.wait_for(lock,
+                        std::chrono::milliseconds(nextDeadlineMs - nowMs));
+        }
+    }
+}
+
+ExecutionWatchdog& getExecutionWatchdog()
+{
+    static ExecutionWatchdog watchdog;
+    return watchdog;
+}
+
+ExecutionDeadlineGuard::ExecutionDeadlineGuard(WasmModule& moduleIn,
+                                               const faabric::Message& msg)
+  : module(moduleIn)
+  , deadlineMs(
+      getCallDeadlineMs(msg, faabric::util::getGlobalClock().epochMillis()))
+  , previousDeadlineMs(currentDeadlineMs)
+  , watchId(getExecutionWatchdog().arm(&module, deadlineMs))
+{
+    currentDeadlineMs = deadlineMs;
+}
+
+ExecutionDeadlineGuard::~ExecutionDeadlineGuard()
+{
+    getExecutionWatchdog().disarm(watchId);
+    currentDeadlineMs = previousDeadlineMs;
+}
+}
@@ -0,0 +1,306 @@
+#include <wasm/dirty_tracking.h>
+
+#include <faabric/util/dirty.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/memory.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <linux/userfaultfd.h>
+#include <stdexcept>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Older kernel headers lack the asynchronous write-protect features (Linux
+// 6.7), so we declare the parts of the ABI we use
+#ifndef UFFD_FEATURE_WP_UNPOPULATED
+#define UFFD_FEATURE_WP_UNPOPULATED (1 << 13)
+#endif
+
+#ifndef UFFD_FEATURE_WP_ASYNC
+#define UFFD_FEATURE_WP_ASYNC (1 << 15)
+#endif
+
+#ifndef PAGEMAP_SCAN
+#define PAGEMAP_SCAN _IOWR('f', 16, struct pm_scan_arg)
+#define PM_SCAN_CHECK_WPASYNC (1 << 1)
+#define PAGE_IS_WRITTEN (1 << 1)
+
+struct page_region
+{
+    __u64 start;
+    __u64 end;
+    __u64 categories;
+};
+
+struct pm_scan_arg
+{
+    __u64 size;
+    __u64 flags;
+    __u64 start;
+    __u64 end;
+    __u64 walk_end;
+    __u64 vec;
+    __u64 vec_len;
+    __u64 max_pages;
+    __u64 category_inverted;
+    __u64 category_mask;
+    __u64 category_anyof_mask;
+    __u64 return_mask;
+};
+#endif
+
+// Memory restored from a snapshot is a private mapping of a memfd, which
+// needs write-protection on shmem as well as anonymous memory
+#define DIRTY_UFFD_FEATURES                                                    \
+    (UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED |                     \
+     UFFD_FEATURE_WP_HUGETLBFS_SHMEM)
+
+// Written regions read back per PAGEMAP_SCAN call
+#define DIRTY_SCAN_BATCH 256
+
+namespace wasm {
+
+// Set while a module is using faabric's process-wide tracker
+static std::atomic<bool> sharedTrackerTaken = false;
+
+static int openUffd()
+{
+    int fd = (int)syscall(
+      SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    uffdio_api api = {
+        .api = UFFD_API, .features = DIRTY_UFFD_FEATURES, .ioctls = 0
+    };
+    if (ioctl(fd, UFFDIO_API, &api) != 0 ||
+        (api.features & DIRTY_UFFD_FEATURES) != DIRTY_UFFD_FEATURES) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int getPagemapScanFd()
+{
+    static int fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    return fd;
+}
+
+// Calls back with each written range, returning false if the scan failed
+template<typename F>
+static bool scanWrittenPages(std::span<uint8_t> mem, F&& onWritten)
+{
+    int fd = getPagemapScanFd();
+    if (fd < 0) {
+        return false;
+    }
+
+    page_region regions[DIRTY_SCAN_BATCH];
+    uint64_t start = (uint64_t)mem.data();
+    uint64_t end = start + mem.size();
+    while (start < end) {
+        pm_scan_arg arg;
+        std::memset(&arg, 0, sizeof(arg));
+        arg.size = sizeof(arg);
+        arg.flags = PM_SCAN_CHECK_WPASYNC;
+        arg.start = start;
+        arg.end = end;
+        arg.vec = (uint64_t)regions;
+        arg.vec_len = DIRTY_SCAN_BATCH;
+        arg.category_mask = PAGE_IS_WRITTEN;
+        arg.return_mask = PAGE_IS_WRITTEN;
+
+        int n = ioctl(fd, PAGEMAP_SCAN, &arg);
+        if (n < 0) {
+            return false;
+        }
+
+        for (int i = 0; i < n; i++) {
+            onWritten(regions[i].start, regions[i].end);
+        }
+
+        if (arg.walk_end <= start) {
+            return false;
+        }
+        start = arg.walk_end;
+    }
+
+    return true;
+}
+
+bool MemoryDirtyTracker::isPerRangeTrackingSupported()
+{
+    // Tracks a page of its own, which checks both the userfaultfd features
+    // and PAGEMAP_SCAN are there
+    static const bool supported = [] {
+        size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+        void* probe = mmap(nullptr,
+                           pageSize,
+                           PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS,
+                           -1,
+                           0);
+        if (probe == MAP_FAILED) {
+            return false;
+        }
+
+        bool tracked = false;
+        {
+            MemoryDirtyTracker tracker;
+            tracker.mem = { (uint8_t*)probe, pageSize };
+            if (tracker.startRangeTracking()) {
+                tracked = scanWrittenPages(tracker.mem,
+                                           [](uint64_t, uint64_t) {});
+            }
+        }
+        munmap(probe, pageSize);
+
+        if (!tracked) {
+            SPDLOG_DEBUG("Per-range dirty tracking unsupported, sharing the "
+                         "process-wide tracker");
+        }
+
+        return tracked;
+    }();
+
+    return supported;
+}
+
+MemoryDirtyTracker::~MemoryDirtyTracker()
+{
+    stopTracking();
+}
+
+bool MemoryDirtyTracker::startTracking(std::span<uint8_t> memIn)
+{
+    stopTracking();
+    mem = memIn;
+
+    if (isPerRangeTrackingSupported() && startRangeTracking()) {
+        return true;
+    }
+
+    // Only one module can trust the shared tracker at a time
+    bool expected = false;
+    if (!sharedTrackerTaken.compare_exchange_strong(expected, true)) {
+        SPDLOG_TRACE("Dirty tracker in use elsewhere, not tracking {} bytes",
+                     mem.size());
+        return false;
+    }
+
+    usingShared = true;
+    faabric::util::getDirtyTracker()->startTracking(mem);
+
+    return true;
+}
+
+bool MemoryDirtyTracker::startRangeTracking()
+{
+    uffd = openUffd();
+    if (uffd < 0) {
+        return false;
+    }
+
+    uffdio_register reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.range = { .start = (uint64_t)mem.data(), .len = mem.size() };
+    reg.mode = UFFDIO_REGISTER_MODE_WP;
+    if (ioctl(uffd, UFFDIO_REGISTER, &reg) != 0) {
+        SPDLOG_DEBUG("Failed to register {} bytes for dirty tracking: {}",
+                     mem.size(),
+                     std::strerror(errno));
+        close(uffd);
+        uffd = -1;
+        return false;
+    }
+
+    writeProtectRange();
+
+    return true;
+}
+
+void MemoryDirtyTracker::writeProtectRange()
+{
+    uffdio_writeprotect wp;
+    std::memset(&wp, 0, sizeof(wp));
+    wp.range = { .start = (uint64_t)mem.data(), .len = mem.size() };
+    wp.mode = UFFDIO_WRITEPROTECT_MODE_WP;
+    if (ioctl(uffd, UFFDIO_WRITEPROTECT, &wp) != 0) {
+        SPDLOG_ERROR("Failed to write-protect {} bytes: {}",
+                     mem.size(),
+                     std::strerror(errno));
+        throw std::runtime_error("Failed to write-protect memory");
+    }
+}
+
+std::vector<char> MemoryDirtyTracker::getDirtyPages()
+{
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    size_t nPages = (mem.size() + pageSize - 1) / pageSize;
+
+    if (usingShared) {
+        return faabric::util::getDirtyTracker()->getDirtyPages(mem);
+    }
+
+    // Without tracking, everything has to be assumed dirty
+    std::vector<char> dirty(nPages, uffd < 0 ? 1 : 0);
+    if (uffd < 0) {
+        return dirty;
+    }
+
+    uint64_t base = (uint64_t)mem.data();
+    bool scanned =
+      scanWrittenPages(mem, [&dirty, base, pageSize](uint64_t s, uint64_t e) {
+          for (uint64_t p = s; p < e; p += pageSize) {
+              dirty.at((p - base) / pageSize) = 1;
+          }
+      });
+
+    if (!scanned) {
+        SPDLOG_ERROR("Failed to scan {} bytes for written pages: {}",
+                     mem.size(),
+                     std::strerror(errno));
+        std::fill(dirty.begin(), dirty.end(), 1);
+    }
+
+    return dirty;
+}
+
+void MemoryDirtyTracker::restartTracking()
+{
+    if (usingShared) {
+        std::shared_ptr<faabric::util::DirtyTracker> tracker =
+          faabric::util::getDirtyTracker();
+        tracker->stopTracking(mem);
+        tracker->startTracking(mem);
+    } else if (uffd >= 0) {
+        writeProtectRange();
+    }
+}
+
+void MemoryDirtyTracker::stopTracking()
+{
+    if (uffd >= 0) {
+        // Closing the userfaultfd unregisters the range and lifts any
+        // protection it left behind
+        close(uffd);
+        uffd = -1;
+    }
+
+    if (usingShared) {
+        faabric::util::getDirtyTracker()->stopTracking(mem);
+        usingShared = false;
+        sharedTrackerTaken.store(false);
+    }
+}
+}
@@ -0,0 +1,196 @@
+#include <conf/FaasmConfig.h>
+#include <storage/FileLoader.h>
+#include <wasm/WasmCommon.h>
+#include <wasm/function_profile.h>
+
+#include <faabric/util/func.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <cctype>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace wasm {
+
+static std::shared_mutex profilesMx;
+static std::unordered_map<std::string, FunctionProfile> profiles;
+
+static bool parsePositiveInt(const std::string& value, uint64_t max, int& out)
+{
+    if (value.empty() ||
+        !std::all_of(value.begin(), value.end(), [](unsigned char c) {
+            return std::isdigit(c);
+        })) {
+        return false;
+    }
+
+    try {
+        uint64_t parsed = std::stoull(value);
+        if (parsed == 0 || parsed > max) {
+            return false;
+        }
+
+        out = (int)parsed;
+    } catch (std::out_of_range& e) {
+        return false;
+    }
+
+    return true;
+}
+
+std::string validateProfileHint(const std::string& key,
+                                const std::string& value)
+{
+    int parsed = 0;
+    if (key == PROFILE_MAX_MEMORY_PAGES) {
+        if (!parsePositiveInt(value, MAX_WASM_MEMORY_PAGES, parsed)) {
+            return fmt::format("{} must be between 1 and {}",
+                               key,
+                               MAX_WASM_MEMORY_PAGES);
+        }
+    } else if (key == PROFILE_WASM_VM) {
+        if (value != "wavm" && value != "wamr") {
+            return fmt::format("{} must be wavm or wamr", key);
+        }
+    } else if (key == PROFILE_WAMR_STACK_SIZE) {
+        if (!parsePositiveInt(value, INT32_MAX, parsed)) {
+            return fmt::format("{} must be a positive number of bytes", key);
+        }
+    } else if (key == PROFILE_CGROUP_GRANULARITY) {
+        if (value != "host" && value != "user" && value != "function") {
+            return fmt::format("{} must be host, user or function", key);
+        }
+    } else if (key == PROFILE_PREWARM_FAASLETS) {
+        if (!parsePositiveInt(value, 1024, parsed)) {
+            return fmt::format("{} must be between 1 and 1024", key);
+        }
+    } else {
+        return fmt::format("Unrecognised profile setting {}", key);
+    }
+
+    return "";
+}
+
+std::map<std::string, std::string> parseProfileHints(
+  const std::string& contents)
+{
+    std::map<std::string, std::string> hints;
+
+    std::istringstream in(contents);
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+
+        size_t end = line.find_last_not_of(" \t\r");
+        line = line.substr(start, end - start + 1);
+
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            throw std::runtime_error("Expected key=value, got " + line);
+        }
+
+        std::string key = line.substr(0, equals);
+        std::string value = line.substr(equals + 1);
+        std::string error = validateProfileHint(key, value);
+        if (!error.empty()) {
+            throw std::runtime_error(error);
+        }
+
+        hints[key] = value;
+    }
+
+    return hints;
+}
+
+FunctionProfile parseFunctionProfile(const storage::FunctionMetadata& metadata)
+{
+    FunctionProfile profile;
+
+    auto getValidHint = [&metadata](const std::string& key) -> std::string {
+        std::string value = metadata.getHint(key);
+        if (value.empty()) {
+            return "";
+        }
+
+        std::string error = validateProfileHint(key, value);
+        if (!error.empty()) {
+            SPDLOG_WARN("Ignoring invalid profile hint: {}", error);
+            return "";
+        }
+
+        return value;
+    };
+
+    std::string value = getValidHint(PROFILE_MAX_MEMORY_PAGES);
+    if (!value.empty()) {
+        profile.maxMemoryPages = std::stoul(value);
+    }
+
+    profile.wasmVm = getValidHint(PROFILE_WASM_VM);
+
+    value = getValidHint(PROFILE_WAMR_STACK_SIZE);
+    if (!value.empty()) {
+        profile.wamrStackSize = std::stoul(value);
+    }
+
+    profile.cgroupGranularity = getValidHint(PROFILE_CGROUP_GRANULARITY);
+
+    value = getValidHint(PROFILE_PREWARM_FAASLETS);
+    if (!value.empty()) {
+        profile.prewarmFaaslets = std::stoi(value);
+    }
+
+    return profile;
+}
+
+FunctionProfile getFunctionProfile(const faabric::Message& msg)
+{
+    std::string funcStr = faabric::util::funcToString(msg, false);
+    {
+        std::shared_lock<std::shared_mutex> lock(profilesMx);
+        auto it = profiles.find(funcStr);
+        if (it != profiles.end()) {
+            return it->second;
+        }
+    }
+
+    // Functions without metadata just get the host's settings
+    storage::FileLoader& loader = storage::getFileLoader();
+    FunctionProfile profile =
+      parseFunctionProfile(loader.loadFunctionMetadata(msg));
+
+    faabric::util::FullLock lock(profilesMx);
+    profiles[funcStr] = profile;
+
+    return profile;
+}
+
+std::string getFunctionWasmVm(const faabric::Message& msg)
+{
+    // Functions can't opt out of running in an enclave
+    const std::string& hostWasmVm = conf::getFaasmConfig().wasmVm;
+    if (hostWasmVm == "sgx") {
+        return hostWasmVm;
+    }
+
+    std::string wasmVm = getFunctionProfile(msg).wasmVm;
+    if (wasmVm.empty()) {
+        return hostWasmVm;
+    }
+
+    return wasmVm;
+}
+
+void clearFunctionProfiles()
+{
+    faabric::util::FullLock lock(profilesMx);
+    profiles.clear();
+}
+}
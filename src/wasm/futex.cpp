@@ -0,0 +1,220 @@
+#include <wasm/deadline.h>
+#include <wasm/futex.h>
+
+#include <faabric/util/logging.h>
+
+#include <atomic>
+#include <cerrno>
+#include <stdexcept>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace wasm {
+
+static int64_t clampToRemainingTime(int64_t timeoutMs)
+{
+    int64_t remainingMs = getRemainingTimeMs();
+    if (remainingMs < 0) {
+        return timeoutMs;
+    }
+
+    if (timeoutMs < 0 || remainingMs < timeoutMs) {
+        return remainingMs;
+    }
+
+    return timeoutMs;
+}
+
+static long waitOnWord(int32_t* addr, int32_t expected, timespec* timeout)
+{
+    return ::syscall(
+      SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, timeout, nullptr, 0);
+}
+
+static int32_t* wordOf(std::atomic<int32_t>& atomic)
+{
+    static_assert(sizeof(std::atomic<int32_t>) == sizeof(int32_t));
+    return reinterpret_cast<int32_t*>(&atomic);
+}
+
+int futexWait(int32_t* addr, int32_t expected, int64_t timeoutMs)
+{
+    if (reinterpret_cast<uintptr_t>(addr) % alignof(int32_t) != 0) {
+        SPDLOG_ERROR("Unaligned futex address {}", (void*)addr);
+        return -EINVAL;
+    }
+
+    timeoutMs = clampToRemainingTime(timeoutMs);
+
+    timespec timeout;
+    timespec* timeoutPtr = nullptr;
+    if (timeoutMs >= 0) {
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = (timeoutMs % 1000) * 1000000;
+        timeoutPtr = &timeout;
+    }
+
+    long res = waitOnWord(addr, expected, timeoutPtr);
+    if (res < 0) {
+        return -errno;
+    }
+
+    return 0;
+}
+
+int futexWake(int32_t* addr, int32_t maxWaiters)
+{
+    long res = ::syscall(
+      SYS_futex, addr, FUTEX_WAKE_PRIVATE, maxWaiters, nullptr, nullptr, 0);
+    if (res < 0) {
+        return -errno;
+    }
+
+    return (int)res;
+}
+
+// -----
+// Mutexes
+// -----
+
+void FutexMutex::lock()
+{
+    int32_t c = 0;
+    if (state.compare_exchange_strong(c, 1, std::memory_order_acquire)) {
+        return;
+    }
+
+    // Mark the lock as contended before waiting, so the holder wakes us
+    if (c != 2) {
+        c = state.exchange(2, std::memory_order_acquire);
+    }
+
+    while (c != 0) {
+        waitOnWord(wordOf(state), 2, nullptr);
+        c = state.exchange(2, std::memory_order_acquire);
+    }
+}
+
+bool FutexMutex::try_lock()
+{
+    int32_t c = 0;
+    return state.compare_exchange_strong(c, 1, std::memory_order_acquire);
+}
+
+void FutexMutex::unlock()
+{
+    if (state.fetch_sub(1, std::memory_order_release) != 1) {
+        state.store(0, std::memory_order_release);
+        futexWake(wordOf(state), 1);
+    }
+}
+
+FutexMutexSlab::FutexMutexSlab(size_t capacityIn)
+  : capacity(capacityIn)
+{}
+
+FutexMutexSlab::Slot* FutexMutexSlab::findSlot(uint32_t mxPtr,
+                                               int32_t* slotWord)
+{
+    Slot* all = slots.load(std::memory_order_acquire);
+    int32_t idx = std::atomic_ref<int32_t>(*slotWord).load() - 1;
+    if (all == nullptr || idx < 0 || (size_t)idx >= capacity) {
+        return nullptr;
+    }
+
+    Slot* slot = &all[idx];
+    if (slot->owner.load(std::memory_order_acquire) != mxPtr) {
+        return nullptr;
+    }
+
+    return slot;
+}
+
+FutexMutex& FutexMutexSlab::get(uint32_t mxPtr, int32_t* slotWord)
+{
+    Slot* slot = findSlot(mxPtr, slotWord);
+    if (slot != nullptr) {
+        return slot->mx;
+    }
+
+    std::unique_lock<std::mutex> lock(allocMx);
+
+    // Another thread may have got in first
+    slot = findSlot(mxPtr, slotWord);
+    if (slot != nullptr) {
+        return slot->mx;
+    }
+
+    if (slotsMemory == nullptr) {
+        slotsMemory = std::make_unique<Slot[]>(capacity);
+        slots.store(slotsMemory.get(), std::memory_order_release);
+    }
+
+    int32_t idx;
+    if (!freeSlots.empty()) {
+        idx = freeSlots.back();
+        freeSlots.pop_back();
+    } else if (nextSlot < capacity) {
+        idx = (int32_t)nextSlot++;
+    } else {
+        SPDLOG_ERROR("All {} pthread mutexes in use", capacity);
+        throw std::runtime_error("Out of pthread mutexes");
+    }
+
+    slot = &slotsMemory[idx];
+    slot->owner.store(mxPtr, std::memory_order_release);
+    std::atomic_ref<int32_t>(*slotWord).store(idx + 1);
+
+    return slot->mx;
+}
+
+void FutexMutexSlab::release(uint32_t mxPtr, int32_t* slotWord)
+{
+    std::unique_lock<std::mutex> lock(allocMx);
+
+    Slot* slot = findSlot(mxPtr, slotWord);
+    if (slot == nullptr) {
+        return;
+    }
+
+    slot->owner.store(0, std::memory_order_release);
+    freeSlots.push_back((int32_t)(slot - slotsMemory.get()));
+    std::atomic_ref<int32_t>(*slotWord).store(0);
+}
+
+size_t FutexMutexSlab::getUsedCount()
+{
+    std::unique_lock<std::mutex> lock(allocMx);
+    return nextSlot - freeSlots.size();
+}
+
+// -----
+// Condition variables
+// -----
+
+int futexCondWait(int32_t* seq, FutexMutex& mx, int64_t timeoutMs)
+{
+    // Reading the sequence before releasing the mutex means a signal sent
+    // after that changes it, so the wait won't miss it
+    int32_t expected = std::atomic_ref<int32_t>(*seq).load();
+
+    mx.unlock();
+    int res = futexWait(seq, expected, timeoutMs);
+    mx.lock();
+
+    // Wakes and changed sequences look the same to the caller
+    if (res == -EAGAIN || res == -EINTR) {
+        return 0;
+    }
+
+    return res;
+}
+
+void futexCondWake(int32_t* seq, int32_t maxWaiters)
+{
+    std::atomic_ref<int32_t>(*seq).fetch_add(1);
+    futexWake(seq, maxWaiters);
+}
+}
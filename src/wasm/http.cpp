@@ -0,0 +1,572 @@
+#include <wasm/http.h>
+#include <wasm/network.h>
+
+#include <conf/FaasmConfig.h>
+#include <system/NetworkNamespace.h>
+
+#include <faabric/scheduler/ExecutorContext.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define HTTP_READ_CHUNK_BYTES 16384
+
+namespace wasm {
+
+HttpUrl parseHttpUrl(const std::string& url)
+{
+    const std::string scheme = "http://";
+    if (url.rfind(scheme, 0) != 0) {
+        SPDLOG_ERROR("Unsupported URL {}, only http:// is supported", url);
+        throw std::runtime_error("Unsupported URL");
+    }
+
+    HttpUrl result;
+    std::string rest = url.substr(scheme.size());
+    size_t slash = rest.find('/');
+    std::string hostPort = rest.substr(0, slash);
+    if (slash != std::string::npos) {
+        result.path = rest.substr(slash);
+    }
+
+    size_t colon = hostPort.rfind(':');
+    result.host = hostPort.substr(0, colon);
+    if (colon != std::string::npos) {
+        result.port = std::stoi(hostPort.substr(colon + 1));
+    }
+
+    if (result.host.empty()) {
+        SPDLOG_ERROR("No host in URL {}", url);
+        throw std::runtime_error("No host in URL");
+    }
+
+    return result;
+}
+
+std::string getHttpPoolKey(const std::string& user, const HttpUrl& url)
+{
+    return fmt::format("{}/{}/{}:{}",
+                       isolation::getCurrentThreadNetworkNamespace(),
+                       user,
+                       url.host,
+                       url.port);
+}
+
+// ------------------------------------------------------
+// Pool
+// ------------------------------------------------------
+
+// An idle connection with anything to read has either been closed by the
+// server or has stray data on it, and can't be reused either way
+static bool isIdleConnectionOpen(int fd)
+{
+    pollfd pollFd = { fd, POLLIN, 0 };
+    return ::poll(&pollFd, 1, 0) == 0;
+}
+
+HttpConnectionPool::~HttpConnectionPool()
+{
+    clear();
+}
+
+int HttpConnectionPool::claim(const std::string& key)
+{
+    auto idleTimeout = std::chrono::milliseconds(
+      conf::getFaasmConfig().httpIdleTimeoutMs);
+    auto now = std::chrono::steady_clock::now();
+
+    faabric::util::UniqueLock lock(mx);
+    auto it = idle.find(key);
+    if (it == idle.end()) {
+        return -1;
+    }
+
+    // Most recently used first, as it's the least likely to have timed out
+    std::vector<IdleConnection>& conns = it->second;
+    while (!conns.empty()) {
+        IdleConnection conn = conns.back();
+        conns.pop_back();
+
+        if (now - conn.idleSince < idleTimeout &&
+            isIdleConnectionOpen(conn.fd)) {
+            return conn.fd;
+        }
+
+        ::close(conn.fd);
+    }
+
+    return -1;
+}
+
+void HttpConnectionPool::release(const std::string& key, int fd)
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    auto idleTimeout = std::chrono::milliseconds(conf.httpIdleTimeoutMs);
+    auto now = std::chrono::steady_clock::now();
+
+    faabric::util::UniqueLock lock(mx);
+    std::vector<IdleConnection>& conns = idle[key];
+
+    // The oldest are at the front, so expired connections can be dropped
+    // from there
+    auto firstLive = std::find_if(
+      conns.begin(), conns.end(), [&now, &idleTimeout](IdleConnection& c) {
+          return now - c.idleSince < idleTimeout;
+      });
+    for (auto c = conns.begin(); c != firstLive; c++) {
+        ::close(c->fd);
+    }
+    conns.erase(conns.begin(), firstLive);
+
+    if ((int)conns.size() >= conf.httpMaxIdleConnections) {
+        ::close(fd);
+        return;
+    }
+
+    conns.push_back({ fd, now });
+}
+
+size_t HttpConnectionPool::getIdleCount(const std::string& key)
+{
+    faabric::util::UniqueLock lock(mx);
+    auto it = idle.find(key);
+    if (it == idle.end()) {
+        return 0;
+    }
+
+    return it->second.size();
+}
+
+void HttpConnectionPool::clear()
+{
+    faabric::util::UniqueLock lock(mx);
+    for (auto& [key, conns] : idle) {
+        for (auto& conn : conns) {
+            ::close(conn.fd);
+        }
+    }
+    idle.clear();
+}
+
+HttpConnectionPool& getHttpConnectionPool()
+{
+    static HttpConnectionPool pool;
+    return pool;
+}
+
+// ------------------------------------------------------
+// Requests
+// ------------------------------------------------------
+
+static void throwHttpError(const std::string& message, int errnoIn = 0)
+{
+    if (errnoIn != 0) {
+        SPDLOG_ERROR("{}: {}", message, strerror(errnoIn));
+    } else {
+        SPDLOG_ERROR("{}", message);
+    }
+
+    throw std::runtime_error(message);
+}
+
+// Sockets are non-blocking, so waits can be bounded by the deadline
+static void waitForFd(int fd, short events)
+{
+    pollfd pollFd = { fd, events, 0 };
+    int res;
+    do {
+        res = pollWithinDeadline(&pollFd, 1, -1);
+    } while (res == -EINTR);
+
+    if (res == 0) {
+        throwHttpError("HTTP request reached the execution deadline");
+    }
+
+    if (res < 0) {
+        throwHttpError("Failed waiting on HTTP connection", -res);
+    }
+}
+
+static int openConnection(const HttpUrl& url)
+{
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* addrs = nullptr;
+    std::string port = std::to_string(url.port);
+    int res = ::getaddrinfo(url.host.c_str(), port.c_str(), &hints, &addrs);
+    if (res != 0) {
+        throwHttpError(fmt::format(
+          "Failed to resolve {}: {}", url.host, ::gai_strerror(res)));
+    }
+
+    int fd = -1;
+    int lastErrno = 0;
+    for (addrinfo* addr = addrs; addr != nullptr; addr = addr->ai_next) {
+        fd = ::socket(addr->ai_family,
+                      addr->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                      addr->ai_protocol);
+        if (fd < 0) {
+            lastErrno = errno;
+            continue;
+        }
+
+        if (::connect(fd, addr->ai_addr, addr->ai_addrlen) == 0) {
+            break;
+        }
+
+        if (errno == EINPROGRESS) {
+            pollfd pollFd = { fd, POLLOUT, 0 };
+            int pollRes = pollWithinDeadline(&pollFd, 1, -1);
+            if (pollRes > 0) {
+                socklen_t errLen = sizeof(lastErrno);
+                ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &lastErrno, &errLen);
+                if (lastErrno == 0) {
+                    break;
+                }
+            } else {
+                lastErrno = pollRes == 0 ? ETIMEDOUT : -pollRes;
+            }
+        } else {
+            lastErrno = errno;
+        }
+
+        ::close(fd);
+        fd = -1;
+    }
+    ::freeaddrinfo(addrs);
+
+    if (fd < 0) {
+        throwHttpError(
+          fmt::format("Failed to connect to {}:{}", url.host, port), lastErrno);
+    }
+
+    // Requests are written in one go, so there's nothing to gain from Nagle
+    int noDelay = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    return fd;
+}
+
+static bool endsWithCrlf(const std::string& s)
+{
+    return s.size() >= 2 && s.compare(s.size() - 2, 2, "\r\n") == 0;
+}
+
+static std::string buildRequest(const std::string& method,
+                                const HttpUrl& url,
+                                const std::string& headers,
+                                const std::vector<uint8_t>& body)
+{
+    std::string request = fmt::format("{} {} HTTP/1.1\r\n", method, url.path);
+    request += fmt::format("Host: {}:{}\r\n", url.host, url.port);
+    request += "Connection: keep-alive\r\n";
+
+    if (!body.empty() || method == "POST" || method == "PUT") {
+        request += fmt::format("Content-Length: {}\r\n", body.size());
+    }
+
+    request += headers;
+    if (!headers.empty() && !endsWithCrlf(headers)) {
+        request += "\r\n";
+    }
+
+    request += "\r\n";
+    request.append(body.begin(), body.end());
+
+    return request;
+}
+
+// Returns false if the connection has been closed by the other end
+static bool sendAll(int fd, const std::string& data)
+{
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n =
+          ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n >= 0) {
+            sent += n;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            waitForFd(fd, POLLOUT);
+        } else if (errno == EPIPE || errno == ECONNRESET) {
+            return false;
+        } else if (errno != EINTR) {
+            throwHttpError("Failed sending HTTP request", errno);
+        }
+    }
+
+    return true;
+}
+
+// Reads whatever is available into the buffer, returning false once the
+// connection has been closed
+static bool readMore(int fd, std::string& buffer)
+{
+    char chunk[HTTP_READ_CHUNK_BYTES];
+    while (true) {
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n > 0) {
+            buffer.append(chunk, n);
+            return true;
+        }
+
+        if (n == 0 || errno == ECONNRESET) {
+            return false;
+        }
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            waitForFd(fd, POLLIN);
+        } else if (errno != EINTR) {
+            throwHttpError("Failed reading HTTP response", errno);
+        }
+    }
+}
+
+static void readAtLeast(int fd, std::string& buffer, size_t nBytes)
+{
+    while (buffer.size() < nBytes) {
+        if (!readMore(fd, buffer)) {
+            throwHttpError("HTTP connection closed mid-response");
+        }
+    }
+}
+
+// Returns the position of the end of the line starting at pos
+static size_t readLine(int fd, std::string& buffer, size_t pos)
+{
+    size_t lineEnd;
+    while ((lineEnd = buffer.find("\r\n", pos)) == std::string::npos) {
+        if (!readMore(fd, buffer)) {
+            throwHttpError("HTTP connection closed mid-response");
+        }
+    }
+
+    return lineEnd;
+}
+
+static std::string toLower(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+/**
+ * Reads a response with a Content-Length, chunked or read-until-close body.
+ * Returns false if the connection was closed before any of the response
+ * arrived, which is what happens when the server has dropped an idle
+ * connection.
+ */
+static bool readResponse(int fd,
+                         const std::string& method,
+                         HttpResponse& response,
+                         bool& keepAlive)
+{
+    std::string buffer;
+    size_t headerEnd;
+    while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+        if (!readMore(fd, buffer)) {
+            if (buffer.empty()) {
+                return false;
+            }
+            throwHttpError("HTTP connection closed mid-response");
+        }
+    }
+
+    // Status line, e.g. HTTP/1.1 200 OK
+    size_t lineEnd = buffer.find("\r\n");
+    std::string statusLine = buffer.substr(0, lineEnd);
+    int minorVersion = 0;
+    if (sscanf(statusLine.c_str(),
+               "HTTP/1.%d %d",
+               &minorVersion,
+               &response.status) != 2) {
+        throwHttpError("Invalid HTTP status line: " + statusLine);
+    }
+
+    keepAlive = minorVersion >= 1;
+    long contentLength = -1;
+    bool chunked = false;
+
+    size_t pos = lineEnd + 2;
+    while (pos < headerEnd) {
+        lineEnd = buffer.find("\r\n", pos);
+        std::string line = buffer.substr(pos, lineEnd - pos);
+        pos = lineEnd + 2;
+
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+
+        std::string name = toLower(line.substr(0, colon));
+        std::string value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(' '));
+
+        if (name == "content-length") {
+            contentLength = std::stol(value);
+        } else if (name == "transfer-encoding") {
+            chunked = toLower(value).find("chunked") != std::string::npos;
+        } else if (name == "connection") {
+            std::string connection = toLower(value);
+            if (connection == "close") {
+                keepAlive = false;
+            } else if (connection == "keep-alive") {
+                keepAlive = true;
+            }
+        }
+    }
+
+    pos = headerEnd + 4;
+    bool noBody = method == "HEAD" || response.status == 204 ||
+                  response.status == 304 || response.status / 100 == 1;
+
+    if (noBody) {
+        return true;
+    }
+
+    if (chunked) {
+        while (true) {
+            lineEnd = readLine(fd, buffer, pos);
+            size_t chunkSize =
+              std::stoul(buffer.substr(pos, lineEnd - pos), nullptr, 16);
+            pos = lineEnd + 2;
+
+            if (chunkSize == 0) {
+                // Skip any trailers up to the final empty line
+                while ((lineEnd = readLine(fd, buffer, pos)) != pos) {
+                    pos = lineEnd + 2;
+                }
+                break;
+            }
+
+            readAtLeast(fd, buffer, pos + chunkSize + 2);
+            response.body.insert(response.body.end(),
+                                 buffer.begin() + pos,
+                                 buffer.begin() + pos + chunkSize);
+            pos += chunkSize + 2;
+        }
+    } else if (contentLength >= 0) {
+        readAtLeast(fd, buffer, pos + contentLength);
+        response.body.assign(buffer.begin() + pos,
+                             buffer.begin() + pos + contentLength);
+    } else {
+        // No length means the body runs until the server closes
+        while (readMore(fd, buffer)) {
+        }
+        response.body.assign(buffer.begin() + pos, buffer.end());
+        keepAlive = false;
+    }
+
+    return true;
+}
+
+static bool sendAndReceive(int fd,
+                           const std::string& method,
+                           const std::string& request,
+                           HttpResponse& response,
+                           bool& keepAlive)
+{
+    try {
+        if (!sendAll(fd, request)) {
+            return false;
+        }
+
+        return readResponse(fd, method, response, keepAlive);
+    } catch (std::runtime_error&) {
+        ::close(fd);
+        throw;
+    }
+}
+
+HttpResponse doHttpRequest(const std::string& method,
+                           const std::string& url,
+                           const std::string& headers,
+                           const std::vector<uint8_t>& body)
+{
+    HttpUrl parsedUrl = parseHttpUrl(url);
+
+    std::string user;
+    if (faabric::scheduler::ExecutorContext::isSet()) {
+        user = faabric::scheduler::ExecutorContext::get()->getMsg().user();
+    }
+
+    std::string key = getHttpPoolKey(user, parsedUrl);
+    std::string request = buildRequest(method, parsedUrl, headers, body);
+
+    HttpConnectionPool& pool = getHttpConnectionPool();
+    HttpResponse response;
+    bool keepAlive = false;
+
+    // A pooled connection can still be closed by the server just as it's
+    // reused. As the request won't have been handled then, it's retried on a
+    // new connection.
+    int fd = pool.claim(key);
+    if (fd >= 0) {
+        SPDLOG_TRACE("Reusing HTTP connection {} to {}", fd, key);
+        if (!sendAndReceive(fd, method, request, response, keepAlive)) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    if (fd < 0) {
+        fd = openConnection(parsedUrl);
+        SPDLOG_TRACE("Opened HTTP connection {} to {}", fd, key);
+        if (!sendAndReceive(fd, method, request, response, keepAlive)) {
+            ::close(fd);
+            throwHttpError("HTTP connection closed before responding");
+        }
+    }
+
+    if (keepAlive) {
+        pool.release(key, fd);
+    } else {
+        ::close(fd);
+    }
+
+    return response;
+}
+
+int32_t doHostHttpRequest(const std::string& method,
+                          const std::string& url,
+                          const std::string& headers,
+                          const uint8_t* body,
+                          size_t bodyLen,
+                          uint8_t* responseBuffer,
+                          size_t responseBufferLen,
+                          int32_t* status)
+{
+    SPDLOG_DEBUG("S - http_request - {} {}", method, url);
+
+    // Failed requests are for the function to handle, so aren't fatal
+    HttpResponse response;
+    try {
+        response = doHttpRequest(
+          method, url, headers, std::vector<uint8_t>(body, body + bodyLen));
+    } catch (std::runtime_error&) {
+        *status = 0;
+        return -1;
+    }
+
+    *status = response.status;
+
+    size_t copyLen = std::min(response.body.size(), responseBufferLen);
+    std::copy(response.body.begin(),
+              response.body.begin() + copyLen,
+              responseBuffer);
+
+    return (int32_t)response.body.size();
+}
+}
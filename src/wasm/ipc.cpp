@@ -0,0 +1,328 @@
+#include <conf/FaasmConfig.h>
+#include <wasm/WasmExecutionContext.h>
+#include <wasm/deadline.h>
+#include <wasm/ipc.h>
+
+#include <faabric/util/clock.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <unordered_map>
+
+namespace wasm {
+
+IpcChannel::IpcChannel(size_t capacityIn)
+  : ring(capacityIn)
+{
+    if (capacityIn == 0) {
+        throw std::runtime_error("IPC channel must have some capacity");
+    }
+}
+
+size_t IpcChannel::write(const uint8_t* data, size_t len, int64_t deadlineMs)
+{
+    std::unique_lock<std::mutex> lock(mx);
+
+    size_t written = 0;
+    while (written < len) {
+        // Nothing is buffered ahead of this, so it can skip the ring
+        if (canHandOff()) {
+            size_t n = std::min(len - written, pendingRead->len);
+            std::memcpy(pendingRead->buffer, data + written, n);
+            pendingRead->filled = n;
+            written += n;
+            cv.notify_all();
+            continue;
+        }
+
+        size_t space = ring.size() - used;
+        if (space == 0) {
+            if (!waitUntil(lock, deadlineMs)) {
+                break;
+            }
+            continue;
+        }
+
+        size_t n = std::min(len - written, space);
+        copyIn(data + written, n);
+        written += n;
+        cv.notify_all();
+    }
+
+    return written;
+}
+
+int64_t IpcChannel::read(uint8_t* buffer, size_t len, int64_t deadlineMs)
+{
+    if (len == 0) {
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> lock(mx);
+    while (used == 0) {
+        if (isFinished()) {
+            return 0;
+        }
+
+        // Only one reader at a time can have writes handed to it, any others
+        // wait for the ring
+        if (pendingRead != nullptr) {
+            if (!waitUntil(lock, deadlineMs)) {
+                return -1;
+            }
+            continue;
+        }
+
+        PendingRead pending{ buffer, len, deadlineMs };
+        pendingRead = &pending;
+
+        bool inTime = true;
+        while (inTime && pending.filled == 0 && used == 0 && !isFinished()) {
+            inTime = waitUntil(lock, deadlineMs);
+        }
+
+        pendingRead = nullptr;
+        cv.notify_all();
+
+        if (pending.filled > 0) {
+            return (int64_t)pending.filled;
+        }
+
+        if (!inTime) {
+            return -1;
+        }
+    }
+
+    size_t n = std::min(len, used);
+    copyOut(buffer, n);
+    cv.notify_all();
+
+    return (int64_t)n;
+}
+
+void IpcChannel::addWriter()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    writers++;
+    hadWriters = true;
+}
+
+void IpcChannel::removeWriter()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    writers--;
+
+    // Readers may be waiting for the end of the stream
+    cv.notify_all();
+}
+
+size_t IpcChannel::getCapacity()
+{
+    return ring.size();
+}
+
+size_t IpcChannel::getBufferedBytes()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    return used;
+}
+
+bool IpcChannel::isFinished()
+{
+    return hadWriters && writers == 0 && used == 0;
+}
+
+bool IpcChannel::canHandOff()
+{
+    if (pendingRead == nullptr || pendingRead->filled > 0 || used > 0) {
+        return false;
+    }
+
+    if (pendingRead->deadlineMs < 0) {
+        return true;
+    }
+
+    int64_t nowMs = faabric::util::getGlobalClock().epochMillis();
+    return nowMs + IPC_HANDOFF_DEADLINE_MARGIN_MS < pendingRead->deadlineMs;
+}
+
+bool IpcChannel::waitUntil(std::unique_lock<std::mutex>& lock,
+                           int64_t deadlineMs)
+{
+    if (deadlineMs < 0) {
+        cv.wait(lock);
+        return true;
+    }
+
+    int64_t nowMs = faabric::util::getGlobalClock().epochMillis();
+    if (nowMs >= deadlineMs) {
+        return false;
+    }
+
+    cv.wait_for(lock, std::chrono::milliseconds(deadlineMs - nowMs));
+    return true;
+}
+
+void IpcChannel::copyIn(const uint8_t* data, size_t len)
+{
+    size_t tail = (head + used) % ring.size();
+    size_t first = std::min(len, ring.size() - tail);
+
+    std::memcpy(ring.data() + tail, data, first);
+    std::memcpy(ring.data(), data + first, len - first);
+    used += len;
+}
+
+void IpcChannel::copyOut(uint8_t* buffer, size_t len)
+{
+    size_t first = std::min(len, ring.size() - head);
+
+    std::memcpy(buffer, ring.data() + head, first);
+    std::memcpy(buffer + first, ring.data(), len - first);
+    head = (head + len) % ring.size();
+    used -= len;
+}
+
+// -----
+// Registry
+// -----
+
+struct OpenIpcChannel
+{
+    std::shared_ptr<IpcChannel> channel;
+    int openEnds = 0;
+};
+
+static std::mutex channelsMx;
+static std::unordered_map<std::string, OpenIpcChannel> openChannels;
+
+static std::string getChannelKey(const std::string& user,
+                                 const std::string& name)
+{
+    return user + "/" + name;
+}
+
+IpcChannelEnd openIpcChannel(const std::string& user,
+                             const std::string& name,
+                             bool write)
+{
+    if (name.empty()) {
+        SPDLOG_ERROR("IPC channel for {} has no name", user);
+        throw std::runtime_error("IPC channel has no name");
+    }
+
+    std::shared_ptr<IpcChannel> channel;
+    {
+        faabric::util::UniqueLock lock(channelsMx);
+        OpenIpcChannel& open = openChannels[getChannelKey(user, name)];
+        if (open.channel == nullptr) {
+            size_t capacity = conf::getFaasmConfig().ipcChannelSize;
+            open.channel = std::make_shared<IpcChannel>(capacity);
+        }
+
+        open.openEnds++;
+        channel = open.channel;
+    }
+
+    if (write) {
+        channel->addWriter();
+    }
+
+    return { user, name, write, channel };
+}
+
+void closeIpcChannel(IpcChannelEnd& end)
+{
+    if (end.channel == nullptr) {
+        return;
+    }
+
+    if (end.write) {
+        end.channel->removeWriter();
+    }
+
+    {
+        faabric::util::UniqueLock lock(channelsMx);
+        auto it = openChannels.find(getChannelKey(end.user, end.name));
+        if (it != openChannels.end() && --it->second.openEnds == 0) {
+            openChannels.erase(it);
+        }
+    }
+
+    end.channel = nullptr;
+}
+
+size_t getOpenIpcChannelCount()
+{
+    faabric::util::UniqueLock lock(channelsMx);
+    return openChannels.size();
+}
+
+// -----
+// Host interface
+// -----
+
+int32_t doHostChannelOpen(const std::string& name, int32_t write)
+{
+    try {
+        return getExecutingModule()->openChannel(name, write != 0);
+    } catch (std::runtime_error& e) {
+        SPDLOG_ERROR("Failed to open IPC channel {}: {}", name, e.what());
+        return -1;
+    }
+}
+
+int32_t doHostChannelWrite(int32_t handle, const uint8_t* data, int32_t len)
+{
+    if (len < 0) {
+        return -1;
+    }
+
+    try {
+        IpcChannelEnd end = getExecutingModule()->getChannelForHandle(handle);
+        if (!end.write) {
+            SPDLOG_ERROR("IPC channel {} not opened for writing", end.name);
+            return -1;
+        }
+
+        return (int32_t)end.channel->write(data, len, getCurrentDeadlineMs());
+    } catch (std::runtime_error& e) {
+        SPDLOG_ERROR("Failed to write to IPC channel: {}", e.what());
+        return -1;
+    }
+}
+
+int32_t doHostChannelRead(int32_t handle, uint8_t* buffer, int32_t len)
+{
+    if (len < 0) {
+        return -1;
+    }
+
+    try {
+        IpcChannelEnd end = getExecutingModule()->getChannelForHandle(handle);
+        if (end.write) {
+            SPDLOG_ERROR("IPC channel {} not opened for reading", end.name);
+            return -1;
+        }
+
+        return (int32_t)end.channel->read(buffer, len, getCurrentDeadlineMs());
+    } catch (std::runtime_error& e) {
+        SPDLOG_ERROR("Failed to read from IPC channel: {}", e.what());
+        return -1;
+    }
+}
+
+int32_t doHostChannelClose(int32_t handle)
+{
+    try {
+        getExecutingModule()->closeChannel(handle);
+        return 0;
+    } catch (std::runtime_error& e) {
+        SPDLOG_ERROR("Failed to close IPC channel: {}", e.what());
+        return -1;
+    }
+}
+}
@@ -0,0 +1,186 @@
+#include <wasm/memdiff.h>
+
+#include <faabric/util/logging.h>
+
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define BLOCK_SIZE MEMORY_DIFF_BLOCK_SIZE
+
+namespace wasm {
+
+// Returns the index of the first block from start that is (or isn't) equal in
+// both regions, or nBlocks if there is none
+using FindBlockFunc = size_t (*)(const uint8_t* a,
+                                 const uint8_t* b,
+                                 size_t start,
+                                 size_t nBlocks,
+                                 bool equal);
+
+using IsZeroFunc = bool (*)(const uint8_t* data, size_t nBlocks);
+
+static size_t findBlockScalar(const uint8_t* a,
+                              const uint8_t* b,
+                              size_t start,
+                              size_t nBlocks,
+                              bool equal)
+{
+    for (size_t i = start; i < nBlocks; i++) {
+        size_t offset = i * BLOCK_SIZE;
+        bool blockEqual = std::memcmp(a + offset, b + offset, BLOCK_SIZE) == 0;
+        if (blockEqual == equal) {
+            return i;
+        }
+    }
+
+    return nBlocks;
+}
+
+static bool isZeroScalar(const uint8_t* data, size_t nBlocks)
+{
+    static const uint8_t zeroes[BLOCK_SIZE] = { 0 };
+    for (size_t i = 0; i < nBlocks; i++) {
+        if (std::memcmp(data + i * BLOCK_SIZE, zeroes, BLOCK_SIZE) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2"))) static size_t
+findBlockAvx2(const uint8_t* a,
+              const uint8_t* b,
+              size_t start,
+              size_t nBlocks,
+              bool equal)
+{
+    for (size_t i = start; i < nBlocks; i++) {
+        size_t offset = i * BLOCK_SIZE;
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + offset));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + offset));
+        __m256i x = _mm256_xor_si256(va, vb);
+        bool blockEqual = _mm256_testz_si256(x, x) != 0;
+        if (blockEqual == equal) {
+            return i;
+        }
+    }
+
+    return nBlocks;
+}
+
+__attribute__((target("avx2"))) static bool
+isZeroAvx2(const uint8_t* data, size_t nBlocks)
+{
+    for (size_t i = 0; i < nBlocks; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i * BLOCK_SIZE));
+        if (_mm256_testz_si256(v, v) == 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+#endif
+
+static bool hostHasAvx2()
+{
+#if defined(__x86_64__)
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    return hasAvx2;
+#else
+    return false;
+#endif
+}
+
+static FindBlockFunc getFindBlockFunc()
+{
+#if defined(__x86_64__)
+    if (hostHasAvx2()) {
+        return findBlockAvx2;
+    }
+#endif
+    return findBlockScalar;
+}
+
+static IsZeroFunc getIsZeroFunc()
+{
+#if defined(__x86_64__)
+    if (hostHasAvx2()) {
+        return isZeroAvx2;
+    }
+#endif
+    return isZeroScalar;
+}
+
+std::vector<std::pair<size_t, size_t>> diffMemoryRanges(
+  std::span<const uint8_t> original,
+  std::span<const uint8_t> updated)
+{
+    if (original.size() != updated.size()) {
+        SPDLOG_ERROR("Diffing memory of different sizes ({} != {})",
+                     original.size(),
+                     updated.size());
+        throw std::runtime_error("Diffing memory of different sizes");
+    }
+
+    std::vector<std::pair<size_t, size_t>> ranges;
+    auto addRange = [&ranges](size_t start, size_t end) {
+        if (!ranges.empty() &&
+            start - ranges.back().second < MEMORY_DIFF_MERGE_GAP) {
+            ranges.back().second = end;
+        } else {
+            ranges.emplace_back(start, end);
+        }
+    };
+
+    static const FindBlockFunc findBlock = getFindBlockFunc();
+    const uint8_t* a = original.data();
+    const uint8_t* b = updated.data();
+    size_t nBlocks = original.size() / BLOCK_SIZE;
+
+    size_t i = 0;
+    while (i < nBlocks) {
+        size_t start = findBlock(a, b, i, nBlocks, false);
+        if (start == nBlocks) {
+            break;
+        }
+
+        size_t end = findBlock(a, b, start, nBlocks, true);
+        addRange(start * BLOCK_SIZE, end * BLOCK_SIZE);
+        i = end;
+    }
+
+    // Anything left over is smaller than a block
+    size_t tailStart = nBlocks * BLOCK_SIZE;
+    size_t tailLen = original.size() - tailStart;
+    if (tailLen > 0 &&
+        std::memcmp(a + tailStart, b + tailStart, tailLen) != 0) {
+        addRange(tailStart, original.size());
+    }
+
+    return ranges;
+}
+
+bool isZeroMemory(std::span<const uint8_t> data)
+{
+    static const IsZeroFunc isZero = getIsZeroFunc();
+    size_t nBlocks = data.size() / BLOCK_SIZE;
+    if (!isZero(data.data(), nBlocks)) {
+        return false;
+    }
+
+    for (size_t i = nBlocks * BLOCK_SIZE; i < data.size(); i++) {
+        if (data[i] != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+}
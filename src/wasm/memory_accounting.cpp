@@ -0,0 +1,122 @@
+#include <wasm/memory_accounting.h>
+
+#include <faabric/util/logging.h>
+#include <faabric/util/memory.h>
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+// Pagemap entries read at once
+#define PAGEMAP_BATCH_PAGES 512
+
+#define PAGEMAP_PRESENT (1ULL << 63)
+#define PAGEMAP_FILE_OR_SHARED (1ULL << 61)
+
+namespace wasm {
+
+ModuleMemoryUsage& ModuleMemoryUsage::operator+=(
+  const ModuleMemoryUsage& other)
+{
+    linearMemoryBytes += other.linearMemoryBytes;
+    residentBytes += other.residentBytes;
+    privateBytes += other.privateBytes;
+    hostBufferBytes += other.hostBufferBytes;
+
+    return *this;
+}
+
+// Opened once and kept, -1 if it can't be read
+static int getPagemapFd()
+{
+    static int fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    return fd;
+}
+
+static bool readPagemap(uintptr_t start,
+                        size_t nPages,
+                        ResidentMemory& resident)
+{
+    int fd = getPagemapFd();
+    if (fd < 0) {
+        return false;
+    }
+
+    std::vector<uint64_t> entries(
+      std::min<size_t>(nPages, PAGEMAP_BATCH_PAGES));
+    size_t firstPage = start / faabric::util::HOST_PAGE_SIZE;
+    for (size_t done = 0; done < nPages;) {
+        size_t n = std::min<size_t>(nPages - done, PAGEMAP_BATCH_PAGES);
+        size_t nBytes = n * sizeof(uint64_t);
+        off_t offset = (firstPage + done) * sizeof(uint64_t);
+        if (pread(fd, entries.data(), nBytes, offset) != (ssize_t)nBytes) {
+            return false;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            if ((entries.at(i) & PAGEMAP_PRESENT) == 0) {
+                continue;
+            }
+
+            resident.residentBytes += faabric::util::HOST_PAGE_SIZE;
+            if ((entries.at(i) & PAGEMAP_FILE_OR_SHARED) == 0) {
+                resident.privateBytes += faabric::util::HOST_PAGE_SIZE;
+            }
+        }
+
+        done += n;
+    }
+
+    return true;
+}
+
+static bool readMincore(uintptr_t start,
+                        size_t nPages,
+                        ResidentMemory& resident)
+{
+    std::vector<unsigned char> pages(nPages);
+    if (mincore((void*)start,
+                nPages * faabric::util::HOST_PAGE_SIZE,
+                pages.data()) != 0) {
+        return false;
+    }
+
+    for (unsigned char p : pages) {
+        if ((p & 1) != 0) {
+            resident.residentBytes += faabric::util::HOST_PAGE_SIZE;
+        }
+    }
+    resident.privateBytes = resident.residentBytes;
+
+    return true;
+}
+
+ResidentMemory getResidentMemory(const uint8_t* ptr, size_t len)
+{
+    ResidentMemory resident;
+    if (ptr == nullptr || len == 0) {
+        return resident;
+    }
+
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    uintptr_t start = (uintptr_t)ptr & ~(pageSize - 1);
+    uintptr_t end = ((uintptr_t)ptr + len + pageSize - 1) & ~(pageSize - 1);
+    size_t nPages = (end - start) / pageSize;
+
+    if (readPagemap(start, nPages, resident)) {
+        return resident;
+    }
+
+    resident = ResidentMemory();
+    if (!readMincore(start, nPages, resident)) {
+        SPDLOG_WARN("Failed to find resident pages of {} bytes at {}",
+                    len,
+                    (void*)ptr);
+        return ResidentMemory();
+    }
+
+    return resident;
+}
+}
@@ -1,12 +1,431 @@
+#include <conf/FaasmConfig.h>
+#include <metrics/LifecycleTrace.h>
+#include <wasm/WasmExecutionContext.h>
+#include <wasm/WasmModule.h>
+#include <wasm/checkpoint.h>
+#include <wasm/memdiff.h>
+#include <wasm/migration.h>
+#include <wasm/mpi_comm.h>
+#include <wasm/mpi_core.h>
+#include <wasm/mpi_progress.h>
+#include <wasm/timing.h>
+
 #include <faabric/mpi/MpiWorldRegistry.h>
 #include <faabric/scheduler/ExecutorContext.h>
 #include <faabric/scheduler/Scheduler.h>
-#include <wasm/migration.h>
+#include <faabric/snapshot/SnapshotRegistry.h>
+#include <faabric/util/clock.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/memory.h>
+#include <faabric/util/snapshot.h>
+#include <faabric/util/timing.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <map>
+#include <unordered_map>
+
+#define MIGRATION_PRECOPY_POLL_MS 100
 
 namespace wasm {
+
+// -------------------------------------
+// SNAPSHOT PUSHING
+// -------------------------------------
+
+// Pushes a snapshot to the given host. If enabled, zero pages are left out:
+// we push a single page, then write the non-zero pages (and the last page, so
+// the size is right) to it as an update. Untouched parts of wasm heaps are
+// mostly zeroes, so this can cut the bytes sent substantially.
+static void pushSnapshotToHost(
+  const std::string& host,
+  const std::string& snapKey,
+  std::shared_ptr<faabric::util::SnapshotData> snap)
+{
+    auto client = faabric::scheduler::getScheduler().getSnapshotClient(host);
+
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    size_t snapSize = snap->getSize();
+    if (conf::getFaasmConfig().migrationElideZeroPages != "on" ||
+        snapSize <= pageSize) {
+        client->pushSnapshot(snapKey, snap);
+        return;
+    }
+
+    const uint8_t* data = snap->getDataPtr();
+    std::vector<faabric::util::SnapshotDiff> diffs;
+    size_t sentBytes = pageSize;
+    auto addDiff = [&diffs, &sentBytes, data](size_t start, size_t end) {
+        diffs.emplace_back(faabric::util::SnapshotDataType::Raw,
+                           faabric::util::SnapshotMergeOperation::Bytewise,
+                           start,
+                           std::span<const uint8_t>(data + start, end - start));
+        sentBytes += end - start;
+    };
+
+    size_t nPages = (snapSize + pageSize - 1) / pageSize;
+    size_t runStart = 0;
+    bool inRun = false;
+    for (size_t i = 1; i < nPages; i++) {
+        size_t offset = i * pageSize;
+        size_t len = std::min(pageSize, snapSize - offset);
+        bool isLast = i == nPages - 1;
+        bool keep = isLast || !isZeroMemory({ data + offset, len });
+
+        if (keep && !inRun) {
+            runStart = offset;
+            inRun = true;
+        } else if (!keep && inRun) {
+            addDiff(runStart, offset);
+            inRun = false;
+        }
+    }
+
+    if (inRun) {
+        addDiff(runStart, snapSize);
+    }
+
+    auto base = std::make_shared<faabric::util::SnapshotData>(
+      std::span<const uint8_t>(data, pageSize), snap->getMaxSize());
+    client->pushSnapshot(snapKey, base);
+    client->pushSnapshotUpdate(snapKey, base, diffs);
+
+    SPDLOG_DEBUG("Pushed snapshot {} to {} eliding zero pages ({}/{} bytes)",
+                 snapKey,
+                 host,
+                 sentBytes,
+                 snapSize);
+}
+
+// -------------------------------------
+// PRE-COPY
+// -------------------------------------
+
+struct MigrationPrecopy
+{
+    std::string snapKey;
+
+    // Guarded by mx
+    std::mutex mx;
+    std::condition_variable cv;
+    bool stopped = false;
+
+    // Only written by the pre-copy thread, read after it has been joined
+    std::string dstHost;
+    std::shared_ptr<faabric::util::SnapshotData> snap;
+    bool pushed = false;
+
+    std::thread thread;
+};
+
+static std::mutex precopiesMx;
+static std::unordered_map<int, std::shared_ptr<MigrationPrecopy>> precopies;
+
+static std::string getPendingMigrationHost(const faabric::Message& msg)
+{
+    auto pendingMigrations =
+      faabric::scheduler::getScheduler().getPendingAppMigrations(msg.appid());
+    if (pendingMigrations == nullptr) {
+        return "";
+    }
+
+    for (int i = 0; i < pendingMigrations->migrations_size(); i++) {
+        const auto& m = pendingMigrations->migrations().at(i);
+        if (m.msg().id() == msg.id()) {
+            return m.dsthost();
+        }
+    }
+
+    return "";
+}
+
+static void runPrecopy(std::shared_ptr<MigrationPrecopy> precopy,
+                       faabric::Message msg,
+                       WasmModule* module)
+{
+    // Wait for a migration of this call to be scheduled
+    std::string dstHost;
+    {
+        faabric::util::UniqueLock lock(precopy->mx);
+        while (!precopy->stopped) {
+            dstHost = getPendingMigrationHost(msg);
+            if (!dstHost.empty()) {
+                break;
+            }
+
+            precopy->cv.wait_for(
+              lock, std::chrono::milliseconds(MIGRATION_PRECOPY_POLL_MS));
+        }
+
+        if (precopy->stopped) {
+            return;
+        }
+    }
+
+    // Sleeping calls get to the migration point sooner if woken
+    wakeSleepingCalls(module);
+
+    SPDLOG_DEBUG("Starting migration pre-copy of {} to {}",
+                 faabric::util::funcToString(msg, false),
+                 dstHost);
+
+    // Anything written while the copy is in progress is picked up when
+    // comparing against it at the migration point
+    std::span<uint8_t> view = module->getMemoryView();
+    precopy->dstHost = dstHost;
+
+    precopy->snap = std::make_shared<faabric::util::SnapshotData>(
+      std::span<const uint8_t>(view.data(), view.size()), MAX_WASM_MEM);
+    faabric::snapshot::getSnapshotRegistry().registerSnapshot(precopy->snapKey,
+                                                              precopy->snap);
+
+    try {
+        pushSnapshotToHost(dstHost, precopy->snapKey, precopy->snap);
+        precopy->pushed = true;
+    } catch (std::exception& ex) {
+        SPDLOG_ERROR("Migration pre-copy of {} to {} failed: {}",
+                     faabric::util::funcToString(msg, false),
+                     dstHost,
+                     ex.what());
+    }
+}
+
+// Stops the pre-copy thread and removes it, returning it so the caller can
+// use or discard what has been copied
+static std::shared_ptr<MigrationPrecopy> takePrecopy(int msgId)
+{
+    std::shared_ptr<MigrationPrecopy> precopy;
+    {
+        faabric::util::UniqueLock lock(precopiesMx);
+        auto it = precopies.find(msgId);
+        if (it == precopies.end()) {
+            return nullptr;
+        }
+
+        precopy = it->second;
+        precopies.erase(it);
+    }
+
+    {
+        faabric::util::UniqueLock lock(precopy->mx);
+        precopy->stopped = true;
+    }
+    precopy->cv.notify_one();
+
+    // If a push is in progress this waits for it to finish
+    if (precopy->thread.joinable()) {
+        precopy->thread.join();
+    }
+
+    return precopy;
+}
+
+static void discardPrecopy(std::shared_ptr<MigrationPrecopy> precopy)
+{
+    if (precopy == nullptr || precopy->snap == nullptr) {
+        return;
+    }
+
+    faabric::snapshot::getSnapshotRegistry().deleteSnapshot(precopy->snapKey);
+
+    if (precopy->pushed) {
+        try {
+            faabric::scheduler::getScheduler()
+              .getSnapshotClient(precopy->dstHost)
+              ->deleteSnapshot(precopy->snapKey);
+        } catch (std::exception& ex) {
+            SPDLOG_WARN("Failed to delete pre-copied snapshot {} on {}: {}",
+                        precopy->snapKey,
+                        precopy->dstHost,
+                        ex.what());
+        }
+    }
+}
+
+std::vector<faabric::util::SnapshotDiff> getPrecopyDiffs(
+  std::span<const uint8_t> precopied,
+  std::span<const uint8_t> memory)
+{
+    std::vector<faabric::util::SnapshotDiff> diffs;
+    auto addDiff = [&diffs, &memory](size_t start, size_t end) {
+        diffs.emplace_back(faabric::util::SnapshotDataType::Raw,
+                           faabric::util::SnapshotMergeOperation::Bytewise,
+                           start,
+                           memory.subspan(start, end - start));
+    };
+
+    size_t compared = std::min(precopied.size(), memory.size());
+    std::vector<std::pair<size_t, size_t>> changed = diffMemoryRanges(
+      precopied.subspan(0, compared), memory.subspan(0, compared));
+    for (const auto& [start, end] : changed) {
+        addDiff(start, end);
+    }
+
+    if (memory.size() > compared) {
+        addDiff(compared, memory.size());
+    }
+
+    return diffs;
+}
+
+MigrationPrecopyGuard::MigrationPrecopyGuard(const faabric::Message& msg,
+                                             WasmModule& module)
+  : msgId(msg.id())
+{
+    if (conf::getFaasmConfig().migrationPrecopy != "on" ||
+        msg.migrationcheckperiod() <= 0) {
+        return;
+    }
+
+    auto precopy = std::make_shared<MigrationPrecopy>();
+    precopy->snapKey = "migration_precopy_" + std::to_string(msg.id());
+
+    {
+        faabric::util::UniqueLock lock(precopiesMx);
+        if (precopies.find(msgId) != precopies.end()) {
+            SPDLOG_WARN("Migration pre-copy already running for {}", msgId);
+            return;
+        }
+
+        precopies[msgId] = precopy;
+    }
+
+    precopy->thread = std::thread(runPrecopy, precopy, msg, &module);
+    active = true;
+}
+
+MigrationPrecopyGuard::~MigrationPrecopyGuard()
+{
+    if (active) {
+        discardPrecopy(takePrecopy(msgId));
+    }
+}
+
+// -------------------------------------
+// COST MODEL
+// -------------------------------------
+
+double getCrossHostFraction(const std::vector<std::string>& rankHosts)
+{
+    double nRanks = (double)rankHosts.size();
+    if (nRanks < 2) {
+        return 0;
+    }
+
+    std::map<std::string, int> ranksPerHost;
+    for (const auto& host : rankHosts) {
+        ranksPerHost[host]++;
+    }
+
+    double samePairs = 0;
+    for (const auto& [host, n] : ranksPerHost) {
+        samePairs += (double)n * (n - 1) / 2;
+    }
+
+    double allPairs = nRanks * (nRanks - 1) / 2;
+    return 1 - samePairs / allPairs;
+}
+
+bool isMigrationWorthwhile(size_t bytesToMove,
+                           double elapsedSecs,
+                           const std::vector<std::string>& rankHostsBefore,
+                           const std::vector<std::string>& rankHostsAfter,
+                           int bandwidthMbps)
+{
+    double speedup = (1 + getCrossHostFraction(rankHostsBefore)) /
+                     (1 + getCrossHostFraction(rankHostsAfter));
+    double savedSecs = elapsedSecs * (1 - 1 / speedup);
+
+    double bytesPerSec = std::max(bandwidthMbps, 1) * 1000.0 * 1000.0 / 8;
+    double moveSecs = (double)bytesToMove / bytesPerSec;
+
+    return savedSecs > moveSecs;
+}
+
+// Every rank must come to the same decision, so they pool the bytes they'd
+// move, and go with the longest any has been running
+static bool isAppMigrationWorthwhile(
+  const faabric::Message& call,
+  std::shared_ptr<faabric::PendingMigrations> pendingMigrations,
+  bool funcMustMigrate)
+{
+    auto& world =
+      faabric::mpi::getMpiWorldRegistry().getWorld(call.mpiworldid());
+
+    int worldSize = world.getSize();
+    std::vector<std::string> hostsBefore;
+    for (int r = 0; r < worldSize; r++) {
+        hostsBefore.push_back(world.getHostForRank(r));
+    }
+
+    std::vector<std::string> hostsAfter = hostsBefore;
+    for (int i = 0; i < pendingMigrations->migrations_size(); i++) {
+        const auto& m = pendingMigrations->migrations().at(i);
+        int rank = m.msg().mpirank();
+        if (rank >= 0 && rank < worldSize) {
+            hostsAfter.at(rank) = m.dsthost();
+        }
+    }
+
+    int64_t nowMs = faabric::util::getGlobalClock().epochMillis();
+    int64_t local[2] = { 0, 0 };
+    if (funcMustMigrate) {
+        local[0] = (int64_t)getExecutingModule()->getMemorySizeBytes();
+    }
+    if (call.timestamp() > 0) {
+        local[1] = nowMs - (int64_t)call.timestamp();
+    }
+
+    int64_t totalBytes = 0;
+    int64_t elapsedMs = 0;
+    awaitMpiCollectives();
+    MpiCommunicator& comm =
+      getMpiCommunicator(world, call.mpirank(), FAABRIC_COMM_WORLD);
+    comm.allReduce(world,
+                   (uint8_t*)&local[0],
+                   (uint8_t*)&totalBytes,
+                   MPI_LONG_LONG,
+                   1,
+                   MPI_SUM);
+    comm.allReduce(world,
+                   (uint8_t*)&local[1],
+                   (uint8_t*)&elapsedMs,
+                   MPI_LONG_LONG,
+                   1,
+                   MPI_MAX);
+
+    bool worthwhile =
+      isMigrationWorthwhile((size_t)totalBytes,
+                            elapsedMs / 1000.0,
+                            hostsBefore,
+                            hostsAfter,
+                            conf::getFaasmConfig().migrationBandwidthMbps);
+
+    SPDLOG_DEBUG("Migration of app {} {} worthwhile ({} bytes, {}ms run)",
+                 call.appid(),
+                 worthwhile ? "is" : "isn't",
+                 totalBytes,
+                 elapsedMs);
+
+    return worthwhile;
+}
+
+// -------------------------------------
+// MIGRATION
+// -------------------------------------
+
 void doMigrationPoint(int32_t entrypointFuncWasmOffset,
                       const std::string& entrypointFuncArg)
 {
+    metrics::TraceScope trace(metrics::TraceEvent::MigrationPoint);
+
+    // Checkpoint before moving, so a restart needn't wait for the move
+    doPeriodicCheckpoint(entrypointFuncWasmOffset, entrypointFuncArg);
+
     auto* call = &faabric::scheduler::ExecutorContext::get()->getMsg();
     auto& sch = faabric::scheduler::getScheduler();
 
@@ -28,16 +447,28 @@ void doMigrationPoint(int32_t entrypointFuncWasmOffset,
         }
     }
 
+    // Migrations not worth making yet are left pending, to be weighed up
+    // again at later migration points
+    if (appMustMigrate && call->ismpi() &&
+        conf::getFaasmConfig().migrationPolicy == "cost" &&
+        !isAppMigrationWorthwhile(*call, pendingMigrations, funcMustMigrate)) {
+        return;
+    }
+
     // Regardless if we have to individually migrate or not, we need to prepare
     // for the app migration
     if (appMustMigrate && call->ismpi()) {
         auto& mpiWorld =
           faabric::mpi::getMpiWorldRegistry().getWorld(call->mpiworldid());
         mpiWorld.prepareMigration(call->mpirank(), pendingMigrations);
+        invalidateMpiContext();
     }
 
     // Do actual migration
     if (funcMustMigrate) {
+        // The function is frozen from here until the migration is dispatched
+        faabric::util::TimePoint freezeStart = faabric::util::startTimer();
+
         std::vector<uint8_t> inputData(entrypointFuncArg.begin(),
                                        entrypointFuncArg.end());
 
@@ -57,12 +488,41 @@ void doMigrationPoint(int32_t entrypointFuncWasmOffset,
         // we are most likely migrating from a non-master host. Thus, we must
         // take and push the snapshot manually.
         auto* exec = faabric::scheduler::ExecutorContext::get()->getExecutor();
-        auto snap =
-          std::make_shared<faabric::util::SnapshotData>(exec->getMemoryView());
-        std::string snapKey = "migration_" + std::to_string(msg.id());
+        std::span<uint8_t> memView = exec->getMemoryView();
         auto& reg = faabric::snapshot::getSnapshotRegistry();
-        reg.registerSnapshot(snapKey, snap);
-        sch.getSnapshotClient(hostToMigrateTo)->pushSnapshot(snapKey, snap);
+
+        // If the memory has been pre-copied to the same host, we only need to
+        // send what's changed since. Memory can't be shrunk in a diff, so fall
+        // back to a full push if it has.
+        std::shared_ptr<MigrationPrecopy> precopy = takePrecopy(call->id());
+        std::string snapKey;
+        size_t precopiedBytes = 0;
+        size_t frozenBytes = 0;
+        if (precopy != nullptr && precopy->pushed &&
+            precopy->dstHost == hostToMigrateTo &&
+            memView.size() >= precopy->snap->getSize()) {
+            std::span<const uint8_t> precopied(precopy->snap->getDataPtr(),
+                                               precopy->snap->getSize());
+            std::vector<faabric::util::SnapshotDiff> diffs =
+              getPrecopyDiffs(precopied, memView);
+            for (const auto& d : diffs) {
+                frozenBytes += d.getData().size();
+            }
+
+            sch.getSnapshotClient(hostToMigrateTo)
+              ->pushSnapshotUpdate(precopy->snapKey, precopy->snap, diffs);
+
+            snapKey = precopy->snapKey;
+            precopiedBytes = precopy->snap->getSize();
+        } else {
+            discardPrecopy(precopy);
+
+            auto snap = std::make_shared<faabric::util::SnapshotData>(memView);
+            snapKey = "migration_" + std::to_string(msg.id());
+            reg.registerSnapshot(snapKey, snap);
+            pushSnapshotToHost(hostToMigrateTo, snapKey, snap);
+            frozenBytes = memView.size();
+        }
         msg.set_snapshotkey(snapKey);
 
         // Propagate the app ID and set the _same_ message ID
@@ -93,6 +553,15 @@ void doMigrationPoint(int32_t entrypointFuncWasmOffset,
         decision.addMessage(hostToMigrateTo, msg);
         sch.callFunctions(req, decision);
 
+        SPDLOG_INFO("Migration of {}/{} {} froze it for {}ms ({} bytes "
+                    "pre-copied, {} bytes sent while frozen)",
+                    msg.user(),
+                    msg.function(),
+                    call->id(),
+                    faabric::util::getTimeDiffMillis(freezeStart),
+                    precopiedBytes,
+                    frozenBytes);
+
         if (call->recordexecgraph()) {
             sch.logChainedFunction(*call, msg);
         }
@@ -0,0 +1,154 @@
+#include <wasm/mpi_collectives.h>
+#include <wasm/mpi_comm.h>
+#include <wasm/mpi_progress.h>
+#include <wasm/mpi_shm.h>
+
+#include <faabric/util/logging.h>
+
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace wasm {
+
+void mpiAllGatherV(faabric::mpi::MpiWorld& world,
+                   int rank,
+                   const uint8_t* sendBuf,
+                   int sendCount,
+                   faabric_datatype_t* sendType,
+                   uint8_t* recvBuf,
+                   const int32_t* recvCounts,
+                   const int32_t* displs,
+                   faabric_datatype_t* recvType)
+{
+    awaitMpiCollectives();
+
+    int worldSize = world.getSize();
+    size_t elemSize = recvType->size;
+
+    if (sendBuf != nullptr) {
+        size_t nBytes = sendCount * sendType->size;
+        if (nBytes != recvCounts[rank] * elemSize) {
+            SPDLOG_ERROR("MPI_Allgatherv size mismatch on rank {}", rank);
+            throw std::runtime_error("MPI_Allgatherv size mismatch");
+        }
+
+        std::memcpy(recvBuf + displs[rank] * elemSize, sendBuf, nBytes);
+    }
+
+    // Ranks are mostly assigned to hosts in order, so most steps of the ring
+    // stay within a host
+    int right = (rank + 1) % worldSize;
+    int left = (rank + worldSize - 1) % worldSize;
+    for (int step = 0; step < worldSize - 1; step++) {
+        int sendIdx = (rank + worldSize - step) % worldSize;
+        int recvIdx = (rank + worldSize - step - 1) % worldSize;
+
+        MPI_Status status{};
+        world.sendRecv(recvBuf + displs[sendIdx] * elemSize,
+                       recvCounts[sendIdx],
+                       recvType,
+                       right,
+                       recvBuf + displs[recvIdx] * elemSize,
+                       recvCounts[recvIdx],
+                       recvType,
+                       left,
+                       rank,
+                       &status);
+    }
+}
+
+void mpiAllToAllV(faabric::mpi::MpiWorld& world,
+                  int rank,
+                  const uint8_t* sendBuf,
+                  const int32_t* sendCounts,
+                  const int32_t* sendDispls,
+                  faabric_datatype_t* sendType,
+                  uint8_t* recvBuf,
+                  const int32_t* recvCounts,
+                  const int32_t* recvDispls,
+                  faabric_datatype_t* recvType)
+{
+    awaitMpiCollectives();
+
+    int worldSize = world.getSize();
+
+    size_t selfBytes = sendCounts[rank] * sendType->size;
+    if (selfBytes != recvCounts[rank] * recvType->size) {
+        SPDLOG_ERROR("MPI_Alltoallv size mismatch on rank {}", rank);
+        throw std::runtime_error("MPI_Alltoallv size mismatch");
+    }
+
+    // Post all the receives before sending, and start from our neighbour so
+    // that not everyone sends to the same rank first
+    std::vector<int> requestIds;
+    for (int i = 1; i < worldSize; i++) {
+        int peer = (rank + worldSize - i) % worldSize;
+        if (recvCounts[peer] == 0) {
+            continue;
+        }
+
+        requestIds.push_back(
+          world.irecv(peer,
+                      rank,
+                      recvBuf + recvDispls[peer] * recvType->size,
+                      recvType,
+                      recvCounts[peer]));
+    }
+
+    for (int i = 1; i < worldSize; i++) {
+        int peer = (rank + i) % worldSize;
+        if (sendCounts[peer] == 0) {
+            continue;
+        }
+
+        requestIds.push_back(world.isend(
+          rank,
+          peer,
+          const_cast<uint8_t*>(sendBuf + sendDispls[peer] * sendType->size),
+          sendType,
+          sendCounts[peer]));
+    }
+
+    std::memmove(recvBuf + recvDispls[rank] * recvType->size,
+                 sendBuf + sendDispls[rank] * sendType->size,
+                 selfBytes);
+
+    for (int requestId : requestIds) {
+        world.awaitAsyncRequest(requestId);
+    }
+}
+
+void mpiReduceScatter(faabric::mpi::MpiWorld& world,
+                      int rank,
+                      const uint8_t* sendBuf,
+                      uint8_t* recvBuf,
+                      const int32_t* recvCounts,
+                      faabric_datatype_t* datatype,
+                      faabric_op_t* op)
+{
+    awaitMpiCollectives();
+
+    int worldSize = world.getSize();
+    int totalCount = std::accumulate(recvCounts, recvCounts + worldSize, 0);
+    int offset = std::accumulate(recvCounts, recvCounts + rank, 0);
+
+    std::vector<uint8_t> result(totalCount * datatype->size);
+    if (isMpiShmCollectivesEnabled()) {
+        getMpiCommunicator(world, rank, FAABRIC_COMM_WORLD)
+          .allReduce(world, sendBuf, result.data(), datatype, totalCount, op);
+    } else {
+        world.allReduce(rank,
+                        const_cast<uint8_t*>(sendBuf),
+                        result.data(),
+                        datatype,
+                        totalCount,
+                        op);
+    }
+
+    std::memcpy(recvBuf,
+                result.data() + offset * datatype->size,
+                recvCounts[rank] * datatype->size);
+}
+}
@@ -0,0 +1,877 @@
+#include <wasm/mpi_comm.h>
+#include <wasm/mpi_progress.h>
+
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <stdexcept>
+#include <tuple>
+
+using namespace faabric::mpi;
+
+namespace wasm {
+
+MpiCommunicator::MpiCommunicator(int idIn,
+                                 std::vector<int> worldRanksIn,
+                                 int worldRank)
+  : id(idIn)
+  , worldRanks(std::move(worldRanksIn))
+{
+    for (int r = 0; r < (int)worldRanks.size(); r++) {
+        commRanks[worldRanks.at(r)] = r;
+    }
+
+    rank = getCommRank(worldRank);
+}
+
+int MpiCommunicator::getWorldRank(int commRank) const
+{
+    if (commRank < 0 || commRank >= getSize()) {
+        SPDLOG_ERROR("Rank {} not in communicator {} of size {}",
+                     commRank,
+                     id,
+                     getSize());
+        throw std::runtime_error("Rank not in communicator");
+    }
+
+    return worldRanks.at(commRank);
+}
+
+int MpiCommunicator::getCommRank(int worldRank) const
+{
+    auto it = commRanks.find(worldRank);
+    if (it == commRanks.end()) {
+        SPDLOG_ERROR("World rank {} not in communicator {}", worldRank, id);
+        throw std::runtime_error("World rank not in communicator");
+    }
+
+    return it->second;
+}
+
+// Cells of a Cartesian grid are numbered in row-major order
+static std::vector<int> getCartCellCoords(const std::vector<int>& dims,
+                                          int cell)
+{
+    std::vector<int> coords(dims.size());
+    for (int d = (int)dims.size() - 1; d >= 0; d--) {
+        coords.at(d) = cell % dims.at(d);
+        cell /= dims.at(d);
+    }
+
+    return coords;
+}
+
+static int getCartCell(const std::vector<int>& dims,
+                       const std::vector<int>& coords)
+{
+    int cell = 0;
+    for (size_t d = 0; d < dims.size(); d++) {
+        cell = cell * dims.at(d) + coords.at(d);
+    }
+
+    return cell;
+}
+
+void MpiCommunicator::setCartTopology(std::vector<int> dimsIn,
+                                      std::vector<bool> periodsIn)
+{
+    int nCells = std::accumulate(
+      dimsIn.begin(), dimsIn.end(), 1, std::multiplies<int>());
+    if (dimsIn.empty() || dimsIn.size() != periodsIn.size() ||
+        nCells != getSize()) {
+        SPDLOG_ERROR("Cartesian grid of {} cells doesn't fit communicator {} "
+                     "of size {}",
+                     nCells,
+                     id,
+                     getSize());
+        throw std::runtime_error("Bad Cartesian grid");
+    }
+
+    cartDims = std::move(dimsIn);
+    cartPeriods = std::move(periodsIn);
+}
+
+std::vector<int> MpiCommunicator::getCartCoords(int commRank) const
+{
+    return getCartCellCoords(cartDims, commRank);
+}
+
+int MpiCommunicator::getCartRank(const std::vector<int>& coords) const
+{
+    std::vector<int> wrapped = coords;
+    for (size_t d = 0; d < cartDims.size(); d++) {
+        int c = wrapped.at(d);
+        int n = cartDims.at(d);
+        if (c >= 0 && c < n) {
+            continue;
+        }
+
+        if (!cartPeriods.at(d)) {
+            return MPI_PROC_NULL;
+        }
+
+        wrapped.at(d) = ((c % n) + n) % n;
+    }
+
+    return getCartCell(cartDims, wrapped);
+}
+
+std::pair<int, int> MpiCommunicator::shiftCart(int direction, int disp) const
+{
+    if (direction < 0 || direction >= (int)cartDims.size()) {
+        SPDLOG_ERROR("No direction {} in communicator {}'s {}-d grid",
+                     direction,
+                     id,
+                     cartDims.size());
+        throw std::runtime_error("Bad Cartesian shift direction");
+    }
+
+    std::vector<int> source = getCartCoords(rank);
+    std::vector<int> dest = source;
+    source.at(direction) -= disp;
+    dest.at(direction) += disp;
+
+    return { getCartRank(source), getCartRank(dest) };
+}
+
+void MpiCommunicator::resetHosts()
+{
+    // Other members may already be using the segment for the new hosts, so
+    // it's left in place
+    hostMembers.clear();
+    hostSegment = nullptr;
+    hostSegmentKey.clear();
+}
+
+void MpiCommunicator::releaseHostSegment()
+{
+    if (hostSegment != nullptr) {
+        removeMpiHostSegment(hostSegmentKey);
+        hostSegment = nullptr;
+        hostSegmentKey.clear();
+    }
+}
+
+void MpiCommunicator::initHosts(MpiWorld& world)
+{
+    if (!hostMembers.empty()) {
+        return;
+    }
+
+    for (int r = 0; r < getSize(); r++) {
+        hostMembers[world.getHostForRank(worldRanks.at(r))].push_back(r);
+    }
+}
+
+const std::vector<int>& MpiCommunicator::getHostMembers(MpiWorld& world)
+{
+    initHosts(world);
+
+    return hostMembers.at(world.getHostForRank(worldRanks.at(rank)));
+}
+
+std::vector<int> MpiCommunicator::getHostLeaders(MpiWorld& world)
+{
+    initHosts(world);
+
+    std::vector<int> leaders;
+    for (const auto& [host, members] : hostMembers) {
+        leaders.push_back(members.front());
+    }
+    std::sort(leaders.begin(), leaders.end());
+
+    return leaders;
+}
+
+int MpiCommunicator::getHostLeader(MpiWorld& world, int commRank, int root)
+{
+    std::string host = world.getHostForRank(worldRanks.at(commRank));
+    if (host == world.getHostForRank(worldRanks.at(root))) {
+        return root;
+    }
+
+    return hostMembers.at(host).front();
+}
+
+MpiHostSegment& MpiCommunicator::getHostSegment(MpiWorld& world)
+{
+    if (hostSegment != nullptr) {
+        return *hostSegment;
+    }
+
+    initHosts(world);
+
+    // The member count is part of the key, as it changes when ranks migrate
+    std::string thisHost = world.getHostForRank(worldRanks.at(rank));
+    int nMembers = (int)hostMembers.at(thisHost).size();
+    hostSegmentKey =
+      fmt::format("{}_{}_{}_{}", world.getId(), id, thisHost, nMembers);
+    hostSegment = getMpiHostSegment(hostSegmentKey, nMembers);
+
+    return *hostSegment;
+}
+
+// Messages go from the root to one rank on each other host, and from there to
+// the rest of the host, so each host is sent the data once
+void MpiCommunicator::broadcast(MpiWorld& world,
+                                int root,
+                                uint8_t* buffer,
+                                faabric_datatype_t* datatype,
+                                int count)
+{
+    if (isMpiShmCollectivesEnabled()) {
+        broadcastOnHost(world, root, buffer, datatype, count);
+        return;
+    }
+
+    initHosts(world);
+
+    int worldRank = worldRanks.at(rank);
+    int leader = getHostLeader(world, rank, root);
+    std::string thisHost = world.getHostForRank(worldRank);
+
+    if (rank == root) {
+        for (const auto& [host, members] : hostMembers) {
+            if (host == thisHost) {
+                continue;
+            }
+
+            int hostLeader = getHostLeader(world, members.front(), root);
+            world.send(
+              worldRank, worldRanks.at(hostLeader), buffer, datatype, count);
+        }
+    } else if (rank == leader) {
+        MPI_Status status{};
+        world.recv(
+          worldRanks.at(root), worldRank, buffer, datatype, count, &status);
+    } else {
+        MPI_Status status{};
+        world.recv(
+          worldRanks.at(leader), worldRank, buffer, datatype, count, &status);
+        return;
+    }
+
+    for (int member : hostMembers.at(thisHost)) {
+        if (member != rank) {
+            world.send(
+              worldRank, worldRanks.at(member), buffer, datatype, count);
+        }
+    }
+}
+
+// The leader on each host gets the data once, then the rest of the host copies
+// it out of the shared segment
+void MpiCommunicator::broadcastOnHost(MpiWorld& world,
+                                      int root,
+                                      uint8_t* buffer,
+                                      faabric_datatype_t* datatype,
+                                      int count)
+{
+    MpiHostSegment& segment = getHostSegment(world);
+
+    int worldRank = worldRanks.at(rank);
+    int leader = getHostLeader(world, rank, root);
+    std::string thisHost = world.getHostForRank(worldRank);
+    size_t nBytes = count * datatype->size;
+
+    segment.contribute(nullptr, 0, nullptr);
+
+    if (rank == leader) {
+        std::vector<uint8_t>& data = segment.awaitContributions();
+
+        if (rank == root) {
+            for (const auto& [host, members] : hostMembers) {
+                if (host == thisHost) {
+                    continue;
+                }
+
+                int hostLeader = getHostLeader(world, members.front(), root);
+                world.send(worldRank,
+                           worldRanks.at(hostLeader),
+                           buffer,
+                           datatype,
+                           count);
+            }
+        } else {
+            MPI_Status status{};
+            world.recv(
+              worldRanks.at(root), worldRank, buffer, datatype, count, &status);
+        }
+
+        data.assign(buffer, buffer + nBytes);
+        segment.publish();
+    }
+
+    segment.read(rank == leader ? nullptr : buffer, nBytes);
+}
+
+void MpiCommunicator::reduce(MpiWorld& world,
+                             int root,
+                             const uint8_t* sendBuf,
+                             uint8_t* recvBuf,
+                             faabric_datatype_t* datatype,
+                             int count,
+                             faabric_op_t* op)
+{
+    MpiCombineFunction combine =
+      [&world, op, datatype](const uint8_t* in, uint8_t* inout, int n) {
+          world.op_reduce(op, datatype, n, const_cast<uint8_t*>(in), inout);
+      };
+
+    // User operators call into the guest, so only built-in ones are combined
+    // in the shared segment
+    if (isMpiShmCollectivesEnabled()) {
+        reduceOnHost(world, root, sendBuf, recvBuf, datatype, count, combine);
+        return;
+    }
+
+    reduce(world, root, sendBuf, recvBuf, datatype, count, combine, true);
+}
+
+// Each member combines its data straight into the host's segment, so only the
+// leaders send anything
+void MpiCommunicator::reduceOnHost(MpiWorld& world,
+                                   int root,
+                                   const uint8_t* sendBuf,
+                                   uint8_t* recvBuf,
+                                   faabric_datatype_t* datatype,
+                                   int count,
+                                   const MpiCombineFunction& combine)
+{
+    MpiHostSegment& segment = getHostSegment(world);
+
+    int worldRank = worldRanks.at(rank);
+    int leader = getHostLeader(world, rank, root);
+    std::string thisHost = world.getHostForRank(worldRank);
+    size_t nBytes = count * datatype->size;
+
+    segment.contribute(
+      sendBuf, nBytes, [&combine, count](const uint8_t* in, uint8_t* inout) {
+          combine(in, inout, count);
+      });
+
+    if (rank == leader) {
+        std::vector<uint8_t>& acc = segment.awaitContributions();
+
+        if (rank == root) {
+            std::vector<uint8_t> received(nBytes);
+            for (const auto& [host, members] : hostMembers) {
+                if (host == thisHost) {
+                    continue;
+                }
+
+                int hostLeader = getHostLeader(world, members.front(), root);
+                MPI_Status status{};
+                world.recv(worldRanks.at(hostLeader),
+                           worldRank,
+                           received.data(),
+                           datatype,
+                           count,
+                           &status);
+                combine(received.data(), acc.data(), count);
+            }
+        } else {
+            world.send(
+              worldRank, worldRanks.at(root), acc.data(), datatype, count);
+        }
+
+        segment.publish();
+    }
+
+    segment.read(rank == root ? recvBuf : nullptr, nBytes);
+}
+
+// The reverse of the broadcast: each host combines its own ranks' data before
+// sending it to the root
+void MpiCommunicator::reduce(MpiWorld& world,
+                             int root,
+                             const uint8_t* sendBuf,
+                             uint8_t* recvBuf,
+                             faabric_datatype_t* datatype,
+                             int count,
+                             const MpiCombineFunction& combine,
+                             bool commute)
+{
+    if (!commute) {
+        reduceInOrder(world, root, sendBuf, recvBuf, datatype, count, combine);
+        return;
+    }
+
+    initHosts(world);
+
+    int worldRank = worldRanks.at(rank);
+    int leader = getHostLeader(world, rank, root);
+    std::string thisHost = world.getHostForRank(worldRank);
+    size_t nBytes = count * datatype->size;
+
+    std::vector<uint8_t> acc(sendBuf, sendBuf + nBytes);
+    if (rank != leader) {
+        world.send(
+          worldRank, worldRanks.at(leader), acc.data(), datatype, count);
+        return;
+    }
+
+    std::vector<int> sources;
+    for (int member : hostMembers.at(thisHost)) {
+        if (member != rank) {
+            sources.push_back(member);
+        }
+    }
+
+    if (rank == root) {
+        for (const auto& [host, members] : hostMembers) {
+            if (host != thisHost) {
+                sources.push_back(getHostLeader(world, members.front(), root));
+            }
+        }
+    }
+
+    std::vector<uint8_t> received(nBytes);
+    for (int source : sources) {
+        MPI_Status status{};
+        world.recv(worldRanks.at(source),
+                   worldRank,
+                   received.data(),
+                   datatype,
+                   count,
+                   &status);
+        combine(received.data(), acc.data(), count);
+    }
+
+    if (rank == root) {
+        std::memcpy(recvBuf, acc.data(), nBytes);
+    } else {
+        world.send(
+          worldRank, worldRanks.at(root), acc.data(), datatype, count);
+    }
+}
+
+// Everyone sends to the root, which computes x0 op (x1 op (... op xn-1))
+void MpiCommunicator::reduceInOrder(MpiWorld& world,
+                                    int root,
+                                    const uint8_t* sendBuf,
+                                    uint8_t* recvBuf,
+                                    faabric_datatype_t* datatype,
+                                    int count,
+                                    const MpiCombineFunction& combine)
+{
+    int worldRank = worldRanks.at(rank);
+    size_t nBytes = count * datatype->size;
+
+    if (rank != root) {
+        world.send(worldRank,
+                   worldRanks.at(root),
+                   const_cast<uint8_t*>(sendBuf),
+                   datatype,
+                   count);
+        return;
+    }
+
+    std::vector<uint8_t> all(getSize() * nBytes);
+    for (int r = 0; r < getSize(); r++) {
+        uint8_t* block = all.data() + r * nBytes;
+        if (r == rank) {
+            std::memcpy(block, sendBuf, nBytes);
+            continue;
+        }
+
+        MPI_Status status{};
+        world.recv(
+          worldRanks.at(r), worldRank, block, datatype, count, &status);
+    }
+
+    uint8_t* acc = all.data() + (getSize() - 1) * nBytes;
+    for (int r = getSize() - 2; r >= 0; r--) {
+        combine(all.data() + r * nBytes, acc, count);
+    }
+
+    std::memcpy(recvBuf, acc, nBytes);
+}
+
+void MpiCommunicator::allReduce(MpiWorld& world,
+                                const uint8_t* sendBuf,
+                                uint8_t* recvBuf,
+                                faabric_datatype_t* datatype,
+                                int count,
+                                faabric_op_t* op)
+{
+    reduce(world, 0, sendBuf, recvBuf, datatype, count, op);
+    broadcast(world, 0, recvBuf, datatype, count);
+}
+
+void MpiCommunicator::allReduce(MpiWorld& world,
+                                const uint8_t* sendBuf,
+                                uint8_t* recvBuf,
+                                faabric_datatype_t* datatype,
+                                int count,
+                                const MpiCombineFunction& combine,
+                                bool commute)
+{
+    reduce(world, 0, sendBuf, recvBuf, datatype, count, combine, commute);
+    broadcast(world, 0, recvBuf, datatype, count);
+}
+
+void MpiCommunicator::allGather(MpiWorld& world,
+                                const uint8_t* sendBuf,
+                                uint8_t* recvBuf,
+                                faabric_datatype_t* datatype,
+                                int count)
+{
+    int worldRank = worldRanks.at(rank);
+    size_t blockSize = count * datatype->size;
+
+    if (rank == 0) {
+        std::memmove(recvBuf, sendBuf, blockSize);
+        for (int r = 1; r < getSize(); r++) {
+            MPI_Status status{};
+            world.recv(worldRanks.at(r),
+                       worldRank,
+                       recvBuf + r * blockSize,
+                       datatype,
+                       count,
+                       &status);
+        }
+    } else {
+        world.send(worldRank,
+                   worldRanks.at(0),
+                   const_cast<uint8_t*>(sendBuf),
+                   datatype,
+                   count);
+    }
+
+    broadcast(world, 0, recvBuf, datatype, count * getSize());
+}
+
+void MpiCommunicator::barrier(MpiWorld& world)
+{
+    std::vector<int> flags(getSize(), 0);
+    int flag = 1;
+    allGather(world,
+              reinterpret_cast<uint8_t*>(&flag),
+              reinterpret_cast<uint8_t*>(flags.data()),
+              MPI_INT,
+              1);
+}
+
+// Communicators belong to the calling rank's thread
+static thread_local std::map<int, std::unique_ptr<MpiCommunicator>> comms;
+
+// How many communicators each rank has made from each parent
+static thread_local std::map<int, int> nChildComms;
+
+/**
+ * Members of a parent make their new communicators in the same order, so
+ * counting them gives every member the same ID for the same one. Split ones
+ * are told apart by their colour.
+ */
+static int getNewCommId(int parentId, int color)
+{
+    int childIdx = nChildComms[parentId]++;
+    std::string key = fmt::format("{}_{}_{}", parentId, childIdx, color);
+
+    int id = (int)(std::hash<std::string>{}(key) & 0x7fffffff);
+    if (id == FAABRIC_COMM_WORLD) {
+        id++;
+    }
+
+    return id;
+}
+
+MpiCommunicator& getMpiCommunicator(MpiWorld& world, int worldRank, int id)
+{
+    auto it = comms.find(id);
+    if (it != comms.end()) {
+        return *it->second;
+    }
+
+    if (id != FAABRIC_COMM_WORLD) {
+        SPDLOG_ERROR("Unrecognised communicator {}", id);
+        throw std::runtime_error("Unrecognised communicator");
+    }
+
+    std::vector<int> worldRanks(world.getSize());
+    std::iota(worldRanks.begin(), worldRanks.end(), 0);
+    auto [newIt, inserted] = comms.emplace(
+      id, std::make_unique<MpiCommunicator>(id, worldRanks, worldRank));
+
+    return *newIt->second;
+}
+
+int splitMpiCommunicator(MpiWorld& world,
+                         int worldRank,
+                         int parentId,
+                         int color,
+                         int key)
+{
+    awaitMpiCollectives();
+
+    MpiCommunicator& parent = getMpiCommunicator(world, worldRank, parentId);
+
+    std::vector<int> sendBuf = { color, key };
+    std::vector<int> recvBuf(2 * parent.getSize(), 0);
+    parent.allGather(world,
+                     reinterpret_cast<uint8_t*>(sendBuf.data()),
+                     reinterpret_cast<uint8_t*>(recvBuf.data()),
+                     MPI_INT,
+                     2);
+
+    int id = getNewCommId(parentId, color);
+    if (color == MPI_UNDEFINED) {
+        return -1;
+    }
+
+    // Order by key, then by rank in the parent
+    std::vector<std::tuple<int, int>> members;
+    for (int r = 0; r < parent.getSize(); r++) {
+        if (recvBuf.at(2 * r) == color) {
+            members.emplace_back(recvBuf.at(2 * r + 1), r);
+        }
+    }
+    std::sort(members.begin(), members.end());
+
+    std::vector<int> worldRanks;
+    for (const auto& [memberKey, parentRank] : members) {
+        worldRanks.push_back(parent.getWorldRank(parentRank));
+    }
+
+    comms.emplace(
+      id, std::make_unique<MpiCommunicator>(id, worldRanks, worldRank));
+
+    SPDLOG_DEBUG("MPI-{} split communicator {} into {} of size {}",
+                 worldRank,
+                 parentId,
+                 id,
+                 worldRanks.size());
+
+    return id;
+}
+
+int dupMpiCommunicator(MpiWorld& world, int worldRank, int parentId)
+{
+    MpiCommunicator& parent = getMpiCommunicator(world, worldRank, parentId);
+
+    std::vector<int> worldRanks;
+    for (int r = 0; r < parent.getSize(); r++) {
+        worldRanks.push_back(parent.getWorldRank(r));
+    }
+
+    int id = getNewCommId(parentId, 0);
+    comms.emplace(
+      id, std::make_unique<MpiCommunicator>(id, worldRanks, worldRank));
+
+    return id;
+}
+
+/**
+ * Visits the cells of a block of the grid, halving its longest side each time,
+ * so any run of cells visited one after the other is a compact block.
+ */
+static void orderCartCells(const std::vector<int>& dims,
+                           std::vector<int>& lo,
+                           std::vector<int>& hi,
+                           std::vector<int>& cells)
+{
+    size_t longest = 0;
+    for (size_t d = 1; d < dims.size(); d++) {
+        if (hi.at(d) - lo.at(d) > hi.at(longest) - lo.at(longest)) {
+            longest = d;
+        }
+    }
+
+    int extent = hi.at(longest) - lo.at(longest);
+    if (extent == 1) {
+        cells.push_back(getCartCell(dims, lo));
+        return;
+    }
+
+    int mid = lo.at(longest) + extent / 2;
+
+    int blockHi = hi.at(longest);
+    hi.at(longest) = mid;
+    orderCartCells(dims, lo, hi, cells);
+    hi.at(longest) = blockHi;
+
+    int blockLo = lo.at(longest);
+    lo.at(longest) = mid;
+    orderCartCells(dims, lo, hi, cells);
+    lo.at(longest) = blockLo;
+}
+
+// Pairs of grid neighbours whose ranks are on the same host
+static int countCartLocalPairs(const std::vector<int>& dims,
+                               const std::vector<bool>& periods,
+                               const std::vector<std::string>& hosts,
+                               const std::vector<int>& placement)
+{
+    int nLocal = 0;
+    for (int cell = 0; cell < (int)placement.size(); cell++) {
+        std::vector<int> coords = getCartCellCoords(dims, cell);
+        for (size_t d = 0; d < dims.size(); d++) {
+            std::vector<int> next = coords;
+            next.at(d)++;
+
+            // Wrapping a side of two would count the same pair twice
+            if (next.at(d) == dims.at(d)) {
+                if (!periods.at(d) || dims.at(d) <= 2) {
+                    continue;
+                }
+                next.at(d) = 0;
+            }
+
+            int nextCell = getCartCell(dims, next);
+            if (hosts.at(placement.at(cell)) ==
+                hosts.at(placement.at(nextCell))) {
+                nLocal++;
+            }
+        }
+    }
+
+    return nLocal;
+}
+
+std::vector<int> getMpiCartPlacement(const std::vector<int>& dims,
+                                     const std::vector<bool>& periods,
+                                     const std::vector<std::string>& hosts)
+{
+    std::vector<int> inOrder(hosts.size());
+    std::iota(inOrder.begin(), inOrder.end(), 0);
+
+    // Each host's ranks, with hosts in order of their lowest rank
+    std::vector<std::string> hostOrder;
+    std::map<std::string, std::vector<int>> hostRanks;
+    for (int r = 0; r < (int)hosts.size(); r++) {
+        if (hostRanks.count(hosts.at(r)) == 0) {
+            hostOrder.push_back(hosts.at(r));
+        }
+        hostRanks[hosts.at(r)].push_back(r);
+    }
+
+    std::vector<int> ranks;
+    for (const auto& host : hostOrder) {
+        const std::vector<int>& members = hostRanks.at(host);
+        ranks.insert(ranks.end(), members.begin(), members.end());
+    }
+
+    std::vector<int> lo(dims.size(), 0);
+    std::vector<int> hi = dims;
+    std::vector<int> cells;
+    orderCartCells(dims, lo, hi, cells);
+
+    std::vector<int> placement(hosts.size());
+    for (size_t i = 0; i < cells.size(); i++) {
+        placement.at(cells.at(i)) = ranks.at(i);
+    }
+
+    if (countCartLocalPairs(dims, periods, hosts, placement) >
+        countCartLocalPairs(dims, periods, hosts, inOrder)) {
+        return placement;
+    }
+
+    return inOrder;
+}
+
+int createMpiCartCommunicator(MpiWorld& world,
+                              int worldRank,
+                              int parentId,
+                              const std::vector<int>& dims,
+                              const std::vector<bool>& periods,
+                              bool reorder)
+{
+    awaitMpiCollectives();
+
+    MpiCommunicator& parent = getMpiCommunicator(world, worldRank, parentId);
+
+    int nCells = std::accumulate(
+      dims.begin(), dims.end(), 1, std::multiplies<int>());
+    bool validDims = std::all_of(
+      dims.begin(), dims.end(), [](int dim) { return dim > 0; });
+    if (dims.empty() || dims.size() != periods.size() || !validDims ||
+        nCells > parent.getSize()) {
+        SPDLOG_ERROR("Cartesian grid of {} cells doesn't fit communicator {} "
+                     "of size {}",
+                     nCells,
+                     parentId,
+                     parent.getSize());
+        throw std::runtime_error("Bad Cartesian grid");
+    }
+
+    // Ranks off the grid still count it, so IDs stay the same on all members
+    int id = getNewCommId(parentId, 0);
+
+    std::vector<int> parentRanks(nCells);
+    std::iota(parentRanks.begin(), parentRanks.end(), 0);
+    if (reorder) {
+        std::vector<std::string> hosts;
+        for (int r = 0; r < nCells; r++) {
+            hosts.push_back(world.getHostForRank(parent.getWorldRank(r)));
+        }
+
+        parentRanks = getMpiCartPlacement(dims, periods, hosts);
+    }
+
+    std::vector<int> worldRanks;
+    for (int parentRank : parentRanks) {
+        worldRanks.push_back(parent.getWorldRank(parentRank));
+    }
+
+    if (std::find(worldRanks.begin(), worldRanks.end(), worldRank) ==
+        worldRanks.end()) {
+        return -1;
+    }
+
+    std::vector<int> allRanks(world.getSize());
+    std::iota(allRanks.begin(), allRanks.end(), 0);
+    if (worldRanks == allRanks) {
+        id = FAABRIC_COMM_WORLD;
+    } else {
+        comms.emplace(
+          id, std::make_unique<MpiCommunicator>(id, worldRanks, worldRank));
+    }
+
+    MpiCommunicator& comm = getMpiCommunicator(world, worldRank, id);
+    comm.setCartTopology(dims, periods);
+
+    SPDLOG_DEBUG("MPI-{} created {}-d Cartesian communicator {} with rank {}",
+                 worldRank,
+                 dims.size(),
+                 id,
+                 comm.getRank());
+
+    return id;
+}
+
+void freeMpiCommunicator(int id)
+{
+    awaitMpiCollectives();
+
+    if (id == FAABRIC_COMM_WORLD) {
+        return;
+    }
+
+    auto it = comms.find(id);
+    if (it != comms.end()) {
+        it->second->releaseHostSegment();
+        comms.erase(it);
+    }
+}
+
+void resetMpiCommunicatorHosts()
+{
+    for (auto& [id, comm] : comms) {
+        comm->resetHosts();
+    }
+}
+
+void clearMpiCommunicators()
+{
+    for (auto& [id, comm] : comms) {
+        comm->releaseHostSegment();
+    }
+
+    comms.clear();
+    nChildComms.clear();
+}
+}
@@ -0,0 +1,545 @@
+#include <wasm/mpi_core.h>
+#include <wasm/mpi_file.h>
+#include <wasm/mpi_mem.h>
+#include <wasm/mpi_ops.h>
+#include <wasm/mpi_profile.h>
+#include <wasm/mpi_progress.h>
+#include <wasm/mpi_rendezvous.h>
+#include <wasm/mpi_requests.h>
+#include <wasm/mpi_shm.h>
+#include <wasm/mpi_types.h>
+#include <wasm/mpi_window.h>
+
+#include <faabric/util/logging.h>
+
+#include <memory>
+
+using namespace faabric::mpi;
+
+namespace wasm {
+
+// Faabric receives into the packed buffer when the request is awaited, and
+// what it receives may be a rendezvous marker rather than the message
+static void addMpiRecvOutputs(int requestId,
+                              std::shared_ptr<MpiTypeBuffer> outputs,
+                              faabric_datatype_t* datatype,
+                              int count)
+{
+    bool isRendezvous = isMpiRendezvousEnabled();
+    if (!isRendezvous && !isMpiDerivedType(datatype)) {
+        return;
+    }
+
+    faabric_datatype_t type = *datatype;
+    addMpiRecvCompletion(
+      requestId, [outputs, type, count, isRendezvous]() mutable {
+          if (isRendezvous) {
+              recvMpiRendezvous(outputs->data(), &type, count, nullptr);
+          }
+
+          outputs->unpack();
+      });
+}
+
+MpiCore::MpiCore(MpiWorld& worldIn, int rankIn)
+  : world(worldIn)
+  , rank(rankIn)
+{}
+
+MpiCommunicator& MpiCore::getCommunicator(int commId)
+{
+    if (commId != FAABRIC_COMM_WORLD) {
+        return getMpiCommunicator(world, rank, commId);
+    }
+
+    if (worldComm == nullptr) {
+        worldComm = &getMpiCommunicator(world, rank, FAABRIC_COMM_WORLD);
+    }
+
+    return *worldComm;
+}
+
+void MpiCore::send(uint8_t* buffer,
+                   int count,
+                   faabric_datatype_t* datatype,
+                   int destRank,
+                   int commId)
+{
+    awaitMpiCollectives();
+
+    int worldDestRank = getCommunicator(commId).getWorldRank(destRank);
+    recordMpiSend(worldDestRank, count * datatype->size);
+
+    MpiTypeBuffer inputs(buffer, datatype, count);
+    inputs.pack();
+    if (!sendMpiRendezvous(
+          world, rank, worldDestRank, inputs.data(), datatype, count)) {
+        world.send(rank, worldDestRank, inputs.data(), datatype, count);
+    }
+}
+
+void MpiCore::recv(uint8_t* buffer,
+                   int count,
+                   faabric_datatype_t* datatype,
+                   int sourceRank,
+                   int commId,
+                   MPI_Status* status)
+{
+    awaitMpiCollectives();
+
+    MpiCommunicator& comm = getCommunicator(commId);
+
+    MpiTypeBuffer outputs(buffer, datatype, count);
+    {
+        MpiWaitTimer waitTimer;
+        world.recv(comm.getWorldRank(sourceRank),
+                   rank,
+                   outputs.data(),
+                   datatype,
+                   count,
+                   status);
+        recvMpiRendezvous(outputs.data(), datatype, count, status);
+    }
+    outputs.unpack();
+    recordMpiBytes(count * datatype->size);
+
+    status->MPI_SOURCE = comm.getCommRank(status->MPI_SOURCE);
+}
+
+int MpiCore::isend(uint8_t* buffer,
+                   int count,
+                   faabric_datatype_t* datatype,
+                   int destRank,
+                   int commId)
+{
+    awaitMpiCollectives();
+
+    int worldDestRank = getCommunicator(commId).getWorldRank(destRank);
+    recordMpiSend(worldDestRank, count * datatype->size);
+
+    // Faabric copies the data into the message straight away
+    MpiTypeBuffer inputs(buffer, datatype, count);
+    inputs.pack();
+    int requestId =
+      world.isend(rank, worldDestRank, inputs.data(), datatype, count);
+    addMpiSendRequest(requestId);
+
+    return requestId;
+}
+
+int MpiCore::irecv(uint8_t* buffer,
+                   int count,
+                   faabric_datatype_t* datatype,
+                   int sourceRank,
+                   int commId)
+{
+    awaitMpiCollectives();
+
+    int worldSourceRank = getCommunicator(commId).getWorldRank(sourceRank);
+    recordMpiBytes(count * datatype->size);
+
+    auto outputs = std::make_shared<MpiTypeBuffer>(buffer, datatype, count);
+    int requestId =
+      world.irecv(worldSourceRank, rank, outputs->data(), datatype, count);
+    addMpiRecvOutputs(requestId, outputs, datatype, count);
+
+    return requestId;
+}
+
+int MpiCore::sendInit(uint8_t* buffer,
+                      int count,
+                      faabric_datatype_t* datatype,
+                      int destRank,
+                      int commId)
+{
+    int worldDestRank = getCommunicator(commId).getWorldRank(destRank);
+
+    // The guest may free its datatype before starting the request, and the
+    // packing buffer is reused on every start
+    auto inputs = std::make_shared<MpiTypeBuffer>(buffer, datatype, count);
+    faabric_datatype_t type = *datatype;
+
+    return addMpiPersistentRequest(
+      [&world = world, rank = rank, worldDestRank, inputs, type,
+       count]() mutable {
+          awaitMpiCollectives();
+          recordMpiSend(worldDestRank, count * type.size);
+
+          inputs->pack();
+          int requestId =
+            world.isend(rank, worldDestRank, inputs->data(), &type, count);
+          addMpiSendRequest(requestId);
+
+          return requestId;
+      });
+}
+
+int MpiCore::recvInit(uint8_t* buffer,
+                      int count,
+                      faabric_datatype_t* datatype,
+                      int sourceRank,
+                      int commId)
+{
+    int worldSourceRank = getCommunicator(commId).getWorldRank(sourceRank);
+
+    auto outputs = std::make_shared<MpiTypeBuffer>(buffer, datatype, count);
+    faabric_datatype_t type = *datatype;
+
+    return addMpiPersistentRequest(
+      [&world = world, rank = rank, worldSourceRank, outputs, type,
+       count]() mutable {
+          awaitMpiCollectives();
+          recordMpiBytes(count * type.size);
+
+          int requestId =
+            world.irecv(worldSourceRank, rank, outputs->data(), &type, count);
+          addMpiRecvOutputs(requestId, outputs, &type, count);
+
+          return requestId;
+      });
+}
+
+void MpiCore::sendRecv(uint8_t* sendBuf,
+                       int sendCount,
+                       faabric_datatype_t* sendType,
+                       int destRank,
+                       uint8_t* recvBuf,
+                       int recvCount,
+                       faabric_datatype_t* recvType,
+                       int sourceRank,
+                       int commId,
+                       MPI_Status* status)
+{
+    awaitMpiCollectives();
+
+    MpiCommunicator& comm = getCommunicator(commId);
+    recordMpiSend(comm.getWorldRank(destRank), sendCount * sendType->size);
+    recordMpiBytes(recvCount * recvType->size);
+
+    MpiTypeBuffer inputs(sendBuf, sendType, sendCount);
+    MpiTypeBuffer outputs(recvBuf, recvType, recvCount);
+
+    inputs.pack();
+    {
+        MpiWaitTimer waitTimer;
+        world.sendRecv(inputs.data(),
+                       sendCount,
+                       sendType,
+                       comm.getWorldRank(destRank),
+                       outputs.data(),
+                       recvCount,
+                       recvType,
+                       comm.getWorldRank(sourceRank),
+                       rank,
+                       status);
+        recvMpiRendezvous(outputs.data(), recvType, recvCount, status);
+    }
+    outputs.unpack();
+
+    status->MPI_SOURCE = comm.getCommRank(status->MPI_SOURCE);
+}
+
+void MpiCore::broadcast(uint8_t* buffer,
+                        int count,
+                        faabric_datatype_t* datatype,
+                        int root,
+                        int commId)
+{
+    awaitMpiCollectives();
+
+    MpiCommunicator& comm = getCommunicator(commId);
+    MpiTypeBuffer data(buffer, datatype, count);
+    recordMpiBytes(count * datatype->size);
+
+    bool isRoot = comm.getRank() == root;
+    if (isRoot) {
+        data.pack();
+    }
+
+    // Collectives can't finish before the other ranks get to them, so all their
+    // time counts as waiting
+    MpiWaitTimer waitTimer;
+
+    // Our communicators do the shared-memory collectives, so the world uses
+    // its communicator for them too
+    if (commId != FAABRIC_COMM_WORLD || isMpiShmCollectivesEnabled()) {
+        comm.broadcast(world, root, data.data(), datatype, count);
+    } else {
+        world.broadcast(
+          root, rank, data.data(), datatype, count, MPIMessage::BROADCAST);
+    }
+
+    if (!isRoot) {
+        data.unpack();
+    }
+}
+
+void MpiCore::barrier(int commId)
+{
+    awaitMpiCollectives();
+
+    MpiWaitTimer waitTimer;
+
+    if (commId != FAABRIC_COMM_WORLD) {
+        getCommunicator(commId).barrier(world);
+        return;
+    }
+
+    world.barrier(rank);
+}
+
+void MpiCore::reduce(uint8_t* sendBuf,
+                     uint8_t* recvBuf,
+                     int count,
+                     faabric_datatype_t* datatype,
+                     faabric_op_t* op,
+                     int root,
+                     int commId)
+{
+    awaitMpiCollectives();
+
+    if (sendBuf == nullptr) {
+        sendBuf = recvBuf;
+    }
+
+    recordMpiBytes(count * datatype->size);
+    MpiWaitTimer waitTimer;
+
+    if (commId != FAABRIC_COMM_WORLD || isMpiShmCollectivesEnabled()) {
+        getCommunicator(commId).reduce(
+          world, root, sendBuf, recvBuf, datatype, count, op);
+        return;
+    }
+
+    world.reduce(rank, root, sendBuf, recvBuf, datatype, count, op);
+}
+
+void MpiCore::allReduce(uint8_t* sendBuf,
+                        uint8_t* recvBuf,
+                        int count,
+                        faabric_datatype_t* datatype,
+                        faabric_op_t* op,
+                        int commId)
+{
+    awaitMpiCollectives();
+
+    if (sendBuf == nullptr) {
+        sendBuf = recvBuf;
+    }
+
+    recordMpiBytes(count * datatype->size);
+    MpiWaitTimer waitTimer;
+
+    if (commId != FAABRIC_COMM_WORLD || isMpiShmCollectivesEnabled()) {
+        getCommunicator(commId).allReduce(
+          world, sendBuf, recvBuf, datatype, count, op);
+        return;
+    }
+
+    world.allReduce(rank, sendBuf, recvBuf, datatype, count, op);
+}
+
+void MpiCore::allGather(uint8_t* sendBuf,
+                        int sendCount,
+                        faabric_datatype_t* sendType,
+                        uint8_t* recvBuf,
+                        int recvCount,
+                        faabric_datatype_t* recvType,
+                        int commId)
+{
+    awaitMpiCollectives();
+
+    recordMpiBytes(recvCount * recvType->size);
+    MpiWaitTimer waitTimer;
+
+    if (commId != FAABRIC_COMM_WORLD) {
+        MpiCommunicator& comm = getCommunicator(commId);
+
+        // In-place, our block is already in the receive buffer
+        if (sendBuf == nullptr) {
+            sendBuf = recvBuf + comm.getRank() * recvCount * recvType->size;
+        }
+
+        comm.allGather(world, sendBuf, recvBuf, recvType, recvCount);
+        return;
+    }
+
+    // Faabric takes the send buffer being the receive buffer as in-place
+    if (sendBuf == nullptr) {
+        sendBuf = recvBuf;
+    }
+
+    world.allGather(
+      rank, sendBuf, sendType, sendCount, recvBuf, recvType, recvCount);
+}
+
+void MpiCore::allToAll(uint8_t* sendBuf,
+                       int sendCount,
+                       faabric_datatype_t* sendType,
+                       uint8_t* recvBuf,
+                       int recvCount,
+                       faabric_datatype_t* recvType)
+{
+    awaitMpiCollectives();
+
+    recordMpiBytes(recvCount * recvType->size);
+    MpiWaitTimer waitTimer;
+
+    world.allToAll(
+      rank, sendBuf, sendType, sendCount, recvBuf, recvType, recvCount);
+}
+
+int MpiCore::ibroadcast(uint8_t* buffer,
+                        int count,
+                        faabric_datatype_t* datatype,
+                        int root,
+                        int commId)
+{
+    MpiCommunicator& comm = getCommunicator(commId);
+    recordMpiBytes(count * datatype->size);
+
+    auto data = std::make_shared<MpiTypeBuffer>(buffer, datatype, count);
+    bool isRoot = comm.getRank() == root;
+    if (isRoot) {
+        data->pack();
+    }
+
+    // The guest's handles may be freed before the collective runs, so it gets
+    // its own copies
+    bool useComm =
+      commId != FAABRIC_COMM_WORLD || isMpiShmCollectivesEnabled();
+    faabric_datatype_t type = *datatype;
+
+    return startMpiCollective(
+      [&world = world, &comm, rank = rank, data, type, count, root, isRoot,
+       useComm]() mutable {
+          if (useComm) {
+              comm.broadcast(world, root, data->data(), &type, count);
+          } else {
+              world.broadcast(
+                root, rank, data->data(), &type, count, MPIMessage::BROADCAST);
+          }
+
+          if (!isRoot) {
+              data->unpack();
+          }
+      });
+}
+
+int MpiCore::iallReduce(uint8_t* sendBuf,
+                        uint8_t* recvBuf,
+                        int count,
+                        faabric_datatype_t* datatype,
+                        faabric_op_t* op,
+                        int commId)
+{
+    if (sendBuf == nullptr) {
+        sendBuf = recvBuf;
+    }
+
+    MpiCommunicator& comm = getCommunicator(commId);
+    recordMpiBytes(count * datatype->size);
+
+    bool useComm =
+      commId != FAABRIC_COMM_WORLD || isMpiShmCollectivesEnabled();
+    faabric_datatype_t type = *datatype;
+    faabric_op_t hostOp = *op;
+
+    return startMpiCollective(
+      [&world = world, &comm, rank = rank, sendBuf, recvBuf, count, type,
+       hostOp, useComm]() mutable {
+          if (useComm) {
+              comm.allReduce(world, sendBuf, recvBuf, &type, count, &hostOp);
+          } else {
+              world.allReduce(rank, sendBuf, recvBuf, &type, count, &hostOp);
+          }
+      });
+}
+
+int MpiCore::iallToAll(uint8_t* sendBuf,
+                       int sendCount,
+                       faabric_datatype_t* sendType,
+                       uint8_t* recvBuf,
+                       int recvCount,
+                       faabric_datatype_t* recvType)
+{
+    recordMpiBytes(recvCount * recvType->size);
+
+    faabric_datatype_t hostSendType = *sendType;
+    faabric_datatype_t hostRecvType = *recvType;
+
+    return startMpiCollective(
+      [&world = world, rank = rank, sendBuf, sendCount, hostSendType, recvBuf,
+       recvCount, hostRecvType]() mutable {
+          world.allToAll(rank,
+                         sendBuf,
+                         &hostSendType,
+                         sendCount,
+                         recvBuf,
+                         &hostRecvType,
+                         recvCount);
+      });
+}
+
+void MpiCore::fileWriteAtAll(int fileId,
+                             int64_t offset,
+                             uint8_t* buffer,
+                             int count,
+                             faabric_datatype_t* datatype,
+                             MPI_Status* status)
+{
+    MpiTypeBuffer inputs(buffer, datatype, count);
+    inputs.pack();
+
+    size_t nBytes = (size_t)count * datatype->size;
+    recordMpiBytes(nBytes);
+    status->bytesSize =
+      getMpiFile(fileId).writeAtAll(offset, inputs.data(), nBytes);
+}
+
+void MpiCore::fileReadAtAll(int fileId,
+                            int64_t offset,
+                            uint8_t* buffer,
+                            int count,
+                            faabric_datatype_t* datatype,
+                            MPI_Status* status)
+{
+    MpiTypeBuffer outputs(buffer, datatype, count);
+
+    size_t nBytes = (size_t)count * datatype->size;
+    status->bytesSize =
+      getMpiFile(fileId).readAtAll(offset, outputs.data(), nBytes);
+    outputs.unpack();
+    recordMpiBytes(status->bytesSize);
+}
+
+void MpiCore::finalize()
+{
+    finishMpiRequests(world);
+    clearMpiFiles();
+    clearMpiCommunicators();
+    clearMpiMemory();
+    clearMpiUserOps();
+    clearMpiDerivedTypes();
+    clearMpiWindows();
+    worldComm = nullptr;
+
+    world.destroy();
+}
+
+static thread_local uint64_t contextEpoch = 0;
+
+void invalidateMpiContext()
+{
+    // Collectives in flight still use the communicators' hosts
+    awaitMpiCollectives();
+
+    contextEpoch++;
+    resetMpiCommunicatorHosts();
+}
+
+uint64_t getMpiContextEpoch()
+{
+    return contextEpoch;
+}
+}
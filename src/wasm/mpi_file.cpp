@@ -0,0 +1,504 @@
+#include <wasm/mpi_comm.h>
+#include <wasm/mpi_file.h>
+#include <wasm/mpi_progress.h>
+
+#include <storage/SharedFiles.h>
+
+#include <faabric/util/gids.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+
+using namespace faabric::mpi;
+
+namespace wasm {
+
+// Data goes between ranks in chunks, as message counts are ints
+static const size_t MPI_FILE_CHUNK_BYTES = 64 * 1024 * 1024;
+
+static void sendHeader(MpiWorld& world, int from, int to, int64_t a, int64_t b)
+{
+    int64_t header[2] = { a, b };
+    world.send(from, to, reinterpret_cast<uint8_t*>(header), MPI_LONG_LONG, 2);
+}
+
+static std::pair<int64_t, int64_t> recvHeader(MpiWorld& world,
+                                              int from,
+                                              int to)
+{
+    int64_t header[2] = { 0, 0 };
+    MPI_Status status{};
+    world.recv(
+      from, to, reinterpret_cast<uint8_t*>(header), MPI_LONG_LONG, 2, &status);
+
+    return { header[0], header[1] };
+}
+
+static void sendBytes(MpiWorld& world,
+                      int from,
+                      int to,
+                      const uint8_t* data,
+                      size_t nBytes)
+{
+    for (size_t sent = 0; sent < nBytes; sent += MPI_FILE_CHUNK_BYTES) {
+        size_t chunk = std::min(MPI_FILE_CHUNK_BYTES, nBytes - sent);
+        world.send(from, to, data + sent, MPI_BYTE, (int)chunk);
+    }
+}
+
+static void recvBytes(MpiWorld& world,
+                      int from,
+                      int to,
+                      uint8_t* buffer,
+                      size_t nBytes)
+{
+    for (size_t recvd = 0; recvd < nBytes; recvd += MPI_FILE_CHUNK_BYTES) {
+        size_t chunk = std::min(MPI_FILE_CHUNK_BYTES, nBytes - recvd);
+        MPI_Status status{};
+        world.recv(from, to, buffer + recvd, MPI_BYTE, (int)chunk, &status);
+    }
+}
+
+// Reads as much as there is, up to the end of the file
+static size_t readFully(int fd, int64_t offset, uint8_t* buffer, size_t nBytes)
+{
+    size_t nRead = 0;
+    while (nRead < nBytes) {
+        ssize_t res =
+          ::pread(fd, buffer + nRead, nBytes - nRead, offset + nRead);
+        if (res < 0) {
+            SPDLOG_ERROR(
+              "Failed to read MPI file ({} - {})", errno, strerror(errno));
+            throw std::runtime_error("Failed to read MPI file");
+        }
+
+        if (res == 0) {
+            break;
+        }
+
+        nRead += res;
+    }
+
+    return nRead;
+}
+
+struct MpiFilePiece
+{
+    int64_t offset;
+    uint8_t* data;
+    size_t nBytes;
+};
+
+MpiFile::MpiFile(MpiWorld& worldIn,
+                 int worldRankIn,
+                 int commIdIn,
+                 const std::string& pathIn,
+                 int amodeIn)
+  : world(worldIn)
+  , worldRank(worldRankIn)
+  , commId(commIdIn)
+  , path(pathIn)
+  , amode(amodeIn)
+{
+    if (!storage::SharedFiles::isPathShared(path)) {
+        SPDLOG_ERROR("MPI-IO on {} not supported, only on shared files", path);
+        throw std::runtime_error("MPI-IO only supported on shared files");
+    }
+
+    if ((amode & MPI_MODE_SEQUENTIAL) != 0) {
+        SPDLOG_ERROR("Sequential MPI file {} not supported", path);
+        throw std::runtime_error("Sequential MPI files not supported");
+    }
+
+    awaitMpiCollectives();
+
+    MpiCommunicator& comm = getMpiCommunicator(world, worldRank, commId);
+    hostMembers = comm.getHostMembers(world);
+    isAggregator = hostMembers.front() == comm.getRank();
+    realPath = storage::SharedFiles::realPathForSharedFile(path);
+
+    // The aggregator makes sure the host's copy is there before the rest
+    // open it. Only it writes, but reads are how it gets data to upload.
+    if (isAggregator) {
+        bool exists = storage::SharedFiles::syncSharedFile(path) == 0;
+        if (exists && (amode & MPI_MODE_EXCL) != 0) {
+            SPDLOG_ERROR("MPI file {} exists, but opened exclusively", path);
+            throw std::runtime_error("MPI file already exists");
+        }
+
+        if (!exists && (amode & MPI_MODE_CREATE) == 0) {
+            SPDLOG_ERROR("MPI file {} doesn't exist", path);
+            throw std::runtime_error("MPI file doesn't exist");
+        }
+
+        if (!exists) {
+            std::filesystem::create_directories(
+              std::filesystem::path(realPath).parent_path());
+        }
+
+        bool writable = (amode & MPI_MODE_RDONLY) == 0;
+        openFile(writable ? O_RDWR | O_CREAT : O_RDONLY);
+    }
+
+    comm.barrier(world);
+
+    if (!isAggregator) {
+        openFile(O_RDONLY);
+    }
+}
+
+void MpiFile::openFile(int flags)
+{
+    fd = ::open(realPath.c_str(), flags, 0644);
+    if (fd < 0) {
+        SPDLOG_ERROR("Failed to open MPI file {} at {} ({} - {})",
+                     path,
+                     realPath,
+                     errno,
+                     strerror(errno));
+        throw std::runtime_error("Failed to open MPI file");
+    }
+}
+
+MpiFile::~MpiFile()
+{
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+void MpiFile::checkWritable() const
+{
+    if ((amode & MPI_MODE_RDONLY) != 0) {
+        SPDLOG_ERROR("Writing to read-only MPI file {}", path);
+        throw std::runtime_error("Writing to read-only MPI file");
+    }
+}
+
+void MpiFile::writeRun(int64_t offset, const std::vector<iovec>& run)
+{
+    size_t idx = 0;
+    size_t skip = 0;
+    while (idx < run.size()) {
+        size_t nIovs = std::min<size_t>(run.size() - idx, IOV_MAX);
+        std::vector<iovec> iovs(run.begin() + idx, run.begin() + idx + nIovs);
+        iovs.front().iov_base = (uint8_t*)iovs.front().iov_base + skip;
+        iovs.front().iov_len -= skip;
+
+        ssize_t res = ::pwritev(fd, iovs.data(), (int)iovs.size(), offset);
+        if (res < 0) {
+            SPDLOG_ERROR("Failed to write MPI file {} ({} - {})",
+                         path,
+                         errno,
+                         strerror(errno));
+            throw std::runtime_error("Failed to write MPI file");
+        }
+
+        // Moves past what was written, which may end part way into a piece
+        offset += res;
+        size_t written = res + skip;
+        while (idx < run.size() && written >= run.at(idx).iov_len) {
+            written -= run.at(idx).iov_len;
+            idx++;
+        }
+        skip = written;
+    }
+}
+
+size_t MpiFile::writeAtAll(int64_t offset, const uint8_t* data, size_t nBytes)
+{
+    checkWritable();
+    awaitMpiCollectives();
+
+    MpiCommunicator& comm = getMpiCommunicator(world, worldRank, commId);
+    if (!isAggregator) {
+        int aggregator = comm.getWorldRank(hostMembers.front());
+        sendHeader(world, worldRank, aggregator, offset, nBytes);
+        sendBytes(world, worldRank, aggregator, data, nBytes);
+        return nBytes;
+    }
+
+    std::vector<MpiFilePiece> pieces;
+    pieces.push_back({ offset, const_cast<uint8_t*>(data), nBytes });
+
+    std::vector<std::vector<uint8_t>> received(hostMembers.size() - 1);
+    for (size_t i = 1; i < hostMembers.size(); i++) {
+        int member = comm.getWorldRank(hostMembers.at(i));
+        auto [memberOffset, memberBytes] = recvHeader(world, member, worldRank);
+
+        std::vector<uint8_t>& buffer = received.at(i - 1);
+        buffer.resize(memberBytes);
+        recvBytes(world, member, worldRank, buffer.data(), memberBytes);
+        pieces.push_back({ memberOffset, buffer.data(), buffer.size() });
+    }
+
+    std::sort(pieces.begin(),
+              pieces.end(),
+              [](const MpiFilePiece& a, const MpiFilePiece& b) {
+                  return a.offset < b.offset;
+              });
+
+    // Pieces that follow on from each other go in one write
+    size_t nRuns = 0;
+    for (size_t i = 0; i < pieces.size();) {
+        int64_t runStart = pieces.at(i).offset;
+        int64_t runEnd = runStart;
+        std::vector<iovec> run;
+        for (; i < pieces.size() && pieces.at(i).offset == runEnd; i++) {
+            if (pieces.at(i).nBytes > 0) {
+                run.push_back({ pieces.at(i).data, pieces.at(i).nBytes });
+            }
+            runEnd += pieces.at(i).nBytes;
+        }
+
+        if (run.empty()) {
+            continue;
+        }
+
+        writeRun(runStart, run);
+        addDirtyRange(runStart, runEnd);
+        nRuns++;
+    }
+
+    SPDLOG_TRACE("MPI-{} wrote {} pieces to {} in {} writes",
+                 worldRank,
+                 pieces.size(),
+                 path,
+                 nRuns);
+
+    return nBytes;
+}
+
+size_t MpiFile::readAtAll(int64_t offset, uint8_t* buffer, size_t nBytes)
+{
+    awaitMpiCollectives();
+
+    MpiCommunicator& comm = getMpiCommunicator(world, worldRank, commId);
+    if (!isAggregator) {
+        int aggregator = comm.getWorldRank(hostMembers.front());
+        sendHeader(world, worldRank, aggregator, offset, nBytes);
+
+        size_t nRead = recvHeader(world, aggregator, worldRank).first;
+        recvBytes(world, aggregator, worldRank, buffer, nRead);
+        return nRead;
+    }
+
+    // The aggregator's own piece is first, then each member's in order
+    std::vector<MpiFilePiece> pieces;
+    pieces.push_back({ offset, buffer, nBytes });
+    for (size_t i = 1; i < hostMembers.size(); i++) {
+        int member = comm.getWorldRank(hostMembers.at(i));
+        auto [memberOffset, memberBytes] = recvHeader(world, member, worldRank);
+        pieces.push_back({ memberOffset, nullptr, (size_t)memberBytes });
+    }
+
+    std::vector<size_t> order(pieces.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order.at(i) = i;
+    }
+    std::sort(order.begin(), order.end(), [&pieces](size_t a, size_t b) {
+        return pieces.at(a).offset < pieces.at(b).offset;
+    });
+
+    // Pieces that touch or overlap come from one read
+    std::vector<size_t> nRead(pieces.size(), 0);
+    std::vector<std::vector<uint8_t>> results(pieces.size());
+    for (size_t i = 0; i < order.size();) {
+        int64_t spanStart = pieces.at(order.at(i)).offset;
+        int64_t spanEnd = spanStart;
+        size_t first = i;
+        for (; i < order.size() && pieces.at(order.at(i)).offset <= spanEnd;
+             i++) {
+            const MpiFilePiece& piece = pieces.at(order.at(i));
+            spanEnd = std::max<int64_t>(spanEnd, piece.offset + piece.nBytes);
+        }
+
+        std::vector<uint8_t> span(spanEnd - spanStart);
+        size_t spanRead = readFully(fd, spanStart, span.data(), span.size());
+
+        for (size_t j = first; j < i; j++) {
+            size_t idx = order.at(j);
+            const MpiFilePiece& piece = pieces.at(idx);
+            size_t start = piece.offset - spanStart;
+            size_t n = start < spanRead
+                         ? std::min(piece.nBytes, spanRead - start)
+                         : 0;
+
+            nRead.at(idx) = n;
+            if (idx == 0) {
+                std::copy(span.data() + start, span.data() + start + n, buffer);
+            } else {
+                results.at(idx).assign(span.data() + start,
+                                       span.data() + start + n);
+            }
+        }
+    }
+
+    for (size_t i = 1; i < hostMembers.size(); i++) {
+        int member = comm.getWorldRank(hostMembers.at(i));
+        sendHeader(world, worldRank, member, nRead.at(i), 0);
+        sendBytes(
+          world, worldRank, member, results.at(i).data(), results.at(i).size());
+    }
+
+    return nRead.at(0);
+}
+
+int64_t MpiFile::getSize()
+{
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        SPDLOG_ERROR("Failed to stat MPI file {} ({} - {})",
+                     path,
+                     errno,
+                     strerror(errno));
+        throw std::runtime_error("Failed to stat MPI file");
+    }
+
+    return st.st_size;
+}
+
+void MpiFile::addDirtyRange(int64_t start, int64_t end)
+{
+    // Merges with any ranges it touches
+    auto it = dirtyRanges.upper_bound(start);
+    if (it != dirtyRanges.begin() && std::prev(it)->second >= start) {
+        it--;
+        start = it->first;
+    }
+
+    while (it != dirtyRanges.end() && it->first <= end) {
+        end = std::max(end, it->second);
+        it = dirtyRanges.erase(it);
+    }
+
+    dirtyRanges[start] = end;
+}
+
+void MpiFile::sendDirtyRanges(int rootWorldRank)
+{
+    sendHeader(world, worldRank, rootWorldRank, dirtyRanges.size(), 0);
+
+    std::vector<uint8_t> buffer;
+    for (const auto& [start, end] : dirtyRanges) {
+        buffer.resize(end - start);
+        readFully(fd, start, buffer.data(), buffer.size());
+
+        sendHeader(world, worldRank, rootWorldRank, start, end);
+        sendBytes(
+          world, worldRank, rootWorldRank, buffer.data(), buffer.size());
+    }
+}
+
+void MpiFile::recvDirtyRanges(int leaderWorldRank)
+{
+    int64_t nRanges = recvHeader(world, leaderWorldRank, worldRank).first;
+
+    std::vector<uint8_t> buffer;
+    for (int64_t i = 0; i < nRanges; i++) {
+        auto [start, end] = recvHeader(world, leaderWorldRank, worldRank);
+
+        buffer.resize(end - start);
+        recvBytes(
+          world, leaderWorldRank, worldRank, buffer.data(), buffer.size());
+        writeRun(start, { { buffer.data(), buffer.size() } });
+        addDirtyRange(start, end);
+    }
+}
+
+void MpiFile::close()
+{
+    awaitMpiCollectives();
+
+    MpiCommunicator& comm = getMpiCommunicator(world, worldRank, commId);
+    bool isRoot = comm.getRank() == 0;
+    bool writable = (amode & MPI_MODE_RDONLY) == 0;
+
+    // Each other host's aggregator sends what it wrote to the first rank
+    if (writable && isRoot) {
+        for (int leader : comm.getHostLeaders(world)) {
+            if (leader != 0) {
+                recvDirtyRanges(comm.getWorldRank(leader));
+            }
+        }
+    } else if (writable && isAggregator) {
+        sendDirtyRanges(comm.getWorldRank(0));
+    }
+
+    ::close(fd);
+    fd = -1;
+
+    if (isRoot && (amode & MPI_MODE_DELETE_ON_CLOSE) != 0) {
+        storage::SharedFiles::deleteSharedFile(path);
+        std::filesystem::remove(realPath);
+    } else if (isRoot && !dirtyRanges.empty()) {
+        SPDLOG_DEBUG("MPI-{} uploading {} after {} ranges written",
+                     worldRank,
+                     path,
+                     dirtyRanges.size());
+        storage::SharedFiles::updateSharedFile(path);
+    }
+
+    // Other hosts' copies are now out of date, so are fetched again on open.
+    // The first rank is its host's aggregator, so other aggregators are on
+    // other hosts.
+    comm.barrier(world);
+    if (writable && isAggregator && !isRoot) {
+        std::filesystem::remove(realPath);
+        storage::SharedFiles::clearCacheForSharedFile(path);
+    }
+
+    dirtyRanges.clear();
+}
+
+static thread_local std::unordered_map<int, std::unique_ptr<MpiFile>> files;
+
+int openMpiFile(MpiWorld& world,
+                int worldRank,
+                int commId,
+                const std::string& path,
+                int amode)
+{
+    int fileId = (int)faabric::util::generateGid();
+    files.emplace(fileId,
+                  std::make_unique<MpiFile>(
+                    world, worldRank, commId, path, amode));
+
+    return fileId;
+}
+
+MpiFile& getMpiFile(int fileId)
+{
+    auto it = files.find(fileId);
+    if (it == files.end()) {
+        SPDLOG_ERROR("Unknown MPI file {}", fileId);
+        throw std::runtime_error("Unknown MPI file");
+    }
+
+    return *it->second;
+}
+
+void closeMpiFile(int fileId)
+{
+    getMpiFile(fileId).close();
+    files.erase(fileId);
+}
+
+void clearMpiFiles()
+{
+    files.clear();
+}
+}
@@ -0,0 +1,108 @@
+#include <wasm/WasmExecutionContext.h>
+#include <wasm/mpi_mem.h>
+
+#include <faabric/util/logging.h>
+
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <sys/mman.h>
+
+namespace wasm {
+
+// Transparent huge pages are only used for aligned 2MiB stretches
+static const size_t HUGE_PAGE_BYTES = 2 * 1024 * 1024;
+
+// The calling rank's regions, as offset to length
+static thread_local std::map<uint32_t, size_t> mpiMemRegions;
+
+static size_t alignToHugePage(size_t n)
+{
+    return (n + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+}
+
+static void lockMpiMemory(uint8_t* ptr, size_t nBytes)
+{
+    // Neither is fatal, e.g. THP may be off or RLIMIT_MEMLOCK too low
+    if (madvise(ptr, nBytes, MADV_HUGEPAGE) != 0) {
+        SPDLOG_DEBUG("Failed to advise huge pages for MPI memory ({} - {})",
+                     errno,
+                     strerror(errno));
+    }
+
+    if (mlock(ptr, nBytes) != 0) {
+        SPDLOG_DEBUG("Failed to lock {} bytes of MPI memory ({} - {})",
+                     nBytes,
+                     errno,
+                     strerror(errno));
+    }
+}
+
+uint32_t allocMpiMemory(WasmModule& module, size_t nBytes)
+{
+    if (nBytes == 0) {
+        nBytes = 1;
+    }
+
+    // Smaller regions wouldn't get a huge page anyway, so aren't padded out
+    size_t regionBytes = roundUpToWasmPageAligned(nBytes);
+    size_t padBytes = 0;
+    if (regionBytes >= HUGE_PAGE_BYTES) {
+        regionBytes = alignToHugePage(regionBytes);
+
+        uintptr_t end =
+          (uintptr_t)module.getMemoryBase() + module.getMemorySizeBytes();
+        padBytes = alignToHugePage(end) - end;
+    }
+
+    uint32_t offset = module.growMemory(padBytes + regionBytes) + padBytes;
+    mpiMemRegions[offset] = regionBytes;
+
+    lockMpiMemory(module.getMemoryBase() + offset, regionBytes);
+
+    SPDLOG_TRACE("Allocated {} bytes of MPI memory at {}", regionBytes, offset);
+
+    return offset;
+}
+
+void freeMpiMemory(WasmModule& module, uint32_t offset)
+{
+    auto it = mpiMemRegions.find(offset);
+    if (it == mpiMemRegions.end()) {
+        SPDLOG_ERROR("Freeing unknown MPI memory at {}", offset);
+        throw std::runtime_error("Freeing unknown MPI memory");
+    }
+
+    munlock(module.getMemoryBase() + offset, it->second);
+    mpiMemRegions.erase(it);
+}
+
+bool isMpiMemory(const uint8_t* buffer, size_t nBytes)
+{
+    WasmModule* module = getExecutingModule();
+    if (module == nullptr || mpiMemRegions.empty()) {
+        return false;
+    }
+
+    const uint8_t* base = module->getMemoryBase();
+    const uint8_t* top = base + module->getMemorySizeBytes();
+    if (buffer < base || buffer + nBytes > top) {
+        return false;
+    }
+
+    uint32_t offset = buffer - base;
+    auto it = mpiMemRegions.upper_bound(offset);
+    if (it == mpiMemRegions.begin()) {
+        return false;
+    }
+
+    it--;
+    return offset + nBytes <= it->first + it->second;
+}
+
+void clearMpiMemory()
+{
+    mpiMemRegions.clear();
+}
+}
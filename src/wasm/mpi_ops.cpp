@@ -0,0 +1,52 @@
+#include <wasm/mpi_ops.h>
+
+#include <faabric/util/logging.h>
+
+#include <stdexcept>
+#include <unordered_map>
+
+namespace wasm {
+
+// Operators belong to the calling rank's thread
+static thread_local std::unordered_map<int, MpiUserOp> userOps;
+
+static thread_local int nextUserOpId = FAASM_MPI_USER_OP_BASE;
+
+int createMpiUserOp(int32_t funcPtr, bool commute)
+{
+    int opId = nextUserOpId++;
+    userOps[opId] = { funcPtr, commute };
+
+    SPDLOG_DEBUG(
+      "Created MPI user op {} (func {}, commute {})", opId, funcPtr, commute);
+
+    return opId;
+}
+
+bool isMpiUserOp(int opId)
+{
+    return opId >= FAASM_MPI_USER_OP_BASE;
+}
+
+const MpiUserOp& getMpiUserOp(int opId)
+{
+    auto it = userOps.find(opId);
+    if (it == userOps.end()) {
+        SPDLOG_ERROR("MPI user op {} not found", opId);
+        throw std::runtime_error("MPI user op not found");
+    }
+
+    return it->second;
+}
+
+void freeMpiUserOp(int opId)
+{
+    userOps.erase(opId);
+}
+
+void clearMpiUserOps()
+{
+    userOps.clear();
+    nextUserOpId = FAASM_MPI_USER_OP_BASE;
+}
+}
@@ -0,0 +1,215 @@
+#include <conf/FaasmConfig.h>
+#include <wasm/mpi_profile.h>
+#include <wasm/timing.h>
+
+#include <faabric/util/config.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+
+namespace wasm {
+
+static std::mutex profileFileMx;
+
+// Each rank runs on its own thread, so there's no need to lock these
+static thread_local MpiRankProfile threadProfile;
+
+static thread_local uint64_t threadWaitNanos = 0;
+
+static thread_local uint64_t threadBytes = 0;
+
+int getMpiLatencyBucket(uint64_t nanos)
+{
+    int bucket = 0;
+    while (nanos > 1 && bucket < MPI_PROFILE_BUCKETS - 1) {
+        nanos >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+void MpiCallProfile::record(uint64_t callNanos,
+                            uint64_t callWaitNanos,
+                            size_t callBytes)
+{
+    count++;
+    bytes += callBytes;
+    nanos += callNanos;
+    waitNanos += callWaitNanos;
+    histogram[getMpiLatencyBucket(callNanos)]++;
+}
+
+template<typename T>
+static std::string mapToJson(const std::map<int, T>& values)
+{
+    std::string json = "{";
+    for (const auto& [key, value] : values) {
+        if (json.size() > 1) {
+            json += ", ";
+        }
+        json += fmt::format("\"{}\": {}", key, value);
+    }
+
+    return json + "}";
+}
+
+std::string MpiRankProfile::toJson(const std::string& host,
+                                   int32_t worldId,
+                                   int32_t rank) const
+{
+    std::string json =
+      fmt::format("{{\"world\": {}, \"rank\": {}, \"host\": \"{}\", "
+                  "\"calls\": {{",
+                  worldId,
+                  rank,
+                  host);
+
+    bool first = true;
+    for (const auto& [name, call] : calls) {
+        std::map<int, uint64_t> buckets;
+        for (int i = 0; i < MPI_PROFILE_BUCKETS; i++) {
+            if (call.histogram[i] > 0) {
+                buckets[i] = call.histogram[i];
+            }
+        }
+
+        json += fmt::format("{}\"{}\": {{\"count\": {}, \"bytes\": {}, "
+                            "\"ns\": {}, \"wait_ns\": {}, \"log2_ns\": {}}}",
+                            first ? "" : ", ",
+                            name,
+                            call.count,
+                            call.bytes,
+                            call.nanos,
+                            call.waitNanos,
+                            mapToJson(buckets));
+        first = false;
+    }
+
+    json += fmt::format("}}, \"sent_bytes\": {}, \"sent_messages\": {}}}",
+                        mapToJson(sentBytes),
+                        mapToJson(sentMessages));
+    return json;
+}
+
+bool isMpiProfiling()
+{
+    return !conf::getFaasmConfig().mpiProfileFile.empty();
+}
+
+void recordMpiBytes(size_t nBytes)
+{
+    threadBytes += nBytes;
+}
+
+void recordMpiSend(int destWorldRank, size_t nBytes)
+{
+    threadBytes += nBytes;
+
+    if (isMpiProfiling()) {
+        threadProfile.sentBytes[destWorldRank] += nBytes;
+        threadProfile.sentMessages[destWorldRank]++;
+    }
+}
+
+MpiRankProfile takeMpiProfile()
+{
+    MpiRankProfile profile = std::move(threadProfile);
+    threadProfile = MpiRankProfile();
+
+    return profile;
+}
+
+void flushMpiProfile(faabric::Message& msg)
+{
+    // Always take the profile, so nothing carries over to the thread's next
+    // message
+    MpiRankProfile profile = takeMpiProfile();
+    if (!isMpiProfiling() || !msg.ismpi() || profile.empty()) {
+        return;
+    }
+
+    uint64_t totalNanos = 0;
+    uint64_t totalWaitNanos = 0;
+    uint64_t totalBytes = 0;
+    for (const auto& [name, call] : profile.calls) {
+        totalNanos += call.nanos;
+        totalWaitNanos += call.waitNanos;
+        totalBytes += call.bytes;
+    }
+
+    auto& details = *msg.mutable_execgraphdetails();
+    details["mpi-ns"] = std::to_string(totalNanos);
+    details["mpi-wait-ns"] = std::to_string(totalWaitNanos);
+    details["mpi-bytes"] = std::to_string(totalBytes);
+
+    const std::string& filePath = conf::getFaasmConfig().mpiProfileFile;
+    const std::string host = faabric::util::getSystemConfig().endpointHost;
+    SPDLOG_DEBUG("Writing MPI profile for rank {} of world {} to {}",
+                 msg.mpirank(),
+                 msg.mpiworldid(),
+                 filePath);
+
+    faabric::util::UniqueLock lock(profileFileMx);
+    std::ofstream outFs(filePath, std::ios::app);
+    if (!outFs.is_open()) {
+        SPDLOG_ERROR("Failed to open MPI profile file {}", filePath);
+        throw std::runtime_error("Failed to open MPI profile file");
+    }
+
+    outFs << profile.toJson(host, msg.mpiworldid(), msg.mpirank())
+          << std::endl;
+}
+
+MpiProfileTimer::MpiProfileTimer(const char* traceStrIn)
+  : traceStr(traceStrIn)
+  , enabled(isMpiProfiling())
+{
+    if (!enabled) {
+        return;
+    }
+
+    startNanos = getTimerNanos();
+    startWaitNanos = threadWaitNanos;
+    startBytes = threadBytes;
+}
+
+MpiProfileTimer::~MpiProfileTimer()
+{
+    if (!enabled) {
+        return;
+    }
+
+    uint64_t elapsed = getTimerNanos() - startNanos;
+
+    // The name is the first word of the trace string, after any "S - "
+    const char* name = traceStr;
+    if (std::strncmp(name, "S - ", 4) == 0) {
+        name += 4;
+    }
+    std::string call(name, std::strcspn(name, " "));
+
+    threadProfile.calls[call].record(elapsed,
+                                     threadWaitNanos - startWaitNanos,
+                                     threadBytes - startBytes);
+}
+
+MpiWaitTimer::MpiWaitTimer()
+  : enabled(isMpiProfiling())
+{
+    if (enabled) {
+        startNanos = getTimerNanos();
+    }
+}
+
+MpiWaitTimer::~MpiWaitTimer()
+{
+    if (enabled) {
+        threadWaitNanos += getTimerNanos() - startNanos;
+    }
+}
+}
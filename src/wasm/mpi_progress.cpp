@@ -0,0 +1,193 @@
+#include <wasm/mpi_progress.h>
+
+#include <faabric/util/gids.h>
+#include <faabric/util/logging.h>
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+namespace wasm {
+
+struct MpiCollectiveRequest
+{
+    std::function<void()> collective;
+    bool done = false;
+    std::exception_ptr error = nullptr;
+};
+
+class MpiProgressThread
+{
+  public:
+    ~MpiProgressThread();
+
+    int start(std::function<void()> collective);
+
+    bool isRequest(int requestId);
+
+    bool isDone(int requestId);
+
+    void await(int requestId);
+
+    void awaitAll();
+
+  private:
+    std::mutex mx;
+    std::condition_variable cv;
+    std::thread thread;
+    bool running = false;
+
+    // Collectives stay at the front until they've finished
+    std::deque<std::shared_ptr<MpiCollectiveRequest>> queue;
+
+    // Only touched by the rank's thread
+    std::unordered_map<int, std::shared_ptr<MpiCollectiveRequest>> requests;
+
+    void run();
+};
+
+MpiProgressThread::~MpiProgressThread()
+{
+    {
+        std::unique_lock<std::mutex> lock(mx);
+        running = false;
+    }
+
+    cv.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+int MpiProgressThread::start(std::function<void()> collective)
+{
+    auto request = std::make_shared<MpiCollectiveRequest>();
+    request->collective = std::move(collective);
+
+    int requestId = (int)faabric::util::generateGid();
+    requests.emplace(requestId, request);
+
+    {
+        std::unique_lock<std::mutex> lock(mx);
+
+        // Only started for ranks that use non-blocking collectives
+        if (!running) {
+            running = true;
+            thread = std::thread(&MpiProgressThread::run, this);
+        }
+
+        queue.push_back(request);
+    }
+    cv.notify_all();
+
+    return requestId;
+}
+
+bool MpiProgressThread::isRequest(int requestId)
+{
+    return requests.count(requestId) > 0;
+}
+
+bool MpiProgressThread::isDone(int requestId)
+{
+    auto it = requests.find(requestId);
+    if (it == requests.end()) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(mx);
+    return it->second->done;
+}
+
+void MpiProgressThread::await(int requestId)
+{
+    auto it = requests.find(requestId);
+    if (it == requests.end()) {
+        SPDLOG_ERROR("Unknown MPI collective request {}", requestId);
+        throw std::runtime_error("Unknown MPI collective request");
+    }
+
+    std::shared_ptr<MpiCollectiveRequest> request = it->second;
+    requests.erase(it);
+
+    {
+        std::unique_lock<std::mutex> lock(mx);
+        cv.wait(lock, [&request] { return request->done; });
+    }
+
+    if (request->error != nullptr) {
+        std::rethrow_exception(request->error);
+    }
+}
+
+void MpiProgressThread::awaitAll()
+{
+    // Only the rank's thread starts the progress thread, so can check this
+    // without the lock, which keeps calls cheap for ranks that never use it
+    if (!running) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mx);
+    cv.wait(lock, [this] { return queue.empty(); });
+}
+
+void MpiProgressThread::run()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    while (true) {
+        cv.wait(lock, [this] { return !running || !queue.empty(); });
+        if (queue.empty()) {
+            return;
+        }
+
+        std::shared_ptr<MpiCollectiveRequest> request = queue.front();
+        lock.unlock();
+
+        try {
+            request->collective();
+        } catch (std::exception& e) {
+            SPDLOG_ERROR("Non-blocking MPI collective failed: {}", e.what());
+            request->error = std::current_exception();
+        }
+
+        lock.lock();
+        request->collective = nullptr;
+        request->done = true;
+        queue.pop_front();
+        cv.notify_all();
+    }
+}
+
+static thread_local MpiProgressThread progressThread;
+
+int startMpiCollective(std::function<void()> collective)
+{
+    return progressThread.start(std::move(collective));
+}
+
+bool isMpiCollectiveRequest(int requestId)
+{
+    return progressThread.isRequest(requestId);
+}
+
+bool isMpiCollectiveDone(int requestId)
+{
+    return progressThread.isDone(requestId);
+}
+
+void awaitMpiCollective(int requestId)
+{
+    progressThread.await(requestId);
+}
+
+void awaitMpiCollectives()
+{
+    progressThread.awaitAll();
+}
+}
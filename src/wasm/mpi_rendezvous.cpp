@@ -0,0 +1,156 @@
+#include <conf/FaasmConfig.h>
+#include <wasm/mpi_mem.h>
+#include <wasm/mpi_rendezvous.h>
+
+#include <faabric/util/config.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace wasm {
+
+static const uint64_t RENDEZVOUS_MAGIC = 0x5a434f5059524456;
+
+// Sent as two MPI_LONG_LONGs, so that any receive of at least two elements
+// can take it
+static const int RENDEZVOUS_MARKER_COUNT = 2;
+
+struct RendezvousMarker
+{
+    uint64_t magic;
+    uint64_t id;
+};
+
+struct PendingRendezvous
+{
+    const uint8_t* data = nullptr;
+    size_t nBytes = 0;
+    bool done = false;
+};
+
+static std::mutex rendezvousMx;
+static std::condition_variable rendezvousCv;
+static std::unordered_map<uint64_t, PendingRendezvous> pendingRendezvous;
+static std::atomic<uint64_t> nextRendezvousId = 1;
+
+bool isMpiRendezvousEnabled()
+{
+    return conf::getFaasmConfig().mpiRendezvousThreshold > 0;
+}
+
+bool sendMpiRendezvous(faabric::mpi::MpiWorld& world,
+                       int sendRank,
+                       int recvRank,
+                       const uint8_t* buffer,
+                       faabric_datatype_t* datatype,
+                       int count)
+{
+    int threshold = conf::getFaasmConfig().mpiRendezvousThreshold;
+    size_t nBytes = (size_t)count * datatype->size;
+    if (!isMpiRendezvousEnabled() || count < RENDEZVOUS_MARKER_COUNT ||
+        nBytes < sizeof(RendezvousMarker)) {
+        return false;
+    }
+
+    // Buffers from MPI_Alloc_mem are declared for communication, so always go
+    if (nBytes < (size_t)threshold && !isMpiMemory(buffer, nBytes)) {
+        return false;
+    }
+
+    const std::string& thisHost = faabric::util::getSystemConfig().endpointHost;
+    if (world.getHostForRank(recvRank) != thisHost) {
+        return false;
+    }
+
+    RendezvousMarker marker = { RENDEZVOUS_MAGIC, nextRendezvousId++ };
+    {
+        faabric::util::UniqueLock lock(rendezvousMx);
+        pendingRendezvous[marker.id] = { buffer, nBytes, false };
+    }
+
+    SPDLOG_TRACE("MPI rendezvous {} of {} bytes from {} to {}",
+                 marker.id,
+                 nBytes,
+                 sendRank,
+                 recvRank);
+
+    world.send(sendRank,
+               recvRank,
+               reinterpret_cast<uint8_t*>(&marker),
+               MPI_LONG_LONG,
+               RENDEZVOUS_MARKER_COUNT);
+
+    // The receiver reads our memory, so we can't return until it's done
+    faabric::util::UniqueLock lock(rendezvousMx);
+    rendezvousCv.wait(lock,
+                      [&marker] { return pendingRendezvous[marker.id].done; });
+    pendingRendezvous.erase(marker.id);
+
+    return true;
+}
+
+bool recvMpiRendezvous(uint8_t* buffer,
+                       faabric_datatype_t* datatype,
+                       int count,
+                       MPI_Status* status)
+{
+    size_t bufferSize = (size_t)count * datatype->size;
+    if (bufferSize < sizeof(RendezvousMarker)) {
+        return false;
+    }
+
+    // The status is sized in the receiver's datatype, whatever was sent
+    if (status != nullptr &&
+        status->bytesSize != RENDEZVOUS_MARKER_COUNT * datatype->size) {
+        return false;
+    }
+
+    RendezvousMarker marker;
+    std::memcpy(&marker, buffer, sizeof(marker));
+    if (marker.magic != RENDEZVOUS_MAGIC) {
+        return false;
+    }
+
+    const uint8_t* data = nullptr;
+    size_t nBytes = 0;
+    {
+        faabric::util::UniqueLock lock(rendezvousMx);
+        auto it = pendingRendezvous.find(marker.id);
+        if (it == pendingRendezvous.end() || it->second.done) {
+            return false;
+        }
+
+        data = it->second.data;
+        nBytes = it->second.nBytes;
+    }
+
+    bool fits = nBytes <= bufferSize;
+    if (fits) {
+        std::memcpy(buffer, data, nBytes);
+        if (status != nullptr) {
+            status->bytesSize = nBytes;
+        }
+    }
+
+    {
+        faabric::util::UniqueLock lock(rendezvousMx);
+        pendingRendezvous[marker.id].done = true;
+    }
+    rendezvousCv.notify_all();
+
+    if (!fits) {
+        SPDLOG_ERROR("MPI message of {} bytes too big for {} byte buffer",
+                     nBytes,
+                     bufferSize);
+        throw std::runtime_error("MPI message too big for buffer");
+    }
+
+    return true;
+}
+}
@@ -0,0 +1,218 @@
+#include <wasm/mpi_profile.h>
+#include <wasm/mpi_progress.h>
+#include <wasm/mpi_requests.h>
+
+#include <faabric/util/gids.h>
+#include <faabric/util/logging.h>
+
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace wasm {
+
+static thread_local std::unordered_set<int> sendRequests;
+
+static thread_local std::vector<int> freedRequests;
+
+static thread_local std::unordered_map<int, std::function<void()>>
+  recvCompletions;
+
+struct MpiPersistentRequest
+{
+    std::function<int()> start;
+
+    // The request it last started, if that's still to be awaited
+    int activeId = 0;
+};
+
+static thread_local std::unordered_map<int, MpiPersistentRequest>
+  persistentRequests;
+
+// Persistent requests stand for the request they last started
+static int getActiveRequestId(int requestId)
+{
+    auto it = persistentRequests.find(requestId);
+    if (it == persistentRequests.end()) {
+        return requestId;
+    }
+
+    return it->second.activeId;
+}
+
+static void deactivateRequest(int requestId)
+{
+    auto it = persistentRequests.find(requestId);
+    if (it != persistentRequests.end()) {
+        it->second.activeId = 0;
+    }
+}
+
+static void awaitRequest(faabric::mpi::MpiWorld& world, int requestId)
+{
+    if (isMpiCollectiveRequest(requestId)) {
+        MpiWaitTimer waitTimer;
+        awaitMpiCollective(requestId);
+        return;
+    }
+
+    // Faabric can't wait on anything while the progress thread talks to the
+    // same ranks
+    awaitMpiCollectives();
+
+    {
+        MpiWaitTimer waitTimer;
+        world.awaitAsyncRequest(requestId);
+    }
+    sendRequests.erase(requestId);
+
+    auto it = recvCompletions.find(requestId);
+    if (it != recvCompletions.end()) {
+        std::function<void()> onComplete = std::move(it->second);
+        recvCompletions.erase(it);
+        onComplete();
+    }
+}
+
+static void awaitFreedMpiRequests(faabric::mpi::MpiWorld& world)
+{
+    if (freedRequests.empty()) {
+        return;
+    }
+
+    SPDLOG_TRACE("Awaiting {} freed MPI requests", freedRequests.size());
+
+    std::vector<int> toAwait;
+    toAwait.swap(freedRequests);
+    for (int requestId : toAwait) {
+        awaitRequest(world, requestId);
+    }
+}
+
+void addMpiSendRequest(int requestId)
+{
+    sendRequests.insert(requestId);
+}
+
+void addMpiRecvCompletion(int requestId, std::function<void()> onComplete)
+{
+    recvCompletions[requestId] = std::move(onComplete);
+}
+
+int addMpiPersistentRequest(std::function<int()> start)
+{
+    int requestId = (int)faabric::util::generateGid();
+    persistentRequests[requestId].start = std::move(start);
+
+    return requestId;
+}
+
+bool isMpiPersistentRequest(int requestId)
+{
+    return persistentRequests.count(requestId) > 0;
+}
+
+void startMpiPersistentRequest(int requestId)
+{
+    auto it = persistentRequests.find(requestId);
+    if (it == persistentRequests.end()) {
+        SPDLOG_ERROR("MPI request {} is not persistent", requestId);
+        throw std::runtime_error("Starting non-persistent MPI request");
+    }
+
+    if (it->second.activeId != 0) {
+        SPDLOG_ERROR("MPI request {} started again before being awaited",
+                     requestId);
+        throw std::runtime_error("Starting active MPI request");
+    }
+
+    it->second.activeId = it->second.start();
+}
+
+void awaitAllMpiRequests(faabric::mpi::MpiWorld& world,
+                         const std::vector<int>& givenIds)
+{
+    awaitFreedMpiRequests(world);
+
+    std::vector<int> requestIds;
+    requestIds.reserve(givenIds.size());
+    for (int givenId : givenIds) {
+        requestIds.push_back(getActiveRequestId(givenId));
+        deactivateRequest(givenId);
+    }
+
+    std::vector<int> recvRequests;
+    for (int requestId : requestIds) {
+        if (requestId == 0) {
+            continue;
+        }
+
+        if (sendRequests.count(requestId) > 0) {
+            awaitRequest(world, requestId);
+        } else {
+            recvRequests.push_back(requestId);
+        }
+    }
+
+    // Faabric delivers messages from each rank in order, so receiving in the
+    // order the requests were made doesn't hold anything up
+    for (int requestId : recvRequests) {
+        awaitRequest(world, requestId);
+    }
+}
+
+int awaitAnyMpiRequest(faabric::mpi::MpiWorld& world,
+                       const std::vector<int>& requestIds)
+{
+    awaitFreedMpiRequests(world);
+
+    int idx = -1;
+    for (int i = 0; i < (int)requestIds.size(); i++) {
+        int requestId = getActiveRequestId(requestIds.at(i));
+        if (requestId == 0) {
+            continue;
+        }
+
+        if (sendRequests.count(requestId) > 0 ||
+            isMpiCollectiveDone(requestId)) {
+            idx = i;
+            break;
+        }
+
+        if (idx < 0) {
+            idx = i;
+        }
+    }
+
+    if (idx >= 0) {
+        int requestId = getActiveRequestId(requestIds.at(idx));
+        deactivateRequest(requestIds.at(idx));
+        awaitRequest(world, requestId);
+    }
+
+    return idx;
+}
+
+void freeMpiRequest(int requestId)
+{
+    // Freeing a started persistent request leaves what it started to finish
+    auto it = persistentRequests.find(requestId);
+    if (it != persistentRequests.end()) {
+        requestId = it->second.activeId;
+        persistentRequests.erase(it);
+    }
+
+    if (requestId != 0) {
+        freedRequests.push_back(requestId);
+    }
+}
+
+void finishMpiRequests(faabric::mpi::MpiWorld& world)
+{
+    awaitMpiCollectives();
+    awaitFreedMpiRequests(world);
+    sendRequests.clear();
+    recvCompletions.clear();
+    persistentRequests.clear();
+}
+}
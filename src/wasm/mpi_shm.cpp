@@ -0,0 +1,119 @@
+#include <conf/FaasmConfig.h>
+#include <wasm/mpi_shm.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace wasm {
+
+static std::mutex segmentsMx;
+static std::unordered_map<std::string, std::shared_ptr<MpiHostSegment>>
+  segments;
+
+MpiHostSegment::MpiHostSegment(int nMembersIn)
+  : nMembers(nMembersIn)
+{}
+
+void MpiHostSegment::contribute(const uint8_t* buffer,
+                                size_t nBytes,
+                                const MpiSegmentCombineFunction& combine)
+{
+    std::unique_lock<std::mutex> lock(mx);
+
+    // Wait for everyone to finish reading the last round
+    cv.wait(lock, [this] { return state == RoundState::Gathering; });
+
+    if (buffer != nullptr) {
+        if (!hasData) {
+            data.assign(buffer, buffer + nBytes);
+            hasData = true;
+        } else {
+            if (data.size() != nBytes) {
+                SPDLOG_ERROR("MPI segment contribution of {} bytes, not {}",
+                             nBytes,
+                             data.size());
+                throw std::runtime_error("Mismatched MPI segment contribution");
+            }
+
+            combine(buffer, data.data());
+        }
+    }
+
+    nArrived++;
+    if (nArrived == nMembers) {
+        state = RoundState::Full;
+        cv.notify_all();
+    }
+}
+
+std::vector<uint8_t>& MpiHostSegment::awaitContributions()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    cv.wait(lock, [this] { return state == RoundState::Full; });
+
+    return data;
+}
+
+void MpiHostSegment::publish()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    state = RoundState::Published;
+    cv.notify_all();
+}
+
+void MpiHostSegment::read(uint8_t* buffer, size_t nBytes)
+{
+    std::unique_lock<std::mutex> lock(mx);
+    cv.wait(lock, [this] { return state == RoundState::Published; });
+
+    if (buffer != nullptr) {
+        if (data.size() < nBytes) {
+            SPDLOG_ERROR(
+              "MPI segment holds {} bytes, not {}", data.size(), nBytes);
+            throw std::runtime_error("MPI segment result too small");
+        }
+
+        std::memcpy(buffer, data.data(), nBytes);
+    }
+
+    nDeparted++;
+    if (nDeparted == nMembers) {
+        // Keep the allocation for the next round
+        nArrived = 0;
+        nDeparted = 0;
+        hasData = false;
+        state = RoundState::Gathering;
+        cv.notify_all();
+    }
+}
+
+std::shared_ptr<MpiHostSegment> getMpiHostSegment(const std::string& key,
+                                                  int nMembers)
+{
+    faabric::util::UniqueLock lock(segmentsMx);
+    auto it = segments.find(key);
+    if (it == segments.end()) {
+        SPDLOG_DEBUG("Creating MPI segment {} for {} ranks", key, nMembers);
+        it =
+          segments.emplace(key, std::make_shared<MpiHostSegment>(nMembers))
+            .first;
+    }
+
+    return it->second;
+}
+
+void removeMpiHostSegment(const std::string& key)
+{
+    faabric::util::UniqueLock lock(segmentsMx);
+    segments.erase(key);
+}
+
+bool isMpiShmCollectivesEnabled()
+{
+    return conf::getFaasmConfig().mpiShmCollectives == "on";
+}
+}
@@ -0,0 +1,355 @@
+#include <wasm/mpi_types.h>
+
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace wasm {
+
+static void checkCount(int count, const char* name)
+{
+    if (count < 0) {
+        SPDLOG_ERROR("Invalid MPI datatype {} {}", name, count);
+        throw std::runtime_error("Invalid MPI datatype argument");
+    }
+}
+
+static size_t toOffset(int64_t offset)
+{
+    if (offset < 0) {
+        SPDLOG_ERROR("MPI datatypes with negative displacements ({}) are not "
+                     "supported",
+                     offset);
+        throw std::runtime_error("Negative MPI datatype displacement");
+    }
+
+    return (size_t)offset;
+}
+
+MpiTypeLayout::MpiTypeLayout(size_t sizeIn)
+  : extent(sizeIn)
+{
+    if (sizeIn > 0) {
+        blocks.push_back({ 0, sizeIn });
+        size = sizeIn;
+    }
+}
+
+void MpiTypeLayout::append(const MpiTypeLayout& type, size_t offset, int count)
+{
+    for (int i = 0; i < count; i++) {
+        size_t elemOffset = offset + i * type.extent;
+        for (const auto& b : type.blocks) {
+            size_t blockOffset = elemOffset + b.offset;
+
+            // Merge runs that follow on from each other
+            if (!blocks.empty() &&
+                blocks.back().offset + blocks.back().length == blockOffset) {
+                blocks.back().length += b.length;
+            } else {
+                blocks.push_back({ blockOffset, b.length });
+            }
+
+            size += b.length;
+            extent = std::max(extent, blockOffset + b.length);
+        }
+    }
+}
+
+size_t MpiTypeLayout::getSpan(int count) const
+{
+    if (count <= 0 || blocks.empty()) {
+        return 0;
+    }
+
+    size_t end = 0;
+    for (const auto& b : blocks) {
+        end = std::max(end, b.offset + b.length);
+    }
+
+    return (count - 1) * extent + end;
+}
+
+bool MpiTypeLayout::isContiguous() const
+{
+    if (blocks.empty()) {
+        return extent == 0;
+    }
+
+    return blocks.size() == 1 && blocks.front().offset == 0 &&
+           blocks.front().length == extent;
+}
+
+// Most derived types are strided runs of a few elements (halo columns and so
+// on), so the copies are kept to plain memcpys of each run, which the
+// compiler and libc turn into vector moves
+void MpiTypeLayout::pack(const uint8_t* src, int count, uint8_t* dst) const
+{
+    for (int i = 0; i < count; i++) {
+        const uint8_t* elem = src + i * extent;
+        for (const auto& b : blocks) {
+            std::memcpy(dst, elem + b.offset, b.length);
+            dst += b.length;
+        }
+    }
+}
+
+void MpiTypeLayout::unpack(const uint8_t* src, int count, uint8_t* dst) const
+{
+    for (int i = 0; i < count; i++) {
+        uint8_t* elem = dst + i * extent;
+        for (const auto& b : blocks) {
+            std::memcpy(elem + b.offset, src, b.length);
+            src += b.length;
+        }
+    }
+}
+
+MpiTypeLayout mpiTypeContiguous(int count, const MpiTypeLayout& oldType)
+{
+    checkCount(count, "count");
+
+    MpiTypeLayout layout;
+    layout.append(oldType, 0, count);
+    layout.setExtent(count * oldType.getExtent());
+
+    return layout;
+}
+
+MpiTypeLayout mpiTypeVector(int count,
+                            int blockLength,
+                            int stride,
+                            const MpiTypeLayout& oldType)
+{
+    checkCount(count, "count");
+    checkCount(blockLength, "block length");
+
+    MpiTypeLayout layout;
+    for (int i = 0; i < count; i++) {
+        size_t offset = toOffset((int64_t)i * stride * oldType.getExtent());
+        layout.append(oldType, offset, blockLength);
+    }
+
+    return layout;
+}
+
+MpiTypeLayout mpiTypeIndexed(int count,
+                             const int32_t* blockLengths,
+                             const int32_t* displacements,
+                             const MpiTypeLayout& oldType)
+{
+    checkCount(count, "count");
+
+    MpiTypeLayout layout;
+    for (int i = 0; i < count; i++) {
+        checkCount(blockLengths[i], "block length");
+        size_t offset =
+          toOffset((int64_t)displacements[i] * oldType.getExtent());
+        layout.append(oldType, offset, blockLengths[i]);
+    }
+
+    return layout;
+}
+
+MpiTypeLayout mpiTypeStruct(int count,
+                            const int32_t* blockLengths,
+                            const int32_t* displacements,
+                            const std::vector<MpiTypeLayout>& types)
+{
+    checkCount(count, "count");
+
+    MpiTypeLayout layout;
+    for (int i = 0; i < count; i++) {
+        checkCount(blockLengths[i], "block length");
+        layout.append(types.at(i), toOffset(displacements[i]), blockLengths[i]);
+    }
+
+    return layout;
+}
+
+MpiTypeLayout mpiTypeSubarray(int nDims,
+                              const int32_t* sizes,
+                              const int32_t* subSizes,
+                              const int32_t* starts,
+                              int order,
+                              const MpiTypeLayout& oldType)
+{
+    if (nDims <= 0) {
+        SPDLOG_ERROR("Invalid MPI subarray dimensions {}", nDims);
+        throw std::runtime_error("Invalid MPI subarray dimensions");
+    }
+
+    if (order != MPI_ORDER_C && order != MPI_ORDER_FORTRAN) {
+        SPDLOG_ERROR("Invalid MPI subarray order {}", order);
+        throw std::runtime_error("Invalid MPI subarray order");
+    }
+
+    // Work in C order, where the last dimension is the fastest
+    std::vector<int> dimSizes(sizes, sizes + nDims);
+    std::vector<int> dimSubSizes(subSizes, subSizes + nDims);
+    std::vector<int> dimStarts(starts, starts + nDims);
+    if (order == MPI_ORDER_FORTRAN) {
+        std::reverse(dimSizes.begin(), dimSizes.end());
+        std::reverse(dimSubSizes.begin(), dimSubSizes.end());
+        std::reverse(dimStarts.begin(), dimStarts.end());
+    }
+
+    for (int d = 0; d < nDims; d++) {
+        if (dimSizes[d] <= 0 || dimSubSizes[d] < 0 || dimStarts[d] < 0 ||
+            dimStarts[d] + dimSubSizes[d] > dimSizes[d]) {
+            SPDLOG_ERROR("Invalid MPI subarray dimension {}: {} from {} of {}",
+                         d,
+                         dimSubSizes[d],
+                         dimStarts[d],
+                         dimSizes[d]);
+            throw std::runtime_error("Invalid MPI subarray dimension");
+        }
+    }
+
+    std::vector<size_t> strides(nDims);
+    strides[nDims - 1] = oldType.getExtent();
+    for (int d = nDims - 2; d >= 0; d--) {
+        strides[d] = strides[d + 1] * dimSizes[d + 1];
+    }
+
+    MpiTypeLayout layout;
+    bool empty = std::any_of(
+      dimSubSizes.begin(), dimSubSizes.end(), [](int s) { return s == 0; });
+
+    // Append each run along the last dimension, counting through the
+    // others like an odometer
+    std::vector<int> idx(nDims, 0);
+    while (!empty) {
+        size_t offset = 0;
+        for (int d = 0; d < nDims; d++) {
+            offset += (dimStarts[d] + idx[d]) * strides[d];
+        }
+        layout.append(oldType, offset, dimSubSizes[nDims - 1]);
+
+        int d = nDims - 2;
+        while (d >= 0 && ++idx[d] == dimSubSizes[d]) {
+            idx[d] = 0;
+            d--;
+        }
+
+        if (d < 0) {
+            break;
+        }
+    }
+
+    // The type spans the whole array, so consecutive elements are whole arrays
+    layout.setExtent(dimSizes[0] * strides[0]);
+
+    return layout;
+}
+
+// Only types with gaps need their layouts keeping
+static thread_local std::unordered_map<int,
+                                       std::shared_ptr<const MpiTypeLayout>>
+  derivedTypes;
+
+static thread_local int nextDerivedTypeId = FAASM_MPI_DERIVED_TYPE_BASE;
+
+// Where in the guest's memory we've put derived types
+static thread_local std::unordered_set<int32_t> derivedTypePtrs;
+
+void createMpiDerivedType(int32_t typePtr,
+                          const MpiTypeLayout& layout,
+                          faabric_datatype_t* newType)
+{
+    derivedTypePtrs.insert(typePtr);
+    newType->size = layout.getSize();
+
+    if (layout.isContiguous()) {
+        newType->id = MPI_BYTE->id;
+        return;
+    }
+
+    newType->id = nextDerivedTypeId++;
+    derivedTypes[newType->id] = std::make_shared<MpiTypeLayout>(layout);
+
+    SPDLOG_DEBUG("Created MPI datatype {} ({} bytes in {} blocks over {})",
+                 newType->id,
+                 layout.getSize(),
+                 layout.getBlocks().size(),
+                 layout.getExtent());
+}
+
+bool isMpiDerivedType(const faabric_datatype_t* type)
+{
+    return type->id >= FAASM_MPI_DERIVED_TYPE_BASE;
+}
+
+std::shared_ptr<const MpiTypeLayout> getMpiTypeLayout(
+  const faabric_datatype_t* type)
+{
+    if (!isMpiDerivedType(type)) {
+        return std::make_shared<MpiTypeLayout>(type->size);
+    }
+
+    auto it = derivedTypes.find(type->id);
+    if (it == derivedTypes.end()) {
+        SPDLOG_ERROR("MPI datatype {} not found", type->id);
+        throw std::runtime_error("MPI datatype not found");
+    }
+
+    return it->second;
+}
+
+size_t getMpiTypeSpan(const faabric_datatype_t* type, int count)
+{
+    if (!isMpiDerivedType(type)) {
+        return (size_t)count * type->size;
+    }
+
+    return getMpiTypeLayout(type)->getSpan(count);
+}
+
+bool freeMpiDerivedType(int32_t typePtr, const faabric_datatype_t* type)
+{
+    if (derivedTypePtrs.erase(typePtr) == 0) {
+        return false;
+    }
+
+    derivedTypes.erase(type->id);
+    return true;
+}
+
+void clearMpiDerivedTypes()
+{
+    derivedTypePtrs.clear();
+    derivedTypes.clear();
+    nextDerivedTypeId = FAASM_MPI_DERIVED_TYPE_BASE;
+}
+
+MpiTypeBuffer::MpiTypeBuffer(uint8_t* guestBufferIn,
+                             faabric_datatype_t* typeIn,
+                             int countIn)
+  : guestBuffer(guestBufferIn)
+  , count(countIn)
+  , packed(isMpiDerivedType(typeIn))
+{
+    if (packed) {
+        layout = getMpiTypeLayout(typeIn);
+        packedData.resize(count * layout->getSize());
+    }
+}
+
+void MpiTypeBuffer::pack()
+{
+    if (packed) {
+        layout->pack(guestBuffer, count, packedData.data());
+    }
+}
+
+void MpiTypeBuffer::unpack()
+{
+    if (packed) {
+        layout->unpack(packedData.data(), count, guestBuffer);
+    }
+}
+}
@@ -0,0 +1,347 @@
+#include <wasm/mpi_profile.h>
+#include <wasm/mpi_progress.h>
+#include <wasm/mpi_window.h>
+
+#include <faabric/mpi/mpi.h>
+#include <faabric/state/State.h>
+#include <faabric/util/config.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/memory.h>
+
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace wasm {
+
+static size_t roundUpToHostPage(size_t nBytes)
+{
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    return ((nBytes + pageSize - 1) / pageSize) * pageSize;
+}
+
+MpiWindow::MpiWindow(faabric::mpi::MpiWorld& worldIn,
+                     int rankIn,
+                     int windowIdxIn,
+                     const std::string& userIn,
+                     WasmModule* moduleIn,
+                     uint32_t baseOffsetIn,
+                     size_t sizeIn,
+                     int dispUnitIn)
+  : world(worldIn)
+  , rank(rankIn)
+  , windowIdx(windowIdxIn)
+  , user(userIn)
+  , thisHost(faabric::util::getSystemConfig().endpointHost)
+  , module(moduleIn)
+  , baseOffset(baseOffsetIn)
+  , base(moduleIn->wasmPointerToNative(baseOffsetIn))
+  , size(sizeIn)
+  , dispUnit(dispUnitIn)
+{
+    if (dispUnit <= 0) {
+        SPDLOG_ERROR("Invalid MPI window displacement unit {}", dispUnit);
+        throw std::runtime_error("Invalid MPI window displacement unit");
+    }
+
+    // Everyone needs to know the size and displacement unit of every other
+    // rank's part of the window
+    int worldSize = world.getSize();
+    std::vector<int> sendBuf = { (int)size, dispUnit };
+    std::vector<int> recvBuf(2 * worldSize, 0);
+    world.allGather(rank,
+                    reinterpret_cast<uint8_t*>(sendBuf.data()),
+                    MPI_INT,
+                    2,
+                    reinterpret_cast<uint8_t*>(recvBuf.data()),
+                    MPI_INT,
+                    2);
+
+    for (int r = 0; r < worldSize; r++) {
+        targetSizes.push_back(recvBuf.at(2 * r));
+        targetDispUnits.push_back(recvBuf.at(2 * r + 1));
+    }
+    targetKvs.resize(worldSize, nullptr);
+
+    if (size > 0) {
+        // Keys are whole pages so that they can be mapped over the window
+        size_t kvSize = roundUpToHostPage(size);
+        auto kv = getTargetKV(rank);
+
+        bool aligned =
+          ((uintptr_t)base % faabric::util::HOST_PAGE_SIZE) == 0;
+        if (aligned && baseOffset + kvSize <= module->getMemorySizeBytes()) {
+            // Take the current contents of all the pages before mapping
+            kv->set(base);
+            module->mapSharedStateMemoryAt(kv, baseOffset, kvSize);
+            mapped = true;
+        } else {
+            kv->setChunk(0, base, size);
+            shadow.assign(base, base + size);
+        }
+
+        kv->pushFull();
+    }
+
+    SPDLOG_DEBUG("MPI-{} created window {} of {} bytes (mapped {})",
+                 rank,
+                 windowIdx,
+                 size,
+                 mapped);
+
+    // Nobody can access the window until every rank has set it up
+    world.barrier(rank);
+}
+
+std::string MpiWindow::getKey(int targetRank) const
+{
+    return fmt::format(
+      "mpi_win_{}_{}_{}", world.getId(), windowIdx, targetRank);
+}
+
+bool MpiWindow::isLocal(int targetRank)
+{
+    return world.getHostForRank(targetRank) == thisHost;
+}
+
+std::shared_ptr<faabric::state::StateKeyValue> MpiWindow::getTargetKV(
+  int targetRank)
+{
+    if (targetKvs.at(targetRank) == nullptr) {
+        size_t kvSize = roundUpToHostPage(targetSizes.at(targetRank));
+        targetKvs.at(targetRank) = faabric::state::getGlobalState().getKV(
+          user, getKey(targetRank), kvSize);
+    }
+
+    return targetKvs.at(targetRank);
+}
+
+size_t MpiWindow::getTargetOffset(int targetRank,
+                                  size_t targetDisp,
+                                  size_t nBytes)
+{
+    if (targetRank < 0 || targetRank >= (int)targetSizes.size()) {
+        SPDLOG_ERROR("MPI window access to invalid rank {}", targetRank);
+        throw std::runtime_error("MPI window access to invalid rank");
+    }
+
+    size_t offset = targetDisp * targetDispUnits.at(targetRank);
+    if (offset + nBytes > (size_t)targetSizes.at(targetRank)) {
+        SPDLOG_ERROR("MPI window access out of bounds on {} ({} + {} > {})",
+                     targetRank,
+                     offset,
+                     nBytes,
+                     targetSizes.at(targetRank));
+        throw std::runtime_error("MPI window access out of bounds");
+    }
+
+    return offset;
+}
+
+void MpiWindow::put(int targetRank,
+                    size_t targetDisp,
+                    const uint8_t* buffer,
+                    size_t nBytes)
+{
+    size_t offset = getTargetOffset(targetRank, targetDisp, nBytes);
+    if (nBytes == 0) {
+        return;
+    }
+
+    // Our own window is just our memory
+    if (targetRank == rank) {
+        std::memcpy(base + offset, buffer, nBytes);
+        return;
+    }
+
+    // Writing to the key updates any co-located window mapped over it, and
+    // remote ones get pushed at the fence
+    getTargetKV(targetRank)->setChunk(offset, buffer, nBytes);
+    if (!isLocal(targetRank)) {
+        dirtyRemoteTargets.insert(targetRank);
+    }
+}
+
+void MpiWindow::get(int targetRank,
+                    size_t targetDisp,
+                    uint8_t* buffer,
+                    size_t nBytes)
+{
+    size_t offset = getTargetOffset(targetRank, targetDisp, nBytes);
+    if (nBytes == 0) {
+        return;
+    }
+
+    if (targetRank == rank) {
+        std::memcpy(buffer, base + offset, nBytes);
+        return;
+    }
+
+    if (isLocal(targetRank)) {
+        getTargetKV(targetRank)->getChunk(offset, buffer, nBytes);
+        return;
+    }
+
+    pendingGets.push_back({ targetRank, offset, buffer, nBytes });
+}
+
+// Makes this rank's own writes since the last fence visible to the others.
+// Only the bytes that changed are written, so puts from other ranks to other
+// parts of the window survive.
+void MpiWindow::publishLocalChanges()
+{
+    if (mapped || size == 0) {
+        return;
+    }
+
+    auto kv = getTargetKV(rank);
+    bool changed = false;
+    size_t i = 0;
+    while (i < size) {
+        if (base[i] == shadow[i]) {
+            i++;
+            continue;
+        }
+
+        size_t start = i;
+        while (i < size && base[i] != shadow[i]) {
+            i++;
+        }
+        kv->setChunk(start, base + start, i - start);
+        changed = true;
+    }
+
+    // Ranks on other hosts read the key from its master
+    if (changed) {
+        kv->pushPartial();
+    }
+}
+
+// Picks up what other ranks have put into this rank's window, including those
+// on other hosts, which push to the key's master
+void MpiWindow::collectRemoteChanges()
+{
+    if (mapped || size == 0) {
+        return;
+    }
+
+    auto kv = getTargetKV(rank);
+    kv->pull();
+    kv->getChunk(0, base, size);
+    std::memcpy(shadow.data(), base, size);
+}
+
+void MpiWindow::fence()
+{
+    awaitMpiCollectives();
+
+    publishLocalChanges();
+
+    for (int targetRank : dirtyRemoteTargets) {
+        getTargetKV(targetRank)->pushPartial();
+    }
+    dirtyRemoteTargets.clear();
+
+    // Every put has landed once everyone is here
+    {
+        MpiWaitTimer waitTimer;
+        world.barrier(rank);
+    }
+
+    std::set<int> pulled;
+    for (const auto& g : pendingGets) {
+        auto kv = getTargetKV(g.targetRank);
+        if (pulled.insert(g.targetRank).second) {
+            kv->pull();
+        }
+        kv->getChunk(g.offset, g.buffer, g.nBytes);
+    }
+    pendingGets.clear();
+
+    collectRemoteChanges();
+
+    // Nobody can start the next epoch's writes until every get is done
+    MpiWaitTimer waitTimer;
+    world.barrier(rank);
+}
+
+void MpiWindow::free()
+{
+    awaitMpiCollectives();
+
+    if (!pendingGets.empty() || !dirtyRemoteTargets.empty()) {
+        SPDLOG_WARN("MPI-{} freeing window {} with unsynchronised operations",
+                    rank,
+                    windowIdx);
+    }
+
+    // Nobody touches the window once everyone is here
+    world.barrier(rank);
+
+    unmap();
+}
+
+void MpiWindow::unmap()
+{
+    if (!mapped) {
+        return;
+    }
+
+    module->unmapSharedStateMemoryAt(baseOffset, roundUpToHostPage(size));
+    mapped = false;
+}
+
+// Windows belong to the rank's thread, and are created in the same order by
+// every rank, so a per-world count gives the same index on all of them
+static thread_local std::unordered_map<int32_t, std::unique_ptr<MpiWindow>>
+  windows;
+
+static thread_local std::map<int, int> windowCounts;
+
+MpiWindow& createMpiWindow(int32_t winPtr,
+                           faabric::mpi::MpiWorld& world,
+                           int rank,
+                           const std::string& user,
+                           WasmModule* module,
+                           uint32_t baseOffset,
+                           size_t size,
+                           int dispUnit)
+{
+    awaitMpiCollectives();
+
+    int windowIdx = windowCounts[world.getId()]++;
+    auto window = std::make_unique<MpiWindow>(
+      world, rank, windowIdx, user, module, baseOffset, size, dispUnit);
+
+    auto [it, inserted] = windows.insert_or_assign(winPtr, std::move(window));
+    return *it->second;
+}
+
+MpiWindow& getMpiWindow(int32_t winPtr)
+{
+    auto it = windows.find(winPtr);
+    if (it == windows.end()) {
+        SPDLOG_ERROR("No MPI window at {}", winPtr);
+        throw std::runtime_error("MPI window not found");
+    }
+
+    return *it->second;
+}
+
+void freeMpiWindow(int32_t winPtr)
+{
+    getMpiWindow(winPtr).free();
+    windows.erase(winPtr);
+}
+
+void clearMpiWindows()
+{
+    for (auto& [winPtr, window] : windows) {
+        window->unmap();
+    }
+
+    windows.clear();
+    windowCounts.clear();
+}
+}
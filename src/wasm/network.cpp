@@ -0,0 +1,64 @@
+#include <wasm/network.h>
+
+#include <faabric/util/clock.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <cerrno>
+
+namespace wasm {
+
+int clampTimeoutToDeadline(int timeoutMs, int64_t nowMs, int64_t deadlineMs)
+{
+    int64_t remainingMs = std::max<int64_t>(deadlineMs - nowMs, 0);
+
+    if (timeoutMs < 0 || timeoutMs > remainingMs) {
+        return (int)remainingMs;
+    }
+
+    return timeoutMs;
+}
+
+int getNetworkWaitTimeoutMs(int timeoutMs)
+{
+    // Outside of a Faaslet, e.g. in tests, there's no deadline
+    int64_t deadlineMs = getCurrentDeadlineMs();
+    if (deadlineMs < 0) {
+        return timeoutMs;
+    }
+
+    int64_t nowMs = faabric::util::getGlobalClock().epochMillis();
+    int clampedMs = clampTimeoutToDeadline(timeoutMs, nowMs, deadlineMs);
+
+    if (clampedMs != timeoutMs) {
+        SPDLOG_DEBUG(
+          "Clamped network wait of {}ms to {}ms", timeoutMs, clampedMs);
+    }
+
+    return clampedMs;
+}
+
+int pollWithinDeadline(pollfd* fds, int nFds, int timeoutMs)
+{
+    int res = ::poll(fds, nFds, getNetworkWaitTimeoutMs(timeoutMs));
+    if (res < 0) {
+        return -errno;
+    }
+
+    return res;
+}
+
+int epollWaitWithinDeadline(int epollFd,
+                            epoll_event* events,
+                            int maxEvents,
+                            int timeoutMs)
+{
+    int res = ::epoll_wait(
+      epollFd, events, maxEvents, getNetworkWaitTimeoutMs(timeoutMs));
+    if (res < 0) {
+        return -errno;
+    }
+
+    return res;
+}
+}
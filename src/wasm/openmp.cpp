@@ -0,0 +1,1167 @@
+#include <threads/LocalTeam.h>
+#include <threads/ThreadState.h>
+#include <wasm/WasmExecutionContext.h>
+#include <wasm/WasmModule.h>
+#include <wasm/openmp.h>
+#include <wasm/openmp_profile.h>
+
+#include <faabric/scheduler/ExecutorContext.h>
+#include <faabric/scheduler/Scheduler.h>
+#include <faabric/state/State.h>
+#include <faabric/transport/PointToPointBroker.h>
+#include <faabric/util/config.h>
+#include <faabric/util/func.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/scheduling.h>
+#include <faabric/util/snapshot.h>
+#include <faabric/util/timing.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+// In distributed mode, each host takes this many chunks at a time from the
+// loop's global iteration counter
+#define OMP_DISPATCH_BATCH_CHUNKS 8
+
+using namespace faabric::scheduler;
+
+namespace wasm {
+
+std::shared_ptr<faabric::transport::PointToPointGroup>
+getExecutingPointToPointGroup()
+{
+    faabric::Message& msg = ExecutorContext::get()->getMsg();
+    return faabric::transport::PointToPointGroup::getOrAwaitGroup(
+      msg.groupid());
+}
+
+// Scheduled teams that all landed on this host share a local barrier, keyed
+// by group id, so barriers don't go through point-to-point messaging
+static std::mutex hostTeamsMx;
+static std::map<int, std::shared_ptr<threads::LocalTeam>> hostTeams;
+
+// Each thread keeps hold of its team's barrier, so only looks it up once
+static thread_local std::pair<int, std::shared_ptr<threads::LocalTeam>>
+  threadHostTeam = { -1, nullptr };
+
+static std::shared_ptr<threads::LocalTeam> getHostTeam(int groupId, int size)
+{
+    if (threadHostTeam.first == groupId) {
+        return threadHostTeam.second;
+    }
+
+    // Drop this thread's hold on its last team before looking for old ones
+    threadHostTeam = { -1, nullptr };
+
+    faabric::util::UniqueLock lock(hostTeamsMx);
+    auto it = hostTeams.find(groupId);
+    if (it == hostTeams.end()) {
+        // Nobody is waiting at a barrier nobody else holds, so it can go
+        std::erase_if(hostTeams,
+                      [](const auto& e) { return e.second.use_count() == 1; });
+
+        it = hostTeams
+               .emplace(groupId, std::make_shared<threads::LocalTeam>(size))
+               .first;
+    }
+
+    threadHostTeam = { groupId, it->second };
+    return it->second;
+}
+
+size_t getHostTeamCount()
+{
+    faabric::util::UniqueLock lock(hostTeamsMx);
+    return hostTeams.size();
+}
+
+// Teams running on the local thread pool have no point-to-point group, and
+// only teams spread over several hosts need it for barriers
+void teamBarrier(int groupIdx)
+{
+    OpenMPProfileTimer timer(OpenMPProfileEvent::Barrier);
+
+    std::shared_ptr<threads::LocalTeam> team = threads::getCurrentLocalTeam();
+    if (team != nullptr) {
+        team->barrier();
+        return;
+    }
+
+    if (ExecutorContext::get()->getBatchRequest()->singlehost()) {
+        const faabric::Message& msg = ExecutorContext::get()->getMsg();
+        int size = threads::getCurrentOpenMPLevel()->numThreads;
+        getHostTeam(msg.groupid(), size)->barrier();
+        return;
+    }
+
+    getExecutingPointToPointGroup()->barrier(groupIdx);
+}
+
+// ------------------------------------------------
+// CRITICAL
+// ------------------------------------------------
+
+/**
+ * When the whole team is on this host, each critical section gets its own
+ * host-local lock, keyed by crit. Otherwise we fall back to the group's
+ * distributed lock, which is shared by all critical sections.
+ */
+void enterOpenMPCritical(faabric::Message* msg,
+                         const std::shared_ptr<threads::Level>& level,
+                         int32_t crit)
+{
+    if (level->numThreads <= 1) {
+        return;
+    }
+
+    OpenMPProfileTimer timer(OpenMPProfileEvent::Critical);
+    if (ExecutorContext::get()->getBatchRequest()->singlehost()) {
+        getExecutingModule()->getOrCreateCriticalMutex(crit)->lock();
+        return;
+    }
+
+    getExecutingPointToPointGroup()->lock(msg->groupidx(), true);
+
+    // NOTE: here we need to pull the latest snapshot diffs from master.
+    // This is a really inefficient way to implement a critical, and needs
+    // more thought as to whether we can avoid doing a request/ response
+    // every time.
+}
+
+void exitOpenMPCritical(faabric::Message* msg,
+                        const std::shared_ptr<threads::Level>& level,
+                        int32_t crit)
+{
+    if (level->numThreads <= 1) {
+        return;
+    }
+
+    if (ExecutorContext::get()->getBatchRequest()->singlehost()) {
+        getExecutingModule()->getOrCreateCriticalMutex(crit)->unlock();
+        return;
+    }
+
+    getExecutingPointToPointGroup()->unlock(msg->groupidx(), true);
+}
+
+// ------------------------------------------------
+// SINGLE
+// ------------------------------------------------
+
+// Every thread in a team meets the team's single constructs in the same order,
+// so constructs are keyed by group ID and their index within the section
+static std::mutex singlesMx;
+static std::map<std::pair<int, int>, int> singles;
+
+struct ThreadSingles
+{
+    int groupId = -1;
+    int nSingles = 0;
+
+    // Threads of the team on this host that can run its single constructs
+    int nCandidates = 0;
+};
+
+static thread_local ThreadSingles threadSingles;
+
+// Only the threads on the host of the team's master can run a distributed
+// team's single constructs, so returns how many of them there are here
+static int countSingleCandidates(int groupId)
+{
+    auto& broker = faabric::transport::getPointToPointBroker();
+    const std::string& thisHost = faabric::util::getSystemConfig().endpointHost;
+    if (broker.getHostForReceiver(groupId, 0) != thisHost) {
+        return 0;
+    }
+
+    int nCandidates = 0;
+    for (int idx : broker.getIdxsRegisteredForGroup(groupId)) {
+        if (broker.getHostForReceiver(groupId, idx) == thisHost) {
+            nCandidates++;
+        }
+    }
+
+    return nCandidates;
+}
+
+/**
+ * The first thread to arrive runs the construct, rather than always the
+ * master, so the rest of the team doesn't wait for the master to get there.
+ *
+ * The first thread to register the construct wins, and the last candidate to
+ * arrive tidies up. On a single host every thread is a candidate. In
+ * distributed mode only the threads on the master's host are, and the rest
+ * lose straight away, so settling a construct never leaves this host.
+ */
+int32_t startOpenMPSingle(faabric::Message* msg,
+                          const std::shared_ptr<threads::Level>& level)
+{
+    if (level->numThreads <= 1) {
+        return 1;
+    }
+
+    if (threadSingles.groupId != msg->groupid()) {
+        bool singleHost =
+          ExecutorContext::get()->getBatchRequest()->singlehost();
+
+        threadSingles.groupId = msg->groupid();
+        threadSingles.nSingles = 0;
+        threadSingles.nCandidates = singleHost
+                                      ? level->numThreads
+                                      : countSingleCandidates(msg->groupid());
+    }
+    std::pair<int, int> key = { msg->groupid(), threadSingles.nSingles++ };
+
+    if (threadSingles.nCandidates == 0) {
+        return 0;
+    }
+
+    faabric::util::UniqueLock lock(singlesMx);
+    auto [it, inserted] = singles.try_emplace(key, 0);
+    if (++it->second == threadSingles.nCandidates) {
+        singles.erase(it);
+    }
+
+    return inserted;
+}
+
+// ------------------------------------------------
+// FORKING
+// ------------------------------------------------
+
+std::shared_ptr<threads::Level> createNextOpenMPLevel(
+  const std::shared_ptr<threads::Level>& parentLevel,
+  int32_t nSharedVars,
+  uint32_t* sharedVarOffsets)
+{
+    int nextThreads = parentLevel->getMaxThreadsAtNextLevel();
+    if (parentLevel->depth > 0 && nextThreads > 1) {
+        SPDLOG_DEBUG("Serialising nested OpenMP team of {} threads at depth {}",
+                     nextThreads,
+                     parentLevel->depth + 1);
+        nextThreads = 1;
+    }
+
+    auto nextLevel = std::make_shared<threads::Level>(nextThreads);
+    nextLevel->fromParentLevel(parentLevel);
+
+    if (nSharedVars > 0) {
+        nextLevel->setSharedVarOffsets(sharedVarOffsets, nSharedVars);
+    }
+
+    return nextLevel;
+}
+
+void executeOpenMPTeam(WasmModule* module,
+                       faabric::Message* parentCall,
+                       const std::shared_ptr<threads::Level>& nextLevel,
+                       int32_t microtaskPtr)
+{
+    // Set up the chained calls
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory(
+        parentCall->user(), parentCall->function(), nextLevel->numThreads);
+    req->set_type(faabric::BatchExecuteRequest::THREADS);
+    req->set_subtype(ThreadRequestType::OPENMP);
+
+    // Add remote context
+    nextLevel->serialise(*req->mutable_contextdata());
+
+    // Configure the mesages
+    for (int i = 0; i < req->messages_size(); i++) {
+        faabric::Message& m = req->mutable_messages()->at(i);
+
+        // Propagte app id
+        m.set_appid(parentCall->appid());
+
+        // Function pointer
+        m.set_funcptr(microtaskPtr);
+
+        // OpenMP thread number
+        int threadNum = nextLevel->getGlobalThreadNum(i);
+        m.set_appidx(threadNum);
+
+        // Group setup for distributed coordination. Note that the group index
+        // is just within this function group, and not the global OpenMP
+        // thread number
+        m.set_groupidx(i);
+    }
+
+    // Execute the threads
+    faabric::scheduler::Executor* executor =
+      faabric::scheduler::ExecutorContext::get()->getExecutor();
+    std::vector<std::pair<uint32_t, int>> results =
+      executor->executeThreads(req, module->getMergeRegions());
+
+    for (auto [mid, res] : results) {
+        if (res != 0) {
+            SPDLOG_ERROR(
+              "OpenMP thread failed, result {} on message {}", res, mid);
+            throw std::runtime_error("OpenMP threads failed");
+        }
+    }
+
+    // Clear this module's merge regions
+    module->clearMergeRegions();
+}
+
+// -------------------------------------------------------
+// FOR LOOP STATIC INIT
+// -------------------------------------------------------
+
+enum sched_type : int
+{
+    sch_lower = 32, /**< lower bound for unordered values */
+    sch_static_chunked = 33,
+    sch_static = 34, /**< static unspecialized */
+    sch_dynamic_chunked = 35,
+    sch_guided_chunked = 36,
+    sch_runtime = 37,
+    sch_auto = 38,
+    sch_static_balanced = 41,
+    sch_guided_iterative_chunked = 42,
+    sch_guided_analytical_chunked = 43,
+    sch_upper = 46, /**< upper bound for unordered values */
+
+    sch_modifier_monotonic = (1 << 29),
+    sch_modifier_nonmonotonic = (1 << 30),
+};
+
+template<typename T>
+void for_static_init(int32_t schedule,
+                     int32_t* lastIter,
+                     T* lower,
+                     T* upper,
+                     T* stride,
+                     T incr,
+                     T chunk)
+{
+    // Unsigned version of the given template parameter
+    typedef typename std::make_unsigned<T>::type UT;
+
+    faabric::Message* msg = &ExecutorContext::get()->getMsg();
+    std::shared_ptr<threads::Level> level = threads::getCurrentOpenMPLevel();
+    int localThreadNum = level->getLocalThreadNum(msg);
+
+    if (level->numThreads == 1) {
+        *lastIter = true;
+
+        if (incr > 0) {
+            *stride = *upper - *lower + 1;
+        } else {
+            *stride = -(*lower - *upper + 1);
+        }
+
+        return;
+    }
+
+    UT tripCount;
+    if (incr == 1) {
+        tripCount = *upper - *lower + 1;
+
+    } else if (incr == -1) {
+        tripCount = *lower - *upper + 1;
+
+    } else if (incr > 0) {
+        // Upper-lower can exceed the limit of signed type
+        tripCount = (int)(*upper - *lower) / incr + 1;
+
+    } else {
+        tripCount = (int)(*lower - *upper) / (-incr) + 1;
+    }
+
+    switch (schedule) {
+        case sch_static_chunked: {
+            int span;
+
+            if (chunk < 1) {
+                chunk = 1;
+            }
+
+            span = chunk * incr;
+
+            *stride = span * level->numThreads;
+            *lower = *lower + (span * localThreadNum);
+            *upper = *lower + span - incr;
+
+            *lastIter =
+              (localThreadNum ==
+               ((tripCount - 1) / (unsigned int)chunk) % level->numThreads);
+
+            break;
+        }
+
+        case sch_static: { // (chunk not given)
+            // If we have fewer trip_counts than threads
+            if (tripCount < level->numThreads) {
+                // Warning for future use, not tested at scale
+                SPDLOG_WARN("Small for loop trip count {} {}",
+                            tripCount,
+                            level->numThreads);
+
+                if (localThreadNum < tripCount) {
+                    *upper = *lower = *lower + localThreadNum * incr;
+                } else {
+                    *lower = *upper + incr;
+                }
+
+                *lastIter = (localThreadNum == tripCount - 1);
+
+            } else {
+                // TODO: We only implement below kmp_sch_static_balanced, not
+                // kmp_sch_static_greedy Those are set through KMP_SCHEDULE so
+                // we would need to look out for real code setting this
+                uint32_t small_chunk = tripCount / level->numThreads;
+                uint32_t extras = tripCount % level->numThreads;
+
+                *lower +=
+                  incr * (localThreadNum * small_chunk +
+                          (localThreadNum < extras ? localThreadNum : extras));
+
+                *upper = *lower + small_chunk * incr -
+                         (localThreadNum < extras ? 0 : incr);
+
+                *lastIter = (localThreadNum == level->numThreads - 1);
+            }
+
+            *stride = tripCount;
+            break;
+        }
+        default: {
+            SPDLOG_ERROR("Unimplemented OpenMP scheduler {}", schedule);
+            throw std::runtime_error("Unimplemented OpenMP scheduler");
+        }
+    }
+}
+
+template void for_static_init<int32_t>(int32_t,
+                                      int32_t*,
+                                      int32_t*,
+                                      int32_t*,
+                                      int32_t*,
+                                      int32_t,
+                                      int32_t);
+
+template void for_static_init<int64_t>(int32_t,
+                                      int32_t*,
+                                      int64_t*,
+                                      int64_t*,
+                                      int64_t*,
+                                      int64_t,
+                                      int64_t);
+
+// -------------------------------------------------------
+// FOR LOOP DYNAMIC DISPATCH
+// -------------------------------------------------------
+
+/**
+ * State shared by all the threads on this host executing a dynamically
+ * scheduled loop. Iterations are numbered from zero to the trip count, and
+ * threads take chunks of them from a shared counter.
+ *
+ * On a single host that's just an atomic. In distributed mode the counter
+ * lives in global state, and each host takes batches of chunks from it under
+ * the group's distributed lock, then hands them out locally.
+ */
+struct DispatchLoop
+{
+    uint64_t lower = 0;
+    int64_t incr = 1;
+    uint64_t tripCount = 0;
+    uint64_t chunk = 1;
+    bool guided = false;
+    int numThreads = 1;
+
+    std::atomic<uint64_t> next = 0;
+
+    // Threads on this host that have joined and finished the loop, guarded by
+    // the dispatch loops mutex
+    int nJoined = 0;
+    int nFinished = 0;
+
+    // Distributed mode only, the local batch is guarded by batchMx
+    bool distributed = false;
+    std::string user;
+    std::string stateKey;
+    std::mutex batchMx;
+    uint64_t batchNext = 0;
+    uint64_t batchEnd = 0;
+};
+
+// Each parallel section can run several loops, so loops are keyed by group ID
+// and the index of the loop within the section
+static std::mutex dispatchLoopsMx;
+static std::map<std::pair<int, int>, std::shared_ptr<DispatchLoop>>
+  dispatchLoops;
+
+struct ThreadDispatch
+{
+    int groupId = -1;
+    int nLoops = 0;
+    std::pair<int, int> key;
+    std::shared_ptr<DispatchLoop> loop = nullptr;
+};
+
+static thread_local ThreadDispatch threadDispatch;
+
+static thread_local std::vector<ThreadDispatch> savedThreadDispatch;
+
+void pushThreadDispatch()
+{
+    savedThreadDispatch.push_back(threadDispatch);
+    threadDispatch = ThreadDispatch();
+}
+
+void popThreadDispatch()
+{
+    threadDispatch = savedThreadDispatch.back();
+    savedThreadDispatch.pop_back();
+}
+
+// Returns the size of the next chunk to take from the given remaining
+// iterations. Guided chunks shrink as the loop progresses.
+static uint64_t getDispatchChunkSize(const DispatchLoop& loop,
+                                     uint64_t remaining,
+                                     int nThreads)
+{
+    uint64_t size = loop.chunk;
+    if (loop.guided) {
+        uint64_t guidedSize = (remaining + 2 * nThreads - 1) / (2 * nThreads);
+        size = std::max(size, guidedSize);
+    }
+
+    return std::min(size, remaining);
+}
+
+// Takes a chunk of iterations (start inclusive, end exclusive) from [next,
+// end), returning false if there are none left
+static bool takeDispatchChunk(const DispatchLoop& loop,
+                              std::atomic<uint64_t>& next,
+                              uint64_t end,
+                              int nThreads,
+                              uint64_t& chunkStart,
+                              uint64_t& chunkEnd)
+{
+    uint64_t start = next.load(std::memory_order_relaxed);
+    while (true) {
+        if (start >= end) {
+            return false;
+        }
+
+        uint64_t size = getDispatchChunkSize(loop, end - start, nThreads);
+        if (next.compare_exchange_weak(
+              start, start + size, std::memory_order_relaxed)) {
+            chunkStart = start;
+            chunkEnd = start + size;
+            return true;
+        }
+    }
+}
+
+// A distributed loop's global state, the next iteration to hand out and the
+// number of threads across all hosts that have finished the loop
+struct DispatchCounter
+{
+    uint64_t next = 0;
+    uint64_t nFinished = 0;
+};
+
+// Takes the next batch of chunks for this host from the global counter
+static bool takeDispatchBatch(DispatchLoop& loop, int groupIdx)
+{
+    auto group = getExecutingPointToPointGroup();
+    auto kv = faabric::state::getGlobalState().getKV(
+      loop.user, loop.stateKey, sizeof(DispatchCounter));
+
+    group->lock(groupIdx, false);
+
+    DispatchCounter counter;
+    kv->pull();
+    kv->get(reinterpret_cast<uint8_t*>(&counter));
+
+    uint64_t start = counter.next;
+    uint64_t end = start;
+    if (start < loop.tripCount) {
+        uint64_t size = getDispatchChunkSize(
+          loop, loop.tripCount - start, loop.numThreads);
+        size = std::min(size * OMP_DISPATCH_BATCH_CHUNKS,
+                        loop.tripCount - start);
+        end = start + size;
+
+        counter.next = end;
+        kv->set(reinterpret_cast<uint8_t*>(&counter));
+        kv->pushFull();
+    }
+
+    group->unlock(groupIdx, false);
+
+    loop.batchNext = start;
+    loop.batchEnd = end;
+
+    return end > start;
+}
+
+// Counts the given number of this host's threads out of a distributed loop.
+// Every thread in the team is counted out once, so whoever counts out the last
+// of them knows nobody will read the global counter again, and deletes it.
+static void finishDistributedLoop(DispatchLoop& loop,
+                                  int groupIdx,
+                                  int nThreads)
+{
+    auto group = getExecutingPointToPointGroup();
+    faabric::state::State& state = faabric::state::getGlobalState();
+    auto kv = state.getKV(loop.user, loop.stateKey, sizeof(DispatchCounter));
+
+    group->lock(groupIdx, false);
+
+    DispatchCounter counter;
+    kv->pull();
+    kv->get(reinterpret_cast<uint8_t*>(&counter));
+
+    counter.nFinished += nThreads;
+    bool isLast = counter.nFinished >= (uint64_t)loop.numThreads;
+    if (!isLast) {
+        kv->set(reinterpret_cast<uint8_t*>(&counter));
+        kv->pushFull();
+    }
+
+    group->unlock(groupIdx, false);
+
+    if (isLast) {
+        state.deleteKV(loop.user, loop.stateKey);
+    }
+}
+
+static bool takeDistributedChunk(DispatchLoop& loop,
+                                 int groupIdx,
+                                 uint64_t& chunkStart,
+                                 uint64_t& chunkEnd)
+{
+    faabric::util::UniqueLock lock(loop.batchMx);
+
+    if (loop.batchNext >= loop.batchEnd && !takeDispatchBatch(loop, groupIdx)) {
+        return false;
+    }
+
+    uint64_t size = std::min(loop.chunk, loop.batchEnd - loop.batchNext);
+    if (loop.guided) {
+        size = getDispatchChunkSize(
+          loop, loop.batchEnd - loop.batchNext, loop.numThreads);
+    }
+
+    chunkStart = loop.batchNext;
+    chunkEnd = chunkStart + size;
+    loop.batchNext = chunkEnd;
+
+    return true;
+}
+
+template<typename T>
+void dispatch_init(int32_t schedule,
+                   T lower,
+                   T upper,
+                   int64_t incr,
+                   int64_t chunk)
+{
+    // Unsigned version of the given template parameter
+    typedef typename std::make_unsigned<T>::type UT;
+
+    faabric::Message* msg = &ExecutorContext::get()->getMsg();
+    std::shared_ptr<threads::Level> level = threads::getCurrentOpenMPLevel();
+
+    schedule &= ~(sch_modifier_monotonic | sch_modifier_nonmonotonic);
+    if (schedule < sch_lower || schedule >= sch_upper) {
+        SPDLOG_ERROR("Unimplemented OpenMP dispatch scheduler {}", schedule);
+        throw std::runtime_error("Unimplemented OpenMP scheduler");
+    }
+
+    auto loop = std::make_shared<DispatchLoop>();
+    loop->lower = (uint64_t)lower;
+    loop->incr = incr;
+    loop->numThreads = level->numThreads;
+
+    if (incr > 0) {
+        loop->tripCount =
+          upper < lower ? 0 : (UT)(upper - lower) / (UT)incr + 1;
+    } else {
+        loop->tripCount =
+          lower < upper ? 0 : (UT)(lower - upper) / (UT)(-incr) + 1;
+    }
+
+    switch (schedule) {
+        case sch_guided_chunked:
+        case sch_guided_iterative_chunked:
+        case sch_guided_analytical_chunked:
+        case sch_auto: {
+            loop->guided = true;
+            loop->chunk = chunk < 1 ? 1 : chunk;
+            break;
+        }
+        case sch_dynamic_chunked: {
+            loop->chunk = chunk < 1 ? 1 : chunk;
+            break;
+        }
+        default: {
+            // Static (and runtime, which defaults to static) loops that come
+            // through dispatch get one balanced chunk per thread
+            uint64_t nThreads = loop->numThreads;
+            loop->chunk =
+              chunk >= 1 ? chunk : (loop->tripCount + nThreads - 1) / nThreads;
+            loop->chunk = std::max<uint64_t>(loop->chunk, 1);
+            break;
+        }
+    }
+
+    // Work out which loop this is within the current parallel section
+    if (threadDispatch.groupId != msg->groupid()) {
+        threadDispatch.groupId = msg->groupid();
+        threadDispatch.nLoops = 0;
+    }
+    threadDispatch.key = { msg->groupid(), threadDispatch.nLoops++ };
+
+    // A single thread doesn't need to share anything
+    if (level->numThreads == 1) {
+        threadDispatch.loop = loop;
+        return;
+    }
+
+    bool singleHost = ExecutorContext::get()->getBatchRequest()->singlehost();
+    loop->distributed = !singleHost;
+    loop->user = msg->user();
+    loop->stateKey = fmt::format("omp_dispatch_{}_{}",
+                                 threadDispatch.key.first,
+                                 threadDispatch.key.second);
+
+    // The first thread on this host to get here creates the shared state
+    faabric::util::UniqueLock lock(dispatchLoopsMx);
+    auto [it, inserted] = dispatchLoops.try_emplace(threadDispatch.key, loop);
+    it->second->nJoined++;
+    threadDispatch.loop = it->second;
+}
+
+template<typename T>
+int32_t dispatch_next(int32_t* lastIter, T* lower, T* upper, T* stride)
+{
+    faabric::Message* msg = &ExecutorContext::get()->getMsg();
+    std::shared_ptr<DispatchLoop> loop = threadDispatch.loop;
+    if (loop == nullptr) {
+        SPDLOG_ERROR("OpenMP dispatch next without init");
+        throw std::runtime_error("OpenMP dispatch next without init");
+    }
+
+    uint64_t chunkStart = 0;
+    uint64_t chunkEnd = 0;
+    bool found = false;
+    if (loop->numThreads == 1) {
+        // The whole loop in one go
+        found = loop->next.exchange(loop->tripCount) < loop->tripCount;
+        chunkEnd = loop->tripCount;
+    } else if (loop->distributed) {
+        found =
+          takeDistributedChunk(*loop, msg->groupidx(), chunkStart, chunkEnd);
+    } else {
+        found = takeDispatchChunk(*loop,
+                                  loop->next,
+                                  loop->tripCount,
+                                  loop->numThreads,
+                                  chunkStart,
+                                  chunkEnd);
+    }
+
+    if (!found) {
+        threadDispatch.loop = nullptr;
+        if (loop->numThreads == 1) {
+            return 0;
+        }
+
+        // The last thread to finish on this host tidies up. On a single host
+        // that means every thread, as a late thread mustn't recreate the loop
+        // and run it again. In distributed mode threads on other hosts never
+        // join, but a recreated loop would find the global counter exhausted,
+        // so it's only deleted once the whole team has finished.
+        int nLeaving = 0;
+        {
+            faabric::util::UniqueLock lock(dispatchLoopsMx);
+            loop->nFinished++;
+            int nExpected =
+              loop->distributed ? loop->nJoined : loop->numThreads;
+            if (loop->nFinished == nExpected) {
+                dispatchLoops.erase(threadDispatch.key);
+                nLeaving = nExpected;
+            }
+        }
+
+        if (loop->distributed && nLeaving > 0) {
+            finishDistributedLoop(*loop, msg->groupidx(), nLeaving);
+        }
+
+        return 0;
+    }
+
+    // Iteration numbers to loop bounds, wrapping as the loop variable would
+    *lower = (T)(loop->lower + chunkStart * (uint64_t)loop->incr);
+    *upper = (T)(loop->lower + (chunkEnd - 1) * (uint64_t)loop->incr);
+    *stride = (T)loop->incr;
+    *lastIter = chunkEnd == loop->tripCount;
+
+    return 1;
+}
+
+template void dispatch_init<int32_t>(int32_t,
+                               int32_t,
+                               int32_t,
+                               int64_t,
+                               int64_t);
+
+template void dispatch_init<uint32_t>(int32_t,
+                                uint32_t,
+                                uint32_t,
+                                int64_t,
+                                int64_t);
+
+template void dispatch_init<int64_t>(int32_t,
+                               int64_t,
+                               int64_t,
+                               int64_t,
+                               int64_t);
+
+template void dispatch_init<uint64_t>(int32_t,
+                                uint64_t,
+                                uint64_t,
+                                int64_t,
+                                int64_t);
+
+template int32_t dispatch_next<int32_t>(int32_t*,
+                                  int32_t*,
+                                  int32_t*,
+                                  int32_t*);
+
+template int32_t dispatch_next<uint32_t>(int32_t*,
+                                   uint32_t*,
+                                   uint32_t*,
+                                   uint32_t*);
+
+template int32_t dispatch_next<int64_t>(int32_t*,
+                                  int64_t*,
+                                  int64_t*,
+                                  int64_t*);
+
+template int32_t dispatch_next<uint64_t>(int32_t*,
+                                   uint64_t*,
+                                   uint64_t*,
+                                   uint64_t*);
+
+// ---------------------------------------------------
+// REDUCTION
+// ---------------------------------------------------
+
+/**
+ * A tree reduction across the threads of a single host team. In each round,
+ * thread t combines the reduce data of thread t + stride into its own using
+ * the compiler's reduce function, so only the master ends up applying the
+ * result to the shared variables. There are no locks, each thread only
+ * waits on its children.
+ *
+ * Threads must wait for their parent to consume their data before returning,
+ * as the reduce data lives on their stack.
+ */
+struct TreeReduction
+{
+    explicit TreeReduction(int numThreadsIn)
+      : numThreads(numThreadsIn)
+      , reduceData(numThreadsIn, 0)
+      , ready(new std::atomic<int>[numThreadsIn])
+      , consumed(new std::atomic<int>[numThreadsIn])
+    {
+        for (int i = 0; i < numThreads; i++) {
+            ready[i] = 0;
+            consumed[i] = 0;
+        }
+    }
+
+    int numThreads;
+    std::vector<int32_t> reduceData;
+    std::unique_ptr<std::atomic<int>[]> ready;
+    std::unique_ptr<std::atomic<int>[]> consumed;
+};
+
+static std::mutex treeReductionsMx;
+static std::map<std::pair<int, int>, std::shared_ptr<TreeReduction>>
+  treeReductions;
+
+struct ThreadReductions
+{
+    int groupId = -1;
+    int nReductions = 0;
+
+    // Whether this thread's current reduction is a tree reduction
+    bool isTree = false;
+};
+
+static thread_local ThreadReductions threadReductions;
+
+static void waitForFlag(std::atomic<int>& flag)
+{
+    int value = flag.load(std::memory_order_acquire);
+    while (value == 0) {
+        flag.wait(value, std::memory_order_acquire);
+        value = flag.load(std::memory_order_acquire);
+    }
+}
+
+static void setFlag(std::atomic<int>& flag)
+{
+    flag.store(1, std::memory_order_release);
+    flag.notify_all();
+}
+
+/**
+ * Performs this thread's part of a tree reduction.
+ *
+ * @return 1 on the master, which must apply the result, 0 elsewhere.
+ */
+static int32_t doTreeReduce(faabric::Message* msg,
+                            int localThreadNum,
+                            int numThreads,
+                            int32_t reduceData,
+                            const OpenMPReduceFunc& reduceFunc)
+{
+    if (threadReductions.groupId != msg->groupid()) {
+        threadReductions.groupId = msg->groupid();
+        threadReductions.nReductions = 0;
+    }
+    std::pair<int, int> key = { msg->groupid(),
+                                threadReductions.nReductions++ };
+
+    std::shared_ptr<TreeReduction> reduction;
+    {
+        faabric::util::UniqueLock lock(treeReductionsMx);
+        auto [it, inserted] = treeReductions.try_emplace(
+          key, std::make_shared<TreeReduction>(numThreads));
+        reduction = it->second;
+    }
+    reduction->reduceData.at(localThreadNum) = reduceData;
+
+    for (int stride = 1; stride < numThreads; stride *= 2) {
+        if (localThreadNum % (2 * stride) != 0) {
+            break;
+        }
+
+        int child = localThreadNum + stride;
+        if (child >= numThreads) {
+            continue;
+        }
+
+        waitForFlag(reduction->ready[child]);
+        reduceFunc(reduceData, reduction->reduceData.at(child));
+        setFlag(reduction->consumed[child]);
+    }
+
+    if (localThreadNum == 0) {
+        // Everyone has contributed by now, so nobody else needs the state
+        faabric::util::UniqueLock lock(treeReductionsMx);
+        treeReductions.erase(key);
+        return 1;
+    }
+
+    setFlag(reduction->ready[localThreadNum]);
+    waitForFlag(reduction->consumed[localThreadNum]);
+
+    return 0;
+}
+
+static bool useTreeReduce(const std::shared_ptr<threads::Level>& level)
+{
+    return level->numThreads > 1 &&
+           ExecutorContext::get()->getBatchRequest()->singlehost();
+}
+
+static void startReduceCritical(faabric::Message* msg,
+                                const std::shared_ptr<threads::Level>& level)
+{
+    // This function synchronises updates to shared reduce variables.
+    // Each host will have its own copy of these variables, which will be merged
+    // at the end of the parallel section via Faasm shared memory.
+    // This means we only need to synchronise local accesses here, so we only
+    // need a local lock.
+    SPDLOG_TRACE("Entering reduce critical section for group {}",
+                 msg->groupid());
+
+    // A single thread team (e.g. a nested one) has nothing to synchronise
+    if (level->numThreads == 1) {
+        return;
+    }
+
+    std::shared_ptr<faabric::transport::PointToPointGroup> group =
+      faabric::transport::PointToPointGroup::getOrAwaitGroup(msg->groupid());
+    group->localLock();
+}
+
+static void endReduceCritical(faabric::Message* msg,
+                              const std::shared_ptr<threads::Level>& level,
+                              bool barrier)
+{
+    if (level->numThreads == 1) {
+        return;
+    }
+
+    int localThreadNum = level->getLocalThreadNum(msg);
+
+    // Unlock the critical section
+    std::shared_ptr<faabric::transport::PointToPointGroup> group =
+      faabric::transport::PointToPointGroup::getGroup(msg->groupid());
+    group->localUnlock();
+
+    // Master must make sure all other threads are done
+    group->notify(localThreadNum);
+
+    // Everyone waits if there's a barrier
+    if (barrier) {
+        OpenMPProfileTimer timer(OpenMPProfileEvent::Barrier);
+        PROF_START(FinaliseReduceBarrier)
+        group->barrier(localThreadNum);
+        PROF_END(FinaliseReduceBarrier)
+    }
+}
+
+/**
+ * When the whole team is on this host we do a tree reduction (see
+ * TreeReduction), returning 1 only on the master. The compiler only calls
+ * __kmpc_end_reduce when we return 1, so for blocking reductions the other
+ * threads wait at the barrier here. Otherwise every thread applies its own
+ * data under the group's local lock.
+ */
+int32_t startOpenMPReduce(faabric::Message* msg,
+                          const std::shared_ptr<threads::Level>& level,
+                          int32_t reduceData,
+                          const OpenMPReduceFunc& reduceFunc,
+                          bool nowait)
+{
+    OpenMPProfileTimer timer(OpenMPProfileEvent::Reduce,
+                             OpenMPProfileEvent::Barrier);
+
+    threadReductions.isTree = useTreeReduce(level);
+    if (threadReductions.isTree) {
+        int localThreadNum = level->getLocalThreadNum(msg);
+        int32_t res = doTreeReduce(
+          msg, localThreadNum, level->numThreads, reduceData, reduceFunc);
+        if (res == 0 && !nowait) {
+            teamBarrier(localThreadNum);
+        }
+
+        return res;
+    }
+
+    startReduceCritical(msg, level);
+    return 1;
+}
+
+void endOpenMPReduce(faabric::Message* msg,
+                     const std::shared_ptr<threads::Level>& level,
+                     bool nowait)
+{
+    OpenMPProfileTimer timer(OpenMPProfileEvent::Reduce,
+                             OpenMPProfileEvent::Barrier);
+
+    // Only the master gets here in a tree reduction
+    if (threadReductions.isTree) {
+        if (!nowait) {
+            teamBarrier(level->getLocalThreadNum(msg));
+        }
+        return;
+    }
+
+    endReduceCritical(msg, level, !nowait);
+}
+
+// ---------------------------------------------------
+// SHARED MEMORY REDUCTIONS
+// ---------------------------------------------------
+
+static std::pair<uint32_t, faabric::util::SnapshotDataType>
+extractSnapshotDataType(int32_t varType)
+{
+    switch (varType) {
+        case (faabric::util::SnapshotDataType::Raw): {
+            SPDLOG_ERROR("Cannot declare untyped merge regions from code");
+            throw std::runtime_error("Untyped shared memory merge region");
+        }
+        case (faabric::util::SnapshotDataType::Bool): {
+            return { sizeof(int8_t), faabric::util::SnapshotDataType::Bool };
+        }
+        case (faabric::util::SnapshotDataType::Int): {
+            return { sizeof(int32_t), faabric::util::SnapshotDataType::Int };
+        }
+        case (faabric::util::SnapshotDataType::Long): {
+            return { sizeof(int64_t), faabric::util::SnapshotDataType::Long };
+        }
+        case (faabric::util::SnapshotDataType::Float): {
+            return { sizeof(float), faabric::util::SnapshotDataType::Float };
+        }
+        case (faabric::util::SnapshotDataType::Double): {
+            return { sizeof(double), faabric::util::SnapshotDataType::Double };
+        }
+        default: {
+            SPDLOG_ERROR("Unrecognised memory data type: {}", varType);
+            throw std::runtime_error("Unrecognised shared memory data type");
+        }
+    }
+}
+
+static faabric::util::SnapshotMergeOperation extractSnapshotMergeOp(
+  int32_t mergeOp)
+{
+    if (faabric::util::SnapshotMergeOperation::Bytewise <= mergeOp &&
+        mergeOp <= faabric::util::SnapshotMergeOperation::Min) {
+        return static_cast<faabric::util::SnapshotMergeOperation>(mergeOp);
+    }
+
+    SPDLOG_ERROR("Unrecognised merge operation: {}", mergeOp);
+    throw std::runtime_error("Unrecognised merge operation");
+}
+
+void addOpenMPMergeRegion(int32_t varPtr,
+                          int32_t varType,
+                          int32_t mergeOp,
+                          int32_t length,
+                          bool currentBatch)
+{
+    auto [elemSize, dataType] = extractSnapshotDataType(varType);
+    faabric::util::SnapshotMergeOperation op = extractSnapshotMergeOp(mergeOp);
+
+    WasmModule* module = getExecutingModule();
+    uint64_t end = (uint64_t)(uint32_t)varPtr + (uint64_t)length * elemSize;
+    if (length <= 0 || end > module->getMemorySizeBytes()) {
+        SPDLOG_ERROR("Invalid shared memory reduction of {} values at {}",
+                     length,
+                     varPtr);
+        throw std::runtime_error("Invalid shared memory reduction");
+    }
+
+    faabric::Message* msg = &ExecutorContext::get()->getMsg();
+    SPDLOG_DEBUG("Registering reduction variable {}-{} for {} {}",
+                 varPtr,
+                 end,
+                 faabric::util::funcToString(*msg, false),
+                 currentBatch ? "this batch" : "next batch");
+
+    if (currentBatch) {
+        auto snap =
+          ExecutorContext::get()->getExecutor()->getMainThreadSnapshot(*msg,
+                                                                       false);
+        for (int32_t i = 0; i < length; i++) {
+            snap->addMergeRegion(varPtr + i * elemSize, elemSize, dataType, op);
+        }
+    } else {
+        for (int32_t i = 0; i < length; i++) {
+            module->addMergeRegionForNextThreads(
+              varPtr + i * elemSize, elemSize, dataType, op);
+        }
+    }
+}
+}
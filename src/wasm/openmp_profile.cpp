@@ -0,0 +1,185 @@
+#include <conf/FaasmConfig.h>
+#include <wasm/openmp_profile.h>
+#include <wasm/timing.h>
+
+#include <faabric/scheduler/ExecutorContext.h>
+#include <faabric/util/config.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+namespace wasm {
+
+static std::mutex profilesMx;
+
+// Keyed by app ID, then OpenMP thread number
+static std::map<int32_t, std::map<int32_t, OpenMPThreadProfile>> profiles;
+
+static std::mutex profileFileMx;
+
+static thread_local std::array<uint64_t, (int)OpenMPProfileEvent::NumEvents>
+  threadNanos = {};
+
+std::string openMPProfileEventName(OpenMPProfileEvent event)
+{
+    switch (event) {
+        case OpenMPProfileEvent::Region:
+            return "region";
+        case OpenMPProfileEvent::Fork:
+            return "fork";
+        case OpenMPProfileEvent::Barrier:
+            return "barrier";
+        case OpenMPProfileEvent::Critical:
+            return "critical";
+        case OpenMPProfileEvent::Reduce:
+            return "reduce";
+        default: {
+            SPDLOG_ERROR("Unrecognised OpenMP profile event {}", (int)event);
+            throw std::runtime_error("Unrecognised OpenMP profile event");
+        }
+    }
+}
+
+std::string OpenMPThreadProfile::toJson(const std::string& host) const
+{
+    std::string json =
+      fmt::format("{{\"app\": {}, \"host\": \"{}\", \"thread\": {}",
+                  appId,
+                  host,
+                  threadNum);
+
+    for (int i = 0; i < (int)OpenMPProfileEvent::NumEvents; i++) {
+        std::string name = openMPProfileEventName((OpenMPProfileEvent)i);
+        json += fmt::format(
+          ", \"{}_ns\": {}, \"{}_count\": {}", name, nanos[i], name, counts[i]);
+    }
+
+    json += "}";
+    return json;
+}
+
+bool isOpenMPProfiling()
+{
+    return !conf::getFaasmConfig().ompProfileFile.empty();
+}
+
+void recordOpenMPEvent(OpenMPProfileEvent event, uint64_t nanos)
+{
+    threadNanos[(int)event] += nanos;
+
+    if (!faabric::scheduler::ExecutorContext::isSet()) {
+        return;
+    }
+
+    faabric::Message& msg =
+      faabric::scheduler::ExecutorContext::get()->getMsg();
+
+    faabric::util::UniqueLock lock(profilesMx);
+    OpenMPThreadProfile& profile = profiles[msg.appid()][msg.appidx()];
+    profile.appId = msg.appid();
+    profile.threadNum = msg.appidx();
+    profile.nanos[(int)event] += nanos;
+    profile.counts[(int)event]++;
+}
+
+uint64_t getThreadOpenMPNanos(OpenMPProfileEvent event)
+{
+    return threadNanos[(int)event];
+}
+
+std::vector<OpenMPThreadProfile> takeOpenMPProfiles(int32_t appId)
+{
+    std::vector<OpenMPThreadProfile> result;
+
+    faabric::util::UniqueLock lock(profilesMx);
+    auto it = profiles.find(appId);
+    if (it == profiles.end()) {
+        return result;
+    }
+
+    for (const auto& [threadNum, profile] : it->second) {
+        result.push_back(profile);
+    }
+    profiles.erase(it);
+
+    return result;
+}
+
+void flushOpenMPProfile(faabric::Message& msg)
+{
+    if (!isOpenMPProfiling()) {
+        return;
+    }
+
+    std::vector<OpenMPThreadProfile> appProfiles =
+      takeOpenMPProfiles(msg.appid());
+    if (appProfiles.empty()) {
+        return;
+    }
+
+    auto& details = *msg.mutable_execgraphdetails();
+    for (int i = 0; i < (int)OpenMPProfileEvent::NumEvents; i++) {
+        uint64_t totalNanos = 0;
+        for (const auto& profile : appProfiles) {
+            totalNanos += profile.nanos[i];
+        }
+
+        std::string name = openMPProfileEventName((OpenMPProfileEvent)i);
+        details[fmt::format("omp-{}-ns", name)] = std::to_string(totalNanos);
+    }
+
+    const std::string& filePath = conf::getFaasmConfig().ompProfileFile;
+    const std::string host = faabric::util::getSystemConfig().endpointHost;
+    SPDLOG_DEBUG("Writing OpenMP profile of {} threads for app {} to {}",
+                 appProfiles.size(),
+                 msg.appid(),
+                 filePath);
+
+    faabric::util::UniqueLock lock(profileFileMx);
+    std::ofstream outFs(filePath, std::ios::app);
+    if (!outFs.is_open()) {
+        SPDLOG_ERROR("Failed to open OpenMP profile file {}", filePath);
+        throw std::runtime_error("Failed to open OpenMP profile file");
+    }
+
+    for (const auto& profile : appProfiles) {
+        outFs << profile.toJson(host) << std::endl;
+    }
+}
+
+OpenMPProfileTimer::OpenMPProfileTimer(OpenMPProfileEvent eventIn,
+                                       OpenMPProfileEvent excludeIn)
+  : event(eventIn)
+  , exclude(excludeIn)
+  , enabled(isOpenMPProfiling())
+{
+    if (!enabled) {
+        return;
+    }
+
+    startNanos = getTimerNanos();
+    if (exclude != OpenMPProfileEvent::NumEvents) {
+        startExcludedNanos = getThreadOpenMPNanos(exclude);
+    }
+}
+
+OpenMPProfileTimer::~OpenMPProfileTimer()
+{
+    if (!enabled) {
+        return;
+    }
+
+    uint64_t elapsed = getTimerNanos() - startNanos;
+    if (exclude != OpenMPProfileEvent::NumEvents) {
+        uint64_t excluded = getThreadOpenMPNanos(exclude) - startExcludedNanos;
+        elapsed -= std::min(elapsed, excluded);
+    }
+
+    recordOpenMPEvent(event, elapsed);
+}
+}
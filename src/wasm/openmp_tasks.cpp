@@ -0,0 +1,351 @@
+#include <wasm/WasmExecutionContext.h>
+#include <wasm/openmp_tasks.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+// Task memory for a team is carved out of chunks of this size
+#define OMP_TASK_ARENA_CHUNK (256 * 1024)
+
+namespace wasm {
+
+uint32_t OpenMPTaskTeam::allocate(uint32_t nBytes)
+{
+    faabric::util::UniqueLock lock(arenaMx);
+
+    std::vector<uint32_t>& freeList = freeLists[nBytes];
+    if (!freeList.empty()) {
+        uint32_t offset = freeList.back();
+        freeList.pop_back();
+        return offset;
+    }
+
+    if (arenaNext + nBytes > arenaEnd) {
+        uint32_t chunkSize = std::max<uint32_t>(OMP_TASK_ARENA_CHUNK, nBytes);
+        uint32_t chunk = module->mmapMemory(chunkSize);
+        arenaChunks.emplace_back(chunk, chunkSize);
+        arenaNext = chunk;
+        arenaEnd = chunk + chunkSize;
+    }
+
+    uint32_t offset = arenaNext;
+    arenaNext += nBytes;
+    return offset;
+}
+
+void OpenMPTaskTeam::free(uint32_t offset, uint32_t nBytes)
+{
+    faabric::util::UniqueLock lock(arenaMx);
+    freeLists[nBytes].push_back(offset);
+}
+
+void OpenMPTaskTeam::releaseArena()
+{
+    faabric::util::UniqueLock lock(arenaMx);
+    for (auto [offset, length] : arenaChunks) {
+        module->unmapMemory(offset, length);
+    }
+
+    arenaChunks.clear();
+    freeLists.clear();
+    arenaNext = 0;
+    arenaEnd = 0;
+}
+
+std::shared_ptr<OpenMPTask> OpenMPTaskTeam::takeTask(int localThreadNum)
+{
+    {
+        OpenMPTaskDeque& own = *deques.at(localThreadNum);
+        faabric::util::UniqueLock lock(own.mx);
+        if (!own.tasks.empty()) {
+            std::shared_ptr<OpenMPTask> task = own.tasks.back();
+            own.tasks.pop_back();
+            return task;
+        }
+    }
+
+    for (int i = 1; i < numThreads; i++) {
+        OpenMPTaskDeque& victim = *deques.at((localThreadNum + i) % numThreads);
+        faabric::util::UniqueLock lock(victim.mx);
+        if (!victim.tasks.empty()) {
+            std::shared_ptr<OpenMPTask> task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return task;
+        }
+    }
+
+    return nullptr;
+}
+
+static std::mutex taskTeamsMx;
+static std::unordered_map<int, std::shared_ptr<OpenMPTaskTeam>> taskTeams;
+
+struct ThreadTasks
+{
+    int groupId = -1;
+    int localThreadNum = 0;
+    std::shared_ptr<OpenMPTaskTeam> team = nullptr;
+    std::shared_ptr<OpenMPTask> current = nullptr;
+};
+
+static thread_local ThreadTasks threadTasks;
+
+// Tasks allocated by this thread but not yet started or queued
+static thread_local std::unordered_map<int32_t, std::shared_ptr<OpenMPTask>>
+  heldTasks;
+
+std::shared_ptr<OpenMPTaskTeam> getOpenMPTaskTeam(
+  faabric::Message* msg,
+  const std::shared_ptr<threads::Level>& level)
+{
+    if (level->numThreads == 1) {
+        return nullptr;
+    }
+
+    if (threadTasks.groupId == msg->groupid() && threadTasks.team != nullptr) {
+        return threadTasks.team;
+    }
+
+    faabric::util::UniqueLock lock(taskTeamsMx);
+    auto [it, inserted] = taskTeams.try_emplace(msg->groupid(), nullptr);
+    if (inserted) {
+        auto team = std::make_shared<OpenMPTaskTeam>();
+        team->module = getExecutingModule();
+        team->numThreads = level->numThreads;
+        for (int i = 0; i < level->numThreads; i++) {
+            team->deques.emplace_back(std::make_unique<OpenMPTaskDeque>());
+        }
+        it->second = team;
+    }
+    it->second->nJoined++;
+
+    threadTasks.groupId = msg->groupid();
+    threadTasks.localThreadNum = level->getLocalThreadNum(msg);
+    threadTasks.team = it->second;
+    threadTasks.current = std::make_shared<OpenMPTask>();
+    threadTasks.current->team = it->second;
+
+    return threadTasks.team;
+}
+
+std::shared_ptr<OpenMPTask> allocateOpenMPTask(
+  const std::shared_ptr<OpenMPTaskTeam>& team,
+  uint32_t nBytes,
+  int32_t routine)
+{
+    WasmModule* module = getExecutingModule();
+
+    auto task = std::make_shared<OpenMPTask>();
+    task->team = team;
+    task->size = nBytes;
+    task->routine = routine;
+    task->taskPtr =
+      team == nullptr ? module->mmapMemory(nBytes) : team->allocate(nBytes);
+
+    std::memset(module->wasmPointerToNative(task->taskPtr), 0, nBytes);
+
+    return task;
+}
+
+void holdOpenMPTask(const std::shared_ptr<OpenMPTask>& task)
+{
+    heldTasks[task->taskPtr] = task;
+}
+
+std::shared_ptr<OpenMPTask> takeHeldOpenMPTask(int32_t taskPtr)
+{
+    auto it = heldTasks.find(taskPtr);
+    if (it == heldTasks.end()) {
+        SPDLOG_ERROR("Unrecognised OpenMP task {}", taskPtr);
+        throw std::runtime_error("Unrecognised OpenMP task");
+    }
+
+    std::shared_ptr<OpenMPTask> task = it->second;
+    heldTasks.erase(it);
+    return task;
+}
+
+void freeOpenMPTask(const OpenMPTask& task)
+{
+    if (task.team == nullptr) {
+        getExecutingModule()->unmapMemory(task.taskPtr, task.size);
+    } else {
+        task.team->free(task.taskPtr, task.size);
+    }
+}
+
+void runOpenMPTask(const OpenMPTaskFunc& func,
+                   const std::shared_ptr<OpenMPTask>& task,
+                   bool counted)
+{
+    std::shared_ptr<OpenMPTask> prev = threadTasks.current;
+    threadTasks.current = task;
+
+    try {
+        func(*task);
+    } catch (...) {
+        threadTasks.current = prev;
+        throw;
+    }
+
+    threadTasks.current = prev;
+    freeOpenMPTask(*task);
+
+    if (counted) {
+        task->parent->nChildren.fetch_sub(1, std::memory_order_acq_rel);
+        if (task->group != nullptr) {
+            task->group->nPending.fetch_sub(1, std::memory_order_acq_rel);
+        }
+        task->team->nPending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+// Runs tasks from the team until the condition holds
+template<typename F>
+static void runTasksUntil(const OpenMPTaskFunc& func, F isDone)
+{
+    std::shared_ptr<OpenMPTaskTeam> team = threadTasks.team;
+    while (!isDone()) {
+        std::shared_ptr<OpenMPTask> task =
+          team->takeTask(threadTasks.localThreadNum);
+        if (task != nullptr) {
+            runOpenMPTask(func, task, true);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void queueOpenMPTask(const std::shared_ptr<OpenMPTask>& task)
+{
+    std::shared_ptr<OpenMPTask> current = threadTasks.current;
+    task->parent = current;
+    task->group =
+      current->openGroup != nullptr ? current->openGroup : current->group;
+
+    current->nChildren.fetch_add(1, std::memory_order_acq_rel);
+    if (task->group != nullptr) {
+        task->group->nPending.fetch_add(1, std::memory_order_acq_rel);
+    }
+    task->team->nPending.fetch_add(1, std::memory_order_acq_rel);
+
+    OpenMPTaskDeque& own = *task->team->deques.at(threadTasks.localThreadNum);
+    faabric::util::UniqueLock lock(own.mx);
+    own.tasks.push_back(task);
+}
+
+void waitForOpenMPChildTasks(const OpenMPTaskFunc& func)
+{
+    std::shared_ptr<OpenMPTask> current = threadTasks.current;
+    runTasksUntil(func, [&current] {
+        return current->nChildren.load(std::memory_order_acquire) == 0;
+    });
+}
+
+void yieldOpenMPTask(const OpenMPTaskFunc& func)
+{
+    std::shared_ptr<OpenMPTask> task =
+      threadTasks.team->takeTask(threadTasks.localThreadNum);
+    if (task != nullptr) {
+        runOpenMPTask(func, task, true);
+    }
+}
+
+void startOpenMPTaskGroup()
+{
+    std::shared_ptr<OpenMPTask> current = threadTasks.current;
+    auto group = std::make_shared<OpenMPTaskGroup>();
+    group->parent = current->openGroup;
+    current->openGroup = group;
+}
+
+void endOpenMPTaskGroup(const OpenMPTaskFunc& func)
+{
+    std::shared_ptr<OpenMPTask> current = threadTasks.current;
+    std::shared_ptr<OpenMPTaskGroup> group = current->openGroup;
+    if (group == nullptr) {
+        SPDLOG_ERROR("Ending OpenMP task group that was never started");
+        throw std::runtime_error("Ending OpenMP task group without start");
+    }
+
+    runTasksUntil(func, [&group] {
+        return group->nPending.load(std::memory_order_acquire) == 0;
+    });
+
+    current->openGroup = group->parent;
+}
+
+void startUndeferredOpenMPTask(int32_t taskPtr)
+{
+    std::shared_ptr<OpenMPTask> task = takeHeldOpenMPTask(taskPtr);
+    if (task->team == nullptr) {
+        holdOpenMPTask(task);
+        return;
+    }
+
+    task->parent = threadTasks.current;
+    threadTasks.current = task;
+}
+
+void finishUndeferredOpenMPTask(int32_t taskPtr)
+{
+    std::shared_ptr<OpenMPTask> task = nullptr;
+    if (threadTasks.current != nullptr &&
+        threadTasks.current->taskPtr == taskPtr) {
+        task = threadTasks.current;
+        threadTasks.current = task->parent;
+    } else {
+        task = takeHeldOpenMPTask(taskPtr);
+    }
+
+    freeOpenMPTask(*task);
+}
+
+void runPendingOpenMPTasks(const OpenMPTaskFunc& func,
+                           faabric::Message* msg,
+                           const std::shared_ptr<threads::Level>& level)
+{
+    if (level->numThreads == 1 || threadTasks.groupId != msg->groupid() ||
+        threadTasks.team == nullptr) {
+        return;
+    }
+
+    std::shared_ptr<OpenMPTaskTeam> team = threadTasks.team;
+    runTasksUntil(func, [&team] {
+        return team->nPending.load(std::memory_order_acquire) == 0;
+    });
+}
+
+void finishOpenMPTeamTasks(const OpenMPTaskFunc& func,
+                           faabric::Message* msg,
+                           const std::shared_ptr<threads::Level>& level)
+{
+    if (level->numThreads == 1 || threadTasks.groupId != msg->groupid() ||
+        threadTasks.team == nullptr) {
+        return;
+    }
+
+    // Every task must be done before the parallel section ends
+    runPendingOpenMPTasks(func, msg, level);
+
+    // The last thread on this host to finish tidies up
+    std::shared_ptr<OpenMPTaskTeam> team = threadTasks.team;
+    threadTasks = ThreadTasks();
+
+    faabric::util::UniqueLock lock(taskTeamsMx);
+    team->nFinished++;
+    if (team->nFinished == team->nJoined) {
+        auto it = taskTeams.find(msg->groupid());
+        if (it != taskTeams.end() && it->second == team) {
+            taskTeams.erase(it);
+        }
+
+        team->releaseArena();
+    }
+}
+}
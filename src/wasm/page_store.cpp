@@ -0,0 +1,324 @@
+#include <wasm/page_store.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/memory.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string_view>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace wasm {
+
+PageStore& getPageStore()
+{
+    static PageStore store;
+    return store;
+}
+
+// -------------------------------------
+// PAGED SNAPSHOT
+// -------------------------------------
+
+PagedSnapshot::~PagedSnapshot()
+{
+    if (pageStore != nullptr) {
+        pageStore->release(slots);
+    }
+}
+
+void PagedSnapshot::mapToMemory(std::span<uint8_t> target) const
+{
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    if (target.size() < slots.size() * pageSize) {
+        throw std::runtime_error("Memory too small to map paged snapshot");
+    }
+
+    // Runs of zero pages, or of consecutive slots, are mapped in one go
+    size_t i = 0;
+    while (i < slots.size()) {
+        size_t j = i + 1;
+        if (slots.at(i) < 0) {
+            while (j < slots.size() && slots.at(j) < 0) {
+                j++;
+            }
+        } else {
+            while (j < slots.size() && slots.at(j) == slots.at(j - 1) + 1) {
+                j++;
+            }
+        }
+
+        uint8_t* addr = target.data() + i * pageSize;
+        size_t len = (j - i) * pageSize;
+        void* res;
+        if (slots.at(i) < 0) {
+            res = ::mmap(addr,
+                         len,
+                         PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+                         -1,
+                         0);
+        } else {
+            res = ::mmap(addr,
+                         len,
+                         PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_FIXED,
+                         pageStore->fd,
+                         slots.at(i) * pageSize);
+        }
+
+        if (res == MAP_FAILED) {
+            SPDLOG_ERROR("Failed to map paged snapshot at {}: {}",
+                         i * pageSize,
+                         std::strerror(errno));
+            throw std::runtime_error("Failed to map paged snapshot");
+        }
+
+        i = j;
+    }
+}
+
+void PagedSnapshot::copyTo(size_t offset, uint8_t* dest, size_t len) const
+{
+    if (len > 0 && offset + len > size) {
+        throw std::runtime_error("Copy out of bounds of paged snapshot");
+    }
+
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    while (len > 0) {
+        size_t pageOffset = offset % pageSize;
+        size_t chunk = std::min(len, pageSize - pageOffset);
+
+        int64_t slot = slots.at(offset / pageSize);
+        if (slot < 0) {
+            std::memset(dest, 0, chunk);
+        } else {
+            std::memcpy(
+              dest, pageStore->view + slot * pageSize + pageOffset, chunk);
+        }
+
+        offset += chunk;
+        dest += chunk;
+        len -= chunk;
+    }
+}
+
+// -------------------------------------
+// PAGE STORE
+// -------------------------------------
+
+PageStore::PageStore()
+{
+    fd = ::memfd_create("faasm-pages", MFD_CLOEXEC);
+    if (fd < 0) {
+        SPDLOG_ERROR("Failed to create page store fd: {}",
+                     std::strerror(errno));
+        throw std::runtime_error("Failed to create page store");
+    }
+
+    // The view covers pages before they're written, so is reserved up front
+    void* res = ::mmap(nullptr,
+                       PAGE_STORE_MAX_BYTES,
+                       PROT_READ,
+                       MAP_SHARED | MAP_NORESERVE,
+                       fd,
+                       0);
+    if (res == MAP_FAILED) {
+        SPDLOG_ERROR("Failed to map page store: {}", std::strerror(errno));
+        ::close(fd);
+        throw std::runtime_error("Failed to map page store");
+    }
+
+    view = (const uint8_t*)res;
+}
+
+PageStore::~PageStore()
+{
+    clear();
+
+    ::munmap((void*)view, PAGE_STORE_MAX_BYTES);
+    ::close(fd);
+}
+
+void PageStore::registerSnapshot(const std::string& key,
+                                 std::span<const uint8_t> data)
+{
+    std::shared_ptr<PagedSnapshot> snap = store(data);
+
+    faabric::util::FullLock lock(snapshotsMx);
+    snapshots[key] = std::move(snap);
+}
+
+std::shared_ptr<PagedSnapshot> PageStore::getSnapshot(const std::string& key)
+{
+    std::shared_lock<std::shared_mutex> lock(snapshotsMx);
+    auto it = snapshots.find(key);
+    return it == snapshots.end() ? nullptr : it->second;
+}
+
+bool PageStore::snapshotExists(const std::string& key)
+{
+    std::shared_lock<std::shared_mutex> lock(snapshotsMx);
+    return snapshots.contains(key);
+}
+
+void PageStore::deleteSnapshot(const std::string& key)
+{
+    // Pages are released outside the lock, by the last holder
+    std::shared_ptr<PagedSnapshot> snap;
+    {
+        faabric::util::FullLock lock(snapshotsMx);
+        auto it = snapshots.find(key);
+        if (it == snapshots.end()) {
+            return;
+        }
+
+        snap = std::move(it->second);
+        snapshots.erase(it);
+    }
+}
+
+void PageStore::clear()
+{
+    std::unordered_map<std::string, std::shared_ptr<PagedSnapshot>> cleared;
+    {
+        faabric::util::FullLock lock(snapshotsMx);
+        cleared.swap(snapshots);
+    }
+}
+
+PageStoreStats PageStore::getStats()
+{
+    faabric::util::UniqueLock lock(pagesMx);
+
+    PageStoreStats stats;
+    stats.refs = nRefs;
+    stats.stored = slotRefs.size() - freeSlots.size();
+
+    return stats;
+}
+
+std::shared_ptr<PagedSnapshot> PageStore::store(std::span<const uint8_t> data)
+{
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    size_t nPages = (data.size() + pageSize - 1) / pageSize;
+
+    auto snap = std::make_shared<PagedSnapshot>();
+    snap->pageStore = this;
+    snap->size = data.size();
+    snap->slots.reserve(nPages);
+
+    // The last page is padded with zeros
+    std::vector<uint8_t> lastPage(pageSize, 0);
+
+    faabric::util::UniqueLock lock(pagesMx);
+    for (size_t i = 0; i < nPages; i++) {
+        const uint8_t* page = data.data() + i * pageSize;
+        size_t len = std::min(pageSize, data.size() - i * pageSize);
+        if (len < pageSize) {
+            std::memcpy(lastPage.data(), page, len);
+            page = lastPage.data();
+        }
+
+        snap->slots.push_back(storePage(page));
+    }
+
+    PageStoreStats stats{ nRefs, slotRefs.size() - freeSlots.size() };
+    SPDLOG_DEBUG("Stored {} byte snapshot, {}/{} pages stored on host",
+                 data.size(),
+                 stats.stored,
+                 stats.refs);
+
+    return snap;
+}
+
+int64_t PageStore::storePage(const uint8_t* page)
+{
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    if (std::all_of(page, page + pageSize, [](uint8_t b) { return b == 0; })) {
+        return -1;
+    }
+
+    nRefs++;
+
+    size_t hash =
+      std::hash<std::string_view>{}({ (const char*)page, pageSize });
+    auto [begin, end] = slotsByHash.equal_range(hash);
+    for (auto it = begin; it != end; ++it) {
+        if (std::memcmp(view + it->second * pageSize, page, pageSize) == 0) {
+            slotRefs.at(it->second)++;
+            return it->second;
+        }
+    }
+
+    int64_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        slot = slotRefs.size();
+        slotRefs.push_back(0);
+        slotHashes.push_back(0);
+    }
+
+    size_t needed = (slot + 1) * pageSize;
+    if (needed > fdSize) {
+        size_t newSize = std::max(needed, 2 * fdSize);
+        if (newSize > PAGE_STORE_MAX_BYTES ||
+            ::ftruncate(fd, newSize) != 0) {
+            SPDLOG_ERROR("Failed to grow page store to {} bytes", newSize);
+            throw std::runtime_error("Failed to grow page store");
+        }
+        fdSize = newSize;
+    }
+
+    if (::pwrite(fd, page, pageSize, slot * pageSize) != (ssize_t)pageSize) {
+        SPDLOG_ERROR("Failed to write page to store: {}",
+                     std::strerror(errno));
+        throw std::runtime_error("Failed to write page to store");
+    }
+
+    slotRefs.at(slot) = 1;
+    slotHashes.at(slot) = hash;
+    slotsByHash.emplace(hash, slot);
+
+    return slot;
+}
+
+void PageStore::release(const std::vector<int64_t>& slots)
+{
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+
+    faabric::util::UniqueLock lock(pagesMx);
+    for (int64_t slot : slots) {
+        if (slot < 0) {
+            continue;
+        }
+
+        nRefs--;
+        if (--slotRefs.at(slot) > 0) {
+            continue;
+        }
+
+        auto [begin, end] = slotsByHash.equal_range(slotHashes.at(slot));
+        for (auto it = begin; it != end; ++it) {
+            if (it->second == slot) {
+                slotsByHash.erase(it);
+                break;
+            }
+        }
+
+        // Give the page's memory back. Modules hold the snapshots they've
+        // mapped, so nothing still reads through to it.
+        ::fallocate(fd,
+                    FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                    slot * pageSize,
+                    pageSize);
+        freeSlots.push_back(slot);
+    }
+}
+}
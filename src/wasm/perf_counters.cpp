@@ -0,0 +1,216 @@
+#include <wasm/perf_counters.h>
+
+#include <faabric/util/logging.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace wasm {
+
+struct PerfReading
+{
+    uint64_t value = 0;
+    uint64_t timeEnabled = 0;
+    uint64_t timeRunning = 0;
+};
+
+static std::atomic<bool> warnedUnavailable = false;
+
+static long perfEventOpen(struct perf_event_attr* attr)
+{
+    // Only count the calling thread, on whichever CPU it runs
+    return ::syscall(SYS_perf_event_open, attr, 0, -1, -1, 0);
+}
+
+static int openCounter(PerfCounter counter)
+{
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_hv = 1;
+
+    uint64_t cacheMiss = (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    switch (counter) {
+        case PerfCounter::Instructions: {
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        }
+        case PerfCounter::Cycles: {
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        }
+        case PerfCounter::LlcMisses: {
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_LL | cacheMiss;
+            break;
+        }
+        case PerfCounter::DtlbMisses: {
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB | cacheMiss;
+            break;
+        }
+        case PerfCounter::ContextSwitches: {
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+            break;
+        }
+        default: {
+            SPDLOG_ERROR("Unrecognised perf counter {}", (int)counter);
+            throw std::runtime_error("Unrecognised perf counter");
+        }
+    }
+
+    // Kernel time is only counted where the host allows it. Context switches
+    // happen in the kernel, so can't be counted without it.
+    long fd = perfEventOpen(&attr);
+    if (fd < 0 && (errno == EACCES || errno == EPERM) &&
+        counter != PerfCounter::ContextSwitches) {
+        attr.exclude_kernel = 1;
+        fd = perfEventOpen(&attr);
+    }
+
+    if (fd < 0) {
+        SPDLOG_DEBUG("Could not open {} counter: {}",
+                     perfCounterName(counter),
+                     std::strerror(errno));
+    }
+
+    return (int)fd;
+}
+
+static PerfReading readCounter(int fd)
+{
+    PerfReading reading;
+    if (::read(fd, &reading, sizeof(reading)) != sizeof(reading)) {
+        return PerfReading();
+    }
+
+    return reading;
+}
+
+// Scales up counts from counters that were multiplexed with others
+static uint64_t scaledDelta(const PerfReading& start, const PerfReading& end)
+{
+    uint64_t value = end.value - start.value;
+    uint64_t enabled = end.timeEnabled - start.timeEnabled;
+    uint64_t running = end.timeRunning - start.timeRunning;
+    if (running == 0 || running >= enabled) {
+        return value;
+    }
+
+    return (uint64_t)((double)value * enabled / running);
+}
+
+class ThreadPerfCounters
+{
+  public:
+    ThreadPerfCounters() { fds.fill(-1); }
+
+    ~ThreadPerfCounters()
+    {
+        for (int fd : fds) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+    }
+
+    void start()
+    {
+        if (!opened) {
+            open();
+        }
+
+        for (int i = 0; i < N_PERF_COUNTERS; i++) {
+            if (fds[i] >= 0) {
+                starts[i] = readCounter(fds[i]);
+            }
+        }
+    }
+
+    PerfCounts read()
+    {
+        PerfCounts counts;
+        if (!opened) {
+            return counts;
+        }
+
+        for (int i = 0; i < N_PERF_COUNTERS; i++) {
+            if (fds[i] < 0) {
+                continue;
+            }
+
+            counts.available[i] = true;
+            counts.values[i] = scaledDelta(starts[i], readCounter(fds[i]));
+        }
+
+        return counts;
+    }
+
+  private:
+    bool opened = false;
+
+    std::array<int, N_PERF_COUNTERS> fds;
+
+    std::array<PerfReading, N_PERF_COUNTERS> starts;
+
+    void open()
+    {
+        int nOpened = 0;
+        for (int i = 0; i < N_PERF_COUNTERS; i++) {
+            fds[i] = openCounter((PerfCounter)i);
+            nOpened += fds[i] >= 0;
+        }
+
+        opened = true;
+
+        if (nOpened < N_PERF_COUNTERS && !warnedUnavailable.exchange(true)) {
+            SPDLOG_WARN("Only {}/{} perf counters available on this host",
+                        nOpened,
+                        N_PERF_COUNTERS);
+        }
+    }
+};
+
+static thread_local ThreadPerfCounters threadCounters;
+
+std::string perfCounterName(PerfCounter counter)
+{
+    switch (counter) {
+        case PerfCounter::Instructions:
+            return "instructions";
+        case PerfCounter::Cycles:
+            return "cycles";
+        case PerfCounter::LlcMisses:
+            return "llc-misses";
+        case PerfCounter::DtlbMisses:
+            return "dtlb-misses";
+        case PerfCounter::ContextSwitches:
+            return "context-switches";
+        default: {
+            SPDLOG_ERROR("Unrecognised perf counter {}", (int)counter);
+            throw std::runtime_error("Unrecognised perf counter");
+        }
+    }
+}
+
+void startPerfCounters()
+{
+    threadCounters.start();
+}
+
+PerfCounts readPerfCounters()
+{
+    return threadCounters.read();
+}
+}
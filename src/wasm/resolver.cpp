@@ -0,0 +1,260 @@
+#include <conf/FaasmConfig.h>
+#include <metrics/Metrics.h>
+#include <system/NetworkNamespace.h>
+#include <wasm/resolver.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#include <chrono>
+#include <cstring>
+#include <netdb.h>
+#include <resolv.h>
+#include <shared_mutex>
+#include <sys/socket.h>
+#include <unordered_map>
+
+// Past this many names, expired entries are dropped, and if that's not enough
+// the whole cache is
+#define RESOLVER_MAX_ENTRIES 4096
+
+namespace wasm {
+
+struct ResolverEntry
+{
+    int error = 0;
+
+    std::vector<ResolvedAddress> addrs;
+
+    std::chrono::steady_clock::time_point expiry;
+};
+
+static std::shared_mutex resolverMx;
+static std::unordered_map<std::string, ResolverEntry> resolverCache;
+
+static metrics::Counter& getHitCounter()
+{
+    static metrics::Counter& counter =
+      metrics::getCounter("faasm_resolver_cache_hits_total",
+                          "Function name lookups answered from the cache");
+    return counter;
+}
+
+static metrics::Counter& getMissCounter()
+{
+    static metrics::Counter& counter =
+      metrics::getCounter("faasm_resolver_cache_misses_total",
+                          "Function name lookups made on the host");
+    return counter;
+}
+
+static std::string getCacheKey(const std::string& host, int family)
+{
+    std::string policy =
+      isolation::getCurrentThreadNetworkNamespace().empty() ? "host" : "netns";
+
+    return policy + "/" + std::to_string(family) + "/" + host;
+}
+
+static bool isNumericHost(const std::string& host)
+{
+    uint8_t buf[sizeof(in6_addr)];
+    return ::inet_pton(AF_INET, host.c_str(), buf) == 1 ||
+           ::inet_pton(AF_INET6, host.c_str(), buf) == 1;
+}
+
+/**
+ * getaddrinfo doesn't say how long its answer is good for, so the TTL comes
+ * from asking DNS directly. Returns -1 if DNS doesn't know the name, e.g.
+ * when it's from /etc/hosts.
+ */
+static int64_t lookUpTtlSecs(const std::string& host, int family)
+{
+    // The global resolver state isn't thread-safe
+    static thread_local struct __res_state resState;
+    static thread_local bool resStateReady = false;
+    if (!resStateReady) {
+        std::memset(&resState, 0, sizeof(resState));
+        if (::res_ninit(&resState) != 0) {
+            return -1;
+        }
+
+        // This is on top of the lookup itself, so give up quickly
+        resState.retrans = 1;
+        resState.retry = 1;
+        resStateReady = true;
+    }
+
+    int type = family == AF_INET6 ? ns_t_aaaa : ns_t_a;
+    std::vector<uint8_t> answer(NS_MAXMSG);
+    int len = ::res_nquery(
+      &resState, host.c_str(), ns_c_in, type, answer.data(), answer.size());
+    if (len < 0) {
+        return -1;
+    }
+
+    ns_msg msg;
+    if (::ns_initparse(answer.data(), len, &msg) != 0) {
+        return -1;
+    }
+
+    int64_t ttl = -1;
+    for (int i = 0; i < ns_msg_count(msg, ns_s_an); i++) {
+        ns_rr rr;
+        if (::ns_parserr(&msg, ns_s_an, i, &rr) != 0) {
+            continue;
+        }
+
+        int64_t rrTtl = ns_rr_ttl(rr);
+        ttl = ttl < 0 ? rrTtl : std::min(ttl, rrTtl);
+    }
+
+    return ttl;
+}
+
+static ResolverEntry lookUp(const std::string& host, int family)
+{
+    ResolverEntry entry;
+
+    addrinfo hints{};
+    hints.ai_family = family;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* addrs = nullptr;
+    entry.error = ::getaddrinfo(host.c_str(), nullptr, &hints, &addrs);
+    if (entry.error != 0) {
+        SPDLOG_DEBUG(
+          "Failed to resolve {}: {}", host, ::gai_strerror(entry.error));
+        return entry;
+    }
+
+    for (addrinfo* a = addrs; a != nullptr; a = a->ai_next) {
+        ResolvedAddress resolved;
+        resolved.family = a->ai_family;
+        if (a->ai_family == AF_INET) {
+            auto* sin = reinterpret_cast<sockaddr_in*>(a->ai_addr);
+            std::memcpy(resolved.addr, &sin->sin_addr, sizeof(in_addr));
+        } else if (a->ai_family == AF_INET6) {
+            auto* sin6 = reinterpret_cast<sockaddr_in6*>(a->ai_addr);
+            std::memcpy(resolved.addr, &sin6->sin6_addr, sizeof(in6_addr));
+        } else {
+            continue;
+        }
+
+        entry.addrs.push_back(resolved);
+    }
+    ::freeaddrinfo(addrs);
+
+    return entry;
+}
+
+static int64_t getEntryTtlSecs(const ResolverEntry& entry,
+                               const std::string& host,
+                               int family)
+{
+    int64_t maxTtl = conf::getFaasmConfig().dnsCacheMaxTtlSecs;
+    if (entry.error != 0) {
+        // Only cache answers that the name doesn't exist
+        if (entry.error != EAI_NONAME) {
+            return 0;
+        }
+
+        return std::min<int64_t>(maxTtl, RESOLVER_NEGATIVE_TTL_S);
+    }
+
+    if (isNumericHost(host)) {
+        return maxTtl;
+    }
+
+    int64_t ttl = lookUpTtlSecs(host, family);
+    return ttl < 0 ? maxTtl : std::min(ttl, maxTtl);
+}
+
+static void insertEntry(const std::string& key, ResolverEntry entry)
+{
+    faabric::util::FullLock lock(resolverMx);
+    if (resolverCache.size() >= RESOLVER_MAX_ENTRIES) {
+        auto now = std::chrono::steady_clock::now();
+        std::erase_if(resolverCache,
+                      [&now](const auto& e) { return e.second.expiry < now; });
+
+        if (resolverCache.size() >= RESOLVER_MAX_ENTRIES) {
+            resolverCache.clear();
+        }
+    }
+
+    resolverCache[key] = std::move(entry);
+}
+
+int resolveHost(const std::string& host,
+                int family,
+                std::vector<ResolvedAddress>& result)
+{
+    std::string key = getCacheKey(host, family);
+    {
+        std::shared_lock<std::shared_mutex> lock(resolverMx);
+        auto it = resolverCache.find(key);
+        if (it != resolverCache.end() &&
+            it->second.expiry > std::chrono::steady_clock::now()) {
+            getHitCounter().inc();
+            result = it->second.addrs;
+            return it->second.error;
+        }
+    }
+
+    getMissCounter().inc();
+    ResolverEntry entry = lookUp(host, family);
+    result = entry.addrs;
+    int error = entry.error;
+
+    int64_t ttl = getEntryTtlSecs(entry, host, family);
+    if (ttl > 0) {
+        SPDLOG_DEBUG("Caching {} addresses of {} for {}s",
+                     entry.addrs.size(),
+                     host,
+                     ttl);
+        entry.expiry =
+          std::chrono::steady_clock::now() + std::chrono::seconds(ttl);
+        insertEntry(key, std::move(entry));
+    }
+
+    return error;
+}
+
+int32_t doHostResolveHost(const std::string& host,
+                          int32_t family,
+                          uint8_t* buffer,
+                          int32_t bufferLen)
+{
+    if (family != AF_INET && family != AF_INET6 && family != AF_UNSPEC) {
+        return EAI_FAMILY;
+    }
+
+    std::vector<ResolvedAddress> addrs;
+    int error = resolveHost(host, family, addrs);
+    if (error != 0) {
+        return error;
+    }
+
+    size_t nAddrs = std::min<size_t>(
+      addrs.size(), std::max(bufferLen, 0) / sizeof(ResolvedAddress));
+    std::memcpy(buffer, addrs.data(), nAddrs * sizeof(ResolvedAddress));
+
+    return (int32_t)nAddrs;
+}
+
+void clearResolverCache()
+{
+    faabric::util::FullLock lock(resolverMx);
+    resolverCache.clear();
+}
+
+size_t getResolverCacheSize()
+{
+    std::shared_lock<std::shared_mutex> lock(resolverMx);
+    return resolverCache.size();
+}
+}
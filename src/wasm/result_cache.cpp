@@ -0,0 +1,263 @@
+#include <conf/FaasmConfig.h>
+#include <metrics/Metrics.h>
+#include <storage/CodegenManifest.h>
+#include <wasm/chaining_input.h>
+#include <wasm/result_cache.h>
+
+#include <faabric/state/State.h>
+#include <faabric/util/func.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <list>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#define RESULT_CACHE_STATE_PREFIX "faasm_result_cache_"
+
+// Shared results start with this, so an empty output isn't a missing value
+#define RESULT_CACHE_STATE_MARKER 'R'
+
+namespace wasm {
+
+static std::mutex cacheMx;
+
+// Most recently used at the front
+static std::list<std::pair<std::string, std::string>> lruResults;
+
+static std::unordered_map<
+  std::string,
+  std::list<std::pair<std::string, std::string>>::iterator>
+  cachedResults;
+
+static size_t cachedBytes = 0;
+
+// The parsed function list, and the config it was parsed from
+static std::string cachedFunctionsConf;
+static std::set<std::string> cachedFunctions;
+
+static metrics::Counter& getHitCounter()
+{
+    static metrics::Counter& counter = metrics::getCounter(
+      "faasm_result_cache_hits_total", "Calls answered from the result cache");
+    return counter;
+}
+
+static metrics::Counter& getMissCounter()
+{
+    static metrics::Counter& counter =
+      metrics::getCounter("faasm_result_cache_misses_total",
+                          "Cacheable calls with no cached result");
+    return counter;
+}
+
+static bool isFunctionListed(const std::string& funcStr)
+{
+    const std::string& functions = conf::getFaasmConfig().resultCacheFunctions;
+    if (functions.empty()) {
+        return false;
+    }
+
+    faabric::util::UniqueLock lock(cacheMx);
+    if (functions != cachedFunctionsConf) {
+        cachedFunctions.clear();
+
+        std::istringstream in(functions);
+        std::string entry;
+        while (std::getline(in, entry, ',')) {
+            if (!entry.empty()) {
+                cachedFunctions.insert(entry);
+            }
+        }
+
+        cachedFunctionsConf = functions;
+    }
+
+    return cachedFunctions.count(funcStr) > 0;
+}
+
+bool isResultCacheable(const faabric::Message& msg)
+{
+    // Threads and nested calls share memory with their caller, and MPI ranks
+    // talk to each other, so only standalone calls are cacheable
+    if (msg.funcptr() != 0 || msg.ismpi()) {
+        return false;
+    }
+
+    // Inputs read from state can change without the message changing
+    if (hasChainedInputRef(msg)) {
+        return false;
+    }
+
+    return isFunctionListed(faabric::util::funcToString(msg, false));
+}
+
+static void appendField(std::vector<uint8_t>& bytes, const std::string& field)
+{
+    // Each field goes after its length, so no two messages share a key
+    uint64_t size = field.size();
+    const auto* sizeBytes = reinterpret_cast<const uint8_t*>(&size);
+    bytes.insert(bytes.end(), sizeBytes, sizeBytes + sizeof(size));
+    bytes.insert(bytes.end(), field.begin(), field.end());
+}
+
+std::string getResultCacheKey(const faabric::Message& msg)
+{
+    std::vector<uint8_t> bytes;
+    bytes.reserve(msg.inputdata().size() + 128);
+
+    appendField(bytes, msg.user());
+    appendField(bytes, msg.function());
+    appendField(bytes, msg.pythonuser());
+    appendField(bytes, msg.pythonfunction());
+    appendField(bytes, msg.cmdline());
+    appendField(bytes, msg.inputdata());
+
+    return storage::hashCodegenInput(bytes);
+}
+
+static void insertLocked(const std::string& key, const std::string& output)
+{
+    size_t budgetBytes =
+      (size_t)conf::getFaasmConfig().resultCacheBudgetMb * 1024 * 1024;
+    size_t entryBytes = key.size() + output.size();
+    if (budgetBytes > 0 && entryBytes > budgetBytes) {
+        return;
+    }
+
+    auto it = cachedResults.find(key);
+    if (it != cachedResults.end()) {
+        cachedBytes -= it->second->first.size() + it->second->second.size();
+        lruResults.erase(it->second);
+        cachedResults.erase(it);
+    }
+
+    lruResults.emplace_front(key, output);
+    cachedResults[key] = lruResults.begin();
+    cachedBytes += entryBytes;
+
+    while (budgetBytes > 0 && cachedBytes > budgetBytes) {
+        auto& oldest = lruResults.back();
+        cachedBytes -= oldest.first.size() + oldest.second.size();
+        cachedResults.erase(oldest.first);
+        lruResults.pop_back();
+    }
+}
+
+static bool lookupShared(const faabric::Message& msg,
+                         const std::string& key,
+                         std::string& output)
+{
+    faabric::state::State& state = faabric::state::getGlobalState();
+    std::string stateKey = RESULT_CACHE_STATE_PREFIX + key;
+
+    // Nothing shared yet can mean there's no master for the key at all
+    size_t size = 0;
+    try {
+        size = state.getStateSize(msg.user(), stateKey);
+    } catch (std::exception& e) {
+        SPDLOG_TRACE("No shared result for {}: {}", stateKey, e.what());
+        return false;
+    }
+
+    if (size == 0) {
+        return false;
+    }
+
+    auto kv = state.getKV(msg.user(), stateKey, size);
+    kv->pull();
+
+    std::vector<uint8_t> value(size);
+    kv->get(value.data());
+    if (value.front() != RESULT_CACHE_STATE_MARKER) {
+        SPDLOG_WARN("Ignoring malformed shared result {}", stateKey);
+        return false;
+    }
+
+    output.assign(value.begin() + 1, value.end());
+    return true;
+}
+
+static void storeShared(const faabric::Message& msg,
+                        const std::string& key,
+                        const std::string& output)
+{
+    std::vector<uint8_t> value;
+    value.reserve(output.size() + 1);
+    value.push_back(RESULT_CACHE_STATE_MARKER);
+    value.insert(value.end(), output.begin(), output.end());
+
+    auto kv = faabric::state::getGlobalState().getKV(
+      msg.user(), RESULT_CACHE_STATE_PREFIX + key, value.size());
+    kv->set(value.data());
+    kv->pushFull();
+}
+
+bool lookupCachedResult(const faabric::Message& msg, std::string& output)
+{
+    if (!isResultCacheable(msg)) {
+        return false;
+    }
+
+    std::string key = getResultCacheKey(msg);
+    {
+        faabric::util::UniqueLock lock(cacheMx);
+        auto it = cachedResults.find(key);
+        if (it != cachedResults.end()) {
+            lruResults.splice(lruResults.begin(), lruResults, it->second);
+            output = it->second->second;
+            getHitCounter().inc();
+            return true;
+        }
+    }
+
+    if (conf::getFaasmConfig().resultCacheShared == "on" &&
+        lookupShared(msg, key, output)) {
+        faabric::util::UniqueLock lock(cacheMx);
+        insertLocked(key, output);
+        getHitCounter().inc();
+        return true;
+    }
+
+    getMissCounter().inc();
+    return false;
+}
+
+void storeCachedResult(const faabric::Message& msg, int32_t returnValue)
+{
+    if (returnValue != 0 || !isResultCacheable(msg)) {
+        return;
+    }
+
+    std::string key = getResultCacheKey(msg);
+    {
+        faabric::util::UniqueLock lock(cacheMx);
+        insertLocked(key, msg.outputdata());
+    }
+
+    if (conf::getFaasmConfig().resultCacheShared == "on") {
+        storeShared(msg, key, msg.outputdata());
+    }
+
+    SPDLOG_TRACE("Cached result of {} ({} bytes)",
+                 faabric::util::funcToString(msg, false),
+                 msg.outputdata().size());
+}
+
+size_t getResultCacheBytes()
+{
+    faabric::util::UniqueLock lock(cacheMx);
+    return cachedBytes;
+}
+
+void clearResultCache()
+{
+    faabric::util::UniqueLock lock(cacheMx);
+    lruResults.clear();
+    cachedResults.clear();
+    cachedBytes = 0;
+}
+}
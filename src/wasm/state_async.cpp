@@ -0,0 +1,67 @@
+#include <wasm/state_async.h>
+
+#include <faabric/util/logging.h>
+
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace wasm {
+
+static thread_local std::unordered_map<int, std::future<void>> operations;
+
+static thread_local int nextHandle = 1;
+
+static std::future<void>& getOperation(int handle)
+{
+    auto it = operations.find(handle);
+    if (it == operations.end()) {
+        SPDLOG_ERROR("Unrecognised state operation {}", handle);
+        throw std::runtime_error("Unrecognised state operation");
+    }
+
+    return it->second;
+}
+
+int startStateOperation(std::function<void()> op)
+{
+    int handle = nextHandle++;
+    operations.emplace(handle, std::async(std::launch::async, std::move(op)));
+
+    return handle;
+}
+
+void awaitStateOperation(int handle)
+{
+    std::future<void> op = std::move(getOperation(handle));
+    operations.erase(handle);
+
+    op.get();
+}
+
+bool pollStateOperation(int handle)
+{
+    std::future<void>& op = getOperation(handle);
+    return op.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+void finishStateOperations()
+{
+    if (operations.empty()) {
+        return;
+    }
+
+    SPDLOG_DEBUG("Finishing {} outstanding state operations",
+                 operations.size());
+
+    for (auto& [handle, op] : operations) {
+        try {
+            op.get();
+        } catch (std::exception& e) {
+            SPDLOG_ERROR("State operation {} failed: {}", handle, e.what());
+        }
+    }
+    operations.clear();
+}
+}
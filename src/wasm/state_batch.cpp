@@ -0,0 +1,84 @@
+#include <wasm/state_batch.h>
+#include <wasm/state_replicas.h>
+
+#include <faabric/scheduler/ExecutorContext.h>
+#include <faabric/state/State.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace wasm {
+
+std::vector<std::shared_ptr<faabric::state::StateKeyValue>> getStateKVs(
+  const std::vector<std::string>& keys,
+  const std::vector<size_t>& sizes)
+{
+    if (keys.size() != sizes.size()) {
+        SPDLOG_ERROR("Mismatched state batch ({} keys, {} sizes)",
+                     keys.size(),
+                     sizes.size());
+        throw std::runtime_error("Mismatched state batch");
+    }
+
+    const std::string& user =
+      faabric::scheduler::ExecutorContext::get()->getMsg().user();
+    StateReplicaCache& replicas = getStateReplicaCache();
+
+    std::vector<std::shared_ptr<faabric::state::StateKeyValue>> kvs;
+    kvs.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        kvs.push_back(replicas.getKV(user, keys.at(i), sizes.at(i)));
+    }
+
+    return kvs;
+}
+
+void runStateBatch(size_t nOps, const std::function<void(size_t)>& op)
+{
+    size_t nThreads = std::min<size_t>(nOps, STATE_BATCH_MAX_CONCURRENCY);
+    if (nThreads <= 1) {
+        for (size_t i = 0; i < nOps; i++) {
+            op(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> nextOp = 0;
+    std::mutex errorMx;
+    std::exception_ptr error = nullptr;
+
+    auto worker = [&] {
+        for (size_t i = nextOp++; i < nOps; i = nextOp++) {
+            try {
+                op(i);
+            } catch (...) {
+                faabric::util::UniqueLock lock(errorMx);
+                if (error == nullptr) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    };
+
+    // The calling thread does its share too
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < nThreads; t++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    if (error != nullptr) {
+        std::rethrow_exception(error);
+    }
+}
+}
@@ -0,0 +1,86 @@
+#include <wasm/memdiff.h>
+#include <wasm/state_diff.h>
+#include <wasm/state_metrics.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace wasm {
+
+struct PushedStateValue
+{
+    std::mutex mx;
+    std::vector<uint8_t> data;
+};
+
+static std::mutex pushedValuesMx;
+
+static std::unordered_map<std::string, std::shared_ptr<PushedStateValue>>
+  pushedValues;
+
+static std::shared_ptr<PushedStateValue> getPushedValue(
+  const std::string& user,
+  const std::string& key)
+{
+    faabric::util::UniqueLock lock(pushedValuesMx);
+    auto& pushed = pushedValues[user + "/" + key];
+    if (pushed == nullptr) {
+        pushed = std::make_shared<PushedStateValue>();
+    }
+
+    return pushed;
+}
+
+size_t pushStateChanges(std::shared_ptr<faabric::state::StateKeyValue> kv)
+{
+    size_t size = kv->size();
+    const uint8_t* value = kv->get();
+
+    auto pushed = getPushedValue(kv->user, kv->key);
+    faabric::util::UniqueLock lock(pushed->mx);
+
+    // Nothing to diff against, or the value has been resized
+    if (pushed->data.size() != size) {
+        SPDLOG_DEBUG(
+          "Pushing all of {}/{} ({} bytes)", kv->user, kv->key, size);
+        pushed->data.assign(value, value + size);
+        kv->pushFull();
+        recordStatePush(size);
+        return size;
+    }
+
+    auto ranges =
+      diffMemoryRanges({ pushed->data.data(), size }, { value, size });
+
+    size_t nDirty = 0;
+    for (const auto& [start, end] : ranges) {
+        kv->flagChunkDirty(start, end - start);
+        std::memcpy(pushed->data.data() + start, value + start, end - start);
+        nDirty += end - start;
+    }
+
+    SPDLOG_DEBUG("Pushing {} changed bytes in {} runs of {}/{}",
+                 nDirty,
+                 ranges.size(),
+                 kv->user,
+                 kv->key);
+
+    if (nDirty > 0) {
+        kv->pushPartial();
+        recordStatePush(nDirty);
+    }
+
+    return nDirty;
+}
+
+void clearStateChanges()
+{
+    faabric::util::UniqueLock lock(pushedValuesMx);
+    pushedValues.clear();
+}
+}
@@ -0,0 +1,277 @@
+#include <conf/FaasmConfig.h>
+#include <storage/S3Wrapper.h>
+#include <wasm/state_disk.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/memory.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace wasm {
+
+DiskStateStore& getDiskStateStore()
+{
+    static DiskStateStore store;
+    return store;
+}
+
+std::string getDiskStatePath(const std::string& user, const std::string& key)
+{
+    return std::string(STATE_DISK_PREFIX) + "/" + user + "/" + key;
+}
+
+// -------------------------------------
+// DISK STATE VALUE
+// -------------------------------------
+
+DiskStateValue::DiskStateValue(const std::string& userIn,
+                               const std::string& keyIn,
+                               size_t sizeIn,
+                               const std::string& localPathIn)
+  : user(userIn)
+  , key(keyIn)
+  , valueSize(sizeIn)
+  , localPath(localPathIn)
+  , chunks((sizeIn + STATE_DISK_CHUNK_SIZE - 1) / STATE_DISK_CHUNK_SIZE,
+           ChunkStatus::Missing)
+{
+    std::filesystem::create_directories(
+      std::filesystem::path(localPath).parent_path());
+
+    // Whatever was left from before is out of date, so the copy starts empty
+    // and sparse
+    int flags = O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC;
+    fd = ::open(localPath.c_str(), flags, 0600);
+    if (fd < 0 || ::ftruncate(fd, valueSize) != 0) {
+        SPDLOG_ERROR("Failed to create disk state file {}: {}",
+                     localPath,
+                     std::strerror(errno));
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        throw std::runtime_error("Failed to create disk state file");
+    }
+}
+
+DiskStateValue::~DiskStateValue()
+{
+    // Modules can keep their mappings of the file once it's gone
+    ::close(fd);
+    ::unlink(localPath.c_str());
+}
+
+void DiskStateValue::fetchRange(size_t offset, size_t len)
+{
+    if (offset + len > valueSize) {
+        SPDLOG_ERROR("Disk state access out of bounds for {}/{} ({} + {} > {})",
+                     user,
+                     key,
+                     offset,
+                     len,
+                     valueSize);
+        throw std::runtime_error("Disk state access out of bounds");
+    }
+
+    if (len == 0) {
+        return;
+    }
+
+    size_t firstChunk = offset / STATE_DISK_CHUNK_SIZE;
+    size_t lastChunk = (offset + len - 1) / STATE_DISK_CHUNK_SIZE;
+
+    // Claim the missing chunks, so that others reading them wait rather than
+    // fetching them again
+    std::vector<size_t> toFetch;
+    {
+        faabric::util::UniqueLock lock(chunksMx);
+        for (size_t i = firstChunk; i <= lastChunk; i++) {
+            if (chunks.at(i) == ChunkStatus::Missing) {
+                chunks.at(i) = ChunkStatus::Fetching;
+                toFetch.push_back(i);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < toFetch.size(); i++) {
+        try {
+            fetchChunk(toFetch.at(i));
+        } catch (std::exception& e) {
+            // Give back the chunks this call didn't get to
+            faabric::util::UniqueLock lock(chunksMx);
+            for (size_t j = i; j < toFetch.size(); j++) {
+                chunks.at(toFetch.at(j)) = ChunkStatus::Missing;
+            }
+            chunksCv.notify_all();
+            throw;
+        }
+
+        faabric::util::UniqueLock lock(chunksMx);
+        chunks.at(toFetch.at(i)) = ChunkStatus::Fetched;
+        chunksCv.notify_all();
+    }
+
+    // Wait for any fetched by others. If their fetch failed, it's down to us.
+    faabric::util::UniqueLock lock(chunksMx);
+    chunksCv.wait(lock, [this, firstChunk, lastChunk] {
+        for (size_t i = firstChunk; i <= lastChunk; i++) {
+            if (chunks.at(i) != ChunkStatus::Fetched) {
+                return chunks.at(i) == ChunkStatus::Missing;
+            }
+        }
+        return true;
+    });
+
+    for (size_t i = firstChunk; i <= lastChunk; i++) {
+        if (chunks.at(i) == ChunkStatus::Missing) {
+            lock.unlock();
+            fetchRange(offset, len);
+            return;
+        }
+    }
+}
+
+void DiskStateValue::fetchChunk(size_t chunkIdx)
+{
+    size_t offset = chunkIdx * STATE_DISK_CHUNK_SIZE;
+    size_t len = std::min<size_t>(STATE_DISK_CHUNK_SIZE, valueSize - offset);
+    SPDLOG_TRACE("Fetching chunk {} of disk state {}/{}", chunkIdx, user, key);
+
+    // Straight from S3, as the file loader would cache the whole file
+    std::vector<uint8_t> buffer(len);
+    storage::S3Wrapper s3;
+    s3.getKeyRange(conf::getFaasmConfig().s3Bucket,
+                   getDiskStatePath(user, key),
+                   offset,
+                   buffer.data(),
+                   len);
+
+    size_t written = 0;
+    while (written < len) {
+        ssize_t res = ::pwrite(
+          fd, buffer.data() + written, len - written, offset + written);
+        if (res < 0) {
+            SPDLOG_ERROR("Failed to write disk state {}/{} at {}: {}",
+                         user,
+                         key,
+                         offset + written,
+                         std::strerror(errno));
+            throw std::runtime_error("Failed to write disk state");
+        }
+
+        written += res;
+    }
+}
+
+void DiskStateValue::mapRange(uint8_t* target, size_t offset, size_t len)
+{
+    if (((uintptr_t)target % faabric::util::HOST_PAGE_SIZE) != 0 ||
+        (offset % faabric::util::HOST_PAGE_SIZE) != 0) {
+        SPDLOG_ERROR("Mapping disk state {}/{} at unaligned offset {}",
+                     user,
+                     key,
+                     offset);
+        throw std::runtime_error("Mapping disk state at unaligned offset");
+    }
+
+    fetchRange(offset, len);
+
+    // The rest of the last page is zeros if it's past the end of the value
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    size_t mapLen = (len + pageSize - 1) / pageSize * pageSize;
+    void* res = ::mmap(target,
+                       mapLen,
+                       PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_FIXED,
+                       fd,
+                       offset);
+    if (res == MAP_FAILED) {
+        SPDLOG_ERROR("Failed to map disk state {}/{} ({} + {}): {}",
+                     user,
+                     key,
+                     offset,
+                     len,
+                     std::strerror(errno));
+        throw std::runtime_error("Failed to map disk state");
+    }
+}
+
+size_t DiskStateValue::getFetchedChunkCount()
+{
+    faabric::util::UniqueLock lock(chunksMx);
+    return std::count(chunks.begin(), chunks.end(), ChunkStatus::Fetched);
+}
+
+// -------------------------------------
+// DISK STATE STORE
+// -------------------------------------
+
+std::shared_ptr<DiskStateValue> DiskStateStore::getValue(
+  const std::string& user,
+  const std::string& key)
+{
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+    const std::string& diskDir = conf.stateDiskDir;
+    if (diskDir.empty()) {
+        return nullptr;
+    }
+
+    std::string path = getDiskStatePath(user, key);
+    {
+        std::shared_lock<std::shared_mutex> lock(valuesMx);
+        auto it = values.find(path);
+        if (it != values.end()) {
+            return it->second;
+        }
+
+        if (missing.contains(path)) {
+            return nullptr;
+        }
+    }
+
+    // Empty files are as good as missing, as for other shared files
+    storage::S3Wrapper s3;
+    int64_t size = s3.getKeySize(conf.s3Bucket, path);
+    if (size <= 0) {
+        faabric::util::FullLock lock(valuesMx);
+        missing.insert(path);
+        return nullptr;
+    }
+
+    faabric::util::FullLock lock(valuesMx);
+    auto it = values.find(path);
+    if (it != values.end()) {
+        return it->second;
+    }
+
+    // Keys may have slashes of their own, which the local copy flattens
+    std::string localName = user + "_" + key;
+    std::replace(localName.begin(), localName.end(), '/', '_');
+
+    SPDLOG_DEBUG("Backing {}/{} ({} bytes) with {}/{}",
+                 user,
+                 key,
+                 size,
+                 diskDir,
+                 localName);
+    auto value = std::make_shared<DiskStateValue>(
+      user, key, size, diskDir + "/" + localName);
+    values[path] = value;
+
+    return value;
+}
+
+void DiskStateStore::clear()
+{
+    faabric::util::FullLock lock(valuesMx);
+    values.clear();
+    missing.clear();
+}
+}
@@ -0,0 +1,100 @@
+#include <wasm/state_file.h>
+#include <wasm/state_metrics.h>
+
+#include <faabric/state/State.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/memory.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <future>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace wasm {
+
+size_t writeStateFromFile(const std::string& user,
+                          const std::string& key,
+                          const std::string& filePath,
+                          size_t chunkSize)
+{
+    if (chunkSize == 0 || chunkSize % faabric::util::HOST_PAGE_SIZE != 0) {
+        SPDLOG_ERROR("Invalid state file chunk size {}", chunkSize);
+        throw std::runtime_error("Invalid state file chunk size");
+    }
+
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        SPDLOG_ERROR("Failed to open {} to write to state: {}",
+                     filePath,
+                     strerror(errno));
+        throw std::runtime_error("Failed to open file for state");
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0) {
+        close(fd);
+        SPDLOG_ERROR("Failed to stat {}: {}", filePath, strerror(errno));
+        throw std::runtime_error("Failed to stat file for state");
+    }
+
+    size_t fileSize = fileStat.st_size;
+    auto kv = faabric::state::getGlobalState().getKV(user, key, fileSize);
+    if (fileSize == 0) {
+        close(fd);
+        return 0;
+    }
+
+    void* mapped = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        SPDLOG_ERROR("Failed to map {}: {}", filePath, strerror(errno));
+        throw std::runtime_error("Failed to map file for state");
+    }
+
+    auto* data = static_cast<uint8_t*>(mapped);
+    madvise(data, fileSize, MADV_SEQUENTIAL);
+
+    SPDLOG_DEBUG("Writing {} bytes from {} to state {}/{} in {} byte chunks",
+                 fileSize,
+                 filePath,
+                 user,
+                 key,
+                 chunkSize);
+
+    // Only one push is in flight, which takes the chunks written since the
+    // last one, while the next chunk is copied in
+    std::future<void> push;
+    try {
+        for (size_t offset = 0; offset < fileSize; offset += chunkSize) {
+            size_t len = std::min(chunkSize, fileSize - offset);
+            kv->setChunk(offset, data + offset, len);
+
+            // We're done with these pages of the file
+            madvise(data + offset, len, MADV_DONTNEED);
+
+            if (push.valid()) {
+                push.get();
+            }
+            push = std::async(std::launch::async, [kv] { kv->pushPartial(); });
+            recordStatePush(len);
+        }
+
+        push.get();
+    } catch (...) {
+        if (push.valid()) {
+            push.wait();
+        }
+        munmap(mapped, fileSize);
+        throw;
+    }
+
+    munmap(mapped, fileSize);
+
+    return fileSize;
+}
+}
@@ -0,0 +1,182 @@
+#include <wasm/state_log.h>
+
+#include <faabric/state/State.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+namespace wasm {
+
+struct StateLogBounds
+{
+    uint64_t head = 0;
+    uint64_t tail = 0;
+};
+
+static std::mutex logMutexesMx;
+
+static std::unordered_map<std::string, std::shared_ptr<std::mutex>> logMutexes;
+
+static std::shared_ptr<std::mutex> getLogMutex(const std::string& user,
+                                               const std::string& key)
+{
+    faabric::util::UniqueLock lock(logMutexesMx);
+    auto& mx = logMutexes[user + "/" + key];
+    if (mx == nullptr) {
+        mx = std::make_shared<std::mutex>();
+    }
+
+    return mx;
+}
+
+static std::string getEntryKey(const std::string& key, uint64_t index)
+{
+    return fmt::format("{}_log_{}", key, index);
+}
+
+static std::shared_ptr<faabric::state::StateKeyValue> getBoundsKV(
+  const std::string& user,
+  const std::string& key)
+{
+    return faabric::state::getGlobalState().getKV(
+      user, key, sizeof(StateLogBounds));
+}
+
+static StateLogBounds pullBounds(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv)
+{
+    kv->pull();
+
+    StateLogBounds bounds;
+    kv->get(reinterpret_cast<uint8_t*>(&bounds));
+    return bounds;
+}
+
+static void pushBounds(const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+                       const StateLogBounds& bounds)
+{
+    kv->set(reinterpret_cast<const uint8_t*>(&bounds));
+    kv->pushFull();
+}
+
+uint64_t appendStateLog(const std::string& user,
+                        const std::string& key,
+                        const uint8_t* data,
+                        size_t dataLen)
+{
+    if (dataLen == 0) {
+        SPDLOG_ERROR("Appending empty entry to state log {}/{}", user, key);
+        throw std::runtime_error("Appending empty state log entry");
+    }
+
+    auto mx = getLogMutex(user, key);
+    faabric::util::UniqueLock lock(*mx);
+
+    auto boundsKv = getBoundsKV(user, key);
+    StateLogBounds bounds = pullBounds(boundsKv);
+    uint64_t index = bounds.tail;
+
+    // The entry must be pushed before the new tail, so readers never see an
+    // index with nothing behind it
+    auto entryKv = faabric::state::getGlobalState().getKV(
+      user, getEntryKey(key, index), dataLen);
+    entryKv->set(data);
+    entryKv->pushFull();
+
+    bounds.tail++;
+    pushBounds(boundsKv, bounds);
+
+    SPDLOG_TRACE("Appended entry {} to state log {}/{}", index, user, key);
+    return index;
+}
+
+int64_t readStateLog(const std::string& user,
+                     const std::string& key,
+                     uint64_t index,
+                     uint8_t* buffer,
+                     size_t bufferLen,
+                     int timeoutMs)
+{
+    auto boundsKv = getBoundsKV(user, key);
+    StateLogBounds bounds = pullBounds(boundsKv);
+
+    // Back off gradually, so short waits stay responsive
+    auto start = std::chrono::steady_clock::now();
+    int pollMs = 1;
+    while (index >= bounds.tail) {
+        auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        if (waited >= timeoutMs) {
+            return -1;
+        }
+
+        int sleepMs = std::min<int>(pollMs, timeoutMs - waited);
+        std::this_thread::sleep_for(std::chrono::milliseconds(sleepMs));
+        pollMs = std::min(2 * pollMs, STATE_LOG_MAX_POLL_MS);
+
+        bounds = pullBounds(boundsKv);
+    }
+
+    if (index < bounds.head) {
+        SPDLOG_ERROR("Reading trimmed entry {} from state log {}/{} (head {})",
+                     index,
+                     user,
+                     key,
+                     bounds.head);
+        throw std::runtime_error("Reading trimmed state log entry");
+    }
+
+    faabric::state::State& state = faabric::state::getGlobalState();
+    std::string entryKey = getEntryKey(key, index);
+    size_t entrySize = state.getStateSize(user, entryKey);
+
+    auto entryKv = state.getKV(user, entryKey, entrySize);
+    entryKv->getChunk(0, buffer, std::min(bufferLen, entrySize));
+
+    return (int64_t)entrySize;
+}
+
+void trimStateLog(const std::string& user,
+                  const std::string& key,
+                  uint64_t index)
+{
+    auto mx = getLogMutex(user, key);
+    faabric::util::UniqueLock lock(*mx);
+
+    auto boundsKv = getBoundsKV(user, key);
+    StateLogBounds bounds = pullBounds(boundsKv);
+
+    // The head never moves back, nor past the tail
+    uint64_t newHead = std::min(index, bounds.tail);
+    if (newHead <= bounds.head) {
+        return;
+    }
+
+    uint64_t oldHead = bounds.head;
+    bounds.head = newHead;
+    pushBounds(boundsKv, bounds);
+
+    faabric::state::State& state = faabric::state::getGlobalState();
+    for (uint64_t i = oldHead; i < newHead; i++) {
+        state.deleteKV(user, getEntryKey(key, i));
+    }
+
+    SPDLOG_TRACE(
+      "Trimmed state log {}/{} from {} to {}", user, key, oldHead, newHead);
+}
+
+std::pair<uint64_t, uint64_t> getStateLogBounds(const std::string& user,
+                                                const std::string& key)
+{
+    StateLogBounds bounds = pullBounds(getBoundsKV(user, key));
+    return { bounds.head, bounds.tail };
+}
+}
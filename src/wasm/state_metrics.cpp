@@ -0,0 +1,115 @@
+#include <metrics/LifecycleTrace.h>
+#include <wasm/state_metrics.h>
+#include <wasm/timing.h>
+
+#include <faabric/util/func.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <mutex>
+#include <unordered_map>
+
+namespace wasm {
+
+static thread_local StateMetrics threadMetrics;
+
+static std::mutex hostMetricsMx;
+
+static std::unordered_map<std::string, StateMetrics> hostMetrics;
+
+void StateMetrics::add(const StateMetrics& other)
+{
+    bytesPulled += other.bytesPulled;
+    bytesPushed += other.bytesPushed;
+    roundTrips += other.roundTrips;
+    lockWaitNanos += other.lockWaitNanos;
+    bytesMapped += other.bytesMapped;
+}
+
+bool StateMetrics::empty() const
+{
+    return roundTrips == 0 && lockWaitNanos == 0 && bytesMapped == 0;
+}
+
+void recordStatePull(size_t nBytes)
+{
+    threadMetrics.bytesPulled += nBytes;
+    threadMetrics.roundTrips++;
+    metrics::traceInstant(metrics::TraceEvent::StatePull, nBytes);
+}
+
+void recordStatePush(size_t nBytes)
+{
+    threadMetrics.bytesPushed += nBytes;
+    threadMetrics.roundTrips++;
+    metrics::traceInstant(metrics::TraceEvent::StatePush, nBytes);
+}
+
+void recordStateMapping(size_t nBytes)
+{
+    threadMetrics.bytesMapped += nBytes;
+}
+
+StateMetrics takeStateMetrics()
+{
+    StateMetrics metrics = threadMetrics;
+    threadMetrics = StateMetrics();
+
+    return metrics;
+}
+
+void flushStateMetrics(faabric::Message& msg)
+{
+    StateMetrics metrics = takeStateMetrics();
+    if (metrics.empty()) {
+        return;
+    }
+
+    // The counts can outgrow the int details, so they go in as strings
+    auto& details = *msg.mutable_execgraphdetails();
+    details["state-bytes-pulled"] = std::to_string(metrics.bytesPulled);
+    details["state-bytes-pushed"] = std::to_string(metrics.bytesPushed);
+    details["state-round-trips"] = std::to_string(metrics.roundTrips);
+    details["state-lock-wait-ns"] = std::to_string(metrics.lockWaitNanos);
+    details["state-bytes-mapped"] = std::to_string(metrics.bytesMapped);
+
+    std::string funcStr = faabric::util::funcToString(msg, false);
+    SPDLOG_DEBUG("{} state: {} pulled, {} pushed, {} trips, {}ns locked, {} "
+                 "mapped",
+                 funcStr,
+                 metrics.bytesPulled,
+                 metrics.bytesPushed,
+                 metrics.roundTrips,
+                 metrics.lockWaitNanos,
+                 metrics.bytesMapped);
+
+    faabric::util::UniqueLock lock(hostMetricsMx);
+    hostMetrics[funcStr].add(metrics);
+}
+
+StateMetrics getHostStateMetrics(const std::string& funcStr)
+{
+    faabric::util::UniqueLock lock(hostMetricsMx);
+    auto it = hostMetrics.find(funcStr);
+    if (it == hostMetrics.end()) {
+        return StateMetrics();
+    }
+
+    return it->second;
+}
+
+void clearHostStateMetrics()
+{
+    faabric::util::UniqueLock lock(hostMetricsMx);
+    hostMetrics.clear();
+}
+
+StateLockTimer::StateLockTimer()
+  : startNanos(getTimerNanos())
+{}
+
+StateLockTimer::~StateLockTimer()
+{
+    threadMetrics.lockWaitNanos += getTimerNanos() - startNanos;
+}
+}
@@ -0,0 +1,216 @@
+#include <conf/FaasmConfig.h>
+#include <wasm/state_replicas.h>
+
+#include <faabric/state/InMemoryStateRegistry.h>
+#include <faabric/util/config.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <set>
+#include <utility>
+
+namespace wasm {
+
+StateReplicaCache& getStateReplicaCache()
+{
+    static StateReplicaCache cache;
+    return cache;
+}
+
+static std::string getReplicaId(const std::string& user, const std::string& key)
+{
+    return user + "/" + key;
+}
+
+// Redis state has no masters, so every local copy is a replica
+static bool isMasteredHere(const std::string& user, const std::string& key)
+{
+    const faabric::util::SystemConfig& sysConf =
+      faabric::util::getSystemConfig();
+    if (sysConf.stateMode != "inmemory") {
+        return false;
+    }
+
+    try {
+        return faabric::state::getInMemoryStateRegistry().getMasterIP(
+                 user, key, sysConf.endpointHost, false) ==
+               sysConf.endpointHost;
+    } catch (std::exception& ex) {
+        return false;
+    }
+}
+
+namespace {
+// Pins held by the call running on this thread. Threads that go away without
+// finishing a call, e.g. those of a local OpenMP team, give them back then.
+struct CallPins
+{
+    std::set<std::pair<std::string, std::string>> keys;
+
+    ~CallPins()
+    {
+        for (const auto& [user, key] : keys) {
+            getStateReplicaCache().unpin(user, key);
+        }
+    }
+};
+}
+
+static thread_local CallPins callPins;
+
+std::shared_ptr<faabric::state::StateKeyValue> StateReplicaCache::getKV(
+  const std::string& user,
+  const std::string& key,
+  size_t size)
+{
+    return track(user, key, [&user, &key, size] {
+        return faabric::state::getGlobalState().getKV(user, key, size);
+    });
+}
+
+std::shared_ptr<faabric::state::StateKeyValue> StateReplicaCache::getKV(
+  const std::string& user,
+  const std::string& key)
+{
+    return track(user, key, [&user, &key] {
+        return faabric::state::getGlobalState().getKV(user, key);
+    });
+}
+
+std::shared_ptr<faabric::state::StateKeyValue> StateReplicaCache::track(
+  const std::string& user,
+  const std::string& key,
+  const std::function<std::shared_ptr<faabric::state::StateKeyValue>()>&
+    lookup)
+{
+    auto kv = lookup();
+    if (conf::getFaasmConfig().stateReplicaBudgetMb <= 0) {
+        return kv;
+    }
+
+    // Pinned before anything is evicted, so the call can't lose it
+    if (callPins.keys.emplace(user, key).second) {
+        pin(user, key);
+    }
+
+    std::string id = getReplicaId(user, key);
+    bool known;
+    {
+        faabric::util::UniqueLock lock(mx);
+        known = replicas.contains(id);
+    }
+
+    // Only new values need the master lookup, which may be remote
+    bool master = !known && isMasteredHere(user, key);
+
+    faabric::util::UniqueLock lock(mx);
+    auto it = replicas.find(id);
+    if (it != replicas.end()) {
+        counts.hits++;
+        lru.splice(lru.begin(), lru, it->second.lruIt);
+
+        if (!it->second.master) {
+            bytes = bytes - it->second.size + kv->size();
+        }
+        it->second.size = kv->size();
+    } else {
+        counts.misses++;
+        lru.push_front(id);
+
+        Replica& replica = replicas[id];
+        replica.user = user;
+        replica.key = key;
+        replica.size = kv->size();
+        replica.master = master;
+        replica.lruIt = lru.begin();
+
+        if (!master) {
+            bytes += replica.size;
+        }
+    }
+
+    evict(id);
+
+    return kv;
+}
+
+void StateReplicaCache::evict(const std::string& keep)
+{
+    size_t budget =
+      (size_t)conf::getFaasmConfig().stateReplicaBudgetMb * 1024 * 1024;
+
+    // Walk back from the least recently used, skipping those in use
+    auto it = lru.end();
+    while (bytes > budget && it != lru.begin()) {
+        --it;
+
+        Replica& replica = replicas.at(*it);
+        if (replica.master || *it == keep || pins.contains(*it)) {
+            continue;
+        }
+
+        SPDLOG_DEBUG("Evicting state replica {}/{} ({} bytes, {} held)",
+                     replica.user,
+                     replica.key,
+                     replica.size,
+                     bytes);
+        faabric::state::getGlobalState().deleteKVLocally(replica.user,
+                                                         replica.key);
+        bytes -= replica.size;
+        counts.evictions++;
+
+        std::string id = *it;
+        it = lru.erase(it);
+        replicas.erase(id);
+    }
+}
+
+void StateReplicaCache::pin(const std::string& user, const std::string& key)
+{
+    faabric::util::UniqueLock lock(mx);
+    pins[getReplicaId(user, key)]++;
+}
+
+void StateReplicaCache::unpin(const std::string& user, const std::string& key)
+{
+    faabric::util::UniqueLock lock(mx);
+    auto it = pins.find(getReplicaId(user, key));
+    if (it != pins.end() && --it->second <= 0) {
+        pins.erase(it);
+    }
+}
+
+void StateReplicaCache::releaseCallPins()
+{
+    std::set<std::pair<std::string, std::string>> keys;
+    keys.swap(callPins.keys);
+
+    for (const auto& [user, key] : keys) {
+        unpin(user, key);
+    }
+}
+
+StateReplicaStats StateReplicaCache::getStats()
+{
+    faabric::util::UniqueLock lock(mx);
+
+    StateReplicaStats stats = counts;
+    stats.bytes = bytes;
+    for (const auto& [id, replica] : replicas) {
+        if (!replica.master) {
+            stats.replicas++;
+        }
+    }
+
+    return stats;
+}
+
+void StateReplicaCache::clear()
+{
+    faabric::util::UniqueLock lock(mx);
+    replicas.clear();
+    lru.clear();
+    bytes = 0;
+    counts = StateReplicaStats();
+}
+}
@@ -0,0 +1,189 @@
+#include <conf/FaasmConfig.h>
+#include <wasm/state_batch.h>
+#include <wasm/state_replicas.h>
+#include <wasm/state_shard.h>
+#include <wasm/state_version.h>
+
+#include <faabric/state/State.h>
+#include <faabric/util/config.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+namespace wasm {
+
+// The part of a read or write that falls in one shard
+struct ShardSpan
+{
+    size_t shardIdx = 0;
+    size_t shardOffset = 0;
+    size_t bufferOffset = 0;
+    size_t len = 0;
+};
+
+size_t StateShardLayout::nShards() const
+{
+    if (shardSize == 0) {
+        return 0;
+    }
+
+    return (totalSize + shardSize - 1) / shardSize;
+}
+
+size_t StateShardLayout::getShardSize(size_t shardIdx) const
+{
+    return std::min(shardSize, totalSize - shardIdx * shardSize);
+}
+
+StateShardLayout getStateShardLayout(size_t totalSize)
+{
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+
+    StateShardLayout layout;
+    layout.totalSize = totalSize;
+    layout.shardSize = (size_t)std::max(conf.stateShardKb, 1) * 1024;
+    layout.replicas = std::max(conf.stateShardReplicas, 1);
+
+    return layout;
+}
+
+std::string getStateShardKey(const std::string& key,
+                             size_t shardIdx,
+                             int replica)
+{
+    std::string shardKey = key + "_shard_" + std::to_string(shardIdx);
+    if (replica > 0) {
+        shardKey += "_copy_" + std::to_string(replica);
+    }
+
+    return shardKey;
+}
+
+int getStateShardReplica(int replicas)
+{
+    if (replicas <= 1) {
+        return 0;
+    }
+
+    const std::string& thisHost = faabric::util::getSystemConfig().endpointHost;
+    return (int)(std::hash<std::string>{}(thisHost) % replicas);
+}
+
+static std::vector<ShardSpan> getShardSpans(const StateShardLayout& layout,
+                                            size_t offset,
+                                            size_t len)
+{
+    if (offset + len > layout.totalSize) {
+        SPDLOG_ERROR("Sharded state access out of bounds ({} + {} > {})",
+                     offset,
+                     len,
+                     layout.totalSize);
+        throw std::runtime_error("Sharded state access out of bounds");
+    }
+
+    std::vector<ShardSpan> spans;
+    size_t pos = offset;
+    while (pos < offset + len) {
+        ShardSpan span;
+        span.shardIdx = pos / layout.shardSize;
+        span.shardOffset = pos % layout.shardSize;
+        span.bufferOffset = pos - offset;
+        span.len =
+          std::min(layout.shardSize - span.shardOffset, offset + len - pos);
+        spans.push_back(span);
+
+        pos += span.len;
+    }
+
+    return spans;
+}
+
+void writeStateSharded(const std::string& user,
+                       const std::string& key,
+                       const StateShardLayout& layout,
+                       size_t offset,
+                       const uint8_t* data,
+                       size_t dataLen)
+{
+    std::vector<ShardSpan> spans = getShardSpans(layout, offset, dataLen);
+    SPDLOG_DEBUG("Writing {} bytes of {}/{} to {} shards",
+                 dataLen,
+                 user,
+                 key,
+                 spans.size());
+
+    StateReplicaCache& stateReplicas = getStateReplicaCache();
+    runStateBatch(spans.size(), [&](size_t i) {
+        const ShardSpan& span = spans.at(i);
+        auto kv = stateReplicas.getKV(user,
+                                      getStateShardKey(key, span.shardIdx),
+                                      layout.getShardSize(span.shardIdx));
+
+        kv->setChunk(span.shardOffset, data + span.bufferOffset, span.len);
+        pushStatePartialVersioned(kv);
+    });
+}
+
+// Brings this host's replica of the shard up to date, refreshing the copy
+// from the shard itself if it's behind
+static void pullShardReplica(
+  const std::shared_ptr<faabric::state::StateKeyValue>& shardKv,
+  const std::shared_ptr<faabric::state::StateKeyValue>& copyKv)
+{
+    if (copyKv == nullptr) {
+        pullStateIfChanged(shardKv);
+        return;
+    }
+
+    uint64_t latest = getStateVersion(shardKv);
+    if (getStateVersion(copyKv) >= latest) {
+        pullStateIfChanged(copyKv);
+        return;
+    }
+
+    SPDLOG_DEBUG("Refreshing {} to version {}", copyKv->key, latest);
+    pullStateIfChanged(shardKv);
+    copyKv->set(shardKv->get());
+    pushStateAtVersion(copyKv, latest);
+}
+
+void readStateSharded(const std::string& user,
+                      const std::string& key,
+                      const StateShardLayout& layout,
+                      int replica,
+                      size_t offset,
+                      uint8_t* buffer,
+                      size_t bufferLen)
+{
+    std::vector<ShardSpan> spans = getShardSpans(layout, offset, bufferLen);
+    SPDLOG_DEBUG("Reading {} bytes of {}/{} from {} shards (replica {})",
+                 bufferLen,
+                 user,
+                 key,
+                 spans.size(),
+                 replica);
+
+    StateReplicaCache& stateReplicas = getStateReplicaCache();
+    runStateBatch(spans.size(), [&](size_t i) {
+        const ShardSpan& span = spans.at(i);
+        size_t shardSize = layout.getShardSize(span.shardIdx);
+        auto shardKv = stateReplicas.getKV(
+          user, getStateShardKey(key, span.shardIdx), shardSize);
+
+        std::shared_ptr<faabric::state::StateKeyValue> copyKv = nullptr;
+        if (replica > 0) {
+            copyKv = stateReplicas.getKV(
+              user, getStateShardKey(key, span.shardIdx, replica), shardSize);
+        }
+
+        pullShardReplica(shardKv, copyKv);
+
+        auto& readKv = copyKv == nullptr ? shardKv : copyKv;
+        readKv->getChunk(
+          span.shardOffset, buffer + span.bufferOffset, span.len);
+    });
+}
+}
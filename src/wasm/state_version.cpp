@@ -0,0 +1,127 @@
+#include <wasm/state_metrics.h>
+#include <wasm/state_version.h>
+
+#include <faabric/state/State.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace wasm {
+
+static std::mutex pulledVersionsMx;
+
+// The version of each key's replica on this host, keyed by user and key
+static std::unordered_map<std::string, uint64_t> pulledVersions;
+
+static std::shared_ptr<faabric::state::StateKeyValue> getVersionKV(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv)
+{
+    return faabric::state::getGlobalState().getKV(
+      kv->user, kv->key + "_version", sizeof(uint64_t));
+}
+
+static uint64_t pullVersion(
+  const std::shared_ptr<faabric::state::StateKeyValue>& versionKv)
+{
+    versionKv->pull();
+    recordStatePull(sizeof(uint64_t));
+
+    uint64_t version = 0;
+    versionKv->get(reinterpret_cast<uint8_t*>(&version));
+    return version;
+}
+
+bool pullStateIfChanged(std::shared_ptr<faabric::state::StateKeyValue> kv)
+{
+    std::string versionKey = kv->user + "/" + kv->key;
+
+    // Take the version before the value, so a push in between means a stale
+    // version rather than a stale value
+    uint64_t latest = pullVersion(getVersionKV(kv));
+    {
+        faabric::util::UniqueLock lock(pulledVersionsMx);
+        auto it = pulledVersions.find(versionKey);
+        if (it != pulledVersions.end() && it->second == latest) {
+            SPDLOG_TRACE(
+              "Skipping pull of {} at version {}", versionKey, latest);
+            return false;
+        }
+    }
+
+    SPDLOG_DEBUG("Pulling {} at version {}", versionKey, latest);
+    kv->pull();
+    recordStatePull(kv->size());
+
+    faabric::util::UniqueLock lock(pulledVersionsMx);
+    pulledVersions[versionKey] = latest;
+
+    return true;
+}
+
+static void setVersion(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+  const std::shared_ptr<faabric::state::StateKeyValue>& versionKv,
+  uint64_t version)
+{
+    versionKv->set(reinterpret_cast<uint8_t*>(&version));
+    versionKv->pushFull();
+    recordStatePush(sizeof(uint64_t));
+
+    // Our own replica is what we just pushed
+    faabric::util::UniqueLock lock(pulledVersionsMx);
+    pulledVersions[kv->user + "/" + kv->key] = version;
+
+    SPDLOG_DEBUG("Pushed {}/{} at version {}", kv->user, kv->key, version);
+}
+
+static uint64_t bumpVersion(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv)
+{
+    auto versionKv = getVersionKV(kv);
+    uint64_t version = pullVersion(versionKv) + 1;
+    setVersion(kv, versionKv, version);
+
+    return version;
+}
+
+uint64_t pushStateVersioned(std::shared_ptr<faabric::state::StateKeyValue> kv)
+{
+    // The value must land before the new version does
+    kv->pushFull();
+    recordStatePush(kv->size());
+
+    return bumpVersion(kv);
+}
+
+uint64_t pushStatePartialVersioned(
+  std::shared_ptr<faabric::state::StateKeyValue> kv)
+{
+    kv->pushPartial();
+    recordStatePush(0);
+
+    return bumpVersion(kv);
+}
+
+uint64_t getStateVersion(std::shared_ptr<faabric::state::StateKeyValue> kv)
+{
+    return pullVersion(getVersionKV(kv));
+}
+
+void pushStateAtVersion(std::shared_ptr<faabric::state::StateKeyValue> kv,
+                        uint64_t version)
+{
+    kv->pushFull();
+    recordStatePush(kv->size());
+
+    setVersion(kv, getVersionKV(kv), version);
+}
+
+void clearStateVersions()
+{
+    faabric::util::UniqueLock lock(pulledVersionsMx);
+    pulledVersions.clear();
+}
+}
@@ -0,0 +1,192 @@
+#include <wasm/WasmExecutionContext.h>
+#include <wasm/deadline.h>
+#include <wasm/timing.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_set>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace wasm {
+
+uint64_t getTimerNanos()
+{
+    timespec ts{};
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        SPDLOG_ERROR("Failed to read monotonic clock");
+        throw std::runtime_error("Failed to read monotonic clock");
+    }
+
+    return faabric::util::timespecToNanos(&ts);
+}
+
+uint64_t getTimerResolutionNanos()
+{
+    static const uint64_t resolution = [] {
+        timespec ts{};
+        if (clock_getres(CLOCK_MONOTONIC, &ts) != 0) {
+            SPDLOG_ERROR("Failed to read monotonic clock resolution");
+            throw std::runtime_error("Failed to read clock resolution");
+        }
+
+        return faabric::util::timespecToNanos(&ts);
+    }();
+
+    return resolution;
+}
+
+double getTimerSeconds()
+{
+    return ((double)getTimerNanos()) / 1e9;
+}
+
+double getTimerResolutionSeconds()
+{
+    return ((double)getTimerResolutionNanos()) / 1e9;
+}
+
+// Linux clocks indexed by WASI clock ID
+static constexpr std::array<clockid_t, 4> linuxClockIds = {
+    CLOCK_REALTIME,
+    CLOCK_MONOTONIC,
+    CLOCK_PROCESS_CPUTIME_ID,
+    CLOCK_THREAD_CPUTIME_ID,
+};
+
+int getWasiClockNanos(uint32_t wasiClockId, uint64_t* result)
+{
+    if (wasiClockId >= linuxClockIds.size()) {
+        return -EINVAL;
+    }
+
+    timespec ts{};
+    if (clock_gettime(linuxClockIds[wasiClockId], &ts) != 0) {
+        return -errno;
+    }
+
+    *result = faabric::util::timespecToNanos(&ts);
+    return 0;
+}
+
+int getWasiClockResolutionNanos(uint32_t wasiClockId, uint64_t* result)
+{
+    static const std::array<uint64_t, linuxClockIds.size()> resolutions = [] {
+        std::array<uint64_t, linuxClockIds.size()> res{};
+        for (size_t i = 0; i < linuxClockIds.size(); i++) {
+            timespec ts{};
+            if (clock_getres(linuxClockIds[i], &ts) == 0) {
+                res[i] = faabric::util::timespecToNanos(&ts);
+            }
+        }
+
+        return res;
+    }();
+
+    if (wasiClockId >= resolutions.size() || resolutions[wasiClockId] == 0) {
+        return -EINVAL;
+    }
+
+    *result = resolutions[wasiClockId];
+    return 0;
+}
+
+// -----
+// Sleeps
+// -----
+
+struct Sleeper
+{
+    WasmModule* module = nullptr;
+
+    // Set to one when the sleep is cut short
+    std::atomic<int32_t> woken = 0;
+};
+
+static std::mutex sleepersMx;
+
+// Sleepers are only removed with the lock held, so waking never touches one
+// that has gone
+static std::unordered_set<Sleeper*> sleepers;
+
+static int32_t* wordOf(std::atomic<int32_t>& atomic)
+{
+    static_assert(sizeof(std::atomic<int32_t>) == sizeof(int32_t));
+    return reinterpret_cast<int32_t*>(&atomic);
+}
+
+bool sleepNanos(uint64_t nanos)
+{
+    Sleeper sleeper;
+    sleeper.module = getExecutingModule();
+    {
+        faabric::util::UniqueLock lock(sleepersMx);
+        sleepers.insert(&sleeper);
+    }
+
+    uint64_t now = getTimerNanos();
+    uint64_t end = now + nanos;
+    int64_t remainingMs = getRemainingTimeMs();
+    if (remainingMs >= 0) {
+        end = std::min(end, now + (uint64_t)remainingMs * 1000000);
+    }
+
+    // Loop as futex waits can return early, e.g. on signals
+    bool woken = false;
+    while (true) {
+        if (sleeper.woken.load(std::memory_order_acquire) != 0) {
+            woken = true;
+            break;
+        }
+
+        now = getTimerNanos();
+        if (now >= end) {
+            break;
+        }
+
+        timespec timeout{};
+        faabric::util::nanosToTimespec(end - now, &timeout);
+        ::syscall(SYS_futex,
+                  wordOf(sleeper.woken),
+                  FUTEX_WAIT_PRIVATE,
+                  0,
+                  &timeout,
+                  nullptr,
+                  0);
+    }
+
+    faabric::util::UniqueLock lock(sleepersMx);
+    sleepers.erase(&sleeper);
+
+    return woken;
+}
+
+void wakeSleepingCalls(WasmModule* module)
+{
+    faabric::util::UniqueLock lock(sleepersMx);
+    for (Sleeper* sleeper : sleepers) {
+        if (sleeper->module != module) {
+            continue;
+        }
+
+        sleeper->woken.store(1, std::memory_order_release);
+        ::syscall(SYS_futex,
+                  wordOf(sleeper->woken),
+                  FUTEX_WAKE_PRIVATE,
+                  1,
+                  nullptr,
+                  nullptr,
+                  0);
+    }
+}
+}
@@ -0,0 +1,100 @@
+#include <conf/FaasmConfig.h>
+#include <wavm/WAVMWasmModule.h>
+
+#include <faabric/util/logging.h>
+
+namespace wasm {
+
+CompartmentPoolFiller& getCompartmentPoolFiller()
+{
+    static CompartmentPoolFiller f;
+    return f;
+}
+
+CompartmentPoolFiller::~CompartmentPoolFiller()
+{
+    {
+        std::unique_lock<std::mutex> lock(mx);
+        running = false;
+        requested.clear();
+    }
+
+    requestedCv.notify_one();
+    if (fillThread.joinable()) {
+        fillThread.join();
+    }
+}
+
+void CompartmentPoolFiller::requestFill(std::shared_ptr<WAVMWasmModule> zygote)
+{
+    if (conf::getFaasmConfig().compartmentPoolSize <= 0) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mx);
+
+    // Only started once there's a pool to fill
+    if (!running) {
+        running = true;
+        fillThread = std::thread(&CompartmentPoolFiller::fillLoop, this);
+    }
+
+    // A zygote only needs to be queued once, as each fill tops it up
+    std::weak_ptr<WAVMWasmModule> weak = zygote;
+    for (const auto& r : requested) {
+        if (!r.owner_before(weak) && !weak.owner_before(r)) {
+            return;
+        }
+    }
+
+    requested.emplace_back(std::move(weak));
+    lock.unlock();
+
+    requestedCv.notify_one();
+}
+
+void CompartmentPoolFiller::drain()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    filledCv.wait(lock, [this] { return requested.empty() && !filling; });
+}
+
+void CompartmentPoolFiller::fillLoop()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    while (true) {
+        requestedCv.wait(lock,
+                         [this] { return !running || !requested.empty(); });
+
+        if (!running) {
+            break;
+        }
+
+        // Zygotes evicted from the cache since don't need filling
+        std::shared_ptr<WAVMWasmModule> zygote = requested.front().lock();
+        requested.pop_front();
+        filling = true;
+        lock.unlock();
+
+        if (zygote != nullptr) {
+            try {
+                zygote->fillCompartmentPool();
+            } catch (std::exception& ex) {
+                SPDLOG_ERROR("Failed to fill compartment pool: {}",
+                             ex.what());
+            }
+        }
+
+        // Drop the zygote without the lock, as this may be the last
+        // reference to it
+        zygote = nullptr;
+
+        lock.lock();
+        filling = false;
+        filledCv.notify_all();
+    }
+
+    filling = false;
+    filledCv.notify_all();
+}
+}
@@ -0,0 +1,100 @@
+#include <wavm/WAVMWasmModule.h>
+
+#include <faabric/util/logging.h>
+
+using namespace WAVM;
+
+namespace wasm {
+
+CompartmentReclaimer& getCompartmentReclaimer()
+{
+    static CompartmentReclaimer r;
+    return r;
+}
+
+CompartmentReclaimer::~CompartmentReclaimer()
+{
+    {
+        std::unique_lock<std::mutex> lock(mx);
+        running = false;
+    }
+
+    queuedCv.notify_one();
+    if (reclaimThread.joinable()) {
+        reclaimThread.join();
+    }
+}
+
+void CompartmentReclaimer::reclaim(
+  Runtime::GCPointer<Runtime::Compartment>&& compartment)
+{
+    std::unique_lock<std::mutex> lock(mx);
+
+    // Only started once there's something to collect, so hosts and tests that
+    // never reset a module don't get the thread
+    if (!running) {
+        running = true;
+        reclaimThread = std::thread(&CompartmentReclaimer::reclaimLoop, this);
+    }
+
+    collectedCv.wait(lock, [this] {
+        return queue.size() < COMPARTMENT_RECLAIM_QUEUE_SIZE;
+    });
+
+    queue.emplace_back(std::move(compartment));
+    lock.unlock();
+
+    queuedCv.notify_one();
+}
+
+void CompartmentReclaimer::drain()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    collectedCv.wait(lock, [this] { return queue.empty() && !collecting; });
+}
+
+size_t CompartmentReclaimer::getPendingCount()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    return queue.size() + (collecting ? 1 : 0);
+}
+
+size_t CompartmentReclaimer::getFailedCount()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    return failedCount;
+}
+
+void CompartmentReclaimer::reclaimLoop()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    while (true) {
+        queuedCv.wait(lock, [this] { return !running || !queue.empty(); });
+
+        // Anything still queued is collected before stopping
+        if (queue.empty()) {
+            break;
+        }
+
+        Runtime::GCPointer<Runtime::Compartment> compartment =
+          std::move(queue.front());
+        queue.pop_front();
+        collecting = true;
+        lock.unlock();
+
+        // There's no one to throw to here, and the module has already moved
+        // on, so a failure just leaks the compartment
+        bool cleared = Runtime::tryCollectCompartment(std::move(compartment));
+        if (!cleared) {
+            SPDLOG_ERROR("WAVM GC failed in the background");
+        }
+
+        lock.lock();
+        collecting = false;
+        if (!cleared) {
+            failedCount++;
+        }
+        collectedCv.notify_all();
+    }
+}
+}
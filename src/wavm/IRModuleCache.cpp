@@ -2,15 +2,21 @@
 #include <faabric/util/func.h>
 #include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
+#include <storage/CodegenManifest.h>
 #include <storage/FileLoader.h>
 #include <wasm/WasmCommon.h>
 #include <wavm/IRModuleCache.h>
+#include <wavm/WAVMWasmModule.h>
 
 #include <WAVM/IR/Module.h>
 #include <WAVM/IR/Types.h>
 #include <WAVM/WASM/WASM.h>
 #include <WAVM/WASTParse/WASTParse.h>
 
+#include <algorithm>
+#include <chrono>
+#include <unordered_set>
+
 namespace wasm {
 IRModuleCache::IRModuleCache()
   : conf(faabric::util::getSystemConfig())
@@ -35,6 +41,52 @@ std::string getModuleKey(const std::string& user,
     return key;
 }
 
+std::string IRModuleCache::getSharedModuleKey(const std::string& path)
+{
+    {
+        faabric::util::SharedLock lock(mx);
+        auto it = sharedModuleKeys.find(path);
+        if (it != sharedModuleKeys.end()) {
+            return it->second;
+        }
+    }
+
+    // Shared modules are keyed on the hash recorded in the codegen manifest,
+    // so two paths containing the same object code (e.g. the same CPython
+    // extension loaded by different functions) share a single entry. If no
+    // hash has been recorded we fall back to keying on the path, which still
+    // shares the module across all functions on this host.
+    storage::FileLoader& functionLoader = storage::getFileLoader();
+    storage::CodegenManifest manifest(
+      functionLoader.loadCodegenManifest(SHARED_OBJ_MANIFEST_SCOPE));
+    storage::CodegenManifestEntry entry =
+      manifest.getEntry(functionLoader.getSharedObjectCodegenKey(path));
+
+    std::string key;
+    if (entry.empty()) {
+        SPDLOG_DEBUG("No manifest entry for shared module {}, keying on path",
+                     path);
+        key = "shared_path_" + path;
+    } else {
+        key = "shared_obj_" + entry.hash;
+    }
+
+    faabric::util::FullLock lock(mx);
+    auto [it, inserted] = sharedModuleKeys.try_emplace(path, key);
+    return it->second;
+}
+
+std::string IRModuleCache::getKeyForModule(const std::string& user,
+                                           const std::string& func,
+                                           const std::string& path)
+{
+    if (path.empty()) {
+        return getModuleKey(user, func, "");
+    }
+
+    return getSharedModuleKey(path);
+}
+
 int IRModuleCache::getModuleCount(const std::string& key)
 {
     faabric::util::SharedLock lock(mx);
@@ -52,15 +104,12 @@ IR::Module& IRModuleCache::getModule(const std::string& user,
                                      const std::string& path)
 {
     /*
-     * Note that shared modules are currently only shared in memory across
-     * instances of the *same* function.  If two different functions both
-     * load shared module A, it will be loaded into memory twice.
-     *
-     * This is currently only to do with needing to modify the table
-     * definition to fit with the importing main module, something which can
-     * probably be fixed.
-     *
-     * TODO - implement this proper sharing of modules
+     * Main modules are cached per function, whereas shared modules are cached
+     * per unique object file, i.e. if two different functions both load
+     * shared module A, it is only loaded into memory once. To make this
+     * possible, the cached IR for a shared module is independent of the main
+     * module importing it, and the table growth it requires is applied when
+     * each importer instantiates it (see getSharedModuleTableSize).
      */
 
     if (path.empty()) {
@@ -85,8 +134,15 @@ U64 IRModuleCache::getSharedModuleTableSize(const std::string& user,
                                             const std::string& func,
                                             const std::string& path)
 {
-    const std::string key = getModuleKey(user, func, path);
-    return originalTableSizes[key];
+    const std::string key = getSharedModuleKey(path);
+
+    faabric::util::SharedLock lock(mx);
+    auto it = originalTableSizes.find(key);
+    if (it == originalTableSizes.end()) {
+        return 0;
+    }
+
+    return it->second;
 }
 
 size_t IRModuleCache::getSharedModuleDataSize(const std::string& user,
@@ -102,34 +158,185 @@ size_t IRModuleCache::getSharedModuleDataSize(const std::string& user,
     return dataSize;
 }
 
+std::vector<std::pair<uint32_t, uint32_t>>
+IRModuleCache::getReadOnlyDataRanges(const std::string& user,
+                                     const std::string& func,
+                                     const std::string& path)
+{
+    IR::Module& irModule = IRModuleCache::getModule(user, func, path);
+
+    IR::DisassemblyNames names;
+    IR::getDisassemblyNames(irModule, names);
+
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    for (size_t i = 0; i < irModule.dataSegments.size(); i++) {
+        const IR::DataSegment& ds = irModule.dataSegments[i];
+        if (!ds.isActive || ds.memoryIndex != 0 ||
+            ds.baseOffset.type != IR::InitializerExpression::Type::i32_const) {
+            continue;
+        }
+
+        if (i >= names.dataSegments.size() ||
+            !names.dataSegments[i].starts_with(".rodata")) {
+            continue;
+        }
+
+        uint32_t start = (uint32_t)ds.baseOffset.i32;
+        ranges.emplace_back(start, start + ds.data->size());
+    }
+
+    std::sort(ranges.begin(), ranges.end());
+    return ranges;
+}
+
 Runtime::ModuleRef IRModuleCache::getCompiledMainModule(const std::string& user,
                                                         const std::string& func)
 {
 
     const std::string key = getModuleKey(user, func, "");
 
-    if (getCompiledModuleCount(key) == 0) {
+    if (getCompiledModuleCount(key) > 0) {
+        SPDLOG_DEBUG("Using cached compiled main module {}/{}", user, func);
+
+        faabric::util::SharedLock lock(mx);
+        return compiledModuleMap[key];
+    }
+
+    // Loading or compiling the machine code can take a long time, so we do
+    // it without holding the registry lock. Only one thread does it for each
+    // function, any others wait for its result.
+    std::promise<Runtime::ModuleRef> compiled;
+    std::shared_future<Runtime::ModuleRef> pending;
+    IR::Module* module = nullptr;
+    {
         faabric::util::FullLock registryLock(mx);
-        if (compiledModuleMap.count(key) == 0) {
-            IR::Module& module = getModuleFromMap(key);
+        auto compiledIt = compiledModuleMap.find(key);
+        if (compiledIt != compiledModuleMap.end()) {
+            return compiledIt->second;
+        }
 
-            storage::FileLoader& functionLoader = storage::getFileLoader();
-            faabric::Message msg = faabric::util::messageFactory(user, func);
-            std::vector<uint8_t> objectFileBytes =
-              functionLoader.loadFunctionObjectFile(msg);
+        auto pendingIt = pendingCompiles.find(key);
+        if (pendingIt != pendingCompiles.end()) {
+            pending = pendingIt->second;
+        } else {
+            pendingCompiles[key] = compiled.get_future().share();
+            module = &getModuleFromMap(key);
+        }
+    }
 
-            if (!objectFileBytes.empty()) {
-                compiledModuleMap[key] =
-                  Runtime::loadPrecompiledModule(module, objectFileBytes);
-            } else {
-                compiledModuleMap[key] = Runtime::compileModule(module);
-            }
+    if (pending.valid()) {
+        SPDLOG_DEBUG("Waiting for main module {}/{} to compile", user, func);
+        return pending.get();
+    }
+
+    faabric::Message msg = faabric::util::messageFactory(user, func);
+    Runtime::ModuleRef compiledModule;
+    size_t objectFileSize = 0;
+    try {
+        std::vector<uint8_t> objectFileBytes = loadMainObjectFile(msg);
+        if (!objectFileBytes.empty()) {
+            compiledModule =
+              Runtime::loadPrecompiledModule(*module, objectFileBytes);
+            objectFileSize = objectFileBytes.size();
+        } else {
+            SPDLOG_WARN("No machine code for {}/{}, compiling", user, func);
+            compiledModule = Runtime::compileModule(*module);
         }
-    } else {
-        SPDLOG_DEBUG("Using cached compiled main module {}/{}", user, func);
+    } catch (...) {
+        {
+            faabric::util::FullLock registryLock(mx);
+            pendingCompiles.erase(key);
+        }
+
+        compiled.set_exception(std::current_exception());
+        throw;
     }
 
-    return compiledModuleMap[key];
+    {
+        faabric::util::FullLock registryLock(mx);
+        compiledModuleMap[key] = compiledModule;
+        if (objectFileSize > 0) {
+            compiledModuleSizes[key] = objectFileSize;
+        }
+        pendingCompiles.erase(key);
+    }
+
+    compiled.set_value(compiledModule);
+
+    // Upload what we compiled, so that other hosts, and this one once the
+    // module is evicted, can load it rather than compiling it again
+    if (objectFileSize == 0) {
+        uploadObjectCode(msg, Runtime::getObjectCode(compiledModule));
+    }
+
+    return compiledModule;
+}
+
+std::vector<uint8_t> IRModuleCache::loadMainObjectFile(
+  const faabric::Message& msg)
+{
+    storage::FileLoader& functionLoader = storage::getFileLoader();
+
+    // Prefer the machine code for the best CPU target we support
+    for (const auto& target : getCodegenTargets()) {
+        if (!isCodegenTargetSupported(target)) {
+            continue;
+        }
+
+        std::vector<uint8_t> objectFileBytes =
+          functionLoader.loadFunctionObjectFile(msg, target);
+        if (!objectFileBytes.empty()) {
+            SPDLOG_DEBUG("Using {} machine code for {}/{}",
+                         target,
+                         msg.user(),
+                         msg.function());
+            return objectFileBytes;
+        }
+    }
+
+    return functionLoader.loadFunctionObjectFile(msg);
+}
+
+void IRModuleCache::uploadObjectCode(const faabric::Message& msg,
+                                     std::vector<uint8_t> objectCode)
+{
+    std::unique_lock<std::mutex> lock(uploadsMx);
+
+    // Drop uploads that have already finished
+    objectUploads.erase(
+      std::remove_if(objectUploads.begin(),
+                     objectUploads.end(),
+                     [](const std::future<void>& f) {
+                         return f.wait_for(std::chrono::seconds(0)) ==
+                                std::future_status::ready;
+                     }),
+      objectUploads.end());
+
+    objectUploads.emplace_back(std::async(
+      std::launch::async, [msg, objectCode = std::move(objectCode)] {
+          const std::string funcStr = faabric::util::funcToString(msg, false);
+          try {
+              storage::getFileLoader().uploadFunctionObjectFile(msg,
+                                                                objectCode);
+              SPDLOG_DEBUG("Uploaded compiled machine code for {}", funcStr);
+          } catch (std::exception& ex) {
+              SPDLOG_ERROR(
+                "Failed to upload machine code for {}: {}", funcStr, ex.what());
+          }
+      }));
+}
+
+void IRModuleCache::awaitObjectUploads()
+{
+    std::vector<std::future<void>> uploads;
+    {
+        std::unique_lock<std::mutex> lock(uploadsMx);
+        uploads.swap(objectUploads);
+    }
+
+    for (auto& f : uploads) {
+        f.wait();
+    }
 }
 
 Runtime::ModuleRef IRModuleCache::getCompiledSharedModule(
@@ -137,13 +344,12 @@ Runtime::ModuleRef IRModuleCache::getCompiledSharedModule(
   const std::string& func,
   const std::string& path)
 {
-    std::string key = getModuleKey(user, func, path);
+    std::string key = getSharedModuleKey(path);
 
     if (getCompiledModuleCount(key) == 0) {
         faabric::util::FullLock registryLock(mx);
         if (compiledModuleMap.count(key) == 0) {
-            SPDLOG_DEBUG(
-              "Loading compiled shared module {}/{} - {}", user, func, path);
+            SPDLOG_DEBUG("Loading compiled shared module {} ({})", path, key);
 
             IR::Module& module = getModuleFromMap(key);
 
@@ -152,10 +358,10 @@ Runtime::ModuleRef IRModuleCache::getCompiledSharedModule(
               functionLoader.loadSharedObjectObjectFile(path);
             compiledModuleMap[key] =
               Runtime::loadPrecompiledModule(module, objectBytes);
+            compiledModuleSizes[key] = objectBytes.size();
         }
     } else {
-        SPDLOG_DEBUG(
-          "Using cached shared compiled module {}/{} - {}", user, func, path);
+        SPDLOG_DEBUG("Using cached shared compiled module {} ({})", path, key);
     }
 
     {
@@ -166,9 +372,7 @@ Runtime::ModuleRef IRModuleCache::getCompiledSharedModule(
 
 static void setModuleSpecFeatures(IR::Module& module)
 {
-    module.featureSpec.simd = true;
-    module.featureSpec.extendedNameSection = true;
-    module.featureSpec.nonTrappingFloatToInt = true;
+    setWavmFeatureSpec(module.featureSpec);
 }
 
 IR::Module& IRModuleCache::getMainModule(const std::string& user,
@@ -234,13 +438,13 @@ IR::Module& IRModuleCache::getSharedModule(const std::string& user,
                                            const std::string& func,
                                            const std::string& path)
 {
-    std::string key = getModuleKey(user, func, path);
+    std::string key = getSharedModuleKey(path);
 
     // Check if initialised
     if (getModuleCount(key) == 0) {
         faabric::util::FullLock lock(mx);
         if (moduleMap.count(key) == 0) {
-            SPDLOG_DEBUG("Loading shared module {}/{} - {}", user, func, path);
+            SPDLOG_DEBUG("Loading shared module {} ({})", path, key);
 
             storage::FileLoader& functionLoader = storage::getFileLoader();
 
@@ -266,29 +470,25 @@ IR::Module& IRModuleCache::getSharedModule(const std::string& user,
                   "Dynamic module trying to define memories");
             }
 
-            // TODO - better way to handle this? Modify WAVM?  To keep WAVM
-            // happy, we have to force the incoming dynamic module to accept
-            // the table from the main module. This modifies the shared
-            // reference, therefore we also have to preserve the original
-            // size and make available to callers.
+            // To keep WAVM happy, the incoming dynamic module must accept
+            // the table from whichever main module imports it. Rather than
+            // patching in the table size of a specific main module, we relax
+            // the import to accept any main module table (these are all
+            // forced to a max of MAX_TABLE_SIZE). We preserve the original
+            // size so that importers can grow their own table by the right
+            // amount at instantiation time.
             if (!module.tables.imports.empty()) {
                 this->originalTableSizes[key] =
                   module.tables.imports[0].type.size.min;
 
-                const std::string mainKey = getModuleKey(user, func, "");
-                IR::Module& mainModule = getModuleFromMap(mainKey);
-
-                module.tables.imports[0].type.size.min =
-                  (U64)mainModule.tables.defs[0].type.size.min;
-                module.tables.imports[0].type.size.max =
-                  (U64)mainModule.tables.defs[0].type.size.max;
+                module.tables.imports[0].type.size.min = 0;
+                module.tables.imports[0].type.size.max = (U64)MAX_TABLE_SIZE;
             } else {
                 SPDLOG_WARN("Module has no imported tables (key={})", key);
             }
         }
     } else {
-        SPDLOG_DEBUG(
-          "Loading cached shared module {}/{} - {}", user, func, path);
+        SPDLOG_DEBUG("Loading cached shared module {} ({})", path, key);
     }
 
     {
@@ -301,7 +501,7 @@ bool IRModuleCache::isModuleCached(const std::string& user,
                                    const std::string& func,
                                    const std::string& path)
 {
-    std::string key = getModuleKey(user, func, path);
+    std::string key = getKeyForModule(user, func, path);
     return getModuleCount(key) > 0;
 }
 
@@ -309,7 +509,7 @@ bool IRModuleCache::isCompiledModuleCached(const std::string& user,
                                            const std::string& func,
                                            const std::string& path)
 {
-    std::string key = getModuleKey(user, func, path);
+    std::string key = getKeyForModule(user, func, path);
     return getCompiledModuleCount(key) > 0;
 }
 
@@ -321,6 +521,53 @@ void IRModuleCache::clear()
 
     moduleMap.clear();
     compiledModuleMap.clear();
+    compiledModuleSizes.clear();
     originalTableSizes.clear();
+    sharedModuleKeys.clear();
+}
+
+size_t IRModuleCache::getCompiledModuleSize(const std::string& user,
+                                            const std::string& func,
+                                            const std::string& path)
+{
+    const std::string key = getKeyForModule(user, func, path);
+
+    faabric::util::SharedLock lock(mx);
+    auto it = compiledModuleSizes.find(key);
+    if (it == compiledModuleSizes.end()) {
+        return 0;
+    }
+
+    return it->second;
+}
+
+void IRModuleCache::evictMainModule(const std::string& user,
+                                    const std::string& func)
+{
+    const std::string key = getModuleKey(user, func, "");
+
+    faabric::util::FullLock lock(mx);
+
+    SPDLOG_DEBUG("Evicting main module {}/{} from IR cache", user, func);
+
+    // Compiled modules are reference counted, so any instances created from
+    // this one keep the compiled code alive
+    moduleMap.erase(key);
+    compiledModuleMap.erase(key);
+    compiledModuleSizes.erase(key);
+}
+
+size_t IRModuleCache::getSharedCompiledModuleCount()
+{
+    faabric::util::SharedLock lock(mx);
+
+    std::unordered_set<std::string> uniqueKeys;
+    for (const auto& p : sharedModuleKeys) {
+        if (compiledModuleMap.count(p.second) > 0) {
+            uniqueKeys.insert(p.second);
+        }
+    }
+
+    return uniqueKeys.size();
 }
 }
@@ -1,3 +1,6 @@
+#include <conf/FaasmConfig.h>
+#include <wasm/page_store.h>
+#include <wavm/IRModuleCache.h>
 #include <wavm/WAVMWasmModule.h>
 
 #include <faabric/snapshot/SnapshotRegistry.h>
@@ -6,6 +9,7 @@
 #include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
 
+#include <chrono>
 #include <sys/mman.h>
 
 namespace wasm {
@@ -15,74 +19,268 @@ WAVMModuleCache& getWAVMModuleCache()
     return r;
 }
 
+static std::string getResetSnapshotKey(const faabric::Message& msg)
+{
+    return getZygoteKey(msg) + "_reset";
+}
+
+thread_local WAVMModuleCache::ThreadCacheView WAVMModuleCache::threadView;
+
+// Millisecond resolution is plenty for LRU, and means hot entries are only
+// written to once per millisecond rather than on every lookup
+static uint64_t getLruTimestamp()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+const WAVMModuleCache::CachedWAVMModuleView& WAVMModuleCache::getThreadView()
+{
+    if (threadView.cache != this ||
+        threadView.generation != generation.load(std::memory_order_acquire)) {
+        faabric::util::SharedLock lock(mx);
+        threadView.cache = this;
+        threadView.generation = generation.load(std::memory_order_relaxed);
+        threadView.entries.clear();
+        for (const auto& [key, entry] : *cachedModuleMap) {
+            threadView.entries.emplace(key, entry);
+        }
+    }
+
+    return threadView.entries;
+}
+
+void WAVMModuleCache::publish(std::shared_ptr<const CachedWAVMModuleMap> newMap)
+{
+    cachedModuleMap = std::move(newMap);
+    generation.fetch_add(1, std::memory_order_release);
+}
+
 size_t WAVMModuleCache::getTotalCachedModuleCount()
 {
     faabric::util::SharedLock lock(mx);
-    return cachedModuleMap.size();
+    return cachedModuleMap->size();
+}
+
+size_t WAVMModuleCache::getTotalResidentBytes()
+{
+    faabric::util::SharedLock lock(mx);
+
+    size_t total = 0;
+    for (const auto& [key, entry] : *cachedModuleMap) {
+        total += entry->residentBytes();
+    }
+
+    return total;
+}
+
+std::vector<WAVMCacheEntryStats> WAVMModuleCache::getEntryStats()
+{
+    faabric::util::SharedLock lock(mx);
+
+    std::vector<WAVMCacheEntryStats> stats;
+    for (const auto& [key, entry] : *cachedModuleMap) {
+        stats.push_back({ key,
+                          entry->residentBytes(),
+                          entry->inUse(),
+                          entry->user,
+                          entry->function,
+                          entry->moduleBytes,
+                          entry->snapshotBytes });
+    }
+
+    return stats;
 }
 
 int WAVMModuleCache::getCachedModuleCount(const std::string& key)
 {
     faabric::util::SharedLock lock(mx);
-    int count = cachedModuleMap.count(key);
+    int count = cachedModuleMap->count(key);
     return count;
 }
 
-std::pair<wasm::WAVMWasmModule&, faabric::util::SharedLock>
-WAVMModuleCache::getCachedModule(faabric::Message& msg)
+std::shared_ptr<wasm::WAVMWasmModule> WAVMModuleCache::getCachedModule(
+  faabric::Message& msg)
 {
-    std::string key = faabric::util::funcToString(msg, false);
+    std::string key = getZygoteKey(msg);
 
-    // If there's no cached module, we need to create it
-    faabric::util::SharedLock readLock(mx);
-    if (cachedModuleMap.find(key) == cachedModuleMap.end()) {
-        readLock.unlock();
-        faabric::util::FullLock lock(mx);
+    // Cache hits are served from this thread's view without locking. Entries
+    // evicted since the view was taken have gone, and are looked up again.
+    const CachedWAVMModuleView& view = getThreadView();
+    auto it = view.find(key);
+    std::shared_ptr<CachedWAVMModule> hit =
+      it == view.end() ? nullptr : it->second.lock();
+    if (hit != nullptr) {
+        uint64_t now = getLruTimestamp();
+        if (hit->lastUsed.load(std::memory_order_relaxed) != now) {
+            hit->lastUsed.store(now, std::memory_order_relaxed);
+        }
 
-        // Re-check condition
-        if (cachedModuleMap.find(key) == cachedModuleMap.end()) {
+        return hit->module;
+    }
 
-            SPDLOG_DEBUG("WAVM module cache initialising {}", key);
+    faabric::util::FullLock lock(mx);
 
-            // Instantiate the base module
-            wasm::WAVMWasmModule& module = cachedModuleMap[key];
-            module.bindToFunction(msg, false);
-        }
+    // Re-check condition
+    auto existing = cachedModuleMap->find(key);
+    if (existing != cachedModuleMap->end()) {
+        return existing->second->module;
     }
 
-    {
-        // Note that we need a shared lock here to avoid a race condition on
-        // initialising the module
-        faabric::util::SharedLock lock(mx);
-        return std::pair<wasm::WAVMWasmModule&, faabric::util::SharedLock>(
-          cachedModuleMap[key], std::move(lock));
+    SPDLOG_DEBUG("WAVM module cache initialising {}", key);
+
+    // Instantiate the base module
+    auto entry = std::make_shared<CachedWAVMModule>();
+    entry->module = std::make_shared<wasm::WAVMWasmModule>();
+    entry->module->bindToFunction(msg, false);
+    if (conf::getFaasmConfig().sharedReadOnlyData == "on") {
+        entry->module->shareReadOnlyData();
     }
+    entry->user = msg.user();
+    entry->function = msg.function();
+    entry->moduleBytes = entry->module->getMemorySizeBytes() +
+                         getIRModuleCache().getCompiledModuleSize(
+                           msg.user(), msg.function(), "");
+    entry->lastUsed = getLruTimestamp();
+
+    auto newMap = std::make_shared<CachedWAVMModuleMap>(*cachedModuleMap);
+    newMap->emplace(key, entry);
+    publish(std::move(newMap));
+
+    evictToBudget(key);
+
+    return entry->module;
 }
 
 std::string WAVMModuleCache::registerResetSnapshot(wasm::WasmModule& module,
                                                    faabric::Message& msg)
 {
-    std::string snapKey = faabric::util::funcToString(msg, false) + "_reset";
+    std::string snapKey = getResetSnapshotKey(msg);
 
     faabric::snapshot::SnapshotRegistry& reg =
       faabric::snapshot::getSnapshotRegistry();
 
-    if (!reg.snapshotExists(snapKey)) {
-        faabric::util::FullLock lock(mx);
-        if (!reg.snapshotExists(snapKey)) {
-            reg.registerSnapshot(snapKey, module.getSnapshotData());
-        }
+    bool paged = conf::getFaasmConfig().snapshotPageDedup == "on";
+    PageStore& pageStore = getPageStore();
+    auto exists = [&] {
+        return paged ? pageStore.snapshotExists(snapKey)
+                     : reg.snapshotExists(snapKey);
+    };
+
+    if (exists()) {
+        return snapKey;
     }
 
-    {
-        faabric::util::SharedLock lock(mx);
+    // Make sure the function has an entry to account the snapshot against
+    getCachedModule(msg);
+
+    faabric::util::FullLock lock(mx);
+    if (exists()) {
         return snapKey;
     }
+
+    // The entry may have been evicted again in the meantime, in which case
+    // nothing would ever delete the snapshot
+    std::string key = getZygoteKey(msg);
+    auto it = cachedModuleMap->find(key);
+    if (it == cachedModuleMap->end()) {
+        SPDLOG_DEBUG("Not registering reset snapshot for evicted {}", key);
+        return "";
+    }
+
+    std::span<uint8_t> memView = module.getMemoryView();
+    if (paged) {
+        pageStore.registerSnapshot(snapKey, memView);
+    } else {
+        reg.registerSnapshot(snapKey, module.getSnapshotData());
+    }
+
+    // Paged snapshots may share most of their pages, but are still counted
+    // in full, as evicting one only frees the pages it doesn't share
+    it->second->snapshotBytes = memView.size();
+    evictToBudget(key);
+
+    return snapKey;
+}
+
+void WAVMModuleCache::evictToBudget(const std::string& keepKey)
+{
+    size_t budgetBytes =
+      ((size_t)conf::getFaasmConfig().moduleCacheBudgetMb) * 1024 * 1024;
+    if (budgetBytes == 0) {
+        return;
+    }
+
+    size_t totalBytes = 0;
+    for (const auto& [key, entry] : *cachedModuleMap) {
+        totalBytes += entry->residentBytes();
+    }
+
+    if (totalBytes <= budgetBytes) {
+        return;
+    }
+
+    faabric::snapshot::SnapshotRegistry& reg =
+      faabric::snapshot::getSnapshotRegistry();
+
+    auto newMap = std::make_shared<CachedWAVMModuleMap>(*cachedModuleMap);
+    while (totalBytes > budgetBytes) {
+        // Find the least recently used entry that nothing is using
+        auto victim = newMap->end();
+        for (auto it = newMap->begin(); it != newMap->end(); ++it) {
+            if (it->first == keepKey || it->second->inUse()) {
+                continue;
+            }
+
+            if (victim == newMap->end() ||
+                it->second->lastUsed < victim->second->lastUsed) {
+                victim = it;
+            }
+        }
+
+        if (victim == newMap->end()) {
+            SPDLOG_WARN("WAVM module cache over budget ({} > {} bytes) but all "
+                        "entries are in use",
+                        totalBytes,
+                        budgetBytes);
+            break;
+        }
+
+        const CachedWAVMModule& entry = *victim->second;
+        SPDLOG_DEBUG("WAVM module cache evicting {} ({} bytes)",
+                     victim->first,
+                     entry.residentBytes());
+
+        faabric::Message msg =
+          faabric::util::messageFactory(entry.user, entry.function);
+        std::string snapKey = getResetSnapshotKey(msg);
+        if (reg.snapshotExists(snapKey)) {
+            reg.deleteSnapshot(snapKey);
+        }
+        getPageStore().deleteSnapshot(snapKey);
+
+        totalBytes -= entry.residentBytes();
+
+        // Modules already bound from this zygote keep it alive, and the IR
+        // cache reloads evicted modules on demand
+        getIRModuleCache().evictMainModule(entry.user, entry.function);
+
+        newMap->erase(victim);
+    }
+
+    publish(std::move(newMap));
 }
 
 void WAVMModuleCache::clear()
 {
-    faabric::util::FullLock lock(mx);
-    cachedModuleMap.clear();
+    {
+        faabric::util::FullLock lock(mx);
+        publish(std::make_shared<const CachedWAVMModuleMap>());
+    }
+
+    // Flushes should leave nothing behind from the functions they flush
+    getCompartmentPoolFiller().drain();
+    getCompartmentReclaimer().drain();
 }
 }
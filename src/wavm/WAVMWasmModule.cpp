@@ -1,9 +1,13 @@
 #include "syscalls.h"
 
+#include <algorithm>
 #include <boost/filesystem.hpp>
+#include <cstring>
+#include <optional>
 #include <stdexcept>
 #include <sys/mman.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <faabric/scheduler/Scheduler.h>
 #include <faabric/util/bytes.h>
@@ -16,12 +20,17 @@
 #include <faabric/util/timing.h>
 
 #include <conf/FaasmConfig.h>
+#include <storage/FileDescriptor.h>
+#include <storage/FileLoader.h>
 #include <storage/SharedFiles.h>
 #include <threads/ThreadState.h>
 #include <wasm/WasmExecutionContext.h>
 #include <wasm/WasmModule.h>
+#include <wasm/openmp_profile.h>
 #include <wavm/IRModuleCache.h>
 #include <wavm/WAVMWasmModule.h>
+#include <wavm/prelink.h>
+#include <wavm/profiler.h>
 
 #include <Runtime/RuntimePrivate.h>
 #include <WASI/WASIPrivate.h>
@@ -32,6 +41,9 @@
 #include <WAVM/Runtime/Runtime.h>
 #include <WAVM/WASM/WASM.h>
 
+// Set in a module's host call state once its memory has been revoked
+#define HOST_CALLS_STOPPED (1u << 31)
+
 using namespace WAVM;
 
 namespace wasm {
@@ -86,10 +98,19 @@ void WAVMWasmModule::reset(faabric::Message& msg,
 
     std::string funcStr = faabric::util::funcToString(msg, true);
     SPDLOG_DEBUG("Resetting after {} (snap key {})", funcStr, snapshotKey);
-    auto [cachedModule, cacheLock] =
+
+    std::shared_ptr<WAVMWasmModule> cachedModule =
       wasm::getWAVMModuleCache().getCachedModule(msg);
 
-    clone(cachedModule, snapshotKey);
+    if (resetDirtyPages(*cachedModule, snapshotKey, msg)) {
+        return;
+    }
+
+    clone(*cachedModule, snapshotKey);
+    zygoteModule = cachedModule;
+    getCompartmentPoolFiller().requestFill(cachedModule);
+
+    armDirtyReset(snapshotKey);
 }
 
 // To keep API compatibility with WAMR we pass a generic std::exception, so in
@@ -156,9 +177,11 @@ void WAVMWasmModule::clone(const WAVMWasmModule& other,
                            const std::string& snapshotKey)
 {
     // If bound, we want to reclaim all the memory we've created _before_
-    // cloning from the zygote otherwise it's lost forever
+    // cloning from the zygote otherwise it's lost forever. Collecting it can
+    // happen in the background though, as nothing here refers to it again.
     if (_isBound) {
-        doWAVMGarbageCollection();
+        disarmDirtyReset();
+        doWAVMGarbageCollection(true);
     }
 
     if (!other._isBound) {
@@ -168,9 +191,14 @@ void WAVMWasmModule::clone(const WAVMWasmModule& other,
     _isBound = other._isBound;
     boundUser = other.boundUser;
     boundFunction = other.boundFunction;
+    boundZygoteKey = other.boundZygoteKey;
+    boundPythonUser = other.boundPythonUser;
+    boundPythonFunction = other.boundPythonFunction;
+    zygoteModule = other.zygoteModule;
 
     currentBrk.store(other.currentBrk.load(std::memory_order_acquire),
                      std::memory_order_release);
+    freeMemoryRegions = other.freeMemoryRegions;
 
     filesystem = other.filesystem;
 
@@ -180,36 +208,26 @@ void WAVMWasmModule::clone(const WAVMWasmModule& other,
     // each module will have its own thread pool
     threadPoolSize = other.threadPoolSize;
     threadStacks = other.threadStacks;
-    openMPContexts = std::vector<Runtime::Context*>(threadPoolSize, nullptr);
+    openMPContexts =
+      std::vector<Runtime::Context*>(getMaxThreadPoolSize(), nullptr);
+    pthreadContexts = std::vector<Runtime::Context*>(threadPoolSize, nullptr);
 
     // Do not copy over any captured stdout
-    stdoutMemFd = 0;
-    stdoutSize = 0;
+    capturedStdout.clear();
 
     if (other._isBound) {
         assert(other.compartment != nullptr);
 
-        // Clone compartment
-        if (snapshotKey.empty()) {
-            // Clone compartment with memory if no snapshot key provided
-            compartment = Runtime::cloneCompartment(other.compartment);
-        } else {
-            // Exclude memory if snapshot key provided
-            compartment =
-              Runtime::cloneCompartment(other.compartment, "", false);
-        }
-
-        // Clone context
-        executionContext =
-          Runtime::cloneContext(other.executionContext, compartment);
+        // Take a compartment cloned ahead of time if the zygote has one.
+        // Memory is only cloned with it if there's no snapshot to restore.
+        PreclonedCompartment precloned =
+          other.takePreclonedCompartment(snapshotKey.empty());
 
-        // Remap parts we need specific references to
-        envModule =
-          Runtime::remapToClonedCompartment(other.envModule, compartment);
-        wasiModule =
-          Runtime::remapToClonedCompartment(other.wasiModule, compartment);
-        moduleInstance =
-          Runtime::remapToClonedCompartment(other.moduleInstance, compartment);
+        compartment = std::move(precloned.compartment);
+        executionContext = std::move(precloned.executionContext);
+        envModule = std::move(precloned.envModule);
+        wasiModule = std::move(precloned.wasiModule);
+        moduleInstance = std::move(precloned.moduleInstance);
 
         // Extract the memory and table again
         defaultMemory = Runtime::getDefaultMemory(moduleInstance);
@@ -217,50 +235,468 @@ void WAVMWasmModule::clone(const WAVMWasmModule& other,
 
         // Restore from snapshot
         if (!snapshotKey.empty()) {
-            // Expand memory if necessary
-            auto data = reg.getSnapshot(snapshotKey);
-            setMemorySize(data->getSize());
+            mapResetSnapshot(snapshotKey);
+        }
+
+        // The cloned memory is a new mapping
+        adviseHugePages(0, getMemorySizeBytes());
 
-            // Map the snapshot into memory
-            uint8_t* memoryBase = getMemoryBase();
-            data->mapToMemory({ memoryBase, data->getSize() });
+        // Snapshots are already mapped from one copy, but cloned memory
+        // isn't, so swap in the shared copy of the read-only data
+        readOnlyData = other.readOnlyData;
+        if (snapshotKey.empty()) {
+            mapReadOnlyData();
         }
 
         // Reset shared memory variables
         sharedMemWasmPtrs = other.sharedMemWasmPtrs;
+        copyPinnedStateReplicas(other);
 
         // Remap dynamic modules
         lastLoadedDynamicModuleHandle = other.lastLoadedDynamicModuleHandle;
         dynamicPathToHandleMap = other.dynamicPathToHandleMap;
+        prelinkedLibraryMap = other.prelinkedLibraryMap;
 
         // Recreate map of dynamic modules
         dynamicModuleMap.clear();
         for (const auto& p : other.dynamicModuleMap) {
-            Runtime::Instance* newInstance =
-              Runtime::remapToClonedCompartment(p.second.ptr, compartment);
-
             dynamicModuleMap[p.first] = p.second;
-            dynamicModuleMap[p.first].ptr = newInstance;
+            dynamicModuleMap[p.first].ptr =
+              std::move(precloned.dynamicModules.at(p.first));
         }
 
         // Copy dynamic linking stuff
         globalOffsetTableMap = other.globalOffsetTableMap;
         globalOffsetMemoryMap = other.globalOffsetMemoryMap;
         missingGlobalOffsetEntries = other.missingGlobalOffsetEntries;
+
+        // Table indices are the same in the cloned table
+        dynamicSymbolCache = other.dynamicSymbolCache;
+    }
+}
+
+SharedReadOnlyData::~SharedReadOnlyData()
+{
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+void WAVMWasmModule::shareReadOnlyData()
+{
+    std::vector<std::pair<uint32_t, uint32_t>> ranges =
+      getIRModuleCache().getReadOnlyDataRanges(boundUser, boundFunction, "");
+
+    // Only whole pages can be mapped, and data that shares a page with
+    // writable data has to stay private
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    size_t memSize = getMemorySizeBytes();
+    auto shared = std::make_shared<SharedReadOnlyData>();
+    uint32_t fdSize = 0;
+    for (const auto& [start, end] : ranges) {
+        size_t alignedStart = ((start + pageSize - 1) / pageSize) * pageSize;
+        size_t alignedEnd =
+          (std::min<size_t>(end, memSize) / pageSize) * pageSize;
+        if (alignedEnd <= alignedStart) {
+            continue;
+        }
+
+        uint32_t length = alignedEnd - alignedStart;
+        shared->regions.push_back({ (uint32_t)alignedStart, fdSize, length });
+        fdSize += length;
+    }
+
+    if (shared->regions.empty()) {
+        return;
+    }
+
+    std::string fdName =
+      fmt::format("faasm-rodata-{}-{}", boundUser, boundFunction);
+    shared->fd = ::memfd_create(fdName.c_str(), MFD_CLOEXEC);
+    if (shared->fd < 0 || ::ftruncate(shared->fd, fdSize) != 0) {
+        SPDLOG_ERROR("Failed to create read-only data fd for {}/{}: {}",
+                     boundUser,
+                     boundFunction,
+                     std::strerror(errno));
+        return;
+    }
+
+    uint8_t* memoryBase = getMemoryBase();
+    for (const auto& r : shared->regions) {
+        ssize_t written =
+          ::pwrite(shared->fd, memoryBase + r.memOffset, r.length, r.fdOffset);
+        if (written != (ssize_t)r.length) {
+            SPDLOG_ERROR("Failed to write read-only data for {}/{}",
+                         boundUser,
+                         boundFunction);
+            return;
+        }
+    }
+
+    SPDLOG_DEBUG("Sharing {} bytes of read-only data for {}/{}",
+                 fdSize,
+                 boundUser,
+                 boundFunction);
+
+    // The zygote drops its own copy too
+    readOnlyData = shared;
+    mapReadOnlyData();
+}
+
+void WAVMWasmModule::mapReadOnlyData()
+{
+    if (readOnlyData == nullptr) {
+        return;
+    }
+
+    // Private mappings, so writes only ever land in this module's own copy
+    // of the page, as they would with any other memory
+    uint8_t* memoryBase = getMemoryBase();
+    for (const auto& r : readOnlyData->regions) {
+        void* res = ::mmap(memoryBase + r.memOffset,
+                           r.length,
+                           PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_FIXED,
+                           readOnlyData->fd,
+                           r.fdOffset);
+        if (res == MAP_FAILED) {
+            SPDLOG_ERROR("Failed to map read-only data at {}: {}",
+                         r.memOffset,
+                         std::strerror(errno));
+            throw std::runtime_error("Failed to map read-only data");
+        }
+    }
+}
+
+std::vector<std::pair<uint32_t, uint32_t>>
+WAVMWasmModule::getReadOnlyDataRegions()
+{
+    std::vector<std::pair<uint32_t, uint32_t>> regions;
+    if (readOnlyData != nullptr) {
+        for (const auto& r : readOnlyData->regions) {
+            regions.emplace_back(r.memOffset, r.memOffset + r.length);
+        }
+    }
+
+    return regions;
+}
+
+WAVMWasmModule::PreclonedCompartment WAVMWasmModule::precloneCompartment(
+  bool withMemory) const
+{
+    PreclonedCompartment p;
+    p.withMemory = withMemory;
+
+    p.compartment = Runtime::cloneCompartment(compartment, "", withMemory);
+    p.executionContext = Runtime::cloneContext(executionContext, p.compartment);
+
+    // Remap parts we need specific references to
+    p.envModule = Runtime::remapToClonedCompartment(envModule, p.compartment);
+    p.wasiModule = Runtime::remapToClonedCompartment(wasiModule, p.compartment);
+    p.moduleInstance =
+      Runtime::remapToClonedCompartment(moduleInstance, p.compartment);
+
+    for (const auto& d : dynamicModuleMap) {
+        p.dynamicModules[d.first] =
+          Runtime::remapToClonedCompartment(d.second.ptr, p.compartment);
+    }
+
+    return p;
+}
+
+WAVMWasmModule::PreclonedCompartment WAVMWasmModule::takePreclonedCompartment(
+  bool withMemory) const
+{
+    std::vector<PreclonedCompartment> stale;
+    std::optional<PreclonedCompartment> taken;
+    {
+        std::unique_lock<std::mutex> lock(compartmentPoolMx);
+
+        // The pool is refilled to match whatever resets last asked for
+        compartmentPoolWithMemory = withMemory;
+        while (!compartmentPool.empty() && !taken.has_value()) {
+            if (compartmentPool.front().withMemory == withMemory) {
+                taken = std::move(compartmentPool.front());
+            } else {
+                stale.emplace_back(std::move(compartmentPool.front()));
+            }
+            compartmentPool.pop_front();
+        }
+    }
+
+    for (auto& p : stale) {
+        releasePreclonedCompartment(p, true);
+    }
+
+    if (taken.has_value()) {
+        return std::move(*taken);
+    }
+
+    return precloneCompartment(withMemory);
+}
+
+void WAVMWasmModule::releasePreclonedCompartment(PreclonedCompartment& p,
+                                                 bool inBackground)
+{
+    for (auto& d : p.dynamicModules) {
+        d.second = nullptr;
+    }
+    p.dynamicModules.clear();
+
+    p.moduleInstance = nullptr;
+    p.envModule = nullptr;
+    p.wasiModule = nullptr;
+    p.executionContext = nullptr;
+
+    if (p.compartment == nullptr) {
+        return;
+    }
+
+    if (inBackground) {
+        getCompartmentReclaimer().reclaim(std::move(p.compartment));
+        p.compartment = nullptr;
+    } else if (!Runtime::tryCollectCompartment(std::move(p.compartment))) {
+        SPDLOG_ERROR("WAVM GC of pooled compartment failed");
+    }
+}
+
+void WAVMWasmModule::fillCompartmentPool()
+{
+    size_t poolSize = conf::getFaasmConfig().compartmentPoolSize;
+    while (true) {
+        bool withMemory;
+        {
+            std::unique_lock<std::mutex> lock(compartmentPoolMx);
+            if (compartmentPool.size() >= poolSize) {
+                return;
+            }
+            withMemory = compartmentPoolWithMemory;
+        }
+
+        // Clone without the lock, so resets can still take from the pool
+        PreclonedCompartment p = precloneCompartment(withMemory);
+
+        std::unique_lock<std::mutex> lock(compartmentPoolMx);
+        if (p.withMemory != compartmentPoolWithMemory) {
+            lock.unlock();
+            releasePreclonedCompartment(p, true);
+            continue;
+        }
+
+        compartmentPool.emplace_back(std::move(p));
+    }
+}
+
+size_t WAVMWasmModule::getCompartmentPoolCount()
+{
+    std::unique_lock<std::mutex> lock(compartmentPoolMx);
+    return compartmentPool.size();
+}
+
+void WAVMWasmModule::armDirtyReset(const std::string& snapshotKey)
+{
+    if (snapshotKey.empty() || conf::getFaasmConfig().resetMode != "dirty") {
+        return;
+    }
+
+    dirtyResetSnapshotKey = snapshotKey;
+    dirtyResetMemorySize = getMemorySizeBytes();
+    dirtyResetBrk = getCurrentBrk();
+
+    // Without tracking, the next reset clones as usual
+    std::span<uint8_t> memView(getMemoryBase(), dirtyResetMemorySize);
+    if (dirtyTracker.startTracking(memView)) {
+        dirtyResetArmed = true;
+    }
+}
+
+void WAVMWasmModule::disarmDirtyReset()
+{
+    if (dirtyResetArmed.exchange(false)) {
+        dirtyTracker.stopTracking();
+    }
+}
+
+void WAVMWasmModule::enterHostCall()
+{
+    uint32_t prev = hostCallState.fetch_add(1);
+    if ((prev & HOST_CALLS_STOPPED) != 0) {
+        // Memory has gone, so the guest can't carry on
+        hostCallState.fetch_sub(1);
+        Runtime::throwException(Runtime::ExceptionTypes::calledAbort);
+    }
+}
+
+void WAVMWasmModule::exitHostCall()
+{
+    uint32_t prev = hostCallState.fetch_sub(1);
+    if (prev == 1 && isExecutionInterrupted()) {
+        // We're on one of the guest's threads, which hold the reset lock
+        revokeMemoryAccess();
+    }
+}
+
+void WAVMWasmModule::doInterruptExecution()
+{
+    faabric::util::SharedLock lock(resetMx);
+    revokeMemoryAccess();
+}
+
+void WAVMWasmModule::revokeMemoryAccess()
+{
+    // Only once no host calls are running, otherwise the last to finish
+    // comes back here
+    uint32_t idle = 0;
+    if (!hostCallState.compare_exchange_strong(idle, HOST_CALLS_STOPPED)) {
+        return;
+    }
+
+    // Faults in linear memory already become WAVM traps, like out-of-bounds
+    // accesses into the guard pages
+    if (::mprotect(getMemoryBase(), getMemorySizeBytes(), PROT_NONE) != 0) {
+        SPDLOG_ERROR("Failed to revoke access to memory: {}",
+                     std::strerror(errno));
+    }
+}
+
+void WAVMWasmModule::doRecoverFromInterrupt()
+{
+    int res = ::mprotect(
+      getMemoryBase(), getMemorySizeBytes(), PROT_READ | PROT_WRITE);
+    if (res != 0) {
+        SPDLOG_ERROR("Failed to restore access to memory: {}",
+                     std::strerror(errno));
+        throw std::runtime_error("Failed to restore access to memory");
+    }
+
+    hostCallState.fetch_and(~HOST_CALLS_STOPPED);
+
+    // Restoring access also lifts any other protection in memory, so only
+    // a full reset can be trusted to undo it all
+    disarmDirtyReset();
+    protectThreadStacks();
+}
+
+void WAVMWasmModule::clearCallThreadState()
+{
+    clearOpenMPHotTeam();
+}
+
+bool WAVMWasmModule::resetDirtyPages(const WAVMWasmModule& zygote,
+                                     const std::string& snapshotKey,
+                                     faabric::Message& msg)
+{
+    if (!dirtyResetArmed.load()) {
+        return false;
+    }
+
+    // The snapshot only lines up with our memory if nothing has been grown,
+    // and globals are only copied from the zygote we were cloned from
+    if (snapshotKey != dirtyResetSnapshotKey ||
+        zygoteModule.get() != &zygote ||
+        getMemorySizeBytes() != dirtyResetMemorySize ||
+        getCurrentBrk() != dirtyResetBrk) {
+        SPDLOG_DEBUG("Falling back to full reset for {}/{}",
+                     boundUser,
+                     boundFunction);
+        return false;
+    }
+
+    PROF_START(dirtyReset)
+
+    std::span<uint8_t> memView(getMemoryBase(), dirtyResetMemorySize);
+    std::vector<char> dirtyPages = dirtyTracker.getDirtyPages();
+
+    // Copy the dirty pages back from the snapshot, anything past the end of
+    // the snapshot was zero when it was mapped in
+    std::shared_ptr<PagedSnapshot> paged =
+      getPageStore().getSnapshot(snapshotKey);
+    std::shared_ptr<faabric::util::SnapshotData> data = nullptr;
+    size_t snapSize;
+    if (paged != nullptr) {
+        snapSize = paged->getSize();
+    } else {
+        data = reg.getSnapshot(snapshotKey);
+        snapSize = data->getSize();
+    }
+
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    int nRestored = 0;
+    for (size_t i = 0; i < dirtyPages.size(); i++) {
+        if (dirtyPages.at(i) == 0) {
+            continue;
+        }
+
+        size_t offset = i * pageSize;
+        size_t len = std::min(pageSize, memView.size() - offset);
+        size_t fromSnap = offset < snapSize ? std::min(len, snapSize - offset)
+                                            : 0;
+
+        if (paged != nullptr) {
+            paged->copyTo(offset, memView.data() + offset, fromSnap);
+        } else {
+            std::memcpy(
+              memView.data() + offset, data->getDataPtr() + offset, fromSnap);
+        }
+        std::memset(memView.data() + offset + fromSnap, 0, len - fromSnap);
+        nRestored++;
     }
+
+    // Restoring the pages wrote to them too
+    dirtyTracker.restartTracking();
+
+    // Restore the non-memory state that clone would otherwise reset. Mutable
+    // globals (including the stack pointer) live in the context, and tables
+    // are only changed by dynamic linking, which disarms this path.
+    std::copy(std::begin(zygote.executionContext->runtimeData->mutableGlobals),
+              std::end(zygote.executionContext->runtimeData->mutableGlobals),
+              std::begin(executionContext->runtimeData->mutableGlobals));
+
+    filesystem = zygote.filesystem;
+    wasmEnvironment = zygote.wasmEnvironment;
+    sharedMemWasmPtrs = zygote.sharedMemWasmPtrs;
+    copyPinnedStateReplicas(zygote);
+    freeMemoryRegions = zygote.freeMemoryRegions;
+    capturedStdout.clear();
+
+    PROF_END(dirtyReset)
+
+    SPDLOG_DEBUG("Dirty reset of {}/{} restored {}/{} pages",
+                 boundUser,
+                 boundFunction,
+                 nRestored,
+                 dirtyPages.size());
+
+    (*msg.mutable_execgraphdetails())["dirty-pages"] =
+      std::to_string(nRestored);
+
+    return true;
 }
 
 WAVMWasmModule::~WAVMWasmModule()
 {
-    // Note - the only need for this destructor is to perform the WAVM-related
-    // GC, do not add anything else here.
+    // Note - the only need for this destructor is to stop dirty tracking and
+    // perform the WAVM-related GC, do not add anything else here. GC is done
+    // here rather than in the background, as modules held in statics can
+    // outlive the reclaimer.
+    disarmDirtyReset();
     doWAVMGarbageCollection();
 }
 
-void WAVMWasmModule::doWAVMGarbageCollection()
+void WAVMWasmModule::doWAVMGarbageCollection(bool inBackground)
 {
     SPDLOG_TRACE("Performing WAVM GC");
 
+    // Zygotes hold on to the compartments cloned from them ahead of time
+    std::deque<PreclonedCompartment> pooled;
+    {
+        std::unique_lock<std::mutex> lock(compartmentPoolMx);
+        pooled.swap(compartmentPool);
+    }
+    for (auto& p : pooled) {
+        releasePreclonedCompartment(p, inBackground);
+    }
+
     // To allow WAVM to perform GC, we need to ensure all of our own copies of
     // WAVM GCPointers have been set to nullptr, so that WAVM's own refcounts
     // will be zero. We can then call its GC method directly.
@@ -268,6 +704,8 @@ void WAVMWasmModule::doWAVMGarbageCollection()
         dynamicModuleMap[m.first].ptr = nullptr;
     }
     dynamicModuleMap.clear();
+    prelinkedLibraryMap.clear();
+    dynamicSymbolCache.clear();
 
     defaultMemory = nullptr;
     defaultTable = nullptr;
@@ -278,7 +716,10 @@ void WAVMWasmModule::doWAVMGarbageCollection()
 
     executionContext = nullptr;
 
-    if (compartment != nullptr) {
+    if (compartment != nullptr && inBackground) {
+        getCompartmentReclaimer().reclaim(std::move(compartment));
+        compartment = nullptr;
+    } else if (compartment != nullptr) {
         bool compartmentCleared =
           Runtime::tryCollectCompartment(std::move(compartment));
 
@@ -449,8 +890,18 @@ void WAVMWasmModule::doBindToFunctionInternal(faabric::Message& msg,
      */
     if (useCache) {
         wasm::WAVMModuleCache& cache = getWAVMModuleCache();
-        auto [cached, cacheLock] = cache.getCachedModule(msg);
-        clone(cached, "");
+        std::shared_ptr<WAVMWasmModule> cached = cache.getCachedModule(msg);
+
+        // The snapshot's memfd is mapped privately, so every module bound
+        // this way shares the zygote's pages until it writes to them
+        std::string snapshotKey;
+        if (conf::getFaasmConfig().sharedZygoteMemory == "on") {
+            snapshotKey = cache.registerResetSnapshot(*cached, msg);
+        }
+
+        clone(*cached, snapshotKey);
+        zygoteModule = cached;
+        getCompartmentPoolFiller().requestFill(cached);
         return;
     }
 
@@ -475,20 +926,26 @@ void WAVMWasmModule::doBindToFunctionInternal(faabric::Message& msg,
 
     // We have to set the current brk before executing any code
     currentBrk.store(getMemorySizeBytes(), std::memory_order_release);
+    freeMemoryRegions.clear();
+    adviseHugePages(0, getMemorySizeBytes());
 
-    // Set up thread stacks
-    createThreadStacks();
+    // Thread stacks are only provisioned once threads run
+    clearThreadStacks();
 
-    // Allocate a pool of OpenMP contexts
-    openMPContexts = std::vector<Runtime::Context*>(threadPoolSize, nullptr);
+    // Allocate pools of OpenMP and pthread contexts
+    openMPContexts =
+      std::vector<Runtime::Context*>(getMaxThreadPoolSize(), nullptr);
+    pthreadContexts = std::vector<Runtime::Context*>(threadPoolSize, nullptr);
 
     // Execute the wasm ctors function. This is a hook generated by the linker
     // that lets things set up the environment (e.g. handling preopened
     // file descriptors).
     executeWasmConstructorsFunction(moduleInstance);
 
-    // Get and execute zygote function
+    // Load the function's preloaded modules and execute its zygote function,
+    // so every module cloned from this one starts with them done
     if (executeZygote) {
+        preloadDynamicModules(msg);
         executeZygoteFunction();
     }
 
@@ -514,40 +971,35 @@ void WAVMWasmModule::doBindToFunctionInternal(faabric::Message& msg,
     PROF_END(wasmBind)
 }
 
-void WAVMWasmModule::writeStringArrayToMemory(
-  const std::vector<std::string>& strings,
-  U32 strPoitners,
-  U32 strBuffer) const
+void WAVMWasmModule::writeStringArrayToMemory(const StringArray& strings,
+                                              U32 strPointers,
+                                              U32 strBuffer) const
 {
-    // Iterate through values, putting them in memory
-    U32 strNextBuffer = strBuffer;
-    U32 strNextPointer = strPoitners;
-
-    for (const auto& thisStr : strings) {
-        // Write this string to the buffer
-        U8* nextBuffer = &Runtime::memoryRef<U8>(defaultMemory, strNextBuffer);
-        std::copy(thisStr.begin(), thisStr.end(), nextBuffer);
-
-        // Write the pointer
-        U32* nextPointer =
-          &Runtime::memoryRef<U32>(defaultMemory, strNextPointer);
-        *nextPointer = strNextBuffer;
-
-        // Move everything along , allowing space for a null terminator on the
-        // string
-        strNextBuffer += thisStr.size() + 1;
-        strNextPointer += sizeof(U32);
+    // Copy all the strings over in one go
+    U8* buffer = Runtime::memoryArrayPtr<U8>(
+      defaultMemory, strBuffer, strings.getBufferSize());
+    std::copy(strings.getBuffer(),
+              strings.getBuffer() + strings.getBufferSize(),
+              buffer);
+
+    // Point at where each one starts
+    U32* pointers = Runtime::memoryArrayPtr<U32>(
+      defaultMemory, strPointers, strings.getCount());
+    const std::vector<uint32_t>& offsets = strings.getOffsets();
+    for (size_t i = 0; i < offsets.size(); i++) {
+        pointers[i] = strBuffer + offsets.at(i);
     }
 }
 
 void WAVMWasmModule::writeArgvToMemory(U32 wasmArgvPointers, U32 wasmArgvBuffer)
 {
-    writeStringArrayToMemory(argv, wasmArgvPointers, wasmArgvBuffer);
+    writeStringArrayToMemory(argvArray, wasmArgvPointers, wasmArgvBuffer);
 }
 
 void WAVMWasmModule::writeWasmEnvToMemory(U32 envPointers, U32 envBuffer)
 {
-    writeStringArrayToMemory(wasmEnvironment.getVars(), envPointers, envBuffer);
+    writeStringArrayToMemory(
+      wasmEnvironment.getVarsArray(), envPointers, envBuffer);
 }
 
 Runtime::Instance* WAVMWasmModule::createModuleInstance(
@@ -727,6 +1179,7 @@ int WAVMWasmModule::dynamicLoadModule(const std::string& path,
     // This function is essentially dlopen. See the comments around the GOT
     // function for more detail on the dynamic linking approach.
     // It returns 0 on error, as does dlopen
+    disarmDirtyReset();
 
     // Return the handle if we've already loaded this module
     if (dynamicPathToHandleMap.count(path) > 0) {
@@ -742,6 +1195,22 @@ int WAVMWasmModule::dynamicLoadModule(const std::string& path,
         SPDLOG_DEBUG("Dynamic linking main module");
         return MAIN_MODULE_DYNLINK_HANDLE;
     }
+
+    // Note, must start handles at 2, otherwise dlopen can see it as an
+    // error
+    thisHandle = 2 + dynamicModuleMap.size() + prelinkedLibraryMap.size();
+
+    // Prelinked libraries are already part of the main module
+    int prelinkedIdx = getPrelinkedLibraryIndex(path);
+    if (prelinkedIdx >= 0) {
+        dynamicPathToHandleMap[path] = thisHandle;
+        prelinkedLibraryMap[thisHandle] = prelinkedIdx;
+
+        SPDLOG_DEBUG(
+          "Using prelinked module {} with handle {}", path, thisHandle);
+        return thisHandle;
+    }
+
     if (boost::filesystem::is_directory(path)) {
         SPDLOG_ERROR("Dynamic linking a directory {}", path);
         return 0;
@@ -751,9 +1220,6 @@ int WAVMWasmModule::dynamicLoadModule(const std::string& path,
         return 0;
     }
 
-    // Note, must start handles at 2, otherwise dlopen can see it as an
-    // error
-    thisHandle = 2 + dynamicModuleMap.size();
     dynamicPathToHandleMap[path] = thisHandle;
     std::string name = "handle_" + std::to_string(thisHandle);
 
@@ -771,6 +1237,46 @@ int WAVMWasmModule::dynamicLoadModule(const std::string& path,
     return thisHandle;
 }
 
+void WAVMWasmModule::preloadDynamicModules(const faabric::Message& msg)
+{
+    std::vector<std::string> preloads =
+      storage::getFileLoader().loadFunctionPreloads(msg);
+
+    for (const auto& path : preloads) {
+        // Use the same path dlopen would, so its calls get the cached handle
+        std::string realPath = storage::prependRuntimeRoot(path);
+        if (dynamicLoadModule(realPath, executionContext) == 0) {
+            SPDLOG_ERROR("Failed to preload {} for {}/{}",
+                         path,
+                         boundUser,
+                         boundFunction);
+            throw std::runtime_error("Failed to preload dynamic module");
+        }
+    }
+
+    if (!preloads.empty()) {
+        SPDLOG_DEBUG("Preloaded {} dynamic modules for {}/{}",
+                     preloads.size(),
+                     boundUser,
+                     boundFunction);
+    }
+}
+
+int WAVMWasmModule::getPrelinkedLibraryIndex(const std::string& path)
+{
+    IR::Module& module =
+      getIRModuleCache().getModule(boundUser, boundFunction, "");
+
+    std::vector<std::string> paths = getPrelinkedLibraryPaths(module);
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (storage::prependRuntimeRoot(paths[i]) == path) {
+            return (int)i;
+        }
+    }
+
+    return -1;
+}
+
 LoadedDynamicModule& WAVMWasmModule::getLastLoadedDynamicModule()
 {
     if (lastLoadedDynamicModuleHandle == 0) {
@@ -788,10 +1294,18 @@ LoadedDynamicModule& WAVMWasmModule::getLastLoadedDynamicModule()
 uint32_t WAVMWasmModule::getDynamicModuleFunction(int handle,
                                                   const std::string& funcName)
 {
-    // Note - we could do some caching in this function to make it more
-    // efficient on repeat calls, but it usually only gets called once per
-    // function (as the module will usually pass around the resulting function
-    // pointer).
+    // Repeat lookups (e.g. a module calling dlsym in a loop) get the table
+    // entry of the first one rather than growing the table again
+    auto& handleSymbols = dynamicSymbolCache[handle];
+    auto cached = handleSymbols.find(funcName);
+    if (cached != handleSymbols.end()) {
+        SPDLOG_TRACE(
+          "Resolved function {} to cached index {}", funcName, cached->second);
+        return cached->second;
+    }
+
+    // This grows the table, which a dirty reset would not undo
+    disarmDirtyReset();
 
     Runtime::Object* exportedFunc;
     if (handle == MAIN_MODULE_DYNLINK_HANDLE) {
@@ -807,6 +1321,11 @@ uint32_t WAVMWasmModule::getDynamicModuleFunction(int handle,
         if (exportedFunc == nullptr) {
             exportedFunc = getInstanceExport(wasiModule, funcName);
         }
+    } else if (prelinkedLibraryMap.contains(handle)) {
+        // Prelinked libraries' exports are renamed in the main module
+        exportedFunc = getInstanceExport(
+          moduleInstance,
+          getPrelinkedExportName(prelinkedLibraryMap.at(handle), funcName));
     } else {
         // Check the handle is valid
         if (dynamicModuleMap.count(handle) == 0) {
@@ -824,6 +1343,7 @@ uint32_t WAVMWasmModule::getDynamicModuleFunction(int handle,
     }
 
     Uptr tableIdx = addFunctionToTable(exportedFunc);
+    handleSymbols.emplace(funcName, tableIdx);
 
     SPDLOG_TRACE("Resolved function {} to index {}", funcName, tableIdx);
     return tableIdx;
@@ -897,13 +1417,19 @@ int32_t WAVMWasmModule::executeFunction(faabric::Message& msg)
         // Set up main args
         prepareArgcArgv(msg);
 
-        // Get the main entrypoint function
-        funcInstance = getMainFunction(moduleInstance);
-        funcType = IR::FunctionType({}, {});
+        // Batch handlers return the call's return value, rather than exiting
+        funcInstance = getBatchHandlerFunction(moduleInstance);
+        if (funcInstance != nullptr) {
+            funcType = IR::FunctionType({ IR::ValueType::i32 }, {});
+        } else {
+            funcInstance = getMainFunction(moduleInstance);
+            funcType = IR::FunctionType({}, {});
+        }
     }
 
     // Call the function
     WasmExecutionContext ctx(this);
+    WasmSamplingProfiler profiler(*this, msg);
     int returnValue = 0;
     try {
         Runtime::catchRuntimeExceptions(
@@ -938,26 +1464,47 @@ int32_t WAVMWasmModule::executePthread(int threadPoolIdx,
     faabric::util::SharedLock lock(resetMx);
     std::string funcStr = faabric::util::funcToString(msg, false);
 
+    // Threads track dirty pages in this memory themselves when diffing
+    // snapshots, so can't share it with a dirty reset
+    disarmDirtyReset();
+
     SPDLOG_DEBUG(
       "WAVM module executing pthread {} for {}", threadPoolIdx, funcStr);
 
     Runtime::Function* funcInstance = getFunctionFromPtr(msg.funcptr());
 
-    int argsPtr = std::stoi(msg.inputdata());
+    int32_t argsPtr = threads::getPthreadArgsPtr(msg);
     std::vector<IR::UntaggedValue> invokeArgs = { argsPtr };
 
-    Runtime::ContextRuntimeData* contextRuntimeData =
-      getContextRuntimeData(executionContext);
-
-    // Set up the context
-    Runtime::Context* threadContext =
-      createThreadContext(stackTop, contextRuntimeData);
+    // Contexts are reused by every pthread this thread runs, starting each
+    // at the top of its stack
+    Runtime::Context* threadContext = pthreadContexts.at(threadPoolIdx);
+    if (threadContext == nullptr) {
+        Runtime::ContextRuntimeData* contextRuntimeData =
+          getContextRuntimeData(executionContext);
+        threadContext = createThreadContext(stackTop, contextRuntimeData);
+        pthreadContexts.at(threadPoolIdx) = threadContext;
+    } else {
+        threadContext->runtimeData->mutableGlobals[0] = stackTop;
+    }
 
     // Execute the function
+    WasmSamplingProfiler profiler(*this, msg);
     IR::UntaggedValue returnValue;
     executeWasmFunction(threadContext, funcInstance, invokeArgs, returnValue);
     msg.set_returnvalue(returnValue.i32);
 
+    // Destructors of the thread's pthread keys run in its context
+    runPthreadKeyDestructors(
+      [this, threadContext](int32_t func, int32_t value) {
+          std::vector<IR::UntaggedValue> destructorArgs = { value };
+          IR::UntaggedValue destructorResult;
+          executeWasmFunction(threadContext,
+                              getFunctionFromPtr(func),
+                              destructorArgs,
+                              destructorResult);
+      });
+
     return returnValue.i32;
 }
 
@@ -968,6 +1515,9 @@ int32_t WAVMWasmModule::executeOMPThread(int threadPoolIdx,
     faabric::util::SharedLock lock(resetMx);
     Runtime::Function* funcInstance = getFunctionFromPtr(msg.funcptr());
 
+    // See executePthread
+    disarmDirtyReset();
+
     std::string funcStr = faabric::util::funcToString(msg, false);
     SPDLOG_DEBUG("Executing OpenMP thread {} for {}", threadPoolIdx, funcStr);
 
@@ -993,36 +1543,80 @@ int32_t WAVMWasmModule::executeOMPThread(int threadPoolIdx,
     Runtime::Context* ctx = openMPContexts.at(threadPoolIdx);
 
     // Execute the wasm function
+    WasmSamplingProfiler profiler(*this, msg);
     IR::UntaggedValue returnValue;
-    executeWasmFunction(ctx, funcInstance, invokeArgs, returnValue);
+    {
+        OpenMPProfileTimer regionTimer(OpenMPProfileEvent::Region,
+                                       OpenMPProfileEvent::Region);
+        executeWasmFunction(ctx, funcInstance, invokeArgs, returnValue);
+        finishOpenMPTasks(ctx);
+    }
     msg.set_returnvalue(returnValue.i32);
 
     return returnValue.i32;
 }
 
-U32 WAVMWasmModule::mmapFile(U32 fd, size_t length)
+threads::LocalThreadPool& WAVMWasmModule::getOpenMPThreadPool()
 {
-    // Create a new memory region
-    U32 wasmPtr = mmapMemory(length);
-    U32* targetPtr = &Runtime::memoryRef<U32>(defaultMemory, wasmPtr);
-
-    // Unmap and remap the memory
-    munmap(targetPtr, length);
-    U32* mmappedPtr =
-      (U32*)mmap(targetPtr, length, PROT_READ, MAP_SHARED, fd, 0);
-    if (mmappedPtr == MAP_FAILED) {
-        SPDLOG_ERROR("Failed mmapping file descriptor {} ({} - {})",
-                     fd,
-                     errno,
-                     strerror(errno));
-        throw std::runtime_error("Unable to map file");
+    faabric::util::UniqueLock lock(openMPThreadPoolMx);
+    if (openMPThreadPool == nullptr) {
+        // The calling thread runs the first team member itself. Workers are
+        // only started as teams need them, so this is just an upper bound.
+        int nWorkers = std::max<int>(getMaxThreadPoolSize(), 1) - 1;
+        openMPThreadPool = std::make_unique<threads::LocalThreadPool>(nWorkers);
     }
 
-    if (mmappedPtr != targetPtr) {
-        throw std::runtime_error("Unable to map file into required location");
-    }
+    return *openMPThreadPool;
+}
+
+U32 WAVMWasmModule::mmapFile(U32 fd,
+                             size_t length,
+                             int prot,
+                             int flags,
+                             uint64_t offset)
+{
+    // A dirty reset would copy snapshot pages over the mapping
+    disarmDirtyReset();
+
+    return WasmModule::mmapFile(fd, length, prot, flags, offset);
+}
+
+uint32_t WAVMWasmModule::mapReadOnlyBytes(const std::string& data)
+{
+    // A dirty reset would fault writing snapshot pages over read-only ones
+    disarmDirtyReset();
+
+    return WasmModule::mapReadOnlyBytes(data);
+}
+
+uint32_t WAVMWasmModule::mapReadOnlyState(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+  size_t offset,
+  uint32_t length)
+{
+    // As for read-only bytes, and the pages are shared with the state too
+    disarmDirtyReset();
 
-    return wasmPtr;
+    return WasmModule::mapReadOnlyState(kv, offset, length);
+}
+
+void WAVMWasmModule::mapSharedStateMemoryAt(
+  const std::shared_ptr<faabric::state::StateKeyValue>& kv,
+  uint32_t wasmOffset,
+  size_t nBytes)
+{
+    // As for files, a dirty reset would write through to the shared state
+    disarmDirtyReset();
+
+    WasmModule::mapSharedStateMemoryAt(kv, wasmOffset, nBytes);
+}
+
+void WAVMWasmModule::reclaimMemory(uint32_t offset, size_t nBytes)
+{
+    // Reclaimed pages are replaced by a fresh mapping the tracker can't see
+    disarmDirtyReset();
+
+    WasmModule::reclaimMemory(offset, nBytes);
 }
 
 bool WAVMWasmModule::doGrowMemory(uint32_t pageChange)
@@ -1163,8 +1757,9 @@ bool WAVMWasmModule::resolve(const std::string& moduleName,
             int tableIdx = -1;
 
             // See if it's already in the GOT
-            if (globalOffsetTableMap.count(name) > 0) {
-                tableIdx = globalOffsetTableMap[name];
+            auto gotEntry = globalOffsetTableMap.find(name);
+            if (gotEntry != globalOffsetTableMap.end()) {
+                tableIdx = gotEntry->second;
                 SPDLOG_TRACE(
                   "Resolved {}.{} to offset {}", moduleName, name, tableIdx);
             }
@@ -1359,12 +1954,13 @@ int WAVMWasmModule::getNextTableBase()
 
 int WAVMWasmModule::getFunctionOffsetFromGOT(const std::string& funcName)
 {
-    if (globalOffsetTableMap.count(funcName) == 0) {
+    auto gotEntry = globalOffsetTableMap.find(funcName);
+    if (gotEntry == globalOffsetTableMap.end()) {
         SPDLOG_ERROR("Function not found in GOT - {}", funcName);
         throw std::runtime_error("Function not found in GOT");
     }
 
-    return globalOffsetTableMap[funcName];
+    return gotEntry->second;
 }
 
 int WAVMWasmModule::getDataOffsetFromGOT(const std::string& name)
@@ -1413,6 +2009,17 @@ Runtime::Function* WAVMWasmModule::getMainFunction(Runtime::Instance* module)
     return getFunction(module, mainFuncName, true);
 }
 
+Runtime::Function* WAVMWasmModule::getBatchHandlerFunction(
+  Runtime::Instance* module)
+{
+    return getFunction(module, BATCH_HANDLER_FUNC_NAME, false);
+}
+
+bool WAVMWasmModule::hasBatchHandler()
+{
+    return _isBound && getBatchHandlerFunction(moduleInstance) != nullptr;
+}
+
 Runtime::Function* WAVMWasmModule::getWasmConstructorsFunction(
   Runtime::Instance* module)
 {
@@ -6,11 +6,16 @@
 #include <faabric/util/bytes.h>
 #include <faabric/util/logging.h>
 
+#include <wasm/call_metrics.h>
 #include <wasm/chaining.h>
+#include <wasm/chaining_dag.h>
 
 #include <WAVM/Runtime/Intrinsics.h>
 #include <WAVM/Runtime/Runtime.h>
 
+#include <algorithm>
+#include <stdexcept>
+
 using namespace WAVM;
 using namespace faabric::scheduler;
 
@@ -23,6 +28,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                __faasm_await_call,
                                U32 messageId)
 {
+    HOST_CALL(Chaining);
     SPDLOG_DEBUG("S - await_call - {}", messageId);
 
     return awaitChainedCall(messageId);
@@ -36,6 +42,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 bufferPtr,
                                I32 bufferLen)
 {
+    HOST_CALL(Chaining);
 
     SPDLOG_DEBUG(
       "S - await_call_output - {} {} {}", messageId, bufferPtr, bufferLen);
@@ -46,6 +53,54 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     return awaitChainedCallOutput(messageId, buffer, bufferLen);
 }
 
+// Reads the next chunk of the output as the callee appends it
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_read_call_output",
+                               I32,
+                               __faasm_read_call_output,
+                               U32 messageId,
+                               I32 bufferPtr,
+                               I32 bufferLen)
+{
+    HOST_CALL(Chaining);
+    SPDLOG_DEBUG(
+      "S - read_call_output - {} {} {}", messageId, bufferPtr, bufferLen);
+
+    U8* buffer =
+      Runtime::memoryArrayPtr<U8>(getExecutingWAVMModule()->defaultMemory,
+                                  (Uptr)bufferPtr,
+                                  (Uptr)bufferLen);
+
+    return readChainedCallOutput(messageId, buffer, bufferLen);
+}
+
+// Puts the output in new memory, writing where it is and how long it is
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_await_call_output_mapped",
+                               I32,
+                               __faasm_await_call_output_mapped,
+                               U32 messageId,
+                               I32 outputPtrPtr,
+                               I32 outputLenPtr)
+{
+    HOST_CALL(Chaining);
+    SPDLOG_DEBUG("S - await_call_output_mapped - {} {} {}",
+                 messageId,
+                 outputPtrPtr,
+                 outputLenPtr);
+
+    uint32_t outputPtr = 0;
+    uint32_t outputLen = 0;
+    int returnValue =
+      awaitChainedCallOutputMapped(messageId, &outputPtr, &outputLen);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    Runtime::memoryRef<U32>(memoryPtr, outputPtrPtr) = outputPtr;
+    Runtime::memoryRef<U32>(memoryPtr, outputLenPtr) = outputLen;
+
+    return returnValue;
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "__faasm_chain_name",
                                U32,
@@ -54,6 +109,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 inputDataPtr,
                                I32 inputDataLen)
 {
+    HOST_CALL(Chaining);
     std::string funcName = getStringFromWasm(namePtr);
     SPDLOG_DEBUG("S - chain_name - {} ({}) {} {}",
                  funcName,
@@ -76,6 +132,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 inputDataPtr,
                                I32 inputDataLen)
 {
+    HOST_CALL(Chaining);
     SPDLOG_DEBUG(
       "S - chain_ptr - {} {} {}", wasmFuncPtr, inputDataPtr, inputDataLen);
 
@@ -86,6 +143,301 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     return makeChainedCall(call->function(), wasmFuncPtr, nullptr, inputData);
 }
 
+// The affinity variants take an array of the state keys the callee will use,
+// so it can be sent to where they are
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_chain_name_affinity",
+                               U32,
+                               __faasm_chain_name_affinity,
+                               I32 namePtr,
+                               I32 inputDataPtr,
+                               I32 inputDataLen,
+                               I32 keysPtr,
+                               I32 nKeys)
+{
+    HOST_CALL(Chaining);
+    std::string funcName = getStringFromWasm(namePtr);
+    SPDLOG_DEBUG("S - chain_name_affinity - {} {} {} {} {}",
+                 funcName,
+                 inputDataPtr,
+                 inputDataLen,
+                 keysPtr,
+                 nKeys);
+
+    const std::vector<uint8_t> inputData =
+      getBytesFromWasm(inputDataPtr, inputDataLen);
+    std::vector<std::string> keys = getStateKeysFromWasm(keysPtr, nKeys);
+
+    return makeChainedCall(funcName, 0, nullptr, inputData, keys);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_chain_ptr_affinity",
+                               U32,
+                               __faasm_chain_ptr_affinity,
+                               I32 wasmFuncPtr,
+                               I32 inputDataPtr,
+                               I32 inputDataLen,
+                               I32 keysPtr,
+                               I32 nKeys)
+{
+    HOST_CALL(Chaining);
+    SPDLOG_DEBUG("S - chain_ptr_affinity - {} {} {} {} {}",
+                 wasmFuncPtr,
+                 inputDataPtr,
+                 inputDataLen,
+                 keysPtr,
+                 nKeys);
+
+    faabric::Message* call = &ExecutorContext::get()->getMsg();
+    const std::vector<uint8_t> inputData =
+      getBytesFromWasm(inputDataPtr, inputDataLen);
+    std::vector<std::string> keys = getStateKeysFromWasm(keysPtr, nKeys);
+
+    return makeChainedCall(
+      call->function(), wasmFuncPtr, nullptr, inputData, keys);
+}
+
+// The state variants take a state key, offset and length in place of the
+// input, which the callee reads from state itself
+static I32 chainWithStateInput(const std::string& funcName,
+                               I32 wasmFuncPtr,
+                               I32 keyPtr,
+                               I32 offset,
+                               I32 length)
+{
+    if (offset < 0 || length < 0) {
+        SPDLOG_ERROR("Invalid chained call state input {} {}", offset, length);
+        throw std::runtime_error("Invalid chained call state input");
+    }
+
+    std::string key = getStringFromWasm(keyPtr);
+    return makeChainedCallWithStateInput(
+      funcName, wasmFuncPtr, key, offset, length);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_chain_name_state",
+                               U32,
+                               __faasm_chain_name_state,
+                               I32 namePtr,
+                               I32 keyPtr,
+                               I32 offset,
+                               I32 length)
+{
+    HOST_CALL(Chaining);
+    std::string funcName = getStringFromWasm(namePtr);
+    SPDLOG_DEBUG("S - chain_name_state - {} {} {} {}",
+                 funcName,
+                 keyPtr,
+                 offset,
+                 length);
+
+    return chainWithStateInput(funcName, 0, keyPtr, offset, length);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_chain_ptr_state",
+                               U32,
+                               __faasm_chain_ptr_state,
+                               I32 wasmFuncPtr,
+                               I32 keyPtr,
+                               I32 offset,
+                               I32 length)
+{
+    HOST_CALL(Chaining);
+    SPDLOG_DEBUG("S - chain_ptr_state - {} {} {} {}",
+                 wasmFuncPtr,
+                 keyPtr,
+                 offset,
+                 length);
+
+    faabric::Message* call = &ExecutorContext::get()->getMsg();
+    return chainWithStateInput(
+      call->function(), wasmFuncPtr, keyPtr, offset, length);
+}
+
+// The batch variants chain one call per input, taking arrays of pointers to
+// the inputs and their lengths, and write the call IDs to another array. They
+// return the number of calls chained.
+static std::vector<std::vector<uint8_t>> getChainInputsFromWasm(I32 inputsPtr,
+                                                                I32 lensPtr,
+                                                                I32 nInputs)
+{
+    if (nInputs < 0) {
+        SPDLOG_ERROR("Invalid number of chained call inputs {}", nInputs);
+        throw std::runtime_error("Invalid number of chained call inputs");
+    }
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    I32* inputPtrs =
+      Runtime::memoryArrayPtr<I32>(memoryPtr, (Uptr)inputsPtr, (Uptr)nInputs);
+    I32* inputLens =
+      Runtime::memoryArrayPtr<I32>(memoryPtr, (Uptr)lensPtr, (Uptr)nInputs);
+
+    std::vector<std::vector<uint8_t>> inputs;
+    for (int i = 0; i < nInputs; i++) {
+        inputs.emplace_back(getBytesFromWasm(inputPtrs[i], inputLens[i]));
+    }
+
+    return inputs;
+}
+
+static I32 writeCallIdsToWasm(const std::vector<int>& callIds, I32 callIdsPtr)
+{
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    I32* callIdsOut = Runtime::memoryArrayPtr<I32>(
+      memoryPtr, (Uptr)callIdsPtr, (Uptr)callIds.size());
+    std::copy(callIds.begin(), callIds.end(), callIdsOut);
+
+    return (I32)callIds.size();
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_chain_name_batch",
+                               I32,
+                               __faasm_chain_name_batch,
+                               I32 namePtr,
+                               I32 inputsPtr,
+                               I32 lensPtr,
+                               I32 nInputs,
+                               I32 callIdsPtr)
+{
+    HOST_CALL(Chaining);
+    std::string funcName = getStringFromWasm(namePtr);
+    SPDLOG_DEBUG("S - chain_name_batch - {} {} {} {} {}",
+                 funcName,
+                 inputsPtr,
+                 lensPtr,
+                 nInputs,
+                 callIdsPtr);
+
+    std::vector<std::vector<uint8_t>> inputs =
+      getChainInputsFromWasm(inputsPtr, lensPtr, nInputs);
+    std::vector<int> callIds = makeChainedCalls(funcName, 0, nullptr, inputs);
+
+    return writeCallIdsToWasm(callIds, callIdsPtr);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_chain_ptr_batch",
+                               I32,
+                               __faasm_chain_ptr_batch,
+                               I32 wasmFuncPtr,
+                               I32 inputsPtr,
+                               I32 lensPtr,
+                               I32 nInputs,
+                               I32 callIdsPtr)
+{
+    HOST_CALL(Chaining);
+    SPDLOG_DEBUG("S - chain_ptr_batch - {} {} {} {} {}",
+                 wasmFuncPtr,
+                 inputsPtr,
+                 lensPtr,
+                 nInputs,
+                 callIdsPtr);
+
+    faabric::Message* call = &ExecutorContext::get()->getMsg();
+    std::vector<std::vector<uint8_t>> inputs =
+      getChainInputsFromWasm(inputsPtr, lensPtr, nInputs);
+    std::vector<int> callIds =
+      makeChainedCalls(call->function(), wasmFuncPtr, nullptr, inputs);
+
+    return writeCallIdsToWasm(callIds, callIdsPtr);
+}
+
+// Takes arrays of pointers to the nodes' function names, their inputs and
+// lengths, and an array of pairs of node indices for the edges. Returns the
+// number of calls chained, or -1 if the graph isn't valid.
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_chain_dag",
+                               I32,
+                               __faasm_chain_dag,
+                               I32 namesPtr,
+                               I32 inputsPtr,
+                               I32 lensPtr,
+                               I32 nNodes,
+                               I32 edgesPtr,
+                               I32 nEdges,
+                               I32 callIdsPtr)
+{
+    HOST_CALL(Chaining);
+    SPDLOG_DEBUG("S - chain_dag - {} {} {} {} {} {} {}",
+                 namesPtr,
+                 inputsPtr,
+                 lensPtr,
+                 nNodes,
+                 edgesPtr,
+                 nEdges,
+                 callIdsPtr);
+
+    if (nEdges < 0) {
+        SPDLOG_ERROR("Invalid number of chained call graph edges {}", nEdges);
+        return -1;
+    }
+
+    std::vector<std::vector<uint8_t>> inputs =
+      getChainInputsFromWasm(inputsPtr, lensPtr, nNodes);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    I32* namePtrs =
+      Runtime::memoryArrayPtr<I32>(memoryPtr, (Uptr)namesPtr, (Uptr)nNodes);
+    I32* edgeNodes =
+      Runtime::memoryArrayPtr<I32>(memoryPtr, (Uptr)edgesPtr, 2 * (Uptr)nEdges);
+
+    std::vector<ChainedDagNode> nodes;
+    for (int i = 0; i < nNodes; i++) {
+        nodes.push_back({ getStringFromWasm(namePtrs[i]), inputs.at(i) });
+    }
+
+    std::vector<ChainedDagEdge> edges;
+    for (int i = 0; i < nEdges; i++) {
+        edges.emplace_back(edgeNodes[2 * i], edgeNodes[2 * i + 1]);
+    }
+
+    std::vector<int> callIds;
+    try {
+        callIds = makeChainedDag(nodes, edges);
+    } catch (std::runtime_error& e) {
+        SPDLOG_ERROR("Failed to chain call graph: {}", e.what());
+        return -1;
+    }
+
+    return writeCallIdsToWasm(callIds, callIdsPtr);
+}
+
+// Writes each call's return value to the matching entry of the results array,
+// and returns how many didn't return zero
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_await_all",
+                               I32,
+                               __faasm_await_all,
+                               I32 callIdsPtr,
+                               I32 nCalls,
+                               I32 resultsPtr)
+{
+    HOST_CALL(Chaining);
+    SPDLOG_DEBUG("S - await_all - {} {} {}", callIdsPtr, nCalls, resultsPtr);
+
+    if (nCalls < 0) {
+        SPDLOG_ERROR("Invalid number of calls to await {}", nCalls);
+        throw std::runtime_error("Invalid number of calls to await");
+    }
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    U32* callIdsIn =
+      Runtime::memoryArrayPtr<U32>(memoryPtr, (Uptr)callIdsPtr, (Uptr)nCalls);
+    I32* resultsOut =
+      Runtime::memoryArrayPtr<I32>(memoryPtr, (Uptr)resultsPtr, (Uptr)nCalls);
+
+    std::vector<unsigned int> callIds(callIdsIn, callIdsIn + nCalls);
+    std::vector<int> results;
+    int nFailed = awaitChainedCalls(callIds, results);
+    std::copy(results.begin(), results.end(), resultsOut);
+
+    return nFailed;
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "__faasm_chain_py",
                                U32,
@@ -94,6 +446,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 inputDataPtr,
                                I32 inputDataLen)
 {
+    HOST_CALL(Chaining);
     const std::string pyFuncName = getStringFromWasm(namePtr);
     SPDLOG_DEBUG(
       "S - chain_py - {} {} {}", pyFuncName, inputDataPtr, inputDataLen);
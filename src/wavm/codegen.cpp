@@ -1,7 +1,10 @@
 #include "WAVMWasmModule.h"
 
+#include <conf/FaasmConfig.h>
+
 #include <WAVM/IR/Module.h>
 #include <WAVM/IR/Types.h>
+#include <WAVM/LLVMJIT/LLVMJIT.h>
 #include <WAVM/Runtime/Runtime.h>
 #include <WAVM/WASM/WASM.h>
 #include <WAVM/WASTParse/WASTParse.h>
@@ -9,18 +12,34 @@
 #include <faabric/util/files.h>
 #include <faabric/util/logging.h>
 
+#include <sstream>
+
+#if defined(__aarch64__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
 using namespace WAVM;
 
 namespace wasm {
-std::vector<uint8_t> wavmCodegen(std::vector<uint8_t>& bytes)
+void setWavmFeatureSpec(IR::FeatureSpec& featureSpec)
+{
+    featureSpec.simd = true;
+    featureSpec.extendedNameSection = true;
+    featureSpec.nonTrappingFloatToInt = true;
+
+    // Lets memcpy and memset compile to memory.copy and memory.fill, rather
+    // than byte loops in wasm
+    featureSpec.bulkMemoryOps = true;
+}
+
+std::vector<uint8_t> wavmCodegen(std::vector<uint8_t>& bytes,
+                                 const std::string& targetCpu)
 {
 
     IR::Module moduleIR;
 
-    // Feature flags
-    moduleIR.featureSpec.simd = true;
-    moduleIR.featureSpec.extendedNameSection = true;
-    moduleIR.featureSpec.nonTrappingFloatToInt = true;
+    setWavmFeatureSpec(moduleIR.featureSpec);
 
     if (faabric::util::isWasm(bytes)) {
         // Handle WASM
@@ -43,8 +62,88 @@ std::vector<uint8_t> wavmCodegen(std::vector<uint8_t>& bytes)
     }
 
     // Compile the module to object code
-    Runtime::ModuleRef module = Runtime::compileModule(moduleIR);
-    std::vector<uint8_t> objBytes = Runtime::getObjectCode(module);
+    if (targetCpu.empty()) {
+        Runtime::ModuleRef module = Runtime::compileModule(moduleIR);
+        std::vector<uint8_t> objBytes = Runtime::getObjectCode(module);
+        return objBytes;
+    }
+
+    LLVMJIT::TargetSpec targetSpec = LLVMJIT::getHostTargetSpec();
+    targetSpec.cpu = targetCpu;
+    if (LLVMJIT::validateTarget(targetSpec, moduleIR.featureSpec) !=
+        LLVMJIT::TargetValidationResult::valid) {
+        SPDLOG_ERROR("Invalid codegen target {} ({})",
+                     targetCpu,
+                     targetSpec.triple);
+        throw std::runtime_error("Invalid codegen target");
+    }
+
+    std::vector<uint8_t> objBytes;
+    if (!LLVMJIT::compileModule(moduleIR, targetSpec, objBytes)) {
+        SPDLOG_ERROR("Failed to generate machine code for {}", targetCpu);
+        throw std::runtime_error("Failed to generate machine code");
+    }
+
     return objBytes;
 }
+
+std::vector<std::string> getCodegenTargets()
+{
+    std::vector<std::string> targets;
+    std::istringstream in(conf::getFaasmConfig().codegenTargets);
+    std::string target;
+    while (std::getline(in, target, ',')) {
+        if (!target.empty()) {
+            targets.push_back(target);
+        }
+    }
+
+    return targets;
+}
+
+bool isCodegenTargetSupported(const std::string& targetCpu)
+{
+#if defined(__x86_64__)
+    bool v2 = __builtin_cpu_supports("sse4.2") &&
+              __builtin_cpu_supports("popcnt") &&
+              __builtin_cpu_supports("ssse3");
+    bool v3 = v2 && __builtin_cpu_supports("avx2") &&
+              __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("fma");
+    bool v4 = v3 && __builtin_cpu_supports("avx512f") &&
+              __builtin_cpu_supports("avx512bw") &&
+              __builtin_cpu_supports("avx512cd") &&
+              __builtin_cpu_supports("avx512dq") &&
+              __builtin_cpu_supports("avx512vl");
+
+    if (targetCpu == "x86-64") {
+        return true;
+    }
+    if (targetCpu == "x86-64-v2") {
+        return v2;
+    }
+    if (targetCpu == "x86-64-v3") {
+        return v3;
+    }
+    if (targetCpu == "x86-64-v4") {
+        return v4;
+    }
+#elif defined(__aarch64__)
+    unsigned long hwcap = getauxval(AT_HWCAP);
+    bool n1 = (hwcap & HWCAP_ATOMICS) && (hwcap & HWCAP_ASIMDDP) &&
+              (hwcap & HWCAP_FPHP);
+    bool v1 = n1 && (hwcap & HWCAP_SVE);
+
+    if (targetCpu == "generic") {
+        return true;
+    }
+    if (targetCpu == "neoverse-n1") {
+        return n1;
+    }
+    if (targetCpu == "neoverse-v1") {
+        return v1;
+    }
+#endif
+
+    return false;
+}
 }
@@ -11,6 +11,7 @@
 #include <WAVM/Runtime/Runtime.h>
 
 #include <wasm/WasmModule.h>
+#include <wasm/call_metrics.h>
 
 using namespace WAVM;
 
@@ -39,6 +40,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 fileNamePtr,
                                I32 flags)
 {
+    HOST_CALL(Other);
     Runtime::Context* context =
       Runtime::getContextFromRuntimeData(contextRuntimeData);
 
@@ -63,6 +65,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 handle,
                                I32 symbolPtr)
 {
+    HOST_CALL(Other);
     const std::string symbol = getStringFromWasm(symbolPtr);
     SPDLOG_DEBUG("S - dlsym - {} {}", handle, symbol);
 
@@ -74,6 +77,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "dlerror", I32, dlerror)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - dlerror");
     std::string errorMessage("Wasm dynamic linking error. See logs");
 
@@ -89,6 +93,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env, "dlerror", I32, dlerror)
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "dlclose", I32, dlclose, I32 handle)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - _dlclose {}", handle);
 
     // Ignore
@@ -163,6 +168,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 retPtr,
                                I32 argsPtrPtr)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - ffi_call {} {} {} {}", cifPtr, fnPtr, retPtr, argsPtrPtr);
 
     // Extract the function
@@ -248,6 +254,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 d,
                                I32 e)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - ffi_prep_closure_loc {} {} {} {} {}", a, b, c, d, e);
 
     // Ignore
@@ -7,6 +7,7 @@
 #include <faabric/util/macros.h>
 
 #include <wasm/WasmModule.h>
+#include <wasm/call_metrics.h>
 
 #include <sys/random.h>
 
@@ -25,6 +26,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 argcPtr,
                                I32 argvBufSize)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - args_sizes_get - {} {}", argcPtr, argvBufSize);
     WAVMWasmModule* module = getExecutingWAVMModule();
 
@@ -42,6 +44,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 argvPtr,
                                I32 argvBufPtr)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - args_get - {} {}", argvPtr, argvBufPtr);
     WAVMWasmModule* module = getExecutingWAVMModule();
     module->writeArgvToMemory(argvPtr, argvBufPtr);
@@ -57,46 +60,54 @@ I32 s__gettid()
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "geteuid", I32, geteuid)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - geteuid");
     return FAKE_UID;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "getegid", I32, getegid)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - getegid");
     return FAKE_GID;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "getgrgid", I32, getgrgid, I32 a)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - getgrgid {}", a);
     return FAKE_GID;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "getgrnam", I32, getgrnam, I32 a)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - getgrnam {}", a);
     return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "setgrent", void, setgrent)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - setgrent");
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "getgrent", I32, getgrent)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - getgrent");
     return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "endgrent", void, endgrent)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - endgrent");
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "getpwuid", I32, getpwuid, I32 uid)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - getpwuid {}", uid);
 
     if (uid != FAKE_UID) {
@@ -140,18 +151,21 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env, "getpwuid", I32, getpwuid, I32 uid)
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "getuid", I32, getuid)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - getuid");
     return FAKE_UID;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "getgid", I32, getgid)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - getgid");
     return FAKE_GID;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "getppid", I32, getppid)
 {
+    HOST_CALL(Other);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -167,6 +181,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                wasi_proc_exit,
                                I32 retCode)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - proc_exit - {}", retCode);
     throw(WasmExitException(retCode));
 }
@@ -194,6 +209,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 b,
                                I32 c)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - confstr - {} {} {}", a, b, c);
 
     // Return zero as if no confstr variables have a value set
@@ -202,18 +218,21 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "abort", void, abort)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - abort");
     throw(WasmExitException(0));
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "exit", void, exit, I32 a)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - exit - {}", a);
     throw(WasmExitException(a));
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "_Exit", void, _Exit, I32 a)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - _Exit - {}", a);
     throw(WasmExitException(a));
 }
@@ -224,6 +243,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env, "_Exit", void, _Exit, I32 a)
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "sysconf", I32, _sysconf, I32 a)
 {
+    HOST_CALL(Other);
 
     SPDLOG_DEBUG("S - _sysconf - {}", a);
 
@@ -237,6 +257,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env, "sysconf", I32, _sysconf, I32 a)
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "uname", I32, uname, I32 bufPtr)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - uname - {}", bufPtr);
 
     // Native pointer to buffer
@@ -268,6 +289,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 environCountPtr,
                                I32 environBuffSizePtr)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG(
       "S - environ_sizes_get - {} {}", environCountPtr, environBuffSizePtr);
 
@@ -289,6 +311,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 environPtrs,
                                I32 environBuf)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - environ_get - {} {}", environPtrs, environBuf);
 
     WAVMWasmModule* module = getExecutingWAVMModule();
@@ -315,6 +338,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 bufPtr,
                                I32 bufLen)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - random_get - {} {}", bufPtr, bufLen);
 
     auto hostBuf = &Runtime::memoryRef<U8>(
@@ -334,16 +358,19 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32,
                                __h_errno_location)
 {
+    HOST_CALL(Other);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "ttyname", I32, ttyname, I32 a)
 {
+    HOST_CALL(Other);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "getpwnam", I32, getpwnam, I32 a)
 {
+    HOST_CALL(Other);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -355,6 +382,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 b,
                                I32 c)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - getresuid - {} {} {}", a, b, c);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -367,18 +395,21 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 b,
                                I32 c)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - getresgid - {} {} {}", a, b, c);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "getrusage", I32, getrusage, I32 a, I32 b)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - getrusage - {} {}", a, b);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "getrlimit", I32, getrlimit, I32 a, I32 b)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - getrlimit - {} {}", a, b);
     // We ignore calls to getrlimit, this may break some functionalities
     return 0;
@@ -386,18 +417,21 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env, "getrlimit", I32, getrlimit, I32 a, I32 b)
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "setrlimit", I32, setrlimit, I32 a, I32 b)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - setrlimit - {} {}", a, b);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "longjmp", void, longjmp, I32 a, U32 b)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - longjmp - {} {}", a, b);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "setjmp", I32, setjmp, I32 a)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - setjmp - {}", a);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -407,6 +441,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32,
                                wasi__errno_location)
 {
+    HOST_CALL(Other);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
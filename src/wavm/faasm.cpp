@@ -7,17 +7,34 @@
 #include <faabric/snapshot/SnapshotRegistry.h>
 #include <faabric/transport/PointToPointBroker.h>
 #include <faabric/util/bytes.h>
-#include <faabric/util/files.h>
 #include <faabric/util/func.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/macros.h>
 #include <faabric/util/scheduling.h>
 #include <faabric/util/snapshot.h>
 #include <faabric/util/state.h>
+#include <threads/LocalTeam.h>
 #include <wasm/WasmExecutionContext.h>
+#include <wasm/call_metrics.h>
 #include <wasm/chaining.h>
+#include <wasm/checkpoint.h>
+#include <wasm/deadline.h>
 #include <wasm/host_interface_test.h>
+#include <wasm/http.h>
+#include <wasm/ipc.h>
 #include <wasm/migration.h>
+#include <wasm/openmp.h>
+#include <wasm/resolver.h>
+#include <wasm/state_async.h>
+#include <wasm/state_batch.h>
+#include <wasm/state_diff.h>
+#include <wasm/state_disk.h>
+#include <wasm/state_file.h>
+#include <wasm/state_log.h>
+#include <wasm/state_metrics.h>
+#include <wasm/state_shard.h>
+#include <wasm/state_version.h>
+#include <wasm/timing.h>
 #include <wavm/WAVMWasmModule.h>
 
 #include <WAVM/Platform/Diagnostics.h>
@@ -42,9 +59,11 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                __faasm_push_state,
                                I32 keyPtr)
 {
+    HOST_CALL(State);
     auto kv = getStateKV(keyPtr, 0);
     SPDLOG_DEBUG("S - push_state - {}", kv->key);
     kv->pushFull();
+    recordStatePush(kv->size());
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -53,9 +72,11 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                __faasm_push_state_partial,
                                I32 keyPtr)
 {
+    HOST_CALL(State);
     auto kv = getStateKV(keyPtr, 0);
     SPDLOG_DEBUG("S - push_state_partial - {}", kv->key);
     kv->pushPartial();
+    recordStatePush(0);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -65,11 +86,26 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 keyPtr,
                                I32 maskKeyPtr)
 {
+    HOST_CALL(State);
     auto kv = getStateKV(keyPtr, 0);
     SPDLOG_DEBUG("S - push_state_partial_mask - {} {}", kv->key, maskKeyPtr);
 
     auto maskKv = getStateKV(maskKeyPtr, 0);
     kv->pushPartialMask(maskKv);
+    recordStatePush(0);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_push_state_changes",
+                               I32,
+                               __faasm_push_state_changes,
+                               I32 keyPtr)
+{
+    HOST_CALL(State);
+    auto kv = getStateKV(keyPtr, 0);
+    SPDLOG_DEBUG("S - push_state_changes - {}", kv->key);
+
+    return (I32)pushStateChanges(kv);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -79,10 +115,482 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 keyPtr,
                                I32 stateLen)
 {
+    HOST_CALL(State);
     auto kv = getStateKV(keyPtr, stateLen);
     SPDLOG_DEBUG("S - pull_state - {} {}", kv->key, stateLen);
 
     kv->pull();
+    recordStatePull(kv->size());
+}
+
+// Versioned pulls skip fetching read-mostly values that haven't changed (see
+// state_version.h)
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_pull_state_versioned",
+                               I32,
+                               __faasm_pull_state_versioned,
+                               I32 keyPtr,
+                               I32 stateLen)
+{
+    HOST_CALL(State);
+    auto kv = getStateKV(keyPtr, stateLen);
+    SPDLOG_DEBUG("S - pull_state_versioned - {} {}", kv->key, stateLen);
+
+    return pullStateIfChanged(kv) ? 1 : 0;
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_push_state_versioned",
+                               I64,
+                               __faasm_push_state_versioned,
+                               I32 keyPtr)
+{
+    HOST_CALL(State);
+    auto kv = getStateKV(keyPtr, 0);
+    SPDLOG_DEBUG("S - push_state_versioned - {}", kv->key);
+
+    return (I64)pushStateVersioned(kv);
+}
+
+// Sharded state spreads large values over several masters (see state_shard.h)
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_write_state_sharded",
+                               void,
+                               __faasm_write_state_sharded,
+                               I32 keyPtr,
+                               I32 totalLen,
+                               I32 offset,
+                               I32 dataPtr,
+                               I32 dataLen)
+{
+    HOST_CALL(State);
+    std::string user = ExecutorContext::get()->getMsg().user();
+    std::string key = getStringFromWasm(keyPtr);
+    SPDLOG_DEBUG("S - write_state_sharded - {} {} {} {} {}",
+                 key,
+                 totalLen,
+                 offset,
+                 dataPtr,
+                 dataLen);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    U8* data =
+      Runtime::memoryArrayPtr<U8>(memoryPtr, (Uptr)dataPtr, (Uptr)dataLen);
+
+    writeStateSharded(
+      user, key, getStateShardLayout(totalLen), offset, data, dataLen);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_read_state_sharded",
+                               void,
+                               __faasm_read_state_sharded,
+                               I32 keyPtr,
+                               I32 totalLen,
+                               I32 offset,
+                               I32 bufferPtr,
+                               I32 bufferLen)
+{
+    HOST_CALL(State);
+    std::string user = ExecutorContext::get()->getMsg().user();
+    std::string key = getStringFromWasm(keyPtr);
+    SPDLOG_DEBUG("S - read_state_sharded - {} {} {} {} {}",
+                 key,
+                 totalLen,
+                 offset,
+                 bufferPtr,
+                 bufferLen);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    U8* buffer =
+      Runtime::memoryArrayPtr<U8>(memoryPtr, (Uptr)bufferPtr, (Uptr)bufferLen);
+
+    StateShardLayout layout = getStateShardLayout(totalLen);
+    readStateSharded(user,
+                     key,
+                     layout,
+                     getStateShardReplica(layout.replicas),
+                     offset,
+                     buffer,
+                     bufferLen);
+}
+
+// Variants taking 64-bit sizes and offsets, for values past 4GB. Only the
+// guest's buffer has to fit in its 32-bit memory.
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_write_state_sharded64",
+                               void,
+                               __faasm_write_state_sharded64,
+                               I32 keyPtr,
+                               I64 totalLen,
+                               I64 offset,
+                               I32 dataPtr,
+                               I32 dataLen)
+{
+    HOST_CALL(State);
+    std::string user = ExecutorContext::get()->getMsg().user();
+    std::string key = getStringFromWasm(keyPtr);
+    SPDLOG_DEBUG("S - write_state_sharded64 - {} {} {} {} {}",
+                 key,
+                 totalLen,
+                 offset,
+                 dataPtr,
+                 dataLen);
+
+    if (totalLen < 0 || offset < 0) {
+        throw std::runtime_error("Negative sharded state size or offset");
+    }
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    U8* data =
+      Runtime::memoryArrayPtr<U8>(memoryPtr, (Uptr)dataPtr, (Uptr)dataLen);
+
+    writeStateSharded(
+      user, key, getStateShardLayout(totalLen), offset, data, dataLen);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_read_state_sharded64",
+                               void,
+                               __faasm_read_state_sharded64,
+                               I32 keyPtr,
+                               I64 totalLen,
+                               I64 offset,
+                               I32 bufferPtr,
+                               I32 bufferLen)
+{
+    HOST_CALL(State);
+    std::string user = ExecutorContext::get()->getMsg().user();
+    std::string key = getStringFromWasm(keyPtr);
+    SPDLOG_DEBUG("S - read_state_sharded64 - {} {} {} {} {}",
+                 key,
+                 totalLen,
+                 offset,
+                 bufferPtr,
+                 bufferLen);
+
+    if (totalLen < 0 || offset < 0) {
+        throw std::runtime_error("Negative sharded state size or offset");
+    }
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    U8* buffer =
+      Runtime::memoryArrayPtr<U8>(memoryPtr, (Uptr)bufferPtr, (Uptr)bufferLen);
+
+    StateShardLayout layout = getStateShardLayout(totalLen);
+    readStateSharded(user,
+                     key,
+                     layout,
+                     getStateShardReplica(layout.replicas),
+                     offset,
+                     buffer,
+                     bufferLen);
+}
+
+// The vectored state calls take an array of pointers to the keys, and arrays
+// of the matching buffers and lengths
+static std::vector<I32> getStateArrayFromWasm(I32 arrayPtr, I32 nKeys)
+{
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    I32* values =
+      Runtime::memoryArrayPtr<I32>(memoryPtr, (Uptr)arrayPtr, (Uptr)nKeys);
+
+    return std::vector<I32>(values, values + nKeys);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_pull_state_multi",
+                               void,
+                               __faasm_pull_state_multi,
+                               I32 keysPtr,
+                               I32 nKeys,
+                               I32 stateLensPtr)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG(
+      "S - pull_state_multi - {} {} {}", keysPtr, nKeys, stateLensPtr);
+
+    std::vector<std::string> keys = getStateKeysFromWasm(keysPtr, nKeys);
+    std::vector<I32> lens = getStateArrayFromWasm(stateLensPtr, nKeys);
+    auto kvs = getStateKVs(keys, std::vector<size_t>(lens.begin(), lens.end()));
+
+    runStateBatch(kvs.size(), [&kvs](size_t i) { kvs.at(i)->pull(); });
+    for (const auto& kv : kvs) {
+        recordStatePull(kv->size());
+    }
+}
+
+/**
+ * Starts pulling the value in the background, returning a handle to wait on
+ * or poll (see state_async.h)
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_pull_state_async",
+                               I32,
+                               __faasm_pull_state_async,
+                               I32 keyPtr,
+                               I32 stateLen)
+{
+    HOST_CALL(State);
+    auto kv = getStateKV(keyPtr, stateLen);
+    recordStatePull(kv->size());
+    int handle = startStateOperation([kv] { kv->pull(); });
+    SPDLOG_DEBUG("S - pull_state_async - {} {} {}", kv->key, stateLen, handle);
+
+    return handle;
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_push_state_async",
+                               I32,
+                               __faasm_push_state_async,
+                               I32 keyPtr)
+{
+    HOST_CALL(State);
+    auto kv = getStateKV(keyPtr, 0);
+    recordStatePush(kv->size());
+    int handle = startStateOperation([kv] { kv->pushFull(); });
+    SPDLOG_DEBUG("S - push_state_async - {} {}", kv->key, handle);
+
+    return handle;
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_await_state",
+                               void,
+                               __faasm_await_state,
+                               I32 handle)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - await_state - {}", handle);
+
+    awaitStateOperation(handle);
+}
+
+// Returns 1 if the operation has finished, and 0 if not
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_poll_state",
+                               I32,
+                               __faasm_poll_state,
+                               I32 handle)
+{
+    HOST_CALL(State);
+    SPDLOG_TRACE("S - poll_state - {}", handle);
+
+    return pollStateOperation(handle) ? 1 : 0;
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_push_state_multi",
+                               void,
+                               __faasm_push_state_multi,
+                               I32 keysPtr,
+                               I32 nKeys)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - push_state_multi - {} {}", keysPtr, nKeys);
+
+    std::vector<std::string> keys = getStateKeysFromWasm(keysPtr, nKeys);
+    auto kvs = getStateKVs(keys, std::vector<size_t>(keys.size(), 0));
+
+    runStateBatch(kvs.size(), [&kvs](size_t i) { kvs.at(i)->pushFull(); });
+    for (const auto& kv : kvs) {
+        recordStatePush(kv->size());
+    }
+}
+
+/**
+ * Reads each key into its buffer, as with __faasm_read_state, pulling the ones
+ * that aren't here yet at the same time.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_read_state_multi",
+                               void,
+                               __faasm_read_state_multi,
+                               I32 keysPtr,
+                               I32 nKeys,
+                               I32 buffersPtr,
+                               I32 bufferLensPtr)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - read_state_multi - {} {} {} {}",
+                 keysPtr,
+                 nKeys,
+                 buffersPtr,
+                 bufferLensPtr);
+
+    std::vector<std::string> keys = getStateKeysFromWasm(keysPtr, nKeys);
+    std::vector<I32> bufferPtrs = getStateArrayFromWasm(buffersPtr, nKeys);
+    std::vector<I32> lens = getStateArrayFromWasm(bufferLensPtr, nKeys);
+    auto kvs = getStateKVs(keys, std::vector<size_t>(lens.begin(), lens.end()));
+
+    // Check all the buffers before starting
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    std::vector<U8*> buffers;
+    for (int i = 0; i < nKeys; i++) {
+        buffers.push_back(Runtime::memoryArrayPtr<U8>(
+          memoryPtr, (Uptr)bufferPtrs.at(i), (Uptr)lens.at(i)));
+    }
+
+    runStateBatch(kvs.size(), [&kvs, &buffers](size_t i) {
+        kvs.at(i)->get(buffers.at(i));
+    });
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_write_state_multi",
+                               void,
+                               __faasm_write_state_multi,
+                               I32 keysPtr,
+                               I32 nKeys,
+                               I32 dataPtrsPtr,
+                               I32 dataLensPtr)
+{
+    HOST_CALL(State);
+    SPDLOG_DEBUG("S - write_state_multi - {} {} {} {}",
+                 keysPtr,
+                 nKeys,
+                 dataPtrsPtr,
+                 dataLensPtr);
+
+    std::vector<std::string> keys = getStateKeysFromWasm(keysPtr, nKeys);
+    std::vector<I32> dataPtrs = getStateArrayFromWasm(dataPtrsPtr, nKeys);
+    std::vector<I32> lens = getStateArrayFromWasm(dataLensPtr, nKeys);
+    auto kvs = getStateKVs(keys, std::vector<size_t>(lens.begin(), lens.end()));
+
+    // Writes are local, so there's nothing to gain from running them at once
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    for (int i = 0; i < nKeys; i++) {
+        U8* data = Runtime::memoryArrayPtr<U8>(
+          memoryPtr, (Uptr)dataPtrs.at(i), (Uptr)lens.at(i));
+        kvs.at(i)->set(data);
+    }
+}
+
+// Handle-based calls skip reading and looking up the key each time
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_get_state_handle",
+                               I32,
+                               __faasm_get_state_handle,
+                               I32 keyPtr,
+                               I32 stateLen)
+{
+    HOST_CALL(State);
+    std::string key = getStringFromWasm(keyPtr);
+    SPDLOG_DEBUG("S - get_state_handle - {} {}", key, stateLen);
+
+    return getExecutingWAVMModule()->getStateHandle(key, stateLen);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_read_state_handle",
+                               void,
+                               __faasm_read_state_handle,
+                               I32 handle,
+                               I32 offset,
+                               I32 bufferPtr,
+                               I32 bufferLen)
+{
+    HOST_CALL(State);
+    SPDLOG_TRACE("S - read_state_handle - {} {} {} {}",
+                 handle,
+                 offset,
+                 bufferPtr,
+                 bufferLen);
+
+    WAVMWasmModule* module = getExecutingWAVMModule();
+    U8* buffer = Runtime::memoryArrayPtr<U8>(
+      module->defaultMemory, (Uptr)bufferPtr, (Uptr)bufferLen);
+    module->getStateKVForHandle(handle)->getChunk(offset, buffer, bufferLen);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_write_state_handle",
+                               void,
+                               __faasm_write_state_handle,
+                               I32 handle,
+                               I32 offset,
+                               I32 dataPtr,
+                               I32 dataLen)
+{
+    HOST_CALL(State);
+    SPDLOG_TRACE("S - write_state_handle - {} {} {} {}",
+                 handle,
+                 offset,
+                 dataPtr,
+                 dataLen);
+
+    WAVMWasmModule* module = getExecutingWAVMModule();
+    U8* data = Runtime::memoryArrayPtr<U8>(
+      module->defaultMemory, (Uptr)dataPtr, (Uptr)dataLen);
+    module->getStateKVForHandle(handle)->setChunk(offset, data, dataLen);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_pull_state_handle",
+                               void,
+                               __faasm_pull_state_handle,
+                               I32 handle)
+{
+    HOST_CALL(State);
+    SPDLOG_TRACE("S - pull_state_handle - {}", handle);
+
+    auto kv = getExecutingWAVMModule()->getStateKVForHandle(handle);
+    kv->pull();
+    recordStatePull(kv->size());
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_push_state_handle",
+                               void,
+                               __faasm_push_state_handle,
+                               I32 handle)
+{
+    HOST_CALL(State);
+    SPDLOG_TRACE("S - push_state_handle - {}", handle);
+
+    auto kv = getExecutingWAVMModule()->getStateKVForHandle(handle);
+    kv->pushFull();
+    recordStatePush(kv->size());
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_push_state_partial_handle",
+                               void,
+                               __faasm_push_state_partial_handle,
+                               I32 handle)
+{
+    HOST_CALL(State);
+    SPDLOG_TRACE("S - push_state_partial_handle - {}", handle);
+
+    getExecutingWAVMModule()->getStateKVForHandle(handle)->pushPartial();
+    recordStatePush(0);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_lock_state_handle",
+                               void,
+                               __faasm_lock_state_handle,
+                               I32 handle)
+{
+    HOST_CALL(State);
+    SPDLOG_TRACE("S - lock_state_handle - {}", handle);
+
+    auto kv = getExecutingWAVMModule()->getStateKVForHandle(handle);
+    StateLockTimer lockTimer;
+    kv->lockWrite();
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_unlock_state_handle",
+                               void,
+                               __faasm_unlock_state_handle,
+                               I32 handle)
+{
+    HOST_CALL(State);
+    SPDLOG_TRACE("S - unlock_state_handle - {}", handle);
+
+    getExecutingWAVMModule()->getStateKVForHandle(handle)->unlockWrite();
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -91,9 +599,11 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                __faasm_lock_state_read,
                                I32 keyPtr)
 {
+    HOST_CALL(State);
     auto kv = getStateKV(keyPtr, 0);
     SPDLOG_DEBUG("S - lock_state_read - {}", kv->key);
 
+    StateLockTimer lockTimer;
     kv->lockRead();
 }
 
@@ -103,6 +613,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                __faasm_unlock_state_read,
                                I32 keyPtr)
 {
+    HOST_CALL(State);
     auto kv = getStateKV(keyPtr, 0);
     SPDLOG_DEBUG("S - unlock_state_read - {}", kv->key);
 
@@ -115,9 +626,11 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                __faasm_lock_state_write,
                                I32 keyPtr)
 {
+    HOST_CALL(State);
     auto kv = getStateKV(keyPtr, 0);
     SPDLOG_DEBUG("S - lock_state_write - {}", kv->key);
 
+    StateLockTimer lockTimer;
     kv->lockWrite();
 }
 
@@ -127,6 +640,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                __faasm_unlock_state_write,
                                I32 keyPtr)
 {
+    HOST_CALL(State);
     auto kv = getStateKV(keyPtr, 0);
     SPDLOG_DEBUG("S - unlock_state_write - {}", keyPtr, kv->key);
 
@@ -141,6 +655,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 dataPtr,
                                I32 dataLen)
 {
+    HOST_CALL(State);
 
     auto kv = getStateKV(keyPtr, dataLen);
     SPDLOG_DEBUG("S - write_state - {} {} {}", kv->key, dataPtr, dataLen);
@@ -161,6 +676,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 dataPtr,
                                I32 dataLen)
 {
+    HOST_CALL(State);
     Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
     U8* data =
       Runtime::memoryArrayPtr<U8>(memoryPtr, (Uptr)dataPtr, (Uptr)dataLen);
@@ -183,6 +699,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 bufferLen,
                                I32 nElems)
 {
+    HOST_CALL(State);
     Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
     U8* buffer =
       Runtime::memoryArrayPtr<U8>(memoryPtr, (Uptr)bufferPtr, (Uptr)bufferLen);
@@ -203,6 +720,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                __faasm_clear_appended_state,
                                I32 keyPtr)
 {
+    HOST_CALL(State);
 
     Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
     UNUSED(memoryPtr);
@@ -217,6 +735,89 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     kv->clearAppended();
 }
 
+// Append logs (see state_log.h)
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_append_log",
+                               I64,
+                               __faasm_append_log,
+                               I32 keyPtr,
+                               I32 dataPtr,
+                               I32 dataLen)
+{
+    HOST_CALL(State);
+    std::string user = ExecutorContext::get()->getMsg().user();
+    std::string key = getStringFromWasm(keyPtr);
+    SPDLOG_DEBUG("S - append_log - {} {} {}", key, dataPtr, dataLen);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    U8* data =
+      Runtime::memoryArrayPtr<U8>(memoryPtr, (Uptr)dataPtr, (Uptr)dataLen);
+
+    return (I64)appendStateLog(user, key, data, dataLen);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_read_log",
+                               I64,
+                               __faasm_read_log,
+                               I32 keyPtr,
+                               I64 index,
+                               I32 bufferPtr,
+                               I32 bufferLen,
+                               I32 timeoutMs)
+{
+    HOST_CALL(State);
+    std::string user = ExecutorContext::get()->getMsg().user();
+    std::string key = getStringFromWasm(keyPtr);
+    SPDLOG_DEBUG("S - read_log - {} {} {} {} {}",
+                 key,
+                 index,
+                 bufferPtr,
+                 bufferLen,
+                 timeoutMs);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    U8* buffer =
+      Runtime::memoryArrayPtr<U8>(memoryPtr, (Uptr)bufferPtr, (Uptr)bufferLen);
+
+    return readStateLog(user, key, index, buffer, bufferLen, timeoutMs);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_trim_log",
+                               void,
+                               __faasm_trim_log,
+                               I32 keyPtr,
+                               I64 index)
+{
+    HOST_CALL(State);
+    std::string user = ExecutorContext::get()->getMsg().user();
+    std::string key = getStringFromWasm(keyPtr);
+    SPDLOG_DEBUG("S - trim_log - {} {}", key, index);
+
+    trimStateLog(user, key, index);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_get_log_bounds",
+                               void,
+                               __faasm_get_log_bounds,
+                               I32 keyPtr,
+                               I32 headPtr,
+                               I32 tailPtr)
+{
+    HOST_CALL(State);
+    std::string user = ExecutorContext::get()->getMsg().user();
+    std::string key = getStringFromWasm(keyPtr);
+    SPDLOG_DEBUG("S - get_log_bounds - {} {} {}", key, headPtr, tailPtr);
+
+    auto [head, tail] = getStateLogBounds(user, key);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    Runtime::memoryRef<U64>(memoryPtr, (Uptr)headPtr) = head;
+    Runtime::memoryRef<U64>(memoryPtr, (Uptr)tailPtr) = tail;
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "__faasm_write_state_offset",
                                void,
@@ -227,6 +828,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 dataPtr,
                                I32 dataLen)
 {
+    HOST_CALL(State);
     auto kv = getStateKV(keyPtr, totalLen);
     SPDLOG_DEBUG("S - write_state_offset - {} {} {} {} {}",
                  kv->key,
@@ -249,22 +851,16 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 keyPtr,
                                I32 pathPtr)
 {
+    HOST_CALL(State);
     const std::string key = getStringFromWasm(keyPtr);
     const std::string path = getStringFromWasm(pathPtr);
 
     SPDLOG_DEBUG("S - write_state_from_file - {} {}", key, path);
 
-    // Read file into bytes
+    std::string user = ExecutorContext::get()->getMsg().user();
     const std::string maskedPath = storage::prependRuntimeRoot(path);
-    const std::vector<uint8_t> bytes =
-      faabric::util::readFileToBytes(maskedPath);
-    unsigned long fileLength = bytes.size();
-
-    // Write to state
-    auto kv = getStateKV(keyPtr, fileLength);
-    kv->set(bytes.data());
 
-    return fileLength;
+    return (I32)writeStateFromFile(user, key, maskedPath);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -275,6 +871,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 bufferPtr,
                                I32 bufferLen)
 {
+    HOST_CALL(State);
 
     // If buffer len is zero, just need the state size
     if (bufferLen == 0) {
@@ -298,6 +895,13 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     }
 }
 
+// Null unless the key is disk-backed (see state_disk.h)
+static std::shared_ptr<DiskStateValue> getDiskState(I32 keyPtr)
+{
+    std::string user = ExecutorContext::get()->getMsg().user();
+    return getDiskStateStore().getValue(user, getStringFromWasm(keyPtr));
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "__faasm_read_state_ptr",
                                I32,
@@ -305,12 +909,25 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 keyPtr,
                                I32 totalLen)
 {
+    HOST_CALL(State);
+    auto diskValue = getDiskState(keyPtr);
+    if (diskValue != nullptr) {
+        SPDLOG_DEBUG(
+          "S - read_state_ptr - {} {} (disk)", diskValue->key, totalLen);
+        U32 wasmPtr = getExecutingWAVMModule()->mapDiskStateMemory(
+          diskValue, 0, totalLen);
+        recordStateMapping(totalLen);
+
+        return wasmPtr;
+    }
+
     auto kv = getStateKV(keyPtr, totalLen);
     SPDLOG_DEBUG("S - read_state_ptr - {} {}", kv->key, totalLen);
 
     // Map shared memory
     WAVMWasmModule* module = getExecutingWAVMModule();
     U32 wasmPtr = module->mapSharedStateMemory(kv, 0, totalLen);
+    recordStateMapping(totalLen);
 
     // Call get to make sure the value is pulled
     kv->get();
@@ -328,6 +945,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 bufferPtr,
                                I32 bufferLen)
 {
+    HOST_CALL(State);
     auto kv = getStateKV(keyPtr, totalLen);
     SPDLOG_DEBUG("S - read_state_offset - {} {} {} {} {}",
                  kv->key,
@@ -343,15 +961,24 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     kv->getChunk(offset, buffer, bufferLen);
 }
 
-WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "__faasm_read_state_offset_ptr",
-                               I32,
-                               __faasm_read_state_offset_ptr,
-                               I32 keyPtr,
-                               I32 totalLen,
-                               I32 offset,
-                               I32 len)
+static U32 readStateOffsetPtr(I32 keyPtr, I64 totalLen, I64 offset, I32 len)
 {
+    WAVMWasmModule* module = getExecutingWAVMModule();
+
+    // Disk-backed values only have the chunks in the range fetched
+    auto diskValue = getDiskState(keyPtr);
+    if (diskValue != nullptr) {
+        SPDLOG_DEBUG("S - read_state_offset_ptr - {} {} {} {} (disk)",
+                     diskValue->key,
+                     totalLen,
+                     offset,
+                     len);
+        U32 wasmPtr = module->mapDiskStateMemory(diskValue, offset, len);
+        recordStateMapping(len);
+
+        return wasmPtr;
+    }
+
     auto kv = getStateKV(keyPtr, totalLen);
     SPDLOG_DEBUG("S - read_state_offset_ptr - {} {} {} {}",
                  kv->key,
@@ -360,8 +987,8 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                  len);
 
     // Map whole key in shared memory
-    WAVMWasmModule* module = getExecutingWAVMModule();
     U32 wasmPtr = module->mapSharedStateMemory(kv, offset, len);
+    recordStateMapping(len);
 
     // Call get to make sure the value is there
     kv->getChunk(offset, len);
@@ -369,6 +996,38 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     return wasmPtr;
 }
 
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_read_state_offset_ptr",
+                               I32,
+                               __faasm_read_state_offset_ptr,
+                               I32 keyPtr,
+                               I32 totalLen,
+                               I32 offset,
+                               I32 len)
+{
+    HOST_CALL(State);
+    return readStateOffsetPtr(keyPtr, totalLen, offset, len);
+}
+
+// Variant taking a 64-bit size and offset, for values past 2GB, e.g.
+// disk-backed ones. Only the mapped range has to fit in the guest's memory.
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_read_state_offset_ptr64",
+                               I32,
+                               __faasm_read_state_offset_ptr64,
+                               I32 keyPtr,
+                               I64 totalLen,
+                               I64 offset,
+                               I32 len)
+{
+    HOST_CALL(State);
+    if (totalLen < 0 || offset < 0 || len < 0) {
+        throw std::runtime_error("Negative state size, offset or length");
+    }
+
+    return readStateOffsetPtr(keyPtr, totalLen, offset, len);
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "__faasm_flag_state_dirty",
                                void,
@@ -376,6 +1035,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 keyPtr,
                                I32 totalLen)
 {
+    HOST_CALL(State);
     auto kv = getStateKV(keyPtr, totalLen);
     SPDLOG_DEBUG("S - __faasm_flag_state_dirty - {} {}", kv->key, totalLen);
 
@@ -391,6 +1051,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 offset,
                                I32 len)
 {
+    HOST_CALL(State);
     auto kv = getStateKV(keyPtr, totalLen);
 
     // Avoid heavy logging
@@ -402,24 +1063,11 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 
 I32 _readInputImpl(I32 bufferPtr, I32 bufferLen)
 {
-    // Get the input
-    faabric::Message* call = &ExecutorContext::get()->getMsg();
-    std::vector<uint8_t> inputBytes =
-      faabric::util::stringToBytes(call->inputdata());
-
-    // If nothing, return nothing
-    if (inputBytes.empty()) {
-        return 0;
-    }
-
-    // Write to the wasm buffer
     Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
     U8* buffer =
       Runtime::memoryArrayPtr<U8>(memoryPtr, (Uptr)bufferPtr, (Uptr)bufferLen);
 
-    int inputSize =
-      faabric::util::safeCopyToBuffer(inputBytes, buffer, bufferLen);
-    return inputSize;
+    return readCallInput(buffer, bufferLen);
 }
 
 // ------------------------------------
@@ -433,16 +1081,53 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 bufferPtr,
                                I32 bufferLen)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - read_input - {} {}", bufferPtr, bufferLen);
 
     return _readInputImpl(bufferPtr, bufferLen);
 }
 
+// How many calls the instance has handled since it was last reset, so batch
+// handlers know when to set themselves up
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_batch_index",
+                               I32,
+                               __faasm_batch_index)
+{
+    HOST_CALL(Other);
+    SPDLOG_DEBUG("S - batch_index");
+
+    return getExecutingWAVMModule()->getBatchIndex();
+}
+
+// Puts the input in new read-only memory, writing where it is and how long
+// it is
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_read_input_mapped",
+                               void,
+                               __faasm_read_input_mapped,
+                               I32 inputPtrPtr,
+                               I32 inputLenPtr)
+{
+    HOST_CALL(Other);
+    SPDLOG_DEBUG("S - read_input_mapped - {} {}", inputPtrPtr, inputLenPtr);
+
+    uint32_t inputPtr = 0;
+    uint32_t inputLen = 0;
+    readCallInputMapped(&inputPtr, &inputLen);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    Runtime::memoryRef<U32>(memoryPtr, inputPtrPtr) = inputPtr;
+    Runtime::memoryRef<U32>(memoryPtr, inputLenPtr) = inputLen;
+}
+
 void _writeOutputImpl(I32 outputPtr, I32 outputLen)
 {
-    std::vector<uint8_t> outputData = getBytesFromWasm(outputPtr, outputLen);
-    faabric::Message* call = &ExecutorContext::get()->getMsg();
-    call->set_outputdata(outputData.data(), outputData.size());
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    U8* output =
+      Runtime::memoryArrayPtr<U8>(memoryPtr, (Uptr)outputPtr, (Uptr)outputLen);
+
+    writeCallOutput(output, outputLen);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -452,10 +1137,28 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 outputPtr,
                                I32 outputLen)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - write_output - {} {}", outputPtr, outputLen);
     _writeOutputImpl(outputPtr, outputLen);
 }
 
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_append_output",
+                               void,
+                               __faasm_append_output,
+                               I32 outputPtr,
+                               I32 outputLen)
+{
+    HOST_CALL(Other);
+    SPDLOG_DEBUG("S - append_output - {} {}", outputPtr, outputLen);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    U8* output =
+      Runtime::memoryArrayPtr<U8>(memoryPtr, (Uptr)outputPtr, (Uptr)outputLen);
+
+    appendCallOutput(output, outputLen);
+}
+
 void _readPythonInput(I32 buffPtr, I32 buffLen, const std::string& value)
 {
     // Get wasm buffer
@@ -475,6 +1178,28 @@ void _readPythonInput(I32 buffPtr, I32 buffLen, const std::string& value)
     }
 }
 
+// A Python function's own zygote runs when it's bound, outside any call, so
+// gets the function it's bound to rather than the one being executed
+static std::string getPythonUser()
+{
+    std::string value = getExecutingWAVMModule()->getBoundPythonUser();
+    if (value.empty()) {
+        value = ExecutorContext::get()->getMsg().pythonuser();
+    }
+
+    return value;
+}
+
+static std::string getPythonFunction()
+{
+    std::string value = getExecutingWAVMModule()->getBoundPythonFunction();
+    if (value.empty()) {
+        value = ExecutorContext::get()->getMsg().pythonfunction();
+    }
+
+    return value;
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "__faasm_get_py_user",
                                void,
@@ -482,8 +1207,9 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 bufferPtr,
                                I32 bufferLen)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - get_py_user - {} {}", bufferPtr, bufferLen);
-    std::string value = ExecutorContext::get()->getMsg().pythonuser();
+    std::string value = getPythonUser();
 
     if (value.empty()) {
         throw std::runtime_error("Python user empty, cannot return");
@@ -499,8 +1225,9 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 bufferPtr,
                                I32 bufferLen)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - get_py_func - {} {}", bufferPtr, bufferLen);
-    std::string value = ExecutorContext::get()->getMsg().pythonfunction();
+    std::string value = getPythonFunction();
     _readPythonInput(bufferPtr, bufferLen, value);
 }
 
@@ -511,6 +1238,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 bufferPtr,
                                I32 bufferLen)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - get_py_entry - {} {}", bufferPtr, bufferLen);
     std::string value = ExecutorContext::get()->getMsg().pythonentry();
     _readPythonInput(bufferPtr, bufferLen, value);
@@ -522,6 +1250,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                __faasm_conf_flag,
                                I32 keyPtr)
 {
+    HOST_CALL(Other);
 
     const std::string key = getStringFromWasm(keyPtr);
     SPDLOG_DEBUG("S - conf_flag - {}", key);
@@ -530,6 +1259,11 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     if (key == "PYTHON_PRELOAD") {
         int res = conf.pythonPreload == "on" ? 1 : 0;
         return res;
+    } else if (key == "PYTHON_IMPORT_ZYGOTE") {
+        // Only a Python function's own zygote should import its module
+        WAVMWasmModule* module = getExecutingWAVMModule();
+        int res = module->getBoundPythonFunction().empty() ? 0 : 1;
+        return res;
     } else if (key == "ALWAYS_ON") {
         // For testing
         return 1;
@@ -552,6 +1286,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                __faasm_backtrace,
                                I32 depth)
 {
+    HOST_CALL(Other);
 
     SPDLOG_DEBUG("S - faasm_backtrace {}", depth);
 
@@ -581,46 +1316,6 @@ static std::shared_ptr<PointToPointGroup> getPointToPointGroup()
     return PointToPointGroup::getOrAwaitGroup(msg.groupid());
 }
 
-static std::pair<uint32_t, faabric::util::SnapshotDataType>
-extractSnapshotDataType(I32 varType)
-{
-    switch (varType) {
-        case (faabric::util::SnapshotDataType::Raw): {
-            SPDLOG_ERROR("Cannot declare untyped merge regions from code");
-        }
-        case (faabric::util::SnapshotDataType::Bool): {
-            return { sizeof(I8), faabric::util::SnapshotDataType::Bool };
-        }
-        case (faabric::util::SnapshotDataType::Int): {
-            return { sizeof(I32), faabric::util::SnapshotDataType::Int };
-        }
-        case (faabric::util::SnapshotDataType::Long): {
-            return { sizeof(I64), faabric::util::SnapshotDataType::Long };
-        }
-        case (faabric::util::SnapshotDataType::Float): {
-            return { sizeof(F32), faabric::util::SnapshotDataType::Float };
-        }
-        case (faabric::util::SnapshotDataType::Double): {
-            return { sizeof(F64), faabric::util::SnapshotDataType::Double };
-        }
-        default: {
-            SPDLOG_ERROR("Unrecognised memory data type: {}", varType);
-            throw std::runtime_error("Unrecognised shared memory data type");
-        }
-    }
-}
-
-static faabric::util::SnapshotMergeOperation extractSnapshotMergeOp(I32 mergeOp)
-{
-    if (faabric::util::SnapshotMergeOperation::Bytewise <= mergeOp &&
-        mergeOp <= faabric::util::SnapshotMergeOperation::Min) {
-        return static_cast<faabric::util::SnapshotMergeOperation>(mergeOp);
-    }
-
-    SPDLOG_ERROR("Unrecognised merge operation: {}", mergeOp);
-    throw std::runtime_error("Unrecognised merge operation");
-}
-
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "__faasm_sm_reduce",
                                void,
@@ -630,6 +1325,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 reduceOp,
                                int currentBatch)
 {
+    HOST_CALL(OpenMP);
     // Here we have two scenarios, the second of which differs in behaviour when
     // we're in single host mode:
     //
@@ -659,27 +1355,48 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     SPDLOG_DEBUG(
       "S - sm_reduce - {} {} {} {}", varPtr, varType, reduceOp, currentBatch);
 
-    auto dataType = extractSnapshotDataType(varType);
-    faabric::util::SnapshotMergeOperation mergeOp =
-      extractSnapshotMergeOp(reduceOp);
+    wasm::addOpenMPMergeRegion(varPtr, varType, reduceOp, 1, isCurrentBatch);
+}
 
-    faabric::Message* msg = &ExecutorContext::get()->getMsg();
-    SPDLOG_DEBUG("Registering reduction variable {}-{} for {} {}",
-                 varPtr,
-                 varPtr + dataType.first,
-                 faabric::util::funcToString(*msg, false),
-                 isCurrentBatch ? "this batch" : "next batch");
-
-    if (isCurrentBatch) {
-        faabric::scheduler::Executor* executor =
-          ExecutorContext::get()->getExecutor();
-        auto snap = executor->getMainThreadSnapshot(*msg, false);
-        snap->addMergeRegion(varPtr, dataType.first, dataType.second, mergeOp);
-    } else {
-        wasm::WasmModule* module = getExecutingModule();
-        module->addMergeRegionForNextThreads(
-          varPtr, dataType.first, dataType.second, mergeOp);
+/**
+ * As __faasm_sm_reduce, for an array of length values of the given type, so
+ * arrays can be declared in one go rather than element by element.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_sm_reduce_array",
+                               void,
+                               __faasm_sm_reduce_array,
+                               I32 varPtr,
+                               I32 varType,
+                               I32 reduceOp,
+                               I32 length,
+                               I32 currentBatch)
+{
+    HOST_CALL(OpenMP);
+
+    // See __faasm_sm_reduce
+    bool isCurrentBatch = currentBatch == 1;
+    bool isSingleHost = ExecutorContext::get()->getBatchRequest()->singlehost();
+    if (isCurrentBatch && isSingleHost) {
+        SPDLOG_DEBUG(
+          "S - sm_reduce_array - {} {} {} {} {} (ignored, single host)",
+          varPtr,
+          varType,
+          reduceOp,
+          length,
+          currentBatch);
+        return;
     }
+
+    SPDLOG_DEBUG("S - sm_reduce_array - {} {} {} {} {}",
+                 varPtr,
+                 varType,
+                 reduceOp,
+                 length,
+                 currentBatch);
+
+    wasm::addOpenMPMergeRegion(
+      varPtr, varType, reduceOp, length, isCurrentBatch);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -687,8 +1404,16 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                void,
                                __faasm_sm_critical_local)
 {
+    HOST_CALL(OpenMP);
     SPDLOG_DEBUG("S - sm_critical_local");
 
+    // Teams on the local thread pool have no point-to-point group
+    std::shared_ptr<threads::LocalTeam> team = threads::getCurrentLocalTeam();
+    if (team != nullptr) {
+        team->localMx.lock();
+        return;
+    }
+
     getPointToPointGroup()->localLock();
 }
 
@@ -697,8 +1422,15 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                void,
                                __faasm_sm_critical_local_end)
 {
+    HOST_CALL(OpenMP);
     SPDLOG_DEBUG("S - sm_critical_local_end");
 
+    std::shared_ptr<threads::LocalTeam> team = threads::getCurrentLocalTeam();
+    if (team != nullptr) {
+        team->localMx.unlock();
+        return;
+    }
+
     getPointToPointGroup()->localUnlock();
 }
 
@@ -713,6 +1445,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 entrypointFuncPtr,
                                I32 entrypointFuncArg)
 {
+    HOST_CALL(Process);
     SPDLOG_DEBUG(
       "S - faasm_migrate_point {} {}", entrypointFuncPtr, entrypointFuncArg);
 
@@ -720,6 +1453,20 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                            std::to_string(entrypointFuncArg));
 }
 
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_checkpoint",
+                               void,
+                               __faasm_checkpoint,
+                               I32 entrypointFuncPtr,
+                               I32 entrypointFuncArg)
+{
+    HOST_CALL(Process);
+    SPDLOG_DEBUG(
+      "S - faasm_checkpoint {} {}", entrypointFuncPtr, entrypointFuncArg);
+
+    wasm::doCheckpoint(entrypointFuncPtr, std::to_string(entrypointFuncArg));
+}
+
 // ------------------------------------
 // LEGACY PYTHON
 // ------------------------------------
@@ -733,6 +1480,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                setEmulatedMessageFromJson,
                                I32 msgPtr)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - setEmulatedMessageFromJson - {}", msgPtr);
     throw std::runtime_error(
       "Should not be calling emulator functions from wasm");
@@ -743,6 +1491,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32,
                                emulatorGetAsyncResponse)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - emulatorGetAsyncResponse");
     throw std::runtime_error(
       "Should not be calling emulator functions from wasm");
@@ -754,17 +1503,162 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                emulatorSetCallStatus,
                                I32 success)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - emulatorSetCallStatus {}", success);
     throw std::runtime_error(
       "Should not be calling emulator functions from wasm");
 }
 
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_timer_nanos",
+                               I64,
+                               __faasm_timer_nanos)
+{
+    HOST_CALL(Other);
+    return (I64)wasm::getTimerNanos();
+}
+
+/**
+ * Milliseconds left before the call is stopped at its deadline, so that long
+ * running functions can wrap up or checkpoint in time. Returns -1 if there's
+ * no deadline.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_remaining_time_ms",
+                               I64,
+                               __faasm_remaining_time_ms)
+{
+    HOST_CALL(Other);
+    return (I64)wasm::getRemainingTimeMs();
+}
+
+/**
+ * HTTP requests made by the host, so connections can be kept open across
+ * calls. Headers are optional, given as "Name: value" lines separated by \r\n.
+ * Returns the length of the full response body, which may be more than fits in
+ * the buffer, or -1 on failure.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_http_request",
+                               I32,
+                               __faasm_http_request,
+                               I32 methodPtr,
+                               I32 urlPtr,
+                               I32 headersPtr,
+                               I32 bodyPtr,
+                               I32 bodyLen,
+                               I32 responsePtr,
+                               I32 responseLen,
+                               I32 statusPtr)
+{
+    HOST_CALL(Network);
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+
+    std::string headers;
+    if (headersPtr != 0) {
+        headers = getStringFromWasm(headersPtr);
+    }
+
+    U8* body = Runtime::memoryArrayPtr<U8>(memoryPtr, bodyPtr, bodyLen);
+    U8* response =
+      Runtime::memoryArrayPtr<U8>(memoryPtr, responsePtr, responseLen);
+    I32& status = Runtime::memoryRef<I32>(memoryPtr, statusPtr);
+
+    return wasm::doHostHttpRequest(getStringFromWasm(methodPtr),
+                                   getStringFromWasm(urlPtr),
+                                   headers,
+                                   body,
+                                   bodyLen,
+                                   response,
+                                   responseLen,
+                                   &status);
+}
+
+/**
+ * Name lookups made and cached on the host (see resolver.h). Writes up to
+ * bufferLen bytes of addresses to the buffer, and returns how many it wrote,
+ * or a negative EAI_ error.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_resolve_host",
+                               I32,
+                               __faasm_resolve_host,
+                               I32 hostPtr,
+                               I32 family,
+                               I32 bufferPtr,
+                               I32 bufferLen)
+{
+    HOST_CALL(Network);
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    U8* buffer = Runtime::memoryArrayPtr<U8>(memoryPtr, bufferPtr, bufferLen);
+
+    return wasm::doHostResolveHost(
+      getStringFromWasm(hostPtr), family, buffer, bufferLen);
+}
+
+/**
+ * Channels stream bytes between Faaslets on the same host without going
+ * through the scheduler. Reads return zero once all writers have closed the
+ * channel and everything written has been read.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_channel_open",
+                               I32,
+                               __faasm_channel_open,
+                               I32 namePtr,
+                               I32 write)
+{
+    HOST_CALL(Chaining);
+    return wasm::doHostChannelOpen(getStringFromWasm(namePtr), write);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_channel_write",
+                               I32,
+                               __faasm_channel_write,
+                               I32 handle,
+                               I32 dataPtr,
+                               I32 dataLen)
+{
+    HOST_CALL(Chaining);
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    U8* data = Runtime::memoryArrayPtr<U8>(memoryPtr, dataPtr, dataLen);
+
+    return wasm::doHostChannelWrite(handle, data, dataLen);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_channel_read",
+                               I32,
+                               __faasm_channel_read,
+                               I32 handle,
+                               I32 bufferPtr,
+                               I32 bufferLen)
+{
+    HOST_CALL(Chaining);
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    U8* buffer = Runtime::memoryArrayPtr<U8>(memoryPtr, bufferPtr, bufferLen);
+
+    return wasm::doHostChannelRead(handle, buffer, bufferLen);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_channel_close",
+                               I32,
+                               __faasm_channel_close,
+                               I32 handle)
+{
+    HOST_CALL(Chaining);
+    return wasm::doHostChannelClose(handle);
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "__faasm_host_interface_test",
                                void,
                                __faasm_host_interface_test,
                                I32 testNum)
 {
+    HOST_CALL(Other);
     wasm::doHostInterfaceTest(testNum);
 }
 }
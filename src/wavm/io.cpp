@@ -10,9 +10,11 @@
 #include <conf/FaasmConfig.h>
 #include <storage/FileDescriptor.h>
 #include <storage/FileLoader.h>
+#include <wasm/call_metrics.h>
 
 #include <cstring>
 #include <dirent.h>
+#include <fcntl.h>
 #include <poll.h>
 #include <strings.h>
 #include <sys/ioctl.h>
@@ -47,6 +49,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 fd,
                                I32 prestatPtr)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_TRACE("S - fd_prestat_get - {} {}", fd, prestatPtr);
 
     WAVMWasmModule* module = getExecutingWAVMModule();
@@ -73,6 +76,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 resPathPtr,
                                I32 resPathLen)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_TRACE("S - fd_prestat_dir_name - {} {}", fd, resPathPtr, resPathLen);
 
     WAVMWasmModule* module = getExecutingWAVMModule();
@@ -106,6 +110,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 fdFlags,
                                I32 resFdPtr)
 {
+    HOST_CALL(Filesystem);
     PROF_START(PathOpen)
     const std::string pathStr = getStringFromWasm(path);
 
@@ -152,6 +157,7 @@ int doWasiDup(I32 fd)
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "dup", I32, dup, I32 fd)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - dup - {}", fd);
     return doWasiDup(fd);
 }
@@ -163,6 +169,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 fd,
                                I32 resFdPtr)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - fd_dup - {}", fd, resFdPtr);
 
     int newFd = doWasiDup(fd);
@@ -190,6 +197,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                U64 startCookie,
                                I32 resSizePtr)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_TRACE("S - fd_readdir - {} {} {} {} {}",
                  fd,
                  buf,
@@ -200,20 +208,11 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
     storage::FileDescriptor& fileDesc =
       getExecutingWAVMModule()->getFileSystem().getFileDescriptor(fd);
 
-    bool isStartCookie = startCookie == __WASI_DIRCOOKIE_START;
-    if (fileDesc.iterStarted() && isStartCookie) {
-        // Return invalid if we've already started the iterator but also get the
-        // start cookie
-        return __WASI_EINVAL;
-    } else if (!fileDesc.iterStarted() && !isStartCookie) {
-        throw std::runtime_error(
-          "No directory iterator exists, and this is not the start cookie");
-    }
-
     U8* buffer = Runtime::memoryArrayPtr<U8>(
       getExecutingWAVMModule()->defaultMemory, buf, bufLen);
 
-    size_t bytesCopied = fileDesc.copyDirentsToWasiBuffer(buffer, bufLen);
+    size_t bytesCopied =
+      fileDesc.copyDirentsToWasiBuffer(buffer, bufLen, startCookie);
 
     // Set the result
     Runtime::memoryRef<U32>(getExecutingWAVMModule()->defaultMemory,
@@ -315,12 +314,16 @@ I32 s__getdents64(I32 fd, I32 wasmDirentBuf, I32 wasmDirentBufLen)
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(wasi, "fd_close", I32, wasi_fd_close, I32 fd)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - fd_close - {}", fd);
 
-    // TODO - actually closing here can close the preopened fds which messes
-    // things up Ignore for now.
+    // The preopened fds are left open, as closing them messes things up
+    storage::FileSystem& fileSystem = getExecutingWAVMModule()->getFileSystem();
+    if (!fileSystem.closeFileDescriptor(fd)) {
+        return __WASI_EBADF;
+    }
 
-    return 0;
+    return __WASI_ESUCCESS;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
@@ -332,6 +335,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 iovecCount,
                                I32 resBytesWrittenPtr)
 {
+    HOST_CALL(Filesystem);
     storage::FileSystem& fileSystem = getExecutingWAVMModule()->getFileSystem();
     std::string path = fileSystem.getPathForFd(fd);
 
@@ -373,6 +377,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 iovecCount,
                                I32 resBytesRead)
 {
+    HOST_CALL(Filesystem);
     PROF_START(FdRead)
     storage::FileSystem& fileSystem = getExecutingWAVMModule()->getFileSystem();
     std::string path = fileSystem.getPathForFd(fd);
@@ -393,6 +398,131 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
     return __WASI_ESUCCESS;
 }
 
+WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
+                               "fd_pwrite",
+                               I32,
+                               wasi_fd_pwrite,
+                               I32 fd,
+                               I32 iovecsPtr,
+                               I32 iovecCount,
+                               I64 offset,
+                               I32 resBytesWrittenPtr)
+{
+    HOST_CALL(Filesystem);
+    storage::FileSystem& fileSystem = getExecutingWAVMModule()->getFileSystem();
+
+    SPDLOG_TRACE(
+      "S - fd_pwrite - {} {} {} {}", fd, iovecsPtr, iovecCount, offset);
+
+    storage::FileDescriptor& fileDesc = fileSystem.getFileDescriptor(fd);
+
+    // The iovecs point straight into linear memory
+    auto nativeIovecs = wasiIovecsToNativeIovecs(iovecsPtr, iovecCount);
+    ssize_t bytesWritten = fileDesc.pwrite(nativeIovecs, iovecCount, offset);
+    if (bytesWritten < 0) {
+        return fileDesc.getWasiErrno();
+    }
+
+    Runtime::memoryRef<int32_t>(getExecutingWAVMModule()->defaultMemory,
+                                resBytesWrittenPtr) = bytesWritten;
+
+    return __WASI_ESUCCESS;
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
+                               "fd_pread",
+                               I32,
+                               wasi_fd_pread,
+                               I32 fd,
+                               I32 iovecsPtr,
+                               I32 iovecCount,
+                               I64 offset,
+                               I32 resBytesReadPtr)
+{
+    HOST_CALL(Filesystem);
+    storage::FileSystem& fileSystem = getExecutingWAVMModule()->getFileSystem();
+
+    SPDLOG_TRACE(
+      "S - fd_pread - {} {} {} {}", fd, iovecsPtr, iovecCount, offset);
+
+    storage::FileDescriptor& fileDesc = fileSystem.getFileDescriptor(fd);
+
+    auto nativeIovecs = wasiIovecsToNativeIovecs(iovecsPtr, iovecCount);
+    ssize_t bytesRead = fileDesc.pread(nativeIovecs, iovecCount, offset);
+    if (bytesRead < 0) {
+        return fileDesc.getWasiErrno();
+    }
+
+    Runtime::memoryRef<int32_t>(getExecutingWAVMModule()->defaultMemory,
+                                resBytesReadPtr) = bytesRead;
+
+    return __WASI_ESUCCESS;
+}
+
+/**
+ * Copies between the descriptors on the host, so the data never passes
+ * through linear memory. The offset pointer is to an off_t, or null to use and
+ * move the input's own offset.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "sendfile",
+                               I32,
+                               sendfile,
+                               I32 outFd,
+                               I32 inFd,
+                               I32 offsetPtr,
+                               I32 count)
+{
+    HOST_CALL(Filesystem);
+    WAVMWasmModule* module = getExecutingWAVMModule();
+    storage::FileSystem& fileSystem = module->getFileSystem();
+
+    SPDLOG_TRACE("S - sendfile - {} {} {} {}", outFd, inFd, offsetPtr, count);
+
+    if (!fileSystem.fileDescriptorExists(outFd) ||
+        !fileSystem.fileDescriptorExists(inFd)) {
+        return -1;
+    }
+
+    storage::FileDescriptor& outDesc = fileSystem.getFileDescriptor(outFd);
+    storage::FileDescriptor& inDesc = fileSystem.getFileDescriptor(inFd);
+
+    off_t* offset = nullptr;
+    if (offsetPtr != 0) {
+        offset = &Runtime::memoryRef<off_t>(module->defaultMemory, offsetPtr);
+    }
+
+    // Captured stdout has to come through the host, so stage it
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    bool isStd = outFd <= 2;
+    if (isStd && conf.captureStdout == "on") {
+        std::vector<uint8_t> buffer(count);
+        ssize_t bytesRead =
+          offset == nullptr
+            ? ::read(inDesc.getLinuxFd(), buffer.data(), count)
+            : ::pread(inDesc.getLinuxFd(), buffer.data(), count, *offset);
+        if (bytesRead < 0) {
+            return -1;
+        }
+
+        std::vector<::iovec> nativeIovecs = { { buffer.data(),
+                                                (size_t)bytesRead } };
+        ssize_t bytesWritten = outDesc.write(nativeIovecs, 1);
+        if (bytesWritten < 0) {
+            return -1;
+        }
+        module->captureStdout(nativeIovecs.data(), 1);
+
+        if (offset != nullptr) {
+            *offset += bytesWritten;
+        }
+
+        return bytesWritten;
+    }
+
+    return inDesc.sendTo(outDesc, offset, count);
+}
+
 I32 s__mkdir(I32 pathPtr, I32 mode)
 {
     const std::string fakePath = getMaskedPathFromWasm(pathPtr);
@@ -416,6 +546,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 path,
                                I32 pathLen)
 {
+    HOST_CALL(Filesystem);
     const std::string& pathStr = getStringFromWasm(path);
     SPDLOG_DEBUG("S - path_create_directory - {} {}", fd, pathStr);
 
@@ -463,6 +594,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 newPath,
                                I32 newPathLen)
 {
+    HOST_CALL(Filesystem);
     std::string oldPathStr = getStringFromWasm(oldPath);
     std::string newPathStr = getStringFromWasm(newPath);
 
@@ -492,6 +624,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 pathPtr,
                                I32 pathLen)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - path_unlink_file - {} {}", rootFd, pathPtr);
 
     std::string pathStr = getStringFromWasm(pathPtr);
@@ -567,6 +700,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 fd,
                                I32 statPtr)
 {
+    HOST_CALL(Filesystem);
 
     storage::FileSystem& fileSystem = getExecutingWAVMModule()->getFileSystem();
     std::string path = fileSystem.getPathForFd(fd);
@@ -600,6 +734,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I64 b,
                                I64 c)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - fd_fdstat_set_rights - {} {} {}", a, b, c);
 
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
@@ -637,6 +772,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 fd,
                                I32 statPtr)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - fd_filestat_get - {} {}", fd, statPtr);
 
     return doFileStat(fd, "", statPtr);
@@ -652,6 +788,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 pathLen,
                                I32 statPtr)
 {
+    HOST_CALL(Filesystem);
     const std::string& pathStr = getStringFromWasm(path);
     SPDLOG_TRACE(
       "S - path_filestat_get - {} {} {} {}", fd, lookupFlags, pathStr, statPtr);
@@ -671,6 +808,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I64 modTimeStamp,
                                I32 fstFlags)
 {
+    HOST_CALL(Filesystem);
     const std::string& pathStr = getStringFromWasm(path);
     SPDLOG_TRACE("S - path_filestat_set_times - {} {} {} {}",
                  fd,
@@ -688,6 +826,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 fd,
                                I32 resOffsetPtr)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_TRACE("S - fd_tell - {} {}", fd, resOffsetPtr);
 
     WAVMWasmModule* module = getExecutingWAVMModule();
@@ -708,6 +847,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 whence,
                                I32 newOffsetPtr)
 {
+    HOST_CALL(Filesystem);
     PROF_START(FdSeek)
     SPDLOG_TRACE("S - fd_seek - {} {} {} {}", fd, offset, whence, newOffsetPtr);
 
@@ -734,6 +874,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I64 len,
                                I32 advice)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - fd_advise - {} {} {} {}", fd, offset, len, advice);
 
     // Ignore fadvise, can't do anything useful with it.
@@ -743,6 +884,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "ioctl", I32, ioctl, I32 a, I32 b, I32 c)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - ioctl - {} {} {}", a, b, c);
 
     return 0;
@@ -753,6 +895,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env, "ioctl", I32, ioctl, I32 a, I32 b, I32 c)
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "puts", I32, puts, I32 strPtr)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - puts - {}", strPtr);
     WAVMWasmModule* module = getExecutingWAVMModule();
     Runtime::Memory* memoryPtr = module->defaultMemory;
@@ -770,6 +913,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env, "puts", I32, puts, I32 strPtr)
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "putc", I32, putc, I32 c, I32 streamPtr)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - putc - {} {}", c, streamPtr);
 
     Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
@@ -792,6 +936,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                U32 formatPtr,
                                I32 argList)
 {
+    HOST_CALL(Filesystem);
     Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
     const char* format = &Runtime::memoryRef<char>(memoryPtr, (Uptr)formatPtr);
     std::cout << "S - vfprintf - " << format << std::endl;
@@ -824,6 +969,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 buffLen,
                                I32 resBytesUsed)
 {
+    HOST_CALL(Filesystem);
     std::string pathStr = getStringFromWasm(pathPtr);
     SPDLOG_DEBUG("S - path_readlink - {} {} {} {} {}",
                  rootFd,
@@ -852,11 +998,33 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 fd,
                                I32 fdFlags)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - fd_fdstat_set_flags - {} {}", fd, fdFlags);
 
     WAVMWasmModule* module = getExecutingWAVMModule();
-    storage::FileDescriptor& fileDesc =
-      module->getFileSystem().getFileDescriptor(fd);
+    storage::FileSystem& fileSystem = module->getFileSystem();
+
+    // Sockets aren't in the file system, but can be made non-blocking
+    if (!fileSystem.fileDescriptorExists(fd)) {
+        int flags = ::fcntl(fd, F_GETFL);
+        if (flags < 0) {
+            return storage::errnoToWasi(errno);
+        }
+
+        if (fdFlags & __WASI_FDFLAG_NONBLOCK) {
+            flags |= O_NONBLOCK;
+        } else {
+            flags &= ~O_NONBLOCK;
+        }
+
+        if (::fcntl(fd, F_SETFL, flags) < 0) {
+            return storage::errnoToWasi(errno);
+        }
+
+        return __WASI_ESUCCESS;
+    }
+
+    storage::FileDescriptor& fileDesc = fileSystem.getFileDescriptor(fd);
 
     bool success = fileDesc.updateFlags(fdFlags);
     if (!success) {
@@ -868,6 +1036,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "bzero", void, bzero, I32 wasmPtr, I32 len)
 {
+    HOST_CALL(Filesystem);
     auto buffer = Runtime::memoryArrayPtr<U8>(
       getExecutingWAVMModule()->defaultMemory, wasmPtr, len);
 
@@ -881,6 +1050,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 wasmPtr,
                                I32 len)
 {
+    HOST_CALL(Filesystem);
     auto buffer = Runtime::memoryArrayPtr<U8>(
       getExecutingWAVMModule()->defaultMemory, wasmPtr, len);
 
@@ -899,6 +1069,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 b,
                                I32 c)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - __small_sprintf - {} {} {}", a, b, c);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -910,26 +1081,31 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 fdOld,
                                I32 fdNew)
 {
+    HOST_CALL(Filesystem);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "tmpfile", I32, tmpfile)
 {
+    HOST_CALL(Filesystem);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "umask", I32, umask, I32 a)
 {
+    HOST_CALL(Filesystem);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "msync", I32, msync, I32 a, I32 b, I32 c)
 {
+    HOST_CALL(Filesystem);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "tempnam", I32, tempnam, I32 a, I32 b)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_TRACE("S - tempnam - {} {}", a, b);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -941,21 +1117,25 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 a,
                                I32 b)
 {
+    HOST_CALL(Filesystem);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "setgroups", I32, setgroups, I32 a, I32 b)
 {
+    HOST_CALL(Filesystem);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "fchdir", I32, s__fchdir, I32 a)
 {
+    HOST_CALL(Filesystem);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "chmod", I32, s__chmod, I32 a, I32 b)
 {
+    HOST_CALL(Filesystem);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -963,35 +1143,18 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                "fd_datasync",
                                I32,
                                wasi_fd_datasync,
-                               I32 a)
+                               I32 fd)
 {
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
-}
+    HOST_CALL(Filesystem);
+    SPDLOG_TRACE("S - fd_datasync - {}", fd);
 
-WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
-                               "fd_pwrite",
-                               I32,
-                               wasi_fd_pwrite,
-                               I32 a,
-                               I32 b,
-                               I32 c,
-                               I64 d,
-                               I32 e)
-{
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
-}
+    storage::FileDescriptor& fileDesc =
+      getExecutingWAVMModule()->getFileSystem().getFileDescriptor(fd);
+    if (!fileDesc.sync()) {
+        return fileDesc.getWasiErrno();
+    }
 
-WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
-                               "fd_pread",
-                               I32,
-                               wasi_fd_pread,
-                               I32 a,
-                               I32 b,
-                               I32 c,
-                               I64 d,
-                               I32 e)
-{
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+    return __WASI_ESUCCESS;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
@@ -1001,12 +1164,22 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 a,
                                I64 b)
 {
+    HOST_CALL(Filesystem);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
-WAVM_DEFINE_INTRINSIC_FUNCTION(wasi, "fd_sync", I32, wasi_fd_sync, I32 a)
+WAVM_DEFINE_INTRINSIC_FUNCTION(wasi, "fd_sync", I32, wasi_fd_sync, I32 fd)
 {
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+    HOST_CALL(Filesystem);
+    SPDLOG_TRACE("S - fd_sync - {}", fd);
+
+    storage::FileDescriptor& fileDesc =
+      getExecutingWAVMModule()->getFileSystem().getFileDescriptor(fd);
+    if (!fileDesc.sync()) {
+        return fileDesc.getWasiErrno();
+    }
+
+    return __WASI_ESUCCESS;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
@@ -1017,6 +1190,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I64 b,
                                I64 c)
 {
+    HOST_CALL(Filesystem);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -1029,6 +1203,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I64 c,
                                I32 d)
 {
+    HOST_CALL(Filesystem);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -1044,6 +1219,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 f,
                                I32 g)
 {
+    HOST_CALL(Filesystem);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -1057,6 +1233,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 d,
                                I32 e)
 {
+    HOST_CALL(Filesystem);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -1068,11 +1245,13 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 b,
                                I32 c)
 {
+    HOST_CALL(Filesystem);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "lockf", I32, lockf, I32 a, I32 b, I64 c)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - lockf - {} {} {}", a, b, c);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -1085,39 +1264,37 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 b,
                                I32 c)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - strncat - {} {} {}", a, b, c);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "realpath", I32, realpath, I32 a, U32 b)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - realpath - {} {}", a, b);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "dirfd", I32, dirfd, I32 a)
 {
+    HOST_CALL(Filesystem);
     SPDLOG_DEBUG("S - dirfd - {}", a);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
-WAVM_DEFINE_INTRINSIC_FUNCTION(env, "poll", I32, poll, I32 a, I32 b, I32 c)
-{
-    SPDLOG_DEBUG("S - poll - {} {} {}", a, b, c);
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
-}
-
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "sendfile",
+                               "poll",
                                I32,
-                               sendfile,
-                               I32 out_fd,
-                               I32 in_fd,
-                               I32 offset,
-                               I32 count)
+                               poll,
+                               I32 fdsPtr,
+                               I32 nfds,
+                               I32 timeout)
 {
-    SPDLOG_DEBUG("S - sendfile - {} {} {} {}", out_fd, in_fd, offset, count);
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+    HOST_CALL(Filesystem);
+    // Called as a libc function, which can't set the guest's errno
+    I32 result = s__poll(fdsPtr, nfds, timeout);
+    return result < 0 ? -1 : result;
 }
 
 // Emscripten-specific functions
@@ -1129,6 +1306,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 b,
                                I32 c)
 {
+    HOST_CALL(Filesystem);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -1,5 +1,6 @@
 #include "WAVMWasmModule.h"
 #include "syscalls.h"
+#include <wasm/call_metrics.h>
 
 #include <faabric/util/logging.h>
 
@@ -15,6 +16,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                _Unwind_RaiseException,
                                I32 a)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - _Unwind_RaiseException - {}", a);
     return 0;
 }
@@ -25,6 +27,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                _Unwind_DeleteException,
                                I32 a)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - _Unwind_DeleteException - {}", a);
 }
 
@@ -40,6 +43,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                __cxa_begin_catch,
                                I32 a)
 {
+    HOST_CALL(Other);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -49,6 +53,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                __cxa_allocate_exception,
                                I32 a)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - __cxa_allocate_exception - {}", a);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -61,6 +66,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 b,
                                I32 c)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - __cxa_throw - {} {} {}", a, b, c);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -1,7 +1,10 @@
 #include "WAVMWasmModule.h"
 #include "syscalls.h"
+#include <wasm/call_metrics.h>
+#include <wasm/state_replicas.h>
 
 #include <linux/membarrier.h>
+#include <sys/mman.h>
 
 #include <WAVM/Runtime/Intrinsics.h>
 #include <WAVM/Runtime/Runtime.h>
@@ -46,8 +49,8 @@ std::shared_ptr<faabric::state::StateKeyValue> getStateKV(I32 keyPtr,
 {
     const std::pair<std::string, std::string> userKey =
       getUserKeyPairFromWasm(keyPtr);
-    faabric::state::State& s = faabric::state::getGlobalState();
-    auto kv = s.getKV(userKey.first, userKey.second, size);
+    auto kv =
+      getStateReplicaCache().getKV(userKey.first, userKey.second, size);
 
     return kv;
 }
@@ -56,25 +59,18 @@ std::shared_ptr<faabric::state::StateKeyValue> getStateKV(I32 keyPtr)
 {
     const std::pair<std::string, std::string> userKey =
       getUserKeyPairFromWasm(keyPtr);
-    faabric::state::State& s = faabric::state::getGlobalState();
-    auto kv = s.getKV(userKey.first, userKey.second);
+    auto kv = getStateReplicaCache().getKV(userKey.first, userKey.second);
 
     return kv;
 }
 
-I32 doMmap(I32 addr, I32 length, I32 prot, I32 flags, I32 fd, I32 offset)
+I32 doMmap(I32 addr, I32 length, I32 prot, I32 flags, I32 fd, I64 offset)
 {
 
     SPDLOG_TRACE(
       "S - mmap - {} {} {} {} {} {}", addr, length, prot, flags, fd, offset);
 
-    // Although we are ignoring the offset we should probably
-    // double check when something explicitly requests one
-    if (offset != 0) {
-        SPDLOG_WARN("WARNING: ignoring non-zero mmap offset ({})", offset);
-    }
-
-    // Likewise with the address hint
+    // We don't support fixed addresses, so ignore the hint
     if (addr != 0) {
         SPDLOG_WARN("WARNING: ignoring mmap hint at {}", addr);
     }
@@ -85,22 +81,32 @@ I32 doMmap(I32 addr, I32 length, I32 prot, I32 flags, I32 fd, I32 offset)
         // If fd is provided, we're mapping a file into memory
         storage::FileDescriptor& fileDesc =
           module->getFileSystem().getFileDescriptor(fd);
-        return module->mmapFile(fileDesc.getLinuxFd(), length);
+        return module->mmapFile(
+          fileDesc.getLinuxFd(), length, prot, flags, offset);
     } else {
+        // The offset is meaningless without a file
+        if (offset != 0) {
+            SPDLOG_WARN("WARNING: ignoring non-zero mmap offset ({})", offset);
+        }
+
         // Map memory
         return module->mmapMemory(length);
     }
 }
 
+I32 s__mmap(I32 addr, I32 length, I32 prot, I32 flags, I32 fd, I32 offset)
+{
+    return doMmap(addr, length, prot, flags, fd, (U32)offset);
+}
+
 /**
  * Note that syscall 192 is mmap2, which has the same interface as mmap except
  * that the final argument specifies the offset into the file in 4096-byte units
- * (instead of bytes, as is done by mmap). Given that we ignore the offset we
- * can just treat it like mmap
+ * (instead of bytes, as is done by mmap)
  */
-I32 s__mmap(I32 addr, I32 length, I32 prot, I32 flags, I32 fd, I32 offset)
+I32 s__mmap2(I32 addr, I32 length, I32 prot, I32 flags, I32 fd, I32 offset)
 {
-    return doMmap(addr, length, prot, flags, fd, offset);
+    return doMmap(addr, length, prot, flags, fd, ((I64)(U32)offset) * 4096);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -114,7 +120,51 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 fd,
                                I64 offset)
 {
-    return doMmap(addr, length, prot, flags, fd, (I32)offset);
+    HOST_CALL(Memory);
+    return doMmap(addr, length, prot, flags, fd, offset);
+}
+
+I32 s__mremap(I32 oldAddr, I32 oldSize, I32 newSize, I32 flags, I32 newAddr)
+{
+    SPDLOG_TRACE("S - mremap - {} {} {} {} {}",
+                 oldAddr,
+                 oldSize,
+                 newSize,
+                 flags,
+                 newAddr);
+
+    // As with mmap, we place mappings ourselves
+    if ((flags & ~MREMAP_MAYMOVE) != 0) {
+        SPDLOG_WARN("Unsupported mremap flags {}", flags);
+        return -EINVAL;
+    }
+
+    WAVMWasmModule* module = getExecutingWAVMModule();
+    if (!module->canRemapMemory(oldAddr, (U32)oldSize, (U32)newSize)) {
+        return -EINVAL;
+    }
+
+    uint32_t res = module->remapMemory(
+      oldAddr, (U32)oldSize, (U32)newSize, (flags & MREMAP_MAYMOVE) != 0);
+    if (res == REMAP_MEMORY_FAILED) {
+        return -ENOMEM;
+    }
+
+    return res;
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "mremap",
+                               I32,
+                               wasi_mremap,
+                               I32 oldAddr,
+                               I32 oldSize,
+                               I32 newSize,
+                               I32 flags,
+                               I32 newAddr)
+{
+    HOST_CALL(Memory);
+    return s__mremap(oldAddr, oldSize, newSize, flags, newAddr);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -124,6 +174,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 addr,
                                I32 length)
 {
+    HOST_CALL(Memory);
 
     SPDLOG_DEBUG("S - munmap - {} {}", addr, length);
 
@@ -146,6 +197,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__sbrk", I32, __sbrk, I32 increment)
 {
+    HOST_CALL(Memory);
     SPDLOG_TRACE("S - sbrk - {}", increment);
 
     WAVMWasmModule* module = getExecutingWAVMModule();
@@ -180,6 +232,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 b,
                                I32 c)
 {
+    HOST_CALL(Memory);
     SPDLOG_DEBUG("S - shm_open - {} {} {}", a, b, c);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -1,5 +1,6 @@
 #include "WAVMWasmModule.h"
 #include "syscalls.h"
+#include <wasm/call_metrics.h>
 
 #include <WAVM/Runtime/Intrinsics.h>
 
@@ -8,11 +9,13 @@ using namespace WAVM;
 namespace wasm {
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "gettext", I32, s__gettext, I32 a)
 {
+    HOST_CALL(Other);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "dgettext", I32, s__dgettext, I32 a, I32 b)
 {
+    HOST_CALL(Other);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -24,11 +27,13 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 b,
                                I32 c)
 {
+    HOST_CALL(Other);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "textdomain", I32, s__textdomain, I32 a)
 {
+    HOST_CALL(Other);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -39,6 +44,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 a,
                                I32 b)
 {
+    HOST_CALL(Other);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
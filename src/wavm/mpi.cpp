@@ -2,6 +2,19 @@
 #include "syscalls.h"
 
 #include <wasm/WasmModule.h>
+#include <wasm/call_metrics.h>
+#include <wasm/mpi_collectives.h>
+#include <wasm/mpi_comm.h>
+#include <wasm/mpi_core.h>
+#include <wasm/mpi_file.h>
+#include <wasm/mpi_mem.h>
+#include <wasm/mpi_ops.h>
+#include <wasm/mpi_profile.h>
+#include <wasm/mpi_progress.h>
+#include <wasm/mpi_rendezvous.h>
+#include <wasm/mpi_requests.h>
+#include <wasm/mpi_types.h>
+#include <wasm/mpi_window.h>
 #include <wavm/WAVMWasmModule.h>
 
 #include <WAVM/Runtime/Intrinsics.h>
@@ -14,14 +27,24 @@
 #include <faabric/util/gids.h>
 #include <faabric/util/logging.h>
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <tuple>
+#include <vector>
+
 using namespace faabric::mpi;
 using namespace faabric::scheduler;
 using namespace WAVM;
 
 #define MPI_FUNC(str)                                                          \
+    HOST_CALL(Mpi);                                                            \
+    MpiProfileTimer mpiProfileTimer(str);                                      \
     SPDLOG_TRACE("MPI-{} {}", executingContext.getRank(), str);
 
 #define MPI_FUNC_ARGS(formatStr, ...)                                          \
+    HOST_CALL(Mpi);                                                            \
+    MpiProfileTimer mpiProfileTimer(formatStr);                                \
     SPDLOG_TRACE("MPI-{} " formatStr, executingContext.getRank(), __VA_ARGS__);
 
 namespace wasm {
@@ -34,22 +57,27 @@ bool isInPlace(U8 wasmPtr)
 
 MpiWorld& getExecutingWorld()
 {
+    // A rank that's been migrated here didn't call MPI_Init on this host
+    faabric::Message& msg = ExecutorContext::get()->getMsg();
+    if (msg.ismpi() && executingContext.getWorldId() != msg.mpiworldid()) {
+        executingContext.joinWorld(msg);
+    }
+
     MpiWorldRegistry& reg = getMpiWorldRegistry();
     return reg.getWorld(executingContext.getWorldId());
 }
 
 /**
- * Convenience wrapper around the MPI context for use in the syscalls in this
- * file.
+ * Decodes the guest's arguments for the shared MPI core, for use in the
+ * syscalls in this file.
  */
-class ContextWrapper
+class ContextWrapper : public MpiCore
 {
   public:
     explicit ContextWrapper()
-      : module(getExecutingWAVMModule())
+      : MpiCore(getExecutingWorld(), executingContext.getRank())
+      , module(getExecutingWAVMModule())
       , memory(module->defaultMemory)
-      , world(getExecutingWorld())
-      , rank(executingContext.getRank())
     {}
 
     void checkMpiComm(I32 wasmPtr)
@@ -63,13 +91,75 @@ class ContextWrapper
         }
     }
 
-    faabric_datatype_t* getFaasmDataType(I32 wasmPtr)
+    int getCommId(I32 wasmPtr)
+    {
+        faabric_communicator_t* hostComm =
+          &Runtime::memoryRef<faabric_communicator_t>(memory, wasmPtr);
+        return hostComm->id;
+    }
+
+    MpiCommunicator& getComm(I32 wasmPtr)
+    {
+        return getCommunicator(getCommId(wasmPtr));
+    }
+
+    // Null for MPI_IN_PLACE, as the core expects
+    uint8_t* getMpiSendBuffer(I32 wasmPtr,
+                              faabric_datatype_t* type,
+                              int count)
+    {
+        if (isInPlace(wasmPtr)) {
+            return nullptr;
+        }
+
+        return getMpiBuffer(wasmPtr, type, count);
+    }
+
+    // Allocates a communicator in wasm memory and writes its offset to the
+    // given MPI_Comm
+    void writeNewComm(I32 newCommPtr, int commId)
+    {
+        U32 commPtr = module->mmapMemory(sizeof(faabric_communicator_t));
+        faabric_communicator_t* hostComm =
+          &Runtime::memoryRef<faabric_communicator_t>(memory, commPtr);
+        hostComm->id = commId;
+
+        writeMpiResult<I32>(newCommPtr, commPtr);
+    }
+
+    /**
+     * Derived types with gaps need packing, so calls that can do so have to
+     * ask for them explicitly (see MpiTypeBuffer).
+     */
+    faabric_datatype_t* getFaasmDataType(I32 wasmPtr, bool allowGaps = false)
     {
         faabric_datatype_t* hostDataType =
           &Runtime::memoryRef<faabric_datatype_t>(memory, wasmPtr);
+
+        if (!allowGaps && isMpiDerivedType(hostDataType)) {
+            SPDLOG_ERROR("MPI datatype {} with gaps not supported here",
+                         hostDataType->id);
+            throw std::runtime_error("MPI datatype with gaps not supported");
+        }
+
         return hostDataType;
     }
 
+    uint8_t* getMpiBuffer(I32 wasmPtr, faabric_datatype_t* type, int count)
+    {
+        return Runtime::memoryArrayPtr<uint8_t>(
+          memory, wasmPtr, getMpiTypeSpan(type, count));
+    }
+
+    void writeNewDataType(I32 newDatatypePtr, const MpiTypeLayout& layout)
+    {
+        U32 typePtr = module->mmapMemory(sizeof(faabric_datatype_t));
+        faabric_datatype_t* hostType = getFaasmDataType(typePtr, true);
+        createMpiDerivedType(typePtr, layout, hostType);
+
+        writeMpiResult<I32>(newDatatypePtr, typePtr);
+    }
+
     /**
      * We use a trick here to avoid allocating extra memory. Rather than create
      * an actual struct for the MPI_Request, we just use the pointer to hold the
@@ -86,8 +176,7 @@ class ContextWrapper
      */
     I32 getFaasmRequestId(I32 requestPtrPtr)
     {
-        I32 requestId = Runtime::memoryRef<I32>(
-          getExecutingWAVMModule()->defaultMemory, requestPtrPtr);
+        I32 requestId = Runtime::memoryRef<I32>(memory, requestPtrPtr);
         return requestId;
     }
 
@@ -114,11 +203,9 @@ class ContextWrapper
 
     WAVMWasmModule* module;
     Runtime::Memory* memory;
-    MpiWorld& world;
-    int rank;
 };
 
-static thread_local std::unique_ptr<ContextWrapper> ctx = nullptr;
+static thread_local MpiContextCache<ContextWrapper> ctx;
 
 /**
  * Sets up the MPI world. Arguments are argc/argv which are NULL, NULL in our
@@ -126,6 +213,7 @@ static thread_local std::unique_ptr<ContextWrapper> ctx = nullptr;
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "MPI_Init", I32, MPI_Init, I32 a, I32 b)
 {
+    HOST_CALL(Mpi);
     faabric::Message* call = &ExecutorContext::get()->getMsg();
 
     // Note - only want to initialise the world on rank zero (or when rank isn't
@@ -143,7 +231,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env, "MPI_Init", I32, MPI_Init, I32 a, I32 b)
         executingContext.joinWorld(*call);
     }
 
-    ctx = std::make_unique<ContextWrapper>();
+    ctx.build();
 
     return 0;
 }
@@ -179,8 +267,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 {
     MPI_FUNC_ARGS("S - MPI_Comm_size {} {}", comm, resPtr);
 
-    ctx->checkMpiComm(comm);
-    ctx->writeMpiResult<int>(resPtr, ctx->world.getSize());
+    ctx->writeMpiResult<int>(resPtr, ctx->getComm(comm).getSize());
 
     return MPI_SUCCESS;
 }
@@ -197,16 +284,13 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 {
     MPI_FUNC_ARGS("S - MPI_Comm_rank {} {}", comm, resPtr);
 
-    ctx->checkMpiComm(comm);
-    ctx->writeMpiResult<int>(resPtr, ctx->rank);
+    ctx->writeMpiResult<int>(resPtr, ctx->getComm(comm).getRank());
 
     return MPI_SUCCESS;
 }
 
 /**
  * Duplicates an existing communicator with all its cached information.
- *
- * TODO not implemented.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "MPI_Comm_dup",
@@ -217,7 +301,9 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 {
     MPI_FUNC_ARGS("S - MPI_Comm_dup {} {}", comm, newComm);
 
-    throw std::runtime_error("MPI_Comm_dup not implemented!");
+    int parentId = ctx->getComm(comm).getId();
+    int commId = dupMpiCommunicator(ctx->world, ctx->rank, parentId);
+    ctx->writeNewComm(newComm, commId);
 
     return MPI_SUCCESS;
 }
@@ -233,15 +319,22 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 {
     MPI_FUNC_ARGS("S - MPI_Comm_free {}", comm);
 
-    // Dealoccation is handled outside of MPI.
+    // The guest passes an MPI_Comm*, which we set to null. Any communicator
+    // allocated in wasm memory is left, as it's tiny
+    I32 commPtr = Runtime::memoryRef<I32>(ctx->memory, comm);
+    if (commPtr != 0) {
+        faabric_communicator_t* hostComm =
+          &Runtime::memoryRef<faabric_communicator_t>(ctx->memory, commPtr);
+        freeMpiCommunicator(hostComm->id);
+        ctx->writeMpiResult<I32>(comm, 0);
+    }
 
     return MPI_SUCCESS;
 }
 
 /**
- * Creates new communicators based on colors and keys.
- *
- * TODO not implemented.
+ * Creates new communicators based on colors and keys. Ranks passing
+ * MPI_UNDEFINED as their color get a null communicator.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "MPI_Comm_split",
@@ -254,7 +347,14 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 {
     MPI_FUNC_ARGS("S - MPI_Comm_split {} {} {} {}", comm, color, key, newComm);
 
-    throw std::runtime_error("MPI_Comm_split not implemented!");
+    int parentId = ctx->getComm(comm).getId();
+    int commId =
+      splitMpiCommunicator(ctx->world, ctx->rank, parentId, color, key);
+    if (commId < 0) {
+        ctx->writeMpiResult<I32>(newComm, 0);
+    } else {
+        ctx->writeNewComm(newComm, commId);
+    }
 
     return MPI_SUCCESS;
 }
@@ -319,12 +419,14 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                   tag,
                   comm);
 
-    ctx->checkMpiComm(comm);
-    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
-    auto inputs = Runtime::memoryArrayPtr<uint8_t>(ctx->memory, buffer, count);
-    ctx->world.send(ctx->rank, destRank, inputs, hostDtype, count);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    ctx->send(ctx->getMpiBuffer(buffer, hostDtype, count),
+              count,
+              hostDtype,
+              destRank,
+              ctx->getCommId(comm));
 
-    return 0;
+    return MPI_SUCCESS;
 }
 
 /**
@@ -357,11 +459,9 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 
 int terminateMpi()
 {
-    // Destroy the MPI world
-    ctx->world.destroy();
+    ctx->finalize();
 
-    // Null-out the context
-    ctx = nullptr;
+    ctx.reset();
 
     return MPI_SUCCESS;
 }
@@ -390,12 +490,12 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                   comm,
                   requestPtrPtr);
 
-    ctx->checkMpiComm(comm);
-    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
-
-    auto inputs = Runtime::memoryArrayPtr<uint8_t>(ctx->memory, buffer, count);
-    int requestId =
-      ctx->world.isend(ctx->rank, destRank, inputs, hostDtype, count);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    int requestId = ctx->isend(ctx->getMpiBuffer(buffer, hostDtype, count),
+                               count,
+                               hostDtype,
+                               destRank,
+                               ctx->getCommId(comm));
 
     ctx->writeFaasmRequestId(requestPtrPtr, requestId);
 
@@ -413,6 +513,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 datatype,
                                I32 countPtr)
 {
+    HOST_CALL(Mpi);
     SPDLOG_TRACE("S - MPI_Get_count {} {} {}", statusPtr, datatype, countPtr);
 
     MPI_Status* status =
@@ -455,14 +556,17 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                   comm,
                   statusPtr);
 
-    ctx->checkMpiComm(comm);
     MPI_Status* status =
       &Runtime::memoryRef<MPI_Status>(ctx->memory, statusPtr);
-    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
-    auto outputs = Runtime::memoryArrayPtr<uint8_t>(ctx->memory, buffer, count);
-    ctx->world.recv(sourceRank, ctx->rank, outputs, hostDtype, count, status);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    ctx->recv(ctx->getMpiBuffer(buffer, hostDtype, count),
+              count,
+              hostDtype,
+              sourceRank,
+              ctx->getCommId(comm),
+              status);
 
-    return 0;
+    return MPI_SUCCESS;
 }
 
 /**
@@ -499,26 +603,21 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                   comm,
                   statusPtr);
 
-    ctx->checkMpiComm(comm);
-    faabric_datatype_t* hostSendDtype = ctx->getFaasmDataType(sendType);
-    faabric_datatype_t* hostRecvDtype = ctx->getFaasmDataType(recvType);
+    faabric_datatype_t* hostSendDtype = ctx->getFaasmDataType(sendType, true);
+    faabric_datatype_t* hostRecvDtype = ctx->getFaasmDataType(recvType, true);
     MPI_Status* status =
       &Runtime::memoryRef<MPI_Status>(ctx->memory, statusPtr);
-    auto hostSendBuffer = Runtime::memoryArrayPtr<uint8_t>(
-      ctx->memory, sendBuf, sendCount * hostSendDtype->size);
-    auto hostRecvBuffer = Runtime::memoryArrayPtr<uint8_t>(
-      ctx->memory, recvBuf, recvCount * hostRecvDtype->size);
 
-    ctx->world.sendRecv(hostSendBuffer,
-                        sendCount,
-                        hostSendDtype,
-                        destination,
-                        hostRecvBuffer,
-                        recvCount,
-                        hostRecvDtype,
-                        source,
-                        ctx->rank,
-                        status);
+    ctx->sendRecv(ctx->getMpiBuffer(sendBuf, hostSendDtype, sendCount),
+                  sendCount,
+                  hostSendDtype,
+                  destination,
+                  ctx->getMpiBuffer(recvBuf, hostRecvDtype, recvCount),
+                  recvCount,
+                  hostRecvDtype,
+                  source,
+                  ctx->getCommId(comm),
+                  status);
 
     return MPI_SUCCESS;
 }
@@ -547,17 +646,127 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                   comm,
                   requestPtrPtr);
 
-    ctx->checkMpiComm(comm);
-    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
-    auto outputs = Runtime::memoryArrayPtr<uint8_t>(ctx->memory, buffer, count);
-    int requestId =
-      ctx->world.irecv(sourceRank, ctx->rank, outputs, hostDtype, count);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    int requestId = ctx->irecv(ctx->getMpiBuffer(buffer, hostDtype, count),
+                               count,
+                               hostDtype,
+                               sourceRank,
+                               ctx->getCommId(comm));
+
+    ctx->writeFaasmRequestId(requestPtrPtr, requestId);
+
+    return MPI_SUCCESS;
+}
+
+/**
+ * Creates a persistent send, which MPI_Start begins each time.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "MPI_Send_init",
+                               I32,
+                               MPI_Send_init,
+                               I32 buffer,
+                               I32 count,
+                               I32 datatype,
+                               I32 destRank,
+                               I32 tag,
+                               I32 comm,
+                               I32 requestPtrPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Send_init {} {} {} {} {} {} {}",
+                  buffer,
+                  count,
+                  datatype,
+                  destRank,
+                  tag,
+                  comm,
+                  requestPtrPtr);
+
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    int requestId = ctx->sendInit(ctx->getMpiBuffer(buffer, hostDtype, count),
+                                  count,
+                                  hostDtype,
+                                  destRank,
+                                  ctx->getCommId(comm));
 
     ctx->writeFaasmRequestId(requestPtrPtr, requestId);
 
     return MPI_SUCCESS;
 }
 
+/**
+ * Creates a persistent receive, which MPI_Start begins each time.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "MPI_Recv_init",
+                               I32,
+                               MPI_Recv_init,
+                               I32 buffer,
+                               I32 count,
+                               I32 datatype,
+                               I32 sourceRank,
+                               I32 tag,
+                               I32 comm,
+                               I32 requestPtrPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Recv_init {} {} {} {} {} {} {}",
+                  buffer,
+                  count,
+                  datatype,
+                  sourceRank,
+                  tag,
+                  comm,
+                  requestPtrPtr);
+
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    int requestId = ctx->recvInit(ctx->getMpiBuffer(buffer, hostDtype, count),
+                                  count,
+                                  hostDtype,
+                                  sourceRank,
+                                  ctx->getCommId(comm));
+
+    ctx->writeFaasmRequestId(requestPtrPtr, requestId);
+
+    return MPI_SUCCESS;
+}
+
+/**
+ * Starts a persistent request, to be waited on like any other.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "MPI_Start",
+                               I32,
+                               MPI_Start,
+                               I32 requestPtrPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Start {}", requestPtrPtr);
+
+    startMpiPersistentRequest(ctx->getFaasmRequestId(requestPtrPtr));
+
+    return MPI_SUCCESS;
+}
+
+/**
+ * Starts all the given persistent requests.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "MPI_Startall",
+                               I32,
+                               MPI_Startall,
+                               I32 count,
+                               I32 requestArray)
+{
+    MPI_FUNC_ARGS("S - MPI_Startall {} {}", count, requestArray);
+
+    I32* requests =
+      Runtime::memoryArrayPtr<I32>(ctx->memory, requestArray, count);
+    for (int i = 0; i < count; i++) {
+        startMpiPersistentRequest(requests[i]);
+    }
+
+    return MPI_SUCCESS;
+}
+
 /**
  * Waits for the asynchronous request to complete
  */
@@ -568,17 +777,17 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 requestPtrPtr,
                                I32 status)
 {
-    int requestId = ctx->getFaasmRequestId(requestPtrPtr);
+    MPI_FUNC_ARGS("S - MPI_Wait {} {}", requestPtrPtr, status);
 
-    MPI_FUNC_ARGS("S - MPI_Wait {} {}", requestPtrPtr, requestId);
-    ctx->world.awaitAsyncRequest(requestId);
+    int requestId = ctx->getFaasmRequestId(requestPtrPtr);
+    awaitAllMpiRequests(ctx->world, { requestId });
 
     return MPI_SUCCESS;
 }
 
 /**
- * Waits for all given communications to complete
- * TODO not implemented
+ * Waits for all given communications to complete, and sets the requests to
+ * null, apart from persistent ones.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "MPI_Waitall",
@@ -590,14 +799,23 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 {
     MPI_FUNC_ARGS("S - MPI_Waitall {} {} {}", count, requestArray, statusArray);
 
-    throw std::runtime_error("MPI_Waitall is not implemented!");
+    I32* requests =
+      Runtime::memoryArrayPtr<I32>(ctx->memory, requestArray, count);
+    std::vector<int> requestIds(requests, requests + count);
+
+    awaitAllMpiRequests(ctx->world, requestIds);
+    for (int i = 0; i < count; i++) {
+        if (!isMpiPersistentRequest(requestIds.at(i))) {
+            requests[i] = 0;
+        }
+    }
 
     return MPI_SUCCESS;
 }
 
 /**
- * Waits for any specified send or receive to complete
- * TODO not implemented
+ * Waits for any specified send or receive to complete, and sets its request
+ * to null. The index is -1 if all the requests are null.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "MPI_Waitany",
@@ -611,7 +829,17 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     MPI_FUNC_ARGS(
       "S - MPI_Waitany {} {} {} {}", count, requestArray, idx, status);
 
-    throw std::runtime_error("MPI_Waitany is not implemented!");
+    I32* requests =
+      Runtime::memoryArrayPtr<I32>(ctx->memory, requestArray, count);
+    std::vector<int> requestIds(requests, requests + count);
+
+    int completedIdx = awaitAnyMpiRequest(ctx->world, requestIds);
+    if (completedIdx >= 0 &&
+        !isMpiPersistentRequest(requestIds.at(completedIdx))) {
+        requests[completedIdx] = 0;
+    }
+
+    ctx->writeMpiResult<I32>(idx, completedIdx);
 
     return MPI_SUCCESS;
 }
@@ -645,6 +873,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     ctx->checkMpiComm(comm);
     MPI_Status* status =
       &Runtime::memoryRef<MPI_Status>(ctx->memory, statusPtr);
+    awaitMpiCollectives();
     ctx->world.probe(source, ctx->rank, status);
 
     return MPI_SUCCESS;
@@ -667,17 +896,46 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     MPI_FUNC_ARGS(
       "S - MPI_Bcast {} {} {} {} {}", buffer, count, datatype, root, comm);
 
-    ctx->checkMpiComm(comm);
-    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
-    auto inputs = Runtime::memoryArrayPtr<uint8_t>(
-      ctx->memory, buffer, count * hostDtype->size);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    ctx->broadcast(ctx->getMpiBuffer(buffer, hostDtype, count),
+                   count,
+                   hostDtype,
+                   root,
+                   ctx->getCommId(comm));
 
-    ctx->world.broadcast(root,
-                         ctx->rank,
-                         inputs,
-                         hostDtype,
-                         count,
-                         faabric::mpi::MPIMessage::BROADCAST);
+    return MPI_SUCCESS;
+}
+
+/**
+ * Non-blocking broadcast, completed by waiting on the request.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "MPI_Ibcast",
+                               I32,
+                               MPI_Ibcast,
+                               I32 buffer,
+                               I32 count,
+                               I32 datatype,
+                               I32 root,
+                               I32 comm,
+                               I32 requestPtrPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Ibcast {} {} {} {} {} {}",
+                  buffer,
+                  count,
+                  datatype,
+                  root,
+                  comm,
+                  requestPtrPtr);
+
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    int requestId = ctx->ibroadcast(ctx->getMpiBuffer(buffer, hostDtype, count),
+                                    count,
+                                    hostDtype,
+                                    root,
+                                    ctx->getCommId(comm));
+
+    ctx->writeFaasmRequestId(requestPtrPtr, requestId);
 
     return MPI_SUCCESS;
 }
@@ -690,8 +948,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env, "MPI_Barrier", I32, MPI_Barrier, I32 comm)
 {
     MPI_FUNC_ARGS("S - MPI_Barrier {}", comm);
 
-    ctx->checkMpiComm(comm);
-    ctx->world.barrier(ctx->rank);
+    ctx->barrier(ctx->getCommId(comm));
 
     return MPI_SUCCESS;
 }
@@ -731,6 +988,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     auto hostRecvBuffer = Runtime::memoryArrayPtr<uint8_t>(
       ctx->memory, recvBuf, recvCount * hostRecvDtype->size);
 
+    awaitMpiCollectives();
     ctx->world.scatter(root,
                        ctx->rank,
                        hostSendBuffer,
@@ -783,6 +1041,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
           ctx->memory, sendBuf, sendCount * hostSendDtype->size);
     }
 
+    awaitMpiCollectives();
     ctx->world.gather(ctx->rank,
                       root,
                       hostSendBuffer,
@@ -820,29 +1079,19 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                   recvType,
                   comm);
 
-    ctx->checkMpiComm(comm);
     faabric_datatype_t* hostSendDtype = ctx->getFaasmDataType(sendType);
     faabric_datatype_t* hostRecvDtype = ctx->getFaasmDataType(recvType);
-
-    auto hostRecvBuffer = Runtime::memoryArrayPtr<uint8_t>(
-      ctx->memory, recvBuf, recvCount * hostRecvDtype->size);
-
-    // Check if we're in-place
-    uint8_t* hostSendBuffer;
-    if (isInPlace(sendBuf)) {
-        hostSendBuffer = hostRecvBuffer;
-    } else {
-        hostSendBuffer = Runtime::memoryArrayPtr<uint8_t>(
-          ctx->memory, sendBuf, sendCount * hostSendDtype->size);
-    }
-
-    ctx->world.allGather(ctx->rank,
-                         hostSendBuffer,
-                         hostSendDtype,
-                         sendCount,
-                         hostRecvBuffer,
-                         hostRecvDtype,
-                         recvCount);
+    int commSize = ctx->getComm(comm).getSize();
+    uint8_t* hostRecvBuffer =
+      ctx->getMpiBuffer(recvBuf, hostRecvDtype, commSize * recvCount);
+
+    ctx->allGather(ctx->getMpiSendBuffer(sendBuf, hostSendDtype, sendCount),
+                   sendCount,
+                   hostSendDtype,
+                   hostRecvBuffer,
+                   recvCount,
+                   hostRecvDtype,
+                   ctx->getCommId(comm));
 
     return MPI_SUCCESS;
 }
@@ -850,8 +1099,6 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 /**
  * Gathers data from all processes and delivers it to all. Each process may
  * contribute a different amount of data.
- *
- * TODO not implemented.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "MPI_Allgatherv",
@@ -861,7 +1108,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 sendCount,
                                I32 sendType,
                                I32 recvBuf,
-                               I32 recvCount,
+                               I32 recvCounts,
                                I32 dspls,
                                I32 recvType,
                                I32 comm)
@@ -871,16 +1118,126 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                   sendCount,
                   sendType,
                   recvBuf,
-                  recvCount,
+                  recvCounts,
                   dspls,
                   recvType,
                   comm);
 
-    throw std::runtime_error("MPI_Allgatherv not implemented!");
+    ctx->checkMpiComm(comm);
+    faabric_datatype_t* hostSendDtype = ctx->getFaasmDataType(sendType);
+    faabric_datatype_t* hostRecvDtype = ctx->getFaasmDataType(recvType);
+
+    int worldSize = ctx->world.getSize();
+    I32* hostRecvCounts =
+      Runtime::memoryArrayPtr<I32>(ctx->memory, recvCounts, worldSize);
+    I32* hostDispls =
+      Runtime::memoryArrayPtr<I32>(ctx->memory, dspls, worldSize);
+
+    size_t recvSize = 0;
+    for (int r = 0; r < worldSize; r++) {
+        recvSize = std::max<size_t>(
+          recvSize, (hostDispls[r] + hostRecvCounts[r]) * hostRecvDtype->size);
+    }
+    uint8_t* hostRecvBuffer =
+      Runtime::memoryArrayPtr<uint8_t>(ctx->memory, recvBuf, recvSize);
+
+    uint8_t* hostSendBuffer = nullptr;
+    if (!isInPlace(sendBuf)) {
+        hostSendBuffer = Runtime::memoryArrayPtr<uint8_t>(
+          ctx->memory, sendBuf, sendCount * hostSendDtype->size);
+    }
+
+    mpiAllGatherV(ctx->world,
+                  ctx->rank,
+                  hostSendBuffer,
+                  sendCount,
+                  hostSendDtype,
+                  hostRecvBuffer,
+                  hostRecvCounts,
+                  hostDispls,
+                  hostRecvDtype);
 
     return MPI_SUCCESS;
 }
 
+/**
+ * Reduces with a user-defined operator, to the given root or, if it's
+ * negative, to all ranks. The guest's MPI_User_function takes (invec,
+ * inoutvec, len, datatype) as wasm pointers, so each combine goes through a
+ * scratch region of wasm memory.
+ */
+static void reduceWithUserOp(Runtime::ContextRuntimeData* contextRuntimeData,
+                             MpiCommunicator& comm,
+                             int root,
+                             uint8_t* hostSendBuffer,
+                             uint8_t* hostRecvBuffer,
+                             I32 datatype,
+                             int count,
+                             int opId)
+{
+    awaitMpiCollectives();
+
+    const MpiUserOp& userOp = getMpiUserOp(opId);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
+    size_t nBytes = count * hostDtype->size;
+
+    size_t scratchSize = 2 * nBytes + 2 * sizeof(I32);
+    U32 scratch = ctx->module->mmapMemory(scratchSize);
+    U8* hostScratch =
+      Runtime::memoryArrayPtr<U8>(ctx->memory, scratch, scratchSize);
+    U32 inPtr = scratch;
+    U32 inoutPtr = scratch + nBytes;
+    U32 lenPtr = scratch + 2 * nBytes;
+    U32 datatypePtr = lenPtr + sizeof(I32);
+
+    Runtime::Function* func = ctx->module->getFunctionFromPtr(userOp.funcPtr);
+    Runtime::Context* wasmCtx =
+      Runtime::getContextFromRuntimeData(contextRuntimeData);
+
+    MpiCombineFunction combine =
+      [&](const uint8_t* in, uint8_t* inout, int n) {
+          size_t combineBytes = n * hostDtype->size;
+          std::memcpy(hostScratch, in, combineBytes);
+          std::memcpy(hostScratch + nBytes, inout, combineBytes);
+          ctx->writeMpiResult<I32>(lenPtr, n);
+          ctx->writeMpiResult<I32>(datatypePtr, datatype);
+
+          std::vector<IR::UntaggedValue> args = {
+              (I32)inPtr, (I32)inoutPtr, (I32)lenPtr, (I32)datatypePtr
+          };
+          IR::UntaggedValue result;
+          ctx->module->executeWasmFunction(wasmCtx, func, args, result);
+
+          std::memcpy(inout, hostScratch + nBytes, combineBytes);
+      };
+
+    try {
+        if (root < 0) {
+            comm.allReduce(ctx->world,
+                           hostSendBuffer,
+                           hostRecvBuffer,
+                           hostDtype,
+                           count,
+                           combine,
+                           userOp.commute);
+        } else {
+            comm.reduce(ctx->world,
+                        root,
+                        hostSendBuffer,
+                        hostRecvBuffer,
+                        hostDtype,
+                        count,
+                        combine,
+                        userOp.commute);
+        }
+    } catch (...) {
+        ctx->module->unmapMemory(scratch, scratchSize);
+        throw;
+    }
+
+    ctx->module->unmapMemory(scratch, scratchSize);
+}
+
 /**
  * Reduces data sent by all ranks in the communicator using the given operator.
  */
@@ -905,30 +1262,30 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                   root,
                   comm);
 
-    ctx->checkMpiComm(comm);
     faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
-
-    auto hostRecvBuffer = Runtime::memoryArrayPtr<uint8_t>(
-      ctx->memory, recvBuf, count * hostDtype->size);
-
-    // Check if we're working in-place
-    uint8_t* hostSendBuffer;
-    if (isInPlace(sendBuf)) {
-        hostSendBuffer = hostRecvBuffer;
-    } else {
-        hostSendBuffer = Runtime::memoryArrayPtr<uint8_t>(
-          ctx->memory, sendBuf, count * hostDtype->size);
-    }
-
     faabric_op_t* hostOp = ctx->getFaasmOp(op);
+    uint8_t* hostRecvBuffer = ctx->getMpiBuffer(recvBuf, hostDtype, count);
+    uint8_t* hostSendBuffer = ctx->getMpiSendBuffer(sendBuf, hostDtype, count);
+
+    if (isMpiUserOp(hostOp->id)) {
+        reduceWithUserOp(contextRuntimeData,
+                         ctx->getComm(comm),
+                         root,
+                         hostSendBuffer ? hostSendBuffer : hostRecvBuffer,
+                         hostRecvBuffer,
+                         datatype,
+                         count,
+                         hostOp->id);
+        return MPI_SUCCESS;
+    }
 
-    ctx->world.reduce(ctx->rank,
-                      root,
-                      hostSendBuffer,
-                      hostRecvBuffer,
-                      hostDtype,
-                      count,
-                      hostOp);
+    ctx->reduce(hostSendBuffer,
+                hostRecvBuffer,
+                count,
+                hostDtype,
+                hostOp,
+                root,
+                ctx->getCommId(comm));
 
     return MPI_SUCCESS;
 }
@@ -942,7 +1299,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                MPI_Reduce_scatter,
                                I32 sendBuf,
                                I32 recvBuf,
-                               I32 recvCount,
+                               I32 recvCounts,
                                I32 datatype,
                                I32 op,
                                I32 comm)
@@ -950,20 +1307,52 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     MPI_FUNC_ARGS("S - MPI_Reduce_scatter {} {} {} {} {} {}",
                   sendBuf,
                   recvBuf,
-                  recvCount,
+                  recvCounts,
                   datatype,
                   op,
                   comm);
 
-    throw std::runtime_error("MPI_Reduce_scatter is not implemented!");
+    ctx->checkMpiComm(comm);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
+    faabric_op_t* hostOp = ctx->getFaasmOp(op);
 
-    return MPI_SUCCESS;
-}
+    int worldSize = ctx->world.getSize();
+    I32* hostRecvCounts =
+      Runtime::memoryArrayPtr<I32>(ctx->memory, recvCounts, worldSize);
+    int totalCount = 0;
+    for (int r = 0; r < worldSize; r++) {
+        totalCount += hostRecvCounts[r];
+    }
 
-/**
- * Reduces data from all ranks in the communicator into all ranks, i.e.
- * an all-to-all reduce where each ends up with the same data.
- */
+    // In-place, the receive buffer holds all the data to start with
+    uint8_t* hostSendBuffer;
+    uint8_t* hostRecvBuffer;
+    if (isInPlace(sendBuf)) {
+        hostRecvBuffer = Runtime::memoryArrayPtr<uint8_t>(
+          ctx->memory, recvBuf, totalCount * hostDtype->size);
+        hostSendBuffer = hostRecvBuffer;
+    } else {
+        hostRecvBuffer = Runtime::memoryArrayPtr<uint8_t>(
+          ctx->memory, recvBuf, hostRecvCounts[ctx->rank] * hostDtype->size);
+        hostSendBuffer = Runtime::memoryArrayPtr<uint8_t>(
+          ctx->memory, sendBuf, totalCount * hostDtype->size);
+    }
+
+    mpiReduceScatter(ctx->world,
+                     ctx->rank,
+                     hostSendBuffer,
+                     hostRecvBuffer,
+                     hostRecvCounts,
+                     hostDtype,
+                     hostOp);
+
+    return MPI_SUCCESS;
+}
+
+/**
+ * Reduces data from all ranks in the communicator into all ranks, i.e.
+ * an all-to-all reduce where each ends up with the same data.
+ */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "MPI_Allreduce",
                                I32,
@@ -983,24 +1372,84 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                   op,
                   comm);
 
-    ctx->checkMpiComm(comm);
     faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
     faabric_op_t* hostOp = ctx->getFaasmOp(op);
+    uint8_t* hostRecvBuffer = ctx->getMpiBuffer(recvBuf, hostDtype, count);
+    uint8_t* hostSendBuffer = ctx->getMpiSendBuffer(sendBuf, hostDtype, count);
+
+    if (isMpiUserOp(hostOp->id)) {
+        reduceWithUserOp(contextRuntimeData,
+                         ctx->getComm(comm),
+                         -1,
+                         hostSendBuffer ? hostSendBuffer : hostRecvBuffer,
+                         hostRecvBuffer,
+                         datatype,
+                         count,
+                         hostOp->id);
+        return MPI_SUCCESS;
+    }
 
-    auto* hostRecvBuffer =
-      Runtime::memoryArrayPtr<uint8_t>(ctx->memory, recvBuf, count);
+    ctx->allReduce(hostSendBuffer,
+                   hostRecvBuffer,
+                   count,
+                   hostDtype,
+                   hostOp,
+                   ctx->getCommId(comm));
 
-    // Check if we're operating in-place
-    uint8_t* hostSendBuffer;
-    if (isInPlace(sendBuf)) {
-        hostSendBuffer = hostRecvBuffer;
-    } else {
-        hostSendBuffer =
-          Runtime::memoryArrayPtr<uint8_t>(ctx->memory, sendBuf, count);
+    return MPI_SUCCESS;
+}
+
+/**
+ * Non-blocking all-reduce, completed by waiting on the request. User ops call
+ * into the guest, so can't run on the progress thread, and complete here.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "MPI_Iallreduce",
+                               I32,
+                               MPI_Iallreduce,
+                               I32 sendBuf,
+                               I32 recvBuf,
+                               I32 count,
+                               I32 datatype,
+                               I32 op,
+                               I32 comm,
+                               I32 requestPtrPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Iallreduce {} {} {} {} {} {} {}",
+                  sendBuf,
+                  recvBuf,
+                  count,
+                  datatype,
+                  op,
+                  comm,
+                  requestPtrPtr);
+
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype);
+    faabric_op_t* hostOp = ctx->getFaasmOp(op);
+    uint8_t* hostRecvBuffer = ctx->getMpiBuffer(recvBuf, hostDtype, count);
+    uint8_t* hostSendBuffer = ctx->getMpiSendBuffer(sendBuf, hostDtype, count);
+
+    if (isMpiUserOp(hostOp->id)) {
+        reduceWithUserOp(contextRuntimeData,
+                         ctx->getComm(comm),
+                         -1,
+                         hostSendBuffer ? hostSendBuffer : hostRecvBuffer,
+                         hostRecvBuffer,
+                         datatype,
+                         count,
+                         hostOp->id);
+        ctx->writeFaasmRequestId(requestPtrPtr, 0);
+        return MPI_SUCCESS;
     }
 
-    ctx->world.allReduce(
-      ctx->rank, hostSendBuffer, hostRecvBuffer, hostDtype, count, hostOp);
+    int requestId = ctx->iallReduce(hostSendBuffer,
+                                    hostRecvBuffer,
+                                    count,
+                                    hostDtype,
+                                    hostOp,
+                                    ctx->getCommId(comm));
+
+    ctx->writeFaasmRequestId(requestPtrPtr, requestId);
 
     return MPI_SUCCESS;
 }
@@ -1049,6 +1498,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 
     faabric_op_t* hostOp = ctx->getFaasmOp(op);
 
+    awaitMpiCollectives();
     ctx->world.scan(
       ctx->rank, hostSendBuffer, hostRecvBuffer, hostDtype, count, hostOp);
 
@@ -1087,49 +1537,127 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     auto hostRecvBuffer = Runtime::memoryArrayPtr<uint8_t>(
       ctx->memory, recvBuf, recvCount * hostRecvDtype->size);
 
-    ctx->world.allToAll(ctx->rank,
-                        hostSendBuffer,
-                        hostSendDtype,
-                        sendCount,
-                        hostRecvBuffer,
-                        hostRecvDtype,
-                        recvCount);
+    ctx->allToAll(hostSendBuffer,
+                  sendCount,
+                  hostSendDtype,
+                  hostRecvBuffer,
+                  recvCount,
+                  hostRecvDtype);
 
     return MPI_SUCCESS;
 }
 
 /**
- * All processes send different amount of data to, and receive different
- * amount of data from, all processes.
- *
- * TODO not implemented
+ * Non-blocking all-to-all, completed by waiting on the request.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "MPI_Ialltoall",
+                               I32,
+                               MPI_Ialltoall,
+                               I32 sendBuf,
+                               I32 sendCount,
+                               I32 sendType,
+                               I32 recvBuf,
+                               I32 recvCount,
+                               I32 recvType,
+                               I32 comm,
+                               I32 requestPtrPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Ialltoall {} {} {} {} {} {} {} {}",
+                  sendBuf,
+                  sendCount,
+                  sendType,
+                  recvBuf,
+                  recvCount,
+                  recvType,
+                  comm,
+                  requestPtrPtr);
+
+    ctx->checkMpiComm(comm);
+    faabric_datatype_t* hostSendDtype = ctx->getFaasmDataType(sendType);
+    faabric_datatype_t* hostRecvDtype = ctx->getFaasmDataType(recvType);
+    auto hostSendBuffer = Runtime::memoryArrayPtr<uint8_t>(
+      ctx->memory, sendBuf, sendCount * hostSendDtype->size);
+    auto hostRecvBuffer = Runtime::memoryArrayPtr<uint8_t>(
+      ctx->memory, recvBuf, recvCount * hostRecvDtype->size);
+
+    int requestId = ctx->iallToAll(hostSendBuffer,
+                                   sendCount,
+                                   hostSendDtype,
+                                   hostRecvBuffer,
+                                   recvCount,
+                                   hostRecvDtype);
+
+    ctx->writeFaasmRequestId(requestPtrPtr, requestId);
+
+    return MPI_SUCCESS;
+}
+
+/**
+ * Sends data to, and receives data from, all processes, with a different
+ * amount of data for each.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "MPI_Alltoallv",
                                I32,
                                MPI_Alltoallv,
                                I32 sendBuf,
-                               I32 sendCount,
+                               I32 sendCounts,
                                I32 sdispls,
                                I32 sendType,
                                I32 recvBuf,
-                               I32 recvCount,
+                               I32 recvCounts,
                                I32 rdispls,
                                I32 recvType,
                                I32 comm)
 {
     MPI_FUNC_ARGS("S - MPI_Alltoallv {} {} {} {} {} {} {} {} {}",
                   sendBuf,
-                  sendCount,
+                  sendCounts,
                   sdispls,
                   sendType,
                   recvBuf,
-                  recvCount,
+                  recvCounts,
                   rdispls,
                   recvType,
                   comm);
 
-    throw std::runtime_error("MPI_Alltoallv not implemented!");
+    ctx->checkMpiComm(comm);
+    faabric_datatype_t* hostSendDtype = ctx->getFaasmDataType(sendType);
+    faabric_datatype_t* hostRecvDtype = ctx->getFaasmDataType(recvType);
+
+    int worldSize = ctx->world.getSize();
+    I32* hostSendCounts =
+      Runtime::memoryArrayPtr<I32>(ctx->memory, sendCounts, worldSize);
+    I32* hostSendDispls =
+      Runtime::memoryArrayPtr<I32>(ctx->memory, sdispls, worldSize);
+    I32* hostRecvCounts =
+      Runtime::memoryArrayPtr<I32>(ctx->memory, recvCounts, worldSize);
+    I32* hostRecvDispls =
+      Runtime::memoryArrayPtr<I32>(ctx->memory, rdispls, worldSize);
+
+    size_t sendSize = 0;
+    size_t recvSize = 0;
+    for (int r = 0; r < worldSize; r++) {
+        sendSize = std::max<size_t>(
+          sendSize,
+          (hostSendDispls[r] + hostSendCounts[r]) * hostSendDtype->size);
+        recvSize = std::max<size_t>(
+          recvSize,
+          (hostRecvDispls[r] + hostRecvCounts[r]) * hostRecvDtype->size);
+    }
+
+    mpiAllToAllV(
+      ctx->world,
+      ctx->rank,
+      Runtime::memoryArrayPtr<uint8_t>(ctx->memory, sendBuf, sendSize),
+      hostSendCounts,
+      hostSendDispls,
+      hostSendDtype,
+      Runtime::memoryArrayPtr<uint8_t>(ctx->memory, recvBuf, recvSize),
+      hostRecvCounts,
+      hostRecvDispls,
+      hostRecvDtype);
 
     return MPI_SUCCESS;
 }
@@ -1166,14 +1694,14 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 {
     MPI_FUNC_ARGS("S - MPI_Type_size {} {}", typePtr, res);
 
-    faabric_datatype_t* hostType = ctx->getFaasmDataType(typePtr);
+    faabric_datatype_t* hostType = ctx->getFaasmDataType(typePtr, true);
     ctx->writeMpiResult<int>(res, hostType->size);
 
     return MPI_SUCCESS;
 }
 
 /**
- * Allocates memory on this host (equivalent to a malloc)
+ * Allocates memory for communication buffers (see allocMpiMemory)
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "MPI_Alloc_mem",
@@ -1192,8 +1720,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 
     // Create the new memory region
     WAVMWasmModule* module = getExecutingWAVMModule();
-    U32 pageAlignedSize = roundUpToWasmPageAligned(memSize);
-    U32 mappedWasmPtr = module->growMemory(pageAlignedSize);
+    U32 mappedWasmPtr = allocMpiMemory(*module, memSize);
 
     // Write the result to the wasm memory (note that the argument passed to the
     // function is a pointer to a pointer)
@@ -1206,9 +1733,9 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 
 /**
  * Makes a new communicator to which Cartesian topology information has been
- * attached.
- * Note: In MPI, memory is allocated from within the function call, that's
- * why we allocate it here.
+ * attached. With reorder set, ranks may be renumbered so grid neighbours are
+ * on the same host (see createMpiCartCommunicator). Ranks left off the grid
+ * get a null communicator.
  *
  * Reference implementation:
  * https://github.com/open-mpi/ompi/blob/master/ompi/mca/topo/base/topo_base_cart_create.c
@@ -1232,24 +1759,22 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                   reorder,
                   newCommPtrPtr);
 
-    // Allocate new faabric_communicator_t object
-    I32 memSize = sizeof(faabric_communicator_t);
-    U32 pageAlignedSize = roundUpToWasmPageAligned(memSize);
-
-    U32 mappedWasmPtr = ctx->module->growMemory(pageAlignedSize);
-
-    // Write the value to wasm memory
-    I32* hostCommPtr = &Runtime::memoryRef<I32>(ctx->memory, newCommPtrPtr);
-    *hostCommPtr = mappedWasmPtr;
+    int* dimsArray =
+      Runtime::memoryArrayPtr<int>(ctx->memory, (Uptr)dims, (Uptr)ndims);
+    int* periodsArray =
+      Runtime::memoryArrayPtr<int>(ctx->memory, (Uptr)periods, (Uptr)ndims);
 
-    // Cast the original communicator
-    faabric_communicator_t* origComm =
-      &Runtime::memoryRef<faabric_communicator_t>(ctx->memory, commOld);
+    std::vector<int> dimsVec(dimsArray, dimsArray + ndims);
+    std::vector<bool> periodsVec(periodsArray, periodsArray + ndims);
 
-    // Populate the new object
-    faabric_communicator_t* newComm =
-      &Runtime::memoryRef<faabric_communicator_t>(ctx->memory, *hostCommPtr);
-    *newComm = *origComm;
+    int parentId = ctx->getComm(commOld).getId();
+    int commId = createMpiCartCommunicator(
+      ctx->world, ctx->rank, parentId, dimsVec, periodsVec, reorder != 0);
+    if (commId < 0) {
+        ctx->writeMpiResult<I32>(newCommPtrPtr, 0);
+    } else {
+        ctx->writeNewComm(newCommPtrPtr, commId);
+    }
 
     return MPI_SUCCESS;
 }
@@ -1267,11 +1792,20 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 {
     MPI_FUNC_ARGS("S - MPI_Cart_rank {} {} {}", comm, coords, rankPtr);
 
-    int* coordsArray = Runtime::memoryArrayPtr<int>(
-      ctx->memory, (Uptr)coords, MPI_CART_MAX_DIMENSIONS);
+    MpiCommunicator& hostComm = ctx->getComm(comm);
 
     int rank;
-    ctx->world.getRankFromCoords(&rank, coordsArray);
+    if (hostComm.hasCartTopology()) {
+        int ndims = (int)hostComm.getCartDims().size();
+        int* coordsArray =
+          Runtime::memoryArrayPtr<int>(ctx->memory, (Uptr)coords, (Uptr)ndims);
+        rank = hostComm.getCartRank(
+          std::vector<int>(coordsArray, coordsArray + ndims));
+    } else {
+        int* coordsArray = Runtime::memoryArrayPtr<int>(
+          ctx->memory, (Uptr)coords, MPI_CART_MAX_DIMENSIONS);
+        ctx->world.getRankFromCoords(&rank, coordsArray);
+    }
     ctx->writeMpiResult<int>(rankPtr, rank);
 
     return MPI_SUCCESS;
@@ -1281,10 +1815,8 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
  * Retrieves the Cartesian topology information associated with a
  * communicator.
  *
- * MPI Topologies are pointless in a serverless environment. Therefore
- * we return default values (2dim grid) basing on the current world size.
- *
- * In particular we define a 2-dim grid with as many processors, leaving
+ * Communicators made without MPI_Cart_create get faabric's default (2dim
+ * grid) basing on the current world size, with as many processors, leaving
  * the rest as MPI_UNDEFINED.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -1300,9 +1832,14 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     MPI_FUNC_ARGS(
       "S - MPI_Cart_get {} {} {} {} {}", comm, maxdims, dims, periods, coords);
 
+    MpiCommunicator& hostComm = ctx->getComm(comm);
+
     // If the provided value is lower we error out. Otherwise we will just
     // use the first <MPI_CART_MAX_DIMENSIONS> array positions.
-    if (maxdims < MPI_CART_MAX_DIMENSIONS) {
+    int ndims = hostComm.hasCartTopology()
+                  ? (int)hostComm.getCartDims().size()
+                  : MPI_CART_MAX_DIMENSIONS;
+    if (maxdims < ndims) {
         SPDLOG_ERROR("Unexpected number of max. dimensions: {}", maxdims);
         throw std::runtime_error("Bad dimensions in MPI_Cart_get");
     }
@@ -1315,8 +1852,18 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     int* coordsArray =
       Runtime::memoryArrayPtr<int>(ctx->memory, (Uptr)coords, (Uptr)maxdims);
 
-    ctx->world.getCartesianRank(
-      ctx->rank, maxdims, dimsArray, periodsArray, coordsArray);
+    if (!hostComm.hasCartTopology()) {
+        ctx->world.getCartesianRank(
+          ctx->rank, maxdims, dimsArray, periodsArray, coordsArray);
+        return MPI_SUCCESS;
+    }
+
+    std::vector<int> hostCoords = hostComm.getCartCoords(hostComm.getRank());
+    for (int d = 0; d < ndims; d++) {
+        dimsArray[d] = hostComm.getCartDims().at(d);
+        periodsArray[d] = hostComm.getCartPeriods().at(d) ? 1 : 0;
+        coordsArray[d] = hostCoords.at(d);
+    }
 
     return MPI_SUCCESS;
 }
@@ -1342,10 +1889,16 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                   sourceRank,
                   destRank);
 
-    int hostSourceRank, hostDestRank;
+    MpiCommunicator& hostComm = ctx->getComm(comm);
 
-    ctx->world.shiftCartesianCoords(
-      ctx->rank, direction, disp, &hostSourceRank, &hostDestRank);
+    int hostSourceRank, hostDestRank;
+    if (hostComm.hasCartTopology()) {
+        std::tie(hostSourceRank, hostDestRank) =
+          hostComm.shiftCart(direction, disp);
+    } else {
+        ctx->world.shiftCartesianCoords(
+          ctx->rank, direction, disp, &hostSourceRank, &hostDestRank);
+    }
 
     ctx->writeMpiResult<int>(sourceRank, hostSourceRank);
     ctx->writeMpiResult<int>(destRank, hostDestRank);
@@ -1354,9 +1907,8 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 }
 
 /**
- * Creates a user-defined combination function handle.
- *
- * TODO not implemented.
+ * Creates a user-defined combination function handle. The guest's MPI_Op
+ * points to a faabric_op_t we allocate here, with a user operator ID.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "MPI_Op_create",
@@ -1368,27 +1920,37 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 {
     MPI_FUNC_ARGS("S - MPI_Op_create {} {} {}", userFn, commute, op);
 
-    throw std::runtime_error("MPI_Op_create not implemented!");
+    U32 opPtr = ctx->module->mmapMemory(sizeof(faabric_op_t));
+    faabric_op_t* hostOp = ctx->getFaasmOp(opPtr);
+    hostOp->id = createMpiUserOp(userFn, commute != 0);
+
+    ctx->writeMpiResult<I32>(op, opPtr);
 
     return MPI_SUCCESS;
 }
 
 /**
- * Frees a user-defined combination function handle.
- *
- * TODO not implemented.
+ * Frees a user-defined combination function handle, and sets it to null.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "MPI_Op_free", I32, MPI_Op_free, I32 op)
 {
     MPI_FUNC_ARGS("S - MPI_Op_free {}", op);
 
-    throw std::runtime_error("MPI_Op_free not implemented!");
+    I32 opPtr = Runtime::memoryRef<I32>(ctx->memory, op);
+    if (opPtr != 0) {
+        faabric_op_t* hostOp = ctx->getFaasmOp(opPtr);
+        freeMpiUserOp(hostOp->id);
+        ctx->module->unmapMemory(opPtr, sizeof(faabric_op_t));
+        ctx->writeMpiResult<I32>(op, 0);
+    }
 
     return MPI_SUCCESS;
 }
 
 /**
- * Creates a shared memory region (i.e. a chunk of Faasm state)
+ * Creates a window for one-sided communication. The guest's MPI_Win points to
+ * a wasm_faabric_win_t we allocate here, whose offset identifies the window.
+ * See MpiWindow for how the window memory is shared.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "MPI_Win_create",
@@ -1409,13 +1971,42 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                   comm,
                   winPtrPtr);
 
-    throw std::runtime_error("MPI_Win_create is not implemented!");
+    ctx->checkMpiComm(comm);
+
+    faabric_info_t* hostInfo = ctx->getFaasmInfoType(info);
+    if (hostInfo->id != FAABRIC_INFO_NULL) {
+        throw std::runtime_error("Non-null info not supported");
+    }
+
+    // Check the window is within memory
+    Runtime::memoryArrayPtr<U8>(ctx->memory, basePtr, size);
+
+    U32 winPtr = ctx->module->mmapMemory(sizeof(wasm_faabric_win_t));
+    wasm_faabric_win_t* win =
+      &Runtime::memoryRef<wasm_faabric_win_t>(ctx->memory, winPtr);
+    win->worldId = ctx->world.getId();
+    win->rank = ctx->rank;
+    win->size = size;
+    win->wasmPtr = basePtr;
+    win->dispUnit = dispUnit;
+
+    createMpiWindow(winPtr,
+                    ctx->world,
+                    ctx->rank,
+                    ExecutorContext::get()->getMsg().user(),
+                    ctx->module,
+                    basePtr,
+                    size,
+                    dispUnit);
+
+    ctx->writeMpiResult<I32>(winPtrPtr, winPtr);
 
     return MPI_SUCCESS;
 }
 
 /**
- * Special type of barrier invoked to ensure all RMA operations have completed.
+ * Collective synchronisation that completes all RMA operations on the window
+ * since the last fence.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "MPI_Win_fence",
@@ -1426,13 +2017,13 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 {
     MPI_FUNC_ARGS("S - MPI_Win_fence {} {}", assert, winPtr);
 
-    throw std::runtime_error("MPI_Win_fence is not implemented!");
+    getMpiWindow(winPtr).fence();
 
     return MPI_SUCCESS;
 }
 
 /**
- * One-sided get RDMA.
+ * One-sided read from another rank's window.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "MPI_Get",
@@ -1457,13 +2048,25 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                   sendType,
                   winPtr);
 
-    throw std::runtime_error("MPI_Get is not implemented!");
+    faabric_datatype_t* hostRecvDtype = ctx->getFaasmDataType(recvType);
+    faabric_datatype_t* hostSendDtype = ctx->getFaasmDataType(sendType);
+    size_t nBytes = recvCount * hostRecvDtype->size;
+    if (nBytes != (size_t)(sendCount * hostSendDtype->size)) {
+        SPDLOG_ERROR("MPI_Get size mismatch ({} != {})",
+                     nBytes,
+                     sendCount * hostSendDtype->size);
+        throw std::runtime_error("MPI_Get size mismatch");
+    }
+
+    U8* hostRecvBuffer =
+      Runtime::memoryArrayPtr<U8>(ctx->memory, recvBuf, nBytes);
+    getMpiWindow(winPtr).get(sendRank, sendOffset, hostRecvBuffer, nBytes);
 
     return MPI_SUCCESS;
 }
 
 /**
- * One-sided write to shared memory.
+ * One-sided write to another rank's window.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "MPI_Put",
@@ -1488,29 +2091,47 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                   recvType,
                   winPtr);
 
-    throw std::runtime_error("MPI_Put is not implemented!");
+    faabric_datatype_t* hostSendDtype = ctx->getFaasmDataType(sendType);
+    faabric_datatype_t* hostRecvDtype = ctx->getFaasmDataType(recvType);
+    size_t nBytes = sendCount * hostSendDtype->size;
+    if (nBytes != (size_t)(recvCount * hostRecvDtype->size)) {
+        SPDLOG_ERROR("MPI_Put size mismatch ({} != {})",
+                     nBytes,
+                     recvCount * hostRecvDtype->size);
+        throw std::runtime_error("MPI_Put size mismatch");
+    }
+
+    U8* hostSendBuffer =
+      Runtime::memoryArrayPtr<U8>(ctx->memory, sendBuf, nBytes);
+    getMpiWindow(winPtr).put(recvRank, recvOffset, hostSendBuffer, nBytes);
 
     return MPI_SUCCESS;
 }
 
 /**
- * Cleans up the given window
+ * Cleans up the given window. This is collective, and sets the guest's
+ * MPI_Win to null.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "MPI_Win_free",
                                I32,
                                MPI_Win_free,
-                               I32 winPtr)
+                               I32 winPtrPtr)
 {
-    MPI_FUNC_ARGS("S - MPI_Win_free {}", winPtr);
+    MPI_FUNC_ARGS("S - MPI_Win_free {}", winPtrPtr);
 
-    throw std::runtime_error("MPI_Win_free is not implemented!");
+    I32 winPtr = Runtime::memoryRef<I32>(ctx->memory, winPtrPtr);
+    freeMpiWindow(winPtr);
+    ctx->module->unmapMemory(winPtr, sizeof(wasm_faabric_win_t));
+
+    ctx->writeMpiResult<I32>(winPtrPtr, 0);
 
     return MPI_SUCCESS;
 }
 
 /**
- * Returns the value for a given attribute of a window.
+ * Returns the value for a given attribute of a window. As in MPI, the result
+ * is a pointer to the value, so we point into the window struct.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "MPI_Win_get_attr",
@@ -1527,7 +2148,161 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                   attrResPtrPtr,
                   flagResPtr);
 
-    throw std::runtime_error("MPI_Win_get_attr is not implemented!");
+    wasm_faabric_win_t* win =
+      &Runtime::memoryRef<wasm_faabric_win_t>(ctx->memory, winPtr);
+
+    int flag = 1;
+    switch (attrKey) {
+        case MPI_WIN_BASE: {
+            ctx->writeMpiResult<I32>(attrResPtrPtr, win->wasmPtr);
+            break;
+        }
+        case MPI_WIN_SIZE: {
+            ctx->writeMpiResult<I32>(
+              attrResPtrPtr, winPtr + offsetof(wasm_faabric_win_t, size));
+            break;
+        }
+        case MPI_WIN_DISP_UNIT: {
+            ctx->writeMpiResult<I32>(
+              attrResPtrPtr, winPtr + offsetof(wasm_faabric_win_t, dispUnit));
+            break;
+        }
+        default: {
+            SPDLOG_WARN("Unsupported MPI window attribute {}", attrKey);
+            flag = 0;
+        }
+    }
+
+    ctx->writeMpiResult<I32>(flagResPtr, flag);
+
+    return MPI_SUCCESS;
+}
+
+/**
+ * Opens a shared file collectively over the communicator (see MpiFile). The
+ * guest's MPI_File holds the file's ID. Hints in the info are ignored.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "MPI_File_open",
+                               I32,
+                               MPI_File_open,
+                               I32 comm,
+                               I32 filenamePtr,
+                               I32 amode,
+                               I32 info,
+                               I32 fhPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_File_open {} {} {} {} {}",
+                  comm,
+                  filenamePtr,
+                  amode,
+                  info,
+                  fhPtr);
+
+    std::string filename = getStringFromWasm(filenamePtr);
+    int fileId = openMpiFile(
+      ctx->world, ctx->rank, ctx->getComm(comm).getId(), filename, amode);
+    ctx->writeMpiResult<I32>(fhPtr, fileId);
+
+    return MPI_SUCCESS;
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "MPI_File_close",
+                               I32,
+                               MPI_File_close,
+                               I32 fhPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_File_close {}", fhPtr);
+
+    closeMpiFile(Runtime::memoryRef<I32>(ctx->memory, fhPtr));
+    ctx->writeMpiResult<I32>(fhPtr, 0);
+
+    return MPI_SUCCESS;
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "MPI_File_get_size",
+                               I32,
+                               MPI_File_get_size,
+                               I32 fh,
+                               I32 sizePtr)
+{
+    MPI_FUNC_ARGS("S - MPI_File_get_size {} {}", fh, sizePtr);
+
+    ctx->writeMpiResult<I64>(sizePtr, getMpiFile(fh).getSize());
+
+    return MPI_SUCCESS;
+}
+
+/**
+ * Reads collectively, with each host's aggregator doing the reads for the
+ * ranks on its host.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "MPI_File_read_at_all",
+                               I32,
+                               MPI_File_read_at_all,
+                               I32 fh,
+                               I64 offset,
+                               I32 buffer,
+                               I32 count,
+                               I32 datatype,
+                               I32 statusPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_File_read_at_all {} {} {} {} {} {}",
+                  fh,
+                  offset,
+                  buffer,
+                  count,
+                  datatype,
+                  statusPtr);
+
+    MPI_Status* status =
+      &Runtime::memoryRef<MPI_Status>(ctx->memory, statusPtr);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    ctx->fileReadAtAll(fh,
+                       offset,
+                       ctx->getMpiBuffer(buffer, hostDtype, count),
+                       count,
+                       hostDtype,
+                       status);
+
+    return MPI_SUCCESS;
+}
+
+/**
+ * Writes collectively, with each host's aggregator doing the writes for the
+ * ranks on its host.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "MPI_File_write_at_all",
+                               I32,
+                               MPI_File_write_at_all,
+                               I32 fh,
+                               I64 offset,
+                               I32 buffer,
+                               I32 count,
+                               I32 datatype,
+                               I32 statusPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_File_write_at_all {} {} {} {} {} {}",
+                  fh,
+                  offset,
+                  buffer,
+                  count,
+                  datatype,
+                  statusPtr);
+
+    MPI_Status* status =
+      &Runtime::memoryRef<MPI_Status>(ctx->memory, statusPtr);
+    faabric_datatype_t* hostDtype = ctx->getFaasmDataType(datatype, true);
+    ctx->fileWriteAtAll(fh,
+                        offset,
+                        ctx->getMpiBuffer(buffer, hostDtype, count),
+                        count,
+                        hostDtype,
+                        status);
 
     return MPI_SUCCESS;
 }
@@ -1540,14 +2315,15 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 {
     MPI_FUNC_ARGS("S - MPI_Free_mem {}", basePtr);
 
-    // Can ignore freeing memory (as we do with munmap etc.)
+    // Only unlocks the memory, leaving it in place as we do with munmap
+    freeMpiMemory(*getExecutingWAVMModule(), basePtr);
 
     return MPI_SUCCESS;
 }
 
 /**
- * Frees a communication request object.
- * TODO not implemented
+ * Frees a communication request object, and sets it to null. The request
+ * itself completes in the background.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "MPI_Request_free",
@@ -1557,11 +2333,15 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 {
     MPI_FUNC_ARGS("S - MPI_Request_free {}", requestPtr);
 
-    throw std::runtime_error("MPI_Request_free is not implemented!");
+    freeMpiRequest(ctx->getFaasmRequestId(requestPtr));
+    ctx->writeFaasmRequestId(requestPtr, 0);
 
     return MPI_SUCCESS;
 }
 
+/**
+ * Creates a type of count consecutive elements of the old type.
+ */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "MPI_Type_contiguous",
                                I32,
@@ -1575,13 +2355,157 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                   oldDatatypePtr,
                   newDatatypePtrPtr);
 
+    auto oldLayout =
+      getMpiTypeLayout(ctx->getFaasmDataType(oldDatatypePtr, true));
+    ctx->writeNewDataType(newDatatypePtrPtr,
+                          mpiTypeContiguous(count, *oldLayout));
+
     return MPI_SUCCESS;
 }
 
 /**
- * Frees a data type
- *
- * TODO not implemented.
+ * Creates a type of equally spaced blocks of the old type, e.g. a column of a
+ * matrix.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "MPI_Type_vector",
+                               I32,
+                               MPI_Type_vector,
+                               I32 count,
+                               I32 blockLength,
+                               I32 stride,
+                               I32 oldDatatypePtr,
+                               I32 newDatatypePtrPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Type_vector {} {} {} {} {}",
+                  count,
+                  blockLength,
+                  stride,
+                  oldDatatypePtr,
+                  newDatatypePtrPtr);
+
+    auto oldLayout =
+      getMpiTypeLayout(ctx->getFaasmDataType(oldDatatypePtr, true));
+    ctx->writeNewDataType(
+      newDatatypePtrPtr,
+      mpiTypeVector(count, blockLength, stride, *oldLayout));
+
+    return MPI_SUCCESS;
+}
+
+/**
+ * Creates a type of blocks of the old type at the given displacements.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "MPI_Type_indexed",
+                               I32,
+                               MPI_Type_indexed,
+                               I32 count,
+                               I32 blockLengthsPtr,
+                               I32 displacementsPtr,
+                               I32 oldDatatypePtr,
+                               I32 newDatatypePtrPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Type_indexed {} {} {} {} {}",
+                  count,
+                  blockLengthsPtr,
+                  displacementsPtr,
+                  oldDatatypePtr,
+                  newDatatypePtrPtr);
+
+    I32* blockLengths =
+      Runtime::memoryArrayPtr<I32>(ctx->memory, blockLengthsPtr, count);
+    I32* displacements =
+      Runtime::memoryArrayPtr<I32>(ctx->memory, displacementsPtr, count);
+    auto oldLayout =
+      getMpiTypeLayout(ctx->getFaasmDataType(oldDatatypePtr, true));
+    ctx->writeNewDataType(
+      newDatatypePtrPtr,
+      mpiTypeIndexed(count, blockLengths, displacements, *oldLayout));
+
+    return MPI_SUCCESS;
+}
+
+/**
+ * Creates a type of blocks of different types at byte displacements.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "MPI_Type_create_struct",
+                               I32,
+                               MPI_Type_create_struct,
+                               I32 count,
+                               I32 blockLengthsPtr,
+                               I32 displacementsPtr,
+                               I32 typesPtr,
+                               I32 newDatatypePtrPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Type_create_struct {} {} {} {} {}",
+                  count,
+                  blockLengthsPtr,
+                  displacementsPtr,
+                  typesPtr,
+                  newDatatypePtrPtr);
+
+    I32* blockLengths =
+      Runtime::memoryArrayPtr<I32>(ctx->memory, blockLengthsPtr, count);
+    I32* displacements =
+      Runtime::memoryArrayPtr<I32>(ctx->memory, displacementsPtr, count);
+    I32* types = Runtime::memoryArrayPtr<I32>(ctx->memory, typesPtr, count);
+
+    std::vector<MpiTypeLayout> layouts;
+    for (int i = 0; i < count; i++) {
+        layouts.push_back(
+          *getMpiTypeLayout(ctx->getFaasmDataType(types[i], true)));
+    }
+
+    ctx->writeNewDataType(
+      newDatatypePtrPtr,
+      mpiTypeStruct(count, blockLengths, displacements, layouts));
+
+    return MPI_SUCCESS;
+}
+
+/**
+ * Creates a type for a block within a multi-dimensional array of the old
+ * type, e.g. the interior or a face of a grid.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "MPI_Type_create_subarray",
+                               I32,
+                               MPI_Type_create_subarray,
+                               I32 nDims,
+                               I32 sizesPtr,
+                               I32 subSizesPtr,
+                               I32 startsPtr,
+                               I32 order,
+                               I32 oldDatatypePtr,
+                               I32 newDatatypePtrPtr)
+{
+    MPI_FUNC_ARGS("S - MPI_Type_create_subarray {} {} {} {} {} {} {}",
+                  nDims,
+                  sizesPtr,
+                  subSizesPtr,
+                  startsPtr,
+                  order,
+                  oldDatatypePtr,
+                  newDatatypePtrPtr);
+
+    I32* sizes = Runtime::memoryArrayPtr<I32>(ctx->memory, sizesPtr, nDims);
+    I32* subSizes =
+      Runtime::memoryArrayPtr<I32>(ctx->memory, subSizesPtr, nDims);
+    I32* starts = Runtime::memoryArrayPtr<I32>(ctx->memory, startsPtr, nDims);
+    auto oldLayout =
+      getMpiTypeLayout(ctx->getFaasmDataType(oldDatatypePtr, true));
+    ctx->writeNewDataType(
+      newDatatypePtrPtr,
+      mpiTypeSubarray(nDims, sizes, subSizes, starts, order, *oldLayout));
+
+    return MPI_SUCCESS;
+}
+
+/**
+ * Frees a derived data type, and sets it to null. Messages already in flight
+ * are unaffected.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "MPI_Type_free",
@@ -1591,7 +2515,12 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 {
     MPI_FUNC_ARGS("S - MPI_Type_free {}", datatype);
 
-    throw std::runtime_error("MPI_Type_free is not implemented!");
+    I32 typePtr = Runtime::memoryRef<I32>(ctx->memory, datatype);
+    if (typePtr != 0 &&
+        freeMpiDerivedType(typePtr, ctx->getFaasmDataType(typePtr, true))) {
+        ctx->module->unmapMemory(typePtr, sizeof(faabric_datatype_t));
+        ctx->writeMpiResult<I32>(datatype, 0);
+    }
 
     return MPI_SUCCESS;
 }
@@ -3,8 +3,15 @@
 
 #include <faabric/util/bytes.h>
 #include <faabric/util/logging.h>
+#include <wasm/call_metrics.h>
+#include <wasm/network.h>
 
+#include <cstring>
+#include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <vector>
 
 #include <WAVM/Runtime/Intrinsics.h>
 #include <WAVM/Runtime/Runtime.h>
@@ -36,6 +43,22 @@ void setSockLen(socklen_t nativeValue, I32 wasmPtr)
     std::copy(&nativeValue, &nativeValue + 1, wasmAddrPtr);
 }
 
+// The guest's libc expects syscalls to return -errno rather than set it, so
+// that it can set its own errno. Non-blocking sockets rely on this to see
+// EINPROGRESS and EAGAIN.
+static I32 toSyscallResult(long result)
+{
+    if (result < 0) {
+        return -errno;
+    }
+
+    return (I32)result;
+}
+
+// Flags that can be or-ed into the socket type, with the same values as musl
+static const U32 WASM_SOCK_NONBLOCK = 04000;
+static const U32 WASM_SOCK_CLOEXEC = 02000000;
+
 /**
  * When properly isolated, functions will run in their own network namespace,
  * therefore we can be relatively comfortable passing some of the syscalls
@@ -48,7 +71,8 @@ I32 s__socketcall(I32 call, I32 argsPtr)
 
     // NOTE
     // We don't want to support server-side socket syscalls as we expect
-    // functions only to be clients
+    // functions only to be clients. Clients can still make many requests
+    // concurrently with non-blocking sockets and poll/ epoll.
 
     switch (call) {
             // ----------------------------
@@ -62,7 +86,15 @@ I32 s__socketcall(I32 call, I32 argsPtr)
             U32* subCallArgs =
               Runtime::memoryArrayPtr<U32>(memoryPtr, argsPtr, 3);
             U32 domain = subCallArgs[0];
-            U32 type = subCallArgs[1];
+            U32 typeArg = subCallArgs[1];
+            U32 type = typeArg & ~(WASM_SOCK_NONBLOCK | WASM_SOCK_CLOEXEC);
+            U32 typeFlags = 0;
+            if (typeArg & WASM_SOCK_NONBLOCK) {
+                typeFlags |= SOCK_NONBLOCK;
+            }
+            if (typeArg & WASM_SOCK_CLOEXEC) {
+                typeFlags |= SOCK_CLOEXEC;
+            }
             U32 protocol = subCallArgs[2];
 
             switch (domain) {
@@ -110,14 +142,17 @@ I32 s__socketcall(I32 call, I32 argsPtr)
                 }
             }
 
-            SPDLOG_DEBUG("S - socket - {} {} {}", domain, type, protocol);
-            I32 sock = (int)syscall(SYS_socket, domain, type, protocol);
+            SPDLOG_DEBUG(
+              "S - socket - {} {} {} {}", domain, type, typeFlags, protocol);
+            long sock = syscall(SYS_socket, domain, type | typeFlags, protocol);
 
             if (sock < 0) {
-                printf("Socket error: %i\n", sock);
+                int socketErrno = errno;
+                SPDLOG_ERROR("Socket error: {}", strerror(socketErrno));
+                return -socketErrno;
             }
 
-            return sock;
+            return (I32)sock;
         }
 
         case (SocketCalls::sc_connect): {
@@ -133,7 +168,8 @@ I32 s__socketcall(I32 call, I32 argsPtr)
             sockaddr addr = getSockAddr(addrPtr);
             int result = connect(sockfd, &addr, sizeof(sockaddr));
 
-            return result;
+            // Non-blocking sockets return EINPROGRESS here
+            return toSyscallResult(result);
         }
 
         case (SocketCalls::sc_recv):
@@ -211,7 +247,7 @@ I32 s__socketcall(I32 call, I32 argsPtr)
                 }
             }
 
-            return (I32)result;
+            return toSyscallResult(result);
         }
 
         case (SocketCalls::sc_bind): {
@@ -227,23 +263,37 @@ I32 s__socketcall(I32 call, I32 argsPtr)
 
             int bindResult = bind(sockfd, &addr, sizeof(addr));
 
-            return (I32)bindResult;
+            return toSyscallResult(bindResult);
         }
 
-        case (SocketCalls::sc_getsockname): {
+        case (SocketCalls::sc_getsockname):
+        case (SocketCalls::sc_getpeername): {
             U32* subCallArgs =
               Runtime::memoryArrayPtr<U32>(memoryPtr, argsPtr, 3);
             I32 sockfd = subCallArgs[0];
             I32 addrPtr = subCallArgs[1];
             I32 addrLenPtr = subCallArgs[2];
 
-            SPDLOG_DEBUG(
-              "S - getsockname - {} {} {}", sockfd, addrPtr, addrLenPtr);
+            SPDLOG_DEBUG("S - {} - {} {} {}",
+                         call == SocketCalls::sc_getsockname ? "getsockname"
+                                                             : "getpeername",
+                         sockfd,
+                         addrPtr,
+                         addrLenPtr);
 
             sockaddr nativeAddr = getSockAddr(addrPtr);
             socklen_t nativeAddrLen = sizeof(nativeAddr);
 
-            int result = getsockname(sockfd, &nativeAddr, &nativeAddrLen);
+            int result;
+            if (call == SocketCalls::sc_getsockname) {
+                result = getsockname(sockfd, &nativeAddr, &nativeAddrLen);
+            } else {
+                result = getpeername(sockfd, &nativeAddr, &nativeAddrLen);
+            }
+
+            if (result < 0) {
+                return toSyscallResult(result);
+            }
 
             // Make sure we write any results back to the wasm objects
             setSockAddr(nativeAddr, addrPtr);
@@ -252,31 +302,72 @@ I32 s__socketcall(I32 call, I32 argsPtr)
             return result;
         }
 
-            // ----------------------------
-            // Unfinished
-            // ----------------------------
-
-        case (SocketCalls::sc_getpeername): {
-            SPDLOG_DEBUG("S - getpeername - {} {}", call, argsPtr);
-            return 0;
-        }
+        case (SocketCalls::sc_shutdown): {
+            U32* subCallArgs =
+              Runtime::memoryArrayPtr<U32>(memoryPtr, argsPtr, 2);
+            I32 sockfd = subCallArgs[0];
+            I32 how = subCallArgs[1];
 
-        case (SocketCalls::sc_socketpair): {
-            SPDLOG_DEBUG("S - socketpair - {} {}", call, argsPtr);
-            return 0;
-        }
+            SPDLOG_DEBUG("S - shutdown - {} {}", sockfd, how);
 
-        case (SocketCalls::sc_shutdown): {
-            SPDLOG_DEBUG("S - shutdown - {} {}", call, argsPtr);
-            return 0;
+            return toSyscallResult(shutdown(sockfd, how));
         }
 
         case (SocketCalls::sc_setsockopt): {
-            SPDLOG_DEBUG("S - setsockopt - {} {}", call, argsPtr);
-            return 0;
+            // Levels, option names and integer option values are the same in
+            // musl as natively, so the value can be passed through as bytes
+            U32* subCallArgs =
+              Runtime::memoryArrayPtr<U32>(memoryPtr, argsPtr, 5);
+            I32 sockfd = subCallArgs[0];
+            I32 level = subCallArgs[1];
+            I32 optName = subCallArgs[2];
+            Uptr optValPtr = subCallArgs[3];
+            socklen_t optLen = subCallArgs[4];
+
+            SPDLOG_DEBUG(
+              "S - setsockopt - {} {} {} {}", sockfd, level, optName, optLen);
+
+            U8* optVal =
+              Runtime::memoryArrayPtr<U8>(memoryPtr, optValPtr, optLen);
+            int result = setsockopt(sockfd, level, optName, optVal, optLen);
+
+            return toSyscallResult(result);
         }
+
         case (SocketCalls::sc_getsockopt): {
-            SPDLOG_DEBUG("S - getsockopt - {} {}", call, argsPtr);
+            // Needed for SO_ERROR, which says whether a non-blocking connect
+            // succeeded once the socket is writable
+            U32* subCallArgs =
+              Runtime::memoryArrayPtr<U32>(memoryPtr, argsPtr, 5);
+            I32 sockfd = subCallArgs[0];
+            I32 level = subCallArgs[1];
+            I32 optName = subCallArgs[2];
+            Uptr optValPtr = subCallArgs[3];
+            I32 optLenPtr = subCallArgs[4];
+
+            socklen_t optLen =
+              Runtime::memoryRef<U32>(memoryPtr, (Uptr)optLenPtr);
+
+            SPDLOG_DEBUG(
+              "S - getsockopt - {} {} {} {}", sockfd, level, optName, optLen);
+
+            U8* optVal =
+              Runtime::memoryArrayPtr<U8>(memoryPtr, optValPtr, optLen);
+            int result = getsockopt(sockfd, level, optName, optVal, &optLen);
+            if (result < 0) {
+                return toSyscallResult(result);
+            }
+
+            setSockLen(optLen, optLenPtr);
+            return result;
+        }
+
+            // ----------------------------
+            // Unfinished
+            // ----------------------------
+
+        case (SocketCalls::sc_socketpair): {
+            SPDLOG_DEBUG("S - socketpair - {} {}", call, argsPtr);
             return 0;
         }
 
@@ -333,12 +424,98 @@ I32 s__socketcall(I32 call, I32 argsPtr)
     return 0;
 }
 
+// ------------------------------------------------------
+// Polling
+// ------------------------------------------------------
+
+/**
+ * Guests can wait on many sockets at once, rather than making one blocking
+ * call after another. Waits are cut short at the function's execution
+ * deadline, so a guest waiting forever on a socket doesn't outlive its call.
+ */
+I32 s__poll(I32 fdsPtr, I32 nfds, I32 timeout)
+{
+    SPDLOG_DEBUG("S - poll - {} {} {}", fdsPtr, nfds, timeout);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    wasm_pollfd* wasmFds =
+      Runtime::memoryArrayPtr<wasm_pollfd>(memoryPtr, fdsPtr, nfds);
+
+    std::vector<pollfd> nativeFds(nfds);
+    for (int i = 0; i < nfds; i++) {
+        nativeFds[i].fd = wasmFds[i].fd;
+        nativeFds[i].events = wasmFds[i].events;
+        nativeFds[i].revents = 0;
+    }
+
+    int result = pollWithinDeadline(nativeFds.data(), nfds, timeout);
+    if (result < 0) {
+        return result;
+    }
+
+    for (int i = 0; i < nfds; i++) {
+        wasmFds[i].revents = nativeFds[i].revents;
+    }
+
+    return result;
+}
+
+I32 s__epoll_create1(I32 flags)
+{
+    SPDLOG_DEBUG("S - epoll_create1 - {}", flags);
+
+    // Only EPOLL_CLOEXEC can be passed, with the same value as O_CLOEXEC
+    int nativeFlags = (flags & O_CLOEXEC) ? EPOLL_CLOEXEC : 0;
+    return toSyscallResult(epoll_create1(nativeFlags));
+}
+
+I32 s__epoll_ctl(I32 epollFd, I32 op, I32 fd, I32 eventPtr)
+{
+    SPDLOG_DEBUG("S - epoll_ctl - {} {} {} {}", epollFd, op, fd, eventPtr);
+
+    // Event pointers are ignored for deletes
+    epoll_event nativeEvent{};
+    if (eventPtr != 0) {
+        wasm_epoll_event& wasmEvent = Runtime::memoryRef<wasm_epoll_event>(
+          getExecutingWAVMModule()->defaultMemory, (Uptr)eventPtr);
+        nativeEvent.events = wasmEvent.events;
+        nativeEvent.data.u64 = wasmEvent.data;
+    }
+
+    return toSyscallResult(epoll_ctl(epollFd, op, fd, &nativeEvent));
+}
+
+I32 s__epoll_wait(I32 epollFd, I32 eventsPtr, I32 maxEvents, I32 timeout)
+{
+    SPDLOG_DEBUG(
+      "S - epoll_wait - {} {} {} {}", epollFd, eventsPtr, maxEvents, timeout);
+
+    if (maxEvents <= 0) {
+        return -EINVAL;
+    }
+
+    wasm_epoll_event* wasmEvents = Runtime::memoryArrayPtr<wasm_epoll_event>(
+      getExecutingWAVMModule()->defaultMemory, eventsPtr, maxEvents);
+
+    std::vector<epoll_event> nativeEvents(maxEvents);
+    int result = epollWaitWithinDeadline(
+      epollFd, nativeEvents.data(), maxEvents, timeout);
+
+    for (int i = 0; i < result; i++) {
+        wasmEvents[i].events = nativeEvents[i].events;
+        wasmEvents[i].data = nativeEvents[i].data.u64;
+    }
+
+    return result;
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "gethostbyname",
                                I32,
                                _gethostbyname,
                                I32 hostnamePtr)
 {
+    HOST_CALL(Network);
     const std::string hostname = getStringFromWasm(hostnamePtr);
     SPDLOG_DEBUG("S - gethostbyname {}", hostname);
 
@@ -352,6 +529,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 buffer,
                                I32 bufferLen)
 {
+    HOST_CALL(Network);
     SPDLOG_DEBUG("S - gethostname {} {}", buffer, bufferLen);
 
     Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
@@ -367,6 +545,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "socket", I32, socket, I32 a, I32 b, I32 c)
 {
+    HOST_CALL(Network);
     SPDLOG_DEBUG("S - socket - {} {} {}", a, b, c);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -379,6 +558,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 b,
                                I32 c)
 {
+    HOST_CALL(Network);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -392,6 +572,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 d,
                                I32 e)
 {
+    HOST_CALL(Network);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -406,6 +587,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 e,
                                I32 f)
 {
+    HOST_CALL(Network);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -416,16 +598,19 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 a,
                                I32 b)
 {
+    HOST_CALL(Network);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "bind", I32, bind, I32 a, I32 b, I32 c)
 {
+    HOST_CALL(Network);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "listen", I32, listen, I32 a, I32 b)
 {
+    HOST_CALL(Network);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -439,16 +624,19 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 d,
                                I32 e)
 {
+    HOST_CALL(Network);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "accept", I32, accept, I32 a, I32 b, I32 c)
 {
+    HOST_CALL(Network);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "inet_addr", I32, inet_addr, I32 a)
 {
+    HOST_CALL(Network);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -460,6 +648,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 b,
                                I32 c)
 {
+    HOST_CALL(Network);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -474,6 +663,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 e,
                                I32 f)
 {
+    HOST_CALL(Network);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -488,11 +678,13 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 e,
                                I32 f)
 {
+    HOST_CALL(Network);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "inet_ntoa", I32, inet_ntoa, I32 a)
 {
+    HOST_CALL(Network);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -502,6 +694,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                getprotobyname,
                                I32 a)
 {
+    HOST_CALL(Network);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -512,6 +705,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 a,
                                I32 b)
 {
+    HOST_CALL(Network);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -523,6 +717,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 b,
                                I32 c)
 {
+    HOST_CALL(Network);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -533,6 +728,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 a,
                                I32 b)
 {
+    HOST_CALL(Network);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -544,47 +740,55 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 b,
                                I32 c)
 {
+    HOST_CALL(Network);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "atoi", I32, atoi, I32 a)
 {
+    HOST_CALL(Network);
     SPDLOG_DEBUG("S - atoi - {}", a);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "htons", I32, _htons, I32 a)
 {
+    HOST_CALL(Network);
     SPDLOG_DEBUG("S - htons - {}", a);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "ntohl", I32, _ntohl, I32 a)
 {
+    HOST_CALL(Network);
     SPDLOG_DEBUG("S - ntohl - {}", a);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "ntohs", I32, _ntohs, I32 a)
 {
+    HOST_CALL(Network);
     SPDLOG_DEBUG("S - ntohs - {}", a);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "htonl", I32, _htonl, I32 a)
 {
+    HOST_CALL(Network);
     SPDLOG_DEBUG("S - htonl - {}", a);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "inet_aton", I32, _inet_aton, I32 a, I32 b)
 {
+    HOST_CALL(Network);
     SPDLOG_DEBUG("S - inet_aton - {} {}", a, b);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "shutdown", I32, _shutdown, I32 a, I32 b)
 {
+    HOST_CALL(Network);
     SPDLOG_DEBUG("S - shutdown - {} {}", a, b);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -597,6 +801,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 b,
                                I32 c)
 {
+    HOST_CALL(Network);
     SPDLOG_DEBUG("S - inet_pton - {} {} {}", a, b, c);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -610,6 +815,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 c,
                                I32 d)
 {
+    HOST_CALL(Network);
     SPDLOG_DEBUG("S - inet_ntop - {} {} {} {}", a, b, c, d);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -623,6 +829,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 c,
                                I32 d)
 {
+    HOST_CALL(Network);
     SPDLOG_DEBUG("S - recv - {} {} {} {}", a, b, c, d);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -636,6 +843,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 c,
                                I32 d)
 {
+    HOST_CALL(Network);
     SPDLOG_DEBUG("S - send - {} {} {} {}", a, b, c, d);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -650,6 +858,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 d,
                                I32 e)
 {
+    HOST_CALL(Network);
     SPDLOG_DEBUG("S - getsockopt - {} {} {} {} {}", a, b, c, d, e);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -6,7 +6,6 @@
 #include <faabric/scheduler/ExecutorContext.h>
 #include <faabric/scheduler/Scheduler.h>
 #include <faabric/snapshot/SnapshotRegistry.h>
-#include <faabric/state/StateKeyValue.h>
 #include <faabric/transport/PointToPointBroker.h>
 #include <faabric/util/func.h>
 #include <faabric/util/gids.h>
@@ -19,53 +18,30 @@
 #include <faabric/util/string_tools.h>
 #include <faabric/util/timing.h>
 
+#include <conf/FaasmConfig.h>
+#include <metrics/LifecycleTrace.h>
+#include <threads/LocalTeam.h>
 #include <threads/ThreadState.h>
 #include <wasm/WasmExecutionContext.h>
 #include <wasm/WasmModule.h>
+#include <wasm/call_metrics.h>
+#include <wasm/openmp.h>
+#include <wasm/openmp_profile.h>
+#include <wasm/openmp_tasks.h>
+#include <wasm/timing.h>
 #include <wavm/WAVMWasmModule.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
 using namespace WAVM;
 using namespace faabric::scheduler;
 
 namespace wasm {
 
-// ------------------------------------------------
-// LOGGING
-// ------------------------------------------------
-
-#define OMP_FUNC(str)                                                          \
-    std::shared_ptr<threads::Level> level = threads::getCurrentOpenMPLevel();  \
-    faabric::Message* msg = &ExecutorContext::get()->getMsg();                 \
-    int localThreadNum = level->getLocalThreadNum(msg);                        \
-    int globalThreadNum = level->getGlobalThreadNum(msg);                      \
-    UNUSED(level);                                                             \
-    UNUSED(msg);                                                               \
-    UNUSED(localThreadNum);                                                    \
-    UNUSED(globalThreadNum);                                                   \
-    SPDLOG_TRACE("OMP {} ({}): " str, localThreadNum, globalThreadNum);
-
-#define OMP_FUNC_ARGS(formatStr, ...)                                          \
-    std::shared_ptr<threads::Level> level = threads::getCurrentOpenMPLevel();  \
-    faabric::Message* msg = &ExecutorContext::get()->getMsg();                 \
-    int localThreadNum = level->getLocalThreadNum(msg);                        \
-    int globalThreadNum = level->getGlobalThreadNum(msg);                      \
-    UNUSED(level);                                                             \
-    UNUSED(msg);                                                               \
-    UNUSED(localThreadNum);                                                    \
-    UNUSED(globalThreadNum);                                                   \
-    SPDLOG_TRACE("OMP {} ({}): " formatStr,                                    \
-                 localThreadNum,                                               \
-                 globalThreadNum,                                              \
-                 __VA_ARGS__);
-
-static std::shared_ptr<faabric::transport::PointToPointGroup>
-getExecutingPointToPointGroup()
-{
-    faabric::Message& msg = ExecutorContext::get()->getMsg();
-    return faabric::transport::PointToPointGroup::getOrAwaitGroup(
-      msg.groupid());
-}
-
 // ------------------------------------------------
 // THREAD NUMS AND LEVELS
 // ------------------------------------------------
@@ -79,6 +55,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32,
                                omp_get_thread_num)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC("omp_get_thread_num")
     return localThreadNum;
 }
@@ -92,6 +69,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32,
                                omp_get_num_threads)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC("omp_get_num_threads")
     return level->numThreads;
 }
@@ -105,12 +83,14 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32,
                                omp_get_max_threads)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC("omp_get_max_threads");
     return level->getMaxThreadsAtNextLevel();
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "omp_get_level", I32, omp_get_level)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC("omp_get_level");
     return level->depth;
 }
@@ -120,6 +100,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32,
                                omp_get_max_active_levels)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC("omp_get_max_active_levels");
     return level->maxActiveLevels;
 }
@@ -130,6 +111,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                omp_set_max_active_levels,
                                I32 maxLevels)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("omp_set_max_active_levels {}", maxLevels)
 
     if (maxLevels < 0) {
@@ -148,6 +130,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 globalTid,
                                I32 numThreads)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS(
       "__kmpc_push_num_threads {} {} {}", loc, globalTid, numThreads);
 
@@ -162,6 +145,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                omp_set_num_threads,
                                I32 numThreads)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("omp_set_num_threads {}", numThreads);
 
     if (numThreads > 0) {
@@ -175,6 +159,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                __kmpc_global_thread_num,
                                I32 loc)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("__kmpc_global_thread_num {}", loc);
     return globalThreadNum;
 }
@@ -185,18 +170,29 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "omp_get_wtime", F64, omp_get_wtime)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC("omp_get_wtime");
 
-    faabric::util::Clock& clock = faabric::util::getGlobalClock();
-    long millis = clock.epochMillis();
+    return getTimerSeconds();
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env, "omp_get_wtick", F64, omp_get_wtick)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC("omp_get_wtick");
 
-    return ((F64)millis) / 1000;
+    return getTimerResolutionSeconds();
 }
 
 // ----------------------------------------------------
 // BARRIER
 // ----------------------------------------------------
 
+// Defined with the tasks
+static void runPendingTasks(Runtime::Context* ctx,
+                            faabric::Message* msg,
+                            const std::shared_ptr<threads::Level>& level);
+
 /**
  * Synchronization point at which threads in a parallel region will not execute
  * beyond the omp barrier until all other threads in the team complete all
@@ -212,8 +208,19 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 loc,
                                I32 globalTid)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("__kmpc_barrier {} {}", loc, globalTid);
-    getExecutingPointToPointGroup()->barrier(msg->groupidx());
+
+    // A single thread team (e.g. a nested one) has nobody to wait for
+    if (level->numThreads == 1) {
+        return;
+    }
+
+    // Queued tasks must all be done before anyone passes the barrier
+    runPendingTasks(
+      Runtime::getContextFromRuntimeData(contextRuntimeData), msg, level);
+
+    teamBarrier(msg->groupidx());
 }
 
 // ----------------------------------------------------
@@ -229,6 +236,10 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
  lock associated with the critical section, or some other suitably unique value.
     The lock is not used because Faasm needs to control the locking mechanism
  for the team.
+ *
+ * When the whole team is on this host, each critical section gets its own
+ * host-local lock, keyed by crit. Otherwise we fall back to the group's
+ * distributed lock, which is shared by all critical sections.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "__kmpc_critical",
@@ -238,16 +249,10 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 globalTid,
                                I32 crit)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("__kmpc_critical {} {} {}", loc, globalTid, crit);
 
-    if (level->numThreads > 1) {
-        getExecutingPointToPointGroup()->lock(msg->groupidx(), true);
-
-        // NOTE: here we need to pull the latest snapshot diffs from master.
-        // This is a really inefficient way to implement a critical, and needs
-        // more thought as to whether we can avoid doing a request/ response
-        // every time.
-    }
+    enterOpenMPCritical(msg, level, crit);
 }
 
 /**
@@ -265,11 +270,10 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 globalTid,
                                I32 crit)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("__kmpc_end_critical {} {} {}", loc, globalTid, crit);
 
-    if (level->numThreads > 1) {
-        getExecutingPointToPointGroup()->unlock(msg->groupidx(), true);
-    }
+    exitOpenMPCritical(msg, level, crit);
 }
 
 /**
@@ -281,6 +285,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "__kmpc_flush", void, __kmpc_flush, I32 loc)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("__kmpc_flush {}", loc);
 
     // Full memory fence, a bit overkill maybe for Wasm
@@ -302,6 +307,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 loc,
                                I32 globalTid)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("__kmpc_master {} {}", loc, globalTid);
 
     return localThreadNum == 0;
@@ -317,6 +323,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 loc,
                                I32 globalTid)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("__kmpc_end_master {} {}", loc, globalTid);
 
     if (localThreadNum != 0) {
@@ -343,9 +350,10 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 loc,
                                I32 globalTid)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("__kmpc_single {} {}", loc, globalTid);
 
-    return localThreadNum == 0;
+    return startOpenMPSingle(msg, level);
 }
 
 /**
@@ -358,17 +366,273 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 loc,
                                I32 globalTid)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("__kmpc_end_single {} {}", loc, globalTid);
-
-    if (localThreadNum != 0) {
-        throw std::runtime_error("Calling _kmpc_end_single from non-master");
-    }
 }
 
 // ----------------------------------------------------
 // FORKING
 // ----------------------------------------------------
 
+/**
+ * Runs the master thread of a team inline on the calling thread, in the same
+ * memory, so it doesn't need to go through the scheduler. While it runs, the
+ * thread's level and OpenMP thread number are those of the new team.
+ */
+static int32_t executeMasterInline(
+  Runtime::ContextRuntimeData* contextRuntimeData,
+  faabric::Message* msg,
+  std::shared_ptr<threads::Level> parentLevel,
+  std::shared_ptr<threads::Level> nextLevel,
+  I32 microtaskPtr)
+{
+    SPDLOG_TRACE("Executing OpenMP master inline at depth {}",
+                 nextLevel->depth);
+    OpenMPProfileTimer regionTimer(OpenMPProfileEvent::Region,
+                                   OpenMPProfileEvent::Region);
+
+    int parentThreadNum = msg->appidx();
+    int threadNum = nextLevel->getGlobalThreadNum(0);
+
+    std::vector<IR::UntaggedValue> invokeArgs = {
+        threadNum, (I32)nextLevel->nSharedVarOffsets
+    };
+    for (uint32_t i = 0; i < nextLevel->nSharedVarOffsets; i++) {
+        invokeArgs.emplace_back(nextLevel->sharedVarOffsets[i]);
+    }
+
+    WAVMWasmModule* module = getExecutingWAVMModule();
+    Runtime::Function* func = module->getFunctionFromPtr(microtaskPtr);
+    Runtime::Context* ctx =
+      Runtime::getContextFromRuntimeData(contextRuntimeData);
+
+    msg->set_appidx(threadNum);
+    threads::setCurrentOpenMPLevel(nextLevel);
+    pushThreadDispatch();
+
+    IR::UntaggedValue result;
+    try {
+        module->executeWasmFunction(ctx, func, invokeArgs, result);
+        finishOpenMPTasks(ctx);
+    } catch (...) {
+        popThreadDispatch();
+        msg->set_appidx(parentThreadNum);
+        threads::setCurrentOpenMPLevel(parentLevel);
+        throw;
+    }
+
+    popThreadDispatch();
+    msg->set_appidx(parentThreadNum);
+    threads::setCurrentOpenMPLevel(parentLevel);
+
+    return result.i32;
+}
+
+/**
+ * A team kept alive between consecutive parallel sections of the same
+ * invocation, as in libomp's hot teams. The pool's workers are already
+ * persistent, so this keeps the rest of the team (its level, barrier, request
+ * and thread stacks) and a fork only has to update the microtask and shared
+ * variables before signalling the workers.
+ */
+struct LocalHotTeam
+{
+    WAVMWasmModule* module = nullptr;
+    std::shared_ptr<threads::Level> parentLevel = nullptr;
+    int appId = -1;
+    int nThreads = 0;
+
+    std::shared_ptr<faabric::BatchExecuteRequest> req = nullptr;
+    std::shared_ptr<threads::Level> level = nullptr;
+    std::shared_ptr<threads::LocalTeam> team = nullptr;
+    std::vector<uint32_t> threadStacks;
+};
+
+static thread_local LocalHotTeam hotTeam;
+
+void clearOpenMPHotTeam()
+{
+    hotTeam = LocalHotTeam();
+}
+
+static LocalHotTeam& getLocalHotTeam(
+  WAVMWasmModule* module,
+  faabric::Message* parentCall,
+  const std::shared_ptr<threads::Level>& parentLevel,
+  int nThreads)
+{
+    bool isHot = hotTeam.module == module &&
+                 hotTeam.parentLevel == parentLevel &&
+                 hotTeam.appId == parentCall->appid() &&
+                 hotTeam.nThreads == nThreads &&
+                 hotTeam.req->messages(0).user() == parentCall->user() &&
+                 hotTeam.req->messages(0).function() == parentCall->function();
+    if (isHot) {
+        return hotTeam;
+    }
+
+    SPDLOG_TRACE("Creating local OpenMP hot team of {}", nThreads);
+
+    hotTeam = LocalHotTeam();
+    hotTeam.module = module;
+    hotTeam.parentLevel = parentLevel;
+    hotTeam.appId = parentCall->appid();
+    hotTeam.nThreads = nThreads;
+
+    // The request only provides each thread's executor context
+    hotTeam.req = faabric::util::batchExecFactory(
+      parentCall->user(), parentCall->function(), nThreads);
+    hotTeam.req->set_type(faabric::BatchExecuteRequest::THREADS);
+    hotTeam.req->set_subtype(ThreadRequestType::OPENMP);
+    hotTeam.req->set_singlehost(true);
+
+    hotTeam.level = std::make_shared<threads::Level>(nThreads);
+    hotTeam.team = std::make_shared<threads::LocalTeam>(nThreads);
+    hotTeam.threadStacks = module->getThreadStacks(nThreads);
+
+    for (int i = 0; i < nThreads; i++) {
+        faabric::Message& m = hotTeam.req->mutable_messages()->at(i);
+        m.set_appid(parentCall->appid());
+        m.set_groupidx(i);
+        m.set_groupsize(nThreads);
+    }
+
+    return hotTeam;
+}
+
+/**
+ * Runs a team on this module's local thread pool, as long as it fits on this
+ * host. This skips the scheduler, and as every thread shares the caller's
+ * memory there are no snapshots or merge regions. The caller runs the master
+ * thread itself. Returns false if the team must go through the scheduler.
+ */
+static bool tryExecuteLocalTeam(Runtime::ContextRuntimeData* contextRuntimeData,
+                                faabric::Message* parentCall,
+                                std::shared_ptr<threads::Level> parentLevel,
+                                I32 nSharedVars,
+                                uint32_t* sharedVarsPtr,
+                                I32 microtaskPtr)
+{
+    if (conf::getFaasmConfig().ompLocalTeams != "on") {
+        return false;
+    }
+
+    int nThreads = parentLevel->getMaxThreadsAtNextLevel();
+    WAVMWasmModule* module = getExecutingWAVMModule();
+    threads::LocalThreadPool& pool = module->getOpenMPThreadPool();
+
+    // The master thread reuses the caller's slot
+    faabric::HostResources res =
+      faabric::scheduler::getScheduler().getThisHostResources();
+    int freeSlots = res.slots() - res.usedslots();
+
+    // Unless the program asked for a team size, the team is sized to what
+    // this host can run now, so it grows on an idle host and shrinks on a
+    // busy one. The pool's workers follow the team sizes.
+    if (!parentLevel->isNextLevelSizeRequested()) {
+        nThreads = std::min({ nThreads, freeSlots + 1, pool.getMaxTeamSize() });
+        nThreads = std::max(nThreads, 1);
+    }
+
+    if (nThreads > pool.getMaxTeamSize() || freeSlots < nThreads - 1) {
+        return false;
+    }
+
+    LocalHotTeam& hot =
+      getLocalHotTeam(module, parentCall, parentLevel, nThreads);
+
+    // Reset the level, as the last section may have changed it
+    std::shared_ptr<threads::Level> nextLevel = hot.level;
+    nextLevel->wantedThreads = -1;
+    nextLevel->pushedThreads = -1;
+    nextLevel->fromParentLevel(parentLevel);
+    if (nSharedVars > 0) {
+        nextLevel->setSharedVarOffsets(sharedVarsPtr, nSharedVars);
+    } else {
+        nextLevel->sharedVarOffsets = nullptr;
+        nextLevel->nSharedVarOffsets = 0;
+    }
+
+    // A new group ID keeps loop and reduction state apart between sections
+    int groupId = faabric::util::generateGid();
+    std::shared_ptr<faabric::BatchExecuteRequest> teamReq = hot.req;
+    for (int i = 0; i < nThreads; i++) {
+        faabric::Message& m = teamReq->mutable_messages()->at(i);
+        m.set_funcptr(microtaskPtr);
+        m.set_appidx(nextLevel->getGlobalThreadNum(i));
+        m.set_groupid(groupId);
+    }
+
+    std::shared_ptr<threads::LocalTeam> team = hot.team;
+    std::shared_ptr<ExecutorContext> parentCtx = ExecutorContext::get();
+    Executor* executor = parentCtx->getExecutor();
+    const std::vector<uint32_t>& threadStacks = hot.threadStacks;
+
+    threads::LocalTask task = [&](int i) -> int32_t {
+        faabric::Message& m = teamReq->mutable_messages()->at(i);
+        threads::setCurrentLocalTeam(team);
+
+        if (i == 0) {
+            ExecutorContext::set(executor, teamReq, 0);
+
+            int32_t res;
+            try {
+                res = executeMasterInline(
+                  contextRuntimeData, &m, parentLevel, nextLevel, microtaskPtr);
+            } catch (...) {
+                threads::setCurrentLocalTeam(nullptr);
+                ExecutorContext::set(executor,
+                                     parentCtx->getBatchRequest(),
+                                     parentCtx->getMsgIdx());
+                throw;
+            }
+
+            threads::setCurrentLocalTeam(nullptr);
+            ExecutorContext::set(
+              executor, parentCtx->getBatchRequest(), parentCtx->getMsgIdx());
+            return res;
+        }
+
+        WasmExecutionContext wasmCtx(module);
+        ExecutorContext::set(executor, teamReq, i);
+        threads::setCurrentOpenMPLevel(nextLevel);
+
+        int32_t res = module->executeOMPThread(i, threadStacks.at(i), m);
+
+        threads::setCurrentLocalTeam(nullptr);
+        ExecutorContext::unset();
+        return res;
+    };
+
+    SPDLOG_TRACE("Executing OpenMP team of {} on local thread pool", nThreads);
+
+    // A failed section can leave the team's barrier half way through, so the
+    // next one gets a fresh team
+    std::vector<int32_t> results;
+    bool success;
+    try {
+        success = pool.tryRun(nThreads, task, results);
+    } catch (...) {
+        clearOpenMPHotTeam();
+        throw;
+    }
+
+    if (!success) {
+        return false;
+    }
+
+    for (int i = 0; i < nThreads; i++) {
+        if (results.at(i) != 0) {
+            SPDLOG_ERROR(
+              "OpenMP thread {} failed, result {}", i, results.at(i));
+            clearOpenMPHotTeam();
+            throw std::runtime_error("OpenMP threads failed");
+        }
+    }
+
+    return true;
+}
+
 /**
  * The LLVM version of this function is implemented in the openmp source at:
  * https://github.com/llvm/llvm-project/blob/main/openmp/runtime/src/kmp_csupport.cpp
@@ -390,7 +654,6 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
  * - those listed in a shared() directive
  * - those listed in a reduce() directive
  */
-
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "__kmpc_fork_call",
                                void,
@@ -400,84 +663,57 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 microtaskPtr,
                                I32 sharedVarPtrs)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("__kmpc_fork_call {} {} {} {}",
                   locPtr,
                   nSharedVars,
                   microtaskPtr,
                   sharedVarPtrs);
+    OpenMPProfileTimer forkTimer(OpenMPProfileEvent::Fork,
+                                 OpenMPProfileEvent::Region);
+    metrics::TraceScope trace(metrics::TraceEvent::ThreadFork);
 
     WAVMWasmModule* parentModule = getExecutingWAVMModule();
     Runtime::Memory* memoryPtr = parentModule->defaultMemory;
     faabric::Message* parentCall = &ExecutorContext::get()->getMsg();
 
-    const std::string parentStr =
-      faabric::util::funcToString(*parentCall, false);
-
-    // Set up the next level
-    std::shared_ptr<threads::Level> parentLevel = level;
-    auto nextLevel =
-      std::make_shared<threads::Level>(parentLevel->getMaxThreadsAtNextLevel());
-    nextLevel->fromParentLevel(parentLevel);
-
-    // Set up shared variables
+    uint32_t* sharedVarsPtr = nullptr;
     if (nSharedVars > 0) {
-        uint32_t* sharedVarsPtr = Runtime::memoryArrayPtr<uint32_t>(
+        sharedVarsPtr = Runtime::memoryArrayPtr<uint32_t>(
           memoryPtr, sharedVarPtrs, nSharedVars);
-        nextLevel->setSharedVarOffsets(sharedVarsPtr, nSharedVars);
     }
 
-    if (nextLevel->depth > 1) {
-        SPDLOG_ERROR("Nested OpenMP support removed");
-        throw std::runtime_error("Nested OpenMP support removed");
-    }
-
-    // Set up the chained calls
-    std::shared_ptr<faabric::BatchExecuteRequest> req =
-      faabric::util::batchExecFactory(
-        parentCall->user(), parentCall->function(), nextLevel->numThreads);
-    req->set_type(faabric::BatchExecuteRequest::THREADS);
-    req->set_subtype(ThreadRequestType::OPENMP);
-
-    // Add remote context
-    std::vector<uint8_t> serialisedLevel = nextLevel->serialise();
-    req->set_contextdata(serialisedLevel.data(), serialisedLevel.size());
-
-    // Configure the mesages
-    for (int i = 0; i < req->messages_size(); i++) {
-        faabric::Message& m = req->mutable_messages()->at(i);
-
-        // Propagte app id
-        m.set_appid(parentCall->appid());
-
-        // Function pointer
-        m.set_funcptr(microtaskPtr);
-
-        // OpenMP thread number
-        int threadNum = nextLevel->getGlobalThreadNum(i);
-        m.set_appidx(threadNum);
-
-        // Group setup for distributed coordination. Note that the group index
-        // is just within this function group, and not the global OpenMP
-        // thread number
-        m.set_groupidx(i);
+    std::shared_ptr<threads::Level> parentLevel = level;
+    if (parentLevel->depth == 0 && tryExecuteLocalTeam(contextRuntimeData,
+                                                       parentCall,
+                                                       parentLevel,
+                                                       nSharedVars,
+                                                       sharedVarsPtr,
+                                                       microtaskPtr)) {
+        parentModule->clearMergeRegions();
+        parentLevel->pushedThreads = -1;
+        return;
     }
 
-    // Execute the threads
-    faabric::scheduler::Executor* executor =
-      faabric::scheduler::ExecutorContext::get()->getExecutor();
-    std::vector<std::pair<uint32_t, int>> results =
-      executor->executeThreads(req, parentModule->getMergeRegions());
+    std::shared_ptr<threads::Level> nextLevel =
+      createNextOpenMPLevel(parentLevel, nSharedVars, sharedVarsPtr);
 
-    for (auto [mid, res] : results) {
+    if (nextLevel->depth > 1) {
+        int32_t res = executeMasterInline(contextRuntimeData,
+                                          parentCall,
+                                          parentLevel,
+                                          nextLevel,
+                                          microtaskPtr);
         if (res != 0) {
-            SPDLOG_ERROR(
-              "OpenMP thread failed, result {} on message {}", res, mid);
+            SPDLOG_ERROR("Nested OpenMP thread failed, result {}", res);
             throw std::runtime_error("OpenMP threads failed");
         }
+
+        parentLevel->pushedThreads = -1;
+        return;
     }
 
-    // Clear this module's merge regions
-    parentModule->clearMergeRegions();
+    executeOpenMPTeam(parentModule, parentCall, nextLevel, microtaskPtr);
 
     // Reset parent level for next setting of threads
     parentLevel->pushedThreads = -1;
@@ -487,129 +723,6 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 // FOR LOOP STATIC INIT
 // -------------------------------------------------------
 
-enum sched_type : int
-{
-    sch_lower = 32, /**< lower bound for unordered values */
-    sch_static_chunked = 33,
-    sch_static = 34, /**< static unspecialized */
-};
-
-template<typename T>
-void for_static_init(I32 schedule,
-                     I32* lastIter,
-                     T* lower,
-                     T* upper,
-                     T* stride,
-                     T incr,
-                     T chunk);
-
-template<typename T>
-void for_static_init(I32 schedule,
-                     I32* lastIter,
-                     T* lower,
-                     T* upper,
-                     T* stride,
-                     T incr,
-                     T chunk)
-{
-    // Unsigned version of the given template parameter
-    typedef typename std::make_unsigned<T>::type UT;
-
-    faabric::Message* msg = &ExecutorContext::get()->getMsg();
-    std::shared_ptr<threads::Level> level = threads::getCurrentOpenMPLevel();
-    int localThreadNum = level->getLocalThreadNum(msg);
-
-    if (level->numThreads == 1) {
-        *lastIter = true;
-
-        if (incr > 0) {
-            *stride = *upper - *lower + 1;
-        } else {
-            *stride = -(*lower - *upper + 1);
-        }
-
-        return;
-    }
-
-    UT tripCount;
-    if (incr == 1) {
-        tripCount = *upper - *lower + 1;
-
-    } else if (incr == -1) {
-        tripCount = *lower - *upper + 1;
-
-    } else if (incr > 0) {
-        // Upper-lower can exceed the limit of signed type
-        tripCount = (int)(*upper - *lower) / incr + 1;
-
-    } else {
-        tripCount = (int)(*lower - *upper) / (-incr) + 1;
-    }
-
-    switch (schedule) {
-        case sch_static_chunked: {
-            int span;
-
-            if (chunk < 1) {
-                chunk = 1;
-            }
-
-            span = chunk * incr;
-
-            *stride = span * level->numThreads;
-            *lower = *lower + (span * localThreadNum);
-            *upper = *lower + span - incr;
-
-            *lastIter =
-              (localThreadNum ==
-               ((tripCount - 1) / (unsigned int)chunk) % level->numThreads);
-
-            break;
-        }
-
-        case sch_static: { // (chunk not given)
-            // If we have fewer trip_counts than threads
-            if (tripCount < level->numThreads) {
-                // Warning for future use, not tested at scale
-                SPDLOG_WARN("Small for loop trip count {} {}",
-                            tripCount,
-                            level->numThreads);
-
-                if (localThreadNum < tripCount) {
-                    *upper = *lower = *lower + localThreadNum * incr;
-                } else {
-                    *lower = *upper + incr;
-                }
-
-                *lastIter = (localThreadNum == tripCount - 1);
-
-            } else {
-                // TODO: We only implement below kmp_sch_static_balanced, not
-                // kmp_sch_static_greedy Those are set through KMP_SCHEDULE so
-                // we would need to look out for real code setting this
-                U32 small_chunk = tripCount / level->numThreads;
-                U32 extras = tripCount % level->numThreads;
-
-                *lower +=
-                  incr * (localThreadNum * small_chunk +
-                          (localThreadNum < extras ? localThreadNum : extras));
-
-                *upper = *lower + small_chunk * incr -
-                         (localThreadNum < extras ? 0 : incr);
-
-                *lastIter = (localThreadNum == level->numThreads - 1);
-            }
-
-            *stride = tripCount;
-            break;
-        }
-        default: {
-            SPDLOG_ERROR("Unimplemented OpenMP scheduler {}", schedule);
-            throw std::runtime_error("Unimplemented OpenMP scheduler");
-        }
-    }
-}
-
 /**
  * @param    loc       Source code location
  * @param    gtid      Global thread id of this thread
@@ -643,6 +756,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 incr,
                                I32 chunk)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("__kmpc_for_static_init_4 {} {} {} {} {} {} {} {} {}",
                   loc,
                   gtid,
@@ -682,6 +796,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I64 incr,
                                I64 chunk)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("__kmpc_for_static_init_4 {} {} {} {} {} {} {} {} {}",
                   loc,
                   gtid,
@@ -710,145 +825,889 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 loc,
                                I32 gtid)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("__kmpc_for_static_fini {} {}", loc, gtid);
 }
 
-// ---------------------------------------------------
-// REDUCTION
-// ---------------------------------------------------
-
-/**
- * Called to start a reduction.
- */
-void startReduceCritical(faabric::Message* msg,
-                         std::shared_ptr<threads::Level> level,
-                         int32_t numReduceVars,
-                         int32_t reduceVarPtrs,
-                         int32_t reduceVarsSize)
-
-{
-    // This function synchronises updates to shared reduce variables.
-    // Each host will have its own copy of these variables, which will be merged
-    // at the end of the parallel section via Faasm shared memory.
-    // This means we only need to synchronise local accesses here, so we only
-    // need a local lock.
-    SPDLOG_TRACE("Entering reduce critical section for group {}",
-                 msg->groupid());
-
-    std::shared_ptr<faabric::transport::PointToPointGroup> group =
-      faabric::transport::PointToPointGroup::getOrAwaitGroup(msg->groupid());
-    group->localLock();
-}
+// -------------------------------------------------------
+// FOR LOOP DYNAMIC DISPATCH
+// -------------------------------------------------------
 
 /**
- * Called to finish off a reduction.
+ * Called before a dynamically scheduled loop (dynamic, guided, runtime or
+ * auto) by every thread in the team. The bounds are inclusive.
+ *
+ * The guts of the implementation in openmp can be found in
+ * __kmp_dispatch_init in runtime/src/kmp_dispatch.cpp
  */
-void endReduceCritical(faabric::Message* msg, bool barrier)
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_init_4",
+                               void,
+                               __kmpc_dispatch_init_4,
+                               I32 loc,
+                               I32 gtid,
+                               I32 schedule,
+                               I32 lower,
+                               I32 upper,
+                               I32 incr,
+                               I32 chunk)
 {
-    std::shared_ptr<threads::Level> level = threads::getCurrentOpenMPLevel();
-    int localThreadNum = level->getLocalThreadNum(msg);
-
-    // Unlock the critical section
-    std::shared_ptr<faabric::transport::PointToPointGroup> group =
-      faabric::transport::PointToPointGroup::getGroup(msg->groupid());
-    group->localUnlock();
-
-    // Master must make sure all other threads are done
-    group->notify(localThreadNum);
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_dispatch_init_4 {} {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  schedule,
+                  lower,
+                  upper,
+                  incr,
+                  chunk);
 
-    // Everyone waits if there's a barrier
-    if (barrier) {
-        PROF_START(FinaliseReduceBarrier)
-        group->barrier(localThreadNum);
-        PROF_END(FinaliseReduceBarrier)
-    }
+    dispatch_init<I32>(schedule, (I32)lower, (I32)upper, incr, chunk);
 }
 
-/**
- * This function is called to start the critical section required to perform the
- * reduction operation by each thread. It will then call __kmpc_end_reduce (and
- * its nowait equivalent), when it's finished.
- *
- * It seems that in our case, always returning 1 for both kmpc_reduce and
- * kmpc_reduce_nowait gets the right result.
- *
- * In the OpenMP source we can see a more varied set of return values, but these
- * are for cases we don't yet support (notably teams):
- * https://github.com/llvm/llvm-project/blob/main/openmp/runtime/src/kmp_csupport.cpp
- *
- * Note that the reduce vars passed into this function are the *LOCAL* copies
- * on the thread's own stack used to hold intermediate results. There is
- * apparently no way to get a reference to the final destination of the
- * reduction result in this function, that is only known in kmpc_fork_call.
+/*
+ * See __kmpc_dispatch_init_4
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "__kmpc_reduce",
-                               I32,
-                               __kmpc_reduce,
+                               "__kmpc_dispatch_init_4u",
+                               void,
+                               __kmpc_dispatch_init_4u,
                                I32 loc,
                                I32 gtid,
-                               I32 numReduceVars,
-                               I32 reduceVarsSize,
-                               I32 reduceVarPtrs,
-                               I32 reduceFunc,
-                               I32 lockPtr)
+                               I32 schedule,
+                               I32 lower,
+                               I32 upper,
+                               I32 incr,
+                               I32 chunk)
 {
-    OMP_FUNC_ARGS("__kmpc_reduce {} {} {} {} {} {} {}",
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_dispatch_init_4u {} {} {} {} {} {} {}",
                   loc,
                   gtid,
-                  numReduceVars,
-                  reduceVarsSize,
-                  reduceVarPtrs,
-                  reduceFunc,
-                  lockPtr);
+                  schedule,
+                  lower,
+                  upper,
+                  incr,
+                  chunk);
 
-    startReduceCritical(
-      msg, level, numReduceVars, reduceVarPtrs, reduceVarsSize);
-    return 1;
+    dispatch_init<U32>(schedule, (U32)lower, (U32)upper, incr, chunk);
 }
 
-/**
- * See __kmpc_reduce
+/*
+ * See __kmpc_dispatch_init_4
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "__kmpc_reduce_nowait",
-                               I32,
-                               __kmpc_reduce_nowait,
+                               "__kmpc_dispatch_init_8",
+                               void,
+                               __kmpc_dispatch_init_8,
                                I32 loc,
                                I32 gtid,
-                               I32 numReduceVars,
-                               I32 reduceVarsSize,
-                               I32 reduceVarPtrs,
-                               I32 reduceFunc,
-                               I32 lockPtr)
+                               I32 schedule,
+                               I64 lower,
+                               I64 upper,
+                               I64 incr,
+                               I64 chunk)
 {
-    OMP_FUNC_ARGS("__kmpc_reduce_nowait {} {} {} {} {} {} {}",
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_dispatch_init_8 {} {} {} {} {} {} {}",
                   loc,
                   gtid,
-                  numReduceVars,
-                  reduceVarsSize,
-                  reduceVarPtrs,
-                  reduceFunc,
-                  lockPtr);
+                  schedule,
+                  lower,
+                  upper,
+                  incr,
+                  chunk);
 
-    startReduceCritical(
-      msg, level, numReduceVars, reduceVarPtrs, reduceVarsSize);
-    return 1;
+    dispatch_init<I64>(schedule, (I64)lower, (I64)upper, incr, chunk);
 }
 
-/**
- * Finalises a blocking reduce, called by all threads.
+/*
+ * See __kmpc_dispatch_init_4
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "__kmpc_end_reduce",
+                               "__kmpc_dispatch_init_8u",
                                void,
-                               __kmpc_end_reduce,
+                               __kmpc_dispatch_init_8u,
+                               I32 loc,
+                               I32 gtid,
+                               I32 schedule,
+                               I64 lower,
+                               I64 upper,
+                               I64 incr,
+                               I64 chunk)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_dispatch_init_8u {} {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  schedule,
+                  lower,
+                  upper,
+                  incr,
+                  chunk);
+
+    dispatch_init<U64>(schedule, (U64)lower, (U64)upper, incr, chunk);
+}
+
+/**
+ * Gets the next chunk of a dynamically scheduled loop for this thread, writing
+ * its inclusive bounds and stride.
+ *
+ * @return 1 if there is a chunk to execute, 0 once the loop is finished.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_next_4",
+                               I32,
+                               __kmpc_dispatch_next_4,
+                               I32 loc,
+                               I32 gtid,
+                               I32 lastIterPtr,
+                               I32 lowerPtr,
+                               I32 upperPtr,
+                               I32 stridePtr)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_dispatch_next_4 {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  lastIterPtr,
+                  lowerPtr,
+                  upperPtr,
+                  stridePtr);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    I32* lastIter = &Runtime::memoryRef<I32>(memoryPtr, lastIterPtr);
+    I32* lower = &Runtime::memoryRef<I32>(memoryPtr, lowerPtr);
+    I32* upper = &Runtime::memoryRef<I32>(memoryPtr, upperPtr);
+    I32* stride = &Runtime::memoryRef<I32>(memoryPtr, stridePtr);
+
+    return dispatch_next<I32>(lastIter, lower, upper, stride);
+}
+
+/*
+ * See __kmpc_dispatch_next_4
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_next_4u",
+                               I32,
+                               __kmpc_dispatch_next_4u,
+                               I32 loc,
+                               I32 gtid,
+                               I32 lastIterPtr,
+                               I32 lowerPtr,
+                               I32 upperPtr,
+                               I32 stridePtr)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_dispatch_next_4u {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  lastIterPtr,
+                  lowerPtr,
+                  upperPtr,
+                  stridePtr);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    I32* lastIter = &Runtime::memoryRef<I32>(memoryPtr, lastIterPtr);
+    U32* lower = &Runtime::memoryRef<U32>(memoryPtr, lowerPtr);
+    U32* upper = &Runtime::memoryRef<U32>(memoryPtr, upperPtr);
+    U32* stride = &Runtime::memoryRef<U32>(memoryPtr, stridePtr);
+
+    return dispatch_next<U32>(lastIter, lower, upper, stride);
+}
+
+/*
+ * See __kmpc_dispatch_next_4
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_next_8",
+                               I32,
+                               __kmpc_dispatch_next_8,
+                               I32 loc,
+                               I32 gtid,
+                               I32 lastIterPtr,
+                               I32 lowerPtr,
+                               I32 upperPtr,
+                               I32 stridePtr)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_dispatch_next_8 {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  lastIterPtr,
+                  lowerPtr,
+                  upperPtr,
+                  stridePtr);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    I32* lastIter = &Runtime::memoryRef<I32>(memoryPtr, lastIterPtr);
+    I64* lower = &Runtime::memoryRef<I64>(memoryPtr, lowerPtr);
+    I64* upper = &Runtime::memoryRef<I64>(memoryPtr, upperPtr);
+    I64* stride = &Runtime::memoryRef<I64>(memoryPtr, stridePtr);
+
+    return dispatch_next<I64>(lastIter, lower, upper, stride);
+}
+
+/*
+ * See __kmpc_dispatch_next_4
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_next_8u",
+                               I32,
+                               __kmpc_dispatch_next_8u,
+                               I32 loc,
+                               I32 gtid,
+                               I32 lastIterPtr,
+                               I32 lowerPtr,
+                               I32 upperPtr,
+                               I32 stridePtr)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_dispatch_next_8u {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  lastIterPtr,
+                  lowerPtr,
+                  upperPtr,
+                  stridePtr);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    I32* lastIter = &Runtime::memoryRef<I32>(memoryPtr, lastIterPtr);
+    U64* lower = &Runtime::memoryRef<U64>(memoryPtr, lowerPtr);
+    U64* upper = &Runtime::memoryRef<U64>(memoryPtr, upperPtr);
+    U64* stride = &Runtime::memoryRef<U64>(memoryPtr, stridePtr);
+
+    return dispatch_next<U64>(lastIter, lower, upper, stride);
+}
+
+/**
+ * Only called at the end of each chunk of ordered loops, which we don't
+ * support, so there's nothing to do.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_fini_4",
+                               void,
+                               __kmpc_dispatch_fini_4,
+                               I32 loc,
+                               I32 gtid)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_dispatch_fini_4 {} {}", loc, gtid);
+}
+
+/*
+ * See __kmpc_dispatch_fini_4
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_fini_4u",
+                               void,
+                               __kmpc_dispatch_fini_4u,
+                               I32 loc,
+                               I32 gtid)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_dispatch_fini_4u {} {}", loc, gtid);
+}
+
+/*
+ * See __kmpc_dispatch_fini_4
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_fini_8",
+                               void,
+                               __kmpc_dispatch_fini_8,
+                               I32 loc,
+                               I32 gtid)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_dispatch_fini_8 {} {}", loc, gtid);
+}
+
+/*
+ * See __kmpc_dispatch_fini_4
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_fini_8u",
+                               void,
+                               __kmpc_dispatch_fini_8u,
+                               I32 loc,
+                               I32 gtid)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_dispatch_fini_8u {} {}", loc, gtid);
+}
+
+// ---------------------------------------------------
+// TASKS
+// ---------------------------------------------------
+
+// Layout of kmp_task_t in wasm memory, see kmp.h in the OpenMP source
+struct WasmKmpTask
+{
+    I32 shareds;
+    I32 routine;
+    I32 partId;
+    I32 data1;
+    I32 data2;
+};
+
+// Shared variables go straight after the task, aligned for any type
+#define OMP_TASK_ALIGN 16
+
+static uint32_t alignTaskOffset(uint32_t offset)
+{
+    return (offset + OMP_TASK_ALIGN - 1) & ~(OMP_TASK_ALIGN - 1);
+}
+
+// Calls a task's entry function on the calling thread
+static OpenMPTaskFunc getTaskFunc(Runtime::Context* ctx,
+                                  int32_t globalThreadNum)
+{
+    return [ctx, globalThreadNum](const OpenMPTask& task) {
+        WAVMWasmModule* module = getExecutingWAVMModule();
+        Runtime::Function* func = module->getFunctionFromPtr(task.routine);
+        std::vector<IR::UntaggedValue> args = { globalThreadNum,
+                                                task.taskPtr };
+        IR::UntaggedValue result;
+        module->executeWasmFunction(ctx, func, args, result);
+    };
+}
+
+static void runPendingTasks(Runtime::Context* ctx,
+                            faabric::Message* msg,
+                            const std::shared_ptr<threads::Level>& level)
+{
+    runPendingOpenMPTasks(
+      getTaskFunc(ctx, level->getGlobalThreadNum(msg)), msg, level);
+}
+
+void finishOpenMPTasks(Runtime::Context* ctx)
+{
+    std::shared_ptr<threads::Level> level = threads::getCurrentOpenMPLevel();
+    faabric::Message* msg = &ExecutorContext::get()->getMsg();
+    finishOpenMPTeamTasks(
+      getTaskFunc(ctx, level->getGlobalThreadNum(msg)), msg, level);
+}
+
+/**
+ * Allocates a task along with its shared variables. The compiler fills in
+ * the shared variables and any private data after the kmp_task_t struct.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_omp_task_alloc",
+                               I32,
+                               __kmpc_omp_task_alloc,
+                               I32 loc,
+                               I32 gtid,
+                               I32 flags,
+                               I32 sizeOfTask,
+                               I32 sizeOfShareds,
+                               I32 taskEntry)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_omp_task_alloc {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  flags,
+                  sizeOfTask,
+                  sizeOfShareds,
+                  taskEntry);
+
+    uint32_t sharedsOffset = alignTaskOffset(sizeOfTask);
+    uint32_t nBytes = alignTaskOffset(sharedsOffset + sizeOfShareds);
+
+    std::shared_ptr<OpenMPTask> node = allocateOpenMPTask(
+      getOpenMPTaskTeam(msg, level), nBytes, taskEntry);
+
+    WAVMWasmModule* module = getExecutingWAVMModule();
+    auto* task = Runtime::memoryObjectPtr<WasmKmpTask>(module->defaultMemory,
+                                                       node->taskPtr);
+    task->shareds = sizeOfShareds > 0 ? node->taskPtr + sharedsOffset : 0;
+    task->routine = taskEntry;
+    task->partId = 0;
+
+    holdOpenMPTask(node);
+
+    return node->taskPtr;
+}
+
+/**
+ * Queues a task for any thread in the team to run, or runs it straight away
+ * if there's no team.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_omp_task",
+                               I32,
+                               __kmpc_omp_task,
+                               I32 loc,
+                               I32 gtid,
+                               I32 taskPtr)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_omp_task {} {} {}", loc, gtid, taskPtr);
+
+    std::shared_ptr<OpenMPTask> node = takeHeldOpenMPTask(taskPtr);
+    if (node->team == nullptr) {
+        Runtime::Context* ctx =
+          Runtime::getContextFromRuntimeData(contextRuntimeData);
+        runOpenMPTask(getTaskFunc(ctx, globalThreadNum), node, false);
+        return 0;
+    }
+
+    queueOpenMPTask(node);
+    return 0;
+}
+
+/**
+ * Tasks with dependencies wait for all their earlier siblings, which is
+ * stricter than needed but always respects the dependencies.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_omp_task_with_deps",
+                               I32,
+                               __kmpc_omp_task_with_deps,
+                               I32 loc,
+                               I32 gtid,
+                               I32 taskPtr,
+                               I32 nDeps,
+                               I32 depList,
+                               I32 nDepsNoAlias,
+                               I32 noAliasDepList)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_omp_task_with_deps {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  taskPtr,
+                  nDeps,
+                  nDepsNoAlias);
+
+    std::shared_ptr<OpenMPTask> node = takeHeldOpenMPTask(taskPtr);
+    OpenMPTaskFunc func = getTaskFunc(
+      Runtime::getContextFromRuntimeData(contextRuntimeData), globalThreadNum);
+    if (node->team == nullptr) {
+        runOpenMPTask(func, node, false);
+        return 0;
+    }
+
+    if (nDeps + nDepsNoAlias > 0) {
+        waitForOpenMPChildTasks(func);
+    }
+
+    queueOpenMPTask(node);
+    return 0;
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_omp_wait_deps",
+                               void,
+                               __kmpc_omp_wait_deps,
+                               I32 loc,
+                               I32 gtid,
+                               I32 nDeps,
+                               I32 depList,
+                               I32 nDepsNoAlias,
+                               I32 noAliasDepList)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_omp_wait_deps {} {} {} {}",
+                  loc,
+                  gtid,
+                  nDeps,
+                  nDepsNoAlias);
+
+    if (getOpenMPTaskTeam(msg, level) == nullptr) {
+        return;
+    }
+
+    waitForOpenMPChildTasks(getTaskFunc(
+      Runtime::getContextFromRuntimeData(contextRuntimeData), globalThreadNum));
+}
+
+/**
+ * An undeferred task (i.e. with an if clause that's false) is run by the
+ * compiler between these two calls.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_omp_task_begin_if0",
+                               void,
+                               __kmpc_omp_task_begin_if0,
+                               I32 loc,
+                               I32 gtid,
+                               I32 taskPtr)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_omp_task_begin_if0 {} {} {}", loc, gtid, taskPtr);
+
+    startUndeferredOpenMPTask(taskPtr);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_omp_task_complete_if0",
+                               void,
+                               __kmpc_omp_task_complete_if0,
+                               I32 loc,
+                               I32 gtid,
+                               I32 taskPtr)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS(
+      "__kmpc_omp_task_complete_if0 {} {} {}", loc, gtid, taskPtr);
+
+    finishUndeferredOpenMPTask(taskPtr);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_omp_taskwait",
+                               I32,
+                               __kmpc_omp_taskwait,
+                               I32 loc,
+                               I32 gtid)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_omp_taskwait {} {}", loc, gtid);
+
+    if (getOpenMPTaskTeam(msg, level) == nullptr) {
+        return 0;
+    }
+
+    waitForOpenMPChildTasks(getTaskFunc(
+      Runtime::getContextFromRuntimeData(contextRuntimeData), globalThreadNum));
+    return 0;
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_omp_taskyield",
+                               I32,
+                               __kmpc_omp_taskyield,
+                               I32 loc,
+                               I32 gtid,
+                               I32 endPart)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_omp_taskyield {} {} {}", loc, gtid, endPart);
+
+    if (getOpenMPTaskTeam(msg, level) == nullptr) {
+        return 0;
+    }
+
+    yieldOpenMPTask(getTaskFunc(
+      Runtime::getContextFromRuntimeData(contextRuntimeData), globalThreadNum));
+    return 0;
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_taskgroup",
+                               void,
+                               __kmpc_taskgroup,
+                               I32 loc,
+                               I32 gtid)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_taskgroup {} {}", loc, gtid);
+
+    if (getOpenMPTaskTeam(msg, level) == nullptr) {
+        return;
+    }
+
+    startOpenMPTaskGroup();
+}
+
+/**
+ * Waits for every task created in the group, including their descendants.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_end_taskgroup",
+                               void,
+                               __kmpc_end_taskgroup,
+                               I32 loc,
+                               I32 gtid)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_end_taskgroup {} {}", loc, gtid);
+
+    if (getOpenMPTaskTeam(msg, level) == nullptr) {
+        return;
+    }
+
+    endOpenMPTaskGroup(getTaskFunc(
+      Runtime::getContextFromRuntimeData(contextRuntimeData), globalThreadNum));
+}
+
+enum taskloop_sched : int
+{
+    taskloop_sched_none = 0,
+    taskloop_sched_grainsize = 1,
+    taskloop_sched_num_tasks = 2,
+};
+
+/**
+ * Splits a loop into tasks, each a copy of the given pattern task with its
+ * own bounds. The bounds are stored in the pattern task's private data, at
+ * the given pointers. The pattern task itself is never run.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_taskloop",
+                               void,
+                               __kmpc_taskloop,
+                               I32 loc,
+                               I32 gtid,
+                               I32 taskPtr,
+                               I32 ifVal,
+                               I32 lowerPtr,
+                               I32 upperPtr,
+                               I64 stride,
+                               I32 noGroup,
+                               I32 sched,
+                               I64 grainSize,
+                               I32 taskDup)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_taskloop {} {} {} {} {} {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  taskPtr,
+                  ifVal,
+                  lowerPtr,
+                  upperPtr,
+                  stride,
+                  noGroup,
+                  sched,
+                  grainSize,
+                  taskDup);
+
+    WAVMWasmModule* module = getExecutingWAVMModule();
+    Runtime::Memory* memory = module->defaultMemory;
+    Runtime::Context* ctx =
+      Runtime::getContextFromRuntimeData(contextRuntimeData);
+    OpenMPTaskFunc func = getTaskFunc(ctx, globalThreadNum);
+    std::shared_ptr<OpenMPTask> pattern = takeHeldOpenMPTask(taskPtr);
+
+    uint32_t taskEnd = (uint32_t)taskPtr + pattern->size;
+    if (lowerPtr < taskPtr || upperPtr < taskPtr ||
+        (uint32_t)lowerPtr + sizeof(uint64_t) > taskEnd ||
+        (uint32_t)upperPtr + sizeof(uint64_t) > taskEnd) {
+        SPDLOG_ERROR("OpenMP taskloop bounds outside task {}", taskPtr);
+        throw std::runtime_error("OpenMP taskloop bounds outside task");
+    }
+
+    uint64_t lower = *Runtime::memoryObjectPtr<uint64_t>(memory, lowerPtr);
+    uint64_t upper = *Runtime::memoryObjectPtr<uint64_t>(memory, upperPtr);
+
+    uint64_t tripCount = 0;
+    if (stride > 0 && (int64_t)(upper - lower) >= 0) {
+        tripCount = (upper - lower) / stride + 1;
+    } else if (stride < 0 && (int64_t)(lower - upper) >= 0) {
+        tripCount = (lower - upper) / (-stride) + 1;
+    }
+
+    // With no team, or when not allowed to defer, the pattern task runs the
+    // whole loop
+    if (pattern->team == nullptr || ifVal == 0 || tripCount <= 1) {
+        if (tripCount > 0) {
+            runOpenMPTask(func, pattern, false);
+        } else {
+            freeOpenMPTask(*pattern);
+        }
+        return;
+    }
+
+    uint64_t nTasks;
+    switch (sched) {
+        case taskloop_sched_grainsize: {
+            uint64_t grain = std::max<uint64_t>(grainSize, 1);
+            nTasks = std::max<uint64_t>(tripCount / grain, 1);
+            break;
+        }
+        case taskloop_sched_num_tasks: {
+            nTasks = std::max<uint64_t>(grainSize, 1);
+            break;
+        }
+        default: {
+            nTasks = (uint64_t)level->numThreads * 10;
+            break;
+        }
+    }
+    nTasks = std::min<uint64_t>(nTasks, tripCount);
+
+    if (noGroup == 0) {
+        startOpenMPTaskGroup();
+    }
+
+    auto* patternTask =
+      Runtime::memoryObjectPtr<WasmKmpTask>(memory, pattern->taskPtr);
+    uint8_t* patternBytes =
+      Runtime::memoryArrayPtr<uint8_t>(memory, pattern->taskPtr, pattern->size);
+
+    // Spread any remainder over the first few tasks
+    uint64_t base = tripCount / nTasks;
+    uint64_t extra = tripCount % nTasks;
+    uint64_t start = 0;
+    for (uint64_t t = 0; t < nTasks; t++) {
+        uint64_t count = base + (t < extra ? 1 : 0);
+
+        std::shared_ptr<OpenMPTask> node = allocateOpenMPTask(
+          pattern->team, pattern->size, pattern->routine);
+
+        uint8_t* bytes =
+          Runtime::memoryArrayPtr<uint8_t>(memory, node->taskPtr, node->size);
+        std::memcpy(bytes, patternBytes, node->size);
+
+        auto* task =
+          Runtime::memoryObjectPtr<WasmKmpTask>(memory, node->taskPtr);
+        if (patternTask->shareds != 0) {
+            task->shareds =
+              node->taskPtr + (patternTask->shareds - pattern->taskPtr);
+        }
+
+        uint64_t taskLower = lower + (start * stride);
+        uint64_t taskUpper = lower + ((start + count - 1) * stride);
+        *Runtime::memoryObjectPtr<uint64_t>(
+          memory, node->taskPtr + (lowerPtr - pattern->taskPtr)) = taskLower;
+        *Runtime::memoryObjectPtr<uint64_t>(
+          memory, node->taskPtr + (upperPtr - pattern->taskPtr)) = taskUpper;
+
+        // Lets the compiler copy-construct privates, and set lastprivate
+        if (taskDup != 0) {
+            Runtime::Function* dupFunc = module->getFunctionFromPtr(taskDup);
+            std::vector<IR::UntaggedValue> args = {
+                node->taskPtr, pattern->taskPtr, (I32)(t == nTasks - 1)
+            };
+            IR::UntaggedValue result;
+            module->executeWasmFunction(ctx, dupFunc, args, result);
+        }
+
+        queueOpenMPTask(node);
+        start += count;
+    }
+
+    freeOpenMPTask(*pattern);
+
+    if (noGroup == 0) {
+        endOpenMPTaskGroup(func);
+    }
+}
+
+// ---------------------------------------------------
+// REDUCTION
+// ---------------------------------------------------
+
+// Calls the compiler's reduce function on the calling thread
+static OpenMPReduceFunc getReduceFunc(
+  Runtime::ContextRuntimeData* contextRuntimeData,
+  I32 reduceFunc)
+{
+    WAVMWasmModule* module = getExecutingWAVMModule();
+    Runtime::Context* ctx =
+      Runtime::getContextFromRuntimeData(contextRuntimeData);
+    Runtime::Function* func = module->getFunctionFromPtr(reduceFunc);
+
+    return [module, ctx, func](int32_t lhs, int32_t rhs) {
+        std::vector<IR::UntaggedValue> args = { lhs, rhs };
+        IR::UntaggedValue result;
+        module->executeWasmFunction(ctx, func, args, result);
+    };
+}
+
+/**
+ * This function is called to start the critical section required to perform the
+ * reduction operation by each thread. It will then call __kmpc_end_reduce (and
+ * its nowait equivalent), when it's finished.
+ *
+ * It seems that in our case, always returning 1 for both kmpc_reduce and
+ * kmpc_reduce_nowait gets the right result.
+ *
+ * In the OpenMP source we can see a more varied set of return values, but these
+ * are for cases we don't yet support (notably teams):
+ * https://github.com/llvm/llvm-project/blob/main/openmp/runtime/src/kmp_csupport.cpp
+ *
+ * Note that the reduce vars passed into this function are the *LOCAL* copies
+ * on the thread's own stack used to hold intermediate results. There is
+ * apparently no way to get a reference to the final destination of the
+ * reduction result in this function, that is only known in kmpc_fork_call.
+ *
+ * When the whole team is on this host we do a tree reduction instead (see
+ * TreeReduction), returning 1 only on the master and 0 elsewhere, which tells
+ * the caller there's nothing left to do. The compiler only calls
+ * __kmpc_end_reduce when we return 1, so for blocking reductions the other
+ * threads wait at the barrier here.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_reduce",
+                               I32,
+                               __kmpc_reduce,
+                               I32 loc,
+                               I32 gtid,
+                               I32 numReduceVars,
+                               I32 reduceVarsSize,
+                               I32 reduceVarPtrs,
+                               I32 reduceFunc,
+                               I32 lockPtr)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_reduce {} {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  numReduceVars,
+                  reduceVarsSize,
+                  reduceVarPtrs,
+                  reduceFunc,
+                  lockPtr);
+
+    return startOpenMPReduce(msg,
+                             level,
+                             reduceVarPtrs,
+                             getReduceFunc(contextRuntimeData, reduceFunc),
+                             false);
+}
+
+/**
+ * See __kmpc_reduce
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_reduce_nowait",
+                               I32,
+                               __kmpc_reduce_nowait,
+                               I32 loc,
+                               I32 gtid,
+                               I32 numReduceVars,
+                               I32 reduceVarsSize,
+                               I32 reduceVarPtrs,
+                               I32 reduceFunc,
+                               I32 lockPtr)
+{
+    HOST_CALL(OpenMP);
+    OMP_FUNC_ARGS("__kmpc_reduce_nowait {} {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  numReduceVars,
+                  reduceVarsSize,
+                  reduceVarPtrs,
+                  reduceFunc,
+                  lockPtr);
+
+    return startOpenMPReduce(msg,
+                             level,
+                             reduceVarPtrs,
+                             getReduceFunc(contextRuntimeData, reduceFunc),
+                             true);
+}
+
+/**
+ * Finalises a blocking reduce, called by all threads.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_end_reduce",
+                               void,
+                               __kmpc_end_reduce,
                                I32 loc,
                                I32 gtid,
                                I32 lck)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("__kmpc_end_reduce {} {} {}", loc, gtid, lck);
-    endReduceCritical(msg, true);
+
+    endOpenMPReduce(msg, level, false);
 }
 
 /**
@@ -862,8 +1721,10 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 gtid,
                                I32 lck)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("__kmpc_end_reduce_nowait {} {} {}", loc, gtid, lck);
-    endReduceCritical(msg, false);
+
+    endOpenMPReduce(msg, level, true);
 }
 
 // ----------------------------------------------
@@ -879,6 +1740,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                int,
                                omp_get_num_devices)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC("omp_get_num_devices");
     return 1;
 }
@@ -892,6 +1754,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                omp_set_default_device,
                                int defaultDeviceNumber)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("omp_set_default_device {} (ignored)", defaultDeviceNumber);
 }
 
@@ -908,6 +1771,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 c,
                                I32 d)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("__atomic_load {} {} {} {}", a, b, c, d);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -923,6 +1787,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 e,
                                I32 f)
 {
+    HOST_CALL(OpenMP);
     OMP_FUNC_ARGS("__atomic_load {} {} {} {} {} {}", a, b, c, d, e, f);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
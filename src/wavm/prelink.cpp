@@ -0,0 +1,1055 @@
+#include <wasm/WasmCommon.h>
+#include <wavm/WAVMWasmModule.h>
+#include <wavm/prelink.h>
+
+#include <faabric/util/logging.h>
+
+#include <WAVM/IR/Module.h>
+#include <WAVM/IR/Operators.h>
+#include <WAVM/IR/Types.h>
+#include <WAVM/Inline/Serialization.h>
+#include <WAVM/WASM/WASM.h>
+
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+
+// See the dynamic linking conventions:
+// https://github.com/WebAssembly/tool-conventions/blob/main/DynamicLinking.md
+#define DYLINK_MEM_INFO 1
+
+#define PRELINKED_EXPORT_PREFIX "faasm.prelinked."
+
+using namespace WAVM;
+
+namespace wasm {
+
+std::string getPrelinkedExportName(size_t libIdx, const std::string& name)
+{
+    return PRELINKED_EXPORT_PREFIX + std::to_string(libIdx) + "." + name;
+}
+
+std::vector<std::string> getPrelinkedLibraryPaths(const IR::Module& module)
+{
+    std::vector<std::string> paths;
+    for (const auto& section : module.customSections) {
+        if (section.name != PRELINKED_SECTION_NAME) {
+            continue;
+        }
+
+        std::istringstream contents(
+          std::string(section.data.begin(), section.data.end()));
+        std::string line;
+        while (std::getline(contents, line)) {
+            if (!line.empty()) {
+                paths.emplace_back(line);
+            }
+        }
+    }
+
+    return paths;
+}
+
+namespace {
+
+// Sizes a shared library asks for in its dylink section
+struct DylinkInfo
+{
+    uint32_t memorySize = 0;
+    uint32_t memoryAlignment = 0;
+    uint32_t tableSize = 0;
+    uint32_t tableAlignment = 0;
+};
+
+uint32_t readVarUint32(const std::vector<U8>& data, size_t& pos)
+{
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (pos >= data.size()) {
+            break;
+        }
+
+        U8 b = data[pos++];
+        result |= (uint32_t)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            return result;
+        }
+    }
+
+    throw std::runtime_error("Invalid dylink section");
+}
+
+DylinkInfo getDylinkInfo(const IR::Module& module, const std::string& path)
+{
+    for (const auto& section : module.customSections) {
+        size_t pos = 0;
+
+        if (section.name == "dylink.0") {
+            // Newer libraries split the section, and we only need the sizes
+            bool found = false;
+            while (!found && pos < section.data.size()) {
+                U8 type = section.data[pos++];
+                uint32_t length = readVarUint32(section.data, pos);
+                if (type == DYLINK_MEM_INFO) {
+                    found = true;
+                } else {
+                    pos += length;
+                }
+            }
+
+            if (!found) {
+                continue;
+            }
+        } else if (section.name != "dylink") {
+            continue;
+        }
+
+        DylinkInfo info;
+        info.memorySize = readVarUint32(section.data, pos);
+        info.memoryAlignment = readVarUint32(section.data, pos);
+        info.tableSize = readVarUint32(section.data, pos);
+        info.tableAlignment = readVarUint32(section.data, pos);
+        return info;
+    }
+
+    SPDLOG_ERROR("{} has no dylink section, so isn't a shared library", path);
+    throw std::runtime_error("Prelinking a module that isn't a shared library");
+}
+
+IR::Module loadModule(const std::vector<uint8_t>& bytes,
+                      const std::string& path)
+{
+    IR::Module module;
+    setWavmFeatureSpec(module.featureSpec);
+
+    WASM::LoadError loadError;
+    if (!WASM::loadBinaryModule(
+          bytes.data(), bytes.size(), module, &loadError)) {
+        SPDLOG_ERROR("Failed to parse {} for prelinking: {}",
+                     path,
+                     loadError.message);
+        throw std::runtime_error("Failed to parse wasm for prelinking");
+    }
+
+    return module;
+}
+
+// Where each of an input module's indices ends up in the linked module
+struct IndexMaps
+{
+    std::vector<Uptr> types;
+    std::vector<Uptr> functions;
+    std::vector<Uptr> globals;
+    Uptr firstElemSegment = 0;
+    Uptr firstDataSegment = 0;
+};
+
+// Re-encodes a function's code with the indices it refers to remapped. The
+// branch tables are indexed per function, so don't change.
+struct CodeRemapper
+{
+    typedef void Result;
+
+    IR::OperatorEncoderStream& encoder;
+    const IndexMaps& maps;
+
+    template<typename Imm>
+    void remap(Imm& imm)
+    {
+        if constexpr (requires { imm.functionIndex; }) {
+            imm.functionIndex = maps.functions.at(imm.functionIndex);
+        }
+
+        if constexpr (std::is_same_v<Imm, IR::GetOrSetVariableImm<true>>) {
+            imm.variableIndex = maps.globals.at(imm.variableIndex);
+        }
+
+        if constexpr (std::is_same_v<Imm, IR::CallIndirectImm>) {
+            imm.type.index = maps.types.at(imm.type.index);
+        }
+
+        if constexpr (std::is_same_v<Imm, IR::ControlStructureImm>) {
+            if (imm.type.format == IR::IndexedBlockType::functionType) {
+                imm.type.index = maps.types.at(imm.type.index);
+            }
+        }
+
+        if constexpr (requires { imm.dataSegmentIndex; }) {
+            imm.dataSegmentIndex += maps.firstDataSegment;
+        }
+
+        if constexpr (requires { imm.elemSegmentIndex; }) {
+            imm.elemSegmentIndex += maps.firstElemSegment;
+        }
+    }
+
+#define VISIT_OP(opcode, name, nameString, Imm, ...)                           \
+    void name(Imm imm)                                                         \
+    {                                                                          \
+        remap(imm);                                                            \
+        encoder.name(imm);                                                     \
+    }
+    WAVM_ENUM_OPERATORS(VISIT_OP)
+#undef VISIT_OP
+
+    void unknown(IR::Opcode opcode)
+    {
+        throw std::runtime_error("Unknown opcode when prelinking");
+    }
+};
+
+// One of the modules being linked, the main module being the first
+struct InputModule
+{
+    std::string path;
+    IR::Module module;
+    IR::DisassemblyNames names;
+    DylinkInfo dylink;
+
+    Uptr memoryBase = 0;
+    Uptr tableBase = 0;
+
+    // Index of the first of this module's function definitions, counting
+    // across all modules' definitions
+    Uptr firstFunctionDef = 0;
+
+    // Index of the first of this module's globals in the linked module.
+    // Libraries' imported globals are turned into definitions after their
+    // own, unless they resolve to another module's global.
+    Uptr firstGlobal = 0;
+
+    // Values of imported globals that turn out to be constants
+    std::vector<std::optional<I32>> globalConstants;
+
+    IndexMaps maps;
+
+    bool isMain = false;
+};
+
+class Prelinker
+{
+  public:
+    Prelinker(const std::vector<uint8_t>& mainBytes,
+              const std::vector<PrelinkedLibrary>& libs)
+    {
+        InputModule& main = inputs.emplace_back();
+        main.isMain = true;
+        main.path = "main module";
+        main.module = loadModule(mainBytes, main.path);
+
+        for (const auto& lib : libs) {
+            InputModule& input = inputs.emplace_back();
+            input.path = lib.path;
+            input.module = loadModule(lib.bytes, lib.path);
+            input.dylink = getDylinkInfo(input.module, lib.path);
+        }
+
+        for (auto& input : inputs) {
+            IR::getDisassemblyNames(input.module, input.names);
+        }
+
+        setWavmFeatureSpec(linked.featureSpec);
+    }
+
+    std::vector<uint8_t> link()
+    {
+        checkInputs();
+        layOut();
+        mergeTypes();
+        indexExports();
+        resolveFunctions();
+        resolveGlobals();
+        mergeFunctions();
+        mergeSegments();
+        addConstructors();
+        mergeExports();
+        mergeNames();
+
+        std::vector<uint8_t> bytes = WASM::saveBinaryModule(linked);
+
+        // Loading the result validates it
+        loadModule(bytes, "prelinked module");
+
+        return bytes;
+    }
+
+  private:
+    std::vector<InputModule> inputs;
+    IR::Module linked;
+
+    U64 memoryEnd = 0;
+    U64 tableEnd = 0;
+
+    // Exports across all modules, the first definition of a name winning
+    struct GlobalExport
+    {
+        size_t input;
+        Uptr index;
+    };
+    std::unordered_map<std::string, Uptr> functionExports;
+    std::unordered_map<std::string, GlobalExport> globalExports;
+    std::unordered_map<std::string, I32> dataExports;
+
+    // Linked function imports, by module and name
+    std::unordered_map<std::string, Uptr> functionImports;
+
+    // Functions whose addresses libraries take, given their own table slots
+    std::vector<Uptr> gotFunctions;
+    std::unordered_map<Uptr, Uptr> gotFunctionSlots;
+    Uptr gotTableBase = 0;
+
+    // Function definitions, as indices across all modules, are only given
+    // their final index once we know how many imports there are
+    std::vector<Uptr> defTypes;
+    Uptr nFunctionDefs = 0;
+
+    Uptr getDefIndex(Uptr def) const
+    {
+        return linked.functions.imports.size() + def;
+    }
+
+    static std::string getImportKey(const std::string& moduleName,
+                                    const std::string& exportName)
+    {
+        return moduleName + "." + exportName;
+    }
+
+    void checkInputs()
+    {
+        const IR::Module& main = inputs.front().module;
+        if (main.memories.defs.size() != 1 || main.tables.defs.size() != 1) {
+            SPDLOG_ERROR("Main module must define one memory and one table");
+            throw std::runtime_error("Invalid main module for prelinking");
+        }
+
+        if (!getPrelinkedLibraryPaths(main).empty()) {
+            SPDLOG_ERROR("Main module has already been prelinked");
+            throw std::runtime_error("Main module already prelinked");
+        }
+
+        for (const auto& input : inputs) {
+            const IR::Module& m = input.module;
+            if (!m.exceptionTypes.imports.empty() ||
+                !m.exceptionTypes.defs.empty()) {
+                SPDLOG_ERROR("Cannot prelink {} as it uses exceptions",
+                             input.path);
+                throw std::runtime_error("Unsupported module for prelinking");
+            }
+
+            bool ownsMemory =
+              !m.memories.defs.empty() || !m.tables.defs.empty();
+            bool extraImports =
+              m.memories.imports.size() > 1 || m.tables.imports.size() > 1;
+            if (!input.isMain && (ownsMemory || extraImports)) {
+                SPDLOG_ERROR("Shared library {} must import its memory and "
+                             "table from the main module",
+                             input.path);
+                throw std::runtime_error("Unsupported module for prelinking");
+            }
+        }
+    }
+
+    // Gives each library its data and table entries after the main module's
+    void layOut()
+    {
+        const IR::Module& main = inputs.front().module;
+        memoryEnd = main.memories.defs[0].type.size.min * WASM_BYTES_PER_PAGE;
+        tableEnd = main.tables.defs[0].type.size.min;
+
+        for (size_t i = 1; i < inputs.size(); i++) {
+            InputModule& input = inputs[i];
+            U64 alignment = (U64)1 << input.dylink.memoryAlignment;
+            memoryEnd = (memoryEnd + alignment - 1) / alignment * alignment;
+
+            input.memoryBase = memoryEnd;
+            memoryEnd += input.dylink.memorySize;
+
+            input.tableBase = tableEnd;
+            tableEnd += input.dylink.tableSize;
+
+            SPDLOG_DEBUG("Prelinking {} with data at {} and table at {}",
+                         input.path,
+                         input.memoryBase,
+                         input.tableBase);
+        }
+
+        if (memoryEnd > (U64)MAX_WASM_MEM) {
+            throw std::runtime_error("Prelinked libraries don't fit in memory");
+        }
+
+        gotTableBase = tableEnd;
+
+        linked.memories = main.memories;
+        linked.tables = main.tables;
+    }
+
+    Uptr getTypeIndex(const IR::FunctionType& type)
+    {
+        for (Uptr i = 0; i < linked.types.size(); i++) {
+            if (linked.types[i] == type) {
+                return i;
+            }
+        }
+
+        linked.types.push_back(type);
+        return linked.types.size() - 1;
+    }
+
+    void mergeTypes()
+    {
+        for (auto& input : inputs) {
+            for (const auto& type : input.module.types) {
+                input.maps.types.push_back(getTypeIndex(type));
+            }
+
+            input.firstFunctionDef = nFunctionDefs;
+            for (const auto& def : input.module.functions.defs) {
+                defTypes.push_back(input.maps.types.at(def.type.index));
+            }
+            nFunctionDefs += input.module.functions.defs.size();
+        }
+    }
+
+    void indexExports()
+    {
+        for (size_t i = 0; i < inputs.size(); i++) {
+            InputModule& input = inputs[i];
+            const IR::Module& m = input.module;
+            Uptr nFuncImports = m.functions.imports.size();
+            Uptr nGlobalImports = m.globals.imports.size();
+
+            for (const auto& e : m.exports) {
+                if (e.kind == IR::ExternKind::function &&
+                    e.index >= nFuncImports) {
+                    functionExports.emplace(
+                      e.name, input.firstFunctionDef + e.index - nFuncImports);
+                } else if (e.kind == IR::ExternKind::global &&
+                           e.index >= nGlobalImports) {
+                    globalExports.emplace(e.name, GlobalExport{ i, e.index });
+
+                    // As in the GOT, pointers to data are exported as
+                    // constants relative to the module's memory base
+                    const IR::GlobalDef& global = m.globals.getDef(e.index);
+                    if (global.initializer.type ==
+                        IR::InitializerExpression::Type::i32_const) {
+                        dataExports.emplace(e.name,
+                                            (I32)input.memoryBase +
+                                              global.initializer.i32);
+                    }
+                }
+            }
+        }
+    }
+
+    // Libraries' function imports become calls to other modules' definitions
+    // where there is one, otherwise they're imported from the host as before
+    void resolveFunctions()
+    {
+        const IR::Module& main = inputs.front().module;
+        for (const auto& import : main.functions.imports) {
+            IR::Import<IR::IndexedFunctionType> linkedImport = import;
+            linkedImport.type.index =
+              inputs.front().maps.types.at(import.type.index);
+
+            functionImports.emplace(
+              getImportKey(import.moduleName, import.exportName),
+              linked.functions.imports.size());
+            linked.functions.imports.push_back(linkedImport);
+        }
+
+        // Defs are marked by setting the top bit until we know their index
+        const Uptr defBit = (Uptr)1 << (sizeof(Uptr) * 8 - 1);
+
+        for (auto& input : inputs) {
+            const IR::Module& m = input.module;
+            for (Uptr i = 0; i < m.functions.imports.size(); i++) {
+                const auto& import = m.functions.imports[i];
+                Uptr type = input.maps.types.at(import.type.index);
+                const std::string key =
+                  getImportKey(import.moduleName, import.exportName);
+
+                auto existing = functionImports.find(key);
+                auto exported = functionExports.find(import.exportName);
+                if (existing != functionImports.end()) {
+                    checkFunctionType(
+                      input,
+                      import.exportName,
+                      type,
+                      linked.functions.imports[existing->second].type.index);
+                    input.maps.functions.push_back(existing->second);
+                } else if (!input.isMain && import.moduleName == "env" &&
+                           exported != functionExports.end()) {
+                    checkFunctionType(input,
+                                      import.exportName,
+                                      type,
+                                      defTypes.at(exported->second));
+                    input.maps.functions.push_back(exported->second | defBit);
+                } else {
+                    IR::Import<IR::IndexedFunctionType> linkedImport = import;
+                    linkedImport.type.index = type;
+
+                    Uptr idx = linked.functions.imports.size();
+                    functionImports.emplace(key, idx);
+                    linked.functions.imports.push_back(linkedImport);
+                    input.maps.functions.push_back(idx);
+                }
+            }
+
+            for (Uptr i = 0; i < m.functions.defs.size(); i++) {
+                input.maps.functions.push_back((input.firstFunctionDef + i) |
+                                               defBit);
+            }
+        }
+
+        for (auto& input : inputs) {
+            for (auto& idx : input.maps.functions) {
+                if (idx & defBit) {
+                    idx = getDefIndex(idx & ~defBit);
+                }
+            }
+        }
+
+        linked.imports.clear();
+        for (const auto& kindAndIndex : main.imports) {
+            if (kindAndIndex.kind != IR::ExternKind::function) {
+                linked.imports.push_back(kindAndIndex);
+            }
+        }
+        for (Uptr i = 0; i < linked.functions.imports.size(); i++) {
+            linked.imports.push_back({ IR::ExternKind::function, i });
+        }
+    }
+
+    void checkFunctionType(const InputModule& input,
+                           const std::string& name,
+                           Uptr expected,
+                           Uptr actual)
+    {
+        if (expected != actual) {
+            SPDLOG_ERROR("{} imports {} as {}, but it is a {}",
+                         input.path,
+                         name,
+                         IR::asString(linked.types[expected]),
+                         IR::asString(linked.types[actual]));
+            throw std::runtime_error("Mismatched import when prelinking");
+        }
+    }
+
+    Uptr getFunctionForGOT(const InputModule& input, const std::string& name)
+    {
+        Uptr func;
+        auto exported = functionExports.find(name);
+        auto imported = functionImports.find(getImportKey("env", name));
+        if (exported != functionExports.end()) {
+            func = getDefIndex(exported->second);
+        } else if (imported != functionImports.end()) {
+            func = imported->second;
+        } else {
+            SPDLOG_ERROR("{} takes the address of {}, which isn't defined by "
+                         "the main module or any prelinked library",
+                         input.path,
+                         name);
+            throw std::runtime_error("Missing function when prelinking");
+        }
+
+        auto slot = gotFunctionSlots.find(func);
+        if (slot != gotFunctionSlots.end()) {
+            return slot->second;
+        }
+
+        Uptr newSlot = gotTableBase + gotFunctions.size();
+        gotFunctions.push_back(func);
+        gotFunctionSlots.emplace(func, newSlot);
+        return newSlot;
+    }
+
+    Uptr getMainStackPointer()
+    {
+        const InputModule& main = inputs.front();
+        const IR::Module& m = main.module;
+        for (Uptr i = 0; i < m.globals.size(); i++) {
+            if (i < main.names.globals.size() &&
+                main.names.globals[i] == "__stack_pointer") {
+                return i;
+            }
+        }
+
+        // The linker puts the stack pointer first if it isn't named
+        for (Uptr i = m.globals.imports.size(); i < m.globals.size(); i++) {
+            const IR::GlobalType& type = m.globals.getType(i);
+            if (type.isMutable && type.valueType == IR::ValueType::i32) {
+                return i;
+            }
+        }
+
+        throw std::runtime_error("Main module has no stack pointer");
+    }
+
+    // Libraries' imported globals become constants, apart from the stack
+    // pointer, which is shared with the main module
+    void resolveGlobals()
+    {
+        InputModule& main = inputs.front();
+        linked.globals.imports = main.module.globals.imports;
+
+        Uptr nGlobals = main.module.globals.size();
+        for (size_t i = 1; i < inputs.size(); i++) {
+            inputs[i].firstGlobal = nGlobals;
+            nGlobals += inputs[i].module.globals.size();
+        }
+
+        Uptr stackPointer = getMainStackPointer();
+
+        for (auto& input : inputs) {
+            const IR::Module& m = input.module;
+            Uptr nImports = m.globals.imports.size();
+            input.globalConstants.resize(m.globals.size());
+
+            if (input.isMain) {
+                for (Uptr i = 0; i < m.globals.size(); i++) {
+                    input.maps.globals.push_back(i);
+                }
+                continue;
+            }
+
+            // Imports are placed after the library's own globals
+            for (Uptr i = 0; i < nImports; i++) {
+                input.maps.globals.push_back(input.firstGlobal +
+                                             m.globals.defs.size() + i);
+            }
+            for (Uptr i = 0; i < m.globals.defs.size(); i++) {
+                input.maps.globals.push_back(input.firstGlobal + i);
+            }
+
+            for (Uptr i = 0; i < nImports; i++) {
+                const auto& import = m.globals.imports[i];
+                const std::string& name = import.exportName;
+
+                if (import.moduleName == "GOT.mem") {
+                    auto data = dataExports.find(name);
+                    if (data == dataExports.end()) {
+                        SPDLOG_ERROR("Memory offset not found in GOT for {}: "
+                                     "{}",
+                                     input.path,
+                                     name);
+                        throw std::runtime_error(
+                          "Missing data when prelinking");
+                    }
+                    input.globalConstants[i] = data->second;
+                } else if (import.moduleName == "GOT.func") {
+                    input.globalConstants[i] =
+                      (I32)getFunctionForGOT(input, name);
+                } else if (name == "__memory_base") {
+                    input.globalConstants[i] = (I32)input.memoryBase;
+                } else if (name == "__table_base") {
+                    input.globalConstants[i] = (I32)input.tableBase;
+                } else if (name == "__stack_pointer") {
+                    input.maps.globals[i] = stackPointer;
+                } else {
+                    input.maps.globals[i] = getExportedGlobal(input, i);
+                }
+            }
+        }
+
+        for (auto& input : inputs) {
+            if (input.isMain) {
+                for (const auto& def : input.module.globals.defs) {
+                    IR::GlobalDef linkedDef = def;
+                    linkedDef.initializer =
+                      remapInitializer(input, def.initializer);
+                    linked.globals.defs.push_back(linkedDef);
+                }
+                continue;
+            }
+
+            addLibraryGlobals(input);
+        }
+    }
+
+    Uptr getExportedGlobal(const InputModule& input, Uptr importIdx)
+    {
+        const auto& import = input.module.globals.imports[importIdx];
+        auto exported = globalExports.find(import.exportName);
+        if (import.moduleName != "env" || exported == globalExports.end()) {
+            SPDLOG_ERROR("Cannot resolve global {}.{} for {}",
+                         import.moduleName,
+                         import.exportName,
+                         input.path);
+            throw std::runtime_error("Missing global when prelinking");
+        }
+
+        const InputModule& owner = inputs.at(exported->second.input);
+        const IR::Module& m = owner.module;
+        if (!(m.globals.getType(exported->second.index) == import.type)) {
+            SPDLOG_ERROR("{} imports global {} with the wrong type",
+                         input.path,
+                         import.exportName);
+            throw std::runtime_error("Mismatched import when prelinking");
+        }
+
+        if (owner.isMain) {
+            return exported->second.index;
+        }
+
+        return owner.firstGlobal + exported->second.index -
+               m.globals.imports.size();
+    }
+
+    void addLibraryGlobals(InputModule& input)
+    {
+        const IR::Module& m = input.module;
+        std::unordered_set<Uptr> exported;
+        for (const auto& e : m.exports) {
+            if (e.kind == IR::ExternKind::global) {
+                exported.insert(e.index);
+            }
+        }
+
+        Uptr nImports = m.globals.imports.size();
+        for (Uptr i = 0; i < m.globals.defs.size(); i++) {
+            IR::GlobalDef def = m.globals.defs[i];
+            def.initializer = remapInitializer(input, def.initializer);
+
+            // Pointers to exported data are made absolute, as for the main
+            // module, so later dynamic modules find them in the GOT
+            if (exported.contains(nImports + i) &&
+                def.initializer.type ==
+                  IR::InitializerExpression::Type::i32_const) {
+                def.initializer = IR::InitializerExpression(
+                  (I32)(input.memoryBase + def.initializer.i32));
+            }
+
+            linked.globals.defs.push_back(def);
+        }
+
+        // Imports that weren't resolved to another global are left unused
+        for (Uptr i = 0; i < nImports; i++) {
+            IR::GlobalDef def;
+            def.type = m.globals.imports[i].type;
+            def.initializer =
+              IR::InitializerExpression(input.globalConstants[i].value_or(0));
+            linked.globals.defs.push_back(def);
+        }
+    }
+
+    // Initialisers can only refer to imported globals, so libraries' ones
+    // must be folded to constants
+    IR::InitializerExpression remapInitializer(
+      const InputModule& input,
+      const IR::InitializerExpression& expr)
+    {
+        IR::InitializerExpression result = expr;
+        if (expr.type == IR::InitializerExpression::Type::global_get) {
+            if (input.globalConstants.at(expr.ref).has_value()) {
+                return IR::InitializerExpression(
+                  input.globalConstants[expr.ref].value());
+            }
+
+            if (!input.isMain) {
+                SPDLOG_ERROR("Cannot prelink {}, as an initialiser reads a "
+                             "global that isn't constant",
+                             input.path);
+                throw std::runtime_error("Unsupported module for prelinking");
+            }
+
+            result.ref = input.maps.globals.at(expr.ref);
+        } else if (expr.type == IR::InitializerExpression::Type::ref_func) {
+            result.ref = input.maps.functions.at(expr.ref);
+        }
+
+        return result;
+    }
+
+    void mergeFunctions()
+    {
+        for (auto& input : inputs) {
+            for (const auto& def : input.module.functions.defs) {
+                IR::FunctionDef linkedDef;
+                linkedDef.type.index = input.maps.types.at(def.type.index);
+                linkedDef.nonParameterLocalTypes = def.nonParameterLocalTypes;
+                linkedDef.branchTables = def.branchTables;
+
+                Serialization::ArrayOutputStream stream;
+                IR::OperatorEncoderStream encoder(stream);
+                CodeRemapper remapper{ encoder, input.maps };
+
+                IR::OperatorDecoderStream decoder(def.code);
+                while (decoder) {
+                    decoder.decodeOp(remapper);
+                }
+
+                linkedDef.code = stream.getBytes();
+                linked.functions.defs.push_back(linkedDef);
+            }
+        }
+    }
+
+    void mergeSegments()
+    {
+        for (auto& input : inputs) {
+            input.maps.firstElemSegment = linked.elemSegments.size();
+            for (const auto& es : input.module.elemSegments) {
+                IR::ElemSegment linkedSegment = es;
+                if (es.type == IR::ElemSegment::Type::active) {
+                    linkedSegment.baseOffset =
+                      remapInitializer(input, es.baseOffset);
+                }
+
+                auto contents =
+                  std::make_shared<IR::ElemSegment::Contents>(*es.contents);
+                if (contents->encoding == IR::ElemSegment::Encoding::index) {
+                    if (contents->externKind == IR::ExternKind::function) {
+                        for (auto& idx : contents->elemIndices) {
+                            idx = input.maps.functions.at(idx);
+                        }
+                    }
+                } else {
+                    for (auto& elemExpr : contents->elemExprs) {
+                        if (elemExpr.type == IR::ElemExpr::Type::ref_func) {
+                            elemExpr.index =
+                              input.maps.functions.at(elemExpr.index);
+                        }
+                    }
+                }
+                linkedSegment.contents = contents;
+
+                linked.elemSegments.push_back(linkedSegment);
+            }
+
+            input.maps.firstDataSegment = linked.dataSegments.size();
+            for (const auto& ds : input.module.dataSegments) {
+                IR::DataSegment linkedSegment = ds;
+                if (ds.isActive) {
+                    linkedSegment.baseOffset =
+                      remapInitializer(input, ds.baseOffset);
+                }
+
+                linked.dataSegments.push_back(linkedSegment);
+            }
+        }
+
+        // Functions whose addresses are taken go after the libraries' tables
+        if (!gotFunctions.empty()) {
+            auto contents = std::make_shared<IR::ElemSegment::Contents>();
+            contents->encoding = IR::ElemSegment::Encoding::index;
+            contents->elemType = IR::ReferenceType::funcref;
+            contents->externKind = IR::ExternKind::function;
+            contents->elemIndices = gotFunctions;
+
+            IR::ElemSegment gotSegment;
+            gotSegment.type = IR::ElemSegment::Type::active;
+            gotSegment.tableIndex = 0;
+            gotSegment.baseOffset =
+              IR::InitializerExpression((I32)gotTableBase);
+            gotSegment.contents = contents;
+            linked.elemSegments.push_back(gotSegment);
+
+            tableEnd += gotFunctions.size();
+        }
+
+        IR::SizeConstraints& memorySize = linked.memories.defs[0].type.size;
+        memorySize.min = std::max<U64>(
+          memorySize.min,
+          (memoryEnd + WASM_BYTES_PER_PAGE - 1) / WASM_BYTES_PER_PAGE);
+        memorySize.max = std::max(memorySize.max, memorySize.min);
+
+        IR::SizeConstraints& tableSize = linked.tables.defs[0].type.size;
+        tableSize.min = std::max<U64>(tableSize.min, tableEnd);
+        tableSize.max = std::max(tableSize.max, tableSize.min);
+    }
+
+    Uptr getExportedFunction(const InputModule& input, const std::string& name)
+    {
+        for (const auto& e : input.module.exports) {
+            if (e.kind == IR::ExternKind::function && e.name == name) {
+                return input.maps.functions.at(e.index);
+            }
+        }
+
+        return UINTPTR_MAX;
+    }
+
+    // The main module's constructors go first, then each library's in the
+    // order they were given, as if they'd been loaded in that order
+    void addConstructors()
+    {
+        Uptr typeIdx = getTypeIndex(IR::FunctionType({}, {}));
+
+        Serialization::ArrayOutputStream stream;
+        IR::OperatorEncoderStream encoder(stream);
+        for (const auto& input : inputs) {
+            if (!input.isMain &&
+                input.module.startFunctionIndex != UINTPTR_MAX) {
+                encoder.call(
+                  { input.maps.functions.at(input.module.startFunctionIndex) });
+            }
+
+            Uptr ctors = getExportedFunction(input, WASM_CTORS_FUNC_NAME);
+            if (ctors != UINTPTR_MAX) {
+                encoder.call({ ctors });
+            }
+        }
+        encoder.end();
+
+        IR::FunctionDef def;
+        def.type.index = typeIdx;
+        def.code = stream.getBytes();
+        linked.functions.defs.push_back(def);
+
+        const IR::Module& main = inputs.front().module;
+        if (main.startFunctionIndex != UINTPTR_MAX) {
+            linked.startFunctionIndex =
+              inputs.front().maps.functions.at(main.startFunctionIndex);
+        }
+    }
+
+    void mergeExports()
+    {
+        Uptr ctorsIdx = linked.functions.size() - 1;
+        std::unordered_set<std::string> names;
+
+        for (const auto& e : inputs.front().module.exports) {
+            IR::Export linkedExport = e;
+            if (e.kind == IR::ExternKind::function) {
+                linkedExport.index = inputs.front().maps.functions.at(e.index);
+            } else if (e.kind == IR::ExternKind::global) {
+                linkedExport.index = inputs.front().maps.globals.at(e.index);
+            }
+
+            if (e.name == WASM_CTORS_FUNC_NAME) {
+                linkedExport.index = ctorsIdx;
+            }
+
+            names.insert(e.name);
+            linked.exports.push_back(linkedExport);
+        }
+
+        if (!names.contains(WASM_CTORS_FUNC_NAME)) {
+            IR::Export ctorsExport;
+            ctorsExport.name = WASM_CTORS_FUNC_NAME;
+            ctorsExport.kind = IR::ExternKind::function;
+            ctorsExport.index = ctorsIdx;
+            names.insert(ctorsExport.name);
+            linked.exports.push_back(ctorsExport);
+        }
+
+        // Libraries' exports are kept for dlsym, and also exported under
+        // their own names where they don't clash, for the GOT
+        std::vector<IR::Export> unprefixed;
+        for (size_t i = 1; i < inputs.size(); i++) {
+            const InputModule& input = inputs[i];
+            for (const auto& e : input.module.exports) {
+                IR::Export linkedExport = e;
+                if (e.kind == IR::ExternKind::function) {
+                    linkedExport.index = input.maps.functions.at(e.index);
+                } else if (e.kind == IR::ExternKind::global) {
+                    linkedExport.index = input.maps.globals.at(e.index);
+                } else {
+                    continue;
+                }
+
+                if (names.insert(e.name).second) {
+                    unprefixed.push_back(linkedExport);
+                }
+
+                linkedExport.name = getPrelinkedExportName(i - 1, e.name);
+                linked.exports.push_back(linkedExport);
+            }
+        }
+
+        linked.exports.insert(
+          linked.exports.end(), unprefixed.begin(), unprefixed.end());
+    }
+
+    void mergeNames()
+    {
+        IR::DisassemblyNames names;
+        names.moduleName = inputs.front().names.moduleName;
+        names.types.resize(linked.types.size());
+        names.functions.resize(linked.functions.size());
+        names.globals.resize(linked.globals.size());
+        names.memories = inputs.front().names.memories;
+        names.tables = inputs.front().names.tables;
+
+        for (const auto& input : inputs) {
+            const IR::Module& m = input.module;
+            for (Uptr i = 0; i < m.functions.size(); i++) {
+                if (i >= input.names.functions.size()) {
+                    break;
+                }
+
+                // Imports resolved to definitions keep the definition's name
+                Uptr idx = input.maps.functions[i];
+                bool isDef = i >= m.functions.imports.size();
+                if (isDef || names.functions[idx].name.empty()) {
+                    names.functions[idx] = input.names.functions[i];
+                }
+            }
+
+            for (Uptr i = 0; i < m.globals.size(); i++) {
+                Uptr idx = input.maps.globals[i];
+                if (i < input.names.globals.size() &&
+                    names.globals[idx].empty()) {
+                    names.globals[idx] = input.names.globals[i];
+                }
+            }
+
+            names.elemSegments.insert(names.elemSegments.end(),
+                                      input.names.elemSegments.begin(),
+                                      input.names.elemSegments.end());
+            names.elemSegments.resize(input.maps.firstElemSegment +
+                                      m.elemSegments.size());
+
+            names.dataSegments.insert(names.dataSegments.end(),
+                                      input.names.dataSegments.begin(),
+                                      input.names.dataSegments.end());
+            names.dataSegments.resize(input.maps.firstDataSegment +
+                                      m.dataSegments.size());
+        }
+
+        names.functions.back().name = "faasm_prelinked_ctors";
+        names.elemSegments.resize(linked.elemSegments.size());
+
+        // Keep the main module's other custom sections
+        for (const auto& section : inputs.front().module.customSections) {
+            if (section.name != "name") {
+                linked.customSections.push_back(section);
+            }
+        }
+
+        IR::setDisassemblyNames(linked, names);
+
+        std::string paths;
+        for (size_t i = 1; i < inputs.size(); i++) {
+            paths += inputs[i].path + "\n";
+        }
+
+        IR::CustomSection section;
+        section.name = PRELINKED_SECTION_NAME;
+        section.data = std::vector<U8>(paths.begin(), paths.end());
+        linked.customSections.insert(linked.customSections.begin(), section);
+    }
+};
+}
+
+std::vector<uint8_t> wavmPrelink(const std::vector<uint8_t>& mainBytes,
+                                 const std::vector<PrelinkedLibrary>& libs)
+{
+    if (libs.empty()) {
+        throw std::runtime_error("No libraries to prelink");
+    }
+
+    Prelinker prelinker(mainBytes, libs);
+    std::vector<uint8_t> bytes = prelinker.link();
+
+    SPDLOG_INFO("Prelinked {} libraries into main module ({} -> {} bytes)",
+                libs.size(),
+                mainBytes.size(),
+                bytes.size());
+
+    return bytes;
+}
+}
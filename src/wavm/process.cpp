@@ -1,5 +1,6 @@
 #include "WAVMWasmModule.h"
 #include "syscalls.h"
+#include <wasm/call_metrics.h>
 
 #include <faabric/util/logging.h>
 
@@ -26,11 +27,13 @@ I32 s__waitpid(I32 pid, I32 statusPtr, I32 options)
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "fork", I32, fork)
 {
+    HOST_CALL(Process);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "chdir", I32, s__chdir, I32 a)
 {
+    HOST_CALL(Process);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -42,46 +45,55 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 b,
                                I32 c)
 {
+    HOST_CALL(Process);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "execv", I32, s__execv, I32 a, I32 b)
 {
+    HOST_CALL(Process);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "kill", I32, s__kill, I32 a, I32 b)
 {
+    HOST_CALL(Process);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "wait", I32, s__wait, I32 a)
 {
+    HOST_CALL(Process);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "pclose", I32, s__pclose, I32 a)
 {
+    HOST_CALL(Process);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "pipe", I32, s__pipe, I32 a)
 {
+    HOST_CALL(Process);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "popen", I32, s__popen, I32 a, I32 b)
 {
+    HOST_CALL(Process);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "raise", I32, s__raise, I32 a)
 {
+    HOST_CALL(Process);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "system", I32, s__system, I32 a)
 {
+    HOST_CALL(Process);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -93,6 +105,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 statusPtr,
                                I32 options)
 {
+    HOST_CALL(Process);
     SPDLOG_DEBUG("S - waitpid {} {} {}", pid, statusPtr, options);
 
     // Note, on success, waitpid returns the process ID that has changed state.
@@ -111,6 +124,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 d,
                                I32 e)
 {
+    HOST_CALL(Process);
     SPDLOG_DEBUG("S - openpty - {} {} {} {} {}", a, b, c, d, e);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -124,6 +138,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 c,
                                I32 d)
 {
+    HOST_CALL(Process);
     SPDLOG_DEBUG("S - forkpty - {} {} {} {}", a, b, c, d);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -0,0 +1,237 @@
+#include <conf/FaasmConfig.h>
+#include <wavm/WAVMWasmModule.h>
+#include <wavm/profiler.h>
+
+#include <faabric/util/func.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <WAVM/Runtime/Runtime.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Older glibc headers don't name the thread ID field
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+using namespace WAVM;
+
+namespace wasm {
+
+static std::mutex profileFileMx;
+
+static std::once_flag handlerFlag;
+
+static std::mutex namesMx;
+
+// Disassembly maps are only built once per function, keyed by user/function
+static std::map<std::string, std::map<std::string, std::string>> namesCache;
+
+// The profiler sampling the calling thread, if any
+static thread_local WasmSamplingProfiler* activeProfiler = nullptr;
+
+static void profilerSignalHandler(int signal)
+{
+    int savedErrno = errno;
+    if (activeProfiler != nullptr) {
+        activeProfiler->recordSample();
+    }
+    errno = savedErrno;
+}
+
+static void installSignalHandler()
+{
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = profilerSignalHandler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    if (sigaction(SIGPROF, &action, nullptr) != 0) {
+        SPDLOG_ERROR("Failed to install profiler signal handler: {}",
+                     std::strerror(errno));
+        throw std::runtime_error("Failed to install profiler signal handler");
+    }
+}
+
+static const std::map<std::string, std::string>& getFunctionNames(
+  WAVMWasmModule& module,
+  const std::string& funcStr)
+{
+    faabric::util::UniqueLock lock(namesMx);
+    auto it = namesCache.find(funcStr);
+    if (it == namesCache.end()) {
+        it = namesCache.emplace(funcStr, module.buildDisassemblyMap()).first;
+    }
+
+    return it->second;
+}
+
+bool isWasmProfiling()
+{
+    return !conf::getFaasmConfig().wasmProfileDir.empty();
+}
+
+bool isCallProfiled(const faabric::Message& msg)
+{
+    if (!isWasmProfiling()) {
+        return false;
+    }
+
+    // Message IDs are spread evenly, so picking on them samples the right
+    // share of calls without having to coordinate between hosts
+    int percent = conf::getFaasmConfig().wasmProfilePercent;
+    return (uint64_t)(uint32_t)msg.id() % 100 < (uint64_t)percent;
+}
+
+std::string foldWasmCallStack(const std::vector<std::string>& frames,
+                              const std::map<std::string, std::string>& names)
+{
+    // Frames look like wasm!<module>!<function>+<instruction index>
+    const std::string prefix = "wasm!";
+
+    std::string folded;
+    for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+        if (it->compare(0, prefix.size(), prefix) != 0) {
+            continue;
+        }
+
+        std::string name = it->substr(0, it->find('+'));
+        name = name.substr(name.rfind('!') + 1);
+
+        auto nameIt = names.find(name);
+        if (nameIt != names.end() && !nameIt->second.empty()) {
+            name = nameIt->second;
+        }
+
+        // Semicolons separate frames, and spaces the count
+        std::replace(name.begin(), name.end(), ';', ':');
+        std::replace(name.begin(), name.end(), ' ', '_');
+
+        if (!folded.empty()) {
+            folded += ";";
+        }
+        folded += name;
+    }
+
+    return folded;
+}
+
+std::string getWasmProfileFile(const faabric::Message& msg)
+{
+    return fmt::format("{}/{}_{}.folded",
+                       conf::getFaasmConfig().wasmProfileDir,
+                       msg.user(),
+                       msg.function());
+}
+
+WasmSamplingProfiler::WasmSamplingProfiler(WAVMWasmModule& moduleIn,
+                                           const faabric::Message& msg)
+  : module(moduleIn)
+  , filePath(getWasmProfileFile(msg))
+  , enabled(isCallProfiled(msg))
+{
+    if (!enabled) {
+        return;
+    }
+
+    std::call_once(handlerFlag, installSignalHandler);
+
+    // Nothing can be allocated in the handler, so samples go straight in here
+    samples.resize(WASM_PROFILE_MAX_SAMPLES);
+    activeProfiler = this;
+
+    // Only sample while this thread is on a CPU
+    struct sigevent event;
+    std::memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_notify_thread_id = syscall(SYS_gettid);
+
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timerId) != 0) {
+        SPDLOG_ERROR("Failed to create profiler timer: {}",
+                     std::strerror(errno));
+        throw std::runtime_error("Failed to create profiler timer");
+    }
+
+    long periodNanos = 1000000000L / conf::getFaasmConfig().wasmProfileHz;
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = periodNanos / 1000000000L;
+    spec.it_interval.tv_nsec = periodNanos % 1000000000L;
+    spec.it_value = spec.it_interval;
+
+    if (timer_settime(timerId, 0, &spec, nullptr) != 0) {
+        SPDLOG_ERROR("Failed to start profiler timer: {}",
+                     std::strerror(errno));
+        throw std::runtime_error("Failed to start profiler timer");
+    }
+}
+
+WasmSamplingProfiler::~WasmSamplingProfiler()
+{
+    if (!enabled) {
+        return;
+    }
+
+    // Any signal still in flight must not touch the samples from here on
+    activeProfiler = nullptr;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    timer_delete(timerId);
+
+    writeSamples();
+}
+
+void WasmSamplingProfiler::recordSample()
+{
+    if (nSamples < samples.size()) {
+        samples[nSamples++] = Platform::captureCallStack(0);
+    }
+}
+
+void WasmSamplingProfiler::writeSamples()
+{
+    if (nSamples == 0) {
+        return;
+    }
+
+    const auto& names =
+      getFunctionNames(module, module.getBoundUser() + "/" +
+                                 module.getBoundFunction());
+
+    std::map<std::string, uint64_t> counts;
+    for (size_t i = 0; i < nSamples; i++) {
+        std::vector<std::string> frames =
+          Runtime::describeCallStack(samples.at(i));
+
+        std::string folded = foldWasmCallStack(frames, names);
+        if (!folded.empty()) {
+            counts[folded]++;
+        }
+    }
+
+    SPDLOG_DEBUG(
+      "Writing {} samples ({} stacks) to {}", nSamples, counts.size(), filePath);
+
+    faabric::util::UniqueLock lock(profileFileMx);
+    std::ofstream outFs(filePath, std::ios::app);
+    // This runs in a destructor, so a missing profile mustn't fail the call
+    if (!outFs.is_open()) {
+        SPDLOG_ERROR("Failed to open wasm profile file {}", filePath);
+        return;
+    }
+
+    for (const auto& [stack, count] : counts) {
+        outFs << stack << " " << count << std::endl;
+    }
+}
+}
@@ -1,5 +1,6 @@
 #include "WAVMWasmModule.h"
 #include "syscalls.h"
+#include <wasm/call_metrics.h>
 
 #include <faabric/util/logging.h>
 
@@ -16,6 +17,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 a,
                                I32 b)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - getpriority - {} {}", a, b);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -28,12 +30,14 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 b,
                                I32 c)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - setpriority - {} {} {}", a, b, c);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(wasi, "sched_yield", I32, wasi_sched_yield)
 {
+    HOST_CALL(Other);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
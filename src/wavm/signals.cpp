@@ -1,5 +1,6 @@
 #include "WAVMWasmModule.h"
 #include "syscalls.h"
+#include <wasm/call_metrics.h>
 
 #include <faabric/util/logging.h>
 
@@ -49,6 +50,7 @@ I32 s__rt_sigprocmask(I32 how, I32 sigSetPtr, I32 oldSetPtr, I32 sigsetsize)
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "signal", I32, signal, I32 a, I32 b)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - signal - {} {}", a, b);
 
     return 0;
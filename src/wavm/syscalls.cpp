@@ -1,5 +1,6 @@
 #include "syscalls.h"
 #include "WAVMWasmModule.h"
+#include <wasm/call_metrics.h>
 
 #include <faabric/util/logging.h>
 
@@ -30,6 +31,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 syscallNo,
                                I32 argsPtr)
 {
+    HOST_CALL(Other);
     switch (syscallNo) {
         case 224:
             // gettid
@@ -49,6 +51,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 syscallNo,
                                I32 argsPtr)
 {
+    HOST_CALL(Other);
     SPDLOG_ERROR("Called unsupported syscall format {} {}", syscallNo, argsPtr);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
@@ -59,6 +62,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                __syscall0,
                                I32 syscallNo)
 {
+    HOST_CALL(Other);
     return executeSyscall(syscallNo, 0, 0, 0, 0, 0, 0, 0);
 }
 
@@ -69,6 +73,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 syscallNo,
                                I32 a)
 {
+    HOST_CALL(Other);
     return executeSyscall(syscallNo, a, 0, 0, 0, 0, 0, 0);
 }
 
@@ -80,6 +85,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 a,
                                I32 b)
 {
+    HOST_CALL(Other);
     return executeSyscall(syscallNo, a, b, 0, 0, 0, 0, 0);
 }
 
@@ -92,6 +98,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 b,
                                I32 c)
 {
+    HOST_CALL(Other);
     return executeSyscall(syscallNo, a, b, c, 0, 0, 0, 0);
 }
 
@@ -105,6 +112,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 c,
                                I32 d)
 {
+    HOST_CALL(Other);
     return executeSyscall(syscallNo, a, b, c, d, 0, 0, 0);
 }
 
@@ -119,6 +127,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 d,
                                I32 e)
 {
+    HOST_CALL(Other);
     return executeSyscall(syscallNo, a, b, c, d, e, 0, 0);
 }
 
@@ -134,6 +143,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 e,
                                I32 f)
 {
+    HOST_CALL(Other);
     return executeSyscall(syscallNo, a, b, c, d, e, f, 0);
 }
 
@@ -150,6 +160,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 f,
                                I32 g)
 {
+    HOST_CALL(Other);
     return executeSyscall(syscallNo, a, b, c, d, e, f, g);
 }
 
@@ -165,6 +176,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 e,
                                I32 f)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG(
       "S - __syscall_cp - {} {} {} {} {} {} {}", syscallNo, a, b, c, d, e, f);
 
@@ -207,14 +219,16 @@ I32 executeSyscall(int syscallNumber,
             return s__mprotect(a, b, c);
         case 162:
             return s__nanosleep(a, b);
+        case 163:
+            return s__mremap(a, b, c, d, e);
+        case 168:
+            return s__poll(a, b, c);
         case 174:
             return s__sigaction(a, b, c);
         case 175:
             return s__rt_sigprocmask(a, b, c, d);
         case 192:
-            // mmap2 is basically the same as mmap (difference is in the final
-            // argument which we ignore)
-            return s__mmap(a, b, c, d, e, f);
+            return s__mmap2(a, b, c, d, e, f);
         case 196:
             return s__lstat64(a, b);
         case 197:
@@ -229,8 +243,20 @@ I32 executeSyscall(int syscallNumber,
             return s__futex(a, b, c, d, e, f);
         case 242:
             return s__sched_getaffinity(a, b, c);
+        case 254:
+            // epoll_create, the size is ignored
+            return s__epoll_create1(0);
+        case 255:
+            return s__epoll_ctl(a, b, c, d);
+        case 256:
+            return s__epoll_wait(a, b, c, d);
         case 265:
             return s__clock_gettime(a, b);
+        case 319:
+            // epoll_pwait, guests don't get signals so the mask is ignored
+            return s__epoll_wait(a, b, c, d);
+        case 329:
+            return s__epoll_create1(a);
         case 355:
             return s__getrandom(a, b, c);
         case 375:
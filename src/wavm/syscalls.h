@@ -14,6 +14,9 @@ std::vector<uint8_t> getBytesFromWasm(int32_t dataPtr, int32_t dataLen);
 
 std::string getStringFromWasm(int32_t strPtr);
 
+// Reads an array of pointers to state keys
+std::vector<std::string> getStateKeysFromWasm(int32_t keysPtr, int32_t nKeys);
+
 std::pair<std::string, std::string> getUserKeyPairFromWasm(int32_t keyPtr);
 
 std::string getMaskedPathFromWasm(int32_t strPtr);
@@ -60,17 +63,6 @@ struct wasm_iovec
     uint32_t iov_len;
 };
 
-/* MPI-related interfacing structs and calls.
- */
-struct wasm_faabric_win_t
-{
-    uint32_t worldId;
-    uint32_t rank;
-    uint32_t size;
-    uint32_t wasmPtr;
-    uint32_t dispUnit;
-};
-
 /** Socket-related struct (see
  * https://beej.us/guide/bgnet/html/multi/sockaddr_inman.html) */
 struct wasm_sockaddr
@@ -213,6 +205,25 @@ enum SocketCalls : uint32_t
     sc_sendmmsg,
 };
 
+// Found in poll.h, same layout as native
+struct wasm_pollfd
+{
+    int32_t fd;
+    int16_t events;
+    int16_t revents;
+};
+
+/**
+ * Found in sys/epoll.h. The data union is 8-byte aligned in wasm, whereas the
+ * native struct is packed, so these have to be converted.
+ */
+struct wasm_epoll_event
+{
+    uint32_t events;
+    uint32_t _pad;
+    uint64_t data;
+};
+
 // Struct conversion
 
 sockaddr getSockAddr(int32_t addrPtr);
@@ -252,6 +263,15 @@ int32_t s__close(int32_t fd);
 
 int32_t s__dup(int32_t oldFd);
 
+int32_t s__epoll_create1(int32_t flags);
+
+int32_t s__epoll_ctl(int32_t epollFd, int32_t op, int32_t fd, int32_t eventPtr);
+
+int32_t s__epoll_wait(int32_t epollFd,
+                      int32_t eventsPtr,
+                      int32_t maxEvents,
+                      int32_t timeout);
+
 int32_t s__exit(int32_t a, int32_t b);
 
 int32_t s__fcntl64(int32_t fd, int32_t cmd, int32_t c);
@@ -307,8 +327,21 @@ int32_t s__mmap(int32_t addr,
                 int32_t fd,
                 int32_t offset);
 
+int32_t s__mmap2(int32_t addr,
+                 int32_t length,
+                 int32_t prot,
+                 int32_t flags,
+                 int32_t fd,
+                 int32_t offset);
+
 int32_t s__mprotect(int32_t addrPtr, int32_t len, int32_t prot);
 
+int32_t s__mremap(int32_t oldAddr,
+                  int32_t oldSize,
+                  int32_t newSize,
+                  int32_t flags,
+                  int32_t newAddr);
+
 int32_t s__nanosleep(int32_t reqPtr, int32_t remPtr);
 
 int32_t s__open(int32_t pathPtr, int32_t flags, int32_t mode);
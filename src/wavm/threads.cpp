@@ -5,6 +5,7 @@
 #include <faabric/scheduler/Scheduler.h>
 #include <faabric/snapshot/SnapshotRegistry.h>
 #include <faabric/transport/PointToPointBroker.h>
+#include <faabric/util/clock.h>
 #include <faabric/util/config.h>
 #include <faabric/util/func.h>
 #include <faabric/util/logging.h>
@@ -12,9 +13,13 @@
 #include <threads/ThreadState.h>
 #include <wasm/WasmExecutionContext.h>
 #include <wasm/WasmModule.h>
+#include <wasm/call_metrics.h>
 #include <wasm/chaining.h>
+#include <wasm/futex.h>
 #include <wavm/WAVMWasmModule.h>
 
+#include <algorithm>
+#include <limits>
 #include <linux/futex.h>
 
 #include <WAVM/Platform/Thread.h>
@@ -56,6 +61,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 entryFunc,
                                I32 argsPtr)
 {
+    HOST_CALL(Threads);
 
     SPDLOG_DEBUG("S - pthread_create - {} {} {} {}",
                  pthreadPtr,
@@ -88,6 +94,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 pthreadPtr,
                                I32 resPtrPtr)
 {
+    HOST_CALL(Threads);
     SPDLOG_DEBUG("S - pthread_join - {} {}", pthreadPtr, resPtrPtr);
 
     faabric::Message* call = &ExecutorContext::get()->getMsg();
@@ -112,6 +119,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                pthread_exit,
                                I32 code)
 {
+    HOST_CALL(Threads);
     SPDLOG_DEBUG("S - pthread_exit - {}", code);
 }
 
@@ -119,6 +127,10 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 // FUTEX
 // ----------------------------------------------
 
+/**
+ * Threads of a module share its memory on the same host, so futex waits and
+ * wakes go straight to the OS futex on the native address of the word.
+ */
 I32 s__futex(I32 uaddrPtr,
              I32 futex_op,
              I32 val,
@@ -126,49 +138,40 @@ I32 s__futex(I32 uaddrPtr,
              I32 uaddr2Ptr,
              I32 other)
 {
+    SPDLOG_TRACE("S - futex - {} {} {} {} {} {}",
+                 uaddrPtr,
+                 futex_op,
+                 val,
+                 timeoutPtr,
+                 uaddr2Ptr,
+                 other);
 
-    std::string opStr;
-    int returnValue = 0;
-
-    // Reference to uaddr
     // The value pointed to by uaddr is always a four byte integer
     Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
-    I32* actualValPtr = &Runtime::memoryRef<I32>(memoryPtr, (Uptr)uaddrPtr);
-    I32 actualVal = *actualValPtr;
-
-    if (futex_op == FUTEX_WAIT || futex_op == FUTEX_WAIT_PRIVATE) {
-        // Waiting needs to be handled using Faasm mechanisms so we ignore
-        opStr = futex_op == FUTEX_WAIT ? "FUTEX_WAIT" : "FUTEX_WAIT_PRIVATE";
-
-        // Need to set the value to be unequal to the expected, otherwise we get
-        // into a loop
-        I32 newVal = actualVal + 1;
-        std::copy(&newVal, &newVal + sizeof(I32), actualValPtr);
-
-        // val here is the expected value, we need to make sure the address
-        // still has that value
-        returnValue = 0;
-    } else if (futex_op == FUTEX_WAKE || futex_op == FUTEX_WAKE_PRIVATE) {
-        // Waking also needs to be handled with Faasm mechanisms so we also
-        // ignore
-        opStr = futex_op == FUTEX_WAKE ? "FUTEX_WAKE" : "FUTEX_WAKE_PRIVATE";
+    I32* uaddr = &Runtime::memoryRef<I32>(memoryPtr, (Uptr)uaddrPtr);
+
+    // Memory is never shared between processes, so private and shared futexes
+    // are the same thing
+    int op = futex_op & ~FUTEX_PRIVATE_FLAG;
+    if (op == FUTEX_WAIT) {
+        // The timeout is relative for FUTEX_WAIT
+        int64_t timeoutMs = -1;
+        if (timeoutPtr != 0) {
+            wasm_timespec* timeout =
+              &Runtime::memoryRef<wasm_timespec>(memoryPtr, timeoutPtr);
+            timeoutMs = timeout->tv_sec * 1000 + timeout->tv_nsec / 1000000;
+        }
+
+        return futexWait(uaddr, val, timeoutMs);
+    }
 
+    if (op == FUTEX_WAKE) {
         // val here means "max waiters to wake"
-        returnValue = val;
-    } else {
-        SPDLOG_ERROR("Unsupported futex syscall with operation {}", futex_op);
-        throw std::runtime_error("Unuspported futex syscall");
+        return futexWake(uaddr, val);
     }
 
-    SPDLOG_DEBUG("S - futex - {} {} {} {} {} {} (uaddr = {})",
-                 uaddrPtr,
-                 opStr,
-                 val,
-                 timeoutPtr,
-                 uaddr2Ptr,
-                 other,
-                 actualVal);
-    return returnValue;
+    SPDLOG_ERROR("Unsupported futex syscall with operation {}", futex_op);
+    throw std::runtime_error("Unuspported futex syscall");
 }
 
 // --------------------------
@@ -177,6 +180,14 @@ I32 s__futex(I32 uaddrPtr,
 // Note we use trace logging here as these are invoked a lot
 // --------------------------
 
+// The first word of the mutex struct holds its slot in the module's slab
+static FutexMutex& getPthreadMutex(I32 mx)
+{
+    WAVMWasmModule* module = getExecutingWAVMModule();
+    I32* slotWord = &Runtime::memoryRef<I32>(module->defaultMemory, mx);
+    return module->getPthreadMutexSlab().get(mx, slotWord);
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "pthread_mutex_init",
                                I32,
@@ -184,7 +195,9 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 mx,
                                I32 attr)
 {
+    HOST_CALL(Threads);
     SPDLOG_TRACE("S - pthread_mutex_init {} {}", mx, attr);
+    getPthreadMutex(mx);
 
     return 0;
 }
@@ -195,8 +208,9 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                pthread_mutex_lock,
                                I32 mx)
 {
+    HOST_CALL(Threads);
     SPDLOG_TRACE("S - pthread_mutex_lock {}", mx);
-    getExecutingModule()->getOrCreatePthreadMutex(mx)->lock();
+    getPthreadMutex(mx).lock();
 
     return 0;
 }
@@ -207,10 +221,10 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                s__pthread_mutex_trylock,
                                I32 mx)
 {
+    HOST_CALL(Threads);
     SPDLOG_TRACE("S - pthread_mutex_trylock {}", mx);
 
-    bool success =
-      getExecutingModule()->getOrCreatePthreadMutex(mx)->try_lock();
+    bool success = getPthreadMutex(mx).try_lock();
 
     if (!success) {
         return EBUSY;
@@ -225,8 +239,9 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                pthread_mutex_unlock,
                                I32 mx)
 {
+    HOST_CALL(Threads);
     SPDLOG_TRACE("S - pthread_mutex_unlock {}", mx);
-    getExecutingModule()->getPthreadMutex(mx)->unlock();
+    getPthreadMutex(mx).unlock();
 
     return 0;
 }
@@ -237,74 +252,140 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                pthread_mutex_destroy,
                                I32 mx)
 {
+    HOST_CALL(Threads);
     SPDLOG_TRACE("S - pthread_mutex_destroy {}", mx);
+
+    WAVMWasmModule* module = getExecutingWAVMModule();
+    I32* slotWord = &Runtime::memoryRef<I32>(module->defaultMemory, mx);
+    module->getPthreadMutexSlab().release(mx, slotWord);
+
     return 0;
 }
 
 // --------------------------
-// STUBBED PTHREADS - We can safely ignore the following functions
+// PTHREAD CONDITION VARIABLES - As with mutexes these are host-local. We own
+// the contents of the cond struct, and use its first word as a futex sequence
+// bumped on every signal.
 // --------------------------
 
+static I32* getCondSeq(I32 cond)
+{
+    return &Runtime::memoryRef<I32>(getExecutingWAVMModule()->defaultMemory,
+                                    cond);
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_mutexattr_init",
+                               "pthread_cond_init",
                                I32,
-                               pthread_mutexattr_init,
-                               I32 a)
+                               pthread_cond_init,
+                               I32 cond,
+                               I32 attr)
 {
-    SPDLOG_TRACE("S - pthread_mutexattr_init {}", a);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_cond_init {} {}", cond, attr);
+    *getCondSeq(cond) = 0;
 
     return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_mutexattr_destroy",
+                               "pthread_cond_wait",
                                I32,
-                               pthread_mutexattr_destroy,
-                               I32 a)
+                               pthread_cond_wait,
+                               I32 cond,
+                               I32 mx)
 {
-    SPDLOG_TRACE("S - pthread_mutexattr_destroy {}", a);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_cond_wait {} {}", cond, mx);
 
-    return 0;
+    int res = futexCondWait(getCondSeq(cond), getPthreadMutex(mx), -1);
+
+    return -res;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_cond_init",
+                               "pthread_cond_timedwait",
                                I32,
-                               pthread_cond_init,
-                               I32 a,
-                               I32 b)
+                               pthread_cond_timedwait,
+                               I32 cond,
+                               I32 mx,
+                               I32 abstimePtr)
 {
-    SPDLOG_TRACE("S - pthread_cond_init {} {}", a, b);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_cond_timedwait {} {} {}", cond, mx, abstimePtr);
 
-    return 0;
+    // The timeout is absolute, on the realtime clock as we ignore cond attrs
+    wasm_timespec* abstime = &Runtime::memoryRef<wasm_timespec>(
+      getExecutingWAVMModule()->defaultMemory, abstimePtr);
+    int64_t abstimeMs = abstime->tv_sec * 1000 + abstime->tv_nsec / 1000000;
+    int64_t nowMs = faabric::util::getGlobalClock().epochMillis();
+    int64_t timeoutMs = std::max<int64_t>(abstimeMs - nowMs, 0);
+
+    int res = futexCondWait(getCondSeq(cond), getPthreadMutex(mx), timeoutMs);
+
+    return -res;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "pthread_cond_signal",
                                I32,
                                pthread_cond_signal,
-                               I32 a)
+                               I32 cond)
 {
-    SPDLOG_TRACE("S - pthread_cond_signal {}", a);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_cond_signal {}", cond);
+    futexCondWake(getCondSeq(cond), 1);
 
     return 0;
 }
 
-WAVM_DEFINE_INTRINSIC_FUNCTION(env, "pthread_self", I32, pthread_self)
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "pthread_cond_broadcast",
+                               I32,
+                               pthread_cond_broadcast,
+                               I32 cond)
 {
-    SPDLOG_TRACE("S - pthread_self");
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_cond_broadcast {}", cond);
+    futexCondWake(getCondSeq(cond), std::numeric_limits<int32_t>::max());
 
     return 0;
 }
 
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "pthread_cond_destroy",
+                               I32,
+                               pthread_cond_destroy,
+                               I32 cond)
+{
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_cond_destroy {}", cond);
+
+    return 0;
+}
+
+// --------------------------
+// PTHREAD KEYS - Each thread has its own values, held on the host thread
+// executing it
+// --------------------------
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "pthread_key_create",
                                I32,
                                s__pthread_key_create,
-                               I32 a,
-                               I32 b)
+                               I32 keyPtr,
+                               I32 destructorFunc)
 {
-    SPDLOG_TRACE("S - pthread_key_create {} {}", a, b);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_key_create {} {}", keyPtr, destructorFunc);
+
+    int32_t key = getExecutingModule()->createPthreadKey(destructorFunc);
+    if (key < 0) {
+        return EAGAIN;
+    }
+
+    Runtime::memoryRef<U32>(getExecutingWAVMModule()->defaultMemory, keyPtr) =
+      key;
 
     return 0;
 }
@@ -313,9 +394,11 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "pthread_key_delete",
                                I32,
                                s__pthread_key_delete,
-                               I32 a)
+                               I32 key)
 {
-    SPDLOG_TRACE("S - pthread_key_delete {}", a);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_key_delete {}", key);
+    getExecutingModule()->deletePthreadKey(key);
 
     return 0;
 }
@@ -324,81 +407,64 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "pthread_getspecific",
                                I32,
                                s__pthread_getspecific,
-                               I32 a)
+                               I32 key)
 {
-    SPDLOG_TRACE("S - pthread_getspecific {}", a);
-
-    return 0;
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_getspecific {}", key);
+    return getExecutingModule()->getPthreadSpecific(key);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "pthread_setspecific",
                                I32,
                                s__pthread_setspecific,
-                               I32 a,
-                               I32 b)
+                               I32 key,
+                               I32 value)
 {
-    SPDLOG_TRACE("S - pthread_setspecific {} {}", a, b);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_setspecific {} {}", key, value);
+
+    if (!getExecutingModule()->setPthreadSpecific(key, value)) {
+        return EINVAL;
+    }
 
     return 0;
 }
 
+// --------------------------
+// STUBBED PTHREADS - We can safely ignore the following functions
+// --------------------------
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_cond_destroy",
+                               "pthread_mutexattr_init",
                                I32,
-                               pthread_cond_destroy,
+                               pthread_mutexattr_init,
                                I32 a)
 {
-    SPDLOG_TRACE("S - pthread_cond_destroy {}", a);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_mutexattr_init {}", a);
 
     return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_cond_broadcast",
+                               "pthread_mutexattr_destroy",
                                I32,
-                               pthread_cond_broadcast,
+                               pthread_mutexattr_destroy,
                                I32 a)
 {
-    SPDLOG_TRACE("S - pthread_cond_broadcast {}", a);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_mutexattr_destroy {}", a);
 
     return 0;
 }
 
-// --------------------------
-// Unsupported
-// --------------------------
-
-WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_equal",
-                               I32,
-                               pthread_equal,
-                               I32 a,
-                               I32 b)
-{
-    SPDLOG_TRACE("S - pthread_equal {} {}", a, b);
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
-}
-
-WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_cond_timedwait",
-                               I32,
-                               pthread_cond_timedwait,
-                               I32 a,
-                               I32 b,
-                               I32 c)
+WAVM_DEFINE_INTRINSIC_FUNCTION(env, "pthread_self", I32, pthread_self)
 {
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
-}
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_self");
 
-WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_cond_wait",
-                               I32,
-                               pthread_cond_wait,
-                               I32 a,
-                               I32 b)
-{
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+    return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -407,7 +473,10 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                s__pthread_attr_init,
                                I32 a)
 {
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_attr_init {}", a);
+
+    return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -417,7 +486,10 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 a,
                                I32 b)
 {
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_attr_setstacksize {} {}", a, b);
+
+    return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -426,6 +498,25 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                s__pthread_attr_destroy,
                                I32 a)
 {
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_attr_destroy {}", a);
+
+    return 0;
+}
+
+// --------------------------
+// Unsupported
+// --------------------------
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "pthread_equal",
+                               I32,
+                               pthread_equal,
+                               I32 a,
+                               I32 b)
+{
+    HOST_CALL(Threads);
+    SPDLOG_TRACE("S - pthread_equal {} {}", a, b);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -435,6 +526,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                s__pthread_detach,
                                I32 a)
 {
+    HOST_CALL(Threads);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -445,6 +537,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 a,
                                I32 b)
 {
+    HOST_CALL(Threads);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
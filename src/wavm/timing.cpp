@@ -1,5 +1,7 @@
 #include "WAVMWasmModule.h"
 #include "syscalls.h"
+#include <wasm/call_metrics.h>
+#include <wasm/timing.h>
 
 #include <sys/time.h>
 
@@ -7,7 +9,6 @@
 #include <WAVM/WASI/WASIABI.h>
 
 #include <faabric/util/logging.h>
-#include <faabric/util/timing.h>
 
 using namespace WAVM;
 
@@ -80,6 +81,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I32 nSubs,
                                I32 resNEvents)
 {
+    HOST_CALL(Other);
     SPDLOG_DEBUG("S - poll_oneoff - {} {} {} {}",
                  subscriptionsPtr,
                  eventsPtr,
@@ -97,20 +99,13 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
 
         if (thisSub->type == __WASI_EVENTTYPE_CLOCK) {
             // This is a timing event like a sleep
-            uint64_t timeoutNanos = thisSub->u.clock.timeout;
-            int clockType = 0;
-            if (thisSub->u.clock.clock_id == __WASI_CLOCK_MONOTONIC) {
-                clockType = CLOCK_MONOTONIC;
-            } else if (thisSub->u.clock.clock_id == __WASI_CLOCK_REALTIME) {
-                clockType = CLOCK_REALTIME;
-            } else {
+            if (thisSub->u.clock.clock_id != __WASI_CLOCK_MONOTONIC &&
+                thisSub->u.clock.clock_id != __WASI_CLOCK_REALTIME) {
                 throw std::runtime_error("Unimplemented clock type");
             }
 
-            // Do the sleep
-            timespec t{};
-            faabric::util::nanosToTimespec(timeoutNanos, &t);
-            clock_nanosleep(clockType, 0, &t, nullptr);
+            // Parked so that the sleep can be cut short (see timing.h)
+            sleepNanos(thisSub->u.clock.timeout);
         } else {
             throw std::runtime_error("Unimplemented event type");
         }
@@ -129,6 +124,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "utime", I32, s__utime, I32 a, I32 b)
 {
+    HOST_CALL(Other);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -140,34 +136,14 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                I64 precision,
                                I32 resultPtr)
 {
-    SPDLOG_TRACE(
-      "S - clock_time_get - {} {} {}", clockId, precision, resultPtr);
+    // Hot path, so no logging (see timing.h)
+    HOST_CALL(Other);
 
-    timespec ts{};
-
-    int linuxClockId;
-    if (clockId == __WASI_CLOCK_REALTIME) {
-        linuxClockId = CLOCK_REALTIME;
-    } else if (clockId == __WASI_CLOCK_MONOTONIC) {
-        linuxClockId = CLOCK_MONOTONIC;
-    } else if (clockId == __WASI_CLOCK_PROCESS_CPUTIME_ID) {
-        linuxClockId = CLOCK_PROCESS_CPUTIME_ID;
-    } else if (clockId == __WASI_CLOCK_THREAD_CPUTIME_ID) {
-        linuxClockId = CLOCK_THREAD_CPUTIME_ID;
-    } else {
-        throw std::runtime_error("Unknown clock ID");
-    }
-
-    int retVal = clock_gettime(linuxClockId, &ts);
-    if (retVal < 0) {
-        if (EINVAL) {
-            return __WASI_EINVAL;
-        } else {
-            throw std::runtime_error("Unexpected clock error");
-        }
+    uint64_t result = 0;
+    if (getWasiClockNanos((uint32_t)clockId, &result) != 0) {
+        return __WASI_EINVAL;
     }
 
-    uint64_t result = faabric::util::timespecToNanos(&ts);
     Runtime::memoryRef<uint64_t>(getExecutingWAVMModule()->defaultMemory,
                                  resultPtr) = result;
 
@@ -178,10 +154,20 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                "clock_res_get",
                                I32,
                                wasi_clock_res_get,
-                               I32 a,
-                               I32 b)
+                               I32 clockId,
+                               I32 resultPtr)
 {
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+    HOST_CALL(Other);
+
+    uint64_t result = 0;
+    if (getWasiClockResolutionNanos((uint32_t)clockId, &result) != 0) {
+        return __WASI_EINVAL;
+    }
+
+    Runtime::memoryRef<uint64_t>(getExecutingWAVMModule()->defaultMemory,
+                                 resultPtr) = result;
+
+    return __WASI_ESUCCESS;
 }
 
 void timingLink() {}
@@ -40,6 +40,25 @@ std::string getStringFromWasm(I32 strPtr)
     return str;
 }
 
+std::vector<std::string> getStateKeysFromWasm(I32 keysPtr, I32 nKeys)
+{
+    if (nKeys < 0) {
+        SPDLOG_ERROR("Invalid number of state keys {}", nKeys);
+        throw std::runtime_error("Invalid number of state keys");
+    }
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    I32* keyPtrs =
+      Runtime::memoryArrayPtr<I32>(memoryPtr, (Uptr)keysPtr, (Uptr)nKeys);
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < nKeys; i++) {
+        keys.push_back(getStringFromWasm(keyPtrs[i]));
+    }
+
+    return keys;
+}
+
 std::pair<std::string, std::string> getUserKeyPairFromWasm(I32 keyPtr)
 {
     Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
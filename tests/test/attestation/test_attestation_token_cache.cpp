@@ -0,0 +1,127 @@
+#include <catch2/catch.hpp>
+
+#include <conf/FaasmConfig.h>
+#include <enclave/outside/attestation/AttestationTokenCache.h>
+
+#include <jwt-cpp/jwt.h>
+
+#include <atomic>
+#include <thread>
+
+using namespace std::chrono;
+
+namespace tests {
+
+static std::string makeJwtResponse(system_clock::time_point expiry)
+{
+    std::string token =
+      jwt::create().set_expires_at(expiry).sign(jwt::algorithm::none{});
+
+    return "{\"token\":\"" + token + "\"}";
+}
+
+class AttestationTokenCacheTestFixture
+{
+  public:
+    AttestationTokenCacheTestFixture()
+      : conf(conf::getFaasmConfig())
+      , originalRefreshSecs(conf.sgxAttestationRefreshSecs)
+    {}
+
+    ~AttestationTokenCacheTestFixture()
+    {
+        conf.sgxAttestationRefreshSecs = originalRefreshSecs;
+    }
+
+  protected:
+    conf::FaasmConfig& conf;
+    int originalRefreshSecs;
+
+    std::atomic<int> attestCount = 0;
+};
+
+TEST_CASE_METHOD(AttestationTokenCacheTestFixture,
+                 "Test attestation tokens are cached until they expire",
+                 "[attestation]")
+{
+    seconds lifetime(3600);
+    int expectedCount = 1;
+
+    SECTION("Valid token") {}
+
+    SECTION("Expired token")
+    {
+        lifetime = seconds(-1);
+        expectedCount = 2;
+    }
+
+    sgx::AttestationTokenCache cache([this, lifetime](sgx_enclave_id_t) {
+        attestCount++;
+        return makeJwtResponse(system_clock::now() + lifetime);
+    });
+
+    std::string first = cache.getToken(1);
+    std::string second = cache.getToken(1);
+    REQUIRE(attestCount == expectedCount);
+
+    // Expired tokens aren't kept
+    if (expectedCount == 1) {
+        REQUIRE(first == second);
+        REQUIRE(cache.getTokenCount() == 1);
+    } else {
+        REQUIRE(cache.getTokenCount() == 0);
+    }
+
+    // Each enclave has its own token
+    cache.getToken(2);
+    REQUIRE(attestCount == expectedCount + 1);
+
+    cache.removeEnclave(1);
+    cache.removeEnclave(2);
+    REQUIRE(cache.getTokenCount() == 0);
+
+    cache.clear();
+}
+
+TEST_CASE_METHOD(AttestationTokenCacheTestFixture,
+                 "Test attestation tokens are refreshed in the background",
+                 "[attestation]")
+{
+    conf.sgxAttestationRefreshSecs = 60;
+
+    // Tokens are due for refresh halfway through their life at the latest
+    sgx::AttestationTokenCache cache([this](sgx_enclave_id_t) {
+        attestCount++;
+        return makeJwtResponse(system_clock::now() + seconds(2));
+    });
+
+    SECTION("Attested on first use") { cache.getToken(1); }
+
+    SECTION("Attested when added") { cache.addEnclave(1); }
+
+    // Wait for the first attestation and at least one refresh
+    for (int i = 0; i < 50 && attestCount < 2; i++) {
+        std::this_thread::sleep_for(milliseconds(100));
+    }
+    REQUIRE(attestCount >= 2);
+    REQUIRE(cache.getTokenCount() == 1);
+
+    cache.clear();
+    REQUIRE(cache.getTokenCount() == 0);
+}
+
+TEST_CASE_METHOD(AttestationTokenCacheTestFixture,
+                 "Test failed attestation isn't cached",
+                 "[attestation]")
+{
+    sgx::AttestationTokenCache cache([this](sgx_enclave_id_t) -> std::string {
+        attestCount++;
+        throw std::runtime_error("Attestation failed");
+    });
+
+    REQUIRE_THROWS(cache.getToken(1));
+    REQUIRE_THROWS(cache.getToken(1));
+    REQUIRE(attestCount == 2);
+    REQUIRE(cache.getTokenCount() == 0);
+}
+}
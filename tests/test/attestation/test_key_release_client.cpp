@@ -0,0 +1,67 @@
+#include <catch2/catch.hpp>
+
+#include <enclave/encrypted_module.h>
+#include <enclave/outside/attestation/KeyReleaseClient.h>
+
+#include <cppcodec/base64_url.hpp>
+#include <rapidjson/document.h>
+
+namespace tests {
+TEST_CASE("Test key release request body", "[attestation]")
+{
+    std::string body =
+      sgx::KeyReleaseClient::requestBody("demo/hello", "dummy.jwt.token");
+
+    rapidjson::Document d;
+    d.Parse(body.c_str());
+    REQUIRE(std::string(d["function"].GetString()) == "demo/hello");
+    REQUIRE(std::string(d["token"].GetString()) == "dummy.jwt.token");
+}
+
+TEST_CASE("Test parsing key release response", "[attestation]")
+{
+    std::vector<uint8_t> releaseKey(sizeof(sgx_ec256_public_t), 3);
+    std::vector<uint8_t> wrappedKey(sizeof(FaasmSgxWrappedModuleKey), 4);
+    bool expectSuccess = true;
+
+    SECTION("Valid response") {}
+
+    SECTION("Short release key")
+    {
+        releaseKey.pop_back();
+        expectSuccess = false;
+    }
+
+    SECTION("Long wrapped key")
+    {
+        wrappedKey.push_back(5);
+        expectSuccess = false;
+    }
+
+    std::string response =
+      "{\"releaseKey\":\"" +
+      cppcodec::base64_url::encode(releaseKey.data(), releaseKey.size()) +
+      "\",\"wrappedKey\":\"" +
+      cppcodec::base64_url::encode(wrappedKey.data(), wrappedKey.size()) +
+      "\"}";
+
+    if (!expectSuccess) {
+        REQUIRE_THROWS(
+          sgx::KeyReleaseClient::releasedKeyFromResponse(response));
+        return;
+    }
+
+    sgx::ReleasedModuleKey released =
+      sgx::KeyReleaseClient::releasedKeyFromResponse(response);
+    REQUIRE(released.wrappedKey == wrappedKey);
+    REQUIRE(released.releaseKey.gx[0] == 3);
+    REQUIRE(released.releaseKey.gy[SGX_ECP256_KEY_SIZE - 1] == 3);
+}
+
+TEST_CASE("Test malformed key release response", "[attestation]")
+{
+    REQUIRE_THROWS(sgx::KeyReleaseClient::releasedKeyFromResponse("not json"));
+    REQUIRE_THROWS(
+      sgx::KeyReleaseClient::releasedKeyFromResponse("{\"releaseKey\":\"\"}"));
+}
+}
@@ -12,7 +12,9 @@
 
 #include <codegen/MachineCodeGenerator.h>
 #include <conf/FaasmConfig.h>
+#include <storage/CodegenManifest.h>
 #include <storage/FileLoader.h>
+#include <wavm/WAVMWasmModule.h>
 
 #include <filesystem>
 #include <stdlib.h>
@@ -58,7 +60,7 @@ TEST_CASE_METHOD(CodegenTestFixture, "Test basic codegen", "[codegen]")
     REQUIRE(!objBytes.empty());
 
     // Check expected keys in S3
-    REQUIRE(s3.listKeys(conf.s3Bucket).size() == 3);
+    REQUIRE(s3.listKeys(conf.s3Bucket).size() == 4);
 
     // Clear the local cache to remove local copies
     loader.clearLocalCache();
@@ -80,19 +82,19 @@ TEST_CASE_METHOD(CodegenTestFixture,
 
     // Ensure machine code exists
     std::string objFile = loader.getFunctionObjectFile(msgA);
-    std::string hashFile = objFile + HASH_EXT;
+    std::string manifestFile = loader.getCodegenManifestFile(msgA.user());
     REQUIRE(std::filesystem::exists(objFile));
-    REQUIRE(std::filesystem::exists(hashFile));
+    REQUIRE(std::filesystem::exists(manifestFile));
 
     // Delete machine code locally
     loader.clearLocalCache();
     REQUIRE(!std::filesystem::exists(objFile));
-    REQUIRE(!std::filesystem::exists(hashFile));
+    REQUIRE(!std::filesystem::exists(manifestFile));
 
     // Run codegen again, will skip, and ensure object is synced regardless
-    gen.codegenForFunction(msgA);
+    REQUIRE(!gen.codegenForFunction(msgA));
     REQUIRE(std::filesystem::exists(objFile));
-    REQUIRE(std::filesystem::exists(hashFile));
+    REQUIRE(std::filesystem::exists(manifestFile));
 }
 
 TEST_CASE_METHOD(CodegenTestFixture,
@@ -129,41 +131,43 @@ TEST_CASE_METHOD(CodegenTestFixture,
     loader.uploadFunction(msgA);
     loader.uploadFunction(msgB);
 
-    std::string wasmFileA = "/tmp/func/demo/hello/function.wasm";
-    std::string wasmFileB = "/tmp/func/demo/echo/function.wasm";
-    std::string hashFileA = objectFileA + HASH_EXT;
-    std::string hashFileB = objectFileB + HASH_EXT;
+    std::string manifestFile = "/tmp/obj/demo/codegen.manifest";
+    std::string keyA = loader.getFunctionCodegenKey(msgA);
+    std::string keyB = loader.getFunctionCodegenKey(msgB);
 
     // Make sure directories are empty to start with
     loader.clearLocalCache();
 
-    // Check files don't yet exist
-    REQUIRE(!std::filesystem::exists(hashFileA));
-    REQUIRE(!std::filesystem::exists(hashFileB));
+    // Check manifest doesn't yet exist
+    REQUIRE(!std::filesystem::exists(manifestFile));
 
     // Do codegen for both
-    gen.codegenForFunction(msgA);
-    gen.codegenForFunction(msgB);
+    REQUIRE(gen.codegenForFunction(msgA));
+    REQUIRE(gen.codegenForFunction(msgB));
 
-    // Check keys exist in S3
-    REQUIRE(s3.listKeys(conf.s3Bucket).size() == 6);
+    // Check keys exist in S3, with a single manifest for the user and
+    // metadata for each function
+    REQUIRE(s3.listKeys(conf.s3Bucket).size() == 7);
 
-    // Check hashes now exist locally
-    REQUIRE(std::filesystem::exists(hashFileA));
-    REQUIRE(std::filesystem::exists(hashFileB));
+    // Check manifest now exists locally
+    REQUIRE(std::filesystem::exists(manifestFile));
 
-    // Read in hashes
-    std::vector<uint8_t> actualHashA =
-      faabric::util::readFileToBytes(hashFileA);
-    std::vector<uint8_t> actualHashB =
-      faabric::util::readFileToBytes(hashFileB);
+    // Read in manifest entries
+    storage::CodegenManifest manifest(
+      faabric::util::readFileToBytes(manifestFile));
+    REQUIRE(manifest.size() == 2);
+    storage::CodegenManifestEntry actualEntryA = manifest.getEntry(keyA);
+    storage::CodegenManifestEntry actualEntryB = manifest.getEntry(keyB);
 
     // Check they're not empty
-    REQUIRE(!actualHashA.empty());
-    REQUIRE(!actualHashB.empty());
+    REQUIRE(!actualEntryA.empty());
+    REQUIRE(!actualEntryB.empty());
+    REQUIRE(actualEntryA.hash == storage::hashCodegenInput(wasmBytesA));
+    REQUIRE(actualEntryA.options == conf.wasmVm);
+    REQUIRE(!actualEntryA.compilerVersion.empty());
 
     // Check they're different
-    REQUIRE(actualHashA != actualHashB);
+    REQUIRE(actualEntryA.hash != actualEntryB.hash);
 
     // Load the object file before, then flush
     REQUIRE(std::filesystem::exists(objectFileA));
@@ -176,24 +180,81 @@ TEST_CASE_METHOD(CodegenTestFixture,
     faabric::util::writeBytesToFile(objectFileA, dummyBytes);
 
     // Rerun the codegen and check the object file doesn't change
-    gen.codegenForFunction(msgA);
+    REQUIRE(!gen.codegenForFunction(msgA));
 
     std::vector<uint8_t> dummyBytesAfter =
       faabric::util::readFileToBytes(objectFileA);
     REQUIRE(dummyBytesAfter == dummyBytes);
 
-    // Now change the hash file and check the object file *is* overwritten
-    faabric::util::writeBytesToFile(hashFileA, dummyBytes);
-    gen.codegenForFunction(msgA);
+    // Now change the manifest entry and check the object file *is* overwritten
+    storage::CodegenManifestEntry dummyEntry = actualEntryA;
+    SECTION("Changed hash") { dummyEntry.hash = "abcd"; }
+
+    SECTION("Changed compiler version")
+    {
+        dummyEntry.compilerVersion = "llvm-0.0.0";
+    }
+
+    SECTION("Changed options") { dummyEntry.options = "blah"; }
+
+    manifest.setEntry(keyA, dummyEntry);
+    loader.uploadCodegenManifest(msgA.user(), manifest.toBytes());
+    REQUIRE(gen.codegenForFunction(msgA));
 
     std::vector<uint8_t> objAAfter =
       faabric::util::readFileToBytes(objectFileA);
 
     REQUIRE(objAAfter == objABefore);
 
-    // Check the hash is updated
-    std::vector<uint8_t> hashAAfter = faabric::util::readFileToBytes(hashFileA);
-    REQUIRE(hashAAfter == actualHashA);
+    // Check the manifest is updated, and B's entry is untouched
+    storage::CodegenManifest manifestAfter(
+      loader.loadCodegenManifest(msgA.user()));
+    REQUIRE(manifestAfter.getEntry(keyA) == actualEntryA);
+    REQUIRE(manifestAfter.getEntry(keyB) == actualEntryB);
+}
+
+TEST_CASE_METHOD(CodegenTestFixture,
+                 "Test codegen manifest updates keep other hosts' entries",
+                 "[codegen]")
+{
+    codegen::MachineCodeGenerator gen(loader);
+
+    loader.uploadFunction(msgA);
+    loader.uploadFunction(msgB);
+    loader.clearLocalCache();
+
+    std::string keyA = loader.getFunctionCodegenKey(msgA);
+    std::string keyB = loader.getFunctionCodegenKey(msgB);
+    std::string manifestKey =
+      msgA.user() + "/" + std::string(CODEGEN_MANIFEST_FILENAME);
+
+    // Leaves the manifest cached locally
+    REQUIRE(gen.codegenForFunction(msgA));
+
+    // Another host adds an entry, which the cached copy doesn't have
+    storage::CodegenManifestEntry otherEntry;
+    otherEntry.hash = "abcd";
+    otherEntry.compilerVersion = "llvm-0.0.0";
+    otherEntry.options = "wamr";
+
+    storage::CodegenManifest remote(
+      s3.getKeyBytes(conf.s3Bucket, manifestKey, true));
+    remote.setEntry("other", otherEntry);
+    s3.addKeyBytes(conf.s3Bucket, manifestKey, remote.toBytes());
+
+    REQUIRE(gen.codegenForFunction(msgB));
+
+    storage::CodegenManifest manifestAfter(
+      s3.getKeyBytes(conf.s3Bucket, manifestKey, true));
+    REQUIRE(manifestAfter.size() == 3);
+    REQUIRE(!manifestAfter.getEntry(keyA).empty());
+    REQUIRE(!manifestAfter.getEntry(keyB).empty());
+    REQUIRE(manifestAfter.getEntry("other") == otherEntry);
+
+    // The local copy is what was uploaded
+    storage::CodegenManifest localAfter(
+      loader.loadCodegenManifest(msgA.user()));
+    REQUIRE(localAfter.getEntry("other") == otherEntry);
 }
 
 TEST_CASE_METHOD(CodegenTestFixture,
@@ -202,7 +263,9 @@ TEST_CASE_METHOD(CodegenTestFixture,
 {
     std::string objFile =
       std::string("/tmp/obj") + std::string(localSharedObjFile) + ".o";
-    std::string hashFile = objFile + HASH_EXT;
+    std::string manifestFile =
+      loader.getCodegenManifestFile(SHARED_OBJ_MANIFEST_SCOPE);
+    std::string key = loader.getSharedObjectCodegenKey(localSharedObjFile);
 
     loader.uploadSharedObjectObjectFile(localSharedObjFile, sharedObjWasm);
 
@@ -210,36 +273,41 @@ TEST_CASE_METHOD(CodegenTestFixture,
     loader.clearLocalCache();
 
     // Run the codegen
-    gen.codegenForSharedObject(localSharedObjFile);
+    REQUIRE(gen.codegenForSharedObject(localSharedObjFile));
 
     // Check the locally cached path matches the expected one
     REQUIRE(loader.getSharedObjectObjectFile(localSharedObjFile) == objFile);
 
-    // Read object file and hash
+    // Read object file and manifest entry
     std::vector<uint8_t> objBefore =
       loader.loadSharedObjectObjectFile(localSharedObjFile);
-    std::vector<uint8_t> hashBefore =
-      loader.loadSharedObjectObjectHash(localSharedObjFile);
+    storage::CodegenManifest manifest(
+      loader.loadCodegenManifest(SHARED_OBJ_MANIFEST_SCOPE));
+    storage::CodegenManifestEntry entryBefore = manifest.getEntry(key);
 
     REQUIRE(!objBefore.empty());
-    REQUIRE(!hashBefore.empty());
+    REQUIRE(!entryBefore.empty());
+    REQUIRE(entryBefore.hash == storage::hashCodegenInput(sharedObjWasm));
 
     // Check files exist locally
     REQUIRE(std::filesystem::exists(objFile));
-    REQUIRE(std::filesystem::exists(hashFile));
+    REQUIRE(std::filesystem::exists(manifestFile));
 
     std::vector<uint8_t> dummyBytes = { 0, 1, 2, 3 };
     loader.uploadSharedObjectObjectFile(localSharedObjFile, dummyBytes);
 
     // Rerun codegen and check dummy data not overwritten (i.e. codegen skipped)
-    gen.codegenForSharedObject(localSharedObjFile);
+    REQUIRE(!gen.codegenForSharedObject(localSharedObjFile));
     std::vector<uint8_t> objAfterA =
       loader.loadSharedObjectObjectFile(localSharedObjFile);
     REQUIRE(objAfterA == dummyBytes);
 
-    // Now write the dummy bytes to the hash file and rerun the upload
-    loader.uploadSharedObjectObjectHash(localSharedObjFile, dummyBytes);
-    gen.codegenForSharedObject(localSharedObjFile);
+    // Now write a dummy entry to the manifest and rerun the upload
+    storage::CodegenManifestEntry dummyEntry = entryBefore;
+    dummyEntry.hash = "abcd";
+    manifest.setEntry(key, dummyEntry);
+    loader.uploadCodegenManifest(SHARED_OBJ_MANIFEST_SCOPE, manifest.toBytes());
+    REQUIRE(gen.codegenForSharedObject(localSharedObjFile));
 
     // Check the object file is updated
     std::vector<uint8_t> objAfterB =
@@ -247,19 +315,19 @@ TEST_CASE_METHOD(CodegenTestFixture,
     REQUIRE(objAfterB.size() == objBefore.size());
     REQUIRE(objAfterB == objBefore);
 
-    // Check the hash is updated
-    std::vector<uint8_t> hashAfter =
-      loader.loadSharedObjectObjectHash(localSharedObjFile);
-    REQUIRE(hashAfter == hashBefore);
+    // Check the manifest is updated
+    storage::CodegenManifest manifestAfter(
+      loader.loadCodegenManifest(SHARED_OBJ_MANIFEST_SCOPE));
+    REQUIRE(manifestAfter.getEntry(key) == entryBefore);
 
     // Clear the local file, re-run the codegen, and check that the object
-    // file and hash are synced back
+    // file and manifest are synced back
     loader.clearLocalCache();
     REQUIRE(!std::filesystem::exists(objFile));
-    REQUIRE(!std::filesystem::exists(hashFile));
-    gen.codegenForSharedObject(localSharedObjFile);
+    REQUIRE(!std::filesystem::exists(manifestFile));
+    REQUIRE(!gen.codegenForSharedObject(localSharedObjFile));
     REQUIRE(std::filesystem::exists(objFile));
-    REQUIRE(std::filesystem::exists(hashFile));
+    REQUIRE(std::filesystem::exists(manifestFile));
 }
 
 TEST_CASE_METHOD(CodegenTestFixture,
@@ -281,42 +349,42 @@ TEST_CASE_METHOD(CodegenTestFixture,
     // Running codegen on same function, so only need to upload function once
     loader.uploadFunction(msg);
 
-    std::string hashFile = objectFile + HASH_EXT;
-    std::string hashFileSgx = objectFileSgx + HASH_EXT;
+    std::string manifestFile = "/tmp/obj/demo/codegen.manifest";
 
     // Make sure directories are empty to start with
     loader.clearLocalCache();
 
     // Check files don't yet exist
-    REQUIRE(!std::filesystem::exists(hashFile));
-    REQUIRE(!std::filesystem::exists(hashFileSgx));
+    REQUIRE(!std::filesystem::exists(objectFile));
+    REQUIRE(!std::filesystem::exists(objectFileSgx));
+    REQUIRE(!std::filesystem::exists(manifestFile));
 
     // Do codegen for both in different orders
     SECTION("SGX first")
     {
         conf.wasmVm = "sgx";
         gen.codegenForFunction(msgSgx);
-        REQUIRE(std::filesystem::exists(hashFileSgx));
-        REQUIRE(!std::filesystem::exists(hashFile));
+        REQUIRE(std::filesystem::exists(objectFileSgx));
+        REQUIRE(!std::filesystem::exists(objectFile));
 
         conf.wasmVm = "wamr";
         gen.codegenForFunction(msg);
-        REQUIRE(std::filesystem::exists(hashFile));
+        REQUIRE(std::filesystem::exists(objectFile));
     }
 
     SECTION("SGX second")
     {
         conf.wasmVm = "wamr";
         gen.codegenForFunction(msg);
-        REQUIRE(std::filesystem::exists(hashFile));
-        REQUIRE(!std::filesystem::exists(hashFileSgx));
+        REQUIRE(std::filesystem::exists(objectFile));
+        REQUIRE(!std::filesystem::exists(objectFileSgx));
 
         conf.wasmVm = "sgx";
         gen.codegenForFunction(msgSgx);
-        REQUIRE(std::filesystem::exists(hashFileSgx));
+        REQUIRE(std::filesystem::exists(objectFileSgx));
     }
 
-    // Check hashes in S3
+    // Check objects and manifest in S3
     const std::string preffix = "/tmp/obj/";
     const std::vector<std::string> bucketKeys = s3.listKeys(conf.s3Bucket);
     REQUIRE(std::find(bucketKeys.begin(),
@@ -328,10 +396,101 @@ TEST_CASE_METHOD(CodegenTestFixture,
             bucketKeys.end());
     REQUIRE(std::find(bucketKeys.begin(),
                       bucketKeys.end(),
-                      hashFile.substr(preffix.length())) != bucketKeys.end());
-    REQUIRE(std::find(bucketKeys.begin(),
-                      bucketKeys.end(),
-                      hashFileSgx.substr(preffix.length())) !=
+                      manifestFile.substr(preffix.length())) !=
             bucketKeys.end());
+
+    // Check the manifest has separate entries for both
+    storage::CodegenManifest manifest(loader.loadCodegenManifest(msg.user()));
+    storage::CodegenManifestEntry entry =
+      manifest.getEntry(objectFile.substr(preffix.length()));
+    storage::CodegenManifestEntry entrySgx =
+      manifest.getEntry(objectFileSgx.substr(preffix.length()));
+    REQUIRE(entry.options == "wamr");
+    REQUIRE(entrySgx.options == "sgx");
+    REQUIRE(entry.hash == entrySgx.hash);
+}
+
+TEST_CASE_METHOD(CodegenTestFixture, "Test batch codegen", "[codegen]")
+{
+    loader.uploadFunction(msgA);
+    loader.uploadFunction(msgB);
+    loader.clearLocalCache();
+
+    std::vector<faabric::Message> msgs = { msgA, msgB };
+
+    // First run should compile everything
+    std::vector<CodegenResult> results = codegenForFunctions(msgs, false, 2);
+    REQUIRE(results.size() == 2);
+    REQUIRE(results.at(0).name == "demo/hello");
+    REQUIRE(results.at(1).name == "demo/echo");
+    for (const auto& r : results) {
+        REQUIRE(r.success);
+        REQUIRE(!r.skipped);
+        REQUIRE(r.error.empty());
+    }
+
+    REQUIRE(std::filesystem::exists(loader.getFunctionObjectFile(msgA)));
+    REQUIRE(std::filesystem::exists(loader.getFunctionObjectFile(msgB)));
+
+    // Check both entries were recorded in the user's manifest
+    storage::CodegenManifest manifest(loader.loadCodegenManifest("demo"));
+    REQUIRE(manifest.size() == 2);
+    REQUIRE(!manifest.getEntry(loader.getFunctionCodegenKey(msgA)).empty());
+    REQUIRE(!manifest.getEntry(loader.getFunctionCodegenKey(msgB)).empty());
+
+    // Second run should skip everything as hashes are unchanged
+    results = codegenForFunctions(msgs, false, 2);
+    for (const auto& r : results) {
+        REQUIRE(r.success);
+        REQUIRE(r.skipped);
+    }
+
+    // Clean run should compile everything again
+    results = codegenForFunctions(msgs, true, 2);
+    for (const auto& r : results) {
+        REQUIRE(r.success);
+        REQUIRE(!r.skipped);
+    }
+
+    // Check failures are reported without affecting other items
+    faabric::Message badMsg = faabric::util::messageFactory("demo", "blah");
+    std::vector<faabric::Message> badMsgs = { badMsg, msgA };
+    results = codegenForFunctions(badMsgs, false, 2);
+    REQUIRE(!results.at(0).success);
+    REQUIRE(!results.at(0).error.empty());
+    REQUIRE(results.at(1).success);
+}
+
+TEST_CASE_METHOD(CodegenTestFixture,
+                 "Test codegen for CPU targets",
+                 "[codegen]")
+{
+    conf.wasmVm = "wavm";
+    conf.codegenTargets = "x86-64-v3,x86-64";
+
+    loader.uploadFunction(msgA);
+    REQUIRE(gen.codegenForFunction(msgA));
+
+    // Each target gets its own machine code, as well as the default
+    std::string objFile = loader.getFunctionObjectFile(msgA);
+    std::string v3File = loader.getFunctionObjectFile(msgA, "x86-64-v3");
+    std::string baseFile = loader.getFunctionObjectFile(msgA, "x86-64");
+    REQUIRE(v3File == "/tmp/obj/demo/hello/function.wasm.x86-64-v3.o");
+    REQUIRE(std::filesystem::exists(objFile));
+    REQUIRE(std::filesystem::exists(v3File));
+    REQUIRE(std::filesystem::exists(baseFile));
+
+    // Unchanged targets skip codegen, new ones don't
+    REQUIRE(!gen.codegenForFunction(msgA));
+    conf.codegenTargets = "x86-64";
+    REQUIRE(gen.codegenForFunction(msgA));
+
+    // Missing targets load nothing
+    loader.clearLocalCache();
+    REQUIRE(!loader.loadFunctionObjectFile(msgA, "x86-64").empty());
+    REQUIRE(loader.loadFunctionObjectFile(msgA, "x86-64-v4").empty());
+
+    REQUIRE(wasm::isCodegenTargetSupported("x86-64"));
+    REQUIRE(!wasm::isCodegenTargetSupported("not-a-cpu"));
 }
 }
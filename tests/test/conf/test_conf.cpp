@@ -19,23 +19,96 @@ TEST_CASE("Test default faasm config initialisation", "[conf]")
         cgroupExpected = "off";
     }
     REQUIRE(conf.cgroupMode == cgroupExpected);
+    REQUIRE(conf.cgroupGranularity == "host");
+    REQUIRE(conf.cgroupCpuWeight == 100);
+    REQUIRE(conf.cgroupCpuMaxPercent == 0);
+    REQUIRE(conf.cgroupMemoryMaxMb == 0);
     REQUIRE(conf.netNsMode == "off");
     REQUIRE(conf.maxNetNs == 100);
+    REQUIRE(conf.netNsClaimTimeoutMs == 0);
+    REQUIRE(conf.netNsEgressRate.empty());
+    REQUIRE(conf.netNsTenantEgressRates.empty());
+    REQUIRE(conf.httpMaxIdleConnections == 16);
+    REQUIRE(conf.httpIdleTimeoutMs == 30000);
+    REQUIRE(conf.dnsCacheMaxTtlSecs == 300);
+    REQUIRE(conf.ipcChannelSize == 4194304);
+    REQUIRE(conf.affinityPolicy == "off");
+    REQUIRE(conf.metricsPort == 0);
 
     REQUIRE(conf.pythonPreload == "off");
+    REQUIRE(conf.pythonPreloadFaaslets == 0);
+    REQUIRE(conf.pythonImportZygote == "off");
+    REQUIRE(conf.pythonBytecodeCache == "on");
     REQUIRE(conf.captureStdout == "off");
+    REQUIRE(conf.captureStdoutMaxBytes == 1048576);
+
+    REQUIRE(conf.prewarmFunctions.empty());
+    REQUIRE(conf.prewarmThreads == 2);
+    REQUIRE(conf.uploadWorkers == 2);
+    REQUIRE(conf.uploadQueueSize == 32);
 
     REQUIRE(conf.chainedCallTimeout == 300000);
+    REQUIRE(conf.chainedShmOutputThreshold == 0);
+    REQUIRE(conf.execTimeoutMs == 0);
+    REQUIRE(conf.batchResetInterval == 64);
+    REQUIRE(conf.resultCacheFunctions.empty());
+    REQUIRE(conf.resultCacheBudgetMb == 64);
+    REQUIRE(conf.resultCacheShared == "off");
+    REQUIRE(conf.migrationPrecopy == "off");
+    REQUIRE(conf.migrationElideZeroPages == "off");
+    REQUIRE(conf.migrationPolicy == "always");
+    REQUIRE(conf.migrationBandwidthMbps == 1000);
+    REQUIRE(conf.checkpointPeriodSecs == 0);
+    REQUIRE(conf.checkpointRestore == "off");
+    REQUIRE(conf.stateShardKb == 1024);
+    REQUIRE(conf.stateShardReplicas == 1);
+    REQUIRE(conf.stateDiskDir.empty());
+    REQUIRE(conf.stateReplicaBudgetMb == 0);
 
     REQUIRE(conf.wasmVm == "wavm");
+    REQUIRE(conf.codegenTargets.empty());
+    REQUIRE(conf.wamrStackSize == 8192);
+    REQUIRE(conf.wamrFunctionStackSizes.empty());
+    REQUIRE(conf.moduleCacheBudgetMb == 0);
+    REQUIRE(conf.resetMode == "remap");
+    REQUIRE(conf.resetPoolSize == 0);
+    REQUIRE(conf.compartmentPoolSize == 0);
+    REQUIRE(conf.faasletMinFreeMemMb == 0);
+    REQUIRE(conf.faasletAdmissionQueue == 64);
+    REQUIRE(conf.faasletAdmissionTimeoutMs == 10000);
+    REQUIRE(conf.sharedZygoteMemory == "off");
+    REQUIRE(conf.sharedReadOnlyData == "on");
+    REQUIRE(conf.snapshotPageDedup == "off");
+    REQUIRE(conf.hugePages == "off");
+    REQUIRE(conf.pthreadDispatchBatch == 0);
+    REQUIRE(conf.ompLocalTeams == "on");
+    REQUIRE(conf.ompProfileFile == "");
+    REQUIRE(conf.mpiRendezvousThreshold == 0);
+    REQUIRE(conf.mpiShmCollectives == "off");
+    REQUIRE(conf.mpiProfileFile == "");
+    REQUIRE(conf.wasmProfileDir == "");
+    REQUIRE(conf.wasmProfileHz == 99);
+    REQUIRE(conf.wasmProfilePercent == 100);
+    REQUIRE(conf.perfCounters == "off");
+
+    REQUIRE(conf.runtimeOverlayDirs == "");
+    REQUIRE(conf.artefactCacheBudgetMb == 0);
+    REQUIRE(conf.artefactPeerFetch == "off");
 
     REQUIRE(conf.s3Bucket == "faasm");
     REQUIRE(conf.s3Host == "minio");
     REQUIRE(conf.s3Port == "9000");
     REQUIRE(conf.s3User == "minio");
     REQUIRE(conf.s3Password == "minio123");
+    REQUIRE(conf.s3PartSizeMb == 16);
+    REQUIRE(conf.s3Concurrency == 8);
+    REQUIRE(conf.sharedFileWriteBackMs == 0);
 
+    REQUIRE(conf.sgxEnclaves == 1);
+    REQUIRE(conf.sgxSwitchlessWorkers == 2);
     REQUIRE(conf.attestationProviderUrl == "");
+    REQUIRE(conf.sgxKeyReleaseUrl == "");
+    REQUIRE(conf.sgxAttestationRefreshSecs == 300);
 }
 
 TEST_CASE("Test overriding faasm config initialisation", "[conf]")
@@ -44,74 +117,298 @@ TEST_CASE("Test overriding faasm config initialisation", "[conf]")
 
     std::string hostType = setEnvVar("HOST_TYPE", "magic");
     std::string cgMode = setEnvVar("CGROUP_MODE", "off");
+    std::string cgGranularity = setEnvVar("CGROUP_GRANULARITY", "function");
+    std::string cgCpuWeight = setEnvVar("CGROUP_CPU_WEIGHT", "50");
+    std::string cgCpuMax = setEnvVar("CGROUP_CPU_MAX_PERCENT", "150");
+    std::string cgMemoryMax = setEnvVar("CGROUP_MEMORY_MAX_MB", "4096");
     std::string nsMode = setEnvVar("NETNS_MODE", "on");
     std::string maxNetNs = setEnvVar("MAX_NET_NAMESPACES", "300");
+    std::string nsTimeout = setEnvVar("NETNS_CLAIM_TIMEOUT_MS", "250");
+    std::string egressRate = setEnvVar("NETNS_EGRESS_RATE", "100mbit");
+    std::string tenantEgressRates =
+      setEnvVar("NETNS_TENANT_EGRESS_RATES", "demo=10mbit");
+    std::string httpIdleConns = setEnvVar("HTTP_MAX_IDLE_CONNS", "4");
+    std::string httpIdleTimeout = setEnvVar("HTTP_IDLE_TIMEOUT_MS", "5000");
+    std::string dnsCacheMaxTtl = setEnvVar("DNS_CACHE_MAX_TTL_S", "60");
+    std::string ipcChannelSize = setEnvVar("IPC_CHANNEL_SIZE", "65536");
+    std::string affinity = setEnvVar("AFFINITY_POLICY", "scatter");
+    std::string metricsPort = setEnvVar("METRICS_PORT", "9464");
 
     std::string pythonPre = setEnvVar("PYTHON_PRELOAD", "on");
+    std::string pythonPreFaaslets = setEnvVar("PYTHON_PRELOAD_FAASLETS", "4");
+    std::string pythonImportZygote = setEnvVar("PYTHON_IMPORT_ZYGOTE", "on");
+    std::string pythonBytecode = setEnvVar("PYTHON_BYTECODE_CACHE", "off");
     std::string captureStdout = setEnvVar("CAPTURE_STDOUT", "on");
+    std::string captureMax = setEnvVar("CAPTURE_STDOUT_MAX_BYTES", "4096");
+    std::string prewarmFuncs = setEnvVar("PREWARM_FUNCTIONS", "demo/echo");
+    std::string prewarmThreads = setEnvVar("PREWARM_THREADS", "7");
+    std::string uploadWorkers = setEnvVar("UPLOAD_WORKERS", "5");
+    std::string uploadQueueSize = setEnvVar("UPLOAD_QUEUE_SIZE", "10");
     std::string wasmVm = setEnvVar("WASM_VM", "blah");
+    std::string codegenTargets =
+      setEnvVar("CODEGEN_TARGETS", "x86-64-v4,x86-64-v3");
+    std::string wamrStackSize = setEnvVar("WAMR_STACK_SIZE", "4096");
+    std::string wamrFunctionStackSizes =
+      setEnvVar("WAMR_FUNCTION_STACK_SIZES", "demo/echo=2048");
+    std::string cacheBudget = setEnvVar("MODULE_CACHE_BUDGET_MB", "512");
+    std::string resetMode = setEnvVar("RESET_MODE", "dirty");
+    std::string resetPoolSize = setEnvVar("RESET_POOL_SIZE", "3");
+    std::string compartmentPool = setEnvVar("COMPARTMENT_POOL_SIZE", "2");
+    std::string minFreeMem = setEnvVar("FAASLET_MIN_FREE_MEM_MB", "1024");
+    std::string admissionQueue = setEnvVar("FAASLET_ADMISSION_QUEUE", "8");
+    std::string admissionTimeout =
+      setEnvVar("FAASLET_ADMISSION_TIMEOUT_MS", "500");
+    std::string sharedZygote = setEnvVar("SHARED_ZYGOTE_MEMORY", "on");
+    std::string sharedRodata = setEnvVar("SHARED_READ_ONLY_DATA", "off");
+    std::string pageDedup = setEnvVar("SNAPSHOT_PAGE_DEDUP", "on");
+    std::string hugePages = setEnvVar("HUGE_PAGES", "on");
+    std::string pthreadBatch = setEnvVar("PTHREAD_DISPATCH_BATCH", "2");
+    std::string ompLocalTeams = setEnvVar("OMP_LOCAL_TEAMS", "off");
+    std::string ompProfile = setEnvVar("OMP_PROFILE_FILE", "/tmp/omp.json");
+    std::string rendezvous = setEnvVar("MPI_RENDEZVOUS_THRESHOLD", "65536");
+    std::string mpiShm = setEnvVar("MPI_SHM_COLLECTIVES", "on");
+    std::string mpiProfile = setEnvVar("MPI_PROFILE_FILE", "/tmp/mpi.json");
+    std::string wasmProfileDir = setEnvVar("WASM_PROFILE_DIR", "/tmp/prof");
+    std::string wasmProfileHz = setEnvVar("WASM_PROFILE_HZ", "999");
+    std::string wasmProfilePercent = setEnvVar("WASM_PROFILE_PERCENT", "5");
+    std::string perfCounters = setEnvVar("PERF_COUNTERS", "on");
 
     std::string chainedTimeout = setEnvVar("CHAINED_CALL_TIMEOUT", "9999");
+    std::string chainedShm =
+      setEnvVar("CHAINED_SHM_OUTPUT_THRESHOLD", "1048576");
+    std::string execTimeout = setEnvVar("EXEC_TIMEOUT_MS", "2500");
+    std::string batchReset = setEnvVar("BATCH_RESET_INTERVAL", "8");
+    std::string resultCacheFuncs =
+      setEnvVar("RESULT_CACHE_FUNCTIONS", "demo/echo,demo/hello");
+    std::string resultCacheBudget = setEnvVar("RESULT_CACHE_BUDGET_MB", "16");
+    std::string resultCacheShared = setEnvVar("RESULT_CACHE_SHARED", "on");
+    std::string precopy = setEnvVar("MIGRATION_PRECOPY", "on");
+    std::string elideZeroes = setEnvVar("MIGRATION_ELIDE_ZERO_PAGES", "on");
+    std::string migrationPolicy = setEnvVar("MIGRATION_POLICY", "cost");
+    std::string migrationBandwidth =
+      setEnvVar("MIGRATION_BANDWIDTH_MBPS", "100");
+    std::string checkpointPeriod = setEnvVar("CHECKPOINT_PERIOD_S", "600");
+    std::string checkpointRestore = setEnvVar("CHECKPOINT_RESTORE", "on");
+    std::string stateShardKb = setEnvVar("STATE_SHARD_KB", "64");
+    std::string stateShardReplicas = setEnvVar("STATE_SHARD_REPLICAS", "3");
+    std::string stateDiskDir = setEnvVar("STATE_DISK_DIR", "/tmp/state");
+    std::string stateReplicaBudgetMb =
+      setEnvVar("STATE_REPLICA_BUDGET_MB", "512");
 
     std::string faasmLocalDir = setEnvVar("FAASM_LOCAL_DIR", "/tmp/blah");
+    std::string overlayDirs = setEnvVar("RUNTIME_OVERLAY_DIRS", "lib/foo");
+    std::string artefactBudget = setEnvVar("ARTEFACT_CACHE_BUDGET_MB", "1024");
+    std::string artefactPeers = setEnvVar("ARTEFACT_PEER_FETCH", "on");
 
     std::string s3Bucket = setEnvVar("S3_BUCKET", "dummy-bucket");
     std::string s3Host = setEnvVar("S3_HOST", "dummy-host");
     std::string s3Port = setEnvVar("S3_PORT", "123456");
     std::string s3User = setEnvVar("S3_USER", "dummy-user");
     std::string s3Password = setEnvVar("S3_PASSWORD", "dummy-password");
+    std::string s3PartSize = setEnvVar("S3_PART_SIZE_MB", "64");
+    std::string s3Concurrency = setEnvVar("S3_CONCURRENCY", "3");
+    std::string writeBack = setEnvVar("SHARED_FILE_WRITE_BACK_MS", "250");
 
+    std::string sgxEnclaves = setEnvVar("SGX_ENCLAVES", "3");
+    std::string sgxSwitchlessWorkers = setEnvVar("SGX_SWITCHLESS_WORKERS", "0");
     std::string attestationProviderUrl =
       setEnvVar("AZ_ATTESTATION_PROVIDER_URL", "dummy-url");
+    std::string sgxKeyReleaseUrl =
+      setEnvVar("SGX_KEY_RELEASE_URL", "dummy-release-url");
+    std::string sgxAttestationRefreshSecs =
+      setEnvVar("SGX_ATTESTATION_REFRESH_SECS", "60");
 
     // Create new conf for test
     FaasmConfig conf;
 
     REQUIRE(conf.hostType == "magic");
     REQUIRE(conf.cgroupMode == "off");
+    REQUIRE(conf.cgroupGranularity == "function");
+    REQUIRE(conf.cgroupCpuWeight == 50);
+    REQUIRE(conf.cgroupCpuMaxPercent == 150);
+    REQUIRE(conf.cgroupMemoryMaxMb == 4096);
     REQUIRE(conf.netNsMode == "on");
     REQUIRE(conf.maxNetNs == 300);
+    REQUIRE(conf.netNsClaimTimeoutMs == 250);
+    REQUIRE(conf.netNsEgressRate == "100mbit");
+    REQUIRE(conf.netNsTenantEgressRates == "demo=10mbit");
+    REQUIRE(conf.httpMaxIdleConnections == 4);
+    REQUIRE(conf.httpIdleTimeoutMs == 5000);
+    REQUIRE(conf.dnsCacheMaxTtlSecs == 60);
+    REQUIRE(conf.ipcChannelSize == 65536);
+    REQUIRE(conf.affinityPolicy == "scatter");
+    REQUIRE(conf.metricsPort == 9464);
 
     REQUIRE(conf.pythonPreload == "on");
+    REQUIRE(conf.pythonPreloadFaaslets == 4);
+    REQUIRE(conf.pythonImportZygote == "on");
+    REQUIRE(conf.pythonBytecodeCache == "off");
     REQUIRE(conf.captureStdout == "on");
+    REQUIRE(conf.captureStdoutMaxBytes == 4096);
+    REQUIRE(conf.prewarmFunctions == "demo/echo");
+    REQUIRE(conf.prewarmThreads == 7);
+    REQUIRE(conf.uploadWorkers == 5);
+    REQUIRE(conf.uploadQueueSize == 10);
     REQUIRE(conf.wasmVm == "blah");
+    REQUIRE(conf.codegenTargets == "x86-64-v4,x86-64-v3");
+    REQUIRE(conf.wamrStackSize == 4096);
+    REQUIRE(conf.wamrFunctionStackSizes == "demo/echo=2048");
+    REQUIRE(conf.moduleCacheBudgetMb == 512);
+    REQUIRE(conf.resetMode == "dirty");
+    REQUIRE(conf.resetPoolSize == 3);
+    REQUIRE(conf.compartmentPoolSize == 2);
+    REQUIRE(conf.faasletMinFreeMemMb == 1024);
+    REQUIRE(conf.faasletAdmissionQueue == 8);
+    REQUIRE(conf.faasletAdmissionTimeoutMs == 500);
+    REQUIRE(conf.sharedZygoteMemory == "on");
+    REQUIRE(conf.sharedReadOnlyData == "off");
+    REQUIRE(conf.snapshotPageDedup == "on");
+    REQUIRE(conf.hugePages == "on");
+    REQUIRE(conf.pthreadDispatchBatch == 2);
+    REQUIRE(conf.ompLocalTeams == "off");
+    REQUIRE(conf.ompProfileFile == "/tmp/omp.json");
+    REQUIRE(conf.mpiRendezvousThreshold == 65536);
+    REQUIRE(conf.mpiShmCollectives == "on");
+    REQUIRE(conf.mpiProfileFile == "/tmp/mpi.json");
+    REQUIRE(conf.wasmProfileDir == "/tmp/prof");
+    REQUIRE(conf.wasmProfileHz == 999);
+    REQUIRE(conf.wasmProfilePercent == 5);
+    REQUIRE(conf.perfCounters == "on");
 
     REQUIRE(conf.chainedCallTimeout == 9999);
+    REQUIRE(conf.chainedShmOutputThreshold == 1048576);
+    REQUIRE(conf.execTimeoutMs == 2500);
+    REQUIRE(conf.batchResetInterval == 8);
+    REQUIRE(conf.resultCacheFunctions == "demo/echo,demo/hello");
+    REQUIRE(conf.resultCacheBudgetMb == 16);
+    REQUIRE(conf.resultCacheShared == "on");
+    REQUIRE(conf.migrationPrecopy == "on");
+    REQUIRE(conf.migrationElideZeroPages == "on");
+    REQUIRE(conf.migrationPolicy == "cost");
+    REQUIRE(conf.migrationBandwidthMbps == 100);
+    REQUIRE(conf.checkpointPeriodSecs == 600);
+    REQUIRE(conf.checkpointRestore == "on");
+    REQUIRE(conf.stateShardKb == 64);
+    REQUIRE(conf.stateShardReplicas == 3);
+    REQUIRE(conf.stateDiskDir == "/tmp/state");
+    REQUIRE(conf.stateReplicaBudgetMb == 512);
 
     REQUIRE(conf.functionDir == "/tmp/blah/wasm");
     REQUIRE(conf.objectFileDir == "/tmp/blah/object");
     REQUIRE(conf.runtimeFilesDir == "/tmp/blah/runtime_root");
     REQUIRE(conf.sharedFilesDir == "/tmp/blah/shared");
+    REQUIRE(conf.runtimeOverlayDirs == "lib/foo");
+    REQUIRE(conf.artefactCacheDir == "/tmp/blah/artefacts");
+    REQUIRE(conf.artefactCacheBudgetMb == 1024);
+    REQUIRE(conf.artefactPeerFetch == "on");
 
     REQUIRE(conf.s3Bucket == "dummy-bucket");
     REQUIRE(conf.s3Host == "dummy-host");
     REQUIRE(conf.s3Port == "123456");
     REQUIRE(conf.s3User == "dummy-user");
     REQUIRE(conf.s3Password == "dummy-password");
+    REQUIRE(conf.s3PartSizeMb == 64);
+    REQUIRE(conf.s3Concurrency == 3);
+    REQUIRE(conf.sharedFileWriteBackMs == 250);
 
+    REQUIRE(conf.sgxEnclaves == 3);
+    REQUIRE(conf.sgxSwitchlessWorkers == 0);
     REQUIRE(conf.attestationProviderUrl == "dummy-url");
+    REQUIRE(conf.sgxKeyReleaseUrl == "dummy-release-url");
+    REQUIRE(conf.sgxAttestationRefreshSecs == 60);
 
     // Be careful with host type as it must remain consistent for tests
     setEnvVar("HOST_TYPE", originalHostType);
 
     setEnvVar("CGROUP_MODE", cgMode);
+    setEnvVar("CGROUP_GRANULARITY", cgGranularity);
+    setEnvVar("CGROUP_CPU_WEIGHT", cgCpuWeight);
+    setEnvVar("CGROUP_CPU_MAX_PERCENT", cgCpuMax);
+    setEnvVar("CGROUP_MEMORY_MAX_MB", cgMemoryMax);
     setEnvVar("NETNS_MODE", nsMode);
     setEnvVar("MAX_NET_NAMESPACES", maxNetNs);
+    setEnvVar("NETNS_CLAIM_TIMEOUT_MS", nsTimeout);
+    setEnvVar("NETNS_EGRESS_RATE", egressRate);
+    setEnvVar("NETNS_TENANT_EGRESS_RATES", tenantEgressRates);
+    setEnvVar("HTTP_MAX_IDLE_CONNS", httpIdleConns);
+    setEnvVar("HTTP_IDLE_TIMEOUT_MS", httpIdleTimeout);
+    setEnvVar("DNS_CACHE_MAX_TTL_S", dnsCacheMaxTtl);
+    setEnvVar("IPC_CHANNEL_SIZE", ipcChannelSize);
+    setEnvVar("AFFINITY_POLICY", affinity);
+    setEnvVar("METRICS_PORT", metricsPort);
 
     setEnvVar("PYTHON_PRELOAD", pythonPre);
+    setEnvVar("PYTHON_PRELOAD_FAASLETS", pythonPreFaaslets);
+    setEnvVar("PYTHON_IMPORT_ZYGOTE", pythonImportZygote);
+    setEnvVar("PYTHON_BYTECODE_CACHE", pythonBytecode);
     setEnvVar("CAPTURE_STDOUT", captureStdout);
+    setEnvVar("CAPTURE_STDOUT_MAX_BYTES", captureMax);
+    setEnvVar("PREWARM_FUNCTIONS", prewarmFuncs);
+    setEnvVar("PREWARM_THREADS", prewarmThreads);
+    setEnvVar("UPLOAD_WORKERS", uploadWorkers);
+    setEnvVar("UPLOAD_QUEUE_SIZE", uploadQueueSize);
     setEnvVar("WASM_VM", wasmVm);
+    setEnvVar("CODEGEN_TARGETS", codegenTargets);
+    setEnvVar("WAMR_STACK_SIZE", wamrStackSize);
+    setEnvVar("WAMR_FUNCTION_STACK_SIZES", wamrFunctionStackSizes);
+    setEnvVar("MODULE_CACHE_BUDGET_MB", cacheBudget);
+    setEnvVar("RESET_MODE", resetMode);
+    setEnvVar("RESET_POOL_SIZE", resetPoolSize);
+    setEnvVar("COMPARTMENT_POOL_SIZE", compartmentPool);
+    setEnvVar("FAASLET_MIN_FREE_MEM_MB", minFreeMem);
+    setEnvVar("FAASLET_ADMISSION_QUEUE", admissionQueue);
+    setEnvVar("FAASLET_ADMISSION_TIMEOUT_MS", admissionTimeout);
+    setEnvVar("SHARED_ZYGOTE_MEMORY", sharedZygote);
+    setEnvVar("SHARED_READ_ONLY_DATA", sharedRodata);
+    setEnvVar("SNAPSHOT_PAGE_DEDUP", pageDedup);
+    setEnvVar("HUGE_PAGES", hugePages);
+    setEnvVar("PTHREAD_DISPATCH_BATCH", pthreadBatch);
+    setEnvVar("OMP_LOCAL_TEAMS", ompLocalTeams);
+    setEnvVar("OMP_PROFILE_FILE", ompProfile);
+    setEnvVar("MPI_RENDEZVOUS_THRESHOLD", rendezvous);
+    setEnvVar("MPI_SHM_COLLECTIVES", mpiShm);
+    setEnvVar("MPI_PROFILE_FILE", mpiProfile);
+    setEnvVar("WASM_PROFILE_DIR", wasmProfileDir);
+    setEnvVar("WASM_PROFILE_HZ", wasmProfileHz);
+    setEnvVar("WASM_PROFILE_PERCENT", wasmProfilePercent);
+    setEnvVar("PERF_COUNTERS", perfCounters);
 
     setEnvVar("CHAINED_CALL_TIMEOUT", chainedTimeout);
+    setEnvVar("CHAINED_SHM_OUTPUT_THRESHOLD", chainedShm);
+    setEnvVar("EXEC_TIMEOUT_MS", execTimeout);
+    setEnvVar("BATCH_RESET_INTERVAL", batchReset);
+    setEnvVar("RESULT_CACHE_FUNCTIONS", resultCacheFuncs);
+    setEnvVar("RESULT_CACHE_BUDGET_MB", resultCacheBudget);
+    setEnvVar("RESULT_CACHE_SHARED", resultCacheShared);
+    setEnvVar("MIGRATION_PRECOPY", precopy);
+    setEnvVar("MIGRATION_ELIDE_ZERO_PAGES", elideZeroes);
+    setEnvVar("MIGRATION_POLICY", migrationPolicy);
+    setEnvVar("MIGRATION_BANDWIDTH_MBPS", migrationBandwidth);
+    setEnvVar("CHECKPOINT_PERIOD_S", checkpointPeriod);
+    setEnvVar("CHECKPOINT_RESTORE", checkpointRestore);
+    setEnvVar("STATE_SHARD_KB", stateShardKb);
+    setEnvVar("STATE_SHARD_REPLICAS", stateShardReplicas);
+    setEnvVar("STATE_DISK_DIR", stateDiskDir);
+    setEnvVar("STATE_REPLICA_BUDGET_MB", stateReplicaBudgetMb);
 
     setEnvVar("FAASM_LOCAL_DIR", faasmLocalDir);
+    setEnvVar("RUNTIME_OVERLAY_DIRS", overlayDirs);
+    setEnvVar("ARTEFACT_CACHE_BUDGET_MB", artefactBudget);
+    setEnvVar("ARTEFACT_PEER_FETCH", artefactPeers);
 
     setEnvVar("S3_BUCKET", s3Bucket);
     setEnvVar("S3_HOST", s3Host);
     setEnvVar("S3_PORT", s3Port);
     setEnvVar("S3_USER", s3User);
     setEnvVar("S3_PASSWORD", s3Password);
+    setEnvVar("S3_PART_SIZE_MB", s3PartSize);
+    setEnvVar("S3_CONCURRENCY", s3Concurrency);
+    setEnvVar("SHARED_FILE_WRITE_BACK_MS", writeBack);
 
+    setEnvVar("SGX_ENCLAVES", sgxEnclaves);
+    setEnvVar("SGX_SWITCHLESS_WORKERS", sgxSwitchlessWorkers);
     setEnvVar("AZ_ATTESTATION_PROVIDER_URL", attestationProviderUrl);
+    setEnvVar("SGX_KEY_RELEASE_URL", sgxKeyReleaseUrl);
+    setEnvVar("SGX_ATTESTATION_REFRESH_SECS", sgxAttestationRefreshSecs);
 }
 }
@@ -0,0 +1,92 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+#include "utils.h"
+
+#include <enclave/outside/EnclaveInterface.h>
+#include <enclave/outside/EnclavePool.h>
+#include <enclave/outside/system.h>
+
+#include <faabric/util/func.h>
+
+namespace tests {
+
+class EnclavePoolTestFixture : public MultiRuntimeFunctionExecTestFixture
+{
+  public:
+    EnclavePoolTestFixture()
+    {
+        conf.wasmVm = "sgx";
+        sgx::checkSgxSetup();
+    }
+
+    ~EnclavePoolTestFixture() { sgx::tearDownEnclave(); }
+};
+
+TEST_CASE_METHOD(EnclavePoolTestFixture,
+                 "Test modules stay loaded in enclave across Faaslets",
+                 "[sgx]")
+{
+    auto req = setUpContext("demo", "hello");
+    faabric::Message& msg = req->mutable_messages()->at(0);
+    std::string funcStr = faabric::util::funcToString(msg, false);
+
+    sgx::EnclavePool& pool = sgx::getEnclavePool();
+
+    sgx_enclave_id_t enclaveId = 0;
+    {
+        wasm::EnclaveInterface enclaveInterface;
+        enclaveInterface.bindToFunction(msg);
+        enclaveId = enclaveInterface.getEnclaveId();
+        REQUIRE(enclaveId == sgx::getGlobalEnclaveId());
+
+        REQUIRE(enclaveInterface.executeFunction(msg) == 0);
+
+        // Resetting re-instantiates in place
+        enclaveInterface.reset(msg, "");
+        REQUIRE(enclaveInterface.executeFunction(msg) == 0);
+    }
+
+    // All TCS slots are given back, and the function is still loaded
+    REQUIRE(pool.getFreeTcs(enclaveId) == FAASM_SGX_ENCLAVE_TCS_NUM);
+    REQUIRE(pool.getLoadedFunctions(enclaveId) ==
+            std::set<std::string>{ funcStr });
+
+    // The next Faaslet goes back to the same enclave
+    wasm::EnclaveInterface enclaveInterface;
+    enclaveInterface.bindToFunction(msg);
+    REQUIRE(enclaveInterface.getEnclaveId() == enclaveId);
+    REQUIRE(enclaveInterface.executeFunction(msg) == 0);
+}
+
+TEST_CASE_METHOD(EnclavePoolTestFixture,
+                 "Test spreading Faaslets over enclaves",
+                 "[sgx]")
+{
+    conf.sgxEnclaves = 2;
+
+    auto req = setUpContext("demo", "hello");
+    faabric::Message& msg = req->mutable_messages()->at(0);
+
+    auto reqB = setUpContext("demo", "echo");
+    faabric::Message& msgB = reqB->mutable_messages()->at(0);
+
+    wasm::EnclaveInterface interfaceA;
+    interfaceA.bindToFunction(msg);
+
+    // A different function goes to a new enclave while there's room
+    wasm::EnclaveInterface interfaceB;
+    interfaceB.bindToFunction(msgB);
+    REQUIRE(interfaceA.getEnclaveId() != interfaceB.getEnclaveId());
+    REQUIRE(sgx::getEnclavePool().getEnclaveCount() == 2);
+
+    // The same function goes where it's already loaded
+    wasm::EnclaveInterface interfaceC;
+    interfaceC.bindToFunction(msg);
+    REQUIRE(interfaceC.getEnclaveId() == interfaceA.getEnclaveId());
+
+    REQUIRE(interfaceA.executeFunction(msg) == 0);
+    REQUIRE(interfaceB.executeFunction(msgB) == 0);
+    REQUIRE(interfaceC.executeFunction(msg) == 0);
+}
+}
@@ -0,0 +1,126 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <faabric/util/func.h>
+#include <faabric/util/macros.h>
+#include <faabric/util/timing.h>
+
+#include <conf/FaasmConfig.h>
+#include <faaslet/Faaslet.h>
+
+#include <algorithm>
+#include <climits>
+#include <thread>
+#include <vector>
+
+namespace tests {
+
+class FaasletAdmissionTestFixture : public FaasmConfTestFixture
+{
+  public:
+    FaasletAdmissionTestFixture()
+    {
+        conf.netNsMode = "off";
+        faaslet::resetFaasletAdmissionStats();
+    }
+
+    ~FaasletAdmissionTestFixture() { faaslet::resetFaasletAdmissionStats(); }
+};
+
+TEST_CASE_METHOD(FaasletAdmissionTestFixture,
+                 "Test admitting Faaslets with room on the host",
+                 "[faaslet]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+
+    conf.faasletMinFreeMemMb = 0;
+    REQUIRE_NOTHROW(faaslet::admitFaaslet(msg));
+    REQUIRE(faaslet::getFaasletAdmissionStats().inFlight == 1);
+    faaslet::finishFaasletAdmission();
+
+    REQUIRE(faaslet::getFaasletAdmissionStats().rejected == 0);
+    REQUIRE(faaslet::getFaasletAdmissionStats().waiting == 0);
+    REQUIRE(faaslet::getFaasletAdmissionStats().inFlight == 0);
+}
+
+TEST_CASE_METHOD(FaasletAdmissionTestFixture,
+                 "Test rejecting Faaslets without room on the host",
+                 "[faaslet]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+
+    // No host has this much memory free
+    conf.faasletMinFreeMemMb = INT_MAX;
+    conf.faasletAdmissionTimeoutMs = 200;
+
+    long minMicros = 0;
+    SECTION("Queue full") { conf.faasletAdmissionQueue = 0; }
+
+    SECTION("Timed out")
+    {
+        conf.faasletAdmissionQueue = 1;
+        minMicros = 200 * 1000;
+    }
+
+    faabric::util::TimePoint start = faabric::util::startTimer();
+    REQUIRE_THROWS(faaslet::admitFaaslet(msg));
+    REQUIRE(faabric::util::getTimeDiffMicros(start) >= minMicros);
+
+    REQUIRE(faaslet::getFaasletAdmissionStats().rejected == 1);
+    REQUIRE(faaslet::getFaasletAdmissionStats().waiting == 0);
+}
+
+TEST_CASE_METHOD(FaasletAdmissionTestFixture,
+                 "Test admitting one waiting Faaslet per freed slot",
+                 "[faaslet]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+
+    // Any host has this much memory free, so only creations in flight stop
+    // others being admitted
+    conf.faasletMinFreeMemMb = 1;
+    conf.faasletAdmissionQueue = 10;
+    conf.faasletAdmissionTimeoutMs = 1000;
+
+    faaslet::admitFaaslet(msg);
+    REQUIRE(faaslet::getFaasletAdmissionStats().inFlight == 1);
+
+    size_t nWaiters = 3;
+    std::vector<char> admitted(nWaiters, 0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < nWaiters; i++) {
+        threads.emplace_back([&admitted, &msg, i] {
+            try {
+                faaslet::admitFaaslet(msg);
+                admitted.at(i) = 1;
+            } catch (std::runtime_error&) {
+                admitted.at(i) = 0;
+            }
+        });
+    }
+
+    // Wait for them all to queue up before freeing a single slot
+    for (int i = 0; i < 100; i++) {
+        if (faaslet::getFaasletAdmissionStats().waiting == nWaiters) {
+            break;
+        }
+        SLEEP_MS(10);
+    }
+    REQUIRE(faaslet::getFaasletAdmissionStats().waiting == nWaiters);
+    faaslet::finishFaasletAdmission();
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    // The one admitted is still in flight, so the rest time out
+    REQUIRE(std::count(admitted.begin(), admitted.end(), 1) == 1);
+    REQUIRE(faaslet::getFaasletAdmissionStats().inFlight == 1);
+    REQUIRE(faaslet::getFaasletAdmissionStats().rejected == nWaiters - 1);
+    REQUIRE(faaslet::getFaasletAdmissionStats().waiting == 0);
+
+    faaslet::finishFaasletAdmission();
+    REQUIRE(faaslet::getFaasletAdmissionStats().inFlight == 0);
+}
+}
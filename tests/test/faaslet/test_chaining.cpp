@@ -3,7 +3,15 @@
 #include "faasm_fixtures.h"
 #include "utils.h"
 
+#include <faabric/scheduler/ExecutorContext.h>
+#include <faabric/util/bytes.h>
 #include <faabric/util/environment.h>
+#include <faabric/util/func.h>
+
+#include <faaslet/Faaslet.h>
+#include <wasm/chaining.h>
+#include <wasm/chaining_dag.h>
+#include <wasm/chaining_shm.h>
 
 using namespace faaslet;
 
@@ -33,4 +41,96 @@ TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
     execFuncWithPool(call, true, 5000);
 }
 
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test chaining a batch of calls",
+                 "[faaslet]")
+{
+    SECTION("WAVM") { conf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { conf.wasmVm = "wamr"; }
+
+    auto req = faabric::util::batchExecFactory("demo", "echo", 1);
+    faaslet::Faaslet faaslet(req->mutable_messages()->at(0));
+    faabric::scheduler::ExecutorContext::set(&faaslet, req, 0);
+
+    std::vector<std::vector<uint8_t>> inputs = {
+        faabric::util::stringToBytes("foo"),
+        faabric::util::stringToBytes("bar"),
+        faabric::util::stringToBytes("baz"),
+    };
+    std::vector<int> callIds =
+      wasm::makeChainedCalls("echo", 0, nullptr, inputs);
+    REQUIRE(callIds.size() == 3);
+
+    std::vector<unsigned int> awaitIds(callIds.begin(), callIds.end());
+    std::vector<int> results;
+    REQUIRE(wasm::awaitChainedCalls(awaitIds, results) == 0);
+    REQUIRE(results == std::vector<int>({ 0, 0, 0 }));
+
+    // Each call gets its own input
+    std::vector<uint8_t> output(3);
+    REQUIRE(wasm::awaitChainedCallOutput(awaitIds.at(1), output.data(), 3) ==
+            0);
+    REQUIRE(output == inputs.at(1));
+
+    // Calls that weren't chained from here count as failed
+    awaitIds.push_back(awaitIds.back() + 1000);
+    REQUIRE(wasm::awaitChainedCalls(awaitIds, results) == 1);
+    REQUIRE(results == std::vector<int>({ 0, 0, 0, 1 }));
+}
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test chained call outputs in shared memory",
+                 "[faaslet]")
+{
+    SECTION("WAVM") { conf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { conf.wasmVm = "wamr"; }
+
+    conf.chainedShmOutputThreshold = 1;
+
+    auto req = faabric::util::batchExecFactory("demo", "echo", 1);
+    faaslet::Faaslet faaslet(req->mutable_messages()->at(0));
+    faabric::scheduler::ExecutorContext::set(&faaslet, req, 0);
+
+    // The callee runs here, so its output comes back through shared memory
+    std::vector<uint8_t> input = faabric::util::stringToBytes("foobar");
+    int callId = wasm::makeChainedCall("echo", 0, nullptr, input);
+
+    std::vector<uint8_t> output(input.size());
+    REQUIRE(wasm::awaitChainedCallOutput(
+              callId, output.data(), output.size()) == 0);
+    REQUIRE(output == input);
+    REQUIRE(wasm::getChainedShmOutputCount() == 0);
+}
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test chaining a graph of calls",
+                 "[faaslet]")
+{
+    SECTION("WAVM") { conf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { conf.wasmVm = "wamr"; }
+
+    auto req = faabric::util::batchExecFactory("demo", "echo", 1);
+    faaslet::Faaslet faaslet(req->mutable_messages()->at(0));
+    faabric::scheduler::ExecutorContext::set(&faaslet, req, 0);
+
+    // Two echoes feeding a third, which gets its own input then theirs
+    std::vector<wasm::ChainedDagNode> nodes = {
+        { "echo", faabric::util::stringToBytes("a") },
+        { "echo", faabric::util::stringToBytes("b") },
+        { "echo", faabric::util::stringToBytes("c") },
+    };
+    std::vector<int> callIds =
+      wasm::makeChainedDag(nodes, { { 1, 2 }, { 0, 2 } });
+    REQUIRE(callIds.size() == 3);
+
+    std::vector<uint8_t> output(3);
+    REQUIRE(wasm::awaitChainedCallOutput(
+              callIds.at(2), output.data(), output.size()) == 0);
+    REQUIRE(output == faabric::util::stringToBytes("cba"));
+
+    wasm::awaitChainedDags(req->messages(0).id());
+}
 }
@@ -0,0 +1,113 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <faabric/scheduler/ExecutorContext.h>
+#include <faabric/util/func.h>
+
+#include <conf/FaasmConfig.h>
+#include <faaslet/Faaslet.h>
+#include <system/IsolationMetrics.h>
+
+#include <map>
+#include <string>
+#include <thread>
+
+namespace tests {
+
+// Executes the task and says whether it had to set up isolation
+static bool executeAndCheckSetUp(
+  faaslet::Faaslet& faaslet,
+  std::shared_ptr<faabric::BatchExecuteRequest> req)
+{
+    faabric::Message& msg = req->mutable_messages()->at(0);
+    msg.mutable_execgraphdetails()->clear();
+
+    faabric::scheduler::ExecutorContext::set(&faaslet, req, 0);
+    faaslet.executeTask(0, 0, req);
+    faaslet.reset(msg);
+
+    return msg.execgraphdetails().count(PHASE_ISOLATION_SETUP) > 0;
+}
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test isolation is only set up when the tenant changes",
+                 "[faaslet]")
+{
+    isolation::resetIsolationMetrics();
+
+    auto reqA = faabric::util::batchExecFactory("demo", "echo", 1);
+    auto reqB = faabric::util::batchExecFactory("demo", "hello", 1);
+    faaslet::Faaslet faasletA(reqA->mutable_messages()->at(0));
+    faaslet::Faaslet faasletB(reqB->mutable_messages()->at(0));
+
+    // A fresh thread, so nothing has been isolated on it yet
+    std::vector<bool> setUp;
+    std::thread t([&] {
+        setUp.push_back(executeAndCheckSetUp(faasletA, reqA));
+        setUp.push_back(executeAndCheckSetUp(faasletA, reqA));
+
+        // The same user shares the host-wide cgroup, so nothing changes
+        setUp.push_back(executeAndCheckSetUp(faasletB, reqB));
+
+        // With a cgroup per function it does
+        conf.cgroupGranularity = "function";
+        setUp.push_back(executeAndCheckSetUp(faasletB, reqB));
+    });
+    t.join();
+
+    REQUIRE(setUp == std::vector<bool>({ true, false, false, true }));
+    REQUIRE(isolation::getIsolationMetrics().reused == 2);
+}
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test Faaslets record the phases of each call",
+                 "[faaslet]")
+{
+    auto req = faabric::util::batchExecFactory("demo", "echo", 1);
+    faabric::Message& msg = req->mutable_messages()->at(0);
+    faaslet::Faaslet faaslet(msg);
+
+    std::vector<std::map<std::string, long>> phases;
+    std::thread t([&] {
+        for (int i = 0; i < 2; i++) {
+            msg.mutable_execgraphdetails()->clear();
+
+            faabric::scheduler::ExecutorContext::set(&faaslet, req, 0);
+            faaslet.executeTask(0, 0, req);
+            faaslet.reset(msg);
+
+            std::map<std::string, long> callPhases;
+            for (const std::string& phase : { PHASE_FAASLET_INIT,
+                                              PHASE_ISOLATION_SETUP,
+                                              PHASE_EXECUTE,
+                                              PHASE_RESET,
+                                              PHASE_TASK_START,
+                                              PHASE_TASK_END }) {
+                if (msg.execgraphdetails().count(phase) > 0) {
+                    callPhases[phase] = faaslet::getPhaseMicros(msg, phase);
+                }
+            }
+            phases.emplace_back(callPhases);
+        }
+    });
+    t.join();
+
+    // Only the first call pays for the Faaslet and its isolation
+    REQUIRE(phases.at(0).count(PHASE_FAASLET_INIT) == 1);
+    REQUIRE(phases.at(0).at(PHASE_FAASLET_INIT) > 0);
+    REQUIRE(phases.at(0).count(PHASE_ISOLATION_SETUP) == 1);
+    REQUIRE(phases.at(1).count(PHASE_FAASLET_INIT) == 0);
+    REQUIRE(phases.at(1).count(PHASE_ISOLATION_SETUP) == 0);
+
+    for (auto& callPhases : phases) {
+        REQUIRE(callPhases.count(PHASE_EXECUTE) == 1);
+        REQUIRE(callPhases.count(PHASE_RESET) == 1);
+
+        long start = callPhases.at(PHASE_TASK_START);
+        long end = callPhases.at(PHASE_TASK_END);
+        REQUIRE(start > 0);
+        REQUIRE(end >= start);
+    }
+}
+}
@@ -0,0 +1,117 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+#include "utils.h"
+
+#include <faabric/util/func.h>
+#include <faabric/util/memory.h>
+
+#include <conf/FaasmConfig.h>
+#include <faaslet/Faaslet.h>
+#include <wasm/memory_accounting.h>
+
+#include <algorithm>
+#include <cstring>
+#include <sys/mman.h>
+
+namespace tests {
+
+TEST_CASE("Test finding resident pages of a range", "[faaslet]")
+{
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    size_t nPages = 16;
+    auto* ptr = (uint8_t*)mmap(nullptr,
+                               nPages * pageSize,
+                               PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS,
+                               -1,
+                               0);
+    REQUIRE(ptr != MAP_FAILED);
+
+    wasm::ResidentMemory resident =
+      wasm::getResidentMemory(ptr, nPages * pageSize);
+    REQUIRE(resident.residentBytes == 0);
+    REQUIRE(resident.privateBytes == 0);
+
+    // Only the pages written to are resident
+    std::memset(ptr, 1, 1);
+    std::memset(ptr + 5 * pageSize, 1, pageSize);
+    std::memset(ptr + 15 * pageSize + 10, 1, 1);
+
+    resident = wasm::getResidentMemory(ptr, nPages * pageSize);
+    REQUIRE(resident.residentBytes == 3 * pageSize);
+    REQUIRE(resident.privateBytes == 3 * pageSize);
+
+    // Ranges are widened to whole pages
+    resident = wasm::getResidentMemory(ptr + 5 * pageSize + 100, 10);
+    REQUIRE(resident.residentBytes == pageSize);
+
+    REQUIRE(wasm::getResidentMemory(nullptr, 10).residentBytes == 0);
+
+    munmap(ptr, nPages * pageSize);
+}
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test Faaslet memory accounting",
+                 "[faaslet]")
+{
+    SECTION("WAVM") { conf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { conf.wasmVm = "wamr"; }
+
+    int resetPoolSize = 0;
+    SECTION("No reset pool") { resetPoolSize = 0; }
+
+    SECTION("Reset pool") { resetPoolSize = 2; }
+
+    conf.resetPoolSize = resetPoolSize;
+
+    auto req = setUpContext("demo", "echo");
+    faabric::Message& msg = req->mutable_messages()->at(0);
+
+    auto faaslet = std::make_unique<faaslet::Faaslet>(msg);
+    REQUIRE(faaslet->executeTask(0, 0, req) == 0);
+
+    faaslet::FaasletMemoryUsage usage = faaslet->getMemoryUsage();
+    REQUIRE(usage.user == "demo");
+    REQUIRE(usage.function == "echo");
+    REQUIRE(usage.resetSnapshotKey == faaslet->getLocalResetSnapshotKey());
+    REQUIRE(usage.nModules == 1 + resetPoolSize);
+
+    size_t memSize = faaslet->module->getMemorySizeBytes();
+    REQUIRE(usage.modules.linearMemoryBytes >= memSize);
+    REQUIRE(usage.modules.residentBytes > 0);
+    REQUIRE(usage.modules.residentBytes <= usage.modules.linearMemoryBytes);
+    REQUIRE(usage.modules.privateBytes <= usage.modules.residentBytes);
+
+    // The Faaslet is listed while it's alive
+    auto isListed = [&usage] {
+        std::vector<faaslet::FaasletMemoryUsage> all =
+          faaslet::getFaasletMemoryUsage();
+        return std::any_of(all.begin(), all.end(), [&usage](const auto& f) {
+            return f.faasletId == usage.faasletId;
+        });
+    };
+    REQUIRE(isListed());
+
+    std::vector<faaslet::FunctionMemoryUsage> functions =
+      faaslet::getFunctionMemoryUsage();
+    auto it = std::find_if(functions.begin(), functions.end(), [](auto& f) {
+        return f.user == "demo" && f.function == "echo";
+    });
+    REQUIRE(it != functions.end());
+    REQUIRE(it->nFaaslets == 1);
+    REQUIRE(it->modules.linearMemoryBytes == usage.modules.linearMemoryBytes);
+    REQUIRE(it->snapshotBytes > 0);
+    REQUIRE(it->cachedModuleBytes > 0);
+
+    std::string report = faaslet::dumpMemoryUsage();
+    REQUIRE(report.find("\"id\":" + std::to_string(usage.faasletId)) !=
+            std::string::npos);
+    REQUIRE(report.find("\"function\":\"echo\"") != std::string::npos);
+
+    faaslet->shutdown();
+    faaslet = nullptr;
+    REQUIRE(!isListed());
+}
+}
@@ -0,0 +1,102 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <faabric/snapshot/SnapshotRegistry.h>
+#include <faabric/util/func.h>
+
+#include <conf/FaasmConfig.h>
+#include <faaslet/Faaslet.h>
+#include <wavm/IRModuleCache.h>
+#include <wavm/WAVMWasmModule.h>
+
+namespace tests {
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test parsing prewarm functions",
+                 "[faaslet]")
+{
+    std::vector<std::string> expected;
+
+    SECTION("Empty") { conf.prewarmFunctions = ""; }
+
+    SECTION("Single")
+    {
+        conf.prewarmFunctions = "demo/echo";
+        expected = { "demo/echo" };
+    }
+
+    SECTION("Multiple with invalid")
+    {
+        conf.prewarmFunctions = "demo/echo,,blah,/foo,bar/,demo/hello";
+        expected = { "demo/echo", "demo/hello" };
+    }
+
+    std::vector<faabric::Message> msgs = faaslet::getPrewarmMessages();
+    std::vector<std::string> actual;
+    for (const auto& msg : msgs) {
+        actual.emplace_back(faabric::util::funcToString(msg, false));
+    }
+
+    REQUIRE(actual == expected);
+}
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test prewarming populates WAVM caches",
+                 "[faaslet][wavm]")
+{
+    conf.wasmVm = "wavm";
+    conf.prewarmFunctions = "demo/echo,demo/hello";
+    conf.prewarmThreads = 2;
+
+    faabric::snapshot::SnapshotRegistry& reg =
+      faabric::snapshot::getSnapshotRegistry();
+
+    wasm::IRModuleCache& irCache = wasm::getIRModuleCache();
+    REQUIRE(moduleCache.getTotalCachedModuleCount() == 0);
+    REQUIRE(!irCache.isCompiledModuleCached("demo", "echo", ""));
+    REQUIRE(!reg.snapshotExists("demo/echo_reset"));
+
+    faaslet::startPrewarm();
+    faaslet::waitForPrewarm();
+
+    REQUIRE(moduleCache.getTotalCachedModuleCount() == 2);
+    REQUIRE(irCache.isCompiledModuleCached("demo", "echo", ""));
+    REQUIRE(irCache.isCompiledModuleCached("demo", "hello", ""));
+    REQUIRE(reg.snapshotExists("demo/echo_reset"));
+    REQUIRE(reg.snapshotExists("demo/hello_reset"));
+
+    // A Faaslet created afterwards picks up the prewarmed snapshot
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    faaslet::Faaslet f(msg);
+    REQUIRE(f.getLocalResetSnapshotKey() == "demo/echo_reset");
+    REQUIRE(moduleCache.getTotalCachedModuleCount() == 2);
+    f.shutdown();
+}
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test pre-creating warm Faaslets",
+                 "[faaslet][wavm]")
+{
+    conf.wasmVm = "wavm";
+
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    faabric::Message otherMsg = faabric::util::messageFactory("demo", "hello");
+
+    faaslet::FaasletFactory fac;
+    REQUIRE(fac.getWarmFaasletCount(msg) == 0);
+    REQUIRE(fac.claimWarmFaaslet(msg) == nullptr);
+
+    fac.prewarmFaaslets(msg, 2);
+    REQUIRE(fac.getWarmFaasletCount(msg) == 2);
+    REQUIRE(fac.getWarmFaasletCount(otherMsg) == 0);
+    REQUIRE(fac.claimWarmFaaslet(otherMsg) == nullptr);
+
+    // Warm Faaslets are bound and have their reset snapshot
+    std::shared_ptr<faaslet::Faaslet> f = fac.claimWarmFaaslet(msg);
+    REQUIRE(f != nullptr);
+    REQUIRE(f->getLocalResetSnapshotKey() == "demo/echo_reset");
+    REQUIRE(fac.getWarmFaasletCount(msg) == 1);
+    f->shutdown();
+}
+}
@@ -0,0 +1,102 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+#include "utils.h"
+
+#include <faabric/util/func.h>
+
+#include <conf/FaasmConfig.h>
+#include <faaslet/Faaslet.h>
+
+#include <chrono>
+#include <thread>
+
+namespace tests {
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test Faaslet reset pool swaps in clean modules",
+                 "[faaslet]")
+{
+    SECTION("WAVM") { conf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { conf.wasmVm = "wamr"; }
+
+    conf.resetPoolSize = 2;
+
+    auto req = setUpContext("demo", "echo");
+    faabric::Message& msg = req->mutable_messages()->at(0);
+    msg.set_inputdata("pooled");
+
+    faaslet::Faaslet faaslet(msg);
+    REQUIRE(faaslet.getCleanModuleCount() == 2);
+
+    for (int i = 0; i < 4; i++) {
+        wasm::WasmModule* usedModule = faaslet.module.get();
+        REQUIRE(faaslet.executeTask(0, 0, req) == 0);
+        REQUIRE(msg.outputdata() == "pooled");
+
+        // A clean module must be swapped in rather than resetting in place
+        faaslet.reset(msg);
+        REQUIRE(faaslet.module.get() != usedModule);
+
+        // Wait for the used module to be reset in the background
+        int waitCount = 0;
+        while (faaslet.getCleanModuleCount() < 2 && waitCount < 100) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            waitCount++;
+        }
+        REQUIRE(faaslet.getCleanModuleCount() == 2);
+    }
+
+    faaslet.shutdown();
+    REQUIRE(faaslet.getCleanModuleCount() == 0);
+}
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test Faaslet resets in place with no reset pool",
+                 "[faaslet]")
+{
+    conf.wasmVm = "wavm";
+    conf.resetPoolSize = 0;
+
+    auto req = setUpContext("demo", "echo");
+    faabric::Message& msg = req->mutable_messages()->at(0);
+
+    faaslet::Faaslet faaslet(msg);
+    REQUIRE(faaslet.getCleanModuleCount() == 0);
+
+    wasm::WasmModule* usedModule = faaslet.module.get();
+    REQUIRE(faaslet.executeTask(0, 0, req) == 0);
+    faaslet.reset(msg);
+    REQUIRE(faaslet.module.get() == usedModule);
+
+    faaslet.shutdown();
+}
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test Faaslet resets functions without a batch handler",
+                 "[faaslet]")
+{
+    SECTION("WAVM") { conf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { conf.wasmVm = "wamr"; }
+
+    conf.resetPoolSize = 2;
+    conf.batchResetInterval = 64;
+
+    auto req = setUpContext("demo", "echo");
+    faabric::Message& msg = req->mutable_messages()->at(0);
+
+    faaslet::Faaslet faaslet(msg);
+    REQUIRE(!faaslet.module->hasBatchHandler());
+
+    // Without a handler the instance is never kept, whatever the interval
+    wasm::WasmModule* usedModule = faaslet.module.get();
+    REQUIRE(faaslet.executeTask(0, 0, req) == 0);
+    faaslet.reset(msg);
+    REQUIRE(faaslet.module.get() != usedModule);
+    REQUIRE(faaslet.module->getBatchIndex() == 0);
+
+    faaslet.shutdown();
+}
+}
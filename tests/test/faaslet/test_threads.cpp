@@ -10,6 +10,7 @@
 #include <faabric/util/func.h>
 #include <faabric/util/testing.h>
 
+#include <conf/FaasmConfig.h>
 #include <wavm/WAVMWasmModule.h>
 
 namespace tests {
@@ -19,9 +20,13 @@ class PthreadTestFixture
   , ConfTestFixture
 {
   public:
-    PthreadTestFixture() { conf.overrideCpuCount = nThreads + 2; }
+    PthreadTestFixture()
+      : faasmConf(conf::getFaasmConfig())
+    {
+        conf.overrideCpuCount = nThreads + 2;
+    }
 
-    ~PthreadTestFixture() {}
+    ~PthreadTestFixture() { faasmConf.reset(); }
 
     void runTestLocally(const std::string& function)
     {
@@ -32,16 +37,50 @@ class PthreadTestFixture
     }
 
   protected:
+    conf::FaasmConfig& faasmConf;
     int nThreads = 4;
 };
 
 TEST_CASE_METHOD(PthreadTestFixture, "Test local-only threading", "[threads]")
 {
+    SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
     runTestLocally("threads_local");
 }
 
 TEST_CASE_METHOD(PthreadTestFixture, "Run thread checks locally", "[threads]")
 {
+    SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
+    runTestLocally("threads_check");
+}
+
+TEST_CASE_METHOD(PthreadTestFixture,
+                 "Test dispatching pthreads as they're created",
+                 "[threads]")
+{
+    SECTION("One at a time") { faasmConf.pthreadDispatchBatch = 1; }
+
+    SECTION("In batches") { faasmConf.pthreadDispatchBatch = 2; }
+
     runTestLocally("threads_check");
 }
+
+TEST_CASE_METHOD(PthreadTestFixture,
+                 "Test reusing pthread contexts across calls",
+                 "[threads]")
+{
+    SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
+    // Later calls' threads run in the contexts left by the first's
+    for (int i = 0; i < 3; i++) {
+        runTestLocally("threads_check");
+    }
+}
 }
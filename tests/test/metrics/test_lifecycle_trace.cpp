@@ -0,0 +1,103 @@
+#include <catch2/catch.hpp>
+
+#include <metrics/LifecycleTrace.h>
+
+#include <thread>
+
+using namespace metrics;
+
+namespace tests {
+
+static std::vector<TraceRecord> getTraceForMessage(int32_t msgId)
+{
+    std::vector<TraceRecord> records;
+    for (const auto& r : getLifecycleTrace()) {
+        if (r.msgId == msgId) {
+            records.push_back(r);
+        }
+    }
+
+    return records;
+}
+
+TEST_CASE("Test recording lifecycle trace events", "[metrics]")
+{
+    clearLifecycleTrace();
+    setTraceMessage(1234);
+
+    {
+        TraceScope scope(TraceEvent::Bind);
+    }
+    traceInstant(TraceEvent::StatePull, 100);
+
+    std::vector<TraceRecord> records = getTraceForMessage(1234);
+    REQUIRE(records.size() == 2);
+
+    REQUIRE(records.at(0).event == TraceEvent::Bind);
+    REQUIRE(records.at(0).durationNanos > 0);
+    REQUIRE(records.at(1).event == TraceEvent::StatePull);
+    REQUIRE(records.at(1).durationNanos == 0);
+    REQUIRE(records.at(1).arg == 100);
+    REQUIRE(records.at(0).tid == records.at(1).tid);
+
+    // Events from other threads go in their own rings
+    std::thread t([] {
+        setTraceMessage(1234);
+        traceInstant(TraceEvent::StatePush, 200);
+    });
+    t.join();
+
+    records = getTraceForMessage(1234);
+    REQUIRE(records.size() == 3);
+    REQUIRE(records.at(2).event == TraceEvent::StatePush);
+    REQUIRE(records.at(2).tid != records.at(0).tid);
+
+    clearLifecycleTrace();
+    REQUIRE(getTraceForMessage(1234).empty());
+
+    setTraceMessage(0);
+}
+
+TEST_CASE("Test lifecycle trace ring overwrites oldest", "[metrics]")
+{
+    clearLifecycleTrace();
+    setTraceMessage(5678);
+
+    int nEvents = LIFECYCLE_TRACE_RING_SIZE + 10;
+    for (int i = 0; i < nEvents; i++) {
+        traceInstant(TraceEvent::Reset, i);
+    }
+
+    std::vector<TraceRecord> records = getTraceForMessage(5678);
+    REQUIRE(records.size() == LIFECYCLE_TRACE_RING_SIZE);
+    REQUIRE(records.front().arg == 10);
+    REQUIRE(records.back().arg == nEvents - 1);
+
+    clearLifecycleTrace();
+    setTraceMessage(0);
+}
+
+TEST_CASE("Test dumping lifecycle trace", "[metrics]")
+{
+    clearLifecycleTrace();
+    setTraceMessage(42);
+
+    traceEvent(TraceEvent::ChainedCall, 5000, 2000, 3);
+    traceEvent(TraceEvent::StatePush, 9000, 0, 64);
+
+    std::string json = dumpLifecycleTrace();
+    REQUIRE(json.rfind("{\"traceEvents\":[", 0) == 0);
+    REQUIRE(json.find("\"name\":\"chained-call\"") != std::string::npos);
+    REQUIRE(json.find("\"ts\":5.000,\"ph\":\"X\",\"dur\":2.000") !=
+            std::string::npos);
+    REQUIRE(json.find("\"ts\":9.000,\"ph\":\"i\",\"s\":\"t\"") !=
+            std::string::npos);
+    REQUIRE(json.find("\"args\":{\"msg\":42,\"arg\":64}") !=
+            std::string::npos);
+
+    clearLifecycleTrace();
+    REQUIRE(json.size() > dumpLifecycleTrace().size());
+
+    setTraceMessage(0);
+}
+}
@@ -0,0 +1,90 @@
+#include <catch2/catch.hpp>
+
+#include <metrics/Metrics.h>
+
+using namespace metrics;
+
+namespace tests {
+
+TEST_CASE("Test metrics counters", "[metrics]")
+{
+    Counter& counter = getCounter("test_counter_total", "A test counter");
+    counter.reset();
+
+    counter.inc();
+    counter.inc(4);
+    REQUIRE(counter.get() == 5);
+
+    // The same name gives the same counter
+    REQUIRE(&getCounter("test_counter_total", "Ignored") == &counter);
+
+    std::string rendered = renderMetrics();
+    REQUIRE(rendered.find("# HELP test_counter_total A test counter\n") !=
+            std::string::npos);
+    REQUIRE(rendered.find("# TYPE test_counter_total counter\n") !=
+            std::string::npos);
+    REQUIRE(rendered.find("\ntest_counter_total 5\n") != std::string::npos);
+
+    resetMetrics();
+    REQUIRE(counter.get() == 0);
+}
+
+TEST_CASE("Test metrics histograms", "[metrics]")
+{
+    Histogram& histogram =
+      getHistogram("test_histogram_seconds", "A test histogram", { 10, 100 });
+    histogram.reset();
+
+    histogram.observe(5);
+    histogram.observe(10);
+    histogram.observe(50);
+    histogram.observe(1000);
+
+    REQUIRE(histogram.getBucketCounts() == std::vector<uint64_t>{ 2, 1, 1 });
+    REQUIRE(histogram.getCount() == 4);
+    REQUIRE(histogram.getSumMicros() == 1065);
+
+    // Buckets are cumulative and in seconds
+    std::string rendered = renderMetrics();
+    REQUIRE(rendered.find("test_histogram_seconds_bucket{le=\"1e-05\"} 2\n") !=
+            std::string::npos);
+    REQUIRE(rendered.find("test_histogram_seconds_bucket{le=\"0.0001\"} 3\n") !=
+            std::string::npos);
+    REQUIRE(rendered.find("test_histogram_seconds_bucket{le=\"+Inf\"} 4\n") !=
+            std::string::npos);
+    REQUIRE(rendered.find("test_histogram_seconds_count 4\n") !=
+            std::string::npos);
+
+    REQUIRE_THROWS(getHistogram("test_unsorted_seconds", "", { 100, 10 }));
+}
+
+TEST_CASE("Test metrics callbacks", "[metrics]")
+{
+    static double value;
+    value = 3;
+    registerGauge("test_gauge", "A test gauge", [&value] { return value; });
+    registerCounterCallback(
+      "test_callback_total", "A test callback", [] { return 7; });
+
+    std::string rendered = renderMetrics();
+    REQUIRE(rendered.find("# TYPE test_gauge gauge\n") != std::string::npos);
+    REQUIRE(rendered.find("\ntest_gauge 3\n") != std::string::npos);
+    REQUIRE(rendered.find("# TYPE test_callback_total counter\n") !=
+            std::string::npos);
+    REQUIRE(rendered.find("\ntest_callback_total 7\n") != std::string::npos);
+
+    // Gauges are read every time they're rendered
+    value = 4.5;
+    REQUIRE(renderMetrics().find("\ntest_gauge 4.5\n") != std::string::npos);
+
+    // Names can't be reused for another type
+    REQUIRE_THROWS(getCounter("test_gauge", ""));
+    REQUIRE_THROWS(getCounter("test_callback_total", ""));
+
+    removeCallback("test_gauge");
+    removeCallback("test_callback_total");
+    rendered = renderMetrics();
+    REQUIRE(rendered.find("test_gauge") == std::string::npos);
+    REQUIRE(rendered.find("test_callback_total") == std::string::npos);
+}
+}
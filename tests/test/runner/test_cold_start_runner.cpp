@@ -0,0 +1,125 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <string>
+
+#include <conf/FaasmConfig.h>
+#include <runner/ColdStartRunner.h>
+
+#include <faabric/util/files.h>
+
+using namespace runner;
+
+namespace tests {
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test cold start runner conditions",
+                 "[runner]")
+{
+    std::string wasmVm;
+    SECTION("WAVM") { wasmVm = "wavm"; }
+
+    SECTION("WAMR") { wasmVm = "wamr"; }
+
+    ColdStartCondition condition;
+    std::string expectedCondition;
+    SECTION("Cold")
+    {
+        condition = ColdStartCondition::Cold;
+        expectedCondition = "cold";
+    }
+
+    SECTION("Artefact")
+    {
+        condition = ColdStartCondition::Artefact;
+        expectedCondition = "artefact";
+    }
+
+    SECTION("Module")
+    {
+        condition = ColdStartCondition::Module;
+        expectedCondition = "module";
+    }
+
+    SECTION("Pooled")
+    {
+        condition = ColdStartCondition::Pooled;
+        expectedCondition = "pooled";
+    }
+
+    bool flush = false;
+    SECTION("No flush") { flush = false; }
+
+    SECTION("Flush") { flush = true; }
+
+    std::string originalVm = conf::getFaasmConfig().wasmVm;
+
+    std::vector<ColdStartResult> results = ColdStartRunner::doRun(
+      "demo", "echo", "blah", wasmVm, condition, 2, flush);
+
+    // The VM is only overridden for the run
+    REQUIRE(conf::getFaasmConfig().wasmVm == originalVm);
+
+    REQUIRE(results.size() == 2);
+    for (int i = 0; i < 2; i++) {
+        const ColdStartResult& result = results.at(i);
+        REQUIRE(result.run == i);
+        REQUIRE(result.returnValue == 0);
+        REQUIRE(result.latencyMicros > 0);
+        REQUIRE(result.executeMicros > 0);
+        REQUIRE(result.wasmVm == wasmVm);
+
+        // Pooled Faaslets have already been created
+        if (condition == ColdStartCondition::Pooled) {
+            REQUIRE(result.initMicros == 0);
+        } else {
+            REQUIRE(result.initMicros > 0);
+        }
+
+        std::string json = result.toJson();
+        REQUIRE(json.find("\"condition\":\"" + expectedCondition + "\"") !=
+                std::string::npos);
+        REQUIRE(json.find("\"wasm_vm\":\"" + wasmVm + "\"") !=
+                std::string::npos);
+    }
+}
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test cold start runner output",
+                 "[runner]")
+{
+    std::string specFile = "/tmp/cold_start_in.csv";
+    std::string outFile = "/tmp/cold_start_out.json";
+
+    std::ofstream specFs;
+    specFs.open(specFile);
+    specFs << "demo,echo,2,blah" << std::endl;
+    specFs.close();
+
+    int returnValue = ColdStartRunner::execute(specFile, outFile, false);
+    REQUIRE(returnValue == 0);
+
+    std::string output = faabric::util::readFileToString(outFile);
+    std::vector<std::string> lines;
+    boost::split(lines, output, [](char c) { return c == '\n'; });
+
+    // Two runs of each condition on each VM, plus the trailing newline
+    size_t nVms = ColdStartRunner::getWasmVms().size();
+    REQUIRE(lines.size() == nVms * 4 * 2 + 1);
+    REQUIRE(lines.back().empty());
+
+    for (size_t i = 0; i < lines.size() - 1; i++) {
+        REQUIRE(lines.at(i).front() == '{');
+        REQUIRE(lines.at(i).back() == '}');
+        REQUIRE(lines.at(i).find("\"function\":\"echo\"") !=
+                std::string::npos);
+    }
+
+    boost::filesystem::remove(specFile);
+    boost::filesystem::remove(outFile);
+}
+}
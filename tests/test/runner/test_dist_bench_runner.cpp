@@ -0,0 +1,79 @@
+#include <catch2/catch.hpp>
+
+#include <sstream>
+#include <string>
+
+#include <runner/DistBenchRunner.h>
+
+using namespace runner;
+
+namespace tests {
+
+TEST_CASE("Test parsing dist bench specs", "[runner]")
+{
+    std::stringstream specStream;
+    specStream << "# Scaling" << std::endl
+               << "hosts=10.0.0.2 10.0.0.3,threads=1 2 4,repeats=5"
+               << std::endl
+               << "omp,stream,strong,1000000" << std::endl
+               << std::endl
+               << "mpi,allreduce,weak,1024" << std::endl;
+
+    DistBenchSpec spec = DistBenchRunner::parseSpec(specStream);
+    REQUIRE(spec.hosts ==
+            std::vector<std::string>({ "10.0.0.2", "10.0.0.3" }));
+    REQUIRE(spec.threads == std::vector<int>({ 1, 2, 4 }));
+    REQUIRE(spec.repeats == 5);
+
+    REQUIRE(spec.kernels.size() == 2);
+    REQUIRE(spec.kernels.at(0).user == "omp");
+    REQUIRE(spec.kernels.at(0).function == "stream");
+    REQUIRE(spec.kernels.at(0).scaling == DistBenchScaling::Strong);
+    REQUIRE(spec.kernels.at(0).size == 1000000);
+    REQUIRE(spec.kernels.at(1).scaling == DistBenchScaling::Weak);
+
+    // Settings can be left out
+    std::stringstream defaultStream("repeats=1\nomp,stencil,strong,10");
+    DistBenchSpec defaultSpec = DistBenchRunner::parseSpec(defaultStream);
+    REQUIRE(defaultSpec.hosts.empty());
+    REQUIRE(defaultSpec.threads == std::vector<int>({ 1 }));
+
+    std::string invalidSpec;
+    SECTION("Unknown setting") { invalidSpec = "foo=1\nomp,stream,weak,1"; }
+
+    SECTION("Bad scaling") { invalidSpec = "repeats=1\nomp,stream,fast,1"; }
+
+    SECTION("No threads") { invalidSpec = "threads=0\nomp,stream,weak,1"; }
+
+    SECTION("No kernels") { invalidSpec = "repeats=1"; }
+
+    std::stringstream invalidStream(invalidSpec);
+    REQUIRE_THROWS(DistBenchRunner::parseSpec(invalidStream));
+}
+
+TEST_CASE("Test dist bench efficiency", "[runner]")
+{
+    // Four times the parallelism at twice the speed is half as efficient
+    REQUIRE(DistBenchRunner::getEfficiency(
+              DistBenchScaling::Strong, 1000, 1, 500, 4) == 0.5);
+
+    // Weak scaling only compares the times
+    REQUIRE(DistBenchRunner::getEfficiency(
+              DistBenchScaling::Weak, 1000, 1, 1250, 4) == 0.8);
+
+    REQUIRE(DistBenchRunner::getEfficiency(
+              DistBenchScaling::Strong, 1000, 1, 0, 4) == 0);
+}
+
+TEST_CASE("Test dist bench kernel input", "[runner]")
+{
+    DistBenchKernel kernel;
+    kernel.size = 100;
+
+    kernel.scaling = DistBenchScaling::Strong;
+    REQUIRE(DistBenchRunner::getKernelInput(kernel, 4) == "100 4");
+
+    kernel.scaling = DistBenchScaling::Weak;
+    REQUIRE(DistBenchRunner::getKernelInput(kernel, 4) == "400 4");
+}
+}
@@ -0,0 +1,101 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <runner/HostInterfaceRunner.h>
+
+#include <faabric/util/files.h>
+
+using namespace runner;
+
+namespace tests {
+
+TEST_CASE("Test parsing host interface bench specs", "[runner]")
+{
+    std::stringstream specStream;
+    specStream << "# State reads" << std::endl
+               << "demo,state_read,1000,64 4096,1 4" << std::endl
+               << std::endl
+               << "mpi,send,50,8,2" << std::endl;
+
+    std::vector<HostInterfaceBench> benches =
+      HostInterfaceRunner::parseSpec(specStream);
+
+    REQUIRE(benches.size() == 2);
+    REQUIRE(benches.at(0).user == "demo");
+    REQUIRE(benches.at(0).function == "state_read");
+    REQUIRE(benches.at(0).iterations == 1000);
+    REQUIRE(benches.at(0).sizes == std::vector<int>({ 64, 4096 }));
+    REQUIRE(benches.at(0).threads == std::vector<int>({ 1, 4 }));
+    REQUIRE(benches.at(1).user == "mpi");
+    REQUIRE(benches.at(1).sizes == std::vector<int>({ 8 }));
+    REQUIRE(benches.at(1).threads == std::vector<int>({ 2 }));
+
+    std::string invalidSpec;
+    SECTION("Missing threads") { invalidSpec = "demo,echo,10,1"; }
+
+    SECTION("No iterations") { invalidSpec = "demo,echo,0,1,1"; }
+
+    SECTION("No sizes") { invalidSpec = "demo,echo,10,,1"; }
+
+    SECTION("Negative threads") { invalidSpec = "demo,echo,10,1,-2"; }
+
+    std::stringstream invalidStream(invalidSpec);
+    REQUIRE_THROWS(HostInterfaceRunner::parseSpec(invalidStream));
+}
+
+TEST_CASE("Test host interface bench results", "[runner]")
+{
+    // A thousand calls on each of two threads taking 500us
+    HostInterfaceResult result =
+      HostInterfaceRunner::getResult(100, 600, 1000, 2);
+    REQUIRE(result.nanosPerCall == 500);
+    REQUIRE(result.callsPerSec == 4000000);
+
+    // Calls too cheap to measure
+    HostInterfaceResult cheap = HostInterfaceRunner::getResult(600, 550, 10, 1);
+    REQUIRE(cheap.nanosPerCall == 0);
+    REQUIRE(cheap.callsPerSec == 0);
+
+    REQUIRE(HostInterfaceRunner::getBenchInput(10, 64, 4) == "10 64 4");
+}
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test host interface runner",
+                 "[runner]")
+{
+    std::string specFile = "/tmp/host_interface_in.csv";
+    std::string outFile = "/tmp/host_interface_out.csv";
+
+    // Echo ignores the iterations, but still exercises the runner
+    std::ofstream specFs;
+    specFs.open(specFile);
+    specFs << "demo,echo,10,1 2,1" << std::endl;
+    specFs.close();
+
+    REQUIRE(HostInterfaceRunner::execute(specFile, outFile) == 0);
+
+    std::string output = faabric::util::readFileToString(outFile);
+    std::vector<std::string> lines;
+    boost::split(lines, output, [](char c) { return c == '\n'; });
+
+    // Header, then each size on each VM, then the trailing newline
+    REQUIRE(lines.size() == 6);
+    REQUIRE(lines.at(0) == "User,Function,Wasm VM,Size,Threads,Iterations,"
+                           "Call (ns),Calls/s");
+    REQUIRE(boost::starts_with(lines.at(1), "demo,echo,wavm,1,1,10,"));
+    REQUIRE(boost::starts_with(lines.at(2), "demo,echo,wavm,2,1,10,"));
+    REQUIRE(boost::starts_with(lines.at(3), "demo,echo,wamr,1,1,10,"));
+    REQUIRE(boost::starts_with(lines.at(4), "demo,echo,wamr,2,1,10,"));
+    REQUIRE(lines.at(5).empty());
+
+    boost::filesystem::remove(specFile);
+    boost::filesystem::remove(outFile);
+}
+}
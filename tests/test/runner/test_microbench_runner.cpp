@@ -6,12 +6,14 @@
 #include <boost/filesystem.hpp>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
 
 #include <runner/MicrobenchRunner.h>
 
 #include <faabric/util/config.h>
 #include <faabric/util/files.h>
+#include <faabric/util/func.h>
 
 using namespace faabric::util;
 using namespace runner;
@@ -25,13 +27,30 @@ void checkLine(const std::string& line,
     std::vector<std::string> lineParts;
     boost::split(lineParts, line, [](char c) { return c == ','; });
 
-    REQUIRE(lineParts.size() == 4);
+    REQUIRE(lineParts.size() == 15);
     REQUIRE(lineParts[0] == user);
     REQUIRE(lineParts[1] == function);
     REQUIRE(lineParts[2] == "0");
 
     float runTime = std::stof(lineParts[3]);
     REQUIRE(runTime > 0);
+
+    // Phases can't add up to more than the whole call, and the function's
+    // execution always takes some time
+    float phaseTotal = 0;
+    for (int i = 4; i < 10; i++) {
+        float phaseTime = std::stof(lineParts[i]);
+        REQUIRE(phaseTime >= 0);
+        phaseTotal += phaseTime;
+    }
+
+    REQUIRE(std::stof(lineParts[7]) > 0);
+    REQUIRE(phaseTotal <= runTime + 1000);
+
+    // Perf counters aren't collected by default
+    for (int i = 10; i < 15; i++) {
+        REQUIRE(lineParts[i].empty());
+    }
 }
 
 TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
@@ -67,7 +86,11 @@ TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
 
     REQUIRE(lines.size() == 14);
 
-    REQUIRE(lines.at(0) == "User,Function,Return value,Execution (us)");
+    REQUIRE(lines.at(0) ==
+            "User,Function,Return value,Execution (us),Dispatch (us),"
+            "Faaslet init (us),Isolation (us),Execute (us),Reset (us),"
+            "Result (us),Instructions,Cycles,LLC misses,dTLB misses,"
+            "Context switches");
 
     for (int i = 1; i < 5; i++) {
         checkLine(lines.at(i), "demo", "echo");
@@ -87,4 +110,193 @@ TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
 
     REQUIRE(lines.at(13).empty());
 }
+
+TEST_CASE("Test microbench perf columns", "[runner]")
+{
+    faabric::Message res = faabric::util::messageFactory("demo", "echo");
+    REQUIRE(MicrobenchRunner::getPerfColumns(res) == ",,,,");
+
+    auto& details = *res.mutable_execgraphdetails();
+    details["perf-instructions"] = "1000";
+    details["perf-cycles"] = "2000";
+    details["perf-context-switches"] = "3";
+
+    REQUIRE(MicrobenchRunner::getPerfColumns(res) == "1000,2000,,,3");
+}
+
+TEST_CASE("Test parsing microbench load specs", "[runner]")
+{
+    std::stringstream specStream;
+    specStream << "# Mixed load" << std::endl
+               << "rate=250,duration=20,warmup=5,concurrency=8,"
+                  "arrival=constant,seed=3,local=on"
+               << std::endl
+               << "demo,echo,3,blah" << std::endl
+               << std::endl
+               << "demo,hello,1" << std::endl;
+
+    LoadSpec spec = MicrobenchRunner::parseLoadSpec(specStream);
+    REQUIRE(spec.rate == 250);
+    REQUIRE(spec.durationSecs == 20);
+    REQUIRE(spec.warmupSecs == 5);
+    REQUIRE(spec.concurrency == 8);
+    REQUIRE(spec.arrival == LoadArrivalProcess::Constant);
+    REQUIRE(spec.seed == 3);
+    REQUIRE(spec.forceLocal);
+
+    REQUIRE(spec.functions.size() == 2);
+    REQUIRE(spec.functions.at(0).user == "demo");
+    REQUIRE(spec.functions.at(0).function == "echo");
+    REQUIRE(spec.functions.at(0).weight == 3);
+    REQUIRE(spec.functions.at(0).inputData == "blah");
+    REQUIRE(spec.functions.at(1).function == "hello");
+    REQUIRE(spec.functions.at(1).inputData.empty());
+
+    std::string invalidSpec;
+    SECTION("Unknown setting") { invalidSpec = "rate=1,foo=2\ndemo,echo,1"; }
+
+    SECTION("Bad arrival") { invalidSpec = "arrival=bursty\ndemo,echo,1"; }
+
+    SECTION("No functions") { invalidSpec = "rate=1"; }
+
+    SECTION("Zero weight") { invalidSpec = "rate=1\ndemo,echo,0"; }
+
+    SECTION("Zero concurrency")
+    {
+        invalidSpec = "concurrency=0\ndemo,echo,1";
+    }
+
+    std::stringstream invalidStream(invalidSpec);
+    REQUIRE_THROWS(MicrobenchRunner::parseLoadSpec(invalidStream));
+}
+
+TEST_CASE("Test microbench load schedules", "[runner]")
+{
+    LoadSpec spec;
+    spec.rate = 100;
+    spec.durationSecs = 8;
+    spec.warmupSecs = 2;
+    spec.seed = 123;
+    spec.functions = { { "demo", "echo", "", 3 }, { "demo", "hello", "", 1 } };
+
+    SECTION("Constant")
+    {
+        spec.arrival = LoadArrivalProcess::Constant;
+        std::vector<LoadArrival> schedule =
+          MicrobenchRunner::getLoadSchedule(spec);
+
+        REQUIRE(schedule.size() == 1000);
+        for (size_t i = 0; i < schedule.size(); i++) {
+            REQUIRE(schedule.at(i).offsetNanos == i * 10000000L);
+        }
+    }
+
+    SECTION("Poisson")
+    {
+        spec.arrival = LoadArrivalProcess::Poisson;
+        std::vector<LoadArrival> schedule =
+          MicrobenchRunner::getLoadSchedule(spec);
+
+        // Roughly the right number, in order, within the run
+        REQUIRE(schedule.size() > 850);
+        REQUIRE(schedule.size() < 1150);
+        for (size_t i = 1; i < schedule.size(); i++) {
+            REQUIRE(schedule.at(i).offsetNanos >=
+                    schedule.at(i - 1).offsetNanos);
+        }
+        REQUIRE(schedule.back().offsetNanos < 10000000000L);
+
+        // The same seed gives the same schedule
+        std::vector<LoadArrival> repeat =
+          MicrobenchRunner::getLoadSchedule(spec);
+        REQUIRE(repeat.size() == schedule.size());
+        REQUIRE(repeat.back().offsetNanos == schedule.back().offsetNanos);
+    }
+
+    // Functions are mixed by weight
+    std::vector<LoadArrival> schedule = MicrobenchRunner::getLoadSchedule(spec);
+    int nEcho = 0;
+    for (const auto& arrival : schedule) {
+        nEcho += arrival.functionIdx == 0;
+    }
+
+    float echoShare = float(nEcho) / schedule.size();
+    REQUIRE(echoShare > 0.65);
+    REQUIRE(echoShare < 0.85);
+}
+
+TEST_CASE("Test microbench percentiles", "[runner]")
+{
+    std::vector<float> values;
+    for (int i = 1; i <= 1000; i++) {
+        values.push_back(i);
+    }
+
+    REQUIRE(MicrobenchRunner::getPercentile(values, 50) == 500);
+    REQUIRE(MicrobenchRunner::getPercentile(values, 90) == 900);
+    REQUIRE(MicrobenchRunner::getPercentile(values, 99) == 990);
+    REQUIRE(MicrobenchRunner::getPercentile(values, 99.9) == 999);
+    REQUIRE(MicrobenchRunner::getPercentile(values, 100) == 1000);
+    REQUIRE(MicrobenchRunner::getPercentile(values, 0) == 1);
+
+    REQUIRE(MicrobenchRunner::getPercentile({}, 50) == 0);
+}
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test microbench runner under open-loop load",
+                 "[runner]")
+{
+    std::string specFile = "/tmp/microbench_load_in.csv";
+    std::ofstream specFs;
+    specFs.open(specFile);
+    specFs << "rate=20,duration=1,warmup=1,concurrency=4,seed=1" << std::endl;
+    specFs << "demo,echo,1,blah" << std::endl;
+    specFs << "demo,hello,1" << std::endl;
+    specFs.close();
+
+    std::string outFile = "/tmp/microbench_load_out.csv";
+    int returnValue = MicrobenchRunner::executeLoad(specFile, outFile);
+    REQUIRE(returnValue == 0);
+
+    std::string result = faabric::util::readFileToString(outFile);
+    std::vector<std::string> lines;
+    boost::split(lines, result, [](char c) { return c == '\n'; });
+
+    // Header, one line per function, the total, and a trailing newline
+    REQUIRE(lines.size() == 5);
+    REQUIRE(lines.at(0) == "User,Function,Requests,Failures,"
+                           "Throughput (req/s),p50 (us),p90 (us),p99 (us),"
+                           "p99.9 (us)");
+
+    std::vector<std::string> expectedFuncs = { "echo", "hello", "all" };
+    int totalRequests = 0;
+    for (int i = 0; i < 3; i++) {
+        std::vector<std::string> lineParts;
+        boost::split(
+          lineParts, lines.at(i + 1), [](char c) { return c == ','; });
+
+        REQUIRE(lineParts.size() == 9);
+        REQUIRE(lineParts.at(1) == expectedFuncs.at(i));
+        REQUIRE(lineParts.at(3) == "0");
+
+        int nRequests = std::stoi(lineParts.at(2));
+        if (i < 2) {
+            totalRequests += nRequests;
+        } else {
+            REQUIRE(nRequests == totalRequests);
+        }
+
+        // Percentiles never go down
+        if (nRequests > 0) {
+            REQUIRE(std::stof(lineParts.at(4)) > 0);
+            for (int p = 5; p < 8; p++) {
+                REQUIRE(std::stof(lineParts.at(p)) <=
+                        std::stof(lineParts.at(p + 1)));
+            }
+        }
+    }
+
+    REQUIRE(totalRequests > 0);
+    REQUIRE(lines.at(4).empty());
+}
 }
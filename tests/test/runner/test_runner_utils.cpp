@@ -0,0 +1,107 @@
+#include <catch2/catch.hpp>
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <runner/runner_utils.h>
+
+using namespace runner;
+
+namespace tests {
+
+static po::variables_map parseArgs(std::vector<std::string> args)
+{
+    std::vector<char*> argv = { (char*)"runner" };
+    for (auto& arg : args) {
+        argv.push_back(arg.data());
+    }
+
+    return parseRunnerCmdLine(argv.size(), argv.data());
+}
+
+TEST_CASE("Test reading batch inputs", "[runner]")
+{
+    std::stringstream inputStream("foo\n\nbar baz  \nqux\n");
+    std::vector<std::string> inputs = readBatchInputs(inputStream);
+    REQUIRE(inputs == std::vector<std::string>({ "foo", "bar baz", "qux" }));
+}
+
+TEST_CASE("Test creating runner batches", "[runner]")
+{
+    std::string inputFile = "/tmp/runner_batch_inputs.txt";
+    std::ofstream inFs(inputFile);
+    inFs << "a" << std::endl << "b" << std::endl << "c" << std::endl;
+    inFs.close();
+
+    SECTION("Single message")
+    {
+        auto vm = parseArgs({ "demo", "echo", "--input-data", "hi" });
+        auto req = createRunnerBatch(vm);
+        REQUIRE(req->messages_size() == 1);
+        REQUIRE(req->messages().at(0).inputdata() == "hi");
+    }
+
+    SECTION("Batch with the same input")
+    {
+        auto vm = parseArgs(
+          { "demo", "echo", "--input-data", "hi", "--batch-size", "4" });
+        auto req = createRunnerBatch(vm);
+        REQUIRE(req->messages_size() == 4);
+
+        for (const auto& msg : req->messages()) {
+            REQUIRE(msg.user() == "demo");
+            REQUIRE(msg.function() == "echo");
+            REQUIRE(msg.inputdata() == "hi");
+        }
+    }
+
+    SECTION("Batch with inputs from a file")
+    {
+        auto vm = parseArgs({ "demo",
+                              "echo",
+                              "--input-file",
+                              inputFile,
+                              "--batch-size",
+                              "5",
+                              "--cmdline",
+                              "x y" });
+        auto req = createRunnerBatch(vm);
+        REQUIRE(req->messages_size() == 5);
+
+        std::vector<std::string> expected = { "a", "b", "c", "a", "b" };
+        for (int i = 0; i < 5; i++) {
+            REQUIRE(req->messages().at(i).inputdata() == expected.at(i));
+            REQUIRE(req->messages().at(i).cmdline() == "x y");
+        }
+    }
+
+    SECTION("Python batch")
+    {
+        auto vm = parseArgs({ "python", "hello", "--batch-size", "2" });
+        auto req = createRunnerBatch(vm);
+        REQUIRE(req->messages_size() == 2);
+
+        for (const auto& msg : req->messages()) {
+            REQUIRE(msg.ispython());
+            REQUIRE(msg.pythonfunction() == "hello");
+        }
+    }
+
+    SECTION("Invalid batch size")
+    {
+        auto vm = parseArgs({ "demo", "echo", "--batch-size", "0" });
+        REQUIRE_THROWS(createRunnerBatch(vm));
+    }
+
+    SECTION("Missing input file")
+    {
+        auto vm = parseArgs({ "demo", "echo", "--input-file", "/tmp/nope" });
+        REQUIRE_THROWS(createRunnerBatch(vm));
+    }
+
+    boost::filesystem::remove(inputFile);
+}
+}
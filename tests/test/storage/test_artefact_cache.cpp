@@ -0,0 +1,123 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <faabric/util/files.h>
+
+#include <storage/ArtefactCache.h>
+
+#include <filesystem>
+#include <sys/stat.h>
+
+using namespace storage;
+
+namespace tests {
+
+class ArtefactCacheTestFixture : public FaasmConfTestFixture
+{
+  public:
+    ArtefactCacheTestFixture()
+      : cache(getArtefactCache())
+    {
+        conf.artefactCacheDir = "/tmp/faasm_artefact_cache";
+        cache.clear();
+        std::filesystem::create_directories(filesDir);
+    }
+
+    ~ArtefactCacheTestFixture()
+    {
+        conf.reset();
+        cache.clear();
+        std::filesystem::remove_all(filesDir);
+    }
+
+  protected:
+    ArtefactCache& cache;
+    const std::string filesDir = "/tmp/faasm_artefact_files";
+
+    // Downloads the blob, as the file loader would
+    void insert(const std::string& hash,
+                const std::vector<uint8_t>& bytes,
+                const std::string& path,
+                bool copy = false)
+    {
+        std::string downloadPath = cache.getDownloadPath(hash);
+        faabric::util::writeBytesToFile(downloadPath, bytes);
+        cache.insert(hash, downloadPath, path, copy);
+    }
+};
+
+static nlink_t getLinkCount(const std::string& path)
+{
+    struct stat s;
+    REQUIRE(stat(path.c_str(), &s) == 0);
+    return s.st_nlink;
+}
+
+TEST_CASE_METHOD(ArtefactCacheTestFixture,
+                 "Test artefact cache deduplicates by hash",
+                 "[storage]")
+{
+    std::vector<uint8_t> bytes = { 1, 2, 3, 4, 5 };
+    std::string pathA = filesDir + "/a.wasm";
+    std::string pathB = filesDir + "/b.wasm";
+
+    REQUIRE(!cache.fetch("abc", pathA, false));
+    insert("abc", bytes, pathA);
+    REQUIRE(faabric::util::readFileToBytes(pathA) == bytes);
+
+    // The second user's identical file is a link to the same blob
+    REQUIRE(cache.fetch("abc", pathB, false));
+    REQUIRE(faabric::util::readFileToBytes(pathB) == bytes);
+    REQUIRE(getLinkCount(pathA) == 3);
+
+    // Copies are separate files
+    std::string pathC = filesDir + "/c.txt";
+    REQUIRE(cache.fetch("abc", pathC, true));
+    REQUIRE(getLinkCount(pathC) == 1);
+    REQUIRE(faabric::util::readFileToBytes(pathC) == bytes);
+
+    cache.touch(pathA);
+
+    ArtefactCacheStats stats = cache.getStats();
+    REQUIRE(stats.nBlobs == 1);
+    REQUIRE(stats.bytes == bytes.size());
+    REQUIRE(stats.misses == 1);
+    REQUIRE(stats.hits == 3);
+    REQUIRE(stats.evictions == 0);
+
+    // Blobs outlive the files made from them
+    std::filesystem::remove(pathA);
+    cache.forgetPaths();
+    REQUIRE(cache.fetch("abc", pathA, false));
+    REQUIRE(faabric::util::readFileToBytes(pathA) == bytes);
+}
+
+TEST_CASE_METHOD(ArtefactCacheTestFixture,
+                 "Test artefact cache evicts least recently used",
+                 "[storage]")
+{
+    conf.artefactCacheBudgetMb = 1;
+    std::vector<uint8_t> bytes(400 * 1024, 7);
+
+    std::string pathA = filesDir + "/a.o";
+    std::string pathB = filesDir + "/b.o";
+    std::string pathC = filesDir + "/c.o";
+    insert("aaa", bytes, pathA);
+    insert("bbb", bytes, pathB);
+
+    // Use the first, so the second is the one to go
+    cache.touch(pathA);
+    insert("ccc", bytes, pathC);
+
+    ArtefactCacheStats stats = cache.getStats();
+    REQUIRE(stats.nBlobs == 2);
+    REQUIRE(stats.evictions == 1);
+    REQUIRE(stats.bytes == 2 * bytes.size());
+
+    REQUIRE(std::filesystem::exists(pathA));
+    REQUIRE(!std::filesystem::exists(pathB));
+    REQUIRE(std::filesystem::exists(pathC));
+    REQUIRE(!cache.fetch("bbb", pathB, false));
+}
+}
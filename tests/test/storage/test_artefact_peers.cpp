@@ -0,0 +1,65 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+#include "fixtures.h"
+
+#include <faabric/state/State.h>
+#include <faabric/util/config.h>
+#include <faabric/util/files.h>
+
+#include <storage/ArtefactPeers.h>
+
+#include <filesystem>
+
+using namespace storage;
+
+namespace tests {
+
+class ArtefactPeersTestFixture
+  : public StateTestFixture
+  , public FaasmConfTestFixture
+{
+  public:
+    ArtefactPeersTestFixture()
+      : sysConf(faabric::util::getSystemConfig())
+    {
+        conf.artefactPeerFetch = "on";
+        sysConf.stateMode = "inmemory";
+    }
+
+    ~ArtefactPeersTestFixture()
+    {
+        sysConf.reset();
+        std::filesystem::remove(filePath);
+    }
+
+  protected:
+    faabric::util::SystemConfig& sysConf;
+    const std::string filePath = "/tmp/faasm_artefact_peer";
+};
+
+TEST_CASE_METHOD(ArtefactPeersTestFixture,
+                 "Test sharing artefacts with peers",
+                 "[storage]")
+{
+    REQUIRE(isArtefactPeerFetchEnabled());
+
+    std::vector<uint8_t> bytes = { 9, 8, 7, 6 };
+    faabric::util::writeBytesToFile(filePath, bytes);
+
+    // Nobody has it to start with, then this host does
+    REQUIRE(!fetchArtefactFromPeer("abc123", filePath));
+    shareArtefactWithPeers("abc123", filePath);
+
+    auto kv = faabric::state::getGlobalState().getKV(
+      ARTEFACT_PEERS_STATE_USER, "abc123", bytes.size());
+    std::vector<uint8_t> actual(kv->get(), kv->get() + bytes.size());
+    REQUIRE(actual == bytes);
+
+    // We don't fetch from ourselves
+    REQUIRE(!fetchArtefactFromPeer("abc123", filePath));
+
+    conf.artefactPeerFetch = "off";
+    REQUIRE(!isArtefactPeerFetchEnabled());
+}
+}
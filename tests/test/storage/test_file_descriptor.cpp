@@ -11,8 +11,10 @@
 #include <storage/SharedFiles.h>
 
 #include <WAVM/WASI/WASIABI.h>
+#include <algorithm>
 #include <boost/filesystem.hpp>
 #include <string_view>
+#include <unistd.h>
 
 using namespace storage;
 
@@ -295,6 +297,119 @@ TEST_CASE_METHOD(FileDescriptorTestFixture,
     REQUIRE(actualContents == contents);
 }
 
+TEST_CASE_METHOD(FileDescriptorTestFixture,
+                 "Test serving shared files from a bundle",
+                 "[storage]")
+{
+    FileDescriptor& rootFileDesc = fs.getFileDescriptor(DEFAULT_ROOT_FD);
+    storage::FileLoader& loader = storage::getFileLoader();
+
+    std::vector<uint8_t> contents = { 0, 1, 2, 3, 4, 5 };
+    std::string bundleDir = "test/bundled";
+    loader.uploadSharedFile(
+      bundleDir + "/" + SHARED_BUNDLE_NAME,
+      buildSharedBundle({ { "pkg/mod.py", contents } }));
+
+    std::string localDir = loader.getSharedFileFile(bundleDir);
+    boost::filesystem::remove_all(localDir);
+    loader.clearLocalCache();
+
+    std::string sharedDir =
+      std::string(SHARED_FILE_PREFIX) + bundleDir + "/pkg";
+    std::string sharedPath = sharedDir + "/mod.py";
+
+    // Stat the file and its directory
+    const Stat& statRes = rootFileDesc.stat(sharedPath);
+    REQUIRE(!statRes.failed);
+    REQUIRE(statRes.wasiFiletype == __WASI_FILETYPE_REGULAR_FILE);
+    REQUIRE(statRes.st_size == contents.size());
+
+    const Stat& dirStatRes = rootFileDesc.stat(sharedDir);
+    REQUIRE(!dirStatRes.failed);
+    REQUIRE(dirStatRes.wasiFiletype == __WASI_FILETYPE_DIRECTORY);
+
+    REQUIRE(rootFileDesc.stat(sharedDir + "/missing.py").failed);
+
+    // List the directory
+    int dirFd = fs.openFileDescriptor(
+      DEFAULT_ROOT_FD, sharedDir, 0, 0, 0, __WASI_O_DIRECTORY, 0);
+    REQUIRE(dirFd > 0);
+
+    FileDescriptor& dirFileDesc = fs.getFileDescriptor(dirFd);
+    std::vector<std::string> names;
+    while (!dirFileDesc.iterFinished()) {
+        names.push_back(dirFileDesc.iterNext().path);
+    }
+    REQUIRE(std::find(names.begin(), names.end(), "mod.py") != names.end());
+
+    // Read the file, which is never written to disk
+    int fileFd = fs.openFileDescriptor(
+      DEFAULT_ROOT_FD, sharedPath, __WASI_RIGHT_FD_READ, 0, 0, 0, 0);
+    REQUIRE(fileFd > 0);
+
+    FileDescriptor& fileDesc = fs.getFileDescriptor(fileFd);
+    std::vector<uint8_t> actual(contents.size(), 0);
+    REQUIRE(::read(fileDesc.getLinuxFd(), actual.data(), actual.size()) ==
+            (ssize_t)contents.size());
+    REQUIRE(actual == contents);
+
+    REQUIRE(!boost::filesystem::exists(
+      storage::SharedFiles::realPathForSharedFile(sharedPath)));
+}
+
+TEST_CASE_METHOD(FileDescriptorTestFixture,
+                 "Test closing and reusing fds",
+                 "[storage]")
+{
+    std::string path = "/tmp/faasm_test_fd_reuse.txt";
+    faabric::util::writeBytesToFile(storage::prependRuntimeRoot(path),
+                                    { 0, 1, 2 });
+
+    int fdA = fs.openFileDescriptor(
+      DEFAULT_ROOT_FD, path, __WASI_RIGHT_FD_READ, 0, 0, 0, 0);
+    int fdB = fs.openFileDescriptor(
+      DEFAULT_ROOT_FD, path, __WASI_RIGHT_FD_READ, 0, 0, 0, 0);
+    REQUIRE(fdA == DEFAULT_ROOT_FD + 1);
+    REQUIRE(fdB == fdA + 1);
+
+    // Failed opens don't use up an fd
+    int failedFd = fs.openFileDescriptor(
+      DEFAULT_ROOT_FD, "/tmp/faasm_missing_file", 0, 0, 0, 0, 0);
+    REQUIRE(failedFd < 0);
+
+    // Closed fds are reused
+    int linuxFdA = fs.getFileDescriptor(fdA).getLinuxFd();
+    REQUIRE(fs.closeFileDescriptor(fdA));
+    REQUIRE(!fs.fileDescriptorExists(fdA));
+    REQUIRE(::fcntl(linuxFdA, F_GETFD) < 0);
+    REQUIRE(!fs.closeFileDescriptor(fdA));
+
+    int fdC = fs.dup(fdB);
+    REQUIRE(fdC == fdA);
+    REQUIRE(fs.getFileDescriptor(fdC).getPath() == path);
+
+    int fdD = fs.openFileDescriptor(
+      DEFAULT_ROOT_FD, path, __WASI_RIGHT_FD_READ, 0, 0, 0, 0);
+    REQUIRE(fdD == fdB + 1);
+
+    // Stdio and the roots stay open
+    REQUIRE(fs.closeFileDescriptor(DEFAULT_ROOT_FD));
+    REQUIRE(fs.fileDescriptorExists(DEFAULT_ROOT_FD));
+
+    // Copies don't close the fds they were copied with
+    FileSystem fsCopy = fs;
+    int linuxFdB = fsCopy.getFileDescriptor(fdB).getLinuxFd();
+    REQUIRE(fsCopy.closeFileDescriptor(fdB));
+    REQUIRE(::fcntl(linuxFdB, F_GETFD) >= 0);
+    REQUIRE(fs.fileDescriptorExists(fdB));
+
+    REQUIRE(fs.closeFileDescriptor(fdB));
+    REQUIRE(::fcntl(linuxFdB, F_GETFD) < 0);
+
+    fs.closeFileDescriptor(fdC);
+    fs.closeFileDescriptor(fdD);
+}
+
 void checkWasiDirentInBuffer(uint8_t* buffer, DirEnt e)
 {
     size_t wasiDirentSize = sizeof(__wasi_dirent_t);
@@ -308,6 +423,106 @@ void checkWasiDirentInBuffer(uint8_t* buffer, DirEnt e)
     REQUIRE(direntPath == e.path);
 }
 
+TEST_CASE_METHOD(FileDescriptorTestFixture,
+                 "Test positional reads, writes and sending between fds",
+                 "[storage]")
+{
+    std::string pathA = "/tmp/faasm_test_pread_a.txt";
+    std::string pathB = "/tmp/faasm_test_pread_b.txt";
+    faabric::util::writeBytesToFile(storage::prependRuntimeRoot(pathA),
+                                    { 0, 1, 2, 3, 4, 5, 6, 7 });
+    faabric::util::writeBytesToFile(storage::prependRuntimeRoot(pathB), {});
+
+    uint64_t rights = __WASI_RIGHT_FD_READ | __WASI_RIGHT_FD_WRITE;
+    int fdA =
+      fs.openFileDescriptor(DEFAULT_ROOT_FD, pathA, rights, 0, 0, 0, 0);
+    int fdB =
+      fs.openFileDescriptor(DEFAULT_ROOT_FD, pathB, rights, 0, 0, 0, 0);
+    REQUIRE(fdA > 0);
+    REQUIRE(fdB > 0);
+
+    FileDescriptor& descA = fs.getFileDescriptor(fdA);
+    FileDescriptor& descB = fs.getFileDescriptor(fdB);
+
+    // Reads are split across the iovecs and don't move the offset
+    std::vector<uint8_t> bufA(2);
+    std::vector<uint8_t> bufB(3);
+    std::vector<::iovec> iovecs = { { bufA.data(), bufA.size() },
+                                    { bufB.data(), bufB.size() } };
+    REQUIRE(descA.pread(iovecs, 2, 3) == 5);
+    REQUIRE(bufA == std::vector<uint8_t>({ 3, 4 }));
+    REQUIRE(bufB == std::vector<uint8_t>({ 5, 6, 7 }));
+    REQUIRE(descA.tell() == 0);
+
+    std::vector<uint8_t> toWrite = { 9, 9 };
+    std::vector<::iovec> writeIovecs = { { toWrite.data(), toWrite.size() } };
+    REQUIRE(descA.pwrite(writeIovecs, 1, 1) == 2);
+    REQUIRE(descA.tell() == 0);
+
+    // Sending from an offset leaves the input's position alone
+    off_t offset = 1;
+    REQUIRE(descA.sendTo(descB, &offset, 4) == 4);
+    REQUIRE(offset == 5);
+    REQUIRE(descA.tell() == 0);
+
+    // Sending without one moves it
+    REQUIRE(descA.sendTo(descB, nullptr, 2) == 2);
+    REQUIRE(descA.tell() == 2);
+
+    std::vector<uint8_t> actual =
+      faabric::util::readFileToBytes(storage::prependRuntimeRoot(pathB));
+    REQUIRE(actual == std::vector<uint8_t>({ 9, 9, 3, 4, 0, 9 }));
+
+    // Reads past the end give nothing
+    REQUIRE(descA.pread(iovecs, 2, 100) == 0);
+
+    REQUIRE(fs.closeFileDescriptor(fdA));
+    REQUIRE(fs.closeFileDescriptor(fdB));
+}
+
+static std::vector<std::string> listDir(FileSystem& fs,
+                                        const std::string& path)
+{
+    int dirFd = fs.openFileDescriptor(
+      DEFAULT_ROOT_FD, path, 0, 0, 0, __WASI_O_DIRECTORY, 0);
+    REQUIRE(dirFd > 0);
+
+    FileDescriptor& dirFileDesc = fs.getFileDescriptor(dirFd);
+    std::vector<std::string> names;
+    while (!dirFileDesc.iterFinished()) {
+        names.push_back(dirFileDesc.iterNext().path);
+    }
+
+    fs.closeFileDescriptor(dirFd);
+    return names;
+}
+
+TEST_CASE_METHOD(FileDescriptorTestFixture,
+                 "Test shared directory listings are cached",
+                 "[storage]")
+{
+    storage::FileLoader& loader = storage::getFileLoader();
+    loader.uploadSharedFile("test/listed/a.txt", { 1, 2, 3 });
+
+    std::string sharedDir = std::string(SHARED_FILE_PREFIX) + "test/listed";
+    std::vector<std::string> names = listDir(fs, sharedDir);
+    REQUIRE(std::count(names.begin(), names.end(), "a.txt") == 1);
+
+    // Files turning up on disk aren't seen by the cached listing
+    std::string pathB = sharedDir + "/b.txt";
+    std::string realPathB = storage::SharedFiles::realPathForSharedFile(pathB);
+    boost::filesystem::create_directories(
+      boost::filesystem::path(realPathB).parent_path());
+    faabric::util::writeBytesToFile(realPathB, { 4, 5 });
+    names = listDir(fs, sharedDir);
+    REQUIRE(std::count(names.begin(), names.end(), "b.txt") == 0);
+
+    // Until the file's cache entry is cleared, e.g. when it's written
+    storage::SharedFiles::clearCacheForSharedFile(pathB);
+    names = listDir(fs, sharedDir);
+    REQUIRE(std::count(names.begin(), names.end(), "b.txt") == 1);
+}
+
 TEST_CASE_METHOD(FileDescriptorTestFixture,
                  "Test readdir iterator and buffer",
                  "[storage]")
@@ -385,29 +600,50 @@ TEST_CASE_METHOD(FileDescriptorTestFixture,
         size_t sizeB = wasiDirentSize + entB.path.size();
         size_t sizeC = wasiDirentSize + entC.path.size();
 
-        // Reset the iterator
-        fileDesc.iterReset();
-
         // Make a buffer slightly too small for all of them
         std::vector<uint8_t> buffer(sizeA + sizeB + sizeC - 10);
 
-        // Copy into this buffer
-        size_t bytesCopied =
-          fileDesc.copyDirentsToWasiBuffer(buffer.data(), buffer.size());
+        // Copy into this buffer, which is filled with the third cut short
+        size_t bytesCopied = fileDesc.copyDirentsToWasiBuffer(
+          buffer.data(), buffer.size(), __WASI_DIRCOOKIE_START);
         REQUIRE(bytesCopied == buffer.size());
 
         // Check contents
         checkWasiDirentInBuffer(buffer.data(), entA);
         checkWasiDirentInBuffer(buffer.data() + sizeA, entB);
 
-        // Run on a second buffer and check the third entry is added first to
-        // this one
+        // Run on a second buffer from the cookie of the last full entry, and
+        // check the third entry is added first to this one
         std::vector<uint8_t> buffer2(sizeC + 10);
-        size_t bytesCopied2 =
-          fileDesc.copyDirentsToWasiBuffer(buffer2.data(), buffer2.size());
+        size_t bytesCopied2 = fileDesc.copyDirentsToWasiBuffer(
+          buffer2.data(), buffer2.size(), entB.next);
         REQUIRE(bytesCopied2 == buffer2.size());
 
         checkWasiDirentInBuffer(buffer2.data(), entC);
+
+        // Going back to an earlier cookie works too
+        bytesCopied2 = fileDesc.copyDirentsToWasiBuffer(
+          buffer2.data(), buffer2.size(), entA.next);
+        REQUIRE(bytesCopied2 == buffer2.size());
+        checkWasiDirentInBuffer(buffer2.data(), entB);
+
+        // Past the end nothing is copied
+        size_t bytesCopied3 = fileDesc.copyDirentsToWasiBuffer(
+          buffer2.data(), buffer2.size(), expectedList.size());
+        REQUIRE(bytesCopied3 == 0);
+    }
+
+    SECTION("Batched listing")
+    {
+        std::vector<storage::DirEnt> entries =
+          storage::readDirEntries(dirPath);
+        REQUIRE(entries.size() == expectedList.size());
+        for (size_t i = 0; i < entries.size(); i++) {
+            REQUIRE(entries.at(i).path == expectedList.at(i));
+            REQUIRE(entries.at(i).next == i + 1);
+        }
+
+        REQUIRE_THROWS(storage::readDirEntries(dirPath + "/does_not_exist"));
     }
 }
 }
@@ -12,6 +12,7 @@
 
 #include <codegen/MachineCodeGenerator.h>
 #include <conf/FaasmConfig.h>
+#include <storage/CodegenManifest.h>
 #include <storage/FileLoader.h>
 #include <upload/UploadServer.h>
 
@@ -19,6 +20,7 @@
 #include <boost/filesystem/operations.hpp>
 
 #include <stdlib.h>
+#include <thread>
 
 using namespace storage;
 
@@ -63,7 +65,7 @@ TEST_CASE_METHOD(FileLoaderTestFixture,
     // Upload the function and machine code
     loader.uploadFunction(msgB);
     gen.codegenForFunction(msgB);
-    REQUIRE(s3.listKeys(conf.s3Bucket).size() == 3);
+    REQUIRE(s3.listKeys(conf.s3Bucket).size() == 4);
     REQUIRE(boost::filesystem::exists(cachedWasmFile) == useFsCache);
     REQUIRE(boost::filesystem::exists(cachedObjFile) == useFsCache);
     REQUIRE(boost::filesystem::exists(cachedObjectHash) == useFsCache);
@@ -183,6 +185,112 @@ TEST_CASE_METHOD(FileLoaderTestFixture,
                       SharedFileNotExistsException);
 }
 
+TEST_CASE_METHOD(FileLoaderTestFixture,
+                 "Test caching shared files without loading them",
+                 "[storage]")
+{
+    std::string relativePath = "test/cached_file_loader.txt";
+    REQUIRE_THROWS_AS(loader.cacheSharedFile(relativePath),
+                      SharedFileNotExistsException);
+
+    std::vector<uint8_t> expected = { 7, 8, 9 };
+    storage::FileLoader loader;
+    loader.uploadSharedFile(relativePath, expected);
+    loader.clearLocalCache();
+
+    std::string expectedPath = conf.sharedFilesDir + "/" + relativePath;
+    REQUIRE(!boost::filesystem::exists(expectedPath));
+
+    // The file is fetched into the cache, and found there the second time
+    REQUIRE(loader.cacheSharedFile(relativePath) == expectedPath);
+    REQUIRE(faabric::util::readFileToBytes(expectedPath) == expected);
+    REQUIRE(loader.cacheSharedFile(relativePath) == expectedPath);
+
+    loader.deleteSharedFile(relativePath);
+}
+
+TEST_CASE_METHOD(FileLoaderTestFixture,
+                 "Test concurrent loads of the same shared file",
+                 "[storage]")
+{
+    std::string relativePath = "test/concurrent_file_loader.txt";
+    std::vector<uint8_t> expected = { 3, 1, 4, 1, 5, 9 };
+    loader.uploadSharedFile(relativePath, expected);
+    loader.clearLocalCache();
+
+    // Each thread has its own loader, so they all miss the cache together
+    int nThreads = 8;
+    std::vector<std::vector<uint8_t>> results(nThreads);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([&results, &relativePath, i] {
+            results.at(i) = getFileLoader().loadSharedFile(relativePath);
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    for (const auto& result : results) {
+        REQUIRE(result == expected);
+    }
+
+    loader.deleteSharedFile(relativePath);
+}
+
+TEST_CASE_METHOD(FileLoaderTestFixture,
+                 "Test function metadata lists uploaded artefacts",
+                 "[storage]")
+{
+    REQUIRE(loader.loadFunctionMetadata(msgA).empty());
+
+    loader.uploadFunction(msgA);
+    loader.uploadFunctionObjectFile(msgA, objBytesA);
+
+    // Metadata is cached locally like the other artefacts
+    std::string metadataFile = loader.getFunctionMetadataFile(msgA);
+    REQUIRE(boost::filesystem::exists(metadataFile));
+    loader.clearLocalCache();
+
+    FunctionMetadata metadata = loader.loadFunctionMetadata(msgA);
+    REQUIRE(metadata.getArtefacts().size() == 2);
+    REQUIRE(metadata.getArtefact("function.wasm").size == wasmBytesA.size());
+    REQUIRE(metadata.getArtefact("function.wasm.o").hash ==
+            hashCodegenInput(objBytesA));
+    REQUIRE(boost::filesystem::exists(metadataFile));
+
+    // Functions with metadata but no preloads don't look for them
+    REQUIRE(loader.loadFunctionPreloads(msgA).empty());
+}
+
+TEST_CASE_METHOD(FileLoaderTestFixture,
+                 "Test uploading and loading function preloads",
+                 "[storage]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "preloads");
+
+    // Functions without a preload list have nothing to preload
+    storage::FileLoader loader;
+    REQUIRE(loader.loadFunctionPreloads(msg).empty());
+
+    std::vector<std::string> expected = { "/lib/a.so", "/lib/b/c.so" };
+    loader.uploadFunctionPreloads(msg, expected);
+    REQUIRE(boost::filesystem::exists(loader.getFunctionPreloadFile(msg)));
+
+    loader.clearLocalCache();
+    REQUIRE(loader.loadFunctionPreloads(msg) == expected);
+
+    // The upload is recorded in the function's metadata
+    FunctionMetadata metadata = loader.loadFunctionMetadata(msg);
+    REQUIRE(metadata.hasArtefact("function.preload"));
+
+    // Parsing ignores comments, blank lines and surrounding whitespace
+    std::vector<std::string> parsed = FileLoader::parseFunctionPreloads(
+      "# Comment\n\n  /lib/a.so\t\r\n/lib/b/c.so");
+    REQUIRE(parsed == expected);
+}
+
 TEST_CASE_METHOD(FileLoaderTestFixture,
                  "Test uploading and loading python files",
                  "[storage]")
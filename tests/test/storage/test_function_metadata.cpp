@@ -0,0 +1,64 @@
+#include <catch2/catch.hpp>
+
+#include <faabric/util/bytes.h>
+
+#include <storage/CodegenManifest.h>
+#include <storage/FunctionMetadata.h>
+
+using namespace storage;
+
+namespace tests {
+
+TEST_CASE("Test function metadata round trip", "[storage]")
+{
+    std::vector<uint8_t> wasmBytes = { 0, 1, 2, 3 };
+    std::vector<uint8_t> objBytes = { 4, 5, 6 };
+
+    FunctionMetadata metadata;
+    REQUIRE(metadata.empty());
+
+    metadata.setArtefact("function.wasm", wasmBytes);
+    metadata.setArtefact("function.wasm.o", objBytes);
+    metadata.setHint("memory-pages", "128");
+    REQUIRE(!metadata.empty());
+
+    FunctionMetadata actual(metadata.toBytes());
+    REQUIRE(actual.getArtefacts().size() == 2);
+    REQUIRE(actual.hasArtefact("function.wasm"));
+    REQUIRE(!actual.hasArtefact("function.aot"));
+
+    FunctionArtefact wasm = actual.getArtefact("function.wasm");
+    REQUIRE(wasm.hash == hashCodegenInput(wasmBytes));
+    REQUIRE(wasm.size == wasmBytes.size());
+    REQUIRE(actual.getArtefact("function.wasm.o").size == objBytes.size());
+    REQUIRE(actual.getArtefact("function.aot").empty());
+
+    REQUIRE(actual.getHint("memory-pages") == "128");
+    REQUIRE(actual.getHint("missing").empty());
+
+    // Overwriting an artefact replaces its entry
+    actual.setArtefact("function.wasm", objBytes);
+    REQUIRE(actual.getArtefact("function.wasm").hash ==
+            hashCodegenInput(objBytes));
+}
+
+TEST_CASE("Test invalid function metadata", "[storage]")
+{
+    std::string contents;
+
+    SECTION("Empty") { contents = ""; }
+
+    SECTION("Wrong header") { contents = "foobar\nartefact\ta\tb\t1\n"; }
+
+    SECTION("Malformed lines")
+    {
+        contents = "faasm-function-metadata-v1\n"
+                   "artefact\tfunction.wasm\tabcd\tnotasize\n"
+                   "artefact\t\tabcd\t12\n"
+                   "junk\tfoo\tbar\n";
+    }
+
+    FunctionMetadata metadata(faabric::util::stringToBytes(contents));
+    REQUIRE(metadata.empty());
+}
+}
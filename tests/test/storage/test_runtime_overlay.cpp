@@ -0,0 +1,79 @@
+#include <catch2/catch.hpp>
+
+#include <faabric/util/files.h>
+#include <storage/RuntimeOverlay.h>
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+
+using namespace storage;
+
+namespace tests {
+
+TEST_CASE("Test runtime overlay index", "[storage]")
+{
+    std::string rootDir = "/tmp/faasm_test_overlay";
+    boost::filesystem::remove_all(rootDir);
+    boost::filesystem::create_directories(rootDir + "/lib/py/pkg");
+    boost::filesystem::create_directories(rootDir + "/other");
+
+    std::vector<uint8_t> bytes = { 0, 1, 2, 3 };
+    faabric::util::writeBytesToFile(rootDir + "/lib/py/os.py", bytes);
+    faabric::util::writeBytesToFile(rootDir + "/lib/py/pkg/mod.py", bytes);
+
+    // Links back up the tree shouldn't be followed forever
+    boost::filesystem::create_directory_symlink(rootDir + "/lib/py",
+                                                rootDir + "/lib/py/pkg/loop");
+
+    std::string dirs;
+    SECTION("Single dir") { dirs = "lib/py"; }
+
+    SECTION("Missing dirs ignored") { dirs = "lib/py,lib/missing"; }
+
+    SECTION("Leading and trailing slashes") { dirs = "/lib/py/"; }
+
+    RuntimeOverlay overlay(rootDir, dirs);
+
+    REQUIRE(overlay.covers("lib/py"));
+    REQUIRE(overlay.covers("/lib/py/os.py"));
+    REQUIRE(overlay.covers("./lib/py/missing.py"));
+    REQUIRE(!overlay.covers("lib/python"));
+    REQUIRE(!overlay.covers("other"));
+    REQUIRE(!overlay.covers("lib"));
+
+    const RuntimeOverlayEntry* file = overlay.lookUp("lib/py/os.py");
+    REQUIRE(file != nullptr);
+    REQUIRE(S_ISREG(file->nativeStat.st_mode));
+    REQUIRE(file->nativeStat.st_size == (off_t)bytes.size());
+
+    REQUIRE(overlay.lookUp("/lib/py/pkg/mod.py") != nullptr);
+    REQUIRE(overlay.lookUp("lib/py/missing.py") == nullptr);
+
+    const RuntimeOverlayEntry* dir = overlay.lookUp("lib/py/");
+    REQUIRE(dir != nullptr);
+    REQUIRE(S_ISDIR(dir->nativeStat.st_mode));
+
+    std::vector<std::string> names;
+    REQUIRE(dir->children != nullptr);
+    for (const auto& ent : *dir->children) {
+        names.push_back(ent.path);
+    }
+    std::sort(names.begin(), names.end());
+    std::vector<std::string> expected = { ".", "..", "os.py", "pkg" };
+    REQUIRE(names == expected);
+
+    // The link is there, but not what's under it
+    REQUIRE(overlay.lookUp("lib/py/pkg/loop") != nullptr);
+    REQUIRE(overlay.lookUp("lib/py/pkg/loop/os.py") == nullptr);
+
+    boost::filesystem::remove_all(rootDir);
+}
+
+TEST_CASE("Test empty runtime overlay", "[storage]")
+{
+    RuntimeOverlay overlay("/tmp", "");
+    REQUIRE(overlay.getNPaths() == 0);
+    REQUIRE(!overlay.covers("lib/py"));
+    REQUIRE(!overlay.covers(""));
+}
+}
@@ -10,6 +10,8 @@
 #include <conf/FaasmConfig.h>
 #include <storage/S3Wrapper.h>
 
+#include <filesystem>
+
 namespace tests {
 
 TEST_CASE_METHOD(S3TestFixture, "Test read/write keys in bucket", "[s3]")
@@ -87,6 +89,86 @@ TEST_CASE_METHOD(S3TestFixture, "Test read/write keys in bucket", "[s3]")
         REQUIRE_THROWS(s3.getKeyBytes(conf.s3Bucket, "blahblah"));
     }
 
+    SECTION("Test reading key to file")
+    {
+        std::string filePath = "/tmp/faasm_s3_key_to_file";
+        s3.addKeyBytes(conf.s3Bucket, "alpha", byteDataA);
+
+        REQUIRE(s3.getKeyToFile(conf.s3Bucket, "alpha", filePath));
+        REQUIRE(faabric::util::readFileToBytes(filePath) == byteDataA);
+
+        // Missing keys must not leave a file behind
+        std::filesystem::remove(filePath);
+        REQUIRE(!s3.getKeyToFile(conf.s3Bucket, "blahblah", filePath, true));
+        REQUIRE(!std::filesystem::exists(filePath));
+
+        REQUIRE_THROWS(s3.getKeyToFile(conf.s3Bucket, "blahblah", filePath));
+        REQUIRE(!std::filesystem::exists(filePath));
+    }
+
+    SECTION("Test multipart read/write")
+    {
+        // Big enough for three parts, with a short last one
+        conf.s3PartSizeMb = 5;
+        conf.s3Concurrency = 2;
+        std::vector<uint8_t> bigData(12 * 1024 * 1024);
+        for (size_t i = 0; i < bigData.size(); i++) {
+            bigData[i] = (uint8_t)(i % 251);
+        }
+
+        s3.addKeyBytes(conf.s3Bucket, "alpha", bigData);
+        REQUIRE(s3.getKeyBytes(conf.s3Bucket, "alpha") == bigData);
+
+        std::string filePath = "/tmp/faasm_s3_multipart_to_file";
+        REQUIRE(s3.getKeyToFile(conf.s3Bucket, "alpha", filePath));
+        REQUIRE(faabric::util::readFileToBytes(filePath) == bigData);
+        std::filesystem::remove(filePath);
+
+        // Objects smaller than a part still come back whole
+        s3.addKeyBytes(conf.s3Bucket, "beta", byteDataB);
+        REQUIRE(s3.getKeyBytes(conf.s3Bucket, "beta") == byteDataB);
+    }
+
+    SECTION("Test updating key in place from file")
+    {
+        conf.s3PartSizeMb = 5;
+        std::vector<uint8_t> bigData(12 * 1024 * 1024);
+        for (size_t i = 0; i < bigData.size(); i++) {
+            bigData[i] = (uint8_t)(i % 251);
+        }
+        s3.addKeyBytes(conf.s3Bucket, "alpha", bigData);
+
+        // Change the middle part, and append to the last
+        std::string filePath = "/tmp/faasm_s3_update_from_file";
+        size_t partSize = 5 * 1024 * 1024;
+        std::fill(bigData.begin() + partSize + 10,
+                  bigData.begin() + partSize + 20,
+                  7);
+        bigData.insert(bigData.end(), 100, 9);
+        faabric::util::writeBytesToFile(filePath, bigData);
+
+        std::vector<std::pair<size_t, size_t>> dirty = {
+            { partSize + 10, partSize + 20 },
+            { bigData.size() - 100, bigData.size() }
+        };
+        REQUIRE(s3.updateKeyFromFile(conf.s3Bucket, "alpha", filePath, dirty));
+        REQUIRE(s3.getKeyBytes(conf.s3Bucket, "alpha") == bigData);
+
+        // Nothing to copy if the key's missing or everything was written
+        REQUIRE(!s3.updateKeyFromFile(conf.s3Bucket, "beta", filePath, dirty));
+        REQUIRE(!s3.updateKeyFromFile(
+          conf.s3Bucket, "alpha", filePath, { { 0, bigData.size() } }));
+
+        std::filesystem::remove(filePath);
+    }
+
+    SECTION("Test empty key read/write")
+    {
+        std::vector<uint8_t> empty;
+        s3.addKeyBytes(conf.s3Bucket, "alpha", empty);
+        REQUIRE(s3.getKeyBytes(conf.s3Bucket, "alpha").empty());
+    }
+
     s3.deleteKey(conf.s3Bucket, "alpha");
     s3.deleteKey(conf.s3Bucket, "beta");
     s3.deleteKey(conf.s3Bucket, "simple");
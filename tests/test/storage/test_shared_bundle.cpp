@@ -0,0 +1,97 @@
+#include <catch2/catch.hpp>
+
+#include <faabric/util/files.h>
+#include <storage/SharedBundle.h>
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace storage;
+
+namespace tests {
+
+TEST_CASE("Test building and loading a shared bundle", "[storage]")
+{
+    std::vector<uint8_t> bytesA = { 0, 1, 2, 3 };
+    std::vector<uint8_t> bytesB = { 4, 5 };
+    std::vector<uint8_t> bytesC;
+    std::map<std::string, std::vector<uint8_t>> files = {
+        { "a.py", bytesA },
+        { "pkg/b.py", bytesB },
+        { "pkg/sub/c.txt", bytesC },
+    };
+
+    std::vector<uint8_t> bundleBytes = buildSharedBundle(files);
+    REQUIRE_NOTHROW(validateSharedBundle(bundleBytes));
+
+    std::string bundlePath = "/tmp/faasm_test_bundle";
+    faabric::util::writeBytesToFile(bundlePath, bundleBytes);
+
+    SharedBundle bundle(bundlePath);
+    REQUIRE(bundle.getNFiles() == 3);
+
+    REQUIRE(bundle.isFile("a.py"));
+    REQUIRE(bundle.isFile("pkg/sub/c.txt"));
+    REQUIRE(!bundle.isFile("pkg"));
+    REQUIRE(!bundle.isFile("missing.py"));
+
+    REQUIRE(bundle.isDir(""));
+    REQUIRE(bundle.isDir("pkg"));
+    REQUIRE(bundle.isDir("pkg/sub"));
+    REQUIRE(!bundle.isDir("a.py"));
+
+    std::vector<std::string> rootNames = bundle.listDir("");
+    std::sort(rootNames.begin(), rootNames.end());
+    std::vector<std::string> expectedRoot = { "a.py", "pkg" };
+    REQUIRE(rootNames == expectedRoot);
+
+    std::vector<std::string> pkgNames = bundle.listDir("pkg");
+    std::sort(pkgNames.begin(), pkgNames.end());
+    std::vector<std::string> expectedPkg = { "b.py", "sub" };
+    REQUIRE(pkgNames == expectedPkg);
+
+    REQUIRE(bundle.readFile("a.py") == bytesA);
+    REQUIRE(bundle.readFile("pkg/b.py") == bytesB);
+    REQUIRE(bundle.readFile("pkg/sub/c.txt").empty());
+    REQUIRE_THROWS(bundle.readFile("missing.py"));
+
+    // Files are opened without being written out
+    int fd = bundle.openFile("pkg/b.py");
+    REQUIRE(fd > 0);
+    std::vector<uint8_t> actual(10, 0);
+    REQUIRE(::read(fd, actual.data(), actual.size()) == (ssize_t)bytesB.size());
+    actual.resize(bytesB.size());
+    REQUIRE(actual == bytesB);
+
+    // They can't be written
+    REQUIRE(::write(fd, bytesA.data(), bytesA.size()) < 0);
+    ::close(fd);
+
+    struct stat fileStat;
+    bundle.statPath("a.py", fileStat);
+    REQUIRE(S_ISREG(fileStat.st_mode));
+    REQUIRE(fileStat.st_size == (off_t)bytesA.size());
+
+    struct stat dirStat;
+    bundle.statPath("pkg/sub", dirStat);
+    REQUIRE(S_ISDIR(dirStat.st_mode));
+
+    boost::filesystem::remove(bundlePath);
+}
+
+TEST_CASE("Test invalid shared bundles", "[storage]")
+{
+    std::vector<uint8_t> bundleBytes =
+      buildSharedBundle({ { "a.py", { 0, 1, 2, 3 } } });
+
+    SECTION("Empty") { bundleBytes.clear(); }
+
+    SECTION("Bad magic") { bundleBytes.at(0) = 'X'; }
+
+    SECTION("Truncated") { bundleBytes.resize(bundleBytes.size() - 1); }
+
+    REQUIRE_THROWS(validateSharedBundle(bundleBytes));
+}
+}
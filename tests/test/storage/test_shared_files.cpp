@@ -98,4 +98,88 @@ TEST_CASE_METHOD(SharedFilesTestFixture, "Check sync python file", "[storage]")
     REQUIRE(actualBytes.size() == contents.size());
     REQUIRE(actualBytes == contents);
 }
+
+TEST_CASE_METHOD(SharedFilesTestFixture,
+                 "Check shared file lookups use directory listings",
+                 "[storage]")
+{
+    std::string relDir = "shared_listing_dir";
+    std::string relPath = relDir + "/present.txt";
+    std::string missingPath = "faasm://" + relDir + "/missing.txt";
+    std::string subDirPath = "faasm://" + relDir + "/sub";
+
+    std::vector<uint8_t> bytes = { 3, 4, 5 };
+    loader.uploadSharedFile(relPath, bytes);
+    loader.uploadSharedFile(relDir + "/sub/nested.txt", bytes);
+
+    std::string localPath = loader.getSharedFileFile(relPath);
+    std::string localSubDir = loader.getSharedFileFile(relDir + "/sub");
+    boost::filesystem::remove_all(
+      boost::filesystem::path(localPath).parent_path());
+
+    REQUIRE(loader.listSharedDirectory(relDir).size() == 2);
+
+    // Missing files and directories are answered from the listing
+    REQUIRE(SharedFiles::syncSharedFile(missingPath, "") == ENOENT);
+    REQUIRE(SharedFiles::syncSharedFile(subDirPath, "") == 0);
+    REQUIRE(boost::filesystem::is_directory(localSubDir));
+
+    // Files in the listing are still fetched
+    REQUIRE(SharedFiles::syncSharedFile("faasm://" + relPath, "") == 0);
+    REQUIRE(faabric::util::readFileToBytes(localPath) == bytes);
+
+    // Uploading through the shared files drops the cached lookups
+    std::string missingRelPath = relDir + "/missing.txt";
+    std::string missingLocalPath = loader.getSharedFileFile(missingRelPath);
+    faabric::util::writeBytesToFile(missingLocalPath, bytes);
+    SharedFiles::updateSharedFile(missingPath);
+    boost::filesystem::remove(missingLocalPath);
+
+    REQUIRE(SharedFiles::syncSharedFile(missingPath, "") == 0);
+    REQUIRE(boost::filesystem::exists(missingLocalPath));
+}
+
+TEST_CASE_METHOD(SharedFilesTestFixture,
+                 "Check writes to shared files are written back",
+                 "[storage]")
+{
+    std::string relPath = "shared_write_back/file.txt";
+    std::string sharedPath = "faasm://" + relPath;
+    std::string localPath = loader.getSharedFileFile(relPath);
+
+    std::vector<uint8_t> bytes = { 0, 1, 2, 3, 4, 5 };
+    loader.uploadSharedFile(relPath, bytes);
+
+    std::vector<uint8_t> updated = { 0, 1, 7, 7, 4, 5, 6 };
+    faabric::util::writeBytesToFile(localPath, updated);
+
+    bool writeThrough = false;
+    SECTION("Write-through")
+    {
+        conf.sharedFileWriteBackMs = 0;
+        writeThrough = true;
+    }
+
+    SECTION("Write-back") { conf.sharedFileWriteBackMs = 60000; }
+
+    SharedFiles::writeSharedFile(sharedPath, 2, 2);
+    SharedFiles::writeSharedFile(sharedPath, 6, 1);
+
+    auto getUploaded = [this, &relPath] {
+        return s3.getKeyBytes(conf.s3Bucket, relPath);
+    };
+
+    if (writeThrough) {
+        REQUIRE(SharedFiles::getDirtySharedFileCount() == 0);
+        REQUIRE(getUploaded() == updated);
+    } else {
+        REQUIRE(SharedFiles::getDirtySharedFileCount() == 1);
+        REQUIRE(getUploaded() == bytes);
+    }
+
+    // Syncing makes sure the writes are uploaded
+    SharedFiles::flushSharedFile(sharedPath);
+    REQUIRE(SharedFiles::getDirtySharedFileCount() == 0);
+    REQUIRE(getUploaded() == updated);
+}
 }
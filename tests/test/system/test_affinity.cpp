@@ -0,0 +1,85 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <conf/FaasmConfig.h>
+#include <system/Affinity.h>
+
+#include <sched.h>
+#include <thread>
+
+using namespace isolation;
+
+namespace tests {
+
+TEST_CASE("Test parsing CPU lists", "[faaslet]")
+{
+    REQUIRE(parseCpuList("0-3,8,10-11\n") ==
+            std::vector<int>({ 0, 1, 2, 3, 8, 10, 11 }));
+    REQUIRE(parseCpuList("5") == std::vector<int>({ 5 }));
+    REQUIRE(parseCpuList("").empty());
+}
+
+TEST_CASE("Test CPU placement orders", "[faaslet]")
+{
+    std::vector<std::vector<int>> nodeCpus = { { 0, 1, 2 }, { 3, 4 } };
+
+    SECTION("Compact")
+    {
+        REQUIRE(getCpuPlacementOrder("compact", nodeCpus) ==
+                std::vector<int>({ 0, 1, 2, 3, 4 }));
+    }
+
+    SECTION("Scatter")
+    {
+        REQUIRE(getCpuPlacementOrder("scatter", nodeCpus) ==
+                std::vector<int>({ 0, 3, 1, 4, 2 }));
+    }
+
+    SECTION("Unknown")
+    {
+        REQUIRE_THROWS(getCpuPlacementOrder("blah", nodeCpus));
+    }
+}
+
+TEST_CASE_METHOD(FaasmConfTestFixture, "Test pinning threads", "[faaslet]")
+{
+    // New threads start with this thread's affinity
+    cpu_set_t parentSet;
+    CPU_ZERO(&parentSet);
+    ::sched_getaffinity(0, sizeof(parentSet), &parentSet);
+
+    int expectedCpus = CPU_COUNT(&parentSet);
+
+    SECTION("Off") { conf.affinityPolicy = "off"; }
+
+    SECTION("Compact")
+    {
+        conf.affinityPolicy = "compact";
+        expectedCpus = 1;
+    }
+
+    SECTION("Scatter")
+    {
+        conf.affinityPolicy = "scatter";
+        expectedCpus = 1;
+    }
+
+    // Pinning sticks to the thread, so do it on a new one
+    int actualCpus = 0;
+    std::thread t([&actualCpus] {
+        pinCurrentThread();
+
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        ::sched_getaffinity(0, sizeof(cpuSet), &cpuSet);
+        actualCpus = CPU_COUNT(&cpuSet);
+    });
+
+    if (t.joinable()) {
+        t.join();
+    }
+
+    REQUIRE(actualCpus == expectedCpus);
+}
+}
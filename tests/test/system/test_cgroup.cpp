@@ -64,8 +64,12 @@ static bool cgroupCheckPassed = false;
 // Need to run this check in a separate thread
 void checkCgroupAddition()
 {
+    bool isV2 = getCgroupVersion() == CgroupVersion::cg_v2;
+
     boost::filesystem::path cgroupPath("/sys/fs/cgroup");
-    cgroupPath.append("cpu");
+    if (!isV2) {
+        cgroupPath.append("cpu");
+    }
     cgroupPath.append(BASE_CGROUP_NAME);
 
     if (!boost::filesystem::exists(cgroupPath)) {
@@ -82,7 +86,7 @@ void checkCgroupAddition()
     cg.addCurrentThread();
 
     // Check this thread is in the cgroup
-    cgroupPath.append("tasks");
+    cgroupPath.append(isV2 ? "cgroup.threads" : "tasks");
     std::string tid = std::to_string((pid_t)syscall(SYS_gettid));
     std::string fileContents =
       faabric::util::readFileToString(cgroupPath.string());
@@ -117,4 +121,60 @@ TEST_CASE("Test adding thread to cpu controller", "[faaslet]")
 
     REQUIRE(cgroupCheckPassed);
 }
+
+TEST_CASE("Test cgroup names for functions", "[faaslet]")
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    std::string original = conf.cgroupGranularity;
+
+    std::string expected;
+
+    SECTION("Host")
+    {
+        conf.cgroupGranularity = "host";
+        expected = BASE_CGROUP_NAME;
+    }
+
+    SECTION("User")
+    {
+        conf.cgroupGranularity = "user";
+        expected = "faasm/demo";
+    }
+
+    SECTION("Function")
+    {
+        conf.cgroupGranularity = "function";
+        expected = "faasm/demo.echo";
+    }
+
+    REQUIRE(getCgroupNameForFunction("demo", "echo") == expected);
+
+    conf.cgroupGranularity = original;
+}
+
+TEST_CASE("Test parsing cgroup CPU usage", "[faaslet]")
+{
+    std::string cpuStat = "usage_usec 123456\n"
+                          "user_usec 100000\n"
+                          "system_usec 23456\n"
+                          "nr_periods 0\n";
+    REQUIRE(parseCpuStatUsage(cpuStat) == 123456);
+
+    REQUIRE(parseCpuStatUsage("") == 0);
+    REQUIRE(parseCpuStatUsage("nr_periods 3\n") == 0);
+}
+
+TEST_CASE("Test cgroup usage with cgroups off", "[faaslet]")
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    std::string original = conf.cgroupMode;
+    conf.cgroupMode = "off";
+
+    CGroup cg("faasm/demo.echo");
+    CGroupUsage usage = cg.getUsage();
+    REQUIRE(usage.cpuMicros == 0);
+    REQUIRE(usage.memoryBytes == 0);
+
+    conf.cgroupMode = original;
+}
 }
@@ -4,10 +4,13 @@
 
 #include <faabric/util/config.h>
 #include <faabric/util/environment.h>
+#include <faabric/util/macros.h>
 
 #include <conf/FaasmConfig.h>
 #include <system/NetworkNamespace.h>
 
+#include <thread>
+
 using namespace isolation;
 
 namespace tests {
@@ -31,4 +34,101 @@ TEST_CASE_METHOD(FaasmConfTestFixture,
         returnNetworkNamespace(ns);
     }
 }
+
+TEST_CASE_METHOD(FaasmConfTestFixture,
+                 "Test network namespace pool stats",
+                 "[faaslet][network]")
+{
+    conf.netNsMode = "on";
+    conf.netNsClaimTimeoutMs = 0;
+
+    resetNetworkNamespacePoolStats();
+
+    std::vector<std::shared_ptr<NetworkNamespace>> namespaces(conf.maxNetNs);
+    for (int i = 0; i < conf.maxNetNs; i++) {
+        namespaces.at(i) = claimNetworkNamespace();
+    }
+
+    NetworkNamespacePoolStats stats = getNetworkNamespacePoolStats();
+    REQUIRE(stats.claims == conf.maxNetNs);
+    REQUIRE(stats.exhausted == 0);
+    REQUIRE(stats.failed == 0);
+    REQUIRE(stats.size == conf.maxNetNs);
+    REQUIRE(stats.free == 0);
+    REQUIRE(stats.maxClaimMicros <= stats.totalClaimMicros);
+
+    REQUIRE_THROWS(claimNetworkNamespace());
+
+    stats = getNetworkNamespacePoolStats();
+    REQUIRE(stats.claims == conf.maxNetNs + 1);
+    REQUIRE(stats.exhausted == 1);
+    REQUIRE(stats.failed == 1);
+
+    for (auto& ns : namespaces) {
+        returnNetworkNamespace(ns);
+    }
+
+    REQUIRE(getNetworkNamespacePoolStats().free == conf.maxNetNs);
+}
+
+TEST_CASE_METHOD(FaasmConfTestFixture,
+                 "Test waiting for a network namespace",
+                 "[faaslet][network]")
+{
+    conf.netNsMode = "on";
+    conf.netNsClaimTimeoutMs = 5000;
+
+    std::vector<std::shared_ptr<NetworkNamespace>> namespaces(conf.maxNetNs);
+    for (int i = 0; i < conf.maxNetNs; i++) {
+        namespaces.at(i) = claimNetworkNamespace();
+    }
+
+    // Returning one lets the waiting claim through
+    std::shared_ptr<NetworkNamespace> returned = namespaces.back();
+    std::thread t([returned] {
+        SLEEP_MS(100);
+        returnNetworkNamespace(returned);
+    });
+
+    std::shared_ptr<NetworkNamespace> claimed = claimNetworkNamespace();
+    REQUIRE(claimed == returned);
+
+    if (t.joinable()) {
+        t.join();
+    }
+
+    for (auto& ns : namespaces) {
+        returnNetworkNamespace(ns);
+    }
+}
+
+TEST_CASE_METHOD(FaasmConfTestFixture,
+                 "Test egress rates for users",
+                 "[faaslet][network]")
+{
+    REQUIRE(getEgressRateForUser("demo").empty());
+
+    conf.netNsEgressRate = "100mbit";
+    REQUIRE(getEgressRateForUser("demo") == "100mbit");
+
+    conf.netNsTenantEgressRates = "bulk=10mbit,demo=50mbit";
+    REQUIRE(getEgressRateForUser("demo") == "50mbit");
+    REQUIRE(getEgressRateForUser("bulk") == "10mbit");
+    REQUIRE(getEgressRateForUser("other") == "100mbit");
+}
+
+TEST_CASE_METHOD(FaasmConfTestFixture,
+                 "Test shaping and counters with namespaces off",
+                 "[faaslet][network]")
+{
+    conf.netNsMode = "off";
+    conf.netNsEgressRate = "100mbit";
+
+    NetworkNamespace ns(BASE_NETNS_NAME + std::string("1"));
+    ns.shapeEgress("demo");
+
+    NetworkNamespaceCounters counters = ns.getCounters();
+    REQUIRE(counters.egressBytes == 0);
+    REQUIRE(counters.ingressBytes == 0);
+}
 }
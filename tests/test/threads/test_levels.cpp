@@ -76,4 +76,95 @@ TEST_CASE("Check level serialisation sizes", "[threads]")
     size_t sizeDiff = serialisedA.size() - serialisedB.size();
     REQUIRE(sizeDiff == sharedVarOffsets.size() * sizeof(uint32_t));
 }
+
+TEST_CASE("Check resetting level shared variables", "[threads]")
+{
+    Level lvl(4);
+
+    std::vector<uint32_t> offsetsA = { 1, 2, 3 };
+    lvl.setSharedVarOffsets(offsetsA.data(), offsetsA.size());
+    REQUIRE(lvl.getSharedVarOffsets() == offsetsA);
+
+    // Same number of variables, as when a hot team forks again
+    std::vector<uint32_t> offsetsB = { 4, 5, 6 };
+    lvl.setSharedVarOffsets(offsetsB.data(), offsetsB.size());
+    REQUIRE(lvl.getSharedVarOffsets() == offsetsB);
+
+    // Different numbers of variables
+    std::vector<uint32_t> offsetsC = { 7, 8, 9, 10, 11 };
+    lvl.setSharedVarOffsets(offsetsC.data(), offsetsC.size());
+    REQUIRE(lvl.getSharedVarOffsets() == offsetsC);
+
+    std::vector<uint32_t> offsetsD = { 12 };
+    lvl.setSharedVarOffsets(offsetsD.data(), offsetsD.size());
+    REQUIRE(lvl.getSharedVarOffsets() == offsetsD);
+    REQUIRE(lvl.nSharedVarOffsets == 1);
+}
+
+TEST_CASE("Check reusing levels sent with the same context", "[threads]")
+{
+    Level lvl(4);
+    lvl.depth = 1;
+    lvl.pushedThreads = 2;
+
+    std::vector<uint32_t> offsets = { 3, 4 };
+    lvl.setSharedVarOffsets(offsets.data(), offsets.size());
+
+    auto req = faabric::util::batchExecFactory("demo", "echo", 1);
+    lvl.serialise(*req->mutable_contextdata());
+    REQUIRE(req->contextdata().size() ==
+            sizeof(Level) + offsets.size() * sizeof(uint32_t));
+
+    setCurrentOpenMPLevel(req);
+    std::shared_ptr<Level> levelA = getCurrentOpenMPLevel();
+    REQUIRE(levelA->pushedThreads == 2);
+    REQUIRE(levelA->getSharedVarOffsets() == offsets);
+
+    // Changes made by the thread don't carry over to the next section
+    levelA->pushedThreads = 5;
+    levelA->wantedThreads = 6;
+
+    // An equal level serialises the same, wherever its offsets live
+    Level lvlCopy(4);
+    lvlCopy.depth = 1;
+    lvlCopy.pushedThreads = 2;
+    lvlCopy.setSharedVarOffsets(offsets.data(), offsets.size());
+
+    auto reqB = faabric::util::batchExecFactory("demo", "echo", 1);
+    lvlCopy.serialise(*reqB->mutable_contextdata());
+    REQUIRE(reqB->contextdata() == req->contextdata());
+
+    setCurrentOpenMPLevel(reqB);
+    REQUIRE(getCurrentOpenMPLevel() == levelA);
+    REQUIRE(levelA->pushedThreads == 2);
+    REQUIRE(levelA->wantedThreads == -1);
+    REQUIRE(levelA->getSharedVarOffsets() == offsets);
+
+    // A different level is deserialised afresh
+    lvlCopy.numThreads = 3;
+    lvlCopy.serialise(*reqB->mutable_contextdata());
+    setCurrentOpenMPLevel(reqB);
+    REQUIRE(getCurrentOpenMPLevel() != levelA);
+    REQUIRE(getCurrentOpenMPLevel()->numThreads == 3);
+
+    setCurrentOpenMPLevel(std::shared_ptr<Level>(nullptr));
+}
+
+TEST_CASE("Check pthread args pointers", "[threads]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+
+    int32_t argsPtr = 0;
+    SECTION("Zero") { argsPtr = 0; }
+
+    SECTION("Large") { argsPtr = 0x7ffffff0; }
+
+    setPthreadArgsPtr(msg, argsPtr);
+    REQUIRE(msg.inputdata().size() == sizeof(int32_t));
+    REQUIRE(getPthreadArgsPtr(msg) == argsPtr);
+
+    // Args aren't parsed from strings
+    msg.set_inputdata("12345");
+    REQUIRE_THROWS(getPthreadArgsPtr(msg));
+}
 }
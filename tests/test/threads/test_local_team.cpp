@@ -0,0 +1,162 @@
+#include <catch2/catch.hpp>
+
+#include <threads/LocalTeam.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace threads;
+
+namespace tests {
+
+TEST_CASE("Test running teams on local thread pool", "[threads]")
+{
+    LocalThreadPool pool(3);
+    REQUIRE(pool.getMaxTeamSize() == 4);
+
+    int teamSize = 0;
+    SECTION("Single thread") { teamSize = 1; }
+
+    SECTION("Partial team") { teamSize = 3; }
+
+    SECTION("Full team") { teamSize = 4; }
+
+    // Run a few teams back to back to check workers are reused
+    for (int r = 0; r < 5; r++) {
+        std::vector<int32_t> results;
+        bool success = pool.tryRun(
+          teamSize, [r](int i) { return (r * 10) + i; }, results);
+        REQUIRE(success);
+
+        std::vector<int32_t> expected;
+        for (int i = 0; i < teamSize; i++) {
+            expected.push_back((r * 10) + i);
+        }
+        REQUIRE(results == expected);
+    }
+}
+
+TEST_CASE("Test local thread pool workers follow team sizes", "[threads]")
+{
+    LocalThreadPool pool(3);
+    REQUIRE(pool.getMaxTeamSize() == 4);
+
+    // No workers until a team needs them
+    REQUIRE(pool.getNumWorkers() == 0);
+
+    std::vector<int32_t> results;
+    auto task = [](int i) { return i; };
+    REQUIRE(pool.tryRun(1, task, results));
+    REQUIRE(pool.getNumWorkers() == 0);
+
+    REQUIRE(pool.tryRun(2, task, results));
+    REQUIRE(pool.getNumWorkers() == 1);
+
+    REQUIRE(pool.tryRun(4, task, results));
+    REQUIRE(pool.getNumWorkers() == 3);
+
+    // Workers are only stopped once a whole run of teams hasn't needed them
+    for (int r = 0; r < 2 * LOCAL_POOL_SHRINK_RUNS; r++) {
+        REQUIRE(pool.tryRun(2, task, results));
+        REQUIRE(results == std::vector<int32_t>({ 0, 1 }));
+    }
+    REQUIRE(pool.getNumWorkers() == 1);
+
+    // The pool grows again when needed
+    REQUIRE(pool.tryRun(4, task, results));
+    REQUIRE(results == std::vector<int32_t>({ 0, 1, 2, 3 }));
+    REQUIRE(pool.getNumWorkers() == 3);
+}
+
+TEST_CASE("Test local thread pool rejects oversized teams", "[threads]")
+{
+    LocalThreadPool pool(2);
+
+    std::vector<int32_t> results;
+    bool called = false;
+    bool success = pool.tryRun(
+      4,
+      [&called](int) {
+          called = true;
+          return 0;
+      },
+      results);
+
+    REQUIRE(!success);
+    REQUIRE(!called);
+    REQUIRE(results.empty());
+}
+
+TEST_CASE("Test local thread pool rethrows task exceptions", "[threads]")
+{
+    LocalThreadPool pool(3);
+
+    std::atomic<int> nRun = 0;
+    std::vector<int32_t> results;
+    auto task = [&nRun](int i) {
+        nRun++;
+        if (i == 2) {
+            throw std::runtime_error("Task failed");
+        }
+        return 0;
+    };
+
+    REQUIRE_THROWS_AS(pool.tryRun(4, task, results), std::runtime_error);
+
+    // Every thread must have finished before the exception comes back
+    REQUIRE(nRun == 4);
+
+    // The pool is still usable afterwards
+    REQUIRE(pool.tryRun(
+      4, [](int i) { return i; }, results));
+    REQUIRE(results == std::vector<int32_t>({ 0, 1, 2, 3 }));
+}
+
+TEST_CASE("Test local team barrier", "[threads]")
+{
+    int teamSize = 4;
+    int nRounds = 50;
+
+    LocalThreadPool pool(teamSize - 1);
+    LocalTeam team(teamSize);
+
+    // Every thread must see all increments from the previous round before it
+    // starts the next one
+    std::atomic<int> counter = 0;
+    std::vector<int32_t> results;
+    bool success = pool.tryRun(
+      teamSize,
+      [&](int i) {
+          for (int r = 0; r < nRounds; r++) {
+              counter++;
+              team.barrier();
+
+              if (counter.load() < (r + 1) * teamSize) {
+                  return 1;
+              }
+
+              team.barrier();
+          }
+
+          return 0;
+      },
+      results);
+
+    REQUIRE(success);
+    REQUIRE(results == std::vector<int32_t>(teamSize, 0));
+    REQUIRE(counter == teamSize * nRounds);
+}
+
+TEST_CASE("Test current local team", "[threads]")
+{
+    REQUIRE(getCurrentLocalTeam() == nullptr);
+
+    auto team = std::make_shared<LocalTeam>(3);
+    setCurrentLocalTeam(team);
+    REQUIRE(getCurrentLocalTeam() == team);
+
+    setCurrentLocalTeam(nullptr);
+    REQUIRE(getCurrentLocalTeam() == nullptr);
+}
+}
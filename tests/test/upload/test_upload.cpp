@@ -14,8 +14,12 @@
 #include <boost/filesystem.hpp>
 
 #include <conf/FaasmConfig.h>
+#include <storage/CodegenManifest.h>
 #include <storage/FileLoader.h>
+#include <storage/SharedBundle.h>
+#include <upload/UploadJobs.h>
 #include <upload/UploadServer.h>
+#include <wasm/function_profile.h>
 
 using namespace web::http::experimental::listener;
 using namespace web::http;
@@ -45,6 +49,24 @@ class UploadTestFixture
         return request;
     }
 
+    http_request createAsyncRequest(const std::string& path,
+                                    const std::vector<uint8_t>& inputData)
+    {
+        http_request request = createRequest(path, inputData);
+
+        uri_builder builder(request.request_uri());
+        builder.append_query(ASYNC_QUERY_PARAM, "1");
+        request.set_request_uri(builder.to_uri());
+
+        return request;
+    }
+
+    std::string getResponseBody(http_response& response)
+    {
+        std::vector<uint8_t> bytes = response.extract_vector().get();
+        return std::string(bytes.begin(), bytes.end());
+    }
+
     void addRequestFilePathHeader(http_request request,
                                   const std::string& relativePath)
     {
@@ -86,6 +108,17 @@ class UploadTestFixture
         REQUIRE(s3bytes.size() == expectedBytes.size());
         REQUIRE(s3bytes == expectedBytes);
     }
+
+    void checkManifestEntry(const std::string& bucket,
+                            const std::string& manifestKey,
+                            const std::string& artefactKey,
+                            const std::vector<uint8_t>& wasmBytes)
+    {
+        storage::CodegenManifest manifest(s3.getKeyBytes(bucket, manifestKey));
+        storage::CodegenManifestEntry entry = manifest.getEntry(artefactKey);
+        REQUIRE(entry.hash == storage::hashCodegenInput(wasmBytes));
+        REQUIRE(entry.options == conf.wasmVm);
+    }
 };
 
 TEST_CASE_METHOD(UploadTestFixture, "Test upload and download", "[upload]")
@@ -153,20 +186,78 @@ TEST_CASE_METHOD(UploadTestFixture, "Test upload and download", "[upload]")
         // Ensure environment is clean before running
         std::string fileKey = "gamma/delta/function.wasm";
         std::string objFileKey = "gamma/delta/function.wasm.o";
-        std::string objFileHashKey = "gamma/delta/function.wasm.o.md5";
+        std::string manifestKey = "gamma/codegen.manifest";
+        std::string metadataKey = "gamma/delta/function.meta";
         s3.deleteKey(conf.s3Bucket, fileKey);
         s3.deleteKey(conf.s3Bucket, objFileKey);
-        s3.deleteKey(conf.s3Bucket, objFileHashKey);
+        s3.deleteKey(conf.s3Bucket, manifestKey);
+        s3.deleteKey(conf.s3Bucket, metadataKey);
 
-        // Check putting the file adds three keys
+        // Check putting the file adds four keys
         std::string url = fmt::format("/{}/gamma/delta", FUNCTION_URL_PART);
         http_request request = createRequest(url, wasmBytesA);
-        checkPut(request, 3);
+        checkPut(request, 4);
 
-        // Check wasm, object file and hash stored in s3
+        // Check wasm, object file and manifest stored in s3
         checkS3bytes(conf.s3Bucket, fileKey, wasmBytesA);
         checkS3bytes(conf.s3Bucket, objFileKey, objBytesA);
-        checkS3bytes(conf.s3Bucket, objFileHashKey, hashBytesA);
+
+        // Check the metadata lists both artefacts
+        storage::FunctionMetadata metadata(
+          s3.getKeyBytes(conf.s3Bucket, metadataKey));
+        REQUIRE(metadata.getArtefact("function.wasm").hash ==
+                storage::hashCodegenInput(wasmBytesA));
+        REQUIRE(metadata.getArtefact("function.wasm").size ==
+                wasmBytesA.size());
+        REQUIRE(metadata.getArtefact("function.wasm.o").size ==
+                objBytesA.size());
+        checkManifestEntry(conf.s3Bucket, manifestKey, objFileKey, wasmBytesA);
+    }
+
+    SECTION("Test uploading function preloads")
+    {
+        std::string preloadKey = "gamma/delta/function.preload";
+        std::string metadataKey = "gamma/delta/function.meta";
+        s3.deleteKey(conf.s3Bucket, preloadKey);
+        s3.deleteKey(conf.s3Bucket, metadataKey);
+
+        // Comments and blank lines are dropped before storing
+        std::string body = "# numpy\n/lib/a.so\n\n  /lib/b.so \n";
+        std::string url = fmt::format("/{}/gamma/delta", PRELOAD_URL_PART);
+        http_request request =
+          createRequest(url, std::vector<uint8_t>(body.begin(), body.end()));
+        checkPut(request, 2);
+
+        std::string expected = "/lib/a.so\n/lib/b.so\n";
+        checkS3bytes(conf.s3Bucket,
+                     preloadKey,
+                     std::vector<uint8_t>(expected.begin(), expected.end()));
+    }
+
+    SECTION("Test uploading function profile")
+    {
+        std::string metadataKey = "gamma/delta/function.meta";
+        s3.deleteKey(conf.s3Bucket, metadataKey);
+
+        std::string body = "# Small function\nmax-memory-pages=100\n"
+                           "wasm-vm=wamr\n";
+        std::string url = fmt::format("/{}/gamma/delta", PROFILE_URL_PART);
+        http_request request =
+          createRequest(url, std::vector<uint8_t>(body.begin(), body.end()));
+        checkPut(request, 1);
+
+        storage::FunctionMetadata metadata(
+          s3.getKeyBytes(conf.s3Bucket, metadataKey));
+        REQUIRE(metadata.getHint(PROFILE_MAX_MEMORY_PAGES) == "100");
+        REQUIRE(metadata.getHint(PROFILE_WASM_VM) == "wamr");
+
+        // Invalid profiles are rejected outright
+        body = "max-memory-pages=100\nwasm-vm=foo\n";
+        request =
+          createRequest(url, std::vector<uint8_t>(body.begin(), body.end()));
+        edge::UploadServer::handlePut(request);
+        http_response response = request.get_response().get();
+        REQUIRE(response.status_code() == status_codes::BadRequest);
     }
 
     SECTION("Test uploading and downloading shared file")
@@ -192,6 +283,31 @@ TEST_CASE_METHOD(UploadTestFixture, "Test upload and download", "[upload]")
         checkGet(requestB, fileBytes);
     }
 
+    SECTION("Test uploading shared bundle")
+    {
+        std::vector<uint8_t> bundleBytes =
+          storage::buildSharedBundle({ { "a.py", { 0, 1, 2 } } });
+
+        std::string bundleKey =
+          fmt::format("test/bundle/{}", SHARED_BUNDLE_NAME);
+        s3.deleteKey(conf.s3Bucket, bundleKey);
+
+        std::string url = fmt::format("/{}/", SHARED_BUNDLE_URL_PART);
+        http_request request = createRequest(url, bundleBytes);
+        addRequestFilePathHeader(request, "test/bundle");
+
+        checkPut(request, 1);
+
+        checkS3bytes(conf.s3Bucket, bundleKey, bundleBytes);
+
+        // Check junk is rejected
+        http_request requestB = createRequest(url, { 0, 1, 2 });
+        addRequestFilePathHeader(requestB, "test/bundle");
+        edge::UploadServer::handlePut(requestB);
+        http_response response = requestB.get_response().get();
+        REQUIRE(response.status_code() == status_codes::BadRequest);
+    }
+
     SECTION("Test uploading and downloading python file")
     {
         std::vector<uint8_t> fileBytes = { 8, 8, 7, 7, 6, 6 };
@@ -221,38 +337,123 @@ TEST_CASE_METHOD(UploadTestFixture, "Test upload and download", "[upload]")
     }
 }
 
+TEST_CASE_METHOD(UploadTestFixture, "Test ranged downloads", "[upload]")
+{
+    std::vector<uint8_t> bytes = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+
+    std::string url;
+    std::string fileKey;
+    SECTION("State")
+    {
+        url = fmt::format("/{}/foo/ranged", STATE_URL_PART);
+        edge::UploadServer::handlePut(createRequest(url, bytes));
+    }
+
+    SECTION("Shared file")
+    {
+        url = fmt::format("/{}/", SHARED_FILE_URL_PART);
+        fileKey = "test/ranged_file.txt";
+        s3.deleteKey(conf.s3Bucket, fileKey);
+
+        http_request putRequest = createRequest(url, bytes);
+        addRequestFilePathHeader(putRequest, fileKey);
+        checkPut(putRequest, 1);
+    }
+
+    std::string range;
+    int expectedStatus = status_codes::PartialContent;
+    std::string expectedContentRange;
+    std::vector<uint8_t> expected;
+
+    SECTION("Start and end")
+    {
+        range = "bytes=2-5";
+        expectedContentRange = "bytes 2-5/10";
+        expected = { 2, 3, 4, 5 };
+    }
+
+    SECTION("Open ended")
+    {
+        range = "bytes=7-";
+        expectedContentRange = "bytes 7-9/10";
+        expected = { 7, 8, 9 };
+    }
+
+    SECTION("End past the value")
+    {
+        range = "bytes=8-100";
+        expectedContentRange = "bytes 8-9/10";
+        expected = { 8, 9 };
+    }
+
+    SECTION("Suffix")
+    {
+        range = "bytes=-3";
+        expectedContentRange = "bytes 7-9/10";
+        expected = { 7, 8, 9 };
+    }
+
+    SECTION("Multiple ranges get everything")
+    {
+        range = "bytes=0-1,4-5";
+        expectedStatus = status_codes::OK;
+        expected = bytes;
+    }
+
+    SECTION("Unsatisfiable")
+    {
+        range = "bytes=10-";
+        expectedStatus = status_codes::RangeNotSatisfiable;
+        expectedContentRange = "bytes */10";
+    }
+
+    http_request request = createRequest(url);
+    if (!fileKey.empty()) {
+        addRequestFilePathHeader(request, fileKey);
+    }
+    request.headers().add(header_names::range, range);
+
+    edge::UploadServer::handleGet(request);
+    http_response response = request.get_response().get();
+    REQUIRE(response.status_code() == expectedStatus);
+
+    if (expectedContentRange.empty()) {
+        REQUIRE(!response.headers().has(header_names::content_range));
+    } else {
+        REQUIRE(response.headers()[header_names::content_range] ==
+                expectedContentRange);
+    }
+
+    if (expectedStatus != status_codes::RangeNotSatisfiable) {
+        REQUIRE(response.extract_vector().get() == expected);
+    }
+}
+
 TEST_CASE_METHOD(UploadTestFixture,
                  "Test uploading function always overwrites",
                  "[upload]")
 {
     std::string fileKey = "gamma/delta/function.wasm";
+    std::string manifestKey = "gamma/codegen.manifest";
+    std::string metadataKey = "gamma/delta/function.meta";
     std::string objFileKey;
-    std::string objFileHashKey;
     std::vector<uint8_t> actualObjBytesA;
     std::vector<uint8_t> actualObjBytesB;
-    std::vector<uint8_t> actualHashBytesA;
-    std::vector<uint8_t> actualHashBytesB;
 
     SECTION("WAVM")
     {
         conf.wasmVm = "wavm";
         objFileKey = "gamma/delta/function.wasm.o";
-        objFileHashKey = "gamma/delta/function.wasm.o.md5";
         actualObjBytesA = objBytesA;
         actualObjBytesB = objBytesB;
-        actualHashBytesA = hashBytesA;
-        actualHashBytesB = hashBytesB;
     }
 
     SECTION("WAMR")
     {
         conf.wasmVm = "wamr";
         objFileKey = "gamma/delta/function.aot";
-        objFileHashKey = "gamma/delta/function.aot.md5";
         actualObjBytesA = wamrObjBytesA;
         actualObjBytesB = wamrObjBytesB;
-        actualHashBytesA = wamrHashBytesA;
-        actualHashBytesB = wamrHashBytesB;
     }
 
 #ifndef FAASM_SGX_DISABLED_MODE
@@ -260,27 +461,25 @@ TEST_CASE_METHOD(UploadTestFixture,
     {
         conf.wasmVm = "sgx";
         objFileKey = "gamma/delta/function.aot.sgx";
-        objFileHashKey = "gamma/delta/function.aot.sgx.md5";
         actualObjBytesA = sgxObjBytesA;
         actualObjBytesB = sgxObjBytesB;
-        actualHashBytesA = sgxHashBytesA;
-        actualHashBytesB = sgxHashBytesB;
     }
 #endif
 
     // Ensure environment is clean before running
     s3.deleteKey(conf.s3Bucket, fileKey);
     s3.deleteKey(conf.s3Bucket, objFileKey);
-    s3.deleteKey(conf.s3Bucket, objFileHashKey);
+    s3.deleteKey(conf.s3Bucket, manifestKey);
+    s3.deleteKey(conf.s3Bucket, metadataKey);
 
     std::string url = fmt::format("/{}/gamma/delta", FUNCTION_URL_PART);
 
     // First, upload one WASM file under the given path
     http_request request = createRequest(url, wasmBytesA);
-    checkPut(request, 3);
+    checkPut(request, 4);
     checkS3bytes(conf.s3Bucket, fileKey, wasmBytesA);
     // checkS3bytes(conf.s3Bucket, objFileKey, actualObjBytesA);
-    checkS3bytes(conf.s3Bucket, objFileHashKey, actualHashBytesA);
+    checkManifestEntry(conf.s3Bucket, manifestKey, objFileKey, wasmBytesA);
 
     SPDLOG_INFO("no error thus far!");
 
@@ -290,7 +489,124 @@ TEST_CASE_METHOD(UploadTestFixture,
     checkPut(request, 0);
     checkS3bytes(conf.s3Bucket, fileKey, wasmBytesB);
     checkS3bytes(conf.s3Bucket, objFileKey, actualObjBytesB);
-    checkS3bytes(conf.s3Bucket, objFileHashKey, actualHashBytesB);
+    checkManifestEntry(conf.s3Bucket, manifestKey, objFileKey, wasmBytesB);
+}
+
+TEST_CASE_METHOD(UploadTestFixture,
+                 "Test uploading unchanged function is skipped",
+                 "[upload]")
+{
+    std::string fileKey = "gamma/delta/function.wasm";
+    std::string objFileKey = "gamma/delta/function.wasm.o";
+    std::string manifestKey = "gamma/codegen.manifest";
+    std::string metadataKey = "gamma/delta/function.meta";
+    s3.deleteKey(conf.s3Bucket, fileKey);
+    s3.deleteKey(conf.s3Bucket, objFileKey);
+    s3.deleteKey(conf.s3Bucket, manifestKey);
+    s3.deleteKey(conf.s3Bucket, metadataKey);
+
+    conf.wasmVm = "wavm";
+    std::string url = fmt::format("/{}/gamma/delta", FUNCTION_URL_PART);
+
+    http_request request = createRequest(url, wasmBytesA);
+    checkPut(request, 4);
+    std::string etag = s3.getKeyETag(conf.s3Bucket, objFileKey);
+
+    // Uploading the same bytes again changes nothing
+    request = createRequest(url, wasmBytesA);
+    edge::UploadServer::handlePut(request);
+    http_response response = request.get_response().get();
+    REQUIRE(response.status_code() == status_codes::OK);
+    REQUIRE(getResponseBody(response) == "Function unchanged\n");
+    REQUIRE(s3.getKeyETag(conf.s3Bucket, objFileKey) == etag);
+
+    // Changing the codegen settings means generating machine code again
+    conf.wasmVm = "wamr";
+    request = createRequest(url, wasmBytesA);
+    edge::UploadServer::handlePut(request);
+    response = request.get_response().get();
+    REQUIRE(response.status_code() == status_codes::OK);
+    REQUIRE(getResponseBody(response) == "Function upload complete\n");
+
+    // As does changing the wasm
+    conf.wasmVm = "wavm";
+    request = createRequest(url, wasmBytesB);
+    edge::UploadServer::handlePut(request);
+    response = request.get_response().get();
+    REQUIRE(getResponseBody(response) == "Function upload complete\n");
+    checkS3bytes(conf.s3Bucket, fileKey, wasmBytesB);
+}
+
+TEST_CASE_METHOD(UploadTestFixture, "Test uploading an archive", "[upload]")
+{
+    std::string fileKey = "gamma/delta/function.wasm";
+    std::string objFileKey = "gamma/delta/function.wasm.o";
+    std::string manifestKey = "gamma/codegen.manifest";
+    std::string metadataKey = "gamma/delta/function.meta";
+    std::string sharedKey = "test/archive/file.txt";
+    s3.deleteKey(conf.s3Bucket, fileKey);
+    s3.deleteKey(conf.s3Bucket, objFileKey);
+    s3.deleteKey(conf.s3Bucket, manifestKey);
+    s3.deleteKey(conf.s3Bucket, metadataKey);
+    s3.deleteKey(conf.s3Bucket, sharedKey);
+
+    conf.wasmVm = "wavm";
+    std::vector<uint8_t> sharedBytes = { 0, 1, 2, 3 };
+    std::vector<uint8_t> stateBytes = { 4, 5, 6 };
+    std::vector<uint8_t> archiveBytes = storage::buildSharedBundle({
+      { "f/gamma/delta", wasmBytesA },
+      { "file/test/archive/file.txt", sharedBytes },
+      { "s/gamma/archived", stateBytes },
+    });
+
+    std::string url = fmt::format("/{}", ARCHIVE_URL_PART);
+    http_request request = createRequest(url, archiveBytes);
+    checkPut(request, 5);
+
+    checkS3bytes(conf.s3Bucket, fileKey, wasmBytesA);
+    checkS3bytes(conf.s3Bucket, sharedKey, sharedBytes);
+    checkManifestEntry(conf.s3Bucket, manifestKey, objFileKey, wasmBytesA);
+
+    faabric::state::State& state = faabric::state::getGlobalState();
+    std::vector<uint8_t> actualState(stateBytes.size());
+    state.getKV("gamma", "archived", stateBytes.size())
+      ->get(actualState.data());
+    REQUIRE(actualState == stateBytes);
+
+    // Uploading it again leaves the function and file alone
+    std::string objETag = s3.getKeyETag(conf.s3Bucket, objFileKey);
+    request = createRequest(url, archiveBytes);
+    checkPut(request, 0);
+    REQUIRE(s3.getKeyETag(conf.s3Bucket, objFileKey) == objETag);
+}
+
+TEST_CASE_METHOD(UploadTestFixture,
+                 "Test uploading invalid archives",
+                 "[upload]")
+{
+    std::string url = fmt::format("/{}", ARCHIVE_URL_PART);
+    http_request request;
+
+    SECTION("Invalid archive")
+    {
+        request = createRequest(url, { 1, 2, 3 });
+    }
+
+    SECTION("Unknown path")
+    {
+        request = createRequest(
+          url, storage::buildSharedBundle({ { "x/gamma/delta", wasmBytesA } }));
+    }
+
+    SECTION("Function path without a user")
+    {
+        request = createRequest(
+          url, storage::buildSharedBundle({ { "f/delta", wasmBytesA } }));
+    }
+
+    edge::UploadServer::handlePut(request);
+    http_response response = request.get_response().get();
+    REQUIRE(response.status_code() == status_codes::BadRequest);
 }
 
 TEST_CASE_METHOD(UploadTestFixture,
@@ -366,4 +682,49 @@ TEST_CASE_METHOD(UploadTestFixture, "Test upload server ping", "[upload]")
 
     REQUIRE(responseStr == "PONG");
 }
+
+TEST_CASE_METHOD(UploadTestFixture,
+                 "Test uploading function asynchronously",
+                 "[upload]")
+{
+    std::string fileKey = "gamma/delta/function.wasm";
+    std::string objFileKey = "gamma/delta/function.wasm.o";
+    std::string manifestKey = "gamma/codegen.manifest";
+    s3.deleteKey(conf.s3Bucket, fileKey);
+    s3.deleteKey(conf.s3Bucket, objFileKey);
+    s3.deleteKey(conf.s3Bucket, manifestKey);
+
+    // The upload replies straight away with the job to poll
+    std::string url = fmt::format("/{}/gamma/delta", FUNCTION_URL_PART);
+    http_request request = createAsyncRequest(url, wasmBytesA);
+    edge::UploadServer::handlePut(request);
+
+    http_response response = request.get_response().get();
+    REQUIRE(response.status_code() == status_codes::Accepted);
+    int jobId = std::stoi(getResponseBody(response));
+
+    edge::UploadJob job = edge::getUploadJobQueue().awaitJob(jobId);
+    REQUIRE(job.status == edge::UploadJobStatus::Succeeded);
+
+    checkS3bytes(conf.s3Bucket, fileKey, wasmBytesA);
+    checkS3bytes(conf.s3Bucket, objFileKey, objBytesA);
+    checkManifestEntry(conf.s3Bucket, manifestKey, objFileKey, wasmBytesA);
+
+    // Polling the job gives its status
+    std::string jobUrl = fmt::format("/{}/{}", JOB_URL_PART, jobId);
+    http_request jobRequest = createRequest(jobUrl);
+    edge::UploadServer::handleGet(jobRequest);
+
+    http_response jobResponse = jobRequest.get_response().get();
+    REQUIRE(jobResponse.status_code() == status_codes::OK);
+    REQUIRE(getResponseBody(jobResponse) == "SUCCEEDED");
+
+    // Jobs that don't exist aren't found
+    std::string missingUrl = fmt::format("/{}/{}", JOB_URL_PART, jobId + 1000);
+    http_request missingRequest = createRequest(missingUrl);
+    edge::UploadServer::handleGet(missingRequest);
+
+    http_response missingResponse = missingRequest.get_response().get();
+    REQUIRE(missingResponse.status_code() == status_codes::NotFound);
+}
 }
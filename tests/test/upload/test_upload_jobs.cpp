@@ -0,0 +1,90 @@
+#include <catch2/catch.hpp>
+
+#include <upload/UploadJobs.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tests {
+
+TEST_CASE("Test running upload jobs", "[upload]")
+{
+    edge::UploadJobQueue jobQueue(2, 10);
+
+    std::atomic<int> nRun = 0;
+    std::vector<int> ids;
+    for (int i = 0; i < 5; i++) {
+        ids.push_back(
+          jobQueue.submit("job-" + std::to_string(i), [&nRun] { nRun++; }));
+    }
+
+    int failedId =
+      jobQueue.submit("bad", [] { throw std::runtime_error("Bad upload"); });
+
+    for (int id : ids) {
+        REQUIRE(id > 0);
+        edge::UploadJob job = jobQueue.awaitJob(id);
+        REQUIRE(job.status == edge::UploadJobStatus::Succeeded);
+        REQUIRE(job.error.empty());
+    }
+
+    edge::UploadJob failed = jobQueue.awaitJob(failedId);
+    REQUIRE(failed.name == "bad");
+    REQUIRE(failed.status == edge::UploadJobStatus::Failed);
+    REQUIRE(failed.error == "Bad upload");
+
+    REQUIRE(nRun == 5);
+
+    // Finished jobs can still be looked up
+    edge::UploadJob job;
+    REQUIRE(jobQueue.getJob(ids.front(), job));
+    REQUIRE(job.isFinished());
+    REQUIRE(!jobQueue.getJob(failedId + 1, job));
+
+    REQUIRE(edge::uploadJobStatusToString(job.status) == "SUCCEEDED");
+}
+
+TEST_CASE("Test upload job queue limit", "[upload]")
+{
+    edge::UploadJobQueue jobQueue(1, 2);
+
+    // Hold up the only worker until we're done filling the queue
+    std::atomic<bool> release = false;
+    std::atomic<bool> started = false;
+    int blockingId = jobQueue.submit("blocking", [&] {
+        started = true;
+        while (!release) {
+            std::this_thread::yield();
+        }
+    });
+
+    while (!started) {
+        std::this_thread::yield();
+    }
+
+    int idA = jobQueue.submit("a", [] {});
+    int idB = jobQueue.submit("b", [] {});
+    int idC = jobQueue.submit("c", [] {});
+
+    REQUIRE(idA > 0);
+    REQUIRE(idB > 0);
+    REQUIRE(idC == -1);
+    REQUIRE(jobQueue.getQueuedCount() == 2);
+
+    edge::UploadJob job;
+    REQUIRE(jobQueue.getJob(blockingId, job));
+    REQUIRE(job.status == edge::UploadJobStatus::Running);
+    REQUIRE(jobQueue.getJob(idA, job));
+    REQUIRE(job.status == edge::UploadJobStatus::Queued);
+
+    release = true;
+
+    // Shutting down still runs what's queued
+    jobQueue.shutdown();
+    REQUIRE(jobQueue.awaitJob(idB).status == edge::UploadJobStatus::Succeeded);
+    REQUIRE_THROWS(jobQueue.submit("d", [] {}));
+}
+}
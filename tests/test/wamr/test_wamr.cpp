@@ -3,6 +3,8 @@
 #include "faasm_fixtures.h"
 #include "utils.h"
 
+#include <faabric/state/State.h>
+#include <faabric/util/bytes.h>
 #include <faabric/util/config.h>
 #include <faabric/util/func.h>
 
@@ -76,6 +78,94 @@ TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
     f.shutdown();
 }
 
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test WAMR modules share a cached module",
+                 "[wamr]")
+{
+    auto req = setUpContext("demo", "echo");
+    faabric::Message& msg = req->mutable_messages()->at(0);
+
+    wasm::WAMRModuleCache& cache = wasm::getWAMRModuleCache();
+
+    wasm::WAMRWasmModule moduleA;
+    moduleA.bindToFunction(msg);
+    size_t cachedCount = cache.getTotalCachedModuleCount();
+    REQUIRE(cachedCount > 0);
+
+    // Binding another module to the same function should not load it again
+    wasm::WAMRWasmModule moduleB;
+    moduleB.bindToFunction(msg);
+    REQUIRE(cache.getTotalCachedModuleCount() == cachedCount);
+    REQUIRE(moduleA.getWasmModule() != nullptr);
+    REQUIRE(moduleA.getWasmModule() == cache.getCachedModule(msg));
+    REQUIRE(moduleB.getWasmModule() == moduleA.getWasmModule());
+
+    // Check both can execute independently
+    msg.set_inputdata("hello there");
+    REQUIRE(moduleA.executeFunction(msg) == 0);
+    REQUIRE(moduleB.executeFunction(msg) == 0);
+}
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test WAMR execution environments are kept between calls",
+                 "[wamr]")
+{
+    auto req = setUpContext("demo", "echo");
+    faabric::Message& msg = req->mutable_messages()->at(0);
+
+    uint32_t expectedStackSize = 0;
+    SECTION("Default stack size")
+    {
+        conf.wamrFunctionStackSizes = "demo/hello=1024";
+        expectedStackSize = conf.wamrStackSize;
+    }
+
+    SECTION("Function stack size")
+    {
+        conf.wamrFunctionStackSizes = "demo/hello=1024,demo/echo=4096";
+        expectedStackSize = 4096;
+    }
+
+    REQUIRE(getWamrStackSize(msg) == expectedStackSize);
+
+    wasm::WAMRWasmModule module;
+    module.bindToFunction(msg);
+    REQUIRE(module.getExecEnvStackSize() == expectedStackSize);
+
+    msg.set_inputdata("first");
+    REQUIRE(module.executeFunction(msg) == 0);
+    WASMExecEnv* execEnv = module.getMainExecEnv();
+
+    // Later calls run in the same environment
+    msg.set_inputdata("second");
+    REQUIRE(module.executeFunction(msg) == 0);
+    REQUIRE(module.getMainExecEnv() == execEnv);
+}
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test WAMR globals lock stats",
+                 "[wamr]")
+{
+    auto req = setUpContext("demo", "echo");
+    faabric::Message& msg = req->mutable_messages()->at(0);
+
+    wasm::WAMRWasmModule::resetGlobalsLockStats();
+    wasm::WAMRLockStats statsBefore = wasm::WAMRWasmModule::getGlobalsLockStats();
+    REQUIRE(statsBefore.acquired == 0);
+    REQUIRE(statsBefore.contended == 0);
+
+    {
+        wasm::WAMRWasmModule module;
+        module.bindToFunction(msg);
+    }
+
+    // Binding and destructing must take the lock at least once each, but
+    // there is nothing to contend with here
+    wasm::WAMRLockStats statsAfter = wasm::WAMRWasmModule::getGlobalsLockStats();
+    REQUIRE(statsAfter.acquired >= 2);
+    REQUIRE(statsAfter.contended == 0);
+}
+
 TEST_CASE_METHOD(FunctionExecTestFixture, "Test WAMR sbrk", "[wamr]")
 {
     auto req = setUpContext("demo", "echo");
@@ -144,4 +234,26 @@ TEST_CASE_METHOD(FunctionExecTestFixture,
         SPDLOG_ERROR("WASM module malloc failed!");
     }
 }
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test WAMR offset state calls",
+                 "[wamr]")
+{
+    auto req = setUpContext("demo", "state_offset");
+    faabric::Message& msg = req->mutable_messages()->at(0);
+
+    wasm::WAMRWasmModule module;
+    module.bindToFunction(msg);
+    REQUIRE(module.executeFunction(msg) == 0);
+
+    std::vector<uint8_t> expectedOutput = { 5, 5, 6, 6, 4 };
+    REQUIRE(faabric::util::stringToBytes(msg.outputdata()) == expectedOutput);
+
+    auto kv =
+      faabric::state::getGlobalState().getKV("demo", "state_offset_example", 0);
+    std::vector<uint8_t> expectedState = { 5, 5, 6, 6, 4, 5, 6 };
+    std::vector<uint8_t> actualState(kv->size(), 0);
+    kv->get(actualState.data());
+    REQUIRE(actualState == expectedState);
+}
 }
@@ -0,0 +1,57 @@
+#include <catch2/catch.hpp>
+
+#include <faabric/util/func.h>
+
+#include <wasm/call_metrics.h>
+
+using namespace wasm;
+
+namespace tests {
+
+TEST_CASE("Test recording host calls", "[wasm]")
+{
+    startCallMetrics();
+
+    HOST_CALL(State);
+    HOST_CALL(State);
+    HOST_CALL(Mpi);
+
+    CallMetrics metrics = takeCallMetrics();
+    REQUIRE(metrics.hostCalls[(int)HostCallCategory::State] == 2);
+    REQUIRE(metrics.hostCalls[(int)HostCallCategory::Mpi] == 1);
+    REQUIRE(metrics.hostCalls[(int)HostCallCategory::Other] == 0);
+
+    // Taking the metrics clears them
+    CallMetrics cleared = takeCallMetrics();
+    for (auto nCalls : cleared.hostCalls) {
+        REQUIRE(nCalls == 0);
+    }
+}
+
+TEST_CASE("Test flushing call metrics", "[wasm]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+
+    startCallMetrics();
+    HOST_CALL(Filesystem);
+
+    uint64_t snapshotBytes = 0;
+    SECTION("No snapshot") {}
+
+    SECTION("With snapshot") { snapshotBytes = 4096; }
+
+    flushCallMetrics(msg, 65536, snapshotBytes);
+
+    const auto& details = msg.execgraphdetails();
+    REQUIRE(details.count("cpu-us") == 1);
+    REQUIRE(details.at("peak-memory-bytes") == "65536");
+    REQUIRE(details.at("host-calls-filesystem") == "1");
+    REQUIRE(details.count("host-calls-state") == 0);
+
+    if (snapshotBytes > 0) {
+        REQUIRE(details.at("snapshot-bytes") == "4096");
+    } else {
+        REQUIRE(details.count("snapshot-bytes") == 0);
+    }
+}
+}
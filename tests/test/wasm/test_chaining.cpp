@@ -0,0 +1,276 @@
+#include <catch2/catch.hpp>
+
+#include "fixtures.h"
+
+#include <faabric/state/State.h>
+#include <faabric/util/config.h>
+#include <faabric/util/func.h>
+#include <faabric/util/macros.h>
+
+#include <conf/FaasmConfig.h>
+#include <wasm/chaining.h>
+#include <wasm/chaining_dag.h>
+#include <wasm/chaining_input.h>
+#include <wasm/chaining_results.h>
+#include <wasm/chaining_shm.h>
+#include <wasm/chaining_stream.h>
+
+#include <thread>
+#include <unistd.h>
+
+using namespace wasm;
+
+namespace tests {
+
+TEST_CASE_METHOD(StateTestFixture, "Test state affinity host", "[wasm]")
+{
+    std::string user = "demo";
+    std::string thisHost = faabric::util::getSystemConfig().endpointHost;
+
+    // No keys, or keys nobody has created yet, give no preference
+    REQUIRE(getStateAffinityHost(user, {}).empty());
+    REQUIRE(getStateAffinityHost(user, { "affinity_a" }).empty());
+
+    // Creating the keys here makes this host their master
+    faabric::state::getGlobalState().getKV(user, "affinity_a", 10);
+    faabric::state::getGlobalState().getKV(user, "affinity_b", 10);
+
+    REQUIRE(getStateAffinityHost(user, { "affinity_a" }) == thisHost);
+    REQUIRE(getStateAffinityHost(
+              user, { "affinity_a", "affinity_b", "affinity_c" }) == thisHost);
+}
+
+TEST_CASE_METHOD(StateTestFixture, "Test chained call state inputs", "[wasm]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    msg.set_inputdata("foo");
+
+    ChainedInputRef ref;
+    REQUIRE(!hasChainedInputRef(msg));
+    REQUIRE(!getChainedInputRef(msg, ref));
+
+    // The reference replaces any input in the message
+    setChainedInputRef(msg, { "input_a", 4, 6 });
+    REQUIRE(msg.inputdata().empty());
+    REQUIRE(hasChainedInputRef(msg));
+    REQUIRE(getChainedInputRef(msg, ref));
+    REQUIRE(ref.key == "input_a");
+    REQUIRE(ref.offset == 4);
+    REQUIRE(ref.length == 6);
+
+    std::vector<uint8_t> value = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+    auto kv = faabric::state::getGlobalState().getKV("demo", "input_a", 10);
+    kv->set(value.data());
+
+    std::vector<uint8_t> input(ref.length);
+    resolveChainedInputRef("demo", ref)
+      ->getChunk(ref.offset, input.data(), input.size());
+    REQUIRE(input == std::vector<uint8_t>({ 4, 5, 6, 7, 8, 9 }));
+
+    // Ranges past the end of the value are rejected
+    REQUIRE_THROWS(resolveChainedInputRef("demo", { "input_a", 5, 6 }));
+    REQUIRE_THROWS(resolveChainedInputRef("demo", { "input_a", 11, 0 }));
+}
+
+TEST_CASE("Test ordering chained call graphs", "[wasm]")
+{
+    REQUIRE(getChainedDagOrder(0, {}).empty());
+    REQUIRE(getChainedDagOrder(3, {}) == std::vector<int>({ 0, 1, 2 }));
+
+    // A diamond, given out of order
+    std::vector<ChainedDagEdge> edges = {
+        { 3, 1 }, { 0, 3 }, { 0, 2 }, { 2, 1 }
+    };
+    std::vector<int> order = getChainedDagOrder(4, edges);
+    REQUIRE(order.size() == 4);
+
+    std::vector<int> positions(4);
+    for (int i = 0; i < order.size(); i++) {
+        positions.at(order.at(i)) = i;
+    }
+
+    for (const auto& [from, to] : edges) {
+        REQUIRE(positions.at(from) < positions.at(to));
+    }
+
+    // Cycles and edges to nodes that don't exist are rejected
+    REQUIRE_THROWS(getChainedDagOrder(2, { { 0, 1 }, { 1, 0 } }));
+    REQUIRE_THROWS(getChainedDagOrder(1, { { 0, 0 } }));
+    REQUIRE_THROWS(getChainedDagOrder(2, { { 0, 2 } }));
+    REQUIRE_THROWS(getChainedDagOrder(2, { { -1, 1 } }));
+}
+
+TEST_CASE("Test notifying chained call results", "[wasm]")
+{
+    unsigned int callerId = 2345;
+    unsigned int messageId = 6789;
+    ChainedResult result;
+
+    // Calls not chained from this host are never notified
+    REQUIRE(!notifyChainedResult(messageId, { 0, "foo" }));
+    REQUIRE(!awaitChainedResultNotification(messageId, 10, result));
+
+    expectChainedResult(callerId, messageId);
+    REQUIRE(isChainedResultExpected(messageId));
+    REQUIRE(!awaitChainedResultNotification(messageId, 10, result));
+
+    bool notified = false;
+    std::thread callee([messageId, &notified] {
+        notified = notifyChainedResult(messageId, { 3, "bar" });
+    });
+
+    REQUIRE(awaitChainedResultNotification(messageId, 5000, result));
+    callee.join();
+    REQUIRE(notified);
+
+    REQUIRE(result.returnValue == 3);
+    REQUIRE(result.outputData == "bar");
+
+    // The result can be awaited again until the caller finishes
+    ChainedResult again;
+    REQUIRE(awaitChainedResultNotification(messageId, 10, again));
+    REQUIRE(again.returnValue == 3);
+
+    dropChainedResults(callerId);
+    REQUIRE(!isChainedResultExpected(messageId));
+    REQUIRE(!awaitChainedResultNotification(messageId, 10, again));
+}
+
+TEST_CASE("Test forgetting chained call results", "[wasm]")
+{
+    unsigned int callerId = 3456;
+    unsigned int messageId = 7890;
+    expectChainedResult(callerId, messageId);
+
+    // Waiters give up as soon as the call turns out to be elsewhere
+    std::thread scheduler([messageId] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        forgetChainedResult(messageId);
+    });
+
+    ChainedResult result;
+    REQUIRE(!awaitChainedResultNotification(messageId, 5000, result));
+    scheduler.join();
+
+    REQUIRE(!isChainedResultExpected(messageId));
+    REQUIRE(!notifyChainedResult(messageId, { 0, "" }));
+
+    dropChainedResults(callerId);
+}
+
+static std::vector<uint8_t> readShmOutput(ChainedShmOutput& output)
+{
+    std::vector<uint8_t> data(output.size);
+    REQUIRE(::pread(output.fd, data.data(), data.size(), 0) == output.size);
+    ::close(output.fd);
+
+    return data;
+}
+
+TEST_CASE("Test chained outputs in shared memory", "[wasm]")
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    conf.chainedShmOutputThreshold = 4;
+
+    unsigned int callerId = 1234;
+    unsigned int messageId = 5678;
+    std::vector<uint8_t> small = { 0, 1, 2 };
+    std::vector<uint8_t> large = { 0, 1, 2, 3, 4, 5 };
+
+    // Calls not chained from this host, or small outputs, go as usual
+    REQUIRE(!writeChainedShmOutput(messageId, large.data(), large.size()));
+
+    expectChainedShmOutput(callerId, messageId);
+    REQUIRE(!writeChainedShmOutput(messageId, small.data(), small.size()));
+    REQUIRE(takeChainedShmOutput(messageId).fd == -1);
+
+    REQUIRE(writeChainedShmOutput(messageId, large.data(), large.size()));
+    REQUIRE(getChainedShmOutputCount() == 1);
+
+    ChainedShmOutput output = takeChainedShmOutput(messageId);
+    REQUIRE(output.size == large.size());
+    REQUIRE(readShmOutput(output) == large);
+    REQUIRE(getChainedShmOutputCount() == 0);
+
+    // Failed calls' outputs are thrown away
+    REQUIRE(writeChainedShmOutput(messageId, large.data(), large.size()));
+    discardChainedShmOutput(messageId);
+    REQUIRE(takeChainedShmOutput(messageId).fd == -1);
+
+    // Nothing is kept once the caller has finished
+    REQUIRE(writeChainedShmOutput(messageId, large.data(), large.size()));
+    dropChainedShmOutputs(callerId);
+    REQUIRE(getChainedShmOutputCount() == 0);
+    REQUIRE(!writeChainedShmOutput(messageId, large.data(), large.size()));
+
+    conf.reset();
+}
+
+static std::string readStreamChunk(unsigned int messageId, int bufferLen)
+{
+    std::vector<uint8_t> buffer(bufferLen);
+    int nBytes =
+      readChainedOutputStream(messageId, buffer.data(), bufferLen, 5000);
+    REQUIRE(nBytes >= 0);
+
+    return std::string(buffer.begin(), buffer.begin() + nBytes);
+}
+
+TEST_CASE("Test streaming chained call outputs", "[wasm]")
+{
+    unsigned int callerId = 4567;
+    unsigned int messageId = 8901;
+    std::string chunk = "abcdef";
+    uint8_t buffer[4];
+
+    // Calls not chained from this host append to their result
+    REQUIRE(!appendChainedOutputStream(messageId, BYTES(chunk.data()), 6));
+    REQUIRE(readChainedOutputStream(messageId, buffer, 4, 10) ==
+            CHAINED_OUTPUT_STREAM_UNAVAILABLE);
+
+    expectChainedResult(callerId, messageId);
+    expectChainedOutputStream(callerId, messageId);
+
+    SECTION("Chunks are read as they're appended")
+    {
+        REQUIRE(appendChainedOutputStream(messageId, BYTES(chunk.data()), 6));
+        REQUIRE(readStreamChunk(messageId, 4) == "abcd");
+
+        std::thread callee([messageId, &chunk] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            appendChainedOutputStream(messageId, BYTES(chunk.data()), 3);
+            finishChainedOutputStream(messageId);
+        });
+
+        REQUIRE(readStreamChunk(messageId, 4) == "ef");
+        REQUIRE(readStreamChunk(messageId, 4) == "abc");
+        callee.join();
+
+        REQUIRE(readStreamChunk(messageId, 4).empty());
+    }
+
+    SECTION("Calls that didn't stream are read from their result")
+    {
+        finishChainedOutputStream(messageId);
+        REQUIRE(readChainedOutputStream(messageId, buffer, 4, 10) ==
+                CHAINED_OUTPUT_STREAM_UNAVAILABLE);
+
+        fillChainedOutputStream(callerId, messageId, "foobar");
+        REQUIRE(readStreamChunk(messageId, 4) == "foob");
+        REQUIRE(readStreamChunk(messageId, 4) == "ar");
+        REQUIRE(readStreamChunk(messageId, 4).empty());
+    }
+
+    SECTION("Calls moved elsewhere stop streaming")
+    {
+        forgetChainedOutputStream(messageId);
+        REQUIRE(!appendChainedOutputStream(messageId, BYTES(chunk.data()), 6));
+        REQUIRE(readChainedOutputStream(messageId, buffer, 4, 10) ==
+                CHAINED_OUTPUT_STREAM_UNAVAILABLE);
+    }
+
+    dropChainedResults(callerId);
+    dropChainedOutputStreams(callerId);
+    REQUIRE(!appendChainedOutputStream(messageId, BYTES(chunk.data()), 6));
+}
+}
@@ -0,0 +1,209 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <wamr/WAMRWasmModule.h>
+#include <wasm/checkpoint.h>
+
+#include <faabric/util/func.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+static size_t countKeys(storage::S3Wrapper& s3,
+                        const std::string& bucket,
+                        const std::string& prefix)
+{
+    std::vector<std::string> keys = s3.listKeys(bucket);
+    return std::count_if(keys.begin(), keys.end(), [&prefix](const auto& k) {
+        return k.starts_with(prefix);
+    });
+}
+
+TEST_CASE("Test checkpoint manifest round trip", "[wasm]")
+{
+    CheckpointManifest manifest;
+    manifest.seq = 3;
+    manifest.memSize = 5 * 1024;
+    manifest.funcPtr = 12;
+    manifest.worldSize = 4;
+    manifest.chunkSeqs = { 0, 3, 1, 0, 2 };
+
+    SECTION("Plain argument") { manifest.funcArg = "123"; }
+
+    SECTION("Argument with spaces and newlines")
+    {
+        manifest.funcArg = " foo\nbar \n";
+    }
+
+    SECTION("Empty argument and no chunks")
+    {
+        manifest.funcArg = "";
+        manifest.memSize = 0;
+        manifest.chunkSeqs.clear();
+    }
+
+    CheckpointManifest actual =
+      CheckpointManifest::fromBytes(manifest.toBytes());
+    REQUIRE(actual.seq == manifest.seq);
+    REQUIRE(actual.memSize == manifest.memSize);
+    REQUIRE(actual.funcPtr == manifest.funcPtr);
+    REQUIRE(actual.funcArg == manifest.funcArg);
+    REQUIRE(actual.worldSize == manifest.worldSize);
+    REQUIRE(actual.chunkSeqs == manifest.chunkSeqs);
+
+    REQUIRE_THROWS(CheckpointManifest::fromBytes({ 'x' }));
+}
+
+TEST_CASE_METHOD(S3TestFixture, "Test incremental checkpoints", "[wasm]")
+{
+    std::string user = "demo";
+    std::string function = "checkpoint";
+    std::string rankPrefix = "checkpoints/demo/checkpoint/rank_1/";
+    size_t chunkBytes = 1024;
+
+    // Four chunks, the third all zeroes
+    std::vector<uint8_t> memory(4 * chunkBytes, 1);
+    std::fill(memory.begin() + 2 * chunkBytes,
+              memory.begin() + 3 * chunkBytes,
+              0);
+
+    REQUIRE(getLatestCheckpoint(user, function) == 0);
+
+    Checkpointer writer(user, function, 1, chunkBytes);
+    REQUIRE(writer.write(1, memory, 7, "42", 2) == 3 * chunkBytes);
+    writer.prune();
+    setLatestCheckpoint(user, function, 1);
+    REQUIRE(getLatestCheckpoint(user, function) == 1);
+
+    // Three chunks and a manifest
+    REQUIRE(countKeys(s3, conf.s3Bucket, rankPrefix) == 4);
+
+    // Only changed chunks are sent, and what they replace is deleted
+    memory.at(5) = 9;
+    memory.at(3 * chunkBytes) = 9;
+    REQUIRE(writer.write(2, memory, 8, "43", 2) == 2 * chunkBytes);
+    REQUIRE(countKeys(s3, conf.s3Bucket, rankPrefix) == 7);
+    writer.prune();
+    setLatestCheckpoint(user, function, 2);
+    REQUIRE(countKeys(s3, conf.s3Bucket, rankPrefix) == 4);
+
+    // Nothing changed, so only the manifest is sent
+    REQUIRE(writer.write(3, memory, 8, "44", 2) == 0);
+    writer.prune();
+    setLatestCheckpoint(user, function, 3);
+    REQUIRE(countKeys(s3, conf.s3Bucket, rankPrefix) == 4);
+
+    // Restore into memory that's been scribbled on
+    Checkpointer reader(user, function, 1, chunkBytes);
+    CheckpointManifest manifest = reader.readManifest(3);
+    REQUIRE(manifest.funcPtr == 8);
+    REQUIRE(manifest.funcArg == "44");
+    REQUIRE(manifest.worldSize == 2);
+    REQUIRE(manifest.chunkSeqs == std::vector<int>({ 2, 1, 0, 2 }));
+
+    std::vector<uint8_t> restored(memory.size(), 5);
+    reader.restore(manifest, restored);
+    REQUIRE(restored == memory);
+
+    // Memory too small can't be restored into, but anything past the
+    // checkpoint in larger memory is left alone
+    std::vector<uint8_t> tooSmall(chunkBytes);
+    REQUIRE_THROWS(reader.restore(manifest, tooSmall));
+
+    std::vector<uint8_t> larger(memory.size() + chunkBytes, 5);
+    reader.restore(manifest, larger);
+    REQUIRE(std::equal(memory.begin(), memory.end(), larger.begin()));
+    REQUIRE(larger.back() == 5);
+
+    // After restoring, unchanged chunks aren't sent again
+    memory.at(0) = 3;
+    REQUIRE(reader.write(4, memory, 8, "45", 2) == chunkBytes);
+    reader.prune();
+    REQUIRE(countKeys(s3, conf.s3Bucket, rankPrefix) == 4);
+
+    // Removing leaves nothing behind for the rank
+    reader.remove();
+    removeLatestCheckpoint(user, function);
+    REQUIRE(countKeys(s3, conf.s3Bucket, rankPrefix) == 0);
+    REQUIRE(getLatestCheckpoint(user, function) == 0);
+}
+
+TEST_CASE_METHOD(S3TestFixture,
+                 "Test resuming checkpoints written elsewhere",
+                 "[wasm]")
+{
+    std::string user = "demo";
+    std::string function = "checkpoint";
+    std::string rankPrefix = "checkpoints/demo/checkpoint/rank_0/";
+    size_t chunkBytes = 1024;
+    std::vector<uint8_t> memory(2 * chunkBytes, 1);
+
+    Checkpointer first(user, function, 0, chunkBytes);
+    first.write(1, memory, 1, "1", 0);
+
+    // Without knowing the hashes everything is sent again, but the chunks and
+    // manifest it replaces are still cleaned up
+    Checkpointer second(user, function, 0, chunkBytes);
+    second.resumeFrom(second.readManifest(1));
+    REQUIRE(second.write(2, memory, 1, "1", 0) == 2 * chunkBytes);
+    second.prune();
+    REQUIRE(countKeys(s3, conf.s3Bucket, rankPrefix) == 3);
+
+    second.remove();
+}
+
+class CheckpointRestoreTestFixture
+  : public S3TestFixture
+  , public FunctionExecTestFixture
+{};
+
+TEST_CASE_METHOD(CheckpointRestoreTestFixture,
+                 "Test restoring a checkpoint into a reset module",
+                 "[wasm]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+
+    wasm::WAMRWasmModule module;
+    module.bindToFunction(msg);
+    std::string snapKey = module.snapshot();
+    uint32_t resetBrk = module.getCurrentBrk();
+
+    // Resetting moves the brk back down, but linear memory stays as big as
+    // it grew
+    module.mmapMemory(4 * WASM_BYTES_PER_PAGE);
+    module.reset(msg, snapKey);
+    REQUIRE(module.getCurrentBrk() == resetBrk);
+    REQUIRE(module.getMemorySizeBytes() > resetBrk);
+
+    // Checkpoint memory that's bigger than the brk but smaller than memory
+    std::vector<uint8_t> memory(resetBrk + 2 * WASM_BYTES_PER_PAGE);
+    for (size_t i = 0; i < memory.size(); i++) {
+        memory.at(i) = (uint8_t)(i % 251);
+    }
+
+    Checkpointer writer("demo", "echo", 0);
+    writer.write(1, memory, 7, "42", 0);
+    setLatestCheckpoint("demo", "echo", 1);
+
+    conf.checkpointRestore = "on";
+    REQUIRE(restoreCheckpoint(module, msg));
+
+    REQUIRE(module.getCurrentBrk() == memory.size());
+    std::span<uint8_t> restored = module.getMemoryView();
+    REQUIRE(std::equal(memory.begin(), memory.end(), restored.begin()));
+    REQUIRE(msg.funcptr() == 7);
+    REQUIRE(msg.inputdata() == "42");
+
+    // Memory is handed out from the end of what was restored
+    REQUIRE(module.mmapMemory(WASM_BYTES_PER_PAGE) == memory.size());
+
+    finishCheckpoints(msg, true);
+    REQUIRE(getLatestCheckpoint("demo", "echo") == 0);
+}
+}
@@ -0,0 +1,165 @@
+#include <catch2/catch.hpp>
+
+#include <faabric/util/clock.h>
+#include <faabric/util/config.h>
+#include <faabric/util/func.h>
+
+#include <conf/FaasmConfig.h>
+#include <wasm/WasmModule.h>
+#include <wasm/deadline.h>
+
+#include <chrono>
+#include <thread>
+
+namespace tests {
+
+class InterruptCountingModule : public wasm::WasmModule
+{
+  public:
+    std::atomic<int> interrupts = 0;
+    int recoveries = 0;
+
+  protected:
+    void doInterruptExecution() override { interrupts++; }
+
+    void doRecoverFromInterrupt() override { recoveries++; }
+};
+
+static bool waitForInterrupt(wasm::WasmModule& module, int timeoutMs)
+{
+    for (int waitedMs = 0; waitedMs < timeoutMs; waitedMs += 10) {
+        if (module.isExecutionInterrupted()) {
+            return true;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    return module.isExecutionInterrupted();
+}
+
+TEST_CASE("Test execution deadline", "[wasm]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    msg.set_timestamp(5000);
+
+    int timeoutMs = faabric::util::getSystemConfig().globalMessageTimeout;
+    REQUIRE(wasm::getExecutionDeadlineMs(msg) == 5000 + timeoutMs);
+}
+
+TEST_CASE("Test call deadlines", "[wasm]")
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    int globalTimeoutMs = faabric::util::getSystemConfig().globalMessageTimeout;
+
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    int64_t startMs = 10000;
+    int64_t expectedMs;
+
+    SECTION("Caller's deadline")
+    {
+        msg.set_timestamp(5000);
+        expectedMs = 5000 + globalTimeoutMs;
+    }
+
+    SECTION("No timestamp")
+    {
+        msg.set_timestamp(0);
+        expectedMs = startMs + globalTimeoutMs;
+    }
+
+    SECTION("Exec timeout shorter than the caller's")
+    {
+        msg.set_timestamp(5000);
+        conf.execTimeoutMs = 100;
+        expectedMs = startMs + 100;
+    }
+
+    SECTION("Exec timeout longer than the caller's")
+    {
+        msg.set_timestamp(5000);
+        conf.execTimeoutMs = globalTimeoutMs * 2;
+        expectedMs = 5000 + globalTimeoutMs;
+    }
+
+    REQUIRE(wasm::getCallDeadlineMs(msg, startMs) == expectedMs);
+
+    conf.reset();
+}
+
+TEST_CASE("Test remaining time", "[wasm]")
+{
+    // Outside of a call there's no deadline
+    REQUIRE(wasm::getCurrentDeadlineMs() == -1);
+    REQUIRE(wasm::getRemainingTimeMs() == -1);
+
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    conf.execTimeoutMs = 60000;
+
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    msg.set_timestamp(0);
+
+    InterruptCountingModule module;
+    {
+        wasm::ExecutionDeadlineGuard guard(module, msg);
+        REQUIRE(wasm::getCurrentDeadlineMs() == guard.getDeadlineMs());
+
+        int64_t remainingMs = wasm::getRemainingTimeMs();
+        REQUIRE(remainingMs > 0);
+        REQUIRE(remainingMs <= 60000);
+    }
+
+    REQUIRE(wasm::getRemainingTimeMs() == -1);
+    REQUIRE(!module.isExecutionInterrupted());
+
+    conf.reset();
+}
+
+TEST_CASE("Test interrupting calls past their deadline", "[wasm]")
+{
+    wasm::ExecutionWatchdog& watchdog = wasm::getExecutionWatchdog();
+    size_t armedBefore = watchdog.getArmedCount();
+
+    InterruptCountingModule module;
+    int64_t nowMs = faabric::util::getGlobalClock().epochMillis();
+    uint64_t id = watchdog.arm(&module, nowMs + 50);
+
+    REQUIRE(waitForInterrupt(module, 5000));
+    REQUIRE(module.interrupts == 1);
+
+    // Interrupted calls are no longer watched
+    REQUIRE(watchdog.getArmedCount() == armedBefore);
+    watchdog.disarm(id);
+
+    module.recoverFromInterrupt();
+    REQUIRE(!module.isExecutionInterrupted());
+    REQUIRE(module.recoveries == 1);
+
+    // Recovering again is a no-op
+    module.recoverFromInterrupt();
+    REQUIRE(module.recoveries == 1);
+}
+
+TEST_CASE("Test calls disarmed before their deadline aren't interrupted",
+          "[wasm]")
+{
+    wasm::ExecutionWatchdog& watchdog = wasm::getExecutionWatchdog();
+
+    InterruptCountingModule earlyModule;
+    InterruptCountingModule lateModule;
+    int64_t nowMs = faabric::util::getGlobalClock().epochMillis();
+
+    // Arming an earlier deadline must wake the watchdog from its wait for the
+    // later one
+    uint64_t lateId = watchdog.arm(&lateModule, nowMs + 200);
+    uint64_t earlyId = watchdog.arm(&earlyModule, nowMs + 50);
+    watchdog.disarm(lateId);
+
+    REQUIRE(waitForInterrupt(earlyModule, 5000));
+    watchdog.disarm(earlyId);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    REQUIRE(!lateModule.isExecutionInterrupted());
+    REQUIRE(lateModule.interrupts == 0);
+}
+}
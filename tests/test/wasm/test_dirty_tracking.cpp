@@ -0,0 +1,110 @@
+#include <catch2/catch.hpp>
+
+#include <faabric/util/memory.h>
+
+#include <wasm/dirty_tracking.h>
+
+#include <algorithm>
+#include <atomic>
+#include <sys/mman.h>
+#include <thread>
+#include <vector>
+
+namespace tests {
+
+static int countDirty(const std::vector<char>& dirty)
+{
+    return std::count_if(
+      dirty.begin(), dirty.end(), [](char c) { return c != 0; });
+}
+
+TEST_CASE("Test tracking dirty pages of a range", "[wasm]")
+{
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    size_t nPages = 32;
+    auto* ptr = (uint8_t*)mmap(nullptr,
+                               nPages * pageSize,
+                               PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS,
+                               -1,
+                               0);
+    REQUIRE(ptr != MAP_FAILED);
+
+    // Pages written before tracking starts aren't dirty
+    ptr[2 * pageSize] = 1;
+
+    wasm::MemoryDirtyTracker tracker;
+    REQUIRE(tracker.startTracking({ ptr, nPages * pageSize }));
+    REQUIRE(tracker.isTracking());
+    REQUIRE(countDirty(tracker.getDirtyPages()) == 0);
+
+    ptr[5 * pageSize] = 1;
+    ptr[20 * pageSize + 10] = 1;
+    std::vector<char> dirty = tracker.getDirtyPages();
+    REQUIRE(dirty.size() == nPages);
+    REQUIRE(countDirty(dirty) == 2);
+    REQUIRE(dirty.at(5) == 1);
+    REQUIRE(dirty.at(20) == 1);
+
+    tracker.restartTracking();
+    REQUIRE(countDirty(tracker.getDirtyPages()) == 0);
+
+    tracker.stopTracking();
+    REQUIRE(!tracker.isTracking());
+
+    munmap(ptr, nPages * pageSize);
+}
+
+TEST_CASE("Test concurrent dirty trackers don't affect each other", "[wasm]")
+{
+    // Without per-range tracking, only one range can be tracked at a time
+    if (!wasm::MemoryDirtyTracker::isPerRangeTrackingSupported()) {
+        return;
+    }
+
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    size_t nPages = 16;
+    int nThreads = 4;
+    int nRounds = 100;
+
+    std::atomic<int> failures = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; t++) {
+        threads.emplace_back([&failures, t, pageSize, nPages, nRounds] {
+            auto* ptr = (uint8_t*)mmap(nullptr,
+                                       nPages * pageSize,
+                                       PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS,
+                                       -1,
+                                       0);
+
+            wasm::MemoryDirtyTracker tracker;
+            if (!tracker.startTracking({ ptr, nPages * pageSize })) {
+                failures++;
+                return;
+            }
+
+            for (int r = 0; r < nRounds; r++) {
+                size_t page = (t + r) % nPages;
+                ptr[page * pageSize] = (uint8_t)r;
+
+                std::vector<char> dirty = tracker.getDirtyPages();
+                if (countDirty(dirty) != 1 || dirty.at(page) == 0) {
+                    failures++;
+                }
+
+                tracker.restartTracking();
+            }
+
+            tracker.stopTracking();
+            munmap(ptr, nPages * pageSize);
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    REQUIRE(failures.load() == 0);
+}
+}
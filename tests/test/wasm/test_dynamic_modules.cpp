@@ -329,4 +329,35 @@ TEST_CASE_METHOD(DynamicModulesFixture,
     REQUIRE(table == module.defaultTable);
 }
 */
+
+TEST_CASE_METHOD(DynamicModulesFixture,
+                 "Test repeat dynamic function lookups are cached",
+                 "[wasm]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(msg);
+
+    Uptr initialTableSize = Runtime::getTableNumElements(module.defaultTable);
+
+    // First lookup adds the function to the table
+    uint32_t idx =
+      module.getDynamicModuleFunction(MAIN_MODULE_DYNLINK_HANDLE, "_start");
+    REQUIRE(idx == initialTableSize);
+    REQUIRE(Runtime::getTableNumElements(module.defaultTable) ==
+            initialTableSize + 1);
+
+    // Repeat lookups get the same entry without growing the table
+    REQUIRE(module.getDynamicModuleFunction(MAIN_MODULE_DYNLINK_HANDLE,
+                                            "_start") == idx);
+    REQUIRE(Runtime::getTableNumElements(module.defaultTable) ==
+            initialTableSize + 1);
+
+    // Clones keep the cached entries
+    wasm::WAVMWasmModule moduleB(module);
+    REQUIRE(moduleB.getDynamicModuleFunction(MAIN_MODULE_DYNLINK_HANDLE,
+                                             "_start") == idx);
+    REQUIRE(Runtime::getTableNumElements(moduleB.defaultTable) ==
+            initialTableSize + 1);
+}
 }
@@ -0,0 +1,104 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <storage/FileLoader.h>
+#include <storage/FunctionMetadata.h>
+#include <wasm/function_profile.h>
+
+#include <faabric/util/func.h>
+
+using namespace wasm;
+
+namespace tests {
+
+class FunctionProfileTestFixture : public S3TestFixture
+{
+  public:
+    FunctionProfileTestFixture() { clearFunctionProfiles(); }
+
+    ~FunctionProfileTestFixture() { clearFunctionProfiles(); }
+};
+
+TEST_CASE("Test validating profile hints", "[wasm]")
+{
+    REQUIRE(validateProfileHint(PROFILE_MAX_MEMORY_PAGES, "100").empty());
+    REQUIRE(!validateProfileHint(PROFILE_MAX_MEMORY_PAGES, "0").empty());
+    REQUIRE(!validateProfileHint(PROFILE_MAX_MEMORY_PAGES, "-1").empty());
+    REQUIRE(!validateProfileHint(PROFILE_MAX_MEMORY_PAGES, "99999999").empty());
+
+    REQUIRE(validateProfileHint(PROFILE_WASM_VM, "wamr").empty());
+    REQUIRE(!validateProfileHint(PROFILE_WASM_VM, "sgx").empty());
+
+    REQUIRE(validateProfileHint(PROFILE_WAMR_STACK_SIZE, "65536").empty());
+    REQUIRE(validateProfileHint(PROFILE_CGROUP_GRANULARITY, "user").empty());
+    REQUIRE(!validateProfileHint(PROFILE_CGROUP_GRANULARITY, "foo").empty());
+    REQUIRE(validateProfileHint(PROFILE_PREWARM_FAASLETS, "4").empty());
+
+    REQUIRE(!validateProfileHint("foo", "bar").empty());
+}
+
+TEST_CASE("Test parsing profile hints", "[wasm]")
+{
+    std::string contents = "# Small function\n"
+                           "max-memory-pages=100\n"
+                           "\n"
+                           "  wasm-vm=wamr \n";
+    std::map<std::string, std::string> expected = {
+        { PROFILE_MAX_MEMORY_PAGES, "100" },
+        { PROFILE_WASM_VM, "wamr" },
+    };
+    REQUIRE(parseProfileHints(contents) == expected);
+
+    REQUIRE_THROWS(parseProfileHints("max-memory-pages"));
+    REQUIRE_THROWS(parseProfileHints("wasm-vm=foo"));
+}
+
+TEST_CASE("Test parsing function profiles", "[wasm]")
+{
+    storage::FunctionMetadata metadata;
+    REQUIRE(parseFunctionProfile(metadata).maxMemoryPages == 0);
+
+    metadata.setHint(PROFILE_MAX_MEMORY_PAGES, "100");
+    metadata.setHint(PROFILE_WAMR_STACK_SIZE, "65536");
+    metadata.setHint(PROFILE_CGROUP_GRANULARITY, "function");
+    metadata.setHint(PROFILE_PREWARM_FAASLETS, "3");
+
+    // Invalid hints are ignored
+    metadata.setHint(PROFILE_WASM_VM, "foo");
+
+    FunctionProfile profile = parseFunctionProfile(metadata);
+    REQUIRE(profile.maxMemoryPages == 100);
+    REQUIRE(profile.wasmVm.empty());
+    REQUIRE(profile.wamrStackSize == 65536);
+    REQUIRE(profile.cgroupGranularity == "function");
+    REQUIRE(profile.prewarmFaaslets == 3);
+}
+
+TEST_CASE_METHOD(FunctionProfileTestFixture,
+                 "Test loading function profiles",
+                 "[wasm]")
+{
+    conf.wasmVm = "wavm";
+    faabric::Message msg = faabric::util::messageFactory("demo", "profiled");
+
+    // Functions without metadata get the host's settings
+    REQUIRE(getFunctionProfile(msg).maxMemoryPages == 0);
+    REQUIRE(getFunctionWasmVm(msg) == "wavm");
+
+    storage::FileLoader& loader = storage::getFileLoader();
+    loader.recordFunctionHints(msg,
+                               { { PROFILE_MAX_MEMORY_PAGES, "100" },
+                                 { PROFILE_WASM_VM, "wamr" } });
+
+    // Profiles are only read again after a flush
+    REQUIRE(getFunctionProfile(msg).maxMemoryPages == 0);
+    clearFunctionProfiles();
+    REQUIRE(getFunctionProfile(msg).maxMemoryPages == 100);
+    REQUIRE(getFunctionWasmVm(msg) == "wamr");
+
+    // Enclaves can't be opted out of
+    conf.wasmVm = "sgx";
+    REQUIRE(getFunctionWasmVm(msg) == "sgx");
+}
+}
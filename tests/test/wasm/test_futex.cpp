@@ -0,0 +1,166 @@
+#include <catch2/catch.hpp>
+
+#include <wasm/futex.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace tests {
+
+TEST_CASE("Test futex wait checks the expected value", "[wasm]")
+{
+    int32_t word = 1;
+    REQUIRE(wasm::futexWait(&word, 2, -1) == -EAGAIN);
+    REQUIRE(wasm::futexWait(&word, 1, 10) == -ETIMEDOUT);
+}
+
+TEST_CASE("Test futex wake with no waiters", "[wasm]")
+{
+    int32_t word = 0;
+    REQUIRE(wasm::futexWake(&word, 1) == 0);
+}
+
+TEST_CASE("Test futex wait is woken by another thread", "[wasm]")
+{
+    std::atomic<int32_t> word = 0;
+    int32_t* addr = reinterpret_cast<int32_t*>(&word);
+
+    std::thread waker([&word, addr] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        word.store(1);
+        wasm::futexWake(addr, 1);
+    });
+
+    // The waker may get in before the wait starts, in which case the value
+    // will already have changed
+    while (word.load() == 0) {
+        int res = wasm::futexWait(addr, 0, -1);
+        REQUIRE((res == 0 || res == -EAGAIN));
+    }
+
+    waker.join();
+
+    REQUIRE(word.load() == 1);
+}
+
+TEST_CASE("Test futex condition variables", "[wasm]")
+{
+    int32_t seq = 0;
+    wasm::FutexMutex mx;
+    int nConsumers = 4;
+    int available = 0;
+    int consumed = 0;
+
+    std::vector<std::thread> consumers;
+    for (int i = 0; i < nConsumers; i++) {
+        consumers.emplace_back([&seq, &mx, &available, &consumed] {
+            std::unique_lock<wasm::FutexMutex> lock(mx);
+            while (available == 0) {
+                wasm::futexCondWait(&seq, mx, -1);
+            }
+
+            available--;
+            consumed++;
+        });
+    }
+
+    for (int i = 0; i < nConsumers; i++) {
+        {
+            std::unique_lock<wasm::FutexMutex> lock(mx);
+            available++;
+        }
+
+        wasm::futexCondWake(&seq, i % 2 == 0 ? 1 : nConsumers);
+    }
+
+    for (auto& t : consumers) {
+        t.join();
+    }
+
+    REQUIRE(consumed == nConsumers);
+    REQUIRE(available == 0);
+    REQUIRE(seq == nConsumers);
+}
+
+TEST_CASE("Test futex condition variable timeout", "[wasm]")
+{
+    int32_t seq = 0;
+    wasm::FutexMutex mx;
+
+    std::unique_lock<wasm::FutexMutex> lock(mx);
+    REQUIRE(wasm::futexCondWait(&seq, mx, 10) == -ETIMEDOUT);
+
+    // The mutex is held again on return
+    bool lockedElsewhere = false;
+    std::thread t([&mx, &lockedElsewhere] {
+        lockedElsewhere = mx.try_lock();
+        if (lockedElsewhere) {
+            mx.unlock();
+        }
+    });
+    t.join();
+
+    REQUIRE(!lockedElsewhere);
+}
+
+TEST_CASE("Test futex mutex under contention", "[wasm]")
+{
+    wasm::FutexMutex mx;
+    int nThreads = 8;
+    int nIncrements = 10000;
+    int counter = 0;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([&mx, &counter, nIncrements] {
+            for (int j = 0; j < nIncrements; j++) {
+                std::unique_lock<wasm::FutexMutex> lock(mx);
+                counter++;
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    REQUIRE(counter == nThreads * nIncrements);
+
+    REQUIRE(mx.try_lock());
+    REQUIRE(!mx.try_lock());
+    mx.unlock();
+}
+
+TEST_CASE("Test futex mutex slab", "[wasm]")
+{
+    wasm::FutexMutexSlab slab(2);
+
+    // Mutexes keep their slot in their first word
+    int32_t mxA = 0;
+    int32_t mxB = 0;
+    wasm::FutexMutex& a = slab.get(100, &mxA);
+    wasm::FutexMutex& b = slab.get(200, &mxB);
+    REQUIRE(&a != &b);
+    REQUIRE(mxA != 0);
+    REQUIRE(mxB != 0);
+    REQUIRE(&slab.get(100, &mxA) == &a);
+    REQUIRE(slab.getUsedCount() == 2);
+
+    // Slots belonging to another mutex, e.g. in memory from elsewhere, aren't
+    // shared
+    int32_t mxC = mxA;
+    REQUIRE_THROWS(slab.get(300, &mxC));
+
+    // Released slots are reused
+    slab.release(100, &mxA);
+    REQUIRE(mxA == 0);
+    REQUIRE(slab.getUsedCount() == 1);
+
+    wasm::FutexMutex& c = slab.get(300, &mxC);
+    REQUIRE(&c == &a);
+    REQUIRE(slab.getUsedCount() == 2);
+}
+}
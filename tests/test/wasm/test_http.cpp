@@ -0,0 +1,165 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <wasm/http.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace tests {
+
+TEST_CASE("Test parsing HTTP URLs", "[wasm]")
+{
+    wasm::HttpUrl url = wasm::parseHttpUrl("http://backend:8080/api/v1?x=1");
+    REQUIRE(url.host == "backend");
+    REQUIRE(url.port == 8080);
+    REQUIRE(url.path == "/api/v1?x=1");
+
+    url = wasm::parseHttpUrl("http://backend");
+    REQUIRE(url.host == "backend");
+    REQUIRE(url.port == 80);
+    REQUIRE(url.path == "/");
+
+    REQUIRE_THROWS(wasm::parseHttpUrl("https://backend/"));
+    REQUIRE_THROWS(wasm::parseHttpUrl("http://:80/"));
+}
+
+// Serves the given responses in turn on the first connection, counting how
+// many connections are made
+class TestHttpServer
+{
+  public:
+    explicit TestHttpServer(std::vector<std::string> responsesIn)
+      : responses(std::move(responsesIn))
+    {
+        listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        ::bind(listenFd, (sockaddr*)&addr, sizeof(addr));
+        ::listen(listenFd, 4);
+
+        socklen_t addrLen = sizeof(addr);
+        ::getsockname(listenFd, (sockaddr*)&addr, &addrLen);
+        port = ntohs(addr.sin_port);
+
+        serverThread = std::thread([this] { serve(); });
+    }
+
+    ~TestHttpServer()
+    {
+        ::shutdown(listenFd, SHUT_RDWR);
+        ::close(listenFd);
+        serverThread.join();
+    }
+
+    int port;
+    std::atomic<int> connections = 0;
+
+  private:
+    int listenFd;
+    std::vector<std::string> responses;
+    std::thread serverThread;
+
+    void serve()
+    {
+        int connFd;
+        while ((connFd = ::accept(listenFd, nullptr, nullptr)) >= 0) {
+            connections++;
+
+            for (size_t i = 0; i < responses.size(); i++) {
+                std::string request;
+                char buf[1024];
+                while (request.find("\r\n\r\n") == std::string::npos) {
+                    ssize_t n = ::recv(connFd, buf, sizeof(buf), 0);
+                    if (n <= 0) {
+                        break;
+                    }
+                    request.append(buf, n);
+                }
+
+                ::send(connFd,
+                       responses.at(i).data(),
+                       responses.at(i).size(),
+                       MSG_NOSIGNAL);
+            }
+
+            ::close(connFd);
+            responses.clear();
+        }
+    }
+};
+
+TEST_CASE_METHOD(FaasmConfTestFixture,
+                 "Test HTTP requests reuse pooled connections",
+                 "[wasm]")
+{
+    wasm::HttpConnectionPool& pool = wasm::getHttpConnectionPool();
+    pool.clear();
+
+    TestHttpServer server({
+      "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello",
+      "HTTP/1.1 201 Created\r\nTransfer-Encoding: chunked\r\n\r\n"
+      "3\r\nhel\r\n2\r\nlo\r\n0\r\n\r\n",
+      "HTTP/1.1 404 Not Found\r\nConnection: close\r\n"
+      "Content-Length: 4\r\n\r\nnope",
+    });
+
+    std::string url = "http://127.0.0.1:" + std::to_string(server.port) + "/";
+    std::string key = wasm::getHttpPoolKey("", wasm::parseHttpUrl(url));
+    std::vector<uint8_t> expected = { 'h', 'e', 'l', 'l', 'o' };
+
+    wasm::HttpResponse response = wasm::doHttpRequest("GET", url, "", {});
+    REQUIRE(response.status == 200);
+    REQUIRE(response.body == expected);
+    REQUIRE(pool.getIdleCount(key) == 1);
+
+    response = wasm::doHttpRequest(
+      "POST", url, "Content-Type: text/plain", { 'a', 'b' });
+    REQUIRE(response.status == 201);
+    REQUIRE(response.body == expected);
+    REQUIRE(pool.getIdleCount(key) == 1);
+
+    // Connections the server closes aren't kept
+    response = wasm::doHttpRequest("GET", url, "", {});
+    REQUIRE(response.status == 404);
+    REQUIRE(pool.getIdleCount(key) == 0);
+
+    REQUIRE(server.connections == 1);
+}
+
+TEST_CASE_METHOD(FaasmConfTestFixture,
+                 "Test host HTTP request copies what fits",
+                 "[wasm]")
+{
+    wasm::getHttpConnectionPool().clear();
+
+    TestHttpServer server({
+      "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello",
+    });
+    std::string url = "http://127.0.0.1:" + std::to_string(server.port) + "/";
+
+    std::vector<uint8_t> buffer(3, 0);
+    int32_t status = 0;
+    int32_t bodyLen = wasm::doHostHttpRequest(
+      "GET", url, "", nullptr, 0, buffer.data(), buffer.size(), &status);
+
+    REQUIRE(status == 200);
+    REQUIRE(bodyLen == 5);
+    REQUIRE(buffer == std::vector<uint8_t>({ 'h', 'e', 'l' }));
+
+    // Failures are returned to the caller
+    bodyLen = wasm::doHostHttpRequest(
+      "GET", "https://foo", "", nullptr, 0, buffer.data(), 0, &status);
+    REQUIRE(bodyLen == -1);
+    REQUIRE(status == 0);
+}
+}
@@ -0,0 +1,187 @@
+#include <catch2/catch.hpp>
+
+#include <faabric/util/clock.h>
+
+#include <conf/FaasmConfig.h>
+#include <wasm/WasmExecutionContext.h>
+#include <wasm/WasmModule.h>
+#include <wasm/ipc.h>
+
+#include <numeric>
+#include <thread>
+
+namespace tests {
+
+static std::vector<uint8_t> makeData(size_t len)
+{
+    std::vector<uint8_t> data(len);
+    std::iota(data.begin(), data.end(), 0);
+    return data;
+}
+
+TEST_CASE("Test IPC channel ring wraps around", "[wasm]")
+{
+    wasm::IpcChannel channel(8);
+    channel.addWriter();
+
+    std::vector<uint8_t> data = makeData(6);
+    std::vector<uint8_t> actual(6);
+
+    // Writing and reading six bytes twice means the second lot wraps
+    for (int i = 0; i < 2; i++) {
+        REQUIRE(channel.write(data.data(), 6, -1) == 6);
+        REQUIRE(channel.getBufferedBytes() == 6);
+
+        REQUIRE(channel.read(actual.data(), 6, -1) == 6);
+        REQUIRE(actual == data);
+        REQUIRE(channel.getBufferedBytes() == 0);
+    }
+}
+
+TEST_CASE("Test IPC channel reads end once writers close", "[wasm]")
+{
+    wasm::IpcChannel channel(16);
+    channel.addWriter();
+
+    std::vector<uint8_t> data = makeData(4);
+    REQUIRE(channel.write(data.data(), 4, -1) == 4);
+    channel.removeWriter();
+
+    // What's buffered is still read before the end of the stream
+    std::vector<uint8_t> actual(8);
+    REQUIRE(channel.read(actual.data(), 8, -1) == 4);
+    REQUIRE(channel.read(actual.data(), 8, -1) == 0);
+}
+
+TEST_CASE("Test IPC channel waits give up at the deadline", "[wasm]")
+{
+    wasm::IpcChannel channel(4);
+    channel.addWriter();
+
+    int64_t deadlineMs = faabric::util::getGlobalClock().epochMillis() + 50;
+    std::vector<uint8_t> data = makeData(8);
+
+    // With no reader, writes only get as far as filling the ring
+    REQUIRE(channel.write(data.data(), 8, deadlineMs) == 4);
+
+    std::vector<uint8_t> actual(4);
+    REQUIRE(channel.read(actual.data(), 4, deadlineMs) == 4);
+    REQUIRE(channel.read(actual.data(), 4, deadlineMs) == -1);
+}
+
+TEST_CASE("Test streaming through an IPC channel", "[wasm]")
+{
+    size_t capacity = 0;
+    size_t readLen = 0;
+
+    SECTION("Reads smaller than the ring")
+    {
+        capacity = 1024;
+        readLen = 100;
+    }
+
+    SECTION("Reads larger than the ring")
+    {
+        capacity = 64;
+        readLen = 1000;
+    }
+
+    wasm::IpcChannel channel(capacity);
+    channel.addWriter();
+
+    std::vector<uint8_t> data = makeData(100000);
+    size_t written = 0;
+    std::thread writer([&channel, &data, &written] {
+        written = channel.write(data.data(), data.size(), -1);
+        channel.removeWriter();
+    });
+
+    std::vector<uint8_t> actual;
+    std::vector<uint8_t> buffer(readLen);
+    int64_t n;
+    while ((n = channel.read(buffer.data(), buffer.size(), -1)) > 0) {
+        actual.insert(actual.end(), buffer.begin(), buffer.begin() + n);
+    }
+
+    writer.join();
+
+    REQUIRE(written == data.size());
+    REQUIRE(n == 0);
+    REQUIRE(actual == data);
+}
+
+TEST_CASE("Test opening IPC channels by name", "[wasm]")
+{
+    size_t openBefore = wasm::getOpenIpcChannelCount();
+
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    conf.ipcChannelSize = 128;
+
+    wasm::IpcChannelEnd writeEnd = wasm::openIpcChannel("demo", "foo", true);
+    wasm::IpcChannelEnd readEnd = wasm::openIpcChannel("demo", "foo", false);
+
+    // Other tenants' channels of the same name are separate
+    wasm::IpcChannelEnd otherEnd = wasm::openIpcChannel("other", "foo", false);
+
+    REQUIRE(writeEnd.channel == readEnd.channel);
+    REQUIRE(otherEnd.channel != readEnd.channel);
+    REQUIRE(readEnd.channel->getCapacity() == 128);
+    REQUIRE(wasm::getOpenIpcChannelCount() == openBefore + 2);
+
+    wasm::closeIpcChannel(otherEnd);
+    wasm::closeIpcChannel(writeEnd);
+    REQUIRE(wasm::getOpenIpcChannelCount() == openBefore + 1);
+
+    wasm::closeIpcChannel(readEnd);
+    REQUIRE(wasm::getOpenIpcChannelCount() == openBefore);
+
+    conf.reset();
+}
+
+TEST_CASE("Test IPC channel host interface", "[wasm]")
+{
+    size_t openBefore = wasm::getOpenIpcChannelCount();
+
+    wasm::WasmModule writerModule;
+    wasm::WasmModule readerModule;
+
+    int32_t writeHandle;
+    int32_t readHandle;
+    {
+        wasm::WasmExecutionContext ctx(&writerModule);
+        writeHandle = wasm::doHostChannelOpen("bar", 1);
+        REQUIRE(writeHandle >= 0);
+    }
+
+    std::vector<uint8_t> data = makeData(10);
+    std::vector<uint8_t> actual(10);
+    {
+        wasm::WasmExecutionContext ctx(&readerModule);
+        readHandle = wasm::doHostChannelOpen("bar", 0);
+        REQUIRE(readHandle >= 0);
+
+        // Ends can only be used the way they were opened
+        REQUIRE(wasm::doHostChannelWrite(readHandle, data.data(), 10) == -1);
+        REQUIRE(wasm::doHostChannelRead(readHandle + 100, actual.data(), 10) ==
+                -1);
+    }
+
+    {
+        wasm::WasmExecutionContext ctx(&writerModule);
+        REQUIRE(wasm::doHostChannelWrite(writeHandle, data.data(), 10) == 10);
+        REQUIRE(wasm::doHostChannelClose(writeHandle) == 0);
+        REQUIRE(wasm::doHostChannelClose(writeHandle) == -1);
+    }
+
+    {
+        wasm::WasmExecutionContext ctx(&readerModule);
+        REQUIRE(wasm::doHostChannelRead(readHandle, actual.data(), 10) == 10);
+        REQUIRE(actual == data);
+        REQUIRE(wasm::doHostChannelRead(readHandle, actual.data(), 10) == 0);
+    }
+
+    // Ends left open are closed with the module's call
+    readerModule.closeAllChannels();
+    REQUIRE(wasm::getOpenIpcChannelCount() == openBefore);
+}
+}
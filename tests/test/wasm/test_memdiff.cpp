@@ -0,0 +1,66 @@
+#include <catch2/catch.hpp>
+
+#include <wasm/memdiff.h>
+
+#include <vector>
+
+namespace tests {
+
+TEST_CASE("Test diffing memory ranges", "[wasm]")
+{
+    size_t memSize = 4096 + 13;
+    std::vector<uint8_t> original(memSize, 1);
+    std::vector<uint8_t> updated = original;
+
+    std::vector<std::pair<size_t, size_t>> expected;
+
+    SECTION("No changes") {}
+
+    SECTION("Single byte")
+    {
+        updated.at(70) = 2;
+        expected = { { 64, 96 } };
+    }
+
+    SECTION("Close changes merged")
+    {
+        updated.at(10) = 2;
+        updated.at(100) = 2;
+        expected = { { 0, 128 } };
+    }
+
+    SECTION("Distant changes")
+    {
+        updated.at(10) = 2;
+        updated.at(1000) = 2;
+        expected = { { 0, 32 }, { 992, 1024 } };
+    }
+
+    SECTION("Change in the tail")
+    {
+        updated.at(memSize - 1) = 2;
+        expected = { { 4096, memSize } };
+    }
+
+    REQUIRE(wasm::diffMemoryRanges(original, updated) == expected);
+}
+
+TEST_CASE("Test diffing memory of different sizes", "[wasm]")
+{
+    std::vector<uint8_t> a(100, 0);
+    std::vector<uint8_t> b(50, 0);
+    REQUIRE_THROWS(wasm::diffMemoryRanges(a, b));
+}
+
+TEST_CASE("Test checking for zero memory", "[wasm]")
+{
+    std::vector<uint8_t> data(1000, 0);
+    REQUIRE(wasm::isZeroMemory(data));
+
+    SECTION("Non-zero in a block") { data.at(33) = 1; }
+
+    SECTION("Non-zero in the tail") { data.at(999) = 1; }
+
+    REQUIRE(!wasm::isZeroMemory(data));
+}
+}
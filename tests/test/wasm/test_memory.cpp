@@ -8,12 +8,15 @@
 
 #include <faabric/util/bytes.h>
 #include <faabric/util/config.h>
+#include <faabric/util/environment.h>
 #include <faabric/util/files.h>
 #include <faabric/util/func.h>
 
+#include <algorithm>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <thread>
 
 using namespace WAVM;
 
@@ -56,6 +59,65 @@ TEST_CASE_METHOD(FunctionExecTestFixture, "Test mmapping a file", "[wasm]")
     REQUIRE(expected == actual);
 }
 
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test mmapping a file with an offset",
+                 "[wasm]")
+{
+    faabric::Message call = faabric::util::messageFactory("demo", "echo");
+
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(call);
+
+    // Write a file where each page holds a different byte
+    std::string fileName = "/tmp/faasm_mmap_offset_test";
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    std::vector<uint8_t> fileBytes(3 * pageSize);
+    for (size_t i = 0; i < 3; i++) {
+        std::fill(fileBytes.begin() + i * pageSize,
+                  fileBytes.begin() + (i + 1) * pageSize,
+                  (uint8_t)(i + 1));
+    }
+    faabric::util::writeBytesToFile(fileName, fileBytes);
+
+    int fd = open(fileName.c_str(), O_RDWR);
+    if (fd == -1) {
+        FAIL("Could not open file");
+    }
+
+    SECTION("Read-only shared")
+    {
+        uint32_t wasmPtr =
+          module.mmapFile(fd, pageSize, PROT_READ, MAP_SHARED, pageSize);
+        uint8_t* hostPtr = module.getMemoryBase() + wasmPtr;
+
+        std::vector<uint8_t> actual(hostPtr, hostPtr + pageSize);
+        std::vector<uint8_t> expected(pageSize, 2);
+        REQUIRE(actual == expected);
+    }
+
+    SECTION("Writable private")
+    {
+        uint32_t wasmPtr = module.mmapFile(
+          fd, pageSize, PROT_READ | PROT_WRITE, MAP_SHARED, 2 * pageSize);
+        uint8_t* hostPtr = module.getMemoryBase() + wasmPtr;
+        REQUIRE(hostPtr[0] == 3);
+
+        // Writes must be visible in memory but never reach the file
+        std::fill(hostPtr, hostPtr + pageSize, 9);
+        REQUIRE(hostPtr[pageSize - 1] == 9);
+        REQUIRE(faabric::util::readFileToBytes(fileName) == fileBytes);
+    }
+
+    SECTION("Unaligned offset")
+    {
+        REQUIRE_THROWS(
+          module.mmapFile(fd, pageSize, PROT_READ, MAP_SHARED, 100));
+    }
+
+    close(fd);
+    remove(fileName.c_str());
+}
+
 TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
                  "Test memory growth and shrinkage",
                  "[wasm]")
@@ -151,6 +213,367 @@ TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
     REQUIRE(newBrk == oldBrk);
 }
 
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test concurrent memory growth",
+                 "[wasm]")
+{
+    faabric::Message call = faabric::util::messageFactory("demo", "echo");
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(call);
+
+    // Once threads are in use, memory is committed in chunks
+    module.getThreadStacks();
+    uint32_t startBrk = module.getCurrentBrk();
+    module.growMemory(WASM_BYTES_PER_PAGE);
+    REQUIRE(module.getMemorySizeBytes() ==
+            startBrk + MEMORY_GROWTH_CHUNK_PAGES * WASM_BYTES_PER_PAGE);
+    REQUIRE(module.getCurrentBrk() == startBrk + WASM_BYTES_PER_PAGE);
+
+    int nThreads = 8;
+    int nGrows = 20;
+    std::vector<std::vector<uint32_t>> offsets(nThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; t++) {
+        threads.emplace_back([&module, &offsets, t, nGrows] {
+            for (int i = 0; i < nGrows; i++) {
+                offsets.at(t).push_back(
+                  module.growMemory(WASM_BYTES_PER_PAGE));
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    // Every grow gets its own page
+    std::vector<uint32_t> allOffsets;
+    for (const auto& o : offsets) {
+        allOffsets.insert(allOffsets.end(), o.begin(), o.end());
+    }
+    std::sort(allOffsets.begin(), allOffsets.end());
+    for (size_t i = 0; i < allOffsets.size(); i++) {
+        REQUIRE(allOffsets.at(i) ==
+                startBrk + (i + 1) * WASM_BYTES_PER_PAGE);
+    }
+
+    uint32_t endBrk = module.getCurrentBrk();
+    REQUIRE(endBrk ==
+            startBrk + (nThreads * nGrows + 1) * WASM_BYTES_PER_PAGE);
+    REQUIRE(module.getMemorySizeBytes() >= endBrk);
+}
+
+// Linear memory in a plain host mapping, where a bump from another thread can
+// be made to land between a shrink reading the brk and lowering it
+class RacingShrinkModule : public HostMemoryModule
+{
+  public:
+    bool bumpOnReclaim = false;
+    uint32_t bumpedOffset = 0;
+
+    RacingShrinkModule()
+      : HostMemoryModule(16)
+    {}
+
+  protected:
+    void reclaimMemory(uint32_t offset, size_t nBytes) override
+    {
+        if (bumpOnReclaim) {
+            bumpOnReclaim = false;
+            std::thread bumper([this] {
+                bumpedOffset = growMemory(WASM_BYTES_PER_PAGE);
+                std::fill_n(
+                  getMemoryBase() + bumpedOffset, WASM_BYTES_PER_PAGE, 7);
+            });
+            bumper.join();
+        }
+
+        WasmModule::reclaimMemory(offset, nBytes);
+    }
+};
+
+TEST_CASE("Test shrinking memory while another thread bumps it", "[wasm]")
+{
+    uint32_t pageSize = WASM_BYTES_PER_PAGE;
+    RacingShrinkModule module;
+
+    // Leave some committed memory above the brk for lock-free bumps
+    module.growMemory(8 * pageSize);
+    module.shrinkMemory(2 * pageSize);
+    uint32_t ours = module.growMemory(pageSize);
+    REQUIRE(ours == 6 * pageSize);
+
+    // The bump gets in after the shrink has read the brk
+    module.bumpOnReclaim = true;
+    REQUIRE(module.shrinkMemory(pageSize) == 7 * pageSize);
+    REQUIRE(module.bumpedOffset == 7 * pageSize);
+
+    // The bumped page is left alone, and ours becomes a hole
+    uint8_t* bumpedPtr = module.getMemoryBase() + module.bumpedOffset;
+    std::vector<uint8_t> expected(pageSize, 7);
+    std::vector<uint8_t> actual(bumpedPtr, bumpedPtr + pageSize);
+    REQUIRE(actual == expected);
+    REQUIRE(module.getCurrentBrk() == 8 * pageSize);
+    REQUIRE(module.getFreeMemoryBytes() == pageSize);
+    REQUIRE(module.mmapMemory(pageSize) == ours);
+}
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test capping memory growth",
+                 "[wasm]")
+{
+    faabric::Message call = faabric::util::messageFactory("demo", "echo");
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(call);
+
+    size_t maxPages = module.getMaxMemoryPages();
+    REQUIRE(module.getMemoryPagesLimit() == maxPages);
+
+    // Leave room for two more pages
+    uint32_t currentPages = module.getMemorySizeBytes() / WASM_BYTES_PER_PAGE;
+    module.setMemoryPagesLimit(currentPages + 2);
+    REQUIRE(module.getMemoryPagesLimit() == currentPages + 2);
+
+    REQUIRE_THROWS(module.growMemory(3 * WASM_BYTES_PER_PAGE));
+    module.growMemory(2 * WASM_BYTES_PER_PAGE);
+    REQUIRE_THROWS(module.growMemory(WASM_BYTES_PER_PAGE));
+
+    // Caps above the module's own maximum have no effect
+    module.setMemoryPagesLimit(maxPages + 1);
+    REQUIRE(module.getMemoryPagesLimit() == maxPages);
+}
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test reusing unmapped memory",
+                 "[wasm]")
+{
+    faabric::Message call = faabric::util::messageFactory("demo", "echo");
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(call);
+
+    uint32_t regionSize = 4 * WASM_BYTES_PER_PAGE;
+    uint32_t regionA = module.mmapMemory(regionSize);
+    uint32_t regionB = module.mmapMemory(regionSize);
+    uint32_t regionC = module.mmapMemory(regionSize);
+    uint32_t topBrk = module.getCurrentBrk();
+    size_t memSize = module.getMemorySizeBytes();
+
+    // Dirty the middle region, then unmap it
+    uint8_t* ptrB = module.getMemoryBase() + regionB;
+    std::fill(ptrB, ptrB + regionSize, 5);
+    module.unmapMemory(regionB, regionSize);
+
+    REQUIRE(module.getCurrentBrk() == topBrk);
+    REQUIRE(module.getFreeMemoryBytes() == regionSize);
+
+    // Unmapped memory must come back zeroed
+    std::vector<uint8_t> expected(regionSize, 0);
+    std::vector<uint8_t> actual(ptrB, ptrB + regionSize);
+    REQUIRE(actual == expected);
+
+    SECTION("Reuse a smaller part of the hole")
+    {
+        uint32_t reused = module.mmapMemory(WASM_BYTES_PER_PAGE);
+        REQUIRE(reused == regionB);
+        REQUIRE(module.getFreeMemoryBytes() ==
+                regionSize - WASM_BYTES_PER_PAGE);
+        REQUIRE(module.getMemorySizeBytes() == memSize);
+    }
+
+    SECTION("Too big for the hole")
+    {
+        uint32_t grown = module.mmapMemory(regionSize + WASM_BYTES_PER_PAGE);
+        REQUIRE(grown == topBrk);
+        REQUIRE(module.getFreeMemoryBytes() == regionSize);
+    }
+
+    SECTION("Merge holes and shrink at the top")
+    {
+        module.unmapMemory(regionA, regionSize);
+        REQUIRE(module.getFreeMemoryBytes() == 2 * regionSize);
+
+        // Unmapping the top absorbs the adjacent holes into the shrink
+        module.unmapMemory(regionC, regionSize);
+        REQUIRE(module.getCurrentBrk() == regionA);
+        REQUIRE(module.getFreeMemoryBytes() == 0);
+    }
+}
+
+TEST_CASE_METHOD(FunctionExecTestFixture, "Test remapping memory", "[wasm]")
+{
+    faabric::Message call = faabric::util::messageFactory("demo", "echo");
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(call);
+
+    uint32_t pageSize = WASM_BYTES_PER_PAGE;
+    uint32_t regionA = module.mmapMemory(2 * pageSize);
+    uint32_t regionB = module.mmapMemory(pageSize);
+    module.mmapMemory(pageSize);
+    uint32_t topBrk = module.getCurrentBrk();
+
+    uint8_t* ptrA = module.getMemoryBase() + regionA;
+    std::fill(ptrA, ptrA + 2 * pageSize, 3);
+    std::vector<uint8_t> expected(2 * pageSize, 3);
+
+    SECTION("Grow into a hole")
+    {
+        module.unmapMemory(regionB, pageSize);
+        uint32_t grown =
+          module.remapMemory(regionA, 2 * pageSize, 3 * pageSize, false);
+        REQUIRE(grown == regionA);
+        REQUIRE(module.getFreeMemoryBytes() == 0);
+        REQUIRE(module.getCurrentBrk() == topBrk);
+    }
+
+    SECTION("Can't grow in place")
+    {
+        uint32_t grown =
+          module.remapMemory(regionA, 2 * pageSize, 3 * pageSize, false);
+        REQUIRE(grown == REMAP_MEMORY_FAILED);
+        REQUIRE(module.getCurrentBrk() == topBrk);
+    }
+
+    SECTION("Shrink below other mappings")
+    {
+        REQUIRE(module.remapMemory(regionA, 2 * pageSize, pageSize, false) ==
+                regionA);
+        REQUIRE(module.getFreeMemoryBytes() == pageSize);
+        REQUIRE(ptrA[0] == 3);
+    }
+
+    SECTION("Move, then grow and shrink at the top")
+    {
+        uint32_t moved =
+          module.remapMemory(regionA, 2 * pageSize, 4 * pageSize, true);
+        REQUIRE(moved == topBrk);
+
+        // The data moves with the pages, and the old region is free again
+        uint8_t* movedPtr = module.getMemoryBase() + moved;
+        std::vector<uint8_t> actual(movedPtr, movedPtr + 2 * pageSize);
+        REQUIRE(actual == expected);
+        REQUIRE(movedPtr[2 * pageSize] == 0);
+        REQUIRE(module.getFreeMemoryBytes() == 2 * pageSize);
+        REQUIRE(ptrA[0] == 0);
+
+        REQUIRE(module.remapMemory(moved, 4 * pageSize, 5 * pageSize, false) ==
+                moved);
+        REQUIRE(module.getCurrentBrk() == moved + 5 * pageSize);
+
+        REQUIRE(module.remapMemory(moved, 5 * pageSize, 10, false) == moved);
+        REQUIRE(module.getCurrentBrk() == moved + pageSize);
+        REQUIRE(movedPtr[0] == 3);
+    }
+
+    SECTION("Invalid remappings")
+    {
+        uint32_t offset = regionA;
+        size_t oldBytes = 2 * pageSize;
+        size_t newBytes = 3 * pageSize;
+
+        SECTION("Unaligned offset") { offset = regionA + 1; }
+
+        SECTION("Empty mapping") { oldBytes = 0; }
+
+        SECTION("Beyond the brk") { oldBytes = topBrk - regionA + 1; }
+
+        // The top of the mapping would wrap round to below the brk
+        SECTION("Wrapping offset") { offset = UINT32_MAX - pageSize + 1; }
+
+        // Rounded up to pages this is 4GB, which is zero in 32 bits
+        SECTION("Size rounded to zero") { newBytes = UINT32_MAX; }
+
+        REQUIRE(!module.canRemapMemory(offset, oldBytes, newBytes));
+        REQUIRE_THROWS(module.remapMemory(offset, oldBytes, newBytes, true));
+
+        // Nothing is unmapped or moved
+        REQUIRE(module.getCurrentBrk() == topBrk);
+        REQUIRE(module.getFreeMemoryBytes() == 0);
+        REQUIRE(ptrA[0] == 3);
+    }
+}
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test restoring a snapshot drops unmapped memory",
+                 "[wasm]")
+{
+    faabric::Message call = faabric::util::messageFactory("demo", "echo");
+
+    std::shared_ptr<wasm::WasmModule> module = nullptr;
+    bool isReset = false;
+
+    SECTION("WAVM restore")
+    {
+        module = std::make_shared<wasm::WAVMWasmModule>();
+    }
+
+    SECTION("WAMR restore")
+    {
+        module = std::make_shared<wasm::WAMRWasmModule>();
+    }
+
+    SECTION("WAMR reset")
+    {
+        module = std::make_shared<wasm::WAMRWasmModule>();
+        isReset = true;
+    }
+
+    module->bindToFunction(call);
+
+    uint32_t regionSize = 2 * WASM_BYTES_PER_PAGE;
+    uint32_t regionA = module->mmapMemory(regionSize);
+    module->mmapMemory(regionSize);
+
+    uint8_t* ptrA = module->getMemoryBase() + regionA;
+    std::fill(ptrA, ptrA + regionSize, 4);
+
+    std::string snapKey = module->snapshot();
+    uint32_t snapBrk = module->getCurrentBrk();
+
+    // The hole is only a hole after the snapshot was taken
+    module->unmapMemory(regionA, regionSize);
+    module->mmapMemory(regionSize);
+    REQUIRE(module->getFreeMemoryBytes() == regionSize);
+
+    if (isReset) {
+        module->reset(call, snapKey);
+    } else {
+        module->restore(snapKey);
+    }
+
+    // The region is in use again, so mustn't be handed out
+    REQUIRE(module->getCurrentBrk() == snapBrk);
+    REQUIRE(module->getFreeMemoryBytes() == 0);
+    REQUIRE(module->getMemoryBase()[regionA] == 4);
+    REQUIRE(module->mmapMemory(regionSize) == snapBrk);
+}
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test mapping read-only bytes",
+                 "[wasm]")
+{
+    faabric::Message call = faabric::util::messageFactory("demo", "echo");
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(call);
+
+    REQUIRE(module.mapReadOnlyBytes("") == 0);
+
+    std::string data(WASM_BYTES_PER_PAGE + 10, 'a');
+    data[10] = 'b';
+    uint32_t wasmPtr = module.mapReadOnlyBytes(data);
+    REQUIRE(wasmPtr > 0);
+
+    uint8_t* nativePtr = module.getMemoryBase() + wasmPtr;
+    std::string actual((char*)nativePtr, data.size());
+    REQUIRE(actual == data);
+
+    // Unmapped pages are writable again
+    module.unmapMemory(wasmPtr, data.size());
+    uint32_t reused = module.mmapMemory(data.size());
+    REQUIRE(reused == wasmPtr);
+    std::fill(nativePtr, nativePtr + data.size(), 5);
+    REQUIRE(nativePtr[data.size() - 1] == 5);
+}
+
 TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
                  "Test mmap/munmap",
                  "[faaslet]")
@@ -173,6 +596,19 @@ TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
     SECTION("WAMR") { execWamrFunction(req->mutable_messages()->at(0)); }
 }
 
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test big mmap with huge pages",
+                 "[faaslet]")
+{
+    conf.hugePages = "on";
+
+    auto req = setUpContext("demo", "mmap_big");
+
+    SECTION("WAVM") { execFunction(req); }
+
+    SECTION("WAMR") { execWamrFunction(req->mutable_messages()->at(0)); }
+}
+
 TEST_CASE_METHOD(FunctionExecTestFixture,
                  "Test allocating over max memory",
                  "[wasm]")
@@ -206,4 +642,81 @@ TEST_CASE_METHOD(FunctionExecTestFixture,
 
     REQUIRE(failed);
 }
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test thread stacks are provisioned on first use",
+                 "[wasm]")
+{
+    auto req = setUpContext("demo", "echo");
+    faabric::Message& call = req->mutable_messages()->at(0);
+
+    int threadPoolSize = 4;
+    std::shared_ptr<wasm::WasmModule> module = nullptr;
+    SECTION("WAVM")
+    {
+        module = std::make_shared<wasm::WAVMWasmModule>(threadPoolSize);
+    }
+
+    SECTION("WAMR")
+    {
+        module = std::make_shared<wasm::WAMRWasmModule>(threadPoolSize);
+    }
+
+    module->bindToFunction(call);
+
+    // Binding doesn't set aside any stacks
+    uint32_t brkBefore = module->getCurrentBrk();
+    std::vector<uint32_t> stacks = module->getThreadStacks();
+    REQUIRE(stacks.size() == (size_t)threadPoolSize);
+
+    // The stacks are all above the old break, one after the other
+    uint32_t stackSize = THREAD_STACK_SIZE + (2 * GUARD_REGION_SIZE);
+    REQUIRE(module->getCurrentBrk() == brkBefore + threadPoolSize * stackSize);
+    for (int i = 0; i < threadPoolSize; i++) {
+        REQUIRE(stacks.at(i) == brkBefore + i * stackSize + GUARD_REGION_SIZE +
+                                  THREAD_STACK_SIZE - 16);
+        REQUIRE(module->getThreadStack(i) == stacks.at(i));
+    }
+
+    // Asking again doesn't provision more
+    REQUIRE(module->getThreadStacks() == stacks);
+    REQUIRE(module->getCurrentBrk() == brkBefore + threadPoolSize * stackSize);
+
+    // Once cleared, they're provisioned again at the break
+    module->clearThreadStacks();
+    module->setMemorySize(brkBefore);
+    REQUIRE(module->getThreadStack(0) == stacks.at(0));
+}
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test provisioning thread stacks beyond the pool",
+                 "[wasm]")
+{
+    faabric::Message call = faabric::util::messageFactory("demo", "echo");
+    wasm::WAVMWasmModule module(1);
+    module.bindToFunction(call);
+
+    int maxStacks = module.getMaxThreadPoolSize();
+    REQUIRE(maxStacks == std::max(1, faabric::util::getUsableCores()));
+
+    // Asking for fewer than the pool still provisions the whole pool
+    std::vector<uint32_t> poolStacks = module.getThreadStacks(0);
+    REQUIRE(poolStacks.size() == 1);
+
+    // Extra stacks come after the pool's
+    uint32_t brkBefore = module.getCurrentBrk();
+    std::vector<uint32_t> stacks = module.getThreadStacks(maxStacks);
+    REQUIRE(stacks.size() == (size_t)maxStacks);
+    REQUIRE(stacks.at(0) == poolStacks.at(0));
+
+    uint32_t stackSize = THREAD_STACK_SIZE + (2 * GUARD_REGION_SIZE);
+    REQUIRE(module.getCurrentBrk() ==
+            brkBefore + (maxStacks - 1) * stackSize);
+
+    // Nothing more is provisioned once they're there
+    REQUIRE(module.getThreadStacks(maxStacks) == stacks);
+    REQUIRE(module.getThreadStacks() == stacks);
+
+    REQUIRE_THROWS(module.getThreadStacks(maxStacks + 1));
+}
 }
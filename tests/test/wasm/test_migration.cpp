@@ -0,0 +1,139 @@
+#include <catch2/catch.hpp>
+
+#include <faabric/snapshot/SnapshotRegistry.h>
+#include <faabric/util/func.h>
+#include <faabric/util/memory.h>
+
+#include <conf/FaasmConfig.h>
+#include <wasm/WasmModule.h>
+#include <wasm/memdiff.h>
+#include <wasm/migration.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+TEST_CASE("Test cross-host fraction of ranks", "[wasm]")
+{
+    std::vector<std::string> hosts;
+    double expected = 0;
+
+    SECTION("No ranks") {}
+
+    SECTION("One rank") { hosts = { "a" }; }
+
+    SECTION("All on one host") { hosts = { "a", "a", "a" }; }
+
+    SECTION("All on different hosts")
+    {
+        hosts = { "a", "b", "c" };
+        expected = 1;
+    }
+
+    SECTION("Split in two")
+    {
+        // Two of the six pairs are on the same host
+        hosts = { "a", "b", "a", "b" };
+        expected = 4.0 / 6.0;
+    }
+
+    REQUIRE(getCrossHostFraction(hosts) == Approx(expected));
+}
+
+TEST_CASE("Test migration cost model", "[wasm]")
+{
+    std::vector<std::string> split = { "a", "a", "b", "b" };
+    std::vector<std::string> packed = { "a", "a", "a", "a" };
+
+    // 1GB takes 8s at 1000Mbps, and packing saves 40% of the time left
+    size_t bytes = 1000 * 1000 * 1000;
+
+    REQUIRE(!isMigrationWorthwhile(bytes, 10, split, packed, 1000));
+    REQUIRE(isMigrationWorthwhile(bytes, 100, split, packed, 1000));
+
+    // Slower networks make it costlier
+    REQUIRE(!isMigrationWorthwhile(bytes, 100, split, packed, 10));
+
+    // Spreading ranks out is never worthwhile
+    REQUIRE(!isMigrationWorthwhile(bytes, 100, packed, split, 1000));
+    REQUIRE(!isMigrationWorthwhile(0, 100, packed, packed, 1000));
+
+    // Moving nothing to consolidate is free
+    REQUIRE(isMigrationWorthwhile(0, 1, split, packed, 1000));
+}
+
+TEST_CASE("Test pre-copy diffs", "[wasm]")
+{
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    std::vector<uint8_t> precopied(4 * pageSize, 0);
+    for (size_t i = 0; i < precopied.size(); i++) {
+        precopied.at(i) = i % 13;
+    }
+    std::vector<uint8_t> memory = precopied;
+
+    size_t expectedChanged = 0;
+    SECTION("Unchanged") {}
+
+    SECTION("Changed")
+    {
+        // Writes are found however the pages were tracked, including pages
+        // written to while the pre-copy was being taken
+        memory.at(100) = 200;
+        memory.at(3 * pageSize + 5) = 201;
+        expectedChanged = 2;
+    }
+
+    SECTION("Grown")
+    {
+        memory.resize(6 * pageSize, 7);
+        memory.at(0) = 202;
+        expectedChanged = 1 + 2 * pageSize;
+    }
+
+    std::vector<faabric::util::SnapshotDiff> diffs =
+      getPrecopyDiffs(precopied, memory);
+    if (expectedChanged == 0) {
+        REQUIRE(diffs.empty());
+    }
+
+    // Applying the diffs brings the pre-copy up to date, without sending
+    // much more than what's changed
+    std::vector<uint8_t> updated = precopied;
+    updated.resize(memory.size(), 0);
+    size_t sentBytes = 0;
+    for (const auto& d : diffs) {
+        std::span<const uint8_t> data = d.getData();
+        std::memcpy(updated.data() + d.getOffset(), data.data(), data.size());
+        sentBytes += data.size();
+    }
+
+    REQUIRE(updated == memory);
+    REQUIRE(sentBytes >= expectedChanged);
+    REQUIRE(sentBytes <= expectedChanged + 2 * MEMORY_DIFF_MERGE_GAP);
+}
+
+TEST_CASE("Test pre-copy guard without a pending migration", "[wasm]")
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    conf.migrationPrecopy = "on";
+
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    msg.set_migrationcheckperiod(1);
+    std::string snapKey = "migration_precopy_" + std::to_string(msg.id());
+
+    // Nothing is copied until a migration is pending, and stopping the
+    // guard doesn't wait for one
+    wasm::WasmModule module;
+    {
+        MigrationPrecopyGuard guard(msg, module);
+    }
+
+    REQUIRE(!faabric::snapshot::getSnapshotRegistry().snapshotExists(snapKey));
+
+    conf.reset();
+}
+}
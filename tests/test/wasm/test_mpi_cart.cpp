@@ -0,0 +1,68 @@
+#include <catch2/catch.hpp>
+
+#include <wasm/mpi_comm.h>
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+TEST_CASE("Test placing Cartesian grids on hosts", "[wasm]")
+{
+    std::vector<int> dims = { 4, 2 };
+    std::vector<bool> periods = { false, false };
+
+    std::vector<std::string> hosts;
+    std::vector<int> expected;
+
+    SECTION("All on one host")
+    {
+        hosts = std::vector<std::string>(8, "a");
+        expected = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    }
+
+    SECTION("Already in blocks")
+    {
+        hosts = { "a", "a", "a", "a", "b", "b", "b", "b" };
+        expected = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    }
+
+    SECTION("Round robin")
+    {
+        // Each host gets a 2x2 block rather than every other rank
+        hosts = { "a", "b", "a", "b", "a", "b", "a", "b" };
+        expected = { 0, 2, 4, 6, 1, 3, 5, 7 };
+    }
+
+    REQUIRE(getMpiCartPlacement(dims, periods, hosts) == expected);
+}
+
+TEST_CASE("Test Cartesian communicator topology", "[wasm]")
+{
+    MpiCommunicator comm(1, { 0, 1, 2, 3, 4, 5 }, 4);
+    REQUIRE(!comm.hasCartTopology());
+
+    // Grids must cover the whole communicator
+    REQUIRE_THROWS_AS(comm.setCartTopology({ 4, 2 }, { true, false }),
+                      std::runtime_error);
+
+    comm.setCartTopology({ 3, 2 }, { true, false });
+    REQUIRE(comm.hasCartTopology());
+    REQUIRE(comm.getCartDims() == std::vector<int>({ 3, 2 }));
+    REQUIRE(comm.getCartCoords(4) == std::vector<int>({ 2, 0 }));
+    REQUIRE(comm.getCartRank({ 1, 1 }) == 3);
+
+    // Only the first dimension wraps
+    REQUIRE(comm.getCartRank({ 3, 0 }) == 0);
+    REQUIRE(comm.getCartRank({ -1, 1 }) == 5);
+    REQUIRE(comm.getCartRank({ 0, 2 }) == MPI_PROC_NULL);
+
+    REQUIRE(comm.shiftCart(0, 1) == std::make_pair(2, 0));
+    REQUIRE(comm.shiftCart(1, 1) == std::make_pair(MPI_PROC_NULL, 5));
+    REQUIRE_THROWS_AS(comm.shiftCart(2, 1), std::runtime_error);
+}
+}
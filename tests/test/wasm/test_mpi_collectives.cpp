@@ -0,0 +1,193 @@
+#include <catch2/catch.hpp>
+
+#include "fixtures.h"
+#include "utils.h"
+
+#include <wasm/mpi_collectives.h>
+#include <wasm/mpi_comm.h>
+
+#include <faabric/mpi/MpiWorld.h>
+#include <faabric/mpi/mpi.h>
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+TEST_CASE_METHOD(MpiTestFixture, "Test MPI all-gather of blocks", "[wasm]")
+{
+    bool inPlace = false;
+
+    SECTION("Separate buffers") { inPlace = false; }
+
+    SECTION("In place") { inPlace = true; }
+
+    // Each rank has a block one bigger than the last, with a gap after it
+    std::vector<int32_t> recvCounts(worldSize);
+    std::vector<int32_t> displs(worldSize);
+    int total = 0;
+    for (int r = 0; r < worldSize; r++) {
+        recvCounts.at(r) = r + 1;
+        displs.at(r) = total;
+        total += r + 2;
+    }
+
+    std::vector<std::vector<int>> expected(worldSize);
+    std::vector<int> allExpected(total, -1);
+    for (int r = 0; r < worldSize; r++) {
+        for (int i = 0; i < recvCounts.at(r); i++) {
+            expected.at(r).push_back(r * 10 + i);
+            allExpected.at(displs.at(r) + i) = r * 10 + i;
+        }
+    }
+
+    std::vector<std::vector<int>> results(worldSize,
+                                          std::vector<int>(total, -1));
+    runRanks(world, worldSize, [&](MpiCore& core) {
+        int r = core.rank;
+        std::vector<int>& result = results.at(r);
+        std::vector<int> ours = expected.at(r);
+
+        const uint8_t* sendBuf = nullptr;
+        if (inPlace) {
+            std::copy(ours.begin(), ours.end(), result.begin() + displs.at(r));
+        } else {
+            sendBuf = reinterpret_cast<uint8_t*>(ours.data());
+        }
+
+        mpiAllGatherV(world,
+                      r,
+                      sendBuf,
+                      ours.size(),
+                      MPI_INT,
+                      reinterpret_cast<uint8_t*>(result.data()),
+                      recvCounts.data(),
+                      displs.data(),
+                      MPI_INT);
+    });
+
+    // The gaps are left alone
+    for (int r = 0; r < worldSize; r++) {
+        REQUIRE(results.at(r) == allExpected);
+    }
+}
+
+TEST_CASE_METHOD(MpiTestFixture, "Test MPI all-to-all of blocks", "[wasm]")
+{
+    // Some ranks send nothing to some others
+    auto getCount = [](int from, int to) { return (from + to) % 3; };
+    auto getValue = [](int from, int to, int i) {
+        return from * 100 + to * 10 + i;
+    };
+
+    std::vector<std::vector<int>> results(worldSize);
+    std::vector<std::vector<int>> expected(worldSize);
+    for (int r = 0; r < worldSize; r++) {
+        for (int from = 0; from < worldSize; from++) {
+            for (int i = 0; i < getCount(from, r); i++) {
+                expected.at(r).push_back(getValue(from, r, i));
+            }
+        }
+
+        results.at(r).resize(expected.at(r).size(), -1);
+    }
+
+    runRanks(world, worldSize, [&](MpiCore& core) {
+        int r = core.rank;
+        std::vector<int> sendBuf;
+        std::vector<int32_t> sendCounts(worldSize);
+        std::vector<int32_t> sendDispls(worldSize);
+        std::vector<int32_t> recvCounts(worldSize);
+        std::vector<int32_t> recvDispls(worldSize);
+
+        int recvTotal = 0;
+        for (int peer = 0; peer < worldSize; peer++) {
+            sendCounts.at(peer) = getCount(r, peer);
+            sendDispls.at(peer) = sendBuf.size();
+            for (int i = 0; i < sendCounts.at(peer); i++) {
+                sendBuf.push_back(getValue(r, peer, i));
+            }
+
+            recvCounts.at(peer) = getCount(peer, r);
+            recvDispls.at(peer) = recvTotal;
+            recvTotal += recvCounts.at(peer);
+        }
+
+        mpiAllToAllV(world,
+                     r,
+                     reinterpret_cast<uint8_t*>(sendBuf.data()),
+                     sendCounts.data(),
+                     sendDispls.data(),
+                     MPI_INT,
+                     reinterpret_cast<uint8_t*>(results.at(r).data()),
+                     recvCounts.data(),
+                     recvDispls.data(),
+                     MPI_INT);
+    });
+
+    for (int r = 0; r < worldSize; r++) {
+        REQUIRE(results.at(r) == expected.at(r));
+    }
+}
+
+TEST_CASE_METHOD(MpiTestFixture, "Test MPI reduce-scatter", "[wasm]")
+{
+    bool inPlace = false;
+
+    SECTION("Separate buffers") { inPlace = false; }
+
+    SECTION("In place") { inPlace = true; }
+
+    std::vector<int32_t> recvCounts(worldSize);
+    std::iota(recvCounts.begin(), recvCounts.end(), 1);
+    int total = std::accumulate(recvCounts.begin(), recvCounts.end(), 0);
+
+    // Each rank contributes its rank plus the index
+    int rankSum = worldSize * (worldSize - 1) / 2;
+    std::vector<std::vector<int>> expected(worldSize);
+    int offset = 0;
+    for (int r = 0; r < worldSize; r++) {
+        for (int i = 0; i < recvCounts.at(r); i++) {
+            expected.at(r).push_back(rankSum + worldSize * (offset + i));
+        }
+        offset += recvCounts.at(r);
+    }
+
+    std::vector<std::vector<int>> results(worldSize);
+    runRanks(world, worldSize, [&](MpiCore& core) {
+        int r = core.rank;
+        std::vector<int> input(total);
+        std::iota(input.begin(), input.end(), r);
+
+        std::vector<int>& result = results.at(r);
+        if (inPlace) {
+            result = input;
+            mpiReduceScatter(world,
+                             r,
+                             reinterpret_cast<uint8_t*>(result.data()),
+                             reinterpret_cast<uint8_t*>(result.data()),
+                             recvCounts.data(),
+                             MPI_INT,
+                             MPI_SUM);
+        } else {
+            result.resize(recvCounts.at(r), -1);
+            mpiReduceScatter(world,
+                             r,
+                             reinterpret_cast<uint8_t*>(input.data()),
+                             reinterpret_cast<uint8_t*>(result.data()),
+                             recvCounts.data(),
+                             MPI_INT,
+                             MPI_SUM);
+        }
+
+        result.resize(recvCounts.at(r));
+    });
+
+    for (int r = 0; r < worldSize; r++) {
+        REQUIRE(results.at(r) == expected.at(r));
+    }
+}
+}
@@ -0,0 +1,158 @@
+#include <catch2/catch.hpp>
+
+#include "fixtures.h"
+#include "utils.h"
+
+#include <wasm/mpi_comm.h>
+#include <wasm/mpi_core.h>
+
+#include <faabric/mpi/MpiWorld.h>
+#include <faabric/mpi/mpi.h>
+
+#include <stdexcept>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+struct CommRankResult
+{
+    int id = 0;
+    int size = 0;
+    int rank = -1;
+    std::vector<int> worldRanks;
+
+    int broadcast = -1;
+    int allReduced = -1;
+    int reduced = -1;
+    std::vector<int> gathered;
+    int received = -1;
+    int receivedFrom = -1;
+
+    std::vector<int> dupWorldRanks;
+    bool dupIsNew = false;
+    bool dupFreed = false;
+};
+
+TEST_CASE_METHOD(MpiTestFixture, "Test splitting MPI communicators", "[wasm]")
+{
+    // Even and odd ranks below the last go into two communicators, in reverse
+    // order of world rank, and the last rank goes in neither
+    int lastRank = worldSize - 1;
+    std::vector<CommRankResult> results(worldSize);
+
+    runRanks(world, worldSize, [&](MpiCore& core) {
+        int r = core.rank;
+        CommRankResult& result = results.at(r);
+
+        int color = r == lastRank ? MPI_UNDEFINED : r % 2;
+        int id = splitMpiCommunicator(world, r, FAABRIC_COMM_WORLD, color, -r);
+        result.id = id;
+        if (id < 0) {
+            return;
+        }
+
+        MpiCommunicator& comm = core.getCommunicator(id);
+        result.size = comm.getSize();
+        result.rank = comm.getRank();
+        for (int c = 0; c < comm.getSize(); c++) {
+            result.worldRanks.push_back(comm.getWorldRank(c));
+        }
+
+        // Collectives only involve the communicator's members
+        int value = r;
+        core.broadcast(reinterpret_cast<uint8_t*>(&value), 1, MPI_INT, 0, id);
+        result.broadcast = value;
+
+        int worldRank = r;
+        core.allReduce(reinterpret_cast<uint8_t*>(&worldRank),
+                       reinterpret_cast<uint8_t*>(&result.allReduced),
+                       1,
+                       MPI_INT,
+                       MPI_SUM,
+                       id);
+
+        int plusOne = r + 1;
+        core.reduce(reinterpret_cast<uint8_t*>(&plusOne),
+                    reinterpret_cast<uint8_t*>(&result.reduced),
+                    1,
+                    MPI_INT,
+                    MPI_SUM,
+                    1,
+                    id);
+
+        value = r;
+        result.gathered.resize(comm.getSize(), -1);
+        core.allGather(reinterpret_cast<uint8_t*>(&value),
+                       1,
+                       MPI_INT,
+                       reinterpret_cast<uint8_t*>(result.gathered.data()),
+                       1,
+                       MPI_INT,
+                       id);
+
+        // Point-to-point ranks are in the communicator too
+        if (comm.getRank() == 0) {
+            core.send(reinterpret_cast<uint8_t*>(&value), 1, MPI_INT, 1, id);
+        } else {
+            MPI_Status status{};
+            core.recv(reinterpret_cast<uint8_t*>(&result.received),
+                      1,
+                      MPI_INT,
+                      0,
+                      id,
+                      &status);
+            result.receivedFrom = status.MPI_SOURCE;
+        }
+
+        core.barrier(id);
+
+        int dupId = dupMpiCommunicator(world, r, id);
+        result.dupIsNew = dupId != id;
+        MpiCommunicator& dup = core.getCommunicator(dupId);
+        for (int c = 0; c < dup.getSize(); c++) {
+            result.dupWorldRanks.push_back(dup.getWorldRank(c));
+        }
+
+        freeMpiCommunicator(dupId);
+        try {
+            core.getCommunicator(dupId);
+        } catch (std::runtime_error& e) {
+            result.dupFreed = true;
+        }
+
+        freeMpiCommunicator(id);
+    });
+
+    REQUIRE(results.at(lastRank).id == -1);
+
+    for (int r = 0; r < lastRank; r++) {
+        const CommRankResult& result = results.at(r);
+
+        // Members agree on the ID, and the two communicators differ
+        REQUIRE(result.id >= 0);
+        REQUIRE(result.id == results.at(r % 2).id);
+        REQUIRE(result.id != results.at(1 - r % 2).id);
+
+        std::vector<int> expectedRanks = { 2 + r % 2, r % 2 };
+        REQUIRE(result.size == 2);
+        REQUIRE(result.worldRanks == expectedRanks);
+        REQUIRE(result.rank == (r < 2 ? 1 : 0));
+
+        REQUIRE(result.broadcast == expectedRanks.at(0));
+        REQUIRE(result.allReduced == expectedRanks.at(0) + expectedRanks.at(1));
+        if (result.rank == 1) {
+            int expectedReduced = expectedRanks.at(0) + expectedRanks.at(1) + 2;
+            REQUIRE(result.reduced == expectedReduced);
+            REQUIRE(result.received == expectedRanks.at(0));
+            REQUIRE(result.receivedFrom == 0);
+        }
+        REQUIRE(result.gathered == expectedRanks);
+
+        REQUIRE(result.dupIsNew);
+        REQUIRE(result.dupWorldRanks == expectedRanks);
+        REQUIRE(result.dupFreed);
+    }
+}
+}
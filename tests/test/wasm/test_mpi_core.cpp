@@ -0,0 +1,297 @@
+#include <catch2/catch.hpp>
+
+#include "fixtures.h"
+#include "utils.h"
+
+#include <wasm/mpi_comm.h>
+#include <wasm/mpi_core.h>
+#include <wasm/mpi_requests.h>
+
+#include <faabric/mpi/MpiWorld.h>
+#include <faabric/mpi/mpi.h>
+
+#include <numeric>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+struct CoreRankResult
+{
+    bool cachesWorld = false;
+
+    int received = -1;
+    int receivedFrom = -1;
+    int receivedBytes = -1;
+
+    int ireceived = -1;
+    std::vector<int> persistent;
+    int sendRecvd = -1;
+    int sendRecvdFrom = -1;
+};
+
+TEST_CASE_METHOD(MpiTestFixture,
+                 "Test MPI point-to-point calls through the core",
+                 "[wasm]")
+{
+    int nStarts = 3;
+    std::vector<CoreRankResult> results(worldSize);
+
+    // Each rank sends to its right and receives from its left, except in the
+    // sendrecv, which goes the other way round
+    runRanks(world, worldSize, [&](MpiCore& core) {
+        int r = core.rank;
+        int right = (r + 1) % worldSize;
+        int left = (r + worldSize - 1) % worldSize;
+        CoreRankResult& result = results.at(r);
+
+        MpiCommunicator& worldComm = core.getCommunicator(FAABRIC_COMM_WORLD);
+        result.cachesWorld =
+          &worldComm == &core.getCommunicator(FAABRIC_COMM_WORLD) &&
+          &worldComm == &getMpiCommunicator(world, r, FAABRIC_COMM_WORLD);
+
+        int value = 100 + r;
+        core.send(reinterpret_cast<uint8_t*>(&value),
+                  1,
+                  MPI_INT,
+                  right,
+                  FAABRIC_COMM_WORLD);
+
+        MPI_Status status{};
+        core.recv(reinterpret_cast<uint8_t*>(&result.received),
+                  1,
+                  MPI_INT,
+                  left,
+                  FAABRIC_COMM_WORLD,
+                  &status);
+        result.receivedFrom = status.MPI_SOURCE;
+        result.receivedBytes = status.bytesSize;
+
+        int sendId = core.isend(reinterpret_cast<uint8_t*>(&value),
+                                1,
+                                MPI_INT,
+                                right,
+                                FAABRIC_COMM_WORLD);
+        int recvId = core.irecv(reinterpret_cast<uint8_t*>(&result.ireceived),
+                                1,
+                                MPI_INT,
+                                left,
+                                FAABRIC_COMM_WORLD);
+        awaitAllMpiRequests(world, { recvId, sendId });
+
+        // Persistent sends read the buffer at each start
+        int outgoing = 0;
+        int incoming = -1;
+        int sendInitId = core.sendInit(reinterpret_cast<uint8_t*>(&outgoing),
+                                       1,
+                                       MPI_INT,
+                                       right,
+                                       FAABRIC_COMM_WORLD);
+        int recvInitId = core.recvInit(reinterpret_cast<uint8_t*>(&incoming),
+                                       1,
+                                       MPI_INT,
+                                       left,
+                                       FAABRIC_COMM_WORLD);
+        for (int i = 0; i < nStarts; i++) {
+            outgoing = r * 10 + i;
+            startMpiPersistentRequest(sendInitId);
+            startMpiPersistentRequest(recvInitId);
+            awaitAllMpiRequests(world, { sendInitId, recvInitId });
+            result.persistent.push_back(incoming);
+        }
+        freeMpiRequest(sendInitId);
+        freeMpiRequest(recvInitId);
+
+        MPI_Status sendRecvStatus{};
+        core.sendRecv(reinterpret_cast<uint8_t*>(&value),
+                      1,
+                      MPI_INT,
+                      left,
+                      reinterpret_cast<uint8_t*>(&result.sendRecvd),
+                      1,
+                      MPI_INT,
+                      right,
+                      FAABRIC_COMM_WORLD,
+                      &sendRecvStatus);
+        result.sendRecvdFrom = sendRecvStatus.MPI_SOURCE;
+    });
+
+    for (int r = 0; r < worldSize; r++) {
+        int right = (r + 1) % worldSize;
+        int left = (r + worldSize - 1) % worldSize;
+        const CoreRankResult& result = results.at(r);
+
+        REQUIRE(result.cachesWorld);
+
+        REQUIRE(result.received == 100 + left);
+        REQUIRE(result.receivedFrom == left);
+        REQUIRE(result.receivedBytes == (int)sizeof(int));
+
+        REQUIRE(result.ireceived == 100 + left);
+
+        std::vector<int> expectedPersistent;
+        for (int i = 0; i < nStarts; i++) {
+            expectedPersistent.push_back(left * 10 + i);
+        }
+        REQUIRE(result.persistent == expectedPersistent);
+
+        REQUIRE(result.sendRecvd == 100 + right);
+        REQUIRE(result.sendRecvdFrom == right);
+    }
+}
+
+struct CollectiveRankResult
+{
+    int broadcast = -1;
+    int reduced = -1;
+    int allReduced = -1;
+    int allReducedInPlace = -1;
+    std::vector<int> gathered;
+    std::vector<int> gatheredInPlace;
+    std::vector<int> exchanged;
+};
+
+TEST_CASE_METHOD(MpiTestFixture,
+                 "Test MPI world collectives through the core",
+                 "[wasm]")
+{
+    bool nonBlocking = false;
+
+    SECTION("Blocking") { nonBlocking = false; }
+
+    SECTION("Non-blocking") { nonBlocking = true; }
+
+    int bcastRoot = 1;
+    int reduceRoot = 3;
+    std::vector<CollectiveRankResult> results(worldSize);
+
+    runRanks(world, worldSize, [&](MpiCore& core) {
+        int r = core.rank;
+        CollectiveRankResult& result = results.at(r);
+
+        int value = r;
+        int plusOne = r + 1;
+        result.broadcast = r == bcastRoot ? 42 : -1;
+        result.allReducedInPlace = r;
+        result.gathered.resize(worldSize, -1);
+        result.gatheredInPlace.resize(worldSize, -1);
+        result.gatheredInPlace.at(r) = r;
+        result.exchanged.resize(worldSize, -1);
+
+        // Rank r sends r * 10 + p to rank p
+        std::vector<int> toSend(worldSize);
+        for (int p = 0; p < worldSize; p++) {
+            toSend.at(p) = r * 10 + p;
+        }
+
+        if (nonBlocking) {
+            std::vector<int> requestIds;
+            requestIds.push_back(
+              core.ibroadcast(reinterpret_cast<uint8_t*>(&result.broadcast),
+                              1,
+                              MPI_INT,
+                              bcastRoot,
+                              FAABRIC_COMM_WORLD));
+            requestIds.push_back(
+              core.iallReduce(reinterpret_cast<uint8_t*>(&value),
+                              reinterpret_cast<uint8_t*>(&result.allReduced),
+                              1,
+                              MPI_INT,
+                              MPI_SUM,
+                              FAABRIC_COMM_WORLD));
+            requestIds.push_back(core.iallReduce(
+              nullptr,
+              reinterpret_cast<uint8_t*>(&result.allReducedInPlace),
+              1,
+              MPI_INT,
+              MPI_SUM,
+              FAABRIC_COMM_WORLD));
+            requestIds.push_back(core.iallToAll(
+              reinterpret_cast<uint8_t*>(toSend.data()),
+              1,
+              MPI_INT,
+              reinterpret_cast<uint8_t*>(result.exchanged.data()),
+              1,
+              MPI_INT));
+            awaitAllMpiRequests(world, requestIds);
+        } else {
+            core.broadcast(reinterpret_cast<uint8_t*>(&result.broadcast),
+                           1,
+                           MPI_INT,
+                           bcastRoot,
+                           FAABRIC_COMM_WORLD);
+            core.allReduce(reinterpret_cast<uint8_t*>(&value),
+                           reinterpret_cast<uint8_t*>(&result.allReduced),
+                           1,
+                           MPI_INT,
+                           MPI_SUM,
+                           FAABRIC_COMM_WORLD);
+            core.allReduce(
+              nullptr,
+              reinterpret_cast<uint8_t*>(&result.allReducedInPlace),
+              1,
+              MPI_INT,
+              MPI_SUM,
+              FAABRIC_COMM_WORLD);
+            core.allToAll(reinterpret_cast<uint8_t*>(toSend.data()),
+                          1,
+                          MPI_INT,
+                          reinterpret_cast<uint8_t*>(result.exchanged.data()),
+                          1,
+                          MPI_INT);
+        }
+
+        // Blocking calls wait for non-blocking ones still in flight
+        core.reduce(reinterpret_cast<uint8_t*>(&plusOne),
+                    reinterpret_cast<uint8_t*>(&result.reduced),
+                    1,
+                    MPI_INT,
+                    MPI_SUM,
+                    reduceRoot,
+                    FAABRIC_COMM_WORLD);
+
+        core.allGather(reinterpret_cast<uint8_t*>(&value),
+                       1,
+                       MPI_INT,
+                       reinterpret_cast<uint8_t*>(result.gathered.data()),
+                       1,
+                       MPI_INT,
+                       FAABRIC_COMM_WORLD);
+        core.allGather(
+          nullptr,
+          1,
+          MPI_INT,
+          reinterpret_cast<uint8_t*>(result.gatheredInPlace.data()),
+          1,
+          MPI_INT,
+          FAABRIC_COMM_WORLD);
+
+        core.barrier(FAABRIC_COMM_WORLD);
+    });
+
+    int rankSum = worldSize * (worldSize - 1) / 2;
+    std::vector<int> allRanks(worldSize);
+    std::iota(allRanks.begin(), allRanks.end(), 0);
+
+    for (int r = 0; r < worldSize; r++) {
+        const CollectiveRankResult& result = results.at(r);
+
+        REQUIRE(result.broadcast == 42);
+        REQUIRE(result.allReduced == rankSum);
+        REQUIRE(result.allReducedInPlace == rankSum);
+        if (r == reduceRoot) {
+            REQUIRE(result.reduced == rankSum + worldSize);
+        }
+
+        REQUIRE(result.gathered == allRanks);
+        REQUIRE(result.gatheredInPlace == allRanks);
+
+        std::vector<int> expectedExchanged(worldSize);
+        for (int p = 0; p < worldSize; p++) {
+            expectedExchanged.at(p) = p * 10 + r;
+        }
+        REQUIRE(result.exchanged == expectedExchanged);
+    }
+}
+}
@@ -0,0 +1,36 @@
+#include <catch2/catch.hpp>
+
+#include <wasm/mpi_file.h>
+
+#include <faabric/mpi/MpiWorld.h>
+#include <faabric/mpi/mpi.h>
+
+#include <stdexcept>
+
+using namespace wasm;
+
+namespace tests {
+
+TEST_CASE("Test MPI files must be shared", "[wasm]")
+{
+    faabric::mpi::MpiWorld world;
+
+    // Checked before any rank is waited on
+    REQUIRE_THROWS_AS(
+      openMpiFile(world, 0, FAABRIC_COMM_WORLD, "/tmp/out.dat", MPI_MODE_RDWR),
+      std::runtime_error);
+
+    REQUIRE_THROWS_AS(openMpiFile(world,
+                                  0,
+                                  FAABRIC_COMM_WORLD,
+                                  "faasm://out.dat",
+                                  MPI_MODE_RDWR | MPI_MODE_SEQUENTIAL),
+                      std::runtime_error);
+}
+
+TEST_CASE("Test unknown MPI files", "[wasm]")
+{
+    REQUIRE_THROWS_AS(getMpiFile(12345), std::runtime_error);
+    REQUIRE_THROWS_AS(closeMpiFile(12345), std::runtime_error);
+}
+}
@@ -0,0 +1,47 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <wasm/WasmExecutionContext.h>
+#include <wasm/mpi_mem.h>
+#include <wavm/WAVMWasmModule.h>
+
+#include <faabric/util/func.h>
+
+#include <stdexcept>
+
+namespace tests {
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test allocating MPI memory",
+                 "[wasm]")
+{
+    faabric::Message call = faabric::util::messageFactory("demo", "echo");
+
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(call);
+    wasm::WasmExecutionContext ctx(&module);
+
+    uint32_t small = wasm::allocMpiMemory(module, 100);
+    uint32_t big = wasm::allocMpiMemory(module, 3 * 1024 * 1024);
+
+    // Big regions start on a huge page
+    uint8_t* base = module.getMemoryBase();
+    REQUIRE(((uintptr_t)(base + big)) % (2 * 1024 * 1024) == 0);
+    REQUIRE(module.getMemorySizeBytes() >= big + 4 * 1024 * 1024);
+
+    REQUIRE(wasm::isMpiMemory(base + small, 100));
+    REQUIRE(wasm::isMpiMemory(base + big + 1024, 1024));
+    REQUIRE(!wasm::isMpiMemory(base, 10));
+
+    // Buffers must lie wholly inside one region
+    REQUIRE(!wasm::isMpiMemory(base + big - 10, 20));
+
+    wasm::freeMpiMemory(module, small);
+    REQUIRE(!wasm::isMpiMemory(base + small, 100));
+    REQUIRE_THROWS_AS(wasm::freeMpiMemory(module, small), std::runtime_error);
+
+    wasm::clearMpiMemory();
+    REQUIRE(!wasm::isMpiMemory(base + big, 1024));
+}
+}
@@ -0,0 +1,169 @@
+#include <catch2/catch.hpp>
+
+#include "fixtures.h"
+#include "utils.h"
+
+#include <wasm/mpi_comm.h>
+#include <wasm/mpi_ops.h>
+
+#include <faabric/mpi/MpiWorld.h>
+#include <faabric/mpi/mpi.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+TEST_CASE("Test registering MPI user ops", "[wasm]")
+{
+    int opA = createMpiUserOp(12, true);
+    int opB = createMpiUserOp(34, false);
+
+    REQUIRE(opA != opB);
+    REQUIRE(isMpiUserOp(opA));
+    REQUIRE(isMpiUserOp(opB));
+    REQUIRE(!isMpiUserOp(MPI_SUM->id));
+    REQUIRE(!isMpiUserOp(MPI_MAX->id));
+
+    REQUIRE(getMpiUserOp(opA).funcPtr == 12);
+    REQUIRE(getMpiUserOp(opA).commute);
+    REQUIRE(getMpiUserOp(opB).funcPtr == 34);
+    REQUIRE(!getMpiUserOp(opB).commute);
+
+    freeMpiUserOp(opA);
+    REQUIRE_THROWS_AS(getMpiUserOp(opA), std::runtime_error);
+    REQUIRE(getMpiUserOp(opB).funcPtr == 34);
+
+    // Ops belong to the thread that made them
+    bool seenElsewhere = true;
+    std::thread other([&seenElsewhere, opB] {
+        try {
+            getMpiUserOp(opB);
+        } catch (std::runtime_error& e) {
+            seenElsewhere = false;
+        }
+    });
+    other.join();
+    REQUIRE(!seenElsewhere);
+
+    clearMpiUserOps();
+    REQUIRE_THROWS_AS(getMpiUserOp(opB), std::runtime_error);
+    REQUIRE(createMpiUserOp(56, true) == FAASM_MPI_USER_OP_BASE);
+    clearMpiUserOps();
+}
+
+// Each element is a number and ten to the power of its number of digits, so
+// combining them writes the digits of one after the other. This is
+// associative but not commutative, so shows the order ranks are combined in.
+static void appendDigits(const uint8_t* in, uint8_t* inout, int count)
+{
+    std::vector<int> a(count);
+    std::vector<int> b(count);
+    std::memcpy(a.data(), in, count * sizeof(int));
+    std::memcpy(b.data(), inout, count * sizeof(int));
+
+    for (int i = 0; i < count; i += 2) {
+        b.at(i) = a.at(i) * b.at(i + 1) + b.at(i);
+        b.at(i + 1) = a.at(i + 1) * b.at(i + 1);
+    }
+
+    std::memcpy(inout, b.data(), count * sizeof(int));
+}
+
+static void maxOf(const uint8_t* in, uint8_t* inout, int count)
+{
+    const int* a = reinterpret_cast<const int*>(in);
+    int* b = reinterpret_cast<int*>(inout);
+    for (int i = 0; i < count; i++) {
+        b[i] = std::max(a[i], b[i]);
+    }
+}
+
+TEST_CASE_METHOD(MpiTestFixture, "Test reducing with MPI user ops", "[wasm]")
+{
+    bool commute = false;
+    bool isAll = false;
+    int root = 2;
+    std::vector<int> expected;
+
+    // Two pairs, to check every element is combined
+    SECTION("Non-commutative reduce")
+    {
+        commute = false;
+        isAll = false;
+        expected = { 12345, 100000, 23456, 100000 };
+    }
+
+    SECTION("Non-commutative allreduce")
+    {
+        commute = false;
+        isAll = true;
+        expected = { 12345, 100000, 23456, 100000 };
+    }
+
+    SECTION("Commutative reduce")
+    {
+        commute = true;
+        isAll = false;
+        expected = { 5, 10, 6, 10 };
+    }
+
+    SECTION("Commutative allreduce")
+    {
+        commute = true;
+        isAll = true;
+        expected = { 5, 10, 6, 10 };
+    }
+
+    int count = expected.size();
+    std::vector<std::vector<int>> results(worldSize,
+                                          std::vector<int>(count, -1));
+
+    runRanks(world, worldSize, [&](MpiCore& core) {
+        int r = core.rank;
+
+        // As the runtimes do, the combine function comes from the op
+        int opId = createMpiUserOp(1, commute);
+        const MpiUserOp& op = getMpiUserOp(opId);
+        MpiCombineFunction combine =
+          op.commute ? MpiCombineFunction(maxOf)
+                     : MpiCombineFunction(appendDigits);
+
+        std::vector<int> input = { r + 1, 10, r + 2, 10 };
+        MpiCommunicator& comm =
+          getMpiCommunicator(world, r, FAABRIC_COMM_WORLD);
+        if (isAll) {
+            comm.allReduce(world,
+                           reinterpret_cast<uint8_t*>(input.data()),
+                           reinterpret_cast<uint8_t*>(results.at(r).data()),
+                           MPI_INT,
+                           count,
+                           combine,
+                           op.commute);
+        } else {
+            comm.reduce(world,
+                        root,
+                        reinterpret_cast<uint8_t*>(input.data()),
+                        reinterpret_cast<uint8_t*>(results.at(r).data()),
+                        MPI_INT,
+                        count,
+                        combine,
+                        op.commute);
+        }
+
+        freeMpiUserOp(opId);
+        clearMpiUserOps();
+    });
+
+    for (int r = 0; r < worldSize; r++) {
+        if (isAll || r == root) {
+            REQUIRE(results.at(r) == expected);
+        }
+    }
+}
+}
@@ -0,0 +1,143 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <wasm/mpi_profile.h>
+
+#include <faabric/util/func.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+
+using namespace wasm;
+
+namespace tests {
+
+TEST_CASE("Test MPI latency buckets", "[wasm]")
+{
+    REQUIRE(getMpiLatencyBucket(0) == 0);
+    REQUIRE(getMpiLatencyBucket(1) == 0);
+    REQUIRE(getMpiLatencyBucket(2) == 1);
+    REQUIRE(getMpiLatencyBucket(3) == 1);
+    REQUIRE(getMpiLatencyBucket(1024) == 10);
+    REQUIRE(getMpiLatencyBucket(2047) == 10);
+    REQUIRE(getMpiLatencyBucket(UINT64_MAX) == MPI_PROFILE_BUCKETS - 1);
+}
+
+TEST_CASE_METHOD(FaasmConfTestFixture,
+                 "Test MPI profiling records calls",
+                 "[wasm]")
+{
+    takeMpiProfile();
+    conf.mpiProfileFile = "/tmp/faasm_mpi_profile.json";
+
+    {
+        MpiProfileTimer timer("S - MPI_Send {} {} {}");
+        recordMpiSend(2, 100);
+    }
+
+    {
+        MpiProfileTimer timer("MPI_Recv {}");
+        MpiWaitTimer waitTimer;
+        recordMpiBytes(40);
+    }
+
+    {
+        MpiProfileTimer timer("S - MPI_Send {} {} {}");
+        recordMpiSend(2, 50);
+        recordMpiSend(3, 8);
+    }
+
+    MpiRankProfile profile = takeMpiProfile();
+    REQUIRE(profile.calls.size() == 2);
+
+    const MpiCallProfile& send = profile.calls.at("MPI_Send");
+    REQUIRE(send.count == 2);
+    REQUIRE(send.bytes == 158);
+    REQUIRE(send.waitNanos == 0);
+
+    uint64_t nHistogram = 0;
+    for (uint64_t n : send.histogram) {
+        nHistogram += n;
+    }
+    REQUIRE(nHistogram == 2);
+
+    const MpiCallProfile& recv = profile.calls.at("MPI_Recv");
+    REQUIRE(recv.count == 1);
+    REQUIRE(recv.bytes == 40);
+    REQUIRE(recv.waitNanos <= recv.nanos);
+
+    std::map<int, uint64_t> expectedBytes = { { 2, 150 }, { 3, 8 } };
+    std::map<int, uint64_t> expectedMessages = { { 2, 2 }, { 3, 1 } };
+    REQUIRE(profile.sentBytes == expectedBytes);
+    REQUIRE(profile.sentMessages == expectedMessages);
+
+    std::string json = profile.toJson("foo", 123, 1);
+    REQUIRE(json.find("\"world\": 123, \"rank\": 1, \"host\": \"foo\"") !=
+            std::string::npos);
+    REQUIRE(json.find("\"MPI_Send\": {\"count\": 2, \"bytes\": 158") !=
+            std::string::npos);
+    REQUIRE(json.find("\"sent_bytes\": {\"2\": 150, \"3\": 8}") !=
+            std::string::npos);
+
+    // Taking the profile clears it
+    REQUIRE(takeMpiProfile().empty());
+}
+
+TEST_CASE_METHOD(FaasmConfTestFixture,
+                 "Test flushing MPI profile attaches totals",
+                 "[wasm]")
+{
+    takeMpiProfile();
+    conf.mpiProfileFile = "/tmp/faasm_mpi_profile_flush.json";
+
+    {
+        MpiProfileTimer timer("S - MPI_Send {} {} {}");
+        recordMpiSend(1, 100);
+    }
+
+    {
+        MpiProfileTimer timer("MPI_Recv {}");
+        recordMpiBytes(20);
+    }
+
+    faabric::Message msg = faabric::util::messageFactory("mpi", "mpi_bcast");
+    msg.set_ismpi(true);
+    flushMpiProfile(msg);
+
+    const auto& details = msg.execgraphdetails();
+    REQUIRE(details.at("mpi-bytes") == "120");
+    REQUIRE(std::stol(details.at("mpi-ns")) > 0);
+    REQUIRE(std::stol(details.at("mpi-wait-ns")) == 0);
+
+    // Non-MPI messages get nothing
+    {
+        MpiProfileTimer timer("S - MPI_Send {} {} {}");
+        recordMpiSend(1, 100);
+    }
+
+    faabric::Message otherMsg = faabric::util::messageFactory("demo", "echo");
+    flushMpiProfile(otherMsg);
+    REQUIRE(otherMsg.execgraphdetails().empty());
+
+    std::remove(conf.mpiProfileFile.c_str());
+}
+
+TEST_CASE_METHOD(FaasmConfTestFixture,
+                 "Test MPI profiling off records nothing",
+                 "[wasm]")
+{
+    takeMpiProfile();
+    conf.mpiProfileFile = "";
+
+    {
+        MpiProfileTimer timer("S - MPI_Send {} {} {}");
+        recordMpiSend(2, 100);
+    }
+
+    MpiRankProfile profile = takeMpiProfile();
+    REQUIRE(profile.empty());
+    REQUIRE(profile.sentBytes.empty());
+}
+}
@@ -0,0 +1,81 @@
+#include <catch2/catch.hpp>
+
+#include <wasm/mpi_progress.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+TEST_CASE("Test running MPI collectives on the progress thread", "[wasm]")
+{
+    std::thread::id callerThread = std::this_thread::get_id();
+
+    // Nothing in flight returns straight away
+    awaitMpiCollectives();
+
+    std::atomic<bool> release = false;
+    std::vector<int> order;
+    std::vector<std::thread::id> threads;
+
+    // The first holds up the rest until we let it go
+    std::vector<int> requestIds;
+    requestIds.push_back(startMpiCollective([&] {
+        while (!release) {
+            std::this_thread::yield();
+        }
+        order.push_back(0);
+        threads.push_back(std::this_thread::get_id());
+    }));
+
+    for (int i = 1; i < 4; i++) {
+        requestIds.push_back(startMpiCollective([&, i] {
+            order.push_back(i);
+            threads.push_back(std::this_thread::get_id());
+        }));
+    }
+
+    for (int requestId : requestIds) {
+        REQUIRE(requestId != 0);
+        REQUIRE(isMpiCollectiveRequest(requestId));
+    }
+    REQUIRE(!isMpiCollectiveDone(requestIds.back()));
+
+    release = true;
+    awaitMpiCollectives();
+
+    // Waiting on them all leaves the requests to be waited on
+    for (int requestId : requestIds) {
+        REQUIRE(isMpiCollectiveDone(requestId));
+        awaitMpiCollective(requestId);
+        REQUIRE(!isMpiCollectiveRequest(requestId));
+    }
+
+    REQUIRE(order == std::vector<int>({ 0, 1, 2, 3 }));
+    for (const auto& t : threads) {
+        REQUIRE(t != callerThread);
+    }
+}
+
+TEST_CASE("Test errors in MPI collectives on the progress thread", "[wasm]")
+{
+    int failed = startMpiCollective(
+      [] { throw std::runtime_error("Collective failed"); });
+
+    bool ran = false;
+    int next = startMpiCollective([&ran] { ran = true; });
+
+    REQUIRE_THROWS_AS(awaitMpiCollective(failed), std::runtime_error);
+    REQUIRE(!isMpiCollectiveRequest(failed));
+
+    awaitMpiCollective(next);
+    REQUIRE(ran);
+
+    REQUIRE(!isMpiCollectiveRequest(12345));
+    REQUIRE_THROWS(awaitMpiCollective(12345));
+}
+}
@@ -0,0 +1,169 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+#include "fixtures.h"
+
+#include <conf/FaasmConfig.h>
+#include <wasm/mpi_comm.h>
+#include <wasm/mpi_core.h>
+#include <wasm/mpi_requests.h>
+
+#include <faabric/mpi/mpi.h>
+
+#include <numeric>
+#include <thread>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+class MpiRendezvousTestFixture : public MpiTestFixture
+{
+  public:
+    MpiRendezvousTestFixture()
+      : faasmConf(conf::getFaasmConfig())
+    {
+        faasmConf.mpiRendezvousThreshold = 256;
+    }
+
+    ~MpiRendezvousTestFixture()
+    {
+        clearMpiCommunicators();
+        faasmConf.reset();
+    }
+
+  protected:
+    conf::FaasmConfig& faasmConf;
+};
+
+TEST_CASE_METHOD(MpiRendezvousTestFixture,
+                 "Test receiving MPI rendezvous sends",
+                 "[wasm]")
+{
+    int sendRank = 1;
+    int recvRank = 0;
+
+    // Big enough to go by rendezvous
+    std::vector<int> sent(1000);
+    std::iota(sent.begin(), sent.end(), 0);
+    int count = sent.size();
+
+    std::thread sender([this, &sent, count, sendRank, recvRank] {
+        MpiCore core(world, sendRank);
+        core.send(reinterpret_cast<uint8_t*>(sent.data()),
+                  count,
+                  MPI_INT,
+                  recvRank,
+                  FAABRIC_COMM_WORLD);
+        clearMpiCommunicators();
+    });
+
+    MpiCore core(world, recvRank);
+    std::vector<int> received(count, -1);
+    uint8_t* buffer = reinterpret_cast<uint8_t*>(received.data());
+    MPI_Status status{};
+    bool hasStatus = true;
+
+    SECTION("MPI_Recv")
+    {
+        core.recv(
+          buffer, count, MPI_INT, sendRank, FAABRIC_COMM_WORLD, &status);
+    }
+
+    SECTION("MPI_Irecv")
+    {
+        int requestId =
+          core.irecv(buffer, count, MPI_INT, sendRank, FAABRIC_COMM_WORLD);
+        awaitAllMpiRequests(world, { requestId });
+        hasStatus = false;
+    }
+
+    SECTION("MPI_Recv_init")
+    {
+        int requestId =
+          core.recvInit(buffer, count, MPI_INT, sendRank, FAABRIC_COMM_WORLD);
+        startMpiPersistentRequest(requestId);
+        REQUIRE(awaitAnyMpiRequest(world, { requestId }) == 0);
+        freeMpiRequest(requestId);
+        finishMpiRequests(world);
+        hasStatus = false;
+    }
+
+    SECTION("MPI_Sendrecv")
+    {
+        // The sender only sends, so ours must go to another rank
+        int other = 2;
+        int outgoing = 7;
+        core.sendRecv(reinterpret_cast<uint8_t*>(&outgoing),
+                      1,
+                      MPI_INT,
+                      other,
+                      buffer,
+                      count,
+                      MPI_INT,
+                      sendRank,
+                      FAABRIC_COMM_WORLD,
+                      &status);
+
+        int incoming = 0;
+        MPI_Status otherStatus{};
+        MpiCore otherCore(world, other);
+        std::thread otherThread([&] {
+            otherCore.recv(reinterpret_cast<uint8_t*>(&incoming),
+                           1,
+                           MPI_INT,
+                           recvRank,
+                           FAABRIC_COMM_WORLD,
+                           &otherStatus);
+            clearMpiCommunicators();
+        });
+        otherThread.join();
+
+        REQUIRE(incoming == outgoing);
+    }
+
+    // The sender only returns once we've copied its data
+    sender.join();
+
+    REQUIRE(received == sent);
+    if (hasStatus) {
+        REQUIRE(status.bytesSize == count * (int)sizeof(int));
+        REQUIRE(status.MPI_SOURCE == sendRank);
+    }
+}
+
+TEST_CASE_METHOD(MpiRendezvousTestFixture,
+                 "Test MPI rendezvous too big for the receive buffer",
+                 "[wasm]")
+{
+    int sendRank = 1;
+    int recvRank = 0;
+
+    std::vector<int> sent(1000, 3);
+    int count = sent.size();
+
+    std::thread sender([this, &sent, count, sendRank, recvRank] {
+        MpiCore core(world, sendRank);
+        core.send(reinterpret_cast<uint8_t*>(sent.data()),
+                  count,
+                  MPI_INT,
+                  recvRank,
+                  FAABRIC_COMM_WORLD);
+        clearMpiCommunicators();
+    });
+
+    // Fails loudly, but still lets the sender go
+    MpiCore core(world, recvRank);
+    std::vector<int> received(count / 2);
+    int requestId = core.irecv(reinterpret_cast<uint8_t*>(received.data()),
+                               received.size(),
+                               MPI_INT,
+                               sendRank,
+                               FAABRIC_COMM_WORLD);
+    REQUIRE_THROWS(awaitAllMpiRequests(world, { requestId }));
+
+    sender.join();
+    finishMpiRequests(world);
+}
+}
@@ -0,0 +1,265 @@
+#include <catch2/catch.hpp>
+
+#include "fixtures.h"
+#include "utils.h"
+
+#include <wasm/mpi_comm.h>
+#include <wasm/mpi_core.h>
+#include <wasm/mpi_progress.h>
+#include <wasm/mpi_requests.h>
+
+#include <faabric/mpi/MpiWorld.h>
+#include <faabric/mpi/mpi.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+TEST_CASE("Test starting persistent MPI requests", "[wasm]")
+{
+    // Collective requests never touch the world
+    faabric::mpi::MpiWorld world;
+
+    int nStarts = 0;
+    int nRuns = 0;
+    int requestId = addMpiPersistentRequest([&nStarts, &nRuns] {
+        nStarts++;
+        return startMpiCollective([&nRuns] { nRuns++; });
+    });
+
+    REQUIRE(isMpiPersistentRequest(requestId));
+
+    // Inactive requests wait like null ones
+    awaitAllMpiRequests(world, { requestId });
+    REQUIRE(awaitAnyMpiRequest(world, { 0, requestId }) == -1);
+    REQUIRE(nStarts == 0);
+
+    for (int i = 1; i <= 3; i++) {
+        startMpiPersistentRequest(requestId);
+        REQUIRE_THROWS_AS(startMpiPersistentRequest(requestId),
+                          std::runtime_error);
+
+        if (i % 2 == 0) {
+            REQUIRE(awaitAnyMpiRequest(world, { 0, requestId }) == 1);
+        } else {
+            awaitAllMpiRequests(world, { requestId });
+        }
+
+        REQUIRE(nStarts == i);
+        REQUIRE(nRuns == i);
+        REQUIRE(isMpiPersistentRequest(requestId));
+    }
+
+    // Freeing a started request still lets it finish
+    startMpiPersistentRequest(requestId);
+    freeMpiRequest(requestId);
+    REQUIRE(!isMpiPersistentRequest(requestId));
+    REQUIRE_THROWS_AS(startMpiPersistentRequest(requestId),
+                      std::runtime_error);
+
+    finishMpiRequests(world);
+    REQUIRE(nRuns == 4);
+}
+
+TEST_CASE_METHOD(MpiTestFixture, "Test waiting for all MPI requests", "[wasm]")
+{
+    std::vector<std::vector<int>> received(worldSize,
+                                           std::vector<int>(worldSize, -1));
+
+    runRanks(world, worldSize, [&](MpiCore& core) {
+        int rank = core.rank;
+        std::vector<int>& ours = received.at(rank);
+
+        // Receives come before sends and nulls are mixed in, so the wait has
+        // to sort them out
+        std::vector<int> requestIds = { 0 };
+        for (int other = 0; other < worldSize; other++) {
+            if (other == rank) {
+                continue;
+            }
+
+            requestIds.push_back(
+              core.irecv(reinterpret_cast<uint8_t*>(&ours.at(other)),
+                         1,
+                         MPI_INT,
+                         other,
+                         FAABRIC_COMM_WORLD));
+        }
+
+        int value = 100 + rank;
+        for (int other = 0; other < worldSize; other++) {
+            if (other == rank) {
+                continue;
+            }
+
+            requestIds.push_back(core.isend(reinterpret_cast<uint8_t*>(&value),
+                                            1,
+                                            MPI_INT,
+                                            other,
+                                            FAABRIC_COMM_WORLD));
+            requestIds.push_back(0);
+        }
+
+        awaitAllMpiRequests(world, requestIds);
+    });
+
+    for (int r = 0; r < worldSize; r++) {
+        for (int other = 0; other < worldSize; other++) {
+            int expected = other == r ? -1 : 100 + other;
+            REQUIRE(received.at(r).at(other) == expected);
+        }
+    }
+}
+
+TEST_CASE_METHOD(MpiTestFixture, "Test waiting for any MPI request", "[wasm]")
+{
+    int nOthers = worldSize - 1;
+
+    std::vector<std::vector<int>> received(worldSize,
+                                           std::vector<int>(worldSize, -1));
+    std::vector<std::vector<int>> order(worldSize);
+    std::vector<int> afterAll(worldSize, 0);
+
+    runRanks(world, worldSize, [&](MpiCore& core) {
+        int rank = core.rank;
+        std::vector<int>& ours = received.at(rank);
+
+        std::vector<int> requestIds;
+        for (int other = 0; other < worldSize; other++) {
+            if (other == rank) {
+                continue;
+            }
+
+            requestIds.push_back(
+              core.irecv(reinterpret_cast<uint8_t*>(&ours.at(other)),
+                         1,
+                         MPI_INT,
+                         other,
+                         FAABRIC_COMM_WORLD));
+        }
+
+        int value = 100 + rank;
+        for (int other = 0; other < worldSize; other++) {
+            if (other == rank) {
+                continue;
+            }
+
+            requestIds.push_back(core.isend(reinterpret_cast<uint8_t*>(&value),
+                                            1,
+                                            MPI_INT,
+                                            other,
+                                            FAABRIC_COMM_WORLD));
+        }
+
+        // Awaited requests become null, as MPI_Waitany does to the guest's
+        for (size_t i = 0; i < requestIds.size(); i++) {
+            int idx = awaitAnyMpiRequest(world, requestIds);
+            order.at(rank).push_back(idx);
+            if (idx >= 0) {
+                requestIds.at(idx) = 0;
+            }
+        }
+
+        afterAll.at(rank) = awaitAnyMpiRequest(world, requestIds);
+    });
+
+    for (int r = 0; r < worldSize; r++) {
+        for (int other = 0; other < worldSize; other++) {
+            int expected = other == r ? -1 : 100 + other;
+            REQUIRE(received.at(r).at(other) == expected);
+        }
+
+        // Every request is returned once, with the sends first as they're
+        // already done
+        const std::vector<int>& indexes = order.at(r);
+        REQUIRE((int)indexes.size() == 2 * nOthers);
+        for (int i = 0; i < nOthers; i++) {
+            REQUIRE(indexes.at(i) >= nOthers);
+        }
+
+        std::vector<int> sorted = indexes;
+        std::sort(sorted.begin(), sorted.end());
+        for (int i = 0; i < 2 * nOthers; i++) {
+            REQUIRE(sorted.at(i) == i);
+        }
+
+        REQUIRE(afterAll.at(r) == -1);
+    }
+}
+
+TEST_CASE_METHOD(MpiTestFixture, "Test freeing MPI requests", "[wasm]")
+{
+    int sendRank = 1;
+    int recvRank = 0;
+
+    int freedValue = -1;
+    int awaitedValue = -1;
+    int valueAtFree = 0;
+    bool atFinalize = false;
+
+    SECTION("Awaited at the next wait") { atFinalize = false; }
+
+    SECTION("Awaited at finalize") { atFinalize = true; }
+
+    std::thread sender([&] {
+        MpiCore core(world, sendRank);
+
+        // The guest may free a send as soon as it's made
+        std::vector<int> values = { 5, 6 };
+        for (int& v : values) {
+            int requestId = core.isend(reinterpret_cast<uint8_t*>(&v),
+                                       1,
+                                       MPI_INT,
+                                       recvRank,
+                                       FAABRIC_COMM_WORLD);
+            freeMpiRequest(requestId);
+        }
+
+        finishMpiRequests(world);
+        clearMpiCommunicators();
+    });
+
+    MpiCore core(world, recvRank);
+    int freedId = core.irecv(reinterpret_cast<uint8_t*>(&freedValue),
+                             1,
+                             MPI_INT,
+                             sendRank,
+                             FAABRIC_COMM_WORLD);
+    freeMpiRequest(freedId);
+    valueAtFree = freedValue;
+
+    if (atFinalize) {
+        finishMpiRequests(world);
+        REQUIRE(freedValue == 5);
+
+        MPI_Status status{};
+        core.recv(reinterpret_cast<uint8_t*>(&awaitedValue),
+                  1,
+                  MPI_INT,
+                  sendRank,
+                  FAABRIC_COMM_WORLD,
+                  &status);
+    } else {
+        int requestId = core.irecv(reinterpret_cast<uint8_t*>(&awaitedValue),
+                                   1,
+                                   MPI_INT,
+                                   sendRank,
+                                   FAABRIC_COMM_WORLD);
+        REQUIRE(awaitAnyMpiRequest(world, { 0, requestId }) == 1);
+        finishMpiRequests(world);
+    }
+
+    sender.join();
+    clearMpiCommunicators();
+
+    // The freed receive still lands where the guest asked
+    REQUIRE(valueAtFree == -1);
+    REQUIRE(freedValue == 5);
+    REQUIRE(awaitedValue == 6);
+}
+}
@@ -0,0 +1,126 @@
+#include <catch2/catch.hpp>
+
+#include <wasm/mpi_shm.h>
+
+#include <thread>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+static void addInts(const uint8_t* in, uint8_t* inout)
+{
+    const int* a = reinterpret_cast<const int*>(in);
+    int* b = reinterpret_cast<int*>(inout);
+    for (int i = 0; i < 4; i++) {
+        b[i] += a[i];
+    }
+}
+
+TEST_CASE("Test reducing through an MPI host segment", "[wasm]")
+{
+    int nMembers = 5;
+    int nRounds = 20;
+    std::string key = "test_mpi_shm_reduce";
+
+    std::shared_ptr<MpiHostSegment> segment =
+      getMpiHostSegment(key, nMembers);
+    REQUIRE(getMpiHostSegment(key, nMembers) == segment);
+    REQUIRE(segment->getMemberCount() == nMembers);
+
+    std::vector<std::vector<int>> results(nMembers);
+    std::vector<std::thread> threads;
+    for (int m = 0; m < nMembers; m++) {
+        threads.emplace_back([&, m] {
+            std::vector<int> result(4);
+            for (int round = 0; round < nRounds; round++) {
+                std::vector<int> data(4, m + round);
+                segment->contribute(reinterpret_cast<uint8_t*>(data.data()),
+                                    data.size() * sizeof(int),
+                                    addInts);
+
+                // The first member leads, and adds one to check the result
+                // goes back out
+                if (m == 0) {
+                    std::vector<uint8_t>& acc = segment->awaitContributions();
+                    reinterpret_cast<int*>(acc.data())[0] += 1;
+                    segment->publish();
+                }
+
+                segment->read(reinterpret_cast<uint8_t*>(result.data()),
+                              result.size() * sizeof(int));
+
+                // Only the last round is kept
+                results.at(m) = result;
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+
+    // Each round sums m + round over the members
+    int lastRound = nRounds - 1;
+    int expected = 0;
+    for (int m = 0; m < nMembers; m++) {
+        expected += m + lastRound;
+    }
+
+    for (const auto& result : results) {
+        REQUIRE(result == std::vector<int>({ expected + 1,
+                                             expected,
+                                             expected,
+                                             expected }));
+    }
+
+    removeMpiHostSegment(key);
+    REQUIRE(getMpiHostSegment(key, nMembers) != segment);
+    removeMpiHostSegment(key);
+}
+
+TEST_CASE("Test broadcasting through an MPI host segment", "[wasm]")
+{
+    int nMembers = 4;
+    std::string key = "test_mpi_shm_broadcast";
+    std::shared_ptr<MpiHostSegment> segment =
+      getMpiHostSegment(key, nMembers);
+
+    std::vector<std::vector<int>> results(nMembers, std::vector<int>(3, 0));
+    std::vector<std::thread> threads;
+    for (int m = 0; m < nMembers; m++) {
+        threads.emplace_back([&, m] {
+            segment->contribute(nullptr, 0, nullptr);
+
+            uint8_t* buffer = reinterpret_cast<uint8_t*>(results.at(m).data());
+            size_t nBytes = 3 * sizeof(int);
+            if (m == 2) {
+                results.at(m) = { 7, 8, 9 };
+                buffer = reinterpret_cast<uint8_t*>(results.at(m).data());
+
+                std::vector<uint8_t>& data = segment->awaitContributions();
+                data.assign(buffer, buffer + nBytes);
+                segment->publish();
+                segment->read(nullptr, nBytes);
+            } else {
+                segment->read(buffer, nBytes);
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+
+    for (const auto& result : results) {
+        REQUIRE(result == std::vector<int>({ 7, 8, 9 }));
+    }
+
+    removeMpiHostSegment(key);
+}
+}
@@ -0,0 +1,133 @@
+#include <catch2/catch.hpp>
+
+#include <wasm/mpi_types.h>
+
+#include <numeric>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+TEST_CASE("Test MPI vector type packs a matrix column", "[wasm]")
+{
+    // Column 1 of a 4x3 matrix of ints
+    std::vector<int> matrix(12);
+    std::iota(matrix.begin(), matrix.end(), 0);
+
+    MpiTypeLayout column = mpiTypeVector(4, 1, 3, MpiTypeLayout(sizeof(int)));
+    REQUIRE(column.getSize() == 4 * sizeof(int));
+    REQUIRE(column.getExtent() == 10 * sizeof(int));
+    REQUIRE(!column.isContiguous());
+    REQUIRE(column.getBlocks().size() == 4);
+
+    std::vector<int> packed(4);
+    column.pack(reinterpret_cast<uint8_t*>(matrix.data() + 1),
+                1,
+                reinterpret_cast<uint8_t*>(packed.data()));
+    REQUIRE(packed == std::vector<int>({ 1, 4, 7, 10 }));
+
+    std::vector<int> unpacked(12, -1);
+    column.unpack(reinterpret_cast<uint8_t*>(packed.data()),
+                  1,
+                  reinterpret_cast<uint8_t*>(unpacked.data() + 1));
+    std::vector<int> expected = { -1, 1, -1, -1, 4, -1, -1, 7, -1, -1, 10, -1 };
+    REQUIRE(unpacked == expected);
+}
+
+TEST_CASE("Test MPI contiguous types have no gaps", "[wasm]")
+{
+    MpiTypeLayout intType(sizeof(int));
+
+    MpiTypeLayout contiguous = mpiTypeContiguous(5, intType);
+    REQUIRE(contiguous.isContiguous());
+    REQUIRE(contiguous.getBlocks().size() == 1);
+    REQUIRE(contiguous.getSize() == 5 * sizeof(int));
+
+    // Vectors with the stride equal to the block length have no gaps
+    MpiTypeLayout dense = mpiTypeVector(3, 2, 2, intType);
+    REQUIRE(dense.isContiguous());
+
+    MpiTypeLayout sparse = mpiTypeVector(3, 1, 2, intType);
+    REQUIRE(!sparse.isContiguous());
+    REQUIRE(sparse.getSpan(2) == 10 * sizeof(int));
+}
+
+TEST_CASE("Test MPI indexed and struct types", "[wasm]")
+{
+    MpiTypeLayout intType(sizeof(int));
+
+    std::vector<int32_t> blockLengths = { 2, 1 };
+    std::vector<int32_t> displacements = { 1, 5 };
+    MpiTypeLayout indexed = mpiTypeIndexed(
+      2, blockLengths.data(), displacements.data(), intType);
+    REQUIRE(indexed.getSize() == 3 * sizeof(int));
+    REQUIRE(indexed.getExtent() == 6 * sizeof(int));
+
+    std::vector<int> data = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+    std::vector<int> packed(6);
+    indexed.pack(reinterpret_cast<uint8_t*>(data.data()),
+                 2,
+                 reinterpret_cast<uint8_t*>(packed.data()));
+    REQUIRE(packed == std::vector<int>({ 1, 2, 5, 7, 8, 11 }));
+
+    // A char followed by a double with padding in between
+    std::vector<int32_t> structLengths = { 1, 1 };
+    std::vector<int32_t> structDisplacements = { 0, 8 };
+    std::vector<MpiTypeLayout> types = { MpiTypeLayout(1), MpiTypeLayout(8) };
+    MpiTypeLayout structType = mpiTypeStruct(
+      2, structLengths.data(), structDisplacements.data(), types);
+    REQUIRE(structType.getSize() == 9);
+    REQUIRE(structType.getExtent() == 16);
+    REQUIRE(structType.getBlocks().size() == 2);
+}
+
+TEST_CASE("Test MPI subarray type", "[wasm]")
+{
+    // One by two elements from a 4x4 grid
+    std::vector<int32_t> sizes = { 4, 4 };
+    std::vector<int32_t> subSizes = { 1, 2 };
+    std::vector<int32_t> starts = { 2, 1 };
+
+    int order = 0;
+    std::vector<int> expected;
+    SECTION("C order")
+    {
+        // Row 2, columns 1 and 2
+        order = MPI_ORDER_C;
+        expected = { 9, 10 };
+    }
+
+    SECTION("Fortran order")
+    {
+        // Column 2, rows 1 and 2
+        order = MPI_ORDER_FORTRAN;
+        expected = { 6, 10 };
+    }
+
+    MpiTypeLayout block = mpiTypeSubarray(2,
+                                          sizes.data(),
+                                          subSizes.data(),
+                                          starts.data(),
+                                          order,
+                                          MpiTypeLayout(sizeof(int)));
+    REQUIRE(block.getSize() == 2 * sizeof(int));
+    REQUIRE(block.getExtent() == 16 * sizeof(int));
+
+    std::vector<int> grid(16);
+    std::iota(grid.begin(), grid.end(), 0);
+    std::vector<int> packed(2);
+    block.pack(reinterpret_cast<uint8_t*>(grid.data()),
+               1,
+               reinterpret_cast<uint8_t*>(packed.data()));
+    REQUIRE(packed == expected);
+
+    starts = { 3, 3 };
+    REQUIRE_THROWS(mpiTypeSubarray(2,
+                                   sizes.data(),
+                                   subSizes.data(),
+                                   starts.data(),
+                                   order,
+                                   MpiTypeLayout(sizeof(int))));
+}
+}
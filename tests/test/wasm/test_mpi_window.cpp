@@ -0,0 +1,116 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+#include "utils.h"
+
+#include <wasm/WasmModule.h>
+#include <wasm/mpi_window.h>
+
+#include <faabric/state/State.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/memory.h>
+
+#include <stdexcept>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+struct WindowRankResult
+{
+    bool mapped = false;
+    uint8_t received = 0;
+    bool registered = true;
+    uint8_t inMemory = 0;
+    uint8_t inKey = 0;
+};
+
+TEST_CASE_METHOD(MpiTestFixture, "Test releasing MPI windows", "[wasm]")
+{
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    // A host page of memory per rank fits in one wasm page
+    HostMemoryModule module(1);
+    module.growMemory(worldSize * pageSize);
+    std::string user = "mpi";
+
+    bool aligned = false;
+    bool freed = false;
+
+    SECTION("Mapped and freed")
+    {
+        aligned = true;
+        freed = true;
+    }
+
+    SECTION("Mapped and dropped")
+    {
+        aligned = true;
+        freed = false;
+    }
+
+    SECTION("Copied and freed")
+    {
+        aligned = false;
+        freed = true;
+    }
+
+    SECTION("Copied and dropped")
+    {
+        aligned = false;
+        freed = false;
+    }
+
+    std::vector<WindowRankResult> results(worldSize);
+    runRanks(world, worldSize, [&](MpiCore& core) {
+        int r = core.rank;
+        uint32_t offset = r * pageSize + (aligned ? 0 : 8);
+        size_t size = aligned ? pageSize : pageSize - 16;
+        uint8_t* base = module.wasmPointerToNative(offset);
+        std::fill_n(base, size, (uint8_t)r);
+
+        int32_t winPtr = 1000 + r;
+        MpiWindow& window =
+          createMpiWindow(winPtr, world, r, user, &module, offset, size, 1);
+        results.at(r).mapped = window.isMapped();
+
+        // Each rank puts into the next one's window
+        int next = (r + 1) % worldSize;
+        std::vector<uint8_t> data(8, 100 + r);
+        window.put(next, 0, data.data(), data.size());
+        window.fence();
+        results.at(r).received = base[0];
+
+        if (freed) {
+            freeMpiWindow(winPtr);
+        } else {
+            clearMpiWindows();
+        }
+
+        try {
+            getMpiWindow(winPtr);
+        } catch (std::runtime_error& e) {
+            results.at(r).registered = false;
+        }
+
+        // Our memory is our own again
+        base[0] = 7;
+        results.at(r).inMemory = base[0];
+
+        std::string key = fmt::format("mpi_win_{}_{}_{}", world.getId(), 0, r);
+        auto kv = faabric::state::getGlobalState().getKV(user, key, pageSize);
+        kv->getChunk(0, &results.at(r).inKey, 1);
+    });
+
+    for (int r = 0; r < worldSize; r++) {
+        uint8_t expected = 100 + (r + worldSize - 1) % worldSize;
+
+        const WindowRankResult& result = results.at(r);
+        REQUIRE(result.mapped == aligned);
+        REQUIRE(result.received == expected);
+        REQUIRE(!result.registered);
+        REQUIRE(result.inMemory == 7);
+        REQUIRE(result.inKey == expected);
+    }
+}
+}
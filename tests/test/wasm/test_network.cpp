@@ -0,0 +1,70 @@
+#include <catch2/catch.hpp>
+
+#include <wasm/network.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace tests {
+
+TEST_CASE("Test clamping network timeouts to the deadline", "[wasm]")
+{
+    int64_t nowMs = 1000;
+    int64_t deadlineMs = 1500;
+
+    // Waits that end before the deadline are left alone
+    REQUIRE(wasm::clampTimeoutToDeadline(0, nowMs, deadlineMs) == 0);
+    REQUIRE(wasm::clampTimeoutToDeadline(200, nowMs, deadlineMs) == 200);
+    REQUIRE(wasm::clampTimeoutToDeadline(500, nowMs, deadlineMs) == 500);
+
+    // Longer and infinite waits end at the deadline
+    REQUIRE(wasm::clampTimeoutToDeadline(501, nowMs, deadlineMs) == 500);
+    REQUIRE(wasm::clampTimeoutToDeadline(-1, nowMs, deadlineMs) == 500);
+
+    // Past the deadline, waits become checks
+    REQUIRE(wasm::clampTimeoutToDeadline(-1, 2000, deadlineMs) == 0);
+    REQUIRE(wasm::clampTimeoutToDeadline(100, 2000, deadlineMs) == 0);
+}
+
+TEST_CASE("Test polling sockets within the deadline", "[wasm]")
+{
+    int fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+
+    pollfd pollFds[2];
+    pollFds[0] = { fds[0], POLLIN, 0 };
+    pollFds[1] = { fds[1], POLLOUT, 0 };
+
+    // Nothing to read yet, but the other end is writable
+    REQUIRE(wasm::pollWithinDeadline(pollFds, 2, 0) == 1);
+    REQUIRE(pollFds[0].revents == 0);
+    REQUIRE(pollFds[1].revents == POLLOUT);
+
+    char data = 'a';
+    REQUIRE(::write(fds[1], &data, 1) == 1);
+
+    REQUIRE(wasm::pollWithinDeadline(pollFds, 1, 100) == 1);
+    REQUIRE(pollFds[0].revents == POLLIN);
+
+    // Same again with epoll
+    int epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    REQUIRE(epollFd >= 0);
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = 123;
+    REQUIRE(::epoll_ctl(epollFd, EPOLL_CTL_ADD, fds[0], &event) == 0);
+
+    epoll_event events[2];
+    REQUIRE(wasm::epollWaitWithinDeadline(epollFd, events, 2, 100) == 1);
+    REQUIRE(events[0].data.u64 == 123);
+    REQUIRE((events[0].events & EPOLLIN) == EPOLLIN);
+
+    // Bad fds give back -errno
+    REQUIRE(wasm::epollWaitWithinDeadline(-1, events, 2, 0) == -EBADF);
+
+    ::close(epollFd);
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+}
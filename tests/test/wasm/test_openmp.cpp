@@ -4,13 +4,27 @@
 #include "fixtures.h"
 #include "utils.h"
 
+#include <conf/FaasmConfig.h>
 #include <faabric/proto/faabric.pb.h>
 #include <faabric/scheduler/Scheduler.h>
 #include <faabric/snapshot/SnapshotRegistry.h>
 #include <faabric/util/config.h>
 #include <faabric/util/environment.h>
+#include <faabric/util/files.h>
 #include <faabric/util/func.h>
+#include <faabric/util/gids.h>
+#include <faabric/util/scheduling.h>
 #include <faabric/util/string_tools.h>
+#include <threads/ThreadState.h>
+#include <wasm/openmp.h>
+#include <wavm/WAVMWasmModule.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+
+#include <atomic>
+#include <functional>
+#include <thread>
 
 // Longer timeout to allow longer-running functions to finish even when doing
 // trace-level logging
@@ -24,9 +38,13 @@ class OpenMPTestFixture
   , public SnapshotTestFixture
 {
   public:
-    OpenMPTestFixture() { conf.overrideCpuCount = 30; }
+    OpenMPTestFixture()
+      : faasmConf(conf::getFaasmConfig())
+    {
+        conf.overrideCpuCount = 30;
+    }
 
-    ~OpenMPTestFixture() {}
+    ~OpenMPTestFixture() { faasmConf.reset(); }
 
     std::string doOmpTestLocal(const std::string& function)
     {
@@ -36,12 +54,132 @@ class OpenMPTestFixture
 
         return result.outputdata();
     }
+
+  protected:
+    conf::FaasmConfig& faasmConf;
+};
+
+/**
+ * Runs the host side of the OpenMP runtime on plain threads, each with the
+ * executor context and level of a thread in a team. All the threads are on
+ * this host, but unless the team is single-host it coordinates through its
+ * point-to-point group and global state as if it were spread out.
+ */
+class OpenMPHostTestFixture
+  : public StateTestFixture
+  , public PointToPointTestFixture
+  , public ExecutorContextTestFixture
+{
+  public:
+    std::shared_ptr<faabric::BatchExecuteRequest> createTeam(int nThreads,
+                                                             bool singleHost)
+    {
+        auto req = faabric::util::batchExecFactory("omp", "host", nThreads);
+        req->set_type(faabric::BatchExecuteRequest::THREADS);
+        req->set_singlehost(singleHost);
+
+        int groupId = (int)faabric::util::generateGid();
+        const std::string& thisHost =
+          faabric::util::getSystemConfig().endpointHost;
+        faabric::util::SchedulingDecision decision(req->messages(0).appid(),
+                                                   groupId);
+        for (int i = 0; i < nThreads; i++) {
+            faabric::Message& m = req->mutable_messages()->at(i);
+            m.set_appidx(i);
+            m.set_groupid(groupId);
+            m.set_groupidx(i);
+            decision.addMessage(thisHost, m);
+        }
+        broker.setUpLocalMappingsFromSchedulingDecision(decision);
+
+        return req;
+    }
+
+    void runTeam(std::shared_ptr<faabric::BatchExecuteRequest> req,
+                 const std::function<void(int)>& threadFunc)
+    {
+        auto level = std::make_shared<threads::Level>(req->messages_size());
+
+        std::vector<std::thread> teamThreads;
+        for (int i = 0; i < req->messages_size(); i++) {
+            teamThreads.emplace_back([req, level, i, &threadFunc] {
+                faabric::scheduler::ExecutorContext::set(nullptr, req, i);
+                threads::setCurrentOpenMPLevel(level);
+                threadFunc(i);
+            });
+        }
+
+        for (auto& t : teamThreads) {
+            if (t.joinable()) {
+                t.join();
+            }
+        }
+    }
 };
 
+TEST_CASE_METHOD(OpenMPTestFixture,
+                 "Test OpenMP with and without local teams",
+                 "[wasm][openmp]")
+{
+    SECTION("Local teams") { faasmConf.ompLocalTeams = "on"; }
+
+    SECTION("Scheduled teams") { faasmConf.ompLocalTeams = "off"; }
+
+    doOmpTestLocal("omp_checks");
+    doOmpTestLocal("repeated_reduce");
+    doOmpTestLocal("for_static_schedule");
+}
+
+TEST_CASE_METHOD(OpenMPTestFixture,
+                 "Test OpenMP profiling",
+                 "[wasm][openmp]")
+{
+    std::string profileFile = "/tmp/faasm_omp_profile.json";
+    boost::filesystem::remove(profileFile);
+    faasmConf.ompProfileFile = profileFile;
+
+    SECTION("Local teams") { faasmConf.ompLocalTeams = "on"; }
+
+    SECTION("Scheduled teams") { faasmConf.ompLocalTeams = "off"; }
+
+    doOmpTestLocal("repeated_reduce");
+
+    std::string profile = faabric::util::readFileToString(profileFile);
+    std::vector<std::string> lines;
+    boost::split(lines, profile, [](char c) { return c == '\n'; });
+
+    // Each line is a thread's profile, and the master records the forks
+    bool masterForked = false;
+    int nProfiles = 0;
+    for (const auto& line : lines) {
+        if (line.empty()) {
+            continue;
+        }
+
+        nProfiles++;
+        REQUIRE(line.find("\"region_ns\"") != std::string::npos);
+        REQUIRE(line.find("\"barrier_ns\"") != std::string::npos);
+
+        if (line.find("\"thread\": 0,") != std::string::npos &&
+            line.find("\"fork_count\": 0,") == std::string::npos) {
+            masterForked = true;
+        }
+    }
+
+    REQUIRE(nProfiles > 1);
+    REQUIRE(masterForked);
+
+    boost::filesystem::remove(profileFile);
+}
+
 TEST_CASE_METHOD(OpenMPTestFixture,
                  "Test OpenMP static for scheduling",
                  "[wasm][openmp]")
 {
+    SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
     doOmpTestLocal("for_static_schedule");
 }
 
@@ -63,6 +201,10 @@ TEST_CASE_METHOD(OpenMPTestFixture,
                  "Test OpenMP barrier pragma",
                  "[wasm][openmp]")
 {
+    SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
     doOmpTestLocal("simple_barrier");
 }
 
@@ -70,6 +212,10 @@ TEST_CASE_METHOD(OpenMPTestFixture,
                  "Test OpenMP parallel for pragma",
                  "[wasm][openmp]")
 {
+    SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
     doOmpTestLocal("simple_for");
 }
 
@@ -77,11 +223,19 @@ TEST_CASE_METHOD(OpenMPTestFixture,
                  "Test OpenMP master pragma",
                  "[wasm][openmp]")
 {
+    SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
     doOmpTestLocal("simple_master");
 }
 
 TEST_CASE_METHOD(OpenMPTestFixture, "Test OpenMP reduction", "[wasm][openmp]")
 {
+    SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
     doOmpTestLocal("simple_reduce");
 }
 
@@ -89,6 +243,10 @@ TEST_CASE_METHOD(OpenMPTestFixture,
                  "Test a mix of OpenMP constructs",
                  "[wasm][openmp]")
 {
+    SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
     doOmpTestLocal("reduction_integral");
 }
 
@@ -96,6 +254,10 @@ TEST_CASE_METHOD(OpenMPTestFixture,
                  "Test OpenMP critical section",
                  "[wasm][openmp]")
 {
+    SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
     doOmpTestLocal("simple_critical");
 }
 
@@ -103,6 +265,10 @@ TEST_CASE_METHOD(OpenMPTestFixture,
                  "Test OpenMP single section",
                  "[wasm][openmp]")
 {
+    SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
     doOmpTestLocal("simple_single");
 }
 
@@ -110,6 +276,10 @@ TEST_CASE_METHOD(OpenMPTestFixture,
                  "Test custom OpenMP reduction function",
                  "[wasm][openmp]")
 {
+    SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
     doOmpTestLocal("custom_reduce");
 }
 
@@ -127,11 +297,19 @@ TEST_CASE_METHOD(OpenMPTestFixture,
                  "Test getting and setting number of OpenMP threads",
                  "[wasm][openmp]")
 {
+    SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
     doOmpTestLocal("setting_num_threads");
 }
 
 TEST_CASE_METHOD(OpenMPTestFixture, "Test OpenMP wtime", "[wasm][openmp]")
 {
+    SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
     doOmpTestLocal("wtime");
 }
 
@@ -139,6 +317,10 @@ TEST_CASE_METHOD(OpenMPTestFixture,
                  "Test single-threaded OpenMP reduction",
                  "[wasm][openmp]")
 {
+    SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
     doOmpTestLocal("single_thread_reduce");
 }
 
@@ -153,6 +335,10 @@ TEST_CASE_METHOD(OpenMPTestFixture,
                  "Test repeated OpenMP reductions",
                  "[wasm][openmp]")
 {
+    SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
     doOmpTestLocal("repeated_reduce");
 }
 
@@ -165,6 +351,10 @@ TEST_CASE_METHOD(OpenMPTestFixture,
                  "Test OpenMP default shared",
                  "[wasm][openmp]")
 {
+    SECTION("WAVM") { faasmConf.wasmVm = "wavm"; }
+
+    SECTION("WAMR") { faasmConf.wasmVm = "wamr"; }
+
     doOmpTestLocal("default_shared");
 }
 
@@ -189,9 +379,7 @@ TEST_CASE_METHOD(OpenMPTestFixture,
     execFuncWithPool(msg, false, OMP_TEST_TIMEOUT_MS);
 }
 
-TEST_CASE_METHOD(OpenMPTestFixture,
-                 "Test nested openmp explicitly disabled",
-                 "[wasm][openmp]")
+TEST_CASE_METHOD(OpenMPTestFixture, "Test nested openmp", "[wasm][openmp]")
 {
     faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
 
@@ -201,16 +389,210 @@ TEST_CASE_METHOD(OpenMPTestFixture,
     res.set_slots(nSlots);
     sch.setThisHostResources(res);
 
-    faabric::Message msg =
-      faabric::util::messageFactory("omp", "nested_parallel");
-    faabric::Message result = execErrorFunction(msg);
+    doOmpTestLocal("nested_parallel");
+}
+
+TEST_CASE_METHOD(OpenMPTestFixture,
+                 "Test declaring merge regions for next threads",
+                 "[wasm][openmp]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(msg);
+
+    // Declare an array element by element, as for __faasm_sm_reduce_array
+    size_t nElems = 1000;
+    for (size_t i = 0; i < nElems; i++) {
+        module.addMergeRegionForNextThreads(
+          1024 + i * sizeof(double),
+          sizeof(double),
+          faabric::util::SnapshotDataType::Double,
+          faabric::util::SnapshotMergeOperation::Sum);
+    }
+    REQUIRE(module.getMergeRegions().size() == nElems);
+
+    // Declaring it again replaces the regions rather than adding more
+    for (size_t i = 0; i < nElems; i++) {
+        module.addMergeRegionForNextThreads(
+          1024 + i * sizeof(double),
+          sizeof(double),
+          faabric::util::SnapshotDataType::Double,
+          faabric::util::SnapshotMergeOperation::Max);
+    }
+
+    std::vector<faabric::util::SnapshotMergeRegion> regions =
+      module.getMergeRegions();
+    REQUIRE(regions.size() == nElems);
+    for (const auto& r : regions) {
+        REQUIRE(r.operation == faabric::util::SnapshotMergeOperation::Max);
+    }
+
+    module.clearMergeRegions();
+    REQUIRE(module.getMergeRegions().empty());
+
+    module.addMergeRegionForNextThreads(
+      1024,
+      sizeof(int32_t),
+      faabric::util::SnapshotDataType::Int,
+      faabric::util::SnapshotMergeOperation::Sum);
+    REQUIRE(module.getMergeRegions().size() == 1);
+}
+
+TEST_CASE_METHOD(OpenMPHostTestFixture,
+                 "Test OpenMP dispatched loops",
+                 "[wasm][openmp]")
+{
+    int32_t schedule = 0;
+    int64_t chunk = 0;
+
+    // Values of the runtime's sched_type
+    SECTION("Static") { schedule = 34; }
+
+    SECTION("Dynamic")
+    {
+        schedule = 35;
+        chunk = 7;
+    }
+
+    SECTION("Guided")
+    {
+        schedule = 36;
+        chunk = 3;
+    }
+
+    int nThreads = 4;
+    int nIters = 1000;
+
+    // Several loops in one section, so threads move on to the next loop's
+    // state while others may still be finishing the last one
+    int nLoops = 3;
+
+    for (bool singleHost : { true, false }) {
+        std::vector<std::atomic<int>> counts(nLoops * nIters);
+
+        auto req = createTeam(nThreads, singleHost);
+        runTeam(req, [&](int) {
+            for (int l = 0; l < nLoops; l++) {
+                wasm::dispatch_init<int32_t>(schedule, 0, nIters - 1, 1, chunk);
+
+                int32_t lastIter = 0;
+                int32_t lower = 0;
+                int32_t upper = 0;
+                int32_t stride = 0;
+                while (wasm::dispatch_next<int32_t>(
+                  &lastIter, &lower, &upper, &stride)) {
+                    for (int32_t i = lower; i <= upper; i += stride) {
+                        counts.at(l * nIters + i)++;
+                    }
+                }
+            }
+        });
+
+        // Every iteration runs exactly once
+        for (int i = 0; i < nLoops * nIters; i++) {
+            REQUIRE(counts.at(i).load() == 1);
+        }
+
+        // Nothing is left behind in global state
+        REQUIRE(state.getKVCount() == 0);
+    }
+}
+
+TEST_CASE_METHOD(OpenMPHostTestFixture,
+                 "Test OpenMP single constructs",
+                 "[wasm][openmp]")
+{
+    bool singleHost = true;
+
+    SECTION("Single host") { singleHost = true; }
+
+    SECTION("Distributed") { singleHost = false; }
+
+    int nThreads = 5;
+    int nSingles = 20;
+    std::vector<std::atomic<int>> winners(nSingles);
+
+    auto req = createTeam(nThreads, singleHost);
+    runTeam(req, [&](int) {
+        faabric::Message* msg =
+          &faabric::scheduler::ExecutorContext::get()->getMsg();
+        std::shared_ptr<threads::Level> level =
+          threads::getCurrentOpenMPLevel();
 
-    // Get result
-    REQUIRE(result.returnvalue() > 0);
+        for (int i = 0; i < nSingles; i++) {
+            if (wasm::startOpenMPSingle(msg, level) == 1) {
+                winners.at(i)++;
+            }
+        }
+    });
+
+    // Exactly one thread runs each construct, without going through state
+    for (int i = 0; i < nSingles; i++) {
+        REQUIRE(winners.at(i).load() == 1);
+    }
+    REQUIRE(state.getKVCount() == 0);
+
+    // A new team starts its constructs afresh
+    std::atomic<int> nWon = 0;
+    auto nextReq = createTeam(nThreads, singleHost);
+    runTeam(nextReq, [&](int) {
+        faabric::Message* msg =
+          &faabric::scheduler::ExecutorContext::get()->getMsg();
+        nWon += wasm::startOpenMPSingle(msg, threads::getCurrentOpenMPLevel());
+    });
+    REQUIRE(nWon.load() == 1);
+}
+
+TEST_CASE_METHOD(OpenMPHostTestFixture,
+                 "Test barriers of scheduled teams on one host",
+                 "[wasm][openmp]")
+{
+    int nTeams = 3;
+    int nThreads = 4;
+    int nPhases = 10;
+
+    std::vector<std::shared_ptr<faabric::BatchExecuteRequest>> reqs;
+    for (int t = 0; t < nTeams; t++) {
+        reqs.emplace_back(createTeam(nThreads, true));
+    }
+
+    // What each thread saw of its team's progress in each phase
+    std::vector<std::atomic<int>> arrived(nTeams);
+    std::vector<std::vector<int>> seen(
+      nTeams, std::vector<int>(nThreads * nPhases, -1));
+
+    // The teams run at the same time, each with its own barrier
+    std::vector<std::thread> teams;
+    for (int t = 0; t < nTeams; t++) {
+        teams.emplace_back([this, t, nPhases, &reqs, &arrived, &seen] {
+            runTeam(reqs.at(t), [t, nPhases, &arrived, &seen](int i) {
+                for (int p = 0; p < nPhases; p++) {
+                    arrived.at(t)++;
+                    wasm::teamBarrier(i);
+                    seen.at(t).at(i * nPhases + p) = arrived.at(t).load();
+                    wasm::teamBarrier(i);
+                }
+            });
+        });
+    }
+
+    for (auto& t : teams) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+
+    for (int t = 0; t < nTeams; t++) {
+        for (int i = 0; i < nThreads; i++) {
+            for (int p = 0; p < nPhases; p++) {
+                REQUIRE(seen.at(t).at(i * nPhases + p) == nThreads * (p + 1));
+            }
+        }
+    }
 
-    std::string expectedOutput = fmt::format(
-      "Task {} threw exception. What: OpenMP threads failed", msg.id());
-    const std::string actualOutput = result.outputdata();
-    REQUIRE(actualOutput == expectedOutput);
+    // Nobody holds the finished teams' barriers, so the next team drops them
+    auto nextReq = createTeam(nThreads, true);
+    runTeam(nextReq, [](int i) { wasm::teamBarrier(i); });
+    REQUIRE(wasm::getHostTeamCount() == 1);
 }
 }
@@ -0,0 +1,241 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <threads/ThreadState.h>
+#include <wasm/WasmExecutionContext.h>
+#include <wasm/WasmModule.h>
+#include <wasm/openmp_tasks.h>
+
+#include <faabric/scheduler/ExecutorContext.h>
+#include <faabric/util/func.h>
+#include <faabric/util/gids.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <latch>
+#include <thread>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+class OpenMPTasksTestFixture : public ExecutorContextTestFixture
+{
+  public:
+    // Each task holds its ID, as the compiler would fill in a task's data
+    std::shared_ptr<OpenMPTask> createTask(
+      const std::shared_ptr<OpenMPTaskTeam>& team,
+      int32_t taskId)
+    {
+        std::shared_ptr<OpenMPTask> task =
+          allocateOpenMPTask(team, sizeof(int32_t) * 4, 0);
+        std::memcpy(module.wasmPointerToNative(task->taskPtr),
+                    &taskId,
+                    sizeof(int32_t));
+        return task;
+    }
+
+    int32_t getTaskId(const OpenMPTask& task)
+    {
+        int32_t taskId = 0;
+        std::memcpy(&taskId,
+                    module.wasmPointerToNative(task.taskPtr),
+                    sizeof(int32_t));
+        return taskId;
+    }
+
+    // Runs the function on a thread per member of a team, each with the
+    // executor context and level of a thread in the team
+    void runTeam(int nThreads, const std::function<void(int)>& threadFunc)
+    {
+        auto req = faabric::util::batchExecFactory("omp", "tasks", nThreads);
+        int groupId = (int)faabric::util::generateGid();
+        for (int i = 0; i < nThreads; i++) {
+            faabric::Message& m = req->mutable_messages()->at(i);
+            m.set_appidx(i);
+            m.set_groupid(groupId);
+            m.set_groupidx(i);
+        }
+
+        auto level = std::make_shared<threads::Level>(nThreads);
+
+        std::vector<std::thread> teamThreads;
+        for (int i = 0; i < nThreads; i++) {
+            teamThreads.emplace_back([this, req, level, i, &threadFunc] {
+                faabric::scheduler::ExecutorContext::set(nullptr, req, i);
+                threads::setCurrentOpenMPLevel(level);
+                WasmExecutionContext ctx(&module);
+                threadFunc(i);
+            });
+        }
+
+        for (auto& t : teamThreads) {
+            if (t.joinable()) {
+                t.join();
+            }
+        }
+    }
+
+  protected:
+    HostMemoryModule module{ 64 };
+};
+
+TEST_CASE_METHOD(OpenMPTasksTestFixture,
+                 "Test creating and waiting for OpenMP tasks",
+                 "[wasm][openmp]")
+{
+    int nThreads = 4;
+    int nTasksPerThread = 50;
+    int nTasks = nThreads * nTasksPerThread;
+
+    std::vector<std::atomic<int>> runs(nTasks);
+    std::vector<int> doneAtTaskwait(nThreads, 0);
+    std::vector<char> zeroed(nThreads, 1);
+
+    runTeam(nThreads, [&](int t) {
+        faabric::Message* msg =
+          &faabric::scheduler::ExecutorContext::get()->getMsg();
+        std::shared_ptr<threads::Level> level =
+          threads::getCurrentOpenMPLevel();
+        std::shared_ptr<OpenMPTaskTeam> team = getOpenMPTaskTeam(msg, level);
+
+        OpenMPTaskFunc func = [&](const OpenMPTask& task) {
+            runs.at(getTaskId(task))++;
+        };
+
+        int firstId = t * nTasksPerThread;
+        for (int i = 0; i < nTasksPerThread; i++) {
+            // Created tasks have nothing left over from earlier ones
+            std::shared_ptr<OpenMPTask> task =
+              allocateOpenMPTask(team, sizeof(int32_t) * 4, 0);
+            uint8_t* bytes = module.wasmPointerToNative(task->taskPtr);
+            for (size_t b = 0; b < task->size; b++) {
+                zeroed.at(t) &= bytes[b] == 0;
+            }
+
+            int32_t taskId = firstId + i;
+            std::memcpy(bytes, &taskId, sizeof(int32_t));
+
+            // Goes through the compiler's hands by pointer
+            holdOpenMPTask(task);
+            queueOpenMPTask(takeHeldOpenMPTask(task->taskPtr));
+        }
+
+        // Taskwait only returns once all this thread's tasks are done,
+        // whoever runs them
+        waitForOpenMPChildTasks(func);
+        for (int i = 0; i < nTasksPerThread; i++) {
+            doneAtTaskwait.at(t) += runs.at(firstId + i).load();
+        }
+
+        finishOpenMPTeamTasks(func, msg, level);
+    });
+
+    for (int t = 0; t < nThreads; t++) {
+        REQUIRE(zeroed.at(t));
+        REQUIRE(doneAtTaskwait.at(t) == nTasksPerThread);
+    }
+
+    for (int i = 0; i < nTasks; i++) {
+        REQUIRE(runs.at(i).load() == 1);
+    }
+
+    REQUIRE_THROWS(takeHeldOpenMPTask(12345));
+}
+
+TEST_CASE_METHOD(OpenMPTasksTestFixture,
+                 "Test stealing OpenMP tasks",
+                 "[wasm][openmp]")
+{
+    int nThreads = 4;
+    int nTasks = 40;
+
+    std::vector<std::atomic<int>> runs(nTasks);
+    std::vector<int> ranOn(nTasks, -1);
+    std::vector<int> pendingAfter(nThreads, -1);
+    std::latch queued(1);
+
+    // Only the first thread creates tasks, the rest of the team steals them
+    // while waiting for the team's tasks to finish, as at a barrier
+    runTeam(nThreads, [&](int t) {
+        faabric::Message* msg =
+          &faabric::scheduler::ExecutorContext::get()->getMsg();
+        std::shared_ptr<threads::Level> level =
+          threads::getCurrentOpenMPLevel();
+        std::shared_ptr<OpenMPTaskTeam> team = getOpenMPTaskTeam(msg, level);
+
+        OpenMPTaskFunc func = [&, t](const OpenMPTask& task) {
+            int32_t taskId = getTaskId(task);
+            runs.at(taskId)++;
+            ranOn.at(taskId) = t;
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        };
+
+        if (t == 0) {
+            for (int i = 0; i < nTasks; i++) {
+                queueOpenMPTask(createTask(team, i));
+            }
+            queued.count_down();
+        } else {
+            queued.wait();
+        }
+
+        runPendingOpenMPTasks(func, msg, level);
+        pendingAfter.at(t) = team->nPending.load();
+
+        finishOpenMPTeamTasks(func, msg, level);
+    });
+
+    for (int t = 0; t < nThreads; t++) {
+        REQUIRE(pendingAfter.at(t) == 0);
+    }
+
+    for (int i = 0; i < nTasks; i++) {
+        REQUIRE(runs.at(i).load() == 1);
+    }
+
+    // The creator works from the back of its deque, so the first task queued
+    // is taken from the front by another thread
+    REQUIRE(ranOn.at(0) != 0);
+}
+
+TEST_CASE_METHOD(OpenMPTasksTestFixture,
+                 "Test OpenMP tasks without a team",
+                 "[wasm][openmp]")
+{
+    int nTasks = 3;
+    std::vector<int> runs(nTasks, 0);
+    std::vector<int> runsAfterStart(nTasks, 0);
+    bool hasTeam = true;
+
+    runTeam(1, [&](int) {
+        faabric::Message* msg =
+          &faabric::scheduler::ExecutorContext::get()->getMsg();
+        std::shared_ptr<threads::Level> level =
+          threads::getCurrentOpenMPLevel();
+        hasTeam = getOpenMPTaskTeam(msg, level) != nullptr;
+
+        OpenMPTaskFunc func = [&](const OpenMPTask& task) {
+            runs.at(getTaskId(task))++;
+        };
+
+        // Tasks run straight away in memory of their own
+        for (int i = 0; i < nTasks; i++) {
+            runOpenMPTask(func, createTask(nullptr, i), false);
+            runsAfterStart.at(i) = runs.at(i);
+        }
+
+        finishOpenMPTeamTasks(func, msg, level);
+    });
+
+    REQUIRE(!hasTeam);
+    for (int i = 0; i < nTasks; i++) {
+        REQUIRE(runsAfterStart.at(i) == 1);
+        REQUIRE(runs.at(i) == 1);
+    }
+}
+}
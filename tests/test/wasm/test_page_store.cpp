@@ -0,0 +1,91 @@
+#include <catch2/catch.hpp>
+
+#include <faabric/util/memory.h>
+
+#include <wasm/page_store.h>
+
+#include <cstring>
+#include <sys/mman.h>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+class PageStoreTestFixture
+{
+  public:
+    PageStoreTestFixture() { getPageStore().clear(); }
+
+    ~PageStoreTestFixture() { getPageStore().clear(); }
+};
+
+TEST_CASE_METHOD(PageStoreTestFixture,
+                 "Test snapshot pages are only stored once",
+                 "[wasm]")
+{
+    PageStore& store = getPageStore();
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+
+    // Two pages the same, one of zeros and one different
+    std::vector<uint8_t> dataA(4 * pageSize, 1);
+    std::memset(dataA.data() + 2 * pageSize, 0, pageSize);
+    std::memset(dataA.data() + 3 * pageSize, 2, pageSize);
+
+    // Shares all but its last page with the first
+    std::vector<uint8_t> dataB = dataA;
+    std::memset(dataB.data() + 3 * pageSize, 3, pageSize);
+
+    store.registerSnapshot("foo", dataA);
+    REQUIRE(store.getStats().refs == 3);
+    REQUIRE(store.getStats().stored == 2);
+
+    store.registerSnapshot("bar", dataB);
+    REQUIRE(store.getStats().refs == 6);
+    REQUIRE(store.getStats().stored == 3);
+
+    std::shared_ptr<PagedSnapshot> snap = store.getSnapshot("bar");
+    REQUIRE(snap->getSize() == dataB.size());
+
+    // Copies across page boundaries and from pages of zeros
+    std::vector<uint8_t> actual(2 * pageSize);
+    snap->copyTo(pageSize + 10, actual.data(), actual.size());
+    REQUIRE(std::memcmp(
+              actual.data(), dataB.data() + pageSize + 10, actual.size()) ==
+            0);
+
+    // Mapped copy-on-write, so writes don't reach the store
+    size_t memSize = 8 * pageSize;
+    auto* mem = (uint8_t*)::mmap(nullptr,
+                                 memSize,
+                                 PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS,
+                                 -1,
+                                 0);
+    REQUIRE(mem != MAP_FAILED);
+
+    snap->mapToMemory({ mem, memSize });
+    REQUIRE(std::memcmp(mem, dataB.data(), dataB.size()) == 0);
+
+    mem[0] = 5;
+    std::vector<uint8_t> firstByte(1);
+    snap->copyTo(0, firstByte.data(), 1);
+    REQUIRE(firstByte.at(0) == 1);
+
+    ::munmap(mem, memSize);
+
+    // Pages are released along with the last snapshot holding them
+    store.deleteSnapshot("foo");
+    REQUIRE(!store.snapshotExists("foo"));
+    REQUIRE(store.getStats().refs == 3);
+    REQUIRE(store.getStats().stored == 2);
+
+    store.deleteSnapshot("bar");
+    REQUIRE(store.getSnapshot("bar") == nullptr);
+    REQUIRE(store.getStats().stored == 2);
+
+    snap = nullptr;
+    REQUIRE(store.getStats().refs == 0);
+    REQUIRE(store.getStats().stored == 0);
+}
+}
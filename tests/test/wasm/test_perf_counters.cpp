@@ -0,0 +1,106 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <faabric/util/func.h>
+
+#include <wasm/call_metrics.h>
+#include <wasm/perf_counters.h>
+
+#include <thread>
+
+using namespace wasm;
+
+namespace tests {
+
+static uint64_t doWork()
+{
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < 1000000; i++) {
+        total += i * i;
+    }
+
+    return total;
+}
+
+TEST_CASE("Test perf counter names", "[wasm]")
+{
+    REQUIRE(perfCounterName(PerfCounter::Instructions) == "instructions");
+    REQUIRE(perfCounterName(PerfCounter::LlcMisses) == "llc-misses");
+    REQUIRE(perfCounterName(PerfCounter::ContextSwitches) ==
+            "context-switches");
+    REQUIRE_THROWS(perfCounterName(PerfCounter::NumCounters));
+}
+
+TEST_CASE("Test reading perf counters", "[wasm]")
+{
+    // Nothing is counted on a thread that hasn't started
+    std::thread t([] {
+        PerfCounts counts = readPerfCounters();
+        for (int i = 0; i < N_PERF_COUNTERS; i++) {
+            REQUIRE(!counts.available[i]);
+        }
+    });
+    t.join();
+
+    startPerfCounters();
+    volatile uint64_t total = doWork();
+    REQUIRE(total > 0);
+    PerfCounts counts = readPerfCounters();
+
+    // Hosts needn't support any counters, but the ones they do count work
+    int instructions = (int)PerfCounter::Instructions;
+    if (counts.available[instructions]) {
+        REQUIRE(counts.values[instructions] > 1000000);
+    }
+
+    // Starting again drops what's been counted so far
+    startPerfCounters();
+    PerfCounts restarted = readPerfCounters();
+    for (int i = 0; i < N_PERF_COUNTERS; i++) {
+        REQUIRE(restarted.available[i] == counts.available[i]);
+    }
+
+    if (counts.available[instructions]) {
+        REQUIRE(restarted.values[instructions] <
+                counts.values[instructions]);
+    }
+}
+
+TEST_CASE_METHOD(FaasmConfTestFixture,
+                 "Test attaching perf counters to call metrics",
+                 "[wasm]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+
+    bool perfOn = false;
+    SECTION("Off") { conf.perfCounters = "off"; }
+
+    SECTION("On")
+    {
+        conf.perfCounters = "on";
+        perfOn = true;
+    }
+
+    startCallMetrics();
+    volatile uint64_t total = doWork();
+    REQUIRE(total > 0);
+
+    CallMetrics metrics = takeCallMetrics();
+
+    // Attached where they're available
+    startCallMetrics();
+    flushCallMetrics(msg, 65536, 0);
+
+    const auto& details = msg.execgraphdetails();
+    for (int i = 0; i < N_PERF_COUNTERS; i++) {
+        std::string key = "perf-" + perfCounterName((PerfCounter)i);
+        if (!perfOn) {
+            REQUIRE(!metrics.perfCounts.available[i]);
+        }
+
+        bool available = metrics.perfCounts.available[i];
+        REQUIRE(details.count(key) == (available ? 1 : 0));
+    }
+}
+}
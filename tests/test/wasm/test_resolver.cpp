@@ -0,0 +1,87 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <wasm/resolver.h>
+
+#include <cstring>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+class ResolverTestFixture : public FaasmConfTestFixture
+{
+  public:
+    ResolverTestFixture() { clearResolverCache(); }
+
+    ~ResolverTestFixture() { clearResolverCache(); }
+};
+
+TEST_CASE_METHOD(ResolverTestFixture, "Test resolving numeric hosts", "[wasm]")
+{
+    conf.dnsCacheMaxTtlSecs = 300;
+
+    std::vector<ResolvedAddress> addrs;
+    REQUIRE(resolveHost("127.0.0.1", AF_INET, addrs) == 0);
+    REQUIRE(addrs.size() == 1);
+    REQUIRE(addrs.at(0).family == AF_INET);
+
+    std::vector<uint8_t> expected = { 127, 0, 0, 1 };
+    REQUIRE(std::vector<uint8_t>(addrs.at(0).addr, addrs.at(0).addr + 4) ==
+            expected);
+    REQUIRE(getResolverCacheSize() == 1);
+
+    // Answered from the cache
+    addrs.clear();
+    REQUIRE(resolveHost("127.0.0.1", AF_INET, addrs) == 0);
+    REQUIRE(addrs.size() == 1);
+    REQUIRE(getResolverCacheSize() == 1);
+
+    // Families are cached separately
+    addrs.clear();
+    REQUIRE(resolveHost("::1", AF_INET6, addrs) == 0);
+    REQUIRE(addrs.size() == 1);
+    REQUIRE(addrs.at(0).family == AF_INET6);
+    REQUIRE(addrs.at(0).addr[15] == 1);
+    REQUIRE(getResolverCacheSize() == 2);
+
+    clearResolverCache();
+    REQUIRE(getResolverCacheSize() == 0);
+}
+
+TEST_CASE_METHOD(ResolverTestFixture,
+                 "Test resolver caching can be turned off",
+                 "[wasm]")
+{
+    conf.dnsCacheMaxTtlSecs = 0;
+
+    std::vector<ResolvedAddress> addrs;
+    REQUIRE(resolveHost("127.0.0.1", AF_INET, addrs) == 0);
+    REQUIRE(addrs.size() == 1);
+    REQUIRE(getResolverCacheSize() == 0);
+}
+
+TEST_CASE_METHOD(ResolverTestFixture,
+                 "Test resolving hosts into a guest buffer",
+                 "[wasm]")
+{
+    std::vector<uint8_t> buffer(2 * sizeof(ResolvedAddress), 0);
+    REQUIRE(doHostResolveHost(
+              "127.0.0.1", AF_INET, buffer.data(), buffer.size()) == 1);
+
+    ResolvedAddress addr;
+    std::memcpy(&addr, buffer.data(), sizeof(ResolvedAddress));
+    REQUIRE(addr.family == AF_INET);
+    REQUIRE(addr.addr[0] == 127);
+
+    // Nothing written if there's no room
+    REQUIRE(doHostResolveHost("127.0.0.1", AF_INET, buffer.data(), 4) == 0);
+
+    REQUIRE(doHostResolveHost(
+              "127.0.0.1", 12345, buffer.data(), buffer.size()) == EAI_FAMILY);
+}
+}
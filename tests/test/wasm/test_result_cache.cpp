@@ -0,0 +1,146 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+#include "fixtures.h"
+
+#include <wasm/result_cache.h>
+
+#include <faabric/util/func.h>
+
+#include <string>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+class ResultCacheTestFixture
+  : public StateTestFixture
+  , public FaasmConfTestFixture
+{
+  public:
+    ResultCacheTestFixture()
+    {
+        clearResultCache();
+        conf.resultCacheFunctions = "demo/echo,demo/hello";
+    }
+
+    ~ResultCacheTestFixture() { clearResultCache(); }
+};
+
+TEST_CASE_METHOD(ResultCacheTestFixture,
+                 "Test caching function results",
+                 "[wasm]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    msg.set_inputdata("foo");
+    msg.set_outputdata("bar");
+
+    std::string output;
+    REQUIRE(!lookupCachedResult(msg, output));
+
+    // Failed calls aren't cached
+    storeCachedResult(msg, 1);
+    REQUIRE(!lookupCachedResult(msg, output));
+    REQUIRE(getResultCacheBytes() == 0);
+
+    storeCachedResult(msg, 0);
+    REQUIRE(lookupCachedResult(msg, output));
+    REQUIRE(output == "bar");
+
+    // Another call with the same input gets the same result
+    faabric::Message other = faabric::util::messageFactory("demo", "echo");
+    other.set_inputdata("foo");
+    REQUIRE(getResultCacheKey(other) == getResultCacheKey(msg));
+    REQUIRE(lookupCachedResult(other, output));
+    REQUIRE(output == "bar");
+
+    // Any difference in input or cmdline is a different result
+    faabric::Message otherInput = other;
+    otherInput.set_inputdata("baz");
+    REQUIRE(!lookupCachedResult(otherInput, output));
+
+    faabric::Message otherCmdline = other;
+    otherCmdline.set_cmdline("-v");
+    REQUIRE(!lookupCachedResult(otherCmdline, output));
+
+    // Nested calls and unlisted functions aren't cached
+    faabric::Message nested = other;
+    nested.set_funcptr(1);
+    REQUIRE(!isResultCacheable(nested));
+    REQUIRE(!lookupCachedResult(nested, output));
+
+    faabric::Message unlisted = faabric::util::messageFactory("demo", "x2");
+    unlisted.set_inputdata("foo");
+    unlisted.set_outputdata("bar");
+    REQUIRE(!isResultCacheable(unlisted));
+    storeCachedResult(unlisted, 0);
+    REQUIRE(!lookupCachedResult(unlisted, output));
+}
+
+TEST_CASE_METHOD(ResultCacheTestFixture,
+                 "Test result cache evicts least recently used",
+                 "[wasm]")
+{
+    conf.resultCacheBudgetMb = 1;
+    std::string bigOutput(400 * 1024, 'a');
+
+    std::vector<faabric::Message> msgs;
+    for (int i = 0; i < 3; i++) {
+        faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+        msg.set_inputdata(std::to_string(i));
+        msg.set_outputdata(bigOutput);
+        msgs.push_back(msg);
+    }
+
+    std::string output;
+    storeCachedResult(msgs.at(0), 0);
+    storeCachedResult(msgs.at(1), 0);
+
+    // Using the first makes the second the oldest
+    REQUIRE(lookupCachedResult(msgs.at(0), output));
+
+    storeCachedResult(msgs.at(2), 0);
+    REQUIRE(getResultCacheBytes() <= 1024 * 1024);
+
+    REQUIRE(lookupCachedResult(msgs.at(0), output));
+    REQUIRE(!lookupCachedResult(msgs.at(1), output));
+    REQUIRE(lookupCachedResult(msgs.at(2), output));
+
+    // Outputs over the whole budget are never cached
+    faabric::Message huge = faabric::util::messageFactory("demo", "echo");
+    huge.set_inputdata("huge");
+    huge.set_outputdata(std::string(2 * 1024 * 1024, 'b'));
+    storeCachedResult(huge, 0);
+    REQUIRE(!lookupCachedResult(huge, output));
+}
+
+TEST_CASE_METHOD(ResultCacheTestFixture,
+                 "Test sharing cached results in state",
+                 "[wasm]")
+{
+    conf.resultCacheShared = "on";
+
+    faabric::Message msg = faabric::util::messageFactory("demo", "hello");
+    msg.set_inputdata("foo");
+
+    std::string expected;
+    SECTION("Empty output") {}
+
+    SECTION("Some output")
+    {
+        expected = "hello world";
+    }
+
+    msg.set_outputdata(expected);
+    storeCachedResult(msg, 0);
+
+    // Another host only has the shared copy
+    clearResultCache();
+
+    std::string output = "junk";
+    REQUIRE(lookupCachedResult(msg, output));
+    REQUIRE(output == expected);
+    REQUIRE(getResultCacheBytes() > 0);
+}
+}
@@ -0,0 +1,61 @@
+#include <catch2/catch.hpp>
+
+#include <wasm/state_async.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+using namespace wasm;
+
+namespace tests {
+
+TEST_CASE("Test awaiting state operations", "[wasm]")
+{
+    std::atomic<int> nRun = 0;
+    int handleA = startStateOperation([&nRun] { nRun++; });
+    int handleB = startStateOperation([&nRun] { nRun++; });
+    REQUIRE(handleA != handleB);
+
+    awaitStateOperation(handleA);
+    awaitStateOperation(handleB);
+    REQUIRE(nRun == 2);
+
+    // Handles are forgotten once awaited
+    REQUIRE_THROWS(awaitStateOperation(handleA));
+    REQUIRE_THROWS(pollStateOperation(handleB));
+}
+
+TEST_CASE("Test polling state operations", "[wasm]")
+{
+    std::atomic<bool> release = false;
+    int handle = startStateOperation([&release] {
+        while (!release) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    REQUIRE(!pollStateOperation(handle));
+
+    release = true;
+    while (!pollStateOperation(handle)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    awaitStateOperation(handle);
+}
+
+TEST_CASE("Test state operation errors", "[wasm]")
+{
+    int handle = startStateOperation(
+      [] { throw std::runtime_error("State operation failed"); });
+    REQUIRE_THROWS_AS(awaitStateOperation(handle), std::runtime_error);
+
+    // Finishing swallows errors and forgets the handles
+    int otherHandle = startStateOperation(
+      [] { throw std::runtime_error("State operation failed"); });
+    finishStateOperations();
+    REQUIRE_THROWS(pollStateOperation(otherHandle));
+}
+}
@@ -0,0 +1,50 @@
+#include <catch2/catch.hpp>
+
+#include <wasm/state_batch.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+TEST_CASE("Test state batch runs every operation once", "[wasm]")
+{
+    size_t nOps = 0;
+    SECTION("Empty") { nOps = 0; }
+
+    SECTION("Single") { nOps = 1; }
+
+    SECTION("Fewer than the concurrency") { nOps = 5; }
+
+    SECTION("More than the concurrency")
+    {
+        nOps = 10 * STATE_BATCH_MAX_CONCURRENCY + 3;
+    }
+
+    std::vector<std::atomic<int>> counts(nOps);
+    runStateBatch(nOps, [&counts](size_t i) { counts.at(i)++; });
+
+    for (const auto& c : counts) {
+        REQUIRE(c == 1);
+    }
+}
+
+TEST_CASE("Test state batch rethrows after finishing", "[wasm]")
+{
+    size_t nOps = 50;
+    std::atomic<int> nRun = 0;
+
+    auto op = [&nRun](size_t i) {
+        nRun++;
+        if (i == 7) {
+            throw std::runtime_error("Batch op failed");
+        }
+    };
+
+    REQUIRE_THROWS_AS(runStateBatch(nOps, op), std::runtime_error);
+    REQUIRE(nRun == (int)nOps);
+}
+}
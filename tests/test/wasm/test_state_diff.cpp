@@ -0,0 +1,77 @@
+#include <catch2/catch.hpp>
+
+#include "fixtures.h"
+
+#include <faabric/state/State.h>
+#include <faabric/util/memory.h>
+
+#include <wasm/memdiff.h>
+#include <wasm/state_diff.h>
+
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+class StateDiffTestFixture : public StateTestFixture
+{
+  public:
+    StateDiffTestFixture() { clearStateChanges(); }
+
+    ~StateDiffTestFixture() { clearStateChanges(); }
+};
+
+TEST_CASE_METHOD(StateDiffTestFixture, "Test pushing state changes", "[wasm]")
+{
+    size_t stateSize = 4 * faabric::util::HOST_PAGE_SIZE;
+    std::vector<uint8_t> value(stateSize, 1);
+
+    auto kv = faabric::state::getGlobalState().getKV(
+      "demo", "state_diff_test", stateSize);
+    kv->set(value.data());
+
+    // First push sends everything
+    REQUIRE(pushStateChanges(kv) == stateSize);
+
+    // Nothing has changed
+    REQUIRE(pushStateChanges(kv) == 0);
+
+    // Change a couple of far apart bytes
+    std::vector<uint8_t> changeA = { 5 };
+    std::vector<uint8_t> changeB = { 6, 7 };
+    size_t offsetA = 10;
+    size_t offsetB = 3 * faabric::util::HOST_PAGE_SIZE + 1;
+    kv->setChunk(offsetA, changeA.data(), changeA.size());
+    kv->setChunk(offsetB, changeB.data(), changeB.size());
+
+    // Each change is rounded out to a diff block
+    REQUIRE(pushStateChanges(kv) == 2 * MEMORY_DIFF_BLOCK_SIZE);
+    REQUIRE(pushStateChanges(kv) == 0);
+
+    value.at(offsetA) = 5;
+    value.at(offsetB) = 6;
+    value.at(offsetB + 1) = 7;
+    std::vector<uint8_t> actual(stateSize, 0);
+    kv->get(actual.data());
+    REQUIRE(actual == value);
+}
+
+TEST_CASE_METHOD(StateDiffTestFixture,
+                 "Test pushing state changes after clearing",
+                 "[wasm]")
+{
+    size_t stateSize = faabric::util::HOST_PAGE_SIZE;
+    std::vector<uint8_t> value(stateSize, 3);
+
+    auto kv = faabric::state::getGlobalState().getKV(
+      "demo", "state_diff_test", stateSize);
+    kv->set(value.data());
+
+    REQUIRE(pushStateChanges(kv) == stateSize);
+    REQUIRE(pushStateChanges(kv) == 0);
+
+    clearStateChanges();
+    REQUIRE(pushStateChanges(kv) == stateSize);
+}
+}
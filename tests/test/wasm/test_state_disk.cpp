@@ -0,0 +1,125 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <faabric/util/memory.h>
+
+#include <wasm/state_disk.h>
+
+#include <cstring>
+#include <filesystem>
+#include <sys/mman.h>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+class DiskStateTestFixture : public SharedFilesTestFixture
+{
+  public:
+    DiskStateTestFixture()
+    {
+        conf.stateDiskDir = diskDir;
+        getDiskStateStore().clear();
+    }
+
+    ~DiskStateTestFixture()
+    {
+        getDiskStateStore().clear();
+        std::filesystem::remove_all(diskDir);
+    }
+
+  protected:
+    std::string diskDir = "/tmp/faasm_state_disk";
+};
+
+TEST_CASE_METHOD(DiskStateTestFixture,
+                 "Test looking up disk-backed state",
+                 "[wasm]")
+{
+    loader.uploadSharedFile(getDiskStatePath("demo", "disk_test"),
+                            std::vector<uint8_t>(100, 1));
+
+    REQUIRE(getDiskStateStore().getValue("demo", "no_such_key") == nullptr);
+
+    auto value = getDiskStateStore().getValue("demo", "disk_test");
+    REQUIRE(value != nullptr);
+    REQUIRE(value->size() == 100);
+    REQUIRE(value->getFetchedChunkCount() == 0);
+
+    // Values are shared on the host
+    REQUIRE(getDiskStateStore().getValue("demo", "disk_test") == value);
+
+    // Nothing is disk-backed when it's off
+    getDiskStateStore().clear();
+    conf.stateDiskDir = "";
+    REQUIRE(getDiskStateStore().getValue("demo", "disk_test") == nullptr);
+}
+
+TEST_CASE_METHOD(DiskStateTestFixture,
+                 "Test mapping disk-backed state",
+                 "[wasm]")
+{
+    // Two and a half chunks
+    size_t valueSize = 2 * STATE_DISK_CHUNK_SIZE + STATE_DISK_CHUNK_SIZE / 2;
+    std::vector<uint8_t> contents(valueSize);
+    for (size_t i = 0; i < valueSize; i++) {
+        contents.at(i) = (uint8_t)(i % 251);
+    }
+    loader.uploadSharedFile(getDiskStatePath("demo", "disk_test"), contents);
+
+    auto value = getDiskStateStore().getValue("demo", "disk_test");
+    REQUIRE(value != nullptr);
+
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    size_t offset = 0;
+    size_t len = 0;
+    size_t expectedChunks = 0;
+
+    SECTION("Within one chunk")
+    {
+        offset = STATE_DISK_CHUNK_SIZE + 2 * pageSize;
+        len = 3 * pageSize;
+        expectedChunks = 1;
+    }
+
+    SECTION("Across chunks")
+    {
+        offset = STATE_DISK_CHUNK_SIZE - pageSize;
+        len = 2 * pageSize;
+        expectedChunks = 2;
+    }
+
+    SECTION("Up to the end")
+    {
+        offset = 2 * STATE_DISK_CHUNK_SIZE;
+        len = valueSize - offset;
+        expectedChunks = 1;
+    }
+
+    size_t mapLen = len + pageSize;
+    void* mem = ::mmap(nullptr,
+                       mapLen,
+                       PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS,
+                       -1,
+                       0);
+    REQUIRE(mem != MAP_FAILED);
+    uint8_t* target = (uint8_t*)mem;
+
+    value->mapRange(target, offset, len);
+    REQUIRE(value->getFetchedChunkCount() == expectedChunks);
+    REQUIRE(std::memcmp(target, contents.data() + offset, len) == 0);
+
+    // Writes to the mapping don't reach the value
+    target[0] = contents.at(offset) + 1;
+    value->mapRange(target, offset, len);
+    REQUIRE(target[0] == contents.at(offset));
+
+    ::munmap(mem, mapLen);
+
+    // Ranges past the end can't be mapped
+    REQUIRE_THROWS(value->fetchRange(valueSize - 10, 20));
+}
+}
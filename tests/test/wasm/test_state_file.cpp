@@ -0,0 +1,60 @@
+#include <catch2/catch.hpp>
+
+#include "fixtures.h"
+
+#include <faabric/state/State.h>
+#include <faabric/util/files.h>
+#include <faabric/util/memory.h>
+
+#include <wasm/state_file.h>
+
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+TEST_CASE_METHOD(StateTestFixture, "Test writing state from file", "[wasm]")
+{
+    size_t chunkSize = faabric::util::HOST_PAGE_SIZE;
+    size_t fileSize = 0;
+
+    SECTION("Smaller than a chunk") { fileSize = 100; }
+
+    SECTION("Exactly one chunk") { fileSize = chunkSize; }
+
+    SECTION("Several chunks") { fileSize = 3 * chunkSize + 17; }
+
+    std::vector<uint8_t> contents(fileSize);
+    for (size_t i = 0; i < fileSize; i++) {
+        contents.at(i) = (uint8_t)(i % 251);
+    }
+
+    std::string filePath = "/tmp/faasm_state_file_test";
+    faabric::util::writeBytesToFile(filePath, contents);
+
+    size_t written =
+      writeStateFromFile("demo", "state_file_test", filePath, chunkSize);
+    REQUIRE(written == fileSize);
+
+    auto kv = faabric::state::getGlobalState().getKV("demo", "state_file_test");
+    REQUIRE(kv->size() == fileSize);
+
+    std::vector<uint8_t> actual(fileSize, 0);
+    kv->get(actual.data());
+    REQUIRE(actual == contents);
+
+    std::filesystem::remove(filePath);
+}
+
+TEST_CASE_METHOD(StateTestFixture,
+                 "Test writing state from a missing file",
+                 "[wasm]")
+{
+    REQUIRE_THROWS_AS(
+      writeStateFromFile("demo", "state_file_test", "/tmp/faasm_no_such_file"),
+      std::runtime_error);
+}
+}
@@ -0,0 +1,108 @@
+#include <catch2/catch.hpp>
+
+#include "fixtures.h"
+
+#include <wasm/state_log.h>
+
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace wasm;
+
+using Bounds = std::pair<uint64_t, uint64_t>;
+
+namespace tests {
+
+TEST_CASE_METHOD(StateTestFixture, "Test appending and reading a log", "[wasm]")
+{
+    std::string user = "demo";
+    std::string key = "log_test";
+
+    REQUIRE(getStateLogBounds(user, key) == Bounds(0, 0));
+
+    std::vector<std::vector<uint8_t>> entries = {
+        { 1, 2, 3 },
+        { 4 },
+        { 5, 6, 7, 8, 9 },
+    };
+    for (size_t i = 0; i < entries.size(); i++) {
+        REQUIRE(appendStateLog(
+                  user, key, entries.at(i).data(), entries.at(i).size()) == i);
+    }
+
+    REQUIRE(getStateLogBounds(user, key) == Bounds(0, 3));
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        std::vector<uint8_t> buffer(10, 0);
+        int64_t size =
+          readStateLog(user, key, i, buffer.data(), buffer.size(), 0);
+        REQUIRE(size == (int64_t)entries.at(i).size());
+
+        buffer.resize(size);
+        REQUIRE(buffer == entries.at(i));
+    }
+
+    // A short buffer gets as much as fits
+    std::vector<uint8_t> shortBuffer(2, 0);
+    REQUIRE(readStateLog(user, key, 2, shortBuffer.data(), 2, 0) == 5);
+    std::vector<uint8_t> expectedShort = { 5, 6 };
+    REQUIRE(shortBuffer == expectedShort);
+
+    // Nothing there yet
+    REQUIRE(readStateLog(user, key, 3, shortBuffer.data(), 2, 0) == -1);
+    REQUIRE(readStateLog(user, key, 3, shortBuffer.data(), 2, 10) == -1);
+}
+
+TEST_CASE_METHOD(StateTestFixture, "Test trimming a log", "[wasm]")
+{
+    std::string user = "demo";
+    std::string key = "log_trim_test";
+
+    std::vector<uint8_t> entry = { 1, 2 };
+    for (int i = 0; i < 4; i++) {
+        appendStateLog(user, key, entry.data(), entry.size());
+    }
+
+    trimStateLog(user, key, 2);
+    REQUIRE(getStateLogBounds(user, key) == Bounds(2, 4));
+
+    std::vector<uint8_t> buffer(2, 0);
+    REQUIRE_THROWS_AS(readStateLog(user, key, 1, buffer.data(), 2, 0),
+                      std::runtime_error);
+    REQUIRE(readStateLog(user, key, 2, buffer.data(), 2, 0) == 2);
+
+    // The head doesn't move back, or past the tail
+    trimStateLog(user, key, 1);
+    REQUIRE(getStateLogBounds(user, key) == Bounds(2, 4));
+
+    trimStateLog(user, key, 10);
+    REQUIRE(getStateLogBounds(user, key) == Bounds(4, 4));
+
+    // Indexes carry on after trimming
+    REQUIRE(appendStateLog(user, key, entry.data(), entry.size()) == 4);
+}
+
+TEST_CASE_METHOD(StateTestFixture, "Test blocking log read", "[wasm]")
+{
+    std::string user = "demo";
+    std::string key = "log_block_test";
+
+    std::vector<uint8_t> entry = { 7, 7, 7 };
+    std::thread writer([&user, &key, &entry] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        appendStateLog(user, key, entry.data(), entry.size());
+    });
+
+    std::vector<uint8_t> buffer(3, 0);
+    int64_t size = readStateLog(user, key, 0, buffer.data(), 3, 5000);
+
+    if (writer.joinable()) {
+        writer.join();
+    }
+
+    REQUIRE(size == 3);
+    REQUIRE(buffer == entry);
+}
+}
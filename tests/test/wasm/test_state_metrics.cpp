@@ -0,0 +1,94 @@
+#include <catch2/catch.hpp>
+
+#include "fixtures.h"
+
+#include <faabric/util/func.h>
+
+#include <wasm/state_metrics.h>
+
+using namespace wasm;
+
+namespace tests {
+
+class StateMetricsTestFixture : public StateTestFixture
+{
+  public:
+    StateMetricsTestFixture()
+    {
+        takeStateMetrics();
+        clearHostStateMetrics();
+    }
+
+    ~StateMetricsTestFixture()
+    {
+        takeStateMetrics();
+        clearHostStateMetrics();
+    }
+};
+
+TEST_CASE_METHOD(StateMetricsTestFixture,
+                 "Test recording state metrics",
+                 "[wasm]")
+{
+    recordStatePull(100);
+    recordStatePull(20);
+    recordStatePush(50);
+    recordStateMapping(4096);
+
+    {
+        StateLockTimer lockTimer;
+    }
+
+    StateMetrics metrics = takeStateMetrics();
+    REQUIRE(metrics.bytesPulled == 120);
+    REQUIRE(metrics.bytesPushed == 50);
+    REQUIRE(metrics.roundTrips == 3);
+    REQUIRE(metrics.bytesMapped == 4096);
+
+    // Taking the metrics clears them
+    REQUIRE(takeStateMetrics().empty());
+}
+
+TEST_CASE_METHOD(StateMetricsTestFixture,
+                 "Test flushing state metrics",
+                 "[wasm]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+
+    SECTION("No state operations")
+    {
+        flushStateMetrics(msg);
+        REQUIRE(msg.execgraphdetails().empty());
+        REQUIRE(getHostStateMetrics("demo/echo").empty());
+    }
+
+    SECTION("State operations")
+    {
+        recordStatePull(10);
+        recordStatePush(30);
+        flushStateMetrics(msg);
+
+        const auto& details = msg.execgraphdetails();
+        REQUIRE(details.at("state-bytes-pulled") == "10");
+        REQUIRE(details.at("state-bytes-pushed") == "30");
+        REQUIRE(details.at("state-round-trips") == "2");
+        REQUIRE(details.at("state-bytes-mapped") == "0");
+
+        // The host totals build up across messages
+        faabric::Message otherMsg =
+          faabric::util::messageFactory("demo", "echo");
+        recordStatePull(5);
+        flushStateMetrics(otherMsg);
+
+        StateMetrics totals = getHostStateMetrics("demo/echo");
+        REQUIRE(totals.bytesPulled == 15);
+        REQUIRE(totals.bytesPushed == 30);
+        REQUIRE(totals.roundTrips == 3);
+
+        REQUIRE(getHostStateMetrics("demo/foo").empty());
+    }
+
+    // Nothing carries over to the next message
+    REQUIRE(takeStateMetrics().empty());
+}
+}
@@ -0,0 +1,158 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+#include "fixtures.h"
+
+#include <faabric/state/State.h>
+#include <faabric/util/config.h>
+
+#include <wasm/state_replicas.h>
+
+using namespace wasm;
+
+namespace tests {
+
+#define REPLICA_SIZE (512 * 1024)
+
+class StateReplicasTestFixture
+  : public StateTestFixture
+  , public FaasmConfTestFixture
+{
+  public:
+    StateReplicasTestFixture()
+      : sysConf(faabric::util::getSystemConfig())
+      , replicas(getStateReplicaCache())
+    {
+        // Redis state has no masters, so every value is a replica
+        sysConf.stateMode = "redis";
+        conf.stateReplicaBudgetMb = 1;
+        replicas.clear();
+    }
+
+    ~StateReplicasTestFixture()
+    {
+        replicas.releaseCallPins();
+        replicas.clear();
+        sysConf.reset();
+    }
+
+  protected:
+    faabric::util::SystemConfig& sysConf;
+    StateReplicaCache& replicas;
+
+    // As if each lookup were made by its own call
+    void lookUp(const std::string& key)
+    {
+        replicas.getKV("demo", key, REPLICA_SIZE);
+        replicas.releaseCallPins();
+    }
+};
+
+TEST_CASE_METHOD(StateReplicasTestFixture,
+                 "Test evicting least recently used state replicas",
+                 "[wasm]")
+{
+    faabric::state::State& state = faabric::state::getGlobalState();
+
+    lookUp("replica_a");
+    lookUp("replica_b");
+    REQUIRE(state.getKVCount() == 2);
+
+    // Using a again makes b the least recently used
+    lookUp("replica_a");
+    lookUp("replica_c");
+    REQUIRE(state.getKVCount() == 2);
+
+    StateReplicaStats stats = replicas.getStats();
+    REQUIRE(stats.replicas == 2);
+    REQUIRE(stats.bytes == 2 * REPLICA_SIZE);
+    REQUIRE(stats.hits == 1);
+    REQUIRE(stats.misses == 3);
+    REQUIRE(stats.evictions == 1);
+
+    // Looking up an evicted value is a miss again
+    lookUp("replica_b");
+    stats = replicas.getStats();
+    REQUIRE(stats.misses == 4);
+    REQUIRE(stats.evictions == 2);
+}
+
+TEST_CASE_METHOD(StateReplicasTestFixture,
+                 "Test pinned state replicas aren't evicted",
+                 "[wasm]")
+{
+    SECTION("Pinned by a module")
+    {
+        lookUp("replica_a");
+        replicas.pin("demo", "replica_a");
+        lookUp("replica_b");
+        lookUp("replica_c");
+
+        // b goes instead of a
+        StateReplicaStats stats = replicas.getStats();
+        REQUIRE(stats.evictions == 1);
+        lookUp("replica_a");
+        REQUIRE(replicas.getStats().hits == 1);
+
+        // Once unpinned it can go
+        replicas.unpin("demo", "replica_a");
+        lookUp("replica_b");
+        lookUp("replica_d");
+        REQUIRE(replicas.getStats().evictions == 3);
+        lookUp("replica_a");
+        REQUIRE(replicas.getStats().hits == 1);
+    }
+
+    SECTION("Pinned by the running call")
+    {
+        // Nothing's evicted until the call's done with its values
+        replicas.getKV("demo", "replica_a", REPLICA_SIZE);
+        replicas.getKV("demo", "replica_b", REPLICA_SIZE);
+        replicas.getKV("demo", "replica_c", REPLICA_SIZE);
+        REQUIRE(replicas.getStats().evictions == 0);
+        REQUIRE(replicas.getStats().bytes == 3 * REPLICA_SIZE);
+
+        replicas.releaseCallPins();
+        lookUp("replica_d");
+
+        StateReplicaStats stats = replicas.getStats();
+        REQUIRE(stats.evictions == 2);
+        REQUIRE(stats.bytes == 2 * REPLICA_SIZE);
+    }
+}
+
+TEST_CASE_METHOD(StateReplicasTestFixture,
+                 "Test state mastered here doesn't count towards the budget",
+                 "[wasm]")
+{
+    sysConf.stateMode = "inmemory";
+
+    lookUp("master_a");
+    lookUp("master_b");
+    lookUp("master_c");
+
+    StateReplicaStats stats = replicas.getStats();
+    REQUIRE(stats.replicas == 0);
+    REQUIRE(stats.bytes == 0);
+    REQUIRE(stats.misses == 3);
+    REQUIRE(stats.evictions == 0);
+    REQUIRE(faabric::state::getGlobalState().getKVCount() == 3);
+}
+
+TEST_CASE_METHOD(StateReplicasTestFixture,
+                 "Test state replicas aren't tracked without a budget",
+                 "[wasm]")
+{
+    conf.stateReplicaBudgetMb = 0;
+
+    lookUp("replica_a");
+    lookUp("replica_b");
+    lookUp("replica_c");
+
+    StateReplicaStats stats = replicas.getStats();
+    REQUIRE(stats.replicas == 0);
+    REQUIRE(stats.misses == 0);
+    REQUIRE(stats.evictions == 0);
+    REQUIRE(faabric::state::getGlobalState().getKVCount() == 3);
+}
+}
@@ -0,0 +1,109 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+#include "fixtures.h"
+
+#include <faabric/state/State.h>
+
+#include <wasm/state_shard.h>
+#include <wasm/state_version.h>
+
+#include <numeric>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+class StateShardTestFixture
+  : public StateTestFixture
+  , public FaasmConfTestFixture
+{
+  public:
+    StateShardTestFixture() { clearStateVersions(); }
+
+    ~StateShardTestFixture() { clearStateVersions(); }
+};
+
+static std::vector<uint8_t> getShardValue(const std::string& key, size_t size)
+{
+    auto kv = faabric::state::getGlobalState().getKV("demo", key, size);
+    std::vector<uint8_t> value(size, 0);
+    kv->get(value.data());
+    return value;
+}
+
+TEST_CASE_METHOD(StateShardTestFixture, "Test sharded state layout", "[wasm]")
+{
+    conf.stateShardKb = 2;
+    conf.stateShardReplicas = 0;
+
+    StateShardLayout layout = getStateShardLayout(5 * 1024);
+    REQUIRE(layout.shardSize == 2048);
+    REQUIRE(layout.replicas == 1);
+    REQUIRE(layout.nShards() == 3);
+    REQUIRE(layout.getShardSize(0) == 2048);
+    REQUIRE(layout.getShardSize(2) == 1024);
+
+    REQUIRE(getStateShardLayout(0).nShards() == 0);
+    REQUIRE(getStateShardLayout(2048).nShards() == 1);
+
+    REQUIRE(getStateShardKey("foo", 2) == "foo_shard_2");
+    REQUIRE(getStateShardKey("foo", 2, 1) == "foo_shard_2_copy_1");
+
+    REQUIRE(getStateShardReplica(1) == 0);
+    int replica = getStateShardReplica(3);
+    REQUIRE(replica >= 0);
+    REQUIRE(replica < 3);
+}
+
+TEST_CASE_METHOD(StateShardTestFixture,
+                 "Test sharded state reads and writes",
+                 "[wasm]")
+{
+    conf.stateShardKb = 1;
+    conf.stateShardReplicas = 2;
+
+    std::string key = "state_shard_test";
+    StateShardLayout layout = getStateShardLayout(2560);
+    REQUIRE(layout.nShards() == 3);
+
+    std::vector<uint8_t> value(layout.totalSize);
+    std::iota(value.begin(), value.end(), 0);
+
+    // Write across all shards in one go
+    writeStateSharded("demo", key, layout, 0, value.data(), value.size());
+    REQUIRE(getShardValue(getStateShardKey(key, 2), 512) ==
+            std::vector<uint8_t>(value.begin() + 2048, value.end()));
+
+    // Write across a shard boundary
+    std::vector<uint8_t> update(100, 7);
+    writeStateSharded("demo", key, layout, 1000, update.data(), 100);
+    std::copy(update.begin(), update.end(), value.begin() + 1000);
+
+    // Read straight from the shards
+    std::vector<uint8_t> actual(value.size(), 0);
+    readStateSharded("demo", key, layout, 0, 0, actual.data(), actual.size());
+    REQUIRE(actual == value);
+
+    // Reading from a copy fills in the copies of the shards read
+    std::vector<uint8_t> part(200, 0);
+    readStateSharded("demo", key, layout, 1, 900, part.data(), 200);
+    REQUIRE(part == std::vector<uint8_t>(value.begin() + 900,
+                                         value.begin() + 1100));
+    REQUIRE(getShardValue(getStateShardKey(key, 1, 1), 1024) ==
+            std::vector<uint8_t>(value.begin() + 1024, value.begin() + 2048));
+
+    // Copies are refreshed once the shard has been written again
+    uint8_t newByte = 9;
+    writeStateSharded("demo", key, layout, 1050, &newByte, 1);
+    readStateSharded("demo", key, layout, 1, 1050, part.data(), 1);
+    REQUIRE(part.at(0) == newByte);
+
+    // Out of bounds
+    REQUIRE_THROWS(
+      readStateSharded("demo", key, layout, 0, 2500, part.data(), 100));
+    REQUIRE_THROWS(
+      writeStateSharded("demo", key, layout, 2560, update.data(), 1));
+}
+}
@@ -0,0 +1,52 @@
+#include <catch2/catch.hpp>
+
+#include "fixtures.h"
+
+#include <faabric/state/State.h>
+
+#include <wasm/state_version.h>
+
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+class StateVersionTestFixture : public StateTestFixture
+{
+  public:
+    StateVersionTestFixture() { clearStateVersions(); }
+
+    ~StateVersionTestFixture() { clearStateVersions(); }
+};
+
+TEST_CASE_METHOD(StateVersionTestFixture,
+                 "Test versioned state pulls",
+                 "[wasm]")
+{
+    std::vector<uint8_t> value = { 1, 2, 3, 4 };
+    auto kv = faabric::state::getGlobalState().getKV(
+      "demo", "state_version_test", value.size());
+
+    // Nothing has been pulled yet
+    REQUIRE(pullStateIfChanged(kv));
+    REQUIRE(!pullStateIfChanged(kv));
+
+    // Pushing bumps the version, and this host's replica is up to date
+    kv->set(value.data());
+    REQUIRE(pushStateVersioned(kv) == 1);
+    REQUIRE(!pullStateIfChanged(kv));
+
+    REQUIRE(pushStateVersioned(kv) == 2);
+    REQUIRE(!pullStateIfChanged(kv));
+
+    // A host that hasn't seen the latest version pulls again
+    clearStateVersions();
+    REQUIRE(pullStateIfChanged(kv));
+    REQUIRE(!pullStateIfChanged(kv));
+
+    std::vector<uint8_t> actual(value.size(), 0);
+    kv->get(actual.data());
+    REQUIRE(actual == value);
+}
+}
@@ -0,0 +1,64 @@
+#include <catch2/catch.hpp>
+
+#include <wasm/StdoutCapture.h>
+
+#include <string>
+
+namespace tests {
+
+TEST_CASE("Test capturing stdout under the cap", "[wasm]")
+{
+    wasm::StdoutCapture capture(16);
+    REQUIRE(capture.read().empty());
+
+    std::string a = "hello ";
+    std::string b = "world\n";
+    struct ::iovec iovecs[2] = { { a.data(), a.size() },
+                                 { b.data(), b.size() } };
+    REQUIRE(capture.write(iovecs, 2) == 12);
+    REQUIRE(capture.write("ab", 2) == 2);
+
+    REQUIRE(capture.size() == 14);
+    REQUIRE(capture.getDroppedBytes() == 0);
+    REQUIRE(capture.read() == "hello world\nab");
+
+    capture.clear();
+    REQUIRE(capture.size() == 0);
+    REQUIRE(capture.read().empty());
+}
+
+TEST_CASE("Test capturing stdout over the cap", "[wasm]")
+{
+    wasm::StdoutCapture capture(8);
+    std::string expected;
+    size_t expectedDropped = 0;
+
+    SECTION("Wrapping around")
+    {
+        capture.write("abcdef", 6);
+        capture.write("ghij", 4);
+        capture.write("kl", 2);
+        expected = "efghijkl";
+        expectedDropped = 4;
+    }
+
+    SECTION("Single write bigger than the cap")
+    {
+        capture.write("ab", 2);
+        capture.write("0123456789", 10);
+        expected = "23456789";
+        expectedDropped = 4;
+    }
+
+    REQUIRE(capture.size() == 8);
+    REQUIRE(capture.getDroppedBytes() == expectedDropped);
+    REQUIRE(capture.read() ==
+            "[" + std::to_string(expectedDropped) +
+              " bytes of stdout dropped]\n" + expected);
+
+    capture.clear();
+    REQUIRE(capture.getDroppedBytes() == 0);
+    capture.write("xyz", 3);
+    REQUIRE(capture.read() == "xyz");
+}
+}
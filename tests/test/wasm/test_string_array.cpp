@@ -0,0 +1,96 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <wasm/StringArray.h>
+#include <wasm/WasmEnvironment.h>
+
+#include <string>
+#include <vector>
+
+namespace tests {
+
+TEST_CASE("Test laying out string arrays", "[wasm]")
+{
+    std::vector<std::string> strings;
+    std::vector<uint32_t> expectedOffsets;
+    std::vector<char> expectedBuffer;
+
+    SECTION("Empty") {}
+
+    SECTION("Single string")
+    {
+        strings = { "foo" };
+        expectedOffsets = { 0 };
+        expectedBuffer = { 'f', 'o', 'o', '\0' };
+    }
+
+    SECTION("Multiple strings including empty")
+    {
+        strings = { "ab", "", "c" };
+        expectedOffsets = { 0, 3, 4 };
+        expectedBuffer = { 'a', 'b', '\0', '\0', 'c', '\0' };
+    }
+
+    wasm::StringArray array(strings);
+
+    REQUIRE(array.getCount() == strings.size());
+    REQUIRE(array.getOffsets() == expectedOffsets);
+    REQUIRE(array.getBufferSize() == expectedBuffer.size());
+
+    std::vector<char> actualBuffer(
+      array.getBuffer(), array.getBuffer() + array.getBufferSize());
+    REQUIRE(actualBuffer == expectedBuffer);
+
+    // Each offset points at the original string
+    for (size_t i = 0; i < strings.size(); i++) {
+        std::string actual(array.getBuffer() + array.getOffsets().at(i));
+        REQUIRE(actual == strings.at(i));
+    }
+}
+
+TEST_CASE("Test wasm environment keeps its array up to date", "[wasm]")
+{
+    wasm::WasmEnvironment env;
+
+    uint32_t originalCount = env.getEnvCount();
+    uint32_t originalSize = env.getEnvBufferSize();
+    REQUIRE(env.getVarsArray().getCount() == env.getVars().size());
+
+    env.addEnv("FOO", "bar");
+
+    REQUIRE(env.getEnvCount() == originalCount + 1);
+    REQUIRE(env.getEnvBufferSize() == originalSize + 8);
+
+    const wasm::StringArray& array = env.getVarsArray();
+    std::vector<std::string> actual;
+    for (uint32_t offset : array.getOffsets()) {
+        actual.emplace_back(array.getBuffer() + offset);
+    }
+    REQUIRE(actual == env.getVars());
+
+    // Overwriting a variable doesn't add another
+    env.addEnv("FOO", "bazz");
+    REQUIRE(env.getEnvCount() == originalCount + 1);
+    REQUIRE(env.getEnvBufferSize() == originalSize + 9);
+}
+
+TEST_CASE_METHOD(FaasmConfTestFixture,
+                 "Test Python bytecode cache in wasm environment",
+                 "[wasm]")
+{
+    SECTION("On")
+    {
+        conf.pythonBytecodeCache = "on";
+        wasm::WasmEnvironment env;
+        REQUIRE(env.getEnv("PYTHONPYCACHEPREFIX") == PYTHON_BYTECODE_CACHE_DIR);
+    }
+
+    SECTION("Off")
+    {
+        conf.pythonBytecodeCache = "off";
+        wasm::WasmEnvironment env;
+        REQUIRE(env.getEnv("PYTHONPYCACHEPREFIX").empty());
+    }
+}
+}
@@ -0,0 +1,82 @@
+#include <catch2/catch.hpp>
+
+#include <wasm/timing.h>
+
+#include <cerrno>
+#include <chrono>
+#include <thread>
+
+namespace tests {
+
+TEST_CASE("Test timer resolution", "[wasm]")
+{
+    // Must be well below a millisecond for timing short kernels
+    uint64_t resolution = wasm::getTimerResolutionNanos();
+    REQUIRE(resolution > 0);
+    REQUIRE(resolution < 1000000);
+
+    REQUIRE(wasm::getTimerResolutionSeconds() ==
+            Approx(((double)resolution) / 1e9));
+}
+
+TEST_CASE("Test timer is monotonic", "[wasm]")
+{
+    uint64_t before = wasm::getTimerNanos();
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+    uint64_t after = wasm::getTimerNanos();
+
+    REQUIRE(after > before);
+    REQUIRE(after - before >= 200000);
+
+    double beforeSecs = wasm::getTimerSeconds();
+    double afterSecs = wasm::getTimerSeconds();
+    REQUIRE(afterSecs >= beforeSecs);
+}
+
+TEST_CASE("Test reading WASI clocks", "[wasm]")
+{
+    // Monotonic clock
+    uint64_t before = 0;
+    uint64_t after = 0;
+    REQUIRE(wasm::getWasiClockNanos(1, &before) == 0);
+    REQUIRE(wasm::getWasiClockNanos(1, &after) == 0);
+    REQUIRE(after >= before);
+
+    // Realtime, process and thread CPU clocks
+    for (uint32_t clockId = 0; clockId < 4; clockId++) {
+        uint64_t nanos = 0;
+        REQUIRE(wasm::getWasiClockNanos(clockId, &nanos) == 0);
+        REQUIRE(nanos > 0);
+
+        uint64_t resolution = 0;
+        REQUIRE(wasm::getWasiClockResolutionNanos(clockId, &resolution) == 0);
+        REQUIRE(resolution > 0);
+    }
+
+    uint64_t unused = 0;
+    REQUIRE(wasm::getWasiClockNanos(4, &unused) == -EINVAL);
+    REQUIRE(wasm::getWasiClockResolutionNanos(4, &unused) == -EINVAL);
+}
+
+TEST_CASE("Test sleeps can be cut short", "[wasm]")
+{
+    // Sleeps last as long as asked if not woken
+    uint64_t before = wasm::getTimerNanos();
+    REQUIRE(!wasm::sleepNanos(2000000));
+    REQUIRE(wasm::getTimerNanos() - before >= 2000000);
+
+    // Sleeps outside of a call are woken by passing no module
+    std::thread waker([] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        wasm::wakeSleepingCalls(nullptr);
+    });
+
+    before = wasm::getTimerNanos();
+    bool woken = wasm::sleepNanos(60000000000);
+    uint64_t slept = wasm::getTimerNanos() - before;
+    waker.join();
+
+    REQUIRE(woken);
+    REQUIRE(slept < 10000000000);
+}
+}
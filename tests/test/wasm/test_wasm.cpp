@@ -7,13 +7,33 @@
 #include <faabric/util/bytes.h>
 #include <faabric/util/config.h>
 #include <faabric/util/func.h>
+#include <faabric/util/memory.h>
 
+#include <conf/FaasmConfig.h>
+#include <faabric/snapshot/SnapshotRegistry.h>
 #include <wavm/WAVMWasmModule.h>
 
+#include <atomic>
+#include <memory>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
 using namespace WAVM;
 
 namespace tests {
 
+// Reads through the kernel, which fails rather than faulting if access to the
+// memory has been revoked
+static bool isReadable(const uint8_t* ptr)
+{
+    uint8_t byte = 0;
+    struct iovec local = { &byte, 1 };
+    struct iovec remote = { (void*)ptr, 1 };
+    return process_vm_readv(getpid(), &local, 1, &remote, 1, 0) == 1;
+}
+
 class SimpleWasmTestFixture : public FunctionExecTestFixture
 {
   public:
@@ -109,6 +129,172 @@ TEST_CASE_METHOD(SimpleWasmTestFixture,
     executeX2(module);
 }
 
+TEST_CASE_METHOD(SimpleWasmTestFixture,
+                 "Test dirty page reset on simple WASM module",
+                 "[wasm]")
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    conf.resetMode = "dirty";
+
+    faabric::Message msg = faabric::util::messageFactory("demo", "x2");
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(msg);
+
+    std::string snapKey =
+      wasm::getWAVMModuleCache().registerResetSnapshot(module, msg);
+    auto snap = faabric::snapshot::getSnapshotRegistry().getSnapshot(snapKey);
+
+    // The first reset maps the snapshot and starts tracking
+    module.reset(msg, snapKey);
+    executeX2(module);
+
+    // Subsequent resets only restore the dirty pages, after which memory must
+    // match the snapshot again
+    for (int i = 0; i < 3; i++) {
+        module.reset(msg, snapKey);
+
+        REQUIRE(module.getMemorySizeBytes() == snap->getSize());
+        std::vector<uint8_t> actual(module.getMemoryBase(),
+                                    module.getMemoryBase() + snap->getSize());
+        REQUIRE(actual == snap->getDataCopy());
+
+        executeX2(module);
+    }
+
+    conf.reset();
+}
+
+TEST_CASE_METHOD(SimpleWasmTestFixture,
+                 "Test dirty page resets of concurrent modules",
+                 "[wasm]")
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    conf.resetMode = "dirty";
+
+    faabric::Message msg = faabric::util::messageFactory("demo", "x2");
+    int nModules = 2;
+    std::vector<std::unique_ptr<wasm::WAVMWasmModule>> modules;
+    for (int i = 0; i < nModules; i++) {
+        modules.emplace_back(std::make_unique<wasm::WAVMWasmModule>());
+        modules.back()->bindToFunction(msg);
+    }
+
+    std::string snapKey =
+      wasm::getWAVMModuleCache().registerResetSnapshot(*modules.at(0), msg);
+    auto snap = faabric::snapshot::getSnapshotRegistry().getSnapshot(snapKey);
+    std::vector<uint8_t> snapData = snap->getDataCopy();
+
+    // Each module dirties its own pages and resets, while the other starts
+    // and restarts its tracking
+    int nRounds = 20;
+    std::atomic<int> failures = 0;
+    std::atomic<int> dirtyResets = 0;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nModules; i++) {
+        threads.emplace_back([&, i] {
+            wasm::WAVMWasmModule& module = *modules.at(i);
+            faabric::Message threadMsg = msg;
+            module.reset(threadMsg, snapKey);
+
+            for (int r = 0; r < nRounds; r++) {
+                uint8_t* memBase = module.getMemoryBase();
+                size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+                size_t nPages = snapData.size() / pageSize;
+                for (size_t p = (i + r) % 3; p < nPages; p += 3) {
+                    memBase[p * pageSize + i] ^= 0xff;
+                }
+
+                threadMsg.mutable_execgraphdetails()->clear();
+                module.reset(threadMsg, snapKey);
+                if (threadMsg.execgraphdetails().count("dirty-pages") > 0) {
+                    dirtyResets++;
+                }
+
+                std::vector<uint8_t> actual(module.getMemoryBase(),
+                                            module.getMemoryBase() +
+                                              snapData.size());
+                if (actual != snapData) {
+                    failures++;
+                }
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    REQUIRE(failures.load() == 0);
+
+    // Modules only share the process-wide tracker one at a time
+    if (wasm::MemoryDirtyTracker::isPerRangeTrackingSupported()) {
+        REQUIRE(dirtyResets.load() == nModules * nRounds);
+    }
+
+    conf.reset();
+}
+
+TEST_CASE_METHOD(SimpleWasmTestFixture,
+                 "Test recovering from an interrupt",
+                 "[wasm]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "x2");
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(msg);
+    executeX2(module);
+
+    module.interruptExecution();
+    REQUIRE(module.isExecutionInterrupted());
+
+    module.recoverFromInterrupt();
+    REQUIRE(!module.isExecutionInterrupted());
+
+    // Memory must be usable again once reset
+    module.reset(msg, "");
+    executeX2(module);
+}
+
+TEST_CASE_METHOD(SimpleWasmTestFixture,
+                 "Test interrupting a wasm guest",
+                 "[wasm]")
+{
+    auto req = setUpContext("demo", "echo");
+    faabric::Message& msg = req->mutable_messages()->at(0);
+    msg.set_inputdata("interrupted");
+
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(msg);
+    uint8_t* memoryBase = module.getMemoryBase();
+
+    SECTION("Interrupted in wasm code")
+    {
+        module.interruptExecution();
+        REQUIRE(!isReadable(memoryBase));
+    }
+
+    SECTION("Interrupted in a host call")
+    {
+        // Host code keeps memory until it returns to the guest
+        module.enterHostCall();
+        module.interruptExecution();
+        REQUIRE(isReadable(memoryBase));
+
+        module.exitHostCall();
+        REQUIRE(!isReadable(memoryBase));
+    }
+
+    // The guest traps rather than taking down the host
+    REQUIRE(module.isExecutionInterrupted());
+    REQUIRE(module.executeFunction(msg) != 0);
+
+    module.recoverFromInterrupt();
+    REQUIRE(isReadable(memoryBase));
+
+    module.reset(msg, "");
+    REQUIRE(module.executeFunction(msg) == 0);
+    REQUIRE(msg.outputdata() == "interrupted");
+}
+
 TEST_CASE_METHOD(SimpleWasmTestFixture,
                  "Test execution without binding fails",
                  "[wasm]")
@@ -164,4 +350,94 @@ TEST_CASE_METHOD(SimpleWasmTestFixture, "Test disassemble module", "[wasm]")
     REQUIRE(disasMap["functionImport3"] ==
             "__imported_wasi_snapshot_preview1_args_sizes_get");
 }
+
+TEST_CASE("Test pthread keys", "[wasm]")
+{
+    wasm::WasmModule module;
+    module.clearPthreadSpecifics();
+
+    int32_t keyA = module.createPthreadKey(5);
+    int32_t keyB = module.createPthreadKey(0);
+    REQUIRE(keyA != keyB);
+
+    REQUIRE(module.getPthreadSpecific(keyA) == 0);
+    REQUIRE(module.setPthreadSpecific(keyA, 42));
+    REQUIRE(module.setPthreadSpecific(keyB, 43));
+    REQUIRE(!module.setPthreadSpecific(MAX_PTHREAD_KEYS, 1));
+
+    // Other threads and modules have their own values
+    int32_t otherBefore = -1;
+    int32_t otherAfter = -1;
+    std::thread other([&module, keyA, &otherBefore, &otherAfter] {
+        otherBefore = module.getPthreadSpecific(keyA);
+        module.setPthreadSpecific(keyA, 7);
+        otherAfter = module.getPthreadSpecific(keyA);
+    });
+    other.join();
+
+    REQUIRE(otherBefore == 0);
+    REQUIRE(otherAfter == 7);
+    REQUIRE(module.getPthreadSpecific(keyA) == 42);
+
+    wasm::WasmModule otherModule;
+    REQUIRE(otherModule.getPthreadSpecific(keyA) == 0);
+
+    // Only keys with destructors and values have their destructors called,
+    // which here sets the value again once
+    std::vector<std::pair<int32_t, int32_t>> calls;
+    module.runPthreadKeyDestructors([&](int32_t func, int32_t value) {
+        calls.emplace_back(func, value);
+        if (calls.size() == 1) {
+            module.setPthreadSpecific(keyA, 44);
+        }
+    });
+
+    std::vector<std::pair<int32_t, int32_t>> expected = { { 5, 42 },
+                                                          { 5, 44 } };
+    REQUIRE(calls == expected);
+    REQUIRE(module.getPthreadSpecific(keyA) == 0);
+    REQUIRE(module.getPthreadSpecific(keyB) == 43);
+
+    module.clearPthreadSpecifics();
+    REQUIRE(module.getPthreadSpecific(keyB) == 0);
+}
+
+TEST_CASE("Test running out of pthread keys", "[wasm]")
+{
+    wasm::WasmModule module;
+
+    for (int i = 0; i < MAX_PTHREAD_KEYS; i++) {
+        REQUIRE(module.createPthreadKey(0) == i);
+    }
+
+    REQUIRE(module.createPthreadKey(0) == -1);
+
+    // Deleted keys aren't reused straight away
+    module.deletePthreadKey(3);
+    REQUIRE(module.createPthreadKey(0) == -1);
+}
+
+TEST_CASE_METHOD(FaasmConfTestFixture,
+                 "Test Python functions' zygote keys",
+                 "[wasm]")
+{
+    faabric::Message msg =
+      faabric::util::messageFactory(PYTHON_USER, PYTHON_FUNC);
+    msg.set_ispython(true);
+    msg.set_pythonuser("foo");
+    msg.set_pythonfunction("bar");
+
+    faabric::Message nonPythonMsg = faabric::util::messageFactory("demo", "x2");
+
+    // Python functions share the runtime's zygote unless turned on
+    std::string funcStr = faabric::util::funcToString(msg, false);
+    REQUIRE(wasm::getZygoteKey(msg) == funcStr);
+
+    conf.pythonImportZygote = "on";
+    REQUIRE(wasm::getZygoteKey(msg) == funcStr + ":foo/bar");
+    REQUIRE(wasm::getZygoteKey(nonPythonMsg) == "demo/x2");
+
+    msg.set_pythonfunction("baz");
+    REQUIRE(wasm::getZygoteKey(msg) == funcStr + ":foo/baz");
+}
 }
@@ -86,4 +86,30 @@ TEST_CASE_METHOD(WasmStateTestFixture,
     std::vector<uint8_t> expectedB2 = { 1, 1, 1, 1, 1, markerB2, 1 };
     checkMapping(moduleB, kv, offsetB2 - 5, 7, expectedB2);
 }
+
+TEST_CASE_METHOD(WasmStateTestFixture, "Test state handles", "[wasm]")
+{
+    wasm::WAVMWasmModule module;
+    faabric::Message call = faabric::util::messageFactory("demo", "echo");
+    module.bindToFunction(call);
+
+    size_t stateSize = 10;
+    int32_t handleA = module.getStateHandle("handle_a", stateSize);
+    int32_t handleB = module.getStateHandle("handle_b", stateSize);
+    REQUIRE(handleA != handleB);
+
+    // Asking again gives the same handle
+    REQUIRE(module.getStateHandle("handle_a", stateSize) == handleA);
+
+    auto kvA = faabric::state::getGlobalState().getKV("demo", "handle_a", 0);
+    REQUIRE(module.getStateKVForHandle(handleA) == kvA);
+
+    auto kvB = module.getStateKVForHandle(handleB);
+    REQUIRE(kvB->key == "handle_b");
+    REQUIRE(kvB->size() == stateSize);
+
+    REQUIRE_THROWS_AS(module.getStateKVForHandle(-1), std::runtime_error);
+    REQUIRE_THROWS_AS(module.getStateKVForHandle(handleB + 1),
+                      std::runtime_error);
+}
 }
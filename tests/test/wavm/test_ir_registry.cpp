@@ -9,6 +9,9 @@
 #include <storage/FileLoader.h>
 #include <wavm/IRModuleCache.h>
 
+#include <thread>
+#include <vector>
+
 namespace tests {
 void checkObjCode(const Runtime::ModuleRef moduleRef, const std::string& path)
 {
@@ -142,6 +145,40 @@ TEST_CASE_METHOD(IRModuleCacheTestFixture,
     checkObjCode(objRefB1, objPathB);
 }
 
+TEST_CASE_METHOD(IRModuleCacheTestFixture,
+                 "Test shared library caching across functions",
+                 "[wasm]")
+{
+    wasm::IRModuleCache& registry = wasm::getIRModuleCache();
+
+    std::string user = "demo";
+    std::string funcA = "echo";
+    std::string funcB = "x2";
+    std::string path = "/usr/local/faasm/runtime_root/lib/fake/libfakeLibA.so";
+
+    // Shared modules should not depend on the importing main module
+    IR::Module& refA = registry.getModule(user, funcA, path);
+    Runtime::ModuleRef objRefA = registry.getCompiledModule(user, funcA, path);
+
+    REQUIRE(registry.isModuleCached(user, funcB, path));
+    REQUIRE(registry.isCompiledModuleCached(user, funcB, path));
+
+    IR::Module& refB = registry.getModule(user, funcB, path);
+    Runtime::ModuleRef objRefB = registry.getCompiledModule(user, funcB, path);
+
+    // Check both functions get the same module
+    REQUIRE(std::addressof(refA) == std::addressof(refB));
+    REQUIRE(objRefA == objRefB);
+    REQUIRE(registry.getSharedCompiledModuleCount() == 1);
+
+    // Check the table import accepts any main module table
+    REQUIRE(!refA.tables.imports.empty());
+    REQUIRE(refA.tables.imports[0].type.size.min == 0);
+    REQUIRE(refA.tables.imports[0].type.size.max == MAX_TABLE_SIZE);
+    REQUIRE(registry.getSharedModuleTableSize(user, funcA, path) ==
+            registry.getSharedModuleTableSize(user, funcB, path));
+}
+
 TEST_CASE_METHOD(IRModuleCacheTestFixture, "Test IR cache clearing", "[wasm]")
 {
     wasm::IRModuleCache& registry = wasm::getIRModuleCache();
@@ -171,4 +208,57 @@ TEST_CASE_METHOD(IRModuleCacheTestFixture, "Test IR cache clearing", "[wasm]")
     REQUIRE(!registry.isModuleCached(user, func, libPath));
     REQUIRE(!registry.isCompiledModuleCached(user, func, libPath));
 }
+
+class IRModuleCompileTestFixture
+  : public FunctionLoaderTestFixture
+  , public IRModuleCacheTestFixture
+{};
+
+TEST_CASE_METHOD(IRModuleCompileTestFixture,
+                 "Test compiling main module with no machine code",
+                 "[wasm]")
+{
+    wasm::IRModuleCache& registry = wasm::getIRModuleCache();
+
+    // Upload the wasm without running codegen
+    loader.uploadFunction(msgA);
+    REQUIRE(loader.loadFunctionObjectFile(msgA).empty());
+
+    const std::string user = msgA.user();
+    const std::string func = msgA.function();
+    registry.getModule(user, func, "");
+
+    // Only one of several concurrent callers compiles the module
+    int nThreads = 4;
+    std::vector<Runtime::ModuleRef> compiled(nThreads);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([&registry, &compiled, &user, &func, i] {
+            compiled.at(i) = registry.getCompiledModule(user, func, "");
+        });
+    }
+
+    for (auto& t : threads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+
+    for (const auto& c : compiled) {
+        REQUIRE(c != nullptr);
+        REQUIRE(c == compiled.at(0));
+    }
+
+    // The compiled code is uploaded for others to use
+    registry.awaitObjectUploads();
+    std::vector<uint8_t> uploaded = loader.loadFunctionObjectFile(msgA);
+    REQUIRE(uploaded == Runtime::getObjectCode(compiled.at(0)));
+
+    // Once evicted, the module is loaded from the uploaded code
+    compiled.clear();
+    registry.evictMainModule(user, func);
+    registry.getModule(user, func, "");
+    registry.getCompiledModule(user, func, "");
+    REQUIRE(registry.getCompiledModuleSize(user, func, "") == uploaded.size());
+}
 }
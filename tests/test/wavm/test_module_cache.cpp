@@ -6,9 +6,17 @@
 #include <faabric/proto/faabric.pb.h>
 #include <faabric/util/func.h>
 #include <faabric/util/macros.h>
+#include <faabric/util/memory.h>
 
+#include <conf/FaasmConfig.h>
+#include <faabric/snapshot/SnapshotRegistry.h>
+#include <wavm/IRModuleCache.h>
 #include <wavm/WAVMWasmModule.h>
 
+#include <algorithm>
+#include <future>
+#include <thread>
+
 namespace tests {
 
 TEST_CASE_METHOD(FunctionExecTestFixture,
@@ -29,24 +37,373 @@ TEST_CASE_METHOD(FunctionExecTestFixture,
     int input[3] = { 1, 2, 3 };
     msgA.set_inputdata(BYTES(input), 3 * sizeof(int));
 
-    // Note - we need to explicitly unlock these locks otherwise we get a
-    // deadlock
-    auto [moduleA, lockA] = moduleCache.getCachedModule(msgA);
-    lockA.unlock();
-    auto [moduleB, lockB] = moduleCache.getCachedModule(msgB);
-    lockB.unlock();
+    std::shared_ptr<wasm::WAVMWasmModule> moduleA =
+      moduleCache.getCachedModule(msgA);
+    std::shared_ptr<wasm::WAVMWasmModule> moduleB =
+      moduleCache.getCachedModule(msgB);
 
     // Check modules are the same
-    REQUIRE(std::addressof(moduleA) == std::addressof(moduleB));
-    REQUIRE(moduleA.isBound());
+    REQUIRE(moduleA == moduleB);
+    REQUIRE(moduleA->isBound());
 
     // Execute the function normally and make sure cached module is not used
     faaslet::Faaslet faaslet(msgA);
     int returnValue = faaslet.executeTask(0, 0, req);
     REQUIRE(returnValue == 0);
 
-    REQUIRE(std::addressof(moduleA) != std::addressof(*faaslet.module));
+    REQUIRE(moduleA.get() != faaslet.module.get());
 
     faaslet.shutdown();
 }
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test WAVM module cache lookups across threads",
+                 "[wasm]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+
+    std::shared_ptr<wasm::WAVMWasmModule> original =
+      moduleCache.getCachedModule(msg);
+
+    // Another thread must see the same module
+    std::shared_ptr<wasm::WAVMWasmModule> fromThread;
+    std::thread t([this, &msg, &fromThread] {
+        fromThread = moduleCache.getCachedModule(msg);
+    });
+    t.join();
+    REQUIRE(fromThread == original);
+
+    // After clearing, this thread's view must be refreshed, and the new entry
+    // must be visible from other threads
+    moduleCache.clear();
+    REQUIRE(moduleCache.getTotalCachedModuleCount() == 0);
+
+    std::shared_ptr<wasm::WAVMWasmModule> recreated =
+      moduleCache.getCachedModule(msg);
+    REQUIRE(recreated != original);
+
+    std::thread tb([this, &msg, &fromThread] {
+        fromThread = moduleCache.getCachedModule(msg);
+    });
+    tb.join();
+    REQUIRE(fromThread == recreated);
+    REQUIRE(moduleCache.getTotalCachedModuleCount() == 1);
+}
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test WAVM module cache eviction",
+                 "[wasm]")
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    faabric::snapshot::SnapshotRegistry& reg =
+      faabric::snapshot::getSnapshotRegistry();
+    wasm::IRModuleCache& irCache = wasm::getIRModuleCache();
+
+    faabric::Message msgA = faabric::util::messageFactory("demo", "echo");
+    faabric::Message msgB = faabric::util::messageFactory("demo", "hello");
+
+    // Bind a module to A, which pins its cache entry
+    auto moduleA = std::make_unique<wasm::WAVMWasmModule>();
+    moduleA->bindToFunction(msgA);
+    std::string snapKeyA = moduleCache.registerResetSnapshot(*moduleA, msgA);
+
+    std::vector<wasm::WAVMCacheEntryStats> stats = moduleCache.getEntryStats();
+    REQUIRE(stats.size() == 1);
+    REQUIRE(stats.at(0).key == "demo/echo");
+    REQUIRE(stats.at(0).inUse);
+    REQUIRE(stats.at(0).residentBytes > 0);
+    REQUIRE(moduleCache.getTotalResidentBytes() == stats.at(0).residentBytes);
+
+    // Set a tiny budget, so that anything not in use gets evicted
+    conf.moduleCacheBudgetMb = 1;
+
+    // Bind and drop a module for B, A must survive as it's in use
+    {
+        wasm::WAVMWasmModule moduleB;
+        moduleB.bindToFunction(msgB);
+        moduleCache.registerResetSnapshot(moduleB, msgB);
+    }
+
+    REQUIRE(moduleCache.getTotalCachedModuleCount() == 2);
+    REQUIRE(reg.snapshotExists(snapKeyA));
+
+    // Release A, then insert a third function, which should evict both A
+    // and B along with their snapshots and IR
+    moduleA = nullptr;
+    faabric::Message msgC = faabric::util::messageFactory("demo", "chain");
+    moduleCache.getCachedModule(msgC);
+
+    REQUIRE(moduleCache.getTotalCachedModuleCount() == 1);
+    REQUIRE(!reg.snapshotExists(snapKeyA));
+    REQUIRE(!reg.snapshotExists("demo/hello_reset"));
+    REQUIRE(!irCache.isCompiledModuleCached("demo", "echo", ""));
+    REQUIRE(!irCache.isCompiledModuleCached("demo", "hello", ""));
+
+    stats = moduleCache.getEntryStats();
+    REQUIRE(stats.size() == 1);
+    REQUIRE(stats.at(0).key == "demo/chain");
+    REQUIRE(!stats.at(0).inUse);
+
+    conf.reset();
+}
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test evicted zygotes aren't kept by idle threads",
+                 "[wasm]")
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    faabric::snapshot::SnapshotRegistry& reg =
+      faabric::snapshot::getSnapshotRegistry();
+
+    faabric::Message msgA = faabric::util::messageFactory("demo", "echo");
+    faabric::Message msgB = faabric::util::messageFactory("demo", "hello");
+
+    // Another thread looks up A, then sits idle while A is evicted
+    std::promise<void> lookedUp;
+    std::promise<void> evicted;
+    std::promise<std::string> registered;
+    std::thread idleThread([&] {
+        faabric::Message threadMsg = msgA;
+        moduleCache.getCachedModule(threadMsg);
+        lookedUp.set_value();
+
+        evicted.get_future().wait();
+
+        // Its view is now stale, so registering a snapshot must put the
+        // function back in the cache to account for it
+        wasm::WAVMWasmModule module;
+        module.bindToFunction(threadMsg);
+        registered.set_value(
+          moduleCache.registerResetSnapshot(module, threadMsg));
+    });
+
+    lookedUp.get_future().wait();
+    std::weak_ptr<wasm::WAVMWasmModule> zygoteA =
+      moduleCache.getCachedModule(msgA);
+    REQUIRE(!zygoteA.expired());
+
+    conf.moduleCacheBudgetMb = 1;
+    moduleCache.getCachedModule(msgB);
+    REQUIRE(moduleCache.getTotalCachedModuleCount() == 1);
+    REQUIRE(zygoteA.expired());
+
+    conf.moduleCacheBudgetMb = 0;
+    evicted.set_value();
+    std::string snapKey = registered.get_future().get();
+    idleThread.join();
+
+    REQUIRE(snapKey == "demo/echo_reset");
+    REQUIRE(reg.snapshotExists(snapKey));
+
+    std::vector<wasm::WAVMCacheEntryStats> stats = moduleCache.getEntryStats();
+    auto it = std::find_if(stats.begin(), stats.end(), [](const auto& e) {
+        return e.key == "demo/echo";
+    });
+    REQUIRE(it != stats.end());
+    REQUIRE(it->snapshotBytes > 0);
+
+    conf.reset();
+}
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test binding from shared zygote memory",
+                 "[wasm]")
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    faabric::snapshot::SnapshotRegistry& reg =
+      faabric::snapshot::getSnapshotRegistry();
+
+    bool shared = false;
+    SECTION("Shared")
+    {
+        conf.sharedZygoteMemory = "on";
+        shared = true;
+    }
+
+    SECTION("Not shared") { conf.sharedZygoteMemory = "off"; }
+
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    msg.set_inputdata("shared");
+
+    wasm::WAVMWasmModule moduleA;
+    moduleA.bindToFunction(msg);
+    REQUIRE(reg.snapshotExists("demo/echo_reset") == shared);
+
+    wasm::WAVMWasmModule moduleB;
+    moduleB.bindToFunction(msg);
+
+    // Both modules must start from the zygote's memory
+    std::shared_ptr<wasm::WAVMWasmModule> zygote =
+      moduleCache.getCachedModule(msg);
+    size_t memSize = zygote->getMemorySizeBytes();
+    REQUIRE(moduleA.getMemorySizeBytes() == memSize);
+    REQUIRE(moduleB.getMemorySizeBytes() == memSize);
+
+    std::vector<uint8_t> expected(zygote->getMemoryBase(),
+                                  zygote->getMemoryBase() + memSize);
+    std::vector<uint8_t> actualA(moduleA.getMemoryBase(),
+                                 moduleA.getMemoryBase() + memSize);
+    REQUIRE(actualA == expected);
+
+    // Writes by one module must not be visible to the other
+    REQUIRE(moduleA.executeFunction(msg) == 0);
+    REQUIRE(msg.outputdata() == "shared");
+
+    std::vector<uint8_t> actualB(moduleB.getMemoryBase(),
+                                 moduleB.getMemoryBase() + memSize);
+    REQUIRE(actualB == expected);
+
+    REQUIRE(moduleB.executeFunction(msg) == 0);
+    REQUIRE(msg.outputdata() == "shared");
+
+    conf.reset();
+}
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test reclaiming compartments in the background",
+                 "[wasm]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    wasm::CompartmentReclaimer& reclaimer = wasm::getCompartmentReclaimer();
+    size_t failedBefore = reclaimer.getFailedCount();
+
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(msg);
+    size_t memSize = moduleCache.getCachedModule(msg)->getMemorySizeBytes();
+
+    // Growing memory rules out the dirty page reset, so every reset clones a
+    // new compartment and leaves the old one to the reclaimer
+    for (int i = 0; i < COMPARTMENT_RECLAIM_QUEUE_SIZE * 2; i++) {
+        module.growMemory(WASM_BYTES_PER_PAGE);
+        module.reset(msg, "");
+        REQUIRE(module.getMemorySizeBytes() == memSize);
+        REQUIRE(reclaimer.getPendingCount() <=
+                COMPARTMENT_RECLAIM_QUEUE_SIZE + 1);
+    }
+
+    reclaimer.drain();
+    REQUIRE(reclaimer.getPendingCount() == 0);
+    REQUIRE(reclaimer.getFailedCount() == failedBefore);
+
+    REQUIRE(module.executeFunction(msg) == 0);
+}
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test resetting from pooled compartments",
+                 "[wasm]")
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    conf.compartmentPoolSize = 2;
+
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    msg.set_inputdata("pooled");
+
+    bool withSnapshot = false;
+    SECTION("With snapshot") { withSnapshot = true; }
+
+    SECTION("Without snapshot") { withSnapshot = false; }
+
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(msg);
+
+    std::string snapshotKey;
+    if (withSnapshot) {
+        snapshotKey = moduleCache.registerResetSnapshot(module, msg);
+    }
+
+    std::shared_ptr<wasm::WAVMWasmModule> zygote =
+      moduleCache.getCachedModule(msg);
+    size_t memSize = zygote->getMemorySizeBytes();
+
+    wasm::CompartmentPoolFiller& filler = wasm::getCompartmentPoolFiller();
+    for (int i = 0; i < 4; i++) {
+        // Growing memory rules out the dirty page reset
+        module.growMemory(WASM_BYTES_PER_PAGE);
+        module.reset(msg, snapshotKey);
+        REQUIRE(module.getMemorySizeBytes() == memSize);
+        REQUIRE(module.executeFunction(msg) == 0);
+        REQUIRE(msg.outputdata() == "pooled");
+
+        // Each reset takes from the pool, and the filler tops it back up
+        filler.drain();
+        REQUIRE(zygote->getCompartmentPoolCount() == 2);
+    }
+
+    // Flushing releases the pool along with the zygote
+    zygote = nullptr;
+    moduleCache.clear();
+
+    conf.reset();
+}
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test sharing read-only data between modules",
+                 "[wasm]")
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    msg.set_inputdata("rodata");
+
+    SECTION("Off")
+    {
+        conf.sharedReadOnlyData = "off";
+        moduleCache.clear();
+
+        REQUIRE(
+          moduleCache.getCachedModule(msg)->getReadOnlyDataRegions().empty());
+    }
+
+    SECTION("On")
+    {
+        conf.sharedReadOnlyData = "on";
+        moduleCache.clear();
+
+        std::shared_ptr<wasm::WAVMWasmModule> zygote =
+          moduleCache.getCachedModule(msg);
+        auto regions = zygote->getReadOnlyDataRegions();
+
+        // Regions are whole pages within the read-only segments
+        auto ranges = wasm::getIRModuleCache().getReadOnlyDataRanges(
+          "demo", "echo", "");
+        for (const auto& [start, end] : regions) {
+            REQUIRE(start % faabric::util::HOST_PAGE_SIZE == 0);
+            REQUIRE(end % faabric::util::HOST_PAGE_SIZE == 0);
+            REQUIRE(std::any_of(ranges.begin(),
+                                ranges.end(),
+                                [start, end](const auto& r) {
+                                    return r.first <= start && end <= r.second;
+                                }));
+        }
+
+        wasm::WAVMWasmModule module;
+        module.bindToFunction(msg);
+        REQUIRE(module.getReadOnlyDataRegions() == regions);
+
+        for (const auto& [start, end] : regions) {
+            std::vector<uint8_t> expected(zygote->getMemoryBase() + start,
+                                          zygote->getMemoryBase() + end);
+            std::vector<uint8_t> actual(module.getMemoryBase() + start,
+                                        module.getMemoryBase() + end);
+            REQUIRE(actual == expected);
+
+            // Writes stay private to the module
+            uint8_t original = zygote->getMemoryBase()[start];
+            module.getMemoryBase()[start] = original + 1;
+            REQUIRE(zygote->getMemoryBase()[start] == original);
+        }
+
+        // Resets restore the shared copy
+        module.growMemory(WASM_BYTES_PER_PAGE);
+        module.reset(msg, "");
+        for (const auto& [start, end] : regions) {
+            REQUIRE(module.getMemoryBase()[start] ==
+                    zygote->getMemoryBase()[start]);
+        }
+
+        REQUIRE(module.executeFunction(msg) == 0);
+        REQUIRE(msg.outputdata() == "rodata");
+    }
+
+    conf.reset();
+}
 }
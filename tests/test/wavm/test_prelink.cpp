@@ -0,0 +1,164 @@
+#include <catch2/catch.hpp>
+
+#include <wasm/WasmCommon.h>
+#include <wavm/WAVMWasmModule.h>
+#include <wavm/prelink.h>
+
+#include <WAVM/IR/Module.h>
+#include <WAVM/WASM/WASM.h>
+#include <WAVM/WASTParse/WASTParse.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace WAVM;
+
+namespace tests {
+
+static const std::string mainWast = R"(
+(module
+  (memory 2)
+  (table 2 funcref)
+  (global $__stack_pointer (mut i32) (i32.const 65536))
+  (global (export "main_data") i32 (i32.const 1024))
+  (func $double (export "double") (param i32) (result i32)
+    (i32.mul (local.get 0) (i32.const 2)))
+  (func (export "__wasm_call_ctors"))
+)
+)";
+
+static const std::string libWast = R"(
+(module
+  (import "env" "memory" (memory 1))
+  (import "env" "__indirect_function_table" (table 1 funcref))
+  (import "env" "__memory_base" (global $mb i32))
+  (import "env" "__table_base" (global $tb i32))
+  (import "env" "__stack_pointer" (global $sp (mut i32)))
+  (import "env" "double" (func $double (param i32) (result i32)))
+  (import "GOT.mem" "main_data" (global $gd (mut i32)))
+  (import "GOT.func" "double" (global $gf (mut i32)))
+  (data (global.get $mb) "\2a\00\00\00")
+  (func (export "quadruple") (param i32) (result i32)
+    (call $double (call $double (local.get 0))))
+  (func (export "lib_data") (result i32) (global.get $gd))
+  (func (export "stack") (result i32) (global.get $sp))
+)
+)";
+
+static std::vector<uint8_t> wastToWasm(const std::string& wast,
+                                       bool isLibrary)
+{
+    IR::Module module;
+    wasm::setWavmFeatureSpec(module.featureSpec);
+
+    std::vector<WAST::Error> parseErrors;
+    REQUIRE(
+      WAST::parseModule(wast.c_str(), wast.size() + 1, module, parseErrors));
+
+    // Four bytes of data and one table entry, four byte aligned
+    if (isLibrary) {
+        IR::CustomSection dylink;
+        dylink.name = "dylink.0";
+        dylink.data = { 0x01, 0x04, 0x04, 0x02, 0x01, 0x00 };
+        module.customSections.push_back(dylink);
+    }
+
+    return WASM::saveBinaryModule(module);
+}
+
+static Uptr getExportIndex(const IR::Module& module, const std::string& name)
+{
+    for (const auto& e : module.exports) {
+        if (e.name == name) {
+            return e.index;
+        }
+    }
+
+    FAIL("Missing export " + name);
+    return 0;
+}
+
+TEST_CASE("Test prelinking a shared library", "[wasm]")
+{
+    std::vector<wasm::PrelinkedLibrary> libs(1);
+    libs[0].path = "lib/libdemo.so";
+    libs[0].bytes = wastToWasm(libWast, true);
+
+    std::vector<uint8_t> linkedBytes =
+      wasm::wavmPrelink(wastToWasm(mainWast, false), libs);
+
+    IR::Module linked;
+    wasm::setWavmFeatureSpec(linked.featureSpec);
+    WASM::LoadError loadError;
+    REQUIRE(WASM::loadBinaryModule(
+      linkedBytes.data(), linkedBytes.size(), linked, &loadError));
+
+    REQUIRE(wasm::getPrelinkedLibraryPaths(linked) ==
+            std::vector<std::string>({ "lib/libdemo.so" }));
+
+    // Everything the library imported is resolved
+    REQUIRE(linked.functions.imports.empty());
+    REQUIRE(linked.globals.imports.empty());
+    REQUIRE(linked.memories.imports.empty());
+    REQUIRE(linked.tables.imports.empty());
+
+    // The library's data goes after the main module's memory, and its table
+    // entries after the main module's, followed by the one for the GOT
+    I32 memoryBase = 2 * WASM_BYTES_PER_PAGE;
+    REQUIRE(linked.memories.defs[0].type.size.min == 3);
+    REQUIRE(linked.tables.defs[0].type.size.min == 4);
+
+    const IR::DataSegment& data = linked.dataSegments.back();
+    REQUIRE(data.baseOffset.type == IR::InitializerExpression::Type::i32_const);
+    REQUIRE(data.baseOffset.i32 == memoryBase);
+
+    Uptr doubleIdx = getExportIndex(linked, "double");
+    const IR::ElemSegment& got = linked.elemSegments.back();
+    REQUIRE(got.baseOffset.i32 == 3);
+    REQUIRE(got.contents->elemIndices == std::vector<Uptr>({ doubleIdx }));
+
+    // The library's exports are kept under their own names and for dlsym
+    Uptr quadrupleIdx = getExportIndex(linked, "quadruple");
+    REQUIRE(getExportIndex(linked,
+                           wasm::getPrelinkedExportName(0, "quadruple")) ==
+            quadrupleIdx);
+
+    // The constructors are chained, and come last
+    REQUIRE(getExportIndex(linked, WASM_CTORS_FUNC_NAME) ==
+            linked.functions.size() - 1);
+
+    // Imported globals become constants
+    std::vector<I32> constants;
+    for (const auto& def : linked.globals.defs) {
+        if (def.initializer.type ==
+            IR::InitializerExpression::Type::i32_const) {
+            constants.push_back(def.initializer.i32);
+        }
+    }
+    REQUIRE(std::find(constants.begin(), constants.end(), 1024) !=
+            constants.end());
+    REQUIRE(std::find(constants.begin(), constants.end(), memoryBase) !=
+            constants.end());
+    REQUIRE(std::find(constants.begin(), constants.end(), 3) !=
+            constants.end());
+}
+
+TEST_CASE("Test prelinking a module that isn't a shared library", "[wasm]")
+{
+    std::vector<wasm::PrelinkedLibrary> libs(1);
+    libs[0].path = "lib/libdemo.so";
+    libs[0].bytes = wastToWasm(libWast, false);
+
+    REQUIRE_THROWS(wasm::wavmPrelink(wastToWasm(mainWast, false), libs));
+}
+
+TEST_CASE("Test modules that aren't prelinked have no prelinked libraries",
+          "[wasm]")
+{
+    IR::Module module;
+    REQUIRE(wasm::getPrelinkedLibraryPaths(module).empty());
+    REQUIRE(wasm::getPrelinkedExportName(1, "foo") ==
+            "faasm.prelinked.1.foo");
+}
+}
@@ -0,0 +1,105 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+
+#include <faabric/util/func.h>
+
+#include <wavm/profiler.h>
+
+using namespace wasm;
+
+namespace tests {
+
+TEST_CASE("Test folding wasm call stacks", "[wasm]")
+{
+    std::map<std::string, std::string> names = {
+        { "functionDef1", "main" },
+        { "functionDef2", "doWork" },
+        { "functionDef3", "" },
+    };
+
+    std::vector<std::string> frames;
+    std::string expected;
+
+    SECTION("Named frames")
+    {
+        // Innermost frame first, with host frames mixed in
+        frames = { "host!libc.so!memcpy+12",
+                   "wasm!demo/echo!functionDef2+34",
+                   "wasm!demo/echo!functionDef1+5",
+                   "host!func_runner!main+100" };
+        expected = "main;doWork";
+    }
+
+    SECTION("Unnamed frames")
+    {
+        frames = { "wasm!demo/echo!functionDef3+1",
+                   "wasm!demo/echo!functionDef9+2",
+                   "wasm!demo/echo!functionDef1+3" };
+        expected = "main;functionDef9;functionDef3";
+    }
+
+    SECTION("No wasm frames")
+    {
+        frames = { "host!func_runner!main+100" };
+        expected = "";
+    }
+
+    REQUIRE(foldWasmCallStack(frames, names) == expected);
+}
+
+TEST_CASE_METHOD(FaasmConfTestFixture,
+                 "Test wasm profiling config",
+                 "[wasm]")
+{
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+
+    conf.wasmProfileDir = "";
+    REQUIRE(!isWasmProfiling());
+
+    conf.wasmProfileDir = "/tmp/faasm_profile";
+    REQUIRE(isWasmProfiling());
+    REQUIRE(getWasmProfileFile(msg) == "/tmp/faasm_profile/demo_echo.folded");
+}
+
+TEST_CASE_METHOD(FaasmConfTestFixture,
+                 "Test profiling a share of calls",
+                 "[wasm]")
+{
+    conf.wasmProfileDir = "/tmp/faasm_profile";
+
+    int percent = 0;
+    SECTION("All calls")
+    {
+        percent = 100;
+    }
+
+    SECTION("Some calls")
+    {
+        percent = 20;
+    }
+
+    SECTION("No calls")
+    {
+        percent = 0;
+    }
+
+    conf.wasmProfilePercent = percent;
+
+    int nCalls = 1000;
+    int nProfiled = 0;
+    faabric::Message msg = faabric::util::messageFactory("demo", "echo");
+    for (int i = 0; i < nCalls; i++) {
+        msg.set_id(i);
+        if (isCallProfiled(msg)) {
+            nProfiled++;
+        }
+    }
+
+    REQUIRE(nProfiled == nCalls * percent / 100);
+
+    // Nothing is profiled with profiling off
+    conf.wasmProfileDir = "";
+    REQUIRE(!isCallProfiled(msg));
+}
+}
@@ -12,6 +12,8 @@
 
 #include <faabric/util/files.h>
 
+#include <sys/mman.h>
+
 namespace tests {
 
 /**
@@ -96,6 +98,54 @@ class WAVMModuleCacheTestFixture
     wasm::WAVMModuleCache& moduleCache;
 };
 
+/**
+ * Module whose linear memory is a plain host mapping, without a runtime
+ * behind it. Memory is committed a page at a time as it grows, up to the
+ * given number of wasm pages.
+ */
+class HostMemoryModule : public wasm::WasmModule
+{
+  public:
+    HostMemoryModule(size_t maxPagesIn)
+      : maxPages(maxPagesIn)
+    {
+        memory = (uint8_t*)mmap(nullptr,
+                                maxPages * WASM_BYTES_PER_PAGE,
+                                PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS,
+                                -1,
+                                0);
+    }
+
+    ~HostMemoryModule() { munmap(memory, maxPages * WASM_BYTES_PER_PAGE); }
+
+    uint8_t* getMemoryBase() override { return memory; }
+
+    size_t getMemorySizeBytes() override
+    {
+        return committedPages * WASM_BYTES_PER_PAGE;
+    }
+
+    size_t getMaxMemoryPages() override { return maxPages; }
+
+    uint8_t* wasmPointerToNative(uint32_t wasmPtr) override
+    {
+        return memory + wasmPtr;
+    }
+
+  protected:
+    bool doGrowMemory(uint32_t pageChange) override
+    {
+        committedPages += pageChange;
+        return true;
+    }
+
+  private:
+    const size_t maxPages;
+    uint8_t* memory = nullptr;
+    size_t committedPages = 0;
+};
+
 /**
  * Convenience fixture that bundles all fixtures necessary for executing
  * functions and tidying up afterwards (resetting the scheduler, clearning
@@ -151,22 +201,16 @@ class FunctionLoaderTestFixture : public S3TestFixture
         conf.wasmVm = "wavm";
         objBytesA = loader.loadFunctionObjectFile(msgA);
         objBytesB = loader.loadFunctionObjectFile(msgB);
-        hashBytesA = loader.loadFunctionObjectHash(msgA);
-        hashBytesB = loader.loadFunctionObjectHash(msgB);
 
         conf.wasmVm = "wamr";
         // Re-do the codegen to avoid caching problems
         wamrObjBytesA = wasm::wamrCodegen(wasmBytesA, false);
         wamrObjBytesB = wasm::wamrCodegen(wasmBytesB, false);
-        wamrHashBytesA = loader.loadFunctionWamrAotHash(msgA);
-        wamrHashBytesB = loader.loadFunctionWamrAotHash(msgB);
 
 #ifndef FAASM_SGX_DISABLED_MODE
         conf.wasmVm = "sgx";
         sgxObjBytesA = loader.loadFunctionWamrAotFile(msgA);
         sgxObjBytesB = loader.loadFunctionWamrAotFile(msgB);
-        sgxHashBytesA = loader.loadFunctionWamrAotHash(msgA);
-        sgxHashBytesB = loader.loadFunctionWamrAotHash(msgB);
 #endif
         conf.wasmVm = oldWasmVm;
 
@@ -209,14 +253,6 @@ class FunctionLoaderTestFixture : public S3TestFixture
     std::vector<uint8_t> sgxObjBytesA;
     std::vector<uint8_t> sgxObjBytesB;
 #endif
-    std::vector<uint8_t> hashBytesA;
-    std::vector<uint8_t> hashBytesB;
-    std::vector<uint8_t> wamrHashBytesA;
-    std::vector<uint8_t> wamrHashBytesB;
-#ifndef FAASM_SGX_DISABLED_MODE
-    std::vector<uint8_t> sgxHashBytesA;
-    std::vector<uint8_t> sgxHashBytesB;
-#endif
 
     std::string localSharedObjFile;
     std::vector<uint8_t> sharedObjWasm;
@@ -0,0 +1,33 @@
+#include "utils.h"
+
+#include <wasm/mpi_comm.h>
+#include <wasm/mpi_requests.h>
+
+#include <thread>
+#include <vector>
+
+using namespace wasm;
+
+namespace tests {
+
+void runRanks(faabric::mpi::MpiWorld& world,
+              int worldSize,
+              const std::function<void(MpiCore&)>& rankFunc)
+{
+    std::vector<std::thread> rankThreads;
+    for (int r = 0; r < worldSize; r++) {
+        rankThreads.emplace_back([&world, &rankFunc, r] {
+            MpiCore core(world, r);
+            rankFunc(core);
+            finishMpiRequests(world);
+            clearMpiCommunicators();
+        });
+    }
+
+    for (auto& t : rankThreads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+}
+}
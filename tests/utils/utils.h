@@ -3,6 +3,9 @@
 #include <faabric/util/func.h>
 
 #include <faaslet/Faaslet.h>
+#include <wasm/mpi_core.h>
+
+#include <functional>
 
 namespace tests {
 void execFunction(std::shared_ptr<faabric::BatchExecuteRequest> req,
@@ -39,4 +42,10 @@ void checkMultipleExecutions(faabric::Message& msg, int nExecs);
 void checkCallingFunctionGivesBoolOutput(const std::string& user,
                                          const std::string& funcName,
                                          bool expected);
+
+// Runs the function on a thread per rank of the world, each with its own core.
+// Each thread then finishes its requests and clears its communicators.
+void runRanks(faabric::mpi::MpiWorld& world,
+              int worldSize,
+              const std::function<void(wasm::MpiCore&)>& rankFunc);
 }